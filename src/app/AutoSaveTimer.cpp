@@ -4,6 +4,10 @@
 #include <QDir>
 #include "settings/ini_keys.h"
 #include <QDebug>
+#ifndef Q_MOC_RUN
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#endif
 
 QAutoSaveTimer::QAutoSaveTimer(MainWindow* obj): QTimer(obj), m_MW(obj)
 {
@@ -33,6 +37,24 @@ QAutoSaveTimer::copyFileTo(const QString& sFromPath, const QString& sToPath)
     return false;
 }
 
+void
+QAutoSaveTimer::replaceProjectFile(
+    QString const& unnamed_autosave_file, QString const& project_file,
+    QString const& file_as_path, bool const saved)
+{
+    if (!saved) {
+        return;
+    }
+
+    QFile::remove(unnamed_autosave_file);
+    if (copyFileTo(project_file, project_file + ".bak")) {
+        QFile::remove(project_file);
+    }
+    if (copyFileTo(file_as_path, project_file)) {
+        QFile::remove(file_as_path);
+    }
+}
+
 const QString
 QAutoSaveTimer::getAutoSaveInputDir()
 {
@@ -50,7 +72,9 @@ QAutoSaveTimer::autoSaveProject()
 
     if (m_MW->numImages() != 0) {
         if (m_MW->projectFile().isEmpty()) {
-            m_MW->saveProjectWithFeedback(unnamed_autosave_projectFile);
+            m_MW->saveProjectInBackground(
+                unnamed_autosave_projectFile, boost::function<void(bool)>()
+            );
         } else {
             QString const project_filename = m_MW->projectFile();
             QFileInfo const project_file(project_filename);
@@ -59,16 +83,13 @@ QAutoSaveTimer::autoSaveProject()
                 project_file.fileName() + ".as"
             );
             QString const file_as_path(file_as.absoluteFilePath());
-            if (m_MW->saveProjectWithFeedback(file_as_path)) {
-                QFile::remove(unnamed_autosave_projectFile);
-                if (copyFileTo(project_filename, project_filename + ".bak")) {
-                    QFile::remove(project_filename);
-                }
-                if (copyFileTo(file_as_path, project_filename)) {
-                    QFile::remove(file_as_path);
-                }
-                //QFile::remove(project_filename+".bak");
-            }
+            m_MW->saveProjectInBackground(
+                file_as_path,
+                boost::bind(
+                    &replaceProjectFile, unnamed_autosave_projectFile,
+                    project_filename, file_as_path, _1
+                )
+            );
         }
     }
 
@@ -16,7 +16,15 @@ public:
 public slots:
     void autoSaveProject();
 private:
-    bool copyFileTo(const QString& sFromPath, const QString& sToPath);
+    static bool copyFileTo(const QString& sFromPath, const QString& sToPath);
+
+    /**
+     * Called once the autosave copy is written.  Moves it over the project
+     * file, keeping the previous one as .bak.
+     */
+    static void replaceProjectFile(
+        QString const& unnamed_autosave_file, QString const& project_file,
+        QString const& file_as_path, bool saved);
     const QString getAutoSaveInputDir();
 private:
     MainWindow* m_MW;
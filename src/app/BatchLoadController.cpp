@@ -0,0 +1,419 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "BatchLoadController.h"
+#include "WorkerThread.h"
+#include "ImageViewBase.h"
+#include "IoGate.h"
+#include "MemoryBudget.h"
+#include "DecodedImageCache.h"
+#include "ThreadPriority.h"
+#include "settings/ini_keys.h"
+#include <QCoreApplication>
+#include <QSettings>
+#include <QEvent>
+#include <QMouseEvent>
+#include <QFile>
+#include <QByteArray>
+#include <QList>
+#include <algorithm>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+namespace
+{
+
+int const SAMPLE_INTERVAL_MSEC = 1000;
+
+int const INTERACTION_LINGER_MSEC = 500;
+
+/**
+ * Memory is considered to be running low below this share
+ * of physical memory being available, in percent.
+ */
+int const LOW_MEMORY_PERCENT = 15;
+
+/**
+ * And available again above this one.
+ */
+int const ENOUGH_MEMORY_PERCENT = 30;
+
+/**
+ * The share of physical memory pages in flight may take while memory
+ * is running low.
+ */
+int const LOW_MEMORY_BUDGET_FRACTION = 4;
+
+/**
+ * Gets the time the system's CPUs spent busy and in total, in arbitrary
+ * units, since an arbitrary point in time.
+ */
+bool readCpuTimes(quint64& busy, quint64& total)
+{
+#if defined(Q_OS_LINUX)
+    QFile file("/proc/stat");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    // cpu user nice system idle iowait irq softirq steal ...
+    QList<QByteArray> const fields(file.readLine().simplified().split(' '));
+    if (fields.size() < 6 || fields[0] != "cpu") {
+        return false;
+    }
+    // Guest time is already included into user time.
+    int const num_fields = std::min(fields.size(), 9);
+    total = 0;
+    for (int i = 1; i < num_fields; ++i) {
+        total += fields[i].toULongLong();
+    }
+    busy = total - fields[4].toULongLong() - fields[5].toULongLong();
+    return true;
+#elif defined(Q_OS_WIN)
+    FILETIME idle_time, kernel_time, user_time;
+    if (!GetSystemTimes(&idle_time, &kernel_time, &user_time)) {
+        return false;
+    }
+    ULARGE_INTEGER idle, kernel, user;
+    idle.LowPart = idle_time.dwLowDateTime;
+    idle.HighPart = idle_time.dwHighDateTime;
+    kernel.LowPart = kernel_time.dwLowDateTime;
+    kernel.HighPart = kernel_time.dwHighDateTime;
+    user.LowPart = user_time.dwLowDateTime;
+    user.HighPart = user_time.dwHighDateTime;
+    // Kernel time includes idle time.
+    total = kernel.QuadPart + user.QuadPart;
+    busy = total - idle.QuadPart;
+    return true;
+#else
+    Q_UNUSED(busy);
+    Q_UNUSED(total);
+    return false;
+#endif
+}
+
+/**
+ * Gets the total and the available physical memory, in bytes.
+ */
+bool readPhysicalMemory(qint64& total, qint64& available)
+{
+#if defined(Q_OS_LINUX)
+    QFile file("/proc/meminfo");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    total = -1;
+    available = -1;
+    while (!file.atEnd() && (total < 0 || available < 0)) {
+        // MemTotal:       16303412 kB
+        QList<QByteArray> const fields(file.readLine().simplified().split(' '));
+        if (fields.size() < 2) {
+            continue;
+        }
+        if (fields[0] == "MemTotal:") {
+            total = fields[1].toLongLong() * 1024;
+        } else if (fields[0] == "MemAvailable:") {
+            available = fields[1].toLongLong() * 1024;
+        }
+    }
+    return total > 0 && available >= 0;
+#elif defined(Q_OS_WIN)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status)) {
+        return false;
+    }
+    total = qint64(status.ullTotalPhys);
+    available = qint64(status.ullAvailPhys);
+    return true;
+#else
+    Q_UNUSED(total);
+    Q_UNUSED(available);
+    return false;
+#endif
+}
+
+/**
+ * The share of CPU time batch processing aims for, in percent,
+ * at a given system load level.
+ */
+int cpuTargetFor(ThreadPriority::Priority const prio)
+{
+    switch (prio) {
+    case ThreadPriority::Idle:
+        return 25;
+    case ThreadPriority::Lowest:
+        return 50;
+    case ThreadPriority::Low:
+        return 75;
+    case ThreadPriority::Normal:
+        break;
+    }
+    return 100;
+}
+
+} // anonymous namespace
+
+BatchLoadController::State::State()
+    :   workers(1),
+        maxWorkers(1),
+        ioLimit(0),
+        memoryLimit(0),
+        cpuLoad(-1),
+        memoryPressure(false),
+        interacting(false),
+        adaptive(false),
+        batchActive(false)
+{
+}
+
+BatchLoadController::BatchLoadController(WorkerThread& workers, QObject* parent)
+    :   QObject(parent),
+        m_rWorkers(workers),
+        m_adaptiveWorkers(1),
+        m_cpuTarget(100),
+        m_baseMemoryLimit(MemoryBudget::limit()),
+        m_prevCpuBusy(0),
+        m_prevCpuTotal(0),
+        m_dragging(false)
+{
+    m_state.memoryLimit = m_baseMemoryLimit;
+
+    m_sampleTimer.setInterval(SAMPLE_INTERVAL_MSEC);
+    connect(&m_sampleTimer, SIGNAL(timeout()), SLOT(sample()));
+
+    m_interactionTimer.setSingleShot(true);
+    m_interactionTimer.setInterval(INTERACTION_LINGER_MSEC);
+    connect(&m_interactionTimer, SIGNAL(timeout()), SLOT(apply()));
+
+    QCoreApplication::instance()->installEventFilter(this);
+
+    reloadSettings();
+}
+
+BatchLoadController::~BatchLoadController()
+{
+    QCoreApplication::instance()->removeEventFilter(this);
+}
+
+void
+BatchLoadController::setBatchActive(bool const active)
+{
+    if (active == m_state.batchActive) {
+        return;
+    }
+
+    m_state.batchActive = active;
+    m_state.cpuLoad = -1;
+    m_state.memoryPressure = false;
+    m_adaptiveWorkers = m_state.maxWorkers;
+
+    if (active) {
+        // The first sample only sets the starting point.
+        readCpuTimes(m_prevCpuBusy, m_prevCpuTotal);
+        m_sampleTimer.start();
+    } else {
+        m_sampleTimer.stop();
+    }
+
+    apply();
+}
+
+void
+BatchLoadController::setAdaptive(bool const adaptive)
+{
+    QSettings().setValue(_key_batch_processing_adaptive, adaptive);
+    reloadSettings();
+}
+
+void
+BatchLoadController::reloadSettings()
+{
+    QSettings const settings;
+
+    int const max_workers = std::max(
+        1, settings.value(_key_batch_processing_threads, _key_batch_processing_threads_def).toInt()
+    );
+    if (max_workers != m_state.maxWorkers) {
+        m_state.maxWorkers = max_workers;
+        m_adaptiveWorkers = max_workers;
+    }
+
+    bool const adaptive = settings.value(
+        _key_batch_processing_adaptive, _key_batch_processing_adaptive_def
+    ).toBool();
+    if (adaptive != m_state.adaptive) {
+        m_state.adaptive = adaptive;
+        m_adaptiveWorkers = max_workers;
+        m_state.memoryPressure = false;
+    }
+
+    m_cpuTarget = cpuTargetFor(
+        ThreadPriority::load(_key_batch_processing_priority).value()
+    );
+
+    apply();
+}
+
+bool
+BatchLoadController::eventFilter(QObject* obj, QEvent* event)
+{
+    switch (event->type()) {
+    case QEvent::MouseButtonPress:
+        if (!m_dragging && isInImageView(obj)) {
+            m_dragging = true;
+            apply();
+        }
+        break;
+    case QEvent::MouseButtonRelease:
+        if (m_dragging && static_cast<QMouseEvent*>(event)->buttons() == Qt::NoButton) {
+            m_dragging = false;
+            m_interactionTimer.start();
+        }
+        break;
+    case QEvent::Wheel:
+        if (isInImageView(obj)) {
+            m_interactionTimer.start();
+            apply();
+        }
+        break;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+void
+BatchLoadController::sample()
+{
+    sampleCpu();
+    sampleMemory();
+    apply();
+}
+
+void
+BatchLoadController::sampleCpu()
+{
+    quint64 busy = 0;
+    quint64 total = 0;
+    if (!readCpuTimes(busy, total) || total <= m_prevCpuTotal) {
+        m_state.cpuLoad = -1;
+        return;
+    }
+
+    m_state.cpuLoad = int(100 * (busy - m_prevCpuBusy) / (total - m_prevCpuTotal));
+    m_prevCpuBusy = busy;
+    m_prevCpuTotal = total;
+
+    if (!adaptiveBatch() || m_state.interacting) {
+        // Workers are held back anyway, so the load says little
+        // about how many of them the system could take.
+        return;
+    }
+
+    // Some of the time goes to the rest of the system,
+    // so full saturation is never asked for.
+    int const high = std::min(m_cpuTarget + 5, 95);
+    int const low = high - 20;
+    if (m_state.cpuLoad > high && m_adaptiveWorkers > 1) {
+        --m_adaptiveWorkers;
+    } else if (m_state.cpuLoad < low && m_adaptiveWorkers < m_state.maxWorkers) {
+        ++m_adaptiveWorkers;
+    }
+}
+
+void
+BatchLoadController::sampleMemory()
+{
+    qint64 total = 0;
+    qint64 available = 0;
+    if (!adaptiveBatch() || !readPhysicalMemory(total, available)) {
+        m_state.memoryPressure = false;
+        return;
+    }
+
+    int const available_percent = int(100 * available / total);
+    if (!m_state.memoryPressure && available_percent < LOW_MEMORY_PERCENT) {
+        m_state.memoryPressure = true;
+        // Cached images are the first thing to give back.
+        DecodedImageCache::clear();
+    } else if (m_state.memoryPressure && available_percent > ENOUGH_MEMORY_PERCENT) {
+        m_state.memoryPressure = false;
+    }
+
+    if (m_state.memoryPressure) {
+        qint64 const cap = total / LOW_MEMORY_BUDGET_FRACTION;
+        m_state.memoryLimit = m_baseMemoryLimit > 0 ? std::min(m_baseMemoryLimit, cap) : cap;
+    }
+}
+
+void
+BatchLoadController::apply()
+{
+    State const old_state(m_state);
+
+    bool const adaptive_batch = adaptiveBatch();
+    m_state.interacting = adaptive_batch && (m_dragging || m_interactionTimer.isActive());
+
+    if (!adaptive_batch) {
+        m_state.workers = m_state.maxWorkers;
+        m_state.ioLimit = 0;
+    } else if (m_state.interacting) {
+        m_state.workers = 1;
+        m_state.ioLimit = 1;
+    } else {
+        m_state.workers = m_adaptiveWorkers;
+        m_state.ioLimit = std::max(1, (m_state.workers + 1) / 2);
+    }
+
+    if (!m_state.memoryPressure) {
+        m_state.memoryLimit = m_baseMemoryLimit;
+    }
+
+    m_rWorkers.setNumThreads(m_state.workers);
+    if (m_state.ioLimit != old_state.ioLimit) {
+        IoGate::setLimit(m_state.ioLimit);
+    }
+    // Reads nobody is waiting for yet get a single slot at most.
+    int const speculative_limit = adaptive_batch ? 1 : 0;
+    if (IoGate::classLimit(IoGate::READ_AHEAD) != speculative_limit) {
+        IoGate::setClassLimit(IoGate::READ_AHEAD, speculative_limit);
+        IoGate::setClassLimit(IoGate::BACKGROUND, speculative_limit);
+    }
+    if (m_state.memoryLimit != old_state.memoryLimit) {
+        MemoryBudget::setLimit(m_state.memoryLimit);
+    }
+
+    // Samples are reported even if nothing else changed.
+    emit stateChanged();
+}
+
+bool
+BatchLoadController::isInImageView(QObject* obj)
+{
+    // Mouse events go to the viewport of an ImageViewBase.
+    for (; obj; obj = obj->parent()) {
+        if (qobject_cast<ImageViewBase*>(obj)) {
+            return true;
+        }
+    }
+    return false;
+}
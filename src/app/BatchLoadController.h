@@ -0,0 +1,158 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BATCH_LOAD_CONTROLLER_H_
+#define BATCH_LOAD_CONTROLLER_H_
+
+#include "NonCopyable.h"
+#include <QObject>
+#include <QTimer>
+#include <QtGlobal>
+
+class WorkerThread;
+class QEvent;
+
+/**
+ * \brief Decides how many resources background processing may use.
+ *
+ * Sets the number of threads of a WorkerThread, the IoGate limit and
+ * the MemoryBudget limit.  The number of workers configured in the
+ * settings is the ceiling.  In adaptive mode, while batch processing:
+ * \li The CPU load of the whole system is sampled once a second.
+ *     Workers are taken away while it's above the share the system load
+ *     slider asks for, and given back while it's well below it.
+ * \li Reading files is limited to half as many workers.  Decoding pages
+ *     ahead and loading thumbnails that aren't on screen are limited
+ *     to one file at a time.
+ * \li When physical memory runs low, the memory budget is capped
+ *     at a quarter of it, and lifted once memory is available again.
+ *     A limit given on the command line is never exceeded.
+ * \li While the user drags or zooms in an image view, a single worker
+ *     is left to run, so that the view stays responsive.
+ *
+ * Tasks that are already running are not interrupted.  stateChanged()
+ * is emitted whenever the state is re-evaluated, which is the owner's cue
+ * to feed the workers, should there be more of them.
+ */
+class BatchLoadController : public QObject
+{
+    Q_OBJECT
+    DECLARE_NON_COPYABLE(BatchLoadController)
+public:
+    struct State
+    {
+        int workers;
+        int maxWorkers;
+
+        /**
+         * Zero means unlimited.
+         */
+        int ioLimit;
+
+        /**
+         * In bytes.  Zero means unlimited.
+         */
+        qint64 memoryLimit;
+
+        /**
+         * System-wide, in percent, or -1 if not measured.
+         */
+        int cpuLoad;
+
+        bool memoryPressure;
+
+        bool interacting;
+
+        bool adaptive;
+
+        bool batchActive;
+
+        State();
+    };
+
+    BatchLoadController(WorkerThread& workers, QObject* parent = 0);
+
+    virtual ~BatchLoadController();
+
+    void setBatchActive(bool active);
+
+    void setAdaptive(bool adaptive);
+
+    /**
+     * \brief Re-reads the number of workers and the system load level
+     *        from the settings.
+     */
+    void reloadSettings();
+
+    State const& state() const
+    {
+        return m_state;
+    }
+signals:
+    void stateChanged();
+protected:
+    virtual bool eventFilter(QObject* obj, QEvent* event);
+private slots:
+    void sample();
+
+    void apply();
+private:
+    bool adaptiveBatch() const
+    {
+        return m_state.adaptive && m_state.batchActive;
+    }
+
+    void sampleCpu();
+
+    void sampleMemory();
+
+    static bool isInImageView(QObject* obj);
+
+    WorkerThread& m_rWorkers;
+    QTimer m_sampleTimer;
+
+    /**
+     * Keeps the workers throttled for a moment after an interaction,
+     * so that they don't start new pages between mouse strokes.
+     */
+    QTimer m_interactionTimer;
+
+    State m_state;
+
+    /**
+     * The worker count the CPU samples settled on.
+     */
+    int m_adaptiveWorkers;
+
+    /**
+     * The share of CPU time batch processing aims for, in percent.
+     */
+    int m_cpuTarget;
+
+    /**
+     * The memory limit given on the command line, or zero.
+     */
+    qint64 m_baseMemoryLimit;
+
+    quint64 m_prevCpuBusy;
+    quint64 m_prevCpuTotal;
+    bool m_dragging;
+};
+
+#endif
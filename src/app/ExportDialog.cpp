@@ -60,11 +60,16 @@ ExportDialog::ExportDialog(QWidget* parent, const QString& defaultOutDir)
     connect(ui.GenerateBlankBackSubscans, SIGNAL(toggled(bool)), this, SLOT(OnCheckGenerateBlankBackSubscans(bool)));
     connect(ui.UseSepSuffixForPics, SIGNAL(toggled(bool)), this, SLOT(OnCheckUseSepSuffixForPics(bool)));
     connect(ui.KeepOriginalColorIllumForeSubscans, SIGNAL(toggled(bool)), this, SLOT(OnCheckKeepOriginalColorIllumForeSubscans(bool)));
+    connect(ui.GenerateOutput, SIGNAL(toggled(bool)), this, SLOT(OnCheckGenerateOutput(bool)));
 
     ui.GenerateBlankBackSubscans->setChecked(m_settings.value(_key_export_generate_blank_subscans, _key_export_generate_blank_subscans_def).toBool());
     ui.UseSepSuffixForPics->setChecked(m_settings.value(_key_export_use_sep_suffix, _key_export_use_sep_suffix_def).toBool());
     ui.KeepOriginalColorIllumForeSubscans->setChecked(m_settings.value(_key_export_keep_original_color, _key_export_keep_original_color_def).toBool());
+    ui.GenerateOutput->setChecked(m_settings.value(_key_export_generate_output, _key_export_generate_output_def).toBool());
     ui.cbMultipageOutput->setChecked(m_settings.value(_key_export_to_multipage, _key_export_to_multipage_def).toBool());
+    ui.cbMrcPdfOutput->setChecked(m_settings.value(_key_export_to_mrc_pdf, _key_export_to_mrc_pdf_def).toBool());
+    ui.cbMrcPdfJbig2->setChecked(m_settings.value(_key_export_mrc_pdf_jbig2, _key_export_mrc_pdf_jbig2_def).toBool());
+    ui.cbMrcPdfJbig2->setEnabled(ui.cbMrcPdfOutput->isChecked());
 }
 
 ExportDialog::~ExportDialog()
@@ -248,7 +253,7 @@ ExportDialog::startExport(void)
         mode |= ExportMode::Zones;
     }
 
-    if (mode == ExportMode::None) {
+    if (mode == ExportMode::None && !ui.cbMrcPdfOutput->isChecked()) {
         QMessageBox::warning(this,  tr("Error"), tr("Nothing to export. Please select some data to export."));
         reset();
         return;
@@ -259,6 +264,8 @@ ExportDialog::startExport(void)
     settings.default_out_dir = ui.DefaultOutputFolder->isChecked();
     settings.export_dir_path = ui.outExportDirLine->text();
     settings.export_to_multipage = ui.cbMultipageOutput->isChecked();
+    settings.export_to_mrc_pdf = ui.cbMrcPdfOutput->isChecked();
+    settings.mrc_pdf_jbig2 = ui.cbMrcPdfJbig2->isChecked();
     settings.generate_blank_back_subscans = ui.GenerateBlankBackSubscans->isChecked();
     settings.use_sep_suffix_for_pics = ui.UseSepSuffixForPics->isChecked();
     settings.page_gen_tweaks = PageGenTweak::NoTweaks;
@@ -275,9 +282,16 @@ ExportDialog::startExport(void)
     } else {
         settings.page_gen_tweaks &= !PageGenTweak::IgnoreOutputProcessingStage;
     }
+
+    if (ui.GenerateOutput->isChecked()) {
+        settings.page_gen_tweaks |= PageGenTweak::GenerateOutput;
+    } else {
+        settings.page_gen_tweaks &= !PageGenTweak::GenerateOutput;
+    }
 #else
     settings.page_gen_tweaks.setFlag(PageGenTweak::KeepOriginalColorIllumForeSubscans, ui.KeepOriginalColorIllumForeSubscans->isChecked());
     settings.page_gen_tweaks.setFlag(PageGenTweak::IgnoreOutputProcessingStage, mode.testFlag(ExportMode::ImageWithoutOutputStage));
+    settings.page_gen_tweaks.setFlag(PageGenTweak::GenerateOutput, ui.GenerateOutput->isChecked());
 #endif
     settings.export_selected_pages_only = ui.cbExportSelected->isChecked();
 
@@ -330,6 +344,12 @@ ExportDialog::OnCheckKeepOriginalColorIllumForeSubscans(bool state)
     m_settings.setValue(_key_export_keep_original_color, state);
 }
 
+void
+ExportDialog::OnCheckGenerateOutput(bool state)
+{
+    m_settings.setValue(_key_export_generate_output, state);
+}
+
 void
 ExportDialog::saveExportMode(ExportMode val, bool on)
 {
@@ -372,6 +392,17 @@ void ExportDialog::on_cbMultipageOutput_toggled(bool checked)
     m_settings.setValue(_key_export_to_multipage, checked);
 }
 
+void ExportDialog::on_cbMrcPdfOutput_toggled(bool checked)
+{
+    m_settings.setValue(_key_export_to_mrc_pdf, checked);
+    ui.cbMrcPdfJbig2->setEnabled(checked);
+}
+
+void ExportDialog::on_cbMrcPdfJbig2_toggled(bool checked)
+{
+    m_settings.setValue(_key_export_mrc_pdf_jbig2, checked);
+}
+
 void ExportDialog::on_cbExportImage_stateChanged(int arg1)
 {
     saveExportMode(ExportMode::WholeImage, arg1);
@@ -394,6 +425,9 @@ void ExportDialog::on_btnResetToDefault_clicked()
     ui.UseSepSuffixForPics->setChecked(_key_export_use_sep_suffix_def);
     ui.KeepOriginalColorIllumForeSubscans->setChecked(_key_export_keep_original_color_def);
     ui.cbMultipageOutput->setChecked(_key_export_to_multipage_def);
+    ui.cbMrcPdfOutput->setChecked(_key_export_to_mrc_pdf_def);
+    ui.cbMrcPdfJbig2->setChecked(_key_export_mrc_pdf_jbig2_def);
+    ui.GenerateOutput->setChecked(_key_export_generate_output_def);
 }
 
 }
@@ -65,6 +65,7 @@ private Q_SLOTS:
     void OnCheckGenerateBlankBackSubscans(bool);
     void OnCheckUseSepSuffixForPics(bool);
     void OnCheckKeepOriginalColorIllumForeSubscans(bool);
+    void OnCheckGenerateOutput(bool);
 
     void on_cbExportZones_stateChanged(int arg1);
 
@@ -76,6 +77,10 @@ private Q_SLOTS:
 
     void on_cbMultipageOutput_toggled(bool checked);
 
+    void on_cbMrcPdfOutput_toggled(bool checked);
+
+    void on_cbMrcPdfJbig2_toggled(bool checked);
+
     void on_cbExportImage_stateChanged(int arg1);
 
     void on_cbExportAutomask_stateChanged(int arg1);
@@ -33,6 +33,7 @@
 #include "OutputFileNameGenerator.h"
 #include "ImageInfo.h"
 #include "PageInfo.h"
+#include "PageSet.h"
 #include "ImageId.h"
 #include "Utils.h"
 #include "FilterOptionsWidget.h"
@@ -43,8 +44,10 @@
 #include "TabbedDebugImages.h"
 #include "BasicImageView.h"
 #include "ProjectWriter.h"
+#include "BackgroundExecutor.h"
 #include "ProjectReader.h"
 #include "ThumbnailPixmapCache.h"
+#include "IntermediateCache.h"
 #include "ThumbnailFactory.h"
 #include "ContentBoxPropagator.h"
 #include "PageOrientationPropagator.h"
@@ -52,8 +55,10 @@
 #include "ProjectOpeningContext.h"
 #include "SkinnedButton.h"
 #include "SystemLoadWidget.h"
+#include "BatchLoadController.h"
 #include "ProcessingIndicationWidget.h"
 #include "ImageMetadataLoader.h"
+#include "ImageMetadataScanner.h"
 #include "SmartFilenameOrdering.h"
 #include "OrthogonalRotation.h"
 #include "FixDpiDialog.h"
@@ -61,6 +66,8 @@
 #include "SettingsDialog.h"
 #include "AbstractRelinker.h"
 #include "RelinkingDialog.h"
+#include "ProfilingDialog.h"
+#include "PageTimings.h"
 #include "OutOfMemoryHandler.h"
 #include "OutOfMemoryDialog.h"
 #include "QtSignalForwarder.h"
@@ -84,6 +91,7 @@
 #include "filters/output/Task.h"
 #include "filters/output/CacheDrivenTask.h"
 #include "LoadFileTask.h"
+#include "ReprocessTaskFactory.h"
 #include "CompositeCacheDrivenTask.h"
 #include "ScopedIncDec.h"
 #include "ui_AboutDialog.h"
@@ -131,7 +139,13 @@
 #include <Qt>
 #include <QDebug>
 #include <QDate>
+#ifndef Q_MOC_RUN
+#include <boost/bind.hpp>
+#endif
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <utility>
 #include <vector>
 #include <stddef.h>
 #include <math.h>
@@ -143,8 +157,10 @@ MainWindow::MainWindow()
     :   m_ptrPages(new ProjectPages),
         m_ptrStages(new StageSequence(m_ptrPages, newPageSelectionAccessor())),
         m_ptrWorkerThread(new WorkerThread),
+        m_ptrLoadController(new BatchLoadController(*m_ptrWorkerThread)),
         m_ptrInteractiveQueue(new ProcessingTaskQueue(ProcessingTaskQueue::RANDOM_ORDER)),
         m_ptrOutOfMemoryDialog(new OutOfMemoryDialog),
+        m_projectSaveGeneration(0),
         m_curFilter(0),
         m_ignoreSelectionChanges(0),
         m_ignorePageOrderingChanges(0),
@@ -160,6 +176,14 @@ MainWindow::MainWindow()
     setupUi(this);
     setupStatusBar();
 
+    m_allThumbnailsInvalidator.setSingleShot(true);
+    m_allThumbnailsInvalidator.setInterval(1000);
+    connect(&m_allThumbnailsInvalidator, SIGNAL(timeout()), SLOT(invalidateAllThumbnailsNow()));
+
+    m_batchResultsApplier.setSingleShot(true);
+    m_batchResultsApplier.setInterval(33);
+    connect(&m_batchResultsApplier, SIGNAL(timeout()), SLOT(applyBatchResults()));
+
     sortOptionsWgt->setVisible(false);
     connect(sortOptions, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
     this, [this](int index) {
@@ -265,6 +289,17 @@ MainWindow::MainWindow()
         SIGNAL(taskResult(BackgroundTaskPtr,FilterResultPtr)),
         this, SLOT(filterResult(BackgroundTaskPtr,FilterResultPtr))
     );
+    connect(
+        m_ptrWorkerThread.get(),
+        SIGNAL(taskPreview(BackgroundTaskPtr,FilterResultPtr)),
+        this, SLOT(filterPreview(BackgroundTaskPtr,FilterResultPtr))
+    );
+    // Queued, as the controller may be re-evaluated in the middle
+    // of starting or stopping batch processing.
+    connect(
+        m_ptrLoadController.get(), SIGNAL(stateChanged()),
+        this, SLOT(batchLoadChanged()), Qt::QueuedConnection
+    );
 
     connect(
         m_ptrThumbSequence.get(),
@@ -302,6 +337,8 @@ MainWindow::MainWindow()
     connect(actionFixDpi, SIGNAL(triggered(bool)), SLOT(fixDpiDialogRequested()));
     connect(actionRelinking, SIGNAL(triggered(bool)), SLOT(showRelinkingDialog()));
     connect(actionSettings, SIGNAL(triggered(bool)), SLOT(openSettingsDialog()));
+    connect(actionProfiling, SIGNAL(triggered(bool)), SLOT(openProfilingDialog()));
+    connect(actionSlowestPages, SIGNAL(triggered(bool)), SLOT(exportSlowestPages()));
 //begin of modified by monday2000
 //Export_Subscans
 //added:
@@ -358,6 +395,7 @@ MainWindow::~MainWindow()
     settings.setValue(_key_app_state, saveState());
 
     m_ptrInteractiveQueue->cancelAndClear();
+    discardPrefetchedResults();
     if (m_ptrBatchQueue.get()) {
         m_ptrBatchQueue->cancelAndClear();
     }
@@ -390,9 +428,15 @@ MainWindow::settingsChanged()
 
     setDockingPanels(settings.value(_key_app_docking_enabled, _key_app_docking_enabled_def).toBool());
 
-    QString default_lang = QLocale::system().name().toLower();
-    default_lang.truncate(default_lang.lastIndexOf('_'));
-    changeLanguage(settings.value(_key_app_language, default_lang).toString());
+    CommandLine const& cli = CommandLine::get();
+    if (cli.hasLanguage() && m_current_lang.isEmpty()) {
+        // Loading the stored language first would only be undone right away.
+        changeLanguage(cli.getLanguage(), true);
+    } else {
+        QString default_lang = QLocale::system().name().toLower();
+        default_lang.truncate(default_lang.lastIndexOf('_'));
+        changeLanguage(settings.value(_key_app_language, default_lang).toString());
+    }
 
     m_debug = settings.value(_key_debug_enabled, _key_debug_enabled_def).toBool();
 
@@ -443,6 +487,8 @@ MainWindow::switchToNewProject(
 {
     stopBatchProcessing(CLEAR_MAIN_AREA);
     m_ptrInteractiveQueue->cancelAndClear();
+    discardPrefetchedResults();
+    PageTimings::reset();
 
     Utils::maybeCreateCacheDir(out_dir);
 
@@ -513,8 +559,10 @@ MainWindow::switchToNewProject(
     // so recreate the thumbnail cache.
     if (out_dir.isEmpty()) {
         m_ptrThumbnailCache.reset();
+        IntermediateCache::setCacheDir(QString());
     } else {
         m_ptrThumbnailCache = Utils::createThumbnailCache(m_outFileNameGen.outDir());
+        IntermediateCache::setCacheDir(Utils::outputDirToIntermediateDir(m_outFileNameGen.outDir()));
     }
 
     resetThumbSequence(currentPageOrderProvider());
@@ -605,6 +653,7 @@ MainWindow::createBatchProcessingWidget()
         Ui::BatchProcessingLowerPanel ui;
     };
     LowerPanel* lower_panel = new LowerPanel(m_ptrBatchProcessingWidget.get());
+    lower_panel->ui.systemLoadWidget->setController(m_ptrLoadController.get());
     m_checkBeepWhenFinished = [lower_panel]() {
         return lower_panel->ui.beepWhenFinished->isChecked();
     };
@@ -897,40 +946,44 @@ void
 MainWindow::ensurePageVisible(const std::set<PageId>& _selectedPages, PageId selectionLeader, ThumbnailSequence::SelectionAction const action)
 {
 
-    QVector<PageId> to_be_selected;
-    for (const PageId& page : _selectedPages) {
-        to_be_selected.append(page);
+    std::set<PageId> to_be_selected(_selectedPages);
+    if (!selectionLeader.isNull()) {
+        to_be_selected.insert(selectionLeader);
     }
 
-    if (!selectionLeader.isNull() &&
-            !to_be_selected.contains(selectionLeader)) {
-        to_be_selected.append(selectionLeader);
-    }
+    // Pages are looked up by their index in the displayed sequence,
+    // rather than compared with every displayed page.
+    std::shared_ptr<PageSequence const> const displayed_pages(
+        std::make_shared<PageSequence>(m_ptrThumbSequence->toPageSequenceById())
+    );
+    PageSet selected(displayed_pages);
 
-    std::sort(to_be_selected.begin(), to_be_selected.end());
+    for (const PageId& page : to_be_selected) {
+        if (selected.insert(page)) {
+            continue;
+        }
 
-    QSet<PageId> maybe_selected;
-    PageSequence const displayed_pages = m_ptrThumbSequence->toPageSequenceById();
-
-    for (const PageId& page : qAsConst(to_be_selected)) {
-        for (const PageInfo& displ_page : displayed_pages) {
-            if (displ_page.id().imageId() == page.imageId()) {
-                if (page.subPage() == displ_page.id().subPage()) {
-                    maybe_selected += page;
-                } else if ((displ_page.id().subPage() == PageId::SINGLE_PAGE) !=
-                           (page.subPage() == PageId::SINGLE_PAGE)) {   // different levels
-                    maybe_selected += displ_page.id();
-                    if (selectionLeader.imageId() == page.imageId()) {
-                        selectionLeader = displ_page.id();
-                    }
-                }
-            }
-            if (page.imageId() < displ_page.id().imageId()) {
-                break;
+        // The page may be displayed at a different level, split or not.
+        std::vector<PageId::SubPage> other_levels;
+        if (page.subPage() == PageId::SINGLE_PAGE) {
+            other_levels.push_back(PageId::LEFT_PAGE);
+            other_levels.push_back(PageId::RIGHT_PAGE);
+        } else {
+            other_levels.push_back(PageId::SINGLE_PAGE);
+        }
+        for (PageId::SubPage const sub_page : other_levels) {
+            PageId const displ_page(page.imageId(), sub_page);
+            if (selected.insert(displ_page) && selectionLeader.imageId() == page.imageId()) {
+                selectionLeader = displ_page;
             }
         }
     }
 
+    QSet<PageId> maybe_selected;
+    for (PageId const& page : selected) {
+        maybe_selected += page;
+    }
+
     m_ptrThumbSequence->setSelection(maybe_selected, action);
     m_ptrThumbSequence->setSelection(selectionLeader, ThumbnailSequence::KEEP_SELECTION);
 
@@ -975,6 +1028,10 @@ MainWindow::setOptionsWidget(FilterOptionsWidget* widget, Ownership const owners
             m_ptrOptionsWidget, SIGNAL(invalidateThumbnail(PageInfo)),
             this, SLOT(invalidateThumbnail(PageInfo))
         );
+        disconnect(
+            m_ptrOptionsWidget, SIGNAL(invalidateThumbnails(std::set<PageId>)),
+            this, SLOT(invalidateThumbnails(std::set<PageId>))
+        );
         disconnect(
             m_ptrOptionsWidget, SIGNAL(invalidateAllThumbnails()),
             this, SLOT(invalidateAllThumbnails())
@@ -1004,6 +1061,10 @@ MainWindow::setOptionsWidget(FilterOptionsWidget* widget, Ownership const owners
         widget, SIGNAL(invalidateThumbnail(PageInfo)),
         this, SLOT(invalidateThumbnail(PageInfo))
     );
+    connect(
+        widget, SIGNAL(invalidateThumbnails(std::set<PageId>)),
+        this, SLOT(invalidateThumbnails(std::set<PageId>))
+    );
     connect(
         widget, SIGNAL(invalidateAllThumbnails()),
         this, SLOT(invalidateAllThumbnails())
@@ -1037,9 +1098,11 @@ MainWindow::setImageWidget(
     } else {
         m_ptrTabbedDebugImages->addTab(widget, "Main");
         AutoRemovingFile file;
+        DebugImages::ImageGenerator generator;
         QString label;
-        while (!(file = debug_images->retrieveNext(&label)).get().isNull()) {
-            QWidget* widget = new DebugImageView(file);
+        while (debug_images->retrieveNext(&file, &generator, &label)) {
+            QWidget* widget = generator.empty()
+                              ? new DebugImageView(file) : new DebugImageView(generator);
             m_imageWidgetCleanup.add(widget);
             m_ptrTabbedDebugImages->addTab(widget, label);
         }
@@ -1061,21 +1124,85 @@ MainWindow::removeImageWidget()
 void
 MainWindow::invalidateThumbnail(PageId const& page_id)
 {
+    discardPrefetchedResults(page_id);
+
+    if (isBatchProcessingInProgress()) {
+        // Pages finishing in parallel would otherwise have the list
+        // relaid out for each of them.
+        m_pendingThumbnailInvalidations.insert(page_id);
+        if (!m_batchResultsApplier.isActive()) {
+            m_batchResultsApplier.start();
+        }
+        return;
+    }
+
     m_ptrThumbSequence->invalidateThumbnail(page_id);
 }
 
 void
 MainWindow::invalidateThumbnail(PageInfo const& page_info)
 {
+    discardPrefetchedResults(page_info.id());
     m_ptrThumbSequence->invalidateThumbnail(page_info);
 }
 
+void
+MainWindow::invalidateThumbnails(std::set<PageId> const& page_ids)
+{
+    for (PageId const& page_id : page_ids) {
+        discardPrefetchedResults(page_id);
+    }
+    m_ptrThumbSequence->invalidateThumbnails(page_ids);
+}
+
 void
 MainWindow::invalidateAllThumbnails()
 {
+    discardPrefetchedResults();
+
+    if (isBatchProcessingInProgress()) {
+        // Pages growing the aggregate size in page_layout ask for this
+        // one after another.  Rebuilding every thumbnail for each of them
+        // makes batch processing quadratic in the number of pages, so
+        // rebuild at most once a second.  stopBatchProcessing() rebuilds
+        // them anyway.
+        if (!m_allThumbnailsInvalidator.isActive()) {
+            m_allThumbnailsInvalidator.start();
+        }
+        return;
+    }
+
+    invalidateAllThumbnailsNow();
+}
+
+void
+MainWindow::invalidateAllThumbnailsNow()
+{
+    m_allThumbnailsInvalidator.stop();
+    m_pendingThumbnailInvalidations.clear();
     m_ptrThumbSequence->invalidateAllThumbnails();
 }
 
+void
+MainWindow::applyBatchResults()
+{
+    m_batchResultsApplier.stop();
+
+    if (!isBatchProcessingInProgress()) {
+        m_pendingThumbnailInvalidations.clear();
+        return;
+    }
+
+    std::set<PageId> page_ids;
+    page_ids.swap(m_pendingThumbnailInvalidations);
+    m_ptrThumbSequence->invalidateThumbnails(page_ids);
+
+    PageInfo const page(m_ptrBatchQueue->selectedPage());
+    if (!page.isNull()) {
+        m_ptrThumbSequence->setSelection(page.id());
+    }
+}
+
 IntrusivePtr<AbstractCommand0<void> >
 MainWindow::relinkingDialogRequester()
 {
@@ -1134,6 +1261,7 @@ MainWindow::performRelinking(IntrusivePtr<AbstractRelinker> const& relinker)
     Utils::maybeCreateCacheDir(m_outFileNameGen.outDir());
 
     m_ptrThumbnailCache->setThumbDir(Utils::outputDirToThumbDir(m_outFileNameGen.outDir()));
+    IntermediateCache::setCacheDir(Utils::outputDirToIntermediateDir(m_outFileNameGen.outDir()));
     resetThumbSequence(currentPageOrderProvider());
     m_selectedPage.set(m_ptrThumbSequence->selectionLeader().id(), getCurrentView());
 
@@ -1459,6 +1587,7 @@ MainWindow::filterSelectionChanged(QItemSelection const& selected)
     }
 
     m_ptrInteractiveQueue->cancelAndClear();
+    discardPrefetchedResults();
     if (m_ptrBatchQueue.get()) {
         // Should not happen, but just in case.
         m_ptrBatchQueue->cancelAndClear();
@@ -1570,6 +1699,7 @@ MainWindow::startBatchProcessing()
     }
 
     m_ptrInteractiveQueue->cancelAndClear();
+    discardPrefetchedResults();
 
     QSettings settings;
 
@@ -1595,6 +1725,7 @@ MainWindow::startBatchProcessing()
             : ProcessingTaskQueue::SEQUENTIAL_ORDER
         )
     );
+    m_ptrBatchQueue->setMemoryBudgeted(true);
 
     PageInfo start_page = processAll ? m_ptrThumbSequence->firstPage() : m_ptrThumbSequence->selectionLeader();
     PageInfo page = start_page;
@@ -1612,11 +1743,10 @@ MainWindow::startBatchProcessing()
     filterList->setBatchProcessingInProgress(true);
     filterList->setEnabled(false);
 
-    BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
-    if (task) {
-        m_ptrWorkerThread->performTask(task);
-    } else {
+    m_ptrLoadController->setBatchActive(true);
+    if (!feedBatchWorkers()) {
         stopBatchProcessing();
+        return;
     }
 
     page = m_ptrBatchQueue->selectedPage();
@@ -1642,6 +1772,7 @@ MainWindow::stopBatchProcessing(MainAreaAction main_area)
 
     m_ptrBatchQueue->cancelAndClear();
     m_ptrBatchQueue.reset();
+    m_ptrLoadController->setBatchActive(false);
 
     filterList->setBatchProcessingInProgress(false);
     filterList->setEnabled(true);
@@ -1656,12 +1787,62 @@ MainWindow::stopBatchProcessing(MainAreaAction main_area)
     }
 
     m_ptrStages->filterAt(m_curFilter)->updateStatistics();
+    m_allThumbnailsInvalidator.stop();
+    m_batchResultsApplier.stop();
+    m_pendingThumbnailInvalidations.clear();
     resetThumbSequence(currentPageOrderProvider());
 }
 
+void
+MainWindow::batchLoadChanged()
+{
+    if (isBatchProcessingInProgress()) {
+        feedBatchWorkers();
+    } else {
+        feedInteractiveWorkers();
+    }
+}
+
+bool
+MainWindow::feedBatchWorkers()
+{
+    bool fed = false;
+    while (m_ptrBatchQueue->numBeingProcessed() < m_ptrWorkerThread->numThreads()) {
+        BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
+        if (!task) {
+            break;
+        }
+        m_ptrWorkerThread->performTask(task);
+        fed = true;
+    }
+    return fed;
+}
+
+void
+MainWindow::filterPreview(BackgroundTaskPtr const& task, FilterResultPtr const& preview)
+{
+    if (task->isCancelled() || isBatchProcessingInProgress()) {
+        return;
+    }
+
+    // Previews are only worth showing for the page the user is looking at,
+    // not for prefetches.  The final result replaces them in filterResult().
+    PageInfo const page(m_ptrInteractiveQueue->pageFor(task));
+    if (page.isNull() || page.id() != m_ptrInteractiveQueue->focusPage()) {
+        return;
+    }
+    if (preview->filter() != m_ptrStages->filterAt(m_curFilter)) {
+        return;
+    }
+
+    preview->updateUI(this);
+}
+
 void
 MainWindow::filterResult(BackgroundTaskPtr const& task, FilterResultPtr const& result)
 {
+    PageInfo const interactive_page(m_ptrInteractiveQueue->pageFor(task));
+
     // Cancelled or not, we must mark it as finished.
     m_ptrInteractiveQueue->processingFinished(task);
     if (m_ptrBatchQueue.get()) {
@@ -1675,6 +1856,19 @@ MainWindow::filterResult(BackgroundTaskPtr const& task, FilterResultPtr const& r
     }
 
     if (!isBatchProcessingInProgress()) {
+        if (!interactive_page.isNull() && interactive_page.id() != m_ptrInteractiveQueue->focusPage()) {
+            // Either a prefetch, or a page the user has navigated away from.
+            // The task has already stored its results in filter settings,
+            // so all that's left to do is to refresh its thumbnail.
+            // The result itself is kept in case the user goes there next.
+            invalidateThumbnail(interactive_page.id());
+            if (result->filter() == m_ptrStages->filterAt(m_curFilter)) {
+                storePrefetchedResult(interactive_page.id(), result);
+            }
+            feedInteractiveWorkers();
+            return;
+        }
+
         if (!result->filter()) {
             // Error loading file.  No special action is necessary.
         } else if (result->filter() != m_ptrStages->filterAt(m_curFilter)) {
@@ -1692,7 +1886,11 @@ MainWindow::filterResult(BackgroundTaskPtr const& task, FilterResultPtr const& r
     // for instance because thumbnail invalidation is done from here.
     result->updateUI(this);
 
-    if (isBatchProcessingInProgress()) {
+    if (!isBatchProcessingInProgress()) {
+        // The page the user is looking at is done,
+        // so idle workers may prefetch its neighbours.
+        feedInteractiveWorkers();
+    } else {
         if (m_ptrBatchQueue->allProcessed()) {
             stopBatchProcessing();
 
@@ -1720,14 +1918,11 @@ MainWindow::filterResult(BackgroundTaskPtr const& task, FilterResultPtr const& r
             return;
         }
 
-        BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
-        if (task) {
-            m_ptrWorkerThread->performTask(task);
-        }
+        feedBatchWorkers();
 
-        PageInfo const page(m_ptrBatchQueue->selectedPage());
-        if (!page.isNull()) {
-            m_ptrThumbSequence->setSelection(page.id());
+        // The selection follows the batch queue once per applyBatchResults().
+        if (!m_batchResultsApplier.isActive()) {
+            m_batchResultsApplier.start();
         }
     }
 }
@@ -1912,8 +2107,11 @@ MainWindow::openProject(QString const& project_file)
         return;
     }
 
-    QDomDocument doc;
-    if (!doc.setContent(&file)) {
+    ProjectOpeningContext* context = new ProjectOpeningContext(this, project_file, file);
+    file.close();
+
+    if (!context->projectReader()->isWellFormed()) {
+        delete context;
         QMessageBox::warning(
             this, tr("Error"),
             tr("The project file is broken.")
@@ -1922,9 +2120,6 @@ MainWindow::openProject(QString const& project_file)
         return;
     }
 
-    file.close();
-
-    ProjectOpeningContext* context = new ProjectOpeningContext(this, project_file, doc);
     connect(context, SIGNAL(done(ProjectOpeningContext*)), SLOT(projectOpened(ProjectOpeningContext*)));
     context->proceed();
 }
@@ -1971,6 +2166,34 @@ MainWindow::openSettingsDialog()
     dialog->exec();
 }
 
+void
+MainWindow::openProfilingDialog()
+{
+    ProfilingDialog* dialog = new ProfilingDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
+void
+MainWindow::exportSlowestPages()
+{
+    QString const file_path(
+        QFileDialog::getSaveFileName(
+            this, tr("Export Slowest Pages"), QString(),
+            tr("CSV files") + " (*.csv)"
+        )
+    );
+    if (file_path.isEmpty()) {
+        return;
+    }
+
+    if (!PageTimings::writeSlowestPagesReport(file_path)) {
+        QMessageBox::warning(
+            this, tr("Error"), tr("Unable to write the report to %1.").arg(file_path)
+        );
+    }
+}
+
 //begin of modified by monday2000
 //Export_Subscans
 //Original_Foreground_Mixed
@@ -2004,6 +2227,7 @@ MainWindow::ExportOutput(exporting::ExportSettings settings)
     }
 
     m_ptrInteractiveQueue->cancelAndClear();
+    discardPrefetchedResults();
     if (m_ptrBatchQueue.get()) { // Should not happen, but just in case.
         m_ptrBatchQueue->cancelAndClear();
     }
@@ -2054,7 +2278,12 @@ MainWindow::ExportOutput(exporting::ExportSettings settings)
     m_ptrThumbSequence_export->reset(all_pages, ThumbnailSequence::RESET_SELECTION, defaultPageOrderProvider());
     m_ptrThumbSequence_export->setSelection(selected_pages, ThumbnailSequence::KEEP_SELECTION);
 
-    if (!m_ptrThumbSequence_export->AllThumbnailsComplete(settings.export_selected_pages_only)) {
+    bool const generate_output = settings.page_gen_tweaks.testFlag(exporting::PageGenTweak::GenerateOutput);
+
+    // When the output is generated as part of the export,
+    // pages don't have to be processed beforehand.
+    if (!generate_output &&
+            !m_ptrThumbSequence_export->AllThumbnailsComplete(settings.export_selected_pages_only)) {
         m_p_export_dialog->reset();
         return;
     }
@@ -2082,12 +2311,17 @@ MainWindow::ExportOutput(exporting::ExportSettings settings)
             }
         }
 
-        if (QFile::exists(out_file_path)) {
+        if (generate_output || QFile::exists(out_file_path)) {
             exporting::ExportThread::ExportRec rec;
             rec.page_no = page_no;
             rec.filename = out_file_path;
             rec.page_id = page_id;
             rec.zones_info = m_ptrStages->outputFilter()->getZonesInfo(page_id);
+            if (!generate_output && settings.mode.testFlag(exporting::ExportMode::AutoMask)) {
+                rec.automask_stale = !m_ptrStages->outputFilter()->findAutomaskFile(
+                            page_id, m_outFileNameGen, &rec.automask_filename
+                            );
+            }
             outpaths_vector.append(rec);
         }
 
@@ -2100,9 +2334,15 @@ MainWindow::ExportOutput(exporting::ExportSettings settings)
 
     // exporting pages
 
+    ReprocessTaskFactory const reprocess_tasks(
+        m_ptrStages, m_ptrPages, m_ptrThumbSequence_export->toPageSequence(),
+        m_ptrThumbnailCache, m_outFileNameGen, m_debug
+    );
+
     m_p_export_thread = new exporting::ExportThread(settings,
                                                     outpaths_vector,
                                                     export_dir,
+                                                    reprocess_tasks,
                                                     this);
 
     connect(m_p_export_thread, &exporting::ExportThread::finished, this, [=](){
@@ -2119,9 +2359,6 @@ MainWindow::ExportOutput(exporting::ExportSettings settings)
     connect(m_p_export_thread, &exporting::ExportThread::imageProcessed,
             m_p_export_dialog, &exporting::ExportDialog::stepProgress);
 
-    connect(m_p_export_thread, &exporting::ExportThread::needReprocess,
-            this, &MainWindow::exportRequestedReprocessing);
-
     connect(m_p_export_dialog, &exporting::ExportDialog::ExportStopSignal,
             m_p_export_thread, &exporting::ExportThread::cancel);
 
@@ -2134,52 +2371,6 @@ MainWindow::ExportOutput(exporting::ExportSettings settings)
     m_p_export_thread->start();
 }
 
-void
-MainWindow::exportRequestedReprocessing(const PageId& page_id, QImage* fore_subscan)
-{
-
-    assert(m_ptrThumbnailCache.get());
-    m_ptrInteractiveQueue->cancelAndClear();
-
-    {
-    const PageInfo page_info = m_ptrThumbSequence_export->toPageSequence().pageAt(page_id);
-
-    auto output_task = m_ptrStages->outputFilter()->createTask(
-                page_id, m_ptrThumbnailCache, m_outFileNameGen, false, m_debug,
-                true, fore_subscan
-                );
-
-    auto page_layout_task = m_ptrStages->pageLayoutFilter()->createTask(
-                page_id, output_task, false, false
-                );
-    auto select_content_task = m_ptrStages->selectContentFilter()->createTask(
-                page_id, page_layout_task, false, false
-                );
-    auto deskew_task = m_ptrStages->deskewFilter()->createTask(
-                page_id, select_content_task, false, false
-                );
-    auto page_split_task = m_ptrStages->pageSplitFilter()->createTask(
-                page_info,
-                deskew_task, false, false
-                );
-    auto fix_orientation_task = m_ptrStages->fixOrientationFilter()->createTask(
-                page_id, page_split_task, false
-                );
-    assert(fix_orientation_task);
-
-    BackgroundTaskPtr task = BackgroundTaskPtr(
-                new LoadFileTask(
-                    BackgroundTask::INTERACTIVE,
-                    page_info, m_ptrThumbnailCache, m_ptrPages, fix_orientation_task
-                    )
-                );
-
-    FilterResultPtr result = (*task)();
-    }
-
-    m_p_export_thread->continueExecution();
-}
-
 void
 MainWindow::SetStartExport()
 {
@@ -2357,9 +2548,20 @@ MainWindow::loadPageInteractive(PageInfo const& page)
 {
     assert(!isBatchProcessingInProgress());
 
-    m_ptrInteractiveQueue->cancelAndClear();
+    // Reloading the page we are already on means its settings may have
+    // changed, so whatever is being computed for it or for its neighbours
+    // may be outdated.  Otherwise, tasks for other pages are left to finish
+    // in background, as their results still get stored.
+    bool const same_page = (page.id() == m_ptrInteractiveQueue->focusPage());
+    if (same_page) {
+        m_ptrInteractiveQueue->cancelAndClear();
+        discardPrefetchedResults();
+    }
 
     if (isOutputFilter() && !checkReadyForOutput(&page.id())) {
+        m_ptrInteractiveQueue->cancelAndClear();
+        discardPrefetchedResults();
+
         filterList->setBatchProcessingPossible(false);
 
         // Switch to the first page - the user will need
@@ -2388,11 +2590,99 @@ MainWindow::loadPageInteractive(PageInfo const& page)
 
     assert(m_ptrThumbnailCache.get());
 
-    m_ptrInteractiveQueue->cancelAndClear();
-    m_ptrInteractiveQueue->addProcessingTask(
-        page, createCompositeTask(page, m_curFilter, /*batch=*/false, m_debug)
+    m_ptrLoadController->reloadSettings();
+
+    // Prefetches that haven't started yet are rebuilt around the new page.
+    m_ptrInteractiveQueue->removeNotTaken();
+    m_ptrInteractiveQueue->setFocusPage(page.id());
+
+    FilterResultPtr const prefetched(m_debug ? FilterResultPtr() : takePrefetchedResult(page.id()));
+    if (prefetched) {
+        // Computed while the user was looking at a neighbouring page.
+        prefetched->updateUI(this);
+    } else if (!m_ptrInteractiveQueue->isBeingProcessed(page.id())) {
+        if (m_ptrInteractiveQueue->numBeingProcessed() >= m_ptrWorkerThread->numThreads()) {
+            // All workers are busy with other pages.  Don't make the user wait for them.
+            m_ptrInteractiveQueue->cancelAndRemoveUnfocused();
+        }
+        m_ptrInteractiveQueue->addProcessingTask(
+            page, createCompositeTask(page, m_curFilter, /*batch=*/false, m_debug)
+        );
+        m_ptrWorkerThread->performTask(m_ptrInteractiveQueue->takeForProcessing());
+    } // Otherwise a task for this page is already running, typically a prefetch.
+
+    PageInfo const neighbours[] = {
+        m_ptrThumbSequence->nextPage(page.id()),
+        m_ptrThumbSequence->prevPage(page.id())
+    };
+    for (PageInfo const& neighbour : neighbours) {
+        if (!neighbour.isNull() && !m_ptrInteractiveQueue->contains(neighbour.id())) {
+            m_ptrInteractiveQueue->addProcessingTask(
+                neighbour, createCompositeTask(neighbour, m_curFilter, /*batch=*/false, /*debug=*/false)
+            );
+        }
+    }
+    // Prefetches start only after the page in focus is done, unless there are idle workers.
+    feedInteractiveWorkers();
+}
+
+void
+MainWindow::feedInteractiveWorkers()
+{
+    while (m_ptrInteractiveQueue->numBeingProcessed() < m_ptrWorkerThread->numThreads()) {
+        BackgroundTaskPtr const task(m_ptrInteractiveQueue->takeForProcessing());
+        if (!task) {
+            break;
+        }
+        m_ptrWorkerThread->performTask(task);
+    }
+}
+
+void
+MainWindow::storePrefetchedResult(PageId const& page_id, FilterResultPtr const& result)
+{
+    // Enough for the pages on both sides of the current one.
+    size_t const max_results = 2;
+
+    discardPrefetchedResults(page_id);
+    if (m_prefetchedResults.size() >= max_results) {
+        m_prefetchedResults.erase(m_prefetchedResults.begin());
+    }
+
+    PrefetchedResult const prefetched = { page_id, m_curFilter, result };
+    m_prefetchedResults.push_back(prefetched);
+}
+
+FilterResultPtr
+MainWindow::takePrefetchedResult(PageId const& page_id)
+{
+    for (auto it = m_prefetchedResults.begin(); it != m_prefetchedResults.end(); ++it) {
+        if (it->pageId == page_id && it->filterIdx == m_curFilter) {
+            FilterResultPtr const result(it->result);
+            m_prefetchedResults.erase(it);
+            return result;
+        }
+    }
+    return FilterResultPtr();
+}
+
+void
+MainWindow::discardPrefetchedResults(PageId const& page_id)
+{
+    if (page_id.isNull()) {
+        m_prefetchedResults.clear();
+        return;
+    }
+
+    m_prefetchedResults.erase(
+        std::remove_if(
+            m_prefetchedResults.begin(), m_prefetchedResults.end(),
+            [&page_id](PrefetchedResult const& prefetched) {
+                return prefetched.pageId == page_id;
+            }
+        ),
+        m_prefetchedResults.end()
     );
-    m_ptrWorkerThread->performTask(m_ptrInteractiveQueue->takeForProcessing());
 }
 
 void
@@ -2506,9 +2796,75 @@ MainWindow::closeProjectWithoutSaving()
     switchToNewProject(pages, QString());
 }
 
+namespace
+{
+
+class ProjectSaveTask :
+    public AbstractCommand0<BackgroundExecutor::TaskResultPtr>
+{
+public:
+    typedef boost::function<void(bool)> Callback;
+
+    ProjectSaveTask(
+        std::shared_ptr<ProjectWriter> const& writer,
+        std::vector<ProjectWriter::FilterPtr> const& filters,
+        QString const& project_file, Callback const& on_done)
+        :   m_ptrWriter(writer),
+            m_filters(filters),
+            m_projectFile(project_file),
+            m_onDone(on_done)
+    {
+    }
+
+    virtual BackgroundExecutor::TaskResultPtr operator()()
+    {
+        bool const success = m_ptrWriter->write(m_projectFile, m_filters);
+        return BackgroundExecutor::TaskResultPtr(new Result(m_onDone, success));
+    }
+private:
+    class Result : public AbstractCommand0<void>
+    {
+    public:
+        Result(Callback const& on_done, bool success)
+            : m_onDone(on_done), m_success(success) {}
+
+        virtual void operator()()
+        {
+            m_onDone(m_success);
+        }
+    private:
+        Callback m_onDone;
+        bool m_success;
+    };
+
+    std::shared_ptr<ProjectWriter> m_ptrWriter;
+    std::vector<ProjectWriter::FilterPtr> m_filters;
+    QString m_projectFile;
+    Callback m_onDone;
+};
+
+void reportBackgroundSave(
+    QPointer<MainWindow> const& main_window, int generation,
+    int const* current_generation, boost::function<void(bool)> const& on_done,
+    bool success)
+{
+    if (!main_window || !on_done) {
+        return;
+    }
+    if (generation != *current_generation) {
+        // Overtaken by a later save.
+        success = false;
+    }
+    on_done(success);
+}
+
+} // anonymous namespace
+
 bool
 MainWindow::saveProjectWithFeedback(QString const& project_file)
 {
+    ++m_projectSaveGeneration;
+
     ProjectWriter writer(m_ptrPages, m_selectedPage, m_outFileNameGen);
 
     if (QStatusBar* sb = statusBar()) {
@@ -2526,6 +2882,37 @@ MainWindow::saveProjectWithFeedback(QString const& project_file)
     return true;
 }
 
+void
+MainWindow::saveProjectInBackground(
+    QString const& project_file, boost::function<void(bool)> const& on_done)
+{
+    if (!m_ptrProjectSaver) {
+        // A single thread keeps saves to the same file strictly ordered.
+        m_ptrProjectSaver.reset(new BackgroundExecutor(1));
+    }
+
+    // ProjectWriter snapshots the page sequence, so all the GUI thread
+    // state is captured here.  Filter settings are safe to read from
+    // any thread.
+    std::shared_ptr<ProjectWriter> const writer(
+        new ProjectWriter(m_ptrPages, m_selectedPage, m_outFileNameGen)
+    );
+
+    int const generation = ++m_projectSaveGeneration;
+    ProjectSaveTask::Callback const callback(
+        boost::bind(
+            &reportBackgroundSave, QPointer<MainWindow>(this),
+            generation, &m_projectSaveGeneration, on_done, _1
+        )
+    );
+
+    m_ptrProjectSaver->enqueueTask(
+        BackgroundExecutor::TaskPtr(
+            new ProjectSaveTask(writer, m_ptrStages->filters(), project_file, callback)
+        ), &m_ptrProjectSaver
+    );
+}
+
 /**
  * Note: showInsertFileDialog(BEFORE, ImageId()) is legal and means inserting at the end.
  */
@@ -2593,7 +2980,7 @@ MainWindow::showInsertFileDialog(BeforeOrAfter before_or_after, ImageId const& e
 
     // The order of items returned by QFileDialog is platform-dependent,
     // so we enforce our own ordering.
-    std::sort(files.begin(), files.end(), SmartFilenameOrdering());
+    SmartFilenameOrdering::sort(files.begin(), files.end());
 
     // I suspect on some platforms it may be possible to select the same file twice,
     // so to be safe, remove duplicates.
@@ -2603,18 +2990,28 @@ MainWindow::showInsertFileDialog(BeforeOrAfter before_or_after, ImageId const& e
     std::vector<QString> loaded_files;
     std::vector<QString> failed_files; // Those we failed to read metadata from.
 
+    // Results come in no particular order, so put them back
+    // into the order of files.
+    std::map<QString, ImageMetadataScanner::Result> results;
+    {
+        ImageMetadataScanner scanner;
+        for (QString const& file : files) {
+            scanner.scan(file);
+        }
+        ImageMetadataScanner::Result result;
+        while (scanner.takeResult(result, /*wait=*/true)) {
+            QString const file_path(result.filePath);
+            results[file_path] = std::move(result);
+        }
+    }
+
     // dialog->selectedFiles() returns file list in reverse order.
     for (int i = files.size() - 1; i >= 0; --i) {
         QFileInfo const file_info(files[i]);
-        ImageFileInfo image_file_info(file_info, std::vector<ImageMetadata>());
-
-        ImageMetadataLoader::Status const status = ImageMetadataLoader::load(
-                    files.at(i),[&](ImageMetadata const& metadata) {
-                image_file_info.imageInfo().push_back(metadata);
-            } );
+        ImageMetadataScanner::Result& result = results[files[i]];
 
-        if (status == ImageMetadataLoader::LOADED) {
-            new_files.push_back(image_file_info);
+        if (result.status == ImageMetadataLoader::LOADED) {
+            new_files.push_back(ImageFileInfo(file_info, result.perPageMetadata));
             loaded_files.push_back(file_info.absoluteFilePath());
         } else {
             failed_files.push_back(file_info.absoluteFilePath());
@@ -2831,20 +3228,24 @@ MainWindow::removeFromProject(std::set<PageId> const& pages)
 
     m_ptrPages->removePages(pages);
 
-    const PageSequence itemsInOrder = m_ptrThumbSequence->toPageSequence();
+    std::shared_ptr<PageSequence const> const itemsInOrder(
+        std::make_shared<PageSequence>(m_ptrThumbSequence->toPageSequence())
+    );
+    PageSet const deleted(itemsInOrder, pages);
     std::set<PageId> new_selection;
 
     bool select_first_non_deleted = false;
-    if (itemsInOrder.numPages() > 0) {
+    if (itemsInOrder->numPages() > 0) {
         // if first page was deleted select first not deleted page
         // otherwise select last not deleted page from beginning
-        select_first_non_deleted = pages.find(itemsInOrder.pageAt(0).id()) != pages.end();
+        select_first_non_deleted = deleted.containsAt(0);
 
         PageId last_non_deleted;
-        for (const PageInfo& page : itemsInOrder) {
+        int idx = 0;
+        for (const PageInfo& page : *itemsInOrder) {
 
             const PageId& id = page.id();
-            const bool was_deleted = (pages.find(id) != pages.end());
+            const bool was_deleted = deleted.containsAt(idx++);
 
             if (!was_deleted) {
                 if (select_first_non_deleted) {
@@ -3100,6 +3501,20 @@ MainWindow::changeLanguage(QString lang, bool dont_store)
         return;
     }
 
+    if (lang == "en") {
+        // The UI is written in English, so there is nothing to look up.
+        // Removing translators that were never installed is a no-op and
+        // doesn't trigger a retranslation, which keeps startup cheap.
+        qApp->removeTranslator(&m_translator);
+        qApp->removeTranslator(&m_qt_translator);
+        if (!dont_store) {
+            QSettings settings;
+            settings.setValue(_key_app_language, lang);
+        }
+        m_current_lang = lang;
+        return;
+    }
+
     bool loaded = loadLanguage("", lang);
     if (!loaded) {
         loaded = loadLanguage(qApp->applicationDirPath() + "/", lang);
@@ -3111,7 +3526,7 @@ MainWindow::changeLanguage(QString lang, bool dont_store)
         }
     }
 
-    if (loaded || lang == "en") {
+    if (loaded) {
         qApp->removeTranslator(&m_translator);
         qApp->installTranslator(&m_translator);
         if (!dont_store) {
@@ -3125,16 +3540,13 @@ MainWindow::changeLanguage(QString lang, bool dont_store)
             qApp->removeTranslator(&m_qt_translator);
         }
 
-        if (lang != "en") { // Qt's "en" is built in
-
 #if defined(unix) || defined(__unix__) || defined(__unix)
-            if (m_qt_translator.isEmpty()) {
-                m_qt_translator.load(QString("qt_%1").arg(lang), "/usr/share/qt5/translations/");
-            }
+        if (m_qt_translator.isEmpty()) {
+            m_qt_translator.load(QString("qt_%1").arg(lang), "/usr/share/qt5/translations/");
+        }
 #endif
-            if (!m_qt_translator.isEmpty()) {
-                qApp->installTranslator(&m_qt_translator);
-            }
+        if (!m_qt_translator.isEmpty()) {
+            qApp->installTranslator(&m_qt_translator);
         }
 
     } else {
@@ -3247,6 +3659,13 @@ MainWindow::setupStatusBar()
     connect(this, &MainWindow::UpdateStatusBarPageSize, this, &MainWindow::displayStatusBarPageSize);
     connect(this, &MainWindow::UpdateStatusBarMousePos, this, &MainWindow::displayStatusBarMousePos);
 
+    // Image memory changes all the time in background threads,
+    // so it's polled rather than notified about.
+    m_memoryUsageUpdater.setInterval(1000);
+    connect(&m_memoryUsageUpdater, &QTimer::timeout, this, &MainWindow::displayStatusBarMemoryUsage);
+    m_memoryUsageUpdater.start();
+    displayStatusBarMemoryUsage();
+
     statusLabelPhysSize->installEventFilter(this);
 }
 
@@ -3317,6 +3736,12 @@ MainWindow::displayStatusBarMousePos()
     statusLabelMousePos->setText(tr("%1, %2").arg(x, 0, 'f', 1).arg(y, 0, 'f', 1));
 }
 
+void
+MainWindow::displayStatusBarMemoryUsage()
+{
+    statusLabelMemory->setText(StatusBarProvider::getMemoryUsageText());
+}
+
 const QList<QKeySequence> getPageActionShortcuts(const HotKeysId& id, int idx = 0)
 {
     // Allows to catch Shift+ any shortcut combination
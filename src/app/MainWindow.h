@@ -45,6 +45,7 @@
 #include <vector>
 #include <set>
 #include <QTranslator>
+#include <QTimer>
 //begin of modified by monday2000
 //Export_Subscans
 #include "exporting/ExportThread.h"
@@ -71,6 +72,7 @@ class ImageInfo;
 class PageInfo;
 class QStackedLayout;
 class WorkerThread;
+class BatchLoadController;
 class ProjectReader;
 class DebugImages;
 class ContentBoxPropagator;
@@ -82,6 +84,7 @@ class TabbedDebugImages;
 class ProcessingTaskQueue;
 class FixDpiDialog;
 class OutOfMemoryDialog;
+class BackgroundExecutor;
 class QLineF;
 class QRectF;
 class QLayout;
@@ -122,6 +125,17 @@ public:
         return m_projectFile;
     }
     bool saveProjectWithFeedback(QString const& project_file);
+
+    /**
+     * \brief Saves the project without blocking the GUI thread.
+     *
+     * The project state is captured right away, while serializing and
+     * writing it happens in a background thread.  \p on_done is called
+     * in the GUI thread with the outcome.  A save that was overtaken by
+     * a later one, either synchronous or not, is reported as failed.
+     */
+    void saveProjectInBackground(
+        QString const& project_file, boost::function<void(bool)> const& on_done);
     // AutoSave Timer / end
 
 public slots:
@@ -150,6 +164,10 @@ signals:
     void UpdateStatusBarMousePos();
     void toBeRemoved(const std::set<PageId> pages);
 private slots:
+    void invalidateAllThumbnailsNow();
+
+    void applyBatchResults();
+
     void goFirstPage(bool in_selection = false);
 
     void goLastPage(bool in_selection = false);
@@ -189,10 +207,17 @@ private slots:
 
     void stopBatchProcessing(MainAreaAction main_area = UPDATE_MAIN_AREA);
 
+    /**
+     * Hands tasks to the workers BatchLoadController may have added.
+     */
+    void batchLoadChanged();
+
     void invalidateThumbnail(PageId const& page_id);
 
     void invalidateThumbnail(PageInfo const& page_info);
 
+    void invalidateThumbnails(std::set<PageId> const& page_ids);
+
     void invalidateAllThumbnails();
 
     void showRelinkingDialog();
@@ -201,6 +226,10 @@ private slots:
         BackgroundTaskPtr const& task,
         FilterResultPtr const& result);
 
+    void filterPreview(
+        BackgroundTaskPtr const& task,
+        FilterResultPtr const& preview);
+
     void fixDpiDialogRequested();
 
     void fixedDpiSubmitted();
@@ -221,6 +250,10 @@ private slots:
 
     void openSettingsDialog();
 
+    void openProfilingDialog();
+
+    void exportSlowestPages();
+
     void showAboutDialog();
 
     void handleOutOfMemorySituation();
@@ -233,6 +266,8 @@ private slots:
 
     void displayStatusBarMousePos();
 
+    void displayStatusBarMemoryUsage();
+
     void applyUnitsSettingToCoordinates(qreal& x, qreal& y);
 
     void on_actionJumpPageF_triggered();
@@ -309,6 +344,36 @@ private:
 
     bool isBatchProcessingInProgress() const;
 
+    /**
+     * Hands batch tasks to the worker threads until
+     * each of them has something to do.
+     * Returns false if there was nothing left to hand out.
+     */
+    bool feedBatchWorkers();
+
+    /**
+     * Hands prefetch tasks to idle worker threads.
+     */
+    void feedInteractiveWorkers();
+
+    /**
+     * Keeps the result of a prefetch, so that navigating to its page
+     * displays it right away.  Only a few most recent ones are kept.
+     */
+    void storePrefetchedResult(PageId const& page_id, FilterResultPtr const& result);
+
+    /**
+     * Removes and returns a prefetched result for the page at the current
+     * filter, or returns null if there is none.
+     */
+    FilterResultPtr takePrefetchedResult(PageId const& page_id);
+
+    /**
+     * Drops prefetched results, either for a single page, whose parameters
+     * may have changed, or for all pages, if \p page_id is null.
+     */
+    void discardPrefetchedResults(PageId const& page_id = PageId());
+
     bool isProjectLoaded() const;
 
     bool isBelowSelectContent() const;
@@ -391,8 +456,20 @@ private:
     IntrusivePtr<ThumbnailPixmapCache> m_ptrThumbnailCache;
     std::unique_ptr<ThumbnailSequence> m_ptrThumbSequence;
     std::unique_ptr<WorkerThread> m_ptrWorkerThread;
+    std::unique_ptr<BatchLoadController> m_ptrLoadController;
     std::unique_ptr<ProcessingTaskQueue> m_ptrBatchQueue;
     std::unique_ptr<ProcessingTaskQueue> m_ptrInteractiveQueue;
+
+    struct PrefetchedResult {
+        PageId pageId;
+        int filterIdx;
+        FilterResultPtr result;
+    };
+
+    /**
+     * Results of prefetch tasks, oldest first.
+     */
+    std::vector<PrefetchedResult> m_prefetchedResults;
     QStackedLayout* m_pImageFrameLayout;
     QStackedLayout* m_pOptionsFrameLayout;
     QPointer<FilterOptionsWidget> m_ptrOptionsWidget;
@@ -407,6 +484,8 @@ private:
     QObjectCleanupHandler m_optionsWidgetCleanup;
     QObjectCleanupHandler m_imageWidgetCleanup;
     std::unique_ptr<OutOfMemoryDialog> m_ptrOutOfMemoryDialog;
+    std::unique_ptr<BackgroundExecutor> m_ptrProjectSaver;
+    int m_projectSaveGeneration;
     int m_curFilter;
     int m_ignoreSelectionChanges;
     int m_ignorePageOrderingChanges;
@@ -415,8 +494,6 @@ private:
     bool m_beepOnBatchProcessingCompletion;
 //begin of modified by monday2000
 //Export_Subscans
-public Q_SLOTS:
-    void exportRequestedReprocessing(const PageId& page_id, QImage* fore_subscan);
 private:
     exporting::ExportDialog* m_p_export_dialog;
     exporting::ExportThread* m_p_export_thread;
@@ -432,6 +509,24 @@ private:
 
     QTimer* m_autosave_timer;
 
+    /**
+     * Coalesces invalidateAllThumbnails() calls during batch processing.
+     */
+    QTimer m_allThumbnailsInvalidator;
+
+    /**
+     * Coalesces what finished batch tasks ask of the thumbnail list,
+     * so it's updated at most about 30 times a second, however many
+     * pages finish in between.
+     */
+    QTimer m_batchResultsApplier;
+    QTimer m_memoryUsageUpdater;
+
+    /**
+     * Pages whose thumbnails are to be rebuilt by applyBatchResults().
+     */
+    std::set<PageId> m_pendingThumbnailInvalidations;
+
 #ifdef HAVE_CANBERRA
     CanberraSoundPlayer m_canberraPlayer;
 #endif
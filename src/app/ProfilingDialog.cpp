@@ -0,0 +1,143 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ProfilingDialog.h"
+#include "Profiler.h"
+#include <QFileDialog>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMessageBox>
+#include <QStringList>
+#include <QTreeWidgetItem>
+#include <map>
+
+namespace
+{
+
+enum Column { COL_STAGE, COL_CALLS, COL_TOTAL, COL_SELF, COL_COUNTERS };
+
+QString formatCounters(QJsonObject const& counters)
+{
+    QStringList parts;
+    for (QJsonObject::const_iterator it = counters.begin(); it != counters.end(); ++it) {
+        parts.push_back(it.key() + QChar('=') + QString::number(qint64(it.value().toDouble())));
+    }
+    return parts.join(QLatin1String(", "));
+}
+
+} // anonymous namespace
+
+ProfilingDialog::ProfilingDialog(QWidget* parent)
+    :   QDialog(parent)
+{
+    ui.setupUi(this);
+    ui.enableCheckBox->setChecked(Profiler::isEnabled());
+    for (int col = COL_CALLS; col <= COL_SELF; ++col) {
+        ui.statsTree->headerItem()->setTextAlignment(col, Qt::AlignRight);
+    }
+
+    connect(ui.enableCheckBox, SIGNAL(toggled(bool)), SLOT(enableToggled(bool)));
+    connect(ui.refreshButton, SIGNAL(clicked()), SLOT(refresh()));
+    connect(ui.resetButton, SIGNAL(clicked()), SLOT(reset()));
+    connect(ui.saveButton, SIGNAL(clicked()), SLOT(saveReport()));
+
+    refresh();
+}
+
+void
+ProfilingDialog::enableToggled(bool const enabled)
+{
+    Profiler::setEnabled(enabled);
+}
+
+void
+ProfilingDialog::refresh()
+{
+    populate(Profiler::report().object().value("stages").toArray());
+}
+
+void
+ProfilingDialog::reset()
+{
+    Profiler::reset();
+    refresh();
+}
+
+void
+ProfilingDialog::saveReport()
+{
+    QString const file_path(
+        QFileDialog::getSaveFileName(
+            this, tr("Save Profiling Report"), QString(),
+            tr("JSON files") + " (*.json)"
+        )
+    );
+    if (file_path.isEmpty()) {
+        return;
+    }
+
+    if (!Profiler::writeReport(file_path)) {
+        QMessageBox::warning(
+            this, tr("Error"), tr("Unable to write the report to %1.").arg(file_path)
+        );
+    }
+}
+
+void
+ProfilingDialog::populate(QJsonArray const& stages)
+{
+    ui.statsTree->clear();
+
+    // Region paths come sorted, so a parent is always seen before its children.
+    std::map<QString, QTreeWidgetItem*> items;
+    for (QJsonValue const& value : stages) {
+        QJsonObject const stage(value.toObject());
+        QString const path(stage.value("region").toString());
+        if (path.isEmpty()) {
+            continue;
+        }
+
+        int const slash = path.lastIndexOf(QChar('/'));
+        QTreeWidgetItem* item = 0;
+        std::map<QString, QTreeWidgetItem*>::const_iterator const parent(
+            slash < 0 ? items.end() : items.find(path.left(slash))
+        );
+        if (parent != items.end()) {
+            item = new QTreeWidgetItem(parent->second);
+            item->setText(COL_STAGE, path.mid(slash + 1));
+        } else {
+            item = new QTreeWidgetItem(ui.statsTree);
+            item->setText(COL_STAGE, path);
+        }
+        items[path] = item;
+
+        item->setText(COL_CALLS, QString::number(qint64(stage.value("calls").toDouble())));
+        item->setText(COL_TOTAL, QString::number(stage.value("msec").toDouble(), 'f', 1));
+        item->setText(COL_SELF, QString::number(stage.value("self_msec").toDouble(), 'f', 1));
+        item->setText(COL_COUNTERS, formatCounters(stage.value("counters").toObject()));
+        for (int col = COL_CALLS; col <= COL_SELF; ++col) {
+            item->setTextAlignment(col, Qt::AlignRight);
+        }
+    }
+
+    ui.statsTree->expandAll();
+    for (int col = COL_STAGE; col < COL_COUNTERS; ++col) {
+        ui.statsTree->resizeColumnToContents(col);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILING_DIALOG_H_
+#define PROFILING_DIALOG_H_
+
+#include "ui_ProfilingDialog.h"
+#include <QDialog>
+
+class QJsonArray;
+
+/**
+ * \brief Shows the per-stage timings and counters collected by Profiler.
+ */
+class ProfilingDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit ProfilingDialog(QWidget* parent = 0);
+private slots:
+    void enableToggled(bool enabled);
+
+    void refresh();
+
+    void reset();
+
+    void saveReport();
+private:
+    void populate(QJsonArray const& stages);
+
+    Ui::ProfilingDialog ui;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "NonCopyable.h"
 #include "ImageMetadata.h"
 #include "ImageMetadataLoader.h"
+#include "ImageMetadataScanner.h"
 #include "SmartFilenameOrdering.h"
 #include <QAbstractListModel>
 #include <QSortFilterProxyModel>
@@ -42,10 +43,15 @@
 #include <QDebug>
 #include <vector>
 #include <deque>
+#include <map>
+#include <memory>
 #include <algorithm>
 #include <utility>
 #include <iterator>
 #include <stddef.h>
+#include <assert.h>
+
+static int const LOAD_POLL_INTERVAL_MS = 50;
 
 class ProjectFilesDialog::Item
 {
@@ -53,13 +59,21 @@ public:
     enum Status { STATUS_DEFAULT, STATUS_LOAD_OK, STATUS_LOAD_FAILED };
 
     Item(QFileInfo const& file_info, Qt::ItemFlags flags)
-        : m_fileInfo(file_info), m_flags(flags), m_status(STATUS_DEFAULT) {}
+        : m_fileInfo(file_info), m_sortKey(file_info), m_flags(flags), m_status(STATUS_DEFAULT) {}
 
     QFileInfo const& fileInfo() const
     {
         return m_fileInfo;
     }
 
+    /**
+     * Computed once, as the sorted views compare items many times over.
+     */
+    SmartFilenameOrdering::Key const& sortKey() const
+    {
+        return m_sortKey;
+    }
+
     Qt::ItemFlags flags() const
     {
         return m_flags;
@@ -86,6 +100,7 @@ public:
     }
 private:
     QFileInfo m_fileInfo;
+    SmartFilenameOrdering::Key m_sortKey;
     Qt::ItemFlags m_flags;
     std::vector<ImageMetadata> m_perPageMetadata;
     Status m_status;
@@ -95,7 +110,7 @@ class ProjectFilesDialog::FileList : private QAbstractListModel
 {
     DECLARE_NON_COPYABLE(FileList)
 public:
-    enum LoadStatus { LOAD_OK, LOAD_FAILED, NO_MORE_FILES };
+    enum LoadStatus { LOAD_OK, LOAD_FAILED, LOAD_IN_PROGRESS, NO_MORE_FILES };
 
     FileList();
 
@@ -135,8 +150,17 @@ public:
 
     void remove(QItemSelection const& selection);
 
+    /**
+     * \brief Starts loading the metadata of all files in the background.
+     */
     void prepareForLoadingFiles();
 
+    /**
+     * \brief Applies the metadata of a file that finished loading.
+     *
+     * Files finish loading in no particular order.  LOAD_IN_PROGRESS
+     * means none finished since the last call.
+     */
     LoadStatus loadNextFile();
 private:
     virtual int rowCount(QModelIndex const& parent) const;
@@ -146,7 +170,8 @@ private:
     virtual Qt::ItemFlags flags(QModelIndex const& index) const;
 
     std::vector<Item> m_items;
-    std::deque<int> m_itemsToLoad;
+    std::unique_ptr<ImageMetadataScanner> m_ptrScanner;
+    std::map<QString, int> m_itemsToLoad; /**< File path -> item index. */
 };
 
 class ProjectFilesDialog::SortedFileList : private QSortFilterProxyModel
@@ -287,22 +312,27 @@ void pushFileInfo(std::vector<ImageFileInfo>& files, Item const& item)
     files.push_back(ImageFileInfo(item.fileInfo(), item.perPageMetadata()));
 }
 
-bool imageFileInfoLess(ImageFileInfo const& lhs, ImageFileInfo const& rhs)
-{
-    return SmartFilenameOrdering()(lhs.fileInfo(), rhs.fileInfo());
-}
-
 } // anonymous namespace
 
 std::vector<ImageFileInfo>
 ProjectFilesDialog::inProjectFiles() const
 {
-    std::vector<ImageFileInfo> files;
+    std::vector<Item const*> items;
     m_ptrInProjectFiles->items([&] (Item const& item) {
-        files.push_back(ImageFileInfo(item.fileInfo(), item.perPageMetadata()));
+        items.push_back(&item);
     });
 
-    std::sort(files.begin(), files.end(), imageFileInfoLess);
+    SmartFilenameOrdering const less;
+    std::sort(
+        items.begin(), items.end(),
+        [&less](Item const* lhs, Item const* rhs) { return less(lhs->sortKey(), rhs->sortKey()); }
+    );
+
+    std::vector<ImageFileInfo> files;
+    files.reserve(items.size());
+    for (Item const* item : items) {
+        files.push_back(ImageFileInfo(item->fileInfo(), item->perPageMetadata()));
+    }
 
     return files;
 }
@@ -609,7 +639,9 @@ ProjectFilesDialog::startLoadingMetadata()
     buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
     offProjectList->clearSelection();
     inProjectList->clearSelection();
-    m_loadTimerId = startTimer(0);
+    // Files load in the background, so there is no point in polling
+    // for them more often than the progress bar can show.
+    m_loadTimerId = startTimer(LOAD_POLL_INTERVAL_MS);
     m_metadataLoadFailed = false;
 }
 
@@ -621,16 +653,21 @@ ProjectFilesDialog::timerEvent(QTimerEvent* event)
         return;
     }
 
-    switch (m_ptrInProjectFiles->loadNextFile()) {
-    case FileList::NO_MORE_FILES:
-        finishLoadingMetadata();
-        break;
-    case FileList::LOAD_FAILED:
-        m_metadataLoadFailed = true;
-    // Fall through.
-    case FileList::LOAD_OK:
-        progressBar->setValue(progressBar->value() + 1);
-        break;
+    // Take everything that completed since the previous tick.
+    for (;;) {
+        switch (m_ptrInProjectFiles->loadNextFile()) {
+        case FileList::NO_MORE_FILES:
+            finishLoadingMetadata();
+            return;
+        case FileList::LOAD_IN_PROGRESS:
+            return;
+        case FileList::LOAD_FAILED:
+            m_metadataLoadFailed = true;
+        // Fall through.
+        case FileList::LOAD_OK:
+            progressBar->setValue(progressBar->value() + 1);
+            break;
+        }
     }
 }
 
@@ -765,31 +802,40 @@ ProjectFilesDialog::FileList::prepareForLoadingFiles()
                 [&](int lhs, int rhs) { return ItemVisualOrdering()(m_items[lhs], m_items[rhs]); }
     );
 
-    m_itemsToLoad.swap(item_indexes);
+    // Files are queued in visual order, so they tend to complete in it.
+    m_ptrScanner.reset(new ImageMetadataScanner);
+    m_itemsToLoad.clear();
+    for (int const item_idx : item_indexes) {
+        QString const file_path(m_items[item_idx].fileInfo().absoluteFilePath());
+        m_itemsToLoad[file_path] = item_idx;
+        m_ptrScanner->scan(file_path);
+    }
 }
 
 ProjectFilesDialog::FileList::LoadStatus
 ProjectFilesDialog::FileList::loadNextFile()
 {
     if (m_itemsToLoad.empty()) {
+        m_ptrScanner.reset();
         return NO_MORE_FILES;
     }
 
-    int const item_idx = m_itemsToLoad.front();
-    Item& item = m_items[item_idx];
-    std::vector<ImageMetadata> per_page_metadata;
-    QString const file_path(item.fileInfo().absoluteFilePath());
+    ImageMetadataScanner::Result result;
+    if (!m_ptrScanner->takeResult(result)) {
+        return LOAD_IN_PROGRESS;
+    }
 
-    ImageMetadataLoader::Status const st = ImageMetadataLoader::load(
-            file_path, [&] (ImageMetadata const& metadata) {
-            per_page_metadata.push_back(metadata);
-        } );
+    std::map<QString, int>::iterator const it(m_itemsToLoad.find(result.filePath));
+    assert(it != m_itemsToLoad.end());
+    int const item_idx = it->second;
+    m_itemsToLoad.erase(it);
+    Item& item = m_items[item_idx];
 
     LoadStatus status;
 
-    if (st == ImageMetadataLoader::LOADED) {
+    if (result.status == ImageMetadataLoader::LOADED) {
         status = LOAD_OK;
-        item.perPageMetadata().swap(per_page_metadata);
+        item.perPageMetadata().swap(result.perPageMetadata);
         item.setStatus(Item::STATUS_LOAD_OK);
     } else {
         status = LOAD_FAILED;
@@ -798,8 +844,6 @@ ProjectFilesDialog::FileList::loadNextFile()
     QModelIndex const idx(index(item_idx, 0));
     emit dataChanged(idx, idx);
 
-    m_itemsToLoad.pop_front();
-
     return status;
 }
 
@@ -836,5 +880,5 @@ ProjectFilesDialog::ItemVisualOrdering::operator()(
         return lhs_failed;
     }
 
-    return SmartFilenameOrdering()(lhs.fileInfo(), rhs.fileInfo());
+    return SmartFilenameOrdering()(lhs.sortKey(), rhs.sortKey());
 }
@@ -20,6 +20,7 @@
 
 #include "FixDpiDialog.h"
 #include "ProjectPages.h"
+#include "settings/globalstaticsettings.h"
 #include <QString>
 #include <QMessageBox>
 #include <Qt>
@@ -27,9 +28,12 @@
 #include <assert.h>
 
 ProjectOpeningContext::ProjectOpeningContext(
-    QWidget* parent, QString const& project_file, QDomDocument const& doc)
+    QWidget* parent, QString const& project_file, QIODevice& project_data)
     :   m_projectFile(project_file),
-        m_reader(doc),
+        m_reader(
+            project_data, GlobalStaticSettings::m_projectBinarySnapshot
+            ? ProjectReader::snapshotFileFor(project_file) : QString()
+        ),
         m_pParent(parent)
 {
 }
@@ -30,7 +30,7 @@
 
 class FixDpiDialog;
 class QWidget;
-class QDomDocument;
+class QIODevice;
 
 class ProjectOpeningContext : public QObject
 {
@@ -38,7 +38,7 @@ class ProjectOpeningContext : public QObject
     DECLARE_NON_COPYABLE(ProjectOpeningContext)
 public:
     ProjectOpeningContext(
-        QWidget* parent, QString const& project_file, QDomDocument const& doc);
+        QWidget* parent, QString const& project_file, QIODevice& project_data);
 
     virtual ~ProjectOpeningContext();
 
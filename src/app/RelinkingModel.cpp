@@ -21,6 +21,7 @@
 #include "OutOfMemoryHandler.h"
 #include <QFile>
 #include <QDir>
+#include <QStringList>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QWaitCondition>
@@ -64,29 +65,44 @@ private:
     Status m_status;
 };
 
-class RelinkingModel::StatusUpdateThread : private QThread
+/**
+ * Checks whether paths exist, using a bounded number of threads.
+ *
+ * Rather than stat'ing every path, a thread lists the parent directory
+ * of the highest priority path and resolves all the queued paths in that
+ * directory from the listing.  On a high latency network share, that's
+ * one round trip per directory instead of one per file.
+ */
+class RelinkingModel::StatusUpdatePool
 {
+    DECLARE_NON_COPYABLE(StatusUpdatePool)
 public:
-    StatusUpdateThread(RelinkingModel* owner);
+    StatusUpdatePool(RelinkingModel* owner);
 
-    /** This will signal the thread to stop and wait for it to happen. */
-    virtual ~StatusUpdateThread();
+    /** This will signal the threads to stop and wait for it to happen. */
+    ~StatusUpdatePool();
 
     /**
-     * Requests are served from last to first.
+     * Requests are served from first to last, one directory at a time.
      * Requesting the same item multiple times will just move the existing
-     * record to the top of the stack.
+     * record to the back of the queue.
      */
     void requestStatusUpdate(QString const& path, int row);
 private:
+    enum { MAX_THREADS = 8 };
+
+    class Worker;
+
     struct Task {
         QString path;
+        QString dir; /**< Parent directory, or empty if it can't be listed. */
         int row;
 
-        Task(QString const& p, int r) : path(p), row(r) {}
+        Task(QString const& p, int r) : path(p), dir(parentDir(p)), row(r) {}
     };
 
     class OrderedByPathTag;
+    class OrderedByDirTag;
     class OrderedByPriorityTag;
 
     typedef boost::multi_index_container <
@@ -96,6 +112,10 @@ private:
     boost::multi_index::tag<OrderedByPathTag>,
     boost::multi_index::member<Task, QString, &Task::path>
     >,
+    boost::multi_index::ordered_non_unique <
+    boost::multi_index::tag<OrderedByDirTag>,
+    boost::multi_index::member<Task, QString, &Task::dir>
+    >,
     boost::multi_index::sequenced <
     boost::multi_index::tag<OrderedByPriorityTag>
     >
@@ -103,27 +123,55 @@ private:
     > TaskList;
 
     typedef TaskList::index<OrderedByPathTag>::type TasksByPath;
+    typedef TaskList::index<OrderedByDirTag>::type TasksByDir;
     typedef TaskList::index<OrderedByPriorityTag>::type TasksByPriority;
 
-    virtual void run();
+    static QString parentDir(QString const& path);
+
+    static QString fileNameKey(QString const& file_name);
+
+    /**
+     * Puts the keys of the entries of \p dir into \p keys.  Returns false
+     * if the listing can't be trusted and paths have to be checked one by one.
+     */
+    static bool listDir(QString const& dir, std::set<QString>& keys);
+
+    /** The body of each worker thread. */
+    void processTasks();
 
     RelinkingModel* m_pOwner;
     TaskList m_tasks;
     TasksByPath& m_rTasksByPath;
+    TasksByDir& m_rTasksByDir;
     TasksByPriority& m_rTasksByPriority;
-    QString m_pathBeingProcessed;
+    std::set<QString> m_dirsBeingListed;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    int m_numIdleWorkers;
     QMutex m_mutex;
     QWaitCondition m_cond;
     bool m_exiting;
 };
 
+class RelinkingModel::StatusUpdatePool::Worker : public QThread
+{
+public:
+    Worker(StatusUpdatePool* pool) : m_pPool(pool) {}
+protected:
+    virtual void run()
+    {
+        m_pPool->processTasks();
+    }
+private:
+    StatusUpdatePool* const m_pPool;
+};
+
 /*============================ RelinkingModel =============================*/
 
 RelinkingModel::RelinkingModel()
     :   m_fileIcon(":/icons/file-16.png")
     ,   m_folderIcon(":/icons/folder-16.png")
     ,   m_ptrRelinker(new Relinker)
-    ,   m_ptrStatusUpdateThread(new StatusUpdateThread(this))
+    ,   m_ptrStatusUpdatePool(new StatusUpdatePool(this))
     ,   m_haveUncommittedChanges(true)
 {
 }
@@ -342,7 +390,7 @@ RelinkingModel::requestStatusUpdate(QModelIndex const& index)
     Item& item = m_items[index.row()];
     item.uncommittedStatus = StatusUpdatePending;
 
-    m_ptrStatusUpdateThread->requestStatusUpdate(item.uncommittedPath, index.row());
+    m_ptrStatusUpdatePool->requestStatusUpdate(item.uncommittedPath, index.row());
 }
 
 void
@@ -368,19 +416,20 @@ RelinkingModel::customEvent(QEvent* event)
     emit dataChanged(index(response.row()), index(response.row()));
 }
 
-/*========================== StatusUpdateThread =========================*/
+/*========================== StatusUpdatePool ===========================*/
 
-RelinkingModel::StatusUpdateThread::StatusUpdateThread(RelinkingModel* owner)
-    :   QThread(owner)
-    ,   m_pOwner(owner)
+RelinkingModel::StatusUpdatePool::StatusUpdatePool(RelinkingModel* owner)
+    :   m_pOwner(owner)
     ,   m_tasks()
     ,   m_rTasksByPath(m_tasks.get<OrderedByPathTag>())
+    ,   m_rTasksByDir(m_tasks.get<OrderedByDirTag>())
     ,   m_rTasksByPriority(m_tasks.get<OrderedByPriorityTag>())
+    ,   m_numIdleWorkers(0)
     ,   m_exiting(false)
 {
 }
 
-RelinkingModel::StatusUpdateThread::~StatusUpdateThread()
+RelinkingModel::StatusUpdatePool::~StatusUpdatePool()
 {
     {
         QMutexLocker locker(&m_mutex);
@@ -388,40 +437,43 @@ RelinkingModel::StatusUpdateThread::~StatusUpdateThread()
     }
 
     m_cond.wakeAll();
-    wait();
+    for (std::unique_ptr<Worker> const& worker : m_workers) {
+        worker->wait();
+    }
 }
 
 void
-RelinkingModel::StatusUpdateThread::requestStatusUpdate(QString const& path, int row)
+RelinkingModel::StatusUpdatePool::requestStatusUpdate(QString const& path, int row)
 {
     QMutexLocker const locker(&m_mutex);
     if (m_exiting) {
         return;
     }
 
-    if (path == m_pathBeingProcessed) {
-        // This task is currently in progress.
-        return;
-    }
-
     std::pair<TasksByPath::iterator, bool> const ins(
         m_rTasksByPath.insert(Task(path, row))
     );
 
-    // Whether inserted or being already there, move it to the front of priority queue.
+    // Whether inserted or being already there, move it to the back of priority queue.
     m_rTasksByPriority.relocate(
         m_rTasksByPriority.end(), m_tasks.project<OrderedByPriorityTag>(ins.first)
     );
 
-    if (!isRunning()) {
-        start();
+    if (!ins.first->dir.isEmpty() && m_dirsBeingListed.count(ins.first->dir)) {
+        // It will be resolved from the listing in progress.
+        return;
     }
 
-    m_cond.wakeOne();
+    if (m_numIdleWorkers > 0) {
+        m_cond.wakeOne();
+    } else if (int(m_workers.size()) < MAX_THREADS) {
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker(this)));
+        m_workers.back()->start();
+    }
 }
 
 void
-RelinkingModel::StatusUpdateThread::run()
+RelinkingModel::StatusUpdatePool::processTasks()
 try
 {
     QMutexLocker const locker(&m_mutex);
@@ -447,33 +499,115 @@ try
             break;
         }
 
-        if (m_tasks.empty()) {
-            m_cond.wait(&m_mutex);
+        // Skip the directories other threads are already listing.
+        TasksByPriority::iterator it(m_rTasksByPriority.begin());
+        while (it != m_rTasksByPriority.end()
+                && !it->dir.isEmpty() && m_dirsBeingListed.count(it->dir)) {
+            ++it;
         }
 
-        if (m_tasks.empty()) {
+        if (it == m_rTasksByPriority.end()) {
+            ++m_numIdleWorkers;
+            m_cond.wait(&m_mutex);
+            --m_numIdleWorkers;
             continue;
         }
 
-        Task const task(m_rTasksByPriority.front());
-        m_pathBeingProcessed = task.path;
-        m_rTasksByPriority.pop_front();
+        std::vector<Task> batch;
+        std::set<QString> keys;
+        bool listed = false;
+
+        if (it->dir.isEmpty()) {
+            batch.push_back(*it);
+            m_rTasksByPriority.erase(it);
+        } else {
+            QString const dir(it->dir);
+            m_dirsBeingListed.insert(dir);
+            {
+                MutexUnlocker const unlocker(&m_mutex);
+                listed = listDir(dir, keys);
+            }
+            m_dirsBeingListed.erase(dir);
+
+            // This includes the tasks requested while we were listing.
+            std::pair<TasksByDir::iterator, TasksByDir::iterator> const range(
+                m_rTasksByDir.equal_range(dir)
+            );
+            batch.assign(range.first, range.second);
+            m_rTasksByDir.erase(range.first, range.second);
+        }
 
         {
             MutexUnlocker const unlocker(&m_mutex);
 
-            bool const exists = QFile::exists(task.path);
-            StatusUpdateResponse const response(task.path, task.row, exists ? Exists : Missing);
-            QCoreApplication::postEvent(m_pOwner, new PayloadEvent<StatusUpdateResponse>(response));
+            for (Task const& task : batch) {
+                bool exists;
+                if (listed) {
+                    QString const file_name(task.path.mid(task.dir.length()));
+                    exists = keys.count(fileNameKey(file_name)) != 0;
+                } else {
+                    exists = QFile::exists(task.path);
+                }
+
+                StatusUpdateResponse const response(task.path, task.row, exists ? Exists : Missing);
+                QCoreApplication::postEvent(m_pOwner, new PayloadEvent<StatusUpdateResponse>(response));
+            }
         }
-
-        m_pathBeingProcessed.clear();
     }
 } catch (std::bad_alloc const&)
 {
     OutOfMemoryHandler::instance().handleOutOfMemorySituation();
 }
 
+QString
+RelinkingModel::StatusUpdatePool::parentDir(QString const& path)
+{
+    int const slash_idx = path.lastIndexOf(QChar('/'));
+    if (slash_idx < 0 || slash_idx == path.length() - 1) {
+        return QString();
+    }
+
+    // Keep the trailing slash, so that "/" and "C:/" stay roots.
+    QString const dir(path.left(slash_idx + 1));
+    if (dir.startsWith(QLatin1String("//")) && dir.count(QChar('/')) < 4) {
+        // "//server/" can't be listed like a directory.
+        return QString();
+    }
+
+    return dir;
+}
+
+QString
+RelinkingModel::StatusUpdatePool::fileNameKey(QString const& file_name)
+{
+#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
+    // These file systems are case insensitive by default.
+    return file_name.toLower();
+#else
+    return file_name;
+#endif
+}
+
+bool
+RelinkingModel::StatusUpdatePool::listDir(QString const& dir, std::set<QString>& keys)
+{
+    QDir const qdir(dir);
+    if (!qdir.exists()) {
+        // Nothing inside it exists either.
+        return true;
+    }
+
+    QStringList const names(
+        qdir.entryList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot)
+    );
+    for (QString const& name : names) {
+        keys.insert(fileNameKey(name));
+    }
+
+    // An empty listing may just mean we aren't allowed to read the directory.
+    return !keys.empty();
+}
+
 /*================================ Item =================================*/
 
 RelinkingModel::Item::Item(RelinkablePath const& path)
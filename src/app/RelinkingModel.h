@@ -94,7 +94,7 @@ public:
 protected:
     virtual void customEvent(QEvent* event);
 private:
-    class StatusUpdateThread;
+    class StatusUpdatePool;
     class StatusUpdateResponse;
 
     /** Stands for File System Object (file or directory). */
@@ -129,7 +129,7 @@ private:
     std::vector<Item> m_items;
     std::set<QString> m_origPathSet;
     IntrusivePtr<Relinker> const m_ptrRelinker;
-    std::unique_ptr<StatusUpdateThread> m_ptrStatusUpdateThread;
+    std::unique_ptr<StatusUpdatePool> m_ptrStatusUpdatePool;
     bool m_haveUncommittedChanges;
 };
 
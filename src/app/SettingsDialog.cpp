@@ -27,6 +27,7 @@
 #include <QResource>
 #include <QColorDialog>
 #include <QMessageBox>
+#include <QThread>
 #include "MainWindow.h"
 #include "filters/output/DespeckleLevel.h"
 #include "filters/output/Params.h"
@@ -506,6 +507,8 @@ void SettingsDialog::on_stackedWidget_currentChanged(int /*arg1*/)
     } else if (currentPage == ui.pageTiffCompression) {
         loadTiffList();
         ui.useHorizontalPredictor->setChecked(m_settings.value(_key_tiff_compr_horiz_pred, _key_tiff_compr_horiz_pred_def).toBool());
+        ui.jpegQuality->setValue(m_settings.value(_key_tiff_compr_jpeg_quality, _key_tiff_compr_jpeg_quality_def).toInt());
+        ui.deflateLevel->setValue(m_settings.value(_key_tiff_compr_deflate_level, _key_tiff_compr_deflate_level_def).toInt());
     } else if (currentPage == ui.pageAutoSaveProject) {
         ui.sbSavePeriod->setValue(abs(m_settings.value(_key_autosave_time_period_min, _key_autosave_time_period_min_def).toInt()));
     } else if (currentPage == ui.pageOutput) {
@@ -545,6 +548,11 @@ void SettingsDialog::on_stackedWidget_currentChanged(int /*arg1*/)
             val);
         ui.showStartBatchProcessingDlg->setChecked(
             !m_settings.value(_key_batch_dialog_remember_choice, _key_batch_dialog_remember_choice_def).toBool());
+        ui.sbBatchProcessingThreads->blockSignals(true);
+        ui.sbBatchProcessingThreads->setMaximum(std::max(ui.sbBatchProcessingThreads->maximum(), QThread::idealThreadCount()));
+        ui.sbBatchProcessingThreads->setValue(
+            m_settings.value(_key_batch_processing_threads, _key_batch_processing_threads_def).toInt());
+        ui.sbBatchProcessingThreads->blockSignals(false);
         ui.cbDontUseNativeDlg->setChecked(
             m_settings.value(_key_dont_use_native_dialog, _key_dont_use_native_dialog_def).toBool());
     } else if (currentPage == ui.pageThumbnails) {
@@ -691,6 +699,11 @@ void SettingsDialog::on_showStartBatchProcessingDlg_clicked(bool checked)
     m_settings.setValue(_key_batch_dialog_remember_choice, !checked);
 }
 
+void SettingsDialog::on_sbBatchProcessingThreads_valueChanged(int value)
+{
+    m_settings.setValue(_key_batch_processing_threads, value);
+}
+
 void SettingsDialog::on_ThresholdDefaultsValue_valueChanged(int arg1)
 {
     int val = arg1;
@@ -720,6 +733,16 @@ void SettingsDialog::on_useHorizontalPredictor_clicked(bool checked)
     m_settings.setValue(_key_tiff_compr_horiz_pred, checked);
 }
 
+void SettingsDialog::on_jpegQuality_valueChanged(int arg1)
+{
+    m_settings.setValue(_key_tiff_compr_jpeg_quality, arg1);
+}
+
+void SettingsDialog::on_deflateLevel_valueChanged(int arg1)
+{
+    m_settings.setValue(_key_tiff_compr_deflate_level, arg1);
+}
+
 void SettingsDialog::on_disableSmoothingBW_clicked(bool checked)
 {
     m_settings.setValue(_key_mode_bw_disable_smoothing, checked);
@@ -63,6 +63,8 @@ private slots:
 
     void on_showStartBatchProcessingDlg_clicked(bool checked);
 
+    void on_sbBatchProcessingThreads_valueChanged(int value);
+
     void on_ThresholdDefaultsValue_valueChanged(int arg1);
 
     void on_dpiDefaultYValue_valueChanged(int arg1);
@@ -71,6 +73,10 @@ private slots:
 
     void on_useHorizontalPredictor_clicked(bool checked);
 
+    void on_jpegQuality_valueChanged(int arg1);
+
+    void on_deflateLevel_valueChanged(int arg1);
+
     void on_disableSmoothingBW_clicked(bool checked);
 
     void on_rectangularAreasSensitivityValue_valueChanged(int arg1);
@@ -18,8 +18,11 @@
 
 #include "SystemLoadWidget.h"
 
+#include "BatchLoadController.h"
 #include "ThreadPriority.h"
 #include "settings/ini_keys.h"
+#include <QSettings>
+#include <QStringList>
 #include <QToolTip>
 
 SystemLoadWidget::SystemLoadWidget(QWidget* parent)
@@ -36,6 +39,24 @@ SystemLoadWidget::SystemLoadWidget(QWidget* parent)
     connect(ui.slider, SIGNAL(valueChanged(int)), SLOT(valueChanged(int)));
     connect(ui.minusBtn, SIGNAL(clicked()), SLOT(decreasePriority()));
     connect(ui.plusBtn, SIGNAL(clicked()), SLOT(increasePriority()));
+
+    ui.adaptiveCB->setChecked(
+        QSettings().value(_key_batch_processing_adaptive, _key_batch_processing_adaptive_def).toBool()
+    );
+    connect(ui.adaptiveCB, SIGNAL(toggled(bool)), SLOT(adaptiveToggled(bool)));
+}
+
+void
+SystemLoadWidget::setController(BatchLoadController* controller)
+{
+    if (m_ptrController) {
+        disconnect(m_ptrController, 0, this, 0);
+    }
+    m_ptrController = controller;
+    if (controller) {
+        connect(controller, SIGNAL(stateChanged()), SLOT(updateStatus()));
+    }
+    updateStatus();
 }
 
 void
@@ -54,6 +75,9 @@ void
 SystemLoadWidget::valueChanged(int prio)
 {
     ThreadPriority((ThreadPriority::Priority)prio).save(_key_batch_processing_priority);
+    if (m_ptrController) {
+        m_ptrController->reloadSettings();
+    }
 }
 
 void
@@ -70,6 +94,54 @@ SystemLoadWidget::increasePriority()
     showHideToolTip(ui.slider->value());
 }
 
+void
+SystemLoadWidget::adaptiveToggled(bool const adaptive)
+{
+    if (m_ptrController) {
+        m_ptrController->setAdaptive(adaptive);
+    } else {
+        QSettings().setValue(_key_batch_processing_adaptive, adaptive);
+    }
+}
+
+void
+SystemLoadWidget::updateStatus()
+{
+    if (!m_ptrController) {
+        ui.statusLabel->clear();
+        ui.statusLabel->setToolTip(QString());
+        return;
+    }
+
+    BatchLoadController::State const& state = m_ptrController->state();
+
+    QStringList parts;
+    parts << tr("%1 of %2 workers").arg(state.workers).arg(state.maxWorkers);
+    if (state.cpuLoad >= 0) {
+        parts << tr("CPU %1%").arg(state.cpuLoad);
+    }
+    ui.statusLabel->setText(parts.join(QStringLiteral(", ")));
+
+    QStringList details;
+    if (state.interacting) {
+        details << tr("Held back while you work with the image.");
+    }
+    if (state.ioLimit > 0) {
+        details << tr("Files read at once: %1").arg(state.ioLimit);
+    } else {
+        details << tr("Files read at once: unlimited");
+    }
+    if (state.memoryLimit > 0) {
+        details << tr("Memory for pages in flight: %1 MiB").arg(state.memoryLimit / (1024 * 1024));
+    } else {
+        details << tr("Memory for pages in flight: unlimited");
+    }
+    if (state.memoryPressure) {
+        details << tr("Physical memory is running low.");
+    }
+    ui.statusLabel->setToolTip(details.join(QChar('\n')));
+}
+
 void
 SystemLoadWidget::showHideToolTip(int prio)
 {
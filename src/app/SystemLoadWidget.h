@@ -21,12 +21,21 @@
 
 #include "ui_SystemLoadWidget.h"
 #include <QWidget>
+#include <QPointer>
 
+class BatchLoadController;
+
+/**
+ * \brief Sets the system load level for batch processing and shows
+ *        the resources a BatchLoadController currently gives it.
+ */
 class SystemLoadWidget : public QWidget
 {
     Q_OBJECT
 public:
     SystemLoadWidget(QWidget* parent = 0);
+
+    void setController(BatchLoadController* controller);
 private slots:
     void sliderPressed();
 
@@ -37,12 +46,17 @@ private slots:
     void decreasePriority();
 
     void increasePriority();
+
+    void adaptiveToggled(bool adaptive);
+
+    void updateStatus();
 private:
     void showHideToolTip(int prio);
 
     static QString tooltipText(int prio);
 
     Ui::SystemLoadWidget ui;
+    QPointer<BatchLoadController> m_ptrController;
 };
 
 #endif
@@ -20,6 +20,7 @@
 
 #include "ThumbnailFactory.h"
 #include "IncompleteThumbnail.h"
+#include "ThumbnailBase.h"
 #include "PageSequence.h"
 #include "PageOrderProvider.h"
 #include "PageInfo.h"
@@ -36,6 +37,7 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/function.hpp>
+#include <boost/ref.hpp>
 #endif
 #include <QGraphicsScene>
 #include <QGraphicsItem>
@@ -43,6 +45,7 @@
 #include <QGraphicsSimpleTextItem>
 #include <QGraphicsPixmapItem>
 #include <QGraphicsView>
+#include <QScrollBar>
 #include <QStyle>
 #include <QStyleOptionGraphicsItem>
 #include <QGraphicsSceneMouseEvent>
@@ -68,6 +71,8 @@
 #include <Qt>
 #include <QDebug>
 #include <algorithm>
+#include <utility>
+#include <vector>
 #include <stddef.h>
 #include <assert.h>
 #include <QMessageBox>
@@ -148,6 +153,18 @@ public:
 
     void attachView(QGraphicsView* view);
 
+    /**
+     * In virtualized mode, puts on the scene the items within a viewport's
+     * distance of the visible area and takes the rest off it.
+     */
+    void materializeAroundView();
+
+    /**
+     * Requests pixmaps for thumbnails within a viewport's distance
+     * of the visible area, nearest ones being served first.
+     */
+    void prefetchAroundView();
+
     void reset(PageSequence const& pages,
                SelectionAction const selection_action,
                IntrusivePtr<PageOrderProvider const> const& provider);
@@ -164,6 +181,8 @@ public:
 
     void invalidateAllThumbnails();
 
+    void invalidateThumbnails(std::set<PageId> const& page_ids);
+
     int  count() const;
 
     bool setSelection(PageId const& page_id, const ThumbnailSequence::SelectionAction action);
@@ -273,6 +292,11 @@ private:
      *        For example, \p dist_from_hint == -2 would indicate that the
      *        insertion position is two elements to the left of \p hint.
      */
+    /**
+     * \brief Sorts m_itemsInOrder using m_ptrOrderProvider.
+     */
+    void sortItemsInOrder();
+
     ItemsInOrder::iterator itemInsertPosition(
         ItemsInOrder::iterator begin, ItemsInOrder::iterator end,
         PageId const& page_id, bool page_incomplete,
@@ -287,6 +311,29 @@ private:
 
     void commitSceneRect();
 
+    /**
+     * Adds a composite item to the scene, unless in virtualized mode,
+     * where materializeAroundView() decides that.  Either way, the
+     * composite is owned by its Item from now on.
+     */
+    void addToScene(CompositeItem* composite);
+
+    bool layoutItems();
+
+    QRectF viewAheadRect() const;
+
+    void rebuildRowIndex();
+
+    /**
+     * A row of thumbnails, as laid out on the scene.
+     */
+    struct Row {
+        double top;
+        double bottom;
+        Item const* first;
+        int numItems;
+    };
+
     ThumbnailSequence& m_rOwner;
     QSizeF m_maxLogicalThumbSize;
     Container m_items;
@@ -304,6 +351,20 @@ private:
     IntrusivePtr<PageOrderProvider const> m_ptrOrderProvider;
     GraphicsScene m_graphicsScene;
     QRectF m_sceneRect;
+    QGraphicsView* m_pView;
+
+    /**
+     * In virtualized mode, only items near the viewport are kept on the scene.
+     * That's enabled for sequences of at least
+     * GlobalStaticSettings::m_thumbsVirtualizeThreshold pages.
+     */
+    bool m_virtualized;
+
+    /**
+     * Rows in top to bottom order.  Only maintained in virtualized mode,
+     * to locate the items near the viewport without going through all of them.
+     */
+    std::vector<Row> m_rows;
 
     ReverseOrderWrapper m_reverseOrder;
     const PageOrderProvider* orderProvider()
@@ -436,6 +497,19 @@ void
 ThumbnailSequence::attachView(QGraphicsView* const view)
 {
     m_ptrImpl->attachView(view);
+
+    connect(
+        view->verticalScrollBar(), SIGNAL(valueChanged(int)),
+        this, SLOT(viewportMoved())
+    );
+    connect(
+        view->verticalScrollBar(), SIGNAL(rangeChanged(int, int)),
+        this, SLOT(viewportMoved())
+    );
+    connect(
+        view->horizontalScrollBar(), SIGNAL(valueChanged(int)),
+        this, SLOT(viewportMoved())
+    );
 }
 
 void
@@ -483,6 +557,12 @@ ThumbnailSequence::invalidateAllThumbnails()
     m_ptrImpl->invalidateAllThumbnails();
 }
 
+void
+ThumbnailSequence::invalidateThumbnails(std::set<PageId> const& page_ids)
+{
+    m_ptrImpl->invalidateThumbnails(page_ids);
+}
+
 int
 ThumbnailSequence::count() const
 {
@@ -596,7 +676,9 @@ ThumbnailSequence::Impl::Impl(
         m_itemsById(m_items.get<ItemsByIdTag>()),
         m_itemsInOrder(m_items.get<ItemsInOrderTag>()),
         m_selectedThenUnselected(m_items.get<SelectedThenUnselectedTag>()),
-        m_pSelectionLeader(0)
+        m_pSelectionLeader(0),
+        m_pView(0),
+        m_virtualized(false)
 {
 	m_graphicsScene.setContextMenuEventCallback(
 		[this](QGraphicsSceneContextMenuEvent* evt) {
@@ -607,6 +689,12 @@ ThumbnailSequence::Impl::Impl(
 
 ThumbnailSequence::Impl::~Impl()
 {
+    // Those on the scene will be deleted by it.
+    for (Item const& item : m_itemsInOrder) {
+        if (!item.composite->scene()) {
+            delete item.composite;
+        }
+    }
 }
 
 void
@@ -619,9 +707,118 @@ ThumbnailSequence::Impl::setThumbnailFactory(
 void
 ThumbnailSequence::Impl::attachView(QGraphicsView* const view)
 {
+    m_pView = view;
     view->setScene(&m_graphicsScene);
 }
 
+QRectF
+ThumbnailSequence::Impl::viewAheadRect() const
+{
+    QRectF const visible(
+        m_pView->mapToScene(m_pView->viewport()->rect()).boundingRect()
+    );
+    return visible.adjusted(
+               -visible.width(), -visible.height(),
+               visible.width(), visible.height()
+           );
+}
+
+void
+ThumbnailSequence::Impl::addToScene(CompositeItem* const composite)
+{
+    if (!m_virtualized) {
+        m_graphicsScene.addItem(composite);
+    }
+}
+
+void
+ThumbnailSequence::Impl::rebuildRowIndex()
+{
+    m_rows.clear();
+
+    for (Item const& item : m_itemsInOrder) {
+        CompositeItem const* composite = item.composite;
+        QRectF const rect(composite->mapToScene(composite->boundingRect()).boundingRect());
+        if (composite->col() == 0 || m_rows.empty()) {
+            Row const row = { rect.top(), rect.bottom(), &item, 0 };
+            m_rows.push_back(row);
+        }
+        Row& row = m_rows.back();
+        row.bottom = std::max(row.bottom, rect.bottom());
+        ++row.numItems;
+    }
+}
+
+void
+ThumbnailSequence::Impl::materializeAroundView()
+{
+    if (!m_virtualized || !m_pView) {
+        return;
+    }
+
+    QRectF const ahead(viewAheadRect());
+
+    // Only composite items are top level ones.
+    for (QGraphicsItem* item : m_graphicsScene.items()) {
+        if (!item->parentItem() && !ahead.intersects(item->sceneBoundingRect())) {
+            m_graphicsScene.removeItem(item);
+        }
+    }
+
+    // Rows don't overlap, so they are sorted by their bottoms as well.
+    std::vector<Row>::const_iterator row(
+        std::lower_bound(
+            m_rows.begin(), m_rows.end(), ahead.top(),
+            [](Row const& r, double y) {
+                return r.bottom < y;
+            }
+        )
+    );
+    for (; row != m_rows.end() && row->top <= ahead.bottom(); ++row) {
+        ItemsInOrder::iterator it(m_itemsInOrder.iterator_to(*row->first));
+        for (int i = 0; i < row->numItems; ++i, ++it) {
+            if (it->composite->scene() != &m_graphicsScene) {
+                m_graphicsScene.addItem(it->composite);
+            }
+        }
+    }
+}
+
+void
+ThumbnailSequence::Impl::prefetchAroundView()
+{
+    if (!m_pView) {
+        return;
+    }
+
+    QRectF const visible(
+        m_pView->mapToScene(m_pView->viewport()->rect()).boundingRect()
+    );
+    QRectF const ahead(viewAheadRect());
+
+    std::vector<std::pair<double, ThumbnailBase*> > thumbs;
+    for (QGraphicsItem* item : m_graphicsScene.items(ahead)) {
+        if (ThumbnailBase* thumb = dynamic_cast<ThumbnailBase*>(item)) {
+            QPointF const d(thumb->sceneBoundingRect().center() - visible.center());
+            thumbs.push_back(std::make_pair(d.x() * d.x() + d.y() * d.y(), thumb));
+        }
+    }
+
+    // The cache serves the most recent requests first, so the farthest
+    // thumbnails go first and the nearest ones go last.
+    std::sort(
+        thumbs.begin(), thumbs.end(),
+        [](std::pair<double, ThumbnailBase*> const& lhs,
+           std::pair<double, ThumbnailBase*> const& rhs) {
+            return lhs.first > rhs.first;
+        }
+    );
+
+    for (auto const& entry : thumbs) {
+        entry.second->prefetch();
+    }
+}
+
 void
 ThumbnailSequence::Impl::reset(
     PageSequence const& pages,
@@ -646,6 +843,9 @@ ThumbnailSequence::Impl::reset(
         return;
     }
 
+    m_virtualized = GlobalStaticSettings::m_thumbsVirtualizeThreshold > 0
+                    && int(pages.numPages()) >= GlobalStaticSettings::m_thumbsVirtualizeThreshold;
+
     Item const* some_selected_item = 0;
 
     for (const PageInfo& page_info : pages) {
@@ -743,7 +943,7 @@ ThumbnailSequence::Impl::invalidateThumbnailImpl(ItemsById::iterator const id_it
 
     new_composite->updateAppearence(id_it->isSelected(), id_it->isSelectionLeader());
 
-    m_graphicsScene.addItem(composite.release());
+    addToScene(composite.release());
     id_it->composite = new_composite;
     id_it->incompleteThumbnail = new_composite->incompleteThumbnail();
     delete old_composite;
@@ -884,6 +1084,11 @@ ThumbnailSequence::Impl::invalidateThumbnailImpl(ItemsById::iterator const id_it
     id_it->composite->updateSceneRect(m_sceneRect);
     commitSceneRect();
 
+    if (m_virtualized) {
+        rebuildRowIndex();
+        materializeAroundView();
+    }
+
     // Possibly emit the newSelectionLeader() signal.
     if (m_pSelectionLeader == &*id_it) {
         if (old_size != new_size || old_pos != id_it->composite->pos()) {
@@ -917,21 +1122,82 @@ ThumbnailSequence::Impl::invalidateAllThumbnails()
         CompositeItem* const old_composite = ord_it->composite;
         ord_it->composite = getCompositeItem(&*ord_it, ord_it->pageInfo, orderProvider()).release();
         ord_it->incompleteThumbnail = ord_it->composite->incompleteThumbnail();
+        ord_it->composite->updateAppearence(ord_it->isSelected(), ord_it->isSelectionLeader());
         delete old_composite;
     }
 
-    // Sort pages in m_itemsInOrder using m_ptrOrderProvider.
-    if (const PageOrderProvider* order = orderProvider()) {
-        m_itemsInOrder.sort(
-                    [this](Item const& lhs, Item const& rhs) {
-                        return m_ptrOrderProvider->precedes(
-                            lhs.pageId(), lhs.incompleteThumbnail,
-                            rhs.pageId(), rhs.incompleteThumbnail
-                        );
-                    }
+    if (orderProvider()) {
+        sortItemsInOrder();
+    }
+
+    if (!layoutItems()) {
+        return;
+    }
+
+    for (Item const& item : m_itemsInOrder) {
+        addToScene(item.composite);
+    }
+}
+
+void
+ThumbnailSequence::Impl::invalidateThumbnails(std::set<PageId> const& page_ids)
+{
+    if (page_ids.empty()) {
+        return;
+    }
+
+    Item const* const leader = m_pSelectionLeader;
+    QRectF old_leader_rect;
+    if (leader) {
+        old_leader_rect = leader->composite->mapToScene(
+                              leader->composite->boundingRect()
+                          ).boundingRect();
+    }
+
+    for (PageId const& page_id : page_ids) {
+        ItemsById::iterator const id_it(m_itemsById.find(page_id));
+        if (id_it == m_itemsById.end()) {
+            continue;
+        }
+
+        CompositeItem* const old_composite = id_it->composite;
+        CompositeItem* const new_composite =
+            getCompositeItem(&*id_it, id_it->pageInfo, orderProvider()).release();
+        new_composite->updateAppearence(id_it->isSelected(), id_it->isSelectionLeader());
+        addToScene(new_composite);
+        id_it->composite = new_composite;
+        id_it->incompleteThumbnail = new_composite->incompleteThumbnail();
+        delete old_composite;
+    }
+
+    if (orderProvider()) {
+        sortItemsInOrder();
+    }
+
+    layoutItems();
+
+    // Possibly emit the newSelectionLeader() signal.
+    if (leader && leader == m_pSelectionLeader
+            && page_ids.find(leader->pageInfo.id()) != page_ids.end()) {
+        QRectF const new_leader_rect(
+            leader->composite->mapToScene(leader->composite->boundingRect()).boundingRect()
         );
+        if (new_leader_rect != old_leader_rect) {
+            m_rOwner.emitNewSelectionLeader(
+                leader->pageInfo, leader->composite, REDUNDANT_SELECTION
+            );
+        }
     }
+}
 
+/**
+ * Positions all the items in their current order, and updates
+ * the scene rect.  Returns false if there is no view to lay them
+ * out for, in which case nothing is done.
+ */
+bool
+ThumbnailSequence::Impl::layoutItems()
+{
     m_sceneRect = QRectF(0.0, 0.0, 0.0, 0.0);
 
     int view_width = 0;
@@ -946,11 +1212,12 @@ ThumbnailSequence::Impl::invalidateAllThumbnails()
     }
 
     if (view_width == 0) {
-        return; // could be 0 if invoked from export to... func
+        return false; // could be 0 if invoked from export to... func
     }
 
     double yoffset = GlobalStaticSettings::m_thumbsMinSpacing;
-    ord_it = m_itemsInOrder.begin();
+    ItemsInOrder::iterator ord_it(m_itemsInOrder.begin());
+    ItemsInOrder::iterator const ord_end(m_itemsInOrder.end());
 
     int cur_row = 0;
 
@@ -982,8 +1249,6 @@ ThumbnailSequence::Impl::invalidateAllThumbnails()
             composite->setPos(xoffset, yoffset);
             composite->setPosInView(cur_row, col);
             composite->updateSceneRect(m_sceneRect);
-            composite->updateAppearence(ord_it->isSelected(), ord_it->isSelectionLeader());
-            m_graphicsScene.addItem(composite);
             xoffset += composite->boundingRect().width() + adj_spacing;
             next_yoffset = std::max(composite->boundingRect().height() + GlobalStaticSettings::m_thumbsMinSpacing, next_yoffset);
         }
@@ -995,6 +1260,13 @@ ThumbnailSequence::Impl::invalidateAllThumbnails()
     }
 
     commitSceneRect();
+
+    if (m_virtualized) {
+        rebuildRowIndex();
+        materializeAroundView();
+    }
+
+    return true;
 }
 
 //begin of modified by monday2000
@@ -1073,6 +1345,13 @@ ThumbnailSequence::maxLogicalThumbSize() const
     return m_ptrImpl->maxLogicalThumbSize();
 }
 
+void
+ThumbnailSequence::viewportMoved()
+{
+    m_ptrImpl->materializeAroundView();
+    m_ptrImpl->prefetchAroundView();
+}
+
 void
 ThumbnailSequence::on_pagesMaybeTargeted(const std::vector<PageId> pages)
 {
@@ -1341,7 +1620,7 @@ ThumbnailSequence::Impl::insert(
         m_itemsInOrder.insert(ord_it, item)
     );
     composite->setItem(&*ins.first);
-    m_graphicsScene.addItem(composite.release());
+    addToScene(composite.release());
 
     // there are some problems with insertion AFTER last page in row
     // so just invalidate all
@@ -1753,6 +2032,7 @@ ThumbnailSequence::Impl::clear()
     }
 
     assert(m_graphicsScene.items().empty());
+    m_rows.clear();
 
     m_sceneRect = QRectF(0.0, 0.0, 0.0, 0.0);
     commitSceneRect();
@@ -1785,6 +2065,49 @@ ThumbnailSequence::Impl::countSelection()
     return res;
 }
 
+void
+ThumbnailSequence::Impl::sortItemsInOrder()
+{
+    typedef std::pair<PageOrderProvider::SortKey, Item const*> KeyedItem;
+
+    // Look up each page once, rather than twice per comparison.
+    std::vector<KeyedItem> keyed_items;
+    keyed_items.reserve(m_itemsInOrder.size());
+    for (Item const& item : m_itemsInOrder) {
+        PageOrderProvider::SortKey key = PageOrderProvider::SortKey();
+        if (!m_ptrOrderProvider->sortKey(item.pageId(), item.incompleteThumbnail, key)) {
+            m_itemsInOrder.sort(
+                [this](Item const& lhs, Item const& rhs) {
+                    return m_ptrOrderProvider->precedes(
+                        lhs.pageId(), lhs.incompleteThumbnail,
+                        rhs.pageId(), rhs.incompleteThumbnail
+                    );
+                }
+            );
+            return;
+        }
+        keyed_items.push_back(KeyedItem(key, &item));
+    }
+
+    std::stable_sort(
+        keyed_items.begin(), keyed_items.end(),
+        [](KeyedItem const& lhs, KeyedItem const& rhs) {
+            if (lhs.first != rhs.first) {
+                return lhs.first < rhs.first;
+            } else {
+                return lhs.second->pageId() < rhs.second->pageId();
+            }
+        }
+    );
+
+    std::vector<boost::reference_wrapper<Item const> > order;
+    order.reserve(keyed_items.size());
+    for (KeyedItem const& keyed_item : keyed_items) {
+        order.push_back(boost::cref(*keyed_item.second));
+    }
+    m_itemsInOrder.rearrange(order.begin());
+}
+
 ThumbnailSequence::Impl::ItemsInOrder::iterator
 ThumbnailSequence::Impl::itemInsertPosition(
     ItemsInOrder::iterator const begin, ItemsInOrder::iterator const end,
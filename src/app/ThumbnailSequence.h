@@ -131,6 +131,17 @@ public:
      */
     void invalidateAllThumbnails();
 
+    /**
+     * \brief Updates appearance of the given thumbnails and possibly
+     *        the order of all of them.
+     *
+     * That's what to call when a setting was applied to a number
+     * of pages.  Only the given thumbnails are recreated, and the
+     * items are laid out once, rather than once per page as
+     * invalidateThumbnail() would do.
+     */
+    void invalidateThumbnails(std::set<PageId> const& page_ids);
+
     /**
      * Returns count of items.
      */
@@ -232,6 +243,8 @@ public:
     QSizeF maxLogicalThumbSize() const;
 public slots:
     void on_pagesMaybeTargeted(const std::vector<PageId> pages);
+private slots:
+    void viewportMoved();
 
 signals:
     void newSelectionLeader(
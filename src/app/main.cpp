@@ -23,6 +23,13 @@
 #include "TiffMetadataLoader.h"
 #include "JpegMetadataLoader.h"
 #include "GenericMetadataLoader.h"
+#include "MemoryBudget.h"
+#include "NumaTopology.h"
+#include "PixelBufferPool.h"
+#include "AnalysisResolution.h"
+#include "PageTimings.h"
+#include "DecodedImageCache.h"
+#include "TraceRecorder.h"
 #include "settings/ini_keys.h"
 #include <QMetaType>
 #include <QtPlugin>
@@ -163,6 +170,34 @@ int main(int argc, char** argv)
         return 0;
     }
 
+    QString trace_file(TraceRecorder::initFromEnvironment());
+    if (cli.hasTrace()) {
+        trace_file = cli.getTraceFile();
+        TraceRecorder::setEnabled(true);
+    }
+
+    // Lets pages be ordered by processing time.
+    PageTimings::setEnabled(true);
+
+    if (cli.hasNuma()) {
+        NumaTopology::setEnabled(true);
+    }
+
+    if (cli.hasDisableHugePages()) {
+        PixelBufferPool::setHugePagesEnabled(false);
+    }
+
+    if (cli.hasAdaptiveAnalysis()) {
+        AnalysisResolution::setAdaptive(true);
+    }
+
+    if (cli.hasMemoryLimit()) {
+        MemoryBudget::setLimit(cli.getMemoryLimit() * 1024 * 1024);
+    }
+    if (cli.hasImageCache()) {
+        DecodedImageCache::setLimit(cli.getImageCacheSize() * 1024 * 1024);
+    }
+
     QSettings settings;
 
     PngMetadataLoader::registerMyself();
@@ -176,10 +211,6 @@ int main(int argc, char** argv)
 
     QObject::connect(main_wnd, &MainWindow::settingsUpdateRequest, CommandLine::updateSettings);
 
-    if (cli.hasLanguage()) {
-        main_wnd->changeLanguage(cli.getLanguage(), true);
-    }
-
     if (settings.value(_key_app_maximized, _key_app_maximized_def) == false) {
         main_wnd->show();
     } else {
@@ -191,5 +222,16 @@ int main(int argc, char** argv)
         main_wnd->openProject(cli.projectFile());
     }
 
-    return app.exec();
+    if (cli.hasStartupBenchmark()) {
+        // Queued after the show events, so the event loop spins once.
+        QTimer::singleShot(0, &app, &QCoreApplication::quit);
+    }
+
+    int const ret = app.exec();
+
+    if (!trace_file.isEmpty()) {
+        TraceRecorder::writeChromeTrace(trace_file);
+    }
+
+    return ret;
 }
@@ -0,0 +1,145 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "BatchJournal.h"
+#include <QMutexLocker>
+#include <QByteArray>
+#include <QList>
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+
+char const CHECKPOINT_LINE[] = "checkpoint\n";
+
+} // anonymous namespace
+
+BatchJournal::BatchJournal(
+    QString const& path, bool const resume,
+    int const checkpoint_interval, CheckpointHandler const& checkpoint)
+    :   m_file(path),
+        m_checkpoint(checkpoint),
+        m_checkpointInterval(std::max(1, checkpoint_interval)),
+        m_pagesSinceCheckpoint(0)
+{
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if (!resume) {
+        mode |= QIODevice::Truncate;
+    }
+    if (!m_file.open(mode)) {
+        throw std::runtime_error(
+            ("Unable to open the journal " + path).toLocal8Bit().constData()
+        );
+    }
+
+    if (resume) {
+        read();
+    }
+}
+
+bool
+BatchJournal::isDone(int const filter_idx, PageId const& page) const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_done.count(Entry(filter_idx, pageKey(page))) != 0;
+}
+
+void
+BatchJournal::pageDone(int const filter_idx, PageId const& page)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    QByteArray const line(
+        QString("%1\t%2\n").arg(filter_idx).arg(pageKey(page)).toUtf8()
+    );
+    m_file.write(line);
+    m_file.flush();
+
+    if (++m_pagesSinceCheckpoint >= m_checkpointInterval) {
+        checkpointLocked();
+    }
+}
+
+void
+BatchJournal::checkpoint()
+{
+    QMutexLocker const locker(&m_mutex);
+    if (m_pagesSinceCheckpoint > 0) {
+        checkpointLocked();
+    }
+}
+
+void
+BatchJournal::checkpointLocked()
+{
+    // Pages can't be journaled while we are here, so every page
+    // journaled so far has its settings saved by the handler.
+    m_checkpoint();
+    m_file.write(CHECKPOINT_LINE);
+    m_file.flush();
+    m_pagesSinceCheckpoint = 0;
+}
+
+QString
+BatchJournal::pageKey(PageId const& page)
+{
+    return QString("%1\t%2\t%3").arg(PageId::subPageToString(page.subPage()))
+           .arg(page.imageId().page()).arg(page.imageId().filePath());
+}
+
+void
+BatchJournal::read()
+{
+    std::set<Entry> done;
+    QList<Entry> pending;
+    qint64 committed_size = 0;
+
+    m_file.seek(0);
+    while (!m_file.atEnd()) {
+        QByteArray const line(m_file.readLine());
+        if (!line.endsWith('\n')) {
+            break; // Cut short by a crash.
+        }
+
+        if (line == CHECKPOINT_LINE) {
+            for (Entry const& entry : pending) {
+                done.insert(entry);
+            }
+            pending.clear();
+            committed_size = m_file.pos();
+            continue;
+        }
+
+        QString const str(QString::fromUtf8(line.constData(), line.size() - 1));
+        int const tab = str.indexOf('\t');
+        bool ok = false;
+        int const filter_idx = str.left(tab).toInt(&ok);
+        if (tab < 0 || !ok) {
+            break;
+        }
+        pending.push_back(Entry(filter_idx, str.mid(tab + 1)));
+    }
+
+    // Pages after the last checkpoint have to be done again,
+    // and must not be taken as done by the next checkpoint.
+    m_file.resize(committed_size);
+    m_file.seek(committed_size);
+    m_done.swap(done);
+}
@@ -0,0 +1,99 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BATCHJOURNAL_H_
+#define BATCHJOURNAL_H_
+
+#include "NonCopyable.h"
+#include "PageId.h"
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <boost/function.hpp>
+#include <set>
+#include <utility>
+
+/**
+ * \brief Records which pages a scantailor-cli run has finished.
+ *
+ * Finished pages are appended to a journal file, one line each.
+ * Every so often the settings of all filters are saved by a
+ * checkpoint handler, after which a checkpoint line is appended.
+ * Only pages journaled before the last checkpoint line are known
+ * to have their settings saved, so only those count as finished
+ * when the journal is read back, and anything after that line is
+ * discarded.
+ */
+class BatchJournal
+{
+    DECLARE_NON_COPYABLE(BatchJournal)
+public:
+    /**
+     * Saves the settings of all filters.  Called with no pages being
+     * journaled at the same time.
+     */
+    typedef boost::function<void()> CheckpointHandler;
+
+    /**
+     * \brief Opens the journal.
+     *
+     * \param path The journal file.
+     * \param resume Whether to read back an existing journal, rather
+     *        than to start from scratch.
+     * \param checkpoint_interval The number of pages between checkpoints.
+     * \param checkpoint Called to make a checkpoint.
+     * Throws std::runtime_error if the file can't be opened.
+     */
+    BatchJournal(QString const& path, bool resume,
+                 int checkpoint_interval, CheckpointHandler const& checkpoint);
+
+    /**
+     * \brief Whether \p page was finished by \p filter_idx as of the last checkpoint.
+     */
+    bool isDone(int filter_idx, PageId const& page) const;
+
+    /**
+     * \brief Journals a finished page, possibly making a checkpoint.
+     *
+     * May be called from several threads at once.
+     */
+    void pageDone(int filter_idx, PageId const& page);
+
+    /**
+     * \brief Makes a checkpoint, unless no pages were journaled since the last one.
+     */
+    void checkpoint();
+private:
+    typedef std::pair<int, QString> Entry;
+
+    static QString pageKey(PageId const& page);
+
+    void read();
+
+    void checkpointLocked();
+
+    mutable QMutex m_mutex;
+    QFile m_file;
+    std::set<Entry> m_done;
+    CheckpointHandler m_checkpoint;
+    int m_checkpointInterval;
+    int m_pagesSinceCheckpoint;
+};
+
+#endif
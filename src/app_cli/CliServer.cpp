@@ -0,0 +1,290 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "CliServer.h"
+#include "CommandLine.h"
+#include "ConsoleBatch.h"
+#include "Metrics.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QJsonObject>
+#include <QRunnable>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonValue>
+#include <QJsonParseError>
+#include <QMetaObject>
+#include <QByteArray>
+#include <boost/bind.hpp>
+#include <exception>
+#include <memory>
+#include <iostream>
+
+class CliServer::JobRunnable : public QRunnable
+{
+public:
+    JobRunnable(CliServer* server, int job_id, QStringList const& args)
+        :   m_pServer(server), m_jobId(job_id), m_args(args) {}
+
+    virtual void run();
+private:
+    void report(QString const& line);
+
+    void reportProgress(int filter_idx, int pages_done, int num_pages);
+
+    CliServer* m_pServer;
+    int m_jobId;
+    QStringList m_args;
+};
+
+void
+CliServer::JobRunnable::run()
+{
+    Metrics::addToGauge(Metrics::JOBS_QUEUED, -1);
+    report("started");
+
+    // CommandLine skips the program name.
+    CommandLine cli(QStringList("scantailor-cli") + m_args, false);
+    if (cli.isError()) {
+        report("failed invalid arguments");
+        return;
+    }
+    if (cli.outputDirectory().isEmpty() || (cli.images().size() == 0 && cli.projectFile().isEmpty() && !cli.hasWatch())) {
+        report("failed no input images or output directory");
+        return;
+    }
+    CommandLine::set(cli);
+
+    try {
+        std::unique_ptr<ConsoleBatch> cbatch(ConsoleBatch::create(cli));
+        cbatch->setProgressCallback(boost::bind(&JobRunnable::reportProgress, this, _1, _2, _3));
+        cbatch->process();
+        if (cli.hasOutputProject()) {
+            cbatch->saveProject(cli.outputProjectFile());
+        }
+    } catch (std::exception const& e) {
+        report(QString("failed ") + QString::fromLocal8Bit(e.what()).simplified());
+        return;
+    }
+
+    report("done");
+}
+
+void
+CliServer::JobRunnable::report(QString const& line)
+{
+    QMetaObject::invokeMethod(
+        m_pServer, "sendLine", Qt::QueuedConnection,
+        Q_ARG(int, m_jobId), Q_ARG(QString, line)
+    );
+}
+
+void
+CliServer::JobRunnable::reportProgress(int const filter_idx, int const pages_done, int const num_pages)
+{
+    report(QString("progress %1 %2/%3").arg(filter_idx + 1).arg(pages_done).arg(num_pages));
+}
+
+CliServer::CliServer(QObject* parent)
+    :   QObject(parent),
+        m_pServer(new QLocalServer(this)),
+        m_pMetricsServer(new QTcpServer(this)),
+        m_lastJobId(0)
+{
+    // One job at a time, see the class description.
+    m_jobPool.setMaxThreadCount(1);
+
+    connect(m_pServer, SIGNAL(newConnection()), SLOT(newConnection()));
+    connect(m_pMetricsServer, SIGNAL(newConnection()), SLOT(newMetricsConnection()));
+    connect(&m_statusTimer, SIGNAL(timeout()), SLOT(printStatusLine()));
+}
+
+CliServer::~CliServer()
+{
+    m_jobPool.waitForDone();
+}
+
+bool
+CliServer::listen(QString const& name)
+{
+    // Clean up after a server that didn't exit cleanly.
+    QLocalServer::removeServer(name);
+
+    if (!m_pServer->listen(name)) {
+        std::cerr << "Unable to listen on " << name.toLocal8Bit().constData()
+                  << ": " << m_pServer->errorString().toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void
+CliServer::newConnection()
+{
+    while (QLocalSocket* socket = m_pServer->nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), SLOT(readJobs()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void
+CliServer::readJobs()
+{
+    QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+    if (!socket) {
+        return;
+    }
+
+    while (socket->canReadLine()) {
+        QByteArray const line(socket->readLine().trimmed());
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        QJsonParseError error;
+        QJsonDocument const doc(QJsonDocument::fromJson(line, &error));
+        if (error.error != QJsonParseError::NoError || !doc.isArray()) {
+            socket->write("0 failed a job must be a JSON array of arguments\n");
+            continue;
+        }
+
+        QStringList args;
+        for (QJsonValue const& arg : doc.array()) {
+            args.push_back(arg.toString());
+        }
+        submitJob(socket, args);
+    }
+}
+
+void
+CliServer::submitJob(QLocalSocket* socket, QStringList const& args)
+{
+    int const job_id = ++m_lastJobId;
+    m_jobSockets[job_id] = socket;
+    sendLine(job_id, "queued");
+    Metrics::addToGauge(Metrics::JOBS_QUEUED, 1);
+
+    // QThreadPool takes ownership of runnables with autoDelete() set.
+    m_jobPool.start(new JobRunnable(this, job_id, args));
+}
+
+void
+CliServer::sendLine(int const job_id, QString const& line)
+{
+    QPointer<QLocalSocket> const socket(m_jobSockets.value(job_id));
+    if (socket) {
+        socket->write(QString("%1 %2\n").arg(job_id).arg(line).toUtf8());
+    }
+
+    if (line == "done" || line.startsWith("failed")) {
+        m_jobSockets.remove(job_id);
+    }
+}
+
+bool
+CliServer::listenMetrics(QString const& address)
+{
+    QHostAddress host(QHostAddress::LocalHost);
+    QString port(address);
+    int const colon = address.lastIndexOf(':');
+    if (colon >= 0) {
+        // IPv6 addresses come in brackets, like [::1]:9100.
+        host = QHostAddress(address.left(colon).remove(QChar('[')).remove(QChar(']')));
+        port = address.mid(colon + 1);
+    }
+
+    bool ok = false;
+    quint16 const port_num = port.toUShort(&ok);
+    if (!ok || host.isNull()) {
+        std::cerr << "Invalid metrics address: " << address.toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+
+    if (!m_pMetricsServer->listen(host, port_num)) {
+        std::cerr << "Unable to serve metrics on " << address.toLocal8Bit().constData()
+                  << ": " << m_pMetricsServer->errorString().toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void
+CliServer::startStatusLines(int const secs)
+{
+    m_sinceLastStatus.start();
+    m_statusTimer.start(secs * 1000);
+}
+
+void
+CliServer::newMetricsConnection()
+{
+    while (QTcpSocket* socket = m_pMetricsServer->nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), SLOT(readMetricsRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void
+CliServer::readMetricsRequest()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) {
+        return;
+    }
+
+    // The request line is all we need.  The rest of the headers are ignored.
+    if (!socket->canReadLine()) {
+        if (socket->bytesAvailable() > 8192) {
+            socket->abort();
+        }
+        return;
+    }
+    QList<QByteArray> const request(socket->readLine().simplified().split(' '));
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(readMetricsRequest()));
+
+    QByteArray status("200 OK");
+    QByteArray body;
+    if (request.size() < 2 || request[0] != "GET") {
+        status = "405 Method Not Allowed";
+    } else if (request[1] != "/metrics") {
+        status = "404 Not Found";
+    } else {
+        body = Metrics::prometheusText();
+    }
+
+    QByteArray response("HTTP/1.0 " + status + "\r\n");
+    response += "Content-Type: text/plain; version=0.0.4\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
+
+void
+CliServer::printStatusLine()
+{
+    QJsonObject const status(
+        Metrics::status(m_lastCounters, m_sinceLastStatus.restart())
+    );
+    std::cout << QJsonDocument(status).toJson(QJsonDocument::Compact).constData() << std::endl;
+}
@@ -0,0 +1,119 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CLISERVER_H_
+#define CLISERVER_H_
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QPointer>
+#include <QThreadPool>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <vector>
+
+class QLocalServer;
+class QLocalSocket;
+class QTcpServer;
+
+/**
+ * \brief Runs scantailor-cli jobs sent over a local socket.
+ *
+ * Started by scantailor-cli --serve=<name>, it saves batch jobs the
+ * cost of starting a process, initializing Qt and loading settings.
+ * A client writes one job per line, as a JSON array of the arguments
+ * it would otherwise pass to scantailor-cli, for example:
+ * \code
+ * ["--threads=4", "--color-mode=mixed", "book.ScanTailor", "out"]
+ * \endcode
+ * Every job gets a number, and the connection it came from receives
+ * lines of the form:
+ * \code
+ * <job> queued
+ * <job> started
+ * <job> progress <filter> <pages done>/<pages in pass>
+ * <job> done
+ * <job> failed <error message>
+ * \endcode
+ * Jobs run one at a time, in the order they were received, as
+ * CommandLine is global to the process.  Each of them still processes
+ * its pages in parallel according to its own --threads, under the
+ * memory budget given to the server with --memory-limit.
+ *
+ * For monitoring, the server can serve Metrics over HTTP, as Prometheus
+ * scrapes them, and print a JSON status line every so often.
+ */
+class CliServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CliServer(QObject* parent = 0);
+
+    virtual ~CliServer();
+
+    /**
+     * \brief Starts accepting connections.
+     *
+     * Returns false and prints the reason if the socket can't be created.
+     */
+    bool listen(QString const& name);
+
+    /**
+     * \brief Starts serving Metrics::prometheusText() at /metrics.
+     *
+     * \param address "[<address>:]<port>".  The address defaults
+     *        to 127.0.0.1.
+     * Returns false and prints the reason if the port can't be bound.
+     */
+    bool listenMetrics(QString const& address);
+
+    /**
+     * \brief Prints Metrics::status() to standard output every \p secs seconds.
+     */
+    void startStatusLines(int secs);
+private slots:
+    void newConnection();
+
+    void readJobs();
+
+    void sendLine(int job_id, QString const& line);
+
+    void newMetricsConnection();
+
+    void readMetricsRequest();
+
+    void printStatusLine();
+private:
+    class JobRunnable;
+
+    void submitJob(QLocalSocket* socket, QStringList const& args);
+
+    QLocalServer* m_pServer;
+    QTcpServer* m_pMetricsServer;
+    QTimer m_statusTimer;
+    QElapsedTimer m_sinceLastStatus;
+    std::vector<qint64> m_lastCounters;
+    QThreadPool m_jobPool;
+    QMap<int, QPointer<QLocalSocket> > m_jobSockets;
+    int m_lastJobId;
+};
+
+#endif
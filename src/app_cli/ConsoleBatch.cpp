@@ -19,6 +19,9 @@
 */
 
 #include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
 #include <iostream>
 #include <assert.h>
 
@@ -33,13 +36,17 @@
 #include "ImageFileInfo.h"
 #include "PageInfo.h"
 #include "PageSequence.h"
+#include "PageSet.h"
 #include "ImageId.h"
 #include "ThumbnailPixmapCache.h"
+#include "IntermediateCache.h"
+#include "OutputCache.h"
 #include "LoadFileTask.h"
 #include "ProjectWriter.h"
 #include "ProjectReader.h"
 #include "OrthogonalRotation.h"
 #include "SelectedPage.h"
+#include "FilterData.h"
 
 #include "filters/fix_orientation/Settings.h"
 #include "filters/fix_orientation/Filter.h"
@@ -65,14 +72,330 @@
 #include "filters/output/Params.h"
 #include "filters/output/Filter.h"
 #include "filters/output/Task.h"
+#include "filters/output/Rendition.h"
 #include "filters/output/CacheDrivenTask.h"
 
 #include <QMap>
+#include <QDir>
 #include <QImage>
-#include <QDomDocument>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QThread>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QSize>
+#include <boost/bind.hpp>
 
 #include "ConsoleBatch.h"
+#include "BatchJournal.h"
+#include "PageCostModel.h"
 #include "CommandLine.h"
+#include "SmartFilenameOrdering.h"
+#include "MemoryBudget.h"
+#include "ImagePrefetcher.h"
+#include "NumaTopology.h"
+#include "OutputWriteQueue.h"
+#include "Metrics.h"
+#include "NonCopyable.h"
+
+namespace
+{
+
+/**
+ * Counts finished pages and forwards the count to a
+ * ConsoleBatch::ProgressCallback, one call at a time.
+ * Finished pages are also journaled, if there is a journal,
+ * and timed for the cost model, if there is one.
+ * Pages of the pass count as queued in Metrics until they start.
+ */
+class ProgressCounter
+{
+public:
+    /**
+     * A page being processed.  Counts as running in Metrics
+     * for its lifetime.
+     */
+    class Page
+    {
+        DECLARE_NON_COPYABLE(Page)
+    public:
+        Page(ProgressCounter& owner, int page_idx);
+
+        ~Page();
+
+        void done();
+    private:
+        ProgressCounter& m_rOwner;
+        int m_pageIdx;
+        QElapsedTimer m_timer;
+    };
+
+    ProgressCounter(ConsoleBatch::ProgressCallback const& callback, BatchJournal* journal,
+                    PageCostModel* cost_model, int filter_idx, char const* stage,
+                    std::vector<PageInfo> const& pages)
+        :   m_callback(callback), m_pJournal(journal), m_pCostModel(cost_model),
+            m_filterIdx(filter_idx), m_pStage(stage), m_rPages(pages),
+            m_pagesDone(0), m_pagesStarted(0)
+    {
+        Metrics::addToGauge(Metrics::PAGES_QUEUED, pages.size());
+    }
+
+    ~ProgressCounter()
+    {
+        // Pages that never started, because of an error.
+        Metrics::addToGauge(Metrics::PAGES_QUEUED, m_pagesStarted.load() - qint64(m_rPages.size()));
+    }
+private:
+    void pageDone(int const page_idx)
+    {
+        if (m_pJournal) {
+            m_pJournal->pageDone(m_filterIdx, m_rPages[page_idx].id());
+        }
+
+        QMutexLocker const locker(&m_mutex);
+        ++m_pagesDone;
+        if (m_callback) {
+            m_callback(m_filterIdx, m_pagesDone, m_rPages.size());
+        }
+    }
+
+    QMutex m_mutex;
+    ConsoleBatch::ProgressCallback m_callback;
+    BatchJournal* m_pJournal;
+    PageCostModel* m_pCostModel;
+    int m_filterIdx;
+    char const* m_pStage;
+    std::vector<PageInfo> const& m_rPages;
+    int m_pagesDone;
+    QAtomicInt m_pagesStarted;
+};
+
+ProgressCounter::Page::Page(ProgressCounter& owner, int const page_idx)
+    :   m_rOwner(owner), m_pageIdx(page_idx)
+{
+    owner.m_pagesStarted.fetchAndAddRelaxed(1);
+    Metrics::addToGauge(Metrics::PAGES_QUEUED, -1);
+    Metrics::addToGauge(Metrics::PAGES_RUNNING, 1);
+    m_timer.start();
+}
+
+ProgressCounter::Page::~Page()
+{
+    Metrics::addToGauge(Metrics::PAGES_RUNNING, -1);
+}
+
+void
+ProgressCounter::Page::done()
+{
+    qint64 const nsecs = m_timer.nsecsElapsed();
+    Metrics::recordStageLatency(m_rOwner.m_pStage, nsecs);
+    if (m_rOwner.m_pCostModel) {
+        m_rOwner.m_pCostModel->record(m_rOwner.m_pStage, m_rOwner.m_rPages[m_pageIdx].id(), nsecs);
+    }
+    Metrics::add(Metrics::PAGES_DONE);
+    m_rOwner.pageDone(m_pageIdx);
+}
+
+/**
+ * Executes a single composite task on a QThreadPool thread.
+ * Exceptions can't cross the thread boundary, so the first error
+ * is recorded and re-thrown by ConsoleBatch::runTasks().
+ */
+class TaskRunnable : public QRunnable
+{
+public:
+    /**
+     * \param node The NUMA node to run on, or -1 for any.
+     *        Images in \p prefetch are decoded on the same node.
+     */
+    TaskRunnable(BackgroundTaskPtr const& task, qint64 footprint,
+                 std::vector<ImageId> const& prefetch, int node,
+                 QMutex& error_mutex, QString& error,
+                 ProgressCounter& progress, int page_idx)
+        :   m_ptrTask(task), m_footprint(footprint), m_prefetch(prefetch), m_node(node),
+            m_rErrorMutex(error_mutex), m_rError(error),
+            m_rProgress(progress), m_pageIdx(page_idx) {}
+
+    virtual void run()
+    {
+        if (m_node >= 0) {
+            NumaTopology::bindCurrentThread(m_node);
+        }
+        // Waits for other pages to finish if this one doesn't fit.
+        MemoryBudget::Reservation const reservation(m_footprint);
+        for (ImageId const& image_id : m_prefetch) {
+            ImagePrefetcher::prefetch(image_id, m_node);
+        }
+        ProgressCounter::Page page(m_rProgress, m_pageIdx);
+        try {
+            (*m_ptrTask)();
+            page.done();
+        } catch (std::exception const& e) {
+            QMutexLocker const locker(&m_rErrorMutex);
+            if (m_rError.isEmpty()) {
+                m_rError = QString::fromLocal8Bit(e.what());
+            }
+        }
+    }
+private:
+    BackgroundTaskPtr m_ptrTask;
+    qint64 m_footprint;
+    std::vector<ImageId> m_prefetch;
+    int m_node;
+    QMutex& m_rErrorMutex;
+    QString& m_rError;
+    ProgressCounter& m_rProgress;
+    int m_pageIdx;
+};
+
+/**
+ * The name a filter pass goes by in Metrics.
+ */
+char const* stageName(StageSequence const& stages, int const filter_idx)
+{
+    if (filter_idx == stages.fixOrientationFilterIdx()) {
+        return "fix_orientation";
+    } else if (filter_idx == stages.pageSplitFilterIdx()) {
+        return "page_split";
+    } else if (filter_idx == stages.deskewFilterIdx()) {
+        return "deskew";
+    } else if (filter_idx == stages.selectContentFilterIdx()) {
+        return "select_content";
+    } else if (filter_idx == stages.pageLayoutFilterIdx()) {
+        return "page_layout";
+    } else {
+        return "output";
+    }
+}
+
+/**
+ * How expensive a page is in a filter pass, relative to other pages.
+ * Only pages that weren't timed before go by this, so it's rough:
+ * the image size, plus the output settings known to be slow.
+ */
+double pageCostPrior(StageSequence const& stages, int const filter_idx, PageInfo const& page)
+{
+    QSize const size(page.metadata().size());
+    // A megapixel for loading and saving, whatever the size.
+    double cost = 1.0 + double(size.width()) * size.height() / 1e6;
+    if (filter_idx != stages.outputFilterIdx()) {
+        return cost;
+    }
+
+    output::Params const params(stages.outputFilter()->getSettings()->getParams(page.id()));
+    switch (params.dewarpingMode()) {
+        case output::DewarpingMode::AUTO:
+            cost *= 3.0;
+            break;
+        case output::DewarpingMode::MARGINAL:
+            cost *= 2.0;
+            break;
+        case output::DewarpingMode::MANUAL:
+            cost *= 1.5;
+            break;
+        default:
+            break;
+    }
+    switch (params.colorParams().colorMode()) {
+        case output::ColorParams::MIXED:
+            cost *= 2.0;
+            break;
+        case output::ColorParams::COLOR_GRAYSCALE:
+            cost *= 1.5;
+            break;
+        default:
+            break;
+    }
+    switch (params.despeckleLevel()) {
+        case output::DESPECKLE_AGGRESSIVE:
+            cost *= 1.5;
+            break;
+        case output::DESPECKLE_NORMAL:
+            cost *= 1.25;
+            break;
+        case output::DESPECKLE_CAUTIOUS:
+            cost *= 1.1;
+            break;
+        default:
+            break;
+    }
+    return cost;
+}
+
+/**
+ * Where to keep the binary snapshot of a project file, if anywhere.
+ */
+QString snapshotFile(QString const& project_file)
+{
+    if (!CommandLine::get().hasProjectSnapshot()) {
+        return QString();
+    }
+    return ProjectReader::snapshotFileFor(project_file);
+}
+
+char const WATCH_CLOSE_FILE[] = "book.done";
+
+unsigned long const WATCH_POLL_INTERVAL_MS = 1000;
+
+} // anonymous namespace
+
+/**
+ * Loads an image once and runs it through a range of filters, one filter
+ * at a time, exactly like the filter-major loop in ConsoleBatch::process()
+ * would, but without decoding the image again for every filter.
+ */
+class ConsoleBatch::PipelinedTask : public LoadFileTask
+{
+public:
+    PipelinedTask(ConsoleBatch& owner, PageInfo const& page,
+                  int first_filter_idx, int last_filter_idx)
+        :   LoadFileTask(
+                BackgroundTask::BATCH, page, owner.m_ptrThumbnailCache,
+                owner.m_ptrPages, IntrusivePtr<fix_orientation::Task>()
+            ),
+            m_rOwner(owner),
+            m_imageId(page.imageId()),
+            m_firstFilterIdx(first_filter_idx),
+            m_lastFilterIdx(last_filter_idx) {}
+protected:
+    virtual FilterResultPtr process(FilterData const& data);
+private:
+    ConsoleBatch& m_rOwner;
+    ImageId m_imageId;
+    int m_firstFilterIdx;
+    int m_lastFilterIdx;
+};
+
+FilterResultPtr
+ConsoleBatch::PipelinedTask::process(FilterData const& data)
+{
+    StageSequence const& stages = *m_rOwner.m_ptrStages;
+
+    for (int j = m_firstFilterIdx; j <= m_lastFilterIdx; ++j) {
+        // page_split may have changed the number of pages this image has.
+        std::vector<PageInfo> const pages(m_rOwner.pagesOf(m_imageId));
+
+        // Filters up to page_split were set up for all pages in advance.
+        if (j > stages.pageSplitFilterIdx()) {
+            std::shared_ptr<PageSequence> const image_pages(std::make_shared<PageSequence>());
+            for (PageInfo const& page : pages) {
+                image_pages->append(page);
+            }
+            QMutexLocker const locker(&m_rOwner.m_setupMutex);
+            m_rOwner.setupFilter(j, PageSet::all(image_pages));
+        }
+
+        for (PageInfo const& page : pages) {
+            throwIfCancelled();
+            m_rOwner.createFilterChain(page, j)->process(*this, data);
+        }
+    }
+
+    return FilterResultPtr();
+}
 
 ConsoleBatch::ConsoleBatch(std::vector<ImageFileInfo> const& images, QString const& output_directory, Qt::LayoutDirection const layout)
     :   batch(true), debug(true),
@@ -84,7 +407,14 @@ ConsoleBatch::ConsoleBatch(std::vector<ImageFileInfo> const& images, QString con
 
     //m_ptrThumbnailCache = IntrusivePtr<ThumbnailPixmapCache>(new ThumbnailPixmapCache(output_dir+"/cache/thumbs", QSize(200,200), 40, 5));
     m_ptrThumbnailCache = Utils::createThumbnailCache(output_directory);
+    IntermediateCache::setCacheDir(Utils::outputDirToIntermediateDir(output_directory));
+    OutputCache::setCacheDir(CommandLine::get().getSharedOutputCacheDir());
     m_outFileNameGen = OutputFileNameGenerator(m_ptrDisambiguator, output_directory, m_ptrPages->layoutDirection());
+    m_ptrCostModel.reset(new PageCostModel(output_directory + QLatin1String("/cache/page_costs")));
+
+    if (CommandLine::get().hasPages()) {
+        m_shardImages = imagesInRange(CommandLine::get().getPages());
+    }
 }
 
 ConsoleBatch::ConsoleBatch(QString const project_file)
@@ -95,23 +425,29 @@ ConsoleBatch::ConsoleBatch(QString const project_file)
         throw std::runtime_error("Unable to open the project file.");
     }
 
-    QDomDocument doc;
-    if (!doc.setContent(&file)) {
+    m_ptrReader.reset(new ProjectReader(file, snapshotFile(project_file)));
+    file.close();
+
+    if (!m_ptrReader->isWellFormed()) {
         throw std::runtime_error("The project file is broken.");
     }
 
-    file.close();
-
-    m_ptrReader.reset(new ProjectReader(doc));
     m_ptrPages = m_ptrReader->pages();
 
+    CommandLine const& cli = CommandLine::get();
+    for (QString const& spec : cli.getMergeProjects()) {
+        mergeProject(spec);
+    }
+    if (cli.hasPages()) {
+        m_shardImages = imagesInRange(cli.getPages());
+    }
+
     PageSelectionAccessor const accessor((IntrusivePtr<PageSelectionProvider>())); // Won't be used anyway.
     m_ptrDisambiguator = m_ptrReader->namingDisambiguator();
 
     m_ptrStages = IntrusivePtr<StageSequence>(new StageSequence(m_ptrPages, accessor));
     m_ptrReader->readFilterSettings(m_ptrStages->filters());
 
-    CommandLine const& cli = CommandLine::get();
     QString output_directory = m_ptrReader->outputDirectory();
     if (!cli.outputDirectory().isEmpty()) {
         output_directory = cli.outputDirectory();
@@ -119,11 +455,145 @@ ConsoleBatch::ConsoleBatch(QString const project_file)
 
     //m_ptrThumbnailCache = IntrusivePtr<ThumbnailPixmapCache>(new ThumbnailPixmapCache(output_directory+"/cache/thumbs", QSize(200,200), 40, 5));
     m_ptrThumbnailCache = Utils::createThumbnailCache(output_directory);
+    IntermediateCache::setCacheDir(Utils::outputDirToIntermediateDir(output_directory));
+    OutputCache::setCacheDir(CommandLine::get().getSharedOutputCacheDir());
     m_outFileNameGen = OutputFileNameGenerator(m_ptrDisambiguator, output_directory, m_ptrPages->layoutDirection());
+    m_ptrCostModel.reset(new PageCostModel(output_directory + QLatin1String("/cache/page_costs")));
 }
 
-BackgroundTaskPtr
-ConsoleBatch::createCompositeTask(
+ConsoleBatch::~ConsoleBatch()
+{
+}
+
+std::set<ImageId>
+ConsoleBatch::imagesInRange(QString const& range) const
+{
+    QStringList const bounds(range.split('-'));
+    bool ok1 = false;
+    bool ok2 = false;
+    int const first = bounds.front().toInt(&ok1);
+    int const last = bounds.back().toInt(&ok2);
+    if (bounds.size() > 2 || !ok1 || !ok2 || first < 1 || last < first) {
+        throw std::runtime_error(("Invalid page range: " + range).toLocal8Bit().constData());
+    }
+
+    std::set<ImageId> images;
+    PageSequence const image_sequence = m_ptrPages->toPageSequence(IMAGE_VIEW);
+    int const end = std::min<int>(last, image_sequence.numPages());
+    for (int i = first; i <= end; ++i) {
+        images.insert(image_sequence.pageAt(i - 1).imageId());
+    }
+    if (images.empty()) {
+        throw std::runtime_error(("No images in page range: " + range).toLocal8Bit().constData());
+    }
+
+    return images;
+}
+
+void
+ConsoleBatch::mergeProject(QString const& spec)
+{
+    int const at = spec.lastIndexOf('@');
+    if (at < 0) {
+        throw std::runtime_error(("No page range given for " + spec).toLocal8Bit().constData());
+    }
+    QString const project_file(spec.left(at));
+    std::set<ImageId> const images(imagesInRange(spec.mid(at + 1)));
+
+    QFile file(project_file);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error(("Unable to open the project file " + project_file).toLocal8Bit().constData());
+    }
+    ProjectReader const reader(file, snapshotFile(project_file));
+    file.close();
+    if (!reader.success()) {
+        throw std::runtime_error(("The project file " + project_file + " is broken.").toLocal8Bit().constData());
+    }
+
+    // Carry over the images the other project has split into two pages,
+    // or the other way around.
+    std::map<ImageId, int> pages_per_image;
+    for (PageInfo const& page : reader.pages()->toPageSequence(PAGE_VIEW)) {
+        ++pages_per_image[page.imageId()];
+    }
+    for (ImageId const& image_id : images) {
+        std::map<ImageId, int>::const_iterator const it(pages_per_image.find(image_id));
+        if (it == pages_per_image.end()) {
+            throw std::runtime_error(("The project file " + project_file + " has different images.").toLocal8Bit().constData());
+        }
+        m_ptrPages->setLayoutTypeFor(
+            image_id, it->second > 1 ? ProjectPages::TWO_PAGE_LAYOUT : ProjectPages::ONE_PAGE_LAYOUT
+        );
+    }
+
+    m_ptrReader->mergeFilterSettings(reader, images);
+}
+
+bool
+ConsoleBatch::isInShard(PageInfo const& page) const
+{
+    return m_shardImages.empty() || m_shardImages.count(page.imageId());
+}
+
+bool
+ConsoleBatch::isDone(int const filter_idx, PageInfo const& page) const
+{
+    return m_ptrJournal && m_ptrJournal->isDone(filter_idx, page.id());
+}
+
+QString
+ConsoleBatch::checkpointFile(QString const& output_directory)
+{
+    return output_directory + QLatin1String("/cache/checkpoint.ScanTailor");
+}
+
+void
+ConsoleBatch::initJournal(QString const& output_directory, bool const resume)
+{
+    CommandLine const& cli = CommandLine::get();
+    if (!cli.hasCheckpoint()) {
+        return;
+    }
+
+    QDir().mkpath(output_directory + QLatin1String("/cache"));
+    m_checkpointFile = checkpointFile(output_directory);
+    m_ptrJournal.reset(
+        new BatchJournal(
+            output_directory + QLatin1String("/cache/checkpoint.journal"), resume,
+            cli.getCheckpointInterval(), boost::bind(&ConsoleBatch::saveCheckpoint, this)
+        )
+    );
+}
+
+void
+ConsoleBatch::saveCheckpoint()
+{
+    // Journaled pages must have their output files on disk, too.
+    OutputWriteQueue::waitForAll();
+    saveProject(m_checkpointFile);
+}
+
+std::unique_ptr<ConsoleBatch>
+ConsoleBatch::create(CommandLine const& cli)
+{
+    std::unique_ptr<ConsoleBatch> cbatch;
+
+    QString const checkpoint(checkpointFile(cli.outputDirectory()));
+    bool const resume = cli.hasResume() && QFile::exists(checkpoint);
+    if (resume) {
+        cbatch.reset(new ConsoleBatch(checkpoint));
+    } else if (!cli.projectFile().isEmpty()) {
+        cbatch.reset(new ConsoleBatch(cli.projectFile()));
+    } else {
+        cbatch.reset(new ConsoleBatch(cli.images(), cli.outputDirectory(), cli.getLayoutDirection()));
+    }
+
+    cbatch->initJournal(cli.outputDirectory(), resume);
+    return cbatch;
+}
+
+IntrusivePtr<fix_orientation::Task>
+ConsoleBatch::createFilterChain(
     PageInfo const& page,
     int const last_filter_idx)
 {
@@ -134,9 +604,9 @@ ConsoleBatch::createCompositeTask(
     IntrusivePtr<page_layout::Task> page_layout_task;
     IntrusivePtr<output::Task> output_task;
 
-    if (batch) {
-        debug = false;
-    }
+    // This may be called from several threads at once,
+    // so we work on a local copy of the debug flag.
+    bool debug = this->debug && !batch;
 
     if (last_filter_idx >= m_ptrStages->outputFilterIdx()) {
         output_task = m_ptrStages->outputFilter()->createTask(
@@ -176,22 +646,58 @@ ConsoleBatch::createCompositeTask(
     }
     assert(fix_orientation_task);
 
+    return fix_orientation_task;
+}
+
+BackgroundTaskPtr
+ConsoleBatch::createCompositeTask(
+    PageInfo const& page,
+    int const last_filter_idx)
+{
     return BackgroundTaskPtr(
                new LoadFileTask(
-                   BackgroundTask::BATCH,
-                   page, m_ptrThumbnailCache, m_ptrPages, fix_orientation_task
+                   BackgroundTask::BATCH, page, m_ptrThumbnailCache, m_ptrPages,
+                   createFilterChain(page, last_filter_idx)
                )
            );
 }
 
+std::vector<PageInfo>
+ConsoleBatch::pagesOf(ImageId const& image_id) const
+{
+    std::vector<PageInfo> pages;
+    for (PageInfo const& page : m_ptrPages->toPageSequence(PAGE_VIEW)) {
+        if (page.imageId() == image_id) {
+            pages.push_back(page);
+        }
+    }
+    return pages;
+}
+
 // process the image vector **images** and save output to **output_dir**
 void
 ConsoleBatch::process()
 {
     CommandLine const& cli = CommandLine::get();
 
+    for (QString const& spec : cli.getRenditions()) {
+        output::Rendition rendition;
+        if (!output::Rendition::parse(spec, rendition)) {
+            throw std::runtime_error(("Invalid rendition: " + spec).toLocal8Bit().constData());
+        }
+    }
+
+    if (cli.hasWatch()) {
+        watch(cli.getWatchDir());
+    }
+
     // get first filter id
     int startFilterIdx = m_ptrStages->fixOrientationFilterIdx();
+    if (cli.hasMerge() || cli.hasWatch()) {
+        // Page layout depends on all pages, so it can't be done in parts.
+        // Earlier filters were run by --merge'd runs or by watch().
+        startFilterIdx = m_ptrStages->pageLayoutFilterIdx();
+    }
     if (cli.hasStartFilterIdx()) {
         unsigned int sf = cli.getStartFilterIdx();
         if (sf >= m_ptrStages->filters().size()) {
@@ -202,6 +708,9 @@ ConsoleBatch::process()
 
     // get last filter id
     int endFilterIdx = m_ptrStages->outputFilterIdx();
+    if (cli.hasMerge()) {
+        endFilterIdx = m_ptrStages->pageLayoutFilterIdx();
+    }
     if (cli.hasEndFilterIdx()) {
         unsigned int ef = cli.getEndFilterIdx();
         if (ef >= m_ptrStages->filters().size()) {
@@ -210,33 +719,341 @@ ConsoleBatch::process()
         endFilterIdx = ef;
     }
 
-    // run filters
-    for (int j = startFilterIdx; j <= endFilterIdx; j++) {
+    runFilters(startFilterIdx, endFilterIdx);
+
+    // Output files may still be in the write queue.
+    OutputWriteQueue::waitForAll();
+
+    // setup rest filters with params from cli
+    PageSet const select_all(
+        PageSet::all(std::make_shared<PageSequence>(m_ptrPages->toPageSequence(PAGE_VIEW)))
+    );
+    for (int j = endFilterIdx + 1; j <= m_ptrStages->count(); j++) {
+        setupFilter(j, select_all);
+    }
+
+    // update statistics for executed filters
+    for (int j = 0; j <= endFilterIdx; j++) {
+        m_ptrStages->filterAt(j)->updateStatistics();
+    }
+}
+
+void
+ConsoleBatch::runFilters(int first_filter_idx, int const last_filter_idx)
+{
+    CommandLine const& cli = CommandLine::get();
+
+    if (cli.isPipelined()) {
+        // Everything up to select_content is per-page, so it can be pipelined.
+        // page_layout needs content boxes of all pages, so that's our barrier.
+        int const last_pipelined_idx = std::min(last_filter_idx, m_ptrStages->selectContentFilterIdx());
+        if (last_pipelined_idx > first_filter_idx) {
+            processPipelined(first_filter_idx, last_pipelined_idx);
+            first_filter_idx = last_pipelined_idx + 1;
+        }
+    }
+
+    for (int j = first_filter_idx; j <= last_filter_idx; j++) {
         if (cli.isVerbose()) {
             std::cout << "Filter: " << (j + 1) << "\n";
         }
 
         // process pages
-        PageSequence page_sequence = m_ptrPages->toPageSequence(PAGE_VIEW);
-        setupFilter(j, page_sequence.asPageIdSet());
-        for (const PageInfo& page : page_sequence) {
+        std::shared_ptr<PageSequence const> const page_sequence(
+            std::make_shared<PageSequence>(m_ptrPages->toPageSequence(PAGE_VIEW))
+        );
+        std::vector<PageInfo> pages;
+        PageSet page_ids(page_sequence);
+        int idx = 0;
+        for (const PageInfo& page : *page_sequence) {
+            // Pages done before a checkpoint keep their settings.
+            if (isInShard(page) && !isDone(j, page)) {
+                pages.push_back(page);
+                page_ids.insertAt(idx);
+            }
+            ++idx;
+        }
+        setupFilter(j, page_ids);
+
+        // Pages within a single filter pass are independent of each other.
+        // Anything that depends on all pages (statistics, aggregate sizes)
+        // is only consumed by later passes, so a barrier between passes
+        // is enough to reproduce the sequential results exactly.
+        std::vector<BackgroundTaskPtr> tasks;
+        for (const PageInfo& page : pages) {
             if (cli.isVerbose()) {
                 std::cout << "\tProcessing: " << page.imageId().filePath().toLocal8Bit().constData() << "\n";
             }
-            BackgroundTaskPtr bgTask = createCompositeTask(page, j);
-            (*bgTask)();
+            tasks.push_back(createCompositeTask(page, j));
+        }
+        runTasks(tasks, pages, cli.getThreads(), j);
+
+        if (m_ptrJournal) {
+            m_ptrJournal->checkpoint();
         }
     }
+}
 
-    // setup rest filters with params from cli
-    const std::set<PageId> select_all = m_ptrPages->toPageSequence(PAGE_VIEW).asPageIdSet();
-    for (int j = endFilterIdx + 1; j <= m_ptrStages->count(); j++) {
-        setupFilter(j, select_all);
+void
+ConsoleBatch::processPipelined(int const first_filter_idx, int const last_filter_idx)
+{
+    CommandLine const& cli = CommandLine::get();
+
+    if (cli.isVerbose()) {
+        std::cout << "Filters: " << (first_filter_idx + 1) << "-" << (last_filter_idx + 1) << "\n";
     }
 
-    // update statistics for executed filters
-    for (int j = 0; j <= endFilterIdx; j++) {
-        m_ptrStages->filterAt(j)->updateStatistics();
+    std::shared_ptr<PageSequence const> const page_sequence(
+        std::make_shared<PageSequence>(m_ptrPages->toPageSequence(PAGE_VIEW))
+    );
+
+    std::vector<PageInfo> pages;
+    PageSet page_ids(page_sequence);
+    ImageId prev_image_id;
+    bool prev_pending = false;
+    int idx = -1;
+    for (PageInfo const& page : *page_sequence) {
+        ++idx;
+        if (page.imageId() == prev_image_id) {
+            // Both halves of a split image are handled by the same task.
+            if (prev_pending) {
+                page_ids.insertAt(idx);
+            }
+            continue;
+        }
+        prev_image_id = page.imageId();
+        prev_pending = isInShard(page) && !isDone(last_filter_idx, page);
+        if (prev_pending) {
+            pages.push_back(page);
+            page_ids.insertAt(idx);
+        }
+    }
+
+    // Filters that aren't set up on a per-page basis.
+    for (int j = first_filter_idx; j <= std::min(last_filter_idx, m_ptrStages->pageSplitFilterIdx()); ++j) {
+        setupFilter(j, page_ids);
+    }
+
+    std::vector<BackgroundTaskPtr> tasks;
+    for (PageInfo const& page : pages) {
+        if (cli.isVerbose()) {
+            std::cout << "\tProcessing: " << page.imageId().filePath().toLocal8Bit().constData() << "\n";
+        }
+        tasks.push_back(
+            BackgroundTaskPtr(new PipelinedTask(*this, page, first_filter_idx, last_filter_idx))
+        );
+    }
+
+    runTasks(tasks, pages, cli.getThreads(), last_filter_idx);
+
+    if (m_ptrJournal) {
+        m_ptrJournal->checkpoint();
+    }
+}
+
+void
+ConsoleBatch::runTasks(
+    std::vector<BackgroundTaskPtr> const& tasks,
+    std::vector<PageInfo> const& pages, int const num_threads, int const filter_idx)
+{
+    assert(tasks.size() == pages.size());
+
+    int const threads = std::max(1, num_threads);
+    int const num_tasks = tasks.size();
+    int const prefetch_depth = ImagePrefetcher::depth();
+
+    char const* const stage = stageName(*m_ptrStages, filter_idx);
+
+    // Ranges of tasks of the same image, which are kept together.
+    std::vector<std::pair<int, int> > images;
+    for (int i = 0; i < num_tasks; ++i) {
+        if (i == 0 || pages[i].imageId() != pages[i - 1].imageId()) {
+            images.push_back(std::make_pair(i, i));
+        }
+        ++images.back().second;
+    }
+
+    // In parallel, the most expensive images go first.  Started last,
+    // one of them could keep the pass running long after the other
+    // threads have run out of work.
+    std::vector<int> image_order(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        image_order[i] = i;
+    }
+    if (threads > 1) {
+        std::vector<double> priors;
+        priors.reserve(pages.size());
+        for (PageInfo const& page : pages) {
+            priors.push_back(pageCostPrior(*m_ptrStages, filter_idx, page));
+        }
+        std::vector<double> const page_costs(m_ptrCostModel->estimate(stage, pages, priors));
+        std::vector<double> image_costs(images.size(), 0.0);
+        for (size_t i = 0; i < images.size(); ++i) {
+            for (int j = images[i].first; j < images[i].second; ++j) {
+                image_costs[i] += page_costs[j];
+            }
+        }
+        std::stable_sort(
+            image_order.begin(), image_order.end(),
+            [&image_costs](int const a, int const b) {
+                return image_costs[a] > image_costs[b];
+            }
+        );
+    }
+
+    // With NUMA placement, every node gets a pool of its own, and images
+    // are dealt to nodes round-robin, keeping the pages of an image together.
+    // Otherwise, there is a single pool, standing for node -1.
+    int const num_nodes = threads > 1 && NumaTopology::isEnabled()
+                          ? std::min(threads, NumaTopology::numNodes()) : 1;
+    std::vector<std::vector<int> > node_tasks(num_nodes);
+    for (size_t i = 0; i < image_order.size(); ++i) {
+        std::pair<int, int> const& image = images[image_order[i]];
+        for (int j = image.first; j < image.second; ++j) {
+            node_tasks[i % num_nodes].push_back(j);
+        }
+    }
+
+    // When task i starts, tasks up to i + threads - 1 of the same pool
+    // may be running already, so decoding ahead starts with the one after them.
+    std::vector<std::vector<ImageId> > prefetch(tasks.size());
+    for (int node = 0; node < num_nodes; ++node) {
+        std::vector<int> const& queue = node_tasks[node];
+        int const node_threads = threads * (node + 1) / num_nodes - threads * node / num_nodes;
+        int const queue_size = queue.size();
+        for (int j = 0; j < queue_size; ++j) {
+            int const end = std::min(queue_size, j + node_threads + prefetch_depth);
+            for (int k = j + node_threads; k < end; ++k) {
+                ImageId const& image_id = pages[queue[k]].imageId();
+                if (image_id != pages[queue[k - 1]].imageId()) {
+                    prefetch[queue[j]].push_back(image_id);
+                }
+            }
+        }
+    }
+
+    ProgressCounter progress(
+        m_progressCallback, m_ptrJournal.get(), m_ptrCostModel.get(), filter_idx, stage, pages
+    );
+
+    if (threads <= 1 || tasks.size() <= 1) {
+        for (int i = 0; i < num_tasks; ++i) {
+            for (ImageId const& image_id : prefetch[i]) {
+                ImagePrefetcher::prefetch(image_id);
+            }
+            ProgressCounter::Page page(progress, i);
+            (*tasks[i])();
+            page.done();
+        }
+        ImagePrefetcher::clear();
+        m_ptrCostModel->save();
+        return;
+    }
+
+    QMutex error_mutex;
+    QString error;
+
+    std::vector<std::unique_ptr<QThreadPool> > pools;
+    for (int node = 0; node < num_nodes; ++node) {
+        pools.emplace_back(new QThreadPool);
+        QThreadPool& pool = *pools.back();
+        pool.setMaxThreadCount(threads * (node + 1) / num_nodes - threads * node / num_nodes);
+        for (int const i : node_tasks[node]) {
+            qint64 const footprint = MemoryBudget::estimatePageFootprint(pages[i].metadata());
+            // QThreadPool takes ownership of runnables with autoDelete() set.
+            pool.start(
+                new TaskRunnable(
+                    tasks[i], footprint, prefetch[i], num_nodes > 1 ? node : -1,
+                    error_mutex, error, progress, i
+                )
+            );
+        }
+    }
+    for (std::unique_ptr<QThreadPool> const& pool : pools) {
+        pool->waitForDone();
+    }
+    ImagePrefetcher::clear();
+    m_ptrCostModel->save();
+
+    if (!error.isEmpty()) {
+        throw std::runtime_error(error.toLocal8Bit().constData());
+    }
+}
+
+void
+ConsoleBatch::watch(QString const& input_dir)
+{
+    CommandLine const& cli = CommandLine::get();
+    QDir const dir(input_dir);
+    SmartFilenameOrdering const ordering;
+
+    std::set<QString> known_files;
+    for (PageInfo const& page : m_ptrPages->toPageSequence(IMAGE_VIEW)) {
+        known_files.insert(page.imageId().filePath());
+    }
+
+    // Sizes of new files as of the previous look.  A file is taken
+    // once its size stops changing, so it's not read half-written.
+    std::map<QString, qint64> growing_files;
+
+    for (;;) {
+        // Checked first, so that files dropped before it are processed.
+        bool const closed = dir.exists(QLatin1String(WATCH_CLOSE_FILE));
+
+        QFileInfoList files(dir.entryInfoList(QDir::Files));
+        SmartFilenameOrdering::sort(files.begin(), files.end());
+
+        std::set<ImageId> new_images;
+        std::map<QString, qint64> still_growing;
+        for (QFileInfo const& file : files) {
+            QString const path(file.absoluteFilePath());
+            if (known_files.count(path) || !CommandLine::isImageFile(path)) {
+                continue;
+            }
+            std::map<QString, qint64>::const_iterator const it(growing_files.find(path));
+            if (!closed && (it == growing_files.end() || it->second != file.size())) {
+                still_growing[path] = file.size();
+                continue;
+            }
+
+            ImageMetadata metadata;
+            metadata.setDpi(cli.getInputDpi());
+            ImageInfo const image(
+                ImageId(path), metadata,
+                ProjectPages::adviseNumberOfLogicalPages(metadata, OrthogonalRotation()),
+                false, false
+            );
+
+            // Keep the images ordered, whatever order they arrive in.
+            SmartFilenameOrdering::Key const file_key(file);
+            ImageId insert_before;
+            for (PageInfo const& page : m_ptrPages->toPageSequence(IMAGE_VIEW)) {
+                SmartFilenameOrdering::Key const page_key(QFileInfo(page.imageId().filePath()));
+                if (ordering(file_key, page_key)) {
+                    insert_before = page.imageId();
+                    break;
+                }
+            }
+            m_ptrPages->insertImage(image, BEFORE, insert_before, IMAGE_VIEW);
+
+            known_files.insert(path);
+            new_images.insert(image.id());
+        }
+        growing_files.swap(still_growing);
+
+        if (!new_images.empty()) {
+            if (cli.isVerbose()) {
+                std::cout << "New images: " << new_images.size() << "\n";
+            }
+            // Only the per-page filters.  The rest needs all pages.
+            m_shardImages.swap(new_images);
+            runFilters(m_ptrStages->fixOrientationFilterIdx(), m_ptrStages->selectContentFilterIdx());
+            m_shardImages.clear();
+        } else if (closed) {
+            break;
+        } else {
+            QThread::msleep(WATCH_POLL_INTERVAL_MS);
+        }
     }
 }
 
@@ -250,7 +1067,7 @@ ConsoleBatch::saveProject(QString const project_file)
 }
 
 void
-ConsoleBatch::setupFilter(int idx, std::set<PageId> allPages)
+ConsoleBatch::setupFilter(int idx, PageSet const& allPages)
 {
     if (idx == m_ptrStages->fixOrientationFilterIdx()) {
         setupFixOrientation(allPages);
@@ -268,7 +1085,7 @@ ConsoleBatch::setupFilter(int idx, std::set<PageId> allPages)
 }
 
 void
-ConsoleBatch::setupFixOrientation(std::set<PageId> allPages)
+ConsoleBatch::setupFixOrientation(PageSet const& allPages)
 {
     IntrusivePtr<fix_orientation::Filter> fix_orientation = m_ptrStages->fixOrientationFilter();
     CommandLine const& cli = CommandLine::get();
@@ -298,7 +1115,7 @@ ConsoleBatch::setupFixOrientation(std::set<PageId> allPages)
 }
 
 void
-ConsoleBatch::setupPageSplit(std::set<PageId> allPages)
+ConsoleBatch::setupPageSplit(PageSet const& allPages)
 {
     IntrusivePtr<page_split::Filter> page_split = m_ptrStages->pageSplitFilter();
     CommandLine const& cli = CommandLine::get();
@@ -310,7 +1127,7 @@ ConsoleBatch::setupPageSplit(std::set<PageId> allPages)
 }
 
 void
-ConsoleBatch::setupDeskew(std::set<PageId> allPages)
+ConsoleBatch::setupDeskew(PageSet const& allPages)
 {
     IntrusivePtr<deskew::Filter> deskew = m_ptrStages->deskewFilter();
     CommandLine const& cli = CommandLine::get();
@@ -336,7 +1153,7 @@ ConsoleBatch::setupDeskew(std::set<PageId> allPages)
 }
 
 void
-ConsoleBatch::setupSelectContent(std::set<PageId> allPages)
+ConsoleBatch::setupSelectContent(PageSet const& allPages)
 {
     IntrusivePtr<select_content::Filter> select_content = m_ptrStages->selectContentFilter();
     CommandLine const& cli = CommandLine::get();
@@ -383,7 +1200,7 @@ ConsoleBatch::setupSelectContent(std::set<PageId> allPages)
 }
 
 void
-ConsoleBatch::setupPageLayout(std::set<PageId> allPages)
+ConsoleBatch::setupPageLayout(PageSet const& allPages)
 {
     IntrusivePtr<page_layout::Filter> page_layout = m_ptrStages->pageLayoutFilter();
     CommandLine const& cli = CommandLine::get();
@@ -435,7 +1252,7 @@ ConsoleBatch::setupPageLayout(std::set<PageId> allPages)
 }
 
 void
-ConsoleBatch::setupOutput(std::set<PageId> allPages)
+ConsoleBatch::setupOutput(PageSet const& allPages)
 {
     IntrusivePtr<output::Filter> output = m_ptrStages->outputFilter();
     CommandLine const& cli = CommandLine::get();
@@ -21,14 +21,20 @@
 #ifndef CONSOLEBATCH_H_
 #define CONSOLEBATCH_H_
 
+#include <QMutex>
 #include <QString>
 #include <vector>
+#include <set>
+#include <memory>
+#include <boost/function.hpp>
 
 #include "IntrusivePtr.h"
 #include "BackgroundTask.h"
 #include "FilterResult.h"
 #include "OutputFileNameGenerator.h"
 #include "PageId.h"
+#include "PageSet.h"
+#include "ImageId.h"
 #include "PageInfo.h"
 #include "PageView.h"
 #include "ProjectPages.h"
@@ -39,19 +45,53 @@
 #include "PageSelectionAccessor.h"
 #include "ProjectReader.h"
 
+namespace fix_orientation
+{
+class Task;
+}
+
+class BatchJournal;
+class PageCostModel;
+class CommandLine;
+
 class ConsoleBatch
 {
     // Member-wise copying is OK.
 public:
+    /**
+     * Called after each page of a filter pass is done, with the index of
+     * the filter, the number of pages done so far and the number of pages
+     * in the pass.  May be called from worker threads, but never from two
+     * threads at once.
+     */
+    typedef boost::function<void(int filter_idx, int pages_done, int num_pages)> ProgressCallback;
+
     ConsoleBatch(
         std::vector<ImageFileInfo> const& images,
         QString                    const& output_directory,
         Qt::LayoutDirection        const  layout);
     ConsoleBatch(QString const project_file);
 
+    ~ConsoleBatch();
+
+    /**
+     * \brief Creates a batch as described by the command line.
+     *
+     * With --resume, the batch starts from the last checkpoint
+     * in the output directory, if there is one.
+     */
+    static std::unique_ptr<ConsoleBatch> create(CommandLine const& cli);
+
+    void setProgressCallback(ProgressCallback const& callback)
+    {
+        m_progressCallback = callback;
+    }
+
     void process();
     void saveProject(QString const project_file);
 private:
+    class PipelinedTask;
+
     bool batch;
     bool debug;
     IntrusivePtr<FileNameDisambiguator> m_ptrDisambiguator;
@@ -60,19 +100,102 @@ private:
     OutputFileNameGenerator m_outFileNameGen;
     IntrusivePtr<ThumbnailPixmapCache> m_ptrThumbnailCache;
     std::unique_ptr<ProjectReader> m_ptrReader;
+    QMutex m_setupMutex;
+    ProgressCallback m_progressCallback;
+    std::set<ImageId> m_shardImages; // Empty means all of them.
+    std::unique_ptr<BatchJournal> m_ptrJournal;
+    std::unique_ptr<PageCostModel> m_ptrCostModel;
+    QString m_checkpointFile;
+
+    void setupFilter(int idx, PageSet const& allPages);
+    void setupFixOrientation(PageSet const& allPages);
+    void setupPageSplit(PageSet const& allPages);
+    void setupDeskew(PageSet const& allPages);
+    void setupSelectContent(PageSet const& allPages);
+    void setupPageLayout(PageSet const& allPages);
+    void setupOutput(PageSet const& allPages);
 
-    void setupFilter(int idx, std::set<PageId> allPages);
-    void setupFixOrientation(std::set<PageId> allPages);
-    void setupPageSplit(std::set<PageId> allPages);
-    void setupDeskew(std::set<PageId> allPages);
-    void setupSelectContent(std::set<PageId> allPages);
-    void setupPageLayout(std::set<PageId> allPages);
-    void setupOutput(std::set<PageId> allPages);
+    IntrusivePtr<fix_orientation::Task> createFilterChain(
+        PageInfo const& page,
+        int const last_filter_idx
+    );
 
     BackgroundTaskPtr createCompositeTask(
         PageInfo const& page,
         int const last_filter_idx
     );
+
+    std::vector<PageInfo> pagesOf(ImageId const& image_id) const;
+
+    /**
+     * \brief Resolves a --pages style range to images of the project.
+     *
+     * Throws std::runtime_error if the range is malformed or empty.
+     */
+    std::set<ImageId> imagesInRange(QString const& range) const;
+
+    /**
+     * \brief Takes settings of some images from a project processed in parts.
+     *
+     * \p spec is "<project_file>@<from>-<to>", as given to --merge.
+     */
+    void mergeProject(QString const& spec);
+
+    bool isInShard(PageInfo const& page) const;
+
+    /**
+     * \brief Whether a previous run got \p page through \p filter_idx.
+     */
+    bool isDone(int filter_idx, PageInfo const& page) const;
+
+    static QString checkpointFile(QString const& output_directory);
+
+    /**
+     * \brief Starts journaling finished pages, if asked to by the command line.
+     *
+     * \param resume Whether to continue the journal of an interrupted run.
+     */
+    void initJournal(QString const& output_directory, bool resume);
+
+    void saveCheckpoint();
+
+    /**
+     * \brief Runs filters [first_filter_idx, last_filter_idx] on all pages to be processed.
+     */
+    void runFilters(int first_filter_idx, int last_filter_idx);
+
+    /**
+     * \brief Adds images to the project as they appear in \p input_dir.
+     *
+     * New images are put through the per-page filters straight away.
+     * Returns once a file named book.done appears and all images
+     * that were there by then are processed.
+     */
+    void watch(QString const& input_dir);
+
+    /**
+     * \brief Runs filters [first_filter_idx, last_filter_idx] page by page.
+     *
+     * Each image is decoded once and passed through all of those filters
+     * before moving on.  The range must not include page_layout or output,
+     * which depend on statistics of all pages.
+     */
+    void processPipelined(int first_filter_idx, int last_filter_idx);
+
+    /**
+     * \brief Runs the given tasks, possibly in parallel.
+     *
+     * Tasks passed together must not depend on each other's results.
+     * \p pages are the pages of the tasks, in the same order.  Their
+     * images are decoded ahead while earlier tasks are running.
+     * When running in parallel, the tasks expected to take longest,
+     * going by the cost model, are started first.
+     * Progress is reported as filter \p filter_idx.
+     * Returns after all of them have finished.
+     */
+    void runTasks(std::vector<BackgroundTaskPtr> const& tasks,
+                  std::vector<PageInfo> const& pages, int num_threads,
+                  int filter_idx);
 };
 
 #endif
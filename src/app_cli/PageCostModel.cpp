@@ -0,0 +1,133 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PageCostModel.h"
+#include <QMutexLocker>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QByteArray>
+#include <QStringList>
+
+PageCostModel::PageCostModel(QString const& path)
+    :   m_path(path),
+        m_modified(false)
+{
+    read();
+}
+
+std::vector<double>
+PageCostModel::estimate(
+    char const* stage, std::vector<PageInfo> const& pages,
+    std::vector<double> const& priors) const
+{
+    QString const stage_name(QString::fromLatin1(stage));
+    std::vector<double> costs(pages.size(), -1.0);
+
+    double timed_msecs = 0;
+    double timed_priors = 0;
+    {
+        QMutexLocker const locker(&m_mutex);
+        for (size_t i = 0; i < pages.size(); ++i) {
+            auto const it(m_msecs.find(Key(stage_name, pageKey(pages[i].id()))));
+            if (it != m_msecs.end()) {
+                costs[i] = it->second;
+                timed_msecs += it->second;
+                timed_priors += priors[i];
+            }
+        }
+    }
+
+    // Priors only tell how pages compare to each other, so to be comparable
+    // to measured times, they are scaled to match those of the timed pages.
+    double const scale = timed_msecs > 0 && timed_priors > 0 ? timed_msecs / timed_priors : 1.0;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        if (costs[i] < 0) {
+            costs[i] = priors[i] * scale;
+        }
+    }
+
+    return costs;
+}
+
+void
+PageCostModel::record(char const* stage, PageId const& page, qint64 const nsecs)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_msecs[Key(QString::fromLatin1(stage), pageKey(page))] = nsecs / 1000000.0;
+    m_modified = true;
+}
+
+void
+PageCostModel::save()
+{
+    QMutexLocker const locker(&m_mutex);
+    if (!m_modified) {
+        return;
+    }
+
+    QDir().mkpath(QFileInfo(m_path).path());
+    QFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return;
+    }
+
+    for (auto const& entry : m_msecs) {
+        file.write(
+            QString("%1\t%2\t%3\n").arg(entry.first.first).arg(entry.second)
+            .arg(entry.first.second).toUtf8()
+        );
+    }
+    m_modified = false;
+}
+
+QString
+PageCostModel::pageKey(PageId const& page)
+{
+    return QString("%1\t%2\t%3").arg(PageId::subPageToString(page.subPage()))
+           .arg(page.imageId().page()).arg(page.imageId().filePath());
+}
+
+void
+PageCostModel::read()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    while (!file.atEnd()) {
+        QByteArray const line(file.readLine());
+        if (!line.endsWith('\n')) {
+            break;
+        }
+
+        QString const str(QString::fromUtf8(line.constData(), line.size() - 1));
+        int const tab1 = str.indexOf('\t');
+        int const tab2 = str.indexOf('\t', tab1 + 1);
+        if (tab1 < 0 || tab2 < 0) {
+            break;
+        }
+        bool ok = false;
+        double const msecs = str.mid(tab1 + 1, tab2 - tab1 - 1).toDouble(&ok);
+        if (!ok) {
+            break;
+        }
+        m_msecs[Key(str.left(tab1), str.mid(tab2 + 1))] = msecs;
+    }
+}
@@ -0,0 +1,88 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PAGECOSTMODEL_H_
+#define PAGECOSTMODEL_H_
+
+#include "NonCopyable.h"
+#include "PageId.h"
+#include "PageInfo.h"
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+#include <map>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief Predicts how long pages take in each filter pass.
+ *
+ * Starting the most expensive pages of a pass first keeps a few
+ * expensive pages from running alone at its end while other cores idle.
+ * The predictions come from the times pages took in previous runs,
+ * which are kept in a file in the output directory.  Pages that weren't
+ * timed yet get a prior from the caller, made of cheap predictors like
+ * the image size, scaled to how the timed pages compare to their priors.
+ */
+class PageCostModel
+{
+    DECLARE_NON_COPYABLE(PageCostModel)
+public:
+    /**
+     * \brief Reads back the times recorded by previous runs, if any.
+     *
+     * \param path The file to keep the times in.
+     */
+    explicit PageCostModel(QString const& path);
+
+    /**
+     * \brief Estimates the time each of \p pages takes in \p stage.
+     *
+     * \p priors are the relative costs of the pages, in the same order.
+     * The result is in milliseconds as long as any of the pages was
+     * timed before, and in the units of \p priors otherwise.
+     */
+    std::vector<double> estimate(
+        char const* stage, std::vector<PageInfo> const& pages,
+        std::vector<double> const& priors) const;
+
+    /**
+     * \brief Records the time \p page took in \p stage.
+     *
+     * May be called from several threads at once.
+     */
+    void record(char const* stage, PageId const& page, qint64 nsecs);
+
+    /**
+     * \brief Writes the recorded times to the file, if any were recorded.
+     */
+    void save();
+private:
+    typedef std::pair<QString, QString> Key; // Stage and page.
+
+    static QString pageKey(PageId const& page);
+
+    void read();
+
+    mutable QMutex m_mutex;
+    QString m_path;
+    std::map<Key, double> m_msecs;
+    bool m_modified;
+};
+
+#endif
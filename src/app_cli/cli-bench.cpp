@@ -0,0 +1,301 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * \file
+ * End-to-end throughput and regression benchmark for scantailor-cli.
+ *
+ * Usage: scantailor-universal-cli-bench [--cli=<path>] [--gui=<path>]
+ *        <corpus_dir> <work_dir> [-- <extra cli options>]
+ *
+ * The corpus is fetched separately.  Each subdirectory of corpus_dir is a
+ * set of scans, such as B&W text, mixed colour, warped book or camera JPEGs.
+ * An optional options.txt in a set lists its CLI options, one per line,
+ * so that the settings are versioned together with the scans.  An optional
+ * VERSION file in corpus_dir identifies the corpus revision.
+ *
+ * Every set is processed by a separate CLI process, so the peak memory
+ * reported is per set.  The report printed to stdout is JSON.  It holds
+ * wall time, pages per minute, per-stage timings, peak RSS and the SHA-1
+ * of every output file, for both speed and byte-identical output checks.
+ *
+ * With --gui, the GUI is also started a few times with --startup-benchmark
+ * and the best time from launch to the main window being shown is reported
+ * as gui_startup_msec.
+ */
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+
+QStringList imageFilters()
+{
+    QStringList filters;
+    filters << "*.tif" << "*.tiff" << "*.png" << "*.jpg" << "*.jpeg";
+    return filters;
+}
+
+QString readTrimmed(QString const& file_path)
+{
+    QFile file(file_path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
+    }
+    return QString::fromUtf8(file.readAll()).trimmed();
+}
+
+QStringList readOptions(QString const& file_path)
+{
+    QStringList options;
+    QString const contents(readTrimmed(file_path));
+    for (QString const& line : contents.split(QChar('\n'), QString::SkipEmptyParts)) {
+        QString const option(line.trimmed());
+        if (!option.isEmpty() && !option.startsWith(QChar('#'))) {
+            options.push_back(option);
+        }
+    }
+    return options;
+}
+
+QJsonArray outputChecksums(QString const& out_dir)
+{
+    QJsonArray checksums;
+    QFileInfoList const files(
+        QDir(out_dir).entryInfoList(QDir::Files, QDir::Name)
+    );
+    for (QFileInfo const& fi : files) {
+        QFile file(fi.filePath());
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(&file);
+
+        QJsonObject entry;
+        entry.insert("file", fi.fileName());
+        entry.insert("sha1", QString::fromLatin1(hash.result().toHex()));
+        checksums.append(entry);
+    }
+    return checksums;
+}
+
+/**
+ * Runs the CLI on one set of scans.  Returns a null object on failure.
+ */
+QJsonObject runSet(
+    QString const& cli, QDir const& set_dir,
+    QString const& work_dir, QStringList const& extra_options)
+{
+    QString const name(set_dir.dirName());
+    QString const out_dir(QDir(work_dir).filePath(name));
+    QString const profile_file(QDir(work_dir).filePath(name + ".profile.json"));
+
+    // Start from scratch to measure a cold run and not mix in stale outputs.
+    QDir(out_dir).removeRecursively();
+    if (!QDir().mkpath(out_dir)) {
+        std::cerr << "Unable to create " << out_dir.toLocal8Bit().constData() << std::endl;
+        return QJsonObject();
+    }
+
+    QFileInfoList const images(
+        set_dir.entryInfoList(imageFilters(), QDir::Files, QDir::Name)
+    );
+    if (images.isEmpty()) {
+        std::cerr << "No images in " << name.toLocal8Bit().constData() << std::endl;
+        return QJsonObject();
+    }
+
+    QStringList args(readOptions(set_dir.filePath("options.txt")));
+    args << extra_options;
+    args << ("--profile=" + profile_file);
+    for (QFileInfo const& image : images) {
+        args << image.filePath();
+    }
+    args << out_dir;
+
+    QProcess process;
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.setStandardOutputFile(QProcess::nullDevice());
+
+    QElapsedTimer timer;
+    timer.start();
+    process.start(cli, args);
+    bool const ok = process.waitForFinished(-1)
+                    && process.exitStatus() == QProcess::NormalExit
+                    && process.exitCode() == 0;
+    double const wall_msec = timer.nsecsElapsed() / 1000000.0;
+    if (!ok) {
+        std::cerr << "Processing " << name.toLocal8Bit().constData() << " failed" << std::endl;
+        return QJsonObject();
+    }
+
+    QFile profile(profile_file);
+    QJsonObject report;
+    if (profile.open(QIODevice::ReadOnly)) {
+        report = QJsonDocument::fromJson(profile.readAll()).object();
+    }
+
+    QJsonArray const outputs(outputChecksums(out_dir));
+
+    QJsonObject result;
+    result.insert("name", name);
+    result.insert("images", images.size());
+    result.insert("pages", outputs.size());
+    result.insert("wall_msec", wall_msec);
+    result.insert("pages_per_minute", outputs.size() * 60000.0 / std::max(wall_msec, 1.0));
+    result.insert("peak_rss_kb", report.value("peak_rss_kb"));
+    result.insert("stages", report.value("stages"));
+    result.insert("outputs", outputs);
+    return result;
+}
+
+/**
+ * Returns the best of several GUI startup times, or a negative value on failure.
+ * The first runs warm up the disk cache, so taking the minimum compares
+ * the work done at startup rather than the state of the machine.
+ */
+double guiStartupMsec(QString const& gui)
+{
+    int const num_runs = 5;
+    double best_msec = -1.0;
+    for (int i = 0; i < num_runs; ++i) {
+        QProcess process;
+        process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        process.setStandardOutputFile(QProcess::nullDevice());
+
+        QElapsedTimer timer;
+        timer.start();
+        process.start(gui, QStringList() << "--startup-benchmark");
+        bool const ok = process.waitForFinished(-1)
+                        && process.exitStatus() == QProcess::NormalExit
+                        && process.exitCode() == 0;
+        double const msec = timer.nsecsElapsed() / 1000000.0;
+        if (!ok) {
+            std::cerr << "Starting " << gui.toLocal8Bit().constData() << " failed" << std::endl;
+            return -1.0;
+        }
+        if (best_msec < 0.0 || msec < best_msec) {
+            best_msec = msec;
+        }
+    }
+    return best_msec;
+}
+
+void printUsage()
+{
+    std::cerr << "Usage: scantailor-universal-cli-bench [--cli=<path>] [--gui=<path>] <corpus_dir> <work_dir>"
+              << " [-- <extra cli options>]" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QString cli(QDir(app.applicationDirPath()).filePath("scantailor-universal-cli"));
+#ifdef Q_OS_WIN
+    cli += ".exe";
+#endif
+
+    QString gui;
+    QStringList positional;
+    QStringList extra_options;
+    QStringList const args(app.arguments().mid(1));
+    for (int i = 0; i < args.size(); ++i) {
+        if (args[i] == "--") {
+            extra_options = args.mid(i + 1);
+            break;
+        } else if (args[i].startsWith("--cli=")) {
+            cli = args[i].mid(6);
+        } else if (args[i].startsWith("--gui=")) {
+            gui = args[i].mid(6);
+        } else {
+            positional.push_back(args[i]);
+        }
+    }
+    if (positional.size() != 2) {
+        printUsage();
+        return 1;
+    }
+
+    QDir const corpus_dir(positional[0]);
+    QString const work_dir(positional[1]);
+    if (!corpus_dir.exists() || !QDir().mkpath(work_dir)) {
+        printUsage();
+        return 1;
+    }
+
+    QJsonArray sets;
+    double total_msec = 0.0;
+    int total_pages = 0;
+    bool failed = false;
+
+    QStringList const set_names(
+        corpus_dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name)
+    );
+    for (QString const& set_name : set_names) {
+        QJsonObject const result(
+            runSet(cli, QDir(corpus_dir.filePath(set_name)), work_dir, extra_options)
+        );
+        if (result.isEmpty()) {
+            failed = true;
+            continue;
+        }
+        total_msec += result.value("wall_msec").toDouble();
+        total_pages += result.value("pages").toInt();
+        sets.append(result);
+    }
+
+    double gui_startup_msec = 0.0;
+    if (!gui.isEmpty()) {
+        gui_startup_msec = guiStartupMsec(gui);
+        if (gui_startup_msec < 0.0) {
+            failed = true;
+        }
+    }
+
+    QJsonObject root;
+    root.insert("corpus_version", readTrimmed(corpus_dir.filePath("VERSION")));
+    root.insert("extra_options", QJsonArray::fromStringList(extra_options));
+    root.insert("sets", sets);
+    root.insert("total_wall_msec", total_msec);
+    root.insert("total_pages", total_pages);
+    root.insert("total_pages_per_minute", total_pages * 60000.0 / std::max(total_msec, 1.0));
+    if (!gui.isEmpty() && gui_startup_msec >= 0.0) {
+        root.insert("gui_startup_msec", gui_startup_msec);
+    }
+
+    std::cout << QJsonDocument(root).toJson().constData();
+
+    return failed ? 1 : 0;
+}
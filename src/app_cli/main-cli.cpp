@@ -25,6 +25,15 @@
 
 #include "CommandLine.h"
 #include "ConsoleBatch.h"
+#include "CliServer.h"
+#include "MemoryBudget.h"
+#include "NumaTopology.h"
+#include "PixelBufferPool.h"
+#include "AnalysisResolution.h"
+#include "DecodedImageCache.h"
+#include "Profiler.h"
+#include "TraceRecorder.h"
+#include "imageproc/GpuCompute.h"
 #include "config.h"
 
 int main(int argc, char** argv)
@@ -52,19 +61,73 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    if (cli.hasHelp() || cli.outputDirectory().isEmpty() || (cli.images().size() == 0 && cli.projectFile().isEmpty())) {
+    if (cli.hasGpuCompute()) {
+        imageproc::GpuCompute::setEnabled(true);
+        QString const device(imageproc::GpuCompute::deviceName());
+        if (device.isEmpty()) {
+            std::cerr << "No OpenCL GPU available, processing on the CPU." << std::endl;
+        } else if (cli.isVerbose()) {
+            std::cout << "Using " << device.toLocal8Bit().constData() << " for output processing." << std::endl;
+        }
+    }
+
+    if (cli.hasNuma()) {
+        NumaTopology::setEnabled(true);
+    }
+
+    if (cli.hasDisableHugePages()) {
+        PixelBufferPool::setHugePagesEnabled(false);
+    }
+
+    if (cli.hasAdaptiveAnalysis()) {
+        AnalysisResolution::setAdaptive(true);
+    }
+
+    if (cli.hasImageCache()) {
+        DecodedImageCache::setLimit(cli.getImageCacheSize() * 1024 * 1024);
+    }
+
+    if (cli.hasServe()) {
+        if (cli.hasMemoryLimit()) {
+            MemoryBudget::setLimit(cli.getMemoryLimit() * 1024 * 1024);
+        }
+
+        CliServer server;
+        if (!server.listen(cli.getServeName())) {
+            return 1;
+        }
+        if (cli.hasMetrics() && !server.listenMetrics(cli.getMetricsAddress())) {
+            return 1;
+        }
+        if (cli.hasStatusInterval()) {
+            server.startStatusLines(cli.getStatusInterval());
+        }
+        return app.exec();
+    }
+
+    if (cli.hasHelp() || cli.outputDirectory().isEmpty() || (cli.images().size() == 0 && cli.projectFile().isEmpty() && !cli.hasWatch())) {
         cli.printHelp();
         return 0;
     }
 
+    if (cli.hasProfile()) {
+        Profiler::setEnabled(true);
+    }
+
+    QString trace_file(TraceRecorder::initFromEnvironment());
+    if (cli.hasTrace()) {
+        trace_file = cli.getTraceFile();
+        TraceRecorder::setEnabled(true);
+    }
+
+    if (cli.hasMemoryLimit()) {
+        MemoryBudget::setLimit(cli.getMemoryLimit() * 1024 * 1024);
+    }
+
     std::unique_ptr<ConsoleBatch> cbatch;
 
     try {
-        if (!cli.projectFile().isEmpty()) {
-            cbatch.reset(new ConsoleBatch(cli.projectFile()));
-        } else {
-            cbatch.reset(new ConsoleBatch(cli.images(), cli.outputDirectory(), cli.getLayoutDirection()));
-        }
+        cbatch = ConsoleBatch::create(cli);
         cbatch->process();
     } catch (std::exception const& e) {
         std::cerr << e.what() << std::endl;
@@ -74,4 +137,14 @@ int main(int argc, char** argv)
     if (cli.hasOutputProject()) {
         cbatch->saveProject(cli.outputProjectFile());
     }
+
+    if (cli.hasProfile() && !Profiler::writeReport(cli.getProfileFile())) {
+        std::cerr << "Unable to write the profiling report to "
+                  << cli.getProfileFile().toLocal8Bit().constData() << std::endl;
+    }
+
+    if (!trace_file.isEmpty() && !TraceRecorder::writeChromeTrace(trace_file)) {
+        std::cerr << "Unable to write the trace to "
+                  << trace_file.toLocal8Bit().constData() << std::endl;
+    }
 }
@@ -0,0 +1,107 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AlternativeImageSource.h"
+#include "ImageViewBase.h"
+#include "BackgroundExecutor.h"
+#include "AbstractCommand.h"
+#include "IntrusivePtr.h"
+#include "TraceRecorder.h"
+#include <QPointer>
+
+class AlternativeImageSource::BuildTask :
+    public AbstractCommand0<IntrusivePtr<AbstractCommand0<void> > >
+{
+    DECLARE_NON_COPYABLE(BuildTask)
+public:
+    BuildTask(AlternativeImageSource* source, Builder const& builder)
+        :   m_ptrResult(new Result(source)),
+            m_builder(builder)
+    {
+    }
+
+    virtual IntrusivePtr<AbstractCommand0<void> > operator()()
+    {
+        TraceRecorder::Span const trace_span("alternative_image");
+
+        QImage const image(m_builder());
+        if (image.isNull() || BackgroundExecutor::currentTaskCancelled()) {
+            return IntrusivePtr<AbstractCommand0<void> >();
+        }
+
+        m_ptrResult->setData(image, ImageViewBase::createDownscaledImage(image));
+        return m_ptrResult;
+    }
+private:
+    class Result : public AbstractCommand0<void>
+    {
+    public:
+        Result(AlternativeImageSource* source) : m_ptrSource(source) {}
+
+        void setData(QImage const& image, QImage const& downscaled_image)
+        {
+            m_image = image;
+            m_downscaledImage = downscaled_image;
+        }
+
+        virtual void operator()()
+        {
+            if (m_ptrSource) {
+                m_ptrSource->built(m_image, m_downscaledImage);
+            }
+        }
+    private:
+        QPointer<AlternativeImageSource> m_ptrSource;
+        QImage m_image;
+        QImage m_downscaledImage;
+    };
+
+    IntrusivePtr<Result> m_ptrResult;
+    Builder m_builder;
+};
+
+AlternativeImageSource::AlternativeImageSource(Builder const& builder)
+    :   m_builder(builder),
+        m_requested(false)
+{
+}
+
+AlternativeImageSource::~AlternativeImageSource()
+{
+}
+
+void
+AlternativeImageSource::request()
+{
+    if (m_requested) {
+        return;
+    }
+    m_requested = true;
+
+    ImageViewBase::backgroundExecutor().enqueueTask(
+        BackgroundExecutor::TaskPtr(new BuildTask(this, m_builder)), this
+    );
+}
+
+void
+AlternativeImageSource::built(QImage const& image, QImage const& downscaled_image)
+{
+    m_ptrImage.reset(new QImage(image));
+    m_ptrDownscaledPixmap.reset(new QPixmap(QPixmap::fromImage(downscaled_image)));
+    emit ready();
+}
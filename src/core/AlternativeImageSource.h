@@ -0,0 +1,90 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ALTERNATIVEIMAGESOURCE_H_
+#define ALTERNATIVEIMAGESOURCE_H_
+
+#include "NonCopyable.h"
+#include <QObject>
+#include <QImage>
+#include <QPixmap>
+#include <boost/function.hpp>
+#include <memory>
+
+/**
+ * \brief Builds the image an ImageViewBase shows in place of its own
+ *        while the "display original" key is held, on first request.
+ *
+ * Building one may take a full resolution transform, which is wasted
+ * work when nobody looks at it.  So nothing is built until request()
+ * is called.  The builder then runs on ImageViewBase::backgroundExecutor(),
+ * and ready() is emitted on the GUI thread when the result is in.
+ *
+ * A single source may be shared by several views.
+ */
+class AlternativeImageSource : public QObject
+{
+    Q_OBJECT
+    DECLARE_NON_COPYABLE(AlternativeImageSource)
+public:
+    /**
+     * Called from a background thread, so it must not touch anything
+     * that's not its own.
+     */
+    typedef boost::function<QImage()> Builder;
+
+    explicit AlternativeImageSource(Builder const& builder);
+
+    virtual ~AlternativeImageSource();
+
+    /**
+     * \brief Starts building the image, unless that was already done.
+     */
+    void request();
+
+    /**
+     * \brief Returns the image, or null if it's not ready yet.
+     */
+    std::shared_ptr<QImage> image() const
+    {
+        return m_ptrImage;
+    }
+
+    /**
+     * \brief Returns the downscaled version of image(), as produced
+     *        by ImageViewBase::createDownscaledImage(), or null if
+     *        it's not ready yet.
+     */
+    std::shared_ptr<QPixmap> downscaledPixmap() const
+    {
+        return m_ptrDownscaledPixmap;
+    }
+signals:
+    void ready();
+private:
+    class BuildTask;
+
+    void built(QImage const& image, QImage const& downscaled_image);
+
+    Builder m_builder;
+    std::shared_ptr<QImage> m_ptrImage;
+    std::shared_ptr<QPixmap> m_ptrDownscaledPixmap;
+    bool m_requested;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "AnalysisResolution.h"
+#include "Dpi.h"
+#include "imageproc/GrayImage.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/BinaryThreshold.h"
+#include "imageproc/ConnCompExtractor.h"
+#include "imageproc/Connectivity.h"
+#include "imageproc/Scale.h"
+#include <QAtomicInt>
+#include <QSize>
+#include <vector>
+#include <algorithm>
+
+using namespace imageproc;
+
+namespace
+{
+
+QAtomicInt g_adaptive(0);
+
+int const PREVIEW_DPI = 150;
+
+/**
+ * The median component height of body text at 300 dpi.  That's
+ * somewhere between the x-height and the cap height of a 10-12 pt font.
+ */
+int const REFERENCE_TEXT_HEIGHT = 24;
+
+/**
+ * Below that, there is too little detail left for any analysis.
+ */
+int const MIN_ANALYSIS_DPI = 150;
+
+/**
+ * Resolutions are reduced only if that saves at least that much per axis.
+ */
+double const MIN_REDUCTION = 0.8;
+
+size_t const MIN_COMPONENTS = 30;
+
+} // anonymous namespace
+
+void
+AnalysisResolution::setAdaptive(bool const adaptive)
+{
+    g_adaptive.storeRelease(adaptive ? 1 : 0);
+}
+
+bool
+AnalysisResolution::isAdaptive()
+{
+    return g_adaptive.loadAcquire() != 0;
+}
+
+Dpi
+AnalysisResolution::choose(
+    GrayImage const& image, Dpi const& dpi, int const reference_dpi)
+{
+    if (!isAdaptive() || image.isNull() || dpi.isNull()) {
+        return Dpi();
+    }
+
+    int const min_dpi = std::min(dpi.horizontal(), dpi.vertical());
+    if (min_dpi * MIN_REDUCTION < MIN_ANALYSIS_DPI) {
+        return Dpi();
+    }
+
+    int const text_height = estimateTextHeight(image, dpi);
+    if (text_height <= 0) {
+        return Dpi();
+    }
+
+    int const target_dpi = std::max(
+        MIN_ANALYSIS_DPI, reference_dpi * REFERENCE_TEXT_HEIGHT / text_height
+    );
+    if (target_dpi > min_dpi * MIN_REDUCTION) {
+        return Dpi();
+    }
+
+    return Dpi(target_dpi, target_dpi);
+}
+
+int
+AnalysisResolution::estimateTextHeight(GrayImage const& image, Dpi const& dpi)
+{
+    double const xscale = std::min(1.0, double(PREVIEW_DPI) / dpi.horizontal());
+    double const yscale = std::min(1.0, double(PREVIEW_DPI) / dpi.vertical());
+    QSize const preview_size(
+        std::max(1, int(image.width() * xscale + 0.5)),
+        std::max(1, int(image.height() * yscale + 0.5))
+    );
+    GrayImage const preview(
+        preview_size == image.size() ? image : scaleToGray(image, preview_size)
+    );
+    BinaryImage const bw(preview, BinaryThreshold::otsuThreshold(preview));
+
+    int const max_height = preview.height() / 8;
+    std::vector<int> heights;
+    ConnCompExtractor const extractor(bw, CONN8);
+    for (size_t i = 0; i < extractor.size(); ++i) {
+        ConnComp const& cc = extractor[i];
+        if (cc.height() < 2 || cc.height() > max_height) {
+            continue;
+        }
+        if (cc.width() > cc.height() * 8) {
+            // Underlines, rules and the like.
+            continue;
+        }
+        heights.push_back(cc.height());
+    }
+
+    if (heights.size() < MIN_COMPONENTS) {
+        return 0;
+    }
+
+    std::vector<int>::iterator const median(heights.begin() + heights.size() / 2);
+    std::nth_element(heights.begin(), median, heights.end());
+    return int(*median * 300.0 / (dpi.vertical() * yscale) + 0.5);
+}
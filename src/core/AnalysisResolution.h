@@ -0,0 +1,76 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ANALYSIS_RESOLUTION_H_
+#define ANALYSIS_RESOLUTION_H_
+
+class Dpi;
+
+namespace imageproc
+{
+class GrayImage;
+}
+
+/**
+ * \brief Picks the resolution to analyse a page at from the size of its text.
+ *
+ * The analysis done by filters is tuned for text of ordinary size at
+ * some resolution.  A 1200 dpi scan, or a book set in large print,
+ * carries more detail than the analysis needs, so in adaptive mode
+ * it's done on a downscaled copy instead.  The size of the text is
+ * estimated from the heights of connected components in a 150 dpi
+ * preview.
+ *
+ * Adaptive mode is off by default, as its results may differ slightly
+ * from those obtained at the full resolution.
+ */
+class AnalysisResolution
+{
+public:
+    static void setAdaptive(bool adaptive);
+
+    static bool isAdaptive();
+
+    /**
+     * \brief Returns the resolution to analyse an image at.
+     *
+     * \param image The image to analyse.
+     * \param dpi The resolution of \p image.
+     * \param reference_dpi The resolution at which the analysis would
+     *        see text of ordinary size as ordinary.
+     * \return A resolution that's the same in both directions and is
+     *         lower than both components of \p dpi, or a null Dpi if
+     *         the image should be analysed as it is.  The latter is
+     *         always the case unless adaptive mode is on.
+     */
+    static Dpi choose(
+        imageproc::GrayImage const& image, Dpi const& dpi, int reference_dpi);
+
+    /**
+     * \brief The median height of connected components in \p image,
+     *        converted to 300 dpi.
+     *
+     * Components too small to be text or too large to be a line of it
+     * are not counted.  Returns 0 if there are too few components left
+     * to tell.
+     */
+    static int estimateTextHeight(imageproc::GrayImage const& image, Dpi const& dpi);
+};
+
+#endif
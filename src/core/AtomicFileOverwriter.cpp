@@ -21,6 +21,11 @@
 #include <QString>
 #include <QFile>
 #include <QTemporaryFile>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 AtomicFileOverwriter::AtomicFileOverwriter()
 {
@@ -45,6 +50,20 @@ AtomicFileOverwriter::startWriting(QString const& file_path)
     return m_ptrTempFile.get();
 }
 
+bool
+AtomicFileOverwriter::sync()
+{
+    if (!m_ptrTempFile.get() || !m_ptrTempFile->flush()) {
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    return _commit(m_ptrTempFile->handle()) == 0;
+#else
+    return fsync(m_ptrTempFile->handle()) == 0;
+#endif
+}
+
 bool
 AtomicFileOverwriter::commit()
 {
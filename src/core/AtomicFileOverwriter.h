@@ -56,6 +56,15 @@ public:
      */
     QIODevice* startWriting(QString const& file_path);
 
+    /**
+     * \brief Forces the data written so far to the disk.
+     *
+     * Calling this before commit() makes sure a crash right after
+     * the replacement can't leave the target file truncated.
+     * Returns false if there is no temporary file or syncing failed.
+     */
+    bool sync();
+
     /**
      * \brief Replaces the target file with the temporary one.
      *
@@ -18,46 +18,93 @@
 
 #include "BackgroundExecutor.h"
 #include "OutOfMemoryHandler.h"
+#include "TraceRecorder.h"
 #include <QCoreApplication>
 #include <QObject>
 #include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QAtomicInt>
 #include <QEvent>
+#include <deque>
+#include <vector>
+#include <algorithm>
 #include <new>
 #include <assert.h>
 
-class BackgroundExecutor::Dispatcher : public QObject
+class BackgroundExecutor::Entry
 {
 public:
-    Dispatcher(Impl& owner);
+    Entry(TaskPtr const& task, void const* key) : task(task), key(key) {}
+
+    void cancel()
+    {
+        m_cancelFlag.fetchAndStoreRelaxed(1);
+    }
+
+    bool isCancelled() const
+    {
+        return m_cancelFlag.fetchAndAddRelaxed(0) != 0;
+    }
+
+    TaskPtr task;
+    TaskResultPtr result;
+    void const* key;
+private:
+    mutable QAtomicInt m_cancelFlag;
+};
+
+class BackgroundExecutor::Worker : public QThread
+{
+public:
+    Worker(Impl& owner) : m_rOwner(owner) {}
+
+    /**
+     * The entry being executed.  Only accessed from this thread.
+     */
+    std::shared_ptr<Entry> current;
 protected:
-    virtual void customEvent(QEvent* event);
+    virtual void run();
 private:
     Impl& m_rOwner;
 };
 
-class BackgroundExecutor::Impl : public QThread
+/**
+ * Lives in the thread the executor was constructed in,
+ * where it receives task results.
+ */
+class BackgroundExecutor::Impl : public QObject
 {
 public:
-    Impl(BackgroundExecutor& owner);
+    Impl(int max_threads);
 
     ~Impl();
 
-    void enqueueTask(TaskPtr const& task);
-protected:
-    virtual void run();
+    void enqueueTask(TaskPtr const& task, void const* key);
 
+    void processTasks(Worker& worker);
+protected:
     virtual void customEvent(QEvent* event);
 private:
-    BackgroundExecutor& m_rOwner;
-    Dispatcher m_dispatcher;
-    bool m_threadStarted;
+    QMutex m_mutex;
+    QWaitCondition m_queueChanged;
+    std::deque<std::shared_ptr<Entry> > m_queue;
+    std::vector<std::shared_ptr<Entry> > m_running;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    int m_maxThreads;
+    int m_numIdleWorkers;
+    bool m_shuttingDown;
 };
 
 /*============================ BackgroundExecutor ==========================*/
 
-BackgroundExecutor::BackgroundExecutor()
-    :   m_ptrImpl(new Impl(*this))
+BackgroundExecutor::BackgroundExecutor(int max_threads)
 {
+    if (max_threads <= 0) {
+        max_threads = qBound(1, QThread::idealThreadCount(), 3);
+    }
+    m_ptrImpl.reset(new Impl(max_threads));
 }
 
 BackgroundExecutor::~BackgroundExecutor()
@@ -71,71 +118,133 @@ BackgroundExecutor::shutdown()
 }
 
 void
-BackgroundExecutor::enqueueTask(TaskPtr const& task)
+BackgroundExecutor::enqueueTask(TaskPtr const& task, void const* key)
 {
     if (m_ptrImpl.get()) {
-        m_ptrImpl->enqueueTask(task);
+        m_ptrImpl->enqueueTask(task, key);
     }
 }
 
-/*===================== BackgroundExecutor::Dispatcher =====================*/
-
-BackgroundExecutor::Dispatcher::Dispatcher(Impl& owner)
-    :   m_rOwner(owner)
+bool
+BackgroundExecutor::currentTaskCancelled()
 {
+    if (Worker* worker = dynamic_cast<Worker*>(QThread::currentThread())) {
+        return worker->current && worker->current->isCancelled();
+    }
+    return false;
 }
 
+/*======================= BackgroundExecutor::Worker =======================*/
+
 void
-BackgroundExecutor::Dispatcher::customEvent(QEvent* event)
+BackgroundExecutor::Worker::run()
 {
-    try {
-        TaskEvent* evt = dynamic_cast<TaskEvent*>(event);
-        assert(evt);
-
-        TaskPtr const& task = evt->payload();
-        assert(task);
-
-        TaskResultPtr const result((*task)());
-        if (result) {
-            QCoreApplication::postEvent(
-                &m_rOwner, new ResultEvent(result)
-            );
-        }
-    } catch (std::bad_alloc const&) {
-        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
-    }
+    m_rOwner.processTasks(*this);
 }
 
 /*======================= BackgroundExecutor::Impl =========================*/
 
-BackgroundExecutor::Impl::Impl(BackgroundExecutor& owner)
-    :   m_rOwner(owner),
-        m_dispatcher(*this),
-        m_threadStarted(false)
+BackgroundExecutor::Impl::Impl(int const max_threads)
+    :   m_maxThreads(max_threads),
+        m_numIdleWorkers(0),
+        m_shuttingDown(false)
 {
-    m_dispatcher.moveToThread(this);
 }
 
 BackgroundExecutor::Impl::~Impl()
 {
-    exit();
-    wait();
+    {
+        QMutexLocker const locker(&m_mutex);
+        m_shuttingDown = true;
+        m_queue.clear();
+        for (std::shared_ptr<Entry> const& entry : m_running) {
+            entry->cancel();
+        }
+        m_queueChanged.wakeAll();
+    }
+
+    for (std::unique_ptr<Worker> const& worker : m_workers) {
+        worker->wait();
+    }
 }
 
 void
-BackgroundExecutor::Impl::enqueueTask(TaskPtr const& task)
+BackgroundExecutor::Impl::enqueueTask(TaskPtr const& task, void const* const key)
 {
-    QCoreApplication::postEvent(&m_dispatcher, new TaskEvent(task));
-    if (!m_threadStarted) {
-        start();
-        m_threadStarted = true;
+    QMutexLocker const locker(&m_mutex);
+
+    if (m_shuttingDown) {
+        return;
+    }
+
+    if (key) {
+        m_queue.erase(
+            std::remove_if(
+                m_queue.begin(), m_queue.end(),
+                [key](std::shared_ptr<Entry> const& entry) {
+                    return entry->key == key;
+                }
+            ),
+            m_queue.end()
+        );
+        for (std::shared_ptr<Entry> const& entry : m_running) {
+            if (entry->key == key) {
+                entry->cancel();
+            }
+        }
+    }
+
+    m_queue.push_back(std::make_shared<Entry>(task, key));
+
+    if (m_numIdleWorkers == 0 && int(m_workers.size()) < m_maxThreads) {
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker(*this)));
+        m_workers.back()->start();
+    } else {
+        m_queueChanged.wakeOne();
     }
 }
 
 void
-BackgroundExecutor::Impl::run()
+BackgroundExecutor::Impl::processTasks(Worker& worker)
 {
-    exec();
+    QMutexLocker locker(&m_mutex);
+
+    for (;;) {
+        ++m_numIdleWorkers;
+        while (!m_shuttingDown && m_queue.empty()) {
+            m_queueChanged.wait(&m_mutex);
+        }
+        --m_numIdleWorkers;
+
+        if (m_shuttingDown) {
+            return;
+        }
+
+        worker.current = m_queue.front();
+        m_queue.pop_front();
+        m_running.push_back(worker.current);
+
+        locker.unlock();
+
+        try {
+            TraceRecorder::Span const trace_span("background_task");
+            worker.current->result = (*worker.current->task)();
+        } catch (std::bad_alloc const&) {
+            OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+        }
+
+        // Let the task go away in this thread rather than in the GUI one.
+        worker.current->task.reset();
+
+        if (worker.current->result && !worker.current->isCancelled()) {
+            QCoreApplication::postEvent(this, new ResultEvent(worker.current));
+        }
+
+        locker.relock();
+
+        m_running.erase(std::find(m_running.begin(), m_running.end(), worker.current));
+        worker.current.reset();
+    }
 }
 
 void
@@ -144,8 +253,11 @@ BackgroundExecutor::Impl::customEvent(QEvent* event)
     ResultEvent* evt = dynamic_cast<ResultEvent*>(event);
     assert(evt);
 
-    TaskResultPtr const& result = evt->payload();
-    assert(result);
+    std::shared_ptr<Entry> const& entry = evt->payload();
+    assert(entry->result);
 
-    (*result)();
+    // It may have been superseded while the event was in flight.
+    if (!entry->isCancelled()) {
+        (*entry->result)();
+    }
 }
@@ -32,7 +32,12 @@ public:
     typedef IntrusivePtr<AbstractCommand0<void> > TaskResultPtr;
     typedef IntrusivePtr<AbstractCommand0<TaskResultPtr> > TaskPtr;
 
-    BackgroundExecutor();
+    /**
+     * \param max_threads The maximum number of background threads.
+     *        Threads are started as tasks arrive.  Zero selects
+     *        a small number based on the number of CPU cores.
+     */
+    explicit BackgroundExecutor(int max_threads = 0);
 
     /**
      * \brief Waits for background tasks to finish, then destroys the object.
@@ -40,11 +45,12 @@ public:
     ~BackgroundExecutor();
 
     /**
-     * \brief Waits for pending jobs to finish and stop the background thread.
+     * \brief Waits for running jobs to finish and stops the background threads.
      *
-     * The destructor also performs these tasks, so this method is only
-     * useful to prematuraly stop task processing.  After shutdown, any
-     * attempts to enqueue a task will be silently ignored.
+     * Tasks that haven't started yet are dropped.  The destructor also
+     * performs these tasks, so this method is only useful to prematuraly
+     * stop task processing.  After shutdown, any attempts to enqueue
+     * a task will be silently ignored.
      */
     void shutdown();
 
@@ -55,13 +61,31 @@ public:
      * That functor may optionally return another one, that is
      * to be executed in the thread where this BackgroundExecutor
      * object was constructed.
+     *
+     * Tasks may run concurrently and finish in any order.
+     *
+     * \param key If not null, the task supersedes the previously enqueued
+     *        ones with the same key.  Those that haven't started are dropped.
+     *        Those that have keep running, but currentTaskCancelled()
+     *        returns true for them, and their results are discarded.
+     *        The address of whatever holds the task on the client side
+     *        makes a good key.
+     */
+    void enqueueTask(TaskPtr const& task, void const* key = 0);
+
+    /**
+     * \brief Returns true if the task running in the current thread
+     *        was superseded or the executor is shutting down.
+     *
+     * Long running tasks may poll this to finish early.  Always returns
+     * false when not called from a task.
      */
-    void enqueueTask(TaskPtr const& task);
+    static bool currentTaskCancelled();
 private:
     class Impl;
-    class Dispatcher;
-    typedef PayloadEvent<TaskPtr> TaskEvent;
-    typedef PayloadEvent<TaskResultPtr> ResultEvent;
+    class Worker;
+    class Entry;
+    typedef PayloadEvent<std::shared_ptr<Entry> > ResultEvent;
 
     std::unique_ptr<Impl> m_ptrImpl;
 };
@@ -32,3 +32,10 @@ BackgroundTask::throwIfCancelled() const
     }
 }
 
+void
+BackgroundTask::postPreview(FilterResultPtr const& preview) const
+{
+    if (m_pPreviewSink && preview) {
+        m_pPreviewSink->previewReady(preview);
+    }
+}
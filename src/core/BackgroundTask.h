@@ -37,7 +37,18 @@ public:
         virtual char const* what() const throw();
     };
 
-    BackgroundTask(Type type) : m_type(type) {}
+    /**
+     * \brief Receives previews posted by a running task.
+     */
+    class PreviewSink
+    {
+    public:
+        virtual ~PreviewSink() {}
+
+        virtual void previewReady(FilterResultPtr const& preview) = 0;
+    };
+
+    BackgroundTask(Type type) : m_type(type), m_pPreviewSink(nullptr) {}
 
     Type type() const
     {
@@ -58,9 +69,25 @@ public:
      * \brief If cancelled, throws CancelledException.
      */
     virtual void throwIfCancelled() const;
+
+    /**
+     * \brief Forwards the preview to the sink, if one is set.
+     */
+    virtual void postPreview(FilterResultPtr const& preview) const;
+
+    /**
+     * \brief Sets the receiver of previews, or nullptr to drop them.
+     *
+     * Set by whoever executes the task, for the duration of execution.
+     */
+    void setPreviewSink(PreviewSink* sink)
+    {
+        m_pPreviewSink = sink;
+    }
 private:
     mutable QAtomicInt m_cancelFlag;
     Type const m_type;
+    PreviewSink* m_pPreviewSink;
 };
 
 typedef IntrusivePtr<BackgroundTask> BackgroundTaskPtr;
@@ -18,6 +18,7 @@
 */
 
 #include <cstdlib>
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
 #include <tiff.h>
@@ -26,6 +27,7 @@
 #include <QMap>
 #include <QRegularExpression>
 #include <QStringList>
+#include <QThread>
 #include "settings/ini_keys.h"
 
 #include "Dpi.h"
@@ -44,7 +46,8 @@ CommandLine CommandLine::m_globalInstance;
 void
 CommandLine::set(CommandLine const& cl)
 {
-    assert(!m_globalInstance.isGlobal());
+    // scantailor-cli --serve replaces the global instance for every job.
+    assert(&cl != &m_globalInstance);
 
     m_globalInstance = cl;
     m_globalInstance.setGlobal();
@@ -104,6 +107,7 @@ CommandLine::parseCli(QStringList const& argv)
     opts << "normalize-illumination";
     opts << "threshold";
     opts << "despeckle";
+    opts << "despeckle-tiled";
     opts << "dewarping";
     opts << "depth-perception";
     opts << "start-filter";
@@ -127,6 +131,28 @@ CommandLine::parseCli(QStringList const& argv)
     opts << "tiff-force-rgb";
     opts << "tiff-force-grayscale";
     opts << "tiff-force-keep-color-space";
+    opts << "threads";
+    opts << "pipeline";
+    opts << "profile";
+    opts << "trace";
+    opts << "memory-limit";
+    opts << "image-cache";
+    opts << "shared-output-cache";
+    opts << "serve";
+    opts << "metrics";
+    opts << "status-interval";
+    opts << "pages";
+    opts << "merge";
+    opts << "renditions";
+    opts << "checkpoint";
+    opts << "resume";
+    opts << "watch";
+    opts << "startup-benchmark";
+    opts << "gpu-compute";
+    opts << "project-snapshot";
+    opts << "numa";
+    opts << "disable-huge-pages";
+    opts << "adaptive-analysis";
 
     QMap<QString, QString> shortMap;
     shortMap["h"] = "help";
@@ -282,6 +308,7 @@ CommandLine::setup()
     m_startFilterIdx = fetchStartFilterIdx();
     m_endFilterIdx = fetchEndFilterIdx();
     m_matchLayoutTolerance = fetchMatchLayoutTolerance();
+    m_threads = fetchThreads();
     m_dewarpingMode = fetchDewarpingMode();
     m_compressionBW = fetchCompressionBW();
     m_compressionColor = fetchCompressionColor();
@@ -291,11 +318,9 @@ CommandLine::setup()
     m_pageDetectionTolerance = fetchPageDetectionTolerance();
     m_defaultNull = fetchDefaultNull();
 
-    QRegularExpression exp("^.*(tif|tiff|jpg|jpeg|bmp|gif|png|pbm|pgm|ppm|xbm|xpm)$", QRegularExpression::CaseInsensitiveOption);
     // setup images
     for (int i = 0; i < (int)m_files.size(); ++i) {
-        QRegularExpressionMatch match = exp.match(m_files[i].filePath());
-        if (! match.hasMatch()) {
+        if (!isImageFile(m_files[i].filePath())) {
 #ifdef DEBUG
             std::cout << "Skipping file: " << m_files[i].filePath().toStdString() << std::endl;
 #endif
@@ -312,6 +337,13 @@ CommandLine::setup()
     }
 }
 
+bool
+CommandLine::isImageFile(QString const& path)
+{
+    static QRegularExpression const exp("^.*(tif|tiff|jpg|jpeg|bmp|gif|png|pbm|pgm|ppm|xbm|xpm)$", QRegularExpression::CaseInsensitiveOption);
+    return exp.match(path).hasMatch();
+}
+
 void
 CommandLine::printHelp()
 {
@@ -324,6 +356,7 @@ CommandLine::printHelp()
     std::cout << "\t2) scantailor <project_file>" << std::endl;
     std::cout << "\t3) scantailor-cli [options] <images|directory|-> <output_directory>" << std::endl;
     std::cout << "\t4) scantailor-cli [options] <project_file> [output_directory]" << std::endl;
+    std::cout << "\t5) scantailor-cli --serve=<socket_name> [--memory-limit=<MiB>] [--metrics=[<address>:]<port>] [--status-interval=<seconds>]" << std::endl;
     std::cout << std::endl;
     std::cout << "1)" << std::endl;
     std::cout << "\tstart ScanTailor's GUI interface" << std::endl;
@@ -335,6 +368,9 @@ CommandLine::printHelp()
     std::cout << "4)" << std::endl;
     std::cout << "\tbatch processing project from command line; no GUI" << std::endl;
     std::cout << "\tif output_directory is specified as last argument, it overwrites the one in project file" << std::endl;
+    std::cout << "5)" << std::endl;
+    std::cout << "\trun forms 3) and 4) as jobs sent over a local socket, one after another, in a single process" << std::endl;
+    std::cout << "\tprogress is sent back as lines of \"<job> queued|started|progress <filter> <done>/<total>|done|failed <error>\"" << std::endl;
     std::cout << std::endl;
     std::cout << "Options:" << std::endl;
     std::cout << "\t--help, -h" << std::endl;
@@ -393,19 +429,49 @@ CommandLine::printHelp()
     std::cout << "\t--normalize-illumination\t\t-- default: false" << std::endl;
     std::cout << "\t--threshold=<n>\t\t\t\t-- n<0 thinner, n>0 thicker; default: 0" << std::endl;
     std::cout << "\t--despeckle=<off|cautious|normal|aggressive>\n\t\t\t\t\t\t-- default: normal" << std::endl;
+    std::cout << "\t--despeckle-tiled\t\t\t-- despeckle large pages in parallel tiles" << std::endl;
     std::cout << "\t--dewarping=<off|auto>\t\t\t-- default: off" << std::endl;
     std::cout << "\t--depth-perception=<1.0...3.0>\t\t-- default: 2.0" << std::endl;
     std::cout << "\t--start-filter=<1...6>\t\t\t-- default: 4" << std::endl;
     std::cout << "\t--end-filter=<1...6>\t\t\t-- default: 6" << std::endl;
     std::cout << "\t--output-project=, -o=<project_name>" << std::endl;
     std::cout << "\t--tiff-compression=<lzw|deflate|packbits|jpeg|none>\t-- default: lzw" << std::endl;
+    std::cout << "\t--renditions=<dpi>:<color|gray|bw>[:<compression>[:<subdir>]],...\n"
+              "\t\t\t\t\t\t-- also write these copies of each output file, resampled from it,\n"
+              "\t\t\t\t\t\t   to <output_directory>/<subdir>; default subdir: <dpi>dpi" << std::endl;
     std::cout << "\t--tiff-force-rgb\t\t\t-- all output tiffs will be rgb" << std::endl;
     std::cout << "\t--tiff-force-grayscale\t\t\t-- all output tiffs will be grayscale" << std::endl;
     std::cout << "\t--tiff-force-keep-color-space\t\t-- output tiffs will be in original color space" << std::endl;
     std::cout << "\t--window-title=WindowTitle\t\t-- default: project name" << std::endl;
     std::cout << "\t--page-detection-box=<widthxheight>\t\t-- in mm" << std::endl;
     std::cout << "\t\t--page-detection-tolerance=<0.0..1.0>\t-- default: 0.1" << std::endl;
-    std::cout << "\t--disable-check-output\t\t\t-- don't check if page is valid when switching to step 6";
+    std::cout << "\t--disable-check-output\t\t\t-- don't check if page is valid when switching to step 6" << std::endl;
+    std::cout << "\t--threads=<auto|1...)\t\t\t-- default: 1; number of pages processed in parallel by scantailor-cli" << std::endl;
+    std::cout << "\t--pipeline\t\t\t\t-- run filters 1-4 page by page, decoding each image only once" << std::endl;
+    std::cout << "\t--profile=<report.json>\t\t\t-- write per-page and per-stage timings and counters to a JSON file" << std::endl;
+    std::cout << "\t--trace=<trace.json>\t\t\t-- write a Chrome trace-event timeline of all threads; also SCANTAILOR_TRACE=<trace.json>" << std::endl;
+    std::cout << "\t--disable-huge-pages\t\t\t-- don't back large image buffers with transparent huge pages" << std::endl;
+    std::cout << "\t--numa\t\t\t\t\t-- on multi-socket machines, keep each worker thread and the images it decodes on one NUMA node" << std::endl;
+    std::cout << "\t--adaptive-analysis\t\t\t-- deskew high resolution scans at a lower resolution picked from the size of their text;" << std::endl;
+    std::cout << "\t\t\t\t\t\t   faster, but angles may differ slightly" << std::endl;
+    std::cout << "\t--memory-limit=<MiB>\t\t\t-- don't start pages in parallel once their estimated working set exceeds this" << std::endl;
+    std::cout << "\t--image-cache=<MiB>\t\t\t-- default: 256; keep this much of decoded images for the next stages of the same pages; 0 disables" << std::endl;
+    std::cout << "\t--shared-output-cache=<dir>\t\t-- reuse output pages produced from the same scans with the same settings, by any project" << std::endl;
+    std::cout << "\t--pages=<from>-<to>\t\t\t-- only process these images of the project, counting from 1; for splitting a book across machines" << std::endl;
+    std::cout << "\t--merge=<project>@<from>-<to>,...\t-- take settings of these images from projects processed with --pages into <project_file>;" << std::endl;
+    std::cout << "\t\t\t\t\t\t   start-filter and end-filter then default to 5, recomputing the page layout of all pages" << std::endl;
+    std::cout << "\t--checkpoint[=<pages>]\t\t\t-- save progress to the output directory every 50 or so pages" << std::endl;
+    std::cout << "\t--resume\t\t\t\t-- continue an interrupted run from its last checkpoint; implies --checkpoint" << std::endl;
+    std::cout << "\t--watch=<input_directory>\t\t-- process images as they appear in the directory, in place of input images;" << std::endl;
+    std::cout << "\t\t\t\t\t\t   filters 5 and 6 run once a file named book.done appears there" << std::endl;
+    std::cout << "\t--startup-benchmark\t\t\t-- GUI only: quit as soon as the main window is shown; for timing startup" << std::endl;
+    std::cout << "\t--gpu-compute\t\t\t\t-- run blurring, gray morphology and local binarization on an OpenCL GPU, if there is one;" << std::endl;
+    std::cout << "\t\t\t\t\t\t   results may differ slightly from the CPU ones" << std::endl;
+    std::cout << "\t--project-snapshot\t\t\t-- read <project_file> from <project_file>.snapshot when that was made from the same XML," << std::endl;
+    std::cout << "\t\t\t\t\t\t   and write the snapshot otherwise; faster to open for large projects" << std::endl;
+    std::cout << "\t--serve=<socket_name>\t\t\t-- keep running and take jobs from a local socket; each line is a JSON array of the other arguments" << std::endl;
+    std::cout << "\t--metrics=[<address>:]<port>\t\t-- with --serve: serve Prometheus metrics over HTTP at /metrics; the address defaults to 127.0.0.1" << std::endl;
+    std::cout << "\t--status-interval=<seconds>\t\t-- with --serve: print a JSON status line to standard output this often";
     std::cout << std::endl;
 }
 
@@ -814,6 +880,21 @@ CommandLine::fetchMatchLayoutTolerance()
     return m_options["match-layout-tolerance"].toFloat();
 }
 
+int
+CommandLine::fetchThreads()
+{
+    if (!hasThreads()) {
+        return 1;
+    }
+
+    QString const threads = m_options.value("threads").toLower();
+    if (threads == "auto") {
+        return std::max(1, QThread::idealThreadCount());
+    }
+
+    return std::max(1, threads.toInt());
+}
+
 bool
 CommandLine::hasMargins(QString base) const
 {
@@ -230,6 +230,10 @@ public:
     {
         return contains("despeckle") && !m_options["despeckle"].isEmpty();
     }
+    bool isDespeckleTiled() const
+    {
+        return contains("despeckle-tiled");
+    }
     bool hasDewarping() const
     {
         return contains("dewarping");
@@ -277,6 +281,90 @@ public:
     {
         return contains("disable-check-output");
     }
+    bool isPipelined() const
+    {
+        return contains("pipeline");
+    }
+    bool hasThreads() const
+    {
+        return contains("threads") && !m_options["threads"].isEmpty();
+    }
+    bool hasProfile() const
+    {
+        return contains("profile") && !m_options["profile"].isEmpty();
+    }
+    bool hasTrace() const
+    {
+        return contains("trace") && !m_options["trace"].isEmpty();
+    }
+    bool hasMemoryLimit() const
+    {
+        return contains("memory-limit") && m_options["memory-limit"].toLongLong() > 0;
+    }
+    bool hasImageCache() const
+    {
+        return contains("image-cache") && !m_options["image-cache"].isEmpty();
+    }
+    bool hasServe() const
+    {
+        return contains("serve") && !m_options["serve"].isEmpty();
+    }
+    bool hasMetrics() const
+    {
+        return contains("metrics") && !m_options["metrics"].isEmpty();
+    }
+    bool hasStatusInterval() const
+    {
+        return contains("status-interval") && m_options["status-interval"].toInt() > 0;
+    }
+    bool hasPages() const
+    {
+        return contains("pages") && !m_options["pages"].isEmpty();
+    }
+    bool hasMerge() const
+    {
+        return contains("merge") && !m_options["merge"].isEmpty();
+    }
+    bool hasRenditions() const
+    {
+        return contains("renditions") && !m_options["renditions"].isEmpty();
+    }
+    bool hasCheckpoint() const
+    {
+        return contains("checkpoint") || hasResume();
+    }
+    bool hasResume() const
+    {
+        return contains("resume");
+    }
+    bool hasWatch() const
+    {
+        return contains("watch") && !m_options["watch"].isEmpty();
+    }
+    bool hasStartupBenchmark() const
+    {
+        return contains("startup-benchmark");
+    }
+    bool hasGpuCompute() const
+    {
+        return contains("gpu-compute");
+    }
+    bool hasProjectSnapshot() const
+    {
+        return contains("project-snapshot");
+    }
+    bool hasNuma() const
+    {
+        return contains("numa");
+    }
+    bool hasDisableHugePages() const
+    {
+        return contains("disable-huge-pages");
+    }
+    bool hasAdaptiveAnalysis() const
+    {
+        return contains("adaptive-analysis");
+    }
 
     page_split::LayoutType getLayout() const
     {
@@ -390,6 +478,75 @@ public:
     {
         return m_matchLayoutTolerance;
     }
+    int getThreads() const
+    {
+        return m_threads;
+    }
+    QString getProfileFile() const
+    {
+        return m_options.value("profile");
+    }
+    QString getTraceFile() const
+    {
+        return m_options.value("trace");
+    }
+    /** \brief The memory budget for in-flight pages, in MiB. */
+    qint64 getMemoryLimit() const
+    {
+        return m_options.value("memory-limit").toLongLong();
+    }
+    /** \brief The size of DecodedImageCache, in MiB. */
+    qint64 getImageCacheSize() const
+    {
+        return m_options.value("image-cache").toLongLong();
+    }
+    /** \brief The directory of OutputCache, or an empty string. */
+    QString getSharedOutputCacheDir() const
+    {
+        return m_options.value("shared-output-cache");
+    }
+    /** \brief The range of images to process, as "<from>-<to>" or "<n>". */
+    QString getPages() const
+    {
+        return m_options.value("pages");
+    }
+    /** \brief Projects to merge, as "<project>@<from>-<to>" each. */
+    QStringList getMergeProjects() const
+    {
+        return m_options.value("merge").split(',', QString::SkipEmptyParts);
+    }
+    /** \brief Additional output renditions, as "<dpi>:<mode>[:<compression>[:<subdir>]]" each. */
+    QStringList getRenditions() const
+    {
+        return m_options.value("renditions").split(',', QString::SkipEmptyParts);
+    }
+    /** \brief The number of pages between checkpoints. */
+    int getCheckpointInterval() const
+    {
+        bool ok = false;
+        int const pages = m_options.value("checkpoint").toInt(&ok);
+        return ok && pages > 0 ? pages : 50;
+    }
+    /** \brief The directory scantailor-cli --watch takes images from. */
+    QString getWatchDir() const
+    {
+        return m_options.value("watch");
+    }
+    /** \brief The name of the local socket scantailor-cli --serve listens on. */
+    QString getServeName() const
+    {
+        return m_options.value("serve");
+    }
+    /** \brief Where scantailor-cli --serve serves metrics, as "[<address>:]<port>". */
+    QString getMetricsAddress() const
+    {
+        return m_options.value("metrics");
+    }
+    /** \brief Seconds between status lines of scantailor-cli --serve. */
+    int getStatusInterval() const
+    {
+        return m_options.value("status-interval").toInt();
+    }
     QString getTiffCompressionBW() const {
         return m_compressionBW;
     }
@@ -423,6 +580,9 @@ public:
     }
     void printHelp();
 
+    /** \brief Whether \p path has the extension of an image format we can read. */
+    static bool isImageFile(QString const& path);
+
     static void updateSettings();
 
 private:
@@ -489,6 +649,7 @@ private:
     output::DespeckleLevel m_despeckleLevel;
     output::DepthPerception m_depthPerception;
     float m_matchLayoutTolerance;
+    int m_threads;
 
     bool parseCli(QStringList const& argv);
     void addImage(QString const& path);
@@ -530,6 +691,7 @@ private:
     output::DespeckleLevel fetchDespeckleLevel();
     output::DepthPerception fetchDepthPerception();
     float fetchMatchLayoutTolerance();
+    int fetchThreads();
     QString fetchCompressionBW() const;
     QString fetchCompressionColor() const;
     QString fetchLanguage() const;
@@ -0,0 +1,37 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CONCURRENTJOBS_H_
+#define CONCURRENTJOBS_H_
+
+#ifndef Q_MOC_RUN
+#include <boost/function.hpp>
+#endif
+#include <vector>
+
+/**
+ * \brief Runs independent jobs, concurrently if OpenMP is available.
+ *
+ * Exceptions can't leave an OpenMP region, so they are collected
+ * and the first one is rethrown once all jobs are done.  Jobs must
+ * not touch each other's data, including debug image sinks.
+ */
+void runConcurrently(std::vector<boost::function<void()> > const& jobs);
+
+#endif
@@ -51,17 +51,24 @@ class DebugImageView::ImageLoader :
     public AbstractCommand0<BackgroundExecutor::TaskResultPtr>
 {
 public:
-    ImageLoader(DebugImageView* owner, QString const& file_path)
-        : m_ptrOwner(owner), m_filePath(file_path) {}
+    ImageLoader(DebugImageView* owner, QString const& file_path,
+                boost::function<QImage()> const& image_generator)
+        : m_ptrOwner(owner), m_filePath(file_path), m_imageGenerator(image_generator) {}
 
     virtual BackgroundExecutor::TaskResultPtr operator()()
     {
-        QImage image(m_filePath);
+        QImage image;
+        if (!m_imageGenerator.empty()) {
+            image = m_imageGenerator();
+        } else {
+            image = QImage(m_filePath);
+        }
         return BackgroundExecutor::TaskResultPtr(new ImageLoadResult(m_ptrOwner, image));
     }
 private:
     QPointer<DebugImageView> m_ptrOwner;
     QString m_filePath;
+    boost::function<QImage()> m_imageGenerator;
 };
 
 DebugImageView::DebugImageView(AutoRemovingFile file,
@@ -75,12 +82,23 @@ DebugImageView::DebugImageView(AutoRemovingFile file,
     addWidget(m_pPlaceholderWidget);
 }
 
+DebugImageView::DebugImageView(boost::function<QImage()> const& image_generator,
+                               boost::function<QWidget* (QImage const&)> const& image_view_factory, QWidget* parent)
+    :   QStackedWidget(parent),
+        m_imageGenerator(image_generator),
+        m_imageViewFactory(image_view_factory),
+        m_pPlaceholderWidget(new ProcessingIndicationWidget(this)),
+        m_isLive(false)
+{
+    addWidget(m_pPlaceholderWidget);
+}
+
 void
 DebugImageView::setLive(bool const live)
 {
     if (live && !m_isLive) {
         ImageViewBase::backgroundExecutor().enqueueTask(
-            BackgroundExecutor::TaskPtr(new ImageLoader(this, m_file.get()))
+            BackgroundExecutor::TaskPtr(new ImageLoader(this, m_file.get(), m_imageGenerator))
         );
     } else if (!live && m_isLive) {
         if (QWidget* wgt = currentWidget()) {
@@ -109,9 +127,9 @@ DebugImageView::imageLoaded(QImage const& image)
             image_view.reset(m_imageViewFactory(image));
         }
 
-        if (!m_file.get().isEmpty()) {
+        if (!m_file.get().isEmpty() || !image.isNull()) {
             QAction* save_as = new QAction(tr("Save image as..."), this);
-            connect(save_as, &QAction::triggered, this, [this]() {
+            connect(save_as, &QAction::triggered, this, [this, image]() {
                 QString new_filename = QFileDialog::getSaveFileName(this, tr("Save debug image"),
                                        QDir::currentPath(), tr("PNG images") + " (*.png)");
                 new_filename = new_filename.trimmed();
@@ -137,7 +155,13 @@ DebugImageView::imageLoaded(QImage const& image)
                         }
                     }
 
-                    if (!QFile::copy(m_file.get(), new_filename)) {
+                    if (m_file.get().isEmpty()) {
+                        // A generated image that never went through a file.
+                        if (!image.save(new_filename, "png")) {
+                            QMessageBox::critical(nullptr, tr("File saving error"), tr("Can't write file %1").arg(new_filename));
+                            return;
+                        }
+                    } else if (!QFile::copy(m_file.get(), new_filename)) {
                         QMessageBox::critical(nullptr, tr("File saving error"), tr("Can't copy file %1 to %2").arg(m_file.get(), new_filename));
                         return;
                     }
@@ -39,6 +39,14 @@ public:
                    boost::function<QWidget* (QImage const&)> const& image_view_factory =
                        boost::function<QWidget* (QImage const&)>(), QWidget* parent = 0);
 
+    /**
+     * Creates a view of an image that's generated, in a background
+     * thread, when the view goes live for the first time.
+     */
+    explicit DebugImageView(boost::function<QImage()> const& image_generator,
+                            boost::function<QWidget* (QImage const&)> const& image_view_factory =
+                                boost::function<QWidget* (QImage const&)>(), QWidget* parent = 0);
+
     /**
      * Tells this widget to either display the actual image or just
      * a placeholder.
@@ -51,6 +59,7 @@ private:
     void imageLoaded(QImage const& image);
 
     AutoRemovingFile m_file;
+    boost::function<QImage()> m_imageGenerator;
     boost::function<QWidget* (QImage const&)> m_imageViewFactory;
     QWidget* m_pPlaceholderWidget;
     bool m_isLive;
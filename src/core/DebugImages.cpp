@@ -42,7 +42,9 @@ DebugImages::add(
         return;
     }
 
-    m_sequence.push_back(IntrusivePtr<Item>(new Item(arem_file, label, image_view_factory)));
+    m_sequence.push_back(
+        IntrusivePtr<Item>(new Item(arem_file, ImageGenerator(), label, image_view_factory))
+    );
 }
 
 void
@@ -53,14 +55,27 @@ DebugImages::add(
     add(image.toQImage(), label, image_view_factory);
 }
 
-AutoRemovingFile
-DebugImages::retrieveNext(QString* label, boost::function<QWidget* (QImage const&)>* image_view_factory)
+void
+DebugImages::addLazy(
+    ImageGenerator const& image_generator, QString const& label,
+    boost::function<QWidget* (QImage const&)> const& image_view_factory)
+{
+    m_sequence.push_back(
+        IntrusivePtr<Item>(new Item(AutoRemovingFile(), image_generator, label, image_view_factory))
+    );
+}
+
+bool
+DebugImages::retrieveNext(
+    AutoRemovingFile* file, ImageGenerator* image_generator,
+    QString* label, boost::function<QWidget* (QImage const&)>* image_view_factory)
 {
     if (m_sequence.empty()) {
-        return AutoRemovingFile();
+        return false;
     }
 
-    AutoRemovingFile file(m_sequence.front()->file);
+    *file = m_sequence.front()->file;
+    *image_generator = m_sequence.front()->imageGenerator;
     if (label) {
         *label = m_sequence.front()->label;
     }
@@ -70,5 +85,5 @@ DebugImages::retrieveNext(QString* label, boost::function<QWidget* (QImage const
 
     m_sequence.pop_front();
 
-    return file;
+    return true;
 }
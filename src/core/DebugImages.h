@@ -40,6 +40,8 @@ class BinaryImage;
 class DebugImages
 {
 public:
+    typedef boost::function<QImage()> ImageGenerator;
+
     void add(QImage const& image, QString const& label,
              boost::function<QWidget* (QImage const&)> const& image_view_factory =
                  boost::function<QWidget* (QImage const&)>());
@@ -48,6 +50,19 @@ public:
              boost::function<QWidget* (QImage const&)> const& image_view_factory =
                  boost::function<QWidget* (QImage const&)>());
 
+    /**
+     * \brief Adds an image that is only generated when it's viewed.
+     *
+     * Nothing is rendered or written to disk until then, so visualizations
+     * that are never looked at cost only what it takes to capture their
+     * inputs.  The generator may be called from a background thread
+     * and after the code that added it has finished, so it must own
+     * copies of everything it needs.
+     */
+    void addLazy(ImageGenerator const& image_generator, QString const& label,
+                 boost::function<QWidget* (QImage const&)> const& image_view_factory =
+                     boost::function<QWidget* (QImage const&)>());
+
     bool empty() const
     {
         return m_sequence.empty();
@@ -56,21 +71,26 @@ public:
     /**
      * \brief Removes and returns the first item in the sequence.
      *
-     * The label and viewer widget factory (that may not be bound)
-     * are returned by taking pointers to them as arguments.
-     * Returns a null AutoRemovingFile if image sequence is empty.
+     * The label, viewer widget factory (that may not be bound)
+     * and image generator are returned by taking pointers to them
+     * as arguments.  Images added with addLazy() come with a null
+     * file and a bound generator, the others with a file and
+     * an unbound generator.
+     * Returns false if image sequence is empty.
      */
-    AutoRemovingFile retrieveNext(QString* label = 0,
-                                  boost::function<QWidget* (QImage const&)>* image_view_factory = 0);
+    bool retrieveNext(AutoRemovingFile* file, ImageGenerator* image_generator,
+                      QString* label = 0,
+                      boost::function<QWidget* (QImage const&)>* image_view_factory = 0);
 private:
     struct Item : public RefCountable {
         AutoRemovingFile file;
+        ImageGenerator imageGenerator;
         QString label;
         boost::function<QWidget* (QImage const&)> imageViewFactory;
 
-        Item(AutoRemovingFile f, QString const& l,
+        Item(AutoRemovingFile f, ImageGenerator const& gen, QString const& l,
              boost::function<QWidget* (QImage const&)> const& imf)
-            :   file(f), label(l), imageViewFactory(imf) {}
+            :   file(f), imageGenerator(gen), label(l), imageViewFactory(imf) {}
     };
 
     std::deque<IntrusivePtr<Item> > m_sequence;
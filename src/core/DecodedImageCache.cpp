@@ -0,0 +1,229 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DecodedImageCache.h"
+#include "FilterData.h"
+#include "ImageId.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include <QImage>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutex>
+#include <QMutexLocker>
+#include <map>
+#include <list>
+#include <algorithm>
+
+class DecodedImageCache::Impl
+{
+public:
+    Impl();
+
+    void setLimit(qint64 bytes);
+
+    qint64 limit() const;
+
+    std::unique_ptr<FilterData> find(ImageId const& image_id);
+
+    void store(ImageId const& image_id, FilterData const& data);
+
+    void clear();
+private:
+    struct Entry {
+        ImageId imageId;
+        FilterData data;
+        QDateTime modified;
+        qint64 fileSize;
+        qint64 bytes;
+
+        Entry(ImageId const& image_id, FilterData const& data,
+              QFileInfo const& file_info, qint64 bytes)
+            :   imageId(image_id), data(data),
+                modified(file_info.lastModified()), fileSize(file_info.size()),
+                bytes(bytes) {}
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    static qint64 estimateBytes(QImage const& image);
+
+    void remove(EntryList::iterator it);
+
+    void evict(qint64 limit);
+
+    mutable QMutex m_mutex;
+    EntryList m_entries; /**< Most recently used first. */
+    std::map<ImageId, EntryList::iterator> m_index;
+    qint64 m_limit;
+    qint64 m_totalBytes;
+};
+
+DecodedImageCache::Impl::Impl()
+    :   m_limit(qint64(256) * 1024 * 1024),
+        m_totalBytes(0)
+{
+}
+
+void
+DecodedImageCache::Impl::setLimit(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_limit = std::max<qint64>(0, bytes);
+    evict(m_limit);
+}
+
+qint64
+DecodedImageCache::Impl::limit() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_limit;
+}
+
+std::unique_ptr<FilterData>
+DecodedImageCache::Impl::find(ImageId const& image_id)
+{
+    std::unique_ptr<FilterData> data;
+    if (MemoryBudget::limit() > 0) {
+        return data;
+    }
+
+    // Outside of the lock, as it hits the file system.
+    QFileInfo const file_info(image_id.filePath());
+
+    QMutexLocker const locker(&m_mutex);
+    std::map<ImageId, EntryList::iterator>::iterator const it(m_index.find(image_id));
+    if (it == m_index.end()) {
+        Metrics::add(Metrics::DECODED_IMAGE_CACHE_MISSES);
+        return data;
+    }
+
+    Entry const& entry = *it->second;
+    if (entry.modified != file_info.lastModified() || entry.fileSize != file_info.size()) {
+        remove(it->second);
+        Metrics::add(Metrics::DECODED_IMAGE_CACHE_MISSES);
+        return data;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    data.reset(new FilterData(entry.data));
+    Metrics::add(Metrics::DECODED_IMAGE_CACHE_HITS);
+    return data;
+}
+
+void
+DecodedImageCache::Impl::store(ImageId const& image_id, FilterData const& data)
+{
+    if (MemoryBudget::limit() > 0) {
+        return;
+    }
+
+    QFileInfo const file_info(image_id.filePath());
+    qint64 const bytes = estimateBytes(data.origImage());
+
+    QMutexLocker const locker(&m_mutex);
+    std::map<ImageId, EntryList::iterator>::iterator const it(m_index.find(image_id));
+    if (it != m_index.end()) {
+        remove(it->second);
+    }
+    if (bytes > m_limit) {
+        // Would evict everything else and still not fit.
+        return;
+    }
+
+    evict(m_limit - bytes);
+    m_entries.push_front(Entry(image_id, data, file_info, bytes));
+    m_index[image_id] = m_entries.begin();
+    m_totalBytes += bytes;
+}
+
+void
+DecodedImageCache::Impl::clear()
+{
+    QMutexLocker const locker(&m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_totalBytes = 0;
+}
+
+/**
+ * The image itself plus its grayscale version, which is computed
+ * on demand and shares the pixels of an image that's grayscale already.
+ */
+qint64
+DecodedImageCache::Impl::estimateBytes(QImage const& image)
+{
+    qint64 bytes = image.byteCount();
+    if (image.format() != QImage::Format_Indexed8 || !image.isGrayscale()) {
+        bytes += qint64(image.width()) * image.height();
+    }
+    return bytes;
+}
+
+void
+DecodedImageCache::Impl::remove(EntryList::iterator const it)
+{
+    m_totalBytes -= it->bytes;
+    m_index.erase(it->imageId);
+    m_entries.erase(it);
+}
+
+void
+DecodedImageCache::Impl::evict(qint64 const limit)
+{
+    while (m_totalBytes > limit && !m_entries.empty()) {
+        remove(--m_entries.end());
+    }
+}
+
+DecodedImageCache::Impl&
+DecodedImageCache::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+void
+DecodedImageCache::setLimit(qint64 const bytes)
+{
+    impl().setLimit(bytes);
+}
+
+qint64
+DecodedImageCache::limit()
+{
+    return impl().limit();
+}
+
+std::unique_ptr<FilterData>
+DecodedImageCache::find(ImageId const& image_id)
+{
+    return impl().find(image_id);
+}
+
+void
+DecodedImageCache::store(ImageId const& image_id, FilterData const& data)
+{
+    impl().store(image_id, data);
+}
+
+void
+DecodedImageCache::clear()
+{
+    impl().clear();
+}
@@ -0,0 +1,81 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DECODEDIMAGECACHE_H_
+#define DECODEDIMAGECACHE_H_
+
+#include <QtGlobal>
+#include <memory>
+
+class ImageId;
+class FilterData;
+
+/**
+ * \brief Keeps recently loaded source images in memory.
+ *
+ * Every stage of every page starts by decoding its source image, so
+ * going through the stages of a page in the GUI, or running several
+ * stages from the command line, decodes the same file again and again.
+ * LoadFileTask stores the FilterData of each image it loads here and
+ * looks for it before decoding.  As FilterData copies share their lazily
+ * computed grayscale image and histogram, those get reused as well.
+ *
+ * Entries are validated against the modification time and the size of
+ * the file, so a replaced file is decoded again.  The least recently
+ * used entries are evicted once their total size exceeds limit().
+ * The cache is shared by all threads.  Like ImagePrefetcher, it's
+ * bypassed while a MemoryBudget limit is set, as cached images live
+ * outside of its reservations.
+ */
+class DecodedImageCache
+{
+public:
+    /**
+     * \brief Sets the limit, in bytes.
+     *
+     * Zero disables the cache.  The default is 256 MiB.
+     */
+    static void setLimit(qint64 bytes);
+
+    static qint64 limit();
+
+    /**
+     * \brief Looks up a previously stored image.
+     *
+     * \return The data of the image, or null if it's not in the cache
+     *         or its file has changed since.
+     */
+    static std::unique_ptr<FilterData> find(ImageId const& image_id);
+
+    /**
+     * \brief Stores the data of a freshly loaded image,
+     *        replacing any older entry.
+     */
+    static void store(ImageId const& image_id, FilterData const& data);
+
+    /**
+     * \brief Drops all entries.
+     */
+    static void clear();
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
@@ -23,14 +23,19 @@
 #include "FastQueue.h"
 #include "imageproc/BinaryImage.h"
 #include "imageproc/ConnectivityMap.h"
+#include "imageproc/CompactConnectivityMap.h"
 #include "imageproc/Connectivity.h"
 #include <QtGlobal>
 #include <QImage>
 #include <QDebug>
 #include <vector>
 #include <map>
+#include <memory>
 #include <limits>
 #include <algorithm>
+#include <exception>
+#include <math.h>
+#include <string.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <assert.h>
@@ -89,6 +94,16 @@ struct Settings {
     int bigObjectThreshold;
 
     static Settings get(Despeckle::Level level, Dpi const& dpi);
+
+    /**
+     * The number of rows around a tile that may affect decisions
+     * made within it.  A component that may be removed is smaller
+     * than bigObjectThreshold in both dimensions, so it's only
+     * attached to components within bigObjectThreshold * sqrt(pixelsToSqDist)
+     * from it.  We double that to allow for a link in a chain of
+     * small components.
+     */
+    int tileHalo() const;
 };
 
 Settings
@@ -125,6 +140,13 @@ Settings::get(Despeckle::Level const level, Dpi const& dpi)
     return settings;
 }
 
+int
+Settings::tileHalo() const
+{
+    double const reach = bigObjectThreshold * (1.0 + sqrt(double(pixelsToSqDist)));
+    return 2 * int(ceil(reach));
+}
+
 struct Component {
     static uint32_t const ANCHORED_TO_BIG = uint32_t(1) << 31;
     static uint32_t const ANCHORED_TO_SMALL = uint32_t(1) << 30;
@@ -710,42 +732,19 @@ void voronoiDistances(
     }
 }
 
-} // anonymous namespace
-
-BinaryImage
-Despeckle::despeckle(
-    BinaryImage const& src, Dpi const& dpi, Level const level,
-    TaskStatus const& status, DebugImages* const dbg)
-{
-    BinaryImage dst(src);
-    despeckleInPlace(dst, dpi, level, status, dbg);
-    return dst;
-}
-
-void
-Despeckle::despeckleInPlace(
-    BinaryImage& image, Dpi const& dpi, Level const level,
-    TaskStatus const& status, DebugImages* const dbg)
+/**
+ * Counts the pixels and finds the bounding box of each connected component.
+ */
+void collectComponents(
+    ConnectivityMap const& cmap, std::vector<Component>& components,
+    std::vector<BoundingBox>& bounding_boxes)
 {
-    Settings const settings(Settings::get(level, dpi));
-
-    ConnectivityMap cmap(image, CONN8);
-    if (cmap.maxLabel() == 0) {
-        // Completely white image?
-        return;
-    }
-
-    status.throwIfCancelled();
-
-    std::vector<Component> components(cmap.maxLabel() + 1);
-    std::vector<BoundingBox> bounding_boxes(cmap.maxLabel() + 1);
-
-    int const width = image.width();
-    int const height = image.height();
-
-    uint32_t* const cmap_data = cmap.data();
+    components.assign(cmap.maxLabel() + 1, Component());
+    bounding_boxes.assign(cmap.maxLabel() + 1, BoundingBox());
 
-    // Count the number of pixels and a bounding rect of each component.
+    int const width = cmap.size().width();
+    int const height = cmap.size().height();
+    uint32_t const* const cmap_data = cmap.data();
     int const cmap_stride = cmap.stride();
     #pragma omp parallel
     {
@@ -753,7 +752,7 @@ Despeckle::despeckleInPlace(
         std::vector<BoundingBox> bounding_boxes_l(cmap.maxLabel() + 1);
         #pragma omp for
         for (int y = 0; y < height; ++y) {
-            uint32_t* cmap_line = cmap_data + y * cmap_stride;
+            uint32_t const* cmap_line = cmap_data + y * cmap_stride;
             for (int x = 0; x < width; ++x) {
                 uint32_t const label = cmap_line[x];
                 ++components_l[label].num_pixels;
@@ -768,11 +767,30 @@ Despeckle::despeckleInPlace(
             }
         }
     }
+}
 
-    status.throwIfCancelled();
+/**
+ * Decides which connected components are to be retained.
+ *
+ * On input, \p components and \p bounding_boxes are indexed by labels
+ * of \p cmap, as produced by collectComponents().  On output, labels
+ * in \p cmap are remapped through \p remapping_table, \p components
+ * is indexed by the remapped labels, and the ones to be retained
+ * are tagged with ANCHORED_TO_BIG.
+ */
+void markRetainedComponents(
+    ConnectivityMap& cmap, std::vector<Component>& components,
+    std::vector<BoundingBox> const& bounding_boxes,
+    std::vector<uint32_t>& remapping_table, Settings const& settings,
+    TaskStatus const& status, DebugImages* const dbg)
+{
+    int const width = cmap.size().width();
+    int const height = cmap.size().height();
+    uint32_t* const cmap_data = cmap.data();
+    int const cmap_stride = cmap.stride();
 
     // Unify big components into one.
-    std::vector<uint32_t> remapping_table(components.size());
+    remapping_table.resize(components.size());
     uint32_t unified_big_component = 0;
     uint32_t next_avail_component = 1;
     for (uint32_t label = 1; label <= cmap.maxLabel(); ++label) {
@@ -794,7 +812,6 @@ Despeckle::despeckleInPlace(
         }
     }
     components.resize(next_avail_component);
-    std::vector<BoundingBox>().swap(bounding_boxes); // We don't need them any more.
 
     status.throwIfCancelled();
 
@@ -810,7 +827,10 @@ Despeckle::despeckleInPlace(
     }
 
     if (dbg) {
-        dbg->add(cmap.visualized(), "big_components_unified");
+        std::shared_ptr<CompactConnectivityMap const> const cmap_copy(
+            new CompactConnectivityMap(cmap)
+        );
+        dbg->addLazy([cmap_copy]() { return cmap_copy->visualized(); }, "big_components_unified");
     }
 
     status.throwIfCancelled();
@@ -819,7 +839,10 @@ Despeckle::despeckleInPlace(
     std::vector<Distance> distance_matrix;
     voronoi(cmap, distance_matrix);
     if (dbg) {
-        dbg->add(cmap.visualized(), "voronoi");
+        std::shared_ptr<CompactConnectivityMap const> const cmap_copy(
+            new CompactConnectivityMap(cmap)
+        );
+        dbg->addLazy([cmap_copy]() { return cmap_copy->visualized(); }, "voronoi");
     }
 
     status.throwIfCancelled();
@@ -898,7 +921,10 @@ Despeckle::despeckleInPlace(
         // them from being overwritten.
         voronoiSpecial(cmap, distance_matrix, special_distance);
         if (dbg) {
-            dbg->add(cmap.visualized(), "voronoi_special");
+            std::shared_ptr<CompactConnectivityMap const> const cmap_copy(
+                new CompactConnectivityMap(cmap)
+            );
+            dbg->addLazy([cmap_copy]() { return cmap_copy->visualized(); }, "voronoi_special");
         }
 
         status.throwIfCancelled();
@@ -982,9 +1008,56 @@ Despeckle::despeckleInPlace(
             ++idx;
         }
     }
+}
+
+} // anonymous namespace
+
+BinaryImage
+Despeckle::despeckle(
+    BinaryImage const& src, Dpi const& dpi, Level const level,
+    TaskStatus const& status, DebugImages* const dbg)
+{
+    BinaryImage dst(src);
+    despeckleInPlace(dst, dpi, level, status, dbg);
+    return dst;
+}
+
+void
+Despeckle::despeckleInPlace(
+    BinaryImage& image, Dpi const& dpi, Level const level,
+    TaskStatus const& status, DebugImages* const dbg)
+{
+    Settings const settings(Settings::get(level, dpi));
+
+    ConnectivityMap cmap(image, CONN8);
+    if (cmap.maxLabel() == 0) {
+        // Completely white image?
+        return;
+    }
+
+    status.throwIfCancelled();
+
+    std::vector<Component> components;
+    std::vector<uint32_t> remapping_table;
+    {
+        std::vector<BoundingBox> bounding_boxes;
+        collectComponents(cmap, components, bounding_boxes);
+
+        status.throwIfCancelled();
+
+        markRetainedComponents(
+            cmap, components, bounding_boxes, remapping_table,
+            settings, status, dbg
+        );
+    }
 
     status.throwIfCancelled();
 
+    int const width = image.width();
+    int const height = image.height();
+    uint32_t const* const cmap_data = cmap.data();
+    int const cmap_stride = cmap.stride();
+
     // Remove unmarked components from the binary image.
     uint32_t const msb = uint32_t(1) << 31;
     int const image_stride = image.wordsPerLine();
@@ -993,7 +1066,7 @@ Despeckle::despeckleInPlace(
     #pragma omp parallel for
     for (int y = 0; y < height; ++y) {
         uint32_t* image_line = image_data + y * image_stride;
-        uint32_t* cmap_line = cmap_data + y * cmap_stride;
+        uint32_t const* cmap_line = cmap_data + y * cmap_stride;
         for (int x = 0; x < width; ++x) {
             if (!components[cmap_line[x]].anchoredToBig()) {
                 image_line[x >> 5] &= ~(msb >> (x & 31));
@@ -1001,3 +1074,145 @@ Despeckle::despeckleInPlace(
         }
     }
 }
+
+std::vector<uint8_t>
+Despeckle::removalLevels(
+    CompactConnectivityMap const& cmap, Dpi const& dpi, TaskStatus const& status)
+{
+    std::vector<uint8_t> levels(cmap.maxLabel() + 1, 0);
+    if (cmap.maxLabel() == 0) {
+        return levels;
+    }
+
+    std::vector<Component> components;
+    std::vector<BoundingBox> bounding_boxes;
+
+    Level const all_levels[] = { CAUTIOUS, NORMAL, AGGRESSIVE };
+    for (Level const level : all_levels) {
+        status.throwIfCancelled();
+
+        // The Voronoi diagram depends on which components are big,
+        // and that depends on the level.
+        ConnectivityMap level_cmap(cmap);
+        if (components.empty()) {
+            collectComponents(level_cmap, components, bounding_boxes);
+        }
+        std::vector<Component> level_components(components);
+        std::vector<uint32_t> remapping_table;
+        markRetainedComponents(
+            level_cmap, level_components, bounding_boxes, remapping_table,
+            Settings::get(level, dpi), status, 0
+        );
+
+        for (uint32_t label = 1; label <= cmap.maxLabel(); ++label) {
+            if (!level_components[remapping_table[label]].anchoredToBig()) {
+                levels[label] |= uint8_t(1) << level;
+            }
+        }
+    }
+
+    return levels;
+}
+
+void
+Despeckle::despeckleInPlaceTiled(
+    BinaryImage& image, Dpi const& dpi, Level const level,
+    TaskStatus const& status)
+{
+    Settings const settings(Settings::get(level, dpi));
+
+    int const width = image.width();
+    int const height = image.height();
+    int const halo = settings.tileHalo();
+    int const tile_height = std::max(1024, halo * 4);
+    int const num_tiles = height / tile_height;
+    if (num_tiles < 2) {
+        despeckleInPlace(image, dpi, level, status);
+        return;
+    }
+
+    BinaryImage despeckled(width, height);
+    uint32_t* const despeckled_data = despeckled.data();
+    uint32_t const* const image_data = image.data();
+    int const wpl = image.wordsPerLine();
+
+    // Exceptions, including the cancellation one, can't leave an OpenMP loop.
+    std::exception_ptr error;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_tiles; ++i) {
+        int const top = i * tile_height;
+        // The last tile takes the remainder.
+        int const bottom = i == num_tiles - 1 ? height : top + tile_height;
+        int const ext_top = std::max(0, top - halo);
+        int const ext_bottom = std::min(height, bottom + halo);
+
+        try {
+            BinaryImage tile(width, ext_bottom - ext_top);
+            assert(tile.wordsPerLine() == wpl);
+            memcpy(tile.data(), image_data + ext_top * wpl, tile.height() * wpl * 4);
+
+            despeckleInPlace(tile, dpi, level, status);
+
+            memcpy(
+                despeckled_data + top * wpl,
+                tile.data() + (top - ext_top) * wpl, (bottom - top) * wpl * 4
+            );
+        } catch (...) {
+            #pragma omp critical
+            {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    // Merge decisions at seams: a component survives if any of its pixels did.
+    ConnectivityMap const cmap(image, CONN8);
+    uint32_t const* const cmap_data = cmap.data();
+    int const cmap_stride = cmap.stride();
+    std::vector<char> keep(cmap.maxLabel() + 1, 0);
+
+    uint32_t const msb = uint32_t(1) << 31;
+    #pragma omp parallel
+    {
+        std::vector<char> keep_l(cmap.maxLabel() + 1, 0);
+        #pragma omp for
+        for (int y = 0; y < height; ++y) {
+            uint32_t const* despeckled_line = despeckled_data + y * wpl;
+            uint32_t const* cmap_line = cmap_data + y * cmap_stride;
+            for (int x = 0; x < width; ++x) {
+                if (despeckled_line[x >> 5] & (msb >> (x & 31))) {
+                    keep_l[cmap_line[x]] = 1;
+                }
+            }
+        }
+        #pragma omp critical
+        {
+            for (size_t i = 0; i < keep_l.size(); ++i) {
+                keep[i] |= keep_l[i];
+            }
+        }
+    }
+
+    status.throwIfCancelled();
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        uint32_t* despeckled_line = despeckled_data + y * wpl;
+        uint32_t const* image_line = image_data + y * wpl;
+        uint32_t const* cmap_line = cmap_data + y * cmap_stride;
+        for (int x = 0; x < width; ++x) {
+            if (keep[cmap_line[x]]) {
+                despeckled_line[x >> 5] |= image_line[x >> 5] & (msb >> (x & 31));
+            }
+        }
+    }
+
+    image.swap(despeckled);
+}
@@ -19,6 +19,9 @@
 #ifndef DESPECKLE_H_
 #define DESPECKLE_H_
 
+#include <vector>
+#include <stdint.h>
+
 class Dpi;
 class TaskStatus;
 class DebugImages;
@@ -26,6 +29,8 @@ class DebugImages;
 namespace imageproc
 {
 class BinaryImage;
+class ConnectivityMap;
+class CompactConnectivityMap;
 }
 
 class Despeckle
@@ -53,6 +58,40 @@ public:
     static void despeckleInPlace(
         imageproc::BinaryImage& image, Dpi const& dpi,
         Level level, TaskStatus const& status, DebugImages* dbg = 0);
+
+    /**
+     * \brief A parallel version of despeckleInPlace().
+     *
+     * The image is split into horizontal tiles that are despeckled
+     * concurrently.  Each tile is extended by a halo wide enough to see
+     * the neighbors that decide the fate of its speckles.  A connected
+     * component crossing a tile seam is kept if any tile has kept it.
+     * The result may differ from despeckleInPlace() in rare cases
+     * involving long chains of small components.
+     */
+    static void despeckleInPlaceTiled(
+        imageproc::BinaryImage& image, Dpi const& dpi,
+        Level level, TaskStatus const& status);
+
+    /**
+     * \brief Finds the despeckling levels that remove each connected component.
+     *
+     * Despeckling only ever removes whole connected components, so
+     * this is enough to produce the result of despeckleInPlace() at
+     * any level without running it again.  The labeling and component
+     * statistics are shared between the levels.
+     *
+     * \param cmap A CONN8 connectivity map of the image to despeckle.
+     *        It's expanded into a regular ConnectivityMap for each level,
+     *        so the caller doesn't have to keep one around.
+     * \param dpi DPI of the image.
+     * \param status For asynchronous task cancellation.
+     * \return A vector indexed by labels of \p cmap, where bit (1 << level)
+     *         is set if despeckling at that level removes the component.
+     */
+    static std::vector<uint8_t> removalLevels(
+        imageproc::CompactConnectivityMap const& cmap, Dpi const& dpi,
+        TaskStatus const& status);
 };
 
 #endif
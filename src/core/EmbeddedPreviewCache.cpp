@@ -0,0 +1,129 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "EmbeddedPreviewCache.h"
+#include "ImageId.h"
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtGlobal>
+#include <map>
+
+class EmbeddedPreviewCache::Impl
+{
+public:
+    Impl() : m_totalBytes(0) {}
+
+    void store(ImageId const& image_id, QImage const& preview);
+
+    QImage find(ImageId const& image_id) const;
+
+    void remove(ImageId const& image_id);
+private:
+    /**
+     * Enough for a few thousand previews of the typical EXIF size.
+     */
+    static qint64 const MAX_TOTAL_BYTES = qint64(64) << 20;
+
+    static qint64 imageBytes(QImage const& image)
+    {
+        return qint64(image.bytesPerLine()) * image.height();
+    }
+
+    mutable QMutex m_mutex;
+    std::map<ImageId, QImage> m_previews;
+    qint64 m_totalBytes;
+};
+
+void
+EmbeddedPreviewCache::Impl::store(ImageId const& image_id, QImage const& preview)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    std::map<ImageId, QImage>::iterator const it(m_previews.find(image_id));
+    if (it != m_previews.end()) {
+        m_totalBytes -= imageBytes(it->second);
+        m_previews.erase(it);
+    }
+
+    qint64 const bytes = imageBytes(preview);
+    if (m_totalBytes + bytes > MAX_TOTAL_BYTES) {
+        return;
+    }
+    m_previews[image_id] = preview;
+    m_totalBytes += bytes;
+}
+
+QImage
+EmbeddedPreviewCache::Impl::find(ImageId const& image_id) const
+{
+    QMutexLocker const locker(&m_mutex);
+    std::map<ImageId, QImage>::const_iterator const it(m_previews.find(image_id));
+    if (it == m_previews.end()) {
+        return QImage();
+    }
+    return it->second;
+}
+
+void
+EmbeddedPreviewCache::Impl::remove(ImageId const& image_id)
+{
+    QMutexLocker const locker(&m_mutex);
+    std::map<ImageId, QImage>::iterator const it(m_previews.find(image_id));
+    if (it != m_previews.end()) {
+        m_totalBytes -= imageBytes(it->second);
+        m_previews.erase(it);
+    }
+}
+
+/*========================== EmbeddedPreviewCache =========================*/
+
+EmbeddedPreviewCache::Impl&
+EmbeddedPreviewCache::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+void
+EmbeddedPreviewCache::store(ImageId const& image_id, QImage const& preview)
+{
+    if (preview.isNull()) {
+        return;
+    }
+
+    QImage scaled(preview);
+    if (scaled.width() > MAX_SIZE || scaled.height() > MAX_SIZE) {
+        scaled = scaled.scaled(
+            MAX_SIZE, MAX_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation
+        );
+    }
+    impl().store(image_id, scaled);
+}
+
+QImage
+EmbeddedPreviewCache::find(ImageId const& image_id)
+{
+    return impl().find(image_id);
+}
+
+void
+EmbeddedPreviewCache::remove(ImageId const& image_id)
+{
+    impl().remove(image_id);
+}
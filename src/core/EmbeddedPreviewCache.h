@@ -0,0 +1,61 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EMBEDDEDPREVIEWCACHE_H_
+#define EMBEDDEDPREVIEWCACHE_H_
+
+class ImageId;
+class QImage;
+
+/**
+ * \brief Holds the previews embedded into image files until proper
+ *        thumbnails are ready.
+ *
+ * ImageMetadataLoader puts here whatever small preview it comes across
+ * while scanning a file for the first time, like an EXIF thumbnail of a
+ * JPEG or a reduced resolution subimage of a TIFF.  ThumbnailPixmapCache
+ * hands them out as provisional thumbnails while the proper ones are
+ * being made, and drops them once that's done.
+ *
+ * The previews are downscaled to fit MAX_SIZE x MAX_SIZE on the way in,
+ * and the total amount of memory they take is limited.  When the limit
+ * is reached, new previews are just not stored.
+ *
+ * All methods are thread-safe.
+ */
+class EmbeddedPreviewCache
+{
+public:
+    enum { MAX_SIZE = 256 };
+
+    static void store(ImageId const& image_id, QImage const& preview);
+
+    /**
+     * \brief Returns the preview of an image, or a null image
+     *        if there is none.
+     */
+    static QImage find(ImageId const& image_id);
+
+    static void remove(ImageId const& image_id);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
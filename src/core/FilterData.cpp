@@ -19,22 +19,185 @@
 #include "FilterData.h"
 #include "Dpm.h"
 #include "Dpi.h"
+#include "RefCountable.h"
+#include "NonCopyable.h"
 #include "imageproc/Grayscale.h"
+#include "imageproc/Scale.h"
+#include "imageproc/Constants.h"
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSize>
+#include <memory>
+#include <algorithm>
+#include <math.h>
 
 using namespace imageproc;
 
+namespace
+{
+
+/**
+ * Returns the scaling factors that bring an image to 300 dpi,
+ * or 1.0 for both if it's close enough already.
+ */
+void scaleFactorsTo300Dpi(QImage const& image, double& xfactor, double& yfactor)
+{
+    xfactor = (300.0 * constants::DPI2DPM) / image.dotsPerMeterX();
+    yfactor = (300.0 * constants::DPI2DPM) / image.dotsPerMeterY();
+    if (fabs(xfactor - 1.0) < 0.1 && fabs(yfactor - 1.0) < 0.1) {
+        xfactor = 1.0;
+        yfactor = 1.0;
+    }
+}
+
+} // anonymous namespace
+
+class FilterData::LazyData : public RefCountable
+{
+    DECLARE_NON_COPYABLE(LazyData)
+public:
+    LazyData()
+        :   m_grayReady(0), m_histogramReady(0), m_thresholdReady(0),
+            m_gray300Ready(0), m_bwThreshold(0) {}
+
+    GrayImage const& grayImage(QImage const& orig_image);
+
+    GrayImage const& grayImage300Dpi(QImage const& orig_image);
+
+    GrayscaleHistogram const& grayHistogram(QImage const& orig_image);
+
+    BinaryThreshold bwThreshold(QImage const& orig_image);
+private:
+    QMutex m_mutex;
+    QAtomicInt m_grayReady;
+    QAtomicInt m_histogramReady;
+    QAtomicInt m_thresholdReady;
+    QAtomicInt m_gray300Ready;
+    GrayImage m_grayImage;
+    GrayImage m_grayImage300Dpi;
+    std::unique_ptr<GrayscaleHistogram> m_ptrGrayHistogram;
+    BinaryThreshold m_bwThreshold;
+};
+
+GrayImage const&
+FilterData::LazyData::grayImage(QImage const& orig_image)
+{
+    if (!m_grayReady.loadAcquire()) {
+        QMutexLocker const locker(&m_mutex);
+        if (!m_grayReady.load()) {
+            // For 8-bit images with a full grayscale palette,
+            // toGrayscale() returns a shallow copy.
+            m_grayImage = GrayImage(orig_image);
+            m_grayReady.storeRelease(1);
+        }
+    }
+    return m_grayImage;
+}
+
+GrayImage const&
+FilterData::LazyData::grayImage300Dpi(QImage const& orig_image)
+{
+    if (!m_gray300Ready.loadAcquire()) {
+        GrayImage const& gray = grayImage(orig_image);
+
+        // Scaling is done outside of the lock, so that the histogram
+        // and the threshold don't have to wait for it.
+        double xfactor, yfactor;
+        scaleFactorsTo300Dpi(orig_image, xfactor, yfactor);
+        GrayImage scaled(gray);
+        if (xfactor != 1.0 || yfactor != 1.0) {
+            QSize const new_size(
+                std::max(1, (int)ceil(xfactor * gray.width())),
+                std::max(1, (int)ceil(yfactor * gray.height()))
+            );
+            scaled = scaleToGray(gray, new_size);
+        }
+
+        QMutexLocker const locker(&m_mutex);
+        if (!m_gray300Ready.load()) {
+            m_grayImage300Dpi = scaled;
+            m_gray300Ready.storeRelease(1);
+        }
+    }
+    return m_grayImage300Dpi;
+}
+
+GrayscaleHistogram const&
+FilterData::LazyData::grayHistogram(QImage const& orig_image)
+{
+    if (!m_histogramReady.loadAcquire()) {
+        GrayImage const& gray = grayImage(orig_image);
+        QMutexLocker const locker(&m_mutex);
+        if (!m_histogramReady.load()) {
+            m_ptrGrayHistogram.reset(new GrayscaleHistogram(gray));
+            m_histogramReady.storeRelease(1);
+        }
+    }
+    return *m_ptrGrayHistogram;
+}
+
+BinaryThreshold
+FilterData::LazyData::bwThreshold(QImage const& orig_image)
+{
+    if (!m_thresholdReady.loadAcquire()) {
+        GrayscaleHistogram const& hist = grayHistogram(orig_image);
+        QMutexLocker const locker(&m_mutex);
+        if (!m_thresholdReady.load()) {
+            m_bwThreshold = BinaryThreshold::otsuThreshold(hist);
+            m_thresholdReady.storeRelease(1);
+        }
+    }
+    return m_bwThreshold;
+}
+
 FilterData::FilterData(QImage const& image)
     :   m_origImage(image),
-        m_grayImage(toGrayscale(m_origImage)),
-        m_xform(image.rect(), Dpm(image)),
-        m_bwThreshold(BinaryThreshold::otsuThreshold(m_grayImage))
+        m_ptrLazyData(new LazyData),
+        m_xform(image.rect(), Dpm(image))
 {
 }
 
 FilterData::FilterData(FilterData const& other, ImageTransformation const& xform)
     :   m_origImage(other.m_origImage),
-        m_grayImage(other.m_grayImage),
-        m_xform(xform),
-        m_bwThreshold(other.m_bwThreshold)
+        m_ptrLazyData(other.m_ptrLazyData),
+        m_xform(xform)
+{
+}
+
+BinaryThreshold
+FilterData::bwThreshold() const
+{
+    return m_ptrLazyData->bwThreshold(m_origImage);
+}
+
+GrayImage const&
+FilterData::grayImage() const
 {
+    return m_ptrLazyData->grayImage(m_origImage);
+}
+
+GrayscaleHistogram const&
+FilterData::grayHistogram() const
+{
+    return m_ptrLazyData->grayHistogram(m_origImage);
+}
+
+GrayImage const&
+FilterData::grayImage300Dpi() const
+{
+    return m_ptrLazyData->grayImage300Dpi(m_origImage);
+}
+
+QTransform
+FilterData::to300DpiTransform() const
+{
+    double xfactor, yfactor;
+    scaleFactorsTo300Dpi(m_origImage, xfactor, yfactor);
+
+    QTransform xform;
+    if (xfactor != 1.0 || yfactor != 1.0) {
+        xform.scale(xfactor, yfactor);
+    }
+    return xform;
 }
@@ -22,8 +22,24 @@
 #include "imageproc/BinaryThreshold.h"
 #include "imageproc/GrayImage.h"
 #include "ImageTransformation.h"
+#include "IntrusivePtr.h"
 #include <QImage>
+#include <QTransform>
 
+namespace imageproc
+{
+class GrayscaleHistogram;
+}
+
+/**
+ * \brief The image a filter task works on, along with its transformation.
+ *
+ * The grayscale version of the image, its histogram and its binarization
+ * threshold are computed on first access, and so is the 300 dpi reduction
+ * of the grayscale version.  They are shared between all FilterData
+ * objects derived from the same one, so each page is converted at most
+ * once, no matter how many stages look at it.
+ */
 class FilterData
 {
     // Member-wise copying is OK.
@@ -32,10 +48,12 @@ public:
 
     FilterData(FilterData const& other, ImageTransformation const& xform);
 
-    imageproc::BinaryThreshold bwThreshold() const
-    {
-        return m_bwThreshold;
-    }
+    /**
+     * \brief The global binarization threshold of the image.
+     *
+     * Computed on first access.  Thread-safe.
+     */
+    imageproc::BinaryThreshold bwThreshold() const;
 
     ImageTransformation const& xform() const
     {
@@ -47,15 +65,41 @@ public:
         return m_origImage;
     }
 
-    imageproc::GrayImage const& grayImage() const
-    {
-        return m_grayImage;
-    }
+    /**
+     * \brief The image converted to grayscale.
+     *
+     * Computed on first access.  Thread-safe.  If the image was already
+     * grayscale, this shares its pixels rather than copying them.
+     */
+    imageproc::GrayImage const& grayImage() const;
+
+    /**
+     * \brief The histogram of grayImage().
+     *
+     * Computed on first access.  Thread-safe.
+     */
+    imageproc::GrayscaleHistogram const& grayHistogram() const;
+
+    /**
+     * \brief grayImage() scaled to 300 dpi.
+     *
+     * Computed on first access.  Thread-safe.  Images within 10% of
+     * 300 dpi aren't scaled, so this shares pixels with grayImage() then.
+     *
+     * \see to300DpiTransform()
+     */
+    imageproc::GrayImage const& grayImage300Dpi() const;
+
+    /**
+     * \brief The scaling grayImage300Dpi() applies to the original image.
+     */
+    QTransform to300DpiTransform() const;
 private:
+    class LazyData;
+
     QImage m_origImage;
-    imageproc::GrayImage m_grayImage;
+    IntrusivePtr<LazyData> m_ptrLazyData;
     ImageTransformation m_xform;
-    imageproc::BinaryThreshold m_bwThreshold;
 };
 
 #endif
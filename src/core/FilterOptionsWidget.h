@@ -22,6 +22,7 @@
 #include "PageId.h"
 #include "PageInfo.h"
 #include <QWidget>
+#include <set>
 
 class FilterOptionsWidget : public QWidget
 {
@@ -40,6 +41,13 @@ signals:
      */
     void invalidateThumbnail(PageInfo const& page_info);
 
+    /**
+     * \brief To be emitted once for a setting applied to a number of pages.
+     *
+     * \param page_ids The pages whose settings actually changed.
+     */
+    void invalidateThumbnails(std::set<PageId> const& page_ids);
+
     void invalidateAllThumbnails();
 
     /**
@@ -0,0 +1,255 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GpuImageRenderer.h"
+#include "config.h"
+#include <QPainter>
+#include <QPaintEngine>
+#include <QImage>
+#include <QTransform>
+#ifdef ENABLE_OPENGL
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QMatrix4x4>
+#include <QVector2D>
+#include <QByteArray>
+#endif
+
+#ifndef ENABLE_OPENGL
+
+class GpuImageRenderer::Impl
+{
+};
+
+GpuImageRenderer::GpuImageRenderer()
+{
+}
+
+GpuImageRenderer::~GpuImageRenderer()
+{
+}
+
+bool
+GpuImageRenderer::draw(QPainter&, QImage const&, QTransform const&, bool)
+{
+    return false;
+}
+
+void
+GpuImageRenderer::release()
+{
+}
+
+#else // ENABLE_OPENGL
+
+namespace
+{
+
+char const vertex_shader[] =
+    "attribute highp vec2 position;\n"
+    "uniform highp mat4 matrix;\n"
+    "uniform highp vec2 imageSize;\n"
+    "varying highp vec2 texCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    texCoord = position / imageSize;\n"
+    "    gl_Position = matrix * vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+// Four samples spread over the footprint of a screen pixel, each of them
+// filtered trilinearly.  That's close to the area averaging the CPU
+// version does, without its cost.
+char const fragment_shader[] =
+    "uniform sampler2D image;\n"
+    "varying highp vec2 texCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    highp vec2 dx = dFdx(texCoord) * 0.25;\n"
+    "    highp vec2 dy = dFdy(texCoord) * 0.25;\n"
+    "    gl_FragColor = 0.25 * (\n"
+    "        texture2D(image, texCoord - dx - dy) +\n"
+    "        texture2D(image, texCoord + dx - dy) +\n"
+    "        texture2D(image, texCoord - dx + dy) +\n"
+    "        texture2D(image, texCoord + dx + dy)\n"
+    "    );\n"
+    "}\n";
+
+} // anonymous namespace
+
+class GpuImageRenderer::Impl
+{
+public:
+    Impl() : imageKey(0), failed(false) {}
+
+    bool ensureProgram(QOpenGLContext& context);
+
+    bool ensureTexture(QOpenGLFunctions& gl, QImage const& image);
+
+    std::unique_ptr<QOpenGLShaderProgram> program;
+    std::unique_ptr<QOpenGLTexture> texture;
+    qint64 imageKey;
+
+    /**
+     * Set if the shaders failed to compile, to avoid retrying on every paint.
+     */
+    bool failed;
+};
+
+bool
+GpuImageRenderer::Impl::ensureProgram(QOpenGLContext& context)
+{
+    if (program) {
+        return true;
+    }
+    if (failed) {
+        return false;
+    }
+
+    QByteArray fragment_source;
+    if (context.isOpenGLES()) {
+        // Derivatives are an extension there.
+        if (!context.hasExtension("GL_OES_standard_derivatives")) {
+            failed = true;
+            return false;
+        }
+        fragment_source = "#extension GL_OES_standard_derivatives : enable\n"
+                          "precision mediump float;\n";
+    }
+    fragment_source += fragment_shader;
+
+    std::unique_ptr<QOpenGLShaderProgram> prog(new QOpenGLShaderProgram);
+    if (!prog->addShaderFromSourceCode(QOpenGLShader::Vertex, vertex_shader)
+            || !prog->addShaderFromSourceCode(QOpenGLShader::Fragment, fragment_source)
+            || !prog->link()) {
+        failed = true;
+        return false;
+    }
+
+    program.swap(prog);
+    return true;
+}
+
+bool
+GpuImageRenderer::Impl::ensureTexture(QOpenGLFunctions& gl, QImage const& image)
+{
+    if (texture && imageKey == image.cacheKey()) {
+        return true;
+    }
+
+    texture.reset();
+    imageKey = 0;
+
+    GLint max_size = 0;
+    gl.glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (image.width() > max_size || image.height() > max_size) {
+        return false;
+    }
+
+    // The first image line goes to the texture coordinate t = 0,
+    // which is what the vertex shader expects.
+    std::unique_ptr<QOpenGLTexture> tex(new QOpenGLTexture(image));
+    if (!tex->isCreated()) {
+        return false;
+    }
+    tex->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    tex->setWrapMode(QOpenGLTexture::ClampToEdge);
+    if (QOpenGLTexture::hasFeature(QOpenGLTexture::AnisotropicFiltering)) {
+        tex->setMaximumAnisotropy(16.0f);
+    }
+
+    texture.swap(tex);
+    imageKey = image.cacheKey();
+    return true;
+}
+
+GpuImageRenderer::GpuImageRenderer()
+    :   m_ptrImpl(new Impl)
+{
+}
+
+GpuImageRenderer::~GpuImageRenderer()
+{
+}
+
+bool
+GpuImageRenderer::draw(
+    QPainter& painter, QImage const& image,
+    QTransform const& image_to_device, bool const smooth)
+{
+    if (image.isNull() || !painter.paintEngine()
+            || painter.paintEngine()->type() != QPaintEngine::OpenGL2) {
+        return false;
+    }
+
+    painter.beginNativePainting();
+
+    QOpenGLContext* const context = QOpenGLContext::currentContext();
+    bool drawn = false;
+    if (context) {
+        QOpenGLFunctions* const gl = context->functions();
+        Impl& impl = *m_ptrImpl;
+        if (impl.ensureProgram(*context) && impl.ensureTexture(*gl, image)) {
+            impl.texture->setMagnificationFilter(
+                smooth ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest
+            );
+
+            QPaintDevice const* device = painter.device();
+            QMatrix4x4 matrix;
+            matrix.ortho(0, device->width(), device->height(), 0, -1, 1);
+            matrix *= QMatrix4x4(image_to_device);
+
+            GLfloat const w = image.width();
+            GLfloat const h = image.height();
+            GLfloat const vertices[] = { 0, 0, w, 0, 0, h, w, h };
+
+            gl->glDisable(GL_BLEND);
+            gl->glActiveTexture(GL_TEXTURE0);
+            impl.texture->bind();
+
+            QOpenGLShaderProgram& program = *impl.program;
+            program.bind();
+            program.setUniformValue("matrix", matrix);
+            program.setUniformValue("imageSize", QVector2D(w, h));
+            program.setUniformValue("image", 0);
+            int const position = program.attributeLocation("position");
+            program.enableAttributeArray(position);
+            program.setAttributeArray(position, vertices, 2);
+            gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            program.disableAttributeArray(position);
+            program.release();
+
+            impl.texture->release();
+            drawn = true;
+        }
+    }
+
+    painter.endNativePainting();
+    return drawn;
+}
+
+void
+GpuImageRenderer::release()
+{
+    m_ptrImpl->texture.reset();
+    m_ptrImpl->program.reset();
+    m_ptrImpl->imageKey = 0;
+}
+
+#endif // ENABLE_OPENGL
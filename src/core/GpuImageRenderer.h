@@ -0,0 +1,73 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GPU_IMAGE_RENDERER_H_
+#define GPU_IMAGE_RENDERER_H_
+
+#include "NonCopyable.h"
+#include <memory>
+
+class QPainter;
+class QImage;
+class QTransform;
+
+/**
+ * \brief Draws an image with OpenGL, doing the filtering on the GPU.
+ *
+ * The image is uploaded once as a mipmapped texture and then drawn
+ * at any scale with trilinear filtering and supersampling done in
+ * a fragment shader.  That makes a delayed high quality version
+ * built on the CPU unnecessary.
+ *
+ * Only works when painting on an OpenGL paint device.  Without
+ * ENABLE_OPENGL, draw() always fails.
+ */
+class GpuImageRenderer
+{
+    DECLARE_NON_COPYABLE(GpuImageRenderer)
+public:
+    GpuImageRenderer();
+
+    /**
+     * \note The GL context, if any resources were created in it,
+     *       must be current at this point.  See release().
+     */
+    ~GpuImageRenderer();
+
+    /**
+     * \brief Draws \p image transformed by \p image_to_device.
+     *
+     * \param smooth Whether to interpolate between pixels when magnifying.
+     * \return false if the image couldn't be drawn this way, in which
+     *         case nothing is drawn.  That happens when the painter
+     *         isn't backed by OpenGL or the image is too big for a texture.
+     */
+    bool draw(QPainter& painter, QImage const& image,
+              QTransform const& image_to_device, bool smooth);
+
+    /**
+     * \brief Releases GL resources.  Their context must be current.
+     */
+    void release();
+private:
+    class Impl;
+
+    std::unique_ptr<Impl> m_ptrImpl;
+};
+
+#endif
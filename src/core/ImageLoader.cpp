@@ -18,26 +18,74 @@
 
 #include "ImageLoader.h"
 #include "TiffReader.h"
+#include "JpegReader.h"
+#include "ImagePrefetcher.h"
+#include "IoGate.h"
 #include "ImageId.h"
+#include "ImageMetadata.h"
+#include "ImageMetadataLoader.h"
+#include "Dpi.h"
+#include "Dpm.h"
+#include "Profiler.h"
+#include "Metrics.h"
 #include <QImageReader>
+#include <QImageIOHandler>
 #include <QImage>
+#include <QSize>
+#include <QRect>
 #include <QString>
 #include <QIODevice>
 #include <QFile>
+#include <algorithm>
+
+namespace
+{
+
+class PageMetadataGrabber
+{
+    // Member-wise copying is OK.
+public:
+    PageMetadataGrabber(int page_num, ImageMetadata& metadata, bool& found)
+        :   m_pageNum(page_num), m_curPage(0), m_pMetadata(&metadata), m_pFound(&found) {}
+
+    void operator()(ImageMetadata const& metadata)
+    {
+        if (m_curPage++ == m_pageNum) {
+            *m_pMetadata = metadata;
+            *m_pFound = true;
+        }
+    }
+private:
+    int m_pageNum;
+    int m_curPage;
+    ImageMetadata* m_pMetadata;
+    bool* m_pFound;
+};
+
+} // anonymous namespace
 
 QImage
 ImageLoader::load(ImageId const& image_id)
 {
+    QImage image;
+    if (ImagePrefetcher::take(image_id, image)) {
+        return image;
+    }
     return load(image_id.filePath(), image_id.zeroBasedPage());
 }
 
 QImage
 ImageLoader::load(QString const& file_path, int const page_num)
 {
+    Profiler::Scope const profile_scope("load_image");
+    IoGate::Slot const io_slot;
+
     QFile file(file_path);
     if (!file.open(QIODevice::ReadOnly)) {
         return QImage();
     }
+    Profiler::addCounter("bytes_read", file.size());
+    Metrics::add(Metrics::BYTES_DECODED, file.size());
 
     if (file_path.startsWith(":")) {
         // internally empty pages are represented as multipage image although they're just links to the same single page image in app resources
@@ -60,6 +108,119 @@ ImageLoader::load(QIODevice& io_dev, int const page_num)
     }
 
     QImage image;
+    if (JpegReader::canRead(io_dev)) {
+        image = JpegReader::readImage(io_dev);
+        if (!image.isNull() || !io_dev.seek(0)) {
+            return image;
+        }
+        // Let Qt have a go at the formats we don't support.
+    }
+
     QImageReader(&io_dev).read(&image);
     return image;
 }
+
+QImage
+ImageLoader::loadScaled(ImageId const& image_id, Dpi const& target_dpi)
+{
+    return loadReduced(image_id, &target_dpi, 0);
+}
+
+QImage
+ImageLoader::loadScaled(ImageId const& image_id, QSize const& min_size)
+{
+    return loadReduced(image_id, 0, &min_size);
+}
+
+QImage
+ImageLoader::loadReduced(
+    ImageId const& image_id, Dpi const* target_dpi, QSize const* min_size)
+{
+    QString const& file_path = image_id.filePath();
+    int const page_num = file_path.startsWith(":") ? 0 : image_id.zeroBasedPage();
+
+    ImageMetadata metadata;
+    bool found = false;
+    ImageMetadataLoader::load(file_path, PageMetadataGrabber(page_num, metadata, found));
+    if (!found || metadata.size().isEmpty()) {
+        return load(file_path, page_num);
+    }
+
+    QSize const& size = metadata.size();
+    Dpi const& dpi = metadata.dpi();
+
+    int reduction = 1;
+    if (target_dpi) {
+        if (!dpi.isNull() && !target_dpi->isNull()) {
+            reduction = std::min(
+                            dpi.horizontal() / target_dpi->horizontal(),
+                            dpi.vertical() / target_dpi->vertical()
+                        );
+        }
+    } else if (min_size) {
+        reduction = std::min(
+                        size.width() / std::max(1, min_size->width()),
+                        size.height() / std::max(1, min_size->height())
+                    );
+    }
+
+    if (reduction <= 1) {
+        return load(file_path, page_num);
+    }
+
+    Profiler::Scope const profile_scope("load_image");
+    IoGate::Slot const io_slot;
+
+    QFile file(file_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+    Profiler::addCounter("bytes_read", file.size());
+    Metrics::add(Metrics::BYTES_DECODED, file.size());
+
+    if (TiffReader::canRead(file)) {
+        return TiffReader::readImage(file, page_num, QRect(), reduction);
+    }
+
+    if (page_num != 0) {
+        // Qt can only load the first page of multi-page images.
+        return QImage();
+    }
+
+    QSize const reduced_size(
+        (size.width() + reduction - 1) / reduction,
+        (size.height() + reduction - 1) / reduction
+    );
+
+    QImage image;
+    if (JpegReader::canRead(file)) {
+        // Decodes at 1/2, 1/4 or 1/8 scale in the DCT domain.
+        image = JpegReader::readImage(file, reduction);
+        if (image.isNull() && !file.seek(0)) {
+            return QImage();
+        }
+    }
+
+    if (image.isNull()) {
+        QImageReader reader(&file);
+        if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+            // For JPEG, this makes libjpeg decode at 1/2, 1/4 or 1/8 scale.
+            reader.setScaledSize(reduced_size);
+        }
+        if (!reader.read(&image)) {
+            return QImage();
+        }
+    }
+
+    if (image.size() != reduced_size) {
+        image = image.scaled(reduced_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    if (!dpi.isNull()) {
+        Dpm const dpm(dpi);
+        image.setDotsPerMeterX(dpm.horizontal() / reduction);
+        image.setDotsPerMeterY(dpm.vertical() / reduction);
+    }
+
+    return image;
+}
@@ -20,7 +20,9 @@
 #define IMAGELOADER_H_
 
 class ImageId;
+class Dpi;
 class QImage;
+class QSize;
 class QString;
 class QIODevice;
 
@@ -32,6 +34,27 @@ public:
     static QImage load(ImageId const& image_id);
 
     static QImage load(QIODevice& io_dev, int page_num);
+
+    /**
+     * \brief Loads an image at a reduced resolution, without decoding
+     *        it at full resolution where the format allows that.
+     *
+     * JPEG images are decoded with DCT scaling and TIFF images are
+     * read strip by strip, averaging pixel blocks on the fly.  The image
+     * is reduced by the largest integer factor that keeps its resolution
+     * at or above \p target_dpi.  The DPI of the result is adjusted accordingly.
+     * Images of unknown DPI are loaded at full resolution.
+     */
+    static QImage loadScaled(ImageId const& image_id, Dpi const& target_dpi);
+
+    /**
+     * \brief Same as above, except the result is to be at least
+     *        \p min_size large rather than of a certain DPI.
+     */
+    static QImage loadScaled(ImageId const& image_id, QSize const& min_size);
+private:
+    static QImage loadReduced(
+        ImageId const& image_id, Dpi const* target_dpi, QSize const* min_size);
 };
 
 #endif
@@ -26,6 +26,10 @@ ImageMetadata::operator==(ImageMetadata const& other) const
 {
     if ((m_size != other.m_size) || (is_grayscale != other.isGrayScale())) {
         return false;
+    } else if (m_haveColorStats != other.m_haveColorStats
+               || m_saturatedPerMille != other.m_saturatedPerMille
+               || m_backgroundLevel != other.m_backgroundLevel) {
+        return false;
     } else if (m_dpi.isNull() && other.m_dpi.isNull()) {
         return true;
     } else {
@@ -34,9 +34,13 @@ public:
         DPI_TOO_SMALL_FOR_THIS_PIXEL_SIZE
     };
 
-    ImageMetadata() {}
+    ImageMetadata()
+        : is_grayscale(true), m_haveColorStats(false),
+          m_saturatedPerMille(0), m_backgroundLevel(255) {}
 
-    ImageMetadata(QSize size, Dpi dpi, bool grayscale = true) : m_size(size), m_dpi(dpi), is_grayscale(grayscale) {}
+    ImageMetadata(QSize size, Dpi dpi, bool grayscale = true)
+        : m_size(size), m_dpi(dpi), is_grayscale(grayscale), m_haveColorStats(false),
+          m_saturatedPerMille(0), m_backgroundLevel(255) {}
 
     QSize const& size() const
     {
@@ -70,6 +74,42 @@ public:
         return is_grayscale;
     }
 
+    /**
+     * \brief Whether the color statistics were gathered from the pixels.
+     *
+     * LoadFileTask does that the first time it decodes the image,
+     * so that nothing has to look at the pixels again to learn how
+     * colorful the image is.  The grayscale flag is part of them.
+     */
+    bool haveColorStats() const
+    {
+        return m_haveColorStats;
+    }
+
+    /**
+     * \brief The share of noticeably saturated pixels, from 0 to 1000.
+     */
+    int saturatedPerMille() const
+    {
+        return m_saturatedPerMille;
+    }
+
+    /**
+     * \brief The gray level of the dominant background, from 0 to 255.
+     */
+    int backgroundLevel() const
+    {
+        return m_backgroundLevel;
+    }
+
+    void setColorStats(bool grayscale, int saturated_per_mille, int background_level)
+    {
+        is_grayscale = grayscale;
+        m_haveColorStats = true;
+        m_saturatedPerMille = saturated_per_mille;
+        m_backgroundLevel = background_level;
+    }
+
     DpiStatus horizontalDpiStatus() const;
 
     DpiStatus verticalDpiStatus() const;
@@ -86,6 +126,9 @@ private:
     QSize m_size;
     Dpi m_dpi;
     bool is_grayscale;
+    bool m_haveColorStats;
+    int m_saturatedPerMille;
+    int m_backgroundLevel;
 };
 
 #endif
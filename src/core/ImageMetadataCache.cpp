@@ -0,0 +1,107 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImageMetadataCache.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutex>
+#include <QMutexLocker>
+#include <map>
+
+class ImageMetadataCache::Impl
+{
+public:
+    bool peek(QString const& file_path, Entry& entry) const;
+
+    void store(QString const& file_path, Entry const& entry);
+private:
+    static size_t const MAX_ENTRIES = 100000;
+
+    mutable QMutex m_mutex;
+    std::map<QString, Entry> m_entries;
+};
+
+bool
+ImageMetadataCache::Impl::peek(QString const& file_path, Entry& entry) const
+{
+    QMutexLocker const locker(&m_mutex);
+    std::map<QString, Entry>::const_iterator const it(m_entries.find(file_path));
+    if (it == m_entries.end()) {
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
+
+void
+ImageMetadataCache::Impl::store(QString const& file_path, Entry const& entry)
+{
+    QMutexLocker const locker(&m_mutex);
+    if (m_entries.size() >= MAX_ENTRIES) {
+        m_entries.clear();
+    }
+    m_entries[file_path] = entry;
+}
+
+/*======================== ImageMetadataCache::Entry =====================*/
+
+bool
+ImageMetadataCache::Entry::matches(QFileInfo const& file_info) const
+{
+    return size == file_info.size()
+           && lastModified == file_info.lastModified().toMSecsSinceEpoch();
+}
+
+void
+ImageMetadataCache::Entry::setFingerprint(QFileInfo const& file_info)
+{
+    size = file_info.size();
+    lastModified = file_info.lastModified().toMSecsSinceEpoch();
+}
+
+/*=========================== ImageMetadataCache ==========================*/
+
+ImageMetadataCache::Impl&
+ImageMetadataCache::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+bool
+ImageMetadataCache::find(QFileInfo const& file_info, Entry& entry)
+{
+    Entry candidate;
+    if (!impl().peek(file_info.absoluteFilePath(), candidate) || !candidate.matches(file_info)) {
+        return false;
+    }
+    entry = candidate;
+    return true;
+}
+
+bool
+ImageMetadataCache::peek(QString const& file_path, Entry& entry)
+{
+    return impl().peek(QFileInfo(file_path).absoluteFilePath(), entry);
+}
+
+void
+ImageMetadataCache::store(QString const& file_path, Entry const& entry)
+{
+    impl().store(QFileInfo(file_path).absoluteFilePath(), entry);
+}
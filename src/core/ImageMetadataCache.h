@@ -0,0 +1,84 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEMETADATACACHE_H_
+#define IMAGEMETADATACACHE_H_
+
+#include "ImageMetadata.h"
+#include "ImageMetadataLoader.h"
+#include <QString>
+#include <QtGlobal>
+#include <vector>
+
+class QFileInfo;
+
+/**
+ * \brief Remembers the metadata loaded from each file.
+ *
+ * ImageMetadataLoader::load(QString const&, ...) looks here first, so
+ * that the files of a project are only read once even though their
+ * metadata is asked for again by the dialogs and when loading thumbnails.
+ * An entry carries the size and modification time of the file it was
+ * loaded from, and is only used while those still match.
+ *
+ * ProjectWriter saves the entries of the project's files and ProjectReader
+ * puts them back, so they survive reopening a project.  Checking an entry
+ * against its file takes a stat() rather than reading the file, and it
+ * happens when the metadata is asked for, which is mostly on background
+ * threads.  Files that did change get loaded again at that point.
+ */
+class ImageMetadataCache
+{
+public:
+    struct Entry {
+        qint64 size;
+        qint64 lastModified; /**< Milliseconds since the epoch. */
+        ImageMetadataLoader::Status status;
+        std::vector<ImageMetadata> pages;
+
+        Entry() : size(-1), lastModified(0), status(ImageMetadataLoader::GENERIC_ERROR) {}
+
+        /**
+         * \brief Whether the entry was loaded from this very file.
+         */
+        bool matches(QFileInfo const& file_info) const;
+
+        /**
+         * \brief Sets size and lastModified from a file.
+         */
+        void setFingerprint(QFileInfo const& file_info);
+    };
+
+    /**
+     * \brief Looks up an entry still matching its file.
+     */
+    static bool find(QFileInfo const& file_info, Entry& entry);
+
+    /**
+     * \brief Looks up an entry without checking it against the file.
+     */
+    static bool peek(QString const& file_path, Entry& entry);
+
+    static void store(QString const& file_path, Entry const& entry);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
@@ -18,9 +18,14 @@
 
 #include "ImageMetadataLoader.h"
 #include "ImageMetadata.h"
+#include "ImageMetadataCache.h"
+#include "EmbeddedPreviewCache.h"
+#include "ImageId.h"
 #include <QString>
 #include <QIODevice>
 #include <QFile>
+#include <QFileInfo>
+#include <QImage>
 
 ImageMetadataLoader::LoaderList ImageMetadataLoader::m_sLoaders;
 
@@ -34,13 +39,17 @@ ImageMetadataLoader::registerLoader(
 ImageMetadataLoader::Status
 ImageMetadataLoader::loadImpl(
     QIODevice& io_device,
-    VirtualFunction1<void, ImageMetadata const&>& out)
+    VirtualFunction1<void, ImageMetadata const&>& out,
+    ImageMetadataLoader** used_loader)
 {
     LoaderList::iterator it(m_sLoaders.begin());
     LoaderList::iterator const end(m_sLoaders.end());
     for (; it != end; ++it) {
         Status const status = (*it)->loadMetadata(io_device, out);
         if (status != FORMAT_NOT_RECOGNIZED) {
+            if (used_loader) {
+                *used_loader = it->get();
+            }
             return status;
         }
     }
@@ -52,10 +61,51 @@ ImageMetadataLoader::loadImpl(
     QString const& file_path,
     VirtualFunction1<void, ImageMetadata const&>& out)
 {
+    QFileInfo const file_info(file_path);
+    ImageMetadataCache::Entry entry;
+    if (ImageMetadataCache::find(file_info, entry)) {
+        for (ImageMetadata const& metadata : entry.pages) {
+            out(metadata);
+        }
+        return entry.status;
+    }
+
     QFile file(file_path);
     if (!file.open(QIODevice::ReadOnly)) {
         return GENERIC_ERROR;
     }
-    return loadImpl(file, out);
+
+    entry.setFingerprint(file_info);
+    auto collect = [&entry](ImageMetadata const& metadata) {
+        entry.pages.push_back(metadata);
+    };
+    ProxyFunction1<decltype(collect), void, ImageMetadata const&> proxy(collect);
+    ImageMetadataLoader* loader = 0;
+    entry.status = loadImpl(file, proxy, &loader);
+
+    if (entry.status == LOADED && file.seek(0)) {
+        int const num_pages = entry.pages.size();
+        auto store_preview = [&file_info, num_pages](int page, QImage const& preview) {
+            if (page >= 0 && page < num_pages) {
+                ImageId const image_id(file_info, (num_pages > 1 ? 1 : 0) + page);
+                EmbeddedPreviewCache::store(image_id, preview);
+            }
+        };
+        ProxyFunction2<decltype(store_preview), void, int, QImage const&> preview_proxy(
+            store_preview
+        );
+        loader->loadEmbeddedPreviews(file, preview_proxy);
+    }
+
+    if (entry.status != GENERIC_ERROR) {
+        // A generic error may well be a transient one, like a network
+        // share going away, so it's not worth remembering.
+        ImageMetadataCache::store(file_path, entry);
+    }
+
+    for (ImageMetadata const& metadata : entry.pages) {
+        out(metadata);
+    }
+    return entry.status;
 }
 
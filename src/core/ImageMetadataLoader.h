@@ -26,6 +26,7 @@
 
 class QString;
 class QIODevice;
+class QImage;
 class ImageMetadata;
 
 class ImageMetadataLoader : public RefCountable
@@ -70,10 +71,29 @@ protected:
     virtual Status loadMetadata(
         QIODevice& io_device,
         VirtualFunction1<void, ImageMetadata const&>& out) = 0;
+
+    /**
+     * \brief Extracts the previews embedded into a file.
+     *
+     * Called after loadMetadata() has succeeded for a file that wasn't
+     * seen before, with \p io_device rewound to the beginning.  The
+     * previews end up in EmbeddedPreviewCache, to be displayed until
+     * proper thumbnails are made.  Only previews that are cheap to get
+     * at should be extracted, as this slows down the metadata scan.
+     * The default implementation does nothing.
+     *
+     * \param io_device The I/O device to read from.
+     * \param out A callback taking a zero-based page number and the
+     *        preview of that page.
+     */
+    virtual void loadEmbeddedPreviews(
+        QIODevice& io_device,
+        VirtualFunction2<void, int, QImage const&>& out) {}
 private:
     static Status loadImpl(
         QIODevice& io_device,
-        VirtualFunction1<void, ImageMetadata const&>& out);
+        VirtualFunction1<void, ImageMetadata const&>& out,
+        ImageMetadataLoader** used_loader = 0);
 
     static Status loadImpl(
         QString const& file_path,
@@ -0,0 +1,164 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImageMetadataScanner.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QRunnable>
+#include <deque>
+#include <utility>
+
+class ImageMetadataScanner::Impl
+{
+public:
+    Impl();
+
+    ~Impl();
+
+    void scan(QString const& file_path);
+
+    bool takeResult(Result& result, bool wait);
+
+    int numPending() const;
+
+    void completed(Result& result);
+private:
+    /**
+     * Loading metadata is bound by the storage latency rather than the CPU,
+     * so we keep more files in flight than there are cores.
+     */
+    static int const MAX_THREADS = 8;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_completed;
+    std::deque<Result> m_results;
+    int m_numPending;
+
+    // Goes last, so that its destructor waits for running
+    // tasks before the rest of the members are gone.
+    QThreadPool m_pool;
+};
+
+class ImageMetadataScanner::ScanTask : public QRunnable
+{
+public:
+    ScanTask(Impl& owner, QString const& file_path)
+        :   m_rOwner(owner), m_filePath(file_path) {}
+
+    virtual void run()
+    {
+        Result result;
+        result.filePath = m_filePath;
+        result.status = ImageMetadataLoader::load(
+            m_filePath, [&result](ImageMetadata const& metadata) {
+                result.perPageMetadata.push_back(metadata);
+            }
+        );
+        m_rOwner.completed(result);
+    }
+private:
+    Impl& m_rOwner;
+    QString m_filePath;
+};
+
+ImageMetadataScanner::Impl::Impl()
+    :   m_numPending(0)
+{
+    m_pool.setMaxThreadCount(MAX_THREADS);
+}
+
+ImageMetadataScanner::Impl::~Impl()
+{
+    // Don't start the files still queued.  The pool's destructor
+    // waits for the ones in progress.
+    m_pool.clear();
+}
+
+void
+ImageMetadataScanner::Impl::scan(QString const& file_path)
+{
+    {
+        QMutexLocker const locker(&m_mutex);
+        ++m_numPending;
+    }
+    m_pool.start(new ScanTask(*this, file_path));
+}
+
+bool
+ImageMetadataScanner::Impl::takeResult(Result& result, bool const wait)
+{
+    QMutexLocker const locker(&m_mutex);
+    while (m_results.empty()) {
+        if (!wait || m_numPending == 0) {
+            return false;
+        }
+        m_completed.wait(&m_mutex);
+    }
+
+    std::swap(result, m_results.front());
+    m_results.pop_front();
+    --m_numPending;
+    return true;
+}
+
+int
+ImageMetadataScanner::Impl::numPending() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_numPending;
+}
+
+void
+ImageMetadataScanner::Impl::completed(Result& result)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_results.push_back(Result());
+    std::swap(m_results.back(), result);
+    m_completed.wakeAll();
+}
+
+/*========================= ImageMetadataScanner =========================*/
+
+ImageMetadataScanner::ImageMetadataScanner()
+    :   m_ptrImpl(new Impl)
+{
+}
+
+ImageMetadataScanner::~ImageMetadataScanner()
+{
+}
+
+void
+ImageMetadataScanner::scan(QString const& file_path)
+{
+    m_ptrImpl->scan(file_path);
+}
+
+bool
+ImageMetadataScanner::takeResult(Result& result, bool const wait)
+{
+    return m_ptrImpl->takeResult(result, wait);
+}
+
+int
+ImageMetadataScanner::numPending() const
+{
+    return m_ptrImpl->numPending();
+}
@@ -0,0 +1,84 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEMETADATASCANNER_H_
+#define IMAGEMETADATASCANNER_H_
+
+#include "NonCopyable.h"
+#include "ImageMetadata.h"
+#include "ImageMetadataLoader.h"
+#include <QString>
+#include <memory>
+#include <vector>
+
+/**
+ * \brief Loads the metadata of many files in parallel.
+ *
+ * Reading the metadata of a file takes little CPU but a few round trips
+ * to the storage, which adds up to minutes for thousands of files on a
+ * network share.  The scanner keeps several files in flight at once and
+ * hands out the results as they complete, in no particular order.
+ *
+ * Files go through ImageMetadataLoader::load(), so the metadata of files
+ * that didn't change since they were last loaded comes from its cache.
+ */
+class ImageMetadataScanner
+{
+    DECLARE_NON_COPYABLE(ImageMetadataScanner)
+public:
+    struct Result {
+        QString filePath;
+        ImageMetadataLoader::Status status;
+        std::vector<ImageMetadata> perPageMetadata;
+
+        Result() : status(ImageMetadataLoader::GENERIC_ERROR) {}
+    };
+
+    ImageMetadataScanner();
+
+    /**
+     * Files not yet started are dropped.  Waits for the ones in progress.
+     */
+    ~ImageMetadataScanner();
+
+    /**
+     * \brief Queues a file.  Files start loading in the order they are queued.
+     */
+    void scan(QString const& file_path);
+
+    /**
+     * \brief Takes a completed result.
+     *
+     * \param wait Whether to wait for a result if none is ready yet.
+     * \return false if there is no result ready, or if \p wait is set,
+     *         if there are no files left to wait for.
+     */
+    bool takeResult(Result& result, bool wait = false);
+
+    /**
+     * \brief The number of queued files whose results weren't taken yet.
+     */
+    int numPending() const;
+private:
+    class Impl;
+    class ScanTask;
+
+    std::unique_ptr<Impl> m_ptrImpl;
+};
+
+#endif
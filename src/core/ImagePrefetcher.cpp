@@ -0,0 +1,244 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ImagePrefetcher.h"
+#include "ImageLoader.h"
+#include "ImageId.h"
+#include "MemoryBudget.h"
+#include "TraceRecorder.h"
+#include "NumaTopology.h"
+#include "IoGate.h"
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QRunnable>
+#include <map>
+#include <deque>
+#include <algorithm>
+
+class ImagePrefetcher::Impl
+{
+public:
+    Impl();
+
+    void setDepth(int pages);
+
+    int depth() const;
+
+    void prefetch(ImageId const& image_id, int node);
+
+    bool take(ImageId const& image_id, QImage& image);
+
+    void clear();
+
+    void decoded(ImageId const& image_id, QImage const& image);
+private:
+    struct Entry {
+        QImage image;
+        bool ready;
+
+        Entry() : ready(false) {}
+    };
+
+    bool evictOne();
+
+    void forget(ImageId const& image_id);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_decoded;
+    std::map<ImageId, Entry> m_entries;
+    std::deque<ImageId> m_order; /**< Oldest first. */
+    int m_depth;
+
+    // Goes last, so that its destructor waits for running
+    // decodes before the rest of the members are gone.
+    QThreadPool m_pool;
+};
+
+class ImagePrefetcher::DecodeTask : public QRunnable
+{
+public:
+    DecodeTask(Impl& owner, ImageId const& image_id, int node)
+        :   m_rOwner(owner), m_imageId(image_id), m_node(node) {}
+
+    virtual void run()
+    {
+        TraceRecorder::Span const trace_span("prefetch_image");
+        IoGate::PriorityScope const io_priority(IoGate::READ_AHEAD);
+        if (m_node >= 0) {
+            // The image is allocated and filled here, so that's
+            // where its memory ends up.
+            NumaTopology::bindCurrentThread(m_node);
+        }
+        // Not ImageLoader::load(ImageId const&), as that would
+        // look for a prefetched image.
+        QImage const image(
+            ImageLoader::load(m_imageId.filePath(), m_imageId.zeroBasedPage())
+        );
+        m_rOwner.decoded(m_imageId, image);
+    }
+private:
+    Impl& m_rOwner;
+    ImageId m_imageId;
+    int m_node;
+};
+
+ImagePrefetcher::Impl::Impl()
+    :   m_depth(2)
+{
+    m_pool.setMaxThreadCount(2);
+}
+
+void
+ImagePrefetcher::Impl::setDepth(int const pages)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_depth = std::max(0, pages);
+}
+
+int
+ImagePrefetcher::Impl::depth() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_depth;
+}
+
+void
+ImagePrefetcher::Impl::prefetch(ImageId const& image_id, int const node)
+{
+    if (image_id.isNull() || MemoryBudget::limit() > 0) {
+        return;
+    }
+
+    QMutexLocker const locker(&m_mutex);
+    if (m_depth <= 0 || m_entries.find(image_id) != m_entries.end()) {
+        return;
+    }
+
+    // Room for the pages being decoded plus as many decoded ones
+    // waiting to be taken.
+    int const max_entries = m_depth * 2;
+    while ((int)m_entries.size() >= max_entries) {
+        if (!evictOne()) {
+            return;
+        }
+    }
+
+    m_entries[image_id] = Entry();
+    m_order.push_back(image_id);
+    m_pool.start(new DecodeTask(*this, image_id, node));
+}
+
+bool
+ImagePrefetcher::Impl::take(ImageId const& image_id, QImage& image)
+{
+    QMutexLocker const locker(&m_mutex);
+    for (;;) {
+        std::map<ImageId, Entry>::iterator const it(m_entries.find(image_id));
+        if (it == m_entries.end()) {
+            return false;
+        }
+        if (it->second.ready) {
+            image = it->second.image;
+            forget(image_id);
+            return true;
+        }
+        m_decoded.wait(&m_mutex);
+    }
+}
+
+void
+ImagePrefetcher::Impl::clear()
+{
+    QMutexLocker const locker(&m_mutex);
+    // Decodes still running find their entries gone and drop the results.
+    m_entries.clear();
+    m_order.clear();
+    m_decoded.wakeAll();
+}
+
+void
+ImagePrefetcher::Impl::decoded(ImageId const& image_id, QImage const& image)
+{
+    QMutexLocker const locker(&m_mutex);
+    std::map<ImageId, Entry>::iterator const it(m_entries.find(image_id));
+    if (it != m_entries.end()) {
+        it->second.image = image;
+        it->second.ready = true;
+    }
+    m_decoded.wakeAll();
+}
+
+bool
+ImagePrefetcher::Impl::evictOne()
+{
+    for (ImageId const& id : m_order) {
+        if (m_entries.find(id)->second.ready) {
+            forget(ImageId(id)); // A copy, as forget() invalidates id.
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+ImagePrefetcher::Impl::forget(ImageId const& image_id)
+{
+    m_entries.erase(image_id);
+    m_order.erase(std::find(m_order.begin(), m_order.end(), image_id));
+}
+
+ImagePrefetcher::Impl&
+ImagePrefetcher::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+void
+ImagePrefetcher::setDepth(int const pages)
+{
+    impl().setDepth(pages);
+}
+
+int
+ImagePrefetcher::depth()
+{
+    return impl().depth();
+}
+
+void
+ImagePrefetcher::prefetch(ImageId const& image_id, int const node)
+{
+    impl().prefetch(image_id, node);
+}
+
+bool
+ImagePrefetcher::take(ImageId const& image_id, QImage& image)
+{
+    return impl().take(image_id, image);
+}
+
+void
+ImagePrefetcher::clear()
+{
+    impl().clear();
+}
@@ -0,0 +1,82 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAGEPREFETCHER_H_
+#define IMAGEPREFETCHER_H_
+
+class ImageId;
+class QImage;
+
+/**
+ * \brief Decodes images of upcoming pages ahead of time.
+ *
+ * Batch schedulers know which pages come next.  They call prefetch()
+ * for the next depth() of them, and ImageLoader::load(ImageId const&)
+ * takes a prefetched image instead of decoding it again, waiting for
+ * the decode to complete if it's still in progress.  That hides the
+ * decoding time behind the processing of the current page.
+ *
+ * Decoding takes place on a pool of its own, in the order the images
+ * were requested, with files read as IoGate::READ_AHEAD.  Prefetched
+ * images that are never taken are evicted, oldest first, as new ones
+ * come in.
+ * Because prefetched images live outside of MemoryBudget reservations,
+ * prefetching is off while a memory limit is set.
+ */
+class ImagePrefetcher
+{
+public:
+    /**
+     * \brief Sets how many pages ahead schedulers should prefetch.
+     *
+     * Zero disables prefetching.  The default is 2.
+     */
+    static void setDepth(int pages);
+
+    static int depth();
+
+    /**
+     * \brief Starts decoding an image unless it's decoded or being decoded already.
+     *
+     * \param node The NUMA node of the worker that will take the image.
+     *        The image is decoded on that node, so that its memory is
+     *        local to the worker.  Negative means any node.
+     *        See NumaTopology.
+     */
+    static void prefetch(ImageId const& image_id, int node = -1);
+
+    /**
+     * \brief Takes a prefetched image, waiting for it if necessary.
+     *
+     * \return false if the image wasn't prefetched.
+     */
+    static bool take(ImageId const& image_id, QImage& image);
+
+    /**
+     * \brief Drops all prefetched images.
+     */
+    static void clear();
+private:
+    class Impl;
+    class DecodeTask;
+
+    static Impl& impl();
+};
+
+#endif
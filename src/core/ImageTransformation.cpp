@@ -23,11 +23,12 @@
 
 ImageTransformation::ImageTransformation(
     QRectF const& orig_image_rect, Dpi const& orig_dpi)
-    :   m_postRotation(0.0),
-        m_origRect(orig_image_rect),
-        m_resultingRect(orig_image_rect),
-        m_origDpi(orig_dpi)
+    :   m_ptrData(new Data)
 {
+    m_ptrData->postRotation = 0.0;
+    m_ptrData->origRect = orig_image_rect;
+    m_ptrData->resultingRect = orig_image_rect;
+    m_ptrData->origDpi = orig_dpi;
     preScaleToEqualizeDpi();
 }
 
@@ -35,48 +36,59 @@ ImageTransformation::~ImageTransformation()
 {
 }
 
+ImageTransformation::Data&
+ImageTransformation::detach()
+{
+    if (m_ptrData.use_count() > 1) {
+        m_ptrData.reset(new Data(*m_ptrData));
+    }
+    return *m_ptrData;
+}
+
 void
 ImageTransformation::preScaleToDpi(Dpi const& dpi)
 {
-    if (m_origDpi.isNull() || dpi.isNull()) {
+    if (m_ptrData->origDpi.isNull() || dpi.isNull()) {
         return;
     }
 
-    m_preScaledDpi = dpi;
+    Data& d = detach();
+
+    d.preScaledDpi = dpi;
 
-    double const xscale = (double)dpi.horizontal() / m_origDpi.horizontal();
-    double const yscale = (double)dpi.vertical() / m_origDpi.vertical();
+    double const xscale = (double)dpi.horizontal() / d.origDpi.horizontal();
+    double const yscale = (double)dpi.vertical() / d.origDpi.vertical();
 
     QSizeF const new_pre_scaled_image_size(
-        m_origRect.width() * xscale, m_origRect.height() * yscale
+        d.origRect.width() * xscale, d.origRect.height() * yscale
     );
 
     // Undo's for the specified steps.
-    QTransform const undo21(m_preRotateXform.inverted() * m_preScaleXform.inverted());
-    QTransform const undo4321(m_postRotateXform.inverted() * m_preCropXform.inverted() * undo21);
+    QTransform const undo21(d.preRotateXform.inverted() * d.preScaleXform.inverted());
+    QTransform const undo4321(d.postRotateXform.inverted() * d.preCropXform.inverted() * undo21);
 
     // Update transform #1: pre-scale.
-    m_preScaleXform.reset();
-    m_preScaleXform.scale(xscale, yscale);
+    d.preScaleXform.reset();
+    d.preScaleXform.scale(xscale, yscale);
 
     // Update transform #2: pre-rotate.
-    m_preRotateXform = m_preRotation.transform(new_pre_scaled_image_size);
+    d.preRotateXform = d.preRotation.transform(new_pre_scaled_image_size);
 
     // Update transform #3: pre-crop.
-    QTransform const redo12(m_preScaleXform * m_preRotateXform);
-    m_preCropArea = (undo21 * redo12).map(m_preCropArea);
-    m_preCropXform = calcCropXform(m_preCropArea);
+    QTransform const redo12(d.preScaleXform * d.preRotateXform);
+    d.preCropArea = (undo21 * redo12).map(d.preCropArea);
+    d.preCropXform = calcCropXform(d.preCropArea);
 
     // Update transform #4: post-rotate.
-    m_postRotateXform = calcPostRotateXform(m_postRotation);
+    d.postRotateXform = calcPostRotateXform(d.postRotation);
 
     // Update transform #5: post-crop.
-    QTransform const redo1234(redo12 * m_preCropXform * m_postRotateXform);
-    m_postCropArea = (undo4321 * redo1234).map(m_postCropArea);
-    m_postCropXform = calcCropXform(m_postCropArea);
+    QTransform const redo1234(redo12 * d.preCropXform * d.postRotateXform);
+    d.postCropArea = (undo4321 * redo1234).map(d.postCropArea);
+    d.postCropXform = calcCropXform(d.postCropArea);
 
     // Update transform #6: post-scale.
-    m_postScaleXform = calcPostScaleXform(m_postScaledDpi);
+    d.postScaleXform = calcPostScaleXform(d.postScaledDpi);
 
     update();
 }
@@ -84,15 +96,17 @@ ImageTransformation::preScaleToDpi(Dpi const& dpi)
 void
 ImageTransformation::preScaleToEqualizeDpi()
 {
-    int const min_dpi = std::min(m_origDpi.horizontal(), m_origDpi.vertical());
+    Data const& d = *m_ptrData;
+    int const min_dpi = std::min(d.origDpi.horizontal(), d.origDpi.vertical());
     preScaleToDpi(Dpi(min_dpi, min_dpi));
 }
 
 void
 ImageTransformation::setPreRotation(OrthogonalRotation const rotation)
 {
-    m_preRotation = rotation;
-    m_preRotateXform = m_preRotation.transform(m_origRect.size());
+    Data& d = detach();
+    d.preRotation = rotation;
+    d.preRotateXform = d.preRotation.transform(d.origRect.size());
     resetPreCropArea();
     resetPostRotation();
     resetPostCrop();
@@ -103,8 +117,9 @@ ImageTransformation::setPreRotation(OrthogonalRotation const rotation)
 void
 ImageTransformation::setPreCropArea(QPolygonF const& area)
 {
-    m_preCropArea = area;
-    m_preCropXform = calcCropXform(area);
+    Data& d = detach();
+    d.preCropArea = area;
+    d.preCropXform = calcCropXform(area);
     resetPostRotation();
     resetPostCrop();
     resetPostScale();
@@ -114,8 +129,9 @@ ImageTransformation::setPreCropArea(QPolygonF const& area)
 void
 ImageTransformation::setPostRotation(double const degrees)
 {
-    m_postRotateXform = calcPostRotateXform(degrees);
-    m_postRotation = degrees;
+    Data& d = detach();
+    d.postRotateXform = calcPostRotateXform(degrees);
+    d.postRotation = degrees;
     resetPostCrop();
     resetPostScale();
     update();
@@ -124,8 +140,9 @@ ImageTransformation::setPostRotation(double const degrees)
 void
 ImageTransformation::setPostCropArea(QPolygonF const& area)
 {
-    m_postCropArea = area;
-    m_postCropXform = calcCropXform(area);
+    Data& d = detach();
+    d.postCropArea = area;
+    d.postCropXform = calcCropXform(area);
     resetPostScale();
     update();
 }
@@ -133,13 +150,14 @@ ImageTransformation::setPostCropArea(QPolygonF const& area)
 void
 ImageTransformation::postScaleToDpi(Dpi const& dpi)
 {
-    m_postScaledDpi = dpi;
-    m_postScaleXform = calcPostScaleXform(dpi);
+    Data& d = detach();
+    d.postScaledDpi = dpi;
+    d.postScaleXform = calcPostScaleXform(dpi);
     update();
 }
 
 QTransform
-ImageTransformation::calcCropXform(QPolygonF const& area)
+ImageTransformation::calcCropXform(QPolygonF const& area) const
 {
     QRectF const bounds(area.boundingRect());
     QTransform xform;
@@ -148,17 +166,18 @@ ImageTransformation::calcCropXform(QPolygonF const& area)
 }
 
 QTransform
-ImageTransformation::calcPostRotateXform(double const degrees)
+ImageTransformation::calcPostRotateXform(double const degrees) const
 {
+    Data const& d = *m_ptrData;
     QTransform xform;
     if (degrees != 0.0) {
-        QPointF const origin(m_preCropArea.boundingRect().center());
+        QPointF const origin(d.preCropArea.boundingRect().center());
         xform.translate(-origin.x(), -origin.y());
         xform *= QTransform().rotate(degrees);
         xform *= QTransform().translate(origin.x(), origin.y());
 
         // Calculate size changes.
-        QPolygonF const pre_rotate_poly(m_preCropXform.map(m_preCropArea));
+        QPolygonF const pre_rotate_poly(d.preCropXform.map(d.preCropArea));
         QRectF const pre_rotate_rect(pre_rotate_poly.boundingRect());
         QPolygonF const post_rotate_poly(xform.map(pre_rotate_poly));
         QRectF const post_rotate_rect(post_rotate_poly.boundingRect());
@@ -172,17 +191,18 @@ ImageTransformation::calcPostRotateXform(double const degrees)
 }
 
 QTransform
-ImageTransformation::calcPostScaleXform(Dpi const& target_dpi)
+ImageTransformation::calcPostScaleXform(Dpi const& target_dpi) const
 {
+    Data const& d = *m_ptrData;
     if (target_dpi.isNull()) {
         return QTransform();
     }
 
     // We are going to measure the effective DPI after the previous transforms.
-    // Normally m_preScaledDpi would be symmetric, so we could just
+    // Normally preScaledDpi would be symmetric, so we could just
     // use that, but just in case ...
 
-    QTransform const to_orig(m_postScaleXform * m_transform.inverted());
+    QTransform const to_orig(d.postScaleXform * d.invTransform);
     // IMPORTANT: in the above line we assume post-scale is the last transform.
 
     QLineF const hor_unit(QPointF(0, 0), QPointF(1, 0));
@@ -190,8 +210,8 @@ ImageTransformation::calcPostScaleXform(Dpi const& target_dpi)
     QLineF const orig_hor_unit(to_orig.map(hor_unit));
     QLineF const orig_vert_unit(to_orig.map(vert_unit));
 
-    double const xscale = target_dpi.horizontal() * orig_hor_unit.length() / m_origDpi.horizontal();
-    double const yscale = target_dpi.vertical() * orig_vert_unit.length() / m_origDpi.vertical();
+    double const xscale = target_dpi.horizontal() * orig_hor_unit.length() / d.origDpi.horizontal();
+    double const yscale = target_dpi.vertical() * orig_vert_unit.length() / d.origDpi.vertical();
     QTransform xform;
     xform.scale(xscale, yscale);
     return xform;
@@ -200,47 +220,52 @@ ImageTransformation::calcPostScaleXform(Dpi const& target_dpi)
 void
 ImageTransformation::resetPreCropArea()
 {
-    m_preCropArea.clear();
-    m_preCropXform.reset();
+    Data& d = *m_ptrData;
+    d.preCropArea.clear();
+    d.preCropXform.reset();
 }
 
 void
 ImageTransformation::resetPostRotation()
 {
-    m_postRotation = 0.0;
-    m_postRotateXform.reset();
+    Data& d = *m_ptrData;
+    d.postRotation = 0.0;
+    d.postRotateXform.reset();
 }
 
 void
 ImageTransformation::resetPostCrop()
 {
-    m_postCropArea.clear();
-    m_postCropXform.reset();
+    Data& d = *m_ptrData;
+    d.postCropArea.clear();
+    d.postCropXform.reset();
 }
 
 void
 ImageTransformation::resetPostScale()
 {
-    m_postScaledDpi = Dpi();
-    m_postScaleXform.reset();
+    Data& d = *m_ptrData;
+    d.postScaledDpi = Dpi();
+    d.postScaleXform.reset();
 }
 
 void
 ImageTransformation::update()
 {
-    QTransform const pre_scale_then_pre_rotate(m_preScaleXform * m_preRotateXform); // 12
-    QTransform const pre_crop_then_post_rotate(m_preCropXform * m_postRotateXform); // 34
-    QTransform const post_crop_then_post_scale(m_postCropXform * m_postScaleXform); // 56
+    Data& d = *m_ptrData;
+    QTransform const pre_scale_then_pre_rotate(d.preScaleXform * d.preRotateXform); // 12
+    QTransform const pre_crop_then_post_rotate(d.preCropXform * d.postRotateXform); // 34
+    QTransform const post_crop_then_post_scale(d.postCropXform * d.postScaleXform); // 56
     QTransform const pre_crop_and_further(pre_crop_then_post_rotate * post_crop_then_post_scale); // 3456
-    m_transform = pre_scale_then_pre_rotate * pre_crop_and_further;
-    m_invTransform = m_transform.inverted();
-    if (m_preCropArea.empty()) {
-        m_preCropArea = pre_scale_then_pre_rotate.map(m_origRect);
+    d.transform = pre_scale_then_pre_rotate * pre_crop_and_further;
+    d.invTransform = d.transform.inverted();
+    if (d.preCropArea.empty()) {
+        d.preCropArea = pre_scale_then_pre_rotate.map(d.origRect);
     }
-    if (m_postCropArea.empty()) {
-        m_postCropArea = pre_crop_then_post_rotate.map(m_preCropArea);
+    if (d.postCropArea.empty()) {
+        d.postCropArea = pre_crop_then_post_rotate.map(d.preCropArea);
     }
-    m_resultingPreCropArea = pre_crop_and_further.map(m_preCropArea);
-    m_resultingPostCropArea = post_crop_then_post_scale.map(m_postCropArea);
-    m_resultingRect = m_resultingPostCropArea.boundingRect();
+    d.resultingPreCropArea = pre_crop_and_further.map(d.preCropArea);
+    d.resultingPostCropArea = post_crop_then_post_scale.map(d.postCropArea);
+    d.resultingRect = d.resultingPostCropArea.boundingRect();
 }
@@ -24,6 +24,7 @@
 #include <QTransform>
 #include <QPolygonF>
 #include <QRectF>
+#include <memory>
 
 /**
  * \brief Provides a transformed view of an image.
@@ -62,7 +63,7 @@
 class ImageTransformation
 {
 public:
-    // Member-wise copying is OK.
+    // Member-wise copying is OK, and cheap.
 
     ImageTransformation(QRectF const& orig_image_rect, Dpi const& orig_dpi);
 
@@ -92,7 +93,7 @@ public:
      */
     Dpi const& origDpi() const
     {
-        return m_origDpi;
+        return m_ptrData->origDpi;
     }
 
     /**
@@ -103,7 +104,7 @@ public:
      */
     Dpi const& preScaledDpi() const
     {
-        return m_preScaledDpi;
+        return m_ptrData->preScaledDpi;
     }
 
     /**
@@ -118,7 +119,7 @@ public:
      */
     OrthogonalRotation preRotation() const
     {
-        return m_preRotation;
+        return m_ptrData->preRotation;
     }
 
     /**
@@ -141,7 +142,7 @@ public:
      */
     QPolygonF const& preCropArea() const
     {
-        return m_preCropArea;
+        return m_ptrData->preCropArea;
     }
 
     /**
@@ -152,7 +153,7 @@ public:
      */
     QPolygonF const& resultingPreCropArea() const
     {
-        return m_resultingPreCropArea;
+        return m_ptrData->resultingPreCropArea;
     }
 
     /**
@@ -167,7 +168,7 @@ public:
      */
     double postRotation() const
     {
-        return m_postRotation;
+        return m_ptrData->postRotation;
     }
 
     /**
@@ -175,7 +176,7 @@ public:
      */
     double postRotationSin() const
     {
-        return m_postRotateXform.m12();
+        return m_ptrData->postRotateXform.m12();
     }
 
     /**
@@ -183,7 +184,7 @@ public:
      */
     double postRotationCos() const
     {
-        return m_postRotateXform.m11();
+        return m_ptrData->postRotateXform.m11();
     }
 
     /**
@@ -199,7 +200,7 @@ public:
      */
     QPolygonF const& resultingPostCropArea() const
     {
-        return m_resultingPostCropArea;
+        return m_ptrData->resultingPostCropArea;
     }
 
     /**
@@ -215,7 +216,7 @@ public:
      */
     QTransform const& transform() const
     {
-        return m_transform;
+        return m_ptrData->transform;
     }
 
     /**
@@ -224,7 +225,7 @@ public:
      */
     QTransform const& transformBack() const
     {
-        return m_invTransform;
+        return m_ptrData->invTransform;
     }
 
     /**
@@ -232,7 +233,7 @@ public:
      */
     QRectF const& origRect() const
     {
-        return m_origRect;
+        return m_ptrData->origRect;
     }
 
     /**
@@ -244,14 +245,43 @@ public:
      */
     QRectF const& resultingRect() const
     {
-        return m_resultingRect;
+        return m_ptrData->resultingRect;
     }
 private:
-    QTransform calcCropXform(QPolygonF const& crop_area);
+    struct Data
+    {
+        QTransform preScaleXform;
+        QTransform preRotateXform;
+        QTransform preCropXform;
+        QTransform postRotateXform;
+        QTransform postCropXform;
+        QTransform postScaleXform;
+        QTransform transform;
+        QTransform invTransform;
+        double postRotation;
+        QRectF origRect;
+        QRectF resultingRect; // Managed by update().
+        QPolygonF preCropArea;
+        QPolygonF resultingPreCropArea; // Managed by update().
+        QPolygonF postCropArea;
+        QPolygonF resultingPostCropArea; // Managed by update().
+        Dpi origDpi;
+        Dpi preScaledDpi; // Always set, as preScaleToEqualizeDpi() is called from the constructor.
+        Dpi postScaledDpi; // Default constructed object if no post-scaling.
+        OrthogonalRotation preRotation;
+    };
+
+    /**
+     * Makes sure m_ptrData isn't shared with other copies,
+     * so that it can be modified.
+     */
+    Data& detach();
 
-    QTransform calcPostRotateXform(double degrees);
+    QTransform calcCropXform(QPolygonF const& crop_area) const;
 
-    QTransform calcPostScaleXform(Dpi const& target_dpi);
+    QTransform calcPostRotateXform(double degrees) const;
+
+    QTransform calcPostScaleXform(Dpi const& target_dpi) const;
 
     void resetPreCropArea();
 
@@ -263,25 +293,12 @@ private:
 
     void update();
 
-    QTransform m_preScaleXform;
-    QTransform m_preRotateXform;
-    QTransform m_preCropXform;
-    QTransform m_postRotateXform;
-    QTransform m_postCropXform;
-    QTransform m_postScaleXform;
-    QTransform m_transform;
-    QTransform m_invTransform;
-    double m_postRotation;
-    QRectF m_origRect;
-    QRectF m_resultingRect; // Managed by update().
-    QPolygonF m_preCropArea;
-    QPolygonF m_resultingPreCropArea; // Managed by update().
-    QPolygonF m_postCropArea;
-    QPolygonF m_resultingPostCropArea; // Managed by update().
-    Dpi m_origDpi;
-    Dpi m_preScaledDpi; // Always set, as preScaleToEqualizeDpi() is called from the constructor.
-    Dpi m_postScaledDpi; // Default constructed object if no post-scaling.
-    OrthogonalRotation m_preRotation;
+    /**
+     * Copies share the data until one of them is modified.  Transformations
+     * are copied into every FilterData, thumbnail and view, while most of
+     * the copies are never modified.
+     */
+    std::shared_ptr<Data> m_ptrData;
 };
 
 #endif
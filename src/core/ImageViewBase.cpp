@@ -20,9 +20,13 @@
 
 #include "NonCopyable.h"
 #include "ImagePresentation.h"
+#include "AlternativeImageSource.h"
 #include "OpenGLSupport.h"
+#include "GpuImageRenderer.h"
+#include "TiledImagePyramid.h"
 #include "PixmapRenderer.h"
 #include "BackgroundExecutor.h"
+#include "TraceRecorder.h"
 #include "Dpm.h"
 #include "Dpi.h"
 #include "ScopedIncDec.h"
@@ -51,6 +55,8 @@
 #include <Qt>
 #include <QDebug>
 #include <algorithm>
+#include <vector>
+#include <utility>
 #include <assert.h>
 #include <math.h>
 
@@ -115,6 +121,60 @@ private:
     QSize m_targetSize;
 };
 
+/**
+ * \brief Builds pyramid tiles in the background.
+ *
+ * Built tiles go to the shared tile cache, so all the result does
+ * is it makes the view repaint itself.
+ */
+class ImageViewBase::TileTask :
+    public AbstractCommand0<IntrusivePtr<AbstractCommand0<void> > >,
+    public QObject
+{
+    DECLARE_NON_COPYABLE(TileTask)
+public:
+    struct TileId {
+        int level;
+        int col;
+        int row;
+    };
+
+    TileTask(ImageViewBase* image_view,
+             QImage const& image, std::vector<TileId> const& tiles);
+
+    void cancel()
+    {
+        m_ptrResult->cancel();
+    }
+
+    virtual IntrusivePtr<AbstractCommand0<void> > operator()();
+private:
+    class Result : public AbstractCommand0<void>
+    {
+    public:
+        Result(ImageViewBase* image_view) : m_ptrImageView(image_view) {}
+
+        void cancel()
+        {
+            m_cancelFlag.fetchAndStoreRelaxed(1);
+        }
+
+        bool isCancelled() const
+        {
+            return m_cancelFlag.fetchAndAddRelaxed(0) != 0;
+        }
+
+        virtual void operator()();
+    private:
+        QPointer<ImageViewBase> m_ptrImageView;
+        mutable QAtomicInt m_cancelFlag;
+    };
+
+    IntrusivePtr<Result> m_ptrResult;
+    QImage m_image;
+    std::vector<TileId> m_tiles;
+};
+
 /**
  * \brief Temporarily adjust the widget focal point, then change it back.
  *
@@ -173,7 +233,8 @@ ImageViewBase::ImageViewBase(
         m_hqTransformEnabled(true),
         m_lastCursorPos(0, 0),
         m_cursorPosAdjustment(m_virtualImageCropArea.boundingRect().topLeft()),
-        m_displayAlternative(false)
+        m_displayAlternative(false),
+        m_livePreview(false)
 {
 #ifdef ENABLE_OPENGL
     if (QSettings().value(_key_use_3d_accel, _key_use_3d_accel_def) != false) {
@@ -189,6 +250,7 @@ ImageViewBase::ImageViewBase(
             format.setDirectRendering(false);
 
             setViewport(new QGLWidget(format));
+            m_ptrGpuRenderer.reset(new GpuImageRenderer);
         }
     }
 #endif
@@ -252,6 +314,18 @@ ImageViewBase::ImageViewBase(
 
 ImageViewBase::~ImageViewBase()
 {
+    if (m_ptrTileTask.get()) {
+        m_ptrTileTask->cancel();
+    }
+
+#ifdef ENABLE_OPENGL
+    if (m_ptrGpuRenderer) {
+        if (QGLWidget* gl_widget = qobject_cast<QGLWidget*>(viewport())) {
+            gl_widget->makeCurrent();
+            m_ptrGpuRenderer->release();
+        }
+    }
+#endif
 }
 
 void
@@ -488,6 +562,54 @@ void
 ImageViewBase::paintEvent(QPaintEvent* event)
 {
     QPainter painter(viewport());
+
+    if (m_ptrGpuRenderer) {
+        // It needs the viewport's OpenGL paint engine,
+        // so it can't draw into a cached layer.
+        paintPageLayer(painter);
+    } else {
+        if (!pageLayerUpToDate()) {
+            int const dpr = viewport()->devicePixelRatio();
+            QPixmap layer(viewport()->size() * dpr);
+            layer.setDevicePixelRatio(dpr);
+            QPainter layer_painter(&layer);
+            bool const complete = paintPageLayer(layer_painter);
+            layer_painter.end();
+
+            m_pageLayer = layer;
+            m_pageLayerKey = complete ? currentPageLayerKey() : PageLayerKey();
+        }
+
+        // The painter is clipped to the region being repainted,
+        // so only that much gets copied.
+        painter.drawPixmap(0, 0, m_pageLayer);
+    }
+
+    painter.setWorldTransform(m_virtualToWidget);
+
+    m_interactionState.resetProximity();
+    if (!m_interactionState.captured()) {
+        m_rootInteractionHandler.proximityUpdate(
+            QPointF(0.5, 0.5) + mapFromGlobal(QCursor::pos()), m_interactionState
+        );
+        updateStatusTipAndCursor();
+    }
+
+    m_rootInteractionHandler.paint(painter, m_interactionState);
+    maybeQueueRedraw();
+}
+
+/**
+ * Draws the image and covers the areas outside of it and outside of
+ * the crop area with background.  Because of Qt::WA_OpaquePaintEvent,
+ * that's all of the viewport.
+ *
+ * Returns false if a low quality version of the image had to be drawn
+ * for some of it, while a better one is being prepared.
+ */
+bool
+ImageViewBase::paintPageLayer(QPainter& painter)
+{
     painter.save();
 
     double const xscale = m_virtualToWidget.m11();
@@ -498,12 +620,25 @@ ImageViewBase::paintEvent(QPaintEvent* event)
     // Disable antialiasing for large zoom levels.
     painter.setRenderHint(QPainter::SmoothPixmapTransform, pixel_width < 0.5);
 
-    if (validateHqPixmap()) {
+    bool complete = true;
+    if (m_livePreview) {
+        drawLivePreview(painter);
+        complete = false;
+    } else if (m_ptrGpuRenderer && m_ptrGpuRenderer->draw(
+                painter, get_image(), m_imageToVirtual * m_virtualToWidget,
+                pixel_width < 0.5)) {
+        // Filtered on the GPU from the full image, so there is
+        // no need for a HQ version.
+    } else if (drawTiles(painter, m_imageToVirtual * m_virtualToWidget, complete)) {
+        // Tiles are prefiltered for the zoom level, so neither
+        // is there here.
+    } else if (validateHqPixmap()) {
         // HQ pixmap maps one to one to screen pixels, so antialiasing is not necessary.
         painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
         painter.drawPixmap(m_hqPixmapPos, get_hq_pixmap());
     } else {
         scheduleHqVersionRebuild();
+        complete = false;
 
         painter.setWorldTransform(
             m_pixmapToImage * m_imageToVirtual * m_virtualToWidget
@@ -553,18 +688,128 @@ ImageViewBase::paintEvent(QPaintEvent* event)
 
     painter.restore();
 
-    painter.setWorldTransform(m_virtualToWidget);
+    return complete;
+}
 
-    m_interactionState.resetProximity();
-    if (!m_interactionState.captured()) {
-        m_rootInteractionHandler.proximityUpdate(
-            QPointF(0.5, 0.5) + mapFromGlobal(QCursor::pos()), m_interactionState
-        );
-        updateStatusTipAndCursor();
+ImageViewBase::PageLayerKey
+ImageViewBase::currentPageLayerKey() const
+{
+    PageLayerKey key;
+    key.imageToWidget = m_imageToVirtual * m_virtualToWidget;
+    key.cropArea = m_virtualImageCropArea;
+    key.viewportSize = viewport()->size();
+    key.devicePixelRatio = viewport()->devicePixelRatio();
+    key.imageKey = get_image().cacheKey();
+    key.background = palette().color(QPalette::Window).rgba();
+    key.valid = true;
+    return key;
+}
+
+bool
+ImageViewBase::pageLayerUpToDate() const
+{
+    if (!m_pageLayerKey.valid) {
+        return false;
     }
 
-    m_rootInteractionHandler.paint(painter, m_interactionState);
-    maybeQueueRedraw();
+    PageLayerKey const key(currentPageLayerKey());
+    return key.imageToWidget == m_pageLayerKey.imageToWidget
+           && key.cropArea == m_pageLayerKey.cropArea
+           && key.viewportSize == m_pageLayerKey.viewportSize
+           && key.devicePixelRatio == m_pageLayerKey.devicePixelRatio
+           && key.imageKey == m_pageLayerKey.imageKey
+           && key.background == m_pageLayerKey.background;
+}
+
+void
+ImageViewBase::beginLivePreview()
+{
+    if (m_livePreview || m_ptrGpuRenderer) {
+        return;
+    }
+
+    int const dpr = viewport()->devicePixelRatio();
+    QPixmap snapshot(viewport()->size() * dpr);
+    snapshot.setDevicePixelRatio(dpr);
+    snapshot.fill(Qt::transparent);
+
+    QPainter painter(&snapshot);
+    drawImageSnapshot(painter);
+    painter.end();
+
+    m_livePreviewPixmap = snapshot;
+    m_livePreviewWidgetToImage = (m_imageToVirtual * m_virtualToWidget).inverted();
+    m_livePreview = true;
+}
+
+void
+ImageViewBase::endLivePreview()
+{
+    if (!m_livePreview) {
+        return;
+    }
+
+    m_livePreview = false;
+    m_livePreviewPixmap = QPixmap();
+    update();
+}
+
+void
+ImageViewBase::drawImageSnapshot(QPainter& painter)
+{
+    painter.save();
+
+    QTransform const image_to_widget(m_imageToVirtual * m_virtualToWidget);
+    bool complete = true;
+    if (drawTiles(painter, image_to_widget, complete)) {
+        // Whatever tiles are missing were drawn from the low quality pixmap.
+    } else if (validateHqPixmap()) {
+        painter.drawPixmap(m_hqPixmapPos, get_hq_pixmap());
+    } else {
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+        painter.setWorldTransform(m_pixmapToImage * image_to_widget);
+        PixmapRenderer::drawPixmap(painter, get_pixmap());
+    }
+
+    painter.restore();
+}
+
+/**
+ * Draws m_livePreviewPixmap moved the way the image moved since
+ * it was taken.  Parts of the viewport it doesn't reach are filled
+ * from the low quality pixmap.
+ */
+void
+ImageViewBase::drawLivePreview(QPainter& painter)
+{
+    // Whatever is being built is for a transform that's already gone,
+    // and nothing is to be built until the preview ends.
+    m_timer.stop();
+    if (m_ptrHqTransformTask.get()) {
+        m_ptrHqTransformTask->cancel();
+        m_ptrHqTransformTask.reset();
+    }
+
+    QTransform const image_to_widget(m_imageToVirtual * m_virtualToWidget);
+    QTransform const snapshot_to_widget(m_livePreviewWidgetToImage * image_to_widget);
+
+    QPainterPath snapshot_area;
+    snapshot_area.addPolygon(snapshot_to_widget.map(QRectF(viewport()->rect())));
+    QPainterPath uncovered_area;
+    uncovered_area.addRect(viewport()->rect());
+    uncovered_area = uncovered_area.subtracted(snapshot_area);
+
+    painter.save();
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    if (!uncovered_area.isEmpty()) {
+        painter.setClipPath(uncovered_area);
+        painter.setWorldTransform(m_pixmapToImage * image_to_widget);
+        PixmapRenderer::drawPixmap(painter, get_pixmap());
+        painter.setClipping(false);
+    }
+    painter.setWorldTransform(snapshot_to_widget);
+    painter.drawPixmap(0, 0, m_livePreviewPixmap);
+    painter.restore();
 }
 
 void
@@ -574,10 +819,14 @@ ImageViewBase::keyPressEvent(QKeyEvent* event)
     m_rootInteractionHandler.keyPressEvent(event, m_interactionState);
     event->setAccepted(true);
     updateStatusTipAndCursor();
-    if (m_alternativeImage &&
+    if ((m_alternativeImage || m_ptrAlternativeSource) &&
             GlobalStaticSettings::checkKeysMatch(PageViewDisplayOriginal,
                     event->modifiers(),
                     (Qt::Key)event->key())) {
+        if (!m_alternativeImage) {
+            // Until it's ready, the regular image stays on screen.
+            m_ptrAlternativeSource->request();
+        }
         m_displayAlternative = true;
         update();
     } else {
@@ -592,7 +841,7 @@ ImageViewBase::keyReleaseEvent(QKeyEvent* event)
     m_rootInteractionHandler.keyReleaseEvent(event, m_interactionState);
     event->setAccepted(true);
     updateStatusTipAndCursor();
-    if (m_alternativeImage &&
+    if ((m_alternativeImage || m_ptrAlternativeSource) &&
             GlobalStaticSettings::checkKeysMatch(PageViewDisplayOriginal,
                     event->modifiers(),
                     (Qt::Key)event->key())) {
@@ -1135,13 +1384,95 @@ ImageViewBase::initiateBuildingHqVersion()
         new HqTransformTask(this, get_image(), xform, viewport()->size())
     );
 
-    backgroundExecutor().enqueueTask(task);
+    backgroundExecutor().enqueueTask(task, &m_ptrHqTransformTask);
 
     m_ptrHqTransformTask = task;
     m_hqXform = xform;
     m_hqSourceId = get_image().cacheKey();
 }
 
+bool
+ImageViewBase::drawTiles(
+    QPainter& painter, QTransform const& image_to_widget, bool& complete)
+{
+    QImage const& image = get_image();
+    if (!TiledImagePyramid::suitableFor(image)) {
+        return false;
+    }
+
+    TiledImagePyramid const pyramid(image);
+
+    // Device pixels per image pixel.
+    double const scale = sqrt(fabs(image_to_widget.determinant()));
+    int const level = pyramid.levelForScale(scale);
+    double const level_scale = 1 << level;
+
+    QRectF const visible_image_rect(
+        image_to_widget.inverted().map(QRectF(viewport()->rect())).boundingRect()
+    );
+    QRect const range(pyramid.tileRange(level, visible_image_rect));
+
+    std::vector<TileTask::TileId> missing;
+    std::vector<std::pair<QRect, QImage> > tiles;
+    for (int row = range.top(); row <= range.bottom(); ++row) {
+        for (int col = range.left(); col <= range.right(); ++col) {
+            QImage const tile(pyramid.cachedTile(level, col, row));
+            if (tile.isNull()) {
+                TileTask::TileId const id = { level, col, row };
+                missing.push_back(id);
+            } else {
+                tiles.push_back(std::make_pair(pyramid.tileRect(level, col, row), tile));
+            }
+        }
+    }
+
+    complete = missing.empty();
+    if (!missing.empty()) {
+        painter.setWorldTransform(m_pixmapToImage * image_to_widget);
+        PixmapRenderer::drawPixmap(painter, get_pixmap());
+
+        if (!m_ptrTileTask.get() && m_hqTransformEnabled) {
+            // Nearest to the center first.
+            QPointF const center(
+                visible_image_rect.center().x() / level_scale,
+                visible_image_rect.center().y() / level_scale
+            );
+            std::sort(
+                missing.begin(), missing.end(),
+                [&pyramid, &center](TileTask::TileId const& lhs, TileTask::TileId const& rhs) {
+                    QPointF const l(pyramid.tileRect(lhs.level, lhs.col, lhs.row).center() - center);
+                    QPointF const r(pyramid.tileRect(rhs.level, rhs.col, rhs.row).center() - center);
+                    return l.x() * l.x() + l.y() * l.y() < r.x() * r.x() + r.y() * r.y();
+                }
+            );
+
+            IntrusivePtr<TileTask> const task(new TileTask(this, image, missing));
+            backgroundExecutor().enqueueTask(task, &m_ptrTileTask);
+            m_ptrTileTask = task;
+        }
+    }
+
+    QTransform level_to_widget;
+    level_to_widget.scale(level_scale, level_scale);
+    level_to_widget *= image_to_widget;
+    painter.setWorldTransform(level_to_widget);
+    for (auto const& tile : tiles) {
+        painter.drawImage(tile.first.topLeft(), tile.second);
+    }
+
+    return true;
+}
+
+/**
+ * Gets called from TileTask::Result.
+ */
+void
+ImageViewBase::tilesBuilt()
+{
+    m_ptrTileTask.reset();
+    update();
+}
+
 /**
  * Gets called from HqTransformationTask::Result.
  */
@@ -1210,6 +1541,38 @@ ImageViewBase::setAlternativeImage(shared_ptr<QImage> image, shared_ptr<QPixmap>
     }
 }
 
+void
+ImageViewBase::setAlternativeImageSource(shared_ptr<AlternativeImageSource> const& source)
+{
+    if (m_ptrAlternativeSource) {
+        disconnect(m_ptrAlternativeSource.get(), 0, this, 0);
+    }
+
+    m_ptrAlternativeSource = source;
+    setAlternativeImage(shared_ptr<QImage>(), shared_ptr<QPixmap>());
+    if (!source) {
+        return;
+    }
+
+    if (source->image()) {
+        alternativeImageReady();
+    } else {
+        connect(source.get(), SIGNAL(ready()), SLOT(alternativeImageReady()));
+    }
+}
+
+void
+ImageViewBase::alternativeImageReady()
+{
+    setAlternativeImage(
+        m_ptrAlternativeSource->image(), m_ptrAlternativeSource->downscaledPixmap()
+    );
+    m_alternativeHqPixmap = QPixmap();
+    if (m_displayAlternative) {
+        update();
+    }
+}
+
 /*==================== ImageViewBase::HqTransformTask ======================*/
 
 ImageViewBase::HqTransformTask::HqTransformTask(
@@ -1230,6 +1593,8 @@ ImageViewBase::HqTransformTask::operator()()
         return IntrusivePtr<AbstractCommand0<void> >();
     }
 
+    TraceRecorder::Span const trace_span("hq_transform");
+
     QRect const target_rect(
         m_xform.map(
             QRectF(m_image.rect())
@@ -1282,6 +1647,41 @@ ImageViewBase::HqTransformTask::Result::operator()()
     }
 }
 
+/*======================= ImageViewBase::TileTask =========================*/
+
+ImageViewBase::TileTask::TileTask(
+    ImageViewBase* image_view,
+    QImage const& image, std::vector<TileId> const& tiles)
+    :   m_ptrResult(new Result(image_view)),
+        m_image(image),
+        m_tiles(tiles)
+{
+}
+
+IntrusivePtr<AbstractCommand0<void> >
+ImageViewBase::TileTask::operator()()
+{
+    TraceRecorder::Span const trace_span("tile_pyramid");
+
+    TiledImagePyramid const pyramid(m_image);
+    for (TileId const& id : m_tiles) {
+        if (m_ptrResult->isCancelled() || BackgroundExecutor::currentTaskCancelled()) {
+            return IntrusivePtr<AbstractCommand0<void> >();
+        }
+        pyramid.tile(id.level, id.col, id.row);
+    }
+
+    return m_ptrResult;
+}
+
+void
+ImageViewBase::TileTask::Result::operator()()
+{
+    if (m_ptrImageView && !isCancelled()) {
+        m_ptrImageView->tilesBuilt();
+    }
+}
+
 /*================= ImageViewBase::TempFocalPointAdjuster =================*/
 
 ImageViewBase::TempFocalPointAdjuster::TempFocalPointAdjuster(ImageViewBase& obj)
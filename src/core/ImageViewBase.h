@@ -28,6 +28,9 @@
 #include <QWidget>
 #include <QAbstractScrollArea>
 #include <QPixmap>
+#include <QPolygonF>
+#include <QSize>
+#include <QColor>
 #include <QImage>
 #include <QString>
 #include <QTransform>
@@ -40,7 +43,9 @@
 
 class QPainter;
 class BackgroundExecutor;
+class GpuImageRenderer;
 class ImagePresentation;
+class AlternativeImageSource;
 
 using namespace std;
 /**
@@ -98,6 +103,15 @@ public:
         return m_pixmap;
     }
 
+    /**
+     * \brief Transformation from downscaledPixmap() coordinates
+     *        to image coordinates.
+     */
+    QTransform const& pixmapToImage() const
+    {
+        return m_pixmapToImage;
+    }
+
     /**
      * \brief Enable or disable the high-quality transform.
      */
@@ -273,6 +287,25 @@ public:
      */
     void moveTowardsIdealPosition(double pixel_length);
 
+    /**
+     * \brief Starts showing transform changes by moving a snapshot
+     *        of what's on screen, rather than by rebuilding the image.
+     *
+     * Meant for continuous changes, like a rotation handle being dragged.
+     * The snapshot is redrawn with the change between the transform it
+     * was taken with and the current one, which costs next to nothing,
+     * and no high quality version is built until endLivePreview().
+     * Does nothing if already started, or with the GPU renderer,
+     * which is fast enough as it is.
+     */
+    void beginLivePreview();
+
+    /**
+     * \brief Goes back to drawing the image normally, scheduling
+     *        a high quality version for the final transform.
+     */
+    void endLivePreview();
+
     static BackgroundExecutor& backgroundExecutor();
 
     void setAlternativeImage(shared_ptr<QImage> image, shared_ptr<QPixmap> pixmap);
@@ -282,6 +315,14 @@ public:
         return m_alternativePixmap;
     }
 
+    /**
+     * \brief Sets where the alternative image comes from, without building it.
+     *
+     * It's requested from \p source when the "display original" key is
+     * first pressed, and shown once ready, if the key is still held.
+     */
+    void setAlternativeImageSource(shared_ptr<AlternativeImageSource> const& source);
+
 protected:
     virtual void paintEvent(QPaintEvent* event);
 
@@ -329,11 +370,14 @@ signals:
 private slots:
     void initiateBuildingHqVersion();
 
+    void alternativeImageReady();
+
     void updateScrollBars();
 
     void reactToScrollBars();
 private:
     class HqTransformTask;
+    class TileTask;
     class TempFocalPointAdjuster;
     class TransformChangeWatcher;
 
@@ -359,6 +403,45 @@ private:
 
     void hqVersionBuilt(QPoint const& origin, QImage const& image);
 
+    /**
+     * Draws the image from TiledImagePyramid tiles, if it's big enough
+     * for that.  Tiles not built yet are queued for building in the
+     * background, and the low quality pixmap is shown in their place.
+     * \p complete is set to false if that happened.
+     */
+    bool drawTiles(QPainter& painter, QTransform const& image_to_widget, bool& complete);
+
+    /**
+     * Draws the best version of the image available right now,
+     * without covering its surroundings.
+     */
+    void drawImageSnapshot(QPainter& painter);
+
+    void drawLivePreview(QPainter& painter);
+
+    /**
+     * What m_pageLayer depends on.
+     */
+    struct PageLayerKey {
+        QTransform imageToWidget;
+        QPolygonF cropArea;
+        QSize viewportSize;
+        int devicePixelRatio;
+        qint64 imageKey;
+        QRgb background;
+        bool valid;
+
+        PageLayerKey() : devicePixelRatio(1), imageKey(0), background(0), valid(false) {}
+    };
+
+    bool paintPageLayer(QPainter& painter);
+
+    PageLayerKey currentPageLayerKey() const;
+
+    bool pageLayerUpToDate() const;
+
+    void tilesBuilt();
+
     void updateStatusTipAndCursor();
 
     void updateStatusTip();
@@ -381,12 +464,12 @@ private:
 
     const QPixmap& get_hq_pixmap() const
     {
-        return m_displayAlternative ? m_alternativeHqPixmap : m_hqPixmap;
+        return m_displayAlternative && m_alternativeImage ? m_alternativeHqPixmap : m_hqPixmap;
     }
 
     void set_hq_pixmap(const QPixmap& pixmap)
     {
-        if (m_displayAlternative) {
+        if (m_displayAlternative && m_alternativeImage) {
             m_alternativeHqPixmap = pixmap;
         } else {
             m_hqPixmap = pixmap;
@@ -405,6 +488,11 @@ private:
 
     shared_ptr<QImage> m_alternativeImage;
 
+    /**
+     * Where m_alternativeImage comes from, if it's built on demand.
+     */
+    shared_ptr<AlternativeImageSource> m_ptrAlternativeSource;
+
     /**
      * This timer is used for delaying the construction of
      * a high quality image version.
@@ -419,6 +507,13 @@ private:
 
     shared_ptr<QPixmap> m_alternativePixmap;
 
+    /**
+     * Draws the image straight from a texture when the viewport is backed
+     * by OpenGL, making the delayed high quality version unnecessary.
+     * Null if the viewport isn't.
+     */
+    std::unique_ptr<GpuImageRenderer> m_ptrGpuRenderer;
+
     /**
      * The high quality, pre-transformed version of m_pixmap.
      */
@@ -454,6 +549,8 @@ private:
      */
     IntrusivePtr<HqTransformTask> m_ptrHqTransformTask;
 
+    IntrusivePtr<TileTask> m_ptrTileTask;
+
     /**
      * Transformation from m_pixmap coordinates to m_image coordinates.
      */
@@ -546,6 +643,33 @@ private:
     QTimer m_cursorPosTimer;
 
     bool m_displayAlternative;
+
+    /**
+     * The image with its surroundings covered, as paintPageLayer() drew it.
+     * While nothing it depends on changes, repaints only copy it and draw
+     * the interaction handlers on top.  That's what keeps dragging things
+     * over big images smooth.  Not used with m_ptrGpuRenderer.
+     */
+    QPixmap m_pageLayer;
+
+    /**
+     * Invalid if m_pageLayer is not to be reused, as when it was drawn
+     * with a low quality version of the image.
+     */
+    PageLayerKey m_pageLayerKey;
+
+    /**
+     * What was on screen when beginLivePreview() was called,
+     * in device pixels.
+     */
+    QPixmap m_livePreviewPixmap;
+
+    /**
+     * Maps m_livePreviewPixmap's widget coordinates back to image ones.
+     */
+    QTransform m_livePreviewWidgetToImage;
+
+    bool m_livePreview;
 };
 
 #endif
@@ -0,0 +1,397 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "IntermediateCache.h"
+#include "AtomicFileOverwriter.h"
+#include "ImageId.h"
+#include "RelinkablePath.h"
+#include "Metrics.h"
+#include "imageproc/BinaryImage.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPolygonF>
+#include <QRect>
+#include <QRectF>
+#include <QTransform>
+#include <map>
+
+using namespace imageproc;
+
+class IntermediateCache::Impl
+{
+public:
+    void setCacheDir(QString const& dir);
+
+    QString cacheDir() const;
+
+    /**
+     * \brief Returns the hash of a file's contents, or an empty array
+     *        if the file can't be read.
+     *
+     * Hashes are remembered for as long as the file's size and
+     * modification time stay the same.
+     */
+    QByteArray fileHash(QString const& file_path);
+private:
+    struct FileHash
+    {
+        qint64 size;
+        QDateTime lastModified;
+        QByteArray hash;
+    };
+
+    mutable QMutex m_mutex;
+    QString m_cacheDir;
+    std::map<QString, FileHash> m_fileHashes;
+};
+
+void
+IntermediateCache::Impl::setCacheDir(QString const& dir)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    m_cacheDir = dir;
+    if (!dir.isEmpty()) {
+        // Fails if $OUT/cache doesn't exist, which is what we want.
+        QDir().mkdir(dir);
+        if (!QFileInfo(dir).isDir()) {
+            m_cacheDir.clear();
+        }
+    }
+}
+
+QString
+IntermediateCache::Impl::cacheDir() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_cacheDir;
+}
+
+QByteArray
+IntermediateCache::Impl::fileHash(QString const& file_path)
+{
+    QFileInfo const file_info(file_path);
+    qint64 const size = file_info.size();
+    QDateTime const last_modified(file_info.lastModified());
+
+    {
+        QMutexLocker const locker(&m_mutex);
+        std::map<QString, FileHash>::const_iterator const it(m_fileHashes.find(file_path));
+        if (it != m_fileHashes.end() && it->second.size == size
+                && it->second.lastModified == last_modified) {
+            return it->second.hash;
+        }
+    }
+
+    // Hashing may take a while for large files, so do it unlocked.
+    // Two threads hashing the same file at once is harmless.
+    QFile file(file_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!hash.addData(&file)) {
+        return QByteArray();
+    }
+
+    FileHash entry;
+    entry.size = size;
+    entry.lastModified = last_modified;
+    entry.hash = hash.result();
+
+    QMutexLocker const locker(&m_mutex);
+    m_fileHashes[file_path] = entry;
+
+    return entry.hash;
+}
+
+/*=========================== IntermediateCache ===========================*/
+
+IntermediateCache::Impl&
+IntermediateCache::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+void
+IntermediateCache::setCacheDir(QString const& dir)
+{
+    impl().setCacheDir(dir.isEmpty() ? dir : RelinkablePath::normalize(dir));
+}
+
+bool
+IntermediateCache::isEnabled()
+{
+    return !impl().cacheDir().isEmpty();
+}
+
+namespace
+{
+
+/**
+ * Counts a lookup of an enabled cache and passes its outcome through.
+ */
+bool countLookup(bool const hit)
+{
+    Metrics::add(hit ? Metrics::INTERMEDIATE_CACHE_HITS : Metrics::INTERMEDIATE_CACHE_MISSES);
+    return hit;
+}
+
+QString entryFilePath(QString const& dir, QString const& digest, size_t idx)
+{
+    return dir + QChar('/') + digest + QChar('_') + QString::number(idx) + QLatin1String(".png");
+}
+
+} // anonymous namespace
+
+bool
+IntermediateCache::load(
+    Key const& key, std::vector<BinaryImage>& images, size_t const count)
+{
+    if (!key.isValid()) {
+        return false;
+    }
+
+    QString const dir(impl().cacheDir());
+    if (dir.isEmpty()) {
+        return false;
+    }
+
+    QString const digest(key.digest());
+    std::vector<BinaryImage> loaded;
+    loaded.reserve(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        QFileInfo const file_info(entryFilePath(dir, digest, i));
+        if (!file_info.exists()) {
+            return countLookup(false);
+        }
+
+        if (file_info.size() == 0) {
+            // A null image.
+            loaded.push_back(BinaryImage());
+            continue;
+        }
+
+        QImage const image(file_info.filePath());
+        if (image.isNull()) {
+            return countLookup(false);
+        }
+        loaded.push_back(BinaryImage(image));
+    }
+
+    images.swap(loaded);
+    return countLookup(true);
+}
+
+void
+IntermediateCache::store(Key const& key, std::vector<BinaryImage> const& images)
+{
+    if (!key.isValid()) {
+        return;
+    }
+
+    QString const dir(impl().cacheDir());
+    if (dir.isEmpty()) {
+        return;
+    }
+
+    QString const digest(key.digest());
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        // Writing through a temporary file ensures other threads
+        // never see a partially written entry.
+        AtomicFileOverwriter overwriter;
+        QIODevice* const io_dev = overwriter.startWriting(entryFilePath(dir, digest, i));
+        if (!io_dev) {
+            return;
+        }
+
+        if (!images[i].isNull()) {
+            if (!images[i].toQImage().save(io_dev, "PNG")) {
+                return;
+            }
+        }
+
+        if (!overwriter.commit()) {
+            return;
+        }
+    }
+}
+
+bool
+IntermediateCache::load(Key const& key, QImage& image)
+{
+    if (!key.isValid()) {
+        return false;
+    }
+
+    QString const dir(impl().cacheDir());
+    if (dir.isEmpty()) {
+        return false;
+    }
+
+    QImage const loaded(entryFilePath(dir, key.digest(), 0));
+    if (loaded.isNull()) {
+        return countLookup(false);
+    }
+
+    image = loaded;
+    return countLookup(true);
+}
+
+void
+IntermediateCache::store(Key const& key, QImage const& image)
+{
+    if (!key.isValid() || image.isNull()) {
+        return;
+    }
+
+    QString const dir(impl().cacheDir());
+    if (dir.isEmpty()) {
+        return;
+    }
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* const io_dev = overwriter.startWriting(entryFilePath(dir, key.digest(), 0));
+    if (!io_dev) {
+        return;
+    }
+
+    // Such images tend to be large, so favour speed over compression ratio.
+    if (image.save(io_dev, "PNG", 80)) {
+        overwriter.commit();
+    }
+}
+
+/*======================== IntermediateCache::Key =========================*/
+
+IntermediateCache::Key::Key(ImageId const& image_id, char const* product)
+{
+    if (IntermediateCache::isEnabled()) {
+        init(image_id, product);
+    }
+}
+
+void
+IntermediateCache::Key::init(ImageId const& image_id, char const* product)
+{
+    QByteArray const file_hash(impl().fileHash(image_id.filePath()));
+    if (file_hash.isEmpty()) {
+        return;
+    }
+
+    m_data = file_hash;
+    add(image_id.page());
+    m_data.append(product);
+    m_data.append('\0');
+}
+
+void
+IntermediateCache::Key::append(void const* data, int const size)
+{
+    if (isValid()) {
+        m_data.append(static_cast<char const*>(data), size);
+    }
+}
+
+IntermediateCache::Key&
+IntermediateCache::Key::add(int const val)
+{
+    append(&val, sizeof(val));
+    return *this;
+}
+
+IntermediateCache::Key&
+IntermediateCache::Key::add(double const val)
+{
+    append(&val, sizeof(val));
+    return *this;
+}
+
+IntermediateCache::Key&
+IntermediateCache::Key::add(QRect const& rect)
+{
+    add(rect.x());
+    add(rect.y());
+    add(rect.width());
+    add(rect.height());
+    return *this;
+}
+
+IntermediateCache::Key&
+IntermediateCache::Key::add(QRectF const& rect)
+{
+    add(rect.x());
+    add(rect.y());
+    add(rect.width());
+    add(rect.height());
+    return *this;
+}
+
+IntermediateCache::Key&
+IntermediateCache::Key::add(QPolygonF const& poly)
+{
+    add(poly.size());
+    for (QPointF const& pt : poly) {
+        add(pt.x());
+        add(pt.y());
+    }
+    return *this;
+}
+
+IntermediateCache::Key&
+IntermediateCache::Key::add(QTransform const& xform)
+{
+    add(xform.m11());
+    add(xform.m12());
+    add(xform.m13());
+    add(xform.m21());
+    add(xform.m22());
+    add(xform.m23());
+    add(xform.m31());
+    add(xform.m32());
+    add(xform.m33());
+    return *this;
+}
+
+IntermediateCache::Key&
+IntermediateCache::Key::add(QByteArray const& data)
+{
+    add(data.size());
+    append(data.constData(), data.size());
+    return *this;
+}
+
+QString
+IntermediateCache::Key::digest() const
+{
+    QByteArray const hash(
+        QCryptographicHash::hash(m_data, QCryptographicHash::Sha1).toHex()
+    );
+    return QString::fromLatin1(hash.data(), hash.size());
+}
@@ -0,0 +1,151 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INTERMEDIATECACHE_H_
+#define INTERMEDIATECACHE_H_
+
+#include <QByteArray>
+#include <QString>
+#include <vector>
+
+class ImageId;
+class QImage;
+class QRect;
+class QRectF;
+class QPolygonF;
+class QTransform;
+
+namespace imageproc
+{
+class BinaryImage;
+}
+
+/**
+ * \brief A content-addressed disk cache of intermediate filter products.
+ *
+ * Entries are keyed by a hash of the source image file contents plus
+ * whatever parameters the product was derived from, so a cached entry
+ * can't go stale: if anything upstream changes, the key changes too.
+ * Entries live in $OUT/cache/intermediate and are shared by all threads.
+ */
+class IntermediateCache
+{
+public:
+    class Key
+    {
+        // Member-wise copying is OK.
+    public:
+        /**
+         * \brief Constructs an invalid key that never hits the cache.
+         */
+        Key() {}
+
+        /**
+         * \brief Starts a key for a product derived from the given image.
+         *
+         * \param image_id The source image.  Its file contents are hashed.
+         * \param product A short name identifying the kind of product.
+         *
+         * If the cache is disabled or the image file can't be read,
+         * the key is invalid and using it is a no-op.
+         */
+        Key(ImageId const& image_id, char const* product);
+
+        bool isValid() const
+        {
+            return !m_data.isEmpty();
+        }
+
+        Key& add(int val);
+
+        Key& add(double val);
+
+        Key& add(QRect const& rect);
+
+        Key& add(QRectF const& rect);
+
+        Key& add(QPolygonF const& poly);
+
+        Key& add(QTransform const& xform);
+
+        Key& add(QByteArray const& data);
+
+        /**
+         * \brief The hex digest of everything added so far.
+         */
+        QString digest() const;
+    private:
+        friend class OutputCache;
+
+        /**
+         * \brief Makes the key valid, regardless of whether the cache is enabled.
+         */
+        void init(ImageId const& image_id, char const* product);
+
+        void append(void const* data, int size);
+
+        QByteArray m_data;
+    };
+
+    /**
+     * \brief Sets the directory to keep cache entries in.
+     *
+     * Passing an empty string disables the cache.  The directory itself
+     * is created only if its parent exists, like the thumbnail directory.
+     */
+    static void setCacheDir(QString const& dir);
+
+    static bool isEnabled();
+
+    /**
+     * \brief Loads a previously stored entry.
+     *
+     * \param key The key the entry was stored under.
+     * \param images Receives the images, in the order they were stored.
+     * \param count The number of images the entry must have.
+     * \return true on a cache hit.
+     */
+    static bool load(Key const& key,
+                     std::vector<imageproc::BinaryImage>& images, size_t count);
+
+    /**
+     * \brief Stores an entry.  Failures are silently ignored.
+     *
+     * Null images are allowed and are restored as null images.
+     */
+    static void store(Key const& key,
+                      std::vector<imageproc::BinaryImage> const& images);
+
+    /**
+     * \brief Loads a previously stored colour or grayscale image.
+     *
+     * \return true on a cache hit.
+     */
+    static bool load(Key const& key, QImage& image);
+
+    /**
+     * \brief Stores a colour or grayscale image.  Failures are silently ignored.
+     */
+    static void store(Key const& key, QImage const& image);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
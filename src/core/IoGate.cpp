@@ -0,0 +1,240 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "IoGate.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QThreadStorage>
+#include <deque>
+
+namespace
+{
+
+struct CurrentPriority
+{
+    IoGate::Priority priority;
+
+    CurrentPriority() : priority(IoGate::INTERACTIVE) {}
+};
+
+QThreadStorage<CurrentPriority>& currentPriorityStorage()
+{
+    static QThreadStorage<CurrentPriority> storage;
+    return storage;
+}
+
+} // anonymous namespace
+
+class IoGate::Impl
+{
+public:
+    Impl();
+
+    void setLimit(int max_readers);
+
+    int limit() const;
+
+    void setClassLimit(Priority priority, int max_readers);
+
+    int classLimit(Priority priority) const;
+
+    void acquire(Priority priority);
+
+    void release(Priority priority);
+private:
+    bool classFull(int priority) const;
+
+    bool mayEnter(int priority, quint64 ticket) const;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_released;
+    int m_limit;
+    int m_active;
+    int m_classLimits[NUM_PRIORITIES];
+    int m_classActive[NUM_PRIORITIES];
+    std::deque<quint64> m_waiting[NUM_PRIORITIES]; /**< Tickets, oldest first. */
+    quint64 m_nextTicket;
+};
+
+IoGate::Impl::Impl()
+    :   m_limit(0),
+        m_active(0),
+        m_nextTicket(0)
+{
+    for (int i = 0; i < NUM_PRIORITIES; ++i) {
+        m_classLimits[i] = 0;
+        m_classActive[i] = 0;
+    }
+}
+
+void
+IoGate::Impl::setLimit(int const max_readers)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_limit = max_readers;
+    // A higher limit may let someone in.
+    m_released.wakeAll();
+}
+
+int
+IoGate::Impl::limit() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_limit;
+}
+
+void
+IoGate::Impl::setClassLimit(Priority const priority, int const max_readers)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_classLimits[priority] = max_readers;
+    m_released.wakeAll();
+}
+
+int
+IoGate::Impl::classLimit(Priority const priority) const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_classLimits[priority];
+}
+
+void
+IoGate::Impl::acquire(Priority const priority)
+{
+    QMutexLocker const locker(&m_mutex);
+    quint64 const ticket = m_nextTicket++;
+    std::deque<quint64>& waiting = m_waiting[priority];
+    waiting.push_back(ticket);
+    while (!mayEnter(priority, ticket)) {
+        m_released.wait(&m_mutex);
+    }
+    waiting.pop_front();
+    ++m_active;
+    ++m_classActive[priority];
+    // The next one in line may be let in as well.
+    m_released.wakeAll();
+}
+
+void
+IoGate::Impl::release(Priority const priority)
+{
+    QMutexLocker const locker(&m_mutex);
+    --m_active;
+    --m_classActive[priority];
+    // Waiters decide among themselves who's next.
+    m_released.wakeAll();
+}
+
+bool
+IoGate::Impl::classFull(int const priority) const
+{
+    int const limit = m_classLimits[priority];
+    return limit > 0 && m_classActive[priority] >= limit;
+}
+
+bool
+IoGate::Impl::mayEnter(int const priority, quint64 const ticket) const
+{
+    if (m_waiting[priority].front() != ticket || classFull(priority)) {
+        return false;
+    }
+    if (m_limit > 0 && m_active >= m_limit) {
+        return false;
+    }
+    // Higher classes go first, unless they are at their own limit.
+    for (int i = 0; i < priority; ++i) {
+        if (!m_waiting[i].empty() && !classFull(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+IoGate::Impl&
+IoGate::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+IoGate::Slot::Slot()
+    :   m_priority(IoGate::currentPriority())
+{
+    IoGate::acquire(m_priority);
+}
+
+IoGate::Slot::~Slot()
+{
+    IoGate::release(m_priority);
+}
+
+IoGate::PriorityScope::PriorityScope(Priority const priority)
+    :   m_prevPriority(IoGate::currentPriority())
+{
+    currentPriorityStorage().localData().priority = priority;
+}
+
+IoGate::PriorityScope::~PriorityScope()
+{
+    currentPriorityStorage().localData().priority = m_prevPriority;
+}
+
+void
+IoGate::setLimit(int const max_readers)
+{
+    impl().setLimit(max_readers);
+}
+
+int
+IoGate::limit()
+{
+    return impl().limit();
+}
+
+void
+IoGate::setClassLimit(Priority const priority, int const max_readers)
+{
+    impl().setClassLimit(priority, max_readers);
+}
+
+int
+IoGate::classLimit(Priority const priority)
+{
+    return impl().classLimit(priority);
+}
+
+IoGate::Priority
+IoGate::currentPriority()
+{
+    QThreadStorage<CurrentPriority>& storage = currentPriorityStorage();
+    return storage.hasLocalData() ? storage.localData().priority : INTERACTIVE;
+}
+
+void
+IoGate::acquire(Priority const priority)
+{
+    impl().acquire(priority);
+}
+
+void
+IoGate::release(Priority const priority)
+{
+    impl().release(priority);
+}
@@ -0,0 +1,127 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IOGATE_H_
+#define IOGATE_H_
+
+#include "NonCopyable.h"
+
+/**
+ * \brief A process-wide limit on the number of image files read at once.
+ *
+ * Workers reading pages in parallel make a spinning disk or a network
+ * share spend its time seeking.  ImageLoader holds a Slot while it reads
+ * and decodes a file, so with a limit set, the rest of the workers keep
+ * computing instead of queueing up on the disk.
+ *
+ * Every read belongs to a priority class, which is that of the
+ * PriorityScope the reading thread is in.  When a slot becomes free,
+ * it goes to the highest class with a reader waiting, so the page the
+ * user is looking at isn't read after the thumbnails and the pages
+ * decoded ahead for a batch.  Within a class, readers are let in in the
+ * order they came.  Each class may also have a limit of its own, which
+ * keeps speculative reads from taking all of the slots.
+ *
+ * The gate and all of the classes are unlimited by default.
+ */
+class IoGate
+{
+public:
+    /**
+     * Priority classes, highest first.
+     */
+    enum Priority {
+        /** The page the user is working with.  The default. */
+        INTERACTIVE,
+        /** Thumbnails that are on screen. */
+        THUMBNAIL,
+        /** Pages being processed in a batch. */
+        BATCH,
+        /** Pages decoded ahead of a batch. */
+        READ_AHEAD,
+        /** Thumbnails that aren't on screen yet. */
+        BACKGROUND
+    };
+
+    enum { NUM_PRIORITIES = BACKGROUND + 1 };
+
+    /**
+     * \brief Holds a slot for the lifetime of the object.
+     *
+     * Blocks until one is free.
+     */
+    class Slot
+    {
+        DECLARE_NON_COPYABLE(Slot)
+    public:
+        Slot();
+
+        ~Slot();
+    private:
+        Priority m_priority;
+    };
+
+    /**
+     * \brief Puts the reads of the current thread into a priority class
+     *        for the lifetime of the object.
+     *
+     * Scopes may be nested.  The innermost one wins.
+     */
+    class PriorityScope
+    {
+        DECLARE_NON_COPYABLE(PriorityScope)
+    public:
+        explicit PriorityScope(Priority priority);
+
+        ~PriorityScope();
+    private:
+        Priority m_prevPriority;
+    };
+
+    /**
+     * \brief Sets the number of files that may be read at once.
+     *        Zero means unlimited.
+     */
+    static void setLimit(int max_readers);
+
+    static int limit();
+
+    /**
+     * \brief Sets the number of files of a priority class that may be
+     *        read at once.  Zero means unlimited.
+     */
+    static void setClassLimit(Priority priority, int max_readers);
+
+    static int classLimit(Priority priority);
+
+    /**
+     * \brief The priority class of the current thread's reads.
+     */
+    static Priority currentPriority();
+
+    static void acquire(Priority priority = currentPriority());
+
+    static void release(Priority priority = currentPriority());
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
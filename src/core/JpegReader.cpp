@@ -0,0 +1,514 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2009  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "JpegReader.h"
+#include "ImageMetadata.h"
+#include "NonCopyable.h"
+#include "Dpi.h"
+#include "Dpm.h"
+#include "imageproc/Grayscale.h"
+#include <QIODevice>
+#include <QBuffer>
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QSysInfo>
+#include <QDebug>
+#include <QtEndian>
+#include <vector>
+#include <new>
+#include <setjmp.h>
+#include <string.h>
+#include <assert.h>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace
+{
+
+/*======================== JpegDecompressionHandle =======================*/
+
+class JpegDecompressHandle
+{
+    DECLARE_NON_COPYABLE(JpegDecompressHandle)
+public:
+    JpegDecompressHandle(jpeg_error_mgr* err_mgr, jpeg_source_mgr* src_mgr);
+
+    ~JpegDecompressHandle();
+
+    jpeg_decompress_struct* ptr()
+    {
+        return &m_info;
+    }
+
+    jpeg_decompress_struct* operator->()
+    {
+        return &m_info;
+    }
+private:
+    jpeg_decompress_struct m_info;
+};
+
+JpegDecompressHandle::JpegDecompressHandle(
+    jpeg_error_mgr* err_mgr, jpeg_source_mgr* src_mgr)
+{
+    m_info.err = err_mgr;
+    jpeg_create_decompress(&m_info);
+    m_info.src = src_mgr;
+}
+
+JpegDecompressHandle::~JpegDecompressHandle()
+{
+    jpeg_destroy_decompress(&m_info);
+}
+
+/*============================ JpegSourceManager =========================*/
+
+class JpegSourceManager : public jpeg_source_mgr
+{
+    DECLARE_NON_COPYABLE(JpegSourceManager)
+public:
+    JpegSourceManager(QIODevice& io_device);
+private:
+    static void initSource(j_decompress_ptr cinfo);
+
+    static boolean fillInputBuffer(j_decompress_ptr cinfo);
+
+    boolean fillInputBufferImpl();
+
+    static void skipInputData(j_decompress_ptr cinfo, long num_bytes);
+
+    void skipInputDataImpl(long num_bytes);
+
+    static void termSource(j_decompress_ptr cinfo);
+
+    static JpegSourceManager* object(j_decompress_ptr cinfo);
+
+    QIODevice& m_rDevice;
+    JOCTET m_buf[4096];
+};
+
+JpegSourceManager::JpegSourceManager(QIODevice& io_device)
+    :   m_rDevice(io_device)
+{
+    init_source = &JpegSourceManager::initSource;
+    fill_input_buffer = &JpegSourceManager::fillInputBuffer;
+    skip_input_data = &JpegSourceManager::skipInputData;
+    resync_to_restart = &jpeg_resync_to_restart;
+    term_source = &JpegSourceManager::termSource;
+    bytes_in_buffer = 0;
+    next_input_byte = m_buf;
+}
+
+void
+JpegSourceManager::initSource(j_decompress_ptr cinfo)
+{
+    // No-op.
+}
+
+boolean
+JpegSourceManager::fillInputBuffer(j_decompress_ptr cinfo)
+{
+    return object(cinfo)->fillInputBufferImpl();
+}
+
+boolean
+JpegSourceManager::fillInputBufferImpl()
+{
+    qint64 const bytes_read = m_rDevice.read((char*)m_buf, sizeof(m_buf));
+    if (bytes_read > 0) {
+        bytes_in_buffer = bytes_read;
+    } else {
+        // Insert a fake EOI marker.
+        m_buf[0] = 0xFF;
+        m_buf[1] = JPEG_EOI;
+        bytes_in_buffer = 2;
+    }
+    next_input_byte = m_buf;
+    return 1;
+}
+
+void
+JpegSourceManager::skipInputData(j_decompress_ptr cinfo, long num_bytes)
+{
+    object(cinfo)->skipInputDataImpl(num_bytes);
+}
+
+void
+JpegSourceManager::skipInputDataImpl(long num_bytes)
+{
+    if (num_bytes <= 0) {
+        return;
+    }
+
+    while (num_bytes > (long)bytes_in_buffer) {
+        num_bytes -= (long)bytes_in_buffer;
+        fillInputBufferImpl();
+    }
+    next_input_byte += num_bytes;
+    bytes_in_buffer -= num_bytes;
+}
+
+void
+JpegSourceManager::termSource(j_decompress_ptr cinfo)
+{
+    // No-op.
+}
+
+JpegSourceManager*
+JpegSourceManager::object(j_decompress_ptr cinfo)
+{
+    return static_cast<JpegSourceManager*>(cinfo->src);
+}
+
+/*============================= JpegErrorManager ===========================*/
+
+class JpegErrorManager : public jpeg_error_mgr
+{
+    DECLARE_NON_COPYABLE(JpegErrorManager)
+public:
+    JpegErrorManager();
+
+    jmp_buf& jmpBuf()
+    {
+        return m_jmpBuf;
+    }
+private:
+    static void errorExit(j_common_ptr cinfo);
+
+    static JpegErrorManager* object(j_common_ptr cinfo);
+
+    jmp_buf m_jmpBuf;
+};
+
+JpegErrorManager::JpegErrorManager()
+{
+    jpeg_std_error(this);
+    error_exit = &JpegErrorManager::errorExit;
+}
+
+void
+JpegErrorManager::errorExit(j_common_ptr cinfo)
+{
+    longjmp(object(cinfo)->jmpBuf(), 1);
+}
+
+JpegErrorManager*
+JpegErrorManager::object(j_common_ptr cinfo)
+{
+    return static_cast<JpegErrorManager*>(cinfo->err);
+}
+
+} // anonymous namespace
+
+static Dpi readDpi(jpeg_decompress_struct const& cinfo)
+{
+    if (cinfo.density_unit == 1) {
+        // Dots per inch.
+        return Dpi(cinfo.X_density, cinfo.Y_density);
+    } else if (cinfo.density_unit == 2) {
+        // Dots per centimeter.
+        return Dpm(cinfo.X_density * 100, cinfo.Y_density * 100);
+    }
+    return Dpi();
+}
+
+/**
+ * Decodes the scanlines of a started decompression into \p image.
+ * Kept apart from JpegReader::readImage(), so that a longjmp() out
+ * of libjpeg doesn't skip destructors of any C++ objects.
+ */
+static bool decodeScanlines(
+    jpeg_decompress_struct* cinfo, JpegErrorManager& err_mgr, QImage& image)
+{
+    if (setjmp(err_mgr.jmpBuf())) {
+        // Returning from longjmp().
+        return false;
+    }
+
+    int const width = cinfo->output_width;
+    int const height = cinfo->output_height;
+
+    if (cinfo->out_color_space == JCS_GRAYSCALE || cinfo->output_components == 4) {
+        // Either grayscale or an extended color space matching Format_RGB32.
+        while ((int)cinfo->output_scanline < height) {
+            JSAMPROW row = image.scanLine(cinfo->output_scanline);
+            jpeg_read_scanlines(cinfo, &row, 1);
+        }
+    } else {
+        assert(cinfo->out_color_space == JCS_RGB);
+        std::vector<JSAMPLE> buf(width * 3);
+        JSAMPROW row = &buf[0];
+        while ((int)cinfo->output_scanline < height) {
+            QRgb* dst = (QRgb*)image.scanLine(cinfo->output_scanline);
+            jpeg_read_scanlines(cinfo, &row, 1);
+            JSAMPLE const* src = row;
+            for (int x = 0; x < width; ++x, src += 3) {
+                dst[x] = qRgb(src[0], src[1], src[2]);
+            }
+        }
+    }
+
+    jpeg_finish_decompress(cinfo);
+    return true;
+}
+
+/**
+ * Locates the JPEG thumbnail in IFD1 of the TIFF structure that makes up
+ * the EXIF data and decodes it.  Thumbnails in other formats are ignored.
+ */
+static QImage decodeExifThumbnail(QByteArray const& tiff)
+{
+    uchar const* const data = (uchar const*)tiff.constData();
+    qint64 const size = tiff.size();
+    if (size < 8) {
+        return QImage();
+    }
+
+    bool big_endian = false;
+    if (data[0] == 'M' && data[1] == 'M') {
+        big_endian = true;
+    } else if (data[0] != 'I' || data[1] != 'I') {
+        return QImage();
+    }
+    auto const get16 = [big_endian](uchar const* p) -> quint16 {
+        return big_endian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+    };
+    auto const get32 = [big_endian](uchar const* p) -> quint32 {
+        return big_endian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+    };
+
+    // Skip IFD0, which describes the main image.
+    qint64 const ifd0 = get32(data + 4);
+    if (ifd0 + 2 > size) {
+        return QImage();
+    }
+    qint64 const ifd0_end = ifd0 + 2 + qint64(get16(data + ifd0)) * 12;
+    if (ifd0_end + 4 > size) {
+        return QImage();
+    }
+
+    qint64 const ifd1 = get32(data + ifd0_end);
+    if (ifd1 == 0 || ifd1 + 2 > size) {
+        return QImage();
+    }
+    int const num_entries = get16(data + ifd1);
+    if (ifd1 + 2 + qint64(num_entries) * 12 > size) {
+        return QImage();
+    }
+
+    qint64 offset = 0;
+    qint64 length = 0;
+    for (int i = 0; i < num_entries; ++i) {
+        uchar const* const entry = data + ifd1 + 2 + i * 12;
+        switch (get16(entry)) {
+        case 0x0201: // JPEGInterchangeFormat
+            offset = get32(entry + 8);
+            break;
+        case 0x0202: // JPEGInterchangeFormatLength
+            length = get32(entry + 8);
+            break;
+        }
+    }
+    if (offset == 0 || length == 0 || offset + length > size) {
+        return QImage();
+    }
+
+    QByteArray thumbnail(QByteArray::fromRawData(tiff.constData() + offset, length));
+    QBuffer buffer(&thumbnail);
+    buffer.open(QIODevice::ReadOnly);
+    return JpegReader::readImage(buffer);
+}
+
+/**
+ * Starts a decompression.  See decodeScanlines() on why it's separate.
+ */
+static bool startDecompress(
+    jpeg_decompress_struct* cinfo, JpegErrorManager& err_mgr, int const reduction)
+{
+    if (setjmp(err_mgr.jmpBuf())) {
+        // Returning from longjmp().
+        return false;
+    }
+
+    if (jpeg_read_header(cinfo, 1) != JPEG_HEADER_OK) {
+        return false;
+    }
+
+    switch (cinfo->jpeg_color_space) {
+    case JCS_GRAYSCALE:
+        cinfo->out_color_space = JCS_GRAYSCALE;
+        break;
+    case JCS_RGB:
+    case JCS_YCbCr:
+#ifdef JCS_EXTENSIONS
+        // libjpeg-turbo can write pixels in the layout of Format_RGB32,
+        // padding them with 0xff.
+        cinfo->out_color_space
+            = QSysInfo::ByteOrder == QSysInfo::LittleEndian ? JCS_EXT_BGRX : JCS_EXT_XRGB;
+#else
+        cinfo->out_color_space = JCS_RGB;
+#endif
+        break;
+    default:
+        // CMYK and YCCK are left to Qt.
+        return false;
+    }
+
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = 1;
+    while (cinfo->scale_denom < 8 && (int)cinfo->scale_denom * 2 <= reduction) {
+        cinfo->scale_denom *= 2;
+    }
+    cinfo->dct_method = JDCT_ISLOW;
+
+    return jpeg_start_decompress(cinfo) != 0;
+}
+
+bool
+JpegReader::canRead(QIODevice& device)
+{
+    if (!device.isReadable()) {
+        return false;
+    }
+
+    static unsigned char const jpeg_signature[] = { 0xff, 0xd8, 0xff };
+    static int const sig_size = sizeof(jpeg_signature);
+
+    unsigned char signature[sig_size];
+    if (device.peek((char*)signature, sig_size) != sig_size) {
+        return false;
+    }
+    return memcmp(jpeg_signature, signature, sig_size) == 0;
+}
+
+ImageMetadataLoader::Status
+JpegReader::readMetadata(
+    QIODevice& io_device,
+    VirtualFunction1<void, ImageMetadata const&>& out)
+{
+    if (!io_device.isReadable()) {
+        return ImageMetadataLoader::GENERIC_ERROR;
+    }
+    if (!canRead(io_device)) {
+        return ImageMetadataLoader::FORMAT_NOT_RECOGNIZED;
+    }
+
+    JpegErrorManager err_mgr;
+    if (setjmp(err_mgr.jmpBuf())) {
+        // Returning from longjmp().
+        return ImageMetadataLoader::GENERIC_ERROR;
+    }
+
+    JpegSourceManager src_mgr(io_device);
+    JpegDecompressHandle cinfo(&err_mgr, &src_mgr);
+
+    int const header_status = jpeg_read_header(cinfo.ptr(), 0);
+    if (header_status == JPEG_HEADER_TABLES_ONLY) {
+        return ImageMetadataLoader::NO_IMAGES;
+    }
+
+    // The other possible value is JPEG_SUSPENDED, but we never suspend it.
+    assert(header_status == JPEG_HEADER_OK);
+
+    if (!jpeg_start_decompress(cinfo.ptr())) {
+        // libjpeg doesn't support all compression types.
+        return ImageMetadataLoader::GENERIC_ERROR;
+    }
+
+    QSize const size(cinfo->image_width, cinfo->image_height);
+    out(ImageMetadata(size, readDpi(*cinfo.ptr())));
+    return ImageMetadataLoader::LOADED;
+}
+
+QImage
+JpegReader::readImage(QIODevice& device, int const reduction)
+{
+    if (!canRead(device)) {
+        return QImage();
+    }
+
+    JpegErrorManager err_mgr;
+    JpegSourceManager src_mgr(device);
+    JpegDecompressHandle cinfo(&err_mgr, &src_mgr);
+
+    if (!startDecompress(cinfo.ptr(), err_mgr, reduction)) {
+        return QImage();
+    }
+
+    QSize const size(cinfo->output_width, cinfo->output_height);
+    QImage image;
+    if (cinfo->out_color_space == JCS_GRAYSCALE) {
+        image = QImage(size, QImage::Format_Indexed8);
+        image.setColorTable(imageproc::createGrayscalePalette());
+    } else {
+        image = QImage(size, QImage::Format_RGB32);
+    }
+    if (image.isNull()) {
+        throw std::bad_alloc();
+    }
+
+    if (!decodeScanlines(cinfo.ptr(), err_mgr, image)) {
+        return QImage();
+    }
+
+    Dpi const dpi(readDpi(*cinfo.ptr()));
+    if (!dpi.isNull()) {
+        Dpm const dpm(dpi);
+        int const scale = cinfo->scale_denom;
+        image.setDotsPerMeterX(dpm.horizontal() / scale);
+        image.setDotsPerMeterY(dpm.vertical() / scale);
+    }
+
+    return image;
+}
+
+QImage
+JpegReader::readExifThumbnail(QIODevice& device)
+{
+    uchar marker[4];
+    if (device.read((char*)marker, 2) != 2 || marker[0] != 0xff || marker[1] != 0xd8) {
+        return QImage();
+    }
+
+    for (;;) {
+        if (device.read((char*)marker, 4) != 4 || marker[0] != 0xff) {
+            return QImage();
+        }
+        int const type = marker[1];
+        int const length = (int(marker[2]) << 8) | marker[3];
+        if (type == 0xda || length < 2) {
+            // We've reached the image data.
+            return QImage();
+        }
+
+        if (type == 0xe1) { // APP1
+            QByteArray const segment(device.read(length - 2));
+            if (segment.size() != length - 2) {
+                return QImage();
+            }
+            if (segment.startsWith(QByteArray("Exif\0\0", 6))) {
+                return decodeExifThumbnail(segment.mid(6));
+            }
+        } else if (!device.seek(device.pos() + length - 2)) {
+            return QImage();
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2009  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JPEGREADER_H_
+#define JPEGREADER_H_
+
+#include "ImageMetadataLoader.h"
+#include "VirtualFunction.h"
+
+class QIODevice;
+class QImage;
+class ImageMetadata;
+
+/**
+ * \brief Decodes JPEG images with libjpeg directly.
+ *
+ * Compared to going through Qt's JPEG plugin, this gets us whatever
+ * SIMD decoding the system libjpeg (normally libjpeg-turbo) has to offer,
+ * decodes straight into the pixel layout of QImage where libjpeg-turbo's
+ * extended color spaces are available, and produces grayscale images
+ * as Format_Indexed8 with a grayscale palette, the way the rest of
+ * the code prefers them.
+ */
+class JpegReader
+{
+public:
+    /**
+     * \brief Checks for the JPEG signature without consuming any data.
+     */
+    static bool canRead(QIODevice& device);
+
+    static ImageMetadataLoader::Status readMetadata(
+        QIODevice& device,
+        VirtualFunction1<void, ImageMetadata const&>& out);
+
+    /**
+     * \brief Reads the image, optionally reduced in the DCT domain.
+     *
+     * \param device The device to read from, positioned at the start
+     *        of the image.
+     * \param reduction The image is decoded at 1/2, 1/4 or 1/8 scale,
+     *        taking the largest of these not exceeding \p reduction.
+     *        The DPI is adjusted accordingly.  Decoding at a reduced
+     *        scale costs a fraction of a full decode.
+     * \return A Format_Indexed8 grayscale or a Format_RGB32 image,
+     *         or a null image if the image couldn't be decoded.
+     *         CMYK images are not supported.
+     */
+    static QImage readImage(QIODevice& device, int reduction = 1);
+
+    /**
+     * \brief Reads the thumbnail embedded into the EXIF data, if any.
+     *
+     * Only the segments preceding the image data are looked at,
+     * so this is cheap compared to decoding the image.
+     *
+     * \param device The device to read from, positioned at the start
+     *        of the image.  It must be seekable.
+     * \return The thumbnail, or a null image if there is none.
+     */
+    static QImage readExifThumbnail(QIODevice& device);
+};
+
+#endif
@@ -0,0 +1,268 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "JpegWriter.h"
+#include "NonCopyable.h"
+#include "Dpm.h"
+#include "imageproc/Constants.h"
+#include <QIODevice>
+#include <QImage>
+#include <vector>
+#include <stdint.h>
+#include <setjmp.h>
+#include <math.h>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace
+{
+
+/*========================= JpegCompressHandle ===========================*/
+
+class JpegCompressHandle
+{
+    DECLARE_NON_COPYABLE(JpegCompressHandle)
+public:
+    JpegCompressHandle(jpeg_error_mgr* err_mgr, jpeg_destination_mgr* dst_mgr);
+
+    ~JpegCompressHandle();
+
+    jpeg_compress_struct* ptr()
+    {
+        return &m_info;
+    }
+
+    jpeg_compress_struct* operator->()
+    {
+        return &m_info;
+    }
+private:
+    jpeg_compress_struct m_info;
+};
+
+JpegCompressHandle::JpegCompressHandle(
+    jpeg_error_mgr* err_mgr, jpeg_destination_mgr* dst_mgr)
+{
+    m_info.err = err_mgr;
+    jpeg_create_compress(&m_info);
+    m_info.dest = dst_mgr;
+}
+
+JpegCompressHandle::~JpegCompressHandle()
+{
+    jpeg_destroy_compress(&m_info);
+}
+
+/*======================== JpegDestinationManager =========================*/
+
+class JpegDestinationManager : public jpeg_destination_mgr
+{
+    DECLARE_NON_COPYABLE(JpegDestinationManager)
+public:
+    JpegDestinationManager(QIODevice& io_device);
+
+    bool failed() const
+    {
+        return m_failed;
+    }
+private:
+    enum { BUF_SIZE = 4096 };
+
+    static void initDestination(j_compress_ptr cinfo);
+
+    static boolean emptyOutputBuffer(j_compress_ptr cinfo);
+
+    static void termDestination(j_compress_ptr cinfo);
+
+    static JpegDestinationManager* object(j_compress_ptr cinfo);
+
+    void flush(size_t size);
+
+    QIODevice& m_rDevice;
+    JOCTET m_buf[BUF_SIZE];
+    bool m_failed;
+};
+
+JpegDestinationManager::JpegDestinationManager(QIODevice& io_device)
+    :   m_rDevice(io_device),
+        m_failed(false)
+{
+    init_destination = &JpegDestinationManager::initDestination;
+    empty_output_buffer = &JpegDestinationManager::emptyOutputBuffer;
+    term_destination = &JpegDestinationManager::termDestination;
+    next_output_byte = m_buf;
+    free_in_buffer = BUF_SIZE;
+}
+
+void
+JpegDestinationManager::initDestination(j_compress_ptr cinfo)
+{
+    JpegDestinationManager* const self = object(cinfo);
+    self->next_output_byte = self->m_buf;
+    self->free_in_buffer = BUF_SIZE;
+}
+
+boolean
+JpegDestinationManager::emptyOutputBuffer(j_compress_ptr cinfo)
+{
+    // libjpeg expects the whole buffer to be flushed here,
+    // regardless of free_in_buffer.
+    JpegDestinationManager* const self = object(cinfo);
+    self->flush(BUF_SIZE);
+    self->next_output_byte = self->m_buf;
+    self->free_in_buffer = BUF_SIZE;
+    return TRUE;
+}
+
+void
+JpegDestinationManager::termDestination(j_compress_ptr cinfo)
+{
+    JpegDestinationManager* const self = object(cinfo);
+    self->flush(BUF_SIZE - self->free_in_buffer);
+}
+
+JpegDestinationManager*
+JpegDestinationManager::object(j_compress_ptr cinfo)
+{
+    return static_cast<JpegDestinationManager*>(cinfo->dest);
+}
+
+void
+JpegDestinationManager::flush(size_t const size)
+{
+    if (size > 0 && m_rDevice.write((char const*)m_buf, size) != (qint64)size) {
+        m_failed = true;
+    }
+}
+
+/*============================= JpegErrorManager ===========================*/
+
+class JpegErrorManager : public jpeg_error_mgr
+{
+    DECLARE_NON_COPYABLE(JpegErrorManager)
+public:
+    JpegErrorManager();
+
+    jmp_buf& jmpBuf()
+    {
+        return m_jmpBuf;
+    }
+private:
+    static void errorExit(j_common_ptr cinfo);
+
+    jmp_buf m_jmpBuf;
+};
+
+JpegErrorManager::JpegErrorManager()
+{
+    jpeg_std_error(this);
+    error_exit = &JpegErrorManager::errorExit;
+}
+
+void
+JpegErrorManager::errorExit(j_common_ptr cinfo)
+{
+    longjmp(static_cast<JpegErrorManager*>(cinfo->err)->jmpBuf(), 1);
+}
+
+} // anonymous namespace
+
+bool
+JpegWriter::writesGrayscale(QImage const& image)
+{
+    return image.format() == QImage::Format_Indexed8 && image.isGrayscale();
+}
+
+bool
+JpegWriter::writeImage(QIODevice& device, QImage const& image, int const quality)
+{
+    if (image.isNull() || !device.isWritable()) {
+        return false;
+    }
+
+    bool const grayscale = writesGrayscale(image);
+    QImage const src(
+        grayscale ? image : image.convertToFormat(QImage::Format_RGB32)
+    );
+    int const width = src.width();
+    int const height = src.height();
+
+    // The palette of a grayscale image isn't necessarily the identity one.
+    unsigned char gray_levels[256];
+    if (grayscale) {
+        for (int i = 0; i < 256; ++i) {
+            gray_levels[i] = i < src.colorCount() ? qGray(src.color(i)) : 0;
+        }
+    }
+
+    // Declared before setjmp(), as nothing but plain data and objects
+    // that don't care about being skipped over should be constructed
+    // between setjmp() and longjmp().
+    std::vector<JSAMPLE> line(width * (grayscale ? 1 : 3));
+    JpegErrorManager err_mgr;
+    JpegDestinationManager dst_mgr(device);
+    JpegCompressHandle cinfo(&err_mgr, &dst_mgr);
+
+    if (setjmp(err_mgr.jmpBuf())) {
+        // Returning from longjmp().
+        return false;
+    }
+
+    cinfo->image_width = width;
+    cinfo->image_height = height;
+    cinfo->input_components = grayscale ? 1 : 3;
+    cinfo->in_color_space = grayscale ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(cinfo.ptr());
+    jpeg_set_quality(cinfo.ptr(), quality, TRUE);
+
+    Dpm const dpm(src);
+    if (!dpm.isNull()) {
+        cinfo->density_unit = 1; // Dots per inch.
+        cinfo->X_density = (UINT16)floor(dpm.horizontal() * imageproc::constants::DPM2DPI + 0.5);
+        cinfo->Y_density = (UINT16)floor(dpm.vertical() * imageproc::constants::DPM2DPI + 0.5);
+    }
+
+    jpeg_start_compress(cinfo.ptr(), TRUE);
+
+    JSAMPROW row = &line[0];
+    for (int y = 0; y < height; ++y) {
+        uint8_t const* src_line = src.scanLine(y);
+        if (grayscale) {
+            for (int x = 0; x < width; ++x) {
+                line[x] = gray_levels[src_line[x]];
+            }
+        } else {
+            uint32_t const* src_pixels = reinterpret_cast<uint32_t const*>(src_line);
+            JSAMPLE* dst = &line[0];
+            for (int x = 0; x < width; ++x) {
+                uint32_t const rgb = src_pixels[x];
+                dst[0] = static_cast<JSAMPLE>(rgb >> 16);
+                dst[1] = static_cast<JSAMPLE>(rgb >> 8);
+                dst[2] = static_cast<JSAMPLE>(rgb);
+                dst += 3;
+            }
+        }
+        jpeg_write_scanlines(cinfo.ptr(), &row, 1);
+    }
+
+    jpeg_finish_compress(cinfo.ptr());
+
+    return !dst_mgr.failed();
+}
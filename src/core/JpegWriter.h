@@ -0,0 +1,52 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JPEGWRITER_H_
+#define JPEGWRITER_H_
+
+class QIODevice;
+class QImage;
+
+/**
+ * \brief Encodes JPEG images with libjpeg directly.
+ *
+ * The counterpart of JpegReader.  Grayscale images are written with
+ * a single component, everything else as RGB.
+ */
+class JpegWriter
+{
+public:
+    /**
+     * \brief Whether writeImage() would write \p image as grayscale.
+     *
+     * That's the case for Format_Indexed8 images with a grayscale palette.
+     */
+    static bool writesGrayscale(QImage const& image);
+
+    /**
+     * \brief Writes the image to an I/O device.
+     *
+     * \param device The device to write to.  It must be opened for writing.
+     * \param image The image to write.  Writing a null image will fail.
+     * \param quality The libjpeg quality setting, from 0 to 100.
+     * \return True on success, false on failure.
+     */
+    static bool writeImage(QIODevice& device, QImage const& image, int quality = 85);
+};
+
+#endif
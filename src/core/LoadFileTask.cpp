@@ -31,15 +31,154 @@
 #include "Dpm.h"
 #include "FilterData.h"
 #include "ImageLoader.h"
+#include "DecodedImageCache.h"
+#include "IoGate.h"
 #include <QCoreApplication>
 #include <QFile>
 #include <QDir>
 #include <QImage>
 #include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
 #include <assert.h>
 
 using namespace imageproc;
 
+namespace
+{
+
+/**
+ * Pixels whose channels are further apart than that are counted
+ * as saturated.  Scanner noise alone doesn't get there.
+ */
+int const SATURATION_THRESHOLD = 32;
+
+/**
+ * Counts the pixels of an image with a color table by their index.
+ */
+void countIndices(QImage const& image, std::vector<qint64>& counts)
+{
+    int const width = image.width();
+    int const height = image.height();
+
+    if (image.depth() == 8) {
+        for (int y = 0; y < height; ++y) {
+            uint8_t const* line = image.constScanLine(y);
+            for (int x = 0; x < width; ++x) {
+                ++counts[line[x]];
+            }
+        }
+        return;
+    }
+
+    // 1 bit per pixel.  Only the number of set bits matters,
+    // so the bit order doesn't.
+    int const full_bytes = width / 8;
+    int const tail_bits = width % 8;
+    uint8_t const tail_mask = image.format() == QImage::Format_MonoLSB
+                              ? uint8_t((1 << tail_bits) - 1)
+                              : uint8_t(0xff << (8 - tail_bits));
+    qint64 ones = 0;
+    for (int y = 0; y < height; ++y) {
+        uint8_t const* line = image.constScanLine(y);
+        for (int i = 0; i <= full_bytes; ++i) {
+            unsigned byte = line[i];
+            if (i == full_bytes) {
+                if (!tail_bits) {
+                    break;
+                }
+                byte &= tail_mask;
+            }
+            for (; byte; byte &= byte - 1) {
+                ++ones;
+            }
+        }
+    }
+    counts[1] += ones;
+    counts[0] += qint64(width) * height - ones;
+}
+
+/**
+ * Takes the dominant background to be the most populated gray level,
+ * with the histogram slightly smoothed so that gaps left by scanners
+ * don't matter.
+ */
+int dominantLevel(qint64 const* hist)
+{
+    int best_level = 255;
+    qint64 best_count = -1;
+    for (int level = 0; level < 256; ++level) {
+        qint64 count = 0;
+        for (int i = std::max(0, level - 2); i <= std::min(255, level + 2); ++i) {
+            count += hist[i];
+        }
+        if (count > best_count) {
+            best_count = count;
+            best_level = level;
+        }
+    }
+    return best_level;
+}
+
+/**
+ * Gathers the color statistics of ImageMetadata in a single pass.
+ */
+void gatherColorStats(QImage const& image, ImageMetadata& metadata)
+{
+    qint64 gray_hist[256] = { 0 };
+    qint64 saturated = 0;
+    qint64 const total = qint64(image.width()) * image.height();
+    bool grayscale = true;
+
+    if (image.depth() <= 8) {
+        // Only the color table has to be looked at, once the pixels
+        // are counted by their index.
+        QVector<QRgb> const color_table(image.colorTable());
+        std::vector<qint64> counts(std::max(color_table.size(), 256), 0);
+        countIndices(image, counts);
+        grayscale = image.isGrayscale();
+        for (int i = 0; i < color_table.size(); ++i) {
+            QRgb const rgb = color_table[i];
+            int const r = qRed(rgb);
+            int const g = qGreen(rgb);
+            int const b = qBlue(rgb);
+            gray_hist[qGray(rgb)] += counts[i];
+            if (std::max(r, std::max(g, b)) - std::min(r, std::min(g, b)) > SATURATION_THRESHOLD) {
+                saturated += counts[i];
+            }
+        }
+    } else {
+        QImage const rgb_image(
+            image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32
+            ? image : image.convertToFormat(QImage::Format_RGB32)
+        );
+        int const width = rgb_image.width();
+        int const height = rgb_image.height();
+        for (int y = 0; y < height; ++y) {
+            QRgb const* line = reinterpret_cast<QRgb const*>(rgb_image.constScanLine(y));
+            for (int x = 0; x < width; ++x) {
+                QRgb const rgb = line[x];
+                int const r = qRed(rgb);
+                int const g = qGreen(rgb);
+                int const b = qBlue(rgb);
+                int const spread = std::max(r, std::max(g, b)) - std::min(r, std::min(g, b));
+                grayscale = grayscale && spread == 0;
+                saturated += spread > SATURATION_THRESHOLD;
+                ++gray_hist[qGray(rgb)];
+            }
+        }
+    }
+
+    int const saturated_per_mille = total ? int(saturated * 1000 / total) : 0;
+    metadata.setColorStats(grayscale, saturated_per_mille, dominantLevel(gray_hist));
+}
+
+} // anonymous namespace
+
 class LoadFileTask::ErrorResult : public FilterResult
 {
     Q_DECLARE_TR_FUNCTIONS(LoadFileTask)
@@ -69,7 +208,6 @@ LoadFileTask::LoadFileTask(
         m_ptrPages(pages),
         m_ptrNextTask(next_task)
 {
-    assert(m_ptrNextTask);
 }
 
 LoadFileTask::~LoadFileTask()
@@ -79,7 +217,13 @@ LoadFileTask::~LoadFileTask()
 FilterResultPtr
 LoadFileTask::operator()()
 {
-    QImage image(ImageLoader::load(m_imageId));
+    // Covers the files the rest of the chain reads, too.
+    IoGate::PriorityScope const io_priority(
+        type() == BATCH ? IoGate::BATCH : IoGate::INTERACTIVE
+    );
+
+    std::unique_ptr<FilterData> data(DecodedImageCache::find(m_imageId));
+    QImage image(data ? data->origImage() : ImageLoader::load(m_imageId));
 
     try {
         throwIfCancelled();
@@ -88,21 +232,35 @@ LoadFileTask::operator()()
             return FilterResultPtr(new ErrorResult(m_imageId.filePath()));
         } else {
 
-            if (image.isGrayscale() != m_imageMetadata.isGrayScale()) {
-                m_imageMetadata.setGrayScale(image.isGrayscale());
+            // A different size means the file was replaced.
+            if (!m_imageMetadata.haveColorStats() || image.size() != m_imageMetadata.size()) {
+                gatherColorStats(image, m_imageMetadata);
                 m_ptrPages->updateImageMetadata(m_imageId, m_imageMetadata);
             }
 
             updateImageSizeIfChanged(image);
-            overrideDpi(image);
+            if (!data || Dpm(image) != Dpm(m_imageMetadata.dpi())) {
+                // Cached images carry the DPI they were loaded with,
+                // which may have been changed since.
+                overrideDpi(image);
+                data.reset(new FilterData(image));
+                DecodedImageCache::store(m_imageId, *data);
+            }
             m_ptrThumbnailCache->ensureThumbnailExists(m_imageId, image);
-            return m_ptrNextTask->process(*this, FilterData(image));
+            return process(*data);
         }
     } catch (CancelledException const&) {
         return FilterResultPtr();
     }
 }
 
+FilterResultPtr
+LoadFileTask::process(FilterData const& data)
+{
+    assert(m_ptrNextTask);
+    return m_ptrNextTask->process(*this, data);
+}
+
 void
 LoadFileTask::updateImageSizeIfChanged(QImage const& image)
 {
@@ -27,6 +27,7 @@
 #include "ImageMetadata.h"
 
 class ThumbnailPixmapCache;
+class FilterData;
 class PageInfo;
 class ProjectPages;
 class QImage;
@@ -48,6 +49,15 @@ public:
     virtual ~LoadFileTask();
 
     virtual FilterResultPtr operator()();
+protected:
+    /**
+     * \brief Called with the image that was just loaded.
+     *
+     * The default implementation forwards it to the fix_orientation task
+     * passed to the constructor.  Subclasses may override it to push the
+     * same image through more than one task chain.
+     */
+    virtual FilterResultPtr process(FilterData const& data);
 private:
     class ErrorResult;
 
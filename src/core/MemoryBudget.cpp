@@ -0,0 +1,190 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MemoryBudget.h"
+#include "ImageMetadata.h"
+#include "PixelBufferPool.h"
+#include "Metrics.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QSize>
+
+namespace
+{
+
+/**
+ * The number of full-size copies of a page that exist at the same time
+ * during processing: the decoded original, its grayscale version, binary
+ * and mask images, and the output being built.  The output stage in mixed
+ * mode with dewarping is the worst case.
+ */
+int const PIPELINE_EXPANSION_FACTOR = 6;
+
+/**
+ * With a limit set, PixelBufferPool may cache at most this fraction of it.
+ */
+int const POOL_FRACTION = 4;
+
+} // anonymous namespace
+
+class MemoryBudget::Impl
+{
+public:
+    Impl() : m_limit(0), m_reserved(0) {}
+
+    void setLimit(qint64 bytes);
+
+    qint64 limit() const;
+
+    bool tryReserve(qint64 bytes);
+
+    void reserve(qint64 bytes);
+
+    void release(qint64 bytes);
+private:
+    bool fits(qint64 bytes) const
+    {
+        return m_limit <= 0 || m_reserved == 0 || m_reserved + bytes <= m_limit;
+    }
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_released;
+    qint64 m_limit;
+    qint64 m_reserved;
+};
+
+void
+MemoryBudget::Impl::setLimit(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_limit = bytes;
+    if (bytes > 0) {
+        PixelBufferPool::setMaxCachedBytes(size_t(bytes / POOL_FRACTION));
+    }
+    // A higher limit may let someone in.
+    m_released.wakeAll();
+}
+
+qint64
+MemoryBudget::Impl::limit() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_limit;
+}
+
+bool
+MemoryBudget::Impl::tryReserve(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    if (!fits(bytes)) {
+        // Buffers cached for reuse are of no use while nothing new may start.
+        PixelBufferPool::trim();
+        return false;
+    }
+    m_reserved += bytes;
+    Metrics::addToGauge(Metrics::MEMORY_RESERVED_BYTES, bytes);
+    return true;
+}
+
+void
+MemoryBudget::Impl::reserve(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    if (!fits(bytes)) {
+        Metrics::addToGauge(Metrics::PAGES_WAITING_FOR_MEMORY, 1);
+        do {
+            // Buffers cached for reuse are of no use while nothing new may start.
+            PixelBufferPool::trim();
+            m_released.wait(&m_mutex);
+        } while (!fits(bytes));
+        Metrics::addToGauge(Metrics::PAGES_WAITING_FOR_MEMORY, -1);
+    }
+    m_reserved += bytes;
+    Metrics::addToGauge(Metrics::MEMORY_RESERVED_BYTES, bytes);
+}
+
+void
+MemoryBudget::Impl::release(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_reserved -= bytes;
+    Metrics::addToGauge(Metrics::MEMORY_RESERVED_BYTES, -bytes);
+    m_released.wakeAll();
+}
+
+MemoryBudget::Impl&
+MemoryBudget::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+MemoryBudget::Reservation::Reservation(qint64 const bytes)
+    :   m_bytes(bytes)
+{
+    MemoryBudget::reserve(m_bytes);
+}
+
+MemoryBudget::Reservation::~Reservation()
+{
+    MemoryBudget::release(m_bytes);
+}
+
+void
+MemoryBudget::setLimit(qint64 const bytes)
+{
+    impl().setLimit(bytes);
+}
+
+qint64
+MemoryBudget::limit()
+{
+    return impl().limit();
+}
+
+qint64
+MemoryBudget::estimatePageFootprint(ImageMetadata const& metadata)
+{
+    QSize const size(metadata.size());
+    if (size.isEmpty()) {
+        return 0;
+    }
+
+    int const bytes_per_pixel = metadata.isGrayScale() ? 1 : 4;
+    return qint64(size.width()) * size.height() * bytes_per_pixel
+           * PIPELINE_EXPANSION_FACTOR;
+}
+
+bool
+MemoryBudget::tryReserve(qint64 const bytes)
+{
+    return impl().tryReserve(bytes);
+}
+
+void
+MemoryBudget::reserve(qint64 const bytes)
+{
+    impl().reserve(bytes);
+}
+
+void
+MemoryBudget::release(qint64 const bytes)
+{
+    impl().release(bytes);
+}
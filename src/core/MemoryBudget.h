@@ -0,0 +1,94 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMORYBUDGET_H_
+#define MEMORYBUDGET_H_
+
+#include "NonCopyable.h"
+#include <QtGlobal>
+
+class ImageMetadata;
+
+/**
+ * \brief A process-wide limit on the estimated memory of pages in flight.
+ *
+ * Rather than waiting for an allocation to fail, task schedulers reserve
+ * the estimated footprint of a page before starting on it, and release it
+ * once done.  A page that doesn't fit waits until enough memory is
+ * released.  A page never waits while nothing else is reserved, even if
+ * it exceeds the limit on its own: it would have nothing to wait for.
+ *
+ * The budget is unlimited by default.  A limit also caps the memory
+ * PixelBufferPool keeps for reuse, and the pool is trimmed whenever
+ * a page has to wait for memory.
+ */
+class MemoryBudget
+{
+public:
+    /**
+     * \brief Reserves a footprint for the lifetime of the object.
+     *
+     * Blocks until the footprint fits into the budget.
+     */
+    class Reservation
+    {
+        DECLARE_NON_COPYABLE(Reservation)
+    public:
+        explicit Reservation(qint64 bytes);
+
+        ~Reservation();
+    private:
+        qint64 m_bytes;
+    };
+
+    /**
+     * \brief Sets the limit, in bytes.  Zero means unlimited.
+     */
+    static void setLimit(qint64 bytes);
+
+    static qint64 limit();
+
+    /**
+     * \brief Estimates the peak memory needed to process a page.
+     *
+     * That's the decoded image size times the number of full-size
+     * working copies the filters keep around at once.  Returns zero
+     * for images whose size isn't known.
+     */
+    static qint64 estimatePageFootprint(ImageMetadata const& metadata);
+
+    /**
+     * \brief Reserves \p bytes if they fit, or if nothing is reserved.
+     *
+     * \return true if the reservation was made.
+     */
+    static bool tryReserve(qint64 bytes);
+
+    /**
+     * \brief Blocks until tryReserve() succeeds.
+     */
+    static void reserve(qint64 bytes);
+
+    static void release(qint64 bytes);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
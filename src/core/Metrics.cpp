@@ -0,0 +1,304 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Metrics.h"
+#include "MemoryBudget.h"
+#include "MemoryAccounting.h"
+#include "PixelBufferPool.h"
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+
+struct CounterInfo {
+    char const* name;
+    char const* help;
+};
+
+/** Indexed by Metrics::Counter.  Cache counters are rendered separately. */
+CounterInfo const counterInfo[] = {
+    { "scantailor_pages_done_total", "Pages that went through a processing stage." },
+    { "scantailor_decoded_bytes_total", "Bytes of image files read for decoding." },
+    { "scantailor_written_bytes_total", "Bytes of TIFF files written." }
+};
+
+int const FIRST_CACHE_COUNTER = Metrics::THUMBNAIL_CACHE_HITS;
+
+/** Cache names, in the order of their hit and miss counters. */
+char const* const cacheNames[] = {
+    "thumbnail", "decoded_image", "intermediate", "output"
+};
+
+int const NUM_CACHES = sizeof(cacheNames) / sizeof(cacheNames[0]);
+
+/** Indexed by Metrics::Gauge. */
+CounterInfo const gaugeInfo[] = {
+    { "scantailor_jobs_queued", "Server jobs waiting to start." },
+    { "scantailor_pages_queued", "Pages of the current pass waiting to start." },
+    { "scantailor_pages_running", "Pages being processed." },
+    { "scantailor_pages_waiting_for_memory", "Pages waiting for the memory budget." },
+    { "scantailor_memory_reserved_bytes", "Estimated footprint of pages in flight." },
+    { "scantailor_write_queue_bytes", "Bytes of output images waiting to be written." }
+};
+
+int const MAX_STAGES = 16;
+
+/** Upper bounds of histogram buckets, in milliseconds. */
+qint64 const bucketBoundsMsec[] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000
+};
+
+int const NUM_BUCKETS = sizeof(bucketBoundsMsec) / sizeof(bucketBoundsMsec[0]);
+
+struct Histogram {
+    QAtomicPointer<char const> stage;
+    QAtomicInteger<qint64> buckets[NUM_BUCKETS + 1]; // The last one is +Inf.
+    QAtomicInteger<qint64> count;
+    QAtomicInteger<qint64> sumNsecs;
+
+    Histogram() : stage(0) {}
+};
+
+void appendLine(QByteArray& out, QByteArray const& name, qint64 const value)
+{
+    out += name;
+    out += ' ';
+    out += QByteArray::number(value);
+    out += '\n';
+}
+
+void appendHeader(QByteArray& out, char const* name, char const* help, char const* type)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+} // anonymous namespace
+
+class Metrics::Impl
+{
+public:
+    QAtomicInteger<qint64> counters[NUM_COUNTERS];
+    QAtomicInteger<qint64> gauges[NUM_GAUGES];
+    Histogram stages[MAX_STAGES];
+
+    Histogram* histogramFor(char const* stage);
+};
+
+Histogram*
+Metrics::Impl::histogramFor(char const* const stage)
+{
+    // Slots are claimed in order and never released, so the first
+    // empty one ends the search.
+    for (int i = 0; i < MAX_STAGES; ++i) {
+        Histogram& histogram = stages[i];
+        char const* name = histogram.stage.loadAcquire();
+        if (!name) {
+            if (histogram.stage.testAndSetOrdered(0, stage)) {
+                return &histogram;
+            }
+            name = histogram.stage.loadAcquire();
+        }
+        if (name == stage || strcmp(name, stage) == 0) {
+            return &histogram;
+        }
+    }
+    return 0;
+}
+
+Metrics::Impl&
+Metrics::impl()
+{
+    // Never destroyed, as worker threads may still record at exit.
+    static Impl* const instance = new Impl;
+    return *instance;
+}
+
+void
+Metrics::add(Counter const counter, qint64 const value)
+{
+    impl().counters[counter].fetchAndAddRelaxed(value);
+}
+
+void
+Metrics::addToGauge(Gauge const gauge, qint64 const delta)
+{
+    impl().gauges[gauge].fetchAndAddRelaxed(delta);
+}
+
+void
+Metrics::recordStageLatency(char const* const stage, qint64 const nsecs)
+{
+    Histogram* const histogram = impl().histogramFor(stage);
+    if (!histogram) {
+        return;
+    }
+
+    int bucket = 0;
+    while (bucket < NUM_BUCKETS && nsecs > bucketBoundsMsec[bucket] * 1000000) {
+        ++bucket;
+    }
+    histogram->buckets[bucket].fetchAndAddRelaxed(1);
+    histogram->sumNsecs.fetchAndAddRelaxed(nsecs);
+    histogram->count.fetchAndAddRelaxed(1);
+}
+
+qint64
+Metrics::counter(Counter const counter)
+{
+    return impl().counters[counter].load();
+}
+
+qint64
+Metrics::gauge(Gauge const gauge)
+{
+    return impl().gauges[gauge].load();
+}
+
+QByteArray
+Metrics::prometheusText()
+{
+    Impl& self = impl();
+    QByteArray out;
+
+    for (int i = 0; i < FIRST_CACHE_COUNTER; ++i) {
+        appendHeader(out, counterInfo[i].name, counterInfo[i].help, "counter");
+        appendLine(out, counterInfo[i].name, self.counters[i].load());
+    }
+
+    char const* const kinds[] = { "hits", "misses" };
+    for (int kind = 0; kind < 2; ++kind) {
+        QByteArray const name(QByteArray("scantailor_cache_") + kinds[kind] + "_total");
+        appendHeader(out, name.constData(), "Lookups in caches, by cache.", "counter");
+        for (int cache = 0; cache < NUM_CACHES; ++cache) {
+            appendLine(
+                out, name + "{cache=\"" + cacheNames[cache] + "\"}",
+                self.counters[FIRST_CACHE_COUNTER + cache * 2 + kind].load()
+            );
+        }
+    }
+
+    for (int i = 0; i < NUM_GAUGES; ++i) {
+        appendHeader(out, gaugeInfo[i].name, gaugeInfo[i].help, "gauge");
+        appendLine(out, gaugeInfo[i].name, self.gauges[i].load());
+    }
+
+    appendHeader(out, "scantailor_memory_limit_bytes", "The memory budget, or 0 if unlimited.", "gauge");
+    appendLine(out, "scantailor_memory_limit_bytes", MemoryBudget::limit());
+    appendHeader(out, "scantailor_pixel_buffer_bytes", "Memory taken by image buffers.", "gauge");
+    appendLine(out, "scantailor_pixel_buffer_bytes", MemoryAccounting::liveBytes());
+    appendHeader(out, "scantailor_pixel_buffer_peak_bytes", "The most memory image buffers ever took.", "gauge");
+    appendLine(out, "scantailor_pixel_buffer_peak_bytes", MemoryAccounting::peakBytes());
+    appendHeader(out, "scantailor_pixel_buffer_cached_bytes", "Released image buffers kept for reuse.", "gauge");
+    appendLine(out, "scantailor_pixel_buffer_cached_bytes", qint64(PixelBufferPool::cachedBytes()));
+
+    char const* const histogram_name = "scantailor_stage_duration_seconds";
+    appendHeader(out, histogram_name, "Time a page spent in a processing stage.", "histogram");
+    for (int i = 0; i < MAX_STAGES; ++i) {
+        Histogram const& histogram = self.stages[i];
+        char const* const stage = histogram.stage.loadAcquire();
+        if (!stage) {
+            break;
+        }
+
+        QByteArray const label(QByteArray("stage=\"") + stage + '"');
+        qint64 cumulative = 0;
+        for (int bucket = 0; bucket <= NUM_BUCKETS; ++bucket) {
+            cumulative += histogram.buckets[bucket].load();
+            QByteArray const le(
+                bucket < NUM_BUCKETS
+                ? QByteArray::number(double(bucketBoundsMsec[bucket]) / 1000.0) : QByteArray("+Inf")
+            );
+            appendLine(out, QByteArray(histogram_name) + "_bucket{" + label + ",le=\"" + le + "\"}", cumulative);
+        }
+        out += histogram_name;
+        out += "_sum{" + label + "} ";
+        out += QByteArray::number(double(histogram.sumNsecs.load()) / 1e9);
+        out += '\n';
+        appendLine(out, QByteArray(histogram_name) + "_count{" + label + '}', cumulative);
+    }
+
+    return out;
+}
+
+QJsonObject
+Metrics::status(std::vector<qint64>& last_counters, qint64 const elapsed_msec)
+{
+    Impl& self = impl();
+
+    std::vector<qint64> counters(NUM_COUNTERS);
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        counters[i] = self.counters[i].load();
+    }
+    if (last_counters.size() != counters.size()) {
+        last_counters.assign(NUM_COUNTERS, 0);
+    }
+
+    double const secs = std::max<qint64>(elapsed_msec, 1) / 1000.0;
+    QJsonObject status;
+    status.insert("pages_done", double(counters[PAGES_DONE]));
+    status.insert("pages_per_sec", (counters[PAGES_DONE] - last_counters[PAGES_DONE]) / secs);
+    status.insert("decoded_bytes_per_sec", (counters[BYTES_DECODED] - last_counters[BYTES_DECODED]) / secs);
+    status.insert("written_bytes_per_sec", (counters[BYTES_WRITTEN] - last_counters[BYTES_WRITTEN]) / secs);
+
+    QJsonObject caches;
+    for (int cache = 0; cache < NUM_CACHES; ++cache) {
+        qint64 const hits = counters[FIRST_CACHE_COUNTER + cache * 2];
+        qint64 const misses = counters[FIRST_CACHE_COUNTER + cache * 2 + 1];
+        if (hits + misses > 0) {
+            caches.insert(cacheNames[cache], double(hits) / double(hits + misses));
+        }
+    }
+    status.insert("cache_hit_rates", caches);
+
+    status.insert("jobs_queued", double(self.gauges[JOBS_QUEUED].load()));
+    status.insert("pages_queued", double(self.gauges[PAGES_QUEUED].load()));
+    status.insert("pages_running", double(self.gauges[PAGES_RUNNING].load()));
+    status.insert("pages_waiting_for_memory", double(self.gauges[PAGES_WAITING_FOR_MEMORY].load()));
+    status.insert("memory_reserved_bytes", double(self.gauges[MEMORY_RESERVED_BYTES].load()));
+    status.insert("memory_limit_bytes", double(MemoryBudget::limit()));
+    status.insert("pixel_buffer_bytes", double(MemoryAccounting::liveBytes()));
+    status.insert("write_queue_bytes", double(self.gauges[WRITE_QUEUE_BYTES].load()));
+
+    QJsonObject stages;
+    for (int i = 0; i < MAX_STAGES; ++i) {
+        Histogram const& histogram = self.stages[i];
+        char const* const stage = histogram.stage.loadAcquire();
+        if (!stage) {
+            break;
+        }
+        qint64 const count = histogram.count.load();
+        if (count > 0) {
+            stages.insert(stage, double(histogram.sumNsecs.load()) / 1e6 / count);
+        }
+    }
+    status.insert("stage_mean_msec", stages);
+
+    last_counters.swap(counters);
+    return status;
+}
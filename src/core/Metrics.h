@@ -0,0 +1,103 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * \brief Process-wide operational counters, for monitoring a long-running
+ *        scantailor-cli --serve.
+ *
+ * Unlike Profiler, metrics are always collected.  Recording is a single
+ * atomic addition, so it may be done on worker threads as they go.
+ * Counters only ever grow.  Gauges go up and down with the state they
+ * describe.  Stage latencies go into fixed-bucket histograms.
+ *
+ * prometheusText() renders everything in the Prometheus text exposition
+ * format, and status() renders a compact JSON summary with rates.
+ */
+class Metrics
+{
+public:
+    enum Counter {
+        PAGES_DONE,
+        BYTES_DECODED,
+        BYTES_WRITTEN,
+        THUMBNAIL_CACHE_HITS,
+        THUMBNAIL_CACHE_MISSES,
+        DECODED_IMAGE_CACHE_HITS,
+        DECODED_IMAGE_CACHE_MISSES,
+        INTERMEDIATE_CACHE_HITS,
+        INTERMEDIATE_CACHE_MISSES,
+        OUTPUT_CACHE_HITS,
+        OUTPUT_CACHE_MISSES,
+        NUM_COUNTERS
+    };
+
+    enum Gauge {
+        JOBS_QUEUED,
+        PAGES_QUEUED,
+        PAGES_RUNNING,
+        PAGES_WAITING_FOR_MEMORY,
+        MEMORY_RESERVED_BYTES,
+        WRITE_QUEUE_BYTES,
+        NUM_GAUGES
+    };
+
+    static void add(Counter counter, qint64 value = 1);
+
+    static void addToGauge(Gauge gauge, qint64 delta);
+
+    /**
+     * \brief Records the time a page spent in a stage.
+     *
+     * \param stage A string literal, or anything else that outlives
+     *        the process.  Stages beyond the first 16 distinct ones
+     *        are not recorded.
+     */
+    static void recordStageLatency(char const* stage, qint64 nsecs);
+
+    static qint64 counter(Counter counter);
+
+    static qint64 gauge(Gauge gauge);
+
+    /**
+     * \brief Renders all metrics in the Prometheus text format.
+     */
+    static QByteArray prometheusText();
+
+    /**
+     * \brief Summarizes the metrics, with rates since the previous call.
+     *
+     * \param last_counters The counters as of the previous call, updated
+     *        to the current ones.  Empty on the first call.
+     * \param elapsed_msec The time since the previous call.
+     */
+    static QJsonObject status(std::vector<qint64>& last_counters, qint64 elapsed_msec);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
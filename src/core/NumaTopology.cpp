@@ -0,0 +1,150 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NumaTopology.h"
+#include <QtGlobal> // For Q_OS_LINUX
+#include <QAtomicInt>
+#include <vector>
+#include <algorithm>
+
+#if defined(Q_OS_LINUX)
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <sched.h>
+#endif
+
+namespace
+{
+
+QAtomicInt g_enabled(0);
+
+#if defined(Q_OS_LINUX)
+
+/**
+ * Parses a CPU list like "0-7,16-23".
+ */
+std::vector<int> parseCpuList(QString const& list)
+{
+    std::vector<int> cpus;
+    for (QString const& range : list.trimmed().split(',', QString::SkipEmptyParts)) {
+        QStringList const ends(range.split('-'));
+        bool ok1 = false;
+        bool ok2 = false;
+        int const first = ends.front().toInt(&ok1);
+        int const last = ends.back().toInt(&ok2);
+        if (!ok1 || !ok2) {
+            continue;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * Returns the CPUs of every node that has any, in the order of node numbers.
+ */
+std::vector<std::vector<int> > readNodes()
+{
+    std::vector<std::vector<int> > nodes;
+
+    QDir const dir(QString::fromLatin1("/sys/devices/system/node"));
+    QStringList names(dir.entryList(QStringList() << QString::fromLatin1("node*"), QDir::Dirs));
+    std::sort(names.begin(), names.end(), [](QString const& a, QString const& b) {
+        return a.mid(4).toInt() < b.mid(4).toInt();
+    });
+
+    for (QString const& name : names) {
+        QFile file(dir.absoluteFilePath(name + QString::fromLatin1("/cpulist")));
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        std::vector<int> cpus(parseCpuList(QString::fromLatin1(file.readAll())));
+        if (!cpus.empty()) {
+            nodes.push_back(cpus);
+        }
+    }
+
+    return nodes;
+}
+
+#else
+
+std::vector<std::vector<int> > readNodes()
+{
+    return std::vector<std::vector<int> >();
+}
+
+#endif
+
+std::vector<std::vector<int> > const& nodes()
+{
+    // Thread-safe since C++11.
+    static std::vector<std::vector<int> > const instance(readNodes());
+    return instance;
+}
+
+} // anonymous namespace
+
+void
+NumaTopology::setEnabled(bool const enabled)
+{
+    g_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool
+NumaTopology::isEnabled()
+{
+    return g_enabled.loadAcquire() != 0 && numNodes() > 1;
+}
+
+int
+NumaTopology::numNodes()
+{
+    return std::max<int>(1, nodes().size());
+}
+
+int
+NumaTopology::nodeOfWorker(int const worker_idx)
+{
+    return worker_idx % numNodes();
+}
+
+void
+NumaTopology::bindCurrentThread(int const node)
+{
+    if (!isEnabled() || node < 0 || node >= numNodes()) {
+        return;
+    }
+
+#if defined(Q_OS_LINUX)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int const cpu : nodes()[node]) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    // Zero stands for the calling thread.  A failure, like a CPU set
+    // outside of what we are allowed to use, leaves things as they are.
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
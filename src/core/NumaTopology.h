@@ -0,0 +1,63 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NUMATOPOLOGY_H_
+#define NUMATOPOLOGY_H_
+
+/**
+ * \brief Keeps batch workers and their memory on the same NUMA node.
+ *
+ * On machines with several sockets, memory is attached to one of them,
+ * and reaching another socket's memory costs bandwidth.  Linux places
+ * pages on the node of the thread that touches them first, so binding
+ * a worker to the CPUs of one node is enough for the buffers it
+ * allocates and fills to be local.
+ *
+ * Placement is off unless enabled with setEnabled(), and it's a no-op
+ * on machines with a single node and on systems other than Linux.
+ * Workers are spread over nodes round-robin, see nodeOfWorker().
+ */
+class NumaTopology
+{
+public:
+    static void setEnabled(bool enabled);
+
+    /**
+     * \brief Returns true if enabled and there is more than one node.
+     */
+    static bool isEnabled();
+
+    /**
+     * \brief Returns the number of nodes with CPUs, at least 1.
+     */
+    static int numNodes();
+
+    /**
+     * \brief Returns the node for the worker with index \p worker_idx.
+     */
+    static int nodeOfWorker(int worker_idx);
+
+    /**
+     * \brief Restricts the calling thread to the CPUs of \p node.
+     *
+     * Does nothing if placement isn't enabled.
+     */
+    static void bindCurrentThread(int node);
+};
+
+#endif
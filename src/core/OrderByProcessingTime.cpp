@@ -0,0 +1,67 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "OrderByProcessingTime.h"
+#include "PageTimings.h"
+#include <QObject>
+#include <QString>
+#include <vector>
+
+bool
+OrderByProcessingTime::precedes(
+    PageId const& lhs_page, bool const lhs_incomplete,
+    PageId const& rhs_page, bool const rhs_incomplete) const
+{
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
+
+bool
+OrderByProcessingTime::sortKey(PageId const& page, bool /*incomplete*/, SortKey& key) const
+{
+    double const msec = PageTimings::totalMsec(page);
+    if (msec < 0.0) {
+        key[0] = 1;
+    } else {
+        key[1] = -msec;
+    }
+    return true;
+}
+
+QString
+OrderByProcessingTime::hint(PageId const& page) const
+{
+    std::vector<PageTimings::StageTime> const times(PageTimings::pageTimes(page));
+    if (times.empty()) {
+        return QObject::tr("time: ?");
+    }
+
+    double total = 0.0;
+    PageTimings::StageTime const* slowest = &times.front();
+    for (PageTimings::StageTime const& time : times) {
+        total += time.msec;
+        if (time.msec > slowest->msec) {
+            slowest = &time;
+        }
+    }
+
+    return QObject::tr("%1 ms, %2: %3 ms")
+           .arg(qRound(total))
+           .arg(QString::fromUtf8(slowest->stage))
+           .arg(qRound(slowest->msec));
+}
@@ -0,0 +1,212 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "OutputCache.h"
+#include "AtomicFileOverwriter.h"
+#include "RelinkablePath.h"
+#include "Metrics.h"
+#include "version.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QMutex>
+#include <QMutexLocker>
+
+class OutputCache::Impl
+{
+public:
+    void setCacheDir(QString const& dir);
+
+    QString cacheDir() const;
+private:
+    mutable QMutex m_mutex;
+    QString m_cacheDir;
+};
+
+void
+OutputCache::Impl::setCacheDir(QString const& dir)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    m_cacheDir = dir;
+    if (!dir.isEmpty() && !QDir().mkpath(dir)) {
+        m_cacheDir.clear();
+    }
+}
+
+QString
+OutputCache::Impl::cacheDir() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_cacheDir;
+}
+
+/*============================== OutputCache ==============================*/
+
+OutputCache::Impl&
+OutputCache::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+void
+OutputCache::setCacheDir(QString const& dir)
+{
+    impl().setCacheDir(dir.isEmpty() ? dir : RelinkablePath::normalize(dir));
+}
+
+bool
+OutputCache::isEnabled()
+{
+    return !impl().cacheDir().isEmpty();
+}
+
+IntermediateCache::Key
+OutputCache::key(ImageId const& image_id, char const* product)
+{
+    IntermediateCache::Key key;
+    if (isEnabled()) {
+        key.init(image_id, product);
+        key.add(QByteArray(VERSION));
+    }
+    return key;
+}
+
+namespace
+{
+
+/**
+ * Counts a lookup of an enabled cache and passes its outcome through.
+ */
+bool countLookup(bool const hit)
+{
+    Metrics::add(hit ? Metrics::OUTPUT_CACHE_HITS : Metrics::OUTPUT_CACHE_MISSES);
+    return hit;
+}
+
+QString entryFilePath(QString const& dir, QString const& digest, int idx)
+{
+    return dir + QChar('/') + digest + QChar('_') + QString::number(idx);
+}
+
+QString metaFilePath(QString const& dir, QString const& digest)
+{
+    return dir + QChar('/') + digest + QLatin1String(".meta");
+}
+
+bool copyContents(QIODevice& src, QIODevice& dst)
+{
+    char buf[64 * 1024];
+    for (;;) {
+        qint64 const len = src.read(buf, sizeof(buf));
+        if (len < 0) {
+            return false;
+        } else if (len == 0) {
+            return true;
+        } else if (dst.write(buf, len) != len) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Copies a file through a temporary one, so that readers
+ * never see it partially written.
+ */
+bool copyFile(QString const& src_path, QString const& dst_path)
+{
+    QFile src(src_path);
+    if (!src.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* const io_dev = overwriter.startWriting(dst_path);
+    if (!io_dev || !copyContents(src, *io_dev) || !overwriter.commit()) {
+        return false;
+    }
+
+    // Temporary files are only accessible by their owner.
+    QFile::setPermissions(dst_path, src.permissions());
+    return true;
+}
+
+} // anonymous namespace
+
+bool
+OutputCache::fetch(
+    IntermediateCache::Key const& key, QStringList const& file_paths, QByteArray& meta)
+{
+    if (!key.isValid()) {
+        return false;
+    }
+
+    QString const dir(impl().cacheDir());
+    if (dir.isEmpty()) {
+        return false;
+    }
+
+    QString const digest(key.digest());
+
+    // The meta file is written last, so its presence marks a complete entry.
+    QFile meta_file(metaFilePath(dir, digest));
+    if (!meta_file.open(QIODevice::ReadOnly)) {
+        return countLookup(false);
+    }
+    QByteArray const loaded_meta(meta_file.readAll());
+
+    for (int i = 0; i < file_paths.size(); ++i) {
+        if (!copyFile(entryFilePath(dir, digest, i), file_paths[i])) {
+            return countLookup(false);
+        }
+    }
+
+    meta = loaded_meta;
+    return countLookup(true);
+}
+
+void
+OutputCache::store(
+    IntermediateCache::Key const& key, QStringList const& file_paths, QByteArray const& meta)
+{
+    if (!key.isValid()) {
+        return;
+    }
+
+    QString const dir(impl().cacheDir());
+    if (dir.isEmpty()) {
+        return;
+    }
+
+    QString const digest(key.digest());
+
+    for (int i = 0; i < file_paths.size(); ++i) {
+        if (!copyFile(file_paths[i], entryFilePath(dir, digest, i))) {
+            return;
+        }
+    }
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* const io_dev = overwriter.startWriting(metaFilePath(dir, digest));
+    if (io_dev && io_dev->write(meta) == meta.size()) {
+        overwriter.commit();
+    }
+}
@@ -0,0 +1,89 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OUTPUTCACHE_H_
+#define OUTPUTCACHE_H_
+
+#include "IntermediateCache.h"
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+class ImageId;
+
+/**
+ * \brief A content-addressed store of output files, shared by projects.
+ *
+ * Unlike IntermediateCache, which lives in a project's output directory,
+ * this one lives in a directory configured by the user, so re-running
+ * the same source scans under another project with the same parameters
+ * reuses earlier results.  Keys cover the application version, as
+ * the way output is generated may change between versions.
+ *
+ * Files are copied in and out rather than hard-linked, because output
+ * files get rewritten in place, which would corrupt a linked entry.
+ */
+class OutputCache
+{
+public:
+    /**
+     * \brief Sets the directory to keep cache entries in.
+     *
+     * Passing an empty string disables the cache.  Unlike IntermediateCache,
+     * the directory is created along with any missing parents.
+     */
+    static void setCacheDir(QString const& dir);
+
+    static bool isEnabled();
+
+    /**
+     * \brief Starts a key for output derived from the given image.
+     *
+     * The key is invalid if the cache is disabled or the image file
+     * can't be read.  Using an invalid key is a no-op.
+     */
+    static IntermediateCache::Key key(ImageId const& image_id, char const* product);
+
+    /**
+     * \brief Copies the files of a previously stored entry.
+     *
+     * \param key The key the entry was stored under.
+     * \param file_paths Where to put the entry's files, in the order
+     *        they were stored.  On a miss, some of them may have been
+     *        overwritten already.
+     * \param meta Receives the data stored along with the files.
+     * \return true on a cache hit.
+     */
+    static bool fetch(IntermediateCache::Key const& key,
+                      QStringList const& file_paths, QByteArray& meta);
+
+    /**
+     * \brief Stores copies of the given files.  Failures are silently ignored.
+     *
+     * \param meta Arbitrary data to be returned by fetch() along with the files.
+     */
+    static void store(IntermediateCache::Key const& key,
+                      QStringList const& file_paths, QByteArray const& meta);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
@@ -0,0 +1,281 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OutputWriteQueue.h"
+#include "AtomicFileOverwriter.h"
+#include "TiffWriter.h"
+#include "TraceRecorder.h"
+#include "Metrics.h"
+#include <QIODevice>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QRunnable>
+#include <deque>
+#include <memory>
+
+class OutputWriteQueue::Impl
+{
+public:
+    Impl();
+
+    void write(std::vector<File> const& files, CompletionHandler const& on_done);
+
+    void waitForAll();
+
+    void setMaxQueuedBytes(size_t bytes);
+
+    size_t maxQueuedBytes() const;
+
+    void drain();
+private:
+    struct Job {
+        std::vector<File> files;
+        CompletionHandler onDone;
+        size_t numBytes;
+    };
+
+    static size_t numBytes(std::vector<File> const& files);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_progress;
+    std::deque<Job> m_jobs;
+    size_t m_queuedBytes;
+    size_t m_maxQueuedBytes;
+    bool m_draining;
+
+    // Goes last, so that its destructor waits for the writer
+    // before the rest of the members are gone.
+    QThreadPool m_pool;
+};
+
+class OutputWriteQueue::DrainTask : public QRunnable
+{
+public:
+    DrainTask(Impl& owner) : m_rOwner(owner) {}
+
+    virtual void run()
+    {
+        m_rOwner.drain();
+    }
+private:
+    Impl& m_rOwner;
+};
+
+namespace
+{
+
+/**
+ * Writes files to temporary files, syncs them and only then replaces
+ * the targets.  Syncing a batch together lets the OS flush it in fewer
+ * and larger requests than syncing file by file.
+ */
+void writeFiles(std::vector<OutputWriteQueue::File*> const& all_files)
+{
+    std::vector<OutputWriteQueue::File*> files;
+    for (OutputWriteQueue::File* file : all_files) {
+        if (file->unchanged) {
+            file->written = true;
+        } else {
+            files.push_back(file);
+        }
+    }
+
+    std::vector<std::unique_ptr<AtomicFileOverwriter> > overwriters;
+    overwriters.reserve(files.size());
+
+    for (OutputWriteQueue::File* file : files) {
+        overwriters.emplace_back(new AtomicFileOverwriter);
+        QIODevice* const dev = overwriters.back()->startWriting(file->path);
+        file->written = dev && TiffWriter::writeImage(
+                            *dev, file->image, false, 0, &file->compressionUsed, file->compression
+                        );
+        if (file->written) {
+            Metrics::add(Metrics::BYTES_WRITTEN, dev->size());
+        }
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i]->written) {
+            files[i]->written = overwriters[i]->sync();
+        }
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i]->written) {
+            files[i]->written = overwriters[i]->commit();
+        } else {
+            overwriters[i]->abort();
+        }
+    }
+}
+
+} // anonymous namespace
+
+OutputWriteQueue::Impl::Impl()
+    :   m_queuedBytes(0),
+        m_maxQueuedBytes(size_t(256) << 20),
+        m_draining(false)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+void
+OutputWriteQueue::Impl::write(
+    std::vector<File> const& files, CompletionHandler const& on_done)
+{
+    Job job;
+    job.files = files;
+    job.onDone = on_done;
+    job.numBytes = numBytes(files);
+
+    QMutexLocker const locker(&m_mutex);
+    while (m_queuedBytes > 0 && m_queuedBytes + job.numBytes > m_maxQueuedBytes) {
+        m_progress.wait(&m_mutex);
+    }
+
+    m_queuedBytes += job.numBytes;
+    m_jobs.push_back(job);
+    Metrics::addToGauge(Metrics::WRITE_QUEUE_BYTES, job.numBytes);
+
+    if (!m_draining) {
+        m_draining = true;
+        m_pool.start(new DrainTask(*this));
+    }
+}
+
+void
+OutputWriteQueue::Impl::waitForAll()
+{
+    QMutexLocker const locker(&m_mutex);
+    while (m_draining) {
+        m_progress.wait(&m_mutex);
+    }
+}
+
+void
+OutputWriteQueue::Impl::setMaxQueuedBytes(size_t const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_maxQueuedBytes = bytes;
+    m_progress.wakeAll();
+}
+
+size_t
+OutputWriteQueue::Impl::maxQueuedBytes() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_maxQueuedBytes;
+}
+
+void
+OutputWriteQueue::Impl::drain()
+{
+    for (;;) {
+        std::deque<Job> batch;
+        {
+            QMutexLocker const locker(&m_mutex);
+            if (m_jobs.empty()) {
+                m_draining = false;
+                m_progress.wakeAll();
+                return;
+            }
+            batch.swap(m_jobs);
+        }
+
+        TraceRecorder::Span const trace_span("write_output_files");
+
+        std::vector<File*> files;
+        size_t batch_bytes = 0;
+        for (Job& job : batch) {
+            for (File& file : job.files) {
+                files.push_back(&file);
+            }
+            batch_bytes += job.numBytes;
+        }
+
+        writeFiles(files);
+
+        for (Job& job : batch) {
+            // The images are no longer needed.
+            for (File& file : job.files) {
+                file.image = QImage();
+            }
+            if (job.onDone) {
+                job.onDone(job.files);
+            }
+        }
+
+        QMutexLocker const locker(&m_mutex);
+        m_queuedBytes -= batch_bytes;
+        Metrics::addToGauge(Metrics::WRITE_QUEUE_BYTES, -qint64(batch_bytes));
+        m_progress.wakeAll();
+    }
+}
+
+size_t
+OutputWriteQueue::Impl::numBytes(std::vector<File> const& files)
+{
+    size_t bytes = 0;
+    for (File const& file : files) {
+        bytes += file.image.byteCount();
+    }
+    return bytes;
+}
+
+OutputWriteQueue::Impl&
+OutputWriteQueue::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+void
+OutputWriteQueue::write(std::vector<File> const& files, CompletionHandler const& on_done)
+{
+    impl().write(files, on_done);
+}
+
+void
+OutputWriteQueue::writeNow(std::vector<File>& files)
+{
+    std::vector<File*> ptrs;
+    for (File& file : files) {
+        ptrs.push_back(&file);
+    }
+    writeFiles(ptrs);
+}
+
+void
+OutputWriteQueue::waitForAll()
+{
+    impl().waitForAll();
+}
+
+void
+OutputWriteQueue::setMaxQueuedBytes(size_t const bytes)
+{
+    impl().setMaxQueuedBytes(bytes);
+}
+
+size_t
+OutputWriteQueue::maxQueuedBytes()
+{
+    return impl().maxQueuedBytes();
+}
@@ -0,0 +1,124 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OUTPUTWRITEQUEUE_H_
+#define OUTPUTWRITEQUEUE_H_
+
+#include <QString>
+#include <QImage>
+#ifndef Q_MOC_RUN
+#include <boost/function.hpp>
+#endif
+#include <vector>
+#include <stddef.h>
+
+/**
+ * \brief Writes output TIFF files behind the back of batch processing.
+ *
+ * Encoding and writing a page takes a noticeable share of the time
+ * batch processing spends on it, and the next page doesn't depend on
+ * it.  write() hands the files to a writer thread and returns, so the
+ * next page can be processed while the previous one is being written.
+ *
+ * The writer thread takes whatever has queued up since its last round
+ * and writes each file to a temporary file next to the target, as
+ * AtomicFileOverwriter does.  Then it syncs all of them to disk in one
+ * go, replaces the target files and only then calls the completion
+ * handlers.  A file is therefore either fully replaced or not touched
+ * at all, even if the machine goes down half way through.
+ *
+ * Queued images stay in memory until written, so write() blocks once
+ * their total size exceeds maxQueuedBytes().  Anything reading output
+ * files back, such as project saving or exporting, must call
+ * waitForAll() first.
+ */
+class OutputWriteQueue
+{
+public:
+    struct File {
+        QString path;
+        QImage image;
+
+        /** Set once the file is written. */
+        bool written;
+
+        /**
+         * The TIFF compression to use instead of the configured ones,
+         * as TiffWriter::writeImage() takes it.
+         */
+        QString compression;
+
+        /** The TIFF compression actually used. */
+        QString compressionUsed;
+
+        /**
+         * The file already holds the image, so it's not written again.
+         * Such files count as written.  compressionUsed is left as is.
+         */
+        bool unchanged;
+
+        File() : written(false), unchanged(false) {}
+
+        File(QString const& p, QImage const& img)
+            :   path(p), image(img), written(false), unchanged(false) {}
+    };
+
+    /**
+     * Called from the writer thread once every file of a write() call
+     * has either been written or failed.
+     */
+    typedef boost::function<void(std::vector<File> const& files)> CompletionHandler;
+
+    /**
+     * \brief Queues files for writing.
+     *
+     * Blocks while the images already queued exceed maxQueuedBytes().
+     */
+    static void write(std::vector<File> const& files, CompletionHandler const& on_done);
+
+    /**
+     * \brief Writes files on the calling thread, the same way the
+     *        writer thread would.
+     *
+     * Fills File::written and File::compressionUsed in place.
+     */
+    static void writeNow(std::vector<File>& files);
+
+    /**
+     * \brief Blocks until every queued file is written and its
+     *        completion handler has returned.
+     */
+    static void waitForAll();
+
+    /**
+     * \brief Sets the memory limit for images waiting to be written.
+     *
+     * The default is 256 MiB.  A single write() larger than that
+     * is still accepted once the queue is empty.
+     */
+    static void setMaxQueuedBytes(size_t bytes);
+
+    static size_t maxQueuedBytes();
+private:
+    class Impl;
+    class DrainTask;
+
+    static Impl& impl();
+};
+
+#endif
@@ -21,6 +21,7 @@
 
 #include "RefCountable.h"
 #include "PageId.h"
+#include <array>
 
 class PageId;
 
@@ -30,6 +31,12 @@ class PageId;
 class PageOrderProvider : public RefCountable
 {
 public:
+    /**
+     * The values a provider orders pages by, most significant first.
+     * Pages with equal keys are ordered by PageId.
+     */
+    typedef std::array<double, 5> SortKey;
+
     /**
      * Returns true if \p lhs_page precedes \p rhs_page.
      * \p lhs_incomplete and \p rhs_incomplete indicate whether
@@ -40,6 +47,35 @@ public:
         PageId const& rhs_page, bool rhs_incomplete) const = 0;
 
     virtual QString hint(PageId const& page) const = 0;
+
+    /**
+     * Fills \p key, which the caller has zeroed, and returns true if
+     * the provider orders pages by such keys.  That lets many pages be
+     * sorted by looking up each one once, rather than twice per comparison.
+     * Otherwise returns false, and pages can only be ordered by precedes().
+     */
+    virtual bool sortKey(PageId const& /*page*/, bool /*incomplete*/, SortKey& /*key*/) const
+    {
+        return false;
+    }
+protected:
+    /**
+     * An implementation of precedes() for providers implementing sortKey().
+     */
+    bool precedesByKey(
+        PageId const& lhs_page, bool lhs_incomplete,
+        PageId const& rhs_page, bool rhs_incomplete) const
+    {
+        SortKey lhs_key = SortKey();
+        SortKey rhs_key = SortKey();
+        sortKey(lhs_page, lhs_incomplete, lhs_key);
+        sortKey(rhs_page, rhs_incomplete, rhs_key);
+        if (lhs_key != rhs_key) {
+            return lhs_key < rhs_key;
+        } else {
+            return lhs_page < rhs_page;
+        }
+    }
 };
 
 class OrderByReadiness : public PageOrderProvider
@@ -50,17 +86,20 @@ public:
         PageId const& lhs_page, bool lhs_incomplete,
         PageId const& rhs_page, bool rhs_incomplete) const
     {
-        if (lhs_incomplete != rhs_incomplete) {
-            return !lhs_incomplete;
-        } else {
-            return lhs_page < rhs_page;
-        }
+        return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
     }
 
     virtual QString hint(PageId const& /*page*/) const
     {
         return QString();
     }
+
+    virtual bool sortKey(PageId const& /*page*/, bool incomplete, SortKey& key) const
+    {
+        // Complete pages go first.
+        key[0] = incomplete ? 1 : 0;
+        return true;
+    }
 };
 
 class ReverseOrderWrapper : public PageOrderProvider
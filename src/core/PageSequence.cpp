@@ -21,6 +21,10 @@
 void
 PageSequence::append(PageInfo const& page_info)
 {
+    // Should a page appear twice, lookups find the first one.
+    if (!m_pageNos.contains(page_info.id())) {
+        m_pageNos.insert(page_info.id(), int(m_pages.size()));
+    }
     m_pages.push_back(page_info);
 }
 
@@ -33,26 +37,13 @@ PageSequence::pageAt(size_t const idx) const
 PageInfo const&
 PageSequence::pageAt(PageId const page) const
 {
-    std::vector<PageInfo>::const_iterator it(m_pages.begin());
-    std::vector<PageInfo>::const_iterator const end(m_pages.end());
-    for (; it != end && it->id() != page; ++it) {
-        // Continue until we have a match.
-    }
-
-    return *it;
+    return m_pages.at(pageNo(page)); // may throw
 }
 
 int
 PageSequence::pageNo(PageId const& page) const
 {
-    std::vector<PageInfo>::const_iterator it(m_pages.begin());
-    std::vector<PageInfo>::const_iterator const end(m_pages.end());
-    int res = 0;
-    for (; it != end && it->id() != page; ++it, ++res) {
-        // Continue until we have a match.
-    }
-
-    return (it == end) ? -1 : res;
+    return m_pageNos.value(page, -1);
 }
 
 std::set<PageId>
@@ -20,6 +20,8 @@
 #define PAGE_SEQUENCE_H_
 
 #include "PageInfo.h"
+#include "PageId.h"
+#include <QHash>
 #include <vector>
 #include <set>
 #include <stddef.h>
@@ -35,10 +37,18 @@ public:
         return m_pages.size();
     }
 
+    /**
+     * \brief Looks up a page in constant time.
+     *
+     * Throws std::out_of_range if there is no such page.
+     */
     PageInfo const& pageAt(PageId page) const;
 
     PageInfo const& pageAt(size_t idx) const;
 
+    /**
+     * \brief Returns the index of a page, or -1 if there is no such page.
+     */
     int pageNo(PageId const& page) const;
 
     std::set<PageId> asPageIdSet() const;
@@ -50,14 +60,7 @@ public:
 //  std::set<PageId> selectEveryOther(PageId const& base) const;
 
     // reqquired for range-based for iteration
-    std::vector<PageInfo>::iterator begin()
-    {
-        return m_pages.begin();
-    }
-    std::vector<PageInfo>::iterator end()
-    {
-        return m_pages.end();
-    }
+    // Pages can't be modified in place, as that would invalidate m_pageNos.
     std::vector<PageInfo>::const_iterator begin() const
     {
         return m_pages.cbegin();
@@ -68,6 +71,7 @@ public:
     }
 private:
     std::vector<PageInfo> m_pages;
+    QHash<PageId, int> m_pageNos;
 };
 
 #endif
@@ -0,0 +1,180 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "PageSet.h"
+#include <assert.h>
+
+namespace
+{
+
+int countBits(uint64_t word)
+{
+    int count = 0;
+    for (; word; word &= word - 1) {
+        ++count;
+    }
+    return count;
+}
+
+} // anonymous namespace
+
+PageSet::PageSet()
+    :   m_ptrPages(std::make_shared<PageSequence>())
+{
+}
+
+PageSet::PageSet(std::shared_ptr<PageSequence const> const& pages)
+    :   m_ptrPages(pages),
+        m_words((pages->numPages() + 63) / 64, 0)
+{
+}
+
+PageSet::PageSet(std::shared_ptr<PageSequence const> const& pages, std::set<PageId> const& page_ids)
+    :   m_ptrPages(pages),
+        m_words((pages->numPages() + 63) / 64, 0)
+{
+    for (PageId const& page : page_ids) {
+        insert(page);
+    }
+}
+
+PageSet
+PageSet::all(std::shared_ptr<PageSequence const> const& pages)
+{
+    PageSet set(pages);
+    int const num_pages = int(pages->numPages());
+    for (int i = 0; i < num_pages / 64; ++i) {
+        set.m_words[i] = ~uint64_t(0);
+    }
+    if (num_pages & 63) {
+        set.m_words[num_pages / 64] = (uint64_t(1) << (num_pages & 63)) - 1;
+    }
+    return set;
+}
+
+bool
+PageSet::insert(PageId const& page)
+{
+    int const idx = m_ptrPages->pageNo(page);
+    if (idx < 0) {
+        return false;
+    }
+    insertAt(idx);
+    return true;
+}
+
+bool
+PageSet::contains(PageId const& page) const
+{
+    int const idx = m_ptrPages->pageNo(page);
+    return idx >= 0 && containsAt(idx);
+}
+
+int
+PageSet::size() const
+{
+    int count = 0;
+    for (uint64_t const word : m_words) {
+        count += countBits(word);
+    }
+    return count;
+}
+
+bool
+PageSet::empty() const
+{
+    for (uint64_t const word : m_words) {
+        if (word) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PageSet&
+PageSet::operator&=(PageSet const& other)
+{
+    assert(m_ptrPages == other.m_ptrPages);
+    for (size_t i = 0; i < m_words.size(); ++i) {
+        m_words[i] &= other.m_words[i];
+    }
+    return *this;
+}
+
+PageSet&
+PageSet::operator|=(PageSet const& other)
+{
+    assert(m_ptrPages == other.m_ptrPages);
+    for (size_t i = 0; i < m_words.size(); ++i) {
+        m_words[i] |= other.m_words[i];
+    }
+    return *this;
+}
+
+PageSet&
+PageSet::operator-=(PageSet const& other)
+{
+    assert(m_ptrPages == other.m_ptrPages);
+    for (size_t i = 0; i < m_words.size(); ++i) {
+        m_words[i] &= ~other.m_words[i];
+    }
+    return *this;
+}
+
+std::set<PageId>
+PageSet::toPageIdSet() const
+{
+    std::set<PageId> page_ids;
+    for (PageId const& page : *this) {
+        // Pages come in sequence order, which is usually the order of the set.
+        page_ids.insert(page_ids.end(), page);
+    }
+    return page_ids;
+}
+
+PageSet::const_iterator
+PageSet::begin() const
+{
+    return const_iterator(this, nextAt(0));
+}
+
+PageSet::const_iterator
+PageSet::end() const
+{
+    return const_iterator(this, int(m_ptrPages->numPages()));
+}
+
+int
+PageSet::nextAt(int idx) const
+{
+    int const num_pages = int(m_ptrPages->numPages());
+    while (idx < num_pages) {
+        uint64_t const word = m_words[idx >> 6] >> (idx & 63);
+        if (!word) {
+            // Nothing more in this word.
+            idx = (idx | 63) + 1;
+            continue;
+        }
+        if (word & 1) {
+            return idx;
+        }
+        ++idx;
+    }
+    return num_pages;
+}
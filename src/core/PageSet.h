@@ -0,0 +1,158 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PAGE_SET_H_
+#define PAGE_SET_H_
+
+#include "PageSequence.h"
+#include "PageId.h"
+#include <memory>
+#include <vector>
+#include <set>
+#include <iterator>
+#include <stdint.h>
+
+/**
+ * \brief A set of pages of a PageSequence, with one bit per page.
+ *
+ * A page is identified by its position in the sequence, which the
+ * sequence looks up in constant time.  Building a set copies no PageId.
+ * Set operations work on whole words.  So even a selection of every page
+ * of a large project is cheap to build and combine, unlike a
+ * std::set<PageId>, which compares file paths.
+ *
+ * Sets combined with each other must share their sequence.  Most APIs
+ * still take std::set<PageId>.  The constructor that takes one and
+ * toPageIdSet() convert at those edges.
+ */
+class PageSet
+{
+    // Member-wise copying is OK.
+public:
+    class const_iterator;
+
+    PageSet();
+
+    explicit PageSet(std::shared_ptr<PageSequence const> const& pages);
+
+    /**
+     * \brief Makes a set of those of \p page_ids that are in \p pages.
+     */
+    PageSet(std::shared_ptr<PageSequence const> const& pages, std::set<PageId> const& page_ids);
+
+    /**
+     * \brief Makes a set of all pages of \p pages.
+     */
+    static PageSet all(std::shared_ptr<PageSequence const> const& pages);
+
+    PageSequence const& sequence() const
+    {
+        return *m_ptrPages;
+    }
+
+    /**
+     * \brief Adds a page, returning false if it isn't in the sequence.
+     */
+    bool insert(PageId const& page);
+
+    void insertAt(int idx)
+    {
+        m_words[idx >> 6] |= uint64_t(1) << (idx & 63);
+    }
+
+    bool contains(PageId const& page) const;
+
+    bool containsAt(int idx) const
+    {
+        return (m_words[idx >> 6] >> (idx & 63)) & 1;
+    }
+
+    int size() const;
+
+    bool empty() const;
+
+    PageSet& operator&=(PageSet const& other);
+
+    PageSet& operator|=(PageSet const& other);
+
+    PageSet& operator-=(PageSet const& other);
+
+    std::set<PageId> toPageIdSet() const;
+
+    /**
+     * \brief Iterates over the pages in sequence order.
+     */
+    const_iterator begin() const;
+
+    const_iterator end() const;
+private:
+    /**
+     * \brief Returns the position of the first page at or after \p idx,
+     *        or the number of pages if there is none.
+     */
+    int nextAt(int idx) const;
+
+    std::shared_ptr<PageSequence const> m_ptrPages;
+    std::vector<uint64_t> m_words;
+};
+
+class PageSet::const_iterator : public std::iterator<std::forward_iterator_tag, PageId const>
+{
+public:
+    const_iterator(PageSet const* set, int idx) : m_pSet(set), m_idx(idx) {}
+
+    PageId const& operator*() const
+    {
+        return m_pSet->sequence().pageAt(size_t(m_idx)).id();
+    }
+
+    PageId const* operator->() const
+    {
+        return &**this;
+    }
+
+    /**
+     * \brief The position of the page in the sequence.
+     */
+    int index() const
+    {
+        return m_idx;
+    }
+
+    const_iterator& operator++()
+    {
+        m_idx = m_pSet->nextAt(m_idx + 1);
+        return *this;
+    }
+
+    bool operator==(const_iterator const& other) const
+    {
+        return m_idx == other.m_idx;
+    }
+
+    bool operator!=(const_iterator const& other) const
+    {
+        return m_idx != other.m_idx;
+    }
+private:
+    PageSet const* m_pSet;
+    int m_idx;
+};
+
+#endif
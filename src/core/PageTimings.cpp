@@ -0,0 +1,324 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "PageTimings.h"
+#include "ImageId.h"
+#include "AtomicFileOverwriter.h"
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThreadStorage>
+#include <exception>
+#include <algorithm>
+#include <utility>
+#include <map>
+
+namespace
+{
+
+struct Frame
+{
+    QElapsedTimer timer;
+    qint64 childNsecs;
+
+    Frame() : childNsecs(0) {}
+};
+
+struct ThreadState
+{
+    std::vector<Frame> frames;
+};
+
+QString csvField(QString const& field)
+{
+    if (!field.contains(QChar(',')) && !field.contains(QChar('"'))) {
+        return field;
+    }
+    QString quoted(field);
+    quoted.replace(QLatin1String("\""), QLatin1String("\"\""));
+    return QChar('"') + quoted + QChar('"');
+}
+
+} // anonymous namespace
+
+class PageTimings::Impl
+{
+public:
+    Impl() : m_enabled(0) {}
+
+    bool isEnabled() const
+    {
+        return m_enabled.load() != 0;
+    }
+
+    void setEnabled(bool enabled)
+    {
+        m_enabled.store(enabled ? 1 : 0);
+    }
+
+    ThreadState& threadState()
+    {
+        return m_threadState.localData();
+    }
+
+    void record(PageId const& page_id, char const* stage, qint64 nsecs);
+
+    void reset();
+
+    std::vector<StageTime> pageTimes(PageId const& page_id) const;
+
+    /**
+     * Returns the stage names in the order they were first seen,
+     * along with the times of every page, indexed the same way.
+     */
+    void snapshot(
+        std::vector<QByteArray>& stages,
+        std::vector<std::pair<PageId, std::vector<qint64> > >& pages) const;
+private:
+    /** Stage index -> nanoseconds, or -1 if the page didn't go through it. */
+    typedef std::vector<qint64> StageNsecs;
+    typedef std::map<PageId, StageNsecs> PerPage;
+
+    QAtomicInt m_enabled;
+    QThreadStorage<ThreadState> m_threadState;
+    mutable QMutex m_mutex;
+    std::vector<QByteArray> m_stages;
+    PerPage m_perPage;
+};
+
+void
+PageTimings::Impl::record(PageId const& page_id, char const* stage, qint64 const nsecs)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    size_t idx = 0;
+    for (; idx < m_stages.size(); ++idx) {
+        if (m_stages[idx] == stage) {
+            break;
+        }
+    }
+    if (idx == m_stages.size()) {
+        m_stages.push_back(stage);
+    }
+
+    StageNsecs& times = m_perPage[page_id];
+    if (times.size() <= idx) {
+        times.resize(idx + 1, -1);
+    }
+    times[idx] = nsecs;
+}
+
+void
+PageTimings::Impl::reset()
+{
+    QMutexLocker const locker(&m_mutex);
+    m_perPage.clear();
+}
+
+std::vector<PageTimings::StageTime>
+PageTimings::Impl::pageTimes(PageId const& page_id) const
+{
+    std::vector<StageTime> result;
+
+    QMutexLocker const locker(&m_mutex);
+
+    // The stages before page splitting time the whole image.
+    // Those times apply to both of its pages.
+    StageNsecs times;
+    PerPage::const_iterator it(m_perPage.find(PageId(page_id.imageId())));
+    if (it != m_perPage.end()) {
+        times = it->second;
+    }
+    if (page_id.subPage() != PageId::SINGLE_PAGE) {
+        it = m_perPage.find(page_id);
+        if (it != m_perPage.end()) {
+            times.resize(std::max(times.size(), it->second.size()), -1);
+            for (size_t i = 0; i < it->second.size(); ++i) {
+                if (it->second[i] >= 0) {
+                    times[i] = it->second[i];
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < times.size(); ++i) {
+        if (times[i] >= 0) {
+            result.push_back(StageTime(m_stages[i], times[i] / 1000000.0));
+        }
+    }
+    return result;
+}
+
+void
+PageTimings::Impl::snapshot(
+    std::vector<QByteArray>& stages,
+    std::vector<std::pair<PageId, std::vector<qint64> > >& pages) const
+{
+    QMutexLocker const locker(&m_mutex);
+    stages = m_stages;
+    pages.assign(m_perPage.begin(), m_perPage.end());
+}
+
+PageTimings::Impl&
+PageTimings::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+PageTimings::Scope::Scope()
+    : m_stage(0), m_active(false)
+{
+}
+
+PageTimings::Scope::Scope(char const* stage, PageId const& page_id)
+    : m_pageId(page_id), m_stage(stage), m_active(false)
+{
+    Impl& self = impl();
+    if (!self.isEnabled()) {
+        return;
+    }
+
+    std::vector<Frame>& frames = self.threadState().frames;
+    frames.push_back(Frame());
+    frames.back().timer.start();
+    m_active = true;
+}
+
+PageTimings::Scope::~Scope()
+{
+    if (!m_active) {
+        return;
+    }
+
+    Impl& self = impl();
+    std::vector<Frame>& frames = self.threadState().frames;
+    qint64 const nsecs = frames.back().timer.nsecsElapsed();
+    qint64 const self_nsecs = nsecs - frames.back().childNsecs;
+    frames.pop_back();
+    if (!frames.empty()) {
+        frames.back().childNsecs += nsecs;
+    }
+
+    if (!std::uncaught_exception()) {
+        self.record(m_pageId, m_stage, self_nsecs);
+    }
+}
+
+void
+PageTimings::setEnabled(bool const enabled)
+{
+    impl().setEnabled(enabled);
+}
+
+bool
+PageTimings::isEnabled()
+{
+    return impl().isEnabled();
+}
+
+void
+PageTimings::reset()
+{
+    impl().reset();
+}
+
+std::vector<PageTimings::StageTime>
+PageTimings::pageTimes(PageId const& page_id)
+{
+    return impl().pageTimes(page_id);
+}
+
+double
+PageTimings::totalMsec(PageId const& page_id)
+{
+    std::vector<StageTime> const times(pageTimes(page_id));
+    if (times.empty()) {
+        return -1.0;
+    }
+
+    double total = 0.0;
+    for (StageTime const& time : times) {
+        total += time.msec;
+    }
+    return total;
+}
+
+bool
+PageTimings::writeSlowestPagesReport(QString const& file_path, size_t const max_pages)
+{
+    std::vector<QByteArray> stages;
+    std::vector<std::pair<PageId, std::vector<qint64> > > pages;
+    impl().snapshot(stages, pages);
+
+    std::vector<std::pair<qint64, size_t> > order;
+    order.reserve(pages.size());
+    for (size_t i = 0; i < pages.size(); ++i) {
+        qint64 total = 0;
+        for (qint64 const nsecs : pages[i].second) {
+            total += std::max<qint64>(nsecs, 0);
+        }
+        order.push_back(std::make_pair(-total, i));
+    }
+    std::sort(order.begin(), order.end());
+    if (max_pages != 0 && order.size() > max_pages) {
+        order.resize(max_pages);
+    }
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* file = overwriter.startWriting(file_path);
+    if (!file) {
+        return false;
+    }
+
+    QTextStream strm(file);
+    strm.setCodec("UTF-8");
+    strm << "file,page,sub_page,total_msec";
+    for (QByteArray const& stage : stages) {
+        strm << ',' << csvField(QString::fromUtf8(stage));
+    }
+    strm << '\n';
+
+    for (std::pair<qint64, size_t> const& entry : order) {
+        PageId const& page_id = pages[entry.second].first;
+        std::vector<qint64> const& times = pages[entry.second].second;
+        strm << csvField(page_id.imageId().filePath())
+             << ',' << page_id.imageId().page()
+             << ',' << page_id.subPageAsString()
+             << ',' << QString::number(-entry.first / 1000000.0, 'f', 1);
+        for (size_t i = 0; i < stages.size(); ++i) {
+            strm << ',';
+            if (i < times.size() && times[i] >= 0) {
+                strm << QString::number(times[i] / 1000000.0, 'f', 1);
+            }
+        }
+        strm << '\n';
+    }
+
+    strm.flush();
+    if (strm.status() != QTextStream::Ok) {
+        overwriter.abort();
+        return false;
+    }
+
+    return overwriter.commit();
+}
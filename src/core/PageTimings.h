@@ -0,0 +1,116 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PAGE_TIMINGS_H_
+#define PAGE_TIMINGS_H_
+
+#include "NonCopyable.h"
+#include "PageId.h"
+#include <QByteArray>
+#include <QString>
+#include <vector>
+
+/**
+ * \brief Remembers how long each page took in each stage.
+ *
+ * Unlike Profiler, which accumulates everything for a report, only the
+ * latest run of a stage on a page is kept, so the numbers reflect the
+ * current settings.  The time of a stage excludes the stages it calls
+ * into, as filter tasks call the next filter's task themselves.
+ * Pages interrupted by cancellation or errors aren't recorded.
+ *
+ * Timing is disabled by default.  The GUI enables it to let pages
+ * be ordered by processing time.
+ */
+class PageTimings
+{
+public:
+    class Scope
+    {
+        DECLARE_NON_COPYABLE(Scope)
+    public:
+        /**
+         * \brief Constructs a scope that doesn't time anything.
+         */
+        Scope();
+
+        /**
+         * \param stage The stage name.  It has to be a string literal,
+         *        as only the pointer is stored.
+         * \param page_id The page being processed.
+         */
+        Scope(char const* stage, PageId const& page_id);
+
+        ~Scope();
+    private:
+        PageId m_pageId;
+        char const* m_stage;
+        bool m_active;
+    };
+
+    struct StageTime
+    {
+        QByteArray stage;
+        double msec;
+
+        StageTime(QByteArray const& stage, double msec) : stage(stage), msec(msec) {}
+    };
+
+    static void setEnabled(bool enabled);
+
+    static bool isEnabled();
+
+    /**
+     * \brief Forgets all timings, as when switching projects.
+     */
+    static void reset();
+
+    /**
+     * \brief The times of the stages a page went through, in the order
+     *        the stages were first seen.  Empty if the page wasn't timed.
+     *
+     * For the left and right pages of a split image, the stages timed for
+     * the image as a whole are included.
+     */
+    static std::vector<StageTime> pageTimes(PageId const& page_id);
+
+    /**
+     * \brief The sum of pageTimes(), or -1 if the page wasn't timed.
+     */
+    static double totalMsec(PageId const& page_id);
+
+    /**
+     * \brief Writes a CSV table of the slowest pages, slowest first.
+     *
+     * Each row has the image file, its page number within the file,
+     * the sub-page, the total time and the time of each stage,
+     * all in milliseconds.
+     *
+     * \param file_path The file to write.
+     * \param max_pages The maximum number of rows.  0 means all pages.
+     * \return false if the file couldn't be written.
+     */
+    static bool writeSlowestPagesReport(QString const& file_path, size_t max_pages = 0);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
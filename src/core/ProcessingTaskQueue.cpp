@@ -17,46 +17,127 @@
 */
 
 #include "ProcessingTaskQueue.h"
+#include "MemoryBudget.h"
+#include "ImagePrefetcher.h"
+#include <stdlib.h>
 
 ProcessingTaskQueue::Entry::Entry(
-    PageInfo const& page_info, BackgroundTaskPtr const& tsk)
+    PageInfo const& page_info, BackgroundTaskPtr const& tsk, int const seq_no)
     :   pageInfo(page_info),
         task(tsk),
-        takenForProcessing(false)
+        seqNo(seq_no),
+        takenForProcessing(false),
+        reservedBytes(0)
 {
 }
 
 ProcessingTaskQueue::ProcessingTaskQueue(Order order)
-    :   m_order(order), m_total_pages(0)
+    :   m_order(order), m_total_pages(0), m_nextSeqNo(0),
+        m_memoryBudgeted(false)
 {
 }
 
+ProcessingTaskQueue::~ProcessingTaskQueue()
+{
+    for (Entry& ent : m_queue) {
+        releaseMemory(ent);
+    }
+    ImagePrefetcher::clear();
+}
+
+void
+ProcessingTaskQueue::releaseMemory(Entry& ent)
+{
+    if (ent.reservedBytes) {
+        MemoryBudget::release(ent.reservedBytes);
+        ent.reservedBytes = 0;
+    }
+}
+
 void
 ProcessingTaskQueue::addProcessingTask(
     PageInfo const& page_info, BackgroundTaskPtr const& task)
 {
-    m_queue.push_back(Entry(page_info, task));
+    m_queue.push_back(Entry(page_info, task, m_nextSeqNo++));
 }
 
 BackgroundTaskPtr
 ProcessingTaskQueue::takeForProcessing()
 {
-    for (Entry& ent : m_queue) {
-        if (!ent.takenForProcessing) {
-            ent.takenForProcessing = true;
-
-            if (m_order == RANDOM_ORDER) {
-                // In this mode we select the most recently submitted for processing page.
-                // This means question marks on selected pages, but at least this avoids
-                // jumps caused by dynamic ordering.
-                m_selectedPage = ent.pageInfo;
+    int focus_seq_no = -1;
+    if (!m_focusPage.isNull()) {
+        for (Entry const& ent : m_queue) {
+            if (ent.pageInfo.id() == m_focusPage) {
+                focus_seq_no = ent.seqNo;
+                break;
             }
+        }
+    }
 
-            return ent.task;
+    Entry* best = 0;
+    for (Entry& ent : m_queue) {
+        if (ent.takenForProcessing) {
+            continue;
+        }
+        if (focus_seq_no < 0) {
+            // Plain submission order.
+            best = &ent;
+            break;
+        }
+        if (!best) {
+            best = &ent;
+            continue;
         }
+        int const dist = abs(ent.seqNo - focus_seq_no);
+        int const best_dist = abs(best->seqNo - focus_seq_no);
+        // On a tie, prefer the following page, as that's where
+        // the user is more likely to go next.
+        if (dist < best_dist || (dist == best_dist && ent.seqNo > best->seqNo)) {
+            best = &ent;
+        }
+    }
+
+    if (!best) {
+        return BackgroundTaskPtr();
     }
 
-    return BackgroundTaskPtr();
+    if (m_memoryBudgeted) {
+        qint64 const footprint = MemoryBudget::estimatePageFootprint(best->pageInfo.metadata());
+        if (!MemoryBudget::tryReserve(footprint)) {
+            // Retried once some task finishes and releases its footprint.
+            return BackgroundTaskPtr();
+        }
+        best->reservedBytes = footprint;
+    }
+
+    best->takenForProcessing = true;
+
+    if (focus_seq_no < 0) {
+        // The pages to follow are known, so have them decoded
+        // while this one is being processed.
+        int to_prefetch = ImagePrefetcher::depth();
+        ImageId prev_image_id(best->pageInfo.imageId());
+        for (Entry const& ent : m_queue) {
+            if (to_prefetch <= 0) {
+                break;
+            }
+            if (ent.takenForProcessing || ent.pageInfo.imageId() == prev_image_id) {
+                continue;
+            }
+            prev_image_id = ent.pageInfo.imageId();
+            ImagePrefetcher::prefetch(prev_image_id);
+            --to_prefetch;
+        }
+    }
+
+    if (m_order == RANDOM_ORDER) {
+        // In this mode we select the most recently submitted for processing page.
+        // This means question marks on selected pages, but at least this avoids
+        // jumps caused by dynamic ordering.
+        m_selectedPage = best->pageInfo;
+    }
+
+    return best->task;
 }
 
 void
@@ -71,12 +152,7 @@ ProcessingTaskQueue::processingFinished(BackgroundTaskPtr const& task)
             return;
         }
 
-        if (!it->takenForProcessing) {
-            // There is no point in looking further.
-            return;
-        }
-
-        if (it->task == task) {
+        if (it->takenForProcessing && it->task == task) {
             break;
         }
     }
@@ -91,6 +167,7 @@ ProcessingTaskQueue::processingFinished(BackgroundTaskPtr const& task)
         m_selectedPage = it->pageInfo;
     }
 
+    releaseMemory(*it);
     m_queue.erase(it);
 }
 
@@ -106,6 +183,87 @@ ProcessingTaskQueue::allProcessed() const
     return m_queue.empty();
 }
 
+int
+ProcessingTaskQueue::numBeingProcessed() const
+{
+    int count = 0;
+    for (Entry const& ent : m_queue) {
+        if (ent.takenForProcessing) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void
+ProcessingTaskQueue::setFocusPage(PageId const& page_id)
+{
+    m_focusPage = page_id;
+}
+
+PageInfo
+ProcessingTaskQueue::pageFor(BackgroundTaskPtr const& task) const
+{
+    for (Entry const& ent : m_queue) {
+        if (ent.task == task) {
+            return ent.pageInfo;
+        }
+    }
+    return PageInfo();
+}
+
+bool
+ProcessingTaskQueue::contains(PageId const& page_id) const
+{
+    for (Entry const& ent : m_queue) {
+        if (ent.pageInfo.id() == page_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+ProcessingTaskQueue::isBeingProcessed(PageId const& page_id) const
+{
+    for (Entry const& ent : m_queue) {
+        if (ent.takenForProcessing && ent.pageInfo.id() == page_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+ProcessingTaskQueue::removeNotTaken()
+{
+    std::list<Entry>::iterator it(m_queue.begin());
+    std::list<Entry>::iterator const end(m_queue.end());
+    while (it != end) {
+        if (!it->takenForProcessing) {
+            m_queue.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+ProcessingTaskQueue::cancelAndRemoveUnfocused()
+{
+    std::list<Entry>::iterator it(m_queue.begin());
+    std::list<Entry>::iterator const end(m_queue.end());
+    while (it != end) {
+        if (it->takenForProcessing && it->pageInfo.id() != m_focusPage) {
+            it->task->cancel();
+            releaseMemory(*it);
+            m_queue.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void
 ProcessingTaskQueue::cancelAndRemove(std::set<PageId> const& pages)
 {
@@ -119,6 +277,7 @@ ProcessingTaskQueue::cancelAndRemove(std::set<PageId> const& pages)
             if (m_selectedPage.id() == it->pageInfo.id()) {
                 m_selectedPage = PageInfo();
             }
+            releaseMemory(*it);
             m_queue.erase(it++);
         } else {
             ++it;
@@ -134,7 +293,9 @@ ProcessingTaskQueue::cancelAndClear()
         if (ent.takenForProcessing) {
             ent.task->cancel();
         }
+        releaseMemory(ent);
         m_queue.pop_front();
     }
     m_selectedPage = PageInfo();
+    m_focusPage = PageId();
 }
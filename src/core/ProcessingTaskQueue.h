@@ -39,12 +39,32 @@ public:
 
     ProcessingTaskQueue(Order order);
 
+    ~ProcessingTaskQueue();
+
+    /**
+     * \brief Makes takeForProcessing() respect MemoryBudget.
+     *
+     * A task is only taken once the estimated footprint of its page
+     * fits into the budget.  The footprint is released when the task
+     * is finished or removed.
+     */
+    void setMemoryBudgeted(bool budgeted)
+    {
+        m_memoryBudgeted = budgeted;
+    }
+
     void addProcessingTask(PageInfo const& page_info, BackgroundTaskPtr const& task);
 
     /**
      * The first task among those that haven't been already taken for processing
      * is marked as taken and returned.  A null task will be returned if there
      * are no such tasks.
+     *
+     * If a focus page is set, the task for that page is taken first,
+     * followed by tasks for its neighbours in submission order, nearest first.
+     *
+     * A null task is also returned if the queue is memory-budgeted
+     * and the next task's page doesn't fit into the budget yet.
      */
     BackgroundTaskPtr takeForProcessing();
 
@@ -61,6 +81,56 @@ public:
 
     bool allProcessed() const;
 
+    /**
+     * \brief Returns the number of tasks taken for processing
+     *        but not yet reported as finished.
+     */
+    int numBeingProcessed() const;
+
+    /**
+     * \brief Sets the page whose task should be taken before any other.
+     *
+     * A null PageId restores plain submission order.  The focus page
+     * doesn't have to be in the queue, in which case it's just remembered.
+     */
+    void setFocusPage(PageId const& page_id);
+
+    PageId const& focusPage() const
+    {
+        return m_focusPage;
+    }
+
+    /**
+     * \brief Returns the page the task was submitted for, or a null
+     *        PageInfo if there is no such task in the queue.
+     */
+    PageInfo pageFor(BackgroundTaskPtr const& task) const;
+
+    bool contains(PageId const& page_id) const;
+
+    /**
+     * \brief Returns true if a task for the given page was taken for
+     *        processing and hasn't finished yet.
+     */
+    bool isBeingProcessed(PageId const& page_id) const;
+
+    /**
+     * \brief Removes tasks that haven't been taken for processing.
+     *
+     * There is nothing to cancel for those.
+     */
+    void removeNotTaken();
+
+    /**
+     * \brief Cancels and removes tasks being processed for pages
+     *        other than the focus page.
+     *
+     * Cancellation is cooperative: the worker abandons the task the next
+     * time it checks for it, which frees the worker for something more
+     * urgent.
+     */
+    void cancelAndRemoveUnfocused();
+
     void cancelAndRemove(std::set<PageId> const& pages);
 
     void cancelAndClear();
@@ -78,15 +148,22 @@ private:
     struct Entry {
         PageInfo pageInfo;
         BackgroundTaskPtr task;
+        int seqNo;
         bool takenForProcessing;
+        qint64 reservedBytes;
 
-        Entry(PageInfo const& page_info, BackgroundTaskPtr const& task);
+        Entry(PageInfo const& page_info, BackgroundTaskPtr const& task, int seq_no);
     };
 
+    void releaseMemory(Entry& ent);
+
     std::list<Entry> m_queue;
     PageInfo m_selectedPage;
+    PageId m_focusPage;
     Order m_order;
     int m_total_pages;
+    int m_nextSeqNo;
+    bool m_memoryBudgeted;
 };
 
 #endif
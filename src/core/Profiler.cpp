@@ -0,0 +1,377 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Profiler.h"
+#include "PageId.h"
+#include "ImageId.h"
+#include "AtomicFileOverwriter.h"
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThreadStorage>
+#include <QtGlobal>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+
+typedef std::map<QByteArray, qint64> Counters;
+
+struct RegionStats
+{
+    qint64 calls;
+    qint64 nsecs;
+    qint64 selfNsecs;
+    qint64 peakBytes;
+    qint64 allocatedBytes;
+    Counters counters;
+
+    RegionStats() : calls(0), nsecs(0), selfNsecs(0), peakBytes(0), allocatedBytes(0) {}
+
+    void merge(RegionStats const& other)
+    {
+        calls += other.calls;
+        nsecs += other.nsecs;
+        selfNsecs += other.selfNsecs;
+        peakBytes = std::max(peakBytes, other.peakBytes);
+        allocatedBytes += other.allocatedBytes;
+        for (Counters::value_type const& kv : other.counters) {
+            counters[kv.first] += kv.second;
+        }
+    }
+};
+
+/** Region path -> stats. */
+typedef std::map<QByteArray, RegionStats> PerRegionStats;
+
+struct Frame
+{
+    QByteArray path;
+    QString page;
+    QElapsedTimer timer;
+    qint64 childNsecs;
+    Counters counters;
+    IntrusivePtr<MemoryAccounting::Account> account;
+
+    Frame() : childNsecs(0) {}
+};
+
+struct ThreadState
+{
+    std::vector<Frame> frames;
+};
+
+QString pageLabel(PageId const& page_id)
+{
+    ImageId const& image_id = page_id.imageId();
+    QString label(QFileInfo(image_id.filePath()).fileName());
+    if (image_id.isMultiPageFile()) {
+        label += QChar('#') + QString::number(image_id.page());
+    }
+    if (page_id.subPage() != PageId::SINGLE_PAGE) {
+        label += QChar(':') + page_id.subPageAsString();
+    }
+    return label;
+}
+
+/**
+ * Returns the peak resident set size of the process, in KiB, or -1.
+ */
+qint64 peakResidentSetKb()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+    return qint64(counters.PeakWorkingSetSize / 1024);
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(Q_OS_MAC)
+    return qint64(usage.ru_maxrss / 1024); // Bytes on OS X.
+#else
+    return qint64(usage.ru_maxrss);
+#endif
+#else
+    return -1;
+#endif
+}
+
+QJsonArray regionsToJson(PerRegionStats const& regions)
+{
+    QJsonArray array;
+    for (PerRegionStats::value_type const& kv : regions) {
+        QJsonObject region;
+        region.insert("region", QString::fromUtf8(kv.first));
+        region.insert("calls", double(kv.second.calls));
+        region.insert("msec", double(kv.second.nsecs) / 1000000.0);
+        region.insert("self_msec", double(kv.second.selfNsecs) / 1000000.0);
+        region.insert("peak_bytes", double(kv.second.peakBytes));
+        region.insert("allocated_bytes", double(kv.second.allocatedBytes));
+        if (!kv.second.counters.empty()) {
+            QJsonObject counters;
+            for (Counters::value_type const& counter : kv.second.counters) {
+                counters.insert(QString::fromUtf8(counter.first), double(counter.second));
+            }
+            region.insert("counters", counters);
+        }
+        array.append(region);
+    }
+    return array;
+}
+
+} // anonymous namespace
+
+class Profiler::Impl
+{
+public:
+    Impl() : m_enabled(0) {}
+
+    bool isEnabled() const
+    {
+        return m_enabled.load() != 0;
+    }
+
+    void setEnabled(bool enabled)
+    {
+        m_enabled.store(enabled ? 1 : 0);
+    }
+
+    ThreadState& threadState()
+    {
+        return m_threadState.localData();
+    }
+
+    void record(QString const& page, QByteArray const& path,
+                RegionStats const& stats);
+
+    void reset();
+
+    QJsonDocument report() const;
+private:
+    /** Page label -> per-region stats. */
+    typedef std::map<QString, PerRegionStats> PerPageStats;
+
+    QAtomicInt m_enabled;
+    QThreadStorage<ThreadState> m_threadState;
+    mutable QMutex m_mutex;
+    PerPageStats m_perPageStats;
+};
+
+void
+Profiler::Impl::record(
+    QString const& page, QByteArray const& path, RegionStats const& stats)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_perPageStats[page][path].merge(stats);
+}
+
+void
+Profiler::Impl::reset()
+{
+    QMutexLocker const locker(&m_mutex);
+    m_perPageStats.clear();
+}
+
+QJsonDocument
+Profiler::Impl::report() const
+{
+    PerPageStats per_page;
+    {
+        QMutexLocker const locker(&m_mutex);
+        per_page = m_perPageStats;
+    }
+
+    QJsonArray pages;
+    PerRegionStats per_stage;
+    for (PerPageStats::value_type const& kv : per_page) {
+        QJsonObject page;
+        qint64 page_peak_bytes = 0;
+        for (PerRegionStats::value_type const& region : kv.second) {
+            per_stage[region.first].merge(region.second);
+            page_peak_bytes = std::max(page_peak_bytes, region.second.peakBytes);
+        }
+
+        page.insert("page", kv.first);
+        page.insert("peak_bytes", double(page_peak_bytes));
+        page.insert("regions", regionsToJson(kv.second));
+        pages.append(page);
+    }
+
+    QJsonObject root;
+    root.insert("pages", pages);
+    root.insert("stages", regionsToJson(per_stage));
+    root.insert("peak_rss_kb", double(peakResidentSetKb()));
+    root.insert("peak_buffer_bytes", double(MemoryAccounting::peakBytes()));
+    return QJsonDocument(root);
+}
+
+Profiler::Impl&
+Profiler::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+Profiler::Scope::Scope(char const* region)
+    : m_traceSpan(region), m_active(false)
+{
+    if (Profiler::isEnabled()) {
+        begin(region, 0);
+    }
+}
+
+Profiler::Scope::Scope(char const* region, PageId const& page_id)
+    : m_traceSpan(region), m_pageTimings(region, page_id), m_active(false)
+{
+    if (Profiler::isEnabled()) {
+        QString const page(pageLabel(page_id));
+        begin(region, &page);
+    }
+}
+
+void
+Profiler::Scope::begin(char const* region, QString const* page)
+{
+    std::vector<Frame>& frames = impl().threadState().frames;
+
+    Frame frame;
+    if (frames.empty()) {
+        frame.path = region;
+        frame.account.reset(new MemoryAccounting::Account);
+    } else {
+        frame.path = frames.back().path + '/' + region;
+        frame.page = frames.back().page;
+        frame.account.reset(new MemoryAccounting::Account(frames.back().account));
+    }
+    if (page) {
+        frame.page = *page;
+    }
+
+    frames.push_back(frame);
+    m_ptrMemoryScope.reset(new MemoryAccounting::Scope(frame.account));
+    frames.back().timer.start();
+    m_active = true;
+}
+
+Profiler::Scope::~Scope()
+{
+    if (!m_active) {
+        return;
+    }
+
+    Impl& self = impl();
+    std::vector<Frame>& frames = self.threadState().frames;
+    Frame& frame = frames.back();
+
+    RegionStats stats;
+    stats.calls = 1;
+    stats.nsecs = frame.timer.nsecsElapsed();
+    stats.selfNsecs = stats.nsecs - frame.childNsecs;
+    stats.peakBytes = frame.account->peakBytes();
+    stats.allocatedBytes = frame.account->allocatedBytes();
+    stats.counters.swap(frame.counters);
+    self.record(frame.page, frame.path, stats);
+
+    m_ptrMemoryScope.reset();
+
+    frames.pop_back();
+    if (!frames.empty()) {
+        frames.back().childNsecs += stats.nsecs;
+    }
+}
+
+void
+Profiler::setEnabled(bool const enabled)
+{
+    impl().setEnabled(enabled);
+}
+
+bool
+Profiler::isEnabled()
+{
+    return impl().isEnabled();
+}
+
+void
+Profiler::reset()
+{
+    impl().reset();
+}
+
+void
+Profiler::addCounter(char const* name, qint64 const value)
+{
+    Impl& self = impl();
+    if (!self.isEnabled()) {
+        return;
+    }
+
+    std::vector<Frame>& frames = self.threadState().frames;
+    if (!frames.empty()) {
+        frames.back().counters[name] += value;
+        return;
+    }
+
+    // Not inside any region, so record it on its own.
+    RegionStats stats;
+    stats.counters[name] = value;
+    self.record(QString(), QByteArray(), stats);
+}
+
+QJsonDocument
+Profiler::report()
+{
+    return impl().report();
+}
+
+bool
+Profiler::writeReport(QString const& file_path)
+{
+    AtomicFileOverwriter overwriter;
+    QIODevice* file = overwriter.startWriting(file_path);
+    if (!file) {
+        return false;
+    }
+
+    if (file->write(report().toJson()) < 0) {
+        overwriter.abort();
+        return false;
+    }
+
+    return overwriter.commit();
+}
@@ -0,0 +1,114 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include "NonCopyable.h"
+#include "TraceRecorder.h"
+#include "PageTimings.h"
+#include "MemoryAccounting.h"
+#include <QString>
+#include <QtGlobal>
+#include <memory>
+
+class PageId;
+class QJsonDocument;
+
+/**
+ * \brief Collects per-page, per-stage timings and counters.
+ *
+ * Code under measurement opens a Profiler::Scope for each named region.
+ * Scopes nest within a thread, forming hierarchical region paths like
+ * "output/dewarping".  The page a scope belongs to is given to the
+ * outermost scope and inherited by the nested ones.  Counters, such as
+ * pixels processed or bytes read, are attributed to the innermost open
+ * scope of the calling thread.
+ *
+ * While profiling, each scope also has a MemoryAccounting account,
+ * so the peak size of the pixel buffers allocated within a region
+ * is known as well.
+ *
+ * Profiling is disabled by default, in which case scopes and counters
+ * cost a single flag check.  Scopes also show up as spans in TraceRecorder
+ * timelines, if that is enabled, and scopes given a page feed PageTimings.
+ */
+class Profiler
+{
+public:
+    class Scope
+    {
+        DECLARE_NON_COPYABLE(Scope)
+    public:
+        explicit Scope(char const* region);
+
+        Scope(char const* region, PageId const& page_id);
+
+        ~Scope();
+    private:
+        void begin(char const* region, QString const* page);
+
+        TraceRecorder::Span m_traceSpan;
+        PageTimings::Scope m_pageTimings;
+        std::unique_ptr<MemoryAccounting::Scope> m_ptrMemoryScope;
+        bool m_active;
+    };
+
+    static void setEnabled(bool enabled);
+
+    static bool isEnabled();
+
+    /**
+     * \brief Discards everything collected so far.
+     */
+    static void reset();
+
+    /**
+     * \brief Adds \p value to the named counter of the current region.
+     */
+    static void addCounter(char const* name, qint64 value);
+
+    /**
+     * \brief Builds a report of what was collected so far.
+     *
+     * The report has a "pages" array, with regions broken down by page,
+     * and a "stages" array, with the same regions summed over all pages.
+     * Each region carries its call count, its total time in "msec", the
+     * part of it not spent in nested regions in "self_msec", and its
+     * counters.  "peak_bytes" is the most pixel buffer memory the region
+     * had allocated at once, and "allocated_bytes" all it ever allocated.
+     * Each page has its own "peak_bytes" as well.  Over pages, peaks are
+     * combined by taking the maximum.  The peak memory use of the process
+     * so far is in "peak_rss_kb", and the part of it taken by pixel buffers
+     * in "peak_buffer_bytes".
+     */
+    static QJsonDocument report();
+
+    /**
+     * \brief Writes report() to a file.
+     *
+     * \return false if the file couldn't be written.
+     */
+    static bool writeReport(QString const& file_path);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
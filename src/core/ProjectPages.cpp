@@ -117,12 +117,23 @@ ProjectPages::initSubPagesInOrder(Qt::LayoutDirection const layout_direction)
 
 PageSequence
 ProjectPages::toPageSequence(PageView const view) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    std::shared_ptr<PageSequence const>& cached = m_ptrPageSequences[view];
+    if (!cached) {
+        cached.reset(new PageSequence(buildPageSequence(view)));
+    }
+
+    return *cached;
+}
+
+PageSequence
+ProjectPages::buildPageSequence(PageView const view) const
 {
     PageSequence pages;
 
     if (view == PAGE_VIEW) {
-        QMutexLocker locker(&m_mutex);
-
         int const num_images = m_images.size();
         for (int i = 0; i < num_images; ++i) {
             ImageDesc const& image = m_images[i];
@@ -147,8 +158,6 @@ ProjectPages::toPageSequence(PageView const view) const
     } else {
         assert(view == IMAGE_VIEW);
 
-        QMutexLocker locker(&m_mutex);
-
         int const num_images = m_images.size();
         for (int i = 0; i < num_images; ++i) {
             ImageDesc const& image = m_images[i];
@@ -167,6 +176,13 @@ ProjectPages::toPageSequence(PageView const view) const
     return pages;
 }
 
+void
+ProjectPages::invalidatePageSequences()
+{
+    m_ptrPageSequences[IMAGE_VIEW].reset();
+    m_ptrPageSequences[PAGE_VIEW].reset();
+}
+
 void
 ProjectPages::listRelinkablePaths(VirtualFunction1<void, RelinkablePath const&>& sink) const
 {
@@ -198,6 +214,8 @@ ProjectPages::performRelinking(AbstractRelinker const& relinker)
         QString const new_path(relinker.substitutionPathFor(old_path));
         image.id.setFilePath(new_path);
     }
+
+    invalidatePageSequences();
 }
 
 void
@@ -208,6 +226,7 @@ ProjectPages::setLayoutTypeFor(ImageId const& image_id, LayoutType const layout)
     {
         QMutexLocker locker(&m_mutex);
         setLayoutTypeForImpl(image_id, layout, &was_modified);
+        invalidatePageSequences();
     }
 
     if (was_modified) {
@@ -223,6 +242,7 @@ ProjectPages::setLayoutTypeForAllPages(LayoutType const layout)
     {
         QMutexLocker locker(&m_mutex);
         setLayoutTypeForAllPagesImpl(layout, &was_modified);
+        invalidatePageSequences();
     }
 
     if (was_modified) {
@@ -239,6 +259,7 @@ ProjectPages::autoSetLayoutTypeFor(
     {
         QMutexLocker locker(&m_mutex);
         autoSetLayoutTypeForImpl(image_id, rotation, &was_modified);
+        invalidatePageSequences();
     }
 
     if (was_modified) {
@@ -255,6 +276,7 @@ ProjectPages::updateImageMetadata(
     {
         QMutexLocker locker(&m_mutex);
         updateImageMetadataImpl(image_id, metadata, &was_modified);
+        invalidatePageSequences();
     }
 
     if (was_modified) {
@@ -302,6 +324,7 @@ ProjectPages::insertImage(
         res = insertImageImpl(
                   new_image, before_or_after, existing, view, was_modified
               );
+        invalidatePageSequences();
     }
 
     if (was_modified) {
@@ -319,6 +342,7 @@ ProjectPages::removePages(std::set<PageId> const& pages)
     {
         QMutexLocker locker(&m_mutex);
         removePagesImpl(pages, was_modified);
+        invalidatePageSequences();
     }
 
     if (was_modified) {
@@ -336,6 +360,7 @@ ProjectPages::unremovePage(PageId const& page_id)
     {
         QMutexLocker locker(&m_mutex);
         page_info = unremovePageImpl(page_id, was_modified);
+        invalidatePageSequences();
     }
 
     if (was_modified) {
@@ -439,6 +464,8 @@ ProjectPages::updateMetadataFrom(std::vector<ImageFileInfo> const& files)
             image.metadata = it->second;
         }
     }
+
+    invalidatePageSequences();
 }
 
 void
@@ -34,6 +34,7 @@
 #include <Qt>
 #include <set>
 #include <vector>
+#include <memory>
 #include <stddef.h>
 
 class ImageFileInfo;
@@ -159,6 +160,13 @@ private:
 
     void initSubPagesInOrder(Qt::LayoutDirection layout_direction);
 
+    PageSequence buildPageSequence(PageView view) const;
+
+    /**
+     * To be called with m_mutex held whenever m_images changes.
+     */
+    void invalidatePageSequences();
+
     void setLayoutTypeForImpl(
         ImageId const& image_id, LayoutType layout, bool* modified);
 
@@ -185,6 +193,13 @@ private:
     mutable QMutex m_mutex;
     std::vector<ImageDesc> m_images;
     PageId::SubPage m_subPagesInOrder[2];
+
+    /**
+     * toPageSequence() results, indexed by PageView, or null if not built yet.
+     * Navigation and batch processing ask for them all the time, while
+     * the pages themselves change rarely.
+     */
+    mutable std::shared_ptr<PageSequence const> m_ptrPageSequences[2];
 };
 
 #endif
@@ -20,73 +20,318 @@
 #include "ProjectPages.h"
 #include "FileNameDisambiguator.h"
 #include "AbstractFilter.h"
-#include "XmlUnmarshaller.h"
 #include "Dpi.h"
+#include "ImageMetadataCache.h"
+#include "AtomicFileOverwriter.h"
 #include <QSize>
 #include <QDir>
+#include <QFile>
+#include <QBuffer>
+#include <QByteArray>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QHash>
+#include <QVector>
 #include <QDomElement>
 #include <QDomNode>
+#include <QDomNamedNodeMap>
+#include <QIODevice>
+#include <QXmlStreamReader>
 #ifndef Q_MOC_RUN
 #include <boost/bind.hpp>
 #endif
 #include <set>
+#include <algorithm>
+#include <stdint.h>
 
-ProjectReader::ProjectReader(QDomDocument const& doc)
-    :   m_doc(doc),
-        m_ptrDisambiguator(new FileNameDisambiguator)
+namespace
 {
-    QDomElement project_el(m_doc.documentElement());
-    m_outDir = project_el.attribute("outputDirectory");
 
-    Qt::LayoutDirection layout_direction = Qt::LeftToRight;
-    if (project_el.attribute("layoutDirection") == "RTL") {
-        layout_direction = Qt::RightToLeft;
+/**
+ * The snapshot is a QDataStream of what the constructor decodes from XML:
+ * files with their probed metadata, images in the order of the project
+ * file, pages, the selected page, and the file name disambiguation and
+ * filter settings subtrees, which are stored as binary DOM trees.
+ */
+uint32_t const SNAPSHOT_MAGIC = 0x50535453; // "STSP"
+uint32_t const SNAPSHOT_VERSION = 1;
+
+enum DomNodeKind { DOM_END, DOM_ELEMENT, DOM_TEXT, DOM_CDATA };
+
+/**
+ * Writes DOM trees with tag names, attributes and text referring
+ * to a table of distinct strings, which a project has relatively few of.
+ */
+class DomEncoder
+{
+public:
+    DomEncoder() : m_tree(&m_treeData, QIODevice::WriteOnly) {}
+
+    /**
+     * Encodes the children of \p parent and everything below them.
+     */
+    void encodeChildren(QDomNode const& parent)
+    {
+        QDomNode node(parent.firstChild());
+        for (; !node.isNull(); node = node.nextSibling()) {
+            if (node.isElement()) {
+                QDomElement const el(node.toElement());
+                QDomNamedNodeMap const attrs(el.attributes());
+                m_tree << quint8(DOM_ELEMENT) << intern(el.tagName()) << quint32(attrs.count());
+                for (int i = 0; i < attrs.count(); ++i) {
+                    QDomAttr const attr(attrs.item(i).toAttr());
+                    m_tree << intern(attr.name()) << intern(attr.value());
+                }
+                encodeChildren(el);
+            } else if (node.isCDATASection()) {
+                m_tree << quint8(DOM_CDATA) << intern(node.toCDATASection().data());
+            } else if (node.isText()) {
+                m_tree << quint8(DOM_TEXT) << intern(node.toText().data());
+            }
+        }
+        m_tree << quint8(DOM_END);
     }
 
-    QDomElement const dirs_el(project_el.namedItem("directories").toElement());
-    if (dirs_el.isNull()) {
+    void writeTo(QDataStream& strm) const
+    {
+        strm << m_strings << m_treeData;
+    }
+private:
+    quint32 intern(QString const& str)
+    {
+        QHash<QString, quint32>::const_iterator const it(m_stringIds.constFind(str));
+        if (it != m_stringIds.constEnd()) {
+            return it.value();
+        }
+        quint32 const id = m_strings.size();
+        m_strings.push_back(str);
+        m_stringIds.insert(str, id);
+        return id;
+    }
+
+    QVector<QString> m_strings;
+    QHash<QString, quint32> m_stringIds;
+    QByteArray m_treeData;
+    QDataStream m_tree;
+};
+
+class DomDecoder
+{
+public:
+    explicit DomDecoder(QDataStream& strm)
+    {
+        strm >> m_strings >> m_treeData;
+    }
+
+    /**
+     * Decodes a tree written by DomEncoder into \p doc.
+     * Returns false if the data is damaged.
+     */
+    bool decode(QDomDocument& doc)
+    {
+        QDataStream tree(m_treeData);
+        return decodeChildren(tree, doc, doc) && tree.status() == QDataStream::Ok;
+    }
+private:
+    bool decodeChildren(QDataStream& tree, QDomDocument& doc, QDomNode parent) const
+    {
+        for (;;) {
+            quint8 kind = DOM_END;
+            quint32 id = 0;
+            tree >> kind;
+            if (tree.status() != QDataStream::Ok) {
+                return false;
+            }
+            switch (kind) {
+            case DOM_END:
+                return true;
+            case DOM_ELEMENT: {
+                quint32 num_attrs = 0;
+                tree >> id >> num_attrs;
+                if (id >= quint32(m_strings.size())) {
+                    return false;
+                }
+                QDomElement el(doc.createElement(m_strings[id]));
+                for (quint32 i = 0; i < num_attrs; ++i) {
+                    quint32 name_id = 0;
+                    quint32 value_id = 0;
+                    tree >> name_id >> value_id;
+                    if (tree.status() != QDataStream::Ok
+                            || name_id >= quint32(m_strings.size())
+                            || value_id >= quint32(m_strings.size())) {
+                        return false;
+                    }
+                    el.setAttribute(m_strings[name_id], m_strings[value_id]);
+                }
+                parent.appendChild(el);
+                if (!decodeChildren(tree, doc, el)) {
+                    return false;
+                }
+                break;
+            }
+            case DOM_TEXT:
+            case DOM_CDATA:
+                tree >> id;
+                if (id >= quint32(m_strings.size())) {
+                    return false;
+                }
+                if (kind == DOM_TEXT) {
+                    parent.appendChild(doc.createTextNode(m_strings[id]));
+                } else {
+                    parent.appendChild(doc.createCDATASection(m_strings[id]));
+                }
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+
+    QVector<QString> m_strings;
+    QByteArray m_treeData;
+};
+
+void writeMetadata(QDataStream& strm, ImageMetadata const& metadata)
+{
+    strm << metadata.size()
+         << qint32(metadata.dpi().horizontal()) << qint32(metadata.dpi().vertical())
+         << metadata.isGrayScale() << metadata.haveColorStats()
+         << qint32(metadata.saturatedPerMille()) << qint32(metadata.backgroundLevel());
+}
+
+ImageMetadata readMetadata(QDataStream& strm)
+{
+    QSize size;
+    qint32 dpi_x = 0;
+    qint32 dpi_y = 0;
+    bool gs = true;
+    bool have_color_stats = false;
+    qint32 saturated = 0;
+    qint32 background = 255;
+    strm >> size >> dpi_x >> dpi_y >> gs >> have_color_stats >> saturated >> background;
+
+    ImageMetadata metadata(size, Dpi(dpi_x, dpi_y), gs);
+    if (have_color_stats) {
+        metadata.setColorStats(gs, saturated, background);
+    }
+    return metadata;
+}
+
+} // anonymous namespace
+
+ProjectReader::ProjectReader(QIODevice& device)
+    :   m_ptrDisambiguator(new FileNameDisambiguator),
+        m_wellFormed(false)
+{
+    parse(device);
+}
+
+ProjectReader::ProjectReader(QIODevice& device, QString const& snapshot_file)
+    :   m_ptrDisambiguator(new FileNameDisambiguator),
+        m_wellFormed(false)
+{
+    if (snapshot_file.isEmpty()) {
+        parse(device);
+        return;
+    }
+
+    // Hashing the file takes a small fraction of the time parsing it does.
+    QByteArray const xml(device.readAll());
+    QByteArray const xml_hash(QCryptographicHash::hash(xml, QCryptographicHash::Sha1));
+    if (loadSnapshot(snapshot_file, xml_hash)) {
         return;
     }
-    processDirectories(dirs_el);
 
-    QDomElement const files_el(project_el.namedItem("files").toElement());
-    if (files_el.isNull()) {
+    QBuffer buffer;
+    buffer.setData(xml);
+    buffer.open(QIODevice::ReadOnly);
+    parse(buffer);
+
+    if (success()) {
+        saveSnapshot(snapshot_file, xml_hash);
+    }
+}
+
+ProjectReader::~ProjectReader()
+{
+}
+
+void
+ProjectReader::parse(QIODevice& device)
+{
+    QXmlStreamReader xml(&device);
+    if (!xml.readNextStartElement()) {
         return;
     }
-    processFiles(files_el);
 
-    QDomElement const images_el(project_el.namedItem("images").toElement());
-    if (images_el.isNull()) {
+    QXmlStreamAttributes const project_attrs(xml.attributes());
+    m_outDir = project_attrs.value("outputDirectory").toString();
+
+    Qt::LayoutDirection layout_direction = Qt::LeftToRight;
+    if (project_attrs.value("layoutDirection") == "RTL") {
+        layout_direction = Qt::RightToLeft;
+    }
+
+    // Sections are expected in the order ProjectWriter produces them.
+    // Each one depends on the previous ones being present.
+    int stage = 0;
+
+    while (xml.readNextStartElement()) {
+        QStringRef const name(xml.name());
+        if (name == "directories" && stage == 0) {
+            processDirectories(xml);
+            stage = 1;
+        } else if (name == "files" && stage == 1) {
+            processFiles(xml);
+            stage = 2;
+        } else if (name == "images" && stage == 2) {
+            processImages(xml, layout_direction);
+            stage = 3;
+        } else if (name == "pages" && stage == 3) {
+            processPages(xml);
+            stage = 4;
+        } else if (name == "file-name-disambiguation") {
+            m_disambiguationDoc = QDomDocument();
+            m_disambiguationDoc.appendChild(readDomElement(xml, m_disambiguationDoc));
+        } else if (name == "filters") {
+            m_filtersDoc.appendChild(readDomElement(xml, m_filtersDoc));
+        } else {
+            xml.skipCurrentElement();
+        }
+    }
+
+    if (xml.hasError()) {
+        m_ptrPages.reset();
         return;
     }
-    processImages(images_el, layout_direction);
 
-    QDomElement const pages_el(project_el.namedItem("pages").toElement());
-    if (pages_el.isNull()) {
+    m_wellFormed = true;
+
+    if (stage < 4) {
+        // The project is incomplete.
+        m_ptrPages.reset();
         return;
     }
-    processPages(pages_el);
 
     // Load naming disambiguator.  This needs to be done after processing pages.
-    QDomElement const disambig_el(
-        project_el.namedItem("file-name-disambiguation").toElement()
-    );
+    createDisambiguator();
+}
+
+void
+ProjectReader::createDisambiguator()
+{
     m_ptrDisambiguator.reset(
         new FileNameDisambiguator(
-            disambig_el, boost::bind(&ProjectReader::expandFilePath, this, _1)
+            m_disambiguationDoc.documentElement(),
+            boost::bind(&ProjectReader::expandFilePath, this, _1)
         )
     );
 }
 
-ProjectReader::~ProjectReader()
-{
-}
-
 void
 ProjectReader::readFilterSettings(std::vector<FilterPtr> const& filters) const
 {
-    QDomElement project_el(m_doc.documentElement());
-    QDomElement filters_el(project_el.namedItem("filters").toElement());
+    QDomElement filters_el(m_filtersDoc.documentElement());
 
     std::vector<FilterPtr>::const_iterator it(filters.begin());
     std::vector<FilterPtr>::const_iterator const end(filters.end());
@@ -96,27 +341,23 @@ ProjectReader::readFilterSettings(std::vector<FilterPtr> const& filters) const
 }
 
 void
-ProjectReader::processDirectories(QDomElement const& dirs_el)
+ProjectReader::processDirectories(QXmlStreamReader& xml)
 {
-    QString const dir_tag_name("directory");
-
-    QDomNode node(dirs_el.firstChild());
-    for (; !node.isNull(); node = node.nextSibling()) {
-        if (!node.isElement()) {
+    while (xml.readNextStartElement()) {
+        if (xml.name() != "directory") {
+            xml.skipCurrentElement();
             continue;
         }
-        if (node.nodeName() != dir_tag_name) {
-            continue;
-        }
-        QDomElement el(node.toElement());
+        QXmlStreamAttributes const attrs(xml.attributes());
+        xml.skipCurrentElement();
 
         bool ok = true;
-        int const id = el.attribute("id").toInt(&ok);
+        int const id = attrs.value("id").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
 
-        QString const path(el.attribute("path"));
+        QString const path(attrs.value("path").toString());
         if (path.isEmpty()) {
             continue;
         }
@@ -127,31 +368,34 @@ ProjectReader::processDirectories(QDomElement const& dirs_el)
 }
 
 void
-ProjectReader::processFiles(QDomElement const& files_el)
+ProjectReader::processFiles(QXmlStreamReader& xml)
 {
-    QString const file_tag_name("file");
-
-    QDomNode node(files_el.firstChild());
-    for (; !node.isNull(); node = node.nextSibling()) {
-        if (!node.isElement()) {
+    while (xml.readNextStartElement()) {
+        if (xml.name() != "file") {
+            xml.skipCurrentElement();
             continue;
         }
-        if (node.nodeName() != file_tag_name) {
-            continue;
+        QXmlStreamAttributes const attrs(xml.attributes());
+        ImageMetadataCache::Entry probed;
+        while (xml.readNextStartElement()) {
+            if (xml.name() == "page") {
+                probed.pages.push_back(processImageMetadata(xml));
+            } else {
+                xml.skipCurrentElement();
+            }
         }
-        QDomElement el(node.toElement());
 
         bool ok = true;
-        int const id = el.attribute("id").toInt(&ok);
+        int const id = attrs.value("id").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
-        int const dir_id = el.attribute("dirId").toInt(&ok);
+        int const dir_id = attrs.value("dirId").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
 
-        QString const name(el.attribute("name"));
+        QString const name(attrs.value("name").toString());
         if (name.isEmpty()) {
             continue;
         }
@@ -162,52 +406,61 @@ ProjectReader::processFiles(QDomElement const& files_el)
         }
 
         // Backwards compatibility.
-        bool const compat_multi_page = (el.attribute("multiPage") == "1");
+        bool const compat_multi_page = (attrs.value("multiPage") == "1");
 
         QString const file_path(QDir(dir_path).filePath(name));
         FileRecord const rec(file_path, compat_multi_page);
         m_fileMap.insert(FileMap::value_type(id, rec));
+
+        // Hand what was probed from the file to ImageMetadataCache,
+        // which checks it against the file once it's asked for.
+        // An entry already there is at least as recent.
+        probed.size = attrs.value("size").toString().toLongLong(&ok);
+        if (ok) {
+            probed.lastModified = attrs.value("modified").toString().toLongLong(&ok);
+        }
+        ImageMetadataCache::Entry existing;
+        if (ok && !probed.pages.empty()
+                && !ImageMetadataCache::peek(file_path, existing)) {
+            probed.status = ImageMetadataLoader::LOADED;
+            ImageMetadataCache::store(file_path, probed);
+        }
     }
 }
 
 void
 ProjectReader::processImages(
-    QDomElement const& images_el,
-    Qt::LayoutDirection const layout_direction)
+    QXmlStreamReader& xml, Qt::LayoutDirection const layout_direction)
 {
-    QString const image_tag_name("image");
-
     std::vector<ImageInfo> images;
 
-    QDomNode node(images_el.firstChild());
-    for (; !node.isNull(); node = node.nextSibling()) {
-        if (!node.isElement()) {
-            continue;
-        }
-        if (node.nodeName() != image_tag_name) {
+    while (xml.readNextStartElement()) {
+        if (xml.name() != "image") {
+            xml.skipCurrentElement();
             continue;
         }
-        QDomElement el(node.toElement());
+        QXmlStreamAttributes const attrs(xml.attributes());
+        ImageMetadata const metadata(processImageMetadata(xml));
 
         bool ok = true;
-        int const id = el.attribute("id").toInt(&ok);
+        int const id = attrs.value("id").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
-        int const sub_pages = el.attribute("subPages").toInt(&ok);
+        int const sub_pages = attrs.value("subPages").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
-        int const file_id = el.attribute("fileId").toInt(&ok);
+        int const file_id = attrs.value("fileId").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
-        int const file_image = el.attribute("fileImage").toInt(&ok);
+        int const file_image = attrs.value("fileImage").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
 
-        QString const removed(el.attribute("removed"));
+        QStringRef const removed(attrs.value("removed"));
         bool const left_half_removed = (removed == "L");
         bool const right_half_removed = (removed == "R");
 
@@ -219,7 +472,6 @@ ProjectReader::processImages(
             file_record.filePath,
             file_image + int(file_record.compatMultiPage)
         );
-        ImageMetadata const metadata(processImageMetadata(el));
         ImageInfo const image_info(
             image_id, metadata, sub_pages,
             left_half_removed, right_half_removed
@@ -227,6 +479,7 @@ ProjectReader::processImages(
 
         images.push_back(image_info);
         m_imageMap.insert(ImageMap::value_type(id, image_info));
+        m_imageOrder.push_back(id);
     }
 
     if (!images.empty()) {
@@ -235,58 +488,76 @@ ProjectReader::processImages(
 }
 
 ImageMetadata
-ProjectReader::processImageMetadata(QDomElement const& image_el)
+ProjectReader::processImageMetadata(QXmlStreamReader& xml)
 {
     QSize size;
     Dpi dpi;
-
-    QDomElement const size_el(image_el.namedItem("size").toElement());
-    if (!size_el.isNull()) {
-        size = XmlUnmarshaller::size(size_el);
-    }
-    QDomElement const dpi_el(image_el.namedItem("dpi").toElement());
-    if (!dpi_el.isNull()) {
-        dpi = XmlUnmarshaller::dpi(dpi_el);
+    bool have_gs = false;
+    bool gs = true;
+    bool have_color_stats = false;
+    int saturated = 0;
+    int background = 255;
+
+    while (xml.readNextStartElement()) {
+        QXmlStreamAttributes const attrs(xml.attributes());
+        if (xml.name() == "size") {
+            size = QSize(
+                attrs.value("width").toString().toInt(),
+                attrs.value("height").toString().toInt()
+            );
+        } else if (xml.name() == "dpi") {
+            dpi = Dpi(
+                attrs.value("horizontal").toString().toInt(),
+                attrs.value("vertical").toString().toInt()
+            );
+        } else if (xml.name() == "grayscale") {
+            have_gs = true;
+            if (attrs.hasAttribute("value")) {
+                gs = attrs.value("value").toString().toInt() != 0;
+            }
+        } else if (xml.name() == "color-stats") {
+            have_color_stats = true;
+            saturated = attrs.value("saturated").toString().toInt();
+            background = attrs.value("background").toString().toInt();
+        }
+        xml.skipCurrentElement();
     }
 
-    QDomElement const gs_el(image_el.namedItem("grayscale").toElement());
-
-    if (!gs_el.isNull()) {
-        return ImageMetadata(size, dpi, gs_el.attribute("value", "1").toInt() != 0);
-    } else {
-        return ImageMetadata(size, dpi);
+    ImageMetadata metadata(size, dpi);
+    if (have_gs) {
+        metadata.setGrayScale(gs);
+    }
+    if (have_gs && have_color_stats) {
+        metadata.setColorStats(gs, qBound(0, saturated, 1000), qBound(0, background, 255));
     }
+    return metadata;
 }
 
 void
-ProjectReader::processPages(QDomElement const& pages_el)
+ProjectReader::processPages(QXmlStreamReader& xml)
 {
-    QString const page_tag_name("page");
-
-    QDomNode node(pages_el.firstChild());
-    for (; !node.isNull(); node = node.nextSibling()) {
-        if (!node.isElement()) {
-            continue;
-        }
-        if (node.nodeName() != page_tag_name) {
+    while (xml.readNextStartElement()) {
+        if (xml.name() != "page") {
+            xml.skipCurrentElement();
             continue;
         }
-        QDomElement el(node.toElement());
+        QXmlStreamAttributes const attrs(xml.attributes());
+        xml.skipCurrentElement();
 
         bool ok = true;
 
-        int const id = el.attribute("id").toInt(&ok);
+        int const id = attrs.value("id").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
 
-        int const image_id = el.attribute("imageId").toInt(&ok);
+        int const image_id = attrs.value("imageId").toString().toInt(&ok);
         if (!ok) {
             continue;
         }
 
         PageId::SubPage const sub_page = PageId::subPageFromString(
-                                             el.attribute("subPage"), &ok
+                                             attrs.value("subPage").toString(), &ok
                                          );
         if (!ok) {
             continue;
@@ -300,12 +571,53 @@ ProjectReader::processPages(QDomElement const& pages_el)
         PageId const page_id(image.id(), sub_page);
         m_pageMap.insert(PageMap::value_type(id, page_id));
 
-        if (el.attribute("selected") == "selected") {
+        if (attrs.value("selected") == "selected") {
             m_selectedPage.set(page_id, PAGE_VIEW);
         }
     }
 }
 
+QDomElement
+ProjectReader::readDomElement(QXmlStreamReader& xml, QDomDocument& doc)
+{
+    QDomElement root(doc.createElement(xml.name().toString()));
+    QDomElement parent(root);
+
+    for (QXmlStreamAttribute const& attr : xml.attributes()) {
+        root.setAttribute(attr.name().toString(), attr.value().toString());
+    }
+
+    for (int depth = 1; depth > 0 && !xml.atEnd();) {
+        switch (xml.readNext()) {
+        case QXmlStreamReader::StartElement: {
+            QDomElement el(doc.createElement(xml.name().toString()));
+            for (QXmlStreamAttribute const& attr : xml.attributes()) {
+                el.setAttribute(attr.name().toString(), attr.value().toString());
+            }
+            parent.appendChild(el);
+            parent = el;
+            ++depth;
+            break;
+        }
+        case QXmlStreamReader::EndElement:
+            parent = parent.parentNode().toElement();
+            --depth;
+            break;
+        case QXmlStreamReader::Characters:
+            if (xml.isCDATA()) {
+                parent.appendChild(doc.createCDATASection(xml.text().toString()));
+            } else if (!xml.isWhitespace()) {
+                parent.appendChild(doc.createTextNode(xml.text().toString()));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return root;
+}
+
 QString
 ProjectReader::getDirPath(int const id) const
 {
@@ -347,6 +659,85 @@ ProjectReader::getImageInfo(int id) const
     return ImageInfo();
 }
 
+void
+ProjectReader::mergeFilterSettings(ProjectReader const& other, std::set<ImageId> const& images)
+{
+    std::map<ImageId, int> image_ids;
+    for (ImageMap::value_type const& kv : m_imageMap) {
+        image_ids[kv.second.id()] = kv.first;
+    }
+    std::map<PageId, int> page_ids;
+    int next_page_id = 1;
+    for (PageMap::value_type const& kv : m_pageMap) {
+        page_ids[kv.second] = kv.first;
+        next_page_id = std::max(next_page_id, kv.first + 1);
+    }
+
+    QDomElement filters_el(m_filtersDoc.documentElement());
+    if (filters_el.isNull()) {
+        filters_el = m_filtersDoc.createElement("filters");
+        m_filtersDoc.appendChild(filters_el);
+    }
+
+    QDomElement const other_filters_el(other.m_filtersDoc.documentElement());
+    QDomElement other_filter_el(other_filters_el.firstChildElement());
+    for (; !other_filter_el.isNull(); other_filter_el = other_filter_el.nextSiblingElement()) {
+        QString const filter_name(other_filter_el.tagName());
+        QDomElement filter_el(filters_el.firstChildElement(filter_name));
+        if (filter_el.isNull()) {
+            filter_el = m_filtersDoc.importNode(other_filter_el, false).toElement();
+            filters_el.appendChild(filter_el);
+        }
+
+        QDomElement el(other_filter_el.firstChildElement());
+        for (; !el.isNull(); el = el.nextSiblingElement()) {
+            bool ok = false;
+            int const other_id = el.attribute("id").toInt(&ok);
+            if (!ok) {
+                continue;
+            }
+
+            int id = -1;
+            if (el.tagName() == "image") {
+                ImageId const image_id(other.imageId(other_id));
+                std::map<ImageId, int>::const_iterator const it(image_ids.find(image_id));
+                if (!images.count(image_id) || it == image_ids.end()) {
+                    continue;
+                }
+                id = it->second;
+            } else if (el.tagName() == "page") {
+                PageId const page_id(other.pageId(other_id));
+                if (!images.count(page_id.imageId())) {
+                    continue;
+                }
+                std::map<PageId, int>::const_iterator const it(page_ids.find(page_id));
+                if (it != page_ids.end()) {
+                    id = it->second;
+                } else {
+                    // The other project has split an image we haven't.
+                    id = next_page_id++;
+                    m_pageMap[id] = page_id;
+                    page_ids[page_id] = id;
+                }
+            } else {
+                continue;
+            }
+
+            QDomElement old_el(filter_el.firstChildElement(el.tagName()));
+            for (; !old_el.isNull(); old_el = old_el.nextSiblingElement(el.tagName())) {
+                if (old_el.attribute("id").toInt() == id) {
+                    filter_el.removeChild(old_el);
+                    break;
+                }
+            }
+
+            QDomElement new_el(m_filtersDoc.importNode(el, true).toElement());
+            new_el.setAttribute("id", id);
+            filter_el.appendChild(new_el);
+        }
+    }
+}
+
 ImageId
 ProjectReader::imageId(int const numeric_id) const
 {
@@ -366,3 +757,210 @@ ProjectReader::pageId(int numeric_id) const
     }
     return PageId();
 }
+
+QString
+ProjectReader::snapshotFileFor(QString const& project_file)
+{
+    return project_file + QLatin1String(".snapshot");
+}
+
+bool
+ProjectReader::loadSnapshot(QString const& snapshot_file, QByteArray const& xml_hash)
+{
+    QFile file(snapshot_file);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qint64 const file_size = file.size();
+    uchar* const mapping = file.map(0, file_size);
+    if (!mapping) {
+        return false;
+    }
+
+    // The data is decoded straight from the mapping, without reading
+    // the file into a buffer first.
+    QByteArray const data(
+        QByteArray::fromRawData(reinterpret_cast<char const*>(mapping), file_size)
+    );
+    QDataStream strm(data);
+    strm.setVersion(QDataStream::Qt_5_4);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray hash;
+    strm >> magic >> version >> hash;
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION || hash != xml_hash) {
+        file.unmap(mapping);
+        return false;
+    }
+
+    qint32 layout_direction = Qt::LeftToRight;
+    strm >> m_outDir >> m_inputDir >> layout_direction;
+
+    std::vector<std::pair<QString, ImageMetadataCache::Entry> > probed_files;
+    quint32 num_files = 0;
+    strm >> num_files;
+    for (quint32 i = 0; i < num_files && strm.status() == QDataStream::Ok; ++i) {
+        qint32 id = 0;
+        FileRecord rec;
+        bool have_probed = false;
+        strm >> id >> rec.filePath >> rec.compatMultiPage >> have_probed;
+        if (have_probed) {
+            ImageMetadataCache::Entry probed;
+            quint32 num_pages = 0;
+            strm >> probed.size >> probed.lastModified >> num_pages;
+            for (quint32 j = 0; j < num_pages && strm.status() == QDataStream::Ok; ++j) {
+                probed.pages.push_back(readMetadata(strm));
+            }
+            probed.status = ImageMetadataLoader::LOADED;
+            probed_files.push_back(std::make_pair(rec.filePath, probed));
+        }
+        m_fileMap.insert(FileMap::value_type(id, rec));
+    }
+
+    std::vector<ImageInfo> images;
+    quint32 num_images = 0;
+    strm >> num_images;
+    for (quint32 i = 0; i < num_images && strm.status() == QDataStream::Ok; ++i) {
+        qint32 id = 0;
+        QString file_path;
+        qint32 page = 0;
+        qint32 sub_pages = 0;
+        bool left_half_removed = false;
+        bool right_half_removed = false;
+        strm >> id >> file_path >> page;
+        ImageMetadata const metadata(readMetadata(strm));
+        strm >> sub_pages >> left_half_removed >> right_half_removed;
+
+        ImageInfo const image_info(
+            ImageId(file_path, page), metadata, sub_pages,
+            left_half_removed, right_half_removed
+        );
+        images.push_back(image_info);
+        m_imageMap.insert(ImageMap::value_type(id, image_info));
+        m_imageOrder.push_back(id);
+    }
+
+    quint32 num_pages = 0;
+    strm >> num_pages;
+    for (quint32 i = 0; i < num_pages && strm.status() == QDataStream::Ok; ++i) {
+        qint32 id = 0;
+        qint32 image_id = 0;
+        qint32 sub_page = 0;
+        strm >> id >> image_id >> sub_page;
+        m_pageMap.insert(
+            PageMap::value_type(
+                id, PageId(getImageInfo(image_id).id(), PageId::SubPage(sub_page))
+            )
+        );
+    }
+
+    qint32 selected_page = -1;
+    strm >> selected_page;
+
+    bool ok = strm.status() == QDataStream::Ok && !images.empty();
+    if (ok) {
+        ok = DomDecoder(strm).decode(m_disambiguationDoc)
+             && DomDecoder(strm).decode(m_filtersDoc)
+             && strm.status() == QDataStream::Ok;
+    }
+
+    file.unmap(mapping);
+
+    if (!ok) {
+        m_outDir.clear();
+        m_inputDir.clear();
+        m_fileMap.clear();
+        m_imageMap.clear();
+        m_pageMap.clear();
+        m_imageOrder.clear();
+        m_disambiguationDoc = QDomDocument();
+        m_filtersDoc = QDomDocument();
+        return false;
+    }
+
+    if (selected_page >= 0) {
+        m_selectedPage.set(pageId(selected_page), PAGE_VIEW);
+    }
+
+    // Same as processFiles() does.
+    for (auto const& kv : probed_files) {
+        ImageMetadataCache::Entry existing;
+        if (!ImageMetadataCache::peek(kv.first, existing)) {
+            ImageMetadataCache::store(kv.first, kv.second);
+        }
+    }
+
+    m_ptrPages.reset(new ProjectPages(images, Qt::LayoutDirection(layout_direction)));
+    m_wellFormed = true;
+    createDisambiguator();
+
+    return true;
+}
+
+void
+ProjectReader::saveSnapshot(QString const& snapshot_file, QByteArray const& xml_hash) const
+{
+    AtomicFileOverwriter overwriter;
+    QIODevice* const io_dev = overwriter.startWriting(snapshot_file);
+    if (!io_dev) {
+        return;
+    }
+
+    QDataStream strm(io_dev);
+    strm.setVersion(QDataStream::Qt_5_4);
+
+    strm << quint32(SNAPSHOT_MAGIC) << quint32(SNAPSHOT_VERSION) << xml_hash;
+    strm << m_outDir << m_inputDir << qint32(m_ptrPages->layoutDirection());
+
+    strm << quint32(m_fileMap.size());
+    for (FileMap::value_type const& kv : m_fileMap) {
+        FileRecord const& rec = kv.second;
+        ImageMetadataCache::Entry probed;
+        bool const have_probed = ImageMetadataCache::peek(rec.filePath, probed)
+                                 && probed.status == ImageMetadataLoader::LOADED
+                                 && !probed.pages.empty();
+        strm << qint32(kv.first) << rec.filePath << rec.compatMultiPage << have_probed;
+        if (have_probed) {
+            strm << probed.size << probed.lastModified << quint32(probed.pages.size());
+            for (ImageMetadata const& metadata : probed.pages) {
+                writeMetadata(strm, metadata);
+            }
+        }
+    }
+
+    std::map<ImageId, int> image_ids;
+    strm << quint32(m_imageOrder.size());
+    for (int const id : m_imageOrder) {
+        ImageInfo const image_info(getImageInfo(id));
+        image_ids[image_info.id()] = id;
+        strm << qint32(id) << image_info.id().filePath() << qint32(image_info.id().page());
+        writeMetadata(strm, image_info.metadata());
+        strm << qint32(image_info.numSubPages())
+             << image_info.leftHalfRemoved() << image_info.rightHalfRemoved();
+    }
+
+    PageId const selected_page(m_selectedPage.get(PAGE_VIEW));
+    qint32 selected_page_id = -1;
+    strm << quint32(m_pageMap.size());
+    for (PageMap::value_type const& kv : m_pageMap) {
+        strm << qint32(kv.first) << qint32(image_ids[kv.second.imageId()])
+             << qint32(kv.second.subPage());
+        if (!m_selectedPage.isNull() && kv.second == selected_page) {
+            selected_page_id = kv.first;
+        }
+    }
+    strm << selected_page_id;
+
+    DomEncoder disambiguation;
+    disambiguation.encodeChildren(m_disambiguationDoc);
+    disambiguation.writeTo(strm);
+
+    DomEncoder filters;
+    filters.encodeChildren(m_filtersDoc);
+    filters.writeTo(strm);
+
+    if (strm.status() == QDataStream::Ok) {
+        overwriter.commit();
+    }
+}
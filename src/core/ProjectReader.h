@@ -30,8 +30,12 @@
 #include <Qt>
 #include <vector>
 #include <map>
+#include <set>
 
 class QDomElement;
+class QIODevice;
+class QByteArray;
+class QXmlStreamReader;
 class ProjectData;
 class ProjectPages;
 class FileNameDisambiguator;
@@ -42,12 +46,51 @@ class ProjectReader
 public:
     typedef IntrusivePtr<AbstractFilter> FilterPtr;
 
-    ProjectReader(QDomDocument const& doc);
+    /**
+     * \brief Parses the project from a stream.
+     *
+     * Everything but filter settings is decoded on the fly.
+     * Filter settings are kept as a DOM subtree until
+     * readFilterSettings() is called.
+     */
+    explicit ProjectReader(QIODevice& device);
+
+    /**
+     * \brief Reads the project from a stream or from a binary snapshot of it.
+     *
+     * The snapshot is used if it was made from the very bytes \p device
+     * provides, as told by their SHA-1 hash.  Otherwise the XML is parsed
+     * and a new snapshot is written to \p snapshot_file, which is where
+     * snapshotFileFor() says it belongs.  The XML remains the project file,
+     * and the snapshot is just a faster way to read it.  An empty
+     * \p snapshot_file makes this equivalent to the constructor above.
+     */
+    ProjectReader(QIODevice& device, QString const& snapshot_file);
 
     ~ProjectReader();
 
+    /**
+     * \brief Returns false if the project file is not valid XML.
+     */
+    bool isWellFormed() const
+    {
+        return m_wellFormed;
+    }
+
     void readFilterSettings(std::vector<FilterPtr> const& filters) const;
 
+    /**
+     * \brief Takes filter settings of some images from another project.
+     *
+     * Per-image and per-page settings of \p images in \p other replace
+     * ours, as if they were part of this project file.  Other filter
+     * attributes, such as statistics, are left alone.  Both projects
+     * are expected to consist of the same images, as is the case for
+     * projects processed in parts by scantailor-cli --pages.
+     * Must be called before readFilterSettings().
+     */
+    void mergeFilterSettings(ProjectReader const& other, std::set<ImageId> const& images);
+
     bool success() const
     {
         return m_ptrPages.get() != 0;
@@ -81,6 +124,11 @@ public:
     ImageId imageId(int numeric_id) const;
 
     PageId pageId(int numeric_id) const;
+
+    /**
+     * \brief Returns the snapshot file to go with a project file.
+     */
+    static QString snapshotFileFor(QString const& project_file);
 private:
     struct FileRecord {
         QString filePath;
@@ -97,16 +145,30 @@ private:
     typedef std::map<int, ImageInfo> ImageMap;
     typedef std::map<int, PageId> PageMap;
 
-    void processDirectories(QDomElement const& dirs_el);
+    void parse(QIODevice& device);
 
-    void processFiles(QDomElement const& files_el);
+    void createDisambiguator();
 
-    void processImages(QDomElement const& images_el,
+    bool loadSnapshot(QString const& snapshot_file, QByteArray const& xml_hash);
+
+    void saveSnapshot(QString const& snapshot_file, QByteArray const& xml_hash) const;
+
+    void processDirectories(QXmlStreamReader& xml);
+
+    void processFiles(QXmlStreamReader& xml);
+
+    void processImages(QXmlStreamReader& xml,
                        Qt::LayoutDirection layout_direction);
 
-    ImageMetadata processImageMetadata(QDomElement const& image_el);
+    ImageMetadata processImageMetadata(QXmlStreamReader& xml);
+
+    void processPages(QXmlStreamReader& xml);
 
-    void processPages(QDomElement const& pages_el);
+    /**
+     * Builds a DOM subtree out of the element the reader is positioned at.
+     * On return, the reader is positioned at the end of that element.
+     */
+    static QDomElement readDomElement(QXmlStreamReader& xml, QDomDocument& doc);
 
     QString getDirPath(int id) const;
 
@@ -116,16 +178,19 @@ private:
 
     ImageInfo getImageInfo(int id) const;
 
-    QDomDocument m_doc;
+    QDomDocument m_filtersDoc;
+    QDomDocument m_disambiguationDoc;
     QString m_outDir;
     QString m_inputDir;
     DirMap m_dirMap;
     FileMap m_fileMap;
     ImageMap m_imageMap;
     PageMap m_pageMap;
+    std::vector<int> m_imageOrder; /**< Image ids in the order of the file. */
     SelectedPage m_selectedPage;
     IntrusivePtr<ProjectPages> m_ptrPages;
     IntrusivePtr<FileNameDisambiguator> m_ptrDisambiguator;
+    bool m_wellFormed;
 };
 
 #endif
@@ -23,12 +23,14 @@
 #include "PageId.h"
 #include "ImageId.h"
 #include "ImageMetadata.h"
+#include "ImageMetadataCache.h"
 #include "AbstractFilter.h"
 #include "FileNameDisambiguator.h"
 #include "version.h"
+#include "AtomicFileOverwriter.h"
+#include "OutputWriteQueue.h"
 #include <QtXml>
-#include <QFile>
-#include <QTextStream>
+#include <QXmlStreamWriter>
 #include <QFileInfo>
 #ifndef Q_MOC_RUN
 #include <boost/bind.hpp>
@@ -80,141 +82,205 @@ ProjectWriter::~ProjectWriter()
 bool
 ProjectWriter::write(QString const& file_path, std::vector<FilterPtr> const& filters) const
 {
-
 #if QT_VERSION > 0x050600
     // this ensures attributes are saved in the same order
     qSetGlobalQHashSeed(21062018);
 #endif
 
-    QDomDocument doc;
-    QDomElement root_el(doc.createElement("project"));
-    doc.appendChild(root_el);
-    root_el.setAttribute("outputDirectory", m_outFileNameGen.outDir());
-    root_el.setAttribute(
+    // Output params of pages still being written are only known
+    // once they are written.
+    OutputWriteQueue::waitForAll();
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* const file = overwriter.startWriting(file_path);
+    if (!file) {
+        return false;
+    }
+
+    QXmlStreamWriter xml(file);
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(2);
+    xml.writeStartDocument();
+
+    xml.writeStartElement("project");
+    xml.writeAttribute("outputDirectory", m_outFileNameGen.outDir());
+    xml.writeAttribute(
         "layoutDirection",
         m_layoutDirection == Qt::LeftToRight ? "LTR" : "RTL"
     );
 
-    QDomElement st_el(doc.createElement("scantailor"));
-    st_el.setAttribute("app", "Universal");
-    st_el.setAttribute("ver", VERSION);
-    root_el.appendChild(st_el);
-
-    root_el.appendChild(processDirectories(doc));
-    root_el.appendChild(processFiles(doc));
-    root_el.appendChild(processImages(doc));
-    root_el.appendChild(processPages(doc));
-    root_el.appendChild(
-        m_outFileNameGen.disambiguator()->toXml(
-            doc, "file-name-disambiguation",
-            boost::bind(&ProjectWriter::packFilePath, this, _1)
-        )
-    );
+    xml.writeStartElement("scantailor");
+    xml.writeAttribute("app", "Universal");
+    xml.writeAttribute("ver", VERSION);
+    xml.writeEndElement();
+
+    writeDirectories(xml);
+    writeFiles(xml);
+    writeImages(xml);
+    writePages(xml);
+
+    // Filters and the disambiguator produce DOM elements.  Each of them
+    // gets a document of its own, which is streamed out and released,
+    // so the whole project never exists as a DOM tree.
+    {
+        QDomDocument doc;
+        writeDomElement(
+            xml, m_outFileNameGen.disambiguator()->toXml(
+                doc, "file-name-disambiguation",
+                boost::bind(&ProjectWriter::packFilePath, this, _1)
+            )
+        );
+    }
 
-    QDomElement filters_el(doc.createElement("filters"));
-    root_el.appendChild(filters_el);
-    std::vector<FilterPtr>::const_iterator it(filters.begin());
-    std::vector<FilterPtr>::const_iterator const end(filters.end());
-    for (; it != end; ++it) {
-        filters_el.appendChild((*it)->saveSettings(*this, doc));
+    xml.writeStartElement("filters");
+    for (FilterPtr const& filter : filters) {
+        QDomDocument doc;
+        writeDomElement(xml, filter->saveSettings(*this, doc));
     }
+    xml.writeEndElement();
 
-#if QT_VERSION > 0x050600
-    qSetGlobalQHashSeed(-1);
-#endif
+    xml.writeEndElement(); // project
+    xml.writeEndDocument();
 
-    QFile file(file_path);
-    if (file.open(QIODevice::WriteOnly)) {
-        QTextStream strm(&file);
-        doc.save(strm, 2);
-        return true;
+    if (xml.hasError()) {
+        return false;
     }
 
-    return false;
+    return overwriter.commit();
 }
 
-QDomElement
-ProjectWriter::processDirectories(QDomDocument& doc) const
+void
+ProjectWriter::writeDomElement(QXmlStreamWriter& xml, QDomElement const& el)
 {
-    QDomElement dirs_el(doc.createElement("directories"));
+    xml.writeStartElement(el.tagName());
+
+    QDomNamedNodeMap const attrs(el.attributes());
+    int const num_attrs = attrs.count();
+    for (int i = 0; i < num_attrs; ++i) {
+        QDomAttr const attr(attrs.item(i).toAttr());
+        xml.writeAttribute(attr.name(), attr.value());
+    }
+
+    for (QDomNode node(el.firstChild()); !node.isNull(); node = node.nextSibling()) {
+        if (node.isElement()) {
+            writeDomElement(xml, node.toElement());
+        } else if (node.isCDATASection()) {
+            xml.writeCDATA(node.toCDATASection().data());
+        } else if (node.isText()) {
+            xml.writeCharacters(node.toText().data());
+        }
+    }
+
+    xml.writeEndElement();
+}
+
+void
+ProjectWriter::writeDirectories(QXmlStreamWriter& xml) const
+{
+    xml.writeStartElement("directories");
 
     for (Directory const& dir : m_dirs.get<Sequenced>()) {
-        QDomElement dir_el(doc.createElement("directory"));
-        dir_el.setAttribute("id", dir.numericId);
-        dir_el.setAttribute("path", dir.path);
-        dirs_el.appendChild(dir_el);
+        xml.writeStartElement("directory");
+        xml.writeAttribute("id", QString::number(dir.numericId));
+        xml.writeAttribute("path", dir.path);
+        xml.writeEndElement();
     }
 
-    return dirs_el;
+    xml.writeEndElement();
 }
 
-QDomElement
-ProjectWriter::processFiles(QDomDocument& doc) const
+void
+ProjectWriter::writeFiles(QXmlStreamWriter& xml) const
 {
-    QDomElement files_el(doc.createElement("files"));
+    xml.writeStartElement("files");
 
     for (File const& file : m_files.get<Sequenced>()) {
         QFileInfo const file_info(file.path);
         QString const& dir_path = file_info.absolutePath();
-        QDomElement file_el(doc.createElement("file"));
-        file_el.setAttribute("id", file.numericId);
-        file_el.setAttribute("dirId", dirId(dir_path));
-        file_el.setAttribute("name", file_info.fileName());
-        files_el.appendChild(file_el);
+        xml.writeStartElement("file");
+        xml.writeAttribute("id", QString::number(file.numericId));
+        xml.writeAttribute("dirId", QString::number(dirId(dir_path)));
+        xml.writeAttribute("name", file_info.fileName());
+
+        // What was probed from the file, so that reopening the project
+        // doesn't have to probe it again.  See ImageMetadataCache.
+        ImageMetadataCache::Entry probed;
+        if (ImageMetadataCache::peek(file.path, probed)
+                && probed.status == ImageMetadataLoader::LOADED) {
+            xml.writeAttribute("size", QString::number(probed.size));
+            xml.writeAttribute("modified", QString::number(probed.lastModified));
+            for (ImageMetadata const& metadata : probed.pages) {
+                xml.writeStartElement("page");
+                writeImageMetadata(xml, metadata);
+                xml.writeEndElement();
+            }
+        }
+
+        xml.writeEndElement();
     }
 
-    return files_el;
+    xml.writeEndElement();
 }
 
-QDomElement
-ProjectWriter::processImages(QDomDocument& doc) const
+void
+ProjectWriter::writeImages(QXmlStreamWriter& xml) const
 {
-    QDomElement images_el(doc.createElement("images"));
+    xml.writeStartElement("images");
 
     for (Image const& image : m_images.get<Sequenced>()) {
-        QDomElement image_el(doc.createElement("image"));
-        image_el.setAttribute("id", image.numericId);
-        image_el.setAttribute("subPages", image.numSubPages);
-        image_el.setAttribute("fileId", fileId(image.id.filePath()));
-        image_el.setAttribute("fileImage", image.id.page());
+        xml.writeStartElement("image");
+        xml.writeAttribute("id", QString::number(image.numericId));
+        xml.writeAttribute("subPages", QString::number(image.numSubPages));
+        xml.writeAttribute("fileId", QString::number(fileId(image.id.filePath())));
+        xml.writeAttribute("fileImage", QString::number(image.id.page()));
         if (image.leftHalfRemoved != image.rightHalfRemoved) {
             // Both are not supposed to be removed.
-            image_el.setAttribute("removed", image.leftHalfRemoved ? "L" : "R");
+            xml.writeAttribute("removed", image.leftHalfRemoved ? "L" : "R");
         }
-        writeImageMetadata(doc, image_el, image.id);
-        images_el.appendChild(image_el);
+        writeImageMetadata(xml, image.id);
+        xml.writeEndElement();
     }
 
-    return images_el;
+    xml.writeEndElement();
 }
 
 void
-ProjectWriter::writeImageMetadata(
-    QDomDocument& doc, QDomElement& image_el, ImageId const& image_id) const
+ProjectWriter::writeImageMetadata(QXmlStreamWriter& xml, ImageId const& image_id) const
 {
     MetadataByImage::const_iterator it(m_metadataByImage.find(image_id));
     assert(it != m_metadataByImage.end());
-    ImageMetadata const& metadata = it->second;
-
-    QDomElement size_el(doc.createElement("size"));
-    size_el.setAttribute("width", metadata.size().width());
-    size_el.setAttribute("height", metadata.size().height());
-    image_el.appendChild(size_el);
-
-    QDomElement dpi_el(doc.createElement("dpi"));
-    dpi_el.setAttribute("horizontal", metadata.dpi().horizontal());
-    dpi_el.setAttribute("vertical", metadata.dpi().vertical());
-    image_el.appendChild(dpi_el);
+    writeImageMetadata(xml, it->second);
+}
 
-    QDomElement gs_el(doc.createElement("grayscale"));
-    gs_el.setAttribute("value", metadata.isGrayScale() ? "1" : "0");
-    image_el.appendChild(gs_el);
+void
+ProjectWriter::writeImageMetadata(QXmlStreamWriter& xml, ImageMetadata const& metadata)
+{
+    xml.writeStartElement("size");
+    xml.writeAttribute("width", QString::number(metadata.size().width()));
+    xml.writeAttribute("height", QString::number(metadata.size().height()));
+    xml.writeEndElement();
+
+    xml.writeStartElement("dpi");
+    xml.writeAttribute("horizontal", QString::number(metadata.dpi().horizontal()));
+    xml.writeAttribute("vertical", QString::number(metadata.dpi().vertical()));
+    xml.writeEndElement();
+
+    xml.writeStartElement("grayscale");
+    xml.writeAttribute("value", metadata.isGrayScale() ? "1" : "0");
+    xml.writeEndElement();
+
+    if (metadata.haveColorStats()) {
+        xml.writeStartElement("color-stats");
+        xml.writeAttribute("saturated", QString::number(metadata.saturatedPerMille()));
+        xml.writeAttribute("background", QString::number(metadata.backgroundLevel()));
+        xml.writeEndElement();
+    }
 }
 
-QDomElement
-ProjectWriter::processPages(QDomDocument& doc) const
+void
+ProjectWriter::writePages(QXmlStreamWriter& xml) const
 {
-    QDomElement pages_el(doc.createElement("pages"));
+    xml.writeStartElement("pages");
 
     PageId const sel_opt_1(m_selectedPage.get(IMAGE_VIEW));
     PageId const sel_opt_2(m_selectedPage.get(PAGE_VIEW));
@@ -229,19 +295,19 @@ ProjectWriter::processPages(QDomDocument& doc) const
 
     for (const PageInfo& page : m_pageSequence) {
         PageId const& page_id = page.id();
-        QDomElement page_el(doc.createElement("page"));
-        page_el.setAttribute("id", pageId(page_id));
-        page_el.setAttribute("imageId", imageId(page_id.imageId()));
-        page_el.setAttribute("subPage", page_id.subPageAsString());
+        xml.writeStartElement("page");
+        xml.writeAttribute("id", QString::number(pageId(page_id)));
+        xml.writeAttribute("imageId", QString::number(imageId(page_id.imageId())));
+        xml.writeAttribute("subPage", page_id.subPageAsString());
         if (page_id == sel_opt_1 || page_id == sel_opt_2
                 || page_id == page_left || page_id == page_right) {
-            page_el.setAttribute("selected", "selected");
+            xml.writeAttribute("selected", "selected");
             page_left = page_right = PageId(); // if one of these match other shouldn't
         }
-        pages_el.appendChild(page_el);
+        xml.writeEndElement();
     }
 
-    return pages_el;
+    xml.writeEndElement();
 }
 
 int
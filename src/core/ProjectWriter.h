@@ -42,6 +42,7 @@ class ProjectPages;
 class PageInfo;
 class QDomDocument;
 class QDomElement;
+class QXmlStreamWriter;
 
 class ProjectWriter
 {
@@ -148,17 +149,19 @@ private:
     >
     > Pages;
 
-    QDomElement processDirectories(QDomDocument& doc) const;
+    static void writeDomElement(QXmlStreamWriter& xml, QDomElement const& el);
 
-    QDomElement processFiles(QDomDocument& doc) const;
+    void writeDirectories(QXmlStreamWriter& xml) const;
 
-    QDomElement processImages(QDomDocument& doc) const;
+    void writeFiles(QXmlStreamWriter& xml) const;
 
-    QDomElement processPages(QDomDocument& doc) const;
+    void writeImages(QXmlStreamWriter& xml) const;
 
-    void writeImageMetadata(
-        QDomDocument& doc, QDomElement& image_el,
-        ImageId const& image_id) const;
+    void writePages(QXmlStreamWriter& xml) const;
+
+    void writeImageMetadata(QXmlStreamWriter& xml, ImageId const& image_id) const;
+
+    static void writeImageMetadata(QXmlStreamWriter& xml, ImageMetadata const& metadata);
 
     int dirId(QString const& dir_path) const;
 
@@ -0,0 +1,95 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ReprocessTaskFactory.h"
+#include "StageSequence.h"
+#include "ProjectPages.h"
+#include "ThumbnailPixmapCache.h"
+#include "LoadFileTask.h"
+#include "PageId.h"
+#include "PageInfo.h"
+#include "filters/fix_orientation/Filter.h"
+#include "filters/fix_orientation/Task.h"
+#include "filters/page_split/Filter.h"
+#include "filters/page_split/Task.h"
+#include "filters/deskew/Filter.h"
+#include "filters/deskew/Task.h"
+#include "filters/select_content/Filter.h"
+#include "filters/select_content/Task.h"
+#include "filters/page_layout/Filter.h"
+#include "filters/page_layout/Task.h"
+#include "filters/output/Filter.h"
+#include "filters/output/Task.h"
+
+ReprocessTaskFactory::ReprocessTaskFactory(
+    IntrusivePtr<StageSequence> const& stages,
+    IntrusivePtr<ProjectPages> const& pages,
+    PageSequence const& page_sequence,
+    IntrusivePtr<ThumbnailPixmapCache> const& thumbnail_cache,
+    OutputFileNameGenerator const& out_file_name_gen, bool const debug)
+    :   m_ptrStages(stages),
+        m_ptrPages(pages),
+        m_pageSequence(page_sequence),
+        m_ptrThumbnailCache(thumbnail_cache),
+        m_outFileNameGen(out_file_name_gen),
+        m_debug(debug)
+{
+}
+
+BackgroundTaskPtr
+ReprocessTaskFactory::createTask(
+    PageId const& page_id, QImage* const fore_subscan,
+    QImage* const out_img, imageproc::BinaryImage* const automask) const
+{
+    int const page_no = m_pageSequence.pageNo(page_id);
+    if (page_no < 0) {
+        return BackgroundTaskPtr();
+    }
+    PageInfo const& page_info = m_pageSequence.pageAt(page_no);
+
+    bool const batch = !fore_subscan;
+
+    IntrusivePtr<output::Task> const output_task(
+        m_ptrStages->outputFilter()->createTask(
+            page_id, m_ptrThumbnailCache, m_outFileNameGen, batch, m_debug,
+            fore_subscan != nullptr, fore_subscan, out_img, automask
+        )
+    );
+    IntrusivePtr<page_layout::Task> const page_layout_task(
+        m_ptrStages->pageLayoutFilter()->createTask(page_id, output_task, batch, false)
+    );
+    IntrusivePtr<select_content::Task> const select_content_task(
+        m_ptrStages->selectContentFilter()->createTask(page_id, page_layout_task, batch, false)
+    );
+    IntrusivePtr<deskew::Task> const deskew_task(
+        m_ptrStages->deskewFilter()->createTask(page_id, select_content_task, batch, false)
+    );
+    IntrusivePtr<page_split::Task> const page_split_task(
+        m_ptrStages->pageSplitFilter()->createTask(page_info, deskew_task, batch, false)
+    );
+    IntrusivePtr<fix_orientation::Task> const fix_orientation_task(
+        m_ptrStages->fixOrientationFilter()->createTask(page_id, page_split_task, batch)
+    );
+
+    return BackgroundTaskPtr(
+               new LoadFileTask(
+                   BackgroundTask::INTERACTIVE, page_info,
+                   m_ptrThumbnailCache, m_ptrPages, fix_orientation_task
+               )
+           );
+}
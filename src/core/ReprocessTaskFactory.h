@@ -0,0 +1,79 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REPROCESSTASKFACTORY_H_
+#define REPROCESSTASKFACTORY_H_
+
+#include "BackgroundTask.h"
+#include "IntrusivePtr.h"
+#include "OutputFileNameGenerator.h"
+#include "PageSequence.h"
+
+class PageId;
+class ProjectPages;
+class StageSequence;
+class ThumbnailPixmapCache;
+class QImage;
+
+namespace imageproc
+{
+class BinaryImage;
+}
+
+/**
+ * \brief Creates tasks that put a page through all of the filters,
+ *        for whoever needs the output without the GUI.
+ *
+ * The pages are captured at construction, and the rest is only read,
+ * so createTask() may be called from any thread, including several
+ * at once.  The filters' settings are protected by their own mutexes.
+ */
+class ReprocessTaskFactory
+{
+    // Member-wise copying is OK.
+public:
+    ReprocessTaskFactory(
+        IntrusivePtr<StageSequence> const& stages,
+        IntrusivePtr<ProjectPages> const& pages,
+        PageSequence const& page_sequence,
+        IntrusivePtr<ThumbnailPixmapCache> const& thumbnail_cache,
+        OutputFileNameGenerator const& out_file_name_gen, bool debug);
+
+    /**
+     * \brief Creates a task for \p page_id.
+     *
+     * Without \p fore_subscan the regular output is generated, just like
+     * in batch processing, and is also stored into \p out_img and
+     * \p automask where those are given.  With \p fore_subscan,
+     * the original color foreground is stored there instead.
+     *
+     * Returns a null task if the page is not in the page sequence.
+     */
+    BackgroundTaskPtr createTask(
+        PageId const& page_id, QImage* fore_subscan,
+        QImage* out_img, imageproc::BinaryImage* automask) const;
+private:
+    IntrusivePtr<StageSequence> m_ptrStages;
+    IntrusivePtr<ProjectPages> m_ptrPages;
+    PageSequence m_pageSequence;
+    IntrusivePtr<ThumbnailPixmapCache> m_ptrThumbnailCache;
+    OutputFileNameGenerator m_outFileNameGen;
+    bool m_debug;
+};
+
+#endif
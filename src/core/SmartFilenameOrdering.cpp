@@ -19,52 +19,84 @@
 #include "SmartFilenameOrdering.h"
 #include <QFileInfo>
 #include <QString>
-#include <QRegularExpression>
+#include <QChar>
+
+namespace
+{
+
+bool isDigit(QChar const ch)
+{
+    return ch >= QChar('0') && ch <= QChar('9');
+}
+
+} // anonymous namespace
+
+SmartFilenameOrdering::Key::Key(QFileInfo const& file_info)
+    :   m_dir(file_info.absolutePath())
+    ,   m_fileName(file_info.fileName())
+{
+    int const len = m_fileName.size();
+    int pos = 0;
+    while (pos < len) {
+        if (!isDigit(m_fileName[pos])) {
+            ++pos;
+            continue;
+        }
+
+        int const begin = pos;
+        while (pos < len && isDigit(m_fileName[pos])) {
+            ++pos;
+        }
+        m_numbers.push_back(std::make_pair(begin, pos));
+    }
+}
 
 bool
 SmartFilenameOrdering::operator()(QFileInfo const& lhs, QFileInfo const& rhs) const
+{
+    return (*this)(Key(lhs), Key(rhs));
+}
+
+bool
+SmartFilenameOrdering::operator()(Key const& lhs, Key const& rhs) const
 {
     // First compare directories.
-    if (int comp = lhs.absolutePath().compare(rhs.absolutePath())) {
+    if (int comp = lhs.m_dir.compare(rhs.m_dir)) {
         return comp < 0;
     }
 
-    QRegularExpression re_num("[0-9]+");
-    const QString zero('0');
+    const QChar zero('0');
 
-    const QString left_filename(lhs.fileName());
-    const QString right_filename(rhs.fileName());
+    const QString& left_filename = lhs.m_fileName;
+    const QString& right_filename = rhs.m_fileName;
 
-    QRegularExpressionMatchIterator match_left_it = re_num.globalMatch(left_filename);
-    QRegularExpressionMatchIterator match_right_it = re_num.globalMatch(right_filename);
+    size_t const num_pairs = std::min(lhs.m_numbers.size(), rhs.m_numbers.size());
 
     int pos1 = 0;
     int pos2 = 0;
     QString fn1;
     QString fn2;
 
-    while (match_left_it.hasNext() && match_right_it.hasNext()) {
-        QRegularExpressionMatch match_left = match_left_it.next();
-        QRegularExpressionMatch match_right = match_right_it.next();
-
-        fn1 += left_filename.midRef(pos1, match_left.capturedStart() - pos1);
-        pos1 =  match_left.capturedEnd();
+    // Numbers at the same positions are padded with zeros to the same length.
+    for (size_t i = 0; i < num_pairs; ++i) {
+        std::pair<int, int> const& left_num = lhs.m_numbers[i];
+        std::pair<int, int> const& right_num = rhs.m_numbers[i];
 
-        fn2 += right_filename.midRef(pos2, match_right.capturedStart() - pos2);
-        pos2 =  match_right.capturedEnd();
+        fn1 += left_filename.midRef(pos1, left_num.first - pos1);
+        pos1 = left_num.second;
 
-        QString left_num = match_left.captured();
-        QString right_num = match_right.captured();
-        int diff = left_num.size() - right_num.size();
+        fn2 += right_filename.midRef(pos2, right_num.first - pos2);
+        pos2 = right_num.second;
 
+        int const diff = (left_num.second - left_num.first) - (right_num.second - right_num.first);
         if (diff < 0) {
-            left_num.prepend(zero.repeated(-1 * diff));
+            fn1 += QString(-diff, zero);
         } else if (diff > 0) {
-            right_num.prepend(zero.repeated(diff));
+            fn2 += QString(diff, zero);
         }
 
-        fn1 += left_num;
-        fn2 += right_num;
+        fn1 += left_filename.midRef(left_num.first, left_num.second - left_num.first);
+        fn2 += right_filename.midRef(right_num.first, right_num.second - right_num.first);
     }
     if (pos1 < left_filename.size() - 1) {
         fn1 += left_filename.rightRef(left_filename.size() - pos1);
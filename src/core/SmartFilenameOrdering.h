@@ -19,11 +19,37 @@
 #ifndef SMARTFILENAMEORDERING_H_
 #define SMARTFILENAMEORDERING_H_
 
-class QFileInfo;
+#include <QFileInfo>
+#include <QString>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
 
 class SmartFilenameOrdering
 {
 public:
+    /**
+     * \brief The parts of a file path the ordering looks at, found once.
+     *
+     * Comparing keys rather than QFileInfo objects saves extracting
+     * the directory and looking for numbers on every comparison.
+     */
+    class Key
+    {
+        // Member-wise copying is OK.
+    public:
+        Key() {}
+
+        explicit Key(QFileInfo const& file_info);
+    private:
+        friend class SmartFilenameOrdering;
+
+        QString m_dir;
+        QString m_fileName;
+        std::vector<std::pair<int, int> > m_numbers; // [begin, end) of each run of digits.
+    };
+
     SmartFilenameOrdering() {}
 
     /**
@@ -37,6 +63,48 @@ public:
      * \return true if \p lhs should go before \p rhs.
      */
     bool operator()(QFileInfo const& lhs, QFileInfo const& rhs) const;
+
+    /**
+     * \brief Same as above, for precomputed keys.
+     */
+    bool operator()(Key const& lhs, Key const& rhs) const;
+
+    /**
+     * \brief Sorts a range of QFileInfo or file path objects.
+     *
+     * The key of each element is computed only once, so this is much
+     * faster than std::sort() with a SmartFilenameOrdering predicate.
+     */
+    template<typename RandomIt>
+    static void sort(RandomIt begin, RandomIt end);
 };
 
+template<typename RandomIt>
+void
+SmartFilenameOrdering::sort(RandomIt const begin, RandomIt const end)
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type Value;
+    typedef std::pair<Key, Value> KeyedValue;
+
+    std::vector<KeyedValue> keyed_values;
+    keyed_values.reserve(std::distance(begin, end));
+    for (RandomIt it(begin); it != end; ++it) {
+        keyed_values.push_back(KeyedValue(Key(QFileInfo(*it)), *it));
+    }
+
+    SmartFilenameOrdering const less;
+    std::stable_sort(
+        keyed_values.begin(), keyed_values.end(),
+        [&less](KeyedValue const& lhs, KeyedValue const& rhs) {
+            return less(lhs.first, rhs.first);
+        }
+    );
+
+    RandomIt out(begin);
+    for (KeyedValue const& keyed_value : keyed_values) {
+        *out = keyed_value.second;
+        ++out;
+    }
+}
+
 #endif
@@ -1,4 +1,5 @@
 #include "StatusBarProvider.h"
+#include "MemoryAccounting.h"
 
 QStatusBar* StatusBarProvider::m_statusBar = nullptr;
 int StatusBarProvider::m_filterIdx = 0;
@@ -28,3 +29,12 @@ StatusBarProvider::changeFilterIdx(int idx)
         notify();
     }
 }
+
+QString
+StatusBarProvider::getMemoryUsageText()
+{
+    qint64 const mib = 1024 * 1024;
+    qint64 const live = (MemoryAccounting::liveBytes() + mib / 2) / mib;
+    qint64 const peak = (MemoryAccounting::peakBytes() + mib / 2) / mib;
+    return QObject::tr("%1 / %2 MiB").arg(live).arg(peak);
+}
@@ -133,6 +133,12 @@ public:
         return getStatusLabelPhysSizeDisplayModeSuffix(statusLabelPhysSizeDisplayMode);
     }
 
+    /**
+     * Returns the memory currently taken by image buffers and its peak,
+     * as tracked by MemoryAccounting, formatted for display.
+     */
+    static QString getMemoryUsageText();
+
 public:
     static QEvent::Type StatusBarEventType;
     static StatusLabelPhysSizeDisplayMode statusLabelPhysSizeDisplayMode;
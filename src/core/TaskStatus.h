@@ -19,6 +19,10 @@
 #ifndef TASKSTATUS_H_
 #define TASKSTATUS_H_
 
+#include "IntrusivePtr.h"
+
+class FilterResult;
+
 class TaskStatus
 {
 public:
@@ -29,6 +33,15 @@ public:
     virtual bool isCancelled() const = 0;
 
     virtual void throwIfCancelled() const = 0;
+
+    /**
+     * \brief Hands over an interim result to be shown while the task
+     *        is still running.
+     *
+     * The final result of the task supersedes it.  Tasks nobody is
+     * watching simply drop it, which is what this default does.
+     */
+    virtual void postPreview(IntrusivePtr<FilterResult> const& preview) const {}
 };
 
 #endif
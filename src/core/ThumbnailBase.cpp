@@ -41,6 +41,7 @@
 #include <QPointF>
 #include <Qt>
 #include <QDebug>
+#include <algorithm>
 #include <math.h>
 
 using namespace imageproc;
@@ -68,13 +69,17 @@ ThumbnailBase::ThumbnailBase(
         m_maxSize(max_size),
         m_imageId(image_id),
         m_imageXform(image_xform),
-        m_extendedClipArea(false)
+        m_requestPriority(IoGate::THUMBNAIL),
+        m_extendedClipArea(false),
+        m_renderedPixmapKey(0),
+        m_renderedDeviants(false)
 {
     setImageXform(m_imageXform);
 }
 
 ThumbnailBase::~ThumbnailBase()
 {
+    QPixmapCache::remove(m_renderingKey);
 }
 
 QRectF
@@ -84,26 +89,52 @@ ThumbnailBase::boundingRect() const
 }
 
 void
-ThumbnailBase::paint(QPainter* painter,
-                     QStyleOptionGraphicsItem const* option, QWidget* widget)
+ThumbnailBase::prefetch()
 {
     QPixmap pixmap;
+    // Not on screen yet.
+    requestPixmap(pixmap, IoGate::BACKGROUND);
+}
 
+void
+ThumbnailBase::requestPixmap(QPixmap& pixmap, IoGate::Priority const priority)
+{
     if (!m_ptrCompletionHandler.get()) {
         boost::shared_ptr<LoadCompletionHandler> handler(
             new LoadCompletionHandler(this)
         );
         ThumbnailPixmapCache::Status const status =
-            m_ptrThumbnailCache->loadRequest(m_imageId, pixmap, handler);
+            m_ptrThumbnailCache->loadRequest(m_imageId, pixmap, handler, priority);
         if (status == ThumbnailPixmapCache::QUEUED) {
             m_ptrCompletionHandler.swap(handler);
+            m_requestPriority = priority;
         }
+    } else if (priority < m_requestPriority) {
+        // Prefetched, and now on screen.
+        m_ptrThumbnailCache->loadRequest(m_imageId, pixmap, m_ptrCompletionHandler, priority);
+        m_requestPriority = priority;
     }
 
-    QTransform const image_to_display(m_postScaleXform * painter->worldTransform());
-    QTransform const thumb_to_display(painter->worldTransform());
+    if (pixmap.isNull() && m_ptrCompletionHandler.get()) {
+        // Display the embedded preview, if any, while waiting.
+        if (m_provisionalPixmap.isNull()) {
+            m_ptrThumbnailCache->loadProvisional(m_imageId, m_provisionalPixmap);
+        }
+        pixmap = m_provisionalPixmap;
+    }
+}
+
+void
+ThumbnailBase::paint(QPainter* painter,
+                     QStyleOptionGraphicsItem const* option, QWidget* widget)
+{
+    QPixmap pixmap;
+    requestPixmap(pixmap, IoGate::THUMBNAIL);
 
     if (pixmap.isNull()) {
+        QTransform const image_to_display(m_postScaleXform * painter->worldTransform());
+        QTransform const thumb_to_display(painter->worldTransform());
+
         double const border = 1.0;
         double const shadow = 2.0;
         QRectF rect(m_boundingRect);
@@ -116,6 +147,47 @@ ThumbnailBase::paint(QPainter* painter,
         return;
     }
 
+    // Only the fractional part of the translation affects the rendering,
+    // so scrolling doesn't make it necessary to render again.
+    QTransform const world_xform(painter->worldTransform());
+    QPointF const origin(floor(world_xform.dx()), floor(world_xform.dy()));
+    QTransform const thumb_to_display(
+        world_xform * QTransform::fromTranslate(-origin.x(), -origin.y())
+    );
+    bool const draw_deviants = GlobalStaticSettings::doDrawDeviants();
+
+    QPixmap rendering;
+    if (m_renderedPixmapKey != pixmap.cacheKey()
+            || m_renderedThumbToDisplay != thumb_to_display
+            || m_renderedDeviants != draw_deviants
+            || !QPixmapCache::find(m_renderingKey, &rendering)) {
+        rendering = render(pixmap, thumb_to_display, m_renderedRect);
+        QPixmapCache::remove(m_renderingKey);
+        m_renderingKey = QPixmapCache::insert(rendering);
+        m_renderedPixmapKey = pixmap.cacheKey();
+        m_renderedThumbToDisplay = thumb_to_display;
+        m_renderedDeviants = draw_deviants;
+    }
+
+    QRectF const display_rect(m_renderedRect.translated(origin));
+    painter->setWorldTransform(QTransform());
+    painter->setClipRect(display_rect);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter->drawPixmap(display_rect.topLeft(), rendering);
+}
+
+/**
+ * Draws the transformed and clipped image with everything paintOverImage()
+ * puts on top of it.  \p display_rect is set to where in display coordinates
+ * the result goes.
+ */
+QPixmap
+ThumbnailBase::render(
+    QPixmap const& pixmap, QTransform const& thumb_to_display, QRectF& display_rect)
+{
+    QTransform const image_to_display(m_postScaleXform * thumb_to_display);
+
     QSizeF const orig_image_size(m_imageXform.origRect().size());
     double const x_pre_scale = orig_image_size.width() / pixmap.width();
     double const y_pre_scale = orig_image_size.height() / pixmap.height();
@@ -139,33 +211,17 @@ ThumbnailBase::paint(QPainter* painter,
     // The polygon to draw into in display coordinates.
     QPolygonF display_poly(image_to_display.map(image_poly));
 
-    QRectF display_rect(display_poly.boundingRect());
+    display_rect = display_poly.boundingRect();
     display_rect.setTop(floor(display_rect.top()));
     display_rect.setLeft(floor(display_rect.left()));
     display_rect.setBottom(ceil(display_rect.bottom()));
     display_rect.setRight(ceil(display_rect.right()));
 
-    QPixmap temp_pixmap;
-    QString const cache_key(QLatin1String("ThumbnailBase::temp_pixmap"));
-    if (!QPixmapCache::find(cache_key, &temp_pixmap)
-            || temp_pixmap.width() < display_rect.width()
-            || temp_pixmap.height() < display_rect.height()) {
-        int w = (int)display_rect.width();
-        int h = (int)display_rect.height();
-
-        // Add some extra, to avoid rectreating the pixmap too often.
-        w += w / 10;
-        h += h / 10;
-
-        temp_pixmap = QPixmap(w, h);
-
-        if (!temp_pixmap.hasAlphaChannel()) {
-            // This actually forces the alpha channel to be created.
-            temp_pixmap.fill(Qt::transparent);
-        }
-
-        QPixmapCache::insert(cache_key, temp_pixmap);
-    }
+    QPixmap temp_pixmap(
+        std::max(1, (int)display_rect.width()), std::max(1, (int)display_rect.height())
+    );
+    // This also forces the alpha channel to be created.
+    temp_pixmap.fill(Qt::transparent);
 
     QPainter temp_painter;
     temp_painter.begin(&temp_pixmap);
@@ -209,11 +265,7 @@ ThumbnailBase::paint(QPainter* painter,
 
     temp_painter.end();
 
-    painter->setWorldTransform(QTransform());
-    painter->setClipRect(display_rect);
-    painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
-    painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
-    painter->drawPixmap(display_rect.topLeft(), temp_pixmap);
+    return temp_pixmap;
 }
 
 void ThumbnailBase::paintDeviant(QPainter& painter)
@@ -255,12 +307,16 @@ ThumbnailBase::setImageXform(ImageTransformation const& image_xform)
     double const y_post_scale = scaled_size.height() / unscaled_size.height();
     m_postScaleXform.reset();
     m_postScaleXform.scale(x_post_scale, y_post_scale);
+
+    QPixmapCache::remove(m_renderingKey);
+    m_renderingKey = QPixmapCache::Key();
 }
 
 void
 ThumbnailBase::handleLoadResult(ThumbnailLoadResult const& result)
 {
     m_ptrCompletionHandler.reset();
+    m_provisionalPixmap = QPixmap();
 
     if (result.status() != ThumbnailLoadResult::LOAD_FAILED) {
         // Note that we don't store result.pixmap() in
@@ -29,6 +29,8 @@
 #endif
 #include <QTransform>
 #include <QGraphicsItem>
+#include <QPixmap>
+#include <QPixmapCache>
 #include <QSizeF>
 #include <QRectF>
 
@@ -49,6 +51,13 @@ public:
 
     virtual void paint(QPainter* painter,
                        QStyleOptionGraphicsItem const* option, QWidget* widget);
+
+    /**
+     * \brief Requests the pixmap ahead of this thumbnail becoming visible.
+     *
+     * Does nothing if the pixmap is already cached or being loaded.
+     */
+    void prefetch();
 protected:
     /**
      * \brief A hook to allow subclasses to draw over the thumbnail.
@@ -108,6 +117,17 @@ private:
 
     void handleLoadResult(ThumbnailLoadResult const& result);
 
+    /**
+     * Fetches the pixmap from the cache, or queues a request for it,
+     * unless one is already pending.  A pending request of a lower
+     * \p priority is raised.  While a request is pending,
+     * the preview embedded into the image file is returned, if any.
+     */
+    void requestPixmap(QPixmap& pixmap, IoGate::Priority priority);
+
+    QPixmap render(
+        QPixmap const& pixmap, QTransform const& thumb_to_display, QRectF& display_rect);
+
     IntrusivePtr<ThumbnailPixmapCache> m_ptrThumbnailCache;
     QSizeF m_maxSize;
     ImageId m_imageId;
@@ -121,7 +141,36 @@ private:
     QTransform m_postScaleXform;
 
     boost::shared_ptr<LoadCompletionHandler> m_ptrCompletionHandler;
+
+    /**
+     * The priority m_ptrCompletionHandler was requested with.
+     */
+    IoGate::Priority m_requestPriority;
+
+    /**
+     * The embedded preview displayed while m_ptrCompletionHandler
+     * is pending.
+     */
+    QPixmap m_provisionalPixmap;
     bool m_extendedClipArea;
+
+    /**
+     * The last rendering of the thumbnail, kept in QPixmapCache,
+     * so the ones out of view are the first to go.  It's reused as
+     * long as the source pixmap, the scale and rotation it's displayed
+     * with and the settings paintOverImage() may depend on don't change.
+     * Subclasses get all the rest of their parameters at construction.
+     */
+    QPixmapCache::Key m_renderingKey;
+    qint64 m_renderedPixmapKey;
+    QTransform m_renderedThumbToDisplay;
+    bool m_renderedDeviants;
+
+    /**
+     * Where the rendering goes in display coordinates, less
+     * the integer part of the translation.
+     */
+    QRectF m_renderedRect;
 };
 
 #endif
@@ -17,11 +17,14 @@
 */
 
 #include "ThumbnailPixmapCache.h"
+#include "ThumbnailStore.h"
+#include "EmbeddedPreviewCache.h"
 #include "ImageId.h"
 #include "ImageLoader.h"
-#include "AtomicFileOverwriter.h"
 #include "RelinkablePath.h"
 #include "OutOfMemoryHandler.h"
+#include "TraceRecorder.h"
+#include "Metrics.h"
 #include "imageproc/Scale.h"
 #include "imageproc/GrayImage.h"
 #include <QCoreApplication>
@@ -29,6 +32,7 @@
 #include <QThread>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QWaitCondition>
 #include <QFileInfo>
 #include <QDir>
 #include <QFile>
@@ -37,6 +41,7 @@
 #include <QImage>
 #include <QPixmap>
 #include <QEvent>
+#include <QElapsedTimer>
 #include <QSize>
 #include <QDebug>
 #ifndef Q_MOC_RUN
@@ -44,9 +49,12 @@
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/member.hpp>
+#include <boost/shared_ptr.hpp>
 #endif
 #include <algorithm>
 #include <vector>
+#include <deque>
+#include <memory>
 #include <new>
 
 using namespace ::boost;
@@ -100,18 +108,24 @@ public:
 
     mutable Status status;
 
-    Item(ImageId const& image_id, int preceding_load_attepmts, Status status);
+    /**
+     * The IoGate class to load the thumbnail in.
+     */
+    mutable IoGate::Priority priority;
+
+    Item(ImageId const& image_id, int preceding_load_attepmts,
+         Status status, IoGate::Priority priority);
 
     Item(Item const& other);
 private:
     Item& operator=(Item const& other); // Assignment is forbidden.
 };
 
-class ThumbnailPixmapCache::Impl : public QThread
+class ThumbnailPixmapCache::Impl : public QObject
 {
 public:
     Impl(QString const& thumb_dir, QSize const& max_thumb_size,
-         int max_cached_pixmaps, int expiration_threshold);
+         qint64 max_cached_bytes, int expiration_threshold);
 
     ~Impl();
 
@@ -119,17 +133,15 @@ public:
 
     Status request(
         ImageId const& image_id, QPixmap& pixmap, bool load_now = false,
-        boost::weak_ptr<CompletionHandler> const* completion_handler = 0);
+        boost::weak_ptr<CompletionHandler> const* completion_handler = 0,
+        IoGate::Priority priority = IoGate::THUMBNAIL);
 
     void ensureThumbnailExists(ImageId const& image_id, QImage const& image);
 
     void recreateThumbnail(ImageId const& image_id, QImage const& image);
 protected:
-    virtual void run();
-
     virtual void customEvent(QEvent* e);
 private:
-    class LoadResultEvent;
     class ItemsByKeyTag;
     class LoadQueueTag;
     class RemoveQueueTag;
@@ -147,37 +159,107 @@ private:
     typedef Container::index<LoadQueueTag>::type LoadQueue;
     typedef Container::index<RemoveQueueTag>::type RemoveQueue;
 
-    class BackgroundLoader : public QObject
+    class LoadResult
     {
+        // Member-wise copying is OK.
     public:
-        BackgroundLoader(Impl& owner);
+        LoadResult(LoadQueue::iterator const& lq_t,
+                   QImage const& image, ThumbnailLoadResult::Status status);
+
+        LoadQueue::iterator lqIter() const
+        {
+            return m_lqIter;
+        }
+
+        /**
+         * \brief Hands over the image, leaving a null one in its place.
+         */
+        QImage takeImage()
+        {
+            QImage image;
+            image.swap(m_image);
+            return image;
+        }
+
+        ThumbnailLoadResult::Status status() const
+        {
+            return m_status;
+        }
+    private:
+        LoadQueue::iterator m_lqIter;
+        QImage m_image;
+        ThumbnailLoadResult::Status m_status;
+    };
+
+    class LoaderThread : public QThread
+    {
+    public:
+        LoaderThread(Impl& owner);
     protected:
-        virtual void customEvent(QEvent* e);
+        virtual void run();
     private:
         Impl& m_rOwner;
     };
 
+    void startLoaderThreadsLocked();
+
     void backgroundProcessing();
 
     static QImage loadSaveThumbnail(
-        ImageId const& image_id, QString const& thumb_dir,
-        QSize const& max_thumb_size);
+        ImageId const& image_id, ThumbnailStore& store,
+        QString const& thumb_dir, QSize const& max_thumb_size);
 
+    static QString getStoreFilePath(QString const& thumb_dir);
+
+    /**
+     * \brief The location of a thumbnail written by earlier versions.
+     *
+     * Those are still used if the store doesn't have a thumbnail yet.
+     */
     static QString getThumbFilePath(
         ImageId const& image_id, QString const& thumb_dir);
 
     static QImage makeThumbnail(
         QImage const& image, QSize const& max_thumb_size);
 
+    /**
+     * \brief Converts an image to the format pixmaps use on the raster
+     *        backend, so that QPixmap::fromImage() has nothing to convert.
+     *
+     * That's done on loader threads, to take the conversion off the GUI thread.
+     */
+    static QImage toDisplayFormat(QImage const& image);
+
     void queuedToInProgress(LoadQueue::iterator const& lq_it);
 
     void postLoadResult(
         LoadQueue::iterator const& lq_it, QImage const& image,
         ThumbnailLoadResult::Status status);
 
-    void processLoadResult(LoadResultEvent* result);
+    void postLoadResultLocked(
+        LoadQueue::iterator const& lq_it, QImage const& image,
+        ThumbnailLoadResult::Status status);
+
+    void postProcessingEventLocked();
 
-    void removeExcessLocked();
+    /**
+     * \brief Processes the load results posted so far, within a time budget.
+     *
+     * Whatever doesn't fit into the budget is left for another event,
+     * so that the GUI stays responsive while thousands of thumbnails
+     * arrive.
+     */
+    void processLoadResults();
+
+    void processLoadResult(LoadResult& result);
+
+    static qint64 pixmapCost(QPixmap const& pixmap);
+
+    /**
+     * \brief Removes the least recently used LOADED items until a pixmap
+     *        of the given cost fits into the memory budget.
+     */
+    void removeExcessLocked(qint64 incoming_cost);
 
     void removeItemLocked(RemoveQueue::iterator const& it);
 
@@ -186,7 +268,19 @@ private:
     void cachePixmapLocked(ImageId const& image_id, QPixmap const& pixmap);
 
     mutable QMutex m_mutex;
-    BackgroundLoader m_backgroundLoader;
+
+    /**
+     * Signalled when new QUEUED items appear or we are shutting down.
+     */
+    QWaitCondition m_loadQueueChanged;
+
+    /**
+     * Loader threads take QUEUED items from the front of the load queue,
+     * so the most recently requested thumbnails, which are likely
+     * to be the visible ones, get loaded first.
+     */
+    std::vector<std::unique_ptr<LoaderThread> > m_loaderThreads;
+
     Container m_items;
     ItemsByKey& m_itemsByKey; /**< ImageId => Item mapping */
 
@@ -215,8 +309,18 @@ private:
     RemoveQueue::iterator m_endOfLoadedItems;
 
     QString m_thumbDir;
+
+    /**
+     * Loader threads take a copy of it, so that setThumbDir()
+     * doesn't pull the store from under their feet.
+     */
+    boost::shared_ptr<ThumbnailStore> m_ptrStore;
+
     QSize m_maxThumbSize;
-    int m_maxCachedPixmaps;
+    /**
+     * The memory budget for pixmaps of LOADED items.
+     */
+    qint64 m_maxCachedBytes;
 
     /**
      * \see ThumbnailPixmapCache::ThumbnailPixmapCache()
@@ -226,58 +330,47 @@ private:
     int m_numQueuedItems;
     int m_numLoadedItems;
 
+    /**
+     * The total cost of pixmaps of LOADED items.
+     */
+    qint64 m_cachedBytes;
+
     /**
      * Total image loading attempts so far.  Used for request expiration.
      * \see ThumbnailLoadResult::REQUEST_EXPIRED
      */
     int m_totalLoadAttempts;
 
-    bool m_threadStarted;
-    bool m_shuttingDown;
-};
-
-class ThumbnailPixmapCache::Impl::LoadResultEvent : public QEvent
-{
-public:
-    LoadResultEvent(Impl::LoadQueue::iterator const& lq_t,
-                    QImage const& image, ThumbnailLoadResult::Status status);
-
-    virtual ~LoadResultEvent();
-
-    Impl::LoadQueue::iterator lqIter() const
-    {
-        return m_lqIter;
-    }
+    /**
+     * Load results posted by loader threads, not yet taken by the GUI thread.
+     */
+    std::vector<LoadResult> m_postedResults;
 
-    QImage const& image() const
-    {
-        return m_image;
-    }
+    /**
+     * Load results taken by the GUI thread but not processed yet.
+     * Only accessed from the GUI thread.
+     */
+    std::deque<LoadResult> m_resultsToProcess;
 
-    void releaseImage()
-    {
-        m_image = QImage();
-    }
+    /**
+     * Whether an event that will process load results is in the queue.
+     * Loader threads post one only if there isn't one already.
+     */
+    bool m_processingEventPosted;
 
-    ThumbnailLoadResult::Status status() const
-    {
-        return m_status;
-    }
-private:
-    Impl::LoadQueue::iterator m_lqIter;
-    QImage m_image;
-    ThumbnailLoadResult::Status m_status;
+    bool m_threadStarted;
+    bool m_shuttingDown;
 };
 
 /*========================== ThumbnailPixmapCache ===========================*/
 
 ThumbnailPixmapCache::ThumbnailPixmapCache(
     QString const& thumb_dir, QSize const& max_thumb_size,
-    int const max_cached_pixmaps, int const expiration_threshold)
+    qint64 const max_cached_bytes, int const expiration_threshold)
     :   m_ptrImpl(
             new Impl(
                 RelinkablePath::normalize(thumb_dir), max_thumb_size,
-                max_cached_pixmaps, expiration_threshold
+                max_cached_bytes, expiration_threshold
             )
         )
 {
@@ -308,9 +401,21 @@ ThumbnailPixmapCache::loadNow(ImageId const& image_id, QPixmap& pixmap)
 ThumbnailPixmapCache::Status
 ThumbnailPixmapCache::loadRequest(
     ImageId const& image_id, QPixmap& pixmap,
-    boost::weak_ptr<CompletionHandler> const& completion_handler)
+    boost::weak_ptr<CompletionHandler> const& completion_handler,
+    IoGate::Priority const priority)
+{
+    return m_ptrImpl->request(image_id, pixmap, false, &completion_handler, priority);
+}
+
+ThumbnailPixmapCache::Status
+ThumbnailPixmapCache::loadProvisional(ImageId const& image_id, QPixmap& pixmap)
 {
-    return m_ptrImpl->request(image_id, pixmap, false, &completion_handler);
+    QImage const preview(EmbeddedPreviewCache::find(image_id));
+    if (preview.isNull()) {
+        return LOAD_FAILED;
+    }
+    pixmap = QPixmap::fromImage(preview);
+    return LOADED;
 }
 
 void
@@ -331,20 +436,21 @@ ThumbnailPixmapCache::recreateThumbnail(
 
 ThumbnailPixmapCache::Impl::Impl(
     QString const& thumb_dir, QSize const& max_thumb_size,
-    int const max_cached_pixmaps, int const expiration_threshold)
-    :   m_backgroundLoader(*this),
-        m_items(),
+    qint64 const max_cached_bytes, int const expiration_threshold)
+    :   m_items(),
         m_itemsByKey(m_items.get<ItemsByKeyTag>()),
         m_loadQueue(m_items.get<LoadQueueTag>()),
         m_removeQueue(m_items.get<RemoveQueueTag>()),
         m_endOfLoadedItems(m_removeQueue.end()),
         m_thumbDir(thumb_dir),
         m_maxThumbSize(max_thumb_size),
-        m_maxCachedPixmaps(max_cached_pixmaps),
+        m_maxCachedBytes(max_cached_bytes),
         m_expirationThreshold(expiration_threshold),
         m_numQueuedItems(0),
         m_numLoadedItems(0),
+        m_cachedBytes(0),
         m_totalLoadAttempts(0),
+        m_processingEventPosted(false),
         m_threadStarted(false),
         m_shuttingDown(false)
 {
@@ -354,7 +460,7 @@ ThumbnailPixmapCache::Impl::Impl(
     // a whole bunch of bogus directories would be created.
     QDir().mkdir(m_thumbDir);
 
-    m_backgroundLoader.moveToThread(this);
+    m_ptrStore.reset(new ThumbnailStore(getStoreFilePath(m_thumbDir)));
 }
 
 ThumbnailPixmapCache::Impl::~Impl()
@@ -367,10 +473,12 @@ ThumbnailPixmapCache::Impl::~Impl()
         }
 
         m_shuttingDown = true;
+        m_loadQueueChanged.wakeAll();
     }
 
-    quit();
-    wait();
+    for (std::unique_ptr<LoaderThread> const& thread : m_loaderThreads) {
+        thread->wait();
+    }
 }
 
 void
@@ -383,6 +491,7 @@ ThumbnailPixmapCache::Impl::setThumbDir(QString const& thumb_dir)
     }
 
     m_thumbDir = thumb_dir;
+    m_ptrStore.reset(new ThumbnailStore(getStoreFilePath(m_thumbDir)));
 
     for (Item const& item : m_loadQueue) {
         // This trick will make all queued tasks to expire.
@@ -396,7 +505,8 @@ ThumbnailPixmapCache::Impl::setThumbDir(QString const& thumb_dir)
 ThumbnailPixmapCache::Status
 ThumbnailPixmapCache::Impl::request(
     ImageId const& image_id, QPixmap& pixmap, bool const load_now,
-    boost::weak_ptr<CompletionHandler> const* completion_handler)
+    boost::weak_ptr<CompletionHandler> const* completion_handler,
+    IoGate::Priority const priority)
 {
     assert(QCoreApplication::instance()->thread() == QThread::currentThread());
 
@@ -417,6 +527,7 @@ ThumbnailPixmapCache::Impl::request(
             );
             m_removeQueue.relocate(m_endOfLoadedItems, rq_it);
 
+            Metrics::add(Metrics::THUMBNAIL_CACHE_HITS);
             return LOADED;
         } else if (k_it->status == Item::LOAD_FAILED) {
             pixmap = k_it->pixmap;
@@ -424,14 +535,19 @@ ThumbnailPixmapCache::Impl::request(
         }
     }
 
+    Metrics::add(Metrics::THUMBNAIL_CACHE_MISSES);
+
     if (load_now) {
         QString const thumb_dir(m_thumbDir);
+        boost::shared_ptr<ThumbnailStore> const store(m_ptrStore);
         QSize const max_thumb_size(m_maxThumbSize);
 
         locker.unlock();
 
         pixmap = QPixmap::fromImage(
-                     loadSaveThumbnail(image_id, thumb_dir, max_thumb_size)
+                     toDisplayFormat(
+                         loadSaveThumbnail(image_id, *store, thumb_dir, max_thumb_size)
+                     )
                  );
         if (pixmap.isNull()) {
             return LOAD_FAILED;
@@ -447,7 +563,18 @@ ThumbnailPixmapCache::Impl::request(
 
     if (k_it != m_itemsByKey.end()) {
         assert(k_it->status == Item::QUEUED || k_it->status == Item::IN_PROGRESS);
-        k_it->completionHandlers.push_back(*completion_handler);
+        bool known_handler = false;
+        for (boost::weak_ptr<CompletionHandler> const& handler : k_it->completionHandlers) {
+            if (!handler.owner_before(*completion_handler)
+                    && !completion_handler->owner_before(handler)) {
+                known_handler = true;
+                break;
+            }
+        }
+        if (!known_handler) {
+            k_it->completionHandlers.push_back(*completion_handler);
+        }
+        k_it->priority = std::min(k_it->priority, priority);
 
         if (k_it->status == Item::QUEUED) {
             // Because we've got a new request for this item,
@@ -467,7 +594,7 @@ ThumbnailPixmapCache::Impl::request(
     // Create a new item.
     LoadQueue::iterator const lq_it(
         m_loadQueue.push_front(
-            Item(image_id, m_totalLoadAttempts, Item::QUEUED)
+            Item(image_id, m_totalLoadAttempts, Item::QUEUED, priority)
         ).first
     );
     // Now our new item is at the beginning of the load queue and at the
@@ -481,22 +608,29 @@ ThumbnailPixmapCache::Impl::request(
     }
     lq_it->completionHandlers.push_back(*completion_handler);
 
-    if (m_numQueuedItems++ == 0) {
-        if (m_threadStarted) {
-            // Wake the background thread up.
-            QCoreApplication::postEvent(
-                &m_backgroundLoader, new QEvent(QEvent::User)
-            );
-        } else {
-            // Start the background thread.
-            start();
-            m_threadStarted = true;
-        }
+    ++m_numQueuedItems;
+    if (m_threadStarted) {
+        m_loadQueueChanged.wakeOne();
+    } else {
+        startLoaderThreadsLocked();
     }
 
     return QUEUED;
 }
 
+void
+ThumbnailPixmapCache::Impl::startLoaderThreadsLocked()
+{
+    // Loading is a mix of disk access and decoding, so a few
+    // threads are enough to keep both busy.
+    int const num_threads = std::max(1, std::min(QThread::idealThreadCount(), 4));
+    for (int i = 0; i < num_threads; ++i) {
+        m_loaderThreads.push_back(std::unique_ptr<LoaderThread>(new LoaderThread(*this)));
+        m_loaderThreads.back()->start();
+    }
+    m_threadStarted = true;
+}
+
 void
 ThumbnailPixmapCache::Impl::ensureThumbnailExists(
     ImageId const& image_id, QImage const& image)
@@ -510,22 +644,15 @@ ThumbnailPixmapCache::Impl::ensureThumbnailExists(
     }
 
     QMutexLocker locker(&m_mutex);
-    QString const thumb_dir(m_thumbDir);
+    boost::shared_ptr<ThumbnailStore> const store(m_ptrStore);
     QSize const max_thumb_size(m_maxThumbSize);
     locker.unlock();
 
-    QString const thumb_file_path(getThumbFilePath(image_id, thumb_dir));
-    if (QFile::exists(thumb_file_path)) {
+    if (store->contains(image_id)) {
         return;
     }
 
-    QImage const thumbnail(makeThumbnail(image, max_thumb_size));
-
-    AtomicFileOverwriter overwriter;
-    QIODevice* iodev = overwriter.startWriting(thumb_file_path);
-    if (iodev && thumbnail.save(iodev, "PNG")) {
-        overwriter.commit();
-    }
+    store->store(image_id, makeThumbnail(image, max_thumb_size));
 }
 
 void
@@ -541,26 +668,12 @@ ThumbnailPixmapCache::Impl::recreateThumbnail(
     }
 
     QMutexLocker locker(&m_mutex);
-    QString const thumb_dir(m_thumbDir);
+    boost::shared_ptr<ThumbnailStore> const store(m_ptrStore);
     QSize const max_thumb_size(m_maxThumbSize);
     locker.unlock();
 
-    QString const thumb_file_path(getThumbFilePath(image_id, thumb_dir));
-    QImage const thumbnail(makeThumbnail(image, max_thumb_size));
-    bool thumb_written = false;
-
     // Note that we may be called from multiple threads at the same time.
-    AtomicFileOverwriter overwriter;
-    QIODevice* iodev = overwriter.startWriting(thumb_file_path);
-    if (iodev && thumbnail.save(iodev, "PNG")) {
-        thumb_written = overwriter.commit();
-    } else {
-        overwriter.abort();
-    }
-
-    if (!thumb_written) {
-        return;
-    }
+    store->store(image_id, makeThumbnail(image, max_thumb_size));
 
     QMutexLocker const locker2(&m_mutex);
 
@@ -588,22 +701,15 @@ ThumbnailPixmapCache::Impl::recreateThumbnail(
 }
 
 void
-ThumbnailPixmapCache::Impl::run()
-{
-    backgroundProcessing();
-    exec(); // Wait for further processing requests (via custom events).
-}
-
-void
-ThumbnailPixmapCache::Impl::customEvent(QEvent* e)
+ThumbnailPixmapCache::Impl::customEvent(QEvent*)
 {
-    processLoadResult(dynamic_cast<LoadResultEvent*>(e));
+    processLoadResults();
 }
 
 void
 ThumbnailPixmapCache::Impl::backgroundProcessing()
 {
-    // This method is called from a background thread.
+    // This method is called from loader threads.
     assert(QCoreApplication::instance()->thread() != QThread::currentThread());
 
     for (;;) {
@@ -612,29 +718,43 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
             LoadQueue::iterator lq_it;
             ImageId image_id;
             QString thumb_dir;
+            boost::shared_ptr<ThumbnailStore> store;
             QSize max_thumb_size;
+            IoGate::Priority priority = IoGate::THUMBNAIL;
+
+            {
+                QMutexLocker const locker(&m_mutex);
+                if (!m_shuttingDown && m_numQueuedItems == 0) {
+                    store = m_ptrStore;
+                }
+            }
+
+            if (store) {
+                // Nothing to load at the moment, so it's a good time
+                // to get rid of stale thumbnails.
+                store->compactIfNeeded();
+            }
 
             {
                 QMutexLocker const locker(&m_mutex);
 
-                if (m_shuttingDown || m_items.empty()) {
+                while (!m_shuttingDown && m_numQueuedItems == 0) {
+                    m_loadQueueChanged.wait(&m_mutex);
+                }
+
+                if (m_shuttingDown) {
                     break;
                 }
 
+                // All QUEUED items precede any other items
+                // in the load queue.
                 lq_it = m_loadQueue.begin();
                 image_id = lq_it->imageId;
-
-                if (lq_it->status != Item::QUEUED) {
-                    // All QUEUED items precede any other items
-                    // in the load queue, so it means there are no
-                    // QUEUED items at all.
-                    assert(m_numQueuedItems == 0);
-                    break;
-                }
+                assert(lq_it->status == Item::QUEUED);
 
                 // By marking the item as IN_PROGRESS, we prevent it
                 // from being processed again before the GUI thread
-                // receives our LoadResultEvent.
+                // processes our LoadResult.
                 queuedToInProgress(lq_it);
 
                 if (m_totalLoadAttempts - lq_it->precedingLoadAttempts
@@ -645,7 +765,7 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
                     // ThumbnailLoadResult::REQUEST_EXPIRED
                     // documentation.
 
-                    postLoadResult(
+                    postLoadResultLocked(
                         lq_it, QImage(),
                         ThumbnailLoadResult::REQUEST_EXPIRED
                     );
@@ -657,11 +777,17 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
 
                 // Copy those while holding the mutex.
                 thumb_dir = m_thumbDir;
+                store = m_ptrStore;
                 max_thumb_size = m_maxThumbSize;
+                priority = lq_it->priority;
             } // mutex scope
 
+            TraceRecorder::Span const trace_span("thumbnail_load");
+            IoGate::PriorityScope const io_priority(priority);
             QImage const image(
-                loadSaveThumbnail(image_id, thumb_dir, max_thumb_size)
+                toDisplayFormat(
+                    loadSaveThumbnail(image_id, *store, thumb_dir, max_thumb_size)
+                )
             );
 
             ThumbnailLoadResult::Status const status = image.isNull()
@@ -676,27 +802,45 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
 
 QImage
 ThumbnailPixmapCache::Impl::loadSaveThumbnail(
-    ImageId const& image_id, QString const& thumb_dir,
-    QSize const& max_thumb_size)
+    ImageId const& image_id, ThumbnailStore& store,
+    QString const& thumb_dir, QSize const& max_thumb_size)
 {
-    QString const thumb_file_path(getThumbFilePath(image_id, thumb_dir));
-
-    QImage image(ImageLoader::load(thumb_file_path, 0));
+    QImage image(store.load(image_id));
     if (!image.isNull()) {
         return image;
     }
 
-    image = ImageLoader::load(image_id);
+    QFileInfo const legacy_thumb_info(getThumbFilePath(image_id, thumb_dir));
+    if (legacy_thumb_info.exists()) {
+        QFileInfo const image_info(image_id.filePath());
+        if (!image_info.exists() || image_info.lastModified() <= legacy_thumb_info.lastModified()) {
+            image = ImageLoader::load(legacy_thumb_info.filePath(), 0);
+            if (!image.isNull()) {
+                store.store(image_id, image);
+                return image;
+            }
+        }
+    }
+
+    // Avoid decoding the full resolution raster where the format allows
+    // that, as huge scans may not even fit into memory.
+    image = ImageLoader::loadScaled(image_id, max_thumb_size);
     if (image.isNull()) {
         return QImage();
     }
 
     QImage const thumbnail(makeThumbnail(image, max_thumb_size));
-    thumbnail.save(thumb_file_path, "PNG");
+    store.store(image_id, thumbnail);
 
     return thumbnail;
 }
 
+QString
+ThumbnailPixmapCache::Impl::getStoreFilePath(QString const& thumb_dir)
+{
+    return thumb_dir + QLatin1String("/thumbnails.pack");
+}
+
 QString
 ThumbnailPixmapCache::Impl::getThumbFilePath(
     ImageId const& image_id, QString const& thumb_dir)
@@ -750,6 +894,18 @@ ThumbnailPixmapCache::Impl::makeThumbnail(
            );
 }
 
+QImage
+ThumbnailPixmapCache::Impl::toDisplayFormat(QImage const& image)
+{
+    if (image.isNull()) {
+        return image;
+    }
+
+    return image.convertToFormat(
+               image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32
+           );
+}
+
 void
 ThumbnailPixmapCache::Impl::queuedToInProgress(LoadQueue::iterator const& lq_it)
 {
@@ -773,17 +929,69 @@ ThumbnailPixmapCache::Impl::postLoadResult(
     LoadQueue::iterator const& lq_it, QImage const& image,
     ThumbnailLoadResult::Status const status)
 {
-    LoadResultEvent* e = new LoadResultEvent(lq_it, image, status);
-    QCoreApplication::postEvent(this, e);
+    QMutexLocker const locker(&m_mutex);
+    postLoadResultLocked(lq_it, image, status);
+}
+
+void
+ThumbnailPixmapCache::Impl::postLoadResultLocked(
+    LoadQueue::iterator const& lq_it, QImage const& image,
+    ThumbnailLoadResult::Status const status)
+{
+    m_postedResults.push_back(LoadResult(lq_it, image, status));
+    postProcessingEventLocked();
+}
+
+void
+ThumbnailPixmapCache::Impl::postProcessingEventLocked()
+{
+    if (!m_processingEventPosted) {
+        m_processingEventPosted = true;
+        QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+    }
+}
+
+void
+ThumbnailPixmapCache::Impl::processLoadResults()
+{
+    assert(QCoreApplication::instance()->thread() == QThread::currentThread());
+
+    // Roughly a frame, leaving some time for painting.
+    qint64 const time_budget_msec = 10;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+        m_processingEventPosted = false;
+        m_resultsToProcess.insert(
+            m_resultsToProcess.end(), m_postedResults.begin(), m_postedResults.end()
+        );
+        m_postedResults.clear();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!m_resultsToProcess.empty()) {
+        if (timer.elapsed() >= time_budget_msec) {
+            QMutexLocker const locker(&m_mutex);
+            postProcessingEventLocked();
+            break;
+        }
+
+        LoadResult result(m_resultsToProcess.front());
+        m_resultsToProcess.pop_front();
+        processLoadResult(result);
+    }
 }
 
 void
-ThumbnailPixmapCache::Impl::processLoadResult(LoadResultEvent* result)
+ThumbnailPixmapCache::Impl::processLoadResult(LoadResult& result)
 {
     assert(QCoreApplication::instance()->thread() == QThread::currentThread());
 
-    QPixmap pixmap(QPixmap::fromImage(result->image()));
-    result->releaseImage();
+    // The image is already in display format, and we are normally
+    // its only owner by now, so the pixmap may take over its data.
+    QPixmap pixmap(QPixmap::fromImage(result.takeImage()));
 
     std::vector<boost::weak_ptr<CompletionHandler> > completion_handlers;
 
@@ -794,14 +1002,14 @@ ThumbnailPixmapCache::Impl::processLoadResult(LoadResultEvent* result)
             return;
         }
 
-        LoadQueue::iterator const lq_it(result->lqIter());
+        LoadQueue::iterator const lq_it(result.lqIter());
         RemoveQueue::iterator const rq_it(
             m_items.project<RemoveQueueTag>(lq_it)
         );
 
         Item const& item = *lq_it;
 
-        if (result->status() == ThumbnailLoadResult::LOADED
+        if (result.status() == ThumbnailLoadResult::LOADED
                 && pixmap.isNull()) {
             // That's a special case caused by cachePixmapLocked().
             assert(!item.pixmap.isNull());
@@ -810,12 +1018,16 @@ ThumbnailPixmapCache::Impl::processLoadResult(LoadResultEvent* result)
         }
         item.completionHandlers.swap(completion_handlers);
 
-        if (result->status() == ThumbnailLoadResult::LOADED) {
-            // Maybe remove an older item.
-            removeExcessLocked();
+        if (result.status() == ThumbnailLoadResult::LOADED) {
+            // The provisional thumbnail is no longer needed.
+            EmbeddedPreviewCache::remove(item.imageId);
+
+            // Maybe remove some older items.
+            removeExcessLocked(pixmapCost(item.pixmap));
 
             item.status = Item::LOADED;
             ++m_numLoadedItems;
+            m_cachedBytes += pixmapCost(item.pixmap);
 
             // Move this item after all other LOADED items in
             // the remove queue.
@@ -823,7 +1035,7 @@ ThumbnailPixmapCache::Impl::processLoadResult(LoadResultEvent* result)
 
             // Move to the end of load queue.
             m_loadQueue.relocate(m_loadQueue.end(), lq_it);
-        } else if (result->status() == ThumbnailLoadResult::LOAD_FAILED) {
+        } else if (result.status() == ThumbnailLoadResult::LOAD_FAILED) {
             // We keep items that failed to load, as they are cheap
             // to keep and helps us avoid trying to load them
             // again and again.
@@ -833,7 +1045,7 @@ ThumbnailPixmapCache::Impl::processLoadResult(LoadResultEvent* result)
             // Move to the end of load queue.
             m_loadQueue.relocate(m_loadQueue.end(), lq_it);
         } else {
-            assert(result->status() == ThumbnailLoadResult::REQUEST_EXPIRED);
+            assert(result.status() == ThumbnailLoadResult::REQUEST_EXPIRED);
 
             // Just remove it.
             removeItemLocked(rq_it);
@@ -841,7 +1053,7 @@ ThumbnailPixmapCache::Impl::processLoadResult(LoadResultEvent* result)
     } // mutex scope
 
     // Notify listeners.
-    ThumbnailLoadResult const load_result(result->status(), pixmap);
+    ThumbnailLoadResult const load_result(result.status(), pixmap);
     typedef boost::weak_ptr<CompletionHandler> WeakHandler;
     for (WeakHandler const& wh : completion_handlers) {
         boost::shared_ptr<CompletionHandler> const sh(wh.lock());
@@ -851,11 +1063,16 @@ ThumbnailPixmapCache::Impl::processLoadResult(LoadResultEvent* result)
     }
 }
 
+qint64
+ThumbnailPixmapCache::Impl::pixmapCost(QPixmap const& pixmap)
+{
+    return qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
+
 void
-ThumbnailPixmapCache::Impl::removeExcessLocked()
+ThumbnailPixmapCache::Impl::removeExcessLocked(qint64 const incoming_cost)
 {
-    if (m_numLoadedItems >= m_maxCachedPixmaps) {
-        assert(m_numLoadedItems > 0);
+    while (m_numLoadedItems > 0 && m_cachedBytes + incoming_cost > m_maxCachedBytes) {
         assert(!m_removeQueue.empty());
         assert(m_removeQueue.front().status == Item::LOADED);
         removeItemLocked(m_removeQueue.begin());
@@ -874,6 +1091,7 @@ ThumbnailPixmapCache::Impl::removeItemLocked(
     case Item::LOADED:
         assert(m_numLoadedItems > 0);
         --m_numLoadedItems;
+        m_cachedBytes -= pixmapCost(it->pixmap);
         break;
     default:;
     }
@@ -903,20 +1121,25 @@ ThumbnailPixmapCache::Impl::cachePixmapLocked(
 
     Item::Status const new_status = pixmap.isNull()
                                     ? Item::LOAD_FAILED : Item::LOADED;
+    if (new_status == Item::LOADED) {
+        EmbeddedPreviewCache::remove(image_id);
+    }
 
     // Check if such item already exists.
     ItemsByKey::iterator const k_it(m_itemsByKey.find(image_id));
     if (k_it == m_itemsByKey.end()) {
         // Existing item not found.
 
-        // Maybe remove an older item.
-        removeExcessLocked();
+        // Maybe remove some older items.
+        if (new_status == Item::LOADED) {
+            removeExcessLocked(pixmapCost(pixmap));
+        }
 
         // Insert our new item.
         RemoveQueue::iterator const rq_it(
             m_removeQueue.insert(
                 m_endOfLoadedItems,
-                Item(image_id, m_totalLoadAttempts, new_status)
+                Item(image_id, m_totalLoadAttempts, new_status, IoGate::THUMBNAIL)
             ).first
         );
         // Our new item is now after all LOADED items in the
@@ -924,6 +1147,9 @@ ThumbnailPixmapCache::Impl::cachePixmapLocked(
 
         if (new_status == Item::LOAD_FAILED) {
             --m_endOfLoadedItems;
+        } else {
+            ++m_numLoadedItems;
+            m_cachedBytes += pixmapCost(pixmap);
         }
 
         rq_it->pixmap = pixmap;
@@ -946,8 +1172,8 @@ ThumbnailPixmapCache::Impl::cachePixmapLocked(
         // Not so fast.  We can't go from QUEUED to LOADED directly.
         // Well, maybe we can, but we'd have to invoke the completion
         // handlers right now.  We'd rather do it asynchronously,
-        // so let's transition it to IN_PROGRESS and send
-        // a LoadResultEvent asynchronously.
+        // so let's transition it to IN_PROGRESS and post
+        // a LoadResult.
 
         assert(!k_it->completionHandlers.empty());
 
@@ -957,12 +1183,17 @@ ThumbnailPixmapCache::Impl::cachePixmapLocked(
 
         lq_it->pixmap = pixmap;
         queuedToInProgress(lq_it);
-        postLoadResult(lq_it, QImage(), ThumbnailLoadResult::LOADED);
+        postLoadResultLocked(lq_it, QImage(), ThumbnailLoadResult::LOADED);
         return;
     }
 
     assert(k_it->status == Item::LOAD_FAILED);
 
+    if (new_status == Item::LOADED) {
+        // Maybe remove some older items.
+        removeExcessLocked(pixmapCost(pixmap));
+    }
+
     k_it->status = new_status;
     k_it->pixmap = pixmap;
 
@@ -972,16 +1203,19 @@ ThumbnailPixmapCache::Impl::cachePixmapLocked(
         );
         m_removeQueue.relocate(m_endOfLoadedItems, rq_it);
         ++m_numLoadedItems;
+        m_cachedBytes += pixmapCost(pixmap);
     }
 }
 
 /*====================== ThumbnailPixmapCache::Item =========================*/
 
 ThumbnailPixmapCache::Item::Item(ImageId const& image_id,
-                                 int const preceding_load_attempts, Status const st)
+                                 int const preceding_load_attempts, Status const st,
+                                 IoGate::Priority const prio)
     :   imageId(image_id),
         precedingLoadAttempts(preceding_load_attempts),
-        status(st)
+        status(st),
+        priority(prio)
 {
 }
 
@@ -990,35 +1224,31 @@ ThumbnailPixmapCache::Item::Item(Item const& other)
         pixmap(other.pixmap),
         completionHandlers(other.completionHandlers),
         precedingLoadAttempts(other.precedingLoadAttempts),
-        status(other.status)
+        status(other.status),
+        priority(other.priority)
 {
 }
 
-/*=============== ThumbnailPixmapCache::Impl::LoadResultEvent ===============*/
+/*================= ThumbnailPixmapCache::Impl::LoadResult =================*/
 
-ThumbnailPixmapCache::Impl::LoadResultEvent::LoadResultEvent(
+ThumbnailPixmapCache::Impl::LoadResult::LoadResult(
     Impl::LoadQueue::iterator const& lq_it, QImage const& image,
     ThumbnailLoadResult::Status const status)
-    :   QEvent(QEvent::User),
-        m_lqIter(lq_it),
+    :   m_lqIter(lq_it),
         m_image(image),
         m_status(status)
 {
 }
 
-ThumbnailPixmapCache::Impl::LoadResultEvent::~LoadResultEvent()
-{
-}
-
-/*================== ThumbnailPixmapCache::BackgroundLoader =================*/
+/*================ ThumbnailPixmapCache::Impl::LoaderThread =================*/
 
-ThumbnailPixmapCache::Impl::BackgroundLoader::BackgroundLoader(Impl& owner)
+ThumbnailPixmapCache::Impl::LoaderThread::LoaderThread(Impl& owner)
     :   m_rOwner(owner)
 {
 }
 
 void
-ThumbnailPixmapCache::Impl::BackgroundLoader::customEvent(QEvent*)
+ThumbnailPixmapCache::Impl::LoaderThread::run()
 {
     m_rOwner.backgroundProcessing();
 }
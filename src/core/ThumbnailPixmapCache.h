@@ -23,6 +23,8 @@
 #include "RefCountable.h"
 #include "ThumbnailLoadResult.h"
 #include "AbstractCommand.h"
+#include "IoGate.h"
+#include <QtGlobal>
 #ifndef Q_MOC_RUN
 #include <boost/weak_ptr.hpp>
 #endif
@@ -52,8 +54,9 @@ public:
      * \param max_size The maximum width and height for thumbnails.
      *        The actual thumbnail size is going to depend on its aspect
      *        ratio, but it won't exceed the provided maximum.
-     * \param max_cached_pixmaps The maximum number of pixmaps to store
-     *        in memory.
+     * \param max_cached_bytes The amount of memory pixmaps may occupy.
+     *        When it's exceeded, the least recently used pixmaps are
+     *        dropped.
      * \param expiration_threshold Requests are served from newest to
      *        oldest ones. If a request is still not served after a certain
      *        number of newer requests have been served, that request is
@@ -63,7 +66,7 @@ public:
      * \see ThumbnailLoadResult::REQUEST_EXPIRED
      */
     ThumbnailPixmapCache(QString const& thumb_dir, QSize const& max_size,
-                         int max_cached_pixmaps, int expiration_threshold);
+                         qint64 max_cached_bytes, int expiration_threshold);
 
     /**
      * \brief Destructor.  To be called from the GUI thread only.
@@ -117,10 +120,28 @@ public:
      * x is only safe when done from the GUI thread.  Another thing to
      * keep in mind is that only boost::bind() can handle trackable binds.
      * Other methods, for example boost::lambda::bind() can't do that.
+     * \param priority The IoGate class the files are read in.
+     * Requesting a queued pixmap again with a higher priority raises it.
+     * The same completion handler is only called once.
      */
     Status loadRequest(
         ImageId const& image_id, QPixmap& pixmap,
-        boost::weak_ptr<CompletionHandler> const& completion_handler);
+        boost::weak_ptr<CompletionHandler> const& completion_handler,
+        IoGate::Priority priority = IoGate::THUMBNAIL);
+
+    /**
+     * \brief Take the preview embedded into the image file, if there is one.
+     *
+     * That's meant to be displayed while loadRequest() is being served,
+     * as the preview is only kept until the proper thumbnail is loaded.
+     * Unlike other functions, this one doesn't count as a cache access
+     * in Metrics.
+     *
+     * \note This function is to be called from the GUI thread only.
+     *
+     * \see EmbeddedPreviewCache
+     */
+    Status loadProvisional(ImageId const& image_id, QPixmap& pixmap);
 
     /**
      * \brief If no thumbnail exists for this image, create it.
@@ -0,0 +1,394 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ThumbnailStore.h"
+#include "ImageId.h"
+#include "AtomicFileOverwriter.h"
+#include <QByteArray>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QImage>
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QVector>
+#include <QRgb>
+#include <string.h>
+
+namespace
+{
+
+uint32_t const FILE_MAGIC = 0x50485453; // "STHP"
+uint32_t const FILE_VERSION = 1;
+uint32_t const RECORD_MAGIC = 0x424d4854; // "THMB"
+
+/** The file header is the magic followed by the version. */
+int64_t const FILE_HEADER_SIZE = 8;
+
+/** Don't bother compacting less dead space than that. */
+int64_t const MIN_DEAD_SIZE_TO_COMPACT = 4 * 1024 * 1024;
+
+int64_t padTo4(int64_t const size)
+{
+    return (size + 3) & ~int64_t(3);
+}
+
+bool isStorableFormat(QImage::Format const format)
+{
+    switch (format) {
+    case QImage::Format_Mono:
+    case QImage::Format_Indexed8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // anonymous namespace
+
+ThumbnailStore::ThumbnailStore(QString const& file_path)
+    :   m_filePath(file_path),
+        m_pMap(nullptr),
+        m_mappedSize(0),
+        m_fileSize(0),
+        m_deadSize(0)
+{
+    QMutexLocker const locker(&m_mutex);
+    openLocked();
+}
+
+ThumbnailStore::~ThumbnailStore()
+{
+    QMutexLocker const locker(&m_mutex);
+    closeLocked();
+}
+
+QImage
+ThumbnailStore::load(ImageId const& image_id)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    Index::const_iterator const it(findLocked(image_id));
+    if (it == m_index.end()) {
+        return QImage();
+    }
+
+    RecordHeader const& hdr = it->second.header;
+    int64_t const colors_offset = it->second.offset + sizeof(RecordHeader) + padTo4(hdr.keySize);
+    int64_t const data_offset = colors_offset + int64_t(hdr.numColors) * 4;
+
+    QImage image(hdr.width, hdr.height, QImage::Format(hdr.format));
+    if (image.isNull() || image.bytesPerLine() != hdr.bytesPerLine
+            || int64_t(image.byteCount()) != hdr.dataSize) {
+        return QImage();
+    }
+
+    if (hdr.numColors > 0) {
+        QVector<QRgb> colors(hdr.numColors);
+        if (!readLocked(colors_offset, colors.data(), int64_t(hdr.numColors) * 4)) {
+            return QImage();
+        }
+        image.setColorTable(colors);
+    }
+
+    if (!readLocked(data_offset, image.bits(), hdr.dataSize)) {
+        return QImage();
+    }
+
+    return image;
+}
+
+bool
+ThumbnailStore::contains(ImageId const& image_id)
+{
+    QMutexLocker const locker(&m_mutex);
+    return findLocked(image_id) != m_index.end();
+}
+
+void
+ThumbnailStore::store(ImageId const& image_id, QImage const& thumbnail)
+{
+    if (thumbnail.isNull()) {
+        return;
+    }
+
+    QImage image(thumbnail);
+    if (!isStorableFormat(image.format())) {
+        image = image.convertToFormat(
+                    image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32
+                );
+    }
+
+    SourceStamp const stamp(sourceStamp(image_id));
+    QByteArray const key(makeKey(image_id).toUtf8());
+    QVector<QRgb> const colors(image.colorTable());
+
+    RecordHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = RECORD_MAGIC;
+    hdr.keySize = key.size();
+    hdr.sourceModified = stamp.modified;
+    hdr.sourceSize = stamp.size;
+    hdr.format = image.format();
+    hdr.width = image.width();
+    hdr.height = image.height();
+    hdr.bytesPerLine = image.bytesPerLine();
+    hdr.numColors = colors.size();
+    hdr.dataSize = image.byteCount();
+
+    QByteArray record;
+    record.reserve(recordSize(hdr));
+    record.append(reinterpret_cast<char const*>(&hdr), sizeof(hdr));
+    record.append(key);
+    record.append(QByteArray(padTo4(key.size()) - key.size(), '\0'));
+    record.append(reinterpret_cast<char const*>(colors.constData()), colors.size() * 4);
+    record.append(reinterpret_cast<char const*>(image.constBits()), image.byteCount());
+
+    QMutexLocker const locker(&m_mutex);
+
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    if (!m_file.seek(m_fileSize) || m_file.write(record) != record.size() || !m_file.flush()) {
+        // Get rid of whatever got written.
+        m_file.resize(m_fileSize);
+        return;
+    }
+
+    Entry entry;
+    entry.offset = m_fileSize;
+    entry.header = hdr;
+    m_fileSize += record.size();
+
+    std::pair<Index::iterator, bool> const ins(
+        m_index.insert(Index::value_type(QString::fromUtf8(key), entry))
+    );
+    if (!ins.second) {
+        m_deadSize += recordSize(ins.first->second.header);
+        ins.first->second = entry;
+    }
+}
+
+void
+ThumbnailStore::compactIfNeeded()
+{
+    QMutexLocker const locker(&m_mutex);
+
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    if (m_deadSize < MIN_DEAD_SIZE_TO_COMPACT || m_deadSize * 2 < m_fileSize) {
+        return;
+    }
+
+    AtomicFileOverwriter overwriter;
+    QIODevice* const io_dev = overwriter.startWriting(m_filePath);
+    if (!io_dev) {
+        return;
+    }
+
+    uint32_t const file_header[2] = { FILE_MAGIC, FILE_VERSION };
+    if (io_dev->write(reinterpret_cast<char const*>(file_header), sizeof(file_header))
+            != qint64(sizeof(file_header))) {
+        return;
+    }
+
+    QByteArray record;
+    for (Index::value_type const& kv : m_index) {
+        record.resize(recordSize(kv.second.header));
+        if (!readLocked(kv.second.offset, record.data(), record.size())) {
+            return;
+        }
+        if (io_dev->write(record) != record.size()) {
+            return;
+        }
+    }
+
+    // The file being replaced has to be closed on some platforms.
+    closeLocked();
+    overwriter.commit();
+    openLocked();
+}
+
+QString
+ThumbnailStore::makeKey(ImageId const& image_id)
+{
+    return image_id.filePath() + QChar('\n') + QString::number(image_id.page());
+}
+
+ThumbnailStore::SourceStamp
+ThumbnailStore::sourceStamp(ImageId const& image_id)
+{
+    QFileInfo const file_info(image_id.filePath());
+
+    SourceStamp stamp;
+    stamp.exists = file_info.exists();
+    stamp.modified = stamp.exists ? file_info.lastModified().toMSecsSinceEpoch() : 0;
+    stamp.size = stamp.exists ? file_info.size() : 0;
+    return stamp;
+}
+
+int64_t
+ThumbnailStore::recordSize(RecordHeader const& header)
+{
+    return sizeof(RecordHeader) + padTo4(header.keySize)
+           + int64_t(header.numColors) * 4 + padTo4(header.dataSize);
+}
+
+void
+ThumbnailStore::openLocked()
+{
+    m_file.setFileName(m_filePath);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        return;
+    }
+
+    if (!scanLocked()) {
+        // Not our file, or a different version.  Start from scratch.
+        m_index.clear();
+        m_deadSize = 0;
+
+        uint32_t const file_header[2] = { FILE_MAGIC, FILE_VERSION };
+        if (!m_file.resize(0) || !m_file.seek(0)
+                || m_file.write(reinterpret_cast<char const*>(file_header), sizeof(file_header))
+                != qint64(sizeof(file_header)) || !m_file.flush()) {
+            m_file.close();
+            return;
+        }
+        m_fileSize = FILE_HEADER_SIZE;
+    }
+}
+
+void
+ThumbnailStore::closeLocked()
+{
+    if (m_pMap) {
+        m_file.unmap(m_pMap);
+        m_pMap = nullptr;
+        m_mappedSize = 0;
+    }
+    m_file.close();
+    m_index.clear();
+    m_fileSize = 0;
+    m_deadSize = 0;
+}
+
+bool
+ThumbnailStore::scanLocked()
+{
+    int64_t const file_size = m_file.size();
+    m_fileSize = file_size;
+
+    uint32_t file_header[2];
+    if (!readLocked(0, file_header, sizeof(file_header))
+            || file_header[0] != FILE_MAGIC || file_header[1] != FILE_VERSION) {
+        return false;
+    }
+
+    int64_t offset = FILE_HEADER_SIZE;
+    QByteArray key;
+    while (offset + int64_t(sizeof(RecordHeader)) <= file_size) {
+        Entry entry;
+        entry.offset = offset;
+        RecordHeader& hdr = entry.header;
+        if (!readLocked(offset, &hdr, sizeof(hdr)) || hdr.magic != RECORD_MAGIC
+                || hdr.numColors < 0 || offset + recordSize(hdr) > file_size) {
+            break;
+        }
+
+        key.resize(hdr.keySize);
+        if (!readLocked(offset + sizeof(hdr), key.data(), key.size())) {
+            break;
+        }
+
+        std::pair<Index::iterator, bool> const ins(
+            m_index.insert(Index::value_type(QString::fromUtf8(key), entry))
+        );
+        if (!ins.second) {
+            // A later record supersedes an earlier one.
+            m_deadSize += recordSize(ins.first->second.header);
+            ins.first->second = entry;
+        }
+
+        offset += recordSize(hdr);
+    }
+
+    if (offset != file_size) {
+        // Probably a record that wasn't completely written.
+        if (m_pMap) {
+            m_file.unmap(m_pMap);
+            m_pMap = nullptr;
+            m_mappedSize = 0;
+        }
+        m_file.resize(offset);
+        m_fileSize = offset;
+    }
+
+    return true;
+}
+
+ThumbnailStore::Index::const_iterator
+ThumbnailStore::findLocked(ImageId const& image_id)
+{
+    Index::const_iterator const it(m_index.find(makeKey(image_id)));
+    if (it == m_index.end()) {
+        return it;
+    }
+
+    SourceStamp const stamp(sourceStamp(image_id));
+    if (stamp.exists && (stamp.modified != it->second.header.sourceModified
+                         || stamp.size != it->second.header.sourceSize)) {
+        return m_index.end();
+    }
+
+    return it;
+}
+
+bool
+ThumbnailStore::readLocked(int64_t const offset, void* data, int64_t const size)
+{
+    if (offset < 0 || size < 0 || offset + size > m_fileSize) {
+        return false;
+    }
+
+    if (offset + size > m_mappedSize) {
+        // Records were appended since the file was mapped.
+        if (m_pMap) {
+            m_file.unmap(m_pMap);
+            m_pMap = nullptr;
+            m_mappedSize = 0;
+        }
+        m_pMap = m_file.map(0, m_fileSize);
+        if (m_pMap) {
+            m_mappedSize = m_fileSize;
+        }
+    }
+
+    if (m_pMap) {
+        memcpy(data, m_pMap + offset, size);
+        return true;
+    }
+
+    // Mapping may fail, for example due to the lack of address space.
+    return m_file.seek(offset) && m_file.read(static_cast<char*>(data), size) == size;
+}
@@ -0,0 +1,148 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef THUMBNAILSTORE_H_
+#define THUMBNAILSTORE_H_
+
+#include "NonCopyable.h"
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <map>
+#include <stdint.h>
+
+class ImageId;
+class QImage;
+
+/**
+ * \brief Keeps thumbnails of all images of a project in a single file.
+ *
+ * Thumbnails are stored uncompressed, one after another, and the file is
+ * memory-mapped, so loading a thumbnail amounts to copying its pixels.
+ * Each thumbnail is stamped with the modification time and size of its
+ * source file, so a thumbnail of a modified file is never returned.
+ * Storing a thumbnail for an image that already has one leaves the old
+ * one as dead space, which compactIfNeeded() gets rid of.
+ *
+ * All methods are thread-safe.  A single process is assumed to be using
+ * the file at a time.
+ */
+class ThumbnailStore
+{
+    DECLARE_NON_COPYABLE(ThumbnailStore)
+public:
+    /**
+     * \brief Opens or creates the store file.
+     *
+     * If that fails, the object acts as an always empty store.
+     */
+    explicit ThumbnailStore(QString const& file_path);
+
+    ~ThumbnailStore();
+
+    /**
+     * \brief Returns a thumbnail of an image, or a null image if there
+     *        is no up-to-date one.
+     *
+     * If the source file doesn't exist, any stored thumbnail is considered
+     * up-to-date.  That keeps thumbnails available for relinking.
+     */
+    QImage load(ImageId const& image_id);
+
+    /**
+     * \brief Checks if an up-to-date thumbnail is available.
+     */
+    bool contains(ImageId const& image_id);
+
+    /**
+     * \brief Stores or replaces the thumbnail of an image.
+     *
+     * Failures are silently ignored.
+     */
+    void store(ImageId const& image_id, QImage const& thumbnail);
+
+    /**
+     * \brief Rewrites the file without the dead space, if there is enough
+     *        of it to be worth the trouble.
+     *
+     * That may take a while, and blocks other operations in the meantime,
+     * so it should be called when the store is otherwise idle.
+     */
+    void compactIfNeeded();
+private:
+    struct RecordHeader
+    {
+        uint32_t magic;
+        uint32_t keySize;
+        int64_t sourceModified;
+        int64_t sourceSize;
+        int32_t format;
+        int32_t width;
+        int32_t height;
+        int32_t bytesPerLine;
+        int32_t numColors;
+        uint32_t dataSize;
+    };
+
+    struct Entry
+    {
+        int64_t offset;
+        RecordHeader header;
+    };
+
+    struct SourceStamp
+    {
+        int64_t modified;
+        int64_t size;
+        bool exists;
+    };
+
+    typedef std::map<QString, Entry> Index;
+
+    static QString makeKey(ImageId const& image_id);
+
+    static SourceStamp sourceStamp(ImageId const& image_id);
+
+    static int64_t recordSize(RecordHeader const& header);
+
+    void openLocked();
+
+    void closeLocked();
+
+    bool scanLocked();
+
+    Index::const_iterator findLocked(ImageId const& image_id);
+
+    bool readLocked(int64_t offset, void* data, int64_t size);
+
+    QString m_filePath;
+    QMutex m_mutex;
+    QFile m_file;
+    Index m_index;
+    uchar* m_pMap;
+    int64_t m_mappedSize;
+    int64_t m_fileSize;
+
+    /**
+     * The total size of records that were superseded by newer ones.
+     */
+    int64_t m_deadSize;
+};
+
+#endif
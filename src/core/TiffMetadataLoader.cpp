@@ -38,3 +38,11 @@ TiffMetadataLoader::loadMetadata(
 {
     return TiffReader::readMetadata(io_device, out);
 }
+
+void
+TiffMetadataLoader::loadEmbeddedPreviews(
+    QIODevice& io_device,
+    VirtualFunction2<void, int, QImage const&>& out)
+{
+    TiffReader::readEmbeddedPreviews(io_device, out);
+}
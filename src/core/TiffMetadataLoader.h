@@ -24,6 +24,7 @@
 #include <vector>
 
 class QIODevice;
+class QImage;
 class ImageMetadata;
 
 class TiffMetadataLoader : public ImageMetadataLoader
@@ -40,6 +41,10 @@ protected:
     virtual Status loadMetadata(
         QIODevice& io_device,
         VirtualFunction1<void, ImageMetadata const&>& out);
+
+    virtual void loadEmbeddedPreviews(
+        QIODevice& io_device,
+        VirtualFunction2<void, int, QImage const&>& out);
 };
 
 #endif
@@ -21,14 +21,24 @@
 #include "NonCopyable.h"
 #include "Dpi.h"
 #include "Dpm.h"
+#include "imageproc/Grayscale.h"
 #include <QtGlobal>
 #include <QSysInfo>
 #include <QIODevice>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QImage>
 #include <QColor>
 #include <QSize>
+#include <QRect>
 #include <QDebug>
+#include <QtEndian>
 #include <algorithm>
+#include <vector>
 #include <tiff.h>
 #include <tiffio.h>
 #include <new>
@@ -113,6 +123,88 @@ private:
     T* m_pData;
 };
 
+/**
+ * Remembers where each directory of recently seen multi-page files starts.
+ * Without that, libtiff has to follow the chain of directories from the
+ * beginning of the file every time a page is requested, which makes
+ * processing every page of an n-page file cost O(n^2) directory reads.
+ * Entries are keyed by file path and dropped if the file's size or
+ * modification time changes.
+ */
+class TiffReader::DirectoryOffsetCache
+{
+    DECLARE_NON_COPYABLE(DirectoryOffsetCache)
+public:
+    static DirectoryOffsetCache& instance()
+    {
+        static DirectoryOffsetCache cache;
+        return cache;
+    }
+
+    bool lookup(QIODevice& device, int page_num, quint32& offset)
+    {
+        QFileInfo info;
+        if (!fileInfo(device, info)) {
+            return false;
+        }
+
+        QMutexLocker const locker(&m_mutex);
+        QHash<QString, Entry>::const_iterator const it(m_entries.constFind(info.filePath()));
+        if (it == m_entries.constEnd() || it->size != info.size()
+            || it->modified != info.lastModified()) {
+            return false;
+        }
+        if (page_num < 0 || page_num >= (int)it->offsets.size()) {
+            return false;
+        }
+
+        offset = it->offsets[page_num];
+        return true;
+    }
+
+    void store(QIODevice& device, std::vector<quint32> const& offsets)
+    {
+        QFileInfo info;
+        if (offsets.size() < 2 || !fileInfo(device, info)) {
+            return; // Nothing to gain for single page files.
+        }
+
+        Entry entry;
+        entry.size = info.size();
+        entry.modified = info.lastModified();
+        entry.offsets = offsets;
+
+        QMutexLocker const locker(&m_mutex);
+        if (m_entries.size() >= MAX_ENTRIES && !m_entries.contains(info.filePath())) {
+            m_entries.erase(m_entries.begin());
+        }
+        m_entries.insert(info.filePath(), entry);
+    }
+private:
+    enum { MAX_ENTRIES = 64 };
+
+    struct Entry {
+        qint64 size;
+        QDateTime modified;
+        std::vector<quint32> offsets;
+    };
+
+    DirectoryOffsetCache() {}
+
+    static bool fileInfo(QIODevice& device, QFileInfo& info)
+    {
+        QFile const* file = qobject_cast<QFile*>(&device);
+        if (!file || file->fileName().isEmpty()) {
+            return false;
+        }
+        info.setFile(file->fileName());
+        return true;
+    }
+
+    QMutex m_mutex;
+    QHash<QString, Entry> m_entries;
+};
+
 struct TiffReader::TiffInfo {
     int width;
     int height;
@@ -173,6 +265,111 @@ TiffReader::TiffInfo::mapsToBinaryOrIndexed8() const
     return false;
 }
 
+/**
+ * \brief Averages source lines into blocks of a reduced image.
+ *
+ * Lines are to be fed top to bottom, each exactly once.
+ */
+class TiffReader::LineReducer
+{
+    DECLARE_NON_COPYABLE(LineReducer)
+public:
+    LineReducer(QImage& dst, QSize const& src_size, int reduction);
+
+    void addGrayLine(uint8 const* line, int y);
+
+    void addArgbLine(uint32 const* line, int y);
+private:
+    void maybeFinishRow(int y);
+
+    QImage& m_rDst;
+    int m_srcWidth;
+    int m_srcHeight;
+    int m_reduction;
+    bool m_gray;
+    std::vector<uint32> m_sums;
+};
+
+TiffReader::LineReducer::LineReducer(
+    QImage& dst, QSize const& src_size, int const reduction)
+    :   m_rDst(dst),
+        m_srcWidth(src_size.width()),
+        m_srcHeight(src_size.height()),
+        m_reduction(reduction),
+        m_gray(dst.format() == QImage::Format_Indexed8),
+        m_sums(dst.width() * (m_gray ? 1 : 4), 0)
+{
+}
+
+void
+TiffReader::LineReducer::addGrayLine(uint8 const* line, int const y)
+{
+    assert(m_gray);
+
+    int const reduction = m_reduction;
+    for (int x = 0; x < m_srcWidth; ++x) {
+        m_sums[x / reduction] += line[x];
+    }
+
+    maybeFinishRow(y);
+}
+
+void
+TiffReader::LineReducer::addArgbLine(uint32 const* line, int const y)
+{
+    int const reduction = m_reduction;
+    if (m_gray) {
+        for (int x = 0; x < m_srcWidth; ++x) {
+            m_sums[x / reduction] += qGray(line[x]);
+        }
+    } else {
+        for (int x = 0; x < m_srcWidth; ++x) {
+            uint32* const sum = &m_sums[(x / reduction) * 4];
+            uint32 const argb = line[x];
+            sum[0] += qAlpha(argb);
+            sum[1] += qRed(argb);
+            sum[2] += qGreen(argb);
+            sum[3] += qBlue(argb);
+        }
+    }
+
+    maybeFinishRow(y);
+}
+
+void
+TiffReader::LineReducer::maybeFinishRow(int const y)
+{
+    int const reduction = m_reduction;
+    if ((y + 1) % reduction != 0 && y + 1 != m_srcHeight) {
+        return;
+    }
+
+    int const dst_y = y / reduction;
+    int const block_height = y + 1 - dst_y * reduction;
+    int const dst_width = m_rDst.width();
+    bool const opaque = m_rDst.format() == QImage::Format_RGB32;
+
+    uint8* const dst_line = m_rDst.scanLine(dst_y);
+    for (int dst_x = 0; dst_x < dst_width; ++dst_x) {
+        int const block_width = std::min(reduction, m_srcWidth - dst_x * reduction);
+        uint32 const area = block_width * block_height;
+        uint32 const half = area / 2;
+
+        if (m_gray) {
+            dst_line[dst_x] = static_cast<uint8>((m_sums[dst_x] + half) / area);
+        } else {
+            uint32 const* const sum = &m_sums[dst_x * 4];
+            int const a = opaque ? 0xff : (sum[0] + half) / area;
+            ((uint32*)dst_line)[dst_x] = qRgba(
+                (sum[1] + half) / area, (sum[2] + half) / area,
+                (sum[3] + half) / area, a
+            );
+        }
+    }
+
+    std::fill(m_sums.begin(), m_sums.end(), 0);
+}
+
 static tsize_t deviceRead(thandle_t context, tdata_t data, tsize_t size)
 {
     QIODevice* dev = (QIODevice*)context;
@@ -256,10 +453,25 @@ TiffReader::readMetadata(
         return ImageMetadataLoader::GENERIC_ERROR;
     }
 
-    if (!checkHeader(TiffHeader(readHeader(device)))) {
+    TiffHeader const header(readHeader(device));
+    if (!checkHeader(header)) {
         return ImageMetadataLoader::FORMAT_NOT_RECOGNIZED;
     }
 
+    std::vector<ImageMetadata> pages;
+    std::vector<quint32> dir_offsets;
+    qint64 const pos = device.pos();
+    bool const walked = walkDirectories(device, header, pages, dir_offsets);
+    device.seek(pos);
+    if (walked) {
+        // Processing stages are going to ask for these pages one by one.
+        DirectoryOffsetCache::instance().store(device, dir_offsets);
+        for (ImageMetadata const& metadata : pages) {
+            out(metadata);
+        }
+        return ImageMetadataLoader::LOADED;
+    }
+
     TiffHandle tif(
         TIFFClientOpen(
             "file", "rBm", &device, &deviceRead, &deviceWrite,
@@ -278,6 +490,11 @@ TiffReader::readMetadata(
     return ImageMetadataLoader::LOADED;
 }
 
+static void deleteMappedFile(void* file)
+{
+    delete static_cast<QFile*>(file);
+}
+
 static void convertAbgrToArgb(uint32 const* src, uint32* dst, int count)
 {
     for (int i = 0; i < count; ++i) {
@@ -317,7 +534,7 @@ TiffReader::readImage(QIODevice& device, int const page_num)
         return QImage();
     }
 
-    if (!TIFFSetDirectory(tif.handle(), page_num)) {
+    if (!setDirectory(device, header, tif, page_num)) {
         return QImage();
     }
 
@@ -329,7 +546,10 @@ TiffReader::readImage(QIODevice& device, int const page_num)
 
     if (info.mapsToBinaryOrIndexed8()) {
         // Common case optimization.
-        image = extractBinaryOrIndexed8Image(tif, info);
+        image = mapUncompressedImage(device, tif, info);
+        if (image.isNull()) {
+            image = extractBinaryOrIndexed8Image(tif, info);
+        }
     } else {
         // General case.
         image = QImage(
@@ -380,6 +600,245 @@ TiffReader::readImage(QIODevice& device, int const page_num)
     return image;
 }
 
+QImage
+TiffReader::readImage(
+    QIODevice& device, int const page_num,
+    QRect const& region, int const reduction)
+{
+    return readReducedRegion(device, page_num, region, reduction, 0);
+}
+
+QImage
+TiffReader::readReducedImage(
+    QIODevice& device, int const page_num, QSize const& min_size)
+{
+    return readReducedRegion(device, page_num, QRect(), 1, &min_size);
+}
+
+QImage
+TiffReader::readReducedRegion(
+    QIODevice& device, int const page_num, QRect const& region,
+    int reduction, QSize const* min_size)
+{
+    if (!device.isReadable()) {
+        return QImage();
+    }
+    if (device.isSequential()) {
+        // libtiff needs to be able to seek.
+        return QImage();
+    }
+
+    TiffHeader header(readHeader(device));
+    if (!checkHeader(header)) {
+        return QImage();
+    }
+
+    TiffHandle tif(
+        TIFFClientOpen(
+            "file", "rBm", &device, &deviceRead, &deviceWrite,
+            &deviceSeek, &deviceClose, &deviceSize,
+            &deviceMap, &deviceUnmap
+        )
+    );
+    if (!tif.handle()) {
+        return QImage();
+    }
+
+    if (!setDirectory(device, header, tif, page_num)) {
+        return QImage();
+    }
+
+    TiffInfo const info(tif, header);
+
+    ImageMetadata const metadata(currentPageMetadata(tif));
+
+    QRect const image_rect(0, 0, info.width, info.height);
+    QRect const src_rect(region.isNull() ? image_rect : region.intersected(image_rect));
+    if (src_rect.isEmpty()) {
+        return QImage();
+    }
+
+    if (min_size) {
+        reduction = std::min(
+                        src_rect.width() / std::max(1, min_size->width()),
+                        src_rect.height() / std::max(1, min_size->height())
+                    );
+    }
+    reduction = std::max(1, reduction);
+
+    bool const gray = info.samples_per_pixel == 1
+                      && (info.photometric == PHOTOMETRIC_MINISBLACK
+                          || info.photometric == PHOTOMETRIC_MINISWHITE);
+    QImage::Format format = QImage::Format_Indexed8;
+    if (!gray) {
+        format = info.samples_per_pixel == 4 ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+    }
+
+    QImage image(
+        (src_rect.width() + reduction - 1) / reduction,
+        (src_rect.height() + reduction - 1) / reduction, format
+    );
+    if (image.isNull()) {
+        throw std::bad_alloc();
+    }
+    if (gray) {
+        image.setColorTable(imageproc::createGrayscalePalette());
+    }
+
+    LineReducer reducer(image, src_rect.size(), reduction);
+
+    bool ok = false;
+    if (TIFFIsTiled(tif.handle())) {
+        ok = readRegionRgbaTiles(tif, info, src_rect, reducer);
+    } else if (canReadRegionScanlines(tif, info)) {
+        ok = readRegionScanlines(tif, info, src_rect, reducer);
+    } else {
+        ok = readRegionRgbaStrips(tif, info, src_rect, reducer);
+    }
+    if (!ok) {
+        return QImage();
+    }
+
+    if (!metadata.dpi().isNull()) {
+        Dpm const dpm(metadata.dpi());
+        image.setDotsPerMeterX(dpm.horizontal() / reduction);
+        image.setDotsPerMeterY(dpm.vertical() / reduction);
+    }
+
+    return image;
+}
+
+void
+TiffReader::readEmbeddedPreviews(
+    QIODevice& device, VirtualFunction2<void, int, QImage const&>& out)
+{
+    if (!device.isReadable() || device.isSequential()) {
+        return;
+    }
+
+    TiffHeader const header(readHeader(device));
+    if (!checkHeader(header) || header.version() != 42) {
+        return;
+    }
+
+    std::vector<quint32> dir_offsets;
+    if (!readDirectoryOffsets(device, header, dir_offsets)) {
+        return;
+    }
+
+    bool const big_endian = (header.signature() == TiffHeader::TIFF_BIG_ENDIAN);
+    auto const get16 = [big_endian](uchar const* p) -> quint16 {
+        return big_endian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+    };
+
+    // Most files have no SubIFDs at all, and for those we don't want
+    // libtiff to decode every directory.
+    std::vector<int> candidates;
+    for (int page = 0; page < (int)dir_offsets.size(); ++page) {
+        uchar count[2];
+        if (!device.seek(dir_offsets[page])
+                || device.read((char*)count, sizeof(count)) != sizeof(count)) {
+            return;
+        }
+        int const num_entries = get16(count);
+        std::vector<uchar> entries(num_entries * 12 + 1);
+        qint64 const entries_size = num_entries * 12;
+        if (device.read((char*)&entries[0], entries_size) != entries_size) {
+            return;
+        }
+        for (int i = 0; i < num_entries; ++i) {
+            if (get16(&entries[i * 12]) == TIFFTAG_SUBIFD) {
+                candidates.push_back(page);
+                break;
+            }
+        }
+    }
+    if (candidates.empty()) {
+        return;
+    }
+
+    device.seek(0);
+    TiffHandle tif(
+        TIFFClientOpen(
+            "file", "rBm", &device, &deviceRead, &deviceWrite,
+            &deviceSeek, &deviceClose, &deviceSize,
+            &deviceMap, &deviceUnmap
+        )
+    );
+    if (!tif.handle()) {
+        return;
+    }
+
+    for (int const page : candidates) {
+        if (!TIFFSetSubDirectory(tif.handle(), dir_offsets[page])) {
+            continue;
+        }
+
+        uint16 count = 0;
+        toff_t* offsets = 0;
+        if (!TIFFGetField(tif.handle(), TIFFTAG_SUBIFD, &count, &offsets) || !offsets) {
+            continue;
+        }
+        // Switching directories invalidates the array.
+        std::vector<quint64> const sub_ifds(offsets, offsets + count);
+
+        QImage const preview(readPreview(tif, sub_ifds));
+        if (!preview.isNull()) {
+            out(page, preview);
+        }
+    }
+}
+
+/**
+ * Decodes the largest of the reduced resolution subimages that doesn't
+ * exceed MAX_PREVIEW_SIZE.  Other kinds of subimages, like transparency
+ * masks, are ignored.
+ */
+QImage
+TiffReader::readPreview(TiffHandle const& tif, std::vector<quint64> const& sub_ifds)
+{
+    quint64 best_offset = 0;
+    uint32 best_width = 0;
+    uint32 best_height = 0;
+    for (quint64 const offset : sub_ifds) {
+        if (!TIFFSetSubDirectory(tif.handle(), offset)) {
+            continue;
+        }
+        uint32 subfile_type = 0;
+        uint32 width = 0;
+        uint32 height = 0;
+        TIFFGetField(tif.handle(), TIFFTAG_SUBFILETYPE, &subfile_type);
+        TIFFGetField(tif.handle(), TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tif.handle(), TIFFTAG_IMAGELENGTH, &height);
+        if (!(subfile_type & FILETYPE_REDUCEDIMAGE) || width == 0 || height == 0
+                || width > MAX_PREVIEW_SIZE || height > MAX_PREVIEW_SIZE) {
+            continue;
+        }
+        if (width * height > best_width * best_height) {
+            best_offset = offset;
+            best_width = width;
+            best_height = height;
+        }
+    }
+
+    if (best_offset == 0 || !TIFFSetSubDirectory(tif.handle(), best_offset)) {
+        return QImage();
+    }
+
+    QImage image(best_width, best_height, QImage::Format_ARGB32);
+    if (image.isNull()) {
+        return QImage();
+    }
+    // Format_ARGB32 lines are never padded.
+    uint32* const pixels = (uint32*)image.bits();
+    if (!TIFFReadRGBAImageOriented(tif.handle(), best_width, best_height,
+                                   pixels, ORIENTATION_TOPLEFT, 0)) {
+        return QImage();
+    }
+    convertAbgrToArgb(pixels, pixels, best_width * best_height);
+    return image;
+}
+
 TiffReader::TiffHeader
 TiffReader::readHeader(QIODevice& device)
 {
@@ -414,6 +873,239 @@ TiffReader::checkHeader(TiffHeader const& header)
     return true;
 }
 
+/**
+ * Follows the chain of directories and picks up only the tags that make
+ * up ImageMetadata.  TIFFReadDirectory() decodes every tag, including
+ * the strip offset and byte count arrays, which costs a lot of small
+ * reads per page over a network share.  Here a page costs one read
+ * for the directory and, if present, one for the resolution values.
+ *
+ * Only classic TIFF with the usual tag types is handled.  Anything
+ * else, including a broken directory, makes us return false and leave
+ * the whole file to libtiff, so that the outcome stays the same.
+ */
+bool
+TiffReader::walkDirectories(
+    QIODevice& device, TiffHeader const& header,
+    std::vector<ImageMetadata>& pages, std::vector<quint32>& dir_offsets)
+{
+    if (header.version() != 42) {
+        return false; // BigTIFF.
+    }
+
+    bool const big_endian = (header.signature() == TiffHeader::TIFF_BIG_ENDIAN);
+    auto const get16 = [big_endian](uchar const* p) -> quint16 {
+        return big_endian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+    };
+    auto const get32 = [big_endian](uchar const* p) -> quint32 {
+        return big_endian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+    };
+    auto const readAt = [&device](quint32 offset, uchar* data, qint64 size) {
+        return device.seek(offset) && device.read((char*)data, size) == size;
+    };
+    // Same as libtiff: a zero numerator or denominator gives zero.
+    auto const toFloat = [&get32](uchar const* p) -> float {
+        quint32 const num = get32(p);
+        quint32 const den = get32(p + 4);
+        return (num == 0 || den == 0) ? 0.0f : float(double(num) / double(den));
+    };
+
+    uchar file_header[8];
+    if (!readAt(0, file_header, sizeof(file_header))) {
+        return false;
+    }
+
+    std::vector<quint32> visited;
+    quint32 offset = get32(file_header + 4);
+    while (offset != 0) {
+        if (std::find(visited.begin(), visited.end(), offset) != visited.end()) {
+            return false; // A loop in the chain.
+        }
+        visited.push_back(offset);
+
+        uchar count[2];
+        if (!readAt(offset, count, sizeof(count))) {
+            return false;
+        }
+        int const num_entries = get16(count);
+        // The entries are followed by the offset of the next directory.
+        std::vector<uchar> entries(num_entries * 12 + 4);
+        if (device.read((char*)&entries[0], entries.size()) != (qint64)entries.size()) {
+            return false;
+        }
+
+        quint32 width = 0;
+        quint32 height = 0;
+        quint32 xres_offset = 0;
+        quint32 yres_offset = 0;
+        unsigned res_unit = RESUNIT_INCH;
+        bool have_data = false;
+
+        for (int i = 0; i < num_entries; ++i) {
+            uchar const* const entry = &entries[i * 12];
+            quint16 const tag = get16(entry);
+            quint16 const type = get16(entry + 2);
+            quint32 const num_values = get32(entry + 4);
+            uchar const* const value = entry + 8;
+
+            switch (tag) {
+            case TIFFTAG_IMAGEWIDTH:
+            case TIFFTAG_IMAGELENGTH: {
+                quint32 dimension = 0;
+                if (num_values != 1) {
+                    return false;
+                } else if (type == TIFF_SHORT) {
+                    dimension = get16(value);
+                } else if (type == TIFF_LONG) {
+                    dimension = get32(value);
+                } else {
+                    return false;
+                }
+                (tag == TIFFTAG_IMAGEWIDTH ? width : height) = dimension;
+                break;
+            }
+            case TIFFTAG_XRESOLUTION:
+            case TIFFTAG_YRESOLUTION:
+                if (type != TIFF_RATIONAL || num_values != 1) {
+                    return false;
+                }
+                (tag == TIFFTAG_XRESOLUTION ? xres_offset : yres_offset) = get32(value);
+                break;
+            case TIFFTAG_RESOLUTIONUNIT:
+                if (type != TIFF_SHORT || num_values != 1) {
+                    return false;
+                }
+                res_unit = get16(value);
+                break;
+            case TIFFTAG_STRIPOFFSETS:
+            case TIFFTAG_TILEOFFSETS:
+                have_data = true;
+                break;
+            }
+        }
+
+        if (width == 0 || height == 0 || !have_data) {
+            // libtiff would stop at such a directory.
+            return false;
+        }
+
+        float xres = 0;
+        float yres = 0;
+        uchar rationals[16];
+        if (xres_offset != 0 && yres_offset == xres_offset + 8) {
+            // The usual layout, which takes a single read.
+            if (!readAt(xres_offset, rationals, 16)) {
+                return false;
+            }
+            xres = toFloat(rationals);
+            yres = toFloat(rationals + 8);
+        } else {
+            if (xres_offset != 0) {
+                if (!readAt(xres_offset, rationals, 8)) {
+                    return false;
+                }
+                xres = toFloat(rationals);
+            }
+            if (yres_offset != 0) {
+                if (!readAt(yres_offset, rationals, 8)) {
+                    return false;
+                }
+                yres = toFloat(rationals);
+            }
+        }
+
+        pages.push_back(
+            ImageMetadata(QSize(width, height), getDpi(xres, yres, res_unit))
+        );
+        offset = get32(&entries[num_entries * 12]);
+    }
+
+    dir_offsets.swap(visited);
+    return !pages.empty();
+}
+
+/**
+ * Collects the offsets of all directories, reading just the entry count
+ * and the next directory offset of each one.  Returns false for BigTIFF
+ * and broken chains, in which case libtiff should be left to sort it out.
+ */
+bool
+TiffReader::readDirectoryOffsets(
+    QIODevice& device, TiffHeader const& header, std::vector<quint32>& dir_offsets)
+{
+    if (header.version() != 42) {
+        return false; // BigTIFF.
+    }
+
+    bool const big_endian = (header.signature() == TiffHeader::TIFF_BIG_ENDIAN);
+    auto const get16 = [big_endian](uchar const* p) -> quint16 {
+        return big_endian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+    };
+    auto const get32 = [big_endian](uchar const* p) -> quint32 {
+        return big_endian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+    };
+    auto const readAt = [&device](qint64 offset, uchar* data, qint64 size) {
+        return device.seek(offset) && device.read((char*)data, size) == size;
+    };
+
+    uchar buf[4];
+    if (!readAt(4, buf, 4)) {
+        return false;
+    }
+
+    std::vector<quint32> offsets;
+    quint32 offset = get32(buf);
+    while (offset != 0) {
+        if (std::find(offsets.begin(), offsets.end(), offset) != offsets.end()) {
+            return false; // A loop in the chain.
+        }
+        offsets.push_back(offset);
+
+        if (!readAt(offset, buf, 2)) {
+            return false;
+        }
+        if (!readAt(qint64(offset) + 2 + qint64(get16(buf)) * 12, buf, 4)) {
+            return false;
+        }
+        offset = get32(buf);
+    }
+
+    dir_offsets.swap(offsets);
+    return true;
+}
+
+/**
+ * Makes \p page_num the current directory.  Pages past the first one
+ * are located through DirectoryOffsetCache, which is filled on demand
+ * if the file hasn't been seen yet.
+ */
+bool
+TiffReader::setDirectory(
+    QIODevice& device, TiffHeader const& header,
+    TiffHandle const& tif, int const page_num)
+{
+    if (page_num > 0) {
+        DirectoryOffsetCache& cache = DirectoryOffsetCache::instance();
+        quint32 offset = 0;
+        if (!cache.lookup(device, page_num, offset)) {
+            std::vector<quint32> dir_offsets;
+            qint64 const pos = device.pos();
+            if (readDirectoryOffsets(device, header, dir_offsets)) {
+                cache.store(device, dir_offsets);
+            }
+            device.seek(pos);
+            if (page_num < (int)dir_offsets.size()) {
+                offset = dir_offsets[page_num];
+            }
+        }
+        if (offset != 0) {
+            return TIFFSetSubDirectory(tif.handle(), offset);
+        }
+    }
+
+    return TIFFSetDirectory(tif.handle(), page_num);
+}
+
 ImageMetadata
 TiffReader::currentPageMetadata(TiffHandle const& tif)
 {
@@ -456,8 +1148,119 @@ TiffReader::extractBinaryOrIndexed8Image(
         throw std::bad_alloc();
     }
 
+    QVector<QRgb> color_table;
+    if (!readColorTable(tif, info, color_table)) {
+        return QImage();
+    }
+    image.setColorTable(color_table);
+
+    if (info.bits_per_sample == 1 || info.bits_per_sample == 8) {
+        readLines(tif, image);
+    } else {
+        readAndUnpackLines(tif, info, image);
+    }
+
+    return image;
+}
+
+/**
+ * Uncompressed bilevel and 8-bit pages stored in contiguous strips
+ * already have the layout of a QImage, so rather than reading them
+ * in, we map the file into memory and wrap the pixels in place.
+ * The mapping is private, so writing to the image costs a copy of
+ * the affected memory pages rather than modifying the file.  Returns
+ * a null image if the page doesn't qualify.
+ */
+QImage
+TiffReader::mapUncompressedImage(
+    QIODevice& device, TiffHandle const& tif, TiffInfo const& info)
+{
+    QFile* const src_file = qobject_cast<QFile*>(&device);
+    if (!src_file || src_file->fileName().isEmpty()) {
+        return QImage();
+    }
+    if (info.bits_per_sample != 1 && info.bits_per_sample != 8) {
+        return QImage();
+    }
+
+    uint16 compression = COMPRESSION_NONE;
+    uint16 fill_order = FILLORDER_MSB2LSB;
+    uint32 rows_per_strip = info.height;
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_COMPRESSION, &compression);
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_FILLORDER, &fill_order);
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+    if (compression != COMPRESSION_NONE || fill_order != FILLORDER_MSB2LSB
+            || TIFFIsTiled(tif.handle()) || rows_per_strip == 0) {
+        return QImage();
+    }
+
+    // toff_t matches the type of these tags in both libtiff 3 and 4.
+    toff_t* offsets = 0;
+    toff_t* byte_counts = 0;
+    if (!TIFFGetField(tif.handle(), TIFFTAG_STRIPOFFSETS, &offsets)
+            || !TIFFGetField(tif.handle(), TIFFTAG_STRIPBYTECOUNTS, &byte_counts)
+            || !offsets || !byte_counts) {
+        return QImage();
+    }
+
+    // QImage and the code using it expect 32-bit aligned lines.
+    qint64 const bpl = TIFFScanlineSize(tif.handle());
+    qint64 const start = offsets[0];
+    if (bpl <= 0 || bpl % 4 != 0 || start % 4 != 0) {
+        return QImage();
+    }
+
+    int const num_strips = TIFFNumberOfStrips(tif.handle());
+    for (int i = 0; i < num_strips; ++i) {
+        qint64 const first_row = qint64(i) * rows_per_strip;
+        qint64 const rows = std::min<qint64>(rows_per_strip, info.height - first_row);
+        if (toff_t(start + first_row * bpl) != offsets[i]
+                || qint64(byte_counts[i]) < rows * bpl) {
+            return QImage();
+        }
+    }
+
+    qint64 const size = bpl * info.height;
+    if (start + size > src_file->size()) {
+        return QImage();
+    }
+
+    QVector<QRgb> color_table;
+    if (!readColorTable(tif, info, color_table)) {
+        return QImage();
+    }
+
+    // The mapping lives as long as this QFile, which the image deletes.
+    QFile* const file = new QFile(src_file->fileName());
+    uchar* data = 0;
+    if (file->open(QIODevice::ReadOnly)) {
+        data = file->map(start, size, QFileDevice::MapPrivateOption);
+    }
+    if (!data) {
+        delete file;
+        return QImage();
+    }
+
+    QImage image(
+        data, info.width, info.height, bpl,
+        info.bits_per_sample == 1 ? QImage::Format_Mono : QImage::Format_Indexed8,
+        &deleteMappedFile, file
+    );
+    if (image.isNull()) {
+        delete file;
+        return QImage();
+    }
+    image.setColorTable(color_table);
+
+    return image;
+}
+
+bool
+TiffReader::readColorTable(
+    TiffHandle const& tif, TiffInfo const& info, QVector<QRgb>& color_table)
+{
     int const num_colors = 1 << info.bits_per_sample;
-    image.setColorCount(num_colors);
+    color_table.resize(num_colors);
 
     if (info.photometric == PHOTOMETRIC_PALETTE) {
         uint16* pr = 0;
@@ -465,7 +1268,7 @@ TiffReader::extractBinaryOrIndexed8Image(
         uint16* pb = 0;
         TIFFGetField(tif.handle(), TIFFTAG_COLORMAP, &pr, &pg, &pb);
         if (!pr || !pg || !pb) {
-            return QImage();
+            return false;
         }
         if (info.host_big_endian != info.file_big_endian) {
             TIFFSwabArrayOfShort(pr, num_colors);
@@ -478,32 +1281,26 @@ TiffReader::extractBinaryOrIndexed8Image(
             uint32 const g = (uint32)(pg[i] * f + 0.5);
             uint32 const b = (uint32)(pb[i] * f + 0.5);
             uint32 const a = 0xFF000000;
-            image.setColor(i, a | (r << 16) | (g << 8) | b);
+            color_table[i] = a | (r << 16) | (g << 8) | b;
         }
     } else if (info.photometric == PHOTOMETRIC_MINISBLACK) {
         double const f = 255.0 / (num_colors - 1);
         for (int i = 0; i < num_colors; ++i) {
             int const gray = (int)(i * f + 0.5);
-            image.setColor(i, qRgb(gray, gray, gray));
+            color_table[i] = qRgb(gray, gray, gray);
         }
     } else if (info.photometric == PHOTOMETRIC_MINISWHITE) {
         double const f = 255.0 / (num_colors - 1);
         int c = num_colors - 1;
         for (int i = 0; i < num_colors; ++i, --c) {
             int const gray = (int)(c * f + 0.5);
-            image.setColor(i, qRgb(gray, gray, gray));
+            color_table[i] = qRgb(gray, gray, gray);
         }
     } else {
-        return QImage();
-    }
-
-    if (info.bits_per_sample == 1 || info.bits_per_sample == 8) {
-        readLines(tif, image);
-    } else {
-        readAndUnpackLines(tif, info, image);
+        return false;
     }
 
-    return image;
+    return true;
 }
 
 void
@@ -547,3 +1344,167 @@ TiffReader::readAndUnpackLines(
         }
     }
 }
+
+bool
+TiffReader::canReadRegionScanlines(TiffHandle const& tif, TiffInfo const& info)
+{
+    if (info.sample_format != SAMPLEFORMAT_UINT) {
+        return false;
+    }
+
+    if (info.mapsToBinaryOrIndexed8()) {
+        // Samples that don't straddle byte boundaries.
+        return 8 % info.bits_per_sample == 0;
+    }
+
+    uint16 planar_config = PLANARCONFIG_CONTIG;
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_PLANARCONFIG, &planar_config);
+
+    return info.photometric == PHOTOMETRIC_RGB
+           && info.bits_per_sample == 8
+           && (info.samples_per_pixel == 3 || info.samples_per_pixel == 4)
+           && planar_config == PLANARCONFIG_CONTIG;
+}
+
+bool
+TiffReader::readRegionScanlines(
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& region, LineReducer& reducer)
+{
+    TiffBuffer<uint8> buf(TIFFScanlineSize(tif.handle()));
+
+    int const left = region.left();
+    int const width = region.width();
+    std::vector<uint32> argb_line(width);
+    std::vector<uint8> gray_line(width);
+
+    if (info.mapsToBinaryOrIndexed8()) {
+        QVector<QRgb> color_table;
+        if (!readColorTable(tif, info, color_table)) {
+            return false;
+        }
+        bool const gray = info.photometric != PHOTOMETRIC_PALETTE;
+        int const bits_per_sample = info.bits_per_sample;
+        unsigned const mask = (1 << bits_per_sample) - 1;
+
+        for (int y = region.top(); y <= region.bottom(); ++y) {
+            if (TIFFReadScanline(tif.handle(), buf.data(), y) < 0) {
+                return false;
+            }
+
+            uint8 const* const src = buf.data();
+            for (int i = 0; i < width; ++i) {
+                int const bit_offset = (left + i) * bits_per_sample;
+                unsigned const shift = 8 - bits_per_sample - (bit_offset & 7);
+                QRgb const color = color_table[(src[bit_offset >> 3] >> shift) & mask];
+                if (gray) {
+                    gray_line[i] = static_cast<uint8>(qGray(color));
+                } else {
+                    argb_line[i] = color;
+                }
+            }
+
+            if (gray) {
+                reducer.addGrayLine(&gray_line[0], y - region.top());
+            } else {
+                reducer.addArgbLine(&argb_line[0], y - region.top());
+            }
+        }
+    } else {
+        int const spp = info.samples_per_pixel;
+
+        for (int y = region.top(); y <= region.bottom(); ++y) {
+            if (TIFFReadScanline(tif.handle(), buf.data(), y) < 0) {
+                return false;
+            }
+
+            uint8 const* src = buf.data() + left * spp;
+            for (int i = 0; i < width; ++i, src += spp) {
+                argb_line[i] = qRgba(src[0], src[1], src[2], spp == 4 ? src[3] : 0xff);
+            }
+
+            reducer.addArgbLine(&argb_line[0], y - region.top());
+        }
+    }
+
+    return true;
+}
+
+bool
+TiffReader::readRegionRgbaTiles(
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& region, LineReducer& reducer)
+{
+    uint32 tile_width = 0;
+    uint32 tile_height = 0;
+    TIFFGetField(tif.handle(), TIFFTAG_TILEWIDTH, &tile_width);
+    TIFFGetField(tif.handle(), TIFFTAG_TILELENGTH, &tile_height);
+    if (tile_width == 0 || tile_height == 0) {
+        return false;
+    }
+
+    int const tw = tile_width;
+    int const th = tile_height;
+    int const width = region.width();
+
+    TiffBuffer<uint32> tile(tsize_t(tw) * th);
+    std::vector<uint32> band(size_t(width) * th);
+
+    for (int ty = region.top() / th * th; ty <= region.bottom(); ty += th) {
+        int const band_top = std::max(ty, region.top());
+        int const band_bottom = std::min(ty + th, region.bottom() + 1);
+
+        for (int tx = region.left() / tw * tw; tx <= region.right(); tx += tw) {
+            if (!TIFFReadRGBATile(tif.handle(), tx, ty, tile.data())) {
+                return false;
+            }
+
+            int const x0 = std::max(tx, region.left());
+            int const x1 = std::min(tx + tw, region.right() + 1);
+            for (int y = band_top; y < band_bottom; ++y) {
+                // The tile raster has its origin in the bottom-left corner.
+                uint32 const* src = tile.data() + (th - 1 - (y - ty)) * tw + (x0 - tx);
+                uint32* dst = &band[(y - band_top) * width + (x0 - region.left())];
+                convertAbgrToArgb(src, dst, x1 - x0);
+            }
+        }
+
+        for (int y = band_top; y < band_bottom; ++y) {
+            reducer.addArgbLine(&band[(y - band_top) * width], y - region.top());
+        }
+    }
+
+    return true;
+}
+
+bool
+TiffReader::readRegionRgbaStrips(
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& region, LineReducer& reducer)
+{
+    uint32 rows_per_strip = 0;
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+    int const rps = std::max(1, std::min<int>(rows_per_strip, info.height));
+
+    TiffBuffer<uint32> strip(tsize_t(info.width) * rps);
+    std::vector<uint32> line(region.width());
+
+    for (int row = region.top() / rps * rps; row <= region.bottom(); row += rps) {
+        if (!TIFFReadRGBAStrip(tif.handle(), row, strip.data())) {
+            return false;
+        }
+
+        int const rows_in_strip = std::min(rps, info.height - row);
+        int const y0 = std::max(row, region.top());
+        int const y1 = std::min(row + rows_in_strip, region.bottom() + 1);
+        for (int y = y0; y < y1; ++y) {
+            // The strip raster has its origin in the bottom-left corner.
+            uint32 const* src = strip.data()
+                                + (rows_in_strip - 1 - (y - row)) * info.width + region.left();
+            convertAbgrToArgb(src, &line[0], region.width());
+            reducer.addArgbLine(&line[0], y - region.top());
+        }
+    }
+
+    return true;
+}
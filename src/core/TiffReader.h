@@ -21,9 +21,15 @@
 
 #include "ImageMetadataLoader.h"
 #include "VirtualFunction.h"
+#include <QVector>
+#include <QRgb>
+#include <QtGlobal>
+#include <vector>
 
 class QIODevice;
 class QImage;
+class QRect;
+class QSize;
 class ImageMetadata;
 class Dpi;
 
@@ -46,16 +52,81 @@ public:
      * \return The resulting image, or a null image in case of failure.
      */
     static QImage readImage(QIODevice& device, int page_num = 0);
+
+    /**
+     * \brief Reads a region of the image at a reduced resolution.
+     *
+     * Unlike readImage(), this one never holds more than a strip or a row
+     * of tiles of the source image in memory, so it's suitable for scans
+     * too large to be loaded in full.
+     *
+     * \param device The device to read from.  This device must be
+     *        opened for reading and must be seekable.
+     * \param page_num A zero-based page number within a multi-page
+     *        TIFF file.
+     * \param region The area to read, in full resolution pixels.
+     *        A null rectangle stands for the whole image.  The region
+     *        is clipped to the image area.
+     * \param reduction Each pixel of the resulting image is the average
+     *        of a \p reduction x \p reduction block of source pixels.
+     * \return A Format_Indexed8 grayscale image for grayscale and
+     *         bilevel sources, a 32-bit image otherwise, or a null image
+     *         in case of failure.  The DPI is adjusted for the reduction.
+     */
+    static QImage readImage(QIODevice& device, int page_num,
+                            QRect const& region, int reduction);
+
+    /**
+     * \brief Reads the whole image with the largest reduction factor
+     *        that still keeps it at least \p min_size large.
+     *
+     * \see readImage(QIODevice&, int, QRect const&, int)
+     */
+    static QImage readReducedImage(QIODevice& device, int page_num,
+                                   QSize const& min_size);
+
+    /**
+     * \brief Reads the reduced resolution subimages scanners and cameras
+     *        store along with the pages.
+     *
+     * For each page having a SubIFD marked as a reduced resolution image
+     * of no more than MAX_PREVIEW_SIZE pixels in either dimension, the
+     * largest such subimage is decoded and passed to \p out along with
+     * the zero-based page number.  Pages without SubIFDs cost a single
+     * read of their directory.  BigTIFF files are skipped.
+     */
+    static void readEmbeddedPreviews(
+        QIODevice& device, VirtualFunction2<void, int, QImage const&>& out);
 private:
+    enum { MAX_PREVIEW_SIZE = 1024 };
+
+    static QImage readPreview(TiffHandle const& tif, std::vector<quint64> const& sub_ifds);
+
     class TiffHeader;
     class TiffHandle;
     struct TiffInfo;
     template<typename T> class TiffBuffer;
+    class LineReducer;
+    class DirectoryOffsetCache;
+
+    static QImage readReducedRegion(
+        QIODevice& device, int page_num, QRect const& region,
+        int reduction, QSize const* min_size);
 
     static TiffHeader readHeader(QIODevice& device);
 
     static bool checkHeader(TiffHeader const& header);
 
+    static bool walkDirectories(QIODevice& device, TiffHeader const& header,
+                                std::vector<ImageMetadata>& pages,
+                                std::vector<quint32>& dir_offsets);
+
+    static bool readDirectoryOffsets(QIODevice& device, TiffHeader const& header,
+                                     std::vector<quint32>& dir_offsets);
+
+    static bool setDirectory(QIODevice& device, TiffHeader const& header,
+                             TiffHandle const& tif, int page_num);
+
     static ImageMetadata currentPageMetadata(TiffHandle const& tif);
 
     static Dpi getDpi(float xres, float yres, unsigned res_unit);
@@ -63,6 +134,26 @@ private:
     static QImage extractBinaryOrIndexed8Image(
         TiffHandle const& tif, TiffInfo const& info);
 
+    static QImage mapUncompressedImage(
+        QIODevice& device, TiffHandle const& tif, TiffInfo const& info);
+
+    static bool readColorTable(
+        TiffHandle const& tif, TiffInfo const& info, QVector<QRgb>& color_table);
+
+    static bool canReadRegionScanlines(TiffHandle const& tif, TiffInfo const& info);
+
+    static bool readRegionScanlines(
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& region, LineReducer& reducer);
+
+    static bool readRegionRgbaTiles(
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& region, LineReducer& reducer);
+
+    static bool readRegionRgbaStrips(
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& region, LineReducer& reducer);
+
     static void readLines(TiffHandle const& tif, QImage& image);
 
     static void readAndUnpackLines(
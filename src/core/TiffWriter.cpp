@@ -19,9 +19,14 @@
 #include "CommandLine.h"
 #include "TiffWriter.h"
 #include "imageproc/Grayscale.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/CcittG4Encoder.h"
 #include "Dpm.h"
+#include "Profiler.h"
+#include "Metrics.h"
 #include "imageproc/Constants.h"
 #include "settings/globalstaticsettings.h"
+#include "settings/TiffCompressionInfo.h"
 #include <QtGlobal>
 #include <QFile>
 #include <QIODevice>
@@ -30,7 +35,12 @@
 #include <QVector>
 #include <QSize>
 #include <QDebug>
+#include <QBuffer>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <vector>
+#include <algorithm>
 #include <tiff.h>
 #include <tiffio.h>
 #include <string.h>
@@ -168,16 +178,24 @@ TiffWriter::writeImage(QString const& file_path, QImage const& image, bool multi
         return false;
     }
 
+    Profiler::Scope const profile_scope("write_tiff");
+
+    // When appending a page, only count what this call adds.
+    qint64 const prev_size = file.size();
     if (!writeImage(file, image, multipage, page_no, compression_used)) {
         file.remove();
         return false;
     }
+    Profiler::addCounter("bytes_written", file.size() - prev_size);
+    Metrics::add(Metrics::BYTES_WRITTEN, file.size() - prev_size);
 
     return true;
 }
 
 bool
-TiffWriter::writeImage(QIODevice& device, QImage const& image, bool multipage, int page_no, QString* compression_used)
+TiffWriter::writeImage(
+    QIODevice& device, QImage const& image, bool multipage, int page_no,
+    QString* compression_used, QString const& compression_name)
 {
     if (image.isNull()) {
         return false;
@@ -218,8 +236,19 @@ TiffWriter::writeImage(QIODevice& device, QImage const& image, bool multipage, i
     CommandLine const& cli = CommandLine::get();
 
     int compression = GlobalStaticSettings::m_tiff_compression_color_id;
+    int bw_compression = GlobalStaticSettings::m_tiff_compression_bw_id;
+    QString color_name = GlobalStaticSettings::m_tiff_compr_method_color;
+    QString bw_name = GlobalStaticSettings::m_tiff_compr_method_bw;
+    if (!compression_name.isEmpty()) {
+        compression = bw_compression = TiffCompressions::info(compression_name).id;
+        color_name = bw_name = compression_name;
+        if (TiffCompressions::info(compression_name).for_bw_only) {
+            compression = COMPRESSION_LZW;
+            color_name = QString::fromLatin1("LZW");
+        }
+    }
     if (compression_used) {
-        *compression_used = GlobalStaticSettings::m_tiff_compr_method_color;
+        *compression_used = color_name;
     }
 
     if (! cli.hasTiffForceRGB()) {
@@ -229,13 +258,17 @@ TiffWriter::writeImage(QIODevice& device, QImage const& image, bool multipage, i
         switch (image.format()) {
         case QImage::Format_Mono:
         case QImage::Format_MonoLSB: {
-            compression = GlobalStaticSettings::m_tiff_compression_bw_id;
+            compression = bw_compression;
             if (compression_used) {
-                *compression_used = GlobalStaticSettings::m_tiff_compr_method_bw;
+                *compression_used = bw_name;
             }
+            avoidJpeg(compression, compression_used);
             return writeBitonalOrIndexed8Image(tif, image, multipage, compression);
         }
         case QImage::Format_Indexed8: {
+            if (!image.isGrayscale()) {
+                avoidJpeg(compression, compression_used);
+            }
             return writeBitonalOrIndexed8Image(tif, image, multipage, compression);
         }
         default:;
@@ -243,6 +276,7 @@ TiffWriter::writeImage(QIODevice& device, QImage const& image, bool multipage, i
     }
 
     if (image.hasAlphaChannel()) {
+        avoidJpeg(compression, compression_used);
         return writeARGB32Image(
                    tif, image.convertToFormat(QImage::Format_ARGB32), multipage, compression
                );
@@ -253,6 +287,90 @@ TiffWriter::writeImage(QIODevice& device, QImage const& image, bool multipage, i
     }
 }
 
+/**
+ * JPEG only takes 8-bit grayscale and color without alpha,
+ * so anything else is written with LZW instead.
+ */
+QByteArray
+TiffWriter::contentDigest(QImage const& image)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    {
+        QByteArray data;
+        QDataStream strm(&data, QIODevice::WriteOnly);
+        strm << int(image.format()) << image.size() << image.colorTable();
+        strm << image.dotsPerMeterX() << image.dotsPerMeterY();
+        strm << GlobalStaticSettings::m_tiff_compression_bw_id;
+        strm << GlobalStaticSettings::m_tiff_compression_color_id;
+        strm << GlobalStaticSettings::m_tiff_rows_per_strip;
+        strm << GlobalStaticSettings::m_tiff_jpeg_quality;
+        strm << GlobalStaticSettings::m_tiff_deflate_level;
+        hash.addData(data);
+    }
+
+    // Padding at the end of lines doesn't go into the file.
+    int const bytes_per_line = (image.width() * image.depth() + 7) / 8;
+    for (int y = 0; y < image.height(); ++y) {
+        hash.addData(reinterpret_cast<char const*>(image.constScanLine(y)), bytes_per_line);
+    }
+
+    return hash.result();
+}
+
+void
+TiffWriter::avoidJpeg(int& compression, QString* compression_used)
+{
+    if (compression == COMPRESSION_JPEG) {
+        compression = COMPRESSION_LZW;
+        if (compression_used) {
+            *compression_used = QString::fromLatin1("LZW");
+        }
+    }
+}
+
+/**
+ * Sets the parameters of the codec, once TIFFTAG_COMPRESSION is set.
+ */
+void
+TiffWriter::setCodecOptions(TiffHandle const& tif, int const compression)
+{
+    switch (compression) {
+    case COMPRESSION_JPEG:
+        TIFFSetField(tif.handle(), TIFFTAG_JPEGQUALITY, GlobalStaticSettings::m_tiff_jpeg_quality);
+        // Each strip gets its own tables, so strips may be encoded separately.
+        TIFFSetField(tif.handle(), TIFFTAG_JPEGTABLESMODE, 0);
+        break;
+    case COMPRESSION_ADOBE_DEFLATE:
+    case COMPRESSION_DEFLATE:
+        TIFFSetField(tif.handle(), TIFFTAG_ZIPQUALITY, GlobalStaticSettings::m_tiff_deflate_level);
+        break;
+    }
+}
+
+/**
+ * Color JPEG is stored as YCbCr with subsampled chroma, which is what
+ * makes it small.  libtiff converts the RGB lines it's given.
+ */
+void
+TiffWriter::setJpegYCbCr(TiffHandle const& tif)
+{
+    TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_YCBCR);
+    TIFFSetField(tif.handle(), TIFFTAG_YCBCRSUBSAMPLING, uint16(2), uint16(2));
+    TIFFSetField(tif.handle(), TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+}
+
+bool
+TiffWriter::encodeCcittG4(QImage const& image, QByteArray& data)
+{
+    if (image.isNull()) {
+        return false;
+    }
+
+    // BinaryImage has dark pixels as 1, which CCITT codes as black.
+    data = imageproc::CcittG4Encoder::encode(imageproc::BinaryImage(image));
+    return true;
+}
+
 /**
  * Set the physical resolution, if it's defined.
  */
@@ -322,11 +440,13 @@ TiffWriter::writeBitonalOrIndexed8Image(
     }
 
     TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, uint16(compression));
+    setCodecOptions(tif, compression);
     TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, bits_per_sample);
     TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, photometric);
     TIFFSetField(tif.handle(), TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
 
-    if (GlobalStaticSettings::m_use_horizontal_predictor && bits_per_sample == 8) {
+    if (GlobalStaticSettings::m_use_horizontal_predictor && bits_per_sample == 8
+            && compression != COMPRESSION_JPEG) {
         TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
     }
 
@@ -349,16 +469,24 @@ TiffWriter::writeBitonalOrIndexed8Image(
     }
 
     if (image.format() == QImage::Format_Indexed8) {
-        if (!write8bitLines(tif, image)) {
+        if (!writeLines(tif, image, &pack8bitLine, image.width())) {
+            return false;
+        }
+    } else if (compression == COMPRESSION_CCITTFAX4
+               && photometric != PHOTOMETRIC_PALETTE) {
+        // BinaryImage has black pixels as 1, whatever the color table.
+        TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISWHITE);
+        if (!writeCcittG4Strips(tif, imageproc::BinaryImage(image))) {
             return false;
         }
     } else {
+        int const bpl = (image.width() + 7) / 8;
         if (image.format() == QImage::Format_MonoLSB) {
-            if (!writeBinaryLinesReversed(tif, image)) {
+            if (!writeLines(tif, image, &packBinaryLineReversed, bpl)) {
                 return false;
             }
         } else {
-            if (!writeBinaryLinesAsIs(tif, image)) {
+            if (!writeLines(tif, image, &packBinaryLineAsIs, bpl)) {
                 return false;
             }
         }
@@ -378,33 +506,19 @@ TiffWriter::writeRGB32Image(
 
     TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(3));
     TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, uint16(compression));
+    setCodecOptions(tif, compression);
     TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, uint16(8));
-    TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-    if (GlobalStaticSettings::m_use_horizontal_predictor) {
-        TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    if (compression == COMPRESSION_JPEG) {
+        setJpegYCbCr(tif);
+    } else {
+        TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+        if (GlobalStaticSettings::m_use_horizontal_predictor) {
+            TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+        }
     }
 
-    int const width = image.width();
-    int const height = image.height();
-
-    std::vector<uint8_t> tmp_line(width * 3);
-
-    // Libtiff expects "RR GG BB" sequences regardless of CPU byte order.
-
-    for (int y = 0; y < height; ++y) {
-        uint32_t const* p_src = (uint32_t const*)image.scanLine(y);
-        uint8_t* p_dst = &tmp_line[0];
-        for (int x = 0; x < width; ++x) {
-            uint32_t const ARGB = *p_src;
-            p_dst[0] = static_cast<uint8_t>(ARGB >> 16);
-            p_dst[1] = static_cast<uint8_t>(ARGB >> 8);
-            p_dst[2] = static_cast<uint8_t>(ARGB);
-            ++p_src;
-            p_dst += 3;
-        }
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-            return false;
-        }
+    if (!writeLines(tif, image, &packRGB32Line, image.width() * 3)) {
+        return false;
     }
 
     if (multipage && (TIFFWriteDirectory(tif.handle()) == -1)) {
@@ -422,34 +536,15 @@ TiffWriter::writeARGB32Image(
 
     TIFFSetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, uint16(4));
     TIFFSetField(tif.handle(), TIFFTAG_COMPRESSION, uint16(compression));
+    setCodecOptions(tif, compression);
     TIFFSetField(tif.handle(), TIFFTAG_BITSPERSAMPLE, uint16(8));
     TIFFSetField(tif.handle(), TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
     if (GlobalStaticSettings::m_use_horizontal_predictor) {
         TIFFSetField(tif.handle(), TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
     }
 
-    int const width = image.width();
-    int const height = image.height();
-
-    std::vector<uint8_t> tmp_line(width * 4);
-
-    // Libtiff expects "RR GG BB AA" sequences regardless of CPU byte order.
-
-    for (int y = 0; y < height; ++y) {
-        uint32_t const* p_src = (uint32_t const*)image.scanLine(y);
-        uint8_t* p_dst = &tmp_line[0];
-        for (int x = 0; x < width; ++x) {
-            uint32_t const ARGB = *p_src;
-            p_dst[0] = static_cast<uint8_t>(ARGB >> 16);
-            p_dst[1] = static_cast<uint8_t>(ARGB >> 8);
-            p_dst[2] = static_cast<uint8_t>(ARGB);
-            p_dst[3] = static_cast<uint8_t>(ARGB >> 24);
-            ++p_src;
-            p_dst += 4;
-        }
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
-            return false;
-        }
+    if (!writeLines(tif, image, &packARGB32Line, image.width() * 4)) {
+        return false;
     }
 
     if (multipage && (TIFFWriteDirectory(tif.handle()) == -1)) {
@@ -459,72 +554,268 @@ TiffWriter::writeARGB32Image(
     return true;
 }
 
-bool
-TiffWriter::write8bitLines(
-    TiffHandle const& tif, QImage const& image)
+void
+TiffWriter::pack8bitLine(QImage const& image, int const y, uint8_t* dst)
 {
+    memcpy(dst, image.scanLine(y), image.width());
+}
+
+void
+TiffWriter::packBinaryLineAsIs(QImage const& image, int const y, uint8_t* dst)
+{
+    memcpy(dst, image.scanLine(y), (image.width() + 7) / 8);
+}
+
+void
+TiffWriter::packBinaryLineReversed(QImage const& image, int const y, uint8_t* dst)
+{
+    uint8_t const* src_line = image.scanLine(y);
+    int const bpl = (image.width() + 7) / 8;
+    for (int i = 0; i < bpl; ++i) {
+        dst[i] = m_reverseBitsLUT[src_line[i]];
+    }
+}
+
+void
+TiffWriter::packRGB32Line(QImage const& image, int const y, uint8_t* dst)
+{
+    // Libtiff expects "RR GG BB" sequences regardless of CPU byte order.
+    uint32_t const* p_src = (uint32_t const*)image.scanLine(y);
     int const width = image.width();
+    for (int x = 0; x < width; ++x) {
+        uint32_t const ARGB = *p_src;
+        dst[0] = static_cast<uint8_t>(ARGB >> 16);
+        dst[1] = static_cast<uint8_t>(ARGB >> 8);
+        dst[2] = static_cast<uint8_t>(ARGB);
+        ++p_src;
+        dst += 3;
+    }
+}
+
+void
+TiffWriter::packARGB32Line(QImage const& image, int const y, uint8_t* dst)
+{
+    // Libtiff expects "RR GG BB AA" sequences regardless of CPU byte order.
+    uint32_t const* p_src = (uint32_t const*)image.scanLine(y);
+    int const width = image.width();
+    for (int x = 0; x < width; ++x) {
+        uint32_t const ARGB = *p_src;
+        dst[0] = static_cast<uint8_t>(ARGB >> 16);
+        dst[1] = static_cast<uint8_t>(ARGB >> 8);
+        dst[2] = static_cast<uint8_t>(ARGB);
+        dst[3] = static_cast<uint8_t>(ARGB >> 24);
+        ++p_src;
+        dst += 4;
+    }
+}
+
+bool
+TiffWriter::canEncodeStripsSeparately(int const compression)
+{
+    // These codecs keep no state across strips.  JPEG strips carry
+    // their own tables, as set up by setCodecOptions().
+    switch (compression) {
+    case COMPRESSION_JPEG:
+    case COMPRESSION_LZW:
+    case COMPRESSION_ADOBE_DEFLATE:
+    case COMPRESSION_DEFLATE:
+    case COMPRESSION_PACKBITS:
+    case COMPRESSION_CCITTFAX3:
+    case COMPRESSION_CCITTFAX4:
+        return true;
+    }
+    return false;
+}
+
+bool
+TiffWriter::writeLines(
+    TiffHandle const& tif, QImage const& image,
+    LinePacker packer, int const bytes_per_line)
+{
     int const height = image.height();
+    int const rows_per_strip = GlobalStaticSettings::m_tiff_rows_per_strip;
+
+    uint16 compression = COMPRESSION_NONE;
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_COMPRESSION, &compression);
+
+    // Strips of subsampled JPEG must be made of whole 16 line MCUs.
+    if (rows_per_strip <= 0 || height <= rows_per_strip
+            || !canEncodeStripsSeparately(compression)
+            || (compression == COMPRESSION_JPEG && rows_per_strip % 16 != 0)) {
+        // TIFFWriteScanline() can actually modify the data you pass it,
+        // so we have to use a temporary buffer even when no conversion
+        // is required.
+        std::vector<uint8_t> tmp_line(bytes_per_line, 0);
+
+        for (int y = 0; y < height; ++y) {
+            packer(image, y, &tmp_line[0]);
+            if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    TIFFSetField(tif.handle(), TIFFTAG_ROWSPERSTRIP, uint32(rows_per_strip));
 
-    // TIFFWriteScanline() can actually modify the data you pass it,
-    // so we have to use a temporary buffer even when no coversion
-    // is required.
-    std::vector<uint8_t> tmp_line(width, 0);
+    // Compression dominates the cost of writing, so strips are encoded
+    // in parallel and then written in order as raw strips.
+    int const num_strips = (height + rows_per_strip - 1) / rows_per_strip;
+    std::vector<QByteArray> strips(num_strips);
+    std::vector<char> encoded(num_strips, 0);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_strips; ++i) {
+        int const top = i * rows_per_strip;
+        int const rows = std::min(rows_per_strip, height - top);
+        encoded[i] = encodeStrip(
+                         tif, image, packer, bytes_per_line, top, rows, strips[i]
+                     );
+    }
 
-    for (int y = 0; y < height; ++y) {
-        uint8_t const* src_line = image.scanLine(y);
-        memcpy(&tmp_line[0], src_line, tmp_line.size());
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
+    for (int i = 0; i < num_strips; ++i) {
+        if (!encoded[i]) {
             return false;
         }
+        QByteArray& strip = strips[i];
+        if (TIFFWriteRawStrip(tif.handle(), i, strip.data(), strip.size()) == -1) {
+            return false;
+        }
+        strip.clear();
     }
 
     return true;
 }
 
 bool
-TiffWriter::writeBinaryLinesAsIs(
-    TiffHandle const& tif, QImage const& image)
+TiffWriter::writeCcittG4Strips(TiffHandle const& tif, imageproc::BinaryImage const& image)
 {
-    int const width = image.width();
     int const height = image.height();
+    int rows_per_strip = GlobalStaticSettings::m_tiff_rows_per_strip;
+    if (rows_per_strip <= 0 || rows_per_strip > height) {
+        rows_per_strip = height;
+    }
 
-    // TIFFWriteScanline() can actually modify the data you pass it,
-    // so we have to use a temporary buffer even when no conversion
-    // is required.
-    int const bpl = (width + 7) / 8;
-    std::vector<uint8_t> tmp_line(bpl, 0);
+    TIFFSetField(tif.handle(), TIFFTAG_ROWSPERSTRIP, uint32(rows_per_strip));
 
-    for (int y = 0; y < height; ++y) {
-        uint8_t const* src_line = image.scanLine(y);
-        memcpy(&tmp_line[0], src_line, bpl);
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
+    int const num_strips = (height + rows_per_strip - 1) / rows_per_strip;
+    std::vector<QByteArray> strips(num_strips);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_strips; ++i) {
+        int const top = i * rows_per_strip;
+        int const rows = std::min(rows_per_strip, height - top);
+        strips[i] = imageproc::CcittG4Encoder::encode(image, top, rows);
+    }
+
+    for (int i = 0; i < num_strips; ++i) {
+        QByteArray& strip = strips[i];
+        if (TIFFWriteRawStrip(tif.handle(), i, strip.data(), strip.size()) == -1) {
             return false;
         }
+        strip.clear();
     }
 
     return true;
 }
 
 bool
-TiffWriter::writeBinaryLinesReversed(
-    TiffHandle const& tif, QImage const& image)
+TiffWriter::encodeStrip(
+    TiffHandle const& tif, QImage const& image, LinePacker packer,
+    int const bytes_per_line, int const top, int const rows, QByteArray& strip)
 {
-    int const width = image.width();
-    int const height = image.height();
+    uint32 width = 0;
+    uint16 spp = 1;
+    uint16 bps = 1;
+    uint16 compression = COMPRESSION_NONE;
+    uint16 photometric = PHOTOMETRIC_MINISBLACK;
+    uint16 predictor = PREDICTOR_NONE;
+    TIFFGetField(tif.handle(), TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, &spp);
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_BITSPERSAMPLE, &bps);
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_COMPRESSION, &compression);
+    TIFFGetField(tif.handle(), TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_PREDICTOR, &predictor);
+    if (photometric == PHOTOMETRIC_PALETTE) {
+        // Doesn't affect encoding, but would require a colormap.
+        photometric = PHOTOMETRIC_MINISBLACK;
+    }
 
-    int const bpl = (width + 7) / 8;
-    std::vector<uint8_t> tmp_line(bpl, 0);
+    StripFormat const format = { width, spp, bps, compression, photometric, predictor };
+    return encodeStrip(format, image, packer, bytes_per_line, top, rows, strip);
+}
 
-    for (int y = 0; y < height; ++y) {
-        uint8_t const* src_line = image.scanLine(y);
-        for (int i = 0; i < bpl; ++i) {
-            tmp_line[i] = m_reverseBitsLUT[src_line[i]];
-        }
-        if (TIFFWriteScanline(tif.handle(), &tmp_line[0], y) == -1) {
+bool
+TiffWriter::encodeStrip(
+    StripFormat const& format, QImage const& image, LinePacker packer,
+    int const bytes_per_line, int const top, int const rows, QByteArray& strip)
+{
+    // Encode the strip as a single-strip TIFF in memory,
+    // then read back its compressed data.
+    QBuffer buffer;
+    if (!buffer.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    {
+        TiffHandle strip_tif(
+            TIFFClientOpen(
+                "strip", "wBm", &buffer, &deviceRead, &deviceWrite,
+                &deviceSeek, &deviceClose, &deviceSize,
+                &deviceMap, &deviceUnmap
+            )
+        );
+        if (!strip_tif.handle()) {
             return false;
         }
+
+        TIFFSetField(strip_tif.handle(), TIFFTAG_IMAGEWIDTH, format.width);
+        TIFFSetField(strip_tif.handle(), TIFFTAG_IMAGELENGTH, uint32(rows));
+        TIFFSetField(strip_tif.handle(), TIFFTAG_ROWSPERSTRIP, uint32(rows));
+        TIFFSetField(strip_tif.handle(), TIFFTAG_SAMPLESPERPIXEL, format.spp);
+        TIFFSetField(strip_tif.handle(), TIFFTAG_BITSPERSAMPLE, format.bps);
+        TIFFSetField(strip_tif.handle(), TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+        TIFFSetField(strip_tif.handle(), TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(strip_tif.handle(), TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
+        TIFFSetField(strip_tif.handle(), TIFFTAG_PHOTOMETRIC, format.photometric);
+        TIFFSetField(strip_tif.handle(), TIFFTAG_COMPRESSION, format.compression);
+        setCodecOptions(strip_tif, format.compression);
+        if (format.photometric == PHOTOMETRIC_YCBCR) {
+            setJpegYCbCr(strip_tif);
+        }
+        if (format.predictor != PREDICTOR_NONE) {
+            TIFFSetField(strip_tif.handle(), TIFFTAG_PREDICTOR, format.predictor);
+        }
+
+        std::vector<uint8_t> tmp_line(bytes_per_line, 0);
+        for (int y = 0; y < rows; ++y) {
+            packer(image, top + y, &tmp_line[0]);
+            if (TIFFWriteScanline(strip_tif.handle(), &tmp_line[0], y) == -1) {
+                return false;
+            }
+        }
+    } // TIFFClose() flushes the data and closes the buffer.
+
+    if (!buffer.open(QIODevice::ReadOnly)) {
+        return false;
     }
 
-    return true;
+    TiffHandle strip_tif(
+        TIFFClientOpen(
+            "strip", "rBm", &buffer, &deviceRead, &deviceWrite,
+            &deviceSeek, &deviceClose, &deviceSize,
+            &deviceMap, &deviceUnmap
+        )
+    );
+    if (!strip_tif.handle()) {
+        return false;
+    }
+
+    tsize_t const size = TIFFRawStripSize(strip_tif.handle(), 0);
+    if (size <= 0) {
+        return false;
+    }
+
+    strip.resize(size);
+    return TIFFReadRawStrip(strip_tif.handle(), 0, strip.data(), size) == size;
 }
@@ -22,12 +22,18 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <tiff.h>
+#include <QString>
 
 class QIODevice;
-class QString;
+class QByteArray;
 class QImage;
 class Dpm;
 
+namespace imageproc
+{
+class BinaryImage;
+}
+
 class TiffWriter
 {
 public:
@@ -45,6 +51,18 @@ public:
      */
 
     static bool writeImage(QString const& file_path, QImage const& image, bool multipage = false, int page_no = 0, QString* compression_used = nullptr);
+
+    /**
+     * \brief Encodes a bilevel image as raw CCITT Group 4 data.
+     *
+     * That's what a PDF CCITTFaxDecode filter with K = -1 and the
+     * default BlackIs1 = false takes.  Pixels darker than mid-gray
+     * are taken as black.
+     *
+     * \return True on success, false on failure.
+     */
+    static bool encodeCcittG4(QImage const& image, QByteArray& data);
+
     /**
      * \brief Writes a QImage in TIFF format to an IO device.
      *
@@ -56,16 +74,34 @@ public:
      * \param page_no Number of page in multipage tiff.
      * \param compression_used Pointer to a string that'll return compression
      *        name that was actually used to save the image.
+     * \param compression_name The compression to use instead of the configured
+     *        ones, by its name in TiffCompressions.  A bilevel-only one is
+     *        replaced with LZW for other images.
      * \return True on success, false on failure.
      */
+    static bool writeImage(
+        QIODevice& device, QImage const& image, bool multipage = false, int page_no = 0,
+        QString* compression_used = nullptr, QString const& compression_name = QString());
 
+    /**
+     * \brief Returns a digest of what writeImage() would write.
+     *
+     * That covers the pixels, the resolution and the compression
+     * settings.  If two digests match, one file may stand for another.
+     */
+    static QByteArray contentDigest(QImage const& image);
 private:
-    static bool writeImage(QIODevice& device, QImage const& image, bool multipage = false, int page_no = 0, QString* compression_used = nullptr);
 
     class TiffHandle;
 
     static void setDpm(TiffHandle const& tif, Dpm const& dpm);
 
+    static void avoidJpeg(int& compression, QString* compression_used);
+
+    static void setCodecOptions(TiffHandle const& tif, int compression);
+
+    static void setJpegYCbCr(TiffHandle const& tif);
+
     static bool writeBitonalOrIndexed8Image(
         TiffHandle const& tif, QImage const& image, bool multipage, int compression = COMPRESSION_LZW);
 
@@ -74,14 +110,57 @@ private:
 
     static bool writeARGB32Image(TiffHandle const& tif, QImage const& image, bool multipage, int compression = COMPRESSION_LZW);
 
-    static bool write8bitLines(
-        TiffHandle const& tif, QImage const& image);
+    typedef void (*LinePacker)(QImage const& image, int y, uint8_t* dst);
+
+    /**
+     * \brief Writes all lines of the image, packed by \p packer.
+     *
+     * If GlobalStaticSettings::m_tiff_rows_per_strip is positive and
+     * the compression allows it, strips of that many rows are compressed
+     * in parallel and then written in order.
+     */
+    static bool writeLines(
+        TiffHandle const& tif, QImage const& image,
+        LinePacker packer, int bytes_per_line);
+
+    static bool canEncodeStripsSeparately(int compression);
+
+    /**
+     * \brief Writes a bilevel image as CCITT Group 4 compressed strips.
+     *
+     * The strips are encoded in parallel, straight from the words of
+     * \p image, and written as raw strips.  The strip height comes from
+     * GlobalStaticSettings::m_tiff_rows_per_strip, the same as in
+     * writeLines(), with a single strip if that's not positive.
+     */
+    static bool writeCcittG4Strips(TiffHandle const& tif, imageproc::BinaryImage const& image);
+
+    static bool encodeStrip(
+        TiffHandle const& tif, QImage const& image, LinePacker packer,
+        int bytes_per_line, int top, int rows, QByteArray& strip);
+
+    struct StripFormat {
+        uint32_t width;
+        uint16_t spp;
+        uint16_t bps;
+        uint16_t compression;
+        uint16_t photometric;
+        uint16_t predictor;
+    };
+
+    static bool encodeStrip(
+        StripFormat const& format, QImage const& image, LinePacker packer,
+        int bytes_per_line, int top, int rows, QByteArray& strip);
+
+    static void pack8bitLine(QImage const& image, int y, uint8_t* dst);
+
+    static void packBinaryLineAsIs(QImage const& image, int y, uint8_t* dst);
+
+    static void packBinaryLineReversed(QImage const& image, int y, uint8_t* dst);
 
-    static bool writeBinaryLinesAsIs(
-        TiffHandle const& tif, QImage const& image);
+    static void packRGB32Line(QImage const& image, int y, uint8_t* dst);
 
-    static bool writeBinaryLinesReversed(
-        TiffHandle const& tif, QImage const& image);
+    static void packARGB32Line(QImage const& image, int y, uint8_t* dst);
 
     static uint8_t const m_reverseBitsLUT[256];
 };
@@ -0,0 +1,309 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TiledImagePyramid.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <list>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+namespace
+{
+
+struct TileKey
+{
+    qint64 image;
+    int level;
+    int col;
+    int row;
+
+    TileKey(qint64 image, int level, int col, int row)
+        : image(image), level(level), col(col), row(row) {}
+
+    bool operator<(TileKey const& other) const
+    {
+        if (image != other.image) {
+            return image < other.image;
+        } else if (level != other.level) {
+            return level < other.level;
+        } else if (row != other.row) {
+            return row < other.row;
+        } else {
+            return col < other.col;
+        }
+    }
+};
+
+/**
+ * Tiles of all pyramids, least recently used first.
+ */
+class TileCache
+{
+public:
+    static TileCache& instance()
+    {
+        static TileCache cache;
+        return cache;
+    }
+
+    TileCache() : m_numBytes(0), m_maxBytes(qint64(128) << 20) {}
+
+    void setLimit(qint64 bytes)
+    {
+        QMutexLocker const locker(&m_mutex);
+        m_maxBytes = bytes;
+        shrinkLocked();
+    }
+
+    QImage find(TileKey const& key)
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        Index::iterator const it(m_index.find(key));
+        if (it == m_index.end()) {
+            return QImage();
+        }
+
+        // Make it the most recently used one.
+        m_lru.splice(m_lru.end(), m_lru, it->second);
+        return it->second->second;
+    }
+
+    void insert(TileKey const& key, QImage const& tile)
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        Index::iterator const it(m_index.find(key));
+        if (it != m_index.end()) {
+            // Another thread was building the same tile.
+            return;
+        }
+
+        m_lru.push_back(std::make_pair(key, tile));
+        m_index.insert(std::make_pair(key, --m_lru.end()));
+        m_numBytes += tile.byteCount();
+        shrinkLocked();
+    }
+private:
+    typedef std::list<std::pair<TileKey, QImage> > Lru;
+    typedef std::map<TileKey, Lru::iterator> Index;
+
+    void shrinkLocked()
+    {
+        while (m_numBytes > m_maxBytes && !m_lru.empty()) {
+            m_numBytes -= m_lru.front().second.byteCount();
+            m_index.erase(m_lru.front().first);
+            m_lru.pop_front();
+        }
+    }
+
+    QMutex m_mutex;
+    Lru m_lru;
+    Index m_index;
+    qint64 m_numBytes;
+    qint64 m_maxBytes;
+};
+
+/**
+ * Halves an image by averaging 2x2 blocks of pixels.  A missing last
+ * column or row is substituted by the one before it.
+ */
+QImage downscale2x(QImage const& src)
+{
+    int const sw = src.width();
+    int const sh = src.height();
+    int const dw = (sw + 1) / 2;
+    int const dh = (sh + 1) / 2;
+
+    QImage dst(dw, dh, src.format());
+    int const src_stride = src.bytesPerLine() / 4;
+    int const dst_stride = dst.bytesPerLine() / 4;
+    uint32_t const* src_line = (uint32_t const*)src.bits();
+    uint32_t* dst_line = (uint32_t*)dst.bits();
+
+    for (int y = 0; y < dh; ++y, src_line += src_stride * 2, dst_line += dst_stride) {
+        uint32_t const* line1 = src_line;
+        uint32_t const* line2 = y * 2 + 1 < sh ? src_line + src_stride : src_line;
+        for (int x = 0; x < dw; ++x) {
+            int const x1 = x * 2;
+            int const x2 = x1 + 1 < sw ? x1 + 1 : x1;
+            uint32_t const p[4] = { line1[x1], line1[x2], line2[x1], line2[x2] };
+            uint32_t res = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = 2;
+                for (int i = 0; i < 4; ++i) {
+                    sum += (p[i] >> shift) & 0xff;
+                }
+                res |= (sum >> 2) << shift;
+            }
+            dst_line[x] = res;
+        }
+    }
+
+    return dst;
+}
+
+} // anonymous namespace
+
+TiledImagePyramid::TiledImagePyramid(QImage const& image)
+    :   m_image(image),
+        m_numLevels(1)
+{
+    int max_side = std::max(image.width(), image.height());
+    while (max_side > TILE_SIZE) {
+        max_side = (max_side + 1) / 2;
+        ++m_numLevels;
+    }
+}
+
+bool
+TiledImagePyramid::suitableFor(QImage const& image)
+{
+    return qint64(image.width()) * image.height() >= qint64(4096) * 4096;
+}
+
+void
+TiledImagePyramid::setCacheLimit(qint64 const bytes)
+{
+    TileCache::instance().setLimit(bytes);
+}
+
+int
+TiledImagePyramid::levelForScale(double const scale) const
+{
+    if (scale <= 0.0) {
+        return m_numLevels - 1;
+    }
+
+    int const level = int(floor(log(1.0 / scale) / log(2.0)));
+    return qBound(0, level, m_numLevels - 1);
+}
+
+QSize
+TiledImagePyramid::levelSize(int const level) const
+{
+    int w = m_image.width();
+    int h = m_image.height();
+    for (int i = 0; i < level; ++i) {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    return QSize(w, h);
+}
+
+QRect
+TiledImagePyramid::tileRect(int const level, int const col, int const row) const
+{
+    QRect const rect(col * TILE_SIZE, row * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+    return rect.intersected(QRect(QPoint(0, 0), levelSize(level)));
+}
+
+QRect
+TiledImagePyramid::tileRange(int const level, QRectF const& image_rect) const
+{
+    QSize const size(levelSize(level));
+    double const scale = 1.0 / (1 << level);
+    QRectF const rect(
+        QRectF(
+            image_rect.left() * scale, image_rect.top() * scale,
+            image_rect.width() * scale, image_rect.height() * scale
+        ).intersected(QRectF(QPointF(0, 0), size))
+    );
+    if (rect.isEmpty()) {
+        return QRect();
+    }
+
+    int const first_col = int(floor(rect.left() / TILE_SIZE));
+    int const first_row = int(floor(rect.top() / TILE_SIZE));
+    int const last_col = int(ceil(rect.right() / TILE_SIZE)) - 1;
+    int const last_row = int(ceil(rect.bottom() / TILE_SIZE)) - 1;
+    return QRect(QPoint(first_col, first_row), QPoint(last_col, last_row));
+}
+
+QImage
+TiledImagePyramid::cachedTile(int const level, int const col, int const row) const
+{
+    return TileCache::instance().find(TileKey(m_image.cacheKey(), level, col, row));
+}
+
+QImage
+TiledImagePyramid::tile(int const level, int const col, int const row) const
+{
+    return buildTile(level, col, row, true);
+}
+
+QImage
+TiledImagePyramid::buildTile(
+    int const level, int const col, int const row, bool const cache_result) const
+{
+    TileKey const key(m_image.cacheKey(), level, col, row);
+    QImage tile(TileCache::instance().find(key));
+    if (!tile.isNull()) {
+        return tile;
+    }
+
+    QImage::Format const format = m_image.hasAlphaChannel()
+                                  ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+
+    if (level == 0) {
+        tile = m_image.copy(tileRect(0, col, row)).convertToFormat(format);
+    } else {
+        // Assemble the up to 2x2 tiles of the finer level this one covers.
+        // Full resolution tiles are not worth caching for that purpose,
+        // as they are cheap to extract and would crowd out everything else.
+        QRect const area(
+            QRect(col * TILE_SIZE * 2, row * TILE_SIZE * 2, TILE_SIZE * 2, TILE_SIZE * 2)
+            .intersected(QRect(QPoint(0, 0), levelSize(level - 1)))
+        );
+        QImage combined(area.size(), format);
+        int const bpp = 4;
+        for (int dy = 0; dy < 2; ++dy) {
+            for (int dx = 0; dx < 2; ++dx) {
+                QRect const child_rect(tileRect(level - 1, col * 2 + dx, row * 2 + dy));
+                if (child_rect.isEmpty()) {
+                    continue;
+                }
+
+                QImage const child(
+                    buildTile(level - 1, col * 2 + dx, row * 2 + dy, level - 1 > 0)
+                );
+                assert(child.size() == child_rect.size());
+                int const x0 = child_rect.left() - area.left();
+                int const y0 = child_rect.top() - area.top();
+                for (int y = 0; y < child.height(); ++y) {
+                    memcpy(
+                        combined.scanLine(y0 + y) + x0 * bpp,
+                        child.constScanLine(y), child.width() * bpp
+                    );
+                }
+            }
+        }
+        tile = downscale2x(combined);
+    }
+
+    if (cache_result) {
+        TileCache::instance().insert(key, tile);
+    }
+    return tile;
+}
@@ -0,0 +1,107 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TILED_IMAGE_PYRAMID_H_
+#define TILED_IMAGE_PYRAMID_H_
+
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+#include <QSize>
+#include <QtGlobal>
+
+/**
+ * \brief Splits an image into tiles at power of two zoom levels.
+ *
+ * Level 0 is the image itself, and each next level halves the previous
+ * one, rounding up.  Tiles are built on demand, coarser ones from finer
+ * ones, and are kept in an LRU cache shared by all pyramids.  The cache
+ * is keyed by QImage::cacheKey(), so tiles of an image survive the
+ * pyramid object and are found again by any pyramid of the same image.
+ *
+ * The object itself is cheap to construct.  All methods are thread-safe.
+ */
+class TiledImagePyramid
+{
+public:
+    enum { TILE_SIZE = 256 };
+
+    explicit TiledImagePyramid(QImage const& image);
+
+    /**
+     * \brief Whether an image is big enough for tiles to pay off.
+     *
+     * Smaller images are better handled as a whole.
+     */
+    static bool suitableFor(QImage const& image);
+
+    /**
+     * \brief Sets the memory limit for tiles of all pyramids.
+     */
+    static void setCacheLimit(qint64 bytes);
+
+    QImage const& image() const
+    {
+        return m_image;
+    }
+
+    int numLevels() const
+    {
+        return m_numLevels;
+    }
+
+    /**
+     * \brief The coarsest level having at least one pixel per
+     *        device pixel, when the image is displayed at \p scale.
+     */
+    int levelForScale(double scale) const;
+
+    QSize levelSize(int level) const;
+
+    /**
+     * \brief The rectangle of a tile, in level coordinates.
+     */
+    QRect tileRect(int level, int col, int row) const;
+
+    /**
+     * \brief The columns and rows of tiles of a level covering
+     *        \p image_rect, which is in level 0 coordinates.
+     *
+     * The result may be empty.
+     */
+    QRect tileRange(int level, QRectF const& image_rect) const;
+
+    /**
+     * \brief Returns a tile if it's cached, or a null image otherwise.
+     */
+    QImage cachedTile(int level, int col, int row) const;
+
+    /**
+     * \brief Returns a tile, building it if necessary.
+     *
+     * That may take a while, so it's meant for background threads.
+     */
+    QImage tile(int level, int col, int row) const;
+private:
+    QImage buildTile(int level, int col, int row, bool cache_result) const;
+
+    QImage m_image;
+    int m_numLevels;
+};
+
+#endif
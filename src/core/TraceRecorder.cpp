@@ -0,0 +1,271 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TraceRecorder.h"
+#include "AtomicFileOverwriter.h"
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadStorage>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+
+struct TraceEvent
+{
+    char const* name;
+    qint64 startUsec;
+    qint64 durationUsec;
+};
+
+/**
+ * A ring of spans written by a single thread and read by whoever
+ * writes the trace out.  The writer publishes each span by bumping
+ * the counter with release semantics, the reader picks it up with
+ * acquire semantics.
+ */
+class ThreadBuffer
+{
+    DECLARE_NON_COPYABLE(ThreadBuffer)
+public:
+    enum { CAPACITY = 1 << 15 }; // Must be a power of 2.
+
+    ThreadBuffer(int thread_id, QString const& thread_name)
+        : m_threadId(thread_id), m_threadName(thread_name),
+          m_events(CAPACITY), m_count(0) {}
+
+    int threadId() const
+    {
+        return m_threadId;
+    }
+
+    QString const& threadName() const
+    {
+        return m_threadName;
+    }
+
+    void push(TraceEvent const& evt)
+    {
+        // Only the owning thread modifies m_count.
+        unsigned const count = m_count.load();
+        m_events[count & (CAPACITY - 1)] = evt;
+        m_count.storeRelease(count + 1);
+    }
+
+    /**
+     * Appends the buffered spans to \p out, oldest first.
+     */
+    void snapshot(std::vector<TraceEvent>& out) const
+    {
+        unsigned const count = m_count.loadAcquire();
+        unsigned const size = std::min<unsigned>(count, CAPACITY);
+        for (unsigned i = count - size; i != count; ++i) {
+            out.push_back(m_events[i & (CAPACITY - 1)]);
+        }
+    }
+private:
+    int const m_threadId;
+    QString const m_threadName;
+    std::vector<TraceEvent> m_events;
+    QAtomicInteger<unsigned> m_count;
+};
+
+/**
+ * QThreadStorage deletes pointers it holds once their thread exits,
+ * but the buffers have to outlive their threads, so we wrap them.
+ */
+struct BufferRef
+{
+    ThreadBuffer* ptr;
+
+    BufferRef() : ptr(0) {}
+};
+
+} // anonymous namespace
+
+class TraceRecorder::Impl
+{
+public:
+    Impl() : m_enabled(0)
+    {
+        m_clock.start();
+    }
+
+    bool isEnabled() const
+    {
+        return m_enabled.load() != 0;
+    }
+
+    void setEnabled(bool enabled)
+    {
+        m_enabled.store(enabled ? 1 : 0);
+    }
+
+    qint64 nowUsec() const
+    {
+        return m_clock.nsecsElapsed() / 1000;
+    }
+
+    ThreadBuffer& threadBuffer();
+
+    QJsonDocument chromeTrace() const;
+private:
+    QAtomicInt m_enabled;
+    QElapsedTimer m_clock;
+    QThreadStorage<BufferRef> m_threadBuffers;
+    mutable QMutex m_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer> > m_buffers;
+};
+
+ThreadBuffer&
+TraceRecorder::Impl::threadBuffer()
+{
+    BufferRef& ref = m_threadBuffers.localData();
+    if (!ref.ptr) {
+        QThread* const thread = QThread::currentThread();
+        QString name(thread->objectName());
+        if (name.isEmpty()) {
+            name = QString::fromLatin1(thread->metaObject()->className());
+        }
+
+        QMutexLocker const locker(&m_mutex);
+        m_buffers.emplace_back(new ThreadBuffer(int(m_buffers.size()) + 1, name));
+        ref.ptr = m_buffers.back().get();
+    }
+    return *ref.ptr;
+}
+
+QJsonDocument
+TraceRecorder::Impl::chromeTrace() const
+{
+    QJsonArray events;
+
+    QMutexLocker const locker(&m_mutex);
+
+    std::vector<TraceEvent> spans;
+    for (std::unique_ptr<ThreadBuffer> const& buffer : m_buffers) {
+        QJsonObject thread_name;
+        thread_name.insert("name", buffer->threadName());
+
+        QJsonObject meta;
+        meta.insert("name", QLatin1String("thread_name"));
+        meta.insert("ph", QLatin1String("M"));
+        meta.insert("pid", 1);
+        meta.insert("tid", buffer->threadId());
+        meta.insert("args", thread_name);
+        events.append(meta);
+
+        spans.clear();
+        buffer->snapshot(spans);
+        for (TraceEvent const& span : spans) {
+            QJsonObject evt;
+            evt.insert("name", QString::fromUtf8(span.name));
+            evt.insert("ph", QLatin1String("X"));
+            evt.insert("ts", double(span.startUsec));
+            evt.insert("dur", double(span.durationUsec));
+            evt.insert("pid", 1);
+            evt.insert("tid", buffer->threadId());
+            events.append(evt);
+        }
+    }
+
+    QJsonObject root;
+    root.insert("traceEvents", events);
+    root.insert("displayTimeUnit", QLatin1String("ms"));
+    return QJsonDocument(root);
+}
+
+TraceRecorder::Impl&
+TraceRecorder::impl()
+{
+    static Impl instance;
+    return instance;
+}
+
+TraceRecorder::Span::Span(char const* name)
+    :   m_name(0),
+        m_startUsec(0)
+{
+    Impl& self = impl();
+    if (self.isEnabled()) {
+        m_name = name;
+        m_startUsec = self.nowUsec();
+    }
+}
+
+TraceRecorder::Span::~Span()
+{
+    if (!m_name) {
+        return;
+    }
+
+    Impl& self = impl();
+    TraceEvent const evt = { m_name, m_startUsec, self.nowUsec() - m_startUsec };
+    self.threadBuffer().push(evt);
+}
+
+void
+TraceRecorder::setEnabled(bool const enabled)
+{
+    impl().setEnabled(enabled);
+}
+
+bool
+TraceRecorder::isEnabled()
+{
+    return impl().isEnabled();
+}
+
+QString
+TraceRecorder::initFromEnvironment()
+{
+    QByteArray const file_name(qgetenv("SCANTAILOR_TRACE"));
+    if (file_name.isEmpty()) {
+        return QString();
+    }
+
+    setEnabled(true);
+    return QString::fromLocal8Bit(file_name);
+}
+
+bool
+TraceRecorder::writeChromeTrace(QString const& file_path)
+{
+    AtomicFileOverwriter overwriter;
+    QIODevice* file = overwriter.startWriting(file_path);
+    if (!file) {
+        return false;
+    }
+
+    if (file->write(impl().chromeTrace().toJson(QJsonDocument::Compact)) < 0) {
+        overwriter.abort();
+        return false;
+    }
+
+    return overwriter.commit();
+}
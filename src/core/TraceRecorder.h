@@ -0,0 +1,82 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACERECORDER_H_
+#define TRACERECORDER_H_
+
+#include "NonCopyable.h"
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * \brief Records a timeline of what each thread was doing.
+ *
+ * Spans are kept in per-thread ring buffers that only their own thread
+ * writes to, so recording takes no locks.  Once a buffer is full, its
+ * oldest spans are overwritten.  The timeline is written out in the Chrome
+ * trace-event format, which chrome://tracing and Perfetto can open.
+ *
+ * Recording is disabled by default.  Setting the SCANTAILOR_TRACE
+ * environment variable to a file name enables it, see initFromEnvironment().
+ */
+class TraceRecorder
+{
+public:
+    class Span
+    {
+        DECLARE_NON_COPYABLE(Span)
+    public:
+        /**
+         * \param name The span name.  It has to be a string literal,
+         *        or otherwise outlive the recorder, as only the pointer
+         *        is stored.
+         */
+        explicit Span(char const* name);
+
+        ~Span();
+    private:
+        char const* m_name;
+        qint64 m_startUsec;
+    };
+
+    static void setEnabled(bool enabled);
+
+    static bool isEnabled();
+
+    /**
+     * \brief Enables recording if SCANTAILOR_TRACE is set.
+     *
+     * \return The file name from SCANTAILOR_TRACE, or an empty string.
+     */
+    static QString initFromEnvironment();
+
+    /**
+     * \brief Writes everything recorded so far as Chrome trace-event JSON.
+     *
+     * Best called once the threads being traced are idle, as spans
+     * recorded while writing may or may not make it to the file.
+     * \return false if the file couldn't be written.
+     */
+    static bool writeChromeTrace(QString const& file_path);
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+#endif
@@ -71,14 +71,25 @@ Utils::outputDirToThumbDir(QString const& output_dir)
     return output_dir + QLatin1String("/cache/thumbs");
 }
 
+QString
+Utils::outputDirToIntermediateDir(QString const& output_dir)
+{
+    return output_dir + QLatin1String("/cache/intermediate");
+}
+
 IntrusivePtr<ThumbnailPixmapCache>
 Utils::createThumbnailCache(QString const& output_dir)
 {
-    QSize const max_pixmap_size = QSettings().value(_key_thumbnails_max_cache_pixmap_size, _key_thumbnails_max_cache_pixmap_size_def).toSize();
+    QSettings settings;
+    QSize const max_pixmap_size = settings.value(_key_thumbnails_max_cache_pixmap_size, _key_thumbnails_max_cache_pixmap_size_def).toSize();
+    int const max_cache_memory_mb = settings.value(_key_thumbnails_max_cache_memory_mb, _key_thumbnails_max_cache_memory_mb_def).toInt();
     QString const thumbs_cache_path(outputDirToThumbDir(output_dir));
 
     return IntrusivePtr<ThumbnailPixmapCache>(
-               new ThumbnailPixmapCache(thumbs_cache_path, max_pixmap_size, 40, 5)
+               new ThumbnailPixmapCache(
+                   thumbs_cache_path, max_pixmap_size,
+                   qint64(max_cache_memory_mb) << 20, 5
+               )
            );
 }
 
@@ -40,6 +40,8 @@ public:
 
     static QString outputDirToThumbDir(QString const& output_dir);
 
+    static QString outputDirToIntermediateDir(QString const& output_dir);
+
     static IntrusivePtr<ThumbnailPixmapCache> createThumbnailCache(QString const& output_dir);
 
     /**
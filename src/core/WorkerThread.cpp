@@ -19,12 +19,15 @@
 
 #include "ThreadPriority.h"
 #include "OutOfMemoryHandler.h"
+#include "TraceRecorder.h"
+#include "NumaTopology.h"
 #include <QCoreApplication>
 #include <QThread>
 #include <QEvent>
 #include "settings/ini_keys.h"
 #include <QtGlobal> // For Q_OS_LINUX
 #include <new>
+#include <algorithm>
 #include <assert.h>
 
 #if defined(Q_OS_LINUX) // For Linux updatePriority()
@@ -33,7 +36,7 @@
 #include <sys/resource.h>
 #endif
 
-class WorkerThread::Dispatcher : public QObject
+class WorkerThread::Dispatcher : public QObject, private BackgroundTask::PreviewSink
 {
 public:
     enum UpdatePriorityResult {
@@ -52,8 +55,15 @@ protected:
 private:
     void processTask(BackgroundTaskPtr const& task);
 
+    virtual void previewReady(FilterResultPtr const& preview);
+
     Impl& m_rOwner;
 
+    /**
+     * The task being executed, to attribute its previews to.
+     */
+    BackgroundTaskPtr m_ptrCurrentTask;
+
     /**
      * This one will be set if we decide we need to restart
      * the background thread before processing a given task.
@@ -66,11 +76,23 @@ class WorkerThread::Impl : public QThread
 public:
     enum { NormalExit = 0, ExitForRestart };
 
-    Impl(WorkerThread& owner);
+    /**
+     * \param node The NUMA node to run on.  See NumaTopology.
+     */
+    Impl(WorkerThread& owner, int node);
 
     ~Impl();
 
     void performTask(BackgroundTaskPtr const& task);
+
+    /**
+     * The number of tasks submitted to this thread and not yet finished.
+     * Only accessed from the thread that owns WorkerThread.
+     */
+    int numPendingTasks() const
+    {
+        return m_numPendingTasks;
+    }
 protected:
     virtual void run();
 
@@ -82,6 +104,8 @@ private:
 
     WorkerThread& m_rOwner;
     Dispatcher m_dispatcher;
+    int m_node;
+    int m_numPendingTasks;
     bool m_threadStarted;
 };
 
@@ -117,11 +141,31 @@ private:
     FilterResultPtr m_ptrResult;
 };
 
+class WorkerThread::TaskPreviewEvent : public QEvent
+{
+public:
+    TaskPreviewEvent(BackgroundTaskPtr const& task, FilterResultPtr const& preview);
+
+    BackgroundTaskPtr const& task() const
+    {
+        return m_ptrTask;
+    }
+
+    FilterResultPtr const& preview() const
+    {
+        return m_ptrPreview;
+    }
+private:
+    BackgroundTaskPtr m_ptrTask;
+    FilterResultPtr m_ptrPreview;
+};
+
 /*=============================== WorkerThread ==============================*/
 
 WorkerThread::WorkerThread(QObject* parent)
     :   QObject(parent),
-        m_ptrImpl(new Impl(*this))
+        m_numThreads(1),
+        m_shutDown(false)
 {
 }
 
@@ -129,18 +173,42 @@ WorkerThread::~WorkerThread()
 {
 }
 
+void
+WorkerThread::setNumThreads(int const num_threads)
+{
+    m_numThreads = std::max(1, num_threads);
+}
+
 void
 WorkerThread::shutdown()
 {
-    m_ptrImpl.reset();
+    m_shutDown = true;
+    m_workers.clear();
 }
 
 void
 WorkerThread::performTask(BackgroundTaskPtr const& task)
 {
-    if (m_ptrImpl.get()) {
-        m_ptrImpl->performTask(task);
+    if (m_shutDown) {
+        return;
+    }
+
+    Impl* least_busy = 0;
+    int const num_active = std::min<int>(m_numThreads, m_workers.size());
+    for (int i = 0; i < num_active; ++i) {
+        Impl* worker = m_workers[i].get();
+        if (!least_busy || worker->numPendingTasks() < least_busy->numPendingTasks()) {
+            least_busy = worker;
+        }
     }
+
+    if (!least_busy || (least_busy->numPendingTasks() > 0 && num_active < m_numThreads)) {
+        int const node = NumaTopology::nodeOfWorker(m_workers.size());
+        m_workers.push_back(std::unique_ptr<Impl>(new Impl(*this, node)));
+        least_busy = m_workers.back().get();
+    }
+
+    least_busy->performTask(task);
 }
 
 void
@@ -150,6 +218,13 @@ WorkerThread::emitTaskResult(
     emit taskResult(task, result);
 }
 
+void
+WorkerThread::emitTaskPreview(
+    BackgroundTaskPtr const& task, FilterResultPtr const& preview)
+{
+    emit taskPreview(task, preview);
+}
+
 /*======================== WorkerThread::Dispatcher ========================*/
 
 WorkerThread::Dispatcher::Dispatcher(Impl& owner)
@@ -238,27 +313,45 @@ WorkerThread::Dispatcher::customEvent(QEvent* event)
 void
 WorkerThread::Dispatcher::processTask(BackgroundTaskPtr const& task)
 {
-    if (task->isCancelled()) {
-        return;
-    }
-
-    try {
-        FilterResultPtr const result((*task)());
-        if (result) {
-            QCoreApplication::postEvent(
-                &m_rOwner, new TaskResultEvent(task, result)
-            );
+    FilterResultPtr result;
+
+    if (!task->isCancelled()) {
+        TraceRecorder::Span const trace_span("background_task");
+        m_ptrCurrentTask = task;
+        task->setPreviewSink(this);
+        try {
+            result = (*task)();
+        } catch (std::bad_alloc const&) {
+            OutOfMemoryHandler::instance().handleOutOfMemorySituation();
         }
-    } catch (std::bad_alloc const&) {
-        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+        task->setPreviewSink(nullptr);
+        m_ptrCurrentTask.reset();
     }
+
+    // Posted even without a result, so that the owner knows this thread
+    // has one task less to do.
+    QCoreApplication::postEvent(
+        &m_rOwner, new TaskResultEvent(task, result)
+    );
+}
+
+void
+WorkerThread::Dispatcher::previewReady(FilterResultPtr const& preview)
+{
+    // Events are delivered in the order they were posted, so the preview
+    // can't overtake the result of the same task.
+    QCoreApplication::postEvent(
+        &m_rOwner, new TaskPreviewEvent(m_ptrCurrentTask, preview)
+    );
 }
 
 /*========================== WorkerThread::Impl ============================*/
 
-WorkerThread::Impl::Impl(WorkerThread& owner)
+WorkerThread::Impl::Impl(WorkerThread& owner, int const node)
     :   m_rOwner(owner),
         m_dispatcher(*this),
+        m_node(node),
+        m_numPendingTasks(0),
         m_threadStarted(false)
 {
     m_dispatcher.moveToThread(this);
@@ -273,6 +366,7 @@ WorkerThread::Impl::~Impl()
 void
 WorkerThread::Impl::performTask(BackgroundTaskPtr const& task)
 {
+    ++m_numPendingTasks;
     QCoreApplication::postEvent(&m_dispatcher, new PerformTaskEvent(task));
     if (!m_threadStarted) {
         start();
@@ -283,6 +377,8 @@ WorkerThread::Impl::performTask(BackgroundTaskPtr const& task)
 void
 WorkerThread::Impl::run()
 {
+    NumaTopology::bindCurrentThread(m_node);
+
     m_dispatcher.maybeProcessQueuedTask();
 
     if (exec() == ExitForRestart) {
@@ -299,7 +395,12 @@ WorkerThread::Impl::customEvent(QEvent* event)
     }
 
     if (TaskResultEvent* evt = dynamic_cast<TaskResultEvent*>(event)) {
-        m_rOwner.emitTaskResult(evt->task(), evt->result());
+        --m_numPendingTasks;
+        if (evt->result()) {
+            m_rOwner.emitTaskResult(evt->task(), evt->result());
+        }
+    } else if (TaskPreviewEvent* evt = dynamic_cast<TaskPreviewEvent*>(event)) {
+        m_rOwner.emitTaskPreview(evt->task(), evt->preview());
     }
 }
 
@@ -322,3 +423,12 @@ WorkerThread::TaskResultEvent::TaskResultEvent(
 {
 }
 
+/*===================== WorkerThread::TaskPreviewEvent =====================*/
+
+WorkerThread::TaskPreviewEvent::TaskPreviewEvent(
+    BackgroundTaskPtr const& task, FilterResultPtr const& preview)
+    :   QEvent(User),
+        m_ptrTask(task),
+        m_ptrPreview(preview)
+{
+}
@@ -24,7 +24,16 @@
 #include "FilterResult.h"
 #include <QObject>
 #include <memory>
+#include <vector>
 
+/**
+ * \brief A pool of background threads executing BackgroundTask objects.
+ *
+ * Tasks are handed to the least busy thread.  Results are delivered
+ * through the taskResult() signal in the thread this object lives in.
+ * Previews a task posts while running are delivered the same way,
+ * through taskPreview(), always ahead of the task's result.
+ */
 class WorkerThread : public QObject
 {
     Q_OBJECT
@@ -34,6 +43,19 @@ public:
 
     ~WorkerThread();
 
+    /**
+     * \brief Sets the number of threads tasks are distributed across.
+     *
+     * Threads are started on demand.  Reducing the number doesn't stop
+     * threads that are already running, they just won't get new tasks.
+     */
+    void setNumThreads(int num_threads);
+
+    int numThreads() const
+    {
+        return m_numThreads;
+    }
+
     /**
      * \brief Waits for pending jobs to finish and stop the thread.
      *
@@ -45,15 +67,22 @@ public slots:
     void performTask(BackgroundTaskPtr const& task);
 signals:
     void taskResult(BackgroundTaskPtr const& task, FilterResultPtr const& result);
+
+    void taskPreview(BackgroundTaskPtr const& task, FilterResultPtr const& preview);
 private:
     void emitTaskResult(BackgroundTaskPtr const& task, FilterResultPtr const& result);
 
+    void emitTaskPreview(BackgroundTaskPtr const& task, FilterResultPtr const& preview);
+
     class Impl;
     class Dispatcher;
     class PerformTaskEvent;
     class TaskResultEvent;
+    class TaskPreviewEvent;
 
-    std::unique_ptr<Impl> m_ptrImpl;
+    std::vector<std::unique_ptr<Impl> > m_workers;
+    int m_numThreads;
+    bool m_shutDown;
 };
 
 #endif
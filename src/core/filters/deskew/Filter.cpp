@@ -33,6 +33,7 @@
 #include <QDomDocument>
 #include <QDomElement>
 #include "CommandLine.h"
+#include "OrderByProcessingTime.h"
 #include "OrderByAngleProvider.h"
 
 namespace deskew
@@ -40,18 +41,17 @@ namespace deskew
 
 Filter::Filter(PageSelectionAccessor const& page_selection_accessor):
     m_ptrSettings(new Settings),
+    m_pageSelectionAccessor(page_selection_accessor),
     m_selectedPageOrder(0)
 {
-    if (CommandLine::get().isGui()) {
-        m_ptrOptionsWidget.reset(new OptionsWidget(m_ptrSettings, page_selection_accessor));
-    }
-
     typedef PageOrderOption::ProviderPtr ProviderPtr;
 
     ProviderPtr const order_by_angle(new OrderByAngleProvider(m_ptrSettings));
     ProviderPtr const order_by_abs_angle(new OrderByAbsAngleProvider(m_ptrSettings));
     m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Natural order"), ProviderPtr()));
     m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Processed then unprocessed"), ProviderPtr(new OrderByReadiness())));
+    m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Order by processing time"), ProviderPtr(new OrderByProcessingTime()),
+                                 QObject::tr("Puts the pages that took longest to process first")));
     m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Order by angle"), order_by_angle));
     m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Order by absolute angle"), order_by_abs_angle));
 }
@@ -60,6 +60,17 @@ Filter::~Filter()
 {
 }
 
+OptionsWidget*
+Filter::optionsWidget()
+{
+    if (!m_ptrOptionsWidget.get() && CommandLine::get().isGui()) {
+        m_ptrOptionsWidget.reset(
+            new OptionsWidget(m_ptrSettings, m_pageSelectionAccessor)
+        );
+    }
+    return m_ptrOptionsWidget.get();
+}
+
 QString
 Filter::getName() const
 {
@@ -100,8 +111,8 @@ Filter::pageOrderOptions() const
 void
 Filter::preUpdateUI(FilterUiInterface* const ui, PageId const& page_id)
 {
-    m_ptrOptionsWidget->preUpdateUI(page_id);
-    ui->setOptionsWidget(m_ptrOptionsWidget.get(), ui->KEEP_OWNERSHIP);
+    optionsWidget()->preUpdateUI(page_id);
+    ui->setOptionsWidget(optionsWidget(), ui->KEEP_OWNERSHIP);
 }
 
 QDomElement
@@ -25,11 +25,11 @@
 #include "IntrusivePtr.h"
 #include "FilterResult.h"
 #include "SafeDeletingQObjectPtr.h"
+#include "PageSelectionAccessor.h"
 #include "Settings.h"
 
 class PageId;
 class QString;
-class PageSelectionAccessor;
 
 namespace select_content
 {
@@ -86,10 +86,13 @@ public:
     IntrusivePtr<CacheDrivenTask> createCacheDrivenTask(
         IntrusivePtr<select_content::CacheDrivenTask> const& next_task);
 
-    OptionsWidget* optionsWidget()
-    {
-        return m_ptrOptionsWidget.get();
-    }
+    /**
+     * \brief Returns the options widget, creating it on first use.
+     *
+     * Returns null when not running the GUI.  Must only be called
+     * from the GUI thread.
+     */
+    OptionsWidget* optionsWidget();
     Settings* getSettings()
     {
         return m_ptrSettings.get();
@@ -101,6 +104,7 @@ private:
         PageId const& page_id, int numeric_id) const;
 
     IntrusivePtr<Settings> m_ptrSettings;
+    PageSelectionAccessor m_pageSelectionAccessor;
     SafeDeletingQObjectPtr<OptionsWidget> m_ptrOptionsWidget;
     std::vector<PageOrderOption> m_pageOrderOptions;
     int m_selectedPageOrder;
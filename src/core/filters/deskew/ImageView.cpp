@@ -272,12 +272,14 @@ ImageView::handleMoveRequest(int idx, QPointF const& pos)
     }
 
     m_xform.setPostRotation(angle_deg);
+    beginLivePreview();
     updateTransformPreservingScale(ImagePresentation(m_xform.transform(), m_xform.resultingPreCropArea()));
 }
 
 void
 ImageView::dragFinished()
 {
+    endLivePreview();
     emit manualDeskewAngleSet(m_xform.postRotation());
 }
 
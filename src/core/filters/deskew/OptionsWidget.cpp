@@ -91,10 +91,7 @@ OptionsWidget::appliedTo(std::set<PageId> const& pages)
         m_uiData.effectiveDeskewAngle(),
         m_uiData.dependencies(), m_uiData.mode()
     );
-    m_ptrSettings->setDegress(pages, params);
-    for (PageId const& page_id : pages) {
-        emit invalidateThumbnail(page_id);
-    }
+    emit invalidateThumbnails(m_ptrSettings->setDegress(pages, params));
 }
 
 void
@@ -38,30 +38,20 @@ public:
         PageId const& lhs_page, bool lhs_incomplete,
         PageId const& rhs_page, bool rhs_incomplete) const
     {
+        return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+    }
 
-        if (lhs_incomplete != rhs_incomplete) {
+    virtual bool sortKey(PageId const& page, bool incomplete, SortKey& key) const
+    {
+        if (incomplete) {
             // Pages with question mark go to the bottom.
-            return rhs_incomplete;
-        } else if (lhs_incomplete) {
-            assert(rhs_incomplete);
-            // Two pages with question marks are ordered naturally.
-            return lhs_page < rhs_page;
+            key[0] = 1;
+            return true;
         }
 
-        assert(lhs_incomplete == false);
-        assert(rhs_incomplete == false);
-
-        std::unique_ptr<Params> const lhs_params(m_ptrSettings->getPageParams(lhs_page));
-        std::unique_ptr<Params> const rhs_params(m_ptrSettings->getPageParams(rhs_page));
-
-        double const lhs_angle = lhs_params.get() ? func(-1.0 * lhs_params->deskewAngle()) : 0.;
-        double const rhs_angle = rhs_params.get() ? func(-1.0 * rhs_params->deskewAngle()) : 0.;
-
-        if (lhs_angle != rhs_angle) {
-            return lhs_angle < rhs_angle;
-        } else {
-            return lhs_page < rhs_page;
-        }
+        std::unique_ptr<Params> const params(m_ptrSettings->getPageParams(page));
+        key[1] = params.get() ? func(-1.0 * params->deskewAngle()) : 0.;
+        return true;
     }
 
     virtual QString hint(PageId const& page) const
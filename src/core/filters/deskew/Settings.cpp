@@ -20,8 +20,10 @@
 #include "Utils.h"
 #include "RelinkablePath.h"
 #include "AbstractRelinker.h"
-#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
 #include "settings/ini_keys.h"
+#include <vector>
 #include <cmath>
 #include <iostream>
 
@@ -42,14 +44,14 @@ Settings::~Settings()
 void
 Settings::clear()
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_perPageParams.clear();
 }
 
 void
 Settings::performRelinking(AbstractRelinker const& relinker)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     PerPageParams new_params;
 
     for (PerPageParams::value_type const& kv : m_perPageParams) {
@@ -89,21 +91,21 @@ void Settings::updateDeviation()
 void
 Settings::setPageParams(PageId const& page_id, Params const& params)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     Utils::mapSetValue(m_perPageParams, page_id, params);
 }
 
 void
 Settings::clearPageParams(PageId const& page_id)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_perPageParams.erase(page_id);
 }
 
 std::unique_ptr<Params>
 Settings::getPageParams(PageId const& page_id) const
 {
-    QMutexLocker locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     PerPageParams::const_iterator it(m_perPageParams.find(page_id));
     if (it != m_perPageParams.end()) {
@@ -113,13 +115,70 @@ Settings::getPageParams(PageId const& page_id) const
     }
 }
 
-void
+bool
+Settings::neighbourDeskewAngle(PageId const& page_id, double& angle) const
+{
+    // Neighbours that disagree by more than this give no usable prior.
+    double const max_disagreement = 1.0;
+
+    QReadLocker const locker(&m_lock);
+
+    PerPageParams::const_iterator const it(m_perPageParams.lower_bound(page_id));
+    std::vector<double> angles;
+    if (it != m_perPageParams.begin()) {
+        PerPageParams::const_iterator prev(it);
+        --prev;
+        if (prev->second.mode() == MODE_AUTO) {
+            angles.push_back(prev->second.deskewAngle());
+        }
+    }
+
+    PerPageParams::const_iterator next(it);
+    if (next != m_perPageParams.end() && next->first == page_id) {
+        ++next;
+    }
+    if (next != m_perPageParams.end() && next->second.mode() == MODE_AUTO) {
+        angles.push_back(next->second.deskewAngle());
+    }
+
+    if (angles.empty()) {
+        return false;
+    }
+    if (angles.size() == 2 && std::fabs(angles[0] - angles[1]) > max_disagreement) {
+        return false;
+    }
+
+    double sum = 0.0;
+    for (double const a : angles) {
+        sum += a;
+    }
+    angle = sum / angles.size();
+    return true;
+}
+
+std::set<PageId>
 Settings::setDegress(std::set<PageId> const& pages, Params const& params)
 {
-    QMutexLocker const locker(&m_mutex);
+    std::set<PageId> changed;
+
+    QWriteLocker const locker(&m_lock);
     for (PageId const& page : pages) {
-        Utils::mapSetValue(m_perPageParams, page, params);
+        PerPageParams::iterator const it(m_perPageParams.lower_bound(page));
+        if (it == m_perPageParams.end() || m_perPageParams.key_comp()(page, it->first)) {
+            m_perPageParams.insert(it, PerPageParams::value_type(page, params));
+            changed.insert(page);
+        } else {
+            Params const& old_params = it->second;
+            if (old_params.deskewAngle() != params.deskewAngle()
+                    || old_params.mode() != params.mode()
+                    || !old_params.dependencies().matches(params.dependencies())) {
+                changed.insert(page);
+            }
+            it->second = params;
+        }
     }
+
+    return changed;
 }
 
 } // namespace deskew
@@ -23,7 +23,7 @@
 #include "NonCopyable.h"
 #include "PageId.h"
 #include "Params.h"
-#include <QMutex>
+#include <QReadWriteLock>
 #include <memory>
 #include <map>
 #include <set>
@@ -53,7 +53,22 @@ public:
 
     std::unique_ptr<Params> getPageParams(PageId const& page_id) const;
 
-    void setDegress(std::set<PageId> const& pages, Params const& params);
+    /**
+     * \brief Estimates the skew of a page from its neighbours.
+     *
+     * Looks at the adjacent pages that were deskewed automatically.
+     * If they agree on the angle, their mean deskew angle is written
+     * to \p angle and true is returned.
+     */
+    bool neighbourDeskewAngle(PageId const& page_id, double& angle) const;
+
+    /**
+     * \brief Sets the same parameters for all of \p pages at once.
+     *
+     * \return The pages whose deskew angle, mode or dependencies
+     *         are different from what they were.
+     */
+    std::set<PageId> setDegress(std::set<PageId> const& pages, Params const& params);
 
     double maxDeviation() const
     {
@@ -85,7 +100,7 @@ public:
 private:
     typedef std::map<PageId, Params> PerPageParams;
 
-    mutable QMutex m_mutex;
+    mutable QReadWriteLock m_lock;
     PerPageParams m_perPageParams;
     double m_avg;
     double m_sigma;
@@ -31,7 +31,12 @@
 #include "Dpi.h"
 #include "Dpm.h"
 #include "ImageTransformation.h"
+#include "IntermediateCache.h"
+#include "AnalysisResolution.h"
 #include "imageproc/BinaryImage.h"
+#include "imageproc/GrayImage.h"
+#include "imageproc/GrayImageView.h"
+#include "imageproc/Scale.h"
 #include "imageproc/BWColor.h"
 #include "imageproc/OrthogonalRotation.h"
 #include "imageproc/SkewFinder.h"
@@ -41,6 +46,7 @@
 #include "imageproc/SeedFill.h"
 #include "imageproc/Connectivity.h"
 #include "imageproc/Morphology.h"
+#include "Profiler.h"
 #include <QImage>
 #include <QSize>
 #include <QPoint>
@@ -50,6 +56,7 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <cmath>
 #include <assert.h>
 #include <stddef.h>
 
@@ -109,6 +116,9 @@ Task::~Task()
 FilterResultPtr
 Task::process(TaskStatus const& status, FilterData const& data)
 {
+    Profiler::Scope const profile_scope("deskew", m_pageId);
+    Profiler::addCounter("pixels", qint64(data.origImage().width()) * data.origImage().height());
+
     status.throwIfCancelled();
 
     Dependencies const deps(data.xform().preCropArea(), data.xform().preRotation());
@@ -167,35 +177,81 @@ Task::process(TaskStatus const& status, FilterData const& data)
         status.throwIfCancelled();
 
         if (bounded_image_area.isValid()) {
-            BinaryImage rotated_image(
-                orthogonalRotation(
-                    BinaryImage(
-                        data.grayImage(), bounded_image_area,
-                        data.bwThreshold()
-                    ),
-                    data.xform().preRotation().toDegrees()
-                )
-            );
-            if (m_ptrDbg.get()) {
-                m_ptrDbg->add(rotated_image, "bw_rotated");
-            }
-
             QSize const unrotated_dpm(Dpm(data.origImage()).toSize());
+
+            // In adaptive mode, scans with more detail than needed
+            // are analysed at a lower resolution.
+            Dpi const source_dpi(Dpm(unrotated_dpm));
+            Dpi const analysis_dpi(
+                AnalysisResolution::choose(data.grayImage(), source_dpi, 300)
+            );
             Dpm const rotated_dpm(
-                data.xform().preRotation().rotate(unrotated_dpm)
+                analysis_dpi.isNull()
+                ? Dpm(data.xform().preRotation().rotate(unrotated_dpm))
+                : Dpm(analysis_dpi)
             );
-            cleanup(status, rotated_image, Dpi(rotated_dpm));
-            if (m_ptrDbg.get()) {
-                m_ptrDbg->add(rotated_image, "after_cleanup");
+
+            // Debug images need the whole pipeline to run, so bypass the cache then.
+            IntermediateCache::Key cache_key;
+            if (!m_ptrDbg.get()) {
+                cache_key = IntermediateCache::Key(m_pageId.imageId(), "deskew_bw");
+                cache_key.add(bounded_image_area)
+                .add(data.xform().preRotation().toDegrees())
+                .add(int(data.bwThreshold()))
+                .add(rotated_dpm.horizontal()).add(rotated_dpm.vertical());
+            }
+
+            std::vector<BinaryImage> cached;
+            BinaryImage rotated_image;
+            if (IntermediateCache::load(cache_key, cached, 1)) {
+                rotated_image = cached.front();
+            } else {
+                BinaryImage bw_image;
+                if (analysis_dpi.isNull()) {
+                    bw_image = BinaryImage(
+                                   data.grayImage(), bounded_image_area,
+                                   data.bwThreshold()
+                               );
+                } else {
+                    QSize const analysis_size(
+                        std::max(1, bounded_image_area.width() * analysis_dpi.horizontal()
+                                 / source_dpi.horizontal()),
+                        std::max(1, bounded_image_area.height() * analysis_dpi.vertical()
+                                 / source_dpi.vertical())
+                    );
+                    bw_image = BinaryImage(
+                                   scaleToGray(
+                                       GrayImageView(data.grayImage(), bounded_image_area),
+                                       analysis_size
+                                   ), data.bwThreshold()
+                               );
+                }
+                rotated_image = orthogonalRotation(
+                                    bw_image, data.xform().preRotation().toDegrees()
+                                );
+                bw_image.release();
+                if (m_ptrDbg.get()) {
+                    m_ptrDbg->add(rotated_image, "bw_rotated");
+                }
+
+                cleanup(status, rotated_image, Dpi(rotated_dpm));
+                if (m_ptrDbg.get()) {
+                    m_ptrDbg->add(rotated_image, "after_cleanup");
+                }
+
+                IntermediateCache::store(cache_key, std::vector<BinaryImage>(1, rotated_image));
             }
 
             status.throwIfCancelled();
 
-            SkewFinder skew_finder;
-            skew_finder.setResolutionRatio(
-                (double)rotated_dpm.horizontal() / rotated_dpm.vertical()
-            );
-            Skew const skew(skew_finder.findSkew(rotated_image));
+            double const resolution_ratio =
+                (double)rotated_dpm.horizontal() / rotated_dpm.vertical();
+            Skew skew;
+            if (!findSkewNearNeighbours(rotated_image, resolution_ratio, skew)) {
+                SkewFinder skew_finder;
+                skew_finder.setResolutionRatio(resolution_ratio);
+                skew = skew_finder.findSkew(rotated_image);
+            }
             //std::cout << "deskew: SkewFinder" << std::endl;
 
             if (skew.confidence() >= skew.GOOD_CONFIDENCE) {
@@ -240,15 +296,15 @@ Task::cleanup(TaskStatus const& status, BinaryImage& image, Dpi const& dpi)
     BinaryImage reduced_image;
 
     {
-        ReduceThreshold reductor(image);
+        std::vector<int> thresholds;
         while (reduced_dpi.horizontal() >= 200 && reduced_dpi.vertical() >= 200) {
-            reductor.reduce(2);
+            thresholds.push_back(2);
             reduced_dpi = Dpi(
                               reduced_dpi.horizontal() / 2,
                               reduced_dpi.vertical() / 2
                           );
         }
-        reduced_image = reductor.image();
+        reduced_image = ReduceThreshold(image).reduceCascade(thresholds).image();
     }
 
     status.throwIfCancelled();
@@ -272,6 +328,48 @@ Task::cleanup(TaskStatus const& status, BinaryImage& image, Dpi const& dpi)
     rasterOp<RopSubtract<RopDst, RopSrc> >(image, garbage);
 }
 
+/**
+ * Neighbouring pages of a book tend to share their skew, so we first
+ * search a narrow window around the angle the adjacent pages got.
+ * The result is only trusted if it's confident and not at the edge
+ * of the window, otherwise the caller falls back to a full search.
+ */
+bool
+Task::findSkewNearNeighbours(
+    BinaryImage const& image, double const resolution_ratio, Skew& skew) const
+{
+    double const window = 2.0;
+    double const edge_margin = 0.5;
+
+    double prior = 0.0;
+    if (!m_ptrSettings->neighbourDeskewAngle(m_pageId, prior)) {
+        return false;
+    }
+
+    // Keeping the center on the integer grid makes the coarse sweep
+    // visit the same angles as the full search does.
+    double const center = -std::floor(prior + 0.5);
+    if (std::fabs(center) + window > SkewFinder::DEFAULT_MAX_ANGLE) {
+        return false;
+    }
+
+    SkewFinder skew_finder;
+    skew_finder.setResolutionRatio(resolution_ratio);
+    skew_finder.setMaxAngle(window);
+    skew_finder.setSearchCenter(center);
+    Skew const narrow_skew(skew_finder.findSkew(image));
+
+    if (narrow_skew.confidence() < Skew::GOOD_CONFIDENCE) {
+        return false;
+    }
+    if (std::fabs(narrow_skew.angle() - center) >= window - edge_margin) {
+        return false;
+    }
+
+    skew = narrow_skew;
+    return true;
+}
+
 int
 Task::from150dpi(int size, int target_dpi)
 {
@@ -35,6 +35,7 @@ class DebugImages;
 namespace imageproc
 {
 class BinaryImage;
+class Skew;
 };
 
 namespace select_content
@@ -68,6 +69,10 @@ private:
         TaskStatus const& status,
         imageproc::BinaryImage& img, Dpi const& dpi);
 
+    bool findSkewNearNeighbours(
+        imageproc::BinaryImage const& image,
+        double resolution_ratio, imageproc::Skew& skew) const;
+
     static int from150dpi(int size, int target_dpi);
 
     static QSize from150dpi(QSize const& size, Dpi const& target_dpi);
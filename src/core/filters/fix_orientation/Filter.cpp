@@ -44,14 +44,9 @@ namespace fix_orientation
 
 Filter::Filter(
     PageSelectionAccessor const& page_selection_accessor)
-    :   m_ptrSettings(new Settings), m_selectedPageOrder(0)
+    :   m_ptrSettings(new Settings),
+        m_pageSelectionAccessor(page_selection_accessor), m_selectedPageOrder(0)
 {
-    if (CommandLine::get().isGui()) {
-        m_ptrOptionsWidget.reset(
-            new OptionsWidget(m_ptrSettings, page_selection_accessor)
-        );
-    }
-
     typedef PageOrderOption::ProviderPtr ProviderPtr;
     ProviderPtr const default_order;
     ProviderPtr const order_by_rotation(new OrderByRotationProvider(m_ptrSettings));
@@ -63,6 +58,17 @@ Filter::~Filter()
 {
 }
 
+OptionsWidget*
+Filter::optionsWidget()
+{
+    if (!m_ptrOptionsWidget.get() && CommandLine::get().isGui()) {
+        m_ptrOptionsWidget.reset(
+            new OptionsWidget(m_ptrSettings, m_pageSelectionAccessor)
+        );
+    }
+    return m_ptrOptionsWidget.get();
+}
+
 QString
 Filter::getName() const
 {
@@ -86,12 +92,12 @@ Filter::performRelinking(AbstractRelinker const& relinker)
 void
 Filter::preUpdateUI(FilterUiInterface* ui, PageId const& page_id)
 {
-    if (m_ptrOptionsWidget.get()) {
+    if (OptionsWidget* const opt_widget = optionsWidget()) {
         OrthogonalRotation const rotation(
             m_ptrSettings->getRotationFor(page_id.imageId())
         );
-        m_ptrOptionsWidget->preUpdateUI(page_id, rotation);
-        ui->setOptionsWidget(m_ptrOptionsWidget.get(), ui->KEEP_OWNERSHIP);
+        opt_widget->preUpdateUI(page_id, rotation);
+        ui->setOptionsWidget(opt_widget, ui->KEEP_OWNERSHIP);
     }
 }
 
@@ -25,10 +25,10 @@
 #include "FilterResult.h"
 #include "IntrusivePtr.h"
 #include "SafeDeletingQObjectPtr.h"
+#include "PageSelectionAccessor.h"
 
 class PageId;
 class ImageId;
-class PageSelectionAccessor;
 class QString;
 class QDomDocument;
 class QDomElement;
@@ -81,10 +81,13 @@ public:
     IntrusivePtr<CacheDrivenTask> createCacheDrivenTask(
         IntrusivePtr<page_split::CacheDrivenTask> const& next_task);
 
-    OptionsWidget* optionsWidget()
-    {
-        return m_ptrOptionsWidget.get();
-    }
+    /**
+     * \brief Returns the options widget, creating it on first use.
+     *
+     * Returns null when not running the GUI.  Must only be called
+     * from the GUI thread.
+     */
+    OptionsWidget* optionsWidget();
 
     Settings* getSettings()
     {
@@ -100,6 +103,7 @@ private:
         ImageId const& image_id, int numeric_id) const;
 
     IntrusivePtr<Settings> m_ptrSettings;
+    PageSelectionAccessor m_pageSelectionAccessor;
     SafeDeletingQObjectPtr<OptionsWidget> m_ptrOptionsWidget;
     std::vector<PageOrderOption> m_pageOrderOptions;
     int m_selectedPageOrder;
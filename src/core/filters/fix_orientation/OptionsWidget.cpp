@@ -114,10 +114,7 @@ OptionsWidget::appliedTo(std::set<PageId> const& pages)
         return;
     }
 
-    m_ptrSettings->applyRotation(pages, m_rotation);
-    for (PageId const& page_id : pages) {
-        emit invalidateThumbnail(page_id);
-    }
+    emit invalidateThumbnails(m_ptrSettings->applyRotation(pages, m_rotation));
 }
 
 void
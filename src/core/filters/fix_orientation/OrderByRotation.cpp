@@ -29,17 +29,17 @@ OrderByRotationProvider::OrderByRotationProvider(IntrusivePtr<Settings> const& s
 
 bool
 OrderByRotationProvider::precedes(
-    PageId const& lhs_page, bool const /*lhs_incomplete*/,
-    PageId const& rhs_page, bool const /*rhs_incomplete*/) const
+    PageId const& lhs_page, bool const lhs_incomplete,
+    PageId const& rhs_page, bool const rhs_incomplete) const
 {
-    int const lrotation = m_ptrSettings->getRotationFor(lhs_page.imageId()).toDegrees();
-    int const rrotation = m_ptrSettings->getRotationFor(rhs_page.imageId()).toDegrees();
-
-    if (lrotation != rrotation) {
-        return lrotation < rrotation;
-    }
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
 
-    return lhs_page < rhs_page;
+bool
+OrderByRotationProvider::sortKey(PageId const& page, bool const /*incomplete*/, SortKey& key) const
+{
+    key[0] = m_ptrSettings->getRotationFor(page.imageId()).toDegrees();
+    return true;
 }
 
 QString
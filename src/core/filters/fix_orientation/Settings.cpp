@@ -20,6 +20,8 @@
 #include "Utils.h"
 #include "RelinkablePath.h"
 #include "AbstractRelinker.h"
+#include <QReadLocker>
+#include <QWriteLocker>
 
 namespace fix_orientation
 {
@@ -35,14 +37,14 @@ Settings::~Settings()
 void
 Settings::clear()
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_perImageRotation.clear();
 }
 
 void
 Settings::performRelinking(AbstractRelinker const& relinker)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     PerImageRotation new_rotations;
 
     for (PerImageRotation::value_type const& kv : m_perImageRotation) {
@@ -59,25 +61,41 @@ void
 Settings::applyRotation(
     ImageId const& image_id, OrthogonalRotation const rotation)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     setImageRotationLocked(image_id, rotation);
 }
 
-void
+std::set<PageId>
 Settings::applyRotation(
     std::set<PageId> const& pages, OrthogonalRotation const rotation)
 {
-    QMutexLocker locker(&m_mutex);
+    std::set<PageId> changed;
+
+    QWriteLocker const locker(&m_lock);
 
+    // Pages may share an image, so nothing is updated
+    // until all of them are checked.
     for (PageId const& page : pages) {
+        PerImageRotation::const_iterator const it(m_perImageRotation.find(page.imageId()));
+        OrthogonalRotation const old_rotation(
+            it != m_perImageRotation.end() ? it->second : OrthogonalRotation()
+        );
+        if (old_rotation != rotation) {
+            changed.insert(page);
+        }
+    }
+
+    for (PageId const& page : changed) {
         setImageRotationLocked(page.imageId(), rotation);
     }
+
+    return changed;
 }
 
 OrthogonalRotation
 Settings::getRotationFor(ImageId const& image_id) const
 {
-    QMutexLocker locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     PerImageRotation::const_iterator it(m_perImageRotation.find(image_id));
     if (it != m_perImageRotation.end()) {
@@ -24,7 +24,7 @@
 #include "OrthogonalRotation.h"
 #include "ImageId.h"
 #include "PageId.h"
-#include <QMutex>
+#include <QReadWriteLock>
 #include <map>
 #include <set>
 
@@ -47,7 +47,13 @@ public:
 
     void applyRotation(ImageId const& image_id, OrthogonalRotation rotation);
 
-    void applyRotation(std::set<PageId> const& pages, OrthogonalRotation rotation);
+    /**
+     * \brief Sets the rotation of the images of all of \p pages at once.
+     *
+     * \return Those of \p pages whose rotation is different from
+     *         what it was.
+     */
+    std::set<PageId> applyRotation(std::set<PageId> const& pages, OrthogonalRotation rotation);
 
     OrthogonalRotation getRotationFor(ImageId const& image_id) const;
 private:
@@ -56,7 +62,7 @@ private:
     void setImageRotationLocked(
         ImageId const& image_id, OrthogonalRotation const& rotation);
 
-    mutable QMutex m_mutex;
+    mutable QReadWriteLock m_lock;
     PerImageRotation m_perImageRotation;
 };
 
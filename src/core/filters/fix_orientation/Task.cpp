@@ -26,6 +26,7 @@
 #include "TaskStatus.h"
 #include "ImageView.h"
 #include "FilterUiInterface.h"
+#include "Profiler.h"
 #include <QImage>
 #include <iostream>
 
@@ -80,6 +81,9 @@ Task::process(TaskStatus const& status, FilterData const& data)
 {
     // This function is executed from the worker thread.
 
+    Profiler::Scope const profile_scope("fix_orientation", PageId(m_imageId));
+    Profiler::addCounter("pixels", qint64(data.origImage().width()) * data.origImage().height());
+
     status.throwIfCancelled();
 
     ImageTransformation xform(data.xform());
@@ -21,7 +21,6 @@
 #include "InteractionState.h"
 #include "ImageViewBase.h"
 #include "PropertySet.h"
-#include "ScopedIncDec.h"
 #include <QKeyEvent>
 #include <QMouseEvent>
 #include <QPixmap>
@@ -33,7 +32,10 @@
 #include <QPen>
 #include <QPoint>
 #include <Qt>
+#include <QWidget>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 
 namespace output
 {
@@ -41,8 +43,7 @@ namespace output
 ColorPickupInteraction::ColorPickupInteraction(
     EditableZoneSet& zones, ZoneInteractionContext& context)
     :   m_rZones(zones),
-        m_rContext(context),
-        m_dontDrawCircle(0)
+        m_rContext(context)
 {
     m_interaction.setInteractionStatusTip(tr("Click on an area to pick up its color, or ESC to cancel."));
 }
@@ -53,6 +54,13 @@ ColorPickupInteraction::startInteraction(
 {
     typedef FillColorProperty FCP;
     m_ptrFillColorProp = zone.properties()->locateOrCreate<FCP>();
+
+    // We sample the view's downscaled image rather than grab the widget,
+    // which would have to render the area again.
+    m_samplingSource = m_rContext.imageView().downscaledPixmap().toImage()
+                       .convertToFormat(QImage::Format_RGB32);
+    m_lastTarget = QRect();
+
     interaction.capture(m_interaction);
 }
 
@@ -66,18 +74,23 @@ void
 ColorPickupInteraction::onPaint(
     QPainter& painter, InteractionState const& interaction)
 {
-    if (m_dontDrawCircle) {
-        return;
-    }
+    QRect const target(targetBoundingRect());
+    m_lastTarget = target;
 
     painter.setWorldTransform(QTransform());
     painter.setRenderHint(QPainter::Antialiasing, true);
 
+    // Preview the color that would be picked.
+    QColor const color(colorUnderTarget(target));
     QPen pen(Qt::red);
     pen.setWidthF(1.5);
     painter.setPen(pen);
-    painter.setBrush(Qt::NoBrush);
-    painter.drawEllipse(targetBoundingRect());
+    if (color.isValid()) {
+        painter.setBrush(color);
+    } else {
+        painter.setBrush(Qt::NoBrush);
+    }
+    painter.drawEllipse(target);
 }
 
 void
@@ -95,7 +108,12 @@ void
 ColorPickupInteraction::onMouseMoveEvent(
     QMouseEvent* event, InteractionState& interaction)
 {
-    m_rContext.imageView().update();
+    // Only the old and the new positions of the circle need repainting.
+    QWidget* viewport = m_rContext.imageView().viewport();
+    if (!m_lastTarget.isNull()) {
+        viewport->update(damagedArea(m_lastTarget));
+    }
+    viewport->update(damagedArea(targetBoundingRect()));
 }
 
 void
@@ -111,57 +129,75 @@ ColorPickupInteraction::onKeyPressEvent(
 void
 ColorPickupInteraction::takeColor()
 {
-    ScopedIncDec<int> const guard(m_dontDrawCircle);
-
-    QRect const rect(targetBoundingRect());
-    QPixmap const pixmap(m_rContext.imageView().grab(rect));
-    if (pixmap.isNull()) {
+    QColor const color(colorUnderTarget(targetBoundingRect()));
+    if (!color.isValid()) {
         return;
     }
-    QImage const image(pixmap.toImage().convertToFormat(QImage::Format_RGB32));
 
-    int const width = rect.width();
-    int const height = rect.height();
+    m_ptrFillColorProp->setColor(color);
+
+    // Update default properties.
+    PropertySet default_props(m_rZones.defaultProperties());
+    default_props.locateOrCreate<FillColorProperty>()->setColor(color);
+    m_rZones.setDefaultProperties(default_props);
+    m_rZones.commit();
+}
+
+QColor
+ColorPickupInteraction::colorUnderTarget(QRect const& target) const
+{
+    if (m_samplingSource.isNull()) {
+        return QColor();
+    }
+
+    int const width = target.width();
+    int const height = target.height();
     int const x_center = width / 2;
     int const y_center = height / 2;
     int const sqdist_threshold = x_center * y_center;
-    uint32_t const* line = (uint32_t*)image.bits();
-    int const stride = image.bytesPerLine() / 4;
+    int const src_width = m_samplingSource.width();
+    int const src_height = m_samplingSource.height();
+    uint32_t const* const src_data = (uint32_t const*)m_samplingSource.bits();
+    int const src_stride = m_samplingSource.bytesPerLine() / 4;
+    ImageViewBase const& view = m_rContext.imageView();
+    QTransform const widget_to_source(view.widgetToImage() * view.pixmapToImage().inverted());
 
     // We are going to take a median color using the bit-mixing technique.
     std::vector<uint32_t> bitmixed_colors;
     bitmixed_colors.reserve(width * height);
 
-    // Take colors from the circle.
-    for (int y = 0; y < height; ++y, line += stride) {
+    // Take colors from the circle, one sample per widget pixel.
+    for (int y = 0; y < height; ++y) {
         int const dy = y - y_center;
         int const dy_sq = dy * dy;
         for (int x = 0; x < width; ++x) {
             int const dx = x - x_center;
             int const dx_sq = dx * dx;
             int const sqdist = dy_sq + dx_sq;
-            if (sqdist <= sqdist_threshold) {
-                uint32_t const color = line[x];
-                bitmixed_colors.push_back(bitMixColor(color));
+            if (sqdist > sqdist_threshold) {
+                continue;
             }
+
+            QPointF const widget_pt(target.left() + x + 0.5, target.top() + y + 0.5);
+            QPointF const src_pt(widget_to_source.map(widget_pt));
+            int const src_x = (int)std::floor(src_pt.x());
+            int const src_y = (int)std::floor(src_pt.y());
+            if (src_x < 0 || src_y < 0 || src_x >= src_width || src_y >= src_height) {
+                continue;
+            }
+
+            uint32_t const color = src_data[src_y * src_stride + src_x];
+            bitmixed_colors.push_back(bitMixColor(color));
         }
     }
 
     if (bitmixed_colors.empty()) {
-        return;
+        return QColor();
     }
 
     std::vector<uint32_t>::iterator half_pos(bitmixed_colors.begin() + bitmixed_colors.size() / 2);
     std::nth_element(bitmixed_colors.begin(), half_pos, bitmixed_colors.end());
-    QColor const color(bitUnmixColor(*half_pos));
-
-    m_ptrFillColorProp->setColor(color);
-
-    // Update default properties.
-    PropertySet default_props(m_rZones.defaultProperties());
-    default_props.locateOrCreate<FillColorProperty>()->setColor(color);
-    m_rZones.setDefaultProperties(default_props);
-    m_rZones.commit();
+    return QColor(bitUnmixColor(*half_pos));
 }
 
 QRect
@@ -173,10 +209,18 @@ ColorPickupInteraction::targetBoundingRect() const
     return rect;
 }
 
+QRect
+ColorPickupInteraction::damagedArea(QRect const& target)
+{
+    // Account for the pen and antialiasing.
+    return target.adjusted(-3, -3, 3, 3);
+}
+
 void
 ColorPickupInteraction::switchToDefaultInteraction()
 {
     m_ptrFillColorProp.reset();
+    m_samplingSource = QImage();
     m_interaction.release();
     makePeerPreceeder(*m_rContext.createDefaultInteraction());
     unlink();
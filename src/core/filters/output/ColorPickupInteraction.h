@@ -25,6 +25,8 @@
 #include "FillColorProperty.h"
 #include "IntrusivePtr.h"
 #include <QCoreApplication>
+#include <QColor>
+#include <QImage>
 #include <QRect>
 #include <stdint.h>
 
@@ -54,8 +56,19 @@ protected:
 private:
     void takeColor();
 
+    /**
+     * Returns the median color within the target circle, or an invalid
+     * color if it's entirely outside of the image.
+     */
+    QColor colorUnderTarget(QRect const& target) const;
+
     QRect targetBoundingRect() const;
 
+    /**
+     * The area to repaint when the target circle moves.
+     */
+    static QRect damagedArea(QRect const& target);
+
     void switchToDefaultInteraction();
 
     static uint32_t bitMixColor(uint32_t color);
@@ -66,7 +79,14 @@ private:
     ZoneInteractionContext& m_rContext;
     InteractionState::Captor m_interaction;
     IntrusivePtr<FillColorProperty> m_ptrFillColorProp;
-    int m_dontDrawCircle;
+
+    /**
+     * The view's downscaled image, converted once per interaction,
+     * so that sampling it under the cursor costs next to nothing.
+     */
+    QImage m_samplingSource;
+
+    QRect m_lastTarget;
 
     static uint32_t const m_sBitMixingLUT[3][256];
     static uint32_t const m_sBitUnmixingLUT[3][256];
@@ -22,6 +22,9 @@
 #include "TaskStatus.h"
 #include "DebugImages.h"
 #include "imageproc/RasterOp.h"
+#include "imageproc/ConnectivityMap.h"
+#include "imageproc/CompactConnectivityMap.h"
+#include "imageproc/Connectivity.h"
 #include <new>
 #include <stdint.h>
 
@@ -78,17 +81,75 @@ DespeckleState::redespeckle(
         break;
     }
 
-    new_state.m_speckles = Despeckle::despeckle(
-                               m_everythingBW, m_dpi, level2, status, dbg
-                           );
+    if (dbg) {
+        // Debugging images only come from a full despeckling run.
+        new_state.m_speckles = Despeckle::despeckle(
+                                   m_everythingBW, m_dpi, level2, status, dbg
+                               );
 
-    status.throwIfCancelled();
+        status.throwIfCancelled();
+
+        rasterOp<RopSubtract<RopSrc, RopDst> >(new_state.m_speckles, m_everythingBW);
+
+        return new_state;
+    }
 
-    rasterOp<RopSubtract<RopSrc, RopDst> >(new_state.m_speckles, m_everythingBW);
+    if (!new_state.m_ptrLevelSpeckles) {
+        new_state.m_ptrLevelSpeckles = findLevelSpeckles(m_everythingBW, m_dpi, status);
+    }
+
+    new_state.m_speckles = (*new_state.m_ptrLevelSpeckles)[level2].toBinaryImage();
 
     return new_state;
 }
 
+std::shared_ptr<std::vector<RleBinaryImage> const>
+DespeckleState::findLevelSpeckles(
+    BinaryImage const& image, Dpi const& dpi, TaskStatus const& status)
+{
+    int const num_levels = Despeckle::AGGRESSIVE + 1;
+    std::shared_ptr<std::vector<RleBinaryImage> > speckles(
+        new std::vector<RleBinaryImage>(num_levels, RleBinaryImage(image.size(), WHITE))
+    );
+
+    // Only the compact copy is kept while removalLevels() runs.
+    CompactConnectivityMap const cmap((ConnectivityMap(image, CONN8)));
+    if (cmap.maxLabel() == 0) {
+        return speckles;
+    }
+
+    std::vector<uint8_t> const removal_levels(
+        Despeckle::removalLevels(cmap, dpi, status)
+    );
+
+    status.throwIfCancelled();
+
+    uint32_t const msb = uint32_t(1) << 31;
+    int const width = image.width();
+    int const height = image.height();
+
+    for (int level = 0; level < num_levels; ++level) {
+        BinaryImage level_speckles(image.size(), WHITE);
+        uint32_t* const speckles_data = level_speckles.data();
+        int const speckles_stride = level_speckles.wordsPerLine();
+        uint8_t const level_bit = uint8_t(1) << level;
+
+        #pragma omp parallel for
+        for (int y = 0; y < height; ++y) {
+            uint32_t* const speckles_line = speckles_data + y * speckles_stride;
+            for (int x = 0; x < width; ++x) {
+                if (removal_levels[cmap.label(x, y)] & level_bit) {
+                    speckles_line[x >> 5] |= msb >> (x & 31);
+                }
+            }
+        }
+
+        (*speckles)[level] = RleBinaryImage(level_speckles);
+    }
+
+    return speckles;
+}
+
 QImage
 DespeckleState::overlaySpeckles(
     QImage const& mixed, imageproc::BinaryImage const& speckles)
@@ -22,7 +22,10 @@
 #include "DespeckleLevel.h"
 #include "Dpi.h"
 #include "imageproc/BinaryImage.h"
+#include "imageproc/RleBinaryImage.h"
 #include <QImage>
+#include <memory>
+#include <vector>
 
 class TaskStatus;
 class DebugImages;
@@ -59,6 +62,10 @@ private:
 
     static imageproc::BinaryImage extractBW(QImage const& mixed);
 
+    static std::shared_ptr<std::vector<imageproc::RleBinaryImage> const>
+    findLevelSpeckles(imageproc::BinaryImage const& image,
+                      Dpi const& dpi, TaskStatus const& status);
+
     /**
      * This image is the output image produced by OutputGenerator
      * with speckles added as black regions.  This image is always in RGB32,
@@ -88,6 +95,13 @@ private:
      * m_everythingBW.
      */
     DespeckleLevel m_despeckleLevel;
+
+    /**
+     * The speckles m_everythingBW would have at each Despeckle::Level.
+     * Computed by the first redespeckle() and shared between copies,
+     * which makes switching between the levels afterwards instant.
+     */
+    std::shared_ptr<std::vector<imageproc::RleBinaryImage> const> m_ptrLevelSpeckles;
 };
 
 } // namespace output
@@ -192,7 +192,7 @@ DespeckleView::initiateDespeckling(AnimationAction const anim_action)
             m_despeckleLevel, m_debug
         )
     );
-    ImageViewBase::backgroundExecutor().enqueueTask(task);
+    ImageViewBase::backgroundExecutor().enqueueTask(task, this);
 }
 
 void
@@ -217,9 +217,14 @@ DespeckleView::despeckleDone(
         std::unique_ptr<TabbedDebugImages> tab_widget(new TabbedDebugImages);
         tab_widget->addTab(widget.release(), "Main");
         AutoRemovingFile file;
+        DebugImages::ImageGenerator generator;
         QString label;
-        while (!(file = dbg->retrieveNext(&label)).get().isNull()) {
-            tab_widget->addTab(new DebugImageView(file), label);
+        while (dbg->retrieveNext(&file, &generator, &label)) {
+            if (generator.empty()) {
+                tab_widget->addTab(new DebugImageView(file), label);
+            } else {
+                tab_widget->addTab(new DebugImageView(generator), label);
+            }
         }
         widget = std::move(tab_widget);
     }
@@ -75,7 +75,10 @@ DewarpingView::DewarpingView(
         m_distortionModel(distortion_model),
         m_depthPerception(depth_perception),
         m_dragHandler(*this),
-        m_zoomHandler(*this)
+        m_zoomHandler(*this),
+        m_gridValid(false),
+        m_gridDirty(true),
+        m_dragInProgress(false)
 {
     setMouseTracking(true);
 
@@ -221,6 +224,7 @@ void
 DewarpingView::depthPerceptionChanged(double val)
 {
     m_depthPerception.setValue(val);
+    m_gridDirty = true;
     update();
 }
 
@@ -245,43 +249,18 @@ DewarpingView::onPaint(QPainter& painter, InteractionState const& interaction)
     painter.setPen(grid_pen);
     painter.setBrush(Qt::NoBrush);
 
-    int const num_vert_grid_lines = 30;
-    int const num_hor_grid_lines = 30;
-
-    bool valid_model = m_distortionModel.isValid();
-
-    if (valid_model) {
-        try {
-            std::vector<QVector<QPointF> > curves(num_hor_grid_lines);
-
-            dewarping::CylindricalSurfaceDewarper dewarper(
-                m_distortionModel.topCurve().polyline(),
-                m_distortionModel.bottomCurve().polyline(), m_depthPerception.value()
-            );
-            dewarping::CylindricalSurfaceDewarper::State state;
-
-            for (int j = 0; j < num_vert_grid_lines; ++j) {
-                double const x = j / (num_vert_grid_lines - 1.0);
-                dewarping::CylindricalSurfaceDewarper::Generatrix const gtx(dewarper.mapGeneratrix(x, state));
-                QPointF const gtx_p0(gtx.imgLine.pointAt(gtx.pln2img(0)));
-                QPointF const gtx_p1(gtx.imgLine.pointAt(gtx.pln2img(1)));
-                painter.drawLine(gtx_p0, gtx_p1);
-                for (int i = 0; i < num_hor_grid_lines; ++i) {
-                    double const y = i / (num_hor_grid_lines - 1.0);
-                    curves[i].push_back(gtx.imgLine.pointAt(gtx.pln2img(y)));
-                }
-            }
+    if (m_gridDirty) {
+        updateGrid();
+    }
 
-            for (QVector<QPointF> const& curve : curves) {
-                painter.drawPolyline(curve);
-            }
-        } catch (std::runtime_error const&) {
-            // Still probably a bad model, even though DistortionModel::isValid() was true.
-            valid_model = false;
+    if (m_gridValid) {
+        for (QLineF const& generatrix : m_gridGeneratrices) {
+            painter.drawLine(generatrix);
         }
-    } // valid_model
-
-    if (!valid_model) {
+        for (QVector<QPointF> const& curve : m_gridCurves) {
+            painter.drawPolyline(curve);
+        }
+    } else {
         // Just draw the frame.
         dewarping::Curve const& top_curve = m_distortionModel.topCurve();
         dewarping::Curve const& bottom_curve = m_distortionModel.bottomCurve();
@@ -295,6 +274,54 @@ DewarpingView::onPaint(QPainter& painter, InteractionState const& interaction)
     paintXSpline(painter, interaction, m_bottomSpline);
 }
 
+/**
+ * Samples the dewarping grid from the current model.  That's too slow
+ * to do on every repaint, and while a curve is being dragged it's done
+ * at a lower density, so the grid keeps up with the mouse.
+ */
+void
+DewarpingView::updateGrid()
+{
+    m_gridDirty = false;
+    m_gridGeneratrices.clear();
+    m_gridCurves.clear();
+    m_gridValid = m_distortionModel.isValid();
+    if (!m_gridValid) {
+        return;
+    }
+
+    int const num_vert_grid_lines = m_dragInProgress ? 10 : 30;
+    int const num_hor_grid_lines = m_dragInProgress ? 10 : 30;
+
+    try {
+        m_gridCurves.resize(num_hor_grid_lines);
+        m_gridGeneratrices.reserve(num_vert_grid_lines);
+
+        dewarping::CylindricalSurfaceDewarper dewarper(
+            m_distortionModel.topCurve().polyline(),
+            m_distortionModel.bottomCurve().polyline(), m_depthPerception.value()
+        );
+        dewarping::CylindricalSurfaceDewarper::State state;
+
+        for (int j = 0; j < num_vert_grid_lines; ++j) {
+            double const x = j / (num_vert_grid_lines - 1.0);
+            dewarping::CylindricalSurfaceDewarper::Generatrix const gtx(dewarper.mapGeneratrix(x, state));
+            QPointF const gtx_p0(gtx.imgLine.pointAt(gtx.pln2img(0)));
+            QPointF const gtx_p1(gtx.imgLine.pointAt(gtx.pln2img(1)));
+            m_gridGeneratrices.push_back(QLineF(gtx_p0, gtx_p1));
+            for (int i = 0; i < num_hor_grid_lines; ++i) {
+                double const y = i / (num_hor_grid_lines - 1.0);
+                m_gridCurves[i].push_back(gtx.imgLine.pointAt(gtx.pln2img(y)));
+            }
+        }
+    } catch (std::runtime_error const&) {
+        // Still probably a bad model, even though DistortionModel::isValid() was true.
+        m_gridValid = false;
+        m_gridGeneratrices.clear();
+        m_gridCurves.clear();
+    }
+}
+
 void
 DewarpingView::paintXSpline(
     QPainter& painter, InteractionState const& interaction,
@@ -350,6 +377,8 @@ DewarpingView::curveModified(int curve_idx)
     } else {
         m_distortionModel.setBottomCurve(dewarping::Curve(m_bottomSpline.spline()));
     }
+    m_dragInProgress = true;
+    m_gridDirty = true;
     update();
 }
 
@@ -364,6 +393,12 @@ DewarpingView::dragFinished()
        ) {
         m_dewarpingMode = DewarpingMode::MANUAL;
     }
+
+    // Back to the full density grid.
+    m_dragInProgress = false;
+    m_gridDirty = true;
+    update();
+
     emit distortionModelChanged(m_distortionModel);
 }
 
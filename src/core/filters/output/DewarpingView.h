@@ -34,6 +34,8 @@
 #include <QPointF>
 #include <QRectF>
 #include <QPolygonF>
+#include <QLineF>
+#include <QVector>
 #include <vector>
 
 namespace output
@@ -71,6 +73,8 @@ private:
         QPainter& painter, InteractionState const& interaction,
         InteractiveXSpline const& ispline);
 
+    void updateGrid();
+
     void curveModified(int curve_idx);
 
     void dragFinished();
@@ -91,6 +95,16 @@ private:
     InteractiveXSpline m_bottomSpline;
     DragHandler m_dragHandler;
     ZoomHandler m_zoomHandler;
+
+    /** Generatrices of the dewarping grid, in source image coordinates. */
+    std::vector<QLineF> m_gridGeneratrices;
+
+    /** Horizontal lines of the dewarping grid, in source image coordinates. */
+    std::vector<QVector<QPointF> > m_gridCurves;
+
+    bool m_gridValid;
+    bool m_gridDirty;
+    bool m_dragInProgress;
 };
 
 } // namespace output
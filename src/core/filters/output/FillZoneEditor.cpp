@@ -36,7 +36,6 @@
 #include <QImage>
 #include <QPointer>
 #include <QPainter>
-#include <QPainterPath>
 #include <QColor>
 #include <QBrush>
 #include <QPen>
@@ -140,18 +139,9 @@ FillZoneEditor::onPaint(QPainter& painter, InteractionState const& interaction)
         QColor const color(zone.properties()->locateOrDefault<FCP>()->color());
         painter.setBrush(m_colorAdapter(color));
         if (!zone.isEllipse()) {
-            painter.drawPolygon(zone.spline()->toPolygon(), Qt::WindingFill);
+            painter.drawPolygon(zone.spline()->polygon(), Qt::WindingFill);
         } else {
-            const EditableEllipse::Ptr& e = zone.ellipse();
-            const QPointF& center = e->center();
-
-            QPainterPath path;
-            path.addEllipse(center, e->rx(), e->ry());
-            QTransform t;
-            t.translate(center.x(), center.y());
-            t.rotate(zone.ellipse()->angle());
-            t.translate(-center.x(), -center.y());
-            painter.drawPolygon(t.map(path).toFillPolygon(), Qt::WindingFill);
+            painter.drawPolygon(zone.ellipse()->toPolygon(), Qt::WindingFill);
         }
     }
 }
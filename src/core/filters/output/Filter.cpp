@@ -24,6 +24,10 @@
 #include "Settings.h"
 #include "Params.h"
 #include "OutputParams.h"
+#include "OutputFileParams.h"
+#include "RenderParams.h"
+#include "OutputFileNameGenerator.h"
+#include "Utils.h"
 #include "ProjectReader.h"
 #include "ProjectWriter.h"
 #include "CacheDrivenTask.h"
@@ -32,10 +36,13 @@
 #include <QCoreApplication>
 #include <QDomDocument>
 #include <QDomElement>
+#include <QDir>
+#include <QFileInfo>
 #include <memory>
 #include <tiff.h>
 
 #include "CommandLine.h"
+#include "OrderByProcessingTime.h"
 #include "ImageViewTab.h"
 #include "OrderByModeProvider.h"
 #include "OrderBySourceColor.h"
@@ -48,20 +55,17 @@ namespace output
 Filter::Filter(
     IntrusivePtr<ProjectPages> const& pages,
     PageSelectionAccessor const& page_selection_accessor)
-    :   m_ptrPages(pages), m_ptrSettings(new Settings), m_selectedPageOrder(0)
+    :   m_ptrPages(pages), m_ptrSettings(new Settings),
+        m_pageSelectionAccessor(page_selection_accessor), m_selectedPageOrder(0)
 {
-    if (CommandLine::get().isGui()) {
-        m_ptrOptionsWidget.reset(
-            new OptionsWidget(m_ptrSettings, page_selection_accessor)
-        );
-    }
-
     typedef PageOrderOption::ProviderPtr ProviderPtr;
     ProviderPtr const default_order;
     ProviderPtr const order_by_mode(new OrderByModeProvider(m_ptrSettings));
     ProviderPtr const order_by_source_color(new OrderBySourceColor(m_ptrSettings, pages));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Natural order"), default_order));
     m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Processed then unprocessed"), ProviderPtr(new OrderByReadiness())));
+    m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Order by processing time"), ProviderPtr(new OrderByProcessingTime()),
+                                 QObject::tr("Puts the pages that took longest to process first")));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Order by mode"), order_by_mode));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Grayscale sources on top"), order_by_source_color,
                                  tr("Groups the pages by presence\nof a non grey color in the source files")));
@@ -71,6 +75,17 @@ Filter::~Filter()
 {
 }
 
+OptionsWidget*
+Filter::optionsWidget()
+{
+    if (!m_ptrOptionsWidget.get() && CommandLine::get().isGui()) {
+        m_ptrOptionsWidget.reset(
+            new OptionsWidget(m_ptrSettings, m_pageSelectionAccessor)
+        );
+    }
+    return m_ptrOptionsWidget.get();
+}
+
 QString
 Filter::getName() const
 {
@@ -92,8 +107,8 @@ Filter::performRelinking(AbstractRelinker const& relinker)
 void
 Filter::preUpdateUI(FilterUiInterface* ui, PageId const& page_id)
 {
-    m_ptrOptionsWidget->preUpdateUI(page_id);
-    ui->setOptionsWidget(m_ptrOptionsWidget.get(), ui->KEEP_OWNERSHIP);
+    optionsWidget()->preUpdateUI(page_id);
+    ui->setOptionsWidget(optionsWidget(), ui->KEEP_OWNERSHIP);
 }
 
 QDomElement
@@ -195,7 +210,9 @@ Filter::createTask(
     bool const batch, bool const debug,
     bool keep_orig_fore_subscan,
 //Original_Foreground_Mixed
-    QImage* p_orig_fore_subscan)
+    QImage* p_orig_fore_subscan,
+    QImage* p_out_img,
+    imageproc::BinaryImage* p_automask)
 {
     ImageViewTab lastTab(TAB_OUTPUT);
     if (m_ptrOptionsWidget.get() != nullptr) {
@@ -208,7 +225,8 @@ Filter::createTask(
                    lastTab, batch, debug,
                    keep_orig_fore_subscan,
 //Original_Foreground_Mixed
-                   p_orig_fore_subscan
+                   p_orig_fore_subscan,
+                   p_out_img, p_automask
                )
            );
 }
@@ -304,4 +322,35 @@ Filter::getZonesInfo(const PageId& id) const
     return exportZonesInfo(new_picture_zones, new_fill_zones);
 }
 
+bool
+Filter::findAutomaskFile(
+    PageId const& page_id, OutputFileNameGenerator const& out_file_name_gen,
+    QString* automask_file) const
+{
+    automask_file->clear();
+
+    if (!RenderParams(m_ptrSettings->getParams(page_id).colorParams()).mixedOutput()) {
+        return true;
+    }
+
+    std::unique_ptr<OutputParams> const stored_output_params(
+        m_ptrSettings->getOutputParams(page_id)
+    );
+    if (!stored_output_params) {
+        return false;
+    }
+
+    QFileInfo const out_file_info(out_file_name_gen.filePathFor(page_id));
+    QFileInfo const automask_file_info(
+        QDir(Utils::automaskDir(out_file_name_gen.outDir())).absoluteFilePath(out_file_info.fileName())
+    );
+    if (!stored_output_params->outputFileParams().matches(OutputFileParams(out_file_info))
+            || !stored_output_params->automaskFileParams().matches(OutputFileParams(automask_file_info))) {
+        return false;
+    }
+
+    *automask_file = automask_file_info.absoluteFilePath();
+    return true;
+}
+
 } // namespace output
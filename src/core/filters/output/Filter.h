@@ -25,6 +25,7 @@
 #include "IntrusivePtr.h"
 #include "FilterResult.h"
 #include "SafeDeletingQObjectPtr.h"
+#include "PageSelectionAccessor.h"
 #include "PictureZonePropFactory.h"
 #include "FillZonePropFactory.h"
 #include "ProjectPages.h"
@@ -32,11 +33,15 @@
 #include <QImage>
 
 class PageId;
-class PageSelectionAccessor;
 class ThumbnailPixmapCache;
 class OutputFileNameGenerator;
 class QString;
 
+namespace imageproc
+{
+class BinaryImage;
+}
+
 namespace output
 {
 
@@ -78,22 +83,40 @@ public:
                                   //bool batch, bool debug);
                                   bool batch, bool debug,
                                   bool keep_orig_fore_subscan = false,
-                                  QImage* p_orig_fore_subscan = nullptr);
+                                  QImage* p_orig_fore_subscan = nullptr,
+                                  QImage* p_out_img = nullptr,
+                                  imageproc::BinaryImage* p_automask = nullptr);
 //end of modified by monday2000
 
     IntrusivePtr<CacheDrivenTask> createCacheDrivenTask(
         OutputFileNameGenerator const& out_file_name_gen);
 
-    OptionsWidget* optionsWidget()
-    {
-        return m_ptrOptionsWidget.get();
-    }
+    /**
+     * \brief Returns the options widget, creating it on first use.
+     *
+     * Returns null when not running the GUI.  Must only be called
+     * from the GUI thread.
+     */
+    OptionsWidget* optionsWidget();
     Settings* getSettings()
     {
         return m_ptrSettings.get();
     }
     QStringList getZonesInfo(const PageId& id) const;
 
+    /**
+     * \brief Finds the automask written along with the output of a page.
+     *
+     * Returns false if the page has mixed output, but its output or
+     * automask file isn't the one recorded when they were written.
+     * Such a page has to be reprocessed.  Otherwise \p automask_file
+     * receives the automask's path, or an empty string if the page
+     * has none.  Thread-safe.
+     */
+    bool findAutomaskFile(PageId const& page_id,
+                          OutputFileNameGenerator const& out_file_name_gen,
+                          QString* automask_file) const;
+
     virtual std::vector<PageOrderOption> pageOrderOptions() const;
     virtual int selectedPageOrder() const;
     virtual void selectPageOrder(int option);
@@ -104,6 +127,7 @@ private:
 
     IntrusivePtr<ProjectPages> m_ptrPages;
     IntrusivePtr<Settings> m_ptrSettings;
+    PageSelectionAccessor m_pageSelectionAccessor;
     SafeDeletingQObjectPtr<OptionsWidget> m_ptrOptionsWidget;
     PictureZonePropFactory m_pictureZonePropFactory;
     FillZonePropFactory m_fillZonePropFactory;
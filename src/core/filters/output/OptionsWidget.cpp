@@ -271,10 +271,7 @@ OptionsWidget::equalizeIlluminationToggled(bool const checked)
 void
 OptionsWidget::dpiChanged(std::set<PageId> const& pages, Dpi const& dpi)
 {
-    for (PageId const& page_id : pages) {
-        m_ptrSettings->setDpi(page_id, dpi);
-    }
-    emit invalidateAllThumbnails();
+    emit invalidateThumbnails(m_ptrSettings->setDpi(pages, dpi));
 
     if (pages.find(m_pageId) != pages.end()) {
         m_outputDpi = dpi;
@@ -341,10 +338,7 @@ OptionsWidget::handleDespeckleLevelChange(DespeckleLevel const level)
 void
 OptionsWidget::applyDespeckleConfirmed(std::set<PageId> const& pages)
 {
-    for (PageId const& page_id : pages) {
-        m_ptrSettings->setDespeckleLevel(page_id, m_despeckleLevel);
-    }
-    emit invalidateAllThumbnails();
+    emit invalidateThumbnails(m_ptrSettings->setDespeckleLevel(pages, m_despeckleLevel));
 
     if (pages.find(m_pageId) != pages.end()) {
         emit reloadRequested();
@@ -354,10 +348,7 @@ OptionsWidget::applyDespeckleConfirmed(std::set<PageId> const& pages)
 void
 OptionsWidget::dewarpingChanged(std::set<PageId> const& pages, DewarpingMode const& mode)
 {
-    for (PageId const& page_id : pages) {
-        m_ptrSettings->setDewarpingMode(page_id, mode);
-    }
-    emit invalidateAllThumbnails();
+    emit invalidateThumbnails(m_ptrSettings->setDewarpingMode(pages, mode));
 
     if (pages.find(m_pageId) != pages.end()) {
         if (m_dewarpingMode != mode) {
@@ -398,10 +389,7 @@ OptionsWidget::dewarpingChanged(std::set<PageId> const& pages, DewarpingMode con
 void
 OptionsWidget::applyDepthPerceptionConfirmed(std::set<PageId> const& pages)
 {
-    for (PageId const& page_id : pages) {
-        m_ptrSettings->setDepthPerception(page_id, m_depthPerception);
-    }
-    emit invalidateAllThumbnails();
+    emit invalidateThumbnails(m_ptrSettings->setDepthPerception(pages, m_depthPerception));
 
     if (pages.find(m_pageId) != pages.end()) {
         emit reloadRequested();
@@ -33,35 +33,24 @@ OrderByModeProvider::OrderByModeProvider(IntrusivePtr<Settings> const& settings)
 
 bool
 OrderByModeProvider::precedes(
-    PageId const& lhs_page, bool const /*lhs_incomplete*/,
-    PageId const& rhs_page, bool const /*rhs_incomplete*/) const
+    PageId const& lhs_page, bool const lhs_incomplete,
+    PageId const& rhs_page, bool const rhs_incomplete) const
 {
-    ColorParams const lclr_param(m_ptrSettings->getParams(lhs_page).colorParams());
-    ColorParams const rclr_param(m_ptrSettings->getParams(rhs_page).colorParams());
-
-    if (lclr_param.colorMode() != rclr_param.colorMode()) {
-        return lclr_param.colorMode() < rclr_param.colorMode();
-    }
-
-    const ColorGrayscaleOptions& cgoptsl = lclr_param.colorGrayscaleOptions();
-    const ColorGrayscaleOptions& cgoptsr = rclr_param.colorGrayscaleOptions();
-
-    if (cgoptsl.autoLayerEnabled() != cgoptsr.autoLayerEnabled()) {
-        return cgoptsl.autoLayerEnabled() < cgoptsr.autoLayerEnabled();
-    }
-    if (cgoptsl.foregroundLayerEnabled() != cgoptsr.foregroundLayerEnabled()) {
-        return cgoptsl.foregroundLayerEnabled() < cgoptsr.foregroundLayerEnabled();
-    }
-    if (cgoptsl.normalizeIllumination() != cgoptsr.normalizeIllumination()) {
-        return cgoptsl.normalizeIllumination() < cgoptsr.normalizeIllumination();
-    }
-
-    if (lclr_param.blackWhiteOptions().thresholdAdjustment() == rclr_param.blackWhiteOptions().thresholdAdjustment()) {
-        return lhs_page < rhs_page;
-    } else {
-        return lclr_param.blackWhiteOptions().thresholdAdjustment() < rclr_param.blackWhiteOptions().thresholdAdjustment();
-    }
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
 
+bool
+OrderByModeProvider::sortKey(PageId const& page, bool const /*incomplete*/, SortKey& key) const
+{
+    ColorParams const clr_param(m_ptrSettings->getParams(page).colorParams());
+    ColorGrayscaleOptions const& cgopts = clr_param.colorGrayscaleOptions();
+
+    key[0] = clr_param.colorMode();
+    key[1] = cgopts.autoLayerEnabled();
+    key[2] = cgopts.foregroundLayerEnabled();
+    key[3] = cgopts.normalizeIllumination();
+    key[4] = clr_param.blackWhiteOptions().thresholdAdjustment();
+    return true;
 }
 
 QString colorMode2String(ColorParams::ColorMode const mode)
@@ -40,23 +40,25 @@ OrderBySourceColor::OrderBySourceColor(IntrusivePtr<Settings> const& settings, c
 
 bool
 OrderBySourceColor::precedes(
-    PageId const& lhs_page, bool const /*lhs_incomplete*/,
-    PageId const& rhs_page, bool const /*rhs_incomplete*/) const
+    PageId const& lhs_page, bool const lhs_incomplete,
+    PageId const& rhs_page, bool const rhs_incomplete) const
+{
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
+
+bool
+OrderBySourceColor::sortKey(PageId const& page, bool const /*incomplete*/, SortKey& key) const
 {
     if (!sequence_cached) {
         cached_pages_views = m_pages->toPageSequence(PAGE_VIEW);
         sequence_cached = true;
     }
 
-    const bool gs1 = cached_pages_views.pageAt(lhs_page).metadata().isGrayScale();
-    const bool gs2 = cached_pages_views.pageAt(rhs_page).metadata().isGrayScale();
-
-    if (gs1 != gs2) {
-        return gs1 > gs2;
-    } else {
-        return lhs_page < rhs_page;
-    }
-
+    // Grayscale sources go first, then the more colorful the later.
+    ImageMetadata const& metadata = cached_pages_views.pageAt(page).metadata();
+    key[0] = metadata.isGrayScale() ? 0 : 1;
+    key[1] = metadata.saturatedPerMille();
+    return true;
 }
 
 void
@@ -41,6 +41,8 @@ public:
         PageId const& rhs_page, bool rhs_incomplete) const;
 
     virtual QString hint(PageId const& page) const;
+
+    virtual bool sortKey(PageId const& page, bool incomplete, SortKey& key) const;
 private:
     IntrusivePtr<Settings> m_ptrSettings;
     IntrusivePtr<ProjectPages> m_pages;
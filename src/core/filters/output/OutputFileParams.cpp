@@ -31,9 +31,10 @@ OutputFileParams::OutputFileParams()
 {
 }
 
-OutputFileParams::OutputFileParams(QFileInfo const& file_info)
+OutputFileParams::OutputFileParams(QFileInfo const& file_info, QByteArray const& digest)
     :   m_size(-1),
-        m_mtime(0)
+        m_mtime(0),
+        m_digest(digest)
 {
     if (file_info.exists()) {
         m_size = file_info.size();
@@ -51,6 +52,9 @@ OutputFileParams::OutputFileParams(QDomElement const& el)
     if (el.hasAttribute("mtime")) {
         m_mtime = (time_t)el.attribute("mtime").toLongLong();
     }
+    if (el.hasAttribute("digest")) {
+        m_digest = QByteArray::fromHex(el.attribute("digest").toLatin1());
+    }
 }
 
 QDomElement
@@ -60,6 +64,9 @@ OutputFileParams::toXml(QDomDocument& doc, QString const& name) const
         QDomElement el(doc.createElement(name));
         el.setAttribute("size", QString::number(m_size));
         el.setAttribute("mtime", QString::number(m_mtime));
+        if (!m_digest.isEmpty()) {
+            el.setAttribute("digest", QString::fromLatin1(m_digest.toHex()));
+        }
         return el;
     } else {
         return QDomElement();
@@ -73,4 +80,11 @@ OutputFileParams::matches(OutputFileParams const& other) const
            m_size == other.m_size/* && m_mtime == other.m_mtime*/;
 }
 
+bool
+OutputFileParams::holds(QFileInfo const& file_info, QByteArray const& digest) const
+{
+    return !m_digest.isEmpty() && m_digest == digest
+           && matches(OutputFileParams(file_info));
+}
+
 } // namespace output
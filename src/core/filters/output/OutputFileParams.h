@@ -20,6 +20,7 @@
 #define OUTPUT_OUTPUT_FILE_PARAMS_H_
 
 #include <QtGlobal>
+#include <QByteArray>
 #include <time.h>
 
 class QDomDocument;
@@ -37,7 +38,12 @@ class OutputFileParams
 public:
     OutputFileParams();
 
-    explicit OutputFileParams(QFileInfo const& file_info);
+    /**
+     * \param digest What TiffWriter::contentDigest() returned
+     *        for the image written to the file, if known.
+     */
+    explicit OutputFileParams(QFileInfo const& file_info,
+                              QByteArray const& digest = QByteArray());
 
     explicit OutputFileParams(QDomElement const& el);
 
@@ -52,9 +58,23 @@ public:
      * \brief Returns true if it's likely we have two identical files.
      */
     bool matches(OutputFileParams const& other) const;
+
+    /**
+     * \brief Returns true if the file described by \p file_info is
+     *        known to hold an image with the given digest.
+     *
+     * That's used to skip writing files that wouldn't change.
+     */
+    bool holds(QFileInfo const& file_info, QByteArray const& digest) const;
+
+    QByteArray const& digest() const
+    {
+        return m_digest;
+    }
 private:
     qint64 m_size;
     time_t m_mtime;
+    QByteArray m_digest;
 };
 
 } // namespace output
@@ -39,7 +39,9 @@
 #include "dewarping/DistortionModelBuilder.h"
 #include "dewarping/DewarpingPointMapper.h"
 #include "dewarping/RasterDewarper.h"
+#include "dewarping/DewarpingMap.h"
 #include "imageproc/GrayImage.h"
+#include "imageproc/GrayImageView.h"
 #include "imageproc/BinaryImage.h"
 #include "imageproc/BinaryThreshold.h"
 #include "imageproc/Binarize.h"
@@ -61,13 +63,18 @@
 #include "imageproc/PolygonRasterizer.h"
 #include "imageproc/ConnectivityMap.h"
 #include "imageproc/InfluenceMap.h"
+#include "imageproc/Kernels.h"
 #include "config.h"
 #include "settings/globalstaticsettings.h"
+#include "ImageId.h"
+#include "Profiler.h"
+#include "PixelBufferPool.h"
 #ifndef Q_MOC_RUN
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #endif
 #include <QImage>
+#include <QPixelFormat>
 #include <QSize>
 #include <QPoint>
 #include <QRect>
@@ -81,11 +88,27 @@
 #include <QBrush>
 #include <QtGlobal>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QDataStream>
+#include <QDomDocument>
+#include <QDomElement>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QVector>
+#include <QTransform>
+#include <QMutex>
+#include <QMutexLocker>
 #include <Qt>
 #include <vector>
+#include <list>
+#include <iostream>
+#include <sstream>
 #include <memory>
 #include <new>
 #include <algorithm>
+#include <utility>
 #include <assert.h>
 #include <string.h>
 #include <stdint.h>
@@ -103,6 +126,26 @@ namespace output
 namespace
 {
 
+/**
+ * Creates an uninitialized image backed by a PixelBufferPool buffer,
+ * for it to be pooled and accounted like the intermediate images.
+ */
+QImage pooledImage(QSize const& size, QImage::Format const format)
+{
+    int const bits_per_line = size.width() * QImage::toPixelFormat(format).bitsPerPixel();
+    int const stride = ((bits_per_line + 31) >> 5) << 2;
+    void* const buffer = PixelBufferPool::allocate(size_t(stride) * size.height());
+    QImage image(
+        static_cast<uchar*>(buffer), size.width(), size.height(),
+        stride, format, &PixelBufferPool::release, buffer
+    );
+    if (image.isNull()) {
+        PixelBufferPool::release(buffer);
+        throw std::bad_alloc();
+    }
+    return image;
+}
+
 struct RaiseAboveBackground {
     static uint8_t transform(uint8_t src, uint8_t dst)
     {
@@ -127,6 +170,71 @@ struct CombineInverted {
     }
 };
 
+/**
+ * Stretches the range of gray levels the way stretchGrayRange() does
+ * and combines the 3x3 erosion and dilation of the result with
+ * CombineInverted, all in one pass over the image and without
+ * any intermediate images.  The stretching mapping is monotonic,
+ * so it's applied to the darkest and lightest pixels of each
+ * neighbourhood rather than to the source.
+ */
+GrayImage stretchedGrayGradient(
+    GrayImage const& src, double const black_clip_fraction,
+    double const white_clip_fraction)
+{
+    if (src.isNull()) {
+        return GrayImage();
+    }
+
+    uint8_t mapping[256];
+    stretchGrayRangeMapping(src, mapping, black_clip_fraction, white_clip_fraction);
+
+    int const width = src.width();
+    int const height = src.height();
+    GrayImage dst(src.size());
+
+    uint8_t const* const src_data = src.data();
+    int const src_stride = src.stride();
+    uint8_t* dst_line = dst.data();
+    int const dst_stride = dst.stride();
+
+    // Column-wise minimums and maximums over the lines of a 3x3 window.
+    // Pixels outside the image don't affect the result, the same as
+    // with the surroundings we used to pass to erodeGray() and dilateGray().
+    std::vector<uint8_t> darkest(width);
+    std::vector<uint8_t> lightest(width);
+
+    for (int y = 0; y < height; ++y, dst_line += dst_stride) {
+        int const top = std::max(y - 1, 0);
+        int const bottom = std::min(y + 1, height - 1);
+
+        uint8_t const* line = src_data + top * src_stride;
+        std::copy(line, line + width, darkest.begin());
+        std::copy(line, line + width, lightest.begin());
+        for (int yy = top + 1; yy <= bottom; ++yy) {
+            line += src_stride;
+            for (int x = 0; x < width; ++x) {
+                darkest[x] = std::min(darkest[x], line[x]);
+                lightest[x] = std::max(lightest[x], line[x]);
+            }
+        }
+
+        for (int x = 0; x < width; ++x) {
+            int const left = std::max(x - 1, 0);
+            int const right = std::min(x + 1, width - 1);
+            uint8_t darker = darkest[left];
+            uint8_t lighter = lightest[left];
+            for (int xx = left + 1; xx <= right; ++xx) {
+                darker = std::min(darker, darkest[xx]);
+                lighter = std::max(lighter, lightest[xx]);
+            }
+            dst_line[x] = CombineInverted::transform(mapping[lighter], mapping[darker]);
+        }
+    }
+
+    return dst;
+}
+
 /**
  * In picture areas we make sure we don't use pure black and pure white colors.
  * These are reserved for text areas.  This behaviour makes it possible to
@@ -163,17 +271,25 @@ uint8_t reserveBlackAndWhite(uint8_t color)
     }
 }
 
+inline void reserveBlackAndWhiteLine(uint8_t* line, int width)
+{
+    Kernels::active().reserveBlackAndWhiteGray(line, width);
+}
+
+inline void reserveBlackAndWhiteLine(uint32_t* line, int width)
+{
+    Kernels::active().reserveBlackAndWhiteRgb(line, width);
+}
+
 template<typename PixelType>
 void reserveBlackAndWhite(QSize size, int stride, PixelType* data)
 {
     int const width = size.width();
     int const height = size.height();
 
-    PixelType* line = data;
-    for (int y = 0; y < height; ++y, line += stride) {
-        for (int x = 0; x < width; ++x) {
-            line[x] = reserveBlackAndWhite<PixelType>(line[x]);
-        }
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; ++y) {
+        reserveBlackAndWhiteLine(data + y * stride, width);
     }
 }
 
@@ -199,45 +315,99 @@ void reserveBlackAndWhite(QImage& img)
  * The \p MixedPixel type is uint8_t for Indexed8 grayscale and uint32_t
  * for RGB32 and ARGB32.
  */
+inline void combineMixedLine(
+    uint8_t* mixed, uint32_t const* bw_content, uint32_t const* bw_mask, int width)
+{
+    Kernels::active().combineMixedGray(mixed, bw_content, bw_mask, width);
+}
+
+inline void combineMixedLine(
+    uint32_t* mixed, uint32_t const* bw_content, uint32_t const* bw_mask, int width)
+{
+    Kernels::active().combineMixedRgb(mixed, bw_content, bw_mask, width);
+}
+
 template<typename MixedPixel>
 void combineMixed(
     QImage& mixed, BinaryImage const& bw_content,
     BinaryImage const& bw_mask)
 {
-    MixedPixel* mixed_line = reinterpret_cast<MixedPixel*>(mixed.bits());
+    MixedPixel* const mixed_data = reinterpret_cast<MixedPixel*>(mixed.bits());
     int const mixed_stride = mixed.bytesPerLine() / sizeof(MixedPixel);
-    uint32_t const* bw_content_line = bw_content.data();
+    uint32_t const* const bw_content_data = bw_content.data();
     int const bw_content_stride = bw_content.wordsPerLine();
-    uint32_t const* bw_mask_line = bw_mask.data();
+    uint32_t const* const bw_mask_data = bw_mask.data();
     int const bw_mask_stride = bw_mask.wordsPerLine();
     int const width = mixed.width();
     int const height = mixed.height();
-    uint32_t const msb = uint32_t(1) << 31;
 
+    #pragma omp parallel for schedule(static)
     for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            if (bw_mask_line[x >> 5] & (msb >> (x & 31))) {
-                // B/W content.
+        combineMixedLine(
+            mixed_data + y * mixed_stride, bw_content_data + y * bw_content_stride,
+            bw_mask_data + y * bw_mask_stride, width
+        );
+    }
+}
 
-                uint32_t tmp = bw_content_line[x >> 5];
-                tmp >>= (31 - (x & 31));
-                tmp &= uint32_t(1);
-                // Now it's 0 for white and 1 for black.
+/**
+ * Zone masks get re-applied every time a page is output, while zones
+ * rarely change.  Rasterized spans of the last few are kept around.
+ */
+int const MAX_CACHED_ZONE_MASKS = 8;
 
-                --tmp; // 0 becomes 0xffffffff and 1 becomes 0.
+typedef std::pair<QByteArray, std::shared_ptr<PolygonRasterizer::Spans const> > ZoneMaskEntry;
 
-                tmp |= 0xff000000; // Force opacity.
+QMutex zoneMaskCacheMutex;
+std::list<ZoneMaskEntry> zoneMaskCache;
 
-                mixed_line[x] = static_cast<MixedPixel>(tmp);
-            } else {
-                // Non-B/W content.
-                mixed_line[x] = reserveBlackAndWhite<MixedPixel>(mixed_line[x]);
+/**
+ * \brief Rasterizes \p fill_ops for a mask of size \p mask_size,
+ *        reusing the result of an earlier call with the same arguments.
+ *
+ * The ops are already in mask coordinates, so they capture both
+ * the zones and the transformation.
+ */
+std::shared_ptr<PolygonRasterizer::Spans const>
+cachedZoneMaskSpans(
+    QSize const& mask_size, std::vector<PolygonRasterizer::BinaryFillOp> const& fill_ops)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    {
+        QByteArray data;
+        QDataStream strm(&data, QIODevice::WriteOnly);
+        strm << mask_size;
+        for (PolygonRasterizer::BinaryFillOp const& op : fill_ops) {
+            strm << op.poly << int(op.color) << int(op.fillRule);
+        }
+        hash.addData(data);
+    }
+    QByteArray const key(hash.result());
+
+    {
+        QMutexLocker const locker(&zoneMaskCacheMutex);
+        for (std::list<ZoneMaskEntry>::iterator it = zoneMaskCache.begin();
+                it != zoneMaskCache.end(); ++it) {
+            if (it->first == key) {
+                zoneMaskCache.splice(zoneMaskCache.begin(), zoneMaskCache, it);
+                return it->second;
             }
         }
-        mixed_line += mixed_stride;
-        bw_content_line += bw_content_stride;
-        bw_mask_line += bw_mask_stride;
     }
+
+    std::shared_ptr<PolygonRasterizer::Spans const> const spans(
+        std::make_shared<PolygonRasterizer::Spans>(
+            PolygonRasterizer::rasterize(mask_size, fill_ops)
+        )
+    );
+
+    QMutexLocker const locker(&zoneMaskCacheMutex);
+    zoneMaskCache.push_front(ZoneMaskEntry(key, spans));
+    if (int(zoneMaskCache.size()) > MAX_CACHED_ZONE_MASKS) {
+        zoneMaskCache.pop_back();
+    }
+
+    return spans;
 }
 
 } // anonymous namespace
@@ -300,7 +470,8 @@ OutputGenerator::process(
     imageproc::BinaryImage* speckles_image,
     DebugImages* const dbg,
     PageId* p_pageId,
-    IntrusivePtr<Settings>* p_settings
+    IntrusivePtr<Settings>* p_settings,
+    QImage* fill_zone_layer
 ) const
 {
     QImage image(
@@ -309,7 +480,7 @@ OutputGenerator::process(
             dewarping_mode, distortion_model, depth_perception,
             keep_orig_fore_subscan,
             auto_layer_mask, speckles_image, dbg,
-            p_pageId, p_settings
+            p_pageId, p_settings, fill_zone_layer
         )
     );
     assert(!image.isNull());
@@ -322,6 +493,56 @@ OutputGenerator::process(
     return image;
 }
 
+QImage
+OutputGenerator::applyFillZones(QImage const& fill_zone_layer, ZoneSet const& fill_zones) const
+{
+    QImage image;
+    if (fill_zone_layer.format() == QImage::Format_Mono) {
+        BinaryImage bw_image(fill_zone_layer);
+        applyFillZonesInPlace(bw_image, fill_zones);
+        image = bw_image.toQImage();
+    } else {
+        // A grayscale layer may come back from the cache in a different
+        // format, while the output is expected to be palettized.
+        image = fill_zone_layer.isGrayscale() ? toGrayscale(fill_zone_layer) : fill_zone_layer;
+        applyFillZonesInPlace(image, fill_zones);
+        if (!RenderParams(m_colorParams).whiteMargins()) {
+            // That's what processAsIs() does after applying fill zones.
+            reserveBlackAndWhite(image);
+        }
+    }
+
+    Dpm const output_dpm(m_dpi);
+    image.setDotsPerMeterX(output_dpm.horizontal());
+    image.setDotsPerMeterY(output_dpm.vertical());
+
+    return image;
+}
+
+IntermediateCache::Key
+OutputGenerator::fillZoneLayerKey(
+    ImageId const& image_id, ZoneSet const& picture_zones,
+    DewarpingMode const dewarping_mode, DistortionModel const& distortion_model) const
+{
+    QDomDocument doc;
+    QDomElement el(doc.createElement("layer"));
+    el.appendChild(m_colorParams.toXml(doc, "color-params"));
+    el.appendChild(picture_zones.toXml(doc, "picture-zones"));
+    doc.appendChild(el);
+
+    IntermediateCache::Key key(image_id, "output_fill_zone_layer");
+    key.add(int(dewarping_mode)).add(int(distortion_model.isValid()))
+    .add(m_xform.transform()).add(m_xform.resultingPreCropArea())
+    .add(m_outRect).add(m_contentRect)
+    .add(m_dpi.horizontal()).add(m_dpi.vertical())
+    .add(int(m_despeckleLevel))
+    .add(int(GlobalStaticSettings::m_disable_bw_smoothing))
+    .add(double(GlobalStaticSettings::m_picture_detection_sensitivity))
+    .add(int(CommandLine::get().hasTiffForceKeepColorSpace()))
+    .add(doc.toByteArray());
+    return key;
+}
+
 QSize
 OutputGenerator::outputImageSize() const
 {
@@ -334,6 +555,27 @@ OutputGenerator::outputContentRect() const
     return m_contentRect;
 }
 
+QString
+OutputGenerator::autoDistortionModelKey(ImageId const& image_id) const
+{
+    QFileInfo const file_info(image_id.filePath());
+
+    QByteArray data;
+    {
+        QDataStream strm(&data, QIODevice::WriteOnly);
+        strm << image_id.filePath() << qint32(image_id.page());
+        strm << qint64(file_info.size()) << file_info.lastModified();
+        strm << m_xform.transform() << m_xform.resultingPreCropArea();
+        strm << m_contentRect;
+        strm << qint32(m_dpi.horizontal()) << qint32(m_dpi.vertical());
+        strm << RenderParams(m_colorParams).normalizeIllumination();
+        strm << GlobalStaticSettings::m_dewarpAutoVertHalfCorrection;
+        strm << GlobalStaticSettings::m_dewarpPyramidEdgeTracing;
+    }
+
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+}
+
 GrayImage
 OutputGenerator::normalizeIlluminationGray(
     TaskStatus const& status,
@@ -341,6 +583,8 @@ OutputGenerator::normalizeIlluminationGray(
     QTransform const& xform, QRect const& target_rect,
     GrayImage* background, DebugImages* const dbg)
 {
+    Profiler::Scope const profile_scope("normalize_illumination");
+
     GrayImage to_be_normalized(
         transformToGray(
             input, xform, target_rect, OutsidePixels::assumeWeakNearest()
@@ -388,35 +632,21 @@ OutputGenerator::estimateBinarizationMask(
     QRect const& source_rect, QRect const& source_sub_rect,
     DebugImages* const dbg) const
 {
+    Profiler::Scope const profile_scope("binarization_mask");
+
     assert(source_rect.contains(source_sub_rect));
 
     // If we need to strip some of the margins from a grayscale
     // image, we may actually do it without copying anything.
-    // We are going to construct a QImage from existing data.
-    // That image won't own that data, but gray_source is not
-    // going anywhere, so it's fine.
-
-    GrayImage trimmed_image;
-
-    if (source_rect == source_sub_rect) {
-        trimmed_image = gray_source; // Shallow copy.
-    } else {
-        // Sub-rectangle in input image coordinates.
-        QRect relative_subrect(source_sub_rect);
-        relative_subrect.moveTopLeft(
-            source_sub_rect.topLeft() - source_rect.topLeft()
-        );
+    // gray_source is not going anywhere, so a view into it is fine.
 
-        int const stride = gray_source.stride();
-        int const offset = relative_subrect.top() * stride
-                           + relative_subrect.left();
+    // Sub-rectangle in input image coordinates.
+    QRect relative_subrect(source_sub_rect);
+    relative_subrect.moveTopLeft(
+        source_sub_rect.topLeft() - source_rect.topLeft()
+    );
 
-        trimmed_image = GrayImage(QImage(
-                                      gray_source.data() + offset,
-                                      relative_subrect.width(), relative_subrect.height(),
-                                      stride, QImage::Format_Indexed8
-                                  ));
-    }
+    GrayImageView const trimmed_image(gray_source, relative_subrect);
 
     status.throwIfCancelled();
 
@@ -424,9 +654,10 @@ OutputGenerator::estimateBinarizationMask(
 
     // A 300dpi version of trimmed_image.
     GrayImage downscaled_input(
-        scaleToGray(trimmed_image, downscaled_size)
+        source_rect == source_sub_rect
+        ? scaleToGray(gray_source, downscaled_size) // May be a shallow copy.
+        : scaleToGray(trimmed_image, downscaled_size)
     );
-    trimmed_image = GrayImage(); // Save memory.
 
     status.throwIfCancelled();
 
@@ -459,13 +690,17 @@ OutputGenerator::modifyBinarizationMask(
 
     typedef PictureLayerProperty PLP;
 
+    // The passes are collected into a batch that's rasterized once
+    // and cached, then painted onto the mask run by run.
+    std::vector<PolygonRasterizer::BinaryFillOp> fill_ops;
+
     // Pass 1: ERASER1
     if (filter & BINARIZATION_MASK_ERASER1) {
         for (Zone const& zone : zones) {
             if (zone.properties().locateOrDefault<PLP>()->layer() == PLP::ERASER1) {
                 if (zone.type() == Zone::SplineType) {
                     QPolygonF const poly(zone.spline().toPolygon());
-                    PolygonRasterizer::fill(bw_mask, BLACK, xform.map(poly), Qt::WindingFill);
+                    fill_ops.push_back(PolygonRasterizer::BinaryFillOp(xform.map(poly), BLACK, Qt::WindingFill));
                 } else if (zone.type() == Zone::EllipseType) {
                     QPainterPath path;
                     QTransform t;
@@ -475,7 +710,9 @@ OutputGenerator::modifyBinarizationMask(
                     path.addEllipse(zone.ellipse().center(), zone.ellipse().rx(), zone.ellipse().ry());
                     path = t.map(path);
 //                    path = xform.map(path);
-                    PolygonRasterizer::fill(bw_mask, BLACK, xform.map(path.toFillPolygon()), Qt::WindingFill);
+                    fill_ops.push_back(
+                        PolygonRasterizer::BinaryFillOp(xform.map(path.toFillPolygon()), BLACK, Qt::WindingFill)
+                    );
                 }
             }
         }
@@ -487,7 +724,7 @@ OutputGenerator::modifyBinarizationMask(
             if (zone.properties().locateOrDefault<PLP>()->layer() == PLP::PAINTER2) {
                 if (zone.type() == Zone::SplineType) {
                     QPolygonF const poly(zone.spline().toPolygon());
-                    PolygonRasterizer::fill(bw_mask, WHITE, xform.map(poly), Qt::WindingFill);
+                    fill_ops.push_back(PolygonRasterizer::BinaryFillOp(xform.map(poly), WHITE, Qt::WindingFill));
                 } else if (zone.type() == Zone::EllipseType) {
                     QPainterPath path;
                     QTransform t;
@@ -497,7 +734,9 @@ OutputGenerator::modifyBinarizationMask(
                     path.addEllipse(zone.ellipse().center(), zone.ellipse().rx(), zone.ellipse().ry());
                     path = t.map(path);
 //                    path = xform.map(path);
-                    PolygonRasterizer::fill(bw_mask, WHITE, xform.map(path.toFillPolygon()), Qt::WindingFill);
+                    fill_ops.push_back(
+                        PolygonRasterizer::BinaryFillOp(xform.map(path.toFillPolygon()), WHITE, Qt::WindingFill)
+                    );
                 }
             }
         }
@@ -509,7 +748,7 @@ OutputGenerator::modifyBinarizationMask(
             if (zone.properties().locateOrDefault<PLP>()->layer() == PLP::ERASER3) {
                 if (zone.type() == Zone::SplineType) {
                     QPolygonF const poly(zone.spline().toPolygon());
-                    PolygonRasterizer::fill(bw_mask, BLACK, xform.map(poly), Qt::WindingFill);
+                    fill_ops.push_back(PolygonRasterizer::BinaryFillOp(xform.map(poly), BLACK, Qt::WindingFill));
                 } else if (zone.type() == Zone::EllipseType) {
                     QPainterPath path;
                     QTransform t;
@@ -519,11 +758,19 @@ OutputGenerator::modifyBinarizationMask(
                     path.addEllipse(zone.ellipse().center(), zone.ellipse().rx(), zone.ellipse().ry());
                     path = t.map(path);
 //                    path = xform.map(path);
-                    PolygonRasterizer::fill(bw_mask, BLACK, xform.map(path.toFillPolygon()), Qt::WindingFill);
+                    fill_ops.push_back(
+                        PolygonRasterizer::BinaryFillOp(xform.map(path.toFillPolygon()), BLACK, Qt::WindingFill)
+                    );
                 }
             }
         }
     }
+
+    if (fill_ops.empty()) {
+        return;
+    }
+
+    PolygonRasterizer::fill(bw_mask, *cachedZoneMaskSpans(bw_mask.size(), fill_ops));
 }
 
 QImage
@@ -541,7 +788,8 @@ OutputGenerator::processImpl(
     imageproc::BinaryImage* speckles_image,
     DebugImages* const dbg,
     PageId* p_pageId,
-    IntrusivePtr<Settings>* p_settings
+    IntrusivePtr<Settings>* p_settings,
+    QImage* fill_zone_layer
 ) const
 {
     RenderParams const render_params(m_colorParams);
@@ -569,6 +817,12 @@ OutputGenerator::processImpl(
                           );
     }
 
+    // Blank pages, typically versos, come out white whatever the mode,
+    // unless there are picture zones to keep.
+    if (m_contentRect.isEmpty() && render_params.whiteMargins() && picture_zones.empty()) {
+        return processBlankPage(fill_zones, auto_layer_mask, fill_zone_layer);
+    }
+
     if (dewarping_mode == DewarpingMode::AUTO ||
 //begin of modified by monday2000
 //Marginal_Dewarping
@@ -584,26 +838,68 @@ OutputGenerator::processImpl(
                );
     } else if (!render_params.whiteMargins()) {
         return processAsIs(
-                   input, status, fill_zones, depth_perception, dbg
+                   input, status, fill_zones, depth_perception, dbg,
+                   fill_zone_layer
                );
     } else {
         return processWithoutDewarping(
                    status, input, picture_zones, fill_zones,
                    auto_layer_mask, speckles_image, dbg,
-                   p_pageId, p_settings
+                   p_pageId, p_settings, fill_zone_layer
                );
     }
 }
 
+QImage
+OutputGenerator::processBlankPage(
+    ZoneSet const& fill_zones, imageproc::BinaryImage* auto_layer_mask,
+    QImage* fill_zone_layer) const
+{
+    Profiler::Scope const profile_scope("blank_page");
+
+    RenderParams const render_params(m_colorParams);
+    QSize const target_size(m_outRect.size().expandedTo(QSize(1, 1)));
+
+    if (auto_layer_mask) {
+        // Nothing on the page is a picture.
+        BinaryImage(target_size, BLACK).swap(*auto_layer_mask);
+    }
+
+    if (render_params.binaryOutput()) {
+        BinaryImage dst(target_size, WHITE);
+        if (fill_zone_layer) {
+            *fill_zone_layer = dst.toQImage();
+        }
+        applyFillZonesInPlace(dst, fill_zones);
+        return dst.toQImage();
+    }
+
+    QImage dst(pooledImage(target_size, QImage::Format_Indexed8));
+    dst.setColorTable(createGrayscalePalette());
+    if (dst.isNull()) {
+        throw std::bad_alloc();
+    }
+    // White.  0xff is reserved if in "Color / Grayscale" mode.
+    dst.fill(render_params.mixedOutput() ? 0xff : 0xfe);
+
+    if (fill_zone_layer) {
+        *fill_zone_layer = dst;
+    }
+    applyFillZonesInPlace(dst, fill_zones);
+    return dst;
+}
+
 QImage
 OutputGenerator::processAsIs(
     FilterData const& input, TaskStatus const& status,
     ZoneSet const& fill_zones,
     DepthPerception const& depth_perception,
-    DebugImages* const dbg) const
+    DebugImages* const dbg, QImage* fill_zone_layer) const
 {
+    Profiler::Scope const profile_scope("as_is");
+
     uint8_t const dominant_gray = reserveBlackAndWhite<uint8_t>(
-                                      calcDominantBackgroundGrayLevel(input.grayImage())
+                                      calcDominantBackgroundGrayLevel(input.grayHistogram())
                                   );
 
     status.throwIfCancelled();
@@ -641,6 +937,10 @@ OutputGenerator::processAsIs(
               );
     }
 
+    if (fill_zone_layer) {
+        *fill_zone_layer = out;
+    }
+
     applyFillZonesInPlace(out, fill_zones);
     reserveBlackAndWhite(out);
 
@@ -653,9 +953,12 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
         imageproc::BinaryImage* auto_layer_mask,
         imageproc::BinaryImage* speckles_image,
         DebugImages* dbg, PageId* p_pageId,
-        IntrusivePtr<Settings>* p_settings
+        IntrusivePtr<Settings>* p_settings,
+        QImage* fill_zone_layer
                                         ) const
 {
+    Profiler::Scope const profile_scope("no_dewarping");
+
     RenderParams const render_params(m_colorParams);
     const bool suppress_smoothing = GlobalStaticSettings::m_disable_bw_smoothing &&
                                     (m_colorParams.colorMode() == ColorParams::BLACK_AND_WHITE);
@@ -725,9 +1028,20 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
 
     QImage maybe_smoothed;
 
+    bool const binary_output = render_params.binaryOutput() || m_outRect.isEmpty();
+
     // We only do smoothing if we are going to do binarization later.
     if (!render_params.needBinarization() || suppress_smoothing) {
         maybe_smoothed = maybe_normalized;
+    } else if (binary_output) {
+        // Only maybe_smoothed is needed from now on, so rather than
+        // having both of them in memory, smooth maybe_normalized in place.
+        maybe_smoothed = std::move(maybe_normalized);
+        maybe_normalized = QImage();
+        smoothToGrayscaleInPlace(maybe_smoothed, m_dpi);
+        if (dbg) {
+            dbg->add(maybe_smoothed, "smoothed");
+        }
     } else {
         maybe_smoothed =  smoothToGrayscale(maybe_normalized, m_dpi);
         if (dbg) {
@@ -737,7 +1051,10 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
 
     status.throwIfCancelled();
 
-    if (render_params.binaryOutput() || m_outRect.isEmpty()) {
+    if (binary_output) {
+        // Only maybe_smoothed is needed from now on.
+        maybe_normalized = QImage(); // Save memory.
+
         BinaryImage dst(m_outRect.size().expandedTo(QSize(1, 1)), WHITE);
 
         if (!m_contentRect.isEmpty()) {
@@ -774,6 +1091,10 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
             );
         }
 
+        if (fill_zone_layer) {
+            *fill_zone_layer = dst.toQImage();
+        }
+
         applyFillZonesInPlace(dst, fill_zones);
         return dst.toQImage();
     }
@@ -888,7 +1209,7 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
                   );
             status.throwIfCancelled();
         }
-        maybe_normalized = tmp;
+        maybe_normalized = std::move(tmp);
         if (dbg) {
             dbg->add(maybe_normalized, "norm_illum_color");
         }
@@ -974,15 +1295,17 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
             }
             bw_mask.invert();
 
-            BinaryImage new_auto_layer_mask = bw_mask;
+            BinaryImage new_auto_layer_mask;
             if (render_params.autoLayer()) {
-                rasterOp<RopAnd<RopSrc, RopDst> >(new_auto_layer_mask, bw_auto_layer_mask);
+                new_auto_layer_mask = BinaryImage(bw_mask.size());
+                rasterOp<RopAnd<RopSrc, RopSrc2> >(new_auto_layer_mask, bw_mask, bw_auto_layer_mask);
 
                 modifyBinarizationMask(bw_auto_layer_mask, small_margins_rect, picture_zones, BINARIZATION_MASK_ERASER1 | BINARIZATION_MASK_PAINTER2);
                 rasterOp<RopAnd<RopSrc, RopDst> >(bw_mask, bw_auto_layer_mask);
                 modifyBinarizationMask(bw_mask, small_margins_rect, picture_zones, BINARIZATION_MASK_ERASER3);
                 bw_auto_layer_mask.release();
             } else {
+                new_auto_layer_mask = bw_mask;
                 // apply all zones directly to color layer mask as we have no autolayer.
                 modifyBinarizationMask(bw_mask, small_margins_rect, picture_zones);
             }
@@ -1013,7 +1336,7 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
     status.throwIfCancelled();
 
     assert(!target_size.isEmpty());
-    QImage dst(target_size, maybe_normalized.format());
+    QImage dst(pooledImage(target_size, maybe_normalized.format()));
 
     if (maybe_normalized.format() == QImage::Format_Indexed8) {
         dst.setColorTable(createGrayscalePalette());
@@ -1036,6 +1359,11 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
         QRect const dst_rect(m_contentRect);
         drawOver(dst, dst_rect, maybe_normalized, src_rect);
     }
+    maybe_normalized = QImage(); // Save memory.
+
+    if (fill_zone_layer) {
+        *fill_zone_layer = dst;
+    }
 
     applyFillZonesInPlace(dst, fill_zones);
     return dst;
@@ -1055,6 +1383,8 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
                                       IntrusivePtr<Settings>* p_settings
                                      ) const
 {
+    Profiler::Scope const profile_scope("dewarping");
+
     QSize const target_size(m_outRect.size().expandedTo(QSize(1, 1)));
     if (m_outRect.isEmpty()) {
         return BinaryImage(target_size, WHITE).toQImage();
@@ -1141,7 +1471,7 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
         } else {
             normalized_original = input.grayImage();
         }
-        if (dewarping_mode == DewarpingMode::AUTO
+        if ((dewarping_mode == DewarpingMode::AUTO && !distortion_model.isValid())
                 || dewarping_mode == DewarpingMode::MARGINAL
                 || render_params.mixedOutput()
            ) {
@@ -1278,7 +1608,8 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
         }
     }
 
-    if (dewarping_mode == DewarpingMode::AUTO) {
+    if (dewarping_mode == DewarpingMode::AUTO && !distortion_model.isValid()) {
+        // A valid model here is an up to date one from a previous run.
         DistortionModelBuilder model_builder(Vec2d(0, 1));
 
         QRect const content_rect(
@@ -1291,7 +1622,9 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
 
         TopBottomEdgeTracer::trace(
             input.grayImage(), model_builder.verticalBounds(),
-            model_builder, status, dbg
+            model_builder, status, dbg,
+            GlobalStaticSettings::m_dewarpPyramidEdgeTracing
+            ? TopBottomEdgeTracer::MODE_PYRAMID : TopBottomEdgeTracer::MODE_SINGLE_LEVEL
         );
 
         distortion_model = model_builder.tryBuildModel(dbg, &input.grayImage().toQImage());
@@ -1539,23 +1872,34 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
     QColor bg_color(Qt::white);
     if (!render_params.whiteMargins()) {
         uint8_t const dominant_gray = reserveBlackAndWhite<uint8_t>(
-                                          calcDominantBackgroundGrayLevel(input.grayImage())
+                                          calcDominantBackgroundGrayLevel(input.grayHistogram())
                                       );
         bg_color = QColor(dominant_gray, dominant_gray, dominant_gray);
     }
 
+    // The residual skew is folded into the dewarping map, so that
+    // every layer gets rotated the same way without a second resampling.
+    double deskew_angle = 0.0;
     QImage dewarped;
     try {
+        deskew_angle = residualSkewAngle(
+                           normalized_original, distortion_model,
+                           depth_perception, dewarping_mode
+                       );
         dewarped = dewarp(
                        QTransform(), normalized_original, m_xform.transform(),
-                       distortion_model, depth_perception, bg_color
+                       distortion_model, depth_perception, bg_color, deskew_angle
                    );
     } catch (std::runtime_error const&) {
         // Probably an impossible distortion model.  Let's fall back to a trivial one.
         setupTrivialDistortionModel(distortion_model);
+        deskew_angle = residualSkewAngle(
+                           normalized_original, distortion_model,
+                           depth_perception, dewarping_mode
+                       );
         dewarped = dewarp(
                        QTransform(), normalized_original, m_xform.transform(),
-                       distortion_model, depth_perception, bg_color
+                       distortion_model, depth_perception, bg_color, deskew_angle
                    );
     }
     normalized_original = QImage(); // Save memory.
@@ -1582,8 +1926,17 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
             m_xform.transform(), m_contentRect
         )
     );
+    QTransform deskew_xform;
+    if (deskew_angle != 0.0) {
+        QPointF const center(m_outRect.width() / 2, m_outRect.height() / 2);
+        deskew_xform.translate(center.x(), center.y());
+        deskew_xform.rotate(-deskew_angle);
+        deskew_xform.translate(-center.x(), -center.y());
+    }
     boost::function<QPointF(QPointF const&)> const orig_to_output(
-        boost::bind(&DewarpingPointMapper::mapToDewarpedSpace, mapper, _1)
+        [mapper, deskew_xform](QPointF const& pt) {
+            return deskew_xform.map(mapper->mapToDewarpedSpace(pt));
+        }
     );
 
     if (render_params.binaryOutput()) {
@@ -1615,13 +1968,7 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
 
         applyFillZonesInPlace(dewarped_bw_content, fill_zones, orig_to_output);
 
-        if (GlobalStaticSettings::m_dewarpAutoDeskewAfterDewarp) {
-            QImage tmp_image(dewarped_bw_content.toQImage());
-            maybe_deskew(&tmp_image, dewarping_mode);
-            return tmp_image.convertToFormat(QImage::Format_Mono);
-        } else {
-            return dewarped_bw_content.toQImage();
-        }
+        return dewarped_bw_content.toQImage();
 //end of modified by monday2000
     }
 
@@ -1646,7 +1993,7 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
             dewarp(
                 orig_to_small_margins, warped_bw_mask.toQImage(),
                 small_margins_to_output, distortion_model,
-                depth_perception, Qt::black
+                depth_perception, Qt::black, deskew_angle
             )
         );
         if (dbg) {
@@ -1689,20 +2036,6 @@ OutputGenerator::processWithDewarping(TaskStatus const& status, FilterData const
 
         status.throwIfCancelled();
 
-        if (GlobalStaticSettings::m_dewarpAutoDeskewAfterDewarp) {
-            double const angle = maybe_deskew(&dewarped, dewarping_mode);
-            if (angle != 0.) {
-                // we deskew img and mask before merging together
-                // to prevent appearence of gray pixels around b/w text if it's roteted
-                QImage tmp_img = dewarped_bw_content.toQImage();
-                do_deskew(&tmp_img, angle);
-                dewarped_bw_content = BinaryImage(tmp_img);
-                tmp_img = dewarped_bw_mask.toQImage();
-                do_deskew(&tmp_img, angle);
-                dewarped_bw_mask = BinaryImage(tmp_img);
-            }
-        }
-
         if (dewarped.format() == QImage::Format_Indexed8) {
             combineMixed<uint8_t>(
                 dewarped, dewarped_bw_content, dewarped_bw_mask
@@ -1781,6 +2114,8 @@ OutputGenerator::createDewarper(
  * \param distortion_model Distortion model.
  * \param depth_perception Depth perception.
  * \param bg_color The color to use for areas outsize of \p src.
+ * \param rotation_deg The angle in degrees to rotate the dewarped image by
+ *                     about its center, as part of dewarping.
  * \param modified_content_rect A vertically shrunk version of outputContentRect().
  *                              See function definition for more details.
  */
@@ -1788,8 +2123,11 @@ QImage
 OutputGenerator::dewarp(
     QTransform const& orig_to_src, QImage const& src,
     QTransform const& src_to_output, DistortionModel const& distortion_model,
-    DepthPerception const& depth_perception, QColor const& bg_color) const
+    DepthPerception const& depth_perception, QColor const& bg_color,
+    double rotation_deg) const
 {
+    Profiler::Scope const profile_scope("dewarp_image");
+
     CylindricalSurfaceDewarper const dewarper(
         createDewarper(distortion_model, orig_to_src, depth_perception.value())
     );
@@ -1807,9 +2145,22 @@ OutputGenerator::dewarp(
         return out;
     }
 
-    return RasterDewarper::dewarp(
-               src, m_outRect.size(), dewarper, model_domain, bg_color
-           );
+    // The map only depends on the distortion model and the geometry,
+    // so it survives changes to colour and threshold settings.
+    QByteArray model_key;
+    {
+        QDataStream strm(&model_key, QIODevice::WriteOnly);
+        strm << QVector<QPointF>::fromStdVector(distortion_model.topCurve().polyline())
+             << QVector<QPointF>::fromStdVector(distortion_model.bottomCurve().polyline())
+             << orig_to_src << depth_perception.value();
+    }
+    std::shared_ptr<DewarpingMap const> const map(
+        DewarpingMap::cached(
+            model_key, dewarper, model_domain, m_outRect.size(), rotation_deg
+        )
+    );
+
+    return RasterDewarper::dewarp(src, *map, bg_color);
 }
 
 QSize
@@ -1882,38 +2233,16 @@ OutputGenerator::detectPictures(
     GrayImage const& input_300dpi, TaskStatus const& status,
     DebugImages* const dbg)
 {
+    Profiler::Scope const profile_scope("picture_detection");
+
     // We stretch the range of gray levels to cover the whole
     // range of [0, 255].  We do it because we want text
     // and background to be equally far from the center
     // of the whole range.  Otherwise text printed with a big
     // font will be considered a picture.
-    GrayImage stretched(stretchGrayRange(input_300dpi, 0.01, 0.01));
-    if (dbg) {
-        dbg->add(stretched, "stretched");
-    }
-
-    status.throwIfCancelled();
-
-    GrayImage eroded(erodeGray(stretched, QSize(3, 3), 0x00));
-    if (dbg) {
-        dbg->add(eroded, "eroded");
-    }
-
-    status.throwIfCancelled();
-
-    GrayImage dilated(dilateGray(stretched, QSize(3, 3), 0xff));
-    if (dbg) {
-        dbg->add(dilated, "dilated");
-    }
-
-    stretched = GrayImage(); // Save memory.
-
-    status.throwIfCancelled();
-
-    grayRasterOp<CombineInverted>(dilated, eroded);
-    GrayImage gray_gradient(dilated);
-    dilated = GrayImage();
-    eroded = GrayImage();
+    // The stretching is fused with the gradient computation,
+    // so the stretched image itself never exists.
+    GrayImage gray_gradient(stretchedGrayGradient(input_300dpi, 0.01, 0.01));
     if (dbg) {
         dbg->add(gray_gradient, "gray_gradient");
     }
@@ -1953,12 +2282,10 @@ OutputGenerator::detectPictures(
     return holes_filled;
 }
 
-QImage
-OutputGenerator::smoothToGrayscale(QImage const& src, Dpi const& dpi)
+void
+OutputGenerator::smoothingWindow(Dpi const& dpi, int& window, int& degree)
 {
     int const min_dpi = std::min(dpi.horizontal(), dpi.vertical());
-    int window;
-    int degree;
     if (min_dpi <= 200) {
         window = 5;
         degree = 3;
@@ -1972,9 +2299,26 @@ OutputGenerator::smoothToGrayscale(QImage const& src, Dpi const& dpi)
         window = 11;
         degree = 2;
     }
+}
+
+QImage
+OutputGenerator::smoothToGrayscale(QImage const& src, Dpi const& dpi)
+{
+    int window;
+    int degree;
+    smoothingWindow(dpi, window, degree);
     return savGolFilter(src, QSize(window, window), degree, degree);
 }
 
+void
+OutputGenerator::smoothToGrayscaleInPlace(QImage& image, Dpi const& dpi)
+{
+    int window;
+    int degree;
+    smoothingWindow(dpi, window, degree);
+    savGolFilterInPlace(image, QSize(window, window), degree, degree);
+}
+
 BinaryThreshold
 OutputGenerator::adjustThreshold(BinaryThreshold threshold, const int* adjustment) const
 {
@@ -2088,6 +2432,8 @@ OutputGenerator::maybeDespeckleInPlace(
     DespeckleLevel const level, BinaryImage* speckles_img,
     Dpi const& dpi, TaskStatus const& status, DebugImages* dbg) const
 {
+    Profiler::Scope const profile_scope("despeckle");
+
     QRect const src_rect(mask_rect.translated(-image_rect.topLeft()));
     QRect const dst_rect(mask_rect);
 
@@ -2113,7 +2459,26 @@ OutputGenerator::maybeDespeckleInPlace(
         default:;
         }
 
-        Despeckle::despeckleInPlace(image, dpi, lvl, status, dbg);
+        // Debug images only make sense for the whole image.
+        bool const tiled = (GlobalStaticSettings::m_despeckle_tiled
+                            || CommandLine::get().isDespeckleTiled()) && !dbg;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if (tiled) {
+            Despeckle::despeckleInPlaceTiled(image, dpi, lvl, status);
+        } else {
+            Despeckle::despeckleInPlace(image, dpi, lvl, status, dbg);
+        }
+
+        if (CommandLine::get().isVerbose()) {
+            // A single write, so that lines from concurrent pages don't mix.
+            std::ostringstream line;
+            line << "\tDespeckle: " << image.width() << "x" << image.height()
+                 << (tiled ? " tiled" : "") << " in " << timer.elapsed() << " ms\n";
+            std::cout << line.str() << std::flush;
+        }
 
         if (dbg) {
             dbg->add(image, "despeckled");
@@ -2129,87 +2494,148 @@ OutputGenerator::maybeDespeckleInPlace(
     }
 }
 
-void
-OutputGenerator::morphologicalSmoothInPlace(
-    BinaryImage& bin_img, TaskStatus const& status)
+namespace
 {
-    // When removing black noise, remove small ones first.
 
+struct SmoothingPattern {
+    char const* pattern;
+    int width;
+    int height;
+};
+
+/**
+ * The patterns morphologicalSmoothInPlace() applies, in this order,
+ * each in all four directions.  When removing black noise,
+ * small ones are removed first.
+ */
+SmoothingPattern const smoothingPatterns[] = {
+    {
+        "XXX"
+        " - "
+        "   ", 3, 3
+    },
+    {
+        "X ?"
+        "X  "
+        "X- "
+        "X- "
+        "X  "
+        "X ?", 3, 6
+    },
+    {
+        "X ?"
+        "X ?"
+        "X  "
+        "X- "
+        "X- "
+        "X- "
+        "X  "
+        "X ?"
+        "X ?", 3, 9
+    },
     {
-        char const pattern[] =
-            "XXX"
-            " - "
-            "   ";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 3);
+        "XX?"
+        "XX?"
+        "XX "
+        "X+ "
+        "X+ "
+        "X+ "
+        "XX "
+        "XX?"
+        "XX?", 3, 9
+    },
+    {
+        "XX?"
+        "XX "
+        "X+ "
+        "X+ "
+        "XX "
+        "XX?", 3, 6
+    },
+    {
+        "   "
+        "X+X"
+        "XXX", 3, 3
     }
+};
 
-    status.throwIfCancelled();
-
-    {
-        char const pattern[] =
-            "X ?"
-            "X  "
-            "X- "
-            "X- "
-            "X  "
-            "X ?";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 6);
+/**
+ * How many lines away a change in the image can propagate during
+ * morphologicalSmoothInPlace().  A single hit-miss replacement pass
+ * changes a pixel based on pixels no further than the pattern height
+ * minus one, the pattern being applied in two vertical and two
+ * horizontal orientations.
+ */
+int smoothingReach()
+{
+    int reach = 0;
+    for (SmoothingPattern const& p : smoothingPatterns) {
+        reach += 2 * (p.height - 1) + 2 * (p.width - 1);
     }
+    return reach;
+}
 
-    status.throwIfCancelled();
+} // anonymous namespace
 
-    {
-        char const pattern[] =
-            "X ?"
-            "X ?"
-            "X  "
-            "X- "
-            "X- "
-            "X- "
-            "X  "
-            "X ?"
-            "X ?";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 9);
+void
+OutputGenerator::morphologicalSmoothInPlace(
+    BinaryImage& bin_img, TaskStatus const& status)
+{
+    // Each replacement pass depends on the result of the previous one,
+    // so they can't be merged.  What can be done is to apply all of them
+    // to a horizontal band at a time, which stays in cache, and to process
+    // bands in parallel.  Every band is extended by enough lines for
+    // the differences at its artificial edges not to reach the lines
+    // it's responsible for, which makes the result the same as if
+    // the whole image was processed at once.
+    int const reach = smoothingReach();
+    int const band_height = std::max(256, reach * 8);
+    int const height = bin_img.height();
+    int const num_bands = height / band_height;
+
+    if (num_bands < 2) {
+        for (SmoothingPattern const& p : smoothingPatterns) {
+            hitMissReplaceAllDirections(bin_img, p.pattern, p.width, p.height);
+            status.throwIfCancelled();
+        }
+        return;
     }
 
-    status.throwIfCancelled();
+    BinaryImage const src(bin_img);
+    BinaryImage dst(src.size());
+    uint32_t const* const src_data = src.data();
+    uint32_t* const dst_data = dst.data();
+    int const wpl = src.wordsPerLine();
 
-    {
-        char const pattern[] =
-            "XX?"
-            "XX?"
-            "XX "
-            "X+ "
-            "X+ "
-            "X+ "
-            "XX "
-            "XX?"
-            "XX?";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 9);
-    }
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_bands; ++i) {
+        if (status.isCancelled()) {
+            continue;
+        }
 
-    status.throwIfCancelled();
+        int const top = i * band_height;
+        // The last band takes the remainder.
+        int const bottom = i == num_bands - 1 ? height : top + band_height;
+        int const ext_top = std::max(0, top - reach);
+        int const ext_bottom = std::min(height, bottom + reach);
 
-    {
-        char const pattern[] =
-            "XX?"
-            "XX "
-            "X+ "
-            "X+ "
-            "XX "
-            "XX?";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 6);
+        BinaryImage band(src.width(), ext_bottom - ext_top);
+        assert(band.wordsPerLine() == wpl);
+        memcpy(band.data(), src_data + ext_top * wpl, (ext_bottom - ext_top) * wpl * 4);
+
+        for (SmoothingPattern const& p : smoothingPatterns) {
+            hitMissReplaceAllDirections(band, p.pattern, p.width, p.height);
+        }
+
+        memcpy(
+            dst_data + top * wpl, band.data() + (top - ext_top) * wpl,
+            (bottom - top) * wpl * 4
+        );
     }
 
     status.throwIfCancelled();
 
-    {
-        char const pattern[] =
-            "   "
-            "X+X"
-            "XXX";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 3);
-    }
+    bin_img = dst;
 }
 
 void
@@ -2284,18 +2710,19 @@ OutputGenerator::calcLocalWindowSize(Dpi const& dpi)
 }
 
 unsigned char
-OutputGenerator::calcDominantBackgroundGrayLevel(QImage const& img)
+OutputGenerator::calcDominantBackgroundGrayLevel(GrayscaleHistogram const& full_hist)
 {
     // TODO: make a color version.
     // In ColorPickupInteraction.cpp we have code for median color finding.
     // We can use that.
 
-    QImage const gray(toGrayscale(img));
-
-    BinaryImage mask(binarizeOtsu(gray));
-    mask.invert();
-
-    GrayscaleHistogram const hist(gray, mask);
+    // Binarizing the image and taking the histogram of its white pixels
+    // would just zero out the levels below the threshold.
+    GrayscaleHistogram hist(full_hist);
+    int const threshold = BinaryThreshold::otsuThreshold(full_hist);
+    for (int i = 0; i < threshold; ++i) {
+        hist[i] = 0;
+    }
 
     int integral_hist[256];
     integral_hist[0] = hist[0];
@@ -2393,12 +2820,14 @@ OutputGenerator::applyFillZonesInPlace(
         return;
     }
 
+    // All the zones are filled in a single pass over the image.
+    std::vector<PolygonRasterizer::BinaryFillOp> fill_ops;
     for (Zone const& zone : zones) {
         QColor const color(zone.properties().locateOrDefault<FillColorProperty>()->color());
         BWColor const bw_color = qGray(color.rgb()) < 128 ? BLACK : WHITE;
         if (zone.type() == Zone::SplineType) {
             QPolygonF const poly(zone.spline().transformed(orig_to_output).toPolygon());
-            PolygonRasterizer::fill(img, bw_color, poly, Qt::WindingFill);
+            fill_ops.push_back(PolygonRasterizer::BinaryFillOp(poly, bw_color, Qt::WindingFill));
         } else if (zone.type() == Zone::EllipseType) {
             const SerializableEllipse e = zone.ellipse().transformed(orig_to_output);
             QPainterPath path;
@@ -2408,9 +2837,13 @@ OutputGenerator::applyFillZonesInPlace(
             t.translate(-e.center().x(), -e.center().y());
             path.addEllipse(e.center(), e.rx(), e.ry());
             path = t.map(path);
-            PolygonRasterizer::fill(img, bw_color, path.toFillPolygon(), Qt::WindingFill);
+            fill_ops.push_back(
+                PolygonRasterizer::BinaryFillOp(path.toFillPolygon(), bw_color, Qt::WindingFill)
+            );
         }
     }
+
+    PolygonRasterizer::fill(img, fill_ops);
 }
 
 /**
@@ -2555,41 +2988,61 @@ OutputGenerator::vert_border_skew_angle(QPointF const& top, QPointF const& botto
     return qFabs(qAtan((bottom.x() - top.x()) / (bottom.y() - top.y())) * 180 / M_PI);
 }
 
+/**
+ * \brief Measures the skew left after dewarping \p normalized_original,
+ *        on a half resolution dewarp of it.
+ *
+ * \return The angle to pass to dewarp(), or 0 if there is no skew to
+ *         correct or it couldn't be measured with confidence.
+ */
 double
-OutputGenerator::maybe_deskew(QImage* p_dewarped, DewarpingMode dewarping_mode) const
+OutputGenerator::residualSkewAngle(
+    QImage const& normalized_original, DistortionModel const& distortion_model,
+    DepthPerception const& depth_perception, DewarpingMode dewarping_mode) const
 {
-    if (dewarping_mode == DewarpingMode::MARGINAL ||
-            dewarping_mode == DewarpingMode::MANUAL) {
-        BinaryThreshold bw_threshold(128);
-        BinaryImage bw_image(*p_dewarped, bw_threshold);
-
-        SkewFinder skew_finder;
-        Skew const skew(skew_finder.findSkew(bw_image));
-        double const angle = skew.angle();
-        if (angle != 0.0 && skew.confidence() >= Skew::GOOD_CONFIDENCE) {
-            do_deskew(p_dewarped, angle);
-        }
-        return angle;
+    if (!GlobalStaticSettings::m_dewarpAutoDeskewAfterDewarp) {
+        return 0.0;
+    }
+    if (dewarping_mode != DewarpingMode::MARGINAL &&
+            dewarping_mode != DewarpingMode::MANUAL) {
+        return 0.0;
     }
 
-    return 0.;
-}
+    Profiler::Scope const profile_scope("residual_skew");
 
-void
-OutputGenerator::do_deskew(QImage* p_image, double angle_deg) const
-{
-    if (angle_deg == 0.) {
-        return;
+    CylindricalSurfaceDewarper const dewarper(
+        createDewarper(distortion_model, QTransform(), depth_perception.value())
+    );
+    QRectF const model_domain(
+        distortion_model.modelDomain(
+            dewarper, m_xform.transform(), outputContentRect()
+        ).toRect()
+    );
+    if (model_domain.isEmpty()) {
+        return 0.0;
     }
 
-    QPointF center(p_image->width() / 2, p_image->height() / 2);
-
-    QTransform rot;
-    rot.translate(center.x(), center.y());
-    rot.rotate(-angle_deg);
-    rot.translate(-center.x(), -center.y());
+    // Dewarping mapping is linear in output coordinates, so halving
+    // the domain and the size gives a half resolution output.
+    QSize const half_size((m_outRect.width() + 1) / 2, (m_outRect.height() + 1) / 2);
+    DewarpingMap const map(
+        dewarper, QRectF(model_domain.topLeft() * 0.5, model_domain.size() * 0.5),
+        half_size
+    );
+    BinaryImage const bw_image(
+        RasterDewarper::dewarp(normalized_original, map, Qt::white),
+        BinaryThreshold(128)
+    );
 
-    *p_image = imageproc::transform(*p_image, rot, p_image->rect(), OutsidePixels::assumeWeakColor(Qt::white));
+    // Area mapping already did one reduction.
+    SkewFinder skew_finder;
+    skew_finder.setCoarseReduction(SkewFinder::DEFAULT_COARSE_REDUCTION - 1);
+    skew_finder.setFineReduction(std::max(0, SkewFinder::DEFAULT_FINE_REDUCTION - 1));
+    Skew const skew(skew_finder.findSkew(bw_image));
+    if (skew.confidence() < Skew::GOOD_CONFIDENCE) {
+        return 0.0;
+    }
+    return skew.angle();
 }
 
 } // namespace output
@@ -27,6 +27,7 @@
 #include "DespeckleLevel.h"
 #include "DewarpingMode.h"
 #include "ImageTransformation.h"
+#include "IntermediateCache.h"
 #ifndef Q_MOC_RUN
 #include <boost/function.hpp>
 #endif
@@ -37,6 +38,7 @@
 #include <QPointF>
 #include <QLineF>
 #include <QPolygonF>
+#include <QString>
 #include <vector>
 #include <utility>
 #include <stdint.h>
@@ -56,6 +58,7 @@
 //end of modified by monday2000
 
 class TaskStatus;
+class ImageId;
 class DebugImages;
 class FilterData;
 class ZoneSet;
@@ -67,6 +70,7 @@ namespace imageproc
 class BinaryImage;
 class BinaryThreshold;
 class GrayImage;
+class GrayscaleHistogram;
 }
 
 namespace dewarping
@@ -119,6 +123,11 @@ public:
      *        to be performed again with different settings, without going
      *        through the whole output generation process again.
      * \param dbg An optional sink for debugging images.
+     * \param fill_zone_layer If provided, the output image as it was before
+     *        applying fill zones will be written there.  It would only happen
+     *        if fill zones are the last thing applied to the output, which is
+     *        not the case with dewarping.  Such an image can then be turned into
+     *        the output again with different fill zones by applyFillZones().
      */
     QImage process(
         TaskStatus const& status, FilterData const& input,
@@ -133,15 +142,45 @@ public:
         imageproc::BinaryImage* auto_picture_mask = 0,
         imageproc::BinaryImage* speckles_image = 0,
         DebugImages* dbg = 0,
-        PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr
+        PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr,
+        QImage* fill_zone_layer = nullptr
     ) const;
 
+    /**
+     * \brief Produces the output image from a fill zone layer,
+     *        written by process() earlier.
+     */
+    QImage applyFillZones(QImage const& fill_zone_layer, ZoneSet const& fill_zones) const;
+
+    /**
+     * \brief Identifies the inputs of a fill zone layer.
+     *
+     * Fill zones themselves don't affect it, while the picture zones do.
+     * The dewarping mode and model are needed to tell which way
+     * the output is produced.
+     */
+    IntermediateCache::Key fillZoneLayerKey(
+        ImageId const& image_id, ZoneSet const& picture_zones,
+        DewarpingMode dewarping_mode,
+        dewarping::DistortionModel const& distortion_model) const;
+
     QSize outputImageSize() const;
 
     /**
      * \brief Returns the content rectangle in output image coordinates.
      */
     QRect outputContentRect() const;
+
+    /**
+     * \brief Identifies the inputs of automatic distortion model detection.
+     *
+     * A model built in DewarpingMode::AUTO may be reused as long as this
+     * key doesn't change.  Colour modes, thresholds and zones don't affect it.
+     *
+     * \param image_id The source image.  Its path, size and modification
+     *        time are taken into account.
+     */
+    QString autoDistortionModelKey(ImageId const& image_id) const;
 private:
 
     QImage processImpl(
@@ -157,14 +196,25 @@ private:
         imageproc::BinaryImage* auto_layer_mask = 0,
         imageproc::BinaryImage* speckles_image = 0,
         DebugImages* dbg = 0,
-        PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr
+        PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr,
+        QImage* fill_zone_layer = nullptr
     ) const;
 
+    /**
+     * \brief Produces the output for a page without content.
+     *
+     * That's a white page of the output size, so none of the source
+     * image has to be transformed, normalized or binarized.
+     */
+    QImage processBlankPage(
+        ZoneSet const& fill_zones, imageproc::BinaryImage* auto_layer_mask,
+        QImage* fill_zone_layer) const;
+
     QImage processAsIs(
         FilterData const& input, TaskStatus const& status,
         ZoneSet const& fill_zones,
         DepthPerception const& depth_perception,
-        DebugImages* dbg = 0) const;
+        DebugImages* dbg = 0, QImage* fill_zone_layer = nullptr) const;
 
     QImage processWithoutDewarping(TaskStatus const& status, FilterData const& input,
 //Quadro_Zoner
@@ -174,7 +224,8 @@ private:
                                    imageproc::BinaryImage* speckles_image = 0,
 //Picture_Shape
                                    DebugImages* dbg = 0,
-                                   PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr
+                                   PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr,
+                                   QImage* fill_zone_layer = nullptr
                                   ) const;
 
     QImage processWithDewarping(
@@ -196,8 +247,11 @@ private:
     void movePointToTopMargin(BinaryImage& bw_image, XSpline& spline, int idx) const;
     void movePointToBottomMargin(BinaryImage& bw_image, XSpline& spline, int idx) const;
     void drawPoint(QImage& image, QPointF const& pt) const;
-    double maybe_deskew(QImage* p_dewarped, DewarpingMode dewarping_mode) const;
-    void do_deskew(QImage* p_image, double angle_deg) const;
+    double residualSkewAngle(
+        QImage const& normalized_original,
+        dewarping::DistortionModel const& distortion_model,
+        DepthPerception const& depth_perception,
+        DewarpingMode dewarping_mode) const;
 
 //Auto_Dewarping_Vert_Half_Correction
     void movePointToTopMargin(BinaryImage& bw_image, std::vector<QPointF>& polyline, int idx) const;
@@ -213,7 +267,8 @@ private:
     QImage dewarp(
         QTransform const& orig_to_src, QImage const& src,
         QTransform const& src_to_output, dewarping::DistortionModel const& distortion_model,
-        DepthPerception const& depth_perception, QColor const& bg_color) const;
+        DepthPerception const& depth_perception, QColor const& bg_color,
+        double rotation_deg = 0.0) const;
 
     static QSize from300dpi(QSize const& size, Dpi const& target_dpi);
 
@@ -266,6 +321,14 @@ private:
 
     static QImage smoothToGrayscale(QImage const& src, Dpi const& dpi);
 
+    /**
+     * \brief The same as smoothToGrayscale(), but without another
+     *        full size image.
+     */
+    static void smoothToGrayscaleInPlace(QImage& image, Dpi const& dpi);
+
+    static void smoothingWindow(Dpi const& dpi, int& window, int& degree);
+
     static void morphologicalSmoothInPlace(
         imageproc::BinaryImage& img, TaskStatus const& status);
 
@@ -275,7 +338,12 @@ private:
 
     static QSize calcLocalWindowSize(Dpi const& dpi);
 
-    static unsigned char calcDominantBackgroundGrayLevel(QImage const& img);
+    /**
+     * \brief Finds the most common gray level among pixels Otsu's method
+     *        considers white, given the histogram of the whole image.
+     */
+    static unsigned char calcDominantBackgroundGrayLevel(
+        imageproc::GrayscaleHistogram const& hist);
 
     static QImage normalizeIllumination(QImage const& gray_input, DebugImages* dbg);
 
@@ -42,6 +42,7 @@ Params::Params(QDomElement const& el)
     :   RegenParams(),
         m_dpi(XmlUnmarshaller::dpi(el.namedItem("dpi").toElement())),
         m_distortionModel(el.namedItem("distortion-model").toElement()),
+        m_distortionModelKey(el.attribute("distortionModelKey")),
         m_depthPerception(el.attribute("depthPerception")),
         m_dewarpingMode(el.attribute("dewarpingMode")),
         m_despeckleLevel(despeckleLevelFromString(el.attribute("despeckleLevel")))
@@ -67,6 +68,9 @@ Params::toXml(QDomDocument& doc, QString const& name) const
 
     QDomElement el(doc.createElement(name));
     el.appendChild(m_distortionModel.toXml(doc, "distortion-model"));
+    if (!m_distortionModelKey.isEmpty()) {
+        el.setAttribute("distortionModelKey", m_distortionModelKey);
+    }
     el.setAttribute("depthPerception", m_depthPerception.toString());
     el.setAttribute("dewarpingMode", m_dewarpingMode.toString());
     el.setAttribute("despeckleLevel", despeckleLevelToString(m_despeckleLevel));
@@ -26,6 +26,7 @@
 #include "DepthPerception.h"
 #include "DespeckleLevel.h"
 #include "RegenParams.h"
+#include <QString>
 
 class QDomDocument;
 class QDomElement;
@@ -79,9 +80,34 @@ public:
         return m_distortionModel;
     }
 
+    /**
+     * Also forgets the auto-detection key, as the model
+     * is no longer the auto-detected one.
+     */
     void setDistortionModel(dewarping::DistortionModel const& model)
     {
         m_distortionModel = model;
+        m_distortionModelKey.clear();
+    }
+
+    /**
+     * \brief Stores a model built in DewarpingMode::AUTO.
+     *
+     * \param key See OutputGenerator::autoDistortionModelKey()
+     */
+    void setAutoDistortionModel(dewarping::DistortionModel const& model, QString const& key)
+    {
+        m_distortionModel = model;
+        m_distortionModelKey = key;
+    }
+
+    /**
+     * \brief The key the distortion model was auto-detected with,
+     *        or an empty string if it wasn't.
+     */
+    QString const& distortionModelKey() const
+    {
+        return m_distortionModelKey;
     }
 
     DepthPerception const& depthPerception() const
@@ -124,6 +150,7 @@ private:
 
     Dpi m_dpi;
     dewarping::DistortionModel m_distortionModel;
+    QString m_distortionModelKey;
     DepthPerception m_depthPerception;
     DewarpingMode m_dewarpingMode;
     DespeckleLevel m_despeckleLevel;
@@ -247,7 +247,7 @@ PictureZoneEditor::initiateBuildingScreenPictureMask()
         new MaskTransformTask(this, m_origPictureMask, xform, viewport()->size())
     );
 
-    backgroundExecutor().enqueueTask(task);
+    backgroundExecutor().enqueueTask(task, &m_ptrMaskTransformTask);
 
     m_screenPictureMask = QPixmap();
     m_ptrMaskTransformTask = task;
@@ -281,7 +281,7 @@ PictureZoneEditor::paintOverPictureMask(QPainter& painter)
     for (EditableZoneSet::Zone const& zone : qAsConst(m_zones)) {
         if (zone.properties()->locateOrDefault<PLP>()->layer() == PLP::ERASER1) {
             if (!zone.isEllipse()) {
-                painter.drawPolygon(zone.spline()->toPolygon(), Qt::WindingFill);
+                painter.drawPolygon(zone.spline()->polygon(), Qt::WindingFill);
             } else {
                 painter.save();
                 painter.setTransform(zone.ellipse()->transform(), true);
@@ -297,7 +297,7 @@ PictureZoneEditor::paintOverPictureMask(QPainter& painter)
     for (EditableZoneSet::Zone const& zone : qAsConst(m_zones)) {
         if (zone.properties()->locateOrDefault<PLP>()->layer() == PLP::PAINTER2) {
             if (!zone.isEllipse()) {
-                painter.drawPolygon(zone.spline()->toPolygon(), Qt::WindingFill);
+                painter.drawPolygon(zone.spline()->polygon(), Qt::WindingFill);
             } else {
                 painter.save();
                 painter.setTransform(zone.ellipse()->transform(), true);
@@ -313,7 +313,7 @@ PictureZoneEditor::paintOverPictureMask(QPainter& painter)
     for (EditableZoneSet::Zone const& zone : qAsConst(m_zones)) {
         if (zone.properties()->locateOrDefault<PLP>()->layer() == PLP::ERASER3) {
             if (!zone.isEllipse()) {
-                painter.drawPolygon(zone.spline()->toPolygon(), Qt::WindingFill);
+                painter.drawPolygon(zone.spline()->polygon(), Qt::WindingFill);
             } else {
                 painter.save();
                 painter.setTransform(zone.ellipse()->transform(), true);
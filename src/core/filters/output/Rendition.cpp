@@ -0,0 +1,175 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Rendition.h"
+#include "CommandLine.h"
+#include "Dpm.h"
+#include "settings/TiffCompressionInfo.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/GrayImage.h"
+#include "imageproc/Scale.h"
+#include <QImage>
+#include <QStringList>
+#include <QDir>
+#include <algorithm>
+
+using namespace imageproc;
+
+namespace output
+{
+
+namespace
+{
+
+/**
+ * Scales \p length down by \p to / \p from, or leaves it as is if that
+ * would make it larger.
+ */
+int scaledLength(int const length, int const from, int const to)
+{
+    if (from <= 0 || to >= from) {
+        return length;
+    }
+    return std::max(1, qRound(double(length) * to / from));
+}
+
+} // anonymous namespace
+
+bool
+Rendition::parse(QString const& spec, Rendition& rendition)
+{
+    QStringList const parts(spec.split(':'));
+    if (parts.size() < 2 || parts.size() > 4) {
+        return false;
+    }
+
+    bool ok = false;
+    int const dpi = parts[0].toInt(&ok);
+    if (!ok || dpi <= 0) {
+        return false;
+    }
+
+    ColorMode color_mode;
+    if (parts[1] == "color") {
+        color_mode = KEEP_COLORS;
+    } else if (parts[1] == "gray") {
+        color_mode = GRAYSCALE;
+    } else if (parts[1] == "bw") {
+        color_mode = BLACK_AND_WHITE;
+    } else {
+        return false;
+    }
+
+    QString compression;
+    if (parts.size() > 2 && !parts[2].isEmpty()) {
+        compression = parts[2].toUpper();
+        if (!TiffCompressions::contains(compression)) {
+            return false;
+        }
+    }
+
+    QString subdir(QString("%1dpi").arg(dpi));
+    if (parts.size() > 3 && !parts[3].isEmpty()) {
+        subdir = parts[3];
+    }
+
+    rendition.m_dpi = Dpi(dpi, dpi);
+    rendition.m_colorMode = color_mode;
+    rendition.m_compression = compression;
+    rendition.m_subdir = subdir;
+    return true;
+}
+
+std::vector<Rendition> const&
+Rendition::fromCommandLine()
+{
+    static std::vector<Rendition> const renditions(
+        [] {
+            std::vector<Rendition> res;
+            for (QString const& spec : CommandLine::get().getRenditions()) {
+                Rendition rendition;
+                if (parse(spec, rendition)) {
+                    res.push_back(rendition);
+                }
+            }
+            return res;
+        }()
+    );
+    return renditions;
+}
+
+QString
+Rendition::dir(QString const& out_dir) const
+{
+    return QDir(out_dir).absoluteFilePath(m_subdir);
+}
+
+QImage
+Rendition::render(QImage const& output) const
+{
+    Dpi const output_dpi((Dpm(output)));
+    QSize const size(
+        scaledLength(output.width(), output_dpi.horizontal(), m_dpi.horizontal()),
+        scaledLength(output.height(), output_dpi.vertical(), m_dpi.vertical())
+    );
+
+    ColorMode color_mode = m_colorMode;
+    if (color_mode == KEEP_COLORS) {
+        if (output.format() == QImage::Format_Mono || output.format() == QImage::Format_MonoLSB) {
+            color_mode = BLACK_AND_WHITE;
+        } else if (output.isGrayscale()) {
+            color_mode = GRAYSCALE;
+        }
+    }
+
+    QImage res;
+    if (color_mode == KEEP_COLORS) {
+        res = size == output.size() ? output
+              : output.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    } else {
+        // Bilevel output is averaged to gray and thresholded again,
+        // which is better at keeping thin strokes than dropping pixels.
+        GrayImage gray(output);
+        if (size != output.size()) {
+            gray = scaleToGray(gray, size);
+        }
+        if (color_mode == BLACK_AND_WHITE) {
+            res = BinaryImage(gray.toQImage()).toQImage();
+        } else {
+            res = gray.toQImage();
+        }
+    }
+
+    // Only set once the intermediate images are gone, so as not to
+    // detach the result, and only if it changes, so as not to copy
+    // the output.
+    Dpm const dpm(
+        Dpi(
+            size.width() == output.width() ? output_dpi.horizontal() : m_dpi.horizontal(),
+            size.height() == output.height() ? output_dpi.vertical() : m_dpi.vertical()
+        )
+    );
+    if (Dpm(res) != dpm) {
+        res.setDotsPerMeterX(dpm.horizontal());
+        res.setDotsPerMeterY(dpm.vertical());
+    }
+
+    return res;
+}
+
+} // namespace output
@@ -0,0 +1,107 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OUTPUT_RENDITION_H_
+#define OUTPUT_RENDITION_H_
+
+#include "Dpi.h"
+#include <QString>
+#include <vector>
+
+class QImage;
+
+namespace output
+{
+
+/**
+ * \brief An additional copy of the output, at its own resolution,
+ *        color mode and TIFF compression.
+ *
+ * Renditions are derived from the finished output image, so producing
+ * a derivative for access next to the archival master costs a resample
+ * rather than another run of the whole output stage.  Each rendition
+ * goes into its own subdirectory of the output directory, under the same
+ * file name as the output file.
+ */
+class Rendition
+{
+    // Member-wise copying is OK.
+public:
+    enum ColorMode {
+        KEEP_COLORS,
+        GRAYSCALE,
+        BLACK_AND_WHITE
+    };
+
+    Rendition() : m_colorMode(KEEP_COLORS) {}
+
+    /**
+     * \brief Parses "<dpi>:<color|gray|bw>[:<compression>[:<subdir>]]".
+     *
+     * The colour mode "color" keeps that of the output.  The compression
+     * is a TIFF compression name, like "lzw" or "jpeg", and defaults to
+     * the configured one.  The subdirectory defaults to "<dpi>dpi".
+     *
+     * \return false if \p spec is malformed.
+     */
+    static bool parse(QString const& spec, Rendition& rendition);
+
+    /**
+     * \brief The renditions given with --renditions.
+     *
+     * Malformed specifications are skipped.  scantailor-cli rejects them
+     * before processing starts.
+     */
+    static std::vector<Rendition> const& fromCommandLine();
+
+    Dpi const& dpi() const
+    {
+        return m_dpi;
+    }
+
+    ColorMode colorMode() const
+    {
+        return m_colorMode;
+    }
+
+    /** \brief The TIFF compression name, or an empty string for the configured one. */
+    QString const& compression() const
+    {
+        return m_compression;
+    }
+
+    QString dir(QString const& out_dir) const;
+
+    /**
+     * \brief Resamples \p output to this rendition.
+     *
+     * \p output must carry its resolution.  Renditions are never upscaled,
+     * so a rendition at a higher resolution than that of the output keeps
+     * the resolution of the output.
+     */
+    QImage render(QImage const& output) const;
+private:
+    Dpi m_dpi;
+    ColorMode m_colorMode;
+    QString m_compression;
+    QString m_subdir;
+};
+
+} // namespace output
+
+#endif
@@ -25,7 +25,8 @@
 #include "../../Utils.h"
 #include <Qt>
 #include <QColor>
-#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
 #include <tiff.h>
 #include <QResource>
 #include "settings/ini_keys.h"
@@ -48,7 +49,7 @@ Settings::~Settings()
 void
 Settings::clear()
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     initialPictureZoneProps().swap(m_defaultPictureZoneProps);
     initialFillZoneProps().swap(m_defaultFillZoneProps);
@@ -61,7 +62,7 @@ Settings::clear()
 void
 Settings::performRelinking(AbstractRelinker const& relinker)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageParams new_params;
     PerPageOutputParams new_output_params;
@@ -105,7 +106,7 @@ Settings::performRelinking(AbstractRelinker const& relinker)
 Params
 Settings::getParams(PageId const& page_id) const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     PerPageParams::const_iterator const it(m_perPageParams.find(page_id));
     if (it != m_perPageParams.end()) {
@@ -118,14 +119,14 @@ Settings::getParams(PageId const& page_id) const
 void
 Settings::setParams(PageId const& page_id, Params const& params)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     Utils::mapSetValue(m_perPageParams, page_id, params);
 }
 
 void
 Settings::setColorParams(PageId const& page_id, ColorParams const& prms, ColorParamsApplyFilter const& filter)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageParams::iterator const it(m_perPageParams.lower_bound(page_id));
     if (it == m_perPageParams.end() || m_perPageParams.key_comp()(page_id, it->first)) {
@@ -150,7 +151,7 @@ Settings::setColorParams(PageId const& page_id, ColorParams const& prms, ColorPa
 void
 Settings::setDpi(PageId const& page_id, Dpi const& dpi)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageParams::iterator const it(m_perPageParams.lower_bound(page_id));
     if (it == m_perPageParams.end() || m_perPageParams.key_comp()(page_id, it->first)) {
@@ -165,7 +166,7 @@ Settings::setDpi(PageId const& page_id, Dpi const& dpi)
 void
 Settings::setDewarpingMode(PageId const& page_id, DewarpingMode const& mode)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageParams::iterator const it(m_perPageParams.lower_bound(page_id));
     if (it == m_perPageParams.end() || m_perPageParams.key_comp()(page_id, it->first)) {
@@ -180,7 +181,7 @@ Settings::setDewarpingMode(PageId const& page_id, DewarpingMode const& mode)
 void
 Settings::setDistortionModel(PageId const& page_id, dewarping::DistortionModel const& model)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageParams::iterator const it(m_perPageParams.lower_bound(page_id));
     if (it == m_perPageParams.end() || m_perPageParams.key_comp()(page_id, it->first)) {
@@ -195,7 +196,7 @@ Settings::setDistortionModel(PageId const& page_id, dewarping::DistortionModel c
 void
 Settings::setDepthPerception(PageId const& page_id, DepthPerception const& depth_perception)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageParams::iterator const it(m_perPageParams.lower_bound(page_id));
     if (it == m_perPageParams.end() || m_perPageParams.key_comp()(page_id, it->first)) {
@@ -210,7 +211,7 @@ Settings::setDepthPerception(PageId const& page_id, DepthPerception const& depth
 void
 Settings::setDespeckleLevel(PageId const& page_id, DespeckleLevel level)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageParams::iterator const it(m_perPageParams.lower_bound(page_id));
     if (it == m_perPageParams.end() || m_perPageParams.key_comp()(page_id, it->first)) {
@@ -222,10 +223,80 @@ Settings::setDespeckleLevel(PageId const& page_id, DespeckleLevel level)
     }
 }
 
+template<typename Update>
+std::set<PageId>
+Settings::updatePages(std::set<PageId> const& pages, Update update)
+{
+    std::set<PageId> changed;
+
+    QWriteLocker const locker(&m_lock);
+
+    for (PageId const& page_id : pages) {
+        PerPageParams::iterator it(m_perPageParams.lower_bound(page_id));
+        if (it == m_perPageParams.end() || m_perPageParams.key_comp()(page_id, it->first)) {
+            it = m_perPageParams.insert(it, PerPageParams::value_type(page_id, Params()));
+        }
+        if (update(it->second)) {
+            changed.insert(page_id);
+        }
+    }
+
+    return changed;
+}
+
+std::set<PageId>
+Settings::setDpi(std::set<PageId> const& pages, Dpi const& dpi)
+{
+    return updatePages(pages, [&dpi](Params& params) {
+        if (params.outputDpi() == dpi) {
+            return false;
+        }
+        params.setOutputDpi(dpi);
+        return true;
+    });
+}
+
+std::set<PageId>
+Settings::setDewarpingMode(std::set<PageId> const& pages, DewarpingMode const& mode)
+{
+    return updatePages(pages, [&mode](Params& params) {
+        if (params.dewarpingMode() == mode) {
+            return false;
+        }
+        params.setDewarpingMode(mode);
+        return true;
+    });
+}
+
+std::set<PageId>
+Settings::setDepthPerception(
+    std::set<PageId> const& pages, DepthPerception const& depth_perception)
+{
+    return updatePages(pages, [&depth_perception](Params& params) {
+        if (params.depthPerception().value() == depth_perception.value()) {
+            return false;
+        }
+        params.setDepthPerception(depth_perception);
+        return true;
+    });
+}
+
+std::set<PageId>
+Settings::setDespeckleLevel(std::set<PageId> const& pages, DespeckleLevel const level)
+{
+    return updatePages(pages, [level](Params& params) {
+        if (params.despeckleLevel() == level) {
+            return false;
+        }
+        params.setDespeckleLevel(level);
+        return true;
+    });
+}
+
 std::unique_ptr<OutputParams>
 Settings::getOutputParams(PageId const& page_id) const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     PerPageOutputParams::const_iterator const it(m_perPageOutputParams.find(page_id));
     if (it != m_perPageOutputParams.end()) {
@@ -238,21 +309,21 @@ Settings::getOutputParams(PageId const& page_id) const
 void
 Settings::removeOutputParams(PageId const& page_id)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_perPageOutputParams.erase(page_id);
 }
 
 void
 Settings::setOutputParams(PageId const& page_id, OutputParams const& params)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     Utils::mapSetValue(m_perPageOutputParams, page_id, params);
 }
 
 ZoneSet
 Settings::pictureZonesForPage(PageId const& page_id) const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     PerPageZones::const_iterator const it(m_perPagePictureZones.find(page_id));
     if (it != m_perPagePictureZones.end()) {
@@ -265,7 +336,7 @@ Settings::pictureZonesForPage(PageId const& page_id) const
 ZoneSet
 Settings::fillZonesForPage(PageId const& page_id) const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     PerPageZones::const_iterator const it(m_perPageFillZones.find(page_id));
     if (it != m_perPageFillZones.end()) {
@@ -278,42 +349,42 @@ Settings::fillZonesForPage(PageId const& page_id) const
 void
 Settings::setPictureZones(PageId const& page_id, ZoneSet const& zones)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     Utils::mapSetValue(m_perPagePictureZones, page_id, zones);
 }
 
 void
 Settings::setFillZones(PageId const& page_id, ZoneSet const& zones)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     Utils::mapSetValue(m_perPageFillZones, page_id, zones);
 }
 
 PropertySet
 Settings::defaultPictureZoneProperties() const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
     return m_defaultPictureZoneProps;
 }
 
 PropertySet
 Settings::defaultFillZoneProperties() const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
     return m_defaultFillZoneProps;
 }
 
 void
 Settings::setDefaultPictureZoneProperties(PropertySet const& props)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_defaultPictureZoneProps = props;
 }
 
 void
 Settings::setDefaultFillZoneProperties(PropertySet const& props)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_defaultFillZoneProps = props;
 }
 
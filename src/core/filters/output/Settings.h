@@ -31,8 +31,9 @@
 #include "DespeckleLevel.h"
 #include "ZoneSet.h"
 #include "PropertySet.h"
-#include <QMutex>
+#include <QReadWriteLock>
 #include <map>
+#include <set>
 #include <memory>
 //begin of modified by monday2000
 //Picture_Shape
@@ -74,6 +75,21 @@ public:
 
     void setDespeckleLevel(PageId const& page_id, DespeckleLevel level);
 
+    /**
+     * \brief Sets the output DPI of all of \p pages at once.
+     *
+     * This and the following functions take the lock once for all
+     * the pages and return those whose setting actually changed.
+     */
+    std::set<PageId> setDpi(std::set<PageId> const& pages, Dpi const& dpi);
+
+    std::set<PageId> setDewarpingMode(std::set<PageId> const& pages, DewarpingMode const& mode);
+
+    std::set<PageId> setDepthPerception(
+        std::set<PageId> const& pages, DepthPerception const& depth_perception);
+
+    std::set<PageId> setDespeckleLevel(std::set<PageId> const& pages, DespeckleLevel level);
+
     std::unique_ptr<OutputParams> getOutputParams(PageId const& page_id) const;
 
     void removeOutputParams(PageId const& page_id);
@@ -104,11 +120,18 @@ private:
     typedef std::map<PageId, OutputParams> PerPageOutputParams;
     typedef std::map<PageId, ZoneSet> PerPageZones;
 
+    /**
+     * Calls \p update for the params of each of \p pages, creating them
+     * as necessary, and collects the pages it returned true for.
+     */
+    template<typename Update>
+    std::set<PageId> updatePages(std::set<PageId> const& pages, Update update);
+
     static PropertySet initialPictureZoneProps();
 
     static PropertySet initialFillZoneProps();
 
-    mutable QMutex m_mutex;
+    mutable QReadWriteLock m_lock;
     PerPageParams m_perPageParams;
     PerPageOutputParams m_perPageOutputParams;
     PerPageZones m_perPagePictureZones;
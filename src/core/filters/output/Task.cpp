@@ -31,6 +31,7 @@
 #include "TaskStatus.h"
 #include "FilterData.h"
 #include "ImageView.h"
+#include "AlternativeImageSource.h"
 #include "ImageViewTab.h"
 #include "TabbedImageView.h"
 #include "PictureZoneComparator.h"
@@ -55,13 +56,18 @@
 #include "DebugImages.h"
 #include "OutputGenerator.h"
 #include "TiffWriter.h"
+#include "OutputWriteQueue.h"
+#include "Rendition.h"
 #include "ImageLoader.h"
+#include "IntermediateCache.h"
+#include "OutputCache.h"
 #include "ErrorWidget.h"
 #include "imageproc/BinaryImage.h"
 #include "imageproc/PolygonUtils.h"
 #include "imageproc/DrawOver.h"
 #include "imageproc/Transform.h"
 #include "VirtualZoneProperty.h"
+#include "Profiler.h"
 #ifndef Q_MOC_RUN
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
@@ -72,9 +78,17 @@
 #include <QFile>
 #include <QDir>
 #include <QFileInfo>
+#include <QStringList>
+#include <QVector>
+#include <QTransform>
+#include <QDomDocument>
+#include <QDomElement>
 #include <QTabWidget>
 #include <QCoreApplication>
 #include <QDebug>
+#include <algorithm>
+#include <vector>
+#include <memory>
 
 #include "CommandLine.h"
 
@@ -108,8 +122,9 @@ public:
     {
         return m_ptrFilter;
     }
-    QImage* getAlternativeImage();
 private:
+    std::shared_ptr<AlternativeImageSource> alternativeImageSource() const;
+
     IntrusivePtr<Filter> m_ptrFilter;
     IntrusivePtr<Settings> m_ptrSettings;
     std::unique_ptr<DebugImages> const& m_ptrDbg;
@@ -135,7 +150,9 @@ Task::Task(IntrusivePtr<Filter> const& filter,
            ImageViewTab const last_tab, bool const batch, bool const debug,
            bool const keep_orig_fore_subscan,
 //Original_Foreground_Mixed
-           QImage* const p_orig_fore_subscan)
+           QImage* const p_orig_fore_subscan,
+           QImage* const p_out_img,
+           BinaryImage* const p_automask)
     :   m_ptrFilter(filter),
         m_ptrSettings(settings),
         m_ptrThumbnailCache(thumbnail_cache),
@@ -148,7 +165,9 @@ Task::Task(IntrusivePtr<Filter> const& filter,
         m_debug(debug),
         m_keep_orig_fore_subscan(keep_orig_fore_subscan),
 //Original_Foreground_Mixed
-        m_p_orig_fore_subscan(p_orig_fore_subscan)
+        m_p_orig_fore_subscan(p_orig_fore_subscan),
+        m_p_out_img(p_out_img),
+        m_p_automask(p_automask)
 {
     if (debug) {
         m_ptrDbg.reset(new DebugImages);
@@ -183,13 +202,124 @@ addVirtualZones(const ZoneSet& zones, const ImageTransformation& xform, ZoneSet&
     return res;
 }
 
+namespace
+{
+
+/**
+ * Identifies an output page, along with its automask and speckles files,
+ * in OutputCache.  Everything the generated files depend on must be covered,
+ * including the picture zones the generator may update.
+ */
+IntermediateCache::Key sharedOutputKey(
+    PageId const& page_id, ImageTransformation const& xform,
+    OutputImageParams const& output_image_params,
+    ZoneSet const& picture_zones, ZoneSet const& fill_zones,
+    bool write_automask, bool write_speckles_file)
+{
+    IntermediateCache::Key key(OutputCache::key(page_id.imageId(), "output_page"));
+    if (!key.isValid()) {
+        return key;
+    }
+
+    QDomDocument doc;
+    QDomElement el(doc.createElement("page"));
+    el.appendChild(output_image_params.toXml(doc, "image"));
+    el.appendChild(picture_zones.toXml(doc, "picture-zones"));
+    el.appendChild(fill_zones.toXml(doc, "fill-zones"));
+    doc.appendChild(el);
+
+    key.add(int(page_id.subPage()))
+    .add(xform.transform()).add(xform.resultingPreCropArea())
+    .add(int(write_automask)).add(int(write_speckles_file))
+    .add(int(GlobalStaticSettings::m_disable_bw_smoothing))
+    .add(double(GlobalStaticSettings::m_picture_detection_sensitivity))
+    .add(int(CommandLine::get().hasTiffForceKeepColorSpace()))
+    .add(doc.toByteArray());
+    return key;
+}
+
+/**
+ * The resolution of a quick preview of output at \p output_dpi, or a null
+ * Dpi if generating the output itself is quick enough not to bother.
+ */
+Dpi previewDpi(Dpi const& output_dpi)
+{
+    int const downscale_factor = 4;
+    int const min_preview_dpi = 75;
+
+    if (std::min(output_dpi.horizontal(), output_dpi.vertical())
+            < downscale_factor * min_preview_dpi) {
+        return Dpi();
+    }
+
+    return Dpi(
+               output_dpi.horizontal() / downscale_factor,
+               output_dpi.vertical() / downscale_factor
+           );
+}
+
+/**
+ * Appends the files of the renditions given with --renditions to \p files.
+ * With \p only_missing, renditions whose files exist are left alone.
+ */
+void addRenditionFiles(
+    std::vector<OutputWriteQueue::File>& files, QImage const& out_img,
+    QString const& out_dir, QString const& file_name, bool const only_missing)
+{
+    for (Rendition const& rendition : Rendition::fromCommandLine()) {
+        QString const dir(rendition.dir(out_dir));
+        QString const path(QDir(dir).absoluteFilePath(file_name));
+        if (only_missing && QFile::exists(path)) {
+            continue;
+        }
+        if (!QDir().mkpath(dir)) {
+            continue;
+        }
+        files.push_back(OutputWriteQueue::File(path, rendition.render(out_img)));
+        files.back().compression = rendition.compression();
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * Shows a reduced resolution rendition of the output while the real one
+ * is being generated.  Nothing but the image view is touched, so that
+ * the final result can replace it without leaving traces.
+ */
+class Task::PreviewUpdater : public FilterResult
+{
+    Q_DECLARE_TR_FUNCTIONS(output::Task::PreviewUpdater)
+public:
+    PreviewUpdater(IntrusivePtr<Filter> const& filter, QImage const& preview);
+
+    virtual void updateUI(FilterUiInterface* ui);
+
+    virtual IntrusivePtr<AbstractFilter> filter()
+    {
+        return m_ptrFilter;
+    }
+private:
+    IntrusivePtr<Filter> m_ptrFilter;
+    QImage m_preview;
+    QImage m_downscaledPreview;
+};
+
 FilterResultPtr
 Task::process(
     TaskStatus const& status, FilterData const& data,
     QPolygonF const& content_rect_phys)
 {
+    Profiler::Scope const profile_scope("output", m_pageId);
+    Profiler::addCounter("pixels", qint64(data.origImage().width()) * data.origImage().height());
+
     status.throwIfCancelled();
 
+    if (!m_batchProcessing) {
+        // Batch processing may still be writing this page.
+        OutputWriteQueue::waitForAll();
+    }
+
     Params params(m_ptrSettings->getParams(m_pageId));
     CommandLine const& cli = CommandLine::get();
 
@@ -227,6 +357,8 @@ Task::process(
     QFileInfo speckles_file_info(speckles_file_path);
 
     bool const need_picture_editor = render_params.mixedOutput() && !m_batchProcessing;
+    // The export takes the automask as well.
+    bool const need_automask_image = need_picture_editor || (render_params.mixedOutput() && m_p_automask);
     bool const need_speckles_image = params.despeckleLevel() != DESPECKLE_OFF
                                      && params.colorParams().colorMode() != ColorParams::COLOR_GRAYSCALE && !m_batchProcessing;
 
@@ -246,6 +378,12 @@ Task::process(
         new_xform, content_rect_phys
     );
 
+    // Identifies the inputs an auto-detected distortion model depends on.
+    QString const auto_model_key(
+        params.dewarpingMode() == DewarpingMode::AUTO
+        ? generator.autoDistortionModelKey(m_pageId.imageId()) : QString()
+    );
+
     OutputImageParams new_output_image_params(
         generator.outputImageSize(), generator.outputContentRect(),
         new_xform, params.outputDpi(), params.colorParams(),
@@ -285,11 +423,14 @@ Task::process(
         speckles_img = BinaryImage();
 
         DistortionModel distortion_model;
-        if (params.dewarpingMode() == DewarpingMode::MANUAL) {
+        if (params.dewarpingMode() == DewarpingMode::MANUAL
+                || (params.dewarpingMode() == DewarpingMode::AUTO
+                    && params.distortionModelKey() == auto_model_key)) {
             distortion_model = params.distortionModel();
         }
         // OutputGenerator will write a new distortion model
-        // there, if dewarping mode is AUTO.
+        // there, if dewarping mode is AUTO and the stored one
+        // is missing or out of date.
 
         out_img = generator.process(
                       status, data, new_picture_zones, new_fill_zones,
@@ -317,11 +458,14 @@ Task::process(
         m_ptrSettings->setParams(m_pageId, p);
     }
 
-    do { // Just to be able to break from it.
+    std::unique_ptr<OutputParams> const stored_output_params(
+        m_ptrSettings->getOutputParams(m_pageId)
+    );
 
-        std::unique_ptr<OutputParams> stored_output_params(
-            m_ptrSettings->getOutputParams(m_pageId)
-        );
+    // Set if fill zones are the only thing that has changed.
+    bool need_fill_zones_reapplied = false;
+
+    do { // Just to be able to break from it.
 
         if (!stored_output_params.get()) {
             need_reprocess = true;
@@ -346,8 +490,8 @@ Task::process(
         }
 
         if (!FillZoneComparator::equal(stored_output_params->fillZones(), new_fill_zones)) {
-            need_reprocess = true;
-            break;
+            // We may get away with re-applying them to the cached fill zone layer.
+            need_fill_zones_reapplied = true;
         }
 
         if (!out_file_info.exists()) {
@@ -360,7 +504,7 @@ Task::process(
             break;
         }
 
-        if (need_picture_editor) {
+        if (need_automask_image) {
             if (!automask_file_info.exists()) {
                 need_reprocess = true;
                 break;
@@ -390,13 +534,31 @@ Task::process(
     BinaryImage speckles_img;
 
     if (!need_reprocess) {
-        QFile out_file(out_file_path);
-        if (out_file.open(QIODevice::ReadOnly)) {
-            out_img = ImageLoader::load(out_file, 0);
+        if (need_fill_zones_reapplied) {
+            QImage fill_zone_layer;
+            IntermediateCache::Key const layer_key(
+                generator.fillZoneLayerKey(
+                    m_pageId.imageId(), new_picture_zones,
+                    params.dewarpingMode(), params.distortionModel()
+                )
+            );
+            if (IntermediateCache::load(layer_key, fill_zone_layer)
+                    && fill_zone_layer.size() == generator.outputImageSize()) {
+                out_img = generator.applyFillZones(fill_zone_layer, new_fill_zones);
+            }
+        } else {
+            QFile out_file(out_file_path);
+            if (out_file.open(QIODevice::ReadOnly)) {
+                out_img = ImageLoader::load(out_file, 0);
+            }
+            // The thumbnail may have been lost with the thumbnail store.
+            // Now that the output is decoded anyway, the thumbnail strip
+            // won't have to decode it again.
+            m_ptrThumbnailCache->ensureThumbnailExists(ImageId(out_file_path), out_img);
         }
         need_reprocess = out_img.isNull();
 
-        if (need_picture_editor && !need_reprocess) {
+        if (need_automask_image && !need_reprocess) {
             QFile automask_file(automask_file_path);
             if (automask_file.open(QIODevice::ReadOnly)) {
                 automask_img = BinaryImage(ImageLoader::load(automask_file, 0));
@@ -427,33 +589,94 @@ Task::process(
         speckles_img = BinaryImage();
 
         DistortionModel distortion_model;
-        if (params.dewarpingMode() == DewarpingMode::MANUAL) {
+        if (params.dewarpingMode() == DewarpingMode::MANUAL
+                || (params.dewarpingMode() == DewarpingMode::AUTO
+                    && params.distortionModelKey() == auto_model_key)) {
             distortion_model = params.distortionModel();
         }
         // OutputGenerator will write a new distortion model
-        // there, if dewarping mode is AUTO.
+        // there, if dewarping mode is AUTO and the stored one
+        // is missing or out of date.
+
+        // Another project may have produced this very page already.  That can't
+        // be taken advantage of if a distortion model is to be produced as well.
+        bool const shareable = params.dewarpingMode() == DewarpingMode::OFF
+                               || params.dewarpingMode() == DewarpingMode::MANUAL
+                               || (params.dewarpingMode() == DewarpingMode::AUTO
+                                   && distortion_model.isValid());
+        IntermediateCache::Key const shared_key(
+            shareable ? sharedOutputKey(
+                m_pageId, new_xform, new_output_image_params,
+                new_picture_zones, new_fill_zones,
+                write_automask, write_speckles_file
+            ) : IntermediateCache::Key()
+        );
 
-        out_img = generator.process(
-                      status, data, new_picture_zones, new_fill_zones,
-                      params.dewarpingMode(), distortion_model,
-                      params.depthPerception(),
-                      false,
-                      write_automask ? &automask_img : nullptr,
-                      write_speckles_file ? &speckles_img : nullptr,
-                      m_ptrDbg.get(), &m_pageId, &m_ptrSettings
-                  );
+        QStringList shared_files(out_file_path);
+        if (write_automask) {
+            shared_files << automask_file_path;
+        }
+        if (write_speckles_file) {
+            shared_files << speckles_file_path;
+        }
 
-        if ((params.dewarpingMode() == DewarpingMode::AUTO && distortion_model.isValid())
+        bool const from_shared_cache = shared_key.isValid() && fetchSharedOutput(
+                                           shared_key, shared_files, write_automask, write_speckles_file,
+                                           new_output_image_params, new_picture_zones,
+                                           out_img, automask_img, speckles_img
+                                       );
+
+        // The output before applying fill zones, to be able to re-apply them
+        // without going through the whole output generation process.
+        QImage fill_zone_layer;
+
+        if (!from_shared_cache && shareable && !m_batchProcessing
+                && GlobalStaticSettings::m_output_quick_preview) {
+            postPreview(
+                status, data, content_rect_phys, params,
+                new_picture_zones, new_fill_zones, distortion_model
+            );
+        }
+
+        if (!from_shared_cache) {
+            out_img = generator.process(
+                          status, data, new_picture_zones, new_fill_zones,
+                          params.dewarpingMode(), distortion_model,
+                          params.depthPerception(),
+                          false,
+                          write_automask ? &automask_img : nullptr,
+                          write_speckles_file ? &speckles_img : nullptr,
+                          m_ptrDbg.get(), &m_pageId, &m_ptrSettings,
+                          IntermediateCache::isEnabled() ? &fill_zone_layer : nullptr
+                      );
+
+            if (!fill_zone_layer.isNull()) {
+                // Note that picture zones may have been updated by the generator.
+                IntermediateCache::store(
+                    generator.fillZoneLayerKey(
+                        m_pageId.imageId(), new_picture_zones,
+                        params.dewarpingMode(), distortion_model
+                    ),
+                    fill_zone_layer
+                );
+            }
+
+            if (params.dewarpingMode() == DewarpingMode::AUTO && distortion_model.isValid()) {
+                // A new distortion model was generated, or the stored one was reused.
+                // We need to save it to be able to modify it manually, and to skip
+                // detection next time, provided its inputs stay the same.
+                params.setAutoDistortionModel(distortion_model, auto_model_key);
+                m_ptrSettings->setParams(m_pageId, params);
+                new_output_image_params.setDistortionModel(distortion_model);
+            }
 //begin of modified by monday2000
 //Marginal_Dewarping
-                || (params.dewarpingMode() == DewarpingMode::MARGINAL && distortion_model.isValid())
+            else if (params.dewarpingMode() == DewarpingMode::MARGINAL && distortion_model.isValid()) {
+                params.setDistortionModel(distortion_model);
+                m_ptrSettings->setParams(m_pageId, params);
+                new_output_image_params.setDistortionModel(distortion_model);
+            }
 //end of modified by monday2000
-           ) {
-            // A new distortion model was generated.
-            // We need to save it to be able to modify it manually.
-            params.setDistortionModel(distortion_model);
-            m_ptrSettings->setParams(m_pageId, params);
-            new_output_image_params.setDistortionModel(distortion_model);
         }
 
         if (write_speckles_file && speckles_img.isNull()) {
@@ -463,63 +686,171 @@ Task::process(
             BinaryImage(out_img.size(), WHITE).swap(speckles_img);
         }
 
-        bool invalidate_params = false;
+        // Regenerating a page often produces the very same files.
+        // Leaving those alone saves I/O and keeps them from looking
+        // modified to anything that syncs or backs up the output.
+        QByteArray const out_digest(TiffWriter::contentDigest(out_img));
+        QByteArray const automask_digest(
+            write_automask ? TiffWriter::contentDigest(automask_img.toQImage()) : QByteArray()
+        );
+        QByteArray const speckles_digest(
+            write_speckles_file ? TiffWriter::contentDigest(speckles_img.toQImage()) : QByteArray()
+        );
 
-        QString TiffCompressionUsed;
+        std::vector<OutputWriteQueue::File> files;
+        bool speckles_dir_ok = true;
 
-        if (!TiffWriter::writeImage(out_file_path, out_img, false, 0, &TiffCompressionUsed)) {
-            invalidate_params = true;
-        } else {
-            deleteMutuallyExclusiveOutputFiles();
-            if (TiffCompressionUsed != new_output_image_params.TiffCompression()) {
-                new_output_image_params.setTiffCompression(TiffCompressionUsed);
+        if (!from_shared_cache) {
+            files.push_back(OutputWriteQueue::File(out_file_path, out_img));
+            if (stored_output_params && stored_output_params->outputFileParams().holds(
+                        QFileInfo(out_file_path), out_digest)) {
+                files.back().image = QImage();
+                files.back().unchanged = true;
+                files.back().compressionUsed = stored_output_params->outputImageParams().TiffCompression();
             }
-//            if (TiffCompressionUsed != params.TiffCompression()) {
-//                params.setTiffCompression(TiffCompressionUsed);
-//                m_ptrSettings->setParams(m_pageId, params);
-//            }
-        }
 
-        if (write_automask) {
-            // Note that QDir::mkdir() will fail if the parent directory,
-            // that is $OUT/cache doesn't exist. We want that behavior,
-            // as otherwise when loading a project from a different machine,
-            // a whole bunch of bogus directories would be created.
-            QDir().mkdir(automask_dir);
-            // Also note that QDir::mkdir() will fail if the directory already exists,
-            // so we ignore its return value here.
-
-            if (!TiffWriter::writeImage(automask_file_path, automask_img.toQImage(), false, 0)) {
-                invalidate_params = true;
+            if (write_automask) {
+                // Note that QDir::mkdir() will fail if the parent directory,
+                // that is $OUT/cache doesn't exist. We want that behavior,
+                // as otherwise when loading a project from a different machine,
+                // a whole bunch of bogus directories would be created.
+                QDir().mkdir(automask_dir);
+                // Also note that QDir::mkdir() will fail if the directory already exists,
+                // so we ignore its return value here.
+
+                files.push_back(OutputWriteQueue::File(automask_file_path, automask_img.toQImage()));
+                if (stored_output_params && stored_output_params->automaskFileParams().holds(
+                            QFileInfo(automask_file_path), automask_digest)) {
+                    files.back().image = QImage();
+                    files.back().unchanged = true;
+                }
+            }
+            if (write_speckles_file) {
+                speckles_dir_ok = QDir().mkpath(speckles_dir);
+                if (speckles_dir_ok) {
+                    files.push_back(OutputWriteQueue::File(speckles_file_path, speckles_img.toQImage()));
+                    if (stored_output_params && stored_output_params->specklesFileParams().holds(
+                                QFileInfo(speckles_file_path), speckles_digest)) {
+                        files.back().image = QImage();
+                        files.back().unchanged = true;
+                    }
+                }
             }
         }
-        if (write_speckles_file) {
-            if (!QDir().mkpath(speckles_dir)) {
-                invalidate_params = true;
-            } else if (!TiffWriter::writeImage(speckles_file_path, speckles_img.toQImage(), false, 0)) {
-                invalidate_params = true;
+
+        // Renditions are derived from the output, so they only need
+        // writing when it changes, or when they've gone missing.
+        addRenditionFiles(
+            files, out_img, m_outFileNameGen.outDir(), out_file_info.fileName(),
+            from_shared_cache || files.front().unchanged
+        );
+
+        // Everything below runs once the files are on disk, which in batch
+        // mode happens on the writer thread, so only copies are captured.
+        IntrusivePtr<Settings> const settings(m_ptrSettings);
+        IntrusivePtr<ThumbnailPixmapCache> const thumbnail_cache(m_ptrThumbnailCache);
+        PageId const page_id(m_pageId);
+        OutputFileNameGenerator const out_file_name_gen(m_outFileNameGen);
+        OutputWriteQueue::CompletionHandler const on_written(
+            [=](std::vector<OutputWriteQueue::File> const& written) {
+                OutputImageParams output_image_params(new_output_image_params);
+                bool invalidate_params = !speckles_dir_ok;
+
+                if (from_shared_cache) {
+                    // The fetched files are already in place.
+                    deleteMutuallyExclusiveOutputFiles(page_id, out_file_name_gen);
+                } else if (written.front().written) {
+                    deleteMutuallyExclusiveOutputFiles(page_id, out_file_name_gen);
+                    if (written.front().compressionUsed != output_image_params.TiffCompression()) {
+                        output_image_params.setTiffCompression(written.front().compressionUsed);
+                    }
+                }
+
+                for (OutputWriteQueue::File const& file : written) {
+                    if (!file.written) {
+                        invalidate_params = true;
+                    }
+                }
+
+                if (invalidate_params) {
+                    settings->removeOutputParams(page_id);
+                } else {
+                    // Note that we can't reuse *_file_info objects
+                    // as we've just overwritten those files.
+                    OutputParams const out_params(
+                        output_image_params,
+                        OutputFileParams(QFileInfo(out_file_path), out_digest),
+                        write_automask ? OutputFileParams(QFileInfo(automask_file_path), automask_digest)
+                        : OutputFileParams(),
+                        write_speckles_file ? OutputFileParams(QFileInfo(speckles_file_path), speckles_digest)
+                        : OutputFileParams(),
+                        new_picture_zones, new_fill_zones
+                    );
+
+                    settings->setOutputParams(page_id, out_params);
+
+                    if (!from_shared_cache && shared_key.isValid()) {
+                        QDomDocument doc;
+                        doc.appendChild(out_params.toXml(doc, "output-params"));
+                        OutputCache::store(shared_key, shared_files, doc.toByteArray());
+                    }
+                }
+
+                thumbnail_cache->recreateThumbnail(ImageId(out_file_path), out_img);
             }
+        );
+
+        if (m_batchProcessing && !from_shared_cache && !m_p_out_img && !m_p_automask) {
+            // Let the next page be processed while this one is being written.
+            OutputWriteQueue::write(files, on_written);
+        } else {
+            OutputWriteQueue::writeNow(files);
+            on_written(files);
         }
+    } else if (need_fill_zones_reapplied) {
+        // The automask and speckles files don't depend on fill zones,
+        // so only the output file needs to be rewritten.
+        QString TiffCompressionUsed;
 
-        if (invalidate_params) {
+        if (!TiffWriter::writeImage(out_file_path, out_img, false, 0, &TiffCompressionUsed)) {
             m_ptrSettings->removeOutputParams(m_pageId);
         } else {
-            // Note that we can't reuse *_file_info objects
-            // as we've just overwritten those files.
+            if (TiffCompressionUsed != new_output_image_params.TiffCompression()) {
+                new_output_image_params.setTiffCompression(TiffCompressionUsed);
+            }
+
             OutputParams const out_params(
                 new_output_image_params,
-                OutputFileParams(QFileInfo(out_file_path)),
-                write_automask ? OutputFileParams(QFileInfo(automask_file_path))
-                : OutputFileParams(),
-                write_speckles_file ? OutputFileParams(QFileInfo(speckles_file_path))
-                : OutputFileParams(),
+                OutputFileParams(QFileInfo(out_file_path), TiffWriter::contentDigest(out_img)),
+                stored_output_params->automaskFileParams(),
+                stored_output_params->specklesFileParams(),
                 new_picture_zones, new_fill_zones
             );
 
             m_ptrSettings->setOutputParams(m_pageId, out_params);
         }
 
+        std::vector<OutputWriteQueue::File> files;
+        addRenditionFiles(
+            files, out_img, m_outFileNameGen.outDir(), out_file_info.fileName(), false
+        );
+        OutputWriteQueue::writeNow(files);
+
         m_ptrThumbnailCache->recreateThumbnail(ImageId(out_file_path), out_img);
+    } else if (!Rendition::fromCommandLine().empty()) {
+        // Renditions may have been asked for after the output was made.
+        std::vector<OutputWriteQueue::File> files;
+        addRenditionFiles(
+            files, out_img, m_outFileNameGen.outDir(), out_file_info.fileName(), true
+        );
+        OutputWriteQueue::writeNow(files);
+    }
+
+    if (m_p_out_img) {
+        *m_p_out_img = out_img;
+    }
+    if (m_p_automask) {
+        *m_p_automask = automask_img;
     }
 
     DespeckleState const despeckle_state(
@@ -553,32 +884,154 @@ Task::process(
  * Delete output files mutually exclusive to m_pageId.
  */
 void
-Task::deleteMutuallyExclusiveOutputFiles()
+Task::deleteMutuallyExclusiveOutputFiles(
+    PageId const& page_id, OutputFileNameGenerator const& out_file_name_gen)
 {
-    switch (m_pageId.subPage()) {
+    switch (page_id.subPage()) {
     case PageId::SINGLE_PAGE:
         QFile::remove(
-            m_outFileNameGen.filePathFor(
-                PageId(m_pageId.imageId(), PageId::LEFT_PAGE)
+            out_file_name_gen.filePathFor(
+                PageId(page_id.imageId(), PageId::LEFT_PAGE)
             )
         );
         QFile::remove(
-            m_outFileNameGen.filePathFor(
-                PageId(m_pageId.imageId(), PageId::RIGHT_PAGE)
+            out_file_name_gen.filePathFor(
+                PageId(page_id.imageId(), PageId::RIGHT_PAGE)
             )
         );
         break;
     case PageId::LEFT_PAGE:
     case PageId::RIGHT_PAGE:
         QFile::remove(
-            m_outFileNameGen.filePathFor(
-                PageId(m_pageId.imageId(), PageId::SINGLE_PAGE)
+            out_file_name_gen.filePathFor(
+                PageId(page_id.imageId(), PageId::SINGLE_PAGE)
             )
         );
         break;
     }
 }
 
+/**
+ * Copies a page produced earlier from OutputCache and loads it.
+ * On success, the output image params and picture zones are updated
+ * to those the files were produced with.
+ */
+bool
+Task::fetchSharedOutput(
+    IntermediateCache::Key const& key, QStringList const& file_paths,
+    bool const write_automask, bool const write_speckles_file,
+    OutputImageParams& output_image_params, ZoneSet& picture_zones,
+    QImage& out_img, BinaryImage& automask_img, BinaryImage& speckles_img)
+{
+    if (write_automask) {
+        // See the comment in process() on why it's not mkpath().
+        QDir().mkdir(Utils::automaskDir(m_outFileNameGen.outDir()));
+    }
+    if (write_speckles_file) {
+        QDir().mkpath(Utils::specklesDir(m_outFileNameGen.outDir()));
+    }
+
+    QByteArray meta;
+    if (!OutputCache::fetch(key, file_paths, meta)) {
+        return false;
+    }
+
+    QDomDocument doc;
+    if (!doc.setContent(meta)) {
+        return false;
+    }
+    OutputParams const cached_params(doc.documentElement());
+
+    QImage image;
+    BinaryImage automask;
+    BinaryImage speckles;
+
+    int idx = 0;
+    QFile out_file(file_paths[idx++]);
+    if (out_file.open(QIODevice::ReadOnly)) {
+        image = ImageLoader::load(out_file, 0);
+    }
+    if (image.isNull()) {
+        return false;
+    }
+    if (write_automask) {
+        QFile automask_file(file_paths[idx++]);
+        if (automask_file.open(QIODevice::ReadOnly)) {
+            automask = BinaryImage(ImageLoader::load(automask_file, 0));
+        }
+        if (automask.isNull() || automask.size() != image.size()) {
+            return false;
+        }
+    }
+    if (write_speckles_file) {
+        QFile speckles_file(file_paths[idx++]);
+        if (speckles_file.open(QIODevice::ReadOnly)) {
+            speckles = BinaryImage(ImageLoader::load(speckles_file, 0));
+        }
+        if (speckles.isNull()) {
+            return false;
+        }
+    }
+
+    // That's what OutputGenerator would have done to them.
+    picture_zones = cached_params.pictureZones();
+    m_ptrSettings->setPictureZones(m_pageId, picture_zones);
+    output_image_params.setTiffCompression(
+        cached_params.outputImageParams().TiffCompression()
+    );
+
+    out_img = image;
+    automask_img.swap(automask);
+    speckles_img.swap(speckles);
+    return true;
+}
+
+void
+Task::postPreview(
+    TaskStatus const& status, FilterData const& data,
+    QPolygonF const& content_rect_phys, Params const& params,
+    ZoneSet const& picture_zones, ZoneSet const& fill_zones,
+    DistortionModel const& distortion_model)
+{
+    Dpi const preview_dpi(previewDpi(params.outputDpi()));
+    if (preview_dpi.isNull()) {
+        return;
+    }
+
+    ImageTransformation preview_xform(data.xform());
+    preview_xform.postScaleToDpi(preview_dpi);
+
+    OutputGenerator const generator(
+        preview_dpi, params.colorParams(), params.despeckleLevel(),
+        preview_xform, content_rect_phys
+    );
+
+    // The generator may update picture zones and the distortion model,
+    // and store the former in settings.  None of that must leak
+    // from a preview, hence the copies and the throwaway settings.
+    // Distortion models are in original image coordinates,
+    // so they apply at any output resolution.
+    ZoneSet preview_picture_zones(picture_zones);
+    DistortionModel preview_distortion_model(distortion_model);
+    PageId preview_page_id(m_pageId);
+    IntrusivePtr<Settings> preview_settings(new Settings);
+
+    QImage const preview(
+        generator.process(
+            status, data, preview_picture_zones, fill_zones,
+            params.dewarpingMode(), preview_distortion_model,
+            params.depthPerception(), false, nullptr, nullptr, nullptr,
+            &preview_page_id, &preview_settings
+        )
+    );
+
+    status.throwIfCancelled();
+
+    if (!preview.isNull()) {
+        status.postPreview(FilterResultPtr(new PreviewUpdater(m_ptrFilter, preview)));
+    }
+}
+
 QObject*
 Task::getSettingsListener()
 {
@@ -641,15 +1094,10 @@ Task::UiUpdater::updateUI(FilterUiInterface* ui)
         new ImageView(m_outputImage, m_downscaledOutputImage)
     );
 
-    std::shared_ptr<QImage> alt_image_ptr;
-    std::shared_ptr<QPixmap> alt_downscaled_pixmap_ptr;
-
+    std::shared_ptr<AlternativeImageSource> alt_image_source;
     if (QSettings().value(_key_output_show_orig_on_space, _key_output_show_orig_on_space_def).toBool()) {
-        alt_image_ptr.reset(getAlternativeImage());
-        if (alt_image_ptr) {
-            image_view->setAlternativeImage(alt_image_ptr, shared_ptr<QPixmap>());
-            alt_downscaled_pixmap_ptr = image_view->getAlternativePixmap();
-        }
+        alt_image_source = alternativeImageSource();
+        image_view->setAlternativeImageSource(alt_image_source);
     }
 
     QPixmap const downscaled_output_pixmap(image_view->downscaledPixmap());
@@ -739,8 +1187,8 @@ Task::UiUpdater::updateUI(FilterUiInterface* ui)
     QObject::connect(fill_zone_editor.get(), SIGNAL(deleteZoneFromPagesDlgRequest(void*)),
                      opt_widget, SLOT(deleteZoneFromPagesDlgRequest(void*)));
 
-    if (alt_image_ptr) {
-        qobject_cast<FillZoneEditor*>(fill_zone_editor.get())->setAlternativeImage(alt_image_ptr, alt_downscaled_pixmap_ptr);
+    if (alt_image_source) {
+        qobject_cast<FillZoneEditor*>(fill_zone_editor.get())->setAlternativeImageSource(alt_image_source);
     }
 
     QObject::connect(
@@ -761,9 +1209,9 @@ Task::UiUpdater::updateUI(FilterUiInterface* ui)
         );
 
         QObject::connect(qobject_cast<DespeckleView*>(despeckle_view.get()), &DespeckleView::imageViewCreated,
-        [alt_image_ptr, alt_downscaled_pixmap_ptr](ImageViewBase * ivb) {
-            if (ivb && alt_image_ptr) {
-                ivb->setAlternativeImage(alt_image_ptr, alt_downscaled_pixmap_ptr);
+        [alt_image_source](ImageViewBase * ivb) {
+            if (ivb && alt_image_source) {
+                ivb->setAlternativeImageSource(alt_image_source);
             }
         });
 
@@ -791,13 +1239,19 @@ Task::UiUpdater::updateUI(FilterUiInterface* ui)
     ui->setImageWidget(tab_widget.release(), ui->TRANSFER_OWNERSHIP, m_ptrDbg.get());
 }
 
-QVector<QRgb> _gray_palette;
+namespace
+{
 
-QImage*
-Task::UiUpdater::getAlternativeImage()
+/**
+ * Builds the "before" image: the original one transformed to the output
+ * geometry, with everything outside of the content box left white.
+ */
+QImage buildAlternativeImage(
+    QImage const& orig_image, ImageTransformation const& xform,
+    QRect const& virt_content_rect, int const dpm_x, int const dpm_y)
 {
-    QRect outRect(m_xform.resultingRect().toAlignedRect());
-    QRect contentRect(m_virtContentRect);
+    QRect outRect(xform.resultingRect().toAlignedRect());
+    QRect contentRect(virt_content_rect);
 
     if (outRect.left() < 0) {
         outRect.setLeft(0);
@@ -818,39 +1272,117 @@ Task::UiUpdater::getAlternativeImage()
         contentRect.setBottom(outRect.bottom());
     }
 
-    QImage src = transform(m_origImage, m_xform.transform(),
+    QImage src = transform(orig_image, xform.transform(),
                            contentRect, imageproc::OutsidePixels::assumeColor(Qt::white));
 
     QSize const target_size(outRect.size().expandedTo(QSize(1, 1)));
 
-    QImage* res = new QImage(target_size, m_origImage.format());
-    if (res->format() == QImage::Format_Indexed8) {
-        if (_gray_palette.size() < 256) {
-            // init gray_palette
-            for (int i = 0; i < _gray_palette.size(); ++i) {
-                _gray_palette[i] = qRgb(i, i, i);
-            }
-            for (int i = _gray_palette.size(); i < 256; ++i) {
-                _gray_palette.append(qRgb(i, i, i));
-            }
+    QImage res(target_size, orig_image.format());
+    if (res.format() == QImage::Format_Indexed8) {
+        QVector<QRgb> gray_palette(256);
+        for (int i = 0; i < 256; ++i) {
+            gray_palette[i] = qRgb(i, i, i);
         }
-        res->setColorTable(_gray_palette);
+        res.setColorTable(gray_palette);
     }
-    res->fill(Qt::white);
+    res.fill(Qt::white);
 
-    if (src.format() != res->format()) {
-        src = src.convertToFormat(res->format());
+    if (src.format() != res.format()) {
+        src = src.convertToFormat(res.format());
     }
 
     QRect const src_rect(src.rect());
     QRect dst_rect(contentRect);
     dst_rect.setSize(src_rect.size()); //to be 100% safe
 
-    imageproc::drawOver(*res, dst_rect, src, src_rect);
-    res->setDotsPerMeterX(m_outputImage.dotsPerMeterX());
-    res->setDotsPerMeterY(m_outputImage.dotsPerMeterY());
+    imageproc::drawOver(res, dst_rect, src, src_rect);
+    res.setDotsPerMeterX(dpm_x);
+    res.setDotsPerMeterY(dpm_y);
 
     return res;
 }
 
+/**
+ * The alternative image source of the page shown last.  Reprocessing
+ * a page without changing its geometry, as most output options do,
+ * then reuses the image if it was built.  Only accessed from the GUI thread.
+ */
+struct AlternativeImageCache
+{
+    PageId pageId;
+    QTransform xform;
+    QRectF resultingRect;
+    QRect contentRect;
+    QSize origSize;
+    int dpmX;
+    int dpmY;
+    std::weak_ptr<AlternativeImageSource> source;
+
+    AlternativeImageCache() : dpmX(0), dpmY(0) {}
+};
+
+AlternativeImageCache alternativeImageCache;
+
+} // anonymous namespace
+
+std::shared_ptr<AlternativeImageSource>
+Task::UiUpdater::alternativeImageSource() const
+{
+    AlternativeImageCache& cache = alternativeImageCache;
+    int const dpm_x = m_outputImage.dotsPerMeterX();
+    int const dpm_y = m_outputImage.dotsPerMeterY();
+
+    std::shared_ptr<AlternativeImageSource> source(cache.source.lock());
+    if (source && cache.pageId == m_pageId && cache.xform == m_xform.transform()
+            && cache.resultingRect == m_xform.resultingRect()
+            && cache.contentRect == m_virtContentRect
+            && cache.origSize == m_origImage.size()
+            && cache.dpmX == dpm_x && cache.dpmY == dpm_y) {
+        return source;
+    }
+
+    source.reset(
+        new AlternativeImageSource(
+            boost::bind(
+                &buildAlternativeImage, m_origImage, m_xform,
+                m_virtContentRect, dpm_x, dpm_y
+            )
+        )
+    );
+
+    cache.pageId = m_pageId;
+    cache.xform = m_xform.transform();
+    cache.resultingRect = m_xform.resultingRect();
+    cache.contentRect = m_virtContentRect;
+    cache.origSize = m_origImage.size();
+    cache.dpmX = dpm_x;
+    cache.dpmY = dpm_y;
+    cache.source = source;
+
+    return source;
+}
+
+/*============================ Task::PreviewUpdater ==========================*/
+
+Task::PreviewUpdater::PreviewUpdater(
+    IntrusivePtr<Filter> const& filter, QImage const& preview)
+    :   m_ptrFilter(filter),
+        m_preview(preview),
+        m_downscaledPreview(ImageView::createDownscaledImage(preview))
+{
+}
+
+void
+Task::PreviewUpdater::updateUI(FilterUiInterface* ui)
+{
+    // This function is executed from the GUI thread.
+
+    ImageView* const view = new ImageView(m_preview, m_downscaledPreview);
+    view->interactionState().setDefaultStatusTip(
+        tr("Preview at reduced resolution. The full output is being generated.")
+    );
+    view->ensureStatusTip(view->interactionState().statusTip());
+    ui->setImageWidget(view, ui->TRANSFER_OWNERSHIP);
+}
+
 } // namespace output
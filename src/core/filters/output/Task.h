@@ -25,6 +25,7 @@
 #include "PageId.h"
 #include "ImageViewTab.h"
 #include "OutputFileNameGenerator.h"
+#include "IntermediateCache.h"
 #include <QColor>
 #include <memory>
 #include <QImage>
@@ -38,6 +39,13 @@ class QPolygonF;
 class QSize;
 class QImage;
 class Dpi;
+class ZoneSet;
+class QStringList;
+
+namespace dewarping
+{
+class DistortionModel;
+}
 
 namespace imageproc
 {
@@ -49,6 +57,8 @@ namespace output
 
 class Filter;
 class Settings;
+class Params;
+class OutputImageParams;
 
 class Task : public RefCountable
 {
@@ -61,7 +71,9 @@ public:
          ImageViewTab last_tab, bool batch, bool debug,
          bool keep_orig_fore_subscan = false,
 //Original_Foreground_Mixed
-         QImage* p_orig_fore_subscan = nullptr);
+         QImage* p_orig_fore_subscan = nullptr,
+         QImage* p_out_img = nullptr,
+         imageproc::BinaryImage* p_automask = nullptr);
 
     virtual ~Task();
 
@@ -72,8 +84,29 @@ public:
     QObject* getSettingsListener();
 private:
     class UiUpdater;
+    class PreviewUpdater;
+
+    static void deleteMutuallyExclusiveOutputFiles(
+        PageId const& page_id, OutputFileNameGenerator const& out_file_name_gen);
+
+    /**
+     * \brief Renders the page at a fraction of the output resolution
+     *        and posts it through \p status.
+     *
+     * Neither settings nor the arguments are modified.
+     */
+    void postPreview(
+        TaskStatus const& status, FilterData const& data,
+        QPolygonF const& content_rect_phys, Params const& params,
+        ZoneSet const& picture_zones, ZoneSet const& fill_zones,
+        dewarping::DistortionModel const& distortion_model);
 
-    void deleteMutuallyExclusiveOutputFiles();
+    bool fetchSharedOutput(
+        IntermediateCache::Key const& key, QStringList const& file_paths,
+        bool write_automask, bool write_speckles_file,
+        OutputImageParams& output_image_params, ZoneSet& picture_zones,
+        QImage& out_img, imageproc::BinaryImage& automask_img,
+        imageproc::BinaryImage& speckles_img);
 
     IntrusivePtr<Filter> m_ptrFilter;
     IntrusivePtr<Settings> m_ptrSettings;
@@ -87,6 +120,9 @@ private:
     bool m_keep_orig_fore_subscan;
 //Original_Foreground_Mixed
     QImage* m_p_orig_fore_subscan;
+    // If set, receive the output image and automask on success.
+    QImage* m_p_out_img;
+    imageproc::BinaryImage* m_p_automask;
 };
 
 } // namespace output
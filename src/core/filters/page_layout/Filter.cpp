@@ -42,6 +42,7 @@
 #include <QDomElement>
 #include <assert.h>
 #include "CommandLine.h"
+#include "OrderByProcessingTime.h"
 #include "XmlMarshaller.h"
 #include "XmlUnmarshaller.h"
 
@@ -68,6 +69,8 @@ Filter::Filter(IntrusivePtr<ProjectPages> const& pages,
     ProviderPtr const order_by_height(new OrderByHeightProvider(m_ptrSettings));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Natural order"), default_order));
     m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Processed then unprocessed"), ProviderPtr(new OrderByReadiness())));
+    m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Order by processing time"), ProviderPtr(new OrderByProcessingTime()),
+                                 QObject::tr("Puts the pages that took longest to process first")));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Order by alignment type"), order_by_alignment));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Order by increasing width"), order_by_width,
                                  tr("Groups the pages by the width of detected content zone\n"
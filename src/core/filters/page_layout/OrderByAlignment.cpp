@@ -37,50 +37,25 @@ OrderByAlignment::precedes(
     PageId const& lhs_page, bool const lhs_incomplete,
     PageId const& rhs_page, bool const rhs_incomplete) const
 {
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
 
-    if (lhs_incomplete != rhs_incomplete) {
+bool
+OrderByAlignment::sortKey(PageId const& page, bool const incomplete, SortKey& key) const
+{
+    if (incomplete) {
         // Pages with question mark go to the bottom.
-        return rhs_incomplete;
-    } else if (lhs_incomplete) {
-        assert(rhs_incomplete);
-        // Two pages with question marks are ordered naturally.
-        return lhs_page < rhs_page;
-    }
-
-    assert(lhs_incomplete == false);
-    assert(rhs_incomplete == false);
-
-    std::unique_ptr<Params> const lhs_params(m_ptrSettings->getPageParams(lhs_page));
-    std::unique_ptr<Params> const rhs_params(m_ptrSettings->getPageParams(rhs_page));
-
-    bool lhs_is_null = true;
-    int lhs_alignment;
-    if (lhs_params.get()) {
-        lhs_is_null = lhs_params->alignment().isNull();
-        lhs_alignment = lhs_params->alignment().compositeAlignment();
+        key[0] = 1;
+        return true;
     }
 
-    bool rhs_is_null = true;
-    int rhs_alignment;
-    if (rhs_params.get()) {
-        rhs_is_null = rhs_params->alignment().isNull();
-        rhs_alignment = rhs_params->alignment().compositeAlignment();
-    }
-
-    if (lhs_is_null != rhs_is_null) {
-        // Pages with no alignment go to the top.
-        return lhs_is_null;
-    } else if (lhs_is_null) {
-        assert(rhs_is_null);
-        // Two pages with no alignmen are ordered naturally.
-        return lhs_page < rhs_page;
-    }
-
-    if (lhs_alignment != rhs_alignment) {
-        return (!(lhs_alignment < rhs_alignment));
-    } else {
-        return lhs_page < rhs_page;
+    std::unique_ptr<Params> const params(m_ptrSettings->getPageParams(page));
+    if (params.get() && !params->alignment().isNull()) {
+        // Pages with no alignment go to the top, the rest by decreasing alignment.
+        key[1] = 1;
+        key[2] = -params->alignment().compositeAlignment();
     }
+    return true;
 }
 
 QString
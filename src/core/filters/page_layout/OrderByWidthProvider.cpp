@@ -37,59 +37,35 @@ OrderByWidthProvider::precedes(
     PageId const& lhs_page, bool const lhs_incomplete,
     PageId const& rhs_page, bool const rhs_incomplete) const
 {
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
 
-    if (lhs_incomplete != rhs_incomplete) {
+bool
+OrderByWidthProvider::sortKey(PageId const& page, bool const incomplete, SortKey& key) const
+{
+    if (incomplete) {
         // Pages with question mark go to the bottom.
-        return rhs_incomplete;
-    } else if (lhs_incomplete) {
-        assert(rhs_incomplete);
-        // Two pages with question marks are ordered naturally.
-        return lhs_page < rhs_page;
+        key[0] = 1;
+        return true;
     }
 
-    assert(lhs_incomplete == false);
-    assert(rhs_incomplete == false);
-
-    std::unique_ptr<Params> const lhs_params(m_ptrSettings->getPageParams(lhs_page));
-    std::unique_ptr<Params> const rhs_params(m_ptrSettings->getPageParams(rhs_page));
-
-    QSizeF lhs_size;
-    if (lhs_params.get()) {
-        Margins const margins(lhs_params->hardMarginsMM());
-        lhs_size = lhs_params->contentSizeMM();
-        lhs_size += QSizeF(
-                        margins.left() + margins.right(), margins.top() + margins.bottom()
-                    );
-    }
-    QSizeF rhs_size;
-    if (rhs_params.get()) {
-        Margins const margins(rhs_params->hardMarginsMM());
-        rhs_size = rhs_params->contentSizeMM();
-        rhs_size += QSizeF(
-                        margins.left() + margins.right(), margins.top() + margins.bottom()
-                    );
+    std::unique_ptr<Params> const params(m_ptrSettings->getPageParams(page));
+    QSizeF size;
+    if (params.get()) {
+        Margins const margins(params->hardMarginsMM());
+        size = params->contentSizeMM();
+        size += QSizeF(
+                    margins.left() + margins.right(), margins.top() + margins.bottom()
+                );
     }
 
-    bool const lhs_invalid = !lhs_size.isValid();
-    bool const rhs_invalid = !rhs_size.isValid();
-
-    if (lhs_invalid != rhs_invalid) {
+    if (!size.isValid()) {
         // Pages with question mark go to the bottom.
-        return rhs_invalid;
-    } else if (lhs_invalid) {
-        assert(rhs_invalid);
-        // Two pages with question marks are ordered naturally.
-        return lhs_page < rhs_page;
-    }
-
-    assert(lhs_invalid == false);
-    assert(rhs_incomplete == false);
-
-    if (lhs_size.width() != rhs_size.width()) {
-        return lhs_size.width() < rhs_size.width();
+        key[1] = 1;
     } else {
-        return lhs_page < rhs_page;
+        key[2] = size.width();
     }
+    return true;
 }
 
 QString
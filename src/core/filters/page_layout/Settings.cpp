@@ -27,8 +27,9 @@
 #include "CommandLine.h"
 #include <QSizeF>
 #include <QRectF>
-#include <QMutex>
-#include <QMutexLocker>
+#include <QReadWriteLock>
+#include <QReadLocker>
+#include <QWriteLocker>
 #ifndef Q_MOC_RUN
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -223,7 +224,7 @@ private:
     typedef Container::index<DescWidthTag>::type DescWidthOrder;
     typedef Container::index<DescHeightTag>::type DescHeightOrder;
 
-    mutable QMutex m_mutex;
+    mutable QReadWriteLock m_lock;
     Container m_items;
     UnorderedItems& m_unorderedItems;
     DescWidthOrder& m_descWidthOrder;
@@ -424,14 +425,14 @@ Settings::Impl::~Impl()
 void
 Settings::Impl::clear()
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_items.clear();
 }
 
 void
 Settings::Impl::performRelinking(AbstractRelinker const& relinker)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     Container new_items;
 
     for (Item const& item : m_unorderedItems) {
@@ -447,7 +448,7 @@ Settings::Impl::performRelinking(AbstractRelinker const& relinker)
 void
 Settings::Impl::removePagesMissingFrom(PageSequence const& pages)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     std::vector<PageId> sorted_pages;
     sorted_pages.reserve(pages.numPages());
@@ -470,7 +471,7 @@ Settings::Impl::removePagesMissingFrom(PageSequence const& pages)
 void
 Settings::Impl::removePages(std::set<PageId> const& pages)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     UnorderedItems::const_iterator it(m_unorderedItems.begin());
     UnorderedItems::const_iterator const end(m_unorderedItems.end());
@@ -487,7 +488,7 @@ bool
 Settings::Impl::checkEverythingDefined(
     PageSequence const& pages, PageId const* ignore) const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     for (const PageInfo& page_info : pages) {
         if (ignore && *ignore == page_info.id()) {
@@ -505,7 +506,7 @@ Settings::Impl::checkEverythingDefined(
 std::unique_ptr<Params>
 Settings::Impl::getPageParams(PageId const& page_id) const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     Container::iterator const it(m_items.find(page_id));
     if (it == m_items.end()) {
@@ -520,7 +521,7 @@ Settings::Impl::getPageParams(PageId const& page_id) const
 void
 Settings::Impl::setPageParams(PageId const& page_id, Params const& params)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     Item const new_item(
         page_id, params.hardMarginsMM(), params.pageRect(),
@@ -540,7 +541,7 @@ Settings::Impl::getParams(
     PageId const& page_id, QRectF const& page_rect, QRectF const& content_rect, QSizeF const& content_size_mm,
     QSizeF* agg_hard_size_before, QSizeF* agg_hard_size_after)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     if (agg_hard_size_before) {
         *agg_hard_size_before = getAggregateHardSizeMMLocked();
@@ -572,7 +573,7 @@ Settings::Impl::getParams(
 MarginsWithAuto
 Settings::Impl::getHardMarginsMM(PageId const& page_id) const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     Container::iterator const it(m_items.find(page_id));
     if (it == m_items.end()) {
@@ -586,7 +587,7 @@ void
 Settings::Impl::setHardMarginsMM(
     PageId const& page_id, MarginsWithAuto const& margins_mm)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     Container::iterator const it(m_items.lower_bound(page_id));
     if (it == m_items.end() || page_id < it->pageId) {
@@ -602,7 +603,7 @@ Settings::Impl::setHardMarginsMM(
 Alignment
 Settings::Impl::getPageAlignment(PageId const& page_id) const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     Container::iterator const it(m_items.find(page_id));
     if (it == m_items.end()) {
@@ -616,7 +617,7 @@ Settings::AggregateSizeChanged
 Settings::Impl::setPageAlignment(
     PageId const& page_id, Alignment const& alignment)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     QSizeF const agg_size_before(getAggregateHardSizeMMLocked());
 
@@ -642,7 +643,7 @@ Settings::AggregateSizeChanged
 Settings::Impl::setContentSizeMM(
     PageId const& page_id, QSizeF const& content_size_mm, QRectF const& content_rect)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     QSizeF const agg_size_before(getAggregateHardSizeMMLocked());
 
@@ -668,7 +669,7 @@ Settings::Impl::setContentSizeMM(
 void
 Settings::Impl::invalidateContentSize(PageId const& page_id)
 {
-    QMutexLocker const locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     Container::iterator const it(m_items.find(page_id));
     if (it != m_items.end()) {
@@ -679,7 +680,7 @@ Settings::Impl::invalidateContentSize(PageId const& page_id)
 QSizeF
 Settings::Impl::getAggregateHardSizeMM() const
 {
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
     return getAggregateHardSizeMMLocked();
 }
 
@@ -708,7 +709,7 @@ Settings::Impl::getAggregateHardSizeMM(
         return getAggregateHardSizeMM();
     }
 
-    QMutexLocker const locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     if (m_items.empty()) {
         return QSizeF(0.0, 0.0);
@@ -30,6 +30,7 @@
 #include "ImageTransformation.h"
 #include "PhysicalTransformation.h"
 #include "filters/output/Task.h"
+#include "Profiler.h"
 #include <QSizeF>
 #include <QRectF>
 #include <QLineF>
@@ -94,6 +95,9 @@ Task::process(
     TaskStatus const& status, FilterData const& data,
     QRectF const& page_rect, QRectF const& content_rect)
 {
+    Profiler::Scope const profile_scope("page_layout", m_pageId);
+    Profiler::addCounter("pixels", qint64(data.origImage().width()) * data.origImage().height());
+
     status.throwIfCancelled();
 
     QSizeF const content_size_mm(
@@ -37,6 +37,7 @@
 #include <QDomElement>
 #include <stddef.h>
 #include "CommandLine.h"
+#include "OrderByProcessingTime.h"
 #include "OrderBySplitTypeProvider.h"
 #include "OrderByPageSizeProvider.h"
 
@@ -47,16 +48,9 @@ Filter::Filter(IntrusivePtr<ProjectPages> const& page_sequence,
                PageSelectionAccessor const& page_selection_accessor)
     :   m_ptrPages(page_sequence),
         m_ptrSettings(new Settings),
+        m_pageSelectionAccessor(page_selection_accessor),
         m_selectedPageOrder(0)
 {
-    if (CommandLine::get().isGui()) {
-        m_ptrOptionsWidget.reset(
-            new OptionsWidget(
-                m_ptrSettings, m_ptrPages, page_selection_accessor
-            )
-        );
-    }
-
     typedef PageOrderOption::ProviderPtr ProviderPtr;
 
     ProviderPtr const default_order;
@@ -65,6 +59,8 @@ Filter::Filter(IntrusivePtr<ProjectPages> const& page_sequence,
 
     m_pageOrderOptions.push_back(PageOrderOption(tr("Natural order"), default_order));
     m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Processed then unprocessed"), ProviderPtr(new OrderByReadiness())));
+    m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Order by processing time"), ProviderPtr(new OrderByProcessingTime()),
+                                 QObject::tr("Puts the pages that took longest to process first")));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Order by split type"), order_by_splitline));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Order by page size"), order_by_page_size));
 }
@@ -73,6 +69,17 @@ Filter::~Filter()
 {
 }
 
+OptionsWidget*
+Filter::optionsWidget()
+{
+    if (!m_ptrOptionsWidget.get() && CommandLine::get().isGui()) {
+        m_ptrOptionsWidget.reset(
+            new OptionsWidget(m_ptrSettings, m_ptrPages, m_pageSelectionAccessor)
+        );
+    }
+    return m_ptrOptionsWidget.get();
+}
+
 QString
 Filter::getName() const
 {
@@ -94,8 +101,8 @@ Filter::performRelinking(AbstractRelinker const& relinker)
 void
 Filter::preUpdateUI(FilterUiInterface* ui, PageId const& page_id)
 {
-    m_ptrOptionsWidget->preUpdateUI(page_id);
-    ui->setOptionsWidget(m_ptrOptionsWidget.get(), ui->KEEP_OWNERSHIP);
+    optionsWidget()->preUpdateUI(page_id);
+    ui->setOptionsWidget(optionsWidget(), ui->KEEP_OWNERSHIP);
 }
 
 QDomElement
@@ -25,6 +25,7 @@
 #include "IntrusivePtr.h"
 #include "FilterResult.h"
 #include "SafeDeletingQObjectPtr.h"
+#include "PageSelectionAccessor.h"
 #include <set>
 #include "PageOrderOption.h"
 #include <QCoreApplication>
@@ -33,7 +34,6 @@ class PageId;
 class ImageId;
 class PageInfo;
 class ProjectPages;
-class PageSelectionAccessor;
 class OrthogonalRotation;
 
 namespace deskew
@@ -82,10 +82,13 @@ public:
     IntrusivePtr<CacheDrivenTask> createCacheDrivenTask(
         IntrusivePtr<deskew::CacheDrivenTask> const& next_task);
 
-    OptionsWidget* optionsWidget()
-    {
-        return m_ptrOptionsWidget.get();
-    }
+    /**
+     * \brief Returns the options widget, creating it on first use.
+     *
+     * Returns null when not running the GUI.  Must only be called
+     * from the GUI thread.
+     */
+    OptionsWidget* optionsWidget();
 
     void pageOrientationUpdate(
         ImageId const& image_id, OrthogonalRotation const& orientation);
@@ -106,6 +109,7 @@ private:
 
     IntrusivePtr<ProjectPages> m_ptrPages;
     IntrusivePtr<Settings> m_ptrSettings;
+    PageSelectionAccessor m_pageSelectionAccessor;
     SafeDeletingQObjectPtr<OptionsWidget> m_ptrOptionsWidget;
     std::vector<PageOrderOption> m_pageOrderOptions;
     int m_selectedPageOrder;
@@ -69,26 +69,20 @@ OrderByPageSizeProvider::precedes(
     PageId const& lhs_page, bool const lhs_incomplete,
     PageId const& rhs_page, bool const rhs_incomplete) const
 {
-    if (lhs_incomplete != rhs_incomplete) {
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
+
+bool
+OrderByPageSizeProvider::sortKey(PageId const& page, bool const incomplete, SortKey& key) const
+{
+    if (incomplete) {
         // Pages with question mark go to the bottom.
-        return rhs_incomplete;
-    } else if (lhs_incomplete) {
-        assert(rhs_incomplete);
-        // Two pages with question marks are ordered naturally.
-        return lhs_page < rhs_page;
+        key[0] = 1;
+        return true;
     }
 
-    assert(lhs_incomplete == false);
-    assert(rhs_incomplete == false);
-
-    qreal const lhs_max_page_size = getMaxPageWidth(m_ptrSettings->getPageRecord(lhs_page.imageId()));
-    qreal const rhs_max_page_size = getMaxPageWidth(m_ptrSettings->getPageRecord(rhs_page.imageId()));
-
-    if (lhs_max_page_size != rhs_max_page_size) {
-        return lhs_max_page_size < rhs_max_page_size;
-    } else {
-        return lhs_page < rhs_page;
-    }
+    key[1] = getMaxPageWidth(m_ptrSettings->getPageRecord(page.imageId()));
+    return true;
 }
 
 QString
@@ -38,45 +38,31 @@ OrderBySplitTypeProvider::precedes(
     PageId const& lhs_page, bool const lhs_incomplete,
     PageId const& rhs_page, bool const rhs_incomplete) const
 {
-    if (lhs_incomplete != rhs_incomplete) {
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
+
+bool
+OrderBySplitTypeProvider::sortKey(PageId const& page, bool const incomplete, SortKey& key) const
+{
+    if (incomplete) {
         // Pages with question mark go to the bottom.
-        return rhs_incomplete;
-    } else if (lhs_incomplete) {
-        assert(rhs_incomplete);
-        // Two pages with question marks are ordered naturally.
-        return lhs_page < rhs_page;
+        key[0] = 1;
+        return true;
     }
 
-    assert(lhs_incomplete == false);
-    assert(rhs_incomplete == false);
-
-    Settings::Record const lhs_record(m_ptrSettings->getPageRecord(lhs_page.imageId()));
-    Settings::Record const rhs_record(m_ptrSettings->getPageRecord(rhs_page.imageId()));
-
-    Params const* lhs_params = lhs_record.params();
-    Params const* rhs_params = rhs_record.params();
-
-    int lhs_layout_type = lhs_record.combinedLayoutType();
-    if (lhs_params) {
-        lhs_layout_type = lhs_params->pageLayout().toLayoutType();
-    }
-    if (lhs_layout_type == AUTO_LAYOUT_TYPE) {
-        lhs_layout_type = 100; // To force it below pages with known layout.
-    }
+    Settings::Record const record(m_ptrSettings->getPageRecord(page.imageId()));
+    Params const* params = record.params();
 
-    int rhs_layout_type = rhs_record.combinedLayoutType();
-    if (rhs_params) {
-        rhs_layout_type = rhs_params->pageLayout().toLayoutType();
+    int layout_type = record.combinedLayoutType();
+    if (params) {
+        layout_type = params->pageLayout().toLayoutType();
     }
-    if (rhs_layout_type == AUTO_LAYOUT_TYPE) {
-        rhs_layout_type = 100; // To force it below pages with known layout.
+    if (layout_type == AUTO_LAYOUT_TYPE) {
+        layout_type = 100; // To force it below pages with known layout.
     }
 
-    if (lhs_layout_type == rhs_layout_type) {
-        return lhs_page < rhs_page;
-    } else {
-        return lhs_layout_type < rhs_layout_type;
-    }
+    key[1] = layout_type;
+    return true;
 }
 
 QString
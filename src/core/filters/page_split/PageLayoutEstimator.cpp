@@ -26,6 +26,10 @@
 #include "DebugImages.h"
 #include "Dpi.h"
 #include "ImageTransformation.h"
+#include "FilterData.h"
+#include "IntermediateCache.h"
+#include "ConcurrentJobs.h"
+#include "ImageId.h"
 #include "foundation/Span.h"
 #include "imageproc/Binarize.h"
 #include "imageproc/BinaryThreshold.h"
@@ -35,7 +39,7 @@
 #include "imageproc/SeedFill.h"
 #include "imageproc/ReduceThreshold.h"
 #include "imageproc/ConnComp.h"
-#include "imageproc/ConnCompEraserExt.h"
+#include "imageproc/ConnCompExtractor.h"
 #include "imageproc/SkewFinder.h"
 #include "imageproc/Constants.h"
 #include "imageproc/RasterOp.h"
@@ -244,23 +248,21 @@ int numPages(LayoutType const layout_type, ImageTransformation const& pre_xform)
 
 PageLayout
 PageLayoutEstimator::estimatePageLayout(
-    LayoutType const layout_type, QImage const& input,
-    ImageTransformation const& pre_xform,
-    BinaryThreshold const bw_threshold,
-    DebugImages* const dbg)
+    LayoutType const layout_type, FilterData const& data,
+    ImageId const& image_id, DebugImages* const dbg)
 {
     if (layout_type == SINGLE_PAGE_UNCUT) {
-        return PageLayout(pre_xform.resultingRect());
+        return PageLayout(data.xform().resultingRect());
     }
 
     std::unique_ptr<PageLayout> layout(
-        tryCutAtFoldingLine(layout_type, input, pre_xform, dbg)
+        tryCutAtFoldingLine(layout_type, data.grayImage(), data.xform(), dbg)
     );
     if (layout.get()) {
         return *layout;
     }
 
-    return cutAtWhitespace(layout_type, input, pre_xform, bw_threshold, dbg);
+    return cutAtWhitespace(layout_type, data, image_id, dbg);
 }
 
 namespace
@@ -383,35 +385,58 @@ PageLayoutEstimator::tryCutAtFoldingLine(
  * \param layout_type The type of a layout to detect.  If set to
  *        something other than AUTO_LAYOUT_TYPE, the returned
  *        layout will have the same type.
- * \param input The input image.  Will be converted to grayscale unless
- *        it's already grayscale.
- * \param pre_xform The logical transformation applied to the input image.
+ * \param data The input image and the logical transformation applied to it.
  *        The resulting page layout will be in transformed coordinates.
- * \param bw_threshold The global binarization threshold for the input image.
+ * \param image_id The source of the input image, for caching.
  * \param dbg An optional sink for debugging images.
  * \return Even if no suitable whitespace was found, this function
  *         will return a PageLayout consistent with the layout_type requested.
  */
 PageLayout
 PageLayoutEstimator::cutAtWhitespace(
-    LayoutType const layout_type, QImage const& input,
-    ImageTransformation const& pre_xform,
-    BinaryThreshold const bw_threshold,
-    DebugImages* const dbg)
+    LayoutType const layout_type, FilterData const& data,
+    ImageId const& image_id, DebugImages* const dbg)
 {
-    QTransform xform;
+    QImage const& input = data.origImage();
+    ImageTransformation const& pre_xform = data.xform();
+    BinaryThreshold const bw_threshold(data.bwThreshold());
+
+    QTransform xform(data.to300DpiTransform());
+    BinaryImage img;
+
+    // The garbage-free 150 dpi image doesn't depend on the layout type,
+    // so switching layouts can skip producing it again.
+    // Debug images need the whole pipeline to run, so bypass the cache then.
+    IntermediateCache::Key cache_key;
+    if (!dbg) {
+        cache_key = IntermediateCache::Key(image_id, "page_split_150");
+        cache_key.add(QRect(input.rect()))
+        .add(input.dotsPerMeterX())
+        .add(input.dotsPerMeterY())
+        .add(int(bw_threshold))
+        .add(pre_xform.preRotation().toDegrees());
+    }
+
+    std::vector<BinaryImage> cached;
+    if (IntermediateCache::load(cache_key, cached, 1)) {
+        img = cached[0];
+    } else {
+        // Convert to B/W and rotate.  The 300 dpi gray level is shared
+        // with other stages through FilterData.
+        img = BinaryImage(data.grayImage300Dpi(), bw_threshold);
 
-    // Convert to B/W and rotate.
-    BinaryImage img(to300DpiBinary(input, xform, bw_threshold));
+        // Note: here we assume the only transformation applied
+        // to the input image is orthogonal rotation.
+        img = orthogonalRotation(img, pre_xform.preRotation().toDegrees());
+        if (dbg) {
+            dbg->add(img, "bw300");
+        }
 
-    // Note: here we assume the only transformation applied
-    // to the input image is orthogonal rotation.
-    img = orthogonalRotation(img, pre_xform.preRotation().toDegrees());
-    if (dbg) {
-        dbg->add(img, "bw300");
-    }
+        img = removeGarbageAnd2xDownscale(img, dbg);
 
-    img = removeGarbageAnd2xDownscale(img, dbg);
+        cached.assign(1, img);
+        IntermediateCache::store(cache_key, cached);
+    }
     xform.scale(0.5, 0.5);
     if (dbg) {
         dbg->add(img, "no_garbage");
@@ -498,9 +523,8 @@ PageLayoutEstimator::cutAtWhitespaceDeskewed150(
     BinaryImage cc_img(input.size(), WHITE);
 
     {
-        ConnCompEraser cc_eraser(input, CONN8);
-        ConnComp cc;
-        while (!(cc = cc_eraser.nextConnComp()).isNull()) {
+        ConnCompExtractor const extractor(input, CONN8);
+        for (ConnComp const& cc : extractor.connComps()) {
             if (cc.width() < 5 || cc.height() < 5) {
                 continue;
             }
@@ -548,29 +572,6 @@ PageLayoutEstimator::cutAtWhitespaceDeskewed150(
     }
 }
 
-imageproc::BinaryImage
-PageLayoutEstimator::to300DpiBinary(
-    QImage const& img, QTransform& xform,
-    BinaryThreshold const binary_threshold)
-{
-    double const xfactor = (300.0 * constants::DPI2DPM) / img.dotsPerMeterX();
-    double const yfactor = (300.0 * constants::DPI2DPM) / img.dotsPerMeterY();
-    if (fabs(xfactor - 1.0) < 0.1 && fabs(yfactor - 1.0) < 0.1) {
-        return BinaryImage(img, binary_threshold);
-    }
-
-    QTransform scale_xform;
-    scale_xform.scale(xfactor, yfactor);
-    xform *= scale_xform;
-    QSize const new_size(
-        std::max(1, (int)ceil(xfactor * img.width())),
-        std::max(1, (int)ceil(yfactor * img.height()))
-    );
-
-    GrayImage const new_image(scaleToGray(GrayImage(img), new_size));
-    return BinaryImage(new_image, binary_threshold);
-}
-
 BinaryImage
 PageLayoutEstimator::removeGarbageAnd2xDownscale(
     BinaryImage const& image, DebugImages* dbg)
@@ -581,8 +582,18 @@ PageLayoutEstimator::removeGarbageAnd2xDownscale(
     }
 
     // Remove anything not connected to a bar of at least 4 pixels long.
-    BinaryImage non_garbage_seed(openBrick(reduced, QSize(4, 1)));
-    BinaryImage non_garbage_seed2(openBrick(reduced, QSize(1, 4)));
+    BinaryImage non_garbage_seed;
+    BinaryImage non_garbage_seed2;
+    {
+        std::vector<boost::function<void()> > jobs;
+        jobs.push_back([&]() {
+            non_garbage_seed = openBrick(reduced, QSize(4, 1));
+        });
+        jobs.push_back([&]() {
+            non_garbage_seed2 = openBrick(reduced, QSize(1, 4));
+        });
+        runConcurrently(jobs);
+    }
     rasterOp<RopOr<RopSrc, RopDst> >(non_garbage_seed, non_garbage_seed2);
     non_garbage_seed2.release();
     reduced = seedFill(non_garbage_seed, reduced, CONN8);
@@ -592,8 +603,23 @@ PageLayoutEstimator::removeGarbageAnd2xDownscale(
         dbg->add(reduced, "garbage_removed");
     }
 
-    BinaryImage hor_seed(openBrick(reduced, QSize(200, 14), BLACK));
-    BinaryImage ver_seed(openBrick(reduced, QSize(14, 300), BLACK));
+    // These only read the reduced image, so they can run in parallel.
+    BinaryImage hor_seed;
+    BinaryImage ver_seed;
+    BinaryImage dilated;
+    {
+        std::vector<boost::function<void()> > jobs;
+        jobs.push_back([&]() {
+            hor_seed = openBrick(reduced, QSize(200, 14), BLACK);
+        });
+        jobs.push_back([&]() {
+            ver_seed = openBrick(reduced, QSize(14, 300), BLACK);
+        });
+        jobs.push_back([&]() {
+            dilated = dilateBrick(reduced, QSize(3, 3));
+        });
+        runConcurrently(jobs);
+    }
 
     rasterOp<RopOr<RopSrc, RopDst> >(hor_seed, ver_seed);
     BinaryImage seed(hor_seed.release());
@@ -602,8 +628,6 @@ PageLayoutEstimator::removeGarbageAnd2xDownscale(
         dbg->add(seed, "shadows_seed");
     }
 
-    BinaryImage dilated(dilateBrick(reduced, QSize(3, 3)));
-
     BinaryImage shadows_dilated(seedFill(seed, dilated, CONN8));
     dilated.release();
     if (dbg) {
@@ -19,7 +19,8 @@
 #include "Settings.h"
 #include "RelinkablePath.h"
 #include "AbstractRelinker.h"
-#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
 #include <assert.h>
 
 namespace page_split
@@ -37,7 +38,7 @@ Settings::~Settings()
 void
 Settings::clear()
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     m_perPageRecords.clear();
     m_defaultLayoutType = AUTO_LAYOUT_TYPE;
@@ -46,7 +47,7 @@ Settings::clear()
 void
 Settings::performRelinking(AbstractRelinker const& relinker)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     PerPageRecords new_records;
 
     for (PerPageRecords::value_type const& kv : m_perPageRecords) {
@@ -62,14 +63,14 @@ Settings::performRelinking(AbstractRelinker const& relinker)
 LayoutType
 Settings::defaultLayoutType() const
 {
-    QMutexLocker locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
     return m_defaultLayoutType;
 }
 
 void
 Settings::setLayoutTypeForAllPages(LayoutType const layout_type)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageRecords::iterator it(m_perPageRecords.begin());
     PerPageRecords::iterator const end(m_perPageRecords.end());
@@ -88,7 +89,7 @@ Settings::setLayoutTypeForAllPages(LayoutType const layout_type)
 void
 Settings::setLayoutTypeFor(LayoutType const layout_type, std::set<PageId> const& pages)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     UpdateAction action;
     //action.setLayoutType(layout_type);
@@ -101,7 +102,7 @@ Settings::setLayoutTypeFor(LayoutType const layout_type, std::set<PageId> const&
 Settings::Record
 Settings::getPageRecord(ImageId const& image_id) const
 {
-    QMutexLocker locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
     return getPageRecordLocked(image_id);
 }
 
@@ -119,7 +120,7 @@ Settings::getPageRecordLocked(ImageId const& image_id) const
 void
 Settings::updatePage(ImageId const& image_id, UpdateAction const& action)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     updatePageLocked(image_id, action);
 }
 
@@ -170,7 +171,7 @@ Settings::Record
 Settings::conditionalUpdate(
     ImageId const& image_id, UpdateAction const& action, bool* conflict)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
 
     PerPageRecords::iterator it(m_perPageRecords.lower_bound(image_id));
     if (it == m_perPageRecords.end() ||
@@ -26,7 +26,7 @@
 #include "Params.h"
 #include "ImageId.h"
 #include "PageId.h"
-#include <QMutex>
+#include <QReadWriteLock>
 #include <memory>
 #include <map>
 #include <set>
@@ -197,7 +197,7 @@ private:
 
     void updatePageLocked(PerPageRecords::iterator it, UpdateAction const& action);
 
-    mutable QMutex m_mutex;
+    mutable QReadWriteLock m_lock;
     PerPageRecords m_perPageRecords;
     LayoutType m_defaultLayoutType;
 };
@@ -39,6 +39,7 @@
 #include "ImageView.h"
 #include "FilterUiInterface.h"
 #include "DebugImages.h"
+#include "Profiler.h"
 #include <QImage>
 #include <QObject>
 #include <QDebug>
@@ -119,6 +120,9 @@ Task::~Task()
 FilterResultPtr
 Task::process(TaskStatus const& status, FilterData const& data)
 {
+    Profiler::Scope const profile_scope("page_split", m_pageInfo.id());
+    Profiler::addCounter("pixels", qint64(data.origImage().width()) * data.origImage().height());
+
     status.throwIfCancelled();
 
     Settings::Record record(m_ptrSettings->getPageRecord(m_pageInfo.imageId()));
@@ -163,9 +167,8 @@ Task::process(TaskStatus const& status, FilterData const& data)
 
         if (need_reprocess) {
             new_layout = PageLayoutEstimator::estimatePageLayout(
-                             record.combinedLayoutType(),
-                             data.grayImage(), data.xform(),
-                             data.bwThreshold(), m_ptrDbg.get()
+                             record.combinedLayoutType(), data,
+                             m_pageInfo.imageId(), m_ptrDbg.get()
                          );
             status.throwIfCancelled();
         } else if (params->pageLayout().uncutOutline().isEmpty()) {
@@ -37,8 +37,9 @@
 #include <QTransform>
 #include <Qt>
 #include <QDebug>
-#include <list>
+#include <vector>
 #include <algorithm>
+#include <utility>
 #include <math.h>
 
 namespace page_split
@@ -133,10 +134,6 @@ VertLineFinder::findLines(
     int const angle_steps_to_max = (int)(max_angle / angle_step);
     int const total_angle_steps = angle_steps_to_max * 2 + 1;
     double const min_angle = -angle_steps_to_max * angle_step;
-    HoughLineDetector line_detector(
-        raster_lines.size(), line_thickness,
-        min_angle, angle_step, total_angle_steps
-    );
 
     unsigned weight_table[256];
     buildWeightTable(weight_table);
@@ -147,60 +144,146 @@ VertLineFinder::findLines(
 
     int const x_limit = raster_lines.width() - margin;
     int const height = raster_lines.height();
-    uint8_t const* line = raster_lines.data();
     int const stride = raster_lines.stride();
-    for (int y = 0; y < height; ++y, line += stride) {
+    std::vector<int> row_xs;
+    std::vector<unsigned> row_weights;
+    row_xs.reserve(std::max(x_limit - margin, 0));
+    row_weights.reserve(row_xs.capacity());
+
+    unsigned const min_quality = (unsigned)(height * line_thickness * 1.8) + 1;
+
+    // The Hough transform is done in two stages.  The coarse one looks
+    // at every few rows, with coarser angles and distances, and only
+    // locates candidate lines.  The full resolution one then looks
+    // at narrow bands around the candidates, which is where all the
+    // pixels of the lines it could find are.
+    int const coarse_row_step = 4;
+    double const coarse_line_thickness = line_thickness * 2;
+    double const coarse_angle_step = 1.0;
+    int const coarse_angle_steps_to_max = (int)ceil(max_angle / coarse_angle_step);
+    HoughLineDetector coarse_detector(
+        raster_lines.size(), coarse_line_thickness,
+        -coarse_angle_steps_to_max * coarse_angle_step, coarse_angle_step,
+        coarse_angle_steps_to_max * 2 + 1
+    );
+
+    for (int y = 0; y < height; y += coarse_row_step) {
+        uint8_t const* const line = raster_lines.data() + y * stride;
+        row_xs.clear();
+        row_weights.clear();
         for (int x = margin; x < x_limit; ++x) {
             unsigned const val = line[x];
             if (val > 1) {
-                line_detector.process(x, y, weight_table[val]);
+                row_xs.push_back(x);
+                row_weights.push_back(weight_table[val]);
             }
         }
+        if (!row_xs.empty()) {
+            coarse_detector.processRow(y, &row_xs[0], &row_weights[0], int(row_xs.size()));
+        }
     }
 
-    unsigned const min_quality = (unsigned)(height * line_thickness * 1.8) + 1;
+    // Sampled rows and angle quantization both lose some of the quality,
+    // so the threshold is lowered to not miss anything.
+    unsigned const coarse_min_quality = min_quality / (coarse_row_step * 2);
+    std::vector<HoughLine> const candidates(coarse_detector.findLines(coarse_min_quality));
+
+    // A line found by the full resolution stage is within half a coarse
+    // angle step and half a coarse distance bin from a candidate.
+    double const band_half_width = coarse_line_thickness + line_thickness
+                                   + height * tan(coarse_angle_step * constants::DEG2RAD);
+
+    HoughLineDetector line_detector(
+        raster_lines.size(), line_thickness,
+        min_angle, angle_step, total_angle_steps
+    );
+
+    std::vector<std::pair<int, int> > bands;
+    uint8_t const* line = raster_lines.data();
+    for (int y = 0; y < height && !candidates.empty(); ++y, line += stride) {
+        bands.clear();
+        for (HoughLine const& candidate : candidates) {
+            double const x = candidate.pointAtY(y).x();
+            int const from = std::max(margin, (int)floor(x - band_half_width));
+            int const to = std::min(x_limit, (int)ceil(x + band_half_width) + 1);
+            if (from < to) {
+                bands.push_back(std::make_pair(from, to));
+            }
+        }
+        std::sort(bands.begin(), bands.end());
+
+        row_xs.clear();
+        row_weights.clear();
+        int x = margin;
+        for (std::pair<int, int> const& band : bands) {
+            for (x = std::max(x, band.first); x < band.second; ++x) {
+                unsigned const val = line[x];
+                if (val > 1) {
+                    row_xs.push_back(x);
+                    row_weights.push_back(weight_table[val]);
+                }
+            }
+        }
+        if (!row_xs.empty()) {
+            line_detector.processRow(y, &row_xs[0], &row_weights[0], int(row_xs.size()));
+        }
+    }
 
     if (dbg) {
+        dbg->add(coarse_detector.visualizeHoughSpace(coarse_min_quality), "coarse_hough_space");
         dbg->add(line_detector.visualizeHoughSpace(min_quality), "hough_space");
     }
 
     std::vector<HoughLine> const hough_lines(line_detector.findLines(min_quality));
 
-    typedef std::list<LineGroup> LineGroups;
-    LineGroups line_groups;
+    std::vector<QualityLine> quality_lines;
+    quality_lines.reserve(hough_lines.size());
     for (HoughLine const& hough_line : hough_lines) {
-        QualityLine const new_line(
-            hough_line.pointAtY(0.0),
-            hough_line.pointAtY(height),
-            hough_line.quality()
+        quality_lines.push_back(
+            QualityLine(
+                hough_line.pointAtY(0.0),
+                hough_line.pointAtY(height),
+                hough_line.quality()
+            )
         );
-        LineGroup* home_group = 0;
-
-        LineGroups::iterator it(line_groups.begin());
-        LineGroups::iterator const end(line_groups.end());
-        while (it != end) {
-            LineGroup& group = *it;
-            if (group.belongsHere(new_line)) {
-                if (home_group) {
-                    home_group->merge(group);
-                    line_groups.erase(it++);
-                    continue;
-                } else {
-                    group.add(new_line);
-                    home_group = &group;
-                }
-            }
-            ++it;
+    }
+
+    // Lines whose horizontal extents overlap, directly or through other
+    // lines, form a group.  Sweeping through them from left to right finds
+    // the groups without checking every line against every group.
+    std::vector<size_t> left_to_right(quality_lines.size());
+    for (size_t i = 0; i < left_to_right.size(); ++i) {
+        left_to_right[i] = i;
+    }
+    std::stable_sort(
+        left_to_right.begin(), left_to_right.end(),
+        [&quality_lines](size_t a, size_t b) {
+            return quality_lines[a].left().x() < quality_lines[b].left().x();
         }
+    );
 
-        if (!home_group) {
-            line_groups.push_back(LineGroup(new_line));
+    // Groups are paired with the position of their best line in hough_lines,
+    // which orders them by the descending quality of their leaders.
+    std::vector<std::pair<size_t, LineGroup> > line_groups;
+    for (size_t const idx : left_to_right) {
+        QualityLine const& new_line = quality_lines[idx];
+        if (!line_groups.empty() && line_groups.back().second.belongsHere(new_line)) {
+            line_groups.back().first = std::min(line_groups.back().first, idx);
+            line_groups.back().second.add(new_line);
+        } else {
+            line_groups.push_back(std::make_pair(idx, LineGroup(new_line)));
         }
     }
+    std::sort(
+        line_groups.begin(), line_groups.end(),
+        [](std::pair<size_t, LineGroup> const& a, std::pair<size_t, LineGroup> const& b) {
+            return a.first < b.first;
+        }
+    );
 
     std::vector<QLineF> lines;
-    for (LineGroup const& group : line_groups) {
-        lines.push_back(group.leader().toQLine());
+    for (auto const& group : line_groups) {
+        lines.push_back(group.second.leader().toQLine());
         if ((int)lines.size() == max_lines) {
             break;
         }
@@ -351,14 +434,4 @@ VertLineFinder::LineGroup::add(QualityLine const& line)
     }
 }
 
-void
-VertLineFinder::LineGroup::merge(LineGroup const& other)
-{
-    m_left = std::min(m_left, other.m_left);
-    m_right = std::max(m_right, other.m_right);
-    if (other.leader().quality() > m_leader.quality()) {
-        m_leader = other.leader();
-    }
-}
-
 } // namespace page_split
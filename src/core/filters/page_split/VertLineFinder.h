@@ -84,8 +84,6 @@ private:
 
         void add(QualityLine const& line);
 
-        void merge(LineGroup const& other);
-
         QualityLine const& leader() const
         {
             return m_leader;
@@ -65,7 +65,7 @@ CacheDrivenTask::process(
     }
 
     Dependencies const deps(xform.resultingPreCropArea());
-    if (need_reprocess || (!params->dependencies().matches(deps) && (params->mode() == MODE_AUTO || !params->isContentDetectionEnabled()))) {
+    if (need_reprocess || (!params->dependencies().nearlyMatches(deps) && (params->mode() == MODE_AUTO || !params->isContentDetectionEnabled()))) {
 
         if (ThumbnailCollector* thumb_col = dynamic_cast<ThumbnailCollector*>(collector)) {
             thumb_col->processThumbnail(
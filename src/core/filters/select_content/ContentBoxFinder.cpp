@@ -23,13 +23,17 @@
 #include "ImageTransformation.h"
 #include "Dpi.h"
 #include "Despeckle.h"
+#include "IntermediateCache.h"
+#include "ConcurrentJobs.h"
+#include "ImageId.h"
 #include "imageproc/BinaryImage.h"
 #include "imageproc/BinaryThreshold.h"
 #include "imageproc/Binarize.h"
 #include "imageproc/BWColor.h"
 #include "imageproc/Connectivity.h"
 #include "imageproc/ConnComp.h"
-#include "imageproc/ConnCompEraserExt.h"
+#include "imageproc/ConnCompEraser.h"
+#include "imageproc/ConnCompExtractor.h"
 #include "imageproc/Transform.h"
 #include "imageproc/RasterOp.h"
 #include "imageproc/GrayRasterOp.h"
@@ -53,6 +57,8 @@
 #include <QtGlobal>
 #include <Qt>
 #include <QDebug>
+#include <QThread>
+#include <QAtomicInt>
 #include <queue>
 #include <vector>
 #include <algorithm>
@@ -62,12 +68,29 @@
 #include <limits.h>
 
 #include "CommandLine.h"
+#ifndef Q_MOC_RUN
+#include <boost/function.hpp>
+#endif
 
 namespace select_content
 {
 
 using namespace imageproc;
 
+/**
+ * Buffers findTextLines() reuses from one content block to the next.
+ */
+class ContentBoxFinder::TextLineScratch
+{
+public:
+    typedef std::pair<int const*, int const*> Range;
+
+    std::vector<Range> ranges;
+    std::vector<Range> splittableRanges;
+    std::vector<int> maxForward;
+    std::vector<int> maxBackwards;
+};
+
 class ContentBoxFinder::Garbage
 {
 public:
@@ -113,7 +136,8 @@ struct PreferVertical {
 
 QRectF
 ContentBoxFinder::findContentBox(
-    TaskStatus const& status, FilterData const& data, QRectF const& page_rect, DebugImages* dbg)
+    TaskStatus const& status, FilterData const& data, QRectF const& page_rect,
+    ImageId const& image_id, DebugImages* dbg)
 {
     ImageTransformation xform_150dpi(data.xform());
     xform_150dpi.preScaleToDpi(Dpi(150, 150));
@@ -122,6 +146,176 @@ ContentBoxFinder::findContentBox(
         return QRectF();
     }
 
+    double const xscale = 150.0 / data.xform().origDpi().horizontal();
+    double const yscale = 150.0 / data.xform().origDpi().vertical();
+    QRectF page_rect150(page_rect.left()*xscale, page_rect.top()*yscale,
+                        page_rect.right()*xscale, page_rect.bottom()*yscale);
+
+    BinaryImage content;
+    BinaryImage content_blocks;
+    BinaryImage text_mask;
+    BinaryImage hor_garbage_img;
+    BinaryImage vert_garbage_img;
+
+    // The masks only depend on the source image and the geometry below,
+    // so reprocessing a page with the same geometry can skip the image work.
+    // Debug images need the whole pipeline to run, so bypass the cache then.
+    IntermediateCache::Key cache_key;
+    if (!dbg) {
+        CommandLine const& cli = CommandLine::get();
+        cache_key = IntermediateCache::Key(image_id, "content_box");
+        cache_key.add(xform_150dpi.transform())
+        .add(xform_150dpi.resultingRect())
+        .add(xform_150dpi.resultingPreCropArea())
+        .add(page_rect150)
+        .add(cli.hasContentRect() ? int(cli.getContentDetection()) : -1)
+        .add(int(cli.hasContentText()));
+    }
+
+    std::vector<BinaryImage> cached;
+    if (IntermediateCache::load(cache_key, cached, 5)) {
+        content = cached[0];
+        content_blocks = cached[1];
+        text_mask = cached[2];
+        hor_garbage_img = cached[3];
+        vert_garbage_img = cached[4];
+    } else {
+        findContentMasks(
+            status, data, xform_150dpi, page_rect150, content, content_blocks,
+            text_mask, hor_garbage_img, vert_garbage_img, dbg
+        );
+
+        cached.clear();
+        cached.push_back(content);
+        cached.push_back(content_blocks);
+        cached.push_back(text_mask);
+        cached.push_back(hor_garbage_img);
+        cached.push_back(vert_garbage_img);
+        IntermediateCache::store(cache_key, cached);
+    }
+
+    QRect content_rect(content_blocks.contentBoundingBox());
+
+    Garbage hor_garbage(Garbage::HOR, hor_garbage_img.release());
+    Garbage vert_garbage(Garbage::VERT, vert_garbage_img.release());
+
+    enum Side { LEFT = 1, RIGHT = 2, TOP = 4, BOTTOM = 8 };
+    int side_mask = LEFT | RIGHT | TOP | BOTTOM;
+
+    while (side_mask && !content_rect.isEmpty()) {
+        QRect old_content_rect;
+
+        if (side_mask & LEFT) {
+            side_mask &= ~LEFT;
+            old_content_rect = content_rect;
+            content_rect = trimLeft(
+                               content, content_blocks, text_mask,
+                               content_rect, vert_garbage, dbg
+                           );
+
+            status.throwIfCancelled();
+
+            if (content_rect.isEmpty()) {
+                break;
+            }
+            if (old_content_rect != content_rect) {
+                side_mask |= LEFT | TOP | BOTTOM;
+            }
+        }
+
+        if (side_mask & RIGHT) {
+            side_mask &= ~RIGHT;
+            old_content_rect = content_rect;
+            content_rect = trimRight(
+                               content, content_blocks, text_mask,
+                               content_rect, vert_garbage, dbg
+                           );
+
+            status.throwIfCancelled();
+
+            if (content_rect.isEmpty()) {
+                break;
+            }
+            if (old_content_rect != content_rect) {
+                side_mask |= RIGHT | TOP | BOTTOM;
+            }
+        }
+
+        if (side_mask & TOP) {
+            side_mask &= ~TOP;
+            old_content_rect = content_rect;
+            content_rect = trimTop(
+                               content, content_blocks, text_mask,
+                               content_rect, hor_garbage, dbg
+                           );
+
+            status.throwIfCancelled();
+
+            if (content_rect.isEmpty()) {
+                break;
+            }
+            if (old_content_rect != content_rect) {
+                side_mask |= TOP | LEFT | RIGHT;
+            }
+        }
+
+        if (side_mask & BOTTOM) {
+            side_mask &= ~BOTTOM;
+            old_content_rect = content_rect;
+            content_rect = trimBottom(
+                               content, content_blocks, text_mask,
+                               content_rect, hor_garbage, dbg
+                           );
+
+            status.throwIfCancelled();
+
+            if (content_rect.isEmpty()) {
+                break;
+            }
+            if (old_content_rect != content_rect) {
+                side_mask |= BOTTOM | LEFT | RIGHT;
+            }
+        }
+
+        if (content_rect.width() < 8 || content_rect.height() < 8) {
+            content_rect = QRect();
+            break;
+        } else if (content_rect.width() < 30 &&
+                   content_rect.height() >
+                   content_rect.width() * 20) {
+            content_rect = QRect();
+            break;
+        }
+    }
+
+    // Transform back from 150dpi.
+    QTransform combined_xform(xform_150dpi.transform().inverted());
+    combined_xform *= data.xform().transform();
+    return combined_xform.map(QRectF(content_rect)).boundingRect();
+}
+
+/**
+ * A page is considered blank if what's left after removing the shadows
+ * and the area outside the page is no more than a speck of dust.
+ * That's less than any glyph, even at 150 dpi.
+ */
+bool
+ContentBoxFinder::isBlank(imageproc::BinaryImage const& content)
+{
+    int const max_black_pixels = std::max(
+                                     1, content.width() * content.height() / 100000
+                                 );
+    return content.countBlackPixels() < max_black_pixels;
+}
+
+void
+ContentBoxFinder::findContentMasks(
+    TaskStatus const& status, FilterData const& data,
+    ImageTransformation const& xform_150dpi, QRectF const& page_rect150,
+    imageproc::BinaryImage& content, imageproc::BinaryImage& content_blocks,
+    imageproc::BinaryImage& text_mask, imageproc::BinaryImage& hor_garbage,
+    imageproc::BinaryImage& vert_garbage, DebugImages* dbg)
+{
     uint8_t const darkest_gray_level = darkestGrayLevel(data.grayImage());
     QColor const outside_color(darkest_gray_level, darkest_gray_level, darkest_gray_level);
 
@@ -144,10 +338,6 @@ ContentBoxFinder::findContentBox(
         dbg->add(bw150, "bw150");
     }
 
-    double const xscale = 150.0 / data.xform().origDpi().horizontal();
-    double const yscale = 150.0 / data.xform().origDpi().vertical();
-    QRectF page_rect150(page_rect.left()*xscale, page_rect.top()*yscale,
-                        page_rect.right()*xscale, page_rect.bottom()*yscale);
     PolygonRasterizer::fillExcept(
         bw150, BLACK, page_rect150, Qt::WindingFill
     );
@@ -159,15 +349,25 @@ ContentBoxFinder::findContentBox(
         dbg->add(bw150, "page_mask_applied");
     }
 
-    BinaryImage hor_shadows_seed(openBrick(bw150, QSize(200, 14), BLACK));
-    if (dbg) {
-        dbg->add(hor_shadows_seed, "hor_shadows_seed");
+    // These only read bw150, so they can be computed in parallel.
+    BinaryImage hor_shadows_seed;
+    BinaryImage ver_shadows_seed;
+    BinaryImage dilated;
+    {
+        std::vector<boost::function<void()> > jobs;
+        jobs.push_back([&]() {
+            hor_shadows_seed = openBrick(bw150, QSize(200, 14), BLACK);
+        });
+        jobs.push_back([&]() {
+            ver_shadows_seed = openBrick(bw150, QSize(14, 300), BLACK);
+        });
+        jobs.push_back([&]() {
+            dilated = dilateBrick(bw150, QSize(3, 3));
+        });
+        runConcurrently(jobs);
     }
-
-    status.throwIfCancelled();
-
-    BinaryImage ver_shadows_seed(openBrick(bw150, QSize(14, 300), BLACK));
     if (dbg) {
+        dbg->add(hor_shadows_seed, "hor_shadows_seed");
         dbg->add(ver_shadows_seed, "ver_shadows_seed");
     }
 
@@ -178,12 +378,6 @@ ContentBoxFinder::findContentBox(
     ver_shadows_seed.release();
     if (dbg) {
         dbg->add(shadows_seed, "shadows_seed");
-    }
-
-    status.throwIfCancelled();
-
-    BinaryImage dilated(dilateBrick(bw150, QSize(3, 3)));
-    if (dbg) {
         dbg->add(dilated, "dilated");
     }
 
@@ -212,7 +406,7 @@ ContentBoxFinder::findContentBox(
 
     status.throwIfCancelled();
 
-    BinaryImage content(bw150.release());
+    content = bw150.release();
     rasterOp<RopSubtract<RopDst, RopSrc> >(content, garbage);
     if (dbg) {
         dbg->add(content, "content");
@@ -220,6 +414,70 @@ ContentBoxFinder::findContentBox(
 
     status.throwIfCancelled();
 
+    if (isBlank(content)) {
+        // Nothing is left for the content blocks to be made of,
+        // so the page gets an empty content box.
+        content_blocks = BinaryImage(content.size(), WHITE);
+        text_mask = content_blocks;
+        hor_garbage = content_blocks;
+        vert_garbage = content_blocks;
+        return;
+    }
+
+    // Garbage segmentation and the search for content blocks
+    // don't depend on each other.
+    {
+        std::vector<boost::function<void()> > jobs;
+        jobs.push_back([&]() {
+            findContentBlocks(status, content, content_blocks, dbg);
+        });
+        jobs.push_back([&]() {
+            segmentGarbage(garbage, hor_garbage, vert_garbage, 0);
+        });
+        runConcurrently(jobs);
+    }
+    garbage.release();
+
+    CommandLine const& cli = CommandLine::get();
+    text_mask = content_blocks;
+    if (cli.hasContentText()) {
+        text_mask = estimateTextMask(content, content_blocks, dbg);
+    }
+
+    if (dbg) {
+        QImage text_mask_visualized(content.size(), QImage::Format_ARGB32_Premultiplied);
+        text_mask_visualized.fill(0xffffffff); // Opaque white.
+
+        QPainter painter(&text_mask_visualized);
+
+        QImage tmp(content.size(), QImage::Format_ARGB32_Premultiplied);
+        tmp.fill(0xff64dd62); // Opaque light green.
+        tmp.setAlphaChannel(text_mask.inverted().toQImage());
+        painter.drawImage(QPoint(0, 0), tmp);
+
+        tmp.fill(0xe0000000); // Mostly transparent black.
+        tmp.setAlphaChannel(content.inverted().toQImage());
+        painter.drawImage(QPoint(0, 0), tmp);
+
+        painter.end();
+
+        dbg->add(text_mask_visualized, "text_mask");
+    }
+
+    // Make text_mask store the actual content pixels that are text.
+    rasterOp<RopAnd<RopSrc, RopDst> >(text_mask, content);
+
+    if (dbg) {
+        dbg->add(hor_garbage, "initial_hor_garbage");
+        dbg->add(vert_garbage, "initial_vert_garbage");
+    }
+}
+
+void
+ContentBoxFinder::findContentBlocks(
+    TaskStatus const& status, imageproc::BinaryImage const& content,
+    imageproc::BinaryImage& content_blocks, DebugImages* dbg)
+{
     CommandLine const& cli = CommandLine::get();
     Despeckle::Level despeckleLevel = Despeckle::NORMAL;
     if (cli.hasContentRect()) {
@@ -233,11 +491,16 @@ ContentBoxFinder::findContentBox(
 
     status.throwIfCancelled();
 
-    BinaryImage content_blocks(content.size(), BLACK);
+    content_blocks = BinaryImage(content.size(), BLACK);
     int const area_threshold = std::min(content.width(), content.height());
 
+    // Both passes below search the same image.
+    MaxWhitespaceFinder::BlackPixelCounts const despeckled_counts(
+        MaxWhitespaceFinder::countBlackPixels(despeckled)
+    );
+
     {
-        MaxWhitespaceFinder hor_ws_finder(PreferHorizontal(), despeckled);
+        MaxWhitespaceFinder hor_ws_finder(PreferHorizontal(), despeckled_counts);
 
         for (int i = 0; i < 80; ++i) {
             QRect ws(hor_ws_finder.next(hor_ws_finder.MANUAL_OBSTACLES));
@@ -256,7 +519,7 @@ ContentBoxFinder::findContentBox(
     }
 
     {
-        MaxWhitespaceFinder vert_ws_finder(PreferVertical(), despeckled);
+        MaxWhitespaceFinder vert_ws_finder(PreferVertical(), despeckled_counts);
 
         for (int i = 0; i < 40; ++i) {
             QRect ws(vert_ws_finder.next(vert_ws_finder.MANUAL_OBSTACLES));
@@ -316,143 +579,6 @@ ContentBoxFinder::findContentBox(
     if (dbg) {
         dbg->add(content_blocks, "except_bordering");
     }
-
-    BinaryImage text_mask(content_blocks);
-    if (cli.hasContentText()) {
-        text_mask = estimateTextMask(content, content_blocks, dbg);
-    }
-
-    if (dbg) {
-        QImage text_mask_visualized(content.size(), QImage::Format_ARGB32_Premultiplied);
-        text_mask_visualized.fill(0xffffffff); // Opaque white.
-
-        QPainter painter(&text_mask_visualized);
-
-        QImage tmp(content.size(), QImage::Format_ARGB32_Premultiplied);
-        tmp.fill(0xff64dd62); // Opaque light green.
-        tmp.setAlphaChannel(text_mask.inverted().toQImage());
-        painter.drawImage(QPoint(0, 0), tmp);
-
-        tmp.fill(0xe0000000); // Mostly transparent black.
-        tmp.setAlphaChannel(content.inverted().toQImage());
-        painter.drawImage(QPoint(0, 0), tmp);
-
-        painter.end();
-
-        dbg->add(text_mask_visualized, "text_mask");
-    }
-
-    // Make text_mask store the actual content pixels that are text.
-    rasterOp<RopAnd<RopSrc, RopDst> >(text_mask, content);
-
-    QRect content_rect(content_blocks.contentBoundingBox());
-
-    // Temporarily reuse hor_shadows_seed and ver_shadows_seed.
-    // It's OK they are null.
-    segmentGarbage(garbage, hor_shadows_seed, ver_shadows_seed, dbg);
-    garbage.release();
-
-    if (dbg) {
-        dbg->add(hor_shadows_seed, "initial_hor_garbage");
-        dbg->add(ver_shadows_seed, "initial_vert_garbage");
-    }
-
-    Garbage hor_garbage(Garbage::HOR, hor_shadows_seed.release());
-    Garbage vert_garbage(Garbage::VERT, ver_shadows_seed.release());
-
-    enum Side { LEFT = 1, RIGHT = 2, TOP = 4, BOTTOM = 8 };
-    int side_mask = LEFT | RIGHT | TOP | BOTTOM;
-
-    while (side_mask && !content_rect.isEmpty()) {
-        QRect old_content_rect;
-
-        if (side_mask & LEFT) {
-            side_mask &= ~LEFT;
-            old_content_rect = content_rect;
-            content_rect = trimLeft(
-                               content, content_blocks, text_mask,
-                               content_rect, vert_garbage, dbg
-                           );
-
-            status.throwIfCancelled();
-
-            if (content_rect.isEmpty()) {
-                break;
-            }
-            if (old_content_rect != content_rect) {
-                side_mask |= LEFT | TOP | BOTTOM;
-            }
-        }
-
-        if (side_mask & RIGHT) {
-            side_mask &= ~RIGHT;
-            old_content_rect = content_rect;
-            content_rect = trimRight(
-                               content, content_blocks, text_mask,
-                               content_rect, vert_garbage, dbg
-                           );
-
-            status.throwIfCancelled();
-
-            if (content_rect.isEmpty()) {
-                break;
-            }
-            if (old_content_rect != content_rect) {
-                side_mask |= RIGHT | TOP | BOTTOM;
-            }
-        }
-
-        if (side_mask & TOP) {
-            side_mask &= ~TOP;
-            old_content_rect = content_rect;
-            content_rect = trimTop(
-                               content, content_blocks, text_mask,
-                               content_rect, hor_garbage, dbg
-                           );
-
-            status.throwIfCancelled();
-
-            if (content_rect.isEmpty()) {
-                break;
-            }
-            if (old_content_rect != content_rect) {
-                side_mask |= TOP | LEFT | RIGHT;
-            }
-        }
-
-        if (side_mask & BOTTOM) {
-            side_mask &= ~BOTTOM;
-            old_content_rect = content_rect;
-            content_rect = trimBottom(
-                               content, content_blocks, text_mask,
-                               content_rect, hor_garbage, dbg
-                           );
-
-            status.throwIfCancelled();
-
-            if (content_rect.isEmpty()) {
-                break;
-            }
-            if (old_content_rect != content_rect) {
-                side_mask |= BOTTOM | LEFT | RIGHT;
-            }
-        }
-
-        if (content_rect.width() < 8 || content_rect.height() < 8) {
-            content_rect = QRect();
-            break;
-        } else if (content_rect.width() < 30 &&
-                   content_rect.height() >
-                   content_rect.width() * 20) {
-            content_rect = QRect();
-            break;
-        }
-    }
-
-    // Transform back from 150dpi.
-    QTransform combined_xform(xform_150dpi.transform().inverted());
-    combined_xform *= data.xform().transform();
-    return combined_xform.map(QRectF(content_rect)).boundingRect();
 }
 
 namespace
@@ -732,8 +858,9 @@ ContentBoxFinder::segmentGarbage(
     }
 
     BinaryImage unconnected_garbage(garbage);
-    rasterOp<RopSubtract<RopDst, RopSrc> >(unconnected_garbage, hor_garbage);
-    rasterOp<RopSubtract<RopDst, RopSrc> >(unconnected_garbage, vert_garbage);
+    rasterOp<RopSubtract<RopSubtract<RopDst, RopSrc>, RopSrc2> >(
+        unconnected_garbage, hor_garbage, vert_garbage
+    );
 
     rasterOp<RopOr<RopSrc, RopDst> >(hor_garbage, unconnected_garbage);
     rasterOp<RopOr<RopSrc, RopDst> >(vert_garbage, unconnected_garbage);
@@ -773,209 +900,248 @@ ContentBoxFinder::estimateTextMask(
         dbg->add(canvas, "ueps");
     }
 
-    BinaryImage text_mask(content.size(), WHITE);
-
-    int const min_text_height = 6;
-
-    ConnCompEraserExt eraser(content_blocks, CONN4);
-    for (;;) {
-        ConnComp const cc(eraser.nextConnComp());
-        if (cc.isNull()) {
-            break;
+    ConnCompExtractor const extractor(content_blocks, CONN4, true);
+    int const num_blocks = extractor.size();
+
+    // Blocks are classified independently of each other.  Workers take
+    // them one by one and keep what they find in slots of their own,
+    // so the text mask is only written once they are done.
+    std::vector<std::vector<QRect> > text_lines(num_blocks);
+    std::vector<BinaryImage> block_images(num_blocks);
+    QAtomicInt next_block(0);
+    std::vector<boost::function<void()> > jobs(
+        std::max(1, std::min(num_blocks, QThread::idealThreadCount())),
+        [&]() {
+            TextLineScratch scratch;
+            int idx;
+            while ((idx = next_block.fetchAndAddRelaxed(1)) < num_blocks) {
+                BinaryImage cc_img(extractor.computeConnCompImage(idx));
+                findTextLines(
+                    extractor[idx].rect(), cc_img, content, content_blocks,
+                    ueps, scratch, text_lines[idx]
+                );
+                if (!text_lines[idx].empty()) {
+                    block_images[idx].swap(cc_img);
+                }
+            }
         }
+    );
+    runConcurrently(jobs);
 
-        BinaryImage cc_img(eraser.computeConnCompImage());
-        BinaryImage content_img(cc_img.size());
-        rasterOp<RopSrc>(
-            content_img, content_img.rect(),
-            content, cc.rect().topLeft()
-        );
-
-        // Note that some content may actually be not masked
-        // by content_blocks, because we build content_blocks
-        // based on despeckled content image.
-        rasterOp<RopAnd<RopSrc, RopDst> >(content_img, cc_img);
+    BinaryImage text_mask(content.size(), WHITE);
+    for (int idx = 0; idx < num_blocks; ++idx) {
+        int const block_top = extractor[idx].rect().top();
+        for (QRect const& line_rect : text_lines[idx]) {
+            // Write this line to the text mask.
+            rasterOp<RopOr<RopSrc, RopDst> >(
+                text_mask, line_rect, block_images[idx],
+                QPoint(0, line_rect.top() - block_top)
+            );
+        }
+    }
 
-        SlicedHistogram const hist(content_img, SlicedHistogram::ROWS);
-        SlicedHistogram const block_hist(cc_img, SlicedHistogram::ROWS);
+    return text_mask;
+}
 
-        assert(hist.size() != 0);
+void
+ContentBoxFinder::findTextLines(
+    QRect const& cc_rect, imageproc::BinaryImage const& cc_img,
+    imageproc::BinaryImage const& content,
+    imageproc::BinaryImage const& content_blocks,
+    imageproc::BinaryImage const& ueps,
+    TextLineScratch& scratch, std::vector<QRect>& lines)
+{
+    int const min_text_height = 6;
 
-        typedef std::pair<int const*, int const*> Range;
-        std::vector<Range> ranges;
-        std::vector<Range> splittable_ranges;
-        splittable_ranges.push_back(
-            Range(&hist[0], &hist[hist.size() - 1])
-        );
+    BinaryImage content_img(cc_img.size());
+    rasterOp<RopSrc>(
+        content_img, content_img.rect(),
+        content, cc_rect.topLeft()
+    );
 
-        std::vector<int> max_forward(hist.size());
-        std::vector<int> max_backwards(hist.size());
+    // Note that some content may actually be not masked
+    // by content_blocks, because we build content_blocks
+    // based on despeckled content image.
+    rasterOp<RopAnd<RopSrc, RopDst> >(content_img, cc_img);
 
-        // Try splitting text lines.
-        while (!splittable_ranges.empty()) {
-            int const* const first = splittable_ranges.back().first;
-            int const* const last = splittable_ranges.back().second;
-            splittable_ranges.pop_back();
+    SlicedHistogram const hist(content_img, SlicedHistogram::ROWS);
+    SlicedHistogram const block_hist(cc_img, SlicedHistogram::ROWS);
 
-            if (last - first < min_text_height - 1) {
-                // Just ignore such a small segment.
-                continue;
-            }
+    assert(hist.size() != 0);
 
-            // Fill max_forward and max_backwards.
-            {
-                int prev = *first;
-                for (int i = 0; i <= last - first; ++i) {
-                    prev = std::max(prev, first[i]);
-                    max_forward[i] = prev;
-                }
-                prev = *last;
-                for (int i = 0; i <= last - first; ++i) {
-                    prev = std::max(prev, last[-i]);
-                    max_backwards[i] = prev;
-                }
-            }
+    typedef TextLineScratch::Range Range;
+    std::vector<Range>& ranges = scratch.ranges;
+    std::vector<Range>& splittable_ranges = scratch.splittableRanges;
+    ranges.clear();
+    splittable_ranges.clear();
+    splittable_ranges.push_back(
+        Range(&hist[0], &hist[hist.size() - 1])
+    );
 
-            int best_magnitude = std::numeric_limits<int>::min();
-            int const* best_split_pos = 0;
-            assert(first != last);
-            for (int const* p = first + 1; p != last; ++p) {
-                int const peak1 = max_forward[p - (first + 1)];
-                int const peak2 = max_backwards[(last - 1) - p];
-                if (*p * 3.5 > 0.5 * (peak1 + peak2)) {
-                    continue;
-                }
-                int const shoulder1 = peak1 - *p;
-                int const shoulder2 = peak2 - *p;
-                if (shoulder1 <= 0 || shoulder2 <= 0) {
-                    continue;
-                }
-                if (std::min(shoulder1, shoulder2) * 20 <
-                        std::max(shoulder1, shoulder2)) {
-                    continue;
-                }
+    std::vector<int>& max_forward = scratch.maxForward;
+    std::vector<int>& max_backwards = scratch.maxBackwards;
+    max_forward.resize(hist.size());
+    max_backwards.resize(hist.size());
 
-                int const magnitude = shoulder1 + shoulder2;
-                if (magnitude > best_magnitude) {
-                    best_magnitude = magnitude;
-                    best_split_pos = p;
-                }
-            }
+    // Try splitting text lines.
+    while (!splittable_ranges.empty()) {
+        int const* const first = splittable_ranges.back().first;
+        int const* const last = splittable_ranges.back().second;
+        splittable_ranges.pop_back();
 
-            if (best_split_pos) {
-                splittable_ranges.push_back(
-                    Range(first, best_split_pos - 1)
-                );
-                splittable_ranges.push_back(
-                    Range(best_split_pos + 1, last)
-                );
-            } else {
-                ranges.push_back(Range(first, last));
-            }
+        if (last - first < min_text_height - 1) {
+            // Just ignore such a small segment.
+            continue;
         }
 
-        for (Range const& range : ranges) {
-            int const first = range.first - &hist[0];
-            int const last = range.second - &hist[0];
-            if (last - first < min_text_height - 1) {
-                continue;
+        // Fill max_forward and max_backwards.
+        {
+            int prev = *first;
+            for (int i = 0; i <= last - first; ++i) {
+                prev = std::max(prev, first[i]);
+                max_forward[i] = prev;
             }
-
-            int64_t weighted_y = 0;
-            int total_weight = 0;
-            for (int i = first; i <= last; ++i) {
-                int const val = hist[i];
-                weighted_y += val * i;
-                total_weight += val;
+            prev = *last;
+            for (int i = 0; i <= last - first; ++i) {
+                prev = std::max(prev, last[-i]);
+                max_backwards[i] = prev;
             }
+        }
 
-            if (total_weight == 0) {
-                //qDebug() << "no black pixels at all";
-                continue;
-            }
-
-            double const min_fill_factor = 0.22;
-            double const max_fill_factor = 0.65;
-
-            int const center_y = (weighted_y + total_weight / 2) / total_weight;
-            int top = center_y - min_text_height / 2;
-            int bottom = top + min_text_height - 1;
-            int num_black = 0;
-            int num_total = 0;
-            int max_width = 0;
-            if (top < first || bottom > last) {
+        int best_magnitude = std::numeric_limits<int>::min();
+        int const* best_split_pos = 0;
+        assert(first != last);
+        for (int const* p = first + 1; p != last; ++p) {
+            int const peak1 = max_forward[p - (first + 1)];
+            int const peak2 = max_backwards[(last - 1) - p];
+            if (*p * 3.5 > 0.5 * (peak1 + peak2)) {
                 continue;
             }
-            for (int i = top; i <= bottom; ++i) {
-                num_black += hist[i];
-                num_total += block_hist[i];
-                max_width = std::max(max_width, block_hist[i]);
-            }
-            if (num_black < num_total * min_fill_factor) {
-                //qDebug() << "initial fill factor too low";
+            int const shoulder1 = peak1 - *p;
+            int const shoulder2 = peak2 - *p;
+            if (shoulder1 <= 0 || shoulder2 <= 0) {
                 continue;
             }
-            if (num_black > num_total * max_fill_factor) {
-                //qDebug() << "initial fill factor too high";
+            if (std::min(shoulder1, shoulder2) * 20 <
+                    std::max(shoulder1, shoulder2)) {
                 continue;
             }
 
-            // Extend the top and bottom of the text line.
-            while ((top > first || bottom < last) &&
-                    abs((center_y - top) - (bottom - center_y)) <= 1) {
-                int const new_top = (top > first) ? top - 1 : top;
-                int const new_bottom = (bottom < last) ? bottom + 1 : bottom;
-                num_black += hist[new_top] + hist[new_bottom];
-                num_total += block_hist[new_top] + block_hist[new_bottom];
-                if (num_black < num_total * min_fill_factor) {
-                    break;
-                }
-                max_width = std::max(max_width, block_hist[new_top]);
-                max_width = std::max(max_width, block_hist[new_bottom]);
-                top = new_top;
-                bottom = new_bottom;
+            int const magnitude = shoulder1 + shoulder2;
+            if (magnitude > best_magnitude) {
+                best_magnitude = magnitude;
+                best_split_pos = p;
             }
+        }
 
-            if (num_black > num_total * max_fill_factor) {
-                //qDebug() << "final fill factor too high";
-                continue;
-            }
+        if (best_split_pos) {
+            splittable_ranges.push_back(
+                Range(first, best_split_pos - 1)
+            );
+            splittable_ranges.push_back(
+                Range(best_split_pos + 1, last)
+            );
+        } else {
+            ranges.push_back(Range(first, last));
+        }
+    }
 
-            if (max_width < (bottom - top + 1) * 0.6) {
-                //qDebug() << "aspect ratio too low";
-                continue;
+    for (Range const& range : ranges) {
+        int const first = range.first - &hist[0];
+        int const last = range.second - &hist[0];
+        if (last - first < min_text_height - 1) {
+            continue;
+        }
+
+        int64_t weighted_y = 0;
+        int total_weight = 0;
+        for (int i = first; i <= last; ++i) {
+            int const val = hist[i];
+            weighted_y += val * i;
+            total_weight += val;
+        }
+
+        if (total_weight == 0) {
+            //qDebug() << "no black pixels at all";
+            continue;
+        }
+
+        double const min_fill_factor = 0.22;
+        double const max_fill_factor = 0.65;
+
+        int const center_y = (weighted_y + total_weight / 2) / total_weight;
+        int top = center_y - min_text_height / 2;
+        int bottom = top + min_text_height - 1;
+        int num_black = 0;
+        int num_total = 0;
+        int max_width = 0;
+        if (top < first || bottom > last) {
+            continue;
+        }
+        for (int i = top; i <= bottom; ++i) {
+            num_black += hist[i];
+            num_total += block_hist[i];
+            max_width = std::max(max_width, block_hist[i]);
+        }
+        if (num_black < num_total * min_fill_factor) {
+            //qDebug() << "initial fill factor too low";
+            continue;
+        }
+        if (num_black > num_total * max_fill_factor) {
+            //qDebug() << "initial fill factor too high";
+            continue;
+        }
+
+        // Extend the top and bottom of the text line.
+        while ((top > first || bottom < last) &&
+                abs((center_y - top) - (bottom - center_y)) <= 1) {
+            int const new_top = (top > first) ? top - 1 : top;
+            int const new_bottom = (bottom < last) ? bottom + 1 : bottom;
+            num_black += hist[new_top] + hist[new_bottom];
+            num_total += block_hist[new_top] + block_hist[new_bottom];
+            if (num_black < num_total * min_fill_factor) {
+                break;
             }
+            max_width = std::max(max_width, block_hist[new_top]);
+            max_width = std::max(max_width, block_hist[new_bottom]);
+            top = new_top;
+            bottom = new_bottom;
+        }
+
+        if (num_black > num_total * max_fill_factor) {
+            //qDebug() << "final fill factor too high";
+            continue;
+        }
 
-            QRect line_rect(cc.rect());
-            line_rect.setTop(cc.rect().top() + top);
-            line_rect.setBottom(cc.rect().top() + bottom);
+        if (max_width < (bottom - top + 1) * 0.6) {
+            //qDebug() << "aspect ratio too low";
+            continue;
+        }
 
-            // Check if there are enough ultimate eroded points on the line.
-            int ueps_todo = int(0.4 * line_rect.width() / line_rect.height());
+        QRect line_rect(cc_rect);
+        line_rect.setTop(cc_rect.top() + top);
+        line_rect.setBottom(cc_rect.top() + bottom);
+
+        // Check if there are enough ultimate eroded points on the line.
+        int ueps_todo = int(0.4 * line_rect.width() / line_rect.height());
+        if (ueps_todo) {
+            BinaryImage line_ueps(line_rect.size());
+            rasterOp<RopSrc>(line_ueps, line_ueps.rect(), content_blocks, line_rect.topLeft());
+            rasterOp<RopAnd<RopSrc, RopDst> >(line_ueps, line_ueps.rect(), ueps, line_rect.topLeft());
+            ConnCompEraser ueps_eraser(line_ueps, CONN4);
+            ConnComp cc;
+            for (; ueps_todo && !(cc = ueps_eraser.nextConnComp()).isNull(); --ueps_todo) {
+                // Erase components until ueps_todo reaches zero or there are no more components.
+            }
             if (ueps_todo) {
-                BinaryImage line_ueps(line_rect.size());
-                rasterOp<RopSrc>(line_ueps, line_ueps.rect(), content_blocks, line_rect.topLeft());
-                rasterOp<RopAnd<RopSrc, RopDst> >(line_ueps, line_ueps.rect(), ueps, line_rect.topLeft());
-                ConnCompEraser ueps_eraser(line_ueps, CONN4);
-                ConnComp cc;
-                for (; ueps_todo && !(cc = ueps_eraser.nextConnComp()).isNull(); --ueps_todo) {
-                    // Erase components until ueps_todo reaches zero or there are no more components.
-                }
-                if (ueps_todo) {
-                    // Not enough ueps were found.
-                    //qDebug() << "Not enough UEPs.";
-                    continue;
-                }
+                // Not enough ueps were found.
+                //qDebug() << "Not enough UEPs.";
+                continue;
             }
-
-            // Write this block to the text mask.
-            rasterOp<RopOr<RopSrc, RopDst> >(
-                text_mask, line_rect, cc_img, QPoint(0, top)
-            );
         }
-    }
 
-    return text_mask;
+        lines.push_back(line_rect);
+    }
 }
 
 QRect
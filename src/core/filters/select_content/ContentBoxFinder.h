@@ -20,10 +20,13 @@
 #define SELECT_CONTENT_CONTENTBOXFINDER_H_
 
 #include "imageproc/BinaryThreshold.h"
+#include <vector>
 
 class TaskStatus;
 class DebugImages;
 class FilterData;
+class ImageId;
+class ImageTransformation;
 class QImage;
 class QRect;
 class QRectF;
@@ -41,11 +44,41 @@ namespace select_content
 class ContentBoxFinder
 {
 public:
+    /**
+     * \brief Finds the content box within \p page_rect.
+     *
+     * \p image_id identifies the source image for the intermediate cache.
+     * Pass a null ImageId to bypass it.
+     */
     static QRectF findContentBox(
         TaskStatus const& status, FilterData const& data, QRectF const& page_rect,
-        DebugImages* dbg = 0);
+        ImageId const& image_id, DebugImages* dbg = 0);
 private:
     class Garbage;
+    class TextLineScratch;
+
+    /**
+     * \brief Produces the 150 dpi masks the content box is trimmed against.
+     *
+     * This is the expensive part of findContentBox() and the one whose
+     * results are kept in IntermediateCache.
+     */
+    static void findContentMasks(
+        TaskStatus const& status, FilterData const& data,
+        ImageTransformation const& xform_150dpi, QRectF const& page_rect150,
+        imageproc::BinaryImage& content, imageproc::BinaryImage& content_blocks,
+        imageproc::BinaryImage& text_mask, imageproc::BinaryImage& hor_garbage,
+        imageproc::BinaryImage& vert_garbage, DebugImages* dbg);
+
+    static bool isBlank(imageproc::BinaryImage const& content);
+
+    /**
+     * \brief Finds blocks of content, with whitespace and areas touching
+     *        the borders removed.
+     */
+    static void findContentBlocks(
+        TaskStatus const& status, imageproc::BinaryImage const& content,
+        imageproc::BinaryImage& content_blocks, DebugImages* dbg);
 
     static void segmentGarbage(
         imageproc::BinaryImage const& garbage,
@@ -65,6 +98,20 @@ private:
         imageproc::BinaryImage const& content_blocks,
         DebugImages* dbg);
 
+    /**
+     * \brief Finds the text lines of a content block.
+     *
+     * \p cc_img is the block, located at \p cc_rect.  Lines are
+     * appended to \p lines.  Buffers are taken from \p scratch,
+     * so that calls for consecutive blocks don't reallocate them.
+     */
+    static void findTextLines(
+        QRect const& cc_rect, imageproc::BinaryImage const& cc_img,
+        imageproc::BinaryImage const& content,
+        imageproc::BinaryImage const& content_blocks,
+        imageproc::BinaryImage const& ueps,
+        TextLineScratch& scratch, std::vector<QRect>& lines);
+
     static void filterShadows(
         TaskStatus const& status, imageproc::BinaryImage& shadows,
         DebugImages* dbg);
@@ -22,12 +22,21 @@
 #include "imageproc/PolygonUtils.h"
 #include <QDomDocument>
 #include <QDomElement>
+#include <QLineF>
 
 using namespace imageproc;
 
 namespace select_content
 {
 
+namespace
+{
+
+/** How far a vertex of the page outline may move without affecting the boxes. */
+double const MAX_VERTEX_DISPLACEMENT = 0.5;
+
+} // anonymous namespace
+
 Dependencies::Dependencies()
 {
 }
@@ -58,6 +67,30 @@ Dependencies::matches(Dependencies const& other) const
            );
 }
 
+bool
+Dependencies::nearlyMatches(Dependencies const& other) const
+{
+    if (matches(other)) {
+        return true;
+    }
+
+    // Both outlines come from the same transformation code,
+    // so their vertices are listed in the same order.
+    QPolygonF const& poly1 = m_rotatedPageOutline;
+    QPolygonF const& poly2 = other.m_rotatedPageOutline;
+    if (poly1.size() != poly2.size() || poly1.size() < 3) {
+        return false;
+    }
+
+    for (int i = 0; i < poly1.size(); ++i) {
+        if (QLineF(poly1[i], poly2[i]).length() > MAX_VERTEX_DISPLACEMENT) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 QDomElement
 Dependencies::toXml(QDomDocument& doc, QString const& name) const
 {
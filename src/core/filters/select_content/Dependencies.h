@@ -53,6 +53,16 @@ public:
 
     bool matches(Dependencies const& other) const;
 
+    /**
+     * \brief Checks if boxes found for \p other are still good for these.
+     *
+     * That's the case when no vertex of the rotated page outline has
+     * moved by more than a fraction of a pixel, as happens when the deskew
+     * angle changes very slightly.  Re-detecting the boxes would then give
+     * the same result, so the following stages don't need to notice.
+     */
+    bool nearlyMatches(Dependencies const& other) const;
+
     QDomElement toXml(QDomDocument& doc, QString const& name) const;
 private:
     QPolygonF m_rotatedPageOutline;
@@ -33,6 +33,7 @@
 #include <QDomElement>
 #include <assert.h>
 #include "CommandLine.h"
+#include "OrderByProcessingTime.h"
 
 namespace select_content
 {
@@ -40,14 +41,9 @@ namespace select_content
 Filter::Filter(
     PageSelectionAccessor const& page_selection_accessor)
     :   m_ptrSettings(new Settings),
+        m_pageSelectionAccessor(page_selection_accessor),
         m_selectedPageOrder(0)
 {
-    if (CommandLine::get().isGui()) {
-        m_ptrOptionsWidget.reset(
-            new OptionsWidget(m_ptrSettings, page_selection_accessor)
-        );
-    }
-
     typedef PageOrderOption::ProviderPtr ProviderPtr;
 
     ProviderPtr const default_order;
@@ -57,6 +53,8 @@ Filter::Filter(
     ProviderPtr const order_by_logical_height(new OrderBySizeProvider(m_ptrSettings, true, true));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Natural order"), default_order));
     m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Processed then unprocessed"), ProviderPtr(new OrderByReadiness())));
+    m_pageOrderOptions.push_back(PageOrderOption(QObject::tr("Order by processing time"), ProviderPtr(new OrderByProcessingTime()),
+                                 QObject::tr("Puts the pages that took longest to process first")));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Order by increasing width"), order_by_width,
                                  tr("Orders the pages by the width of detected content zone")));
     m_pageOrderOptions.push_back(PageOrderOption(tr("Order by increasing height"), order_by_height,
@@ -71,6 +69,17 @@ Filter::~Filter()
 {
 }
 
+OptionsWidget*
+Filter::optionsWidget()
+{
+    if (!m_ptrOptionsWidget.get() && CommandLine::get().isGui()) {
+        m_ptrOptionsWidget.reset(
+            new OptionsWidget(m_ptrSettings, m_pageSelectionAccessor)
+        );
+    }
+    return m_ptrOptionsWidget.get();
+}
+
 QString
 Filter::getName() const
 {
@@ -111,8 +120,8 @@ Filter::performRelinking(AbstractRelinker const& relinker)
 void
 Filter::preUpdateUI(FilterUiInterface* ui, PageId const& page_id)
 {
-    m_ptrOptionsWidget->preUpdateUI(page_id);
-    ui->setOptionsWidget(m_ptrOptionsWidget.get(), ui->KEEP_OWNERSHIP);
+    optionsWidget()->preUpdateUI(page_id);
+    ui->setOptionsWidget(optionsWidget(), ui->KEEP_OWNERSHIP);
 }
 
 QDomElement
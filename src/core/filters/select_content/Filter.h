@@ -25,13 +25,13 @@
 #include "IntrusivePtr.h"
 #include "FilterResult.h"
 #include "SafeDeletingQObjectPtr.h"
+#include "PageSelectionAccessor.h"
 #include "PageOrderOption.h"
 #include "Settings.h"
 #include <QCoreApplication>
 #include <vector>
 
 class PageId;
-class PageSelectionAccessor;
 class QString;
 
 namespace page_layout
@@ -90,10 +90,13 @@ public:
     IntrusivePtr<CacheDrivenTask> createCacheDrivenTask(
         IntrusivePtr<page_layout::CacheDrivenTask> const& next_task);
 
-    OptionsWidget* optionsWidget()
-    {
-        return m_ptrOptionsWidget.get();
-    }
+    /**
+     * \brief Returns the options widget, creating it on first use.
+     *
+     * Returns null when not running the GUI.  Must only be called
+     * from the GUI thread.
+     */
+    OptionsWidget* optionsWidget();
     Settings* getSettings()
     {
         return m_ptrSettings.get();
@@ -105,6 +108,7 @@ private:
         PageId const& page_id, int numeric_id) const;
 
     IntrusivePtr<Settings> m_ptrSettings;
+    PageSelectionAccessor m_pageSelectionAccessor;
     SafeDeletingQObjectPtr<OptionsWidget> m_ptrOptionsWidget;
     std::vector<PageOrderOption> m_pageOrderOptions;
     int m_selectedPageOrder;
@@ -55,56 +55,32 @@ OrderBySizeProvider::precedes(
     PageId const& lhs_page, bool const lhs_incomplete,
     PageId const& rhs_page, bool const rhs_incomplete) const
 {
+    return precedesByKey(lhs_page, lhs_incomplete, rhs_page, rhs_incomplete);
+}
 
-    if (lhs_incomplete != rhs_incomplete) {
+bool
+OrderBySizeProvider::sortKey(PageId const& page, bool const incomplete, SortKey& key) const
+{
+    if (incomplete) {
         // Pages with question mark go to the bottom.
-        return rhs_incomplete;
-    } else if (lhs_incomplete) {
-        assert(rhs_incomplete);
-        // Two pages with question marks are ordered naturally.
-        return lhs_page < rhs_page;
+        key[0] = 1;
+        return true;
     }
 
-    assert(lhs_incomplete == false);
-    assert(rhs_incomplete == false);
-
-    std::unique_ptr<Params> const lhs_params(m_ptrSettings->getPageParams(lhs_page));
-    std::unique_ptr<Params> const rhs_params(m_ptrSettings->getPageParams(rhs_page));
-
-    QSizeF lhs_size;
-    if (lhs_params.get()) {
-        lhs_size = lhs_params->contentRect().size();
-    }
-    QSizeF rhs_size;
-    if (rhs_params.get()) {
-        rhs_size = rhs_params->contentRect().size();
+    std::unique_ptr<Params> const params(m_ptrSettings->getPageParams(page));
+    QSizeF size;
+    if (params.get()) {
+        size = params->contentRect().size();
     }
 
-    bool const lhs_invalid = !lhs_size.isValid();
-    bool const rhs_invalid = !rhs_size.isValid();
-
-    if (lhs_invalid != rhs_invalid) {
+    if (!size.isValid()) {
         // Pages with question mark go to the bottom.
-        return rhs_invalid;
-    } else if (lhs_invalid) {
-        assert(rhs_invalid);
-        // Two pages with question marks are ordered naturally.
-        return lhs_page < rhs_page;
-    }
-
-    assert(lhs_invalid == false);
-    assert(rhs_incomplete == false);
-
-    qreal rv = m_byHeight ? rhs_size.height() : rhs_size.width();
-    qreal lv = m_byHeight ? lhs_size.height() : lhs_size.width();
-    rv = adjustByDpi(rv, rhs_params, StatusBarProvider::statusLabelPhysSizeDisplayMode);
-    lv = adjustByDpi(lv, lhs_params, StatusBarProvider::statusLabelPhysSizeDisplayMode);
-
-    if (lv != rv) {
-        return lv < rv;
+        key[1] = 1;
     } else {
-        return lhs_page < rhs_page;
+        qreal const val = m_byHeight ? size.height() : size.width();
+        key[2] = adjustByDpi(val, params, StatusBarProvider::statusLabelPhysSizeDisplayMode);
     }
+    return true;
 }
 
 QString _unknown = QObject::tr("?");
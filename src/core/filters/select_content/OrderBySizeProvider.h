@@ -36,6 +36,8 @@ public:
         PageId const& rhs_page, bool rhs_incomplete) const;
 
     virtual QString hint(PageId const& page) const;
+
+    virtual bool sortKey(PageId const& page, bool incomplete, SortKey& key) const;
 private:
     qreal adjustByDpi(qreal val, std::unique_ptr<Params> const& params,
                       StatusLabelPhysSizeDisplayMode mode = StatusLabelPhysSizeDisplayMode::Inch,
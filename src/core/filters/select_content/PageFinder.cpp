@@ -24,6 +24,8 @@
 #include "DebugImages.h"
 #include "FilterData.h"
 #include "ImageTransformation.h"
+#include "IntermediateCache.h"
+#include "ImageId.h"
 #include "imageproc/BinaryImage.h"
 #include "imageproc/Binarize.h"
 #include "imageproc/Transform.h"
@@ -39,6 +41,7 @@
 #include <QRect>
 #include <QRectF>
 #include <QTransform>
+#include <vector>
 
 namespace select_content
 {
@@ -47,7 +50,8 @@ using namespace imageproc;
 
 QRectF
 PageFinder::findPageBox(
-    TaskStatus const& status, FilterData const& data, bool fine_tune, QSizeF const& box, double tolerance, Margins borders, DebugImages* dbg)
+    TaskStatus const& status, FilterData const& data, ImageId const& image_id,
+    bool fine_tune, QSizeF const& box, double tolerance, Margins borders, DebugImages* dbg)
 {
     ImageTransformation xform_150dpi(data.xform());
     xform_150dpi.preScaleToDpi(Dpi(150, 150));
@@ -66,47 +70,63 @@ PageFinder::findPageBox(
     std::cout << "exp_width = " << exp_width << "; exp_height" << exp_height << std::endl;
 #endif
 
-    uint8_t const darkest_gray_level = darkestGrayLevel(data.grayImage());
-    QColor const outside_color(darkest_gray_level, darkest_gray_level, darkest_gray_level);
-
-    QImage gray150(
-        transformToGray(
-            data.grayImage(), xform_150dpi.transform(),
-            xform_150dpi.resultingRect().toRect(),
-            OutsidePixels::assumeColor(outside_color)
-        )
-    );
-    // Note that we fill new areas that appear as a result of
-    // rotation with black, not white.  Filling them with white
-    // may be bad for detecting the shadow around the page.
-    if (dbg) {
-        dbg->add(gray150, "gray150");
-    }
-
     std::vector<QRect> rects;
     std::vector<BinaryImage> bwimages;
 
-    // get binary images from gray150 using different algorithm
-    bwimages.push_back(peakThreshold(gray150));
-    bwimages.push_back(binarizeOtsu(gray150));
-    bwimages.push_back(binarizeMokji(gray150));
-    bwimages.push_back(binarizeSauvola(gray150, gray150.size()));
-    bwimages.push_back(binarizeWolf(gray150, gray150.size()));
-    if (dbg) {
-        dbg->add(bwimages[0], "peakThreshold");
-        dbg->add(bwimages[1], "OtsuThreshold");
-        dbg->add(bwimages[2], "MokjiThreshold");
-        dbg->add(bwimages[3], "SauvolaThreshold");
-        dbg->add(bwimages[4], "WolfThreshold");
+    // Debug images need the binarizations to run, so bypass the cache then.
+    IntermediateCache::Key cache_key;
+    if (!dbg) {
+        cache_key = IntermediateCache::Key(image_id, "page_finder");
+        cache_key.add(xform_150dpi.transform())
+        .add(xform_150dpi.resultingRect());
     }
 
+    if (!IntermediateCache::load(cache_key, bwimages, 5)) {
+        bwimages.clear();
+
+        uint8_t const darkest_gray_level = darkestGrayLevel(data.grayImage());
+        QColor const outside_color(darkest_gray_level, darkest_gray_level, darkest_gray_level);
+
+        QImage gray150(
+            transformToGray(
+                data.grayImage(), xform_150dpi.transform(),
+                xform_150dpi.resultingRect().toRect(),
+                OutsidePixels::assumeColor(outside_color)
+            )
+        );
+        // Note that we fill new areas that appear as a result of
+        // rotation with black, not white.  Filling them with white
+        // may be bad for detecting the shadow around the page.
+        if (dbg) {
+            dbg->add(gray150, "gray150");
+        }
+
+        // get binary images from gray150 using different algorithm
+        bwimages.push_back(peakThreshold(gray150));
+        bwimages.push_back(binarizeOtsu(gray150));
+        bwimages.push_back(binarizeMokji(gray150));
+        bwimages.push_back(binarizeSauvola(gray150, gray150.size()));
+        bwimages.push_back(binarizeWolf(gray150, gray150.size()));
+        if (dbg) {
+            dbg->add(bwimages[0], "peakThreshold");
+            dbg->add(bwimages[1], "OtsuThreshold");
+            dbg->add(bwimages[2], "MokjiThreshold");
+            dbg->add(bwimages[3], "SauvolaThreshold");
+            dbg->add(bwimages[4], "WolfThreshold");
+        }
+
+        IntermediateCache::store(cache_key, bwimages);
+    }
+
+    status.throwIfCancelled();
+
     QRect content_rect(0, 0, 0, 0);
     double err_width = 1.0;
     double err_height = 1.0;
 
     if (box.isEmpty()) {
         // detect content box with otsu
-        QImage bwimg(bwimages[3].toQImage());
+        BinaryImage const& bwimg = bwimages[3];
         content_rect = detectBorders(bwimg);
         if (fine_tune) {
             fineTuneCorners(bwimg, content_rect, QSize(0, 0), 1.0);
@@ -115,7 +135,7 @@ PageFinder::findPageBox(
         // detect content box using different binarized images
         for (size_t i = 0; i < bwimages.size(); ++i) {
             // detect content box
-            QImage bwimg(bwimages[i].toQImage());
+            BinaryImage const& bwimg = bwimages[i];
             rects.push_back(QRect(detectBorders(bwimg)));
             if (fine_tune) {
                 fineTuneCorners(bwimg, rects[i], QSize(exp_width, exp_height), tolerance);
@@ -169,7 +189,7 @@ PageFinder::findPageBox(
 }
 
 QRect
-PageFinder::detectBorders(QImage const& img)
+PageFinder::detectBorders(BinaryImage const& img)
 {
     int l = 0, t = 0, r = img.width() - 1, b = img.height() - 1;
     int xmid = r / 2;
@@ -191,7 +211,7 @@ PageFinder::detectBorders(QImage const& img)
  * shift edge while points around mid are black
  */
 int
-PageFinder::detectEdge(QImage const& img, int start, int end, int inc, int mid, Qt::Orientation orient)
+PageFinder::detectEdge(BinaryImage const& img, int start, int end, int inc, int mid, Qt::Orientation orient)
 {
     int min_size = 10;
     int gap = 0;
@@ -201,23 +221,28 @@ PageFinder::detectEdge(QImage const& img, int start, int end, int inc, int mid,
     int ms = 0;
     int me = 2 * mid;
     int min_bp = int(double(me - ms) * 0.95);
-    Qt::GlobalColor black = Qt::color1;
+
+    // Columns are counted a word at a time, as that's a single pass
+    // over the rows for 32 of them.
+    int column_counts[32];
+    int counted_word = -1;
 
     while (i != end) {
         int black_pixels = 0;
 //        int old_gap = gap;
 
         // count black pixels on the edge around given point
-        for (int j = ms; j != me; j++) {
-            int x = i, y = j;
-            if (orient == Qt::Vertical) {
-                x = j;
-                y = i;
-            }
-            int pixel = img.pixelIndex(x, y);
-            if (pixel == black) {
-                ++black_pixels;
+        if (me <= ms) {
+            // Nothing to count.
+        } else if (orient == Qt::Vertical) {
+            black_pixels = img.countBlackPixels(QRect(ms, i, me - ms, 1));
+        } else {
+            int const word = i >> 5;
+            if (word != counted_word) {
+                countColumnBlackPixels(img, word, ms, me, column_counts);
+                counted_word = word;
             }
+            black_pixels = column_counts[i & 31];
         }
 
         if (black_pixels < min_bp) {
@@ -237,8 +262,28 @@ PageFinder::detectEdge(QImage const& img, int start, int end, int inc, int mid,
     return edge;
 }
 
+/**
+ * count black pixels in rows [top, bottom) of the 32 columns of a word
+ */
+void
+PageFinder::countColumnBlackPixels(BinaryImage const& img, int word, int top, int bottom, int counts[32])
+{
+    for (int bit = 0; bit < 32; ++bit) {
+        counts[bit] = 0;
+    }
+
+    int const wpl = img.wordsPerLine();
+    uint32_t const* line = img.data() + top * wpl + word;
+    for (int y = top; y < bottom; ++y, line += wpl) {
+        uint32_t const bits = *line;
+        for (int bit = 0; bit < 32; ++bit) {
+            counts[bit] += (bits >> (31 - bit)) & 1;
+        }
+    }
+}
+
 void
-PageFinder::fineTuneCorners(QImage const& img, QRect& rect, QSize const& size, double tolerance)
+PageFinder::fineTuneCorners(BinaryImage const& img, QRect& rect, QSize const& size, double tolerance)
 {
     int l = rect.left(), t = rect.top(), r = rect.right(), b = rect.bottom();
     bool done = false;
@@ -260,14 +305,14 @@ PageFinder::fineTuneCorners(QImage const& img, QRect& rect, QSize const& size, d
  * shift edges until given corner is out of black
  */
 bool
-PageFinder::fineTuneCorner(QImage const& img, int& x, int& y, int max_x, int max_y, int inc_x, int inc_y, QSize const& size, double tolerance)
+PageFinder::fineTuneCorner(BinaryImage const& img, int& x, int& y, int max_x, int max_y, int inc_x, int inc_y, QSize const& size, double tolerance)
 {
     int width_t = size.width() * (1.0 - tolerance);
     int height_t = size.height() * (1.0 - tolerance);
 
-    Qt::GlobalColor black = Qt::color1;
     //while (1) {
-    int pixel = img.pixelIndex(x, y);
+    uint32_t const* line = img.data() + y * img.wordsPerLine();
+    bool const black = (line[x >> 5] >> (31 - (x & 31))) & 1;
     int tx = x + inc_x;
     int ty = y + inc_y;
     int w = abs(max_x - x);
@@ -276,7 +321,7 @@ PageFinder::fineTuneCorner(QImage const& img, int& x, int& y, int max_x, int max
     if ((! size.isEmpty()) && (w < width_t || h < height_t)) {
         return true;
     }
-    if (pixel != black || tx < 0 || tx > (img.width() - 1) || ty < 0 || ty > (img.height() - 1)) {
+    if (!black || tx < 0 || tx > (img.width() - 1) || ty < 0 || ty > (img.height() - 1)) {
         return true;
     }
     x = tx;
@@ -28,6 +28,7 @@
 class TaskStatus;
 class DebugImages;
 class FilterData;
+class ImageId;
 class QImage;
 class QRect;
 class QRectF;
@@ -45,13 +46,21 @@ namespace select_content
 class PageFinder
 {
 public:
+    /**
+     * The binarized images the page box is searched in only depend on the
+     * source image and its transformation, so they are kept in
+     * IntermediateCache.  Changing the detection box, tolerance or borders
+     * then only repeats the cheap edge search.
+     */
     static QRectF findPageBox(
-        TaskStatus const& status, FilterData const& data, bool fine_tune, QSizeF const& box, double tolerance, Margins borders, DebugImages* dbg = 0);
+        TaskStatus const& status, FilterData const& data, ImageId const& image_id,
+        bool fine_tune, QSizeF const& box, double tolerance, Margins borders, DebugImages* dbg = 0);
 private:
-    static QRect detectBorders(QImage const& img);
-    static int detectEdge(QImage const& img, int start, int end, int inc, int mid, Qt::Orientation orient);
-    static void fineTuneCorners(QImage const& img, QRect& rect, QSize const& size, double tolerance);
-    static bool fineTuneCorner(QImage const& img, int& x, int& y, int max_x, int max_y, int inc_x, int inc_y, QSize const& size, double tolerance);
+    static QRect detectBorders(imageproc::BinaryImage const& img);
+    static int detectEdge(imageproc::BinaryImage const& img, int start, int end, int inc, int mid, Qt::Orientation orient);
+    static void countColumnBlackPixels(imageproc::BinaryImage const& img, int word, int top, int bottom, int counts[32]);
+    static void fineTuneCorners(imageproc::BinaryImage const& img, QRect& rect, QSize const& size, double tolerance);
+    static bool fineTuneCorner(imageproc::BinaryImage const& img, int& x, int& y, int max_x, int max_y, int inc_x, int inc_y, QSize const& size, double tolerance);
 };
 
 } // namespace select_content
@@ -20,7 +20,8 @@
 #include "Utils.h"
 #include "RelinkablePath.h"
 #include "AbstractRelinker.h"
-#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
 #include "settings/ini_keys.h"
 #include <cmath>
 #include <iostream>
@@ -45,14 +46,14 @@ Settings::~Settings()
 void
 Settings::clear()
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_pageParams.clear();
 }
 
 void
 Settings::performRelinking(AbstractRelinker const& relinker)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     PageParams new_params;
 
     for (PageParams::value_type const& kv : m_pageParams) {
@@ -93,21 +94,21 @@ void Settings::updateDeviation()
 void
 Settings::setPageParams(PageId const& page_id, Params const& params)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     Utils::mapSetValue(m_pageParams, page_id, params);
 }
 
 void
 Settings::clearPageParams(PageId const& page_id)
 {
-    QMutexLocker locker(&m_mutex);
+    QWriteLocker const locker(&m_lock);
     m_pageParams.erase(page_id);
 }
 
 std::unique_ptr<Params>
 Settings::getPageParams(PageId const& page_id) const
 {
-    QMutexLocker locker(&m_mutex);
+    QReadLocker const locker(&m_lock);
 
     PageParams::const_iterator const it(m_pageParams.find(page_id));
     if (it != m_pageParams.end()) {
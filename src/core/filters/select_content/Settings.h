@@ -23,7 +23,7 @@
 #include "NonCopyable.h"
 #include "PageId.h"
 #include "Params.h"
-#include <QMutex>
+#include <QReadWriteLock>
 #include <memory>
 #include <map>
 
@@ -99,7 +99,7 @@ public:
 private:
     typedef std::map<PageId, Params> PageParams;
 
-    mutable QMutex m_mutex;
+    mutable QReadWriteLock m_lock;
     PageParams m_pageParams;
     double m_avg;
     double m_sigma;
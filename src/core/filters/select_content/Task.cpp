@@ -34,6 +34,7 @@
 #include "ImageTransformation.h"
 #include "PhysSizeCalc.h"
 #include "filters/page_layout/Task.h"
+#include "Profiler.h"
 #include <QObject>
 #include <QTransform>
 #include <QDebug>
@@ -92,6 +93,9 @@ Task::~Task()
 FilterResultPtr
 Task::process(TaskStatus const& status, FilterData const& data)
 {
+    Profiler::Scope const profile_scope("select_content", m_pageId);
+    Profiler::addCounter("pixels", qint64(data.origImage().width()) * data.origImage().height());
+
     status.throwIfCancelled();
 
     Dependencies const deps(data.xform().resultingPreCropArea());
@@ -130,10 +134,12 @@ Task::process(TaskStatus const& status, FilterData const& data)
         new_params.setPageRect(params->pageRect());
         */
         new_params = *params;
-        new_params.setDependencies(deps);
-        if (regeneration_enforced || !params->dependencies().matches(deps)) {
+        if (regeneration_enforced || !params->dependencies().nearlyMatches(deps)) {
+            new_params.setDependencies(deps);
             goto create_new_content;
         }
+        // Otherwise the stored boxes are kept along with the dependencies
+        // they were found for, so that a series of tiny changes can't add up.
     } else {
     create_new_content:
         QRectF page_rect(data.xform().resultingRect());
@@ -141,12 +147,12 @@ Task::process(TaskStatus const& status, FilterData const& data)
 
         if (regeneration_enforced || new_params.isPageDetectionEnabled()) {
             //std::cout << "PageFinder" << std::endl;
-            page_rect = PageFinder::findPageBox(status, data, new_params.isFineTuningEnabled(), m_ptrSettings->pageDetectionBox(), m_ptrSettings->pageDetectionTolerance(), new_params.pageBorders(), m_ptrDbg.get());
+            page_rect = PageFinder::findPageBox(status, data, m_pageId.imageId(), new_params.isFineTuningEnabled(), m_ptrSettings->pageDetectionBox(), m_ptrSettings->pageDetectionTolerance(), new_params.pageBorders(), m_ptrDbg.get());
         }
 
         if (regeneration_enforced || (new_params.isContentDetectionEnabled() && new_params.mode() == MODE_AUTO)) {
             //std::cout << "ContentBoxFinder" << std::endl;
-            content_rect = ContentBoxFinder::findContentBox(status, data, page_rect, m_ptrDbg.get());
+            content_rect = ContentBoxFinder::findContentBox(status, data, page_rect, m_pageId.imageId(), m_ptrDbg.get());
         } else if (new_params.isContentDetectionEnabled() && new_params.mode() == MODE_MANUAL &&
                    // allow isNull as content rect may be deleted from page
                    (new_params.contentRect().isValid() || new_params.contentRect().isNull())) {
@@ -191,13 +197,13 @@ Task::process(TaskStatus const& status, FilterData const& data)
         QRectF page_rect(data.xform().resultingRect());
         if (new_params.isPageDetectionEnabled()) {
             std::cout << "PageFinder" << std::endl;
-            page_rect = PageFinder::findPageBox(status, data, new_params.isFineTuningEnabled(), m_ptrSettings->pageDetectionBox(), m_ptrSettings->pageDetectionTolerance(), new_params.pageBorders(), m_ptrDbg.get());
+            page_rect = PageFinder::findPageBox(status, data, m_pageId.imageId(), new_params.isFineTuningEnabled(), m_ptrSettings->pageDetectionBox(), m_ptrSettings->pageDetectionTolerance(), new_params.pageBorders(), m_ptrDbg.get());
         }
         new_params.setPageRect(page_rect);
 
         QRectF content_rect(page_rect);
         if (new_params.isContentDetectionEnabled() && new_params.mode() == MODE_AUTO) {
-            content_rect = ContentBoxFinder::findContentBox(status, data, page_rect, m_ptrDbg.get());
+            content_rect = ContentBoxFinder::findContentBox(status, data, page_rect, m_pageId.imageId(), m_ptrDbg.get());
         } else if (params.get() && new_params.isContentDetectionEnabled() && new_params.mode() == MODE_MANUAL) {
             std::cout << "params->contentRect()" << std::endl;
             content_rect = params->contentRect();
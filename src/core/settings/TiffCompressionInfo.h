@@ -16,6 +16,7 @@ class TiffCompressions
 {
 public:
     static const TiffCompressionInfo& info(QString const& name);
+    static bool contains(QString const& name) { return compression_data.contains(name); }
     static QMap<QString, TiffCompressionInfo>::const_iterator constBegin() { return compression_data.constBegin(); }
     static QMap<QString, TiffCompressionInfo>::const_iterator constEnd() { return compression_data.constEnd(); }
 private:
@@ -19,6 +19,7 @@
 #include "globalstaticsettings.h"
 
 #include "TiffCompressionInfo.h"
+#include "OutputCache.h"
 
 
 QString GlobalStaticSettings::m_tiff_compr_method_bw;
@@ -32,7 +33,12 @@ bool GlobalStaticSettings::m_drawDeviants = false;
 int  GlobalStaticSettings::m_currentStage = 0;
 int  GlobalStaticSettings::m_binrization_threshold_control_default = 0;
 bool GlobalStaticSettings::m_use_horizontal_predictor = false;
+int GlobalStaticSettings::m_tiff_rows_per_strip = _key_tiff_compr_rows_per_strip_def;
+int GlobalStaticSettings::m_tiff_jpeg_quality = _key_tiff_compr_jpeg_quality_def;
+int GlobalStaticSettings::m_tiff_deflate_level = _key_tiff_compr_deflate_level_def;
 bool GlobalStaticSettings::m_disable_bw_smoothing = false;
+bool GlobalStaticSettings::m_despeckle_tiled = _key_output_despeckling_tiled_def;
+bool GlobalStaticSettings::m_output_quick_preview = _key_output_quick_preview_def;
 qreal GlobalStaticSettings::m_zone_editor_min_angle = 3.0;
 float GlobalStaticSettings::m_picture_detection_sensitivity = 100.;
 QColor GlobalStaticSettings::m_deskew_controls_color;
@@ -49,14 +55,17 @@ int GlobalStaticSettings::m_thumbsBoundaryAdjTop = 5;
 int GlobalStaticSettings::m_thumbsBoundaryAdjBottom = 5;
 int GlobalStaticSettings::m_thumbsBoundaryAdjLeft = 5;
 int GlobalStaticSettings::m_thumbsBoundaryAdjRight = 3;
+int GlobalStaticSettings::m_thumbsVirtualizeThreshold = 2000;
 bool GlobalStaticSettings::m_fixedMaxLogicalThumbSize = false;
 bool GlobalStaticSettings::m_displayOrderHints = true;
 
 bool GlobalStaticSettings::m_dewarpAutoVertHalfCorrection = false;
 bool GlobalStaticSettings::m_dewarpAutoDeskewAfterDewarp = false;
+bool GlobalStaticSettings::m_dewarpPyramidEdgeTracing = _key_dewarp_pyramid_edge_tracing_def;
 bool GlobalStaticSettings::m_simulateSelectionModifier = false;
 bool GlobalStaticSettings::m_simulateSelectionModifierHintEnabled = true;
 bool GlobalStaticSettings::m_inversePageOrder = false;
+bool GlobalStaticSettings::m_projectBinarySnapshot = _key_project_binary_snapshot_def;
 
 bool GlobalStaticSettings::m_DontUseNativeDialog = true;
 
@@ -105,7 +114,12 @@ void GlobalStaticSettings::updateSettings()
     setTiffCompressionColor( settings.value(_key_tiff_compr_method_color, _key_tiff_compr_method_color_def).toString() );
     m_binrization_threshold_control_default = settings.value(_key_output_bin_threshold_default, _key_output_bin_threshold_default_def).toInt();
     m_use_horizontal_predictor = settings.value(_key_tiff_compr_horiz_pred, _key_tiff_compr_horiz_pred_def).toBool();
+    m_tiff_rows_per_strip = settings.value(_key_tiff_compr_rows_per_strip, _key_tiff_compr_rows_per_strip_def).toInt();
+    m_tiff_jpeg_quality = qBound(1, settings.value(_key_tiff_compr_jpeg_quality, _key_tiff_compr_jpeg_quality_def).toInt(), 100);
+    m_tiff_deflate_level = qBound(1, settings.value(_key_tiff_compr_deflate_level, _key_tiff_compr_deflate_level_def).toInt(), 9);
     m_disable_bw_smoothing = settings.value(_key_mode_bw_disable_smoothing, _key_mode_bw_disable_smoothing_def).toBool();
+    m_despeckle_tiled = settings.value(_key_output_despeckling_tiled, _key_output_despeckling_tiled_def).toBool();
+    m_output_quick_preview = settings.value(_key_output_quick_preview, _key_output_quick_preview_def).toBool();
     m_zone_editor_min_angle = settings.value(_key_zone_editor_min_angle, _key_zone_editor_min_angle_def).toReal();
     m_picture_detection_sensitivity = settings.value(_key_picture_zones_layer_sensitivity, _key_picture_zones_layer_sensitivity_def).toInt();
     m_deskew_controls_color.setNamedColor(settings.value(_key_deskew_controls_color, _key_deskew_controls_color_def).toString());
@@ -127,15 +141,21 @@ void GlobalStaticSettings::updateSettings()
     m_thumbsBoundaryAdjBottom = settings.value(_key_thumbnails_boundary_adj_bottom, _key_thumbnails_boundary_adj_bottom_def).toInt();
     m_thumbsBoundaryAdjLeft = settings.value(_key_thumbnails_boundary_adj_left, _key_thumbnails_boundary_adj_left_def).toInt();
     m_thumbsBoundaryAdjRight = settings.value(_key_thumbnails_boundary_adj_right, _key_thumbnails_boundary_adj_right_def).toInt();
+    m_thumbsVirtualizeThreshold = settings.value(_key_thumbnails_virtualize_threshold, _key_thumbnails_virtualize_threshold_def).toInt();
     m_fixedMaxLogicalThumbSize = settings.value(_key_thumbnails_fixed_thumb_size, _key_thumbnails_fixed_thumb_size_def).toBool();
     m_displayOrderHints = settings.value(_key_thumbnails_display_order_hints, _key_thumbnails_display_order_hints_def).toBool();
 
     m_dewarpAutoVertHalfCorrection = settings.value(_key_dewarp_auto_vert_half_correction, _key_dewarp_auto_vert_half_correction_def).toBool();
     m_dewarpAutoDeskewAfterDewarp = settings.value(_key_dewarp_auto_deskew_after_dewarp, _key_dewarp_auto_deskew_after_dewarp_def).toBool();
+    m_dewarpPyramidEdgeTracing = settings.value(_key_dewarp_pyramid_edge_tracing, _key_dewarp_pyramid_edge_tracing_def).toBool();
 
     m_simulateSelectionModifierHintEnabled = settings.value(_key_thumbnails_simulate_key_press_hint, _key_thumbnails_simulate_key_press_hint_def).toBool();
 
     m_DontUseNativeDialog = settings.value(_key_dont_use_native_dialog, _key_dont_use_native_dialog_def).toBool();
+
+    m_projectBinarySnapshot = settings.value(_key_project_binary_snapshot, _key_project_binary_snapshot_def).toBool();
+
+    OutputCache::setCacheDir(settings.value(_key_output_shared_cache_dir, _key_output_shared_cache_dir_def).toString());
 }
 
 void GlobalStaticSettings::updateHotkeys()
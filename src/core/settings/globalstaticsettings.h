@@ -66,7 +66,12 @@ public:
     static int m_tiff_compression_color_id;
     static int m_binrization_threshold_control_default;
     static bool m_use_horizontal_predictor;
+    static int m_tiff_rows_per_strip;
+    static int m_tiff_jpeg_quality;
+    static int m_tiff_deflate_level;
     static bool m_disable_bw_smoothing;
+    static bool m_despeckle_tiled;
+    static bool m_output_quick_preview;
     static qreal m_zone_editor_min_angle;
     static float m_picture_detection_sensitivity;
     static QColor m_deskew_controls_color;
@@ -83,14 +88,17 @@ public:
     static int m_thumbsBoundaryAdjBottom;
     static int m_thumbsBoundaryAdjLeft;
     static int m_thumbsBoundaryAdjRight;
+    static int m_thumbsVirtualizeThreshold;
     static bool m_fixedMaxLogicalThumbSize;
     static bool m_displayOrderHints;
 
     static bool m_dewarpAutoVertHalfCorrection;
     static bool m_dewarpAutoDeskewAfterDewarp;
+    static bool m_dewarpPyramidEdgeTracing;
     static bool m_simulateSelectionModifier;
     static bool m_simulateSelectionModifierHintEnabled;
     static bool m_inversePageOrder;
+    static bool m_projectBinarySnapshot;
 
     static bool m_DontUseNativeDialog;
 };
@@ -51,12 +51,18 @@ static const bool _key_batch_dialog_start_from_current_def = true;
 static const char* _key_batch_dialog_remember_choice = "batch_dialog/remember_choice";
 static const bool _key_batch_dialog_remember_choice_def = false;
 static const char* _key_batch_processing_priority = "settings/batch_processing_priority";
+static const char* _key_batch_processing_threads = "settings/batch_processing_threads";
+static const int _key_batch_processing_threads_def = 1;
+static const char* _key_batch_processing_adaptive = "settings/batch_processing_adaptive";
+static const bool _key_batch_processing_adaptive_def = true;
 
 /* Thumbnails */
 
 static const char* _key_thumbnails_category = "thumbnails/";
 static const char* _key_thumbnails_max_cache_pixmap_size = "thumbnails/max_cache_pixmap_size";
 static const QSize _key_thumbnails_max_cache_pixmap_size_def = QSize(200, 200);
+static const char* _key_thumbnails_max_cache_memory_mb = "thumbnails/max_cache_memory_mb";
+static const int _key_thumbnails_max_cache_memory_mb_def = 64;
 static const char* _key_thumbnails_max_thumb_size = "thumbnails/max_thumb_size";
 static const QSizeF _key_thumbnails_max_thumb_size_def = QSizeF(250., 160.);
 static const char* _key_thumbnails_non_focused_selection_highlight_color_adj = "thumbnails/non_focused_selection_highlight_color_adj";
@@ -73,6 +79,8 @@ static const char* _key_thumbnails_boundary_adj_left = "thumbnails/boundary_adj_
 static const int _key_thumbnails_boundary_adj_left_def  = 5;
 static const char* _key_thumbnails_boundary_adj_right = "thumbnails/boundary_adj_right";
 static const int _key_thumbnails_boundary_adj_right_def = 3;
+static const char* _key_thumbnails_virtualize_threshold = "thumbnails/virtualize_threshold";
+static const int _key_thumbnails_virtualize_threshold_def = 2000;
 static const char* _key_thumbnails_fixed_thumb_size = "thumbnails/fixed_thumb_size";
 static const bool _key_thumbnails_fixed_thumb_size_def = false;
 static const char* _key_thumbnails_display_order_hints = "thumbnails/display_order_hints";
@@ -91,6 +99,12 @@ static const char* _key_export_keep_original_color = "settings/keep_original_col
 static const bool  _key_export_keep_original_color_def = false;
 static const char* _key_export_to_multipage = "settings/export_to_multipage";
 static const bool  _key_export_to_multipage_def = false;
+static const char* _key_export_to_mrc_pdf = "settings/export_to_mrc_pdf";
+static const bool  _key_export_to_mrc_pdf_def = false;
+static const char* _key_export_mrc_pdf_jbig2 = "settings/export_mrc_pdf_jbig2";
+static const bool  _key_export_mrc_pdf_jbig2_def = false;
+static const char* _key_export_generate_output = "settings/export_generate_output";
+static const bool  _key_export_generate_output_def = false;
 static const char* _key_export_split_mixed_settings = "settings/split_mixed_settings";
 namespace exporting {
 static const int _key_export_split_mixed_settings_def = (int) ExportModes(ExportMode::Foreground | ExportMode::Background);
@@ -186,6 +200,12 @@ static const char* _key_output_bin_threshold_default = "output/binrization_thres
 static const int _key_output_bin_threshold_default_def = 0;
 static const char* _key_output_despeckling_default_lvl = "despeckling/default_level";
 static const output::DespeckleLevel _key_output_despeckling_default_lvl_def = output::DespeckleLevel::DESPECKLE_CAUTIOUS;
+static const char* _key_output_despeckling_tiled = "despeckling/tiled";
+static const bool _key_output_despeckling_tiled_def = false;
+static const char* _key_output_shared_cache_dir = "output/shared_cache_dir";
+static const char* _key_output_shared_cache_dir_def = "";
+static const char* _key_output_quick_preview = "output/quick_preview";
+static const bool _key_output_quick_preview_def = true;
 static const char* _key_output_foreground_layer_control_threshold = "foreground_layer/control_threshold";
 static const bool _key_output_foreground_layer_control_threshold_def = false;
 
@@ -200,6 +220,8 @@ static const char* _key_dewarp_auto_vert_half_correction = "dewarp/auto_vert_hal
 static const bool _key_dewarp_auto_vert_half_correction_def = false;
 static const char* _key_dewarp_auto_deskew_after_dewarp = "dewarp/auto_deskew_after_dewarp";
 static const bool _key_dewarp_auto_deskew_after_dewarp_def = false;
+static const char* _key_dewarp_pyramid_edge_tracing = "dewarp/pyramid_edge_tracing";
+static const bool _key_dewarp_pyramid_edge_tracing_def = false;
 /* Misc */
 
 static const char* _key_autosave_inputdir = "auto-save_project/_inputDir";
@@ -214,6 +236,8 @@ static const char* _key_dpi_predefined_list_def = "300x300,400x400,600x600";
 static const char* _key_dpi_change_list = "dpi/change_dpi_list";
 static const char* _key_dpi_change_list_def = "300,400,600" ;
 static const char* _key_project_last_dir = "project/lastDir";
+static const char* _key_project_binary_snapshot = "project/binary_snapshot";
+static const bool _key_project_binary_snapshot_def = false;
 static const char* _key_hot_keys_jump_forward_pg_num = "hot_keys/jump_forward_pg_num";
 static const int _key_hot_keys_jump_forward_pg_num_def = 5;
 static const char* _key_hot_keys_jump_backward_pg_num = "hot_keys/jump_backward_pg_num";
@@ -242,6 +266,12 @@ static const char* _key_tiff_compr_method_color = "tiff_compression/method_color
 static const char* _key_tiff_compr_method_color_def = "LZW";
 static const char* _key_tiff_compr_horiz_pred = "tiff_compression/use_horizontal_predictor";
 static const bool _key_tiff_compr_horiz_pred_def = false;
+static const char* _key_tiff_compr_rows_per_strip = "tiff_compression/rows_per_strip";
+static const int _key_tiff_compr_rows_per_strip_def = 256;
+static const char* _key_tiff_compr_jpeg_quality = "tiff_compression/jpeg_quality";
+static const int _key_tiff_compr_jpeg_quality_def = 85;
+static const char* _key_tiff_compr_deflate_level = "tiff_compression/deflate_level";
+static const int _key_tiff_compr_deflate_level_def = 6;
 static const char* _key_tiff_compr_show_all = "tiff_compression/show_all";
 static const bool _key_tiff_compr_show_all_def = false;
 
@@ -143,6 +143,59 @@ BOOST_AUTO_TEST_CASE(test4)
     }
 }
 
+BOOST_AUTO_TEST_CASE(test5)
+{
+    // Square systems small enough for LinearSolver's fixed size code.
+    static double const A2[] = {
+        2, 1,
+        1, 3
+    };
+
+    static double const B2[] = {
+        3, 5
+    };
+
+    static double const control2[] = {
+        0.8, 1.4
+    };
+
+    static double const A4[] = {
+        0, 2, 0, 1,
+        1, 0, 0, 0,
+        0, 1, 3, 0,
+        4, 0, 1, 1
+    };
+
+    static double const B4[] = {
+        5, 1, 11, 8
+    };
+
+    static double const control4[] = {
+        1, 2, 3, 1
+    };
+
+    static double const singular[] = {
+        1, 2,
+        2, 4
+    };
+
+    double x2[2];
+    double x4[4];
+
+    MatrixCalc<double> mc;
+    mc(A2, 2, 2).trans().solve(mc(B2, 2, 1)).write(x2);
+    mc(A4, 4, 4).trans().solve(mc(B4, 4, 1)).write(x4);
+
+    for (int i = 0; i < 2; ++i) {
+        BOOST_REQUIRE_CLOSE(x2[i], control2[i], 1e-6);
+    }
+    for (int i = 0; i < 4; ++i) {
+        BOOST_REQUIRE_CLOSE(x4[i], control4[i], 1e-6);
+    }
+
+    BOOST_CHECK_THROW(mc(singular, 2, 2).solve(mc(B2, 2, 1)), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
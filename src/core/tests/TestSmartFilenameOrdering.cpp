@@ -19,6 +19,8 @@
 #include "SmartFilenameOrdering.h"
 #include <QFileInfo>
 #include <QString>
+#include <QStringList>
+#include <algorithm>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -80,6 +82,20 @@ BOOST_AUTO_TEST_CASE(test_almost_equal)
     BOOST_CHECK(less(rhs, lhs) == true);
 }
 
+BOOST_AUTO_TEST_CASE(test_sort_matches_predicate)
+{
+    QStringList files;
+    files << "/etc/a10_10.png" << "/etc/10.png" << "/ect/file" << "/etc/a_1.png"
+          << "/etc/010.png" << "/etc/a010_2.png" << "/etc/2.png" << "/etc/a_0002.png"
+          << "/etc/1.png" << "/etc/file" << "/etc/page1b" << "/etc/page1a";
+
+    QStringList expected(files);
+    std::sort(expected.begin(), expected.end(), SmartFilenameOrdering());
+
+    SmartFilenameOrdering::sort(files.begin(), files.end());
+    BOOST_CHECK(files == expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace Tests
@@ -64,7 +64,7 @@ BasicSplineVisualizer::drawSpline(
     QPainter& painter, QTransform const& to_screen, EditableSpline::Ptr const& spline)
 {
     prepareForSpline(painter, spline);
-    painter.drawPolygon(to_screen.map(spline->toPolygon()), Qt::WindingFill);
+    painter.drawPolygon(spline->polygon(to_screen), Qt::WindingFill);
 }
 
 void
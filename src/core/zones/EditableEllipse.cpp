@@ -24,6 +24,7 @@
 #include <QDomNode>
 #include <QDomElement>
 #include <QString>
+#include <QPainterPath>
 #include <assert.h>
 #include <cmath>
 
@@ -110,3 +111,14 @@ EditableEllipse::area() const
 {
     return M_PI * m_rx * m_ry / 4;
 }
+
+QPolygonF const&
+EditableEllipse::toPolygon() const
+{
+    if (m_polygon.isEmpty()) {
+        QPainterPath path;
+        path.addEllipse(m_center, m_rx, m_ry);
+        m_polygon = transform().map(path).toFillPolygon();
+    }
+    return m_polygon;
+}
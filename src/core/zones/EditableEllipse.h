@@ -25,6 +25,7 @@
 #include "SerializableEllipse.h"
 #include <QPointF>
 #include <QVector>
+#include <QPolygonF>
 #include <QDomElement>
 #include <QTransform>
 #include <cmath>
@@ -68,10 +69,11 @@ public:
         for (QPointF& p: m_points) {
             p += diff;
         }
+        m_polygon.clear();
     }
 
     const QVector<QPointF> & const_data() const { return m_points; }
-    QVector<QPointF> & data() { return m_points; }
+    QVector<QPointF> & data() { m_polygon.clear(); return m_points; }
 
     void changePoint(int idx, QPointF const & new_point, bool make_circle = false);
 
@@ -82,6 +84,12 @@ public:
 
     double area() const;
 
+    /**
+     * \brief Returns the outline of the rotated ellipse, cached until
+     *        the ellipse is modified.
+     */
+    QPolygonF const& toPolygon() const;
+
 private:
     void update_points() {
         const double c = cos(m_angle);
@@ -92,6 +100,7 @@ private:
         m_points[1] = m_center + ry;
         m_points[2] = m_center - rx;
         m_points[3] = m_center - ry;
+        m_polygon.clear();
     }
 
 private:
@@ -100,6 +109,7 @@ private:
     double m_ry;
     double m_angle;
     QVector<QPointF> m_points;
+    mutable QPolygonF m_polygon; // Empty if not yet built.
 };
 
 #endif // EDITABLEELIPSE_H_
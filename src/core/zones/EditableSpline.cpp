@@ -26,10 +26,14 @@
 #include <cmath>
 
 EditableSpline::EditableSpline()
+    :   m_cachedRevision(-1),
+        m_screenRevision(-1)
 {
 }
 
 EditableSpline::EditableSpline(SerializableSpline const& spline)
+    :   m_cachedRevision(-1),
+        m_screenRevision(-1)
 {
     copyFromSerializableSpline(spline);
 }
@@ -83,22 +87,65 @@ EditableSpline::segmentsCount() const
     return num;
 }
 
-QPolygonF
-EditableSpline::toPolygon() const
+void
+EditableSpline::updateCache() const
 {
-    QPolygonF poly;
+    if (m_cachedRevision == m_sentinel.revision()) {
+        return;
+    }
+
+    m_polygon.clear();
 
     SplineVertex::Ptr vertex(firstVertex());
     for (; vertex; vertex = vertex->next(SplineVertex::NO_LOOP)) {
-        poly.push_back(vertex->point());
+        m_polygon.push_back(vertex->point());
     }
 
-    vertex = lastVertex()->next(SplineVertex::LOOP_IF_BRIDGED);
+    vertex = lastVertex();
     if (vertex) {
-        poly.push_back(vertex->point());
+        vertex = vertex->next(SplineVertex::LOOP_IF_BRIDGED);
+        if (vertex) {
+            m_polygon.push_back(vertex->point());
+        }
+    }
+
+    m_boundingRect = m_polygon.boundingRect();
+    m_cachedRevision = m_sentinel.revision();
+}
+
+QPolygonF const&
+EditableSpline::polygon() const
+{
+    updateCache();
+    return m_polygon;
+}
+
+QPolygonF const&
+EditableSpline::polygon(QTransform const& to_screen) const
+{
+    if (m_screenRevision != m_sentinel.revision() || m_screenXform != to_screen) {
+        m_screenPolygon = to_screen.map(polygon());
+        m_screenXform = to_screen;
+        m_screenRevision = m_sentinel.revision();
     }
+    return m_screenPolygon;
+}
+
+QRectF const&
+EditableSpline::boundingRect() const
+{
+    updateCache();
+    return m_boundingRect;
+}
 
-    return poly;
+bool
+EditableSpline::contains(QPointF const& pt) const
+{
+    updateCache();
+    if (!m_boundingRect.contains(pt)) {
+        return false;
+    }
+    return m_polygon.containsPoint(pt, Qt::WindingFill);
 }
 
 qreal get_angle(QVector<QPointF>& vec)
@@ -166,6 +213,6 @@ EditableSpline::SegmentIterator::next()
 
 double EditableSpline::area() const
 {
-    QRectF const bbox(toPolygon().boundingRect());
+    QRectF const& bbox = boundingRect();
     return bbox.width() * bbox.height();
 }
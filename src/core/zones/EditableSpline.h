@@ -25,6 +25,9 @@
 #include "SplineVertex.h"
 #include "SplineSegment.h"
 #include <QPolygonF>
+#include <QTransform>
+#include <QRectF>
+#include <QPointF>
 
 class SerializableSpline;
 
@@ -79,11 +82,56 @@ public:
         m_sentinel.setBridged(true);
     }
 
-    QPolygonF toPolygon() const;
+    /**
+     * \brief Returns the vertices, with the first one repeated at the end
+     *        if the spline is bridged.
+     *
+     * The polygon is cached until the spline is modified.
+     */
+    QPolygonF toPolygon() const
+    {
+        return polygon();
+    }
+
+    /**
+     * \brief Same as toPolygon(), without copying the cached polygon.
+     */
+    QPolygonF const& polygon() const;
+
+    /**
+     * \brief Returns polygon() mapped to widget coordinates.
+     *
+     * The mapped polygon is cached until either the spline or
+     * \p to_screen changes.  Its points correspond to the vertices
+     * and segments in the order they are iterated.
+     */
+    QPolygonF const& polygon(QTransform const& to_screen) const;
+
+    QRectF const& boundingRect() const;
+
+    /**
+     * \brief Checks if a point in image coordinates is inside
+     *        the spline, with the winding fill rule.
+     */
+    bool contains(QPointF const& pt) const;
 
     double area() const;
 private:
+    void updateCache() const;
+
     SentinelSplineVertex m_sentinel;
+
+    // Image space geometry, valid while m_cachedRevision matches
+    // m_sentinel.revision().
+    mutable int m_cachedRevision;
+    mutable QPolygonF m_polygon;
+    mutable QRectF m_boundingRect;
+
+    // Widget space geometry, valid while m_screenRevision matches
+    // m_sentinel.revision() and m_screenXform is the current transform.
+    mutable int m_screenRevision;
+    mutable QTransform m_screenXform;
+    mutable QPolygonF m_screenPolygon;
 };
 
 #endif
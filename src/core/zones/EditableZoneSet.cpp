@@ -20,8 +20,13 @@
 #include "EditableZoneSet.h"
 
 #include "ZoneSet.h"
+#include <algorithm>
+#include <cmath>
 
 EditableZoneSet::EditableZoneSet()
+    :   m_gridWidth(0),
+        m_gridHeight(0),
+        m_indexValid(false)
 {
 }
 
@@ -36,6 +41,7 @@ EditableZoneSet::addSpline(EditableSpline::Ptr const& spline)
 {
     IntrusivePtr<PropertySet> new_props(new PropertySet(m_defaultProps));
     m_zonesMap.insert(Map::value_type(GenericZonePtr(spline), new_props));
+    invalidateIndex();
 }
 
 void
@@ -43,12 +49,14 @@ EditableZoneSet::addSpline(EditableSpline::Ptr const& spline, PropertySet const&
 {
     IntrusivePtr<PropertySet> new_props(new PropertySet(props));
     m_zonesMap.insert(Map::value_type(GenericZonePtr(spline), new_props));
+    invalidateIndex();
 }
 
 void
 EditableZoneSet::removeSpline(EditableSpline::Ptr const& spline)
 {
     m_zonesMap.erase(GenericZonePtr(spline));
+    invalidateIndex();
 }
 
 void
@@ -56,6 +64,7 @@ EditableZoneSet::addEllipse(EditableEllipse::Ptr const& ellipse)
 {
     IntrusivePtr<PropertySet> new_props(new PropertySet(m_defaultProps));
     m_zonesMap.insert(Map::value_type(GenericZonePtr(ellipse), new_props));
+    invalidateIndex();
 }
 
 void
@@ -63,17 +72,20 @@ EditableZoneSet::addEllipse(EditableEllipse::Ptr const& ellipse, PropertySet con
 {
     IntrusivePtr<PropertySet> new_props(new PropertySet(props));
     m_zonesMap.insert(Map::value_type(GenericZonePtr(ellipse), new_props));
+    invalidateIndex();
 }
 
 void
 EditableZoneSet::removeEllipse(EditableEllipse::Ptr const& ellipse)
 {
     m_zonesMap.erase(GenericZonePtr(ellipse));
+    invalidateIndex();
 }
 
 void
 EditableZoneSet::commit()
 {
+    invalidateIndex();
     emit committed();
 }
 
@@ -98,3 +110,112 @@ EditableZoneSet::propertiesFor(EditableSpline::Ptr const& spline) const
         return IntrusivePtr<PropertySet const>();
     }
 }
+
+std::vector<EditableZoneSet::Zone>
+EditableZoneSet::zonesNear(QRectF const& area) const
+{
+    if (!m_indexValid) {
+        buildIndex();
+    }
+
+    std::vector<Zone> zones;
+    if (m_indexedZones.empty()) {
+        return zones;
+    }
+
+    QRect const cells(cellsCovering(area));
+
+    std::vector<int> candidates;
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            std::vector<int> const& cell = m_gridCells[y * m_gridWidth + x];
+            candidates.insert(candidates.end(), cell.begin(), cell.end());
+        }
+    }
+
+    // A zone spanning several cells shows up once per cell.
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    for (int const idx : candidates) {
+        IndexedZone const& indexed = m_indexedZones[idx];
+        // Not QRectF::intersects(), as that's always false for empty rectangles.
+        if (indexed.bounds.left() <= area.right() && area.left() <= indexed.bounds.right()
+                && indexed.bounds.top() <= area.bottom() && area.top() <= indexed.bounds.bottom()) {
+            zones.push_back(Zone(indexed.it));
+        }
+    }
+
+    return zones;
+}
+
+void
+EditableZoneSet::invalidateIndex()
+{
+    m_indexValid = false;
+}
+
+void
+EditableZoneSet::buildIndex() const
+{
+    m_indexedZones.clear();
+    m_gridCells.clear();
+    m_gridArea = QRectF();
+
+    for (Map::const_iterator it(m_zonesMap.begin()); it != m_zonesMap.end(); ++it) {
+        IndexedZone indexed;
+        indexed.it = it;
+        indexed.bounds = zoneBounds(it->first);
+        m_indexedZones.push_back(indexed);
+        m_gridArea |= indexed.bounds;
+    }
+
+    // Roughly one zone per cell.  Degenerate zones may be left out of
+    // m_gridArea, but cellsCovering() clamps them to the border cells.
+    int const side = std::max(1, (int)std::ceil(std::sqrt((double)m_indexedZones.size())));
+    m_gridWidth = side;
+    m_gridHeight = side;
+    m_gridArea.setSize(m_gridArea.size().expandedTo(QSizeF(1, 1)));
+    m_gridCells.resize(m_gridWidth * m_gridHeight);
+
+    int const num_zones = m_indexedZones.size();
+    for (int i = 0; i < num_zones; ++i) {
+        QRect const cells(cellsCovering(m_indexedZones[i].bounds));
+        for (int y = cells.top(); y <= cells.bottom(); ++y) {
+            for (int x = cells.left(); x <= cells.right(); ++x) {
+                m_gridCells[y * m_gridWidth + x].push_back(i);
+            }
+        }
+    }
+
+    m_indexValid = true;
+}
+
+QRect
+EditableZoneSet::cellsCovering(QRectF const& rect) const
+{
+    double const cell_width = m_gridArea.width() / m_gridWidth;
+    double const cell_height = m_gridArea.height() / m_gridHeight;
+    int const x0 = (int)std::floor((rect.left() - m_gridArea.left()) / cell_width);
+    int const y0 = (int)std::floor((rect.top() - m_gridArea.top()) / cell_height);
+    int const x1 = (int)std::floor((rect.right() - m_gridArea.left()) / cell_width);
+    int const y1 = (int)std::floor((rect.bottom() - m_gridArea.top()) / cell_height);
+
+    return QRect(
+        QPoint(qBound(0, x0, m_gridWidth - 1), qBound(0, y0, m_gridHeight - 1)),
+        QPoint(qBound(0, x1, m_gridWidth - 1), qBound(0, y1, m_gridHeight - 1))
+    );
+}
+
+QRectF
+EditableZoneSet::zoneBounds(GenericZonePtr const& zone)
+{
+    if (zone.isEllipse()) {
+        // Whatever the angle, the ellipse fits into a circle of its larger radius.
+        EditableEllipse const& ellipse = *zone.m_ellipse;
+        double const r = std::max(std::fabs(ellipse.rx()), std::fabs(ellipse.ry()));
+        return QRectF(ellipse.center() - QPointF(r, r), QSizeF(2 * r, 2 * r));
+    } else {
+        return zone.m_spline->boundingRect();
+    }
+}
@@ -25,11 +25,14 @@
 #include "PropertySet.h"
 #include "IntrusivePtr.h"
 #include <QObject>
+#include <QRect>
+#include <QRectF>
 #ifndef Q_MOC_RUN
 #include <boost/mpl/bool.hpp>
 #include <boost/iterator/iterator_facade.hpp>
 #endif
 #include <map>
+#include <vector>
 
 class ZoneSet;
 
@@ -63,6 +66,7 @@ public:
 
     class Zone
     {
+        friend class EditableZoneSet;
         friend class EditableZoneSet::const_iterator;
     public:
         Zone() {}
@@ -159,12 +163,48 @@ public:
     IntrusivePtr<PropertySet> propertiesFor(EditableSpline::Ptr const& spline);
 
     IntrusivePtr<PropertySet const> propertiesFor(EditableSpline::Ptr const& spline) const;
+
+    /**
+     * \brief Returns zones whose bounding boxes touch \p area,
+     *        in iteration order.
+     *
+     * Zones are looked up through a grid of buckets, so hit-testing
+     * and painting don't have to go through every vertex of every zone.
+     * The grid is rebuilt on the first call after zones were added,
+     * removed or committed.  Editing a zone in place is only reflected
+     * once commit() is called.
+     */
+    std::vector<Zone> zonesNear(QRectF const& area) const;
 signals:
     void committed();
     void manuallyDeleted();
 private:
+    struct IndexedZone {
+        Map::const_iterator it;
+        QRectF bounds;
+    };
+
+    void invalidateIndex();
+
+    void buildIndex() const;
+
+    /**
+     * Returns the range of grid cells \p rect falls into, clamped to the grid.
+     */
+    QRect cellsCovering(QRectF const& rect) const;
+
+    static QRectF zoneBounds(GenericZonePtr const& zone);
+
     Map m_zonesMap;
     PropertySet m_defaultProps;
+
+    // The grid index, managed by buildIndex().
+    mutable std::vector<IndexedZone> m_indexedZones; // In iteration order.
+    mutable std::vector<std::vector<int> > m_gridCells; // Indexes into m_indexedZones.
+    mutable QRectF m_gridArea;
+    mutable int m_gridWidth;
+    mutable int m_gridHeight;
+    mutable bool m_indexValid;
 };
 
 #endif
@@ -23,7 +23,8 @@
 
 SplineVertex::SplineVertex(SplineVertex* prev, SplineVertex* next)
     :   m_pPrev(prev),
-        m_ptrNext(next)
+        m_ptrNext(next),
+        m_pRevision(prev == this ? 0 : prev->m_pRevision)
 {
 }
 
@@ -33,6 +34,9 @@ SplineVertex::remove()
     // Be very careful here - don't let this object
     // be destroyed before we've finished working with it.
 
+    touch();
+    m_pRevision = 0;
+
     m_pPrev->m_ptrNext.swap(m_ptrNext);
     assert(m_ptrNext.get() == this);
 
@@ -74,6 +78,7 @@ SplineVertex::insertBefore(QPointF const& pt)
     SplineVertex::Ptr new_vertex(new RealSplineVertex(pt, m_pPrev, this));
     m_pPrev->m_ptrNext = new_vertex;
     m_pPrev = new_vertex.get();
+    touch();
     return new_vertex;
 }
 
@@ -83,6 +88,7 @@ SplineVertex::insertAfter(QPointF const& pt)
     SplineVertex::Ptr new_vertex(new RealSplineVertex(pt, this, m_ptrNext.get()));
     m_ptrNext->m_pPrev = new_vertex.get();
     m_ptrNext = new_vertex;
+    touch();
     return new_vertex;
 }
 
@@ -90,8 +96,10 @@ SplineVertex::insertAfter(QPointF const& pt)
 
 SentinelSplineVertex::SentinelSplineVertex()
     :   SplineVertex(this, this),
-        m_bridged(false)
+        m_bridged(false),
+        m_revision(0)
 {
+    m_pRevision = &m_revision;
 }
 
 SentinelSplineVertex::~SentinelSplineVertex()
@@ -209,5 +217,8 @@ RealSplineVertex::point() const
 void
 RealSplineVertex::setPoint(QPointF const& pt)
 {
-    m_point = pt;
+    if (m_point != pt) {
+        m_point = pt;
+        touch();
+    }
 }
@@ -79,6 +79,16 @@ public:
 
     SplineVertex::Ptr insertAfter(QPointF const& pt);
 protected:
+    /**
+     * Marks the spline this vertex belongs to as modified.
+     */
+    void touch()
+    {
+        if (m_pRevision) {
+            ++*m_pRevision;
+        }
+    }
+
     /**
      * The reason m_pPrev is an ordinary pointer rather than a smart pointer
      * is that we don't want pairs of vertices holding smart pointers to each
@@ -87,6 +97,12 @@ protected:
      */
     SplineVertex* m_pPrev;
     SplineVertex::Ptr m_ptrNext;
+
+    /**
+     * Points to the revision counter of the spline, which is kept by
+     * its sentinel vertex.  Null for vertices that were removed.
+     */
+    int* m_pRevision;
 };
 
 class SentinelSplineVertex : public SplineVertex
@@ -118,10 +134,23 @@ public:
 
     void setBridged(bool bridged)
     {
-        m_bridged = bridged;
+        if (m_bridged != bridged) {
+            m_bridged = bridged;
+            touch();
+        }
+    }
+
+    /**
+     * \brief Changes whenever a vertex of the spline is added, removed
+     *        or moved, or the spline gets bridged.
+     */
+    int revision() const
+    {
+        return m_revision;
     }
 private:
     bool m_bridged;
+    int m_revision;
 };
 
 class RealSplineVertex : public SplineVertex
@@ -31,7 +31,6 @@
 #include <QPixmap>
 #include <QIcon>
 #include <QPainter>
-#include <QPainterPath>
 #include <QTransform>
 #include <QSignalMapper>
 #include <QCursor>
@@ -92,17 +91,16 @@ ZoneContextMenuInteraction::zonesUnderMouse(ZoneInteractionContext& context)
 
     // Find zones containing the mouse position.
     std::vector<Zone> selectable_zones;
-    const EditableZoneSet& zones = context.zones();
+    std::vector<EditableZoneSet::Zone> const zones(
+        context.zones().zonesNear(QRectF(image_mouse_pos, image_mouse_pos))
+    );
     for (EditableZoneSet::Zone const& zone : zones) {
-        QPainterPath path;
-        path.setFillRule(Qt::WindingFill);
         if (zone.isEllipse()) {
             if (zone.ellipse()->contains(image_mouse_pos)) {
                 selectable_zones.push_back(Zone(zone));
             }
         } else {
-            path.addPolygon(zone.spline()->toPolygon());
-            if (path.contains(image_mouse_pos)) {
+            if (zone.spline()->contains(image_mouse_pos)) {
                 selectable_zones.push_back(Zone(zone));
             }
         }
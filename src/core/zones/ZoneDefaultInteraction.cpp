@@ -25,10 +25,11 @@
 #include "settings/globalstaticsettings.h"
 #include <QTransform>
 #include <QPolygon>
+#include <QRectF>
+#include <QSizeF>
 #include <QPointF>
 #include <QPen>
 #include <QPainter>
-#include <QPainterPath>
 #include <QColor>
 #include <QLinearGradient>
 #include <Qt>
@@ -79,9 +80,13 @@ ZoneDefaultInteraction::onPaint(QPainter& painter, InteractionState const& inter
     painter.setRenderHint(QPainter::Antialiasing);
 
     QTransform const to_screen(m_rContext.imageView().imageToWidget());
+    QTransform const from_screen(m_rContext.imageView().widgetToImage());
+
+    // Leave some room for vertex markers sticking out of zones.
+    QRectF const screen_rect(QRectF(m_rContext.imageView().viewport()->rect()).adjusted(-10, -10, 10, 10));
+    QRectF const visible_area(from_screen.mapRect(screen_rect));
 
-    const EditableZoneSet & zones = m_rContext.zones();
-    for (EditableZoneSet::Zone const& zone : zones) {
+    for (EditableZoneSet::Zone const& zone : m_rContext.zones().zonesNear(visible_area)) {
         if (!zone.isEllipse()) {
             EditableSpline::Ptr const& spline = zone.spline();
             m_visualizer.prepareForSpline(painter, spline);
@@ -198,24 +203,32 @@ ZoneDefaultInteraction::onProximityUpdate(QPointF const& mouse_pos, InteractionS
 
     m_mouse_over_zone = false;
 
-    for (EditableZoneSet::Zone const& zone : m_rContext.zones()) {
+    // Zones farther than the proximity threshold can't be hit.
+    double const threshold = interaction.proximityThreshold().dist();
+    QRectF const screen_neighbourhood(
+        mouse_pos - QPointF(threshold, threshold), QSizeF(2 * threshold, 2 * threshold)
+    );
+    QRectF const neighbourhood(from_screen.mapRect(screen_neighbourhood));
+
+    for (EditableZoneSet::Zone const& zone : m_rContext.zones().zonesNear(neighbourhood)) {
         if (!m_mouse_over_zone) {
             if (!zone.isEllipse()) {
-                QPainterPath path;
-                path.setFillRule(Qt::WindingFill);
-                path.addPolygon(zone.spline()->toPolygon());
-                if (path.contains(image_mouse_pos)) {
+                EditableSpline::Ptr const& spline = zone.spline();
+                if (spline->contains(image_mouse_pos)) {
                     m_ptrNearestZone = zone;
                     m_mouse_over_zone = true;
                 }
 
-                EditableSpline::Ptr const& spline = zone.spline();
+                // The points of the cached screen polygon correspond to
+                // the vertices and segments in iteration order.
+                QPolygonF const& screen_poly = spline->polygon(to_screen);
 
                 // Process vertices.
+                int idx = 0;
                 for (SplineVertex::Ptr vert(spline->firstVertex());
-                        vert; vert = vert->next(SplineVertex::NO_LOOP)) {
+                        vert; vert = vert->next(SplineVertex::NO_LOOP), ++idx) {
 
-                    Proximity const proximity(mouse_pos, to_screen.map(vert->point()));
+                    Proximity const proximity(mouse_pos, screen_poly[idx]);
                     if (proximity < best_vertex_proximity) {
                         m_ptrNearestVertex = vert;
                         m_ptrNearestVertexSpline = spline;
@@ -224,9 +237,10 @@ ZoneDefaultInteraction::onProximityUpdate(QPointF const& mouse_pos, InteractionS
                 }
 
                 // Process segments.
-                for (EditableSpline::SegmentIterator it(*spline); it.hasNext();) {
+                idx = 0;
+                for (EditableSpline::SegmentIterator it(*spline); it.hasNext(); ++idx) {
                     SplineSegment const segment(it.next());
-                    QLineF const line(to_screen.map(segment.toLine()));
+                    QLineF const line(screen_poly[idx], screen_poly[idx + 1]);
                     QPointF point_on_segment;
                     Proximity const proximity(Proximity::pointAndLineSegment(mouse_pos, line, &point_on_segment));
                     if (proximity < best_segment_proximity) {
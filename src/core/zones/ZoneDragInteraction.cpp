@@ -74,7 +74,7 @@ ZoneDragInteraction::onPaint(QPainter& painter, InteractionState const& /*intera
             painter.setPen(pen);
 
             if (!zone.isEllipse()) {
-                painter.drawPolygon(to_screen.map(zone.spline()->toPolygon()), Qt::WindingFill);
+                painter.drawPolygon(zone.spline()->polygon(to_screen), Qt::WindingFill);
             } else {
                 EditableEllipse::Ptr const & e = zone.ellipse();
                 painter.save();
@@ -24,7 +24,11 @@
 #include <QLineF>
 #include <QtGlobal>
 #include <QDebug>
+#ifndef Q_MOC_RUN
+#include <boost/optional.hpp>
+#endif
 #include <algorithm>
+#include <numeric>
 #include <math.h>
 #include <assert.h>
 
@@ -50,6 +54,28 @@ crv: Dewarped normalized coordinates.  crv X coordinates are linked
 namespace dewarping
 {
 
+namespace
+{
+
+/**
+ * Returns the indices of \p keys in ascending order of keys,
+ * without sorting when they are already in that order.
+ */
+std::vector<size_t> ascendingOrder(std::vector<double> const& keys)
+{
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    if (!std::is_sorted(keys.begin(), keys.end())) {
+        std::stable_sort(
+            order.begin(), order.end(),
+            [&keys](size_t a, size_t b) { return keys[a] < keys[b]; }
+        );
+    }
+    return order;
+}
+
+} // anonymous namespace
+
 class CylindricalSurfaceDewarper::CoupledPolylinesIterator
 {
 public:
@@ -134,12 +160,9 @@ CylindricalSurfaceDewarper::mapGeneratrix(double crv_x, State& state) const
     return Generatrix(img_generatrix, H);
 }
 
-QPointF
-CylindricalSurfaceDewarper::mapToDewarpedSpace(QPointF const& img_pt) const
+CylindricalSurfaceDewarper::InverseGeneratrix
+CylindricalSurfaceDewarper::mapInverseGeneratrix(double pln_x, State& state) const
 {
-    State state;
-
-    double const pln_x = m_img2pln(img_pt)[0];
     double const crv_x = m_arcLengthMapper.xToArcLen(pln_x, state.m_arcLengthHint);
 
     Vec2d const pln_top_pt(pln_x, 0);
@@ -169,10 +192,15 @@ CylindricalSurfaceDewarper::mapToDewarpedSpace(QPointF const& img_pt) const
     }
     HomographicTransform<1, double> const H(threePoint1DHomography(pairs));
 
-    double const img_pt_proj(projector.projectionScalar(img_pt));
-    double const crv_y = H(img_pt_proj);
+    return InverseGeneratrix(crv_x, projector, H);
+}
 
-    return QPointF(crv_x, crv_y);
+QPointF
+CylindricalSurfaceDewarper::mapToDewarpedSpace(QPointF const& img_pt) const
+{
+    State state;
+    double const pln_x = m_img2pln(img_pt)[0];
+    return mapInverseGeneratrix(pln_x, state).map(img_pt);
 }
 
 QPointF
@@ -183,6 +211,50 @@ CylindricalSurfaceDewarper::mapToWarpedSpace(QPointF const& crv_pt) const
     return gtx.imgLine.pointAt(gtx.pln2img(crv_pt.y()));
 }
 
+void
+CylindricalSurfaceDewarper::mapToDewarpedSpace(
+    QPointF const* img_pts, QPointF* crv_pts, size_t const count) const
+{
+    std::vector<double> pln_xs(count);
+    for (size_t i = 0; i < count; ++i) {
+        pln_xs[i] = m_img2pln(img_pts[i])[0];
+    }
+    std::vector<size_t> const order(ascendingOrder(pln_xs));
+
+    State state;
+    boost::optional<InverseGeneratrix> gtx;
+    double gtx_pln_x = 0;
+    for (size_t const i : order) {
+        if (!gtx || pln_xs[i] != gtx_pln_x) {
+            gtx_pln_x = pln_xs[i];
+            gtx = mapInverseGeneratrix(gtx_pln_x, state);
+        }
+        crv_pts[i] = gtx->map(img_pts[i]);
+    }
+}
+
+void
+CylindricalSurfaceDewarper::mapToWarpedSpace(
+    QPointF const* crv_pts, QPointF* img_pts, size_t const count) const
+{
+    std::vector<double> crv_xs(count);
+    for (size_t i = 0; i < count; ++i) {
+        crv_xs[i] = crv_pts[i].x();
+    }
+    std::vector<size_t> const order(ascendingOrder(crv_xs));
+
+    State state;
+    boost::optional<Generatrix> gtx;
+    double gtx_crv_x = 0;
+    for (size_t const i : order) {
+        if (!gtx || crv_xs[i] != gtx_crv_x) {
+            gtx_crv_x = crv_xs[i];
+            gtx = mapGeneratrix(gtx_crv_x, state);
+        }
+        img_pts[i] = gtx->imgLine.pointAt(gtx->pln2img(crv_pts[i].y()));
+    }
+}
+
 HomographicTransform<2, double>
 CylindricalSurfaceDewarper::calcPlnToImgHomography(
     std::vector<QPointF> const& img_directrix1,
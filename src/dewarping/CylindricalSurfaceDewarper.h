@@ -22,10 +22,12 @@
 #include "HomographicTransform.h"
 #include "PolylineIntersector.h"
 #include "ArcLengthMapper.h"
+#include "ToLineProjector.h"
 #ifndef Q_MOC_RUN
 #include <boost/array.hpp>
 #endif
 #include <vector>
+#include <stddef.h>
 #include <utility>
 #include <QPointF>
 #include <QLineF>
@@ -90,9 +92,48 @@ public:
      * systems we owork with.
      */
     QPointF mapToWarpedSpace(QPointF const& crv_pt) const;
+
+    /**
+     * \brief Maps \p count points with mapToDewarpedSpace().
+     *
+     * The points are processed in the order of their generatrixes,
+     * so the intersection and arc length lookups continue from where
+     * the previous point left them, and points sharing a generatrix
+     * share its computation.  The input doesn't have to be sorted,
+     * though sorted input saves a sort.  \p img_pts and \p crv_pts
+     * may point to the same array.
+     */
+    void mapToDewarpedSpace(QPointF const* img_pts, QPointF* crv_pts, size_t count) const;
+
+    /**
+     * \brief Maps \p count points with mapToWarpedSpace().
+     *
+     * \see mapToDewarpedSpace(QPointF const*, QPointF*, size_t)
+     */
+    void mapToWarpedSpace(QPointF const* crv_pts, QPointF* img_pts, size_t count) const;
 private:
     class CoupledPolylinesIterator;
 
+    /**
+     * The counterpart of Generatrix for mapping the other way.
+     */
+    struct InverseGeneratrix {
+        double crvX;
+        ToLineProjector projector;
+        HomographicTransform<1, double> img2crv;
+
+        InverseGeneratrix(
+            double crv_x, ToLineProjector const& proj, HomographicTransform<1, double> const& H)
+            : crvX(crv_x), projector(proj), img2crv(H) {}
+
+        QPointF map(QPointF const& img_pt) const
+        {
+            return QPointF(crvX, img2crv(projector.projectionScalar(img_pt)));
+        }
+    };
+
+    InverseGeneratrix mapInverseGeneratrix(double pln_x, State& state) const;
+
     static HomographicTransform<2, double> calcPlnToImgHomography(
         std::vector<QPointF> const& img_directrix1,
         std::vector<QPointF> const& img_directrix2);
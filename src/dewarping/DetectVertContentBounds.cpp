@@ -36,6 +36,7 @@
 #include <deque>
 #include <algorithm>
 #include <math.h>
+#include <stdint.h>
 #include <assert.h>
 
 using namespace imageproc;
@@ -86,11 +87,6 @@ struct RansacModel {
         totalVertDist += seg.vertDist;
     }
 
-    bool betterThan(RansacModel const& other) const
-    {
-        return totalVertDist > other.totalVertDist;
-    }
-
     void swap(RansacModel& other)
     {
         segments.swap(other.segments);
@@ -98,12 +94,22 @@ struct RansacModel {
     }
 };
 
+/**
+ * Models are assessed by their score alone, which is cheap and thread-safe,
+ * so that the trials can run in parallel.  Only the winning model is built.
+ */
 class RansacAlgo
 {
 public:
     RansacAlgo(std::vector<Segment> const& segments);
 
-    void buildAndAssessModel(Segment const& seed_segment);
+    /**
+     * \brief Runs a trial for each of the seed segments, given by index.
+     *
+     * The earliest of the best scoring trials wins, as it would
+     * if the trials were run one by one.
+     */
+    void run(std::vector<int> const& seed_indices);
 
     RansacModel& bestModel()
     {
@@ -115,6 +121,15 @@ public:
         return m_bestModel;
     }
 private:
+    bool isCompatible(Segment const& seg, Segment const& seed_segment) const
+    {
+        return seg.unitVec.dot(seed_segment.unitVec) > m_cosThreshold;
+    }
+
+    int assessModel(Segment const& seed_segment) const;
+
+    void buildModel(Segment const& seed_segment, RansacModel& model) const;
+
     std::vector<Segment> const& m_rSegments;
     RansacModel m_bestModel;
     double m_cosThreshold;
@@ -157,20 +172,50 @@ RansacAlgo::RansacAlgo(std::vector<Segment> const& segments)
 }
 
 void
-RansacAlgo::buildAndAssessModel(Segment const& seed_segment)
+RansacAlgo::run(std::vector<int> const& seed_indices)
 {
-    RansacModel cur_model;
-    cur_model.add(seed_segment);
+    int const num_trials = seed_indices.size();
+    std::vector<int> scores(num_trials);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_trials; ++i) {
+        scores[i] = assessModel(m_rSegments[seed_indices[i]]);
+    }
 
+    int best_trial = -1;
+    for (int i = 0; i < num_trials; ++i) {
+        if (scores[i] > (best_trial < 0 ? m_bestModel.totalVertDist : scores[best_trial])) {
+            best_trial = i;
+        }
+    }
+
+    if (best_trial >= 0) {
+        RansacModel model;
+        buildModel(m_rSegments[seed_indices[best_trial]], model);
+        model.swap(m_bestModel);
+    }
+}
+
+int
+RansacAlgo::assessModel(Segment const& seed_segment) const
+{
+    int total_vert_dist = seed_segment.vertDist;
     for (Segment const& seg : m_rSegments) {
-        double const cos = seg.unitVec.dot(seed_segment.unitVec);
-        if (cos > m_cosThreshold) {
-            cur_model.add(seg);
+        if (isCompatible(seg, seed_segment)) {
+            total_vert_dist += seg.vertDist;
         }
     }
+    return total_vert_dist;
+}
 
-    if (cur_model.betterThan(m_bestModel)) {
-        cur_model.swap(m_bestModel);
+void
+RansacAlgo::buildModel(Segment const& seed_segment, RansacModel& model) const
+{
+    model.add(seed_segment);
+    for (Segment const& seg : m_rSegments) {
+        if (isCompatible(seg, seed_segment)) {
+            model.add(seg);
+        }
     }
 }
 
@@ -310,16 +355,20 @@ SequentialColumnProcessor::approximateWithLine(std::vector<Segment>* dbg_segment
         segments.begin(), segments.begin() + num_best_segments, segments.end(),
                 [=](const Segment& lhs, const Segment& rhs) { return lhs.distToVertLine(m_leadingTop.x()) < rhs.distToVertLine(m_leadingTop.x()); }
     );
+    std::vector<int> seed_indices;
     for (size_t i = 0; i < num_best_segments; ++i) {
-        ransac.buildAndAssessModel(segments[i]);
+        seed_indices.push_back(i);
     }
 
-    // Continue with random samples.
+    // Continue with random samples.  They are drawn up front,
+    // so the sequence doesn't depend on how the trials are run.
     int const ransac_iterations = segments.empty() ? 0 : 200;
     for (int i = 0; i < ransac_iterations; ++i) {
-        ransac.buildAndAssessModel(segments[qrand() % segments.size()]);
+        seed_indices.push_back(qrand() % segments.size());
     }
 
+    ransac.run(seed_indices);
+
     if (ransac.bestModel().segments.empty()) {
         return QLineF(m_leadingTop, m_leadingTop + QPointF(0, 1));
     }
@@ -417,40 +466,64 @@ QImage visualizeSegments(QImage const& background, std::vector<Segment> const& s
     return canvas;
 }
 
+/**
+ * Records \p y for those columns of \p line that are black there,
+ * but weren't black in any of the lines visited before.
+ * \p seen accumulates the black columns of the lines visited so far.
+ */
+template<typename Setter>
+void recordFirstBlack(
+    uint32_t const* line, uint32_t* seen, int const words_per_line,
+    uint32_t const last_word_mask, int const y, Setter setter)
+{
+    for (int i = 0; i < words_per_line; ++i) {
+        uint32_t word = line[i] & ~seen[i];
+        if (i == words_per_line - 1) {
+            word &= last_word_mask;
+        }
+        if (!word) {
+            continue;
+        }
+        seen[i] |= word;
+        for (int bit = 0; word; ++bit, word <<= 1) {
+            if (word & (uint32_t(1) << 31)) {
+                setter((i << 5) + bit, y);
+            }
+        }
+    }
+}
+
 // For every column in the image, store the top-most and bottom-most black pixel.
+// Rather than going down each column, which is cache-hostile, whole lines
+// are swept from the top and from the bottom, a word at a time.
 void calculateVertRanges(imageproc::BinaryImage const& image, std::vector<VertRange>& ranges)
 {
     int const width = image.width();
     int const height = image.height();
     uint32_t const* image_data = image.data();
     int const image_stride = image.wordsPerLine();
-    uint32_t const msb = uint32_t(1) << 31;
-
-    ranges.reserve(width);
+    int const words_per_line = (width + 31) >> 5;
+    uint32_t const last_word_mask = (width & 31) ? ~uint32_t(0) << (32 - (width & 31)) : ~uint32_t(0);
 
-    for (int x = 0; x < width; ++x) {
-        ranges.push_back(VertRange());
-        VertRange& range = ranges.back();
-
-        uint32_t const mask = msb >> (x & 31);
-        uint32_t const* p_word = image_data + (x >> 5);
+    ranges.assign(width, VertRange());
+    if (width == 0) {
+        return;
+    }
 
-        int top_y = 0;
-        for (; top_y < height; ++top_y, p_word += image_stride) {
-            if (*p_word & mask) {
-                range.top = top_y;
-                break;
-            }
-        }
+    std::vector<uint32_t> seen(words_per_line, 0);
+    for (int y = 0; y < height; ++y) {
+        recordFirstBlack(
+            image_data + y * image_stride, &seen[0], words_per_line, last_word_mask, y,
+            [&ranges](int x, int y) { ranges[x].top = y; }
+        );
+    }
 
-        int bottom_y = height - 1;
-        p_word = image_data + bottom_y * image_stride + (x >> 5);
-        for (; bottom_y >= top_y; --bottom_y, p_word -= image_stride) {
-            if (*p_word & mask) {
-                range.bottom = bottom_y;
-                break;
-            }
-        }
+    std::fill(seen.begin(), seen.end(), 0);
+    for (int y = height - 1; y >= 0; --y) {
+        recordFirstBlack(
+            image_data + y * image_stride, &seen[0], words_per_line, last_word_mask, y,
+            [&ranges](int x, int y) { ranges[x].bottom = y; }
+        );
     }
 }
 
@@ -504,14 +577,20 @@ std::pair<QLineF, QLineF> detectVertContentBounds(
     left_line.translate(-1, 0);
     bounds.first = extendLine(left_line, height);
     if (dbg) {
-        dbg->add(visualizeSegments(image.toQImage(), *dbg_segments), "left_ransac_model");
+        std::vector<Segment> const segments_copy(*dbg_segments);
+        dbg->addLazy([=]() {
+            return visualizeSegments(image.toQImage(), segments_copy);
+        }, "left_ransac_model");
     }
 
     QLineF right_line(right_processor.approximateWithLine(dbg_segments));
     right_line.translate(1, 0);
     bounds.second = extendLine(right_line, height);
     if (dbg) {
-        dbg->add(visualizeSegments(image.toQImage(), *dbg_segments), "right_ransac_model");
+        std::vector<Segment> const segments_copy(*dbg_segments);
+        dbg->addLazy([=]() {
+            return visualizeSegments(image.toQImage(), segments_copy);
+        }, "right_ransac_model");
     }
 
     return bounds;
@@ -0,0 +1,197 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DewarpingMap.h"
+#include <QRectF>
+#include <QPointF>
+#include <QPolygonF>
+#include <QTransform>
+#include <QMutex>
+#include <QMutexLocker>
+#include <list>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+
+namespace dewarping
+{
+
+namespace
+{
+
+/**
+ * Maps are rebuilt rarely, but the same page tends to be re-output
+ * with different colour or threshold settings, and one output may
+ * dewarp several layers.  A few recent maps cover that.
+ */
+int const MAX_CACHED_MAPS = 4;
+
+typedef std::pair<QByteArray, std::shared_ptr<DewarpingMap const> > CacheEntry;
+
+QMutex cacheMutex;
+std::list<CacheEntry> cacheEntries;
+
+void appendRaw(QByteArray& key, void const* data, int size)
+{
+    key.append(static_cast<char const*>(data), size);
+}
+
+} // anonymous namespace
+
+DewarpingMap::Column::Column(CylindricalSurfaceDewarper::Generatrix const& generatrix)
+    : origin(generatrix.imgLine.p1()),
+      vec(generatrix.imgLine.p2() - generatrix.imgLine.p1()),
+      homog(generatrix.pln2img.mat())
+{
+}
+
+DewarpingMap::DewarpingMap(
+    CylindricalSurfaceDewarper const& distortion_model,
+    QRectF const& model_domain, QSize const& dst_size, double rotation_deg)
+    : m_dstSize(dst_size),
+      m_rotated(rotation_deg != 0.0),
+      m_firstColumnX(0),
+      m_modelDomainTop(model_domain.top()),
+      m_modelYScale(1.0 / (model_domain.bottom() - model_domain.top()))
+{
+    int const dst_width = dst_size.width();
+    int const dst_height = dst_size.height();
+
+    double const model_domain_left = model_domain.left();
+    double const model_x_scale = 1.0 / (model_domain.right() - model_domain.left());
+
+    float const model_domain_top = m_modelDomainTop;
+    float const model_y_scale = m_modelYScale;
+
+    // The columns to sample.  Without rotation, one per node column.
+    int first_column_x = 0;
+    int last_column_x = dst_width;
+
+    if (m_rotated) {
+        // The same rotation imageproc::transform() would apply to the
+        // dewarped image, inverted to go from output to dewarped nodes.
+        QPointF const center(dst_width / 2, dst_height / 2);
+        QTransform rotate;
+        rotate.translate(center.x(), center.y());
+        rotate.rotate(-rotation_deg);
+        rotate.translate(-center.x(), -center.y());
+        QTransform const unrotate(rotate.inverted());
+
+        m_unrotate[0] = unrotate.m11();
+        m_unrotate[1] = unrotate.m21();
+        m_unrotate[2] = unrotate.dx();
+        m_unrotate[3] = unrotate.m12();
+        m_unrotate[4] = unrotate.m22();
+        m_unrotate[5] = unrotate.dy();
+
+        // Rotated corners reach beyond the unrotated columns.  The model
+        // extrapolates there, while the margin covers interpolation.
+        QPolygonF const corners(unrotate.map(
+            QPolygonF(QRectF(0, 0, dst_width, dst_height))
+        ));
+        QRectF const bounds(corners.boundingRect());
+        first_column_x = (int)std::floor(bounds.left()) - 1;
+        last_column_x = (int)std::ceil(bounds.right()) + 1;
+        m_firstColumnX = first_column_x;
+    }
+
+    // Generatrixes are mapped sequentially, as the state carries
+    // search hints from one to the next.
+    CylindricalSurfaceDewarper::State state;
+    m_columns.reserve(last_column_x - first_column_x + 1);
+    for (int x = first_column_x; x <= last_column_x; ++x) {
+        double const model_x = (x - model_domain_left) * model_x_scale;
+        m_columns.push_back(Column(distortion_model.mapGeneratrix(model_x, state)));
+    }
+
+    if (m_rotated) {
+        return;
+    }
+
+    m_modelY.reserve(dst_height + 1);
+    for (int dst_y = 0; dst_y <= dst_height; ++dst_y) {
+        m_modelY.push_back((float(dst_y) - model_domain_top) * model_y_scale);
+    }
+}
+
+Vec2f
+DewarpingMap::mapRotatedNode(int dst_x, int dst_y) const
+{
+    float const x = dst_x;
+    float const y = dst_y;
+    float const unrotated_x = m_unrotate[0] * x + m_unrotate[1] * y + m_unrotate[2];
+    float const unrotated_y = m_unrotate[3] * x + m_unrotate[4] * y + m_unrotate[5];
+    float const model_y = (unrotated_y - m_modelDomainTop) * m_modelYScale;
+
+    float const column_pos = unrotated_x - m_firstColumnX;
+    int const last_left = int(m_columns.size()) - 2;
+    int const left = std::max(0, std::min(last_left, int(std::floor(column_pos))));
+    float const fraction = column_pos - left;
+
+    Vec2f const left_pt(m_columns[left].map(model_y));
+    Vec2f const right_pt(m_columns[left + 1].map(model_y));
+    return left_pt + (right_pt - left_pt) * fraction;
+}
+
+std::shared_ptr<DewarpingMap const>
+DewarpingMap::cached(
+    QByteArray const& model_key,
+    CylindricalSurfaceDewarper const& distortion_model,
+    QRectF const& model_domain, QSize const& dst_size,
+    double rotation_deg)
+{
+    QByteArray key(model_key);
+    qreal const domain[] = {
+        model_domain.left(), model_domain.top(),
+        model_domain.width(), model_domain.height()
+    };
+    int const size[] = { dst_size.width(), dst_size.height() };
+    appendRaw(key, domain, sizeof(domain));
+    appendRaw(key, size, sizeof(size));
+    appendRaw(key, &rotation_deg, sizeof(rotation_deg));
+
+    {
+        QMutexLocker const locker(&cacheMutex);
+        for (std::list<CacheEntry>::iterator it = cacheEntries.begin();
+                it != cacheEntries.end(); ++it) {
+            if (it->first == key) {
+                // Move to front.
+                cacheEntries.splice(cacheEntries.begin(), cacheEntries, it);
+                return it->second;
+            }
+        }
+    }
+
+    // Build it without holding the lock.  If two threads race
+    // to build the same map, both results are the same anyway.
+    std::shared_ptr<DewarpingMap const> const map(
+        std::make_shared<DewarpingMap>(
+            distortion_model, model_domain, dst_size, rotation_deg
+        )
+    );
+
+    QMutexLocker const locker(&cacheMutex);
+    cacheEntries.push_front(CacheEntry(key, map));
+    if (int(cacheEntries.size()) > MAX_CACHED_MAPS) {
+        cacheEntries.pop_back();
+    }
+
+    return map;
+}
+
+} // namespace dewarping
@@ -0,0 +1,130 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DEWARPING_DEWARPING_MAP_H_
+#define DEWARPING_DEWARPING_MAP_H_
+
+#include "CylindricalSurfaceDewarper.h"
+#include "HomographicTransform.h"
+#include "VecNT.h"
+#include <QSize>
+#include <QByteArray>
+#include <vector>
+#include <memory>
+
+class QRectF;
+
+namespace dewarping
+{
+
+/**
+ * \brief Maps the pixel grid of a dewarped image to the warped one.
+ *
+ * Rather than storing a point for every grid node, the map stores
+ * a generatrix per grid column and a model coordinate per grid row.
+ * That's enough to compute any node with a few multiplications,
+ * while the expensive part, mapping the generatrixes, is done once.
+ *
+ * The map may also rotate the dewarped image about its center.  Then
+ * the generatrixes are sampled along the axis of the unrotated image
+ * and a node is interpolated between the two nearest of them, so that
+ * a residual skew is corrected without resampling the output twice.
+ */
+class DewarpingMap
+{
+public:
+    /**
+     * \param distortion_model The distortion model to sample.
+     * \param model_domain The rectangle in dewarped image coordinates
+     *        the distortion model is mapped to.
+     * \param dst_size The size of the dewarped image.
+     * \param rotation_deg The angle in degrees, clockwise, to rotate
+     *        the dewarped image by about its center.  The rotated image
+     *        keeps \p dst_size.
+     */
+    DewarpingMap(
+        CylindricalSurfaceDewarper const& distortion_model,
+        QRectF const& model_domain, QSize const& dst_size,
+        double rotation_deg = 0.0);
+
+    /**
+     * \brief Returns a map shared with earlier callers passing
+     *        the same parameters, building it if necessary.
+     *
+     * \param model_key Uniquely identifies \p distortion_model.
+     *        The other parameters are added to it internally.
+     */
+    static std::shared_ptr<DewarpingMap const> cached(
+        QByteArray const& model_key,
+        CylindricalSurfaceDewarper const& distortion_model,
+        QRectF const& model_domain, QSize const& dst_size,
+        double rotation_deg = 0.0);
+
+    QSize const& dstSize() const
+    {
+        return m_dstSize;
+    }
+
+    /**
+     * \brief Maps a node of the dewarped pixel grid to warped image coordinates.
+     *
+     * Node (x, y) is the top-left corner of pixel (x, y), so \p dst_x
+     * goes up to dstSize().width() and \p dst_y up to dstSize().height().
+     */
+    Vec2f mapNode(int dst_x, int dst_y) const
+    {
+        if (m_rotated) {
+            return mapRotatedNode(dst_x, dst_y);
+        }
+        return m_columns[dst_x].map(m_modelY[dst_y]);
+    }
+private:
+    struct Column {
+        Vec2f origin;
+        Vec2f vec;
+        HomographicTransform<1, float> homog;
+
+        explicit Column(CylindricalSurfaceDewarper::Generatrix const& generatrix);
+
+        Vec2f map(float model_y) const
+        {
+            return origin + vec * homog(model_y);
+        }
+    };
+
+    Vec2f mapRotatedNode(int dst_x, int dst_y) const;
+
+    QSize m_dstSize;
+    std::vector<Column> m_columns;
+    std::vector<float> m_modelY;
+
+    /**
+     * For a rotated map, the affine transformation from the rotated
+     * to the unrotated dewarped image, as in QTransform::map(), the x
+     * coordinate of m_columns.front() and the model y mapping.
+     */
+    bool m_rotated;
+    float m_unrotate[6];
+    float m_firstColumnX;
+    float m_modelDomainTop;
+    float m_modelYScale;
+};
+
+} // namespace dewarping
+
+#endif
@@ -21,6 +21,7 @@
 #include <QTransform>
 #include <QSize>
 #include <QRect>
+#include <vector>
 
 namespace dewarping
 {
@@ -73,4 +74,28 @@ DewarpingPointMapper::mapToWarpedSpace(QPointF const& dewarped_pt) const
     return m_dewarper.mapToWarpedSpace(QPointF(crv_x, crv_y));
 }
 
+void
+DewarpingPointMapper::mapToDewarpedSpace(
+    QPointF const* warped_pts, QPointF* dewarped_pts, size_t const count) const
+{
+    m_dewarper.mapToDewarpedSpace(warped_pts, dewarped_pts, count);
+    for (size_t i = 0; i < count; ++i) {
+        QPointF& pt = dewarped_pts[i];
+        pt.setX(pt.x() * m_modelXScaleFromNormalized + m_modelDomainLeft);
+        pt.setY(pt.y() * m_modelYScaleFromNormalized + m_modelDomainTop);
+    }
+}
+
+void
+DewarpingPointMapper::mapToWarpedSpace(
+    QPointF const* dewarped_pts, QPointF* warped_pts, size_t const count) const
+{
+    std::vector<QPointF> crv_pts(count);
+    for (size_t i = 0; i < count; ++i) {
+        crv_pts[i].setX((dewarped_pts[i].x() - m_modelDomainLeft) * m_modelXScaleToNormalized);
+        crv_pts[i].setY((dewarped_pts[i].y() - m_modelDomainTop) * m_modelYScaleToNormalized);
+    }
+    m_dewarper.mapToWarpedSpace(crv_pts.data(), warped_pts, count);
+}
+
 } // namespace dewarping
@@ -50,6 +50,16 @@ public:
      * from normalized dewarped coordinates.
      */
     QPointF mapToWarpedSpace(QPointF const& dewarped_pt) const;
+
+    /**
+     * \see CylindricalSurfaceDewarper::mapToDewarpedSpace(QPointF const*, QPointF*, size_t)
+     */
+    void mapToDewarpedSpace(QPointF const* warped_pts, QPointF* dewarped_pts, size_t count) const;
+
+    /**
+     * \see CylindricalSurfaceDewarper::mapToWarpedSpace(QPointF const*, QPointF*, size_t)
+     */
+    void mapToWarpedSpace(QPointF const* dewarped_pts, QPointF* warped_pts, size_t count) const;
 private:
     CylindricalSurfaceDewarper m_dewarper;
     double m_modelDomainLeft;
@@ -42,6 +42,7 @@
 #include <algorithm>
 #include <exception>
 #include <iterator>
+#include <utility>
 #include <limits>
 #include <math.h>
 #include <assert.h>
@@ -88,8 +89,17 @@ public:
     RansacAlgo(std::vector<TracedCurve> const& all_curves)
         : m_rAllCurves(all_curves) {}
 
-    void buildAndAssessModel(
-        TracedCurve const* top_curve, TracedCurve const* bottom_curve);
+    /**
+     * Queues a pair of curves to be assessed by assessCandidates().
+     */
+    void addCandidate(TracedCurve const* top_curve, TracedCurve const* bottom_curve);
+
+    /**
+     * Assesses the queued candidates in parallel and updates the best model.
+     * Among models with equal errors, the one queued first wins, just like
+     * it would if candidates were assessed one by one in order.
+     */
+    void assessCandidates();
 
     RansacModel& bestModel()
     {
@@ -101,10 +111,22 @@ public:
         return m_bestModel;
     }
 private:
+    typedef std::pair<TracedCurve const*, TracedCurve const*> Candidate;
+
+    /**
+     * Returns the error of the model built from a pair of curves,
+     * or NumericTraits<double>::max() if the model can't be built
+     * or its error would exceed \p error_bound.
+     */
+    double calcModelError(
+        TracedCurve const* top_curve, TracedCurve const* bottom_curve,
+        double error_bound) const;
+
     double calcReferenceHeight(
         CylindricalSurfaceDewarper const& dewarper, QPointF const& loc);
 
     RansacModel m_bestModel;
+    std::vector<Candidate> m_candidates;
     std::vector<TracedCurve> const& m_rAllCurves;
 };
 
@@ -208,7 +230,7 @@ DistortionModelBuilder::tryBuildModel(DebugImages* dbg, QImage const* dbg_backgr
     for (int i = 0; i < std::min<int>(3, num_curves); ++i) {
         for (int j = std::max<int>(0, num_curves - 3); j < num_curves; ++j) {
             if (i < j) {
-                ransac.buildAndAssessModel(&ordered_curves[i], &ordered_curves[j]);
+                ransac.addCandidate(&ordered_curves[i], &ordered_curves[j]);
             }
         }
     }
@@ -223,10 +245,12 @@ DistortionModelBuilder::tryBuildModel(DebugImages* dbg, QImage const* dbg_backgr
             std::swap(i, j);
         }
         if (i < j) {
-            ransac.buildAndAssessModel(&ordered_curves[i], &ordered_curves[j]);
+            ransac.addCandidate(&ordered_curves[i], &ordered_curves[j]);
         }
     }
 
+    ransac.assessCandidates();
+
     if (dbg && dbg_background) {
         dbg->add(visualizeTrimmedPolylines(*dbg_background, ordered_curves), "trimmed_polylines");
         dbg->add(visualizeModel(*dbg_background, ordered_curves, ransac.bestModel()), "distortion_model");
@@ -480,15 +504,57 @@ DistortionModelBuilder::fitExtendedSpline(
 /*============================== RansacAlgo ============================*/
 
 void
-DistortionModelBuilder::RansacAlgo::buildAndAssessModel(
+DistortionModelBuilder::RansacAlgo::addCandidate(
     TracedCurve const* top_curve, TracedCurve const* bottom_curve)
+{
+    m_candidates.push_back(Candidate(top_curve, bottom_curve));
+}
+
+void
+DistortionModelBuilder::RansacAlgo::assessCandidates()
+{
+    int const num_candidates = m_candidates.size();
+    std::vector<double> errors(num_candidates, NumericTraits<double>::max());
+    double const initial_bound = m_bestModel.totalError;
+
+    #pragma omp parallel
+    {
+        // The best error seen by this thread.  Any candidate exceeding it
+        // can't win, so its assessment may be cut short.  Which candidates
+        // get cut short depends on scheduling, but the winner doesn't.
+        double error_bound = initial_bound;
+
+        #pragma omp for schedule(dynamic)
+        for (int i = 0; i < num_candidates; ++i) {
+            errors[i] = calcModelError(
+                            m_candidates[i].first, m_candidates[i].second, error_bound
+                        );
+            error_bound = std::min(error_bound, errors[i]);
+        }
+    }
+
+    for (int i = 0; i < num_candidates; ++i) {
+        if (errors[i] < m_bestModel.totalError) {
+            m_bestModel.topCurve = m_candidates[i].first;
+            m_bestModel.bottomCurve = m_candidates[i].second;
+            m_bestModel.totalError = errors[i];
+        }
+    }
+
+    m_candidates.clear();
+}
+
+double
+DistortionModelBuilder::RansacAlgo::calcModelError(
+    TracedCurve const* top_curve, TracedCurve const* bottom_curve,
+    double const error_bound) const
 try
 {
     DistortionModel model;
     model.setTopCurve(Curve(top_curve->extendedPolyline));
     model.setBottomCurve(Curve(bottom_curve->extendedPolyline));
     if (!model.isValid()) {
-        return;
+        return NumericTraits<double>::max();
     }
 
     double const depth_perception = 2.0; // Doesn't matter much here.
@@ -508,10 +574,11 @@ try
         std::vector<double> B;
         B.reserve(polyline_size);
 
-        for (QPointF const& warped_pt : curve.trimmedPolyline) {
-            // TODO: add another signature with hint for efficiency.
-            QPointF const dewarped_pt(dewarper.mapToDewarpedSpace(warped_pt));
-
+        std::vector<QPointF> dewarped_polyline(polyline_size);
+        dewarper.mapToDewarpedSpace(
+            curve.trimmedPolyline.data(), dewarped_polyline.data(), polyline_size
+        );
+        for (QPointF const& dewarped_pt : dewarped_polyline) {
             // ax + b = y  <-> x * a + 1 * b = y
             At.push_back(dewarped_pt.x());
             At.push_back(1);
@@ -549,16 +616,18 @@ try
             // Strictly vertical line?
             error += 1000;
         }
-    }
 
-    if (error < m_bestModel.totalError) {
-        m_bestModel.topCurve = top_curve;
-        m_bestModel.bottomCurve = bottom_curve;
-        m_bestModel.totalError = error;
+        if (error > error_bound) {
+            // Errors only accumulate, so this model has already lost.
+            return NumericTraits<double>::max();
+        }
     }
+
+    return error;
 } catch (std::runtime_error const&)
 {
     // Probably CylindricalSurfaceDewarper didn't like something.
+    return NumericTraits<double>::max();
 }
 #if 0
 double
@@ -28,6 +28,7 @@ namespace dewarping
 {
 
 class CylindricalSurfaceDewarper;
+class DewarpingMap;
 
 class RasterDewarper
 {
@@ -37,6 +38,15 @@ public:
         CylindricalSurfaceDewarper const& distortion_model,
         QRectF const& model_domain, QColor const& background_color
     );
+
+    /**
+     * \brief Same as above, but with a precomputed map, which may be
+     *        reused for dewarping several images the same way.
+     */
+    static QImage dewarp(
+        QImage const& src, DewarpingMap const& map,
+        QColor const& background_color
+    );
 };
 
 } // namespace dewarping
@@ -20,6 +20,7 @@
 #include "Dpi.h"
 #include "VecNT.h"
 #include "NumericTraits.h"
+#include "MonotonicArena.h"
 #include "DebugImages.h"
 #include "imageproc/GrayImage.h"
 #include "imageproc/GaussBlur.h"
@@ -85,10 +86,14 @@ struct TextLineRefiner::FrenetFrame {
     Vec2f unitDownNormal;
 };
 
+/**
+ * Temporaries of a single optimization step are allocated from an arena,
+ * which the caller resets between steps.
+ */
 class TextLineRefiner::Optimizer
 {
 public:
-    Optimizer(Snake const& snake, Vec2f const& unit_down_vec, float factor);
+    Optimizer(Snake const& snake, Vec2f const& unit_down_vec, float factor, MonotonicArena& arena);
 
     bool thicknessAdjustment(Snake& snake, Grid<float> const& gradient);
 
@@ -96,8 +101,40 @@ public:
 
     bool normalMovement(Snake& snake, Grid<float> const& gradient);
 private:
-    static float calcExternalEnergy(
-        Grid<float> const& gradient, SnakeNode const& node, Vec2f const down_normal);
+    typedef std::vector<float, ArenaAllocator<float> > FloatVector;
+    typedef std::vector<uint32_t, ArenaAllocator<uint32_t> > IndexVector;
+    typedef std::vector<Step, ArenaAllocator<Step> > StepVector;
+
+    /**
+     * Snake nodes along with their down normals, stored as a structure
+     * of arrays, so that their external energies can be evaluated
+     * in vectorizable loops.
+     */
+    struct NodeBatch {
+        FloatVector centerX;
+        FloatVector centerY;
+        FloatVector rib;
+        FloatVector normalX;
+        FloatVector normalY;
+
+        explicit NodeBatch(MonotonicArena& arena);
+
+        void reserve(size_t size);
+
+        void push_back(Vec2f const& center, float rib_half_length, Vec2f const& down_normal);
+
+        size_t size() const
+        {
+            return centerX.size();
+        }
+    };
+
+    /**
+     * Evaluates the external energy of each node in a batch.
+     * \p energies must have room for batch.size() elements.
+     */
+    void calcExternalEnergies(
+        Grid<float> const& gradient, NodeBatch const& batch, float* energies) const;
 
     static float calcElasticityEnergy(
         SnakeNode const& node1, SnakeNode const& node2, float avg_dist);
@@ -110,6 +147,7 @@ private:
     static float const m_topExternalWeight;
     static float const m_bottomExternalWeight;
     float const m_factor;
+    MonotonicArena& m_rArena;
     SnakeLength m_snakeLength;
     std::vector<FrenetFrame> m_frenetFrames;
 };
@@ -125,7 +163,7 @@ TextLineRefiner::TextLineRefiner(
 
 void
 TextLineRefiner::refine(
-    std::list<std::vector<QPointF> >& polylines,
+    std::vector<std::vector<QPointF> >& polylines,
     int const iterations, DebugImages* dbg) const
 {
     if (polylines.empty()) {
@@ -144,15 +182,21 @@ TextLineRefiner::refine(
         dbg->add(visualizeSnakes(snakes), "initial_snakes");
     }
 
-    Grid<float> gradient(m_image.width(), m_image.height(), /*padding=*/0);
+    Grid<float> gradient(
+        m_image.width(), m_image.height(), /*padding=*/0, Grid<float>::ALIGNED_ROWS
+    );
 
     // Start with a rather strong blur.
     float h_sigma = (4.0f / 200.f) * m_dpi.horizontal();
     float v_sigma = (4.0f / 200.f) * m_dpi.vertical();
     calcBlurredGradient(gradient, h_sigma, v_sigma);
 
-    for (Snake& snake : snakes) {
-        evolveSnake(snake, gradient, ON_CONVERGENCE_STOP);
+    int const num_snakes = snakes.size();
+
+    // Snakes evolve independently of each other.
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_snakes; ++i) {
+        evolveSnake(snakes[i], gradient, ON_CONVERGENCE_STOP);
     }
     if (dbg) {
         dbg->add(visualizeSnakes(snakes, &gradient), "evolved_snakes1");
@@ -163,8 +207,9 @@ TextLineRefiner::refine(
     v_sigma *= 0.5f;
     calcBlurredGradient(gradient, h_sigma, v_sigma);
 
-    for (Snake& snake : snakes) {
-        evolveSnake(snake, gradient, ON_CONVERGENCE_GO_FINER);
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_snakes; ++i) {
+        evolveSnake(snakes[i], gradient, ON_CONVERGENCE_GO_FINER);
     }
     if (dbg) {
         dbg->add(visualizeSnakes(snakes, &gradient), "evolved_snakes2");
@@ -188,7 +233,9 @@ TextLineRefiner::calcBlurredGradient(
 {
 
     float const downscale = 1.0f / (255.0f * 8.0f);
-    Grid<float> vert_grad(m_image.width(), m_image.height(), /*padding=*/0);
+    Grid<float> vert_grad(
+        m_image.width(), m_image.height(), /*padding=*/0, Grid<float>::ALIGNED_ROWS
+    );
     horizontalSobel<float>(
         m_image.width(), m_image.height(), m_image.data(), m_image.stride(), [=](float val) {return val * downscale; },
         gradient.data(), gradient.stride(), [=](float& n, float val) { n = val; }, [=](float val) { return val; },
@@ -202,35 +249,47 @@ TextLineRefiner::calcBlurredGradient(
     );
     Grid<float>().swap(vert_grad); // Save memory.
 
-    gaussBlurGeneric(
-        m_image.size(), h_sigma, v_sigma,
-        gradient.data(), gradient.stride(), [=](float val) { return val; },
-        gradient.data(), gradient.stride(), [=](float& n, float val) { n = val; }
-    );
+    gaussBlurInPlace(gradient, h_sigma, v_sigma);
 }
 
-float
-TextLineRefiner::externalEnergyAt(
-    Grid<float> const& gradient, Vec2f const& pos, float penalty_if_outside)
+void
+TextLineRefiner::externalEnergiesAt(
+    Grid<float> const& gradient, float const* xs, float const* ys,
+    int const count, float const penalty_if_outside, float* energies)
 {
-    float const x_base = floor(pos[0]);
-    float const y_base = floor(pos[1]);
-    int const x_base_i = (int)x_base;
-    int const y_base_i = (int)y_base;
-
-    if (x_base_i < 0 || y_base_i < 0 || x_base_i + 1 >= gradient.width() || y_base_i + 1 >= gradient.height()) {
-        return penalty_if_outside;
+    int const width = gradient.width();
+    int const height = gradient.height();
+    if (width < 2 || height < 2) {
+        std::fill(energies, energies + count, penalty_if_outside);
+        return;
     }
 
-    float const x = pos[0] - x_base;
-    float const y = pos[1] - y_base;
-    float const x1 = 1.0f - x;
-    float const y1 = 1.0f - y;
-
     int const stride = gradient.stride();
-    float const* base = gradient.data() + y_base_i * stride + x_base_i;
-
-    return base[0] * x1 * y1 + base[1] * x * y1 + base[stride] * x1 * y + base[stride + 1] * x * y;
+    float const* const data = gradient.data();
+
+    // Bilinear interpolation, free of early exits to let it vectorize.
+    // Out of range positions are clamped to sample something,
+    // and then the sample is replaced with the penalty.
+    for (int i = 0; i < count; ++i) {
+        float const x_base = floor(xs[i]);
+        float const y_base = floor(ys[i]);
+        int const x_base_i = (int)x_base;
+        int const y_base_i = (int)y_base;
+        bool const inside = x_base_i >= 0 && y_base_i >= 0
+                            && x_base_i + 1 < width && y_base_i + 1 < height;
+        int const x_clamped = std::min(std::max(x_base_i, 0), width - 2);
+        int const y_clamped = std::min(std::max(y_base_i, 0), height - 2);
+
+        float const x = xs[i] - x_base;
+        float const y = ys[i] - y_base;
+        float const x1 = 1.0f - x;
+        float const y1 = 1.0f - y;
+
+        float const* base = data + y_clamped * stride + x_clamped;
+        float const energy = base[0] * x1 * y1 + base[1] * x * y1
+                             + base[stride] * x1 * y + base[stride + 1] * x * y;
+        energies[i] = inside ? energy : penalty_if_outside;
+    }
 }
 
 TextLineRefiner::Snake
@@ -336,11 +395,13 @@ TextLineRefiner::evolveSnake(Snake& snake, Grid<float> const& gradient,
                              OnConvergence const on_convergence) const
 {
     float factor = 1.0f;
+    MonotonicArena arena;
 
     while (snake.iterationsRemaining > 0) {
         --snake.iterationsRemaining;
 
-        Optimizer optimizer(snake, m_unitDownVec, factor);
+        arena.reset();
+        Optimizer optimizer(snake, m_unitDownVec, factor, arena);
         bool changed = false;
         changed |= optimizer.thicknessAdjustment(snake, gradient);
         changed |= optimizer.tangentMovement(snake, gradient);
@@ -505,14 +566,45 @@ TextLineRefiner::SnakeLength::SnakeLength(Snake const& snake)
 
 /*=========================== Optimizer =============================*/
 
+TextLineRefiner::Optimizer::NodeBatch::NodeBatch(MonotonicArena& arena)
+    : centerX(ArenaAllocator<float>(arena))
+    , centerY(ArenaAllocator<float>(arena))
+    , rib(ArenaAllocator<float>(arena))
+    , normalX(ArenaAllocator<float>(arena))
+    , normalY(ArenaAllocator<float>(arena))
+{
+}
+
+void
+TextLineRefiner::Optimizer::NodeBatch::reserve(size_t const size)
+{
+    centerX.reserve(size);
+    centerY.reserve(size);
+    rib.reserve(size);
+    normalX.reserve(size);
+    normalY.reserve(size);
+}
+
+void
+TextLineRefiner::Optimizer::NodeBatch::push_back(
+    Vec2f const& center, float const rib_half_length, Vec2f const& down_normal)
+{
+    centerX.push_back(center[0]);
+    centerY.push_back(center[1]);
+    rib.push_back(rib_half_length);
+    normalX.push_back(down_normal[0]);
+    normalY.push_back(down_normal[1]);
+}
+
 float const TextLineRefiner::Optimizer::m_elasticityWeight = 0.2f;
 float const TextLineRefiner::Optimizer::m_bendingWeight = 1.8f;
 float const TextLineRefiner::Optimizer::m_topExternalWeight = 1.0f;
 float const TextLineRefiner::Optimizer::m_bottomExternalWeight = 1.0f;
 
 TextLineRefiner::Optimizer::Optimizer(
-    Snake const& snake, Vec2f const& unit_down_vec, float factor)
+    Snake const& snake, Vec2f const& unit_down_vec, float factor, MonotonicArena& arena)
     : m_factor(factor)
+    , m_rArena(arena)
     , m_snakeLength(snake)
 {
     calcFrenetFrames(m_frenetFrames, snake, m_snakeLength, unit_down_vec);
@@ -526,6 +618,16 @@ TextLineRefiner::Optimizer::thicknessAdjustment(Snake& snake, Grid<float> const&
     float const rib_adjustments[] = { 0.0f * m_factor, 0.5f * m_factor, -0.5f * m_factor };
     enum { NUM_RIB_ADJUSTMENTS = sizeof(rib_adjustments) / sizeof(rib_adjustments[0]) };
 
+    // Node positions and normals stay the same, only ribs vary.
+    NodeBatch batch(m_rArena);
+    batch.reserve(num_nodes);
+    for (size_t node_idx = 0; node_idx < num_nodes; ++node_idx) {
+        batch.push_back(
+            snake.nodes[node_idx].center, 0.0f, m_frenetFrames[node_idx].unitDownNormal
+        );
+    }
+    FloatVector energies(num_nodes, 0.0f, ArenaAllocator<float>(m_rArena));
+
     int best_i = 0;
     int best_j = 0;
     float best_cost = NumericTraits<float>::max();
@@ -541,15 +643,15 @@ TextLineRefiner::Optimizer::thicknessAdjustment(Snake& snake, Grid<float> const&
                 continue;
             }
 
-            float cost = 0;
             for (size_t node_idx = 0; node_idx < num_nodes; ++node_idx) {
                 float const t = m_snakeLength.arcLengthFractionAt(node_idx);
-                float const rib = head_rib + t * (tail_rib - head_rib);
-                Vec2f const down_normal(m_frenetFrames[node_idx].unitDownNormal);
+                batch.rib[node_idx] = head_rib + t * (tail_rib - head_rib);
+            }
+            calcExternalEnergies(gradient, batch, &energies[0]);
 
-                SnakeNode node(snake.nodes[node_idx]);
-                node.ribHalfLength = rib;
-                cost += calcExternalEnergy(gradient, node, down_normal);
+            float cost = 0;
+            for (size_t node_idx = 0; node_idx < num_nodes; ++node_idx) {
+                cost += energies[node_idx];
             }
             if (cost < best_cost) {
                 best_cost = cost;
@@ -582,9 +684,26 @@ TextLineRefiner::Optimizer::tangentMovement(Snake& snake, Grid<float> const& gra
     float const tangent_movements[] = { 0.0f * m_factor, 1.0f * m_factor, -1.0f * m_factor };
     enum { NUM_TANGENT_MOVEMENTS = sizeof(tangent_movements) / sizeof(tangent_movements[0]) };
 
-    std::vector<uint32_t> paths;
-    std::vector<uint32_t> new_paths;
-    std::vector<Step> step_storage;
+    // External energies don't depend on the path taken,
+    // so we evaluate them for all candidate steps upfront.
+    NodeBatch batch(m_rArena);
+    batch.reserve((num_nodes - 2) * NUM_TANGENT_MOVEMENTS);
+    for (size_t node_idx = 1; node_idx < num_nodes - 1; ++node_idx) {
+        SnakeNode const& node = snake.nodes[node_idx];
+        FrenetFrame const& frame = m_frenetFrames[node_idx];
+        for (int i = 0; i < NUM_TANGENT_MOVEMENTS; ++i) {
+            batch.push_back(
+                node.center + tangent_movements[i] * frame.unitTangent,
+                node.ribHalfLength, frame.unitDownNormal
+            );
+        }
+    }
+    FloatVector energies(batch.size(), 0.0f, ArenaAllocator<float>(m_rArena));
+    calcExternalEnergies(gradient, batch, &energies[0]);
+
+    IndexVector paths((ArenaAllocator<uint32_t>(m_rArena)));
+    IndexVector new_paths((ArenaAllocator<uint32_t>(m_rArena)));
+    StepVector step_storage((ArenaAllocator<Step>(m_rArena)));
 
     // Note that we don't move the first and the last node in tangent direction.
     paths.push_back(step_storage.size());
@@ -597,7 +716,7 @@ TextLineRefiner::Optimizer::tangentMovement(Snake& snake, Grid<float> const& gra
         Vec2f const initial_pos(snake.nodes[node_idx].center);
         float const rib = snake.nodes[node_idx].ribHalfLength;
         Vec2f const unit_tangent(m_frenetFrames[node_idx].unitTangent);
-        Vec2f const down_normal(m_frenetFrames[node_idx].unitDownNormal);
+        float const* node_energies = &energies[(node_idx - 1) * NUM_TANGENT_MOVEMENTS];
 
         for (int i = 0; i < NUM_TANGENT_MOVEMENTS; ++i) {
             Step step;
@@ -606,7 +725,7 @@ TextLineRefiner::Optimizer::tangentMovement(Snake& snake, Grid<float> const& gra
             step.node.ribHalfLength = rib;
             step.pathCost = NumericTraits<float>::max();
 
-            float base_cost = calcExternalEnergy(gradient, step.node, down_normal);
+            float base_cost = node_energies[i];
 
             if (node_idx == num_nodes - 2) {
                 // Take into account the distance to the last node as well.
@@ -675,9 +794,26 @@ TextLineRefiner::Optimizer::normalMovement(Snake& snake, Grid<float> const& grad
     float const normal_movements[] = { 0.0f * m_factor, 1.0f * m_factor, -1.0f * m_factor };
     enum { NUM_NORMAL_MOVEMENTS = sizeof(normal_movements) / sizeof(normal_movements[0]) };
 
-    std::vector<uint32_t> paths;
-    std::vector<uint32_t> new_paths;
-    std::vector<Step> step_storage;
+    // External energies don't depend on the path taken,
+    // so we evaluate them for all candidate steps upfront.
+    NodeBatch batch(m_rArena);
+    batch.reserve(num_nodes * NUM_NORMAL_MOVEMENTS);
+    for (size_t node_idx = 0; node_idx < num_nodes; ++node_idx) {
+        SnakeNode const& node = snake.nodes[node_idx];
+        Vec2f const down_normal(m_frenetFrames[node_idx].unitDownNormal);
+        for (int i = 0; i < NUM_NORMAL_MOVEMENTS; ++i) {
+            batch.push_back(
+                node.center + normal_movements[i] * down_normal,
+                node.ribHalfLength, down_normal
+            );
+        }
+    }
+    FloatVector energies(batch.size(), 0.0f, ArenaAllocator<float>(m_rArena));
+    calcExternalEnergies(gradient, batch, &energies[0]);
+
+    IndexVector paths((ArenaAllocator<uint32_t>(m_rArena)));
+    IndexVector new_paths((ArenaAllocator<uint32_t>(m_rArena)));
+    StepVector step_storage((ArenaAllocator<Step>(m_rArena)));
 
     // The first two nodes pose a problem for us.  These nodes don't have two predecessors,
     // and therefore we can't take bending into the account.  We could take the followers
@@ -694,7 +830,7 @@ TextLineRefiner::Optimizer::normalMovement(Snake& snake, Grid<float> const& grad
             step.node.center = snake.nodes[0].center + normal_movements[i] * down_normal;
             step.node.ribHalfLength = snake.nodes[0].ribHalfLength;
             step.prevStepIdx = ~uint32_t(0);
-            step.pathCost = calcExternalEnergy(gradient, step.node, down_normal);
+            step.pathCost = energies[i];
 
             step_storage.push_back(step);
         }
@@ -708,7 +844,7 @@ TextLineRefiner::Optimizer::normalMovement(Snake& snake, Grid<float> const& grad
             step.node.ribHalfLength = snake.nodes[1].ribHalfLength;
             step.prevStepIdx = prev_step_idx;
             step.pathCost = step_storage[prev_step_idx].pathCost +
-                            calcExternalEnergy(gradient, step.node, down_normal);
+                            energies[NUM_NORMAL_MOVEMENTS + j];
 
             paths.push_back(step_storage.size());
             step_storage.push_back(step);
@@ -726,7 +862,7 @@ TextLineRefiner::Optimizer::normalMovement(Snake& snake, Grid<float> const& grad
             step.node.ribHalfLength = node.ribHalfLength;
             step.pathCost = NumericTraits<float>::max();
 
-            float const base_cost = calcExternalEnergy(gradient, step.node, down_normal);
+            float const base_cost = energies[node_idx * NUM_NORMAL_MOVEMENTS + i];
 
             // Now find the best step for the previous node to combine with.
             for (uint32_t prev_step_idx : paths) {
@@ -779,26 +915,44 @@ TextLineRefiner::Optimizer::normalMovement(Snake& snake, Grid<float> const& grad
     return max_sqdist > std::numeric_limits<float>::epsilon();
 }
 
-float
-TextLineRefiner::Optimizer::calcExternalEnergy(
-    Grid<float> const& gradient, SnakeNode const& node, Vec2f const down_normal)
+void
+TextLineRefiner::Optimizer::calcExternalEnergies(
+    Grid<float> const& gradient, NodeBatch const& batch, float* energies) const
 {
-    Vec2f const top(node.center - node.ribHalfLength * down_normal);
-    Vec2f const bottom(node.center + node.ribHalfLength * down_normal);
+    int const count = batch.size();
+    if (count == 0) {
+        return;
+    }
+
+    ArenaAllocator<float> const alloc(m_rArena);
+    FloatVector xs(count, 0.0f, alloc);
+    FloatVector ys(count, 0.0f, alloc);
+    FloatVector bottom_grads(count, 0.0f, alloc);
+
+    for (int i = 0; i < count; ++i) {
+        xs[i] = batch.centerX[i] + batch.rib[i] * batch.normalX[i];
+        ys[i] = batch.centerY[i] + batch.rib[i] * batch.normalY[i];
+    }
+    externalEnergiesAt(gradient, &xs[0], &ys[0], count, 0.0f, &bottom_grads[0]);
 
-    float const top_grad = externalEnergyAt(gradient, top, 0.0f);
-    float const bottom_grad = externalEnergyAt(gradient, bottom, 0.0f);
+    for (int i = 0; i < count; ++i) {
+        xs[i] = batch.centerX[i] - batch.rib[i] * batch.normalX[i];
+        ys[i] = batch.centerY[i] - batch.rib[i] * batch.normalY[i];
+    }
+    // Top gradients go straight to the output.
+    externalEnergiesAt(gradient, &xs[0], &ys[0], count, 0.0f, energies);
 
     // Surprisingly, it turns out it's a bad idea to penalize for the opposite
     // sign in the gradient.  Sometimes a snake's edge has to move over the
     // "wrong" gradient ridge before it gets into a good position.
     // Those std::min and std::max prevent such penalties.
-    float const top_energy = m_topExternalWeight * std::min<float>(top_grad, 0.0f);
-    float const bottom_energy = m_bottomExternalWeight * std::max<float>(bottom_grad, 0.0f);
-
     // Positive gradient indicates the bottom edge and vice versa.
     // Note that negative energies are fine with us - the less the better.
-    return top_energy - bottom_energy;
+    for (int i = 0; i < count; ++i) {
+        float const top_energy = m_topExternalWeight * std::min<float>(energies[i], 0.0f);
+        float const bottom_energy = m_bottomExternalWeight * std::max<float>(bottom_grads[i], 0.0f);
+        energies[i] = top_energy - bottom_energy;
+    }
 }
 
 float
@@ -26,7 +26,6 @@
 #include <QPointF>
 #include <QLineF>
 #include <vector>
-#include <list>
 #include <stdint.h>
 
 class Dpi;
@@ -43,7 +42,7 @@ public:
         imageproc::GrayImage const& image,
         Dpi const& dpi, Vec2f const& unit_down_vector);
 
-    void refine(std::list<std::vector<QPointF> >& polylines,
+    void refine(std::vector<std::vector<QPointF> >& polylines,
                 int iterations, DebugImages* dbg) const;
 private:
     enum OnConvergence { ON_CONVERGENCE_STOP, ON_CONVERGENCE_GO_FINER };
@@ -72,8 +71,14 @@ private:
 
     void calcBlurredGradient(Grid<float>& gradient, float h_sigma, float v_sigma) const;
 
-    static float externalEnergyAt(
-        Grid<float> const& gradient, Vec2f const& pos, float penalty_if_outside);
+    /**
+     * Samples the gradient at many positions at once, given as separate
+     * arrays of x and y coordinates.  Positions that are not surrounded
+     * by four grid nodes get \p penalty_if_outside.
+     */
+    static void externalEnergiesAt(
+        Grid<float> const& gradient, float const* xs, float const* ys,
+        int count, float penalty_if_outside, float* energies);
 
     static Snake makeSnake(std::vector<QPointF> const& polyline, int iterations);
 
@@ -64,6 +64,7 @@
 #include <algorithm>
 #include <set>
 #include <map>
+#include <memory>
 #include <deque>
 #include <cmath>
 #include <utility>
@@ -114,19 +115,21 @@ TextLineTracer::trace(
 
     std::pair<QLineF, QLineF> vert_bounds(detectVertContentBounds(binarized, dbg));
     if (dbg) {
-        dbg->add(visualizeVerticalBounds(binarized.toQImage(), vert_bounds), "vert_bounds");
+        dbg->addLazy([=]() {
+            return visualizeVerticalBounds(binarized.toQImage(), vert_bounds);
+        }, "vert_bounds");
     }
 
-    std::list<std::vector<QPointF> > polylines;
+    std::vector<std::vector<QPointF> > polylines;
     extractTextLines(polylines, stretchGrayRange(downscaled), vert_bounds, dbg);
     if (dbg) {
-        dbg->add(visualizePolylines(downscaled, polylines), "traced");
+        dbg->addLazy([=]() { return visualizePolylines(downscaled, polylines); }, "traced");
     }
 
     filterShortCurves(polylines, vert_bounds.first, vert_bounds.second);
     filterOutOfBoundsCurves(polylines, vert_bounds.first, vert_bounds.second);
     if (dbg) {
-        dbg->add(visualizePolylines(downscaled, polylines), "filtered1");
+        dbg->addLazy([=]() { return visualizePolylines(downscaled, polylines); }, "filtered1");
     }
 
     Vec2f unit_down_vector(calcAvgUnitVector(vert_bounds));
@@ -139,7 +142,7 @@ TextLineTracer::trace(
 
     filterEdgyCurves(polylines);
     if (dbg) {
-        dbg->add(visualizePolylines(downscaled, polylines), "filtered2");
+        dbg->addLazy([=]() { return visualizePolylines(downscaled, polylines); }, "filtered2");
     }
 
     // Transform back to original coordinates and output.
@@ -271,64 +274,63 @@ TextLineTracer::isInsideBounds(
 
 void
 TextLineTracer::filterShortCurves(
-    std::list<std::vector<QPointF> >& polylines,
+    std::vector<std::vector<QPointF> >& polylines,
     QLineF const& left_bound, QLineF const& right_bound)
 {
     ToLineProjector const proj1(left_bound);
     ToLineProjector const proj2(right_bound);
 
-    std::list<std::vector<QPointF> >::iterator it(polylines.begin());
-    std::list<std::vector<QPointF> >::iterator const end(polylines.end());
-    while (it != end) {
-        assert(!it->empty());
-        QPointF const front(it->front());
-        QPointF const back(it->back());
-        double const front_proj_len = proj1.projectionDist(front);
-        double const back_proj_len = proj2.projectionDist(back);
-        double const chord_len = QLineF(front, back).length();
-
-        if (front_proj_len + back_proj_len > 0.3 * chord_len) {
-            polylines.erase(it++);
-        } else {
-            ++it;
-        }
-    }
+    polylines.erase(
+        std::remove_if(
+            polylines.begin(), polylines.end(),
+            [&](std::vector<QPointF> const& polyline) {
+                assert(!polyline.empty());
+                QPointF const front(polyline.front());
+                QPointF const back(polyline.back());
+                double const front_proj_len = proj1.projectionDist(front);
+                double const back_proj_len = proj2.projectionDist(back);
+                double const chord_len = QLineF(front, back).length();
+                return front_proj_len + back_proj_len > 0.3 * chord_len;
+            }
+        ),
+        polylines.end()
+    );
 }
 
 void
 TextLineTracer::filterOutOfBoundsCurves(
-    std::list<std::vector<QPointF> >& polylines,
+    std::vector<std::vector<QPointF> >& polylines,
     QLineF const& left_bound, QLineF const& right_bound)
 {
-    std::list<std::vector<QPointF> >::iterator it(polylines.begin());
-    std::list<std::vector<QPointF> >::iterator const end(polylines.end());
-    while (it != end) {
-        if (!isInsideBounds(it->front(), left_bound, right_bound) &&
-                !isInsideBounds(it->back(), left_bound, right_bound)) {
-            polylines.erase(it++);
-        } else {
-            ++it;
-        }
-    }
+    polylines.erase(
+        std::remove_if(
+            polylines.begin(), polylines.end(),
+            [&](std::vector<QPointF> const& polyline) {
+                return !isInsideBounds(polyline.front(), left_bound, right_bound) &&
+                       !isInsideBounds(polyline.back(), left_bound, right_bound);
+            }
+        ),
+        polylines.end()
+    );
 }
 
 void
-TextLineTracer::filterEdgyCurves(std::list<std::vector<QPointF> >& polylines)
+TextLineTracer::filterEdgyCurves(std::vector<std::vector<QPointF> >& polylines)
 {
-    std::list<std::vector<QPointF> >::iterator it(polylines.begin());
-    std::list<std::vector<QPointF> >::iterator const end(polylines.end());
-    while (it != end) {
-        if (!isCurvatureConsistent(*it)) {
-            polylines.erase(it++);
-        } else {
-            ++it;
-        }
-    }
+    polylines.erase(
+        std::remove_if(
+            polylines.begin(), polylines.end(),
+            [](std::vector<QPointF> const& polyline) {
+                return !isCurvatureConsistent(polyline);
+            }
+        ),
+        polylines.end()
+    );
 }
 
 void
 TextLineTracer::extractTextLines(
-    std::list<std::vector<QPointF> >& out, imageproc::GrayImage const& image,
+    std::vector<std::vector<QPointF> >& out, imageproc::GrayImage const& image,
     std::pair<QLineF, QLineF> const& bounds, DebugImages* dbg)
 {
     int const width = image.width();
@@ -350,16 +352,14 @@ TextLineTracer::extractTextLines(
         main_grid.data(), main_grid.stride(), [=](float& n, float val) { n = n * direction[0] + val * direction[1]; }
     );
     if (dbg) {
-        dbg->add(visualizeGradient(image, main_grid), "first_dir_deriv");
+        std::shared_ptr<Grid<float> const> const grid_copy(new Grid<float>(main_grid));
+        dbg->addLazy([=]() { return visualizeGradient(image, *grid_copy); }, "first_dir_deriv");
     }
 
-    gaussBlurGeneric(
-        size, 6.0f, 6.0f,
-        main_grid.data(), main_grid.stride(), [=](float val) { return val; },
-        main_grid.data(), main_grid.stride(), [=](float& n, float val) { n = val; }
-    );
+    gaussBlurInPlace(main_grid, 6.0f, 6.0f);
     if (dbg) {
-        dbg->add(visualizeGradient(image, main_grid), "first_dir_deriv_blurred");
+        std::shared_ptr<Grid<float> const> const grid_copy(new Grid<float>(main_grid));
+        dbg->addLazy([=]() { return visualizeGradient(image, *grid_copy); }, "first_dir_deriv_blurred");
     }
 
     horizontalSobel<float>(
@@ -377,7 +377,8 @@ TextLineTracer::extractTextLines(
         main_grid.data(), main_grid.stride(), [=](const float& b, float& f) {f = b * direction[0] + f * direction[1]; }
     );
     if (dbg) {
-        dbg->add(visualizeGradient(image, main_grid), "second_dir_deriv");
+        std::shared_ptr<Grid<float> const> const grid_copy(new Grid<float>(main_grid));
+        dbg->addLazy([=]() { return visualizeGradient(image, *grid_copy); }, "second_dir_deriv");
     }
 
     float max = 0;
@@ -402,16 +403,14 @@ TextLineTracer::extractTextLines(
         aux_grid.data(), aux_grid.stride(), [](const float& a, float & b) { b = std::fabs(a); }
     );
     if (dbg) {
-        dbg->add(visualizeGradient(image, aux_grid), "abs");
+        std::shared_ptr<Grid<float> const> const grid_copy(new Grid<float>(aux_grid));
+        dbg->addLazy([=]() { return visualizeGradient(image, *grid_copy); }, "abs");
     }
 
-    gaussBlurGeneric(
-        size, 12.0f, 12.0f,
-        aux_grid.data(), aux_grid.stride(), [=](float val) { return val; },
-        aux_grid.data(), aux_grid.stride(), [=](float& n, float val) { n = val; }
-    );
+    gaussBlurInPlace(aux_grid, 12.0f, 12.0f);
     if (dbg) {
-        dbg->add(visualizeGradient(image, aux_grid), "blurred");
+        std::shared_ptr<Grid<float> const> const grid_copy(new Grid<float>(aux_grid));
+        dbg->addLazy([=]() { return visualizeGradient(image, *grid_copy); }, "blurred");
     }
 
     rasterOpGeneric(
@@ -421,7 +420,8 @@ TextLineTracer::extractTextLines(
 //        _2 += _1 - bind((float (*)(float))&std::fabs, _1)
     );
     if (dbg) {
-        dbg->add(visualizeGradient(image, aux_grid), "+= diff");
+        std::shared_ptr<Grid<float> const> const grid_copy(new Grid<float>(aux_grid));
+        dbg->addLazy([=]() { return visualizeGradient(image, *grid_copy); }, "+= diff");
     }
 
     BinaryImage post_binarization(image.size());
@@ -466,13 +466,22 @@ TextLineTracer::extractTextLines(
     QLineF mid_line(calcMidLine(bounds.first, bounds.second));
     findMidLineSeeds(sedm, mid_line, seeds);
     if (dbg) {
-        dbg->add(visualizeMidLineSeeds(image, post_binarization, bounds, mid_line, seeds), "seeds");
+        dbg->addLazy([=]() {
+            return visualizeMidLineSeeds(image, post_binarization, bounds, mid_line, seeds);
+        }, "seeds");
     }
 
     post_binarization.release(); // Save memory.
 
-    for (QPoint const& seed : seeds) {
-        std::vector<QPointF> polyline;
+    // Seeds are traced independently of each other, each into its own
+    // slot, so the output doesn't depend on the order they finish in.
+    int const num_seeds = seeds.size();
+    std::vector<std::vector<QPointF> > traced(num_seeds);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_seeds; ++i) {
+        QPoint const& seed = seeds[i];
+        std::vector<QPointF>& polyline = traced[i];
 
         {
             TowardsLineTracer tracer(&sedm, &main_grid, bounds.first, seed);
@@ -490,7 +499,10 @@ TextLineTracer::extractTextLines(
                 polyline.push_back(*pt);
             }
         }
+    }
 
+    out.reserve(out.size() + num_seeds);
+    for (std::vector<QPointF>& polyline : traced) {
         out.push_back(std::vector<QPointF>());
         out.back().swap(polyline);
     }
@@ -683,7 +695,7 @@ TextLineTracer::visualizeMidLineSeeds(
 
 QImage
 TextLineTracer::visualizePolylines(
-    QImage const& background, std::list<std::vector<QPointF> > const& polylines,
+    QImage const& background, std::vector<std::vector<QPointF> > const& polylines,
     std::pair<QLineF, QLineF> const* vert_bounds)
 {
     QImage canvas(background.convertToFormat(QImage::Format_ARGB32_Premultiplied));
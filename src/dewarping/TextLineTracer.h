@@ -25,7 +25,6 @@
 #include <QPointF>
 #include <QLineF>
 #include <vector>
-#include <list>
 #include <utility>
 #include <stdint.h>
 
@@ -61,7 +60,7 @@ private:
     static void sanitizeBinaryImage(imageproc::BinaryImage& image, QRect const& content_rect);
 
     static void extractTextLines(
-        std::list<std::vector<QPointF> >& out, imageproc::GrayImage const& image,
+        std::vector<std::vector<QPointF> >& out, imageproc::GrayImage const& image,
         std::pair<QLineF, QLineF> const& bounds, DebugImages* dbg);
 
     static Vec2f calcAvgUnitVector(std::pair<QLineF, QLineF> const& bounds);
@@ -80,13 +79,13 @@ private:
     static bool isInsideBounds(
         QPointF const& pt, QLineF const& left_bound, QLineF const& right_bound);
 
-    static void filterShortCurves(std::list<std::vector<QPointF> >& polylines,
+    static void filterShortCurves(std::vector<std::vector<QPointF> >& polylines,
                                   QLineF const& left_bound, QLineF const& right_bound);
 
-    static void filterOutOfBoundsCurves(std::list<std::vector<QPointF> >& polylines,
+    static void filterOutOfBoundsCurves(std::vector<std::vector<QPointF> >& polylines,
                                         QLineF const& left_bound, QLineF const& right_bound);
 
-    static void filterEdgyCurves(std::list<std::vector<QPointF> >& polylines);
+    static void filterEdgyCurves(std::vector<std::vector<QPointF> >& polylines);
 
     static QImage visualizeVerticalBounds(
         QImage const& background, std::pair<QLineF, QLineF> const& bounds);
@@ -97,7 +96,7 @@ private:
                                         std::pair<QLineF, QLineF> bounds, QLineF mid_line, std::vector<QPoint> const& seeds);
 
     static QImage visualizePolylines(
-        QImage const& background, std::list<std::vector<QPointF> > const& polylines,
+        QImage const& background, std::vector<std::vector<QPointF> > const& polylines,
         std::pair<QLineF, QLineF> const* vert_bounds = 0);
 };
 
@@ -21,7 +21,7 @@
 #include "TaskStatus.h"
 #include "DebugImages.h"
 #include "NumericTraits.h"
-#include "PriorityQueue.h"
+#include "BucketQueue.h"
 #include "ToLineProjector.h"
 #include "LineBoundedByRect.h"
 #include "GridLineTraverser.h"
@@ -39,10 +39,13 @@
 #include <QColor>
 #include <QtGlobal>
 #include <QDebug>
+#include <vector>
+#include <memory>
 #include <limits>
 #include <algorithm>
 #include <math.h>
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 
 using namespace imageproc;
@@ -52,19 +55,18 @@ namespace dewarping
 
 struct TopBottomEdgeTracer::GridNode {
 private:
-    static uint32_t const HEAP_IDX_BITS = 28;
+    static uint32_t const QUEUED_BITS = 1;
     static uint32_t const PREV_NEIGHBOUR_BITS = 3;
     static uint32_t const PATH_CONTINUATION_BITS = 1;
 
-    static uint32_t const HEAP_IDX_SHIFT = 0;
-    static uint32_t const PREV_NEIGHBOUR_SHIFT = HEAP_IDX_SHIFT + HEAP_IDX_BITS;
+    static uint32_t const QUEUED_SHIFT = 0;
+    static uint32_t const PREV_NEIGHBOUR_SHIFT = QUEUED_SHIFT + QUEUED_BITS;
     static uint32_t const PATH_CONTINUATION_SHIFT = PREV_NEIGHBOUR_SHIFT + PREV_NEIGHBOUR_BITS;
 
-    static uint32_t const HEAP_IDX_MASK = ((uint32_t(1) << HEAP_IDX_BITS) - uint32_t(1)) << HEAP_IDX_SHIFT;
+    static uint32_t const QUEUED_MASK = ((uint32_t(1) << QUEUED_BITS) - uint32_t(1)) << QUEUED_SHIFT;
     static uint32_t const PREV_NEIGHBOUR_MASK = ((uint32_t(1) << PREV_NEIGHBOUR_BITS) - uint32_t(1)) << PREV_NEIGHBOUR_SHIFT;
     static uint32_t const PATH_CONTINUATION_MASK = ((uint32_t(1) << PATH_CONTINUATION_BITS) - uint32_t(1)) << PATH_CONTINUATION_SHIFT;
 public:
-    static uint32_t const INVALID_HEAP_IDX = HEAP_IDX_MASK >> HEAP_IDX_SHIFT;
 
     union {
         float dirDeriv; // Directional derivative.
@@ -90,7 +92,7 @@ public:
     {
         dirDeriv = 0;
         pathCost = -1;
-        packedData = INVALID_HEAP_IDX;
+        packedData = 0;
     }
 
     /**
@@ -99,18 +101,20 @@ public:
     void setupForInterior()
     {
         pathCost = NumericTraits<float>::max();
-        packedData = INVALID_HEAP_IDX;
+        packedData = 0;
     }
 
-    uint32_t heapIdx() const
+    /**
+     * Whether the node has an up to date entry in PrioQueue.
+     */
+    bool isQueued() const
     {
-        return (packedData & HEAP_IDX_MASK) >> HEAP_IDX_SHIFT;
+        return packedData & QUEUED_MASK;
     }
 
-    void setHeapIdx(uint32_t idx)
+    void setQueued(bool queued)
     {
-        assert(!(idx & ~(HEAP_IDX_MASK >> HEAP_IDX_SHIFT)));
-        packedData = idx | (packedData & ~HEAP_IDX_MASK);
+        packedData = (queued ? QUEUED_MASK : 0) | (packedData & ~QUEUED_MASK);
     }
 
     bool hasPathContinuation() const
@@ -142,27 +146,52 @@ public:
     }
 };
 
-class TopBottomEdgeTracer::PrioQueue :
-    public PriorityQueue<uint32_t, PrioQueue>
+/**
+ * Path costs are from 0 to 1 and never decrease along a path,
+ * so a bucket queue over quantized costs can be used in place of a heap.
+ * Nodes whose costs fall into the same bucket may come out in the wrong
+ * order, in which case they get improved and pushed again, so the final
+ * costs are still exact.
+ */
+class TopBottomEdgeTracer::PrioQueue
 {
+    static int const NUM_BUCKETS = 4096;
 public:
-    PrioQueue(Grid<GridNode>& grid) : m_pData(grid.data()) {}
-
-    bool higherThan(uint32_t lhs, uint32_t rhs) const
-    {
-        return m_pData[lhs].pathCost < m_pData[rhs].pathCost;
-    }
+    PrioQueue(Grid<GridNode>& grid) : m_queue(NUM_BUCKETS), m_pData(grid.data()) {}
 
-    void setIndex(uint32_t grid_idx, size_t heap_idx)
+    /**
+     * Queues a node with its current path cost.  That's also the way to
+     * requeue a node after its path cost went down.
+     */
+    void push(uint32_t grid_idx)
     {
-        m_pData[grid_idx].setHeapIdx(static_cast<uint32_t>(heap_idx));
+        GridNode& node = m_pData[grid_idx];
+        assert(node.pathCost >= 0 && node.pathCost <= 1);
+        node.setQueued(true);
+        m_queue.push(grid_idx, int(node.pathCost * (NUM_BUCKETS - 1)));
     }
 
-    void reposition(GridNode* node)
+    /**
+     * Retrieves the node with the lowest path cost and removes it from
+     * the queue.  Returns false if the queue has run out of nodes.
+     */
+    bool retrieveFront(uint32_t& grid_idx)
     {
-        PriorityQueue<uint32_t, PrioQueue>::reposition(node->heapIdx());
+        while (!m_queue.empty()) {
+            grid_idx = m_queue.front();
+            m_queue.pop();
+
+            GridNode& node = m_pData[grid_idx];
+            if (node.isQueued()) {
+                node.setQueued(false);
+                return true;
+            }
+            // Otherwise it's a stale entry left by requeueing.
+        }
+        return false;
     }
 private:
+    BucketQueue m_queue;
     GridNode* const m_pData;
 };
 
@@ -200,7 +229,8 @@ TopBottomEdgeTracer::interpolatedGridValue(Grid<GridNode> const& grid, Extractor
 void
 TopBottomEdgeTracer::trace(
     imageproc::GrayImage const& image, std::pair<QLineF, QLineF> bounds,
-    DistortionModelBuilder& output, TaskStatus const& status, DebugImages* dbg)
+    DistortionModelBuilder& output, TaskStatus const& status, DebugImages* dbg,
+    Mode const mode)
 {
     if (bounds.first.p1() == bounds.first.p2() || bounds.second.p1() == bounds.second.p2()) {
         return; // Bad bounds.
@@ -240,47 +270,66 @@ TopBottomEdgeTracer::trace(
     forceSameDirection(bounds);
 
     Vec2f const avg_bounds_dir(calcAvgUnitVector(bounds));
-    Grid<GridNode> grid(downscaled.width(), downscaled.height(), /*padding=*/1);
-    calcDirectionalDerivative(grid, downscaled, avg_bounds_dir);
-    if (dbg) {
-        dbg->add(visualizeGradient(grid), "gradient");
-    }
 
-    status.throwIfCancelled();
+    std::vector<std::vector<QPointF> > snakes;
+
+    if (mode == MODE_PYRAMID) {
+        traceInBands(downscaled, bounds, avg_bounds_dir, snakes, status);
+        if (dbg) {
+            dbg->addLazy([=]() {
+                return visualizeSnakes(downscaled.toQImage(), snakes, bounds);
+            }, "band_snakes");
+        }
+    } else {
+        Grid<GridNode> grid(downscaled.width(), downscaled.height(), /*padding=*/1);
+        calcDirectionalDerivative(grid, downscaled, avg_bounds_dir);
+        if (dbg) {
+            std::shared_ptr<Grid<GridNode> const> const grid_copy(new Grid<GridNode>(grid));
+            dbg->addLazy([=]() { return visualizeGradient(*grid_copy); }, "gradient");
+        }
+
+        status.throwIfCancelled();
 
-    PrioQueue queue(grid);
+        PrioQueue queue(grid);
 
-    // Shortest paths from bounds.first towards bounds.second.
-    prepareForShortestPathsFrom(queue, grid, bounds.first);
-    Vec2f const dir_1st_to_2nd(directionFromPointToLine(bounds.first.pointAt(0.5), bounds.second));
-    propagateShortestPaths(dir_1st_to_2nd, queue, grid);
-    std::vector<QPoint> const endpoints1(locateBestPathEndpoints(grid, bounds.second));
-    if (dbg) {
-        dbg->add(visualizePaths(downscaled, grid, bounds, endpoints1), "best_paths_ltr");
-    }
+        // Shortest paths from bounds.first towards bounds.second.
+        prepareForShortestPathsFrom(queue, grid, bounds.first);
+        Vec2f const dir_1st_to_2nd(directionFromPointToLine(bounds.first.pointAt(0.5), bounds.second));
+        propagateShortestPaths(dir_1st_to_2nd, queue, grid);
+        std::vector<QPoint> const endpoints1(locateBestPathEndpoints(grid, bounds.second));
+        if (dbg) {
+            std::shared_ptr<Grid<GridNode> const> const grid_copy(new Grid<GridNode>(grid));
+            dbg->addLazy([=]() {
+                return visualizePaths(downscaled, *grid_copy, bounds, endpoints1);
+            }, "best_paths_ltr");
+        }
 
-    gaussBlurGradient(grid);
+        gaussBlurGradient(grid);
 
-    std::vector<std::vector<QPointF> > snakes;
-    snakes.reserve(endpoints1.size());
+        snakes.reserve(endpoints1.size());
 
-    for (QPoint const& endpoint : endpoints1) {
-        snakes.push_back(pathToSnake(grid, endpoint));
-        Vec2f const dir(downTheHillDirection(downscaled.rect(), snakes.back(), avg_bounds_dir));
-        downTheHillSnake(snakes.back(), grid, dir);
-    }
-    if (dbg) {
-        QImage const background(visualizeBlurredGradient(grid));
-        dbg->add(visualizeSnakes(background, snakes, bounds), "down_the_hill_snakes");
-    }
+        for (QPoint const& endpoint : endpoints1) {
+            snakes.push_back(pathToSnake(grid, endpoint));
+            Vec2f const dir(downTheHillDirection(downscaled.rect(), snakes.back(), avg_bounds_dir));
+            downTheHillSnake(snakes.back(), grid, dir);
+        }
+        if (dbg) {
+            std::shared_ptr<Grid<GridNode> const> const grid_copy(new Grid<GridNode>(grid));
+            dbg->addLazy([=]() {
+                return visualizeSnakes(visualizeBlurredGradient(*grid_copy), snakes, bounds);
+            }, "down_the_hill_snakes");
+        }
 
-    for (std::vector<QPointF>& snake : snakes) {
-        Vec2f const dir(-downTheHillDirection(downscaled.rect(), snake, avg_bounds_dir));
-        upTheHillSnake(snake, grid, dir);
-    }
-    if (dbg) {
-        QImage const background(visualizeGradient(grid));
-        dbg->add(visualizeSnakes(background, snakes, bounds), "up_the_hill_snakes");
+        for (std::vector<QPointF>& snake : snakes) {
+            Vec2f const dir(-downTheHillDirection(downscaled.rect(), snake, avg_bounds_dir));
+            upTheHillSnake(snake, grid, dir);
+        }
+        if (dbg) {
+            std::shared_ptr<Grid<GridNode> const> const grid_copy(new Grid<GridNode>(grid));
+            dbg->addLazy([=]() {
+                return visualizeSnakes(visualizeGradient(*grid_copy), snakes, bounds);
+            }, "up_the_hill_snakes");
+        }
     }
 
     // Convert snakes back to the original coordinate system.
@@ -395,20 +444,25 @@ TopBottomEdgeTracer::horizontalSobelInPlace(Grid<GridNode>& grid)
     int const height = grid.height();
     int const grid_stride = grid.stride();
 
-    // Do a vertical pass.
-    for (int x = -1; x < width + 1; ++x) {
-        GridNode* p_grid = grid.data() + x;
-        float prev = p_grid[-grid_stride].xGrad;
-        for (int y = 0; y < height; ++y) {
-            float const cur = p_grid->xGrad;
-            p_grid->xGrad = prev + cur + cur + p_grid[grid_stride].xGrad;
-            prev = cur;
-            p_grid += grid_stride;
+    // Do a vertical pass.  It goes line by line, to access memory
+    // sequentially, so the line above is kept in a buffer, as it's
+    // already overwritten by the time we get to the current one.
+    std::vector<float> prev_line(width + 2);
+    GridNode* grid_line = grid.data() - 1;
+    for (int x = 0; x < width + 2; ++x) {
+        prev_line[x] = grid_line[x - grid_stride].xGrad;
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width + 2; ++x) {
+            float const cur = grid_line[x].xGrad;
+            grid_line[x].xGrad = prev_line[x] + cur + cur + grid_line[x + grid_stride].xGrad;
+            prev_line[x] = cur;
         }
+        grid_line += grid_stride;
     }
 
     // Do a horizontal pass and write results.
-    GridNode* grid_line = grid.data();
+    grid_line = grid.data();
     for (int y = 0; y < height; ++y) {
         float prev = grid_line[-1].xGrad;
         for (int x = 0; x < width; ++x) {
@@ -441,16 +495,19 @@ TopBottomEdgeTracer::verticalSobelInPlace(Grid<GridNode>& grid)
         grid_line += grid_stride;
     }
 
-    // Do a vertical pass and write results.
+    // Do a vertical pass and write results, line by line.
+    std::vector<float> prev_line(width);
+    grid_line = grid.data();
     for (int x = 0; x < width; ++x) {
-        GridNode* p_grid = grid.data() + x;
-        float prev = p_grid[-grid_stride].yGrad;
-        for (int y = 0; y < height; ++y) {
-            float const cur = p_grid->yGrad;
-            p_grid->yGrad = p_grid[grid_stride].yGrad - prev;
-            prev = cur;
-            p_grid += grid_stride;
+        prev_line[x] = grid_line[x - grid_stride].yGrad;
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float const cur = grid_line[x].yGrad;
+            grid_line[x].yGrad = grid_line[x + grid_stride].yGrad - prev_line[x];
+            prev_line[x] = cur;
         }
+        grid_line += grid_stride;
     }
 }
 
@@ -517,6 +574,178 @@ TopBottomEdgeTracer::prepareForShortestPathsFrom(
     }
 }
 
+void
+TopBottomEdgeTracer::prepareForShortestPathsInBand(
+    PrioQueue& queue, Grid<GridNode>& grid, QLineF const& from,
+    std::vector<uint8_t> const& band_mask)
+{
+    GridNode padding_node;
+    padding_node.setupForPadding();
+    grid.initPadding(padding_node);
+
+    int const width = grid.width();
+    int const height = grid.height();
+    int const stride = grid.stride();
+    GridNode* const data = grid.data();
+
+    GridNode* line = grid.data();
+    uint8_t const* mask_line = &band_mask[0];
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            GridNode* node = line + x;
+            if (mask_line[x]) {
+                node->setupForInterior();
+            } else {
+                // Like padding, except dirDeriv is preserved for snakes.
+                node->pathCost = -1;
+                node->packedData = 0;
+            }
+        }
+        line += stride;
+        mask_line += width;
+    }
+
+    GridLineTraverser traverser(from);
+    while (traverser.hasNext()) {
+        QPoint const pt(traverser.next());
+        if (pt.x() < 0 || pt.y() < 0 || pt.x() >= width || pt.y() >= height) {
+            continue;
+        }
+        if (!band_mask[pt.y() * width + pt.x()]) {
+            continue;
+        }
+
+        int const offset = pt.y() * stride + pt.x();
+        data[offset].pathCost = 0;
+        queue.push(offset);
+    }
+}
+
+void
+TopBottomEdgeTracer::traceInBands(
+    GrayImage const& image, std::pair<QLineF, QLineF> const& bounds,
+    Vec2f const& avg_bounds_dir, std::vector<std::vector<QPointF> >& snakes,
+    TaskStatus const& status)
+{
+    // How far from a coarse path the fine one may go.
+    int const band_radius = 12;
+    // The room snakes need to move around in.
+    int const snake_margin = 40;
+
+    Vec2f const dir_1st_to_2nd(directionFromPointToLine(bounds.first.pointAt(0.5), bounds.second));
+
+    // Coarse level.
+    QSize const coarse_size(
+        std::max(1, image.width() / 4), std::max(1, image.height() / 4)
+    );
+    double const x_scale = double(image.width()) / coarse_size.width();
+    double const y_scale = double(image.height()) / coarse_size.height();
+    QTransform coarse_to_fine;
+    coarse_to_fine.scale(x_scale, y_scale);
+
+    std::vector<std::vector<QPoint> > coarse_paths;
+    {
+        GrayImage const coarse(scaleToGray(image, coarse_size));
+        std::pair<QLineF, QLineF> coarse_bounds(
+            coarse_to_fine.inverted().map(bounds.first),
+            coarse_to_fine.inverted().map(bounds.second)
+        );
+        if (!intersectWithRect(coarse_bounds, QRectF(coarse.rect()).adjusted(0, 0, -1, -1))) {
+            return;
+        }
+
+        Grid<GridNode> grid(coarse.width(), coarse.height(), /*padding=*/1);
+        calcDirectionalDerivative(grid, coarse, avg_bounds_dir);
+
+        status.throwIfCancelled();
+
+        PrioQueue queue(grid);
+        prepareForShortestPathsFrom(queue, grid, coarse_bounds.first);
+        propagateShortestPaths(dir_1st_to_2nd, queue, grid);
+
+        for (QPoint const& endpoint : locateBestPathEndpoints(grid, coarse_bounds.second)) {
+            coarse_paths.push_back(tracePathFromEndpoint(grid, endpoint));
+        }
+    }
+
+    QRect const image_rect(image.rect());
+
+    for (std::vector<QPoint> const& coarse_path : coarse_paths) {
+        status.throwIfCancelled();
+
+        // Band centers, in fine coordinates.
+        std::vector<QPoint> centers;
+        centers.reserve(coarse_path.size());
+        QRect band_rect;
+        for (QPoint const& pt : coarse_path) {
+            QPoint const center(
+                int((pt.x() + 0.5) * x_scale), int((pt.y() + 0.5) * y_scale)
+            );
+            centers.push_back(center);
+            band_rect |= QRect(center, QSize(1, 1));
+        }
+
+        int const margin = band_radius + snake_margin;
+        QRect const crop_rect(
+            band_rect.adjusted(-margin, -margin, margin, margin).intersected(image_rect)
+        );
+        if (crop_rect.isEmpty()) {
+            continue;
+        }
+
+        int const width = crop_rect.width();
+        int const height = crop_rect.height();
+
+        GrayImage crop(crop_rect.size());
+        for (int y = 0; y < height; ++y) {
+            memcpy(
+                crop.data() + y * crop.stride(),
+                image.data() + (crop_rect.top() + y) * image.stride() + crop_rect.left(),
+                width
+            );
+        }
+
+        // Coarse path pixels are at most (scale * sqrt(2)) apart,
+        // which is well below the band diameter, so squares around
+        // them make up a continuous band.
+        std::vector<uint8_t> band_mask(width * height, 0);
+        for (QPoint const& center : centers) {
+            int const x0 = std::max(0, center.x() - crop_rect.left() - band_radius);
+            int const x1 = std::min(width - 1, center.x() - crop_rect.left() + band_radius);
+            int const y0 = std::max(0, center.y() - crop_rect.top() - band_radius);
+            int const y1 = std::min(height - 1, center.y() - crop_rect.top() + band_radius);
+            for (int y = y0; y <= y1; ++y) {
+                std::fill(&band_mask[y * width + x0], &band_mask[y * width + x1] + 1, 1);
+            }
+        }
+
+        Grid<GridNode> grid(width, height, /*padding=*/1);
+        calcDirectionalDerivative(grid, crop, avg_bounds_dir);
+
+        QPointF const origin(crop_rect.topLeft());
+        QLineF const from(bounds.first.translated(-origin));
+        QLineF const to(bounds.second.translated(-origin));
+
+        PrioQueue queue(grid);
+        prepareForShortestPathsInBand(queue, grid, from, band_mask);
+        propagateShortestPaths(dir_1st_to_2nd, queue, grid);
+        std::vector<QPoint> const endpoints(locateBestPathEndpoints(grid, to));
+
+        gaussBlurGradient(grid);
+
+        QRectF const page_rect(image_rect.translated(-crop_rect.topLeft()));
+        for (QPoint const& endpoint : endpoints) {
+            std::vector<QPointF> snake(pathToSnake(grid, endpoint));
+            downTheHillSnake(snake, grid, downTheHillDirection(page_rect, snake, avg_bounds_dir));
+            upTheHillSnake(snake, grid, -downTheHillDirection(page_rect, snake, avg_bounds_dir));
+            for (QPointF& pt : snake) {
+                pt += origin;
+            }
+            snakes.push_back(snake);
+        }
+    }
+}
+
 void
 TopBottomEdgeTracer::propagateShortestPaths(
     Vec2f const& direction, PrioQueue& queue, Grid<GridNode>& grid)
@@ -527,12 +756,10 @@ TopBottomEdgeTracer::propagateShortestPaths(
     int prev_nbh_indexes[8];
     int const num_neighbours = initNeighbours(next_nbh_offsets, prev_nbh_indexes, grid.stride(), direction);
 
-    while (!queue.empty()) {
-        int const grid_idx = queue.front();
+    uint32_t grid_idx;
+    while (queue.retrieveFront(grid_idx)) {
         GridNode* node = data + grid_idx;
         assert(node->pathCost >= 0);
-        queue.pop();
-        node->setHeapIdx(GridNode::INVALID_HEAP_IDX);
 
         for (int i = 0; i < num_neighbours; ++i) {
             int const nbh_grid_idx = grid_idx + next_nbh_offsets[i];
@@ -543,11 +770,7 @@ TopBottomEdgeTracer::propagateShortestPaths(
             if (new_cost < nbh_node->pathCost) {
                 nbh_node->pathCost = new_cost;
                 nbh_node->setPrevNeighbourIdx(prev_nbh_indexes[i]);
-                if (nbh_node->heapIdx() == GridNode::INVALID_HEAP_IDX) {
-                    queue.push(nbh_grid_idx);
-                } else {
-                    queue.reposition(nbh_node);
-                }
+                queue.push(nbh_grid_idx);
             }
         }
     }
@@ -615,11 +838,18 @@ TopBottomEdgeTracer::locateBestPathEndpoints(Grid<GridNode> const& grid, QLineF
     while (traverser.hasNext()) {
         QPoint const pt(traverser.next());
 
-        // intersectWithRect() ensures that.
-        assert(pt.x() >= 0 && pt.y() >= 0 && pt.x() < width && pt.y() < height);
+        // intersectWithRect() ensures that, except for the cropped grids
+        // of traceInBands(), where the line may go outside.
+        if (pt.x() < 0 || pt.y() < 0 || pt.x() >= width || pt.y() >= height) {
+            continue;
+        }
 
         uint32_t const offset = pt.y() * stride + pt.x();
         GridNode const* node = data + offset;
+        if (node->pathCost < 0 || node->pathCost == NumericTraits<float>::max()) {
+            // Outside of the band or not reached from it.
+            continue;
+        }
 
         // Find the closest path.
         Path* closest_path = 0;
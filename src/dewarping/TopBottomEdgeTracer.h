@@ -27,6 +27,7 @@
 #include <list>
 #include <utility>
 #include <vector>
+#include <stdint.h>
 
 class TaskStatus;
 class DebugImages;
@@ -46,9 +47,22 @@ class DistortionModelBuilder;
 class TopBottomEdgeTracer
 {
 public:
+    enum Mode {
+        /** Find shortest paths over the whole (downscaled) image. */
+        MODE_SINGLE_LEVEL,
+        /**
+         * Find shortest paths at a quarter of that resolution first,
+         * then only search narrow bands around them.  That takes much
+         * less time and memory, at the risk of missing an edge that
+         * doesn't show up at the coarse level.
+         */
+        MODE_PYRAMID
+    };
+
     static void trace(
         imageproc::GrayImage const& image, std::pair<QLineF, QLineF> bounds,
-        DistortionModelBuilder& output, TaskStatus const& status, DebugImages* dbg = 0);
+        DistortionModelBuilder& output, TaskStatus const& status, DebugImages* dbg = 0,
+        Mode mode = MODE_SINGLE_LEVEL);
 private:
     struct GridNode;
     class PrioQueue;
@@ -71,6 +85,15 @@ private:
 
     static void prepareForShortestPathsFrom(PrioQueue& queue, Grid<GridNode>& grid, QLineF const& from);
 
+    static void prepareForShortestPathsInBand(
+        PrioQueue& queue, Grid<GridNode>& grid, QLineF const& from,
+        std::vector<uint8_t> const& band_mask);
+
+    static void traceInBands(
+        imageproc::GrayImage const& image, std::pair<QLineF, QLineF> const& bounds,
+        Vec2f const& avg_bounds_dir, std::vector<std::vector<QPointF> >& snakes,
+        TaskStatus const& status);
+
     static void propagateShortestPaths(Vec2f const& direction, PrioQueue& queue, Grid<GridNode>& grid);
 
     static int initNeighbours(int* next_nbh_offsets, int* prev_nbh_indexes, int stride, Vec2f const& direction);
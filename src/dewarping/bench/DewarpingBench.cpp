@@ -0,0 +1,584 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * \file
+ * Times the stages of automatic dewarping and measures the quality
+ * of the distortion models they produce.
+ *
+ * Usage: dewarping_bench [--iterations=N] [--filter=substring] [image ...]
+ *
+ * The corpus consists of synthetic book pages, rendered through known
+ * cylindrical distortion models at several resolutions and amounts of
+ * curl, plus every image given on the command line.  A real image may
+ * come with a reference model in a file next to it, named like the image
+ * but with the .model.xml extension.  Its document element is a distortion
+ * model in the format of the project files, like the one Scan Tailor writes
+ * after manual dewarping.
+ *
+ * Each stage is timed on its own, with the inputs it needs computed
+ * beforehand by the earlier stages.  Results are printed to stdout as
+ * JSON lines, one object per stage and fixture, followed by a
+ * "model_quality" object per fixture.  The latter tells whether a valid
+ * model was built and, given a reference, how far from straight the lines
+ * the reference straightens come out under the built model, in pixels.
+ */
+
+#include "TextLineTracer.h"
+#include "TextLineRefiner.h"
+#include "TopBottomEdgeTracer.h"
+#include "DistortionModelBuilder.h"
+#include "DistortionModel.h"
+#include "CylindricalSurfaceDewarper.h"
+#include "RasterDewarper.h"
+#include "Curve.h"
+#include "Dpi.h"
+#include "TaskStatus.h"
+#include "VecNT.h"
+#include "imageproc/GrayImage.h"
+#include "imageproc/Scale.h"
+#include "imageproc/Constants.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDomDocument>
+#include <QImage>
+#include <QPainter>
+#include <QPolygonF>
+#include <QLinearGradient>
+#include <QTransform>
+#include <QColor>
+#include <QSize>
+#include <QRect>
+#include <QRectF>
+#include <QPointF>
+#include <QString>
+#include <QStringList>
+#ifndef Q_MOC_RUN
+#include <boost/function.hpp>
+#endif
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <math.h>
+
+using namespace dewarping;
+using namespace imageproc;
+
+namespace
+{
+
+/** The default of the output filter's depth perception setting. */
+double const DEPTH_PERCEPTION = 2.0;
+
+class NeverCancelled : public TaskStatus
+{
+public:
+    virtual void cancel() {}
+
+    virtual bool isCancelled() const
+    {
+        return false;
+    }
+
+    virtual void throwIfCancelled() const {}
+};
+
+NeverCancelled const g_status;
+
+struct Fixture
+{
+    QString name;
+    int dpi;
+    GrayImage gray;
+    QRect contentRect;
+
+    /** May be null, in which case model quality can't be measured. */
+    DistortionModel reference;
+
+    /**
+     * Vertical positions of text lines in the dewarped space of the
+     * reference model, or of the built one for fixtures without
+     * a reference.  TextLineRefiner is seeded with these.
+     */
+    std::vector<double> lineYs;
+
+    // Products of the earlier stages.
+    DistortionModelBuilder afterTextLines;
+    DistortionModelBuilder afterEdges;
+    DistortionModel model;
+    GrayImage downscaled;
+    std::vector<std::vector<QPointF> > refinerSeeds;
+
+    Fixture() : dpi(0), afterTextLines(Vec2d(0, 1)), afterEdges(Vec2d(0, 1)) {}
+};
+
+struct Benchmark
+{
+    char const* name;
+
+    /** Returns false if the fixture lacks what the stage needs. */
+    boost::function<bool(Fixture const&)> run;
+};
+
+std::vector<QPointF> mapToWarped(
+    CylindricalSurfaceDewarper const& dewarper, std::vector<QPointF> const& crv_pts)
+{
+    std::vector<QPointF> img_pts(crv_pts.size());
+    dewarper.mapToWarpedSpace(crv_pts.data(), img_pts.data(), crv_pts.size());
+    return img_pts;
+}
+
+/**
+ * Renders a book page lying on a dark background and curling up towards
+ * the spine, with text-like glyph boxes along the lines the model
+ * straightens.  The top and bottom edges of the page are the directrices
+ * of the reference model.
+ *
+ * \param curl How far the page edges rise near the spine, in inches.
+ */
+Fixture syntheticFixture(
+    QString const& name, int const dpi, double const curl, bool const spine_on_left)
+{
+    QSize const size(dpi * 827 / 100, dpi * 1169 / 100); // A4
+    double const left = 0.6 * dpi;
+    double const right = size.width() - 0.6 * dpi;
+    double const top = 0.8 * dpi;
+    double const bottom = size.height() - 0.8 * dpi;
+
+    std::vector<QPointF> top_curve;
+    std::vector<QPointF> bottom_curve;
+    int const num_curve_points = 41;
+    for (int i = 0; i < num_curve_points; ++i) {
+        double const t = double(i) / (num_curve_points - 1);
+        double const s = spine_on_left ? 1.0 - t : t;
+        double const rise = curl * dpi * s * s * s;
+        double const x = left + t * (right - left);
+        top_curve.push_back(QPointF(x, top - rise));
+        bottom_curve.push_back(QPointF(x, bottom + 0.6 * rise));
+    }
+
+    Fixture fixture;
+    fixture.name = name;
+    fixture.dpi = dpi;
+    fixture.reference.setTopCurve(Curve(top_curve));
+    fixture.reference.setBottomCurve(Curve(bottom_curve));
+
+    CylindricalSurfaceDewarper const dewarper(top_curve, bottom_curve, DEPTH_PERCEPTION);
+
+    QImage canvas(size, QImage::Format_RGB32);
+    canvas.fill(QColor(70, 70, 70));
+    QPainter painter(&canvas);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(Qt::NoPen);
+
+    QPolygonF page;
+    page << QPolygonF::fromStdVector(top_curve);
+    for (auto it = bottom_curve.rbegin(); it != bottom_curve.rend(); ++it) {
+        page << *it;
+    }
+    // The page is lit less towards the spine.
+    QLinearGradient lighting(left, 0, right, 0);
+    lighting.setColorAt(spine_on_left ? 1.0 : 0.0, QColor(240, 240, 240));
+    lighting.setColorAt(spine_on_left ? 0.0 : 1.0, QColor(205, 205, 205));
+    painter.setBrush(lighting);
+    painter.drawPolygon(page);
+
+    // Text geometry, in the dewarped space where the page is a unit square.
+    double const crv_per_px_x = 1.0 / (right - left);
+    double const line_pitch = (1.0 / 6.0) * dpi / (bottom - top);
+    double const glyph_height = 0.6 * line_pitch;
+    std::minstd_rand rng(dpi + int(curl * 100) + (spine_on_left ? 1 : 0));
+    std::uniform_real_distribution<double> glyph_width(
+        dpi / 40 * crv_per_px_x, dpi / 12 * crv_per_px_x
+    );
+    std::uniform_real_distribution<double> paragraph_end(0.4, 0.9);
+    std::uniform_int_distribution<int> ink(20, 60);
+    double const gap = dpi / 60 * crv_per_px_x;
+
+    QRectF content_rect;
+    int line_idx = 0;
+    for (double y = 0.07; y + glyph_height < 0.93; y += line_pitch, ++line_idx) {
+        double const line_end = (line_idx % 7 == 6) ? paragraph_end(rng) : 0.92;
+        for (double x = 0.08; x < line_end;) {
+            double const w = std::min(glyph_width(rng), line_end - x);
+            std::vector<QPointF> glyph;
+            glyph.push_back(QPointF(x, y));
+            glyph.push_back(QPointF(x + w, y));
+            glyph.push_back(QPointF(x + w, y + glyph_height));
+            glyph.push_back(QPointF(x, y + glyph_height));
+            QPolygonF const poly(QPolygonF::fromStdVector(mapToWarped(dewarper, glyph)));
+            int const level = ink(rng);
+            painter.setBrush(QColor(level, level, level));
+            painter.drawPolygon(poly);
+            content_rect |= poly.boundingRect();
+            x += w + gap;
+        }
+        // Seed the refiner a bit off the line, so it has work to do.
+        fixture.lineYs.push_back(y + 0.7 * glyph_height);
+    }
+    painter.end();
+
+    fixture.gray = GrayImage(canvas);
+    fixture.contentRect = content_rect.toAlignedRect();
+    return fixture;
+}
+
+Fixture fileFixture(QString const& file)
+{
+    QImage const image(file);
+    if (image.isNull()) {
+        throw std::runtime_error(
+            "Unable to load " + std::string(file.toLocal8Bit().constData())
+        );
+    }
+
+    Fixture fixture;
+    fixture.name = QFileInfo(file).fileName();
+    fixture.dpi = qRound(image.dotsPerMeterX() * constants::DPM2DPI);
+    if (fixture.dpi < 50) {
+        fixture.dpi = 300;
+    }
+    fixture.gray = GrayImage(image);
+    fixture.contentRect = fixture.gray.rect();
+
+    QFileInfo const file_info(file);
+    QFile reference_file(
+        file_info.path() + QLatin1Char('/') + file_info.completeBaseName()
+        + QLatin1String(".model.xml")
+    );
+    if (reference_file.open(QIODevice::ReadOnly)) {
+        QDomDocument doc;
+        if (doc.setContent(&reference_file)) {
+            fixture.reference = DistortionModel(doc.documentElement());
+        }
+    }
+
+    return fixture;
+}
+
+/**
+ * Runs every stage once, untimed, to provide the inputs of the next ones.
+ */
+void prepareFixture(Fixture& fixture)
+{
+    Dpi const dpi(fixture.dpi, fixture.dpi);
+    TextLineTracer::trace(
+        fixture.gray, dpi, fixture.contentRect, fixture.afterTextLines, g_status
+    );
+
+    fixture.afterEdges = fixture.afterTextLines;
+    TopBottomEdgeTracer::trace(
+        fixture.gray, fixture.afterEdges.verticalBounds(), fixture.afterEdges, g_status
+    );
+
+    fixture.model = fixture.afterEdges.tryBuildModel();
+
+    // Mirrors what TextLineTracer feeds to TextLineRefiner.
+    QSize const downscaled_size(
+        std::max(1, fixture.gray.width() * 200 / fixture.dpi),
+        std::max(1, fixture.gray.height() * 200 / fixture.dpi)
+    );
+    fixture.downscaled = scaleToGray(fixture.gray, downscaled_size);
+
+    DistortionModel const& seed_model(
+        fixture.reference.isValid() ? fixture.reference : fixture.model
+    );
+    if (!seed_model.isValid()) {
+        return;
+    }
+    if (fixture.lineYs.empty()) {
+        for (int i = 1; i < 20; ++i) {
+            fixture.lineYs.push_back(i / 20.0);
+        }
+    }
+
+    CylindricalSurfaceDewarper const dewarper(
+        seed_model.topCurve().polyline(), seed_model.bottomCurve().polyline(),
+        DEPTH_PERCEPTION
+    );
+    QTransform to_downscaled;
+    to_downscaled.scale(
+        double(downscaled_size.width()) / fixture.gray.width(),
+        double(downscaled_size.height()) / fixture.gray.height()
+    );
+    for (double const y : fixture.lineYs) {
+        std::vector<QPointF> seed;
+        for (int i = 0; i <= 30; ++i) {
+            seed.push_back(QPointF(0.1 + 0.8 * i / 30, y));
+        }
+        seed = mapToWarped(dewarper, seed);
+        for (QPointF& pt : seed) {
+            pt = to_downscaled.map(pt);
+        }
+        fixture.refinerSeeds.push_back(seed);
+    }
+}
+
+std::vector<Benchmark> benchmarks()
+{
+    std::vector<Benchmark> list;
+
+    struct TraceTextLines
+    {
+        bool operator()(Fixture const& f) const
+        {
+            DistortionModelBuilder builder(Vec2d(0, 1));
+            TextLineTracer::trace(
+                f.gray, Dpi(f.dpi, f.dpi), f.contentRect, builder, g_status
+            );
+            return true;
+        }
+    };
+    list.push_back(Benchmark { "TextLineTracer::trace", TraceTextLines() });
+
+    struct TraceEdges
+    {
+        TopBottomEdgeTracer::Mode mode;
+
+        bool operator()(Fixture const& f) const
+        {
+            DistortionModelBuilder builder(f.afterTextLines);
+            TopBottomEdgeTracer::trace(
+                f.gray, builder.verticalBounds(), builder, g_status, 0, mode
+            );
+            return true;
+        }
+    };
+    list.push_back(
+        Benchmark { "TopBottomEdgeTracer::trace", TraceEdges { TopBottomEdgeTracer::MODE_SINGLE_LEVEL } }
+    );
+    list.push_back(
+        Benchmark { "TopBottomEdgeTracer::trace/pyramid", TraceEdges { TopBottomEdgeTracer::MODE_PYRAMID } }
+    );
+
+    struct BuildModel
+    {
+        bool operator()(Fixture const& f) const
+        {
+            f.afterEdges.tryBuildModel();
+            return true;
+        }
+    };
+    list.push_back(Benchmark { "DistortionModelBuilder::tryBuildModel", BuildModel() });
+
+    struct Refine
+    {
+        bool operator()(Fixture const& f) const
+        {
+            if (f.refinerSeeds.empty()) {
+                return false;
+            }
+            std::vector<std::vector<QPointF> > polylines(f.refinerSeeds);
+            TextLineRefiner const refiner(f.downscaled, Dpi(200, 200), Vec2f(0, 1));
+            refiner.refine(polylines, /*iterations=*/100, 0);
+            return true;
+        }
+    };
+    list.push_back(Benchmark { "TextLineRefiner::refine", Refine() });
+
+    struct Dewarp
+    {
+        bool operator()(Fixture const& f) const
+        {
+            DistortionModel const& model(f.model.isValid() ? f.model : f.reference);
+            if (!model.isValid()) {
+                return false;
+            }
+            CylindricalSurfaceDewarper const dewarper(
+                model.topCurve().polyline(), model.bottomCurve().polyline(),
+                DEPTH_PERCEPTION
+            );
+            QRectF const model_domain(
+                model.modelDomain(dewarper, QTransform(), f.gray.rect())
+            );
+            RasterDewarper::dewarp(
+                f.gray.toQImage(), f.gray.size(), dewarper, model_domain, Qt::white
+            );
+            return true;
+        }
+    };
+    list.push_back(Benchmark { "RasterDewarper::dewarp", Dewarp() });
+
+    return list;
+}
+
+/**
+ * Maps horizontal lines of the reference model's dewarped space to the
+ * image and back with \p model.  A perfect model brings them back straight
+ * and horizontal.  Returns the mean and the maximum over lines of their
+ * vertical extent after the round trip, in pixels of the reference page
+ * height.
+ */
+void lineDeviation(
+    DistortionModel const& reference, DistortionModel const& model,
+    double& mean_px, double& max_px)
+{
+    CylindricalSurfaceDewarper const ref_dewarper(
+        reference.topCurve().polyline(), reference.bottomCurve().polyline(),
+        DEPTH_PERCEPTION
+    );
+    CylindricalSurfaceDewarper const dewarper(
+        model.topCurve().polyline(), model.bottomCurve().polyline(),
+        DEPTH_PERCEPTION
+    );
+
+    std::vector<QPointF> const page_axis(
+        mapToWarped(ref_dewarper, { QPointF(0.5, 0.0), QPointF(0.5, 1.0) })
+    );
+    QPointF const axis_vec(page_axis[1] - page_axis[0]);
+    double const page_height = sqrt(QPointF::dotProduct(axis_vec, axis_vec));
+
+    int const num_lines = 9;
+    double sum = 0;
+    max_px = 0;
+    for (int i = 1; i <= num_lines; ++i) {
+        std::vector<QPointF> line;
+        for (int j = 0; j <= 50; ++j) {
+            line.push_back(QPointF(0.1 + 0.8 * j / 50, double(i) / (num_lines + 1)));
+        }
+        line = mapToWarped(ref_dewarper, line);
+        dewarper.mapToDewarpedSpace(line.data(), line.data(), line.size());
+
+        double min_y = line.front().y();
+        double max_y = min_y;
+        for (QPointF const& pt : line) {
+            min_y = std::min(min_y, pt.y());
+            max_y = std::max(max_y, pt.y());
+        }
+        double const deviation = (max_y - min_y) * page_height;
+        sum += deviation;
+        max_px = std::max(max_px, deviation);
+    }
+    mean_px = sum / num_lines;
+}
+
+QString jsonEscaped(QString str)
+{
+    str.replace(QLatin1String("\\"), QLatin1String("\\\\"));
+    str.replace(QLatin1String("\""), QLatin1String("\\\""));
+    return str;
+}
+
+void printFixturePrefix(char const* benchmark, Fixture const& fixture)
+{
+    std::cout << "{\"benchmark\": \"" << benchmark
+              << "\", \"fixture\": \"" << jsonEscaped(fixture.name).toUtf8().constData()
+              << "\", \"width\": " << fixture.gray.width()
+              << ", \"height\": " << fixture.gray.height()
+              << ", \"dpi\": " << fixture.dpi;
+}
+
+void runBenchmark(Benchmark const& bench, Fixture const& fixture, int const iterations)
+{
+    std::vector<double> msecs;
+    msecs.reserve(iterations);
+    for (int i = 0; i < iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        if (!bench.run(fixture)) {
+            return;
+        }
+        msecs.push_back(timer.nsecsElapsed() / 1000000.0);
+    }
+    std::sort(msecs.begin(), msecs.end());
+
+    printFixturePrefix(bench.name, fixture);
+    std::cout << ", \"iterations\": " << iterations
+              << ", \"min_msec\": " << msecs.front()
+              << ", \"median_msec\": " << msecs[msecs.size() / 2]
+              << "}" << std::endl;
+}
+
+void reportModelQuality(Fixture const& fixture)
+{
+    printFixturePrefix("model_quality", fixture);
+    std::cout << ", \"model_valid\": " << (fixture.model.isValid() ? "true" : "false")
+              << ", \"has_reference\": " << (fixture.reference.isValid() ? "true" : "false");
+    if (fixture.model.isValid() && fixture.reference.isValid()) {
+        double mean_px = 0;
+        double max_px = 0;
+        lineDeviation(fixture.reference, fixture.model, mean_px, max_px);
+        std::cout << ", \"line_deviation_mean_px\": " << mean_px
+                  << ", \"line_deviation_max_px\": " << max_px;
+    }
+    std::cout << "}" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    // Makes image format plugins available for real fixtures.
+    QCoreApplication app(argc, argv);
+
+    int iterations = 5;
+    QString filter;
+    QStringList files;
+    QStringList const args(app.arguments().mid(1));
+    for (QString const& arg : args) {
+        if (arg.startsWith(QLatin1String("--iterations="))) {
+            iterations = std::max(1, arg.mid(13).toInt());
+        } else if (arg.startsWith(QLatin1String("--filter="))) {
+            filter = arg.mid(9);
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    std::vector<Fixture> fixtures;
+    fixtures.push_back(syntheticFixture("warped_150dpi", 150, 0.15, false));
+    fixtures.push_back(syntheticFixture("warped_300dpi", 300, 0.15, false));
+    fixtures.push_back(syntheticFixture("warped_600dpi", 600, 0.15, false));
+    fixtures.push_back(syntheticFixture("warped_300dpi_strong", 300, 0.45, false));
+    fixtures.push_back(syntheticFixture("warped_300dpi_spine_left", 300, 0.3, true));
+    try {
+        for (QString const& file : files) {
+            fixtures.push_back(fileFixture(file));
+        }
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    for (Fixture& fixture : fixtures) {
+        prepareFixture(fixture);
+    }
+
+    std::vector<Benchmark> const list(benchmarks());
+    for (Benchmark const& bench : list) {
+        if (!filter.isEmpty() && !QString::fromLatin1(bench.name).contains(filter)) {
+            continue;
+        }
+        for (Fixture const& fixture : fixtures) {
+            runBenchmark(bench, fixture, iterations);
+        }
+    }
+
+    if (filter.isEmpty() || QString::fromLatin1("model_quality").contains(filter)) {
+        for (Fixture const& fixture : fixtures) {
+            reportModelQuality(fixture);
+        }
+    }
+
+    return 0;
+}
@@ -28,7 +28,10 @@ namespace exporting {
 enum PageGenTweak {
     NoTweaks = 0,
     KeepOriginalColorIllumForeSubscans = 1,
-    IgnoreOutputProcessingStage = 2
+    IgnoreOutputProcessingStage = 2,
+    // Run the output stage as part of the export and take its results
+    // straight from memory instead of reloading the output files.
+    GenerateOutput = 4
 };
 
 Q_DECLARE_FLAGS(PageGenTweaks, PageGenTweak)
@@ -38,6 +41,10 @@ struct ExportSettings {
     bool default_out_dir;
     QString export_dir_path;
     bool export_to_multipage;
+    // Put all pages into a single MRC PDF instead of per-page TIFF files.
+    bool export_to_mrc_pdf;
+    // Compress the MRC PDF foreground with JBIG2 rather than CCITT G4.
+    bool mrc_pdf_jbig2;
     bool generate_blank_back_subscans;
     bool use_sep_suffix_for_pics;
     PageGenTweaks page_gen_tweaks;
@@ -20,29 +20,66 @@
 #include "ExportThread.h"
 #include <QDir>
 #include <QMetaType>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
 #include "ImageLoader.h"
 #include "ImageSplitOps.h"
 #include "TiffWriter.h"
+#include "TraceRecorder.h"
+#include "OutputWriteQueue.h"
 #include "settings/globalstaticsettings.h"
+#include "imageproc/BinaryImage.h"
 
 
 
+using namespace imageproc;
+
 namespace exporting {
 
 const int dummy = qRegisterMetaType<PageId>("PageId");
 
+class ExportThread::PageExporter : public QRunnable
+{
+public:
+    PageExporter(ExportThread& owner, const ExportRec& rec, int seq)
+        : m_rOwner(owner), m_rec(rec), m_seq(seq) {}
+
+    void run() override
+    {
+        const bool to_pdf = m_rOwner.m_ptrPdfWriter != nullptr;
+        MrcPdfWriter::Page pdf_page;
+        if (!m_rOwner.isCancelRequested()) {
+            m_rOwner.exportPage(m_rec, to_pdf ? &pdf_page : nullptr);
+        }
+        if (to_pdf) {
+            m_rOwner.submitPdfPage(m_seq, pdf_page);
+        }
+    }
+private:
+    ExportThread& m_rOwner;
+    ExportRec m_rec;
+    int m_seq;
+};
+
 ExportThread::ExportThread(const ExportSettings& settings, const QVector<ExportRec>& outpaths,
-                           const QString& export_dir, QObject *parent): QThread(parent),
+                           const QString& export_dir, const ReprocessTaskFactory& reprocess_tasks,
+                           QObject *parent): QThread(parent),
     m_settings(settings),
     m_outpaths_vector(outpaths),
     m_export_dir(export_dir),
-    m_interrupted(false)
+    m_reprocessTasks(reprocess_tasks),
+    m_interrupted(false),
+    m_nextPdfPage(0),
+    m_pdfWriteFailed(false)
 {
 }
 
 bool
 ExportThread::isCancelRequested()
 {
+    QMutexLocker const locker(&m_cancelMutex);
     if (!m_interrupted && isInterruptionRequested()) {
         m_interrupted = true;
         emit exportCanceled();
@@ -53,162 +90,291 @@ ExportThread::isCancelRequested()
 void
 ExportThread::run()
 {
+    TraceRecorder::Span const trace_span("export");
+
+    // Exporting reads the output files back.
+    OutputWriteQueue::waitForAll();
+
     QDir dir;
     dir.mkdir(m_export_dir);
 
-    const QString text_dir = m_export_dir + QDir::separator() + "txt";  //folder for foreground subscans
-    const QString pic_dir  = m_export_dir + QDir::separator() + "pic";  //folder for background subscans
-    const QString mask_dir = m_export_dir + QDir::separator() + "mask"; //folder for zones info
+    m_text_dir = m_export_dir + QDir::separator() + "txt";  //folder for foreground subscans
+    m_pic_dir  = m_export_dir + QDir::separator() + "pic";  //folder for background subscans
+    m_mask_dir = m_export_dir + QDir::separator() + "mask"; //folder for zones info
     const QString zone_dir = m_export_dir + QDir::separator() + "zone"; //folder for zones info
 
+    const bool separate_files = !m_settings.export_to_multipage && !m_settings.export_to_mrc_pdf;
+
     if (m_settings.mode != exporting::ExportMode::None) {
-        if (m_settings.mode.testFlag(exporting::ExportMode::Foreground) && !m_settings.export_to_multipage) {
-            dir.mkdir(text_dir);
+        if (m_settings.mode.testFlag(exporting::ExportMode::Foreground) && separate_files) {
+            dir.mkdir(m_text_dir);
         }
-        if (m_settings.mode.testFlag(ExportMode::Background) && !m_settings.export_to_multipage) {
-            dir.mkdir(pic_dir);
+        if (m_settings.mode.testFlag(ExportMode::Background) && separate_files) {
+            dir.mkdir(m_pic_dir);
         }
         if ( (m_settings.mode.testFlag(ExportMode::Mask) || m_settings.mode.testFlag(ExportMode::AutoMask))
-                && !m_settings.export_to_multipage) {
-            dir.mkdir(mask_dir);
+                && separate_files) {
+            dir.mkdir(m_mask_dir);
         }
         if (m_settings.mode.testFlag(ExportMode::Zones)) {
             dir.mkdir(zone_dir);
         }
     }
 
-    bool need_reprocess = m_settings.mode.testFlag(ExportMode::Foreground) &&
+    if (m_settings.export_to_mrc_pdf) {
+        const QString pdf_path = m_export_dir + QDir::separator() + "export.pdf";
+        m_ptrPdfWriter.reset(new MrcPdfWriter);
+        if (!m_ptrPdfWriter->open(pdf_path)) {
+            m_ptrPdfWriter.reset();
+            emit error(tr("Can't write") + " \"" + pdf_path + "\".");
+            return;
+        }
+    }
+
+    // Every page goes to its own set of files, so pages are independent.
+    // The pool size bounds the number of pages held in memory at once.
+    // PDF pages are compressed by the pool threads as well, and only
+    // written in order.
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+    for (int i = 0; i < m_outpaths_vector.size(); ++i) {
+        pool.start(new PageExporter(*this, m_outpaths_vector[i], i));
+    }
+    pool.waitForDone();
+
+    if (isCancelRequested()) {
+        m_ptrPdfWriter.reset(); // Removes the incomplete file.
+        return;
+    }
+
+    if (m_ptrPdfWriter) {
+        if (m_pdfWriteFailed || !m_ptrPdfWriter->close()) {
+            emit error(tr("Failed to write the PDF file."));
+        }
+        m_ptrPdfWriter.reset();
+    }
+
+    emit exportCompleted();
+}
+
+void
+ExportThread::reprocess(const PageId& page_id, QImage* fore_subscan,
+                        QImage* out_img, BinaryImage* automask)
+{
+    BackgroundTaskPtr const task(
+        m_reprocessTasks.createTask(page_id, fore_subscan, out_img, automask)
+    );
+    if (task) {
+        (*task)();
+    }
+}
+
+void
+ExportThread::submitPdfPage(int seq, const MrcPdfWriter::Page& page)
+{
+    QMutexLocker const locker(&m_pdfMutex);
+    m_pendingPdfPages[seq] = page;
+
+    std::map<int, MrcPdfWriter::Page>::iterator it;
+    while ((it = m_pendingPdfPages.find(m_nextPdfPage)) != m_pendingPdfPages.end()) {
+        if (!m_pdfWriteFailed && !m_ptrPdfWriter->writePage(it->second)) {
+            m_pdfWriteFailed = true;
+        }
+        m_pendingPdfPages.erase(it);
+        ++m_nextPdfPage;
+    }
+}
+
+MrcPdfWriter::Page
+ExportThread::encodeMrcPage(QImage& out_img) const
+{
+    QImage foreground;
+    QImage background;
+    bool only_bw = true;
+
+    if (out_img.format() == QImage::Format_Mono) {
+        foreground = out_img;
+    } else {
+        if (out_img.format() != QImage::Format_Indexed8
+                && out_img.format() != QImage::Format_RGB32
+                && out_img.format() != QImage::Format_ARGB32) {
+            out_img = out_img.convertToFormat(QImage::Format_RGB32);
+        }
+        if (out_img.format() == QImage::Format_Indexed8) {
+            only_bw = ImageSplitOps::GenerateSubscans<uint8_t>(out_img, &foreground, &background, nullptr, false, nullptr);
+        } else {
+            only_bw = ImageSplitOps::GenerateSubscans<uint32_t>(out_img, &foreground, &background, nullptr, false, nullptr);
+        }
+    }
+
+    if (only_bw) {
+        // The background would be blank.
+        background = QImage();
+    }
+
+    return MrcPdfWriter::encodePage(foreground, background, 75, m_settings.mrc_pdf_jbig2);
+}
+
+void
+ExportThread::exportPage(const ExportRec& rec, MrcPdfWriter::Page* pdf_page)
+{
+    // The original color foreground doesn't fit into a bilevel layer.
+    bool need_reprocess = !pdf_page && m_settings.mode.testFlag(ExportMode::Foreground) &&
             m_settings.page_gen_tweaks.testFlag(PageGenTweak::KeepOriginalColorIllumForeSubscans);
     const bool keep_orig = need_reprocess;
-    if (!need_reprocess) {
+    if (!need_reprocess && !pdf_page) {
         need_reprocess = m_settings.mode.testFlag(ExportMode::WholeImage) &&
                 m_settings.page_gen_tweaks.testFlag(PageGenTweak::IgnoreOutputProcessingStage);
     }
 
-    for (const ExportRec& rec : qAsConst(m_outpaths_vector)) {
+    const bool generate_output = m_settings.page_gen_tweaks.testFlag(PageGenTweak::GenerateOutput) ||
+            (m_settings.mode.testFlag(ExportMode::AutoMask) && rec.automask_stale);
 
-        if (isCancelRequested()) {
-            return;
-        }
+    QImage out_img;
+    BinaryImage automask_img;
+    QImage orig_fore_subscan;
 
-        if (need_reprocess) {
-            m_paused.lock();
-            // ask main thread to reprocess the image
-            emit needReprocess(rec.page_id, &m_orig_fore_subscan);
-            m_wait.wait(&m_paused);
-            m_paused.unlock();
-        }
+    if (generate_output) {
+        reprocess(rec.page_id, nullptr, &out_img, &automask_img);
+    }
 
-        if (isCancelRequested()) {
-            return;
-        }
+    if (need_reprocess && !isCancelRequested()) {
+        reprocess(rec.page_id, &orig_fore_subscan);
+    }
+
+    if (isCancelRequested()) {
+        return;
+    }
 
-        const QString out_file_path = rec.filename;
-        QString st_num = QString::number(rec.page_no);
-        const QString name = QString().fill('0', std::max(0, 4 - st_num.length())) + st_num;
+    const QString out_file_path = rec.filename;
+    QString st_num = QString::number(rec.page_no);
+    const QString name = QString().fill('0', std::max(0, 4 - st_num.length())) + st_num;
 
+    if (!generate_output) {
         if (!QFile().exists(out_file_path)) {
             emit error(tr("The file") + " \"" + out_file_path + "\" " + tr("is not found") + ".");
-            exit(-1);
+            return;
         }
 
-        QImage out_img = ImageLoader::load(out_file_path);
+        out_img = ImageLoader::load(out_file_path);
+    } else if (out_img.isNull()) {
+        emit error(tr("Failed to generate the output for") + " \"" + out_file_path + "\".");
+        return;
+    }
 
-        QString out_file_path_no_split = m_export_dir + QDir::separator() + name + ".tif";
+    QString out_file_path_no_split = m_export_dir + QDir::separator() + name + ".tif";
 
-        if (m_settings.mode.testFlag(ExportMode::Zones)) {
-            const QStringList& zones_info = rec.zones_info;
-            QString out_zone_file = m_export_dir + QDir::separator() + "zone" + QDir::separator() + name + ".tsv";
-            if (!zones_info.isEmpty()) {
-                QFile f(out_zone_file);
-                if (f.open(QIODevice::WriteOnly)) {
-                    f.write(zones_info.join("\n").toStdString().c_str());
-                    f.close();
-                }
-            } else if (QFile::exists(out_zone_file)) {
-                QFile::remove(out_zone_file);
+    if (m_settings.mode.testFlag(ExportMode::Zones)) {
+        const QStringList& zones_info = rec.zones_info;
+        QString out_zone_file = m_export_dir + QDir::separator() + "zone" + QDir::separator() + name + ".tsv";
+        if (!zones_info.isEmpty()) {
+            QFile f(out_zone_file);
+            if (f.open(QIODevice::WriteOnly)) {
+                f.write(zones_info.join("\n").toStdString().c_str());
+                f.close();
             }
+        } else if (QFile::exists(out_zone_file)) {
+            QFile::remove(out_zone_file);
         }
+    }
 
-        std::unique_ptr<QImage> img_foreground(m_settings.mode.testFlag(ExportMode::Foreground) ? new QImage() : nullptr);
-        std::unique_ptr<QImage> img_background(m_settings.mode.testFlag(ExportMode::Background) ? new QImage() : nullptr);
-        std::unique_ptr<QImage> img_mask(m_settings.mode.testFlag(ExportMode::Mask) ? new QImage() : nullptr);
+    if (pdf_page) {
+        *pdf_page = encodeMrcPage(out_img);
+        if (pdf_page->isNull()) {
+            emit error(tr("Failed to compress") + " \"" + out_file_path + "\".");
+        } else {
+            emit imageProcessed();
+        }
+        return;
+    }
 
-        bool only_bw = true;
+    std::unique_ptr<QImage> img_foreground(m_settings.mode.testFlag(ExportMode::Foreground) ? new QImage() : nullptr);
+    std::unique_ptr<QImage> img_background(m_settings.mode.testFlag(ExportMode::Background) ? new QImage() : nullptr);
+    std::unique_ptr<QImage> img_mask(m_settings.mode.testFlag(ExportMode::Mask) ? new QImage() : nullptr);
 
-        if (out_img.format() == QImage::Format_Indexed8) {
-            only_bw = ImageSplitOps::GenerateSubscans<uint8_t>(out_img, img_foreground.get(), img_background.get(), img_mask.get(), keep_orig, keep_orig ? &m_orig_fore_subscan : nullptr);
-        } else if (out_img.format() == QImage::Format_RGB32 || out_img.format() == QImage::Format_ARGB32) {
-            only_bw = ImageSplitOps::GenerateSubscans<uint32_t>(out_img, img_foreground.get(), img_background.get(), img_mask.get(), keep_orig, keep_orig ? &m_orig_fore_subscan : nullptr);
-        } else if (out_img.format() == QImage::Format_Mono) {
-            if (img_foreground) {
-                *img_foreground = out_img;
-            }
-            if (img_background && m_settings.generate_blank_back_subscans) {
-                *img_background = ImageSplitOps::GenerateBlankImage(out_img, out_img.format());
-            } else {
-                img_background.reset(nullptr);
-            }
-            if (img_mask) {
-                *img_mask = ImageSplitOps::GenerateBlankImage(out_img, out_img.format(), 0x00000000);
-            }
+    bool only_bw = true;
 
+    if (out_img.format() == QImage::Format_Indexed8) {
+        only_bw = ImageSplitOps::GenerateSubscans<uint8_t>(out_img, img_foreground.get(), img_background.get(), img_mask.get(), keep_orig, keep_orig ? &orig_fore_subscan : nullptr);
+    } else if (out_img.format() == QImage::Format_RGB32 || out_img.format() == QImage::Format_ARGB32) {
+        only_bw = ImageSplitOps::GenerateSubscans<uint32_t>(out_img, img_foreground.get(), img_background.get(), img_mask.get(), keep_orig, keep_orig ? &orig_fore_subscan : nullptr);
+    } else if (out_img.format() == QImage::Format_Mono) {
+        if (img_foreground) {
+            *img_foreground = out_img;
+        }
+        if (img_background && m_settings.generate_blank_back_subscans) {
+            *img_background = ImageSplitOps::GenerateBlankImage(out_img, out_img.format());
+        } else {
+            img_background.reset(nullptr);
+        }
+        if (img_mask) {
+            *img_mask = ImageSplitOps::GenerateBlankImage(out_img, out_img.format(), 0x00000000);
         }
 
-        int page_no = 0;
+    }
 
-        if (m_settings.mode.testFlag(ExportMode::WholeImage)) {
-            TiffWriter::writeImage(out_file_path_no_split,
-                                   m_settings.page_gen_tweaks.testFlag(PageGenTweak::IgnoreOutputProcessingStage) ? m_orig_fore_subscan : out_img,
-                                   m_settings.export_to_multipage, page_no);
-            if (m_settings.export_to_multipage) {
-                page_no++;
-            }
+    int page_no = 0;
+
+    if (m_settings.mode.testFlag(ExportMode::WholeImage)) {
+        TiffWriter::writeImage(out_file_path_no_split,
+                               m_settings.page_gen_tweaks.testFlag(PageGenTweak::IgnoreOutputProcessingStage) ? orig_fore_subscan : out_img,
+                               m_settings.export_to_multipage, page_no);
+        if (m_settings.export_to_multipage) {
+            page_no++;
         }
+    }
 
-        if (img_foreground) {
-            QString out_filepath_foreground = text_dir + QDir::separator() + name + ".tif";
-            TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_foreground,
-                                   *img_foreground,
-                                   m_settings.export_to_multipage,
-                                   page_no++
-                                   );
-        }
-        if (img_background && (!only_bw || m_settings.generate_blank_back_subscans)) {
-            QString out_filepath_background = m_settings.use_sep_suffix_for_pics ? ".sep.tif" : ".tif";
-            out_filepath_background = pic_dir + QDir::separator() + name + out_filepath_background;
-            TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_background,
-                                   *img_background,
-                                   m_settings.export_to_multipage,
-                                   page_no++);
-        }
-
-        if (m_settings.mode.testFlag(ExportMode::AutoMask)) {
-            QFileInfo fi(rec.filename);
-            QString filepath_automask = fi.path() + "/cache/automask/" + fi.fileName();
-            QImage automask_img = (QFile::exists(filepath_automask)) ? ImageLoader::load(filepath_automask) :
-                                                                       ImageSplitOps::GenerateBlankImage(out_img, out_img.format(), 0x00000000);
-            QString out_filepath_mask = mask_dir + QDir::separator() + name + ".auto.tif";
-            TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_mask,
-                                   automask_img,
-                                   m_settings.export_to_multipage,
-                                   page_no);
-            if (m_settings.export_to_multipage) {
-                page_no++;
+    if (img_foreground) {
+        QString out_filepath_foreground = m_text_dir + QDir::separator() + name + ".tif";
+        TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_foreground,
+                               *img_foreground,
+                               m_settings.export_to_multipage,
+                               page_no++
+                               );
+    }
+    if (img_background && (!only_bw || m_settings.generate_blank_back_subscans)) {
+        QString out_filepath_background = m_settings.use_sep_suffix_for_pics ? ".sep.tif" : ".tif";
+        out_filepath_background = m_pic_dir + QDir::separator() + name + out_filepath_background;
+        TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_background,
+                               *img_background,
+                               m_settings.export_to_multipage,
+                               page_no++);
+    }
+
+    if (m_settings.mode.testFlag(ExportMode::AutoMask)) {
+        QImage automask;
+        if (generate_output) {
+            automask = automask_img.isNull() ? ImageSplitOps::GenerateBlankImage(out_img, out_img.format(), 0x00000000) :
+                                               automask_img.toQImage();
+        } else {
+            // Written by the output stage, so there is no need
+            // to derive it from the output image again.
+            if (!rec.automask_filename.isEmpty()) {
+                automask = ImageLoader::load(rec.automask_filename);
+            }
+            if (automask.isNull() || automask.size() != out_img.size()) {
+                automask = ImageSplitOps::GenerateBlankImage(out_img, out_img.format(), 0x00000000);
             }
         }
-
-        if (img_mask) {
-            QString out_filepath_mask = mask_dir + QDir::separator() + name + ".tif";
-            TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_mask,
-                                   *img_mask,
-                                   m_settings.export_to_multipage,
-                                   page_no++);
+        QString out_filepath_mask = m_mask_dir + QDir::separator() + name + ".auto.tif";
+        TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_mask,
+                               automask,
+                               m_settings.export_to_multipage,
+                               page_no);
+        if (m_settings.export_to_multipage) {
+            page_no++;
         }
+    }
 
-        emit imageProcessed();
+    if (img_mask) {
+        QString out_filepath_mask = m_mask_dir + QDir::separator() + name + ".tif";
+        TiffWriter::writeImage(m_settings.export_to_multipage ? out_file_path_no_split : out_filepath_mask,
+                               *img_mask,
+                               m_settings.export_to_multipage,
+                               page_no++);
     }
-    emit exportCompleted();
+
+    emit imageProcessed();
 }
 
 }
@@ -22,10 +22,18 @@
 
 #include <QThread>
 #include <QMutex>
-#include <QWaitCondition>
 #include <QImage>
+#include "ReprocessTaskFactory.h"
 #include "PageId.h"
 #include "ExportSettings.h"
+#include "MrcPdfWriter.h"
+#include <map>
+#include <memory>
+
+namespace imageproc
+{
+class BinaryImage;
+}
 
 namespace exporting {
 
@@ -38,33 +46,85 @@ public:
         PageId page_id;
         QString filename;
         QStringList zones_info;
+        /**
+         * \brief The automask written along with the output file.
+         *
+         * Only set up for ExportMode::AutoMask when the output isn't
+         * generated as part of the export.  Empty if the page has no
+         * automask.  If automask_stale is set, the output and automask
+         * files are outdated, and the page is reprocessed.
+         */
+        QString automask_filename;
+        bool automask_stale = false;
     };
 
+    /**
+     * \param reprocess_tasks Creates the tasks for pages that are
+     *        reprocessed as part of the export.  That happens on the
+     *        export workers, without involving the main thread.
+     */
     ExportThread(const ExportSettings& settings, const QVector<ExportRec>& outpaths,
-                 const QString& export_dir, QObject *parent = nullptr);
+                 const QString& export_dir, const ReprocessTaskFactory& reprocess_tasks,
+                 QObject *parent = nullptr);
     ~ExportThread() { requestInterruption(); }
 
     void run() override;
-
-    void continueExecution() { m_wait.wakeAll(); }
 public Q_SLOTS:
     void cancel() { requestInterruption(); };
 Q_SIGNALS:
     void imageProcessed();
     void exportCanceled();
     void exportCompleted();
-    void needReprocess(const PageId& page_id, QImage* fore_subscan);
     void error(const QString& errorStr);
 private:
+    class PageExporter;
+
     bool isCancelRequested();
+
+    /**
+     * \brief Puts a page through all of the filters on the calling thread.
+     *
+     * \param fore_subscan Receives the original foreground subscan.
+     *        If null, the regular output is generated and goes to
+     *        \p out_img and \p automask instead, so we don't have
+     *        to load it back from disk.
+     */
+    void reprocess(const PageId& page_id, QImage* fore_subscan,
+                   QImage* out_img = nullptr, imageproc::BinaryImage* automask = nullptr);
+
+    /**
+     * \brief Exports a single page.  Called from pool threads.
+     *
+     * \param pdf_page Receives the compressed page when exporting
+     *        to an MRC PDF, in which case no TIFF files are written.
+     */
+    void exportPage(const ExportRec& rec, MrcPdfWriter::Page* pdf_page);
+
+    MrcPdfWriter::Page encodeMrcPage(QImage& out_img) const;
+
+    /**
+     * \brief Hands over the page with index \p seq in the export order.
+     *
+     * Pages complete out of order, but go into the PDF in order, so
+     * those that come early are held until it's their turn.
+     * Null pages, standing for failed ones, only advance the order.
+     */
+    void submitPdfPage(int seq, const MrcPdfWriter::Page& page);
 private:
     ExportSettings m_settings;
     QVector<ExportRec> m_outpaths_vector;
     QString m_export_dir;
-    QMutex m_paused;
-    QWaitCondition m_wait;
-    QImage m_orig_fore_subscan;
+    ReprocessTaskFactory m_reprocessTasks;
+    QString m_text_dir;
+    QString m_pic_dir;
+    QString m_mask_dir;
+    QMutex m_cancelMutex;
     bool m_interrupted;
+    std::unique_ptr<MrcPdfWriter> m_ptrPdfWriter;
+    QMutex m_pdfMutex;
+    std::map<int, MrcPdfWriter::Page> m_pendingPdfPages;
+    int m_nextPdfPage;
+    bool m_pdfWriteFailed;
 };
 
 }
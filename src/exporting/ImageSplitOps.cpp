@@ -18,9 +18,67 @@
 */
 
 #include "ImageSplitOps.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace exporting {
 
+#ifdef __SSE2__
+/**
+ * movemask produces the first pixel in the lowest bit,
+ * while Format_Mono wants it in the highest one.
+ */
+static inline uchar reverseBits(unsigned bits)
+{
+    bits = ((bits & 0xF0) >> 4) | ((bits & 0x0F) << 4);
+    bits = ((bits & 0xCC) >> 2) | ((bits & 0x33) << 2);
+    bits = ((bits & 0xAA) >> 1) | ((bits & 0x55) << 1);
+    return static_cast<uchar>(bits);
+}
+#endif
+
+void ImageSplitOps::classifyPixels(uint8_t const* pixels, int count, uchar* black, uchar* white)
+{
+    int x = 0;
+#ifdef __SSE2__
+    __m128i const black_pixels = _mm_setzero_si128();
+    __m128i const white_pixels = _mm_set1_epi8(char(0xFF));
+    for (; x + 16 <= count; x += 16) {
+        __m128i const px = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels + x));
+        unsigned const b = _mm_movemask_epi8(_mm_cmpeq_epi8(px, black_pixels));
+        unsigned const w = _mm_movemask_epi8(_mm_cmpeq_epi8(px, white_pixels));
+        black[x >> 3] = reverseBits(b & 0xFF);
+        black[(x >> 3) + 1] = reverseBits(b >> 8);
+        white[x >> 3] = reverseBits(w & 0xFF);
+        white[(x >> 3) + 1] = reverseBits(w >> 8);
+    }
+#endif
+    classifyRemainingPixels(pixels, x, count, black, white);
+}
+
+void ImageSplitOps::classifyPixels(uint32_t const* pixels, int count, uchar* black, uchar* white)
+{
+    int x = 0;
+#ifdef __SSE2__
+    __m128i const rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+    __m128i const black_pixels = _mm_setzero_si128();
+    for (; x + 8 <= count; x += 8) {
+        __m128i const px0 = _mm_and_si128(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels + x)), rgb_mask);
+        __m128i const px1 = _mm_and_si128(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels + x + 4)), rgb_mask);
+        unsigned const b = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(px0, black_pixels)))
+                           | (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(px1, black_pixels))) << 4);
+        unsigned const w = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(px0, rgb_mask)))
+                           | (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(px1, rgb_mask))) << 4);
+        black[x >> 3] = reverseBits(b);
+        white[x >> 3] = reverseBits(w);
+    }
+#endif
+    classifyRemainingPixels(pixels, x, count, black, white);
+}
+
 void ImageSplitOps::initSplitImage(const QImage& source_img, QImage& target_img, QImage::Format format, bool grayscale_allowed)
 {
     target_img = QImage(source_img.width(), source_img.height(), format);
@@ -21,6 +21,8 @@
 #define IMAGESPLITOPS_H
 
 #include <QImage>
+#include <algorithm>
+#include <stdint.h>
 
 namespace exporting {
 
@@ -53,103 +55,163 @@ public:
     //        mask_img->fill(0x00000000);
         }
 
-        MixedPixel* source_line = reinterpret_cast<MixedPixel*>(source_img.bits());
+        MixedPixel const* const source_data = reinterpret_cast<MixedPixel const*>(source_img.constBits());
         int const source_stride = source_img.bytesPerLine() / sizeof(MixedPixel);
 
-        MixedPixel* foreground_orig_line = nullptr;
-        int foreground_orig_stride = 0;
-        uchar* foreground_mono_line = nullptr;
-        int foreground_mono_stride = 0;
+        MixedPixel* foreground_orig_data = nullptr;
+        uchar* foreground_mono_data = nullptr;
+        int foreground_stride = 0;
         if (foreground_img) {
-            foreground_orig_line = reinterpret_cast<MixedPixel*>(foreground_img->bits());
-            foreground_orig_stride = foreground_img->bytesPerLine() / sizeof(MixedPixel);
-            foreground_mono_line = foreground_img->bits();
-            foreground_mono_stride = foreground_img->bytesPerLine();
+            // In bytes, for both formats.
+            foreground_stride = foreground_img->bytesPerLine();
+            if (keep_orig_fore_subscan) {
+                foreground_orig_data = reinterpret_cast<MixedPixel*>(foreground_img->bits());
+            } else {
+                foreground_mono_data = foreground_img->bits();
+            }
         }
 
-        uchar* mask_mono_line = nullptr;
-        int  mask_mono_stride = 0;
-        if (mask_img) {
-            mask_mono_line = mask_img->bits();
-            mask_mono_stride = mask_img->bytesPerLine();
-        }
+        uchar* const mask_mono_data = mask_img ? mask_img->bits() : nullptr;
+        int const mask_mono_stride = mask_img ? mask_img->bytesPerLine() : 0;
 
-        MixedPixel* background_line = nullptr;
-        int background_stride = 0;
-        if (background_img) {
-            background_line = reinterpret_cast<MixedPixel*>(background_img->bits());
-            background_stride = background_img->bytesPerLine() / sizeof(MixedPixel);
-        }
+        MixedPixel* const background_data = background_img
+                ? reinterpret_cast<MixedPixel*>(background_img->bits()) : nullptr;
+        int const background_stride = background_img
+                ? background_img->bytesPerLine() / (int)sizeof(MixedPixel) : 0;
 
-        MixedPixel* source_orig_line = nullptr;
+        MixedPixel const* source_orig_data = nullptr;
         int source_orig_stride = 0;
         if (keep_orig_fore_subscan) {
-            source_orig_line = reinterpret_cast<MixedPixel*>(p_orig_fore_subscan->bits());
+            source_orig_data = reinterpret_cast<MixedPixel const*>(p_orig_fore_subscan->constBits());
             source_orig_stride = p_orig_fore_subscan->bytesPerLine() / sizeof(MixedPixel);
         }
 
+        int const width = source_img.width();
+        int const height = source_img.height();
+        bool only_bw = true;
+
+        // Lines are independent of each other.
+        #pragma omp parallel for schedule(static) reduction(&&: only_bw)
+        for (int y = 0; y < height; ++y) {
+            MixedPixel* const foreground_orig_line = foreground_orig_data
+                    ? reinterpret_cast<MixedPixel*>(reinterpret_cast<uchar*>(foreground_orig_data) + y * foreground_stride)
+                    : nullptr;
+            bool const line_bw = splitLine(
+                width, source_data + y * source_stride,
+                source_orig_data ? source_orig_data + y * source_orig_stride : nullptr,
+                foreground_orig_line,
+                foreground_mono_data ? foreground_mono_data + y * foreground_stride : nullptr,
+                background_data ? background_data + y * background_stride : nullptr,
+                mask_mono_data ? mask_mono_data + y * mask_mono_stride : nullptr
+            );
+            only_bw = only_bw && line_bw;
+        }
+
+        return only_bw;
+    }
+private:
+    /**
+     * \brief Classifies up to 32 pixels as pure black or pure white.
+     *
+     * Sets a bit in \p black or \p white for each pixel that is pure black
+     * or pure white, ignoring alpha, in the bit order of Format_Mono.
+     * (count + 7) / 8 bytes are written, with bits past \p count cleared.
+     */
+    static void classifyPixels(uint8_t const* pixels, int count, uchar* black, uchar* white);
+
+    static void classifyPixels(uint32_t const* pixels, int count, uchar* black, uchar* white);
+
+    template<typename MixedPixel>
+    static void classifyPixels(MixedPixel const* pixels, int count, uchar* black, uchar* white)
+    {
+        classifyRemainingPixels(pixels, 0, count, black, white);
+    }
+
+    /**
+     * \brief The portable part of classifyPixels(), starting at pixel \p from,
+     *        which must be a multiple of 8.
+     */
+    template<typename MixedPixel>
+    static void classifyRemainingPixels(
+        MixedPixel const* pixels, int from, int count, uchar* black, uchar* white)
+    {
+        const MixedPixel mask_pixel = static_cast<MixedPixel>((uint32_t) 0x00ffffff);
+
+        for (int i = from >> 3; i < (count + 7) >> 3; ++i) {
+            black[i] = 0;
+            white[i] = 0;
+        }
+        for (int x = from; x < count; ++x) {
+            //this line of code was suggested by Tulon:
+            MixedPixel const masked = pixels[x] & mask_pixel;
+            uchar const bit = 0x80 >> (x & 7);
+            if (masked == 0) {
+                black[x >> 3] |= bit;
+            } else if (masked == mask_pixel) {
+                white[x >> 3] |= bit;
+            }
+        }
+    }
+
+    /**
+     * \brief Splits a line of the source image.
+     *
+     * Pure black and pure white pixels go to the foreground, everything
+     * else to the background.  Mono lines are written a byte at a time
+     * from the classification of 32 pixels.  Any of the output lines may
+     * be null.
+     *
+     * \return true if the line only has pure black and pure white pixels.
+     */
+    template<typename MixedPixel>
+    static bool splitLine(int width, MixedPixel const* source, MixedPixel const* source_orig,
+                          MixedPixel* foreground_orig, uchar* foreground_mono,
+                          MixedPixel* background, uchar* mask_mono)
+    {
         const MixedPixel white_pixel = static_cast<MixedPixel>((uint32_t) 0xffffffff);
         const MixedPixel mask_pixel = static_cast<MixedPixel>((uint32_t) 0x00ffffff);
 
         bool only_bw = true;
-
-        for (int y = 0; y < source_img.height(); ++y) {
-            for (int x = 0; x < source_img.width(); ++x) {
-                //this line of code was suggested by Tulon:
-                if ((source_line[x] & mask_pixel) == 0 || (source_line[x] & mask_pixel) == mask_pixel) {
-                    // source_line[x] is pure black or pure white
-                    if (keep_orig_fore_subscan && foreground_orig_line) {
-                        foreground_orig_line[x] = source_orig_line[x];
-                    } else if (!keep_orig_fore_subscan && foreground_mono_line) {
-                        uint8_t value1 = static_cast<uint8_t>(source_line[x]);
-                        // BW SetPixel from http://djvu-soft.narod.ru/bookscanlib/023.htm
-                        // set white or black bit to mono image
-                        value1 ? foreground_mono_line[x >> 3] |= (0x80 >> (x & 0x7)) : foreground_mono_line[x >> 3] &= (0xFF7F >> (x & 0x7));
-                    }
-
-                    if (background_line) {
-                        background_line[x] = white_pixel;
-                    }
-
-                    if (mask_mono_line) {
-    //                    uint8_t value1 = static_cast<uint8_t>(source_line[x]);
-                        /*!value1 ? mask_mono_line[x >> 3] |= (0x80 >> (x & 0x7)) : */mask_mono_line[x >> 3] &= (0xFF7F >> (x & 0x7));
-                    }
-
-                } else {
+        uchar black[4];
+        uchar white[4];
+
+        for (int x0 = 0; x0 < width; x0 += 32) {
+            int const count = std::min(32, width - x0);
+            classifyPixels(source + x0, count, black, white);
+
+            int const num_bytes = (count + 7) >> 3;
+            for (int i = 0; i < num_bytes; ++i) {
+                // Bits past the end of the line are left as they are.
+                uchar const keep = (i == num_bytes - 1) ? uchar(0xFF >> (((count - 1) & 7) + 1)) : 0;
+                uchar const bw = black[i] | white[i];
+                if ((bw | keep) != 0xFF) {
                     only_bw = false;
-                    // non-BW
-                    if (keep_orig_fore_subscan && foreground_orig_line) {
-                        foreground_orig_line[x] = white_pixel;
-                    } else if (!keep_orig_fore_subscan && foreground_mono_line) {
-                        // set white bit to mono image
-                        foreground_mono_line[x >> 3] |= (0x80 >> (x & 0x7));
-                    }
-
-                    if (background_line) {
-                        background_line[x] = source_line[x];
-                    }
-
-                    if (mask_mono_line) {
-                        mask_mono_line[x >> 3] |= (0x80 >> (x & 0x7)); //white
-                    }
+                }
+                uchar* const fore_byte = foreground_mono ? foreground_mono + (x0 >> 3) + i : nullptr;
+                if (fore_byte) {
+                    // Black stays black, everything else becomes white.
+                    *fore_byte = (*fore_byte & keep) | (uchar(~black[i]) & ~keep);
+                }
+                uchar* const mask_byte = mask_mono ? mask_mono + (x0 >> 3) + i : nullptr;
+                if (mask_byte) {
+                    // White where the background shows through.
+                    *mask_byte = (*mask_byte & keep) | (uchar(~bw) & ~keep);
                 }
             }
+        }
 
-            source_line += source_stride;
-            if (background_line) {
-                background_line += background_stride;
+        if (background) {
+            for (int x = 0; x < width; ++x) {
+                MixedPixel const masked = source[x] & mask_pixel;
+                bool const bw = (masked == 0) | (masked == mask_pixel);
+                background[x] = bw ? white_pixel : source[x];
             }
-            if (mask_mono_line) {
-                mask_mono_line += mask_mono_stride;
-            }
-            if (keep_orig_fore_subscan) {
-                if (foreground_orig_line) {
-                    foreground_orig_line += foreground_orig_stride;
-                }
-                source_orig_line += source_orig_stride;
-            } else if (foreground_mono_line) {
-                foreground_mono_line += foreground_mono_stride;
+        }
+        if (foreground_orig) {
+            for (int x = 0; x < width; ++x) {
+                MixedPixel const masked = source[x] & mask_pixel;
+                bool const bw = (masked == 0) | (masked == mask_pixel);
+                foreground_orig[x] = bw ? source_orig[x] : white_pixel;
             }
         }
 
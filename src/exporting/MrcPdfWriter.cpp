@@ -0,0 +1,240 @@
+/*
+    Scan Tailor Universal - Interactive post-processing tool for scanned
+    pages. A fork of Scan Tailor by Joseph Artsimovich.
+    Copyright (C) 2020 Alexander Trufanov <trufanovan@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MrcPdfWriter.h"
+#include <QBuffer>
+#include <QImage>
+#include "Dpm.h"
+#include "JpegWriter.h"
+#include "TiffWriter.h"
+#include "imageproc/Constants.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/Jbig2Encoder.h"
+
+namespace exporting {
+
+MrcPdfWriter::Page
+MrcPdfWriter::encodePage(QImage const& foreground, QImage const& background,
+                         int const jpeg_quality, bool const jbig2_foreground)
+{
+    Page page;
+    QImage const& base = foreground.isNull() ? background : foreground;
+    if (base.isNull()) {
+        return page;
+    }
+
+    // Pixels to points.  The DPI of the image decides the page size.
+    Dpm const dpm(base);
+    double const dpi_x = dpm.isNull() ? 300.0 : dpm.horizontal() * imageproc::constants::DPM2DPI;
+    double const dpi_y = dpm.isNull() ? 300.0 : dpm.vertical() * imageproc::constants::DPM2DPI;
+    page.sizeInPoints = QSizeF(base.width() * 72.0 / dpi_x, base.height() * 72.0 / dpi_y);
+
+    if (!foreground.isNull()) {
+        if (jbig2_foreground) {
+            page.foreground = imageproc::Jbig2Encoder::encodeEmbedded(
+                                  imageproc::BinaryImage(foreground)
+                              );
+            page.jbig2Foreground = true;
+        } else if (!TiffWriter::encodeCcittG4(foreground, page.foreground)) {
+            return Page();
+        }
+        page.foregroundSize = foreground.size();
+    }
+
+    if (!background.isNull()) {
+        QBuffer buffer(&page.background);
+        if (!buffer.open(QIODevice::WriteOnly)
+                || !JpegWriter::writeImage(buffer, background, jpeg_quality)) {
+            return Page();
+        }
+        page.backgroundSize = background.size();
+        page.grayscaleBackground = JpegWriter::writesGrayscale(background);
+    }
+
+    return page;
+}
+
+MrcPdfWriter::MrcPdfWriter()
+    : m_pagesObject(0),
+      m_opened(false),
+      m_ok(false),
+      m_closed(false)
+{
+}
+
+MrcPdfWriter::~MrcPdfWriter()
+{
+    if (m_opened && !m_closed) {
+        // An incomplete file is of no use.
+        m_file.close();
+        m_file.remove();
+    }
+}
+
+bool
+MrcPdfWriter::open(QString const& file_path)
+{
+    m_file.setFileName(file_path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    m_opened = true;
+    m_ok = true;
+
+    // The binary comment tells transfer tools the file isn't text.
+    write("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+
+    m_objectOffsets.push_back(0); // Object 0 is always free.
+    int const catalog = reserveObject();
+    m_pagesObject = reserveObject();
+
+    beginObject(catalog);
+    write("<< /Type /Catalog /Pages " + QByteArray::number(m_pagesObject) + " 0 R >>\nendobj\n");
+
+    return m_ok;
+}
+
+bool
+MrcPdfWriter::writePage(Page const& page)
+{
+    if (!m_ok) {
+        return false;
+    }
+    if (page.isNull()) {
+        return true;
+    }
+
+    QByteArray const width_pt(QByteArray::number(page.sizeInPoints.width(), 'f', 2));
+    QByteArray const height_pt(QByteArray::number(page.sizeInPoints.height(), 'f', 2));
+    // Images are painted into the unit square, so scale it to the page.
+    QByteArray const to_page(width_pt + " 0 0 " + height_pt + " 0 0 cm ");
+
+    QByteArray resources;
+    QByteArray content;
+
+    if (!page.background.isEmpty()) {
+        int const obj_num = reserveObject();
+        QByteArray dict("/Width " + QByteArray::number(page.backgroundSize.width()));
+        dict += " /Height " + QByteArray::number(page.backgroundSize.height());
+        dict += page.grayscaleBackground ? " /ColorSpace /DeviceGray" : " /ColorSpace /DeviceRGB";
+        dict += " /BitsPerComponent 8 /Filter /DCTDecode";
+        writeImage(obj_num, dict, page.background);
+        resources += "/Bg " + QByteArray::number(obj_num) + " 0 R ";
+        content += "q " + to_page + "/Bg Do Q\n";
+    }
+
+    if (!page.foreground.isEmpty()) {
+        int const obj_num = reserveObject();
+        QByteArray const columns(QByteArray::number(page.foregroundSize.width()));
+        QByteArray const rows(QByteArray::number(page.foregroundSize.height()));
+        QByteArray dict("/Width " + columns + " /Height " + rows);
+        dict += " /ImageMask true /BitsPerComponent 1";
+        if (page.jbig2Foreground) {
+            // JBIG2 decodes black pixels as 1s, while a stencil mask
+            // paints 0s by default.
+            dict += " /Filter /JBIG2Decode /Decode [1 0]";
+        } else {
+            dict += " /Filter /CCITTFaxDecode";
+            dict += " /DecodeParms << /K -1 /Columns " + columns + " /Rows " + rows + " >>";
+        }
+        writeImage(obj_num, dict, page.foreground);
+        resources += "/Fg " + QByteArray::number(obj_num) + " 0 R ";
+        // A stencil mask paints its black pixels with the fill color.
+        content += "q 0 g " + to_page + "/Fg Do Q\n";
+    }
+
+    int const content_obj = reserveObject();
+    beginObject(content_obj);
+    write("<< /Length " + QByteArray::number(content.size()) + " >>\nstream\n");
+    write(content);
+    write("\nendstream\nendobj\n");
+
+    int const page_obj = reserveObject();
+    beginObject(page_obj);
+    write("<< /Type /Page /Parent " + QByteArray::number(m_pagesObject) + " 0 R");
+    write(" /MediaBox [0 0 " + width_pt + " " + height_pt + "]");
+    write(" /Resources << /XObject << " + resources + ">> >>");
+    write(" /Contents " + QByteArray::number(content_obj) + " 0 R >>\nendobj\n");
+    m_pageObjects.push_back(page_obj);
+
+    return m_ok;
+}
+
+bool
+MrcPdfWriter::close()
+{
+    if (!m_ok) {
+        return false;
+    }
+
+    beginObject(m_pagesObject);
+    write("<< /Type /Pages /Kids [");
+    for (int const page_obj : m_pageObjects) {
+        write(" " + QByteArray::number(page_obj) + " 0 R");
+    }
+    write(" ] /Count " + QByteArray::number((int)m_pageObjects.size()) + " >>\nendobj\n");
+
+    qint64 const xref_offset = m_file.pos();
+    write("xref\n0 " + QByteArray::number((int)m_objectOffsets.size()) + "\n");
+    // Every entry is exactly 20 bytes long.
+    write("0000000000 65535 f \n");
+    for (size_t i = 1; i < m_objectOffsets.size(); ++i) {
+        write(QByteArray::number(m_objectOffsets[i]).rightJustified(10, '0') + " 00000 n \n");
+    }
+    write("trailer\n<< /Size " + QByteArray::number((int)m_objectOffsets.size()));
+    write(" /Root 1 0 R >>\nstartxref\n" + QByteArray::number(xref_offset) + "\n%%EOF\n");
+
+    m_file.close();
+    m_closed = m_ok && m_file.error() == QFile::NoError;
+    return m_closed;
+}
+
+int
+MrcPdfWriter::reserveObject()
+{
+    m_objectOffsets.push_back(0);
+    return int(m_objectOffsets.size()) - 1;
+}
+
+void
+MrcPdfWriter::beginObject(int const obj_num)
+{
+    m_objectOffsets[obj_num] = m_file.pos();
+    write(QByteArray::number(obj_num) + " 0 obj\n");
+}
+
+void
+MrcPdfWriter::writeImage(int const obj_num, QByteArray const& dict, QByteArray const& data)
+{
+    beginObject(obj_num);
+    write("<< /Type /XObject /Subtype /Image " + dict);
+    write(" /Length " + QByteArray::number(data.size()) + " >>\nstream\n");
+    write(data);
+    write("\nendstream\nendobj\n");
+}
+
+void
+MrcPdfWriter::write(QByteArray const& data)
+{
+    if (m_ok && m_file.write(data) != data.size()) {
+        m_ok = false;
+    }
+}
+
+}
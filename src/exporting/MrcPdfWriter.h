@@ -0,0 +1,117 @@
+/*
+    Scan Tailor Universal - Interactive post-processing tool for scanned
+    pages. A fork of Scan Tailor by Joseph Artsimovich.
+    Copyright (C) 2020 Alexander Trufanov <trufanovan@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MRCPDFWRITER_H
+#define MRCPDFWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QSize>
+#include <QSizeF>
+#include <vector>
+#include "NonCopyable.h"
+
+class QImage;
+
+namespace exporting {
+
+/**
+ * \brief Writes mixed raster content pages into a single PDF file.
+ *
+ * Each page is a JPEG background with a CCITT G4 or JBIG2 compressed
+ * bilevel foreground painted over it as a stencil mask.  Pages are encoded by
+ * encodePage(), which can be called from any number of threads, and then
+ * written one by one in page order.  Only the file offsets of the objects
+ * are kept around, so the memory use doesn't grow with the number of pages.
+ */
+class MrcPdfWriter
+{
+    DECLARE_NON_COPYABLE(MrcPdfWriter)
+public:
+    struct Page {
+        QSizeF sizeInPoints;
+        QSize foregroundSize;
+        QByteArray foreground; /**< CCITT G4 or JBIG2, or empty. */
+        QSize backgroundSize;
+        QByteArray background; /**< JPEG, or empty. */
+        bool grayscaleBackground;
+        bool jbig2Foreground;
+
+        Page() : grayscaleBackground(false), jbig2Foreground(false) {}
+
+        bool isNull() const
+        {
+            return foreground.isEmpty() && background.isEmpty();
+        }
+    };
+
+    /**
+     * \brief Compresses the layers of a page.
+     *
+     * \param foreground A bilevel image whose black pixels are painted
+     *        over the background, or a null image.
+     * \param background The background, or a null image.
+     * \param jpeg_quality The quality the background is compressed with.
+     * \param jbig2_foreground Whether to compress the foreground with
+     *        JBIG2 rather than CCITT G4.
+     * \return The compressed page, or a null page on failure.
+     */
+    static Page encodePage(QImage const& foreground, QImage const& background,
+                           int jpeg_quality = 75, bool jbig2_foreground = false);
+
+    MrcPdfWriter();
+
+    /**
+     * Removes the file unless close() succeeded.
+     */
+    ~MrcPdfWriter();
+
+    bool open(QString const& file_path);
+
+    /**
+     * \brief Appends a page to the file.  Null pages are skipped.
+     */
+    bool writePage(Page const& page);
+
+    /**
+     * \brief Writes the page tree and the cross-reference table
+     *        and closes the file.
+     */
+    bool close();
+private:
+    int reserveObject();
+
+    void beginObject(int obj_num);
+
+    void writeImage(int obj_num, QByteArray const& dict, QByteArray const& data);
+
+    void write(QByteArray const& data);
+
+    QFile m_file;
+    std::vector<qint64> m_objectOffsets; /**< Indexed by object number. */
+    std::vector<int> m_pageObjects;
+    int m_pagesObject;
+    bool m_opened;
+    bool m_ok;
+    bool m_closed;
+};
+
+}
+
+#endif // MRCPDFWRITER_H
@@ -0,0 +1,115 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUCKET_QUEUE_H_
+#define BUCKET_QUEUE_H_
+
+#include <vector>
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
+/**
+ * \brief A monotone priority queue of integer ids with priorities from
+ *        a small integer range, also known as a bucket queue.
+ *
+ * Lower priorities come out first, and ids within a single bucket come
+ * out in no particular order.  Pushing is O(1).  So is popping, amortized
+ * over the range of priorities, provided pushed priorities don't go below
+ * the priority of the last popped id.  That's the case for Dijkstra-like
+ * searches with non-negative edge costs.
+ *
+ * There is no reposition() operation.  To lower the priority of an id
+ * that is already in the queue, push it again and skip the stale entry
+ * when it comes out.
+ */
+class BucketQueue
+{
+    // Member-wise copying is OK.
+public:
+    /**
+     * \param num_buckets Priorities will be from 0 to num_buckets - 1.
+     */
+    explicit BucketQueue(int num_buckets)
+        : m_buckets(num_buckets), m_size(0), m_curBucket(0) {}
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    uint32_t front() const
+    {
+        assert(!empty());
+        return m_buckets[m_curBucket].back();
+    }
+
+    /**
+     * \brief The priority of front().
+     */
+    int frontPriority() const
+    {
+        assert(!empty());
+        return m_curBucket;
+    }
+
+    void push(uint32_t id, int priority)
+    {
+        assert(priority >= 0 && priority < int(m_buckets.size()));
+        if (m_size == 0 || priority < m_curBucket) {
+            m_curBucket = priority;
+        }
+        m_buckets[priority].push_back(id);
+        ++m_size;
+    }
+
+    void pop()
+    {
+        assert(!empty());
+        m_buckets[m_curBucket].pop_back();
+        if (--m_size != 0) {
+            while (m_buckets[m_curBucket].empty()) {
+                ++m_curBucket;
+            }
+        }
+    }
+
+    void swap(BucketQueue& other)
+    {
+        m_buckets.swap(other.m_buckets);
+        std::swap(m_size, other.m_size);
+        std::swap(m_curBucket, other.m_curBucket);
+    }
+private:
+    std::vector<std::vector<uint32_t> > m_buckets;
+    size_t m_size;
+    int m_curBucket;
+};
+
+inline void swap(BucketQueue& o1, BucketQueue& o2)
+{
+    o1.swap(o2);
+}
+
+#endif
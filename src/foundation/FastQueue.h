@@ -22,21 +22,32 @@
 #include "NonCopyable.h"
 #include <boost/intrusive/list.hpp>
 #include <boost/type_traits/alignment_of.hpp>
+#include <algorithm>
+#include <new>
 #include <stddef.h>
 #include <stdint.h>
 #include <assert.h>
 
+/**
+ * \brief A FIFO queue of chunks of elements.
+ *
+ * Chunks emptied by pop() are kept and reused by push(), so a queue that
+ * stays roughly the same size, like the front of a flood fill, stops
+ * allocating once it has grown.  One chunk is kept by default, and
+ * reserve() raises that.  Element storage starts at a cache line boundary.
+ */
 template<typename T>
 class FastQueue
 {
 public:
-    FastQueue() : m_chunkCapacity(defaultChunkCapacity()) {}
+    FastQueue() : m_chunkCapacity(defaultChunkCapacity()), m_numSpareChunks(0), m_maxSpareChunks(1) {}
 
     FastQueue(FastQueue const& other);
 
     ~FastQueue()
     {
         m_chunkList.clear_and_dispose(ChunkDisposer());
+        m_spareChunks.clear_and_dispose(ChunkDisposer());
     }
 
     FastQueue& operator=(FastQueue const& other);
@@ -60,18 +71,28 @@ public:
 
     void pop();
 
+    /**
+     * \brief Allocates chunks for \p capacity elements up front.
+     *
+     * That many elements may then be pushed on top of the current ones
+     * without allocating, and chunks for that many are kept when emptied.
+     */
+    void reserve(size_t capacity);
+
     void swap(FastQueue& other);
 private:
+    enum { CACHE_LINE_SIZE = 64 };
+
     struct Chunk : public boost::intrusive::list_base_hook<> {
         DECLARE_NON_COPYABLE(Chunk)
     public:
         Chunk(size_t capacity)
         {
             uintptr_t const p = (uintptr_t)(this + 1);
-            size_t const alignment = boost::alignment_of<T>::value;
-            pBegin = (T*)(((p + alignment - 1) / alignment) * alignment);
-            pEnd = pBegin;
-            pBufferEnd = pBegin + capacity;
+            pStorage = (T*)(((p + alignment() - 1) / alignment()) * alignment());
+            pBegin = pStorage;
+            pEnd = pStorage;
+            pBufferEnd = pStorage + capacity;
             assert(size_t((char*)pBufferEnd - (char*)this) <= storageRequirement(capacity));
         }
 
@@ -82,11 +103,28 @@ private:
             }
         }
 
+        /**
+         * Makes an emptied chunk ready to be pushed to again.
+         */
+        void reset()
+        {
+            assert(pBegin == pEnd);
+            pBegin = pStorage;
+            pEnd = pStorage;
+        }
+
+        static size_t alignment()
+        {
+            size_t const a = boost::alignment_of<T>::value;
+            return a > size_t(CACHE_LINE_SIZE) ? a : size_t(CACHE_LINE_SIZE);
+        }
+
         static size_t storageRequirement(size_t capacity)
         {
-            return sizeof(Chunk) + boost::alignment_of<T>::value - 1 + capacity * sizeof(T);
+            return sizeof(Chunk) + alignment() - 1 + capacity * sizeof(T);
         }
 
+        T* pStorage;
         T* pBegin;
         T* pEnd;
         T* pBufferEnd;
@@ -110,16 +148,34 @@ private:
         return (sizeof(T) >= 4096) ? 1 : 4096 / sizeof(T);
     }
 
+    static void prefetch(void const* p)
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(p);
+#else
+        (void)p;
+#endif
+    }
+
+    Chunk* newChunk();
+
+    void retireFrontChunk();
+
     ChunkList m_chunkList;
+    ChunkList m_spareChunks;
     size_t m_chunkCapacity;
+    size_t m_numSpareChunks;
+    size_t m_maxSpareChunks;
 };
 
 template<typename T>
 FastQueue<T>::FastQueue(FastQueue const& other)
-    :   m_chunkCapacity(other.m_chunkCapacity)
+    :   m_chunkCapacity(other.m_chunkCapacity),
+        m_numSpareChunks(0),
+        m_maxSpareChunks(1)
 {
-    for (const Chunk& chunk : other.m_chunkList) {
-        for (T const* obj = chunk->pBegin; obj != chunk->pEnd; ++obj) {
+    for (Chunk const& chunk : other.m_chunkList) {
+        for (T const* obj = chunk.pBegin; obj != chunk.pEnd; ++obj) {
             push(*obj);
         }
     }
@@ -147,9 +203,7 @@ FastQueue<T>::push(T const& t)
     }
 
     if (!chunk) {
-        // Create a new chunk.
-        char* buf = new char[Chunk::storageRequirement(m_chunkCapacity)];
-        chunk = new (buf) Chunk(m_chunkCapacity);
+        chunk = newChunk();
         m_chunkList.push_back(*chunk);
     }
 
@@ -168,8 +222,22 @@ FastQueue<T>::pop()
     chunk->pBegin->~T();
     ++chunk->pBegin;
     if (chunk->pBegin == chunk->pEnd) {
-        m_chunkList.pop_front();
-        ChunkDisposer()(chunk);
+        retireFrontChunk();
+    }
+}
+
+template<typename T>
+void
+FastQueue<T>::reserve(size_t const capacity)
+{
+    size_t const num_chunks = (capacity + m_chunkCapacity - 1) / m_chunkCapacity;
+    if (num_chunks > m_maxSpareChunks) {
+        m_maxSpareChunks = num_chunks;
+    }
+
+    for (; m_numSpareChunks < num_chunks; ++m_numSpareChunks) {
+        char* buf = new char[Chunk::storageRequirement(m_chunkCapacity)];
+        m_spareChunks.push_back(*new (buf) Chunk(m_chunkCapacity));
     }
 }
 
@@ -178,9 +246,51 @@ void
 FastQueue<T>::swap(FastQueue& other)
 {
     m_chunkList.swap(other.m_chunkList);
-    size_t const tmp = m_chunkCapacity;
-    m_chunkCapacity = other.m_chunkCapacity;
-    other.m_chunkCapacity = tmp;
+    m_spareChunks.swap(other.m_spareChunks);
+    std::swap(m_chunkCapacity, other.m_chunkCapacity);
+    std::swap(m_numSpareChunks, other.m_numSpareChunks);
+    std::swap(m_maxSpareChunks, other.m_maxSpareChunks);
+}
+
+template<typename T>
+typename FastQueue<T>::Chunk*
+FastQueue<T>::newChunk()
+{
+    if (!m_spareChunks.empty()) {
+        Chunk* chunk = &m_spareChunks.front();
+        m_spareChunks.pop_front();
+        --m_numSpareChunks;
+        return chunk;
+    }
+
+    char* buf = new char[Chunk::storageRequirement(m_chunkCapacity)];
+    return new (buf) Chunk(m_chunkCapacity);
+}
+
+template<typename T>
+void
+FastQueue<T>::retireFrontChunk()
+{
+    Chunk* chunk = &m_chunkList.front();
+    m_chunkList.pop_front();
+
+    if (m_numSpareChunks < m_maxSpareChunks) {
+        chunk->reset();
+        m_spareChunks.push_front(*chunk);
+        ++m_numSpareChunks;
+    } else {
+        ChunkDisposer()(chunk);
+    }
+
+    // Chunks are separate allocations, so the hardware prefetcher
+    // won't move on to the next one by itself.  Fetching it a whole
+    // chunk ahead keeps the check out of the per element path.
+    if (!m_chunkList.empty()) {
+        typename ChunkList::iterator const next(++m_chunkList.begin());
+        if (next != m_chunkList.end()) {
+            prefetch(next->pBegin);
+        }
+    }
 }
 
 template<typename T>
@@ -19,12 +19,29 @@
 #ifndef GRID_H_
 #define GRID_H_
 
-#include <boost/scoped_array.hpp>
+#include "PixelBufferPool.h"
+#include <new>
+#include <stddef.h>
 
 template<typename Node>
 class Grid
 {
 public:
+    enum { ROW_ALIGNMENT = 64 };
+
+    enum RowAlignment {
+        UNALIGNED_ROWS,
+
+        /**
+         * The first unpadded node of every row starts at a ROW_ALIGNMENT
+         * byte boundary, and vectorized loops may run over alignedWidth()
+         * nodes of a row.  Rows can only be aligned like that if the size
+         * of Node divides ROW_ALIGNMENT.  Otherwise this is the same as
+         * UNALIGNED_ROWS.
+         */
+        ALIGNED_ROWS
+    };
+
     /**
      * Creates a null grid.
      */
@@ -33,15 +50,17 @@ public:
     /**
      * \brief Creates a width x height grid with specified padding on each side.
      */
-    Grid(int width, int height, int padding);
+    Grid(int width, int height, int padding, RowAlignment alignment = UNALIGNED_ROWS);
 
     /**
      * \brief Creates a deep copy of another grid including padding.
      *
-     * Stride is also preserved.
+     * Stride and row alignment are also preserved.
      */
     Grid(Grid const& other);
 
+    ~Grid();
+
     bool isNull() const
     {
         return m_width <= 0 || m_height <= 0;
@@ -72,7 +91,7 @@ public:
      */
     Node* paddedData()
     {
-        return m_storage.get();
+        return m_pStorage + m_lead;
     }
 
     /**
@@ -80,7 +99,23 @@ public:
      */
     Node const* paddedData() const
     {
-        return m_storage.get();
+        return m_pStorage + m_lead;
+    }
+
+    /**
+     * \brief Returns a pointer to the first unpadded node of row \p y.
+     */
+    Node* row(int y)
+    {
+        return m_pData + y * m_stride;
+    }
+
+    /**
+     * \brief Returns a pointer to the first unpadded node of row \p y.
+     */
+    Node const* row(int y) const
+    {
+        return m_pData + y * m_stride;
     }
 
     /**
@@ -115,6 +150,21 @@ public:
         return m_padding;
     }
 
+    /**
+     * \brief Returns the number of nodes of a row that may be accessed
+     *        as whole ROW_ALIGNMENT byte blocks.
+     *
+     * That's width() rounded up for grids with ALIGNED_ROWS, and width()
+     * itself otherwise.  The nodes past width() are there for vectorized
+     * loops to run over without handling the end of a row separately.
+     * In grids with padding, they overlap the right padding nodes, so
+     * such a loop may overwrite them.  It never reaches into the next row.
+     */
+    int alignedWidth() const
+    {
+        return m_alignedWidth;
+    }
+
     void swap(Grid& other);
 private:
     template<typename T>
@@ -124,48 +174,135 @@ private:
         T tmp(o1); o1 = o2; o2 = tmp;
     }
 
-    boost::scoped_array<Node> m_storage;
+    /**
+     * Grids are as large as the images they are computed from, so their
+     * storage comes from PixelBufferPool, like the images' own.
+     */
+    static Node* allocateNodes(size_t num_nodes);
+
+    static void freeNodes(Node* nodes, size_t num_nodes);
+
+    /**
+     * The number of nodes a ROW_ALIGNMENT byte block holds, or 1 if that's
+     * not a whole number.
+     */
+    static int nodesPerAlignment()
+    {
+        return ROW_ALIGNMENT % sizeof(Node) == 0 ? int(ROW_ALIGNMENT / sizeof(Node)) : 1;
+    }
+
+    static int roundUp(int val, int multiple)
+    {
+        return (val + multiple - 1) / multiple * multiple;
+    }
+
+    size_t numNodes() const
+    {
+        return m_lead + size_t(m_stride) * (m_height + m_padding * 2);
+    }
+
+    Grid& operator=(Grid const&); // Not implemented.
+
+    Node* m_pStorage;
     Node* m_pData;
     int m_width;
     int m_height;
     int m_stride;
     int m_padding;
+    int m_alignedWidth;
+
+    /**
+     * The number of unused nodes before the padded data, which
+     * put the first unpadded node at an aligned address.
+     */
+    int m_lead;
 };
 
 template<typename Node>
 Grid<Node>::Grid()
-    :   m_pData(0),
+    :   m_pStorage(0),
+        m_pData(0),
         m_width(0),
         m_height(0),
         m_stride(0),
-        m_padding(0)
+        m_padding(0),
+        m_alignedWidth(0),
+        m_lead(0)
 {
 }
 
 template<typename Node>
-Grid<Node>::Grid(int width, int height, int padding)
-    :   m_storage(new Node[(width + padding * 2) * (height + padding * 2)]),
-        m_pData(m_storage.get() + (width + padding * 2) * padding + padding),
+Grid<Node>::Grid(int width, int height, int padding, RowAlignment alignment)
+    :   m_pStorage(0),
+        m_pData(0),
         m_width(width),
         m_height(height),
         m_stride(width + padding * 2),
-        m_padding(padding)
+        m_padding(padding),
+        m_alignedWidth(width),
+        m_lead(0)
 {
+    int const block = nodesPerAlignment();
+    if (alignment == ALIGNED_ROWS && block > 1) {
+        // The storage itself is aligned, as are the starts of rows
+        // as long as the stride is a multiple of the block.  With that,
+        // the lead only has to cover the left padding.  Leaving at least
+        // a block for the two paddings keeps the aligned width of a row
+        // clear of the next row.
+        m_alignedWidth = roundUp(width, block);
+        m_stride = m_alignedWidth + roundUp(padding * 2, block);
+        m_lead = (block - padding % block) % block;
+    }
+
+    m_pStorage = allocateNodes(numNodes());
+    m_pData = m_pStorage + m_lead + m_stride * padding + padding;
 }
 
 template<typename Node>
 Grid<Node>::Grid(Grid const& other)
-    :   m_storage(new Node[(other.stride() * (other.height() + other.padding() * 2))]),
-        m_pData(m_storage.get() + other.stride() * other.padding() + other.padding()),
+    :   m_pStorage(allocateNodes(other.numNodes())),
+        m_pData(m_pStorage + (other.m_pData - other.m_pStorage)),
         m_width(other.width()),
         m_height(other.height()),
         m_stride(other.stride()),
-        m_padding(other.padding())
+        m_padding(other.padding()),
+        m_alignedWidth(other.alignedWidth()),
+        m_lead(other.m_lead)
 {
-    int const len = m_stride * (m_height + m_padding * 2);
-    for (int i = 0; i < len; ++i) {
-        m_storage[i] = other.m_storage[i];
+    size_t const len = numNodes();
+    for (size_t i = 0; i < len; ++i) {
+        m_pStorage[i] = other.m_pStorage[i];
+    }
+}
+
+template<typename Node>
+Grid<Node>::~Grid()
+{
+    freeNodes(m_pStorage, numNodes());
+}
+
+template<typename Node>
+Node*
+Grid<Node>::allocateNodes(size_t const num_nodes)
+{
+    Node* const nodes = static_cast<Node*>(PixelBufferPool::allocate(num_nodes * sizeof(Node)));
+    for (size_t i = 0; i < num_nodes; ++i) {
+        new(nodes + i) Node;
+    }
+    return nodes;
+}
+
+template<typename Node>
+void
+Grid<Node>::freeNodes(Node* const nodes, size_t const num_nodes)
+{
+    if (!nodes) {
+        return;
+    }
+    for (size_t i = 0; i < num_nodes; ++i) {
+        nodes[i].~Node();
     }
+    PixelBufferPool::release(nodes);
 }
 
 template<typename Node>
@@ -177,7 +314,7 @@ Grid<Node>::initPadding(Node const& padding_node)
         return;
     }
 
-    Node* line = m_storage.get();
+    Node* line = paddedData();
     for (int row = 0; row < m_padding; ++row) {
         for (int x = 0; x < m_stride; ++x) {
             line[x] = padding_node;
@@ -189,7 +326,8 @@ Grid<Node>::initPadding(Node const& padding_node)
         for (int col = 0; col < m_padding; ++col) {
             line[col] = padding_node;
         }
-        for (int col = m_stride - m_padding; col < m_stride; ++col) {
+        // That includes the nodes between the right padding and the stride.
+        for (int col = m_padding + m_width; col < m_stride; ++col) {
             line[col] = padding_node;
         }
         line += m_stride;
@@ -220,12 +358,14 @@ template<typename Node>
 void
 Grid<Node>::swap(Grid& other)
 {
-    m_storage.swap(other.m_storage);
+    basicSwap(m_pStorage, other.m_pStorage);
     basicSwap(m_pData, other.m_pData);
     basicSwap(m_width, other.m_width);
     basicSwap(m_height, other.m_height);
     basicSwap(m_stride, other.m_stride);
     basicSwap(m_padding, other.m_padding);
+    basicSwap(m_alignedWidth, other.m_alignedWidth);
+    basicSwap(m_lead, other.m_lead);
 }
 
 template<typename Node>
@@ -19,6 +19,7 @@
 #ifndef MAT_MNT_H_
 #define MAT_MNT_H_
 
+#include "VecNT.h"
 #include <stddef.h>
 
 template<size_t M, size_t N, typename T> class MatMNT;
@@ -32,6 +33,10 @@ typedef MatMNT<4, 4, double> Mat44d;
 /**
  * \brief A matrix with pre-defined dimensions.
  *
+ * The products below have their dimensions known at compile time, so for
+ * the small sizes these are used with, the compiler unrolls them fully.
+ * Going through MatrixCalc is only worth it for sizes known at run time.
+ *
  * \note The memory layout is always column-major, as that's what MatrixCalc uses.
  */
 template<size_t M, size_t N, typename T>
@@ -123,4 +128,32 @@ MatMNT<M, N, T>::MatMNT(MatMNT<M, N, OT> const& other)
     }
 }
 
+template<size_t M, size_t N, size_t K, typename T>
+MatMNT<M, K, T> operator*(MatMNT<M, N, T> const& m1, MatMNT<N, K, T> const& m2)
+{
+    MatMNT<M, K, T> res;
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t n = 0; n < N; ++n) {
+            T const factor(m2(n, k));
+            for (size_t m = 0; m < M; ++m) {
+                res(m, k) += m1(m, n) * factor;
+            }
+        }
+    }
+    return res;
+}
+
+template<size_t M, size_t N, typename T>
+VecNT<M, T> operator*(MatMNT<M, N, T> const& mat, VecNT<N, T> const& vec)
+{
+    VecNT<M, T> res;
+    for (size_t n = 0; n < N; ++n) {
+        T const factor(vec[n]);
+        for (size_t m = 0; m < M; ++m) {
+            res[m] += mat(m, n) * factor;
+        }
+    }
+    return res;
+}
+
 #endif
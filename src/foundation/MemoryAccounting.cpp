@@ -0,0 +1,144 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MemoryAccounting.h"
+#include <QAtomicInt>
+#include <QThreadStorage>
+
+namespace
+{
+
+struct CurrentAccount
+{
+    IntrusivePtr<MemoryAccounting::Account> ptr;
+};
+
+QThreadStorage<CurrentAccount>& currentAccountStorage()
+{
+    // Leaked, as buffers may be released during static destruction.
+    static QThreadStorage<CurrentAccount>* const storage = new QThreadStorage<CurrentAccount>;
+    return *storage;
+}
+
+/**
+ * The number of live scopes in all threads.  While it's zero, which is
+ * the case unless profiling, charging doesn't look into thread storage.
+ */
+QAtomicInt g_numScopes(0);
+
+} // anonymous namespace
+
+MemoryAccounting::Account::Account(IntrusivePtr<Account> const& parent)
+    :   m_ptrParent(parent),
+        m_liveBytes(0),
+        m_peakBytes(0),
+        m_allocatedBytes(0)
+{
+}
+
+void
+MemoryAccounting::Account::charge(qint64 const bytes)
+{
+    for (Account* account = this; account; account = account->m_ptrParent.get()) {
+        qint64 const live = account->m_liveBytes.fetchAndAddOrdered(bytes) + bytes;
+        if (bytes <= 0) {
+            continue;
+        }
+
+        account->m_allocatedBytes.fetchAndAddRelaxed(bytes);
+        for (;;) {
+            qint64 const peak = account->m_peakBytes.load();
+            if (live <= peak || account->m_peakBytes.testAndSetOrdered(peak, live)) {
+                break;
+            }
+        }
+    }
+}
+
+void
+MemoryAccounting::Account::resetPeak()
+{
+    m_peakBytes.store(m_liveBytes.load());
+}
+
+MemoryAccounting::Scope::Scope(IntrusivePtr<Account> const& account)
+{
+    CurrentAccount& current = currentAccountStorage().localData();
+    m_ptrPrevious = current.ptr;
+    current.ptr = account;
+    g_numScopes.fetchAndAddOrdered(1);
+}
+
+MemoryAccounting::Scope::~Scope()
+{
+    g_numScopes.fetchAndAddOrdered(-1);
+    currentAccountStorage().localData().ptr = m_ptrPrevious;
+}
+
+IntrusivePtr<MemoryAccounting::Account>
+MemoryAccounting::currentAccount()
+{
+    if (g_numScopes.load() == 0 || !currentAccountStorage().hasLocalData()) {
+        return IntrusivePtr<Account>();
+    }
+    return currentAccountStorage().localData().ptr;
+}
+
+MemoryAccounting::Account*
+MemoryAccounting::charge(size_t const bytes)
+{
+    processAccount().charge(qint64(bytes));
+
+    IntrusivePtr<Account> const account(currentAccount());
+    if (account) {
+        account->ref();
+        account->charge(qint64(bytes));
+    }
+    return account.get();
+}
+
+void
+MemoryAccounting::discharge(Account* const account, size_t const bytes)
+{
+    processAccount().charge(-qint64(bytes));
+
+    if (account) {
+        account->charge(-qint64(bytes));
+        account->unref();
+    }
+}
+
+qint64
+MemoryAccounting::liveBytes()
+{
+    return processAccount().liveBytes();
+}
+
+qint64
+MemoryAccounting::peakBytes()
+{
+    return processAccount().peakBytes();
+}
+
+MemoryAccounting::Account&
+MemoryAccounting::processAccount()
+{
+    // Never destroyed, like the thread storage above.
+    static Account* const instance = new Account;
+    return *instance;
+}
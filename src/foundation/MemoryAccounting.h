@@ -0,0 +1,142 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMORY_ACCOUNTING_H_
+#define MEMORY_ACCOUNTING_H_
+
+#include "NonCopyable.h"
+#include "RefCountable.h"
+#include "IntrusivePtr.h"
+#include <QAtomicInteger>
+#include <QtGlobal>
+
+/**
+ * \brief Keeps track of how much memory pixel buffers take, overall
+ *        and per unit of work.
+ *
+ * PixelBufferPool charges every buffer it hands out, and with it every
+ * BinaryImage, GrayImage and Grid, as well as the containers using
+ * PixelBufferAllocator.  A buffer is charged to the process as a whole
+ * and to the account current for the allocating thread, if any.
+ * The charge is taken back when the buffer is released, no matter
+ * which thread does that.
+ *
+ * Accounts form a hierarchy.  Charging an account charges its parent
+ * as well, so the peak of an account covers everything allocated within
+ * its nested accounts.  Memory that was already in use when an account
+ * was installed doesn't count towards its peak.
+ *
+ * Only the allocating thread's current account gets charged, so work
+ * handed over to other threads, like OpenMP loops, is only accounted
+ * for the process.
+ *
+ * All functions are thread-safe.
+ */
+class MemoryAccounting
+{
+public:
+    class Account : public RefCountable
+    {
+        DECLARE_NON_COPYABLE(Account)
+    public:
+        explicit Account(IntrusivePtr<Account> const& parent = IntrusivePtr<Account>());
+
+        /**
+         * \brief Adds \p bytes to this account and its ancestors.
+         *
+         * A negative value takes a previous charge back.
+         */
+        void charge(qint64 bytes);
+
+        /** \brief The number of bytes currently charged. */
+        qint64 liveBytes() const
+        {
+            return m_liveBytes.load();
+        }
+
+        /** \brief The maximum liveBytes() ever reached. */
+        qint64 peakBytes() const
+        {
+            return m_peakBytes.load();
+        }
+
+        /** \brief The total of all positive charges. */
+        qint64 allocatedBytes() const
+        {
+            return m_allocatedBytes.load();
+        }
+
+        /** \brief Makes the peak equal to the current live bytes. */
+        void resetPeak();
+    private:
+        IntrusivePtr<Account> m_ptrParent;
+        QAtomicInteger<qint64> m_liveBytes;
+        QAtomicInteger<qint64> m_peakBytes;
+        QAtomicInteger<qint64> m_allocatedBytes;
+    };
+
+    /**
+     * \brief Makes an account current for the calling thread, for the
+     *        lifetime of the scope.
+     *
+     * Scopes nest.  The previously current account is restored on exit.
+     */
+    class Scope
+    {
+        DECLARE_NON_COPYABLE(Scope)
+    public:
+        explicit Scope(IntrusivePtr<Account> const& account);
+
+        ~Scope();
+    private:
+        IntrusivePtr<Account> m_ptrPrevious;
+    };
+
+    /**
+     * \brief Returns the calling thread's current account, possibly null.
+     */
+    static IntrusivePtr<Account> currentAccount();
+
+    /**
+     * \brief Charges the process and the calling thread's current account.
+     *
+     * \return The account charged besides the process, possibly null.
+     *         The caller owns a reference to it and has to pass it
+     *         to discharge() later.
+     */
+    static Account* charge(size_t bytes);
+
+    /**
+     * \brief Takes back a charge made by charge().
+     */
+    static void discharge(Account* account, size_t bytes);
+
+    /**
+     * \brief The number of bytes currently charged to the process.
+     */
+    static qint64 liveBytes();
+
+    /**
+     * \brief The maximum liveBytes() ever reached.
+     */
+    static qint64 peakBytes();
+private:
+    static Account& processAccount();
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MonotonicArena.h"
+#include <algorithm>
+#include <new>
+#include <assert.h>
+
+MonotonicArena::MonotonicArena(size_t initial_capacity)
+    : m_pChunks(0)
+    , m_pCur(0)
+    , m_pEnd(0)
+    , m_totalCapacity(0)
+    , m_nextCapacity(std::max<size_t>(initial_capacity, 64))
+{
+}
+
+MonotonicArena::~MonotonicArena()
+{
+    freeChunks();
+}
+
+void
+MonotonicArena::reset()
+{
+    if (!m_pChunks) {
+        return;
+    }
+
+    if (m_pChunks->pNext) {
+        size_t const total_capacity = m_totalCapacity;
+        freeChunks();
+        addChunk(total_capacity);
+    } else {
+        m_pCur = chunkData(m_pChunks);
+    }
+}
+
+void*
+MonotonicArena::allocateSlow(size_t size, size_t alignment)
+{
+    assert(alignment != 0 && !(alignment & (alignment - 1)));
+
+    addChunk(std::max(m_nextCapacity, size + alignment));
+    m_nextCapacity *= 2;
+
+    uintptr_t const addr = (uintptr_t(m_pCur) + alignment - 1) & ~uintptr_t(alignment - 1);
+    assert(addr + size <= uintptr_t(m_pEnd));
+    m_pCur = reinterpret_cast<char*>(addr + size);
+    return reinterpret_cast<void*>(addr);
+}
+
+void
+MonotonicArena::addChunk(size_t capacity)
+{
+    Chunk* chunk = static_cast<Chunk*>(::operator new(sizeof(Chunk) + capacity));
+    chunk->pNext = m_pChunks;
+    chunk->capacity = capacity;
+    m_pChunks = chunk;
+    m_pCur = chunkData(chunk);
+    m_pEnd = m_pCur + capacity;
+    m_totalCapacity += capacity;
+}
+
+void
+MonotonicArena::freeChunks()
+{
+    while (m_pChunks) {
+        Chunk* next = m_pChunks->pNext;
+        ::operator delete(m_pChunks);
+        m_pChunks = next;
+    }
+    m_pCur = 0;
+    m_pEnd = 0;
+    m_totalCapacity = 0;
+}
+
+char*
+MonotonicArena::chunkData(Chunk* chunk)
+{
+    return reinterpret_cast<char*>(chunk + 1);
+}
@@ -0,0 +1,154 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONOTONIC_ARENA_H_
+#define MONOTONIC_ARENA_H_
+
+#include "NonCopyable.h"
+#include <boost/type_traits/alignment_of.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Hands out memory by bumping a pointer, and takes it all back
+ *        at once with reset().
+ *
+ * Individual allocations are never freed.  That makes allocating nearly
+ * free, which pays off for short-lived temporaries that get allocated
+ * over and over, like those of iterative algorithms.  After reset(),
+ * the memory gets reused, so once an arena has seen a full cycle of
+ * allocations, further cycles of the same size don't touch the heap.
+ *
+ * An arena is not thread-safe.  Threads should have an arena each.
+ *
+ * \see ArenaAllocator
+ */
+class MonotonicArena
+{
+    DECLARE_NON_COPYABLE(MonotonicArena)
+public:
+    /**
+     * \param initial_capacity The size of the first chunk of memory,
+     *        to be allocated when the first allocation takes place.
+     */
+    explicit MonotonicArena(size_t initial_capacity = 4096);
+
+    ~MonotonicArena();
+
+    /**
+     * \brief Allocates uninitialized memory.
+     *
+     * \param size The number of bytes to allocate.
+     * \param alignment A power of two the address is to be a multiple of.
+     */
+    void* allocate(size_t size, size_t alignment)
+    {
+        uintptr_t const addr = (uintptr_t(m_pCur) + alignment - 1) & ~uintptr_t(alignment - 1);
+        if (addr + size <= uintptr_t(m_pEnd) && m_pCur) {
+            m_pCur = reinterpret_cast<char*>(addr + size);
+            return reinterpret_cast<void*>(addr);
+        }
+        return allocateSlow(size, alignment);
+    }
+
+    /**
+     * \brief Takes back everything allocated so far.
+     *
+     * If several chunks were in use, they are merged into one,
+     * so that the next cycle fits into a single chunk.
+     */
+    void reset();
+private:
+    struct Chunk {
+        Chunk* pNext;
+        size_t capacity;
+    };
+
+    void* allocateSlow(size_t size, size_t alignment);
+
+    void addChunk(size_t capacity);
+
+    void freeChunks();
+
+    static char* chunkData(Chunk* chunk);
+
+    Chunk* m_pChunks; /**< The current chunk, followed by older ones. */
+    char* m_pCur;
+    char* m_pEnd;
+    size_t m_totalCapacity;
+    size_t m_nextCapacity;
+};
+
+/**
+ * \brief A standard allocator taking memory from a MonotonicArena.
+ *
+ * deallocate() does nothing, as memory is only returned by resetting
+ * the arena.  Containers using this allocator must not outlive the arena
+ * or be used after it has been reset.
+ */
+template<typename T>
+class ArenaAllocator
+{
+    template<typename U> friend class ArenaAllocator;
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef T const* const_pointer;
+    typedef T& reference;
+    typedef T const& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    explicit ArenaAllocator(MonotonicArena& arena) : m_pArena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(ArenaAllocator<U> const& other) : m_pArena(other.m_pArena) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(m_pArena->allocate(n * sizeof(T), boost::alignment_of<T>::value));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    size_t max_size() const
+    {
+        return size_t(-1) / sizeof(T);
+    }
+
+    template<typename U>
+    bool operator==(ArenaAllocator<U> const& other) const
+    {
+        return m_pArena == other.m_pArena;
+    }
+
+    template<typename U>
+    bool operator!=(ArenaAllocator<U> const& other) const
+    {
+        return m_pArena != other.m_pArena;
+    }
+private:
+    MonotonicArena* m_pArena;
+};
+
+#endif
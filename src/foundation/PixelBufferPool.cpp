@@ -0,0 +1,379 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PixelBufferPool.h"
+#include "MemoryAccounting.h"
+#include <QAtomicInteger>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtGlobal> // For Q_OS_LINUX
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(Q_OS_LINUX)
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+
+/** Allocations below this size are not pooled. */
+size_t const MIN_POOLED_BYTES = size_t(1) << 16;
+
+int const MIN_POOLED_LOG2 = 16;
+
+/** Buckets per power of two, itself a power of two. */
+int const SUB_BUCKETS_LOG2 = 3;
+
+int const SUB_BUCKETS = 1 << SUB_BUCKETS_LOG2;
+
+int const NUM_BUCKETS = (int(sizeof(size_t)) * 8 - MIN_POOLED_LOG2) * SUB_BUCKETS;
+
+int const NUM_SHARDS = 8;
+
+size_t const DEFAULT_MAX_CACHED_BYTES = size_t(256) << 20;
+
+/** Buffers of this size and above are backed by huge pages. */
+size_t const MIN_HUGE_PAGE_BYTES = size_t(4) << 20;
+
+size_t const HUGE_PAGE_SIZE = size_t(2) << 20;
+
+QAtomicInt g_hugePagesEnabled(1);
+
+/**
+ * Precedes every buffer handed out.  While a buffer sits in the pool,
+ * pNext links it to other buffers of the same bucket, so that returning
+ * a buffer never has to allocate.  While it's in use, pAccount is what
+ * MemoryAccounting::charge() returned for it.
+ */
+struct Header {
+    void* pRaw;
+    Header* pNext;
+    MemoryAccounting::Account* pAccount;
+    size_t capacity;
+};
+
+int highestBit(size_t val)
+{
+    int bit = -1;
+    for (; val; val >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+/**
+ * Rounds a size up to the capacity of its bucket.
+ */
+size_t capacityFor(size_t const bytes)
+{
+    if (bytes < MIN_POOLED_BYTES) {
+        return bytes;
+    }
+    size_t const step = size_t(1) << (highestBit(bytes) - SUB_BUCKETS_LOG2);
+    return (bytes + step - 1) & ~(step - 1);
+}
+
+int bucketIndex(size_t const capacity)
+{
+    int const msb = highestBit(capacity);
+    int const sub = int(capacity >> (msb - SUB_BUCKETS_LOG2)) - SUB_BUCKETS;
+    return (msb - MIN_POOLED_LOG2) * SUB_BUCKETS + sub;
+}
+
+Header* headerOf(void* buffer)
+{
+    return static_cast<Header*>(buffer) - 1;
+}
+
+void* bufferOf(Header* header)
+{
+    return header + 1;
+}
+
+void freeBuffer(Header* header)
+{
+    free(header->pRaw);
+}
+
+struct Shard {
+    QMutex mutex;
+    Header* buckets[NUM_BUCKETS];
+
+    Shard()
+    {
+        for (int i = 0; i < NUM_BUCKETS; ++i) {
+            buckets[i] = 0;
+        }
+    }
+};
+
+} // anonymous namespace
+
+class PixelBufferPool::Impl
+{
+public:
+    Impl() : m_cachedBytes(0), m_maxCachedBytes(DEFAULT_MAX_CACHED_BYTES) {}
+
+    void* allocate(size_t bytes);
+
+    void release(void* buffer);
+
+    void trim(size_t max_bytes);
+
+    void setMaxCachedBytes(size_t bytes);
+
+    size_t maxCachedBytes() const
+    {
+        return m_maxCachedBytes.load();
+    }
+
+    size_t cachedBytes() const
+    {
+        return m_cachedBytes.load();
+    }
+private:
+    static int homeShard();
+
+    Header* takeCached(size_t capacity);
+
+    static Header* allocateNew(size_t capacity);
+
+    Shard m_shards[NUM_SHARDS];
+    QAtomicInteger<quintptr> m_cachedBytes;
+    QAtomicInteger<quintptr> m_maxCachedBytes;
+};
+
+int
+PixelBufferPool::Impl::homeShard()
+{
+    quintptr const id = quintptr(QThread::currentThreadId());
+    return int(((id >> 4) ^ (id >> 12)) % NUM_SHARDS);
+}
+
+void*
+PixelBufferPool::Impl::allocate(size_t const bytes)
+{
+    size_t const capacity = capacityFor(bytes);
+
+    Header* header = 0;
+    if (capacity >= MIN_POOLED_BYTES) {
+        header = takeCached(capacity);
+    }
+    if (!header) {
+        header = allocateNew(capacity);
+    }
+    if (!header) {
+        // The cache may be holding what we need, only in wrong sizes.
+        trim(0);
+        header = allocateNew(capacity);
+        if (!header) {
+            throw std::bad_alloc();
+        }
+    }
+    header->pAccount = MemoryAccounting::charge(capacity);
+    return bufferOf(header);
+}
+
+Header*
+PixelBufferPool::Impl::takeCached(size_t const capacity)
+{
+    int const bucket = bucketIndex(capacity);
+    int const home = homeShard();
+
+    for (int i = 0; i < NUM_SHARDS; ++i) {
+        Shard& shard = m_shards[(home + i) % NUM_SHARDS];
+        // Block on our own shard only.  If another one is busy,
+        // allocating from the heap is cheaper than waiting.
+        if (i == 0) {
+            shard.mutex.lock();
+        } else if (!shard.mutex.tryLock()) {
+            continue;
+        }
+
+        Header* const header = shard.buckets[bucket];
+        if (header) {
+            shard.buckets[bucket] = header->pNext;
+        }
+        shard.mutex.unlock();
+
+        if (header) {
+            m_cachedBytes.fetchAndSubOrdered(capacity);
+            return header;
+        }
+    }
+
+    return 0;
+}
+
+Header*
+PixelBufferPool::Impl::allocateNew(size_t const capacity)
+{
+    size_t const total = sizeof(Header) + ALIGNMENT - 1 + capacity;
+    void* raw = 0;
+#if defined(Q_OS_LINUX) && defined(MADV_HUGEPAGE)
+    if (capacity >= MIN_HUGE_PAGE_BYTES && g_hugePagesEnabled.load()) {
+        // Rounded up to whole huge pages, so that the tail doesn't
+        // end up in small ones.  Still released with free().
+        size_t const rounded = (total + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        if (posix_memalign(&raw, HUGE_PAGE_SIZE, rounded) == 0) {
+            // Just advice.  Without transparent huge pages in the kernel,
+            // the buffer is backed by regular pages.
+            madvise(raw, rounded, MADV_HUGEPAGE);
+        } else {
+            raw = 0;
+        }
+    }
+#endif
+    if (!raw) {
+        raw = malloc(total);
+    }
+    if (!raw) {
+        return 0;
+    }
+
+    uintptr_t const addr = (uintptr_t(raw) + sizeof(Header) + ALIGNMENT - 1)
+                           & ~uintptr_t(ALIGNMENT - 1);
+    Header* const header = headerOf(reinterpret_cast<void*>(addr));
+    header->pRaw = raw;
+    header->pNext = 0;
+    header->pAccount = 0;
+    header->capacity = capacity;
+    return header;
+}
+
+void
+PixelBufferPool::Impl::release(void* const buffer)
+{
+    if (!buffer) {
+        return;
+    }
+
+    Header* const header = headerOf(buffer);
+    size_t const capacity = header->capacity;
+    MemoryAccounting::discharge(header->pAccount, capacity);
+    header->pAccount = 0;
+    if (capacity < MIN_POOLED_BYTES) {
+        freeBuffer(header);
+        return;
+    }
+
+    // Account for the buffer before caching it, so that concurrent
+    // releases can't overshoot the limit together.
+    for (;;) {
+        quintptr const cached = m_cachedBytes.load();
+        if (cached + capacity > m_maxCachedBytes.load()) {
+            freeBuffer(header);
+            return;
+        }
+        if (m_cachedBytes.testAndSetOrdered(cached, cached + capacity)) {
+            break;
+        }
+    }
+
+    Shard& shard = m_shards[homeShard()];
+    int const bucket = bucketIndex(capacity);
+    QMutexLocker const locker(&shard.mutex);
+    header->pNext = shard.buckets[bucket];
+    shard.buckets[bucket] = header;
+}
+
+void
+PixelBufferPool::Impl::trim(size_t const max_bytes)
+{
+    // Larger buffers go first, as they are the most expensive to keep.
+    for (int i = 0; i < NUM_SHARDS && m_cachedBytes.load() > max_bytes; ++i) {
+        Shard& shard = m_shards[i];
+        QMutexLocker const locker(&shard.mutex);
+        for (int bucket = NUM_BUCKETS - 1; bucket >= 0; --bucket) {
+            while (shard.buckets[bucket] && m_cachedBytes.load() > max_bytes) {
+                Header* const header = shard.buckets[bucket];
+                shard.buckets[bucket] = header->pNext;
+                m_cachedBytes.fetchAndSubOrdered(header->capacity);
+                freeBuffer(header);
+            }
+        }
+    }
+}
+
+void
+PixelBufferPool::Impl::setMaxCachedBytes(size_t const bytes)
+{
+    m_maxCachedBytes.store(bytes);
+    trim(bytes);
+}
+
+PixelBufferPool::Impl&
+PixelBufferPool::impl()
+{
+    // Never destroyed, as images in static storage may release
+    // their buffers after a function-local static would be gone.
+    static Impl* const instance = new Impl;
+    return *instance;
+}
+
+void*
+PixelBufferPool::allocate(size_t const bytes)
+{
+    return impl().allocate(bytes);
+}
+
+void
+PixelBufferPool::release(void* const buffer)
+{
+    impl().release(buffer);
+}
+
+void
+PixelBufferPool::trim(size_t const max_bytes)
+{
+    impl().trim(max_bytes);
+}
+
+void
+PixelBufferPool::setMaxCachedBytes(size_t const bytes)
+{
+    impl().setMaxCachedBytes(bytes);
+}
+
+size_t
+PixelBufferPool::maxCachedBytes()
+{
+    return impl().maxCachedBytes();
+}
+
+size_t
+PixelBufferPool::cachedBytes()
+{
+    return impl().cachedBytes();
+}
+
+void
+PixelBufferPool::setHugePagesEnabled(bool const enabled)
+{
+    g_hugePagesEnabled.store(enabled ? 1 : 0);
+}
+
+bool
+PixelBufferPool::hugePagesEnabled()
+{
+    return g_hugePagesEnabled.load() != 0;
+}
@@ -0,0 +1,160 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIXEL_BUFFER_POOL_H_
+#define PIXEL_BUFFER_POOL_H_
+
+#include <stddef.h>
+
+/**
+ * \brief A process-wide pool of large, 64-byte aligned pixel buffers.
+ *
+ * Processing a page allocates a series of full-size intermediate images
+ * of only a few distinct sizes.  Each of those allocations is big enough
+ * for the C runtime to map fresh pages from the OS and unmap them on
+ * release, which with several pages processed in parallel shows up as
+ * page faults and allocator lock contention.  The pool keeps released
+ * buffers around and hands them out again for requests of a similar size.
+ *
+ * Sizes are rounded up to one of 8 buckets per power of two, so that
+ * a buffer fits requests up to 12.5% smaller than itself.  Allocations
+ * below 64 KiB aren't worth pooling and are passed through to the heap.
+ *
+ * Released buffers go to a shard picked by the releasing thread, and
+ * allocations look into the calling thread's shard first, so threads
+ * don't contend for a single lock.  The total size of cached buffers
+ * is capped by setMaxCachedBytes(), and trim() gives them back to the
+ * heap.  MemoryBudget does both, according to its own limit.
+ *
+ * Buffers of 4 MiB and more are aligned to 2 MiB and, on Linux, marked
+ * for transparent huge pages.  Kernels walking such buffers column-wise
+ * touch a new 4 KiB page on every row, so huge pages save a lot of TLB
+ * misses.  That can be turned off with setHugePagesEnabled().
+ *
+ * Buffers in use are charged to MemoryAccounting.  Cached ones are not.
+ *
+ * All functions are thread-safe.
+ */
+class PixelBufferPool
+{
+public:
+    enum { ALIGNMENT = 64 };
+
+    /**
+     * \brief Allocates an uninitialized buffer aligned to ALIGNMENT bytes.
+     *
+     * \throw std::bad_alloc
+     */
+    static void* allocate(size_t bytes);
+
+    /**
+     * \brief Returns a buffer obtained from allocate() to the pool.
+     *
+     * A null pointer is ignored.  The signature is that of
+     * QImageCleanupFunction, so QImage can release buffers itself.
+     */
+    static void release(void* buffer);
+
+    /**
+     * \brief Frees cached buffers until no more than \p max_bytes are cached.
+     */
+    static void trim(size_t max_bytes = 0);
+
+    /**
+     * \brief Sets the maximum total size of cached buffers.
+     *
+     * Buffers released while the cache is full are freed right away.
+     * Lowering the limit trims the cache accordingly.
+     */
+    static void setMaxCachedBytes(size_t bytes);
+
+    static size_t maxCachedBytes();
+
+    static size_t cachedBytes();
+
+    /**
+     * \brief Enables or disables huge pages for new large buffers.
+     *
+     * Enabled by default.  Buffers allocated already stay as they are.
+     */
+    static void setHugePagesEnabled(bool enabled);
+
+    static bool hugePagesEnabled();
+private:
+    class Impl;
+
+    static Impl& impl();
+};
+
+/**
+ * \brief A standard allocator taking memory from PixelBufferPool.
+ *
+ * Meant for large containers of pixel-sized elements, which then get
+ * pooled and accounted like images.
+ */
+template<typename T>
+class PixelBufferAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef T const* const_pointer;
+    typedef T& reference;
+    typedef T const& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind {
+        typedef PixelBufferAllocator<U> other;
+    };
+
+    PixelBufferAllocator() {}
+
+    template<typename U>
+    PixelBufferAllocator(PixelBufferAllocator<U> const&) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(PixelBufferPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        PixelBufferPool::release(p);
+    }
+
+    size_t max_size() const
+    {
+        return size_t(-1) / sizeof(T);
+    }
+
+    template<typename U>
+    bool operator==(PixelBufferAllocator<U> const&) const
+    {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(PixelBufferAllocator<U> const&) const
+    {
+        return false;
+    }
+};
+
+#endif
@@ -20,7 +20,8 @@
 #include "BinaryImage.h"
 #include "BinaryThreshold.h"
 #include "Grayscale.h"
-#include "IntegralImage.h"
+#include "GpuCompute.h"
+#include "NonCopyable.h"
 #include <QImage>
 #include <QRect>
 #include <QDebug>
@@ -52,6 +53,223 @@ BinaryImage binarizeMokji(
     return BinaryImage(src, threshold);
 }
 
+namespace
+{
+
+/**
+ * \brief Local means and standard deviations over a sliding window,
+ *        computed one row at a time.
+ *
+ * Instead of whole-image integral tables, we keep per-column sums of
+ * the rows currently inside the window, updating them incrementally
+ * as the window slides down.  Horizontal window sums then come from
+ * a prefix sum over those columns.  The memory footprint is O(width).
+ */
+class WindowStats
+{
+    DECLARE_NON_COPYABLE(WindowStats)
+public:
+    WindowStats(QImage const& gray, QSize const& window_size);
+
+    /**
+     * \brief Computes statistics for row y.
+     *
+     * Cheap when called for consecutive rows.
+     */
+    void moveTo(int y);
+
+    double const* means() const
+    {
+        return &m_means[0];
+    }
+
+    double const* deviations() const
+    {
+        return &m_deviations[0];
+    }
+private:
+    void addRow(int y);
+
+    void subtractRow(int y);
+
+    void computeRow();
+
+    uint8_t const* const m_pGrayData;
+    int const m_grayBpl;
+    int const m_width;
+    int const m_height;
+    int const m_windowLowerHalf;
+    int const m_windowUpperHalf;
+    int const m_windowLeftHalf;
+    int const m_windowRightHalf;
+    int m_y;
+    int m_top;
+    int m_bottom; // exclusive
+    std::vector<uint32_t> m_colSums;
+    std::vector<uint64_t> m_colSqSums;
+
+    // Prefix sums of the above.  Unsigned overflow is fine for m_prefixSums,
+    // as differences are still correct as long as a window sum fits.
+    std::vector<uint32_t> m_prefixSums;
+    std::vector<uint64_t> m_prefixSqSums;
+    std::vector<double> m_means;
+    std::vector<double> m_deviations;
+};
+
+WindowStats::WindowStats(QImage const& gray, QSize const& window_size)
+    :   m_pGrayData(gray.bits()),
+        m_grayBpl(gray.bytesPerLine()),
+        m_width(gray.width()),
+        m_height(gray.height()),
+        m_windowLowerHalf(window_size.height() >> 1),
+        m_windowUpperHalf(window_size.height() - m_windowLowerHalf),
+        m_windowLeftHalf(window_size.width() >> 1),
+        m_windowRightHalf(window_size.width() - m_windowLeftHalf),
+        m_y(-2),
+        m_top(0),
+        m_bottom(0),
+        m_colSums(m_width, 0),
+        m_colSqSums(m_width, 0),
+        m_prefixSums(m_width + 1, 0),
+        m_prefixSqSums(m_width + 1, 0),
+        m_means(m_width),
+        m_deviations(m_width)
+{
+}
+
+void
+WindowStats::moveTo(int const y)
+{
+    int const top = std::max(0, y - m_windowLowerHalf);
+    int const bottom = std::min(m_height, y + m_windowUpperHalf); // exclusive
+
+    if (y != m_y + 1) {
+        std::fill(m_colSums.begin(), m_colSums.end(), 0);
+        std::fill(m_colSqSums.begin(), m_colSqSums.end(), 0);
+        for (int row = top; row < bottom; ++row) {
+            addRow(row);
+        }
+    } else {
+        for (int row = m_top; row < top; ++row) {
+            subtractRow(row);
+        }
+        for (int row = m_bottom; row < bottom; ++row) {
+            addRow(row);
+        }
+    }
+
+    m_y = y;
+    m_top = top;
+    m_bottom = bottom;
+
+    computeRow();
+}
+
+void
+WindowStats::addRow(int const y)
+{
+    uint8_t const* const line = m_pGrayData + m_grayBpl * y;
+    uint32_t* const sums = &m_colSums[0];
+    uint64_t* const sqsums = &m_colSqSums[0];
+    int const w = m_width;
+
+    for (int x = 0; x < w; ++x) {
+        uint32_t const pixel = line[x];
+        sums[x] += pixel;
+        sqsums[x] += pixel * pixel;
+    }
+}
+
+void
+WindowStats::subtractRow(int const y)
+{
+    uint8_t const* const line = m_pGrayData + m_grayBpl * y;
+    uint32_t* const sums = &m_colSums[0];
+    uint64_t* const sqsums = &m_colSqSums[0];
+    int const w = m_width;
+
+    for (int x = 0; x < w; ++x) {
+        uint32_t const pixel = line[x];
+        sums[x] -= pixel;
+        sqsums[x] -= pixel * pixel;
+    }
+}
+
+void
+WindowStats::computeRow()
+{
+    int const w = m_width;
+
+    uint32_t* const prefix = &m_prefixSums[0];
+    uint64_t* const sqprefix = &m_prefixSqSums[0];
+    for (int x = 0; x < w; ++x) {
+        prefix[x + 1] = prefix[x] + m_colSums[x];
+        sqprefix[x + 1] = sqprefix[x] + m_colSqSums[x];
+    }
+
+    int const window_height = m_bottom - m_top;
+    double* const means = &m_means[0];
+    double* const deviations = &m_deviations[0];
+
+    for (int x = 0; x < w; ++x) {
+        int const left = std::max(0, x - m_windowLeftHalf);
+        int const right = std::min(w, x + m_windowRightHalf); // exclusive
+        int const area = window_height * (right - left);
+        assert(area > 0); // because window_size > 0 and w > 0 and h > 0
+
+        double const window_sum = uint32_t(prefix[right] - prefix[left]);
+        double const window_sqsum = double(sqprefix[right] - sqprefix[left]);
+
+        double const r_area = 1.0 / area;
+        double const mean = window_sum * r_area;
+        double const sqmean = window_sqsum * r_area;
+        double const variance = sqmean - mean * mean;
+
+        means[x] = mean;
+        deviations[x] = sqrt(fabs(variance));
+    }
+}
+
+/**
+ * Rows are split into strips processed in parallel.  Each strip has to
+ * accumulate its initial window from scratch, so strips shouldn't be
+ * much shorter than the window.
+ */
+int stripHeight(QSize const& window_size, int const height)
+{
+    return std::max(64, std::min(height, window_size.height()));
+}
+
+/**
+ * Packs a row of black (true) / white (false) decisions 32 pixels
+ * at a time.  Bits past the end of the row are cleared.
+ */
+template<typename IsBlack>
+void packRow(uint32_t* const bw_line, int const width, IsBlack is_black)
+{
+    int const full_words = width >> 5;
+    int x = 0;
+
+    for (int i = 0; i < full_words; ++i) {
+        uint32_t word = 0;
+        for (int const end = x + 32; x < end; ++x) {
+            word = (word << 1) | uint32_t(is_black(x));
+        }
+        bw_line[i] = word;
+    }
+
+    int const tail = width & 31;
+    if (tail) {
+        uint32_t word = 0;
+        for (; x < width; ++x) {
+            word = (word << 1) | uint32_t(is_black(x));
+        }
+        bw_line[full_words] = word << (32 - tail);
+    }
+}
+
+} // anonymous namespace
+
 BinaryImage binarizeSauvola(QImage const& src, QSize const window_size)
 {
     if (window_size.isEmpty()) {
@@ -63,72 +281,47 @@ BinaryImage binarizeSauvola(QImage const& src, QSize const window_size)
     }
 
     QImage const gray(toGrayscale(src));
+
+    BinaryImage gpu_bw_img;
+    if (GpuCompute::binarizeSauvola(gray, window_size, gpu_bw_img)) {
+        return gpu_bw_img;
+    }
+
     int const w = gray.width();
     int const h = gray.height();
 
-    IntegralImage<uint32_t> integral_image(w, h);
-    IntegralImage<uint64_t> integral_sqimage(w, h);
-
-    uint8_t const* gray_line = gray.bits();
+    uint8_t const* const gray_data = gray.bits();
     int const gray_bpl = gray.bytesPerLine();
 
-    for (int y = 0; y < h; ++y, gray_line += gray_bpl) {
-        integral_image.beginRow();
-        integral_sqimage.beginRow();
-        for (int x = 0; x < w; ++x) {
-            uint32_t const pixel = gray_line[x];
-            integral_image.push(pixel);
-            integral_sqimage.push(pixel * pixel);
-        }
-    }
-
-    int const window_lower_half = window_size.height() >> 1;
-    int const window_upper_half = window_size.height() - window_lower_half;
-    int const window_left_half = window_size.width() >> 1;
-    int const window_right_half = window_size.width() - window_left_half;
-
     BinaryImage bw_img(w, h);
-    uint32_t* bw_line = bw_img.data();
+    uint32_t* const bw_data = bw_img.data();
     int const bw_wpl = bw_img.wordsPerLine();
 
-    gray_line = gray.bits();
-    for (int y = 0; y < h; ++y) {
-        int const top = std::max(0, y - window_lower_half);
-        int const bottom = std::min(h, y + window_upper_half); // exclusive
-
-        for (int x = 0; x < w; ++x) {
-            int const left = std::max(0, x - window_left_half);
-            int const right = std::min(w, x + window_right_half); // exclusive
-            int const area = (bottom - top) * (right - left);
-            assert(area > 0); // because window_size > 0 and w > 0 and h > 0
-
-            QRect const rect(left, top, right - left, bottom - top);
-            long double const window_sum = integral_image.sum(rect);
-            long double const window_sqsum = integral_sqimage.sum(rect);
-
-            long double const r_area = 1.0 / area;
-            long double const mean = window_sum * r_area;
-            long double const sqmean = window_sqsum * r_area;
-
-            long double const variance = sqmean - mean * mean;
-            long double const deviation = sqrt(fabs(variance));
-
-            long double const k = 0.34;
-            long double const threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
-
-            uint32_t const msb = uint32_t(1) << 31;
-            uint32_t const mask = msb >> (x & 31);
-            if (int(gray_line[x]) < threshold) {
-                // black
-                bw_line[x >> 5] |= mask;
-            } else {
-                // white
-                bw_line[x >> 5] &= ~mask;
+    int const strip_height = stripHeight(window_size, h);
+    int const num_strips = (h + strip_height - 1) / strip_height;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        WindowStats stats(gray, window_size);
+        std::vector<double> thresholds(w);
+
+        int const y_end = std::min(h, (strip + 1) * strip_height);
+        for (int y = strip * strip_height; y < y_end; ++y) {
+            stats.moveTo(y);
+            double const* const means = stats.means();
+            double const* const deviations = stats.deviations();
+
+            double const k = 0.34;
+            for (int x = 0; x < w; ++x) {
+                thresholds[x] = means[x] * (1.0 + k * (deviations[x] / 128.0 - 1.0));
             }
-        }
 
-        gray_line += gray_bpl;
-        bw_line += bw_wpl;
+            uint8_t const* const gray_line = gray_data + gray_bpl * y;
+            double const* const thr = &thresholds[0];
+            packRow(bw_data + bw_wpl * y, w, [=](int x) {
+                return int(gray_line[x]) < thr[x];
+            });
+        }
     }
 
     return bw_img;
@@ -147,90 +340,84 @@ BinaryImage binarizeWolf(
     }
 
     QImage const gray(toGrayscale(src));
+
+    BinaryImage gpu_bw_img;
+    if (GpuCompute::binarizeWolf(gray, window_size, lower_bound, upper_bound, gpu_bw_img)) {
+        return gpu_bw_img;
+    }
+
     int const w = gray.width();
     int const h = gray.height();
 
-    IntegralImage<uint32_t> integral_image(w, h);
-    IntegralImage<uint64_t> integral_sqimage(w, h);
-
-    uint8_t const* gray_line = gray.bits();
+    uint8_t const* const gray_data = gray.bits();
     int const gray_bpl = gray.bytesPerLine();
 
-    uint32_t min_gray_level = 255;
+    int const strip_height = stripHeight(window_size, h);
+    int const num_strips = (h + strip_height - 1) / strip_height;
+
+    // The threshold depends on global extremes, so we make two passes,
+    // computing window statistics twice rather than storing them.
+    std::vector<double> strip_max_deviations(num_strips, 0);
+    std::vector<uint32_t> strip_min_gray_levels(num_strips, 255);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        WindowStats stats(gray, window_size);
+        double max_deviation = 0;
+        uint32_t min_gray_level = 255;
+
+        int const y_end = std::min(h, (strip + 1) * strip_height);
+        for (int y = strip * strip_height; y < y_end; ++y) {
+            stats.moveTo(y);
+            double const* const deviations = stats.deviations();
+            for (int x = 0; x < w; ++x) {
+                max_deviation = std::max(max_deviation, deviations[x]);
+            }
 
-    for (int y = 0; y < h; ++y, gray_line += gray_bpl) {
-        integral_image.beginRow();
-        integral_sqimage.beginRow();
-        for (int x = 0; x < w; ++x) {
-            uint32_t const pixel = gray_line[x];
-            integral_image.push(pixel);
-            integral_sqimage.push(pixel * pixel);
-            min_gray_level = std::min(min_gray_level, pixel);
+            uint8_t const* const gray_line = gray_data + gray_bpl * y;
+            for (int x = 0; x < w; ++x) {
+                min_gray_level = std::min<uint32_t>(min_gray_level, gray_line[x]);
+            }
         }
-    }
 
-    int const window_lower_half = window_size.height() >> 1;
-    int const window_upper_half = window_size.height() - window_lower_half;
-    int const window_left_half = window_size.width() >> 1;
-    int const window_right_half = window_size.width() - window_left_half;
-
-    std::vector<float> means(w * h, 0);
-    std::vector<float> deviations(w * h, 0);
-
-    long double max_deviation = 0;
-
-    for (int y = 0; y < h; ++y) {
-        int const top = std::max(0, y - window_lower_half);
-        int const bottom = std::min(h, y + window_upper_half); // exclusive
-
-        for (int x = 0; x < w; ++x) {
-            int const left = std::max(0, x - window_left_half);
-            int const right = std::min(w, x + window_right_half); // exclusive
-            int const area = (bottom - top) * (right - left);
-            assert(area > 0); // because window_size > 0 and w > 0 and h > 0
-
-            QRect const rect(left, top, right - left, bottom - top);
-            long double const window_sum = integral_image.sum(rect);
-            long double const window_sqsum = integral_sqimage.sum(rect);
-
-            long double const r_area = 1.0 / area;
-            long double const mean = window_sum * r_area;
-            long double const sqmean = window_sqsum * r_area;
-
-            long double const variance = sqmean - mean * mean;
-            long double const deviation = sqrt(fabs(variance));
-            max_deviation = std::max(max_deviation, deviation);
-            means[w * y + x] = mean;
-            deviations[w * y + x] = deviation;
-        }
+        strip_max_deviations[strip] = max_deviation;
+        strip_min_gray_levels[strip] = min_gray_level;
     }
 
-    // TODO: integral images can be disposed at this point.
+    double const max_deviation = *std::max_element(
+                                     strip_max_deviations.begin(), strip_max_deviations.end()
+                                 );
+    double const min_gray_level = *std::min_element(
+                                      strip_min_gray_levels.begin(), strip_min_gray_levels.end()
+                                  );
 
     BinaryImage bw_img(w, h);
-    uint32_t* bw_line = bw_img.data();
+    uint32_t* const bw_data = bw_img.data();
     int const bw_wpl = bw_img.wordsPerLine();
 
-    gray_line = gray.bits();
-    for (int y = 0; y < h; ++y, gray_line += gray_bpl, bw_line += bw_wpl) {
-        for (int x = 0; x < w; ++x) {
-            float const mean = means[y * w + x];
-            float const deviation = deviations[y * w + x];
-            long double const k = 0.3;
-            long double const a = 1.0 - deviation / max_deviation;
-            long double const threshold = mean - k * a * (mean - min_gray_level);
-
-            uint32_t const msb = uint32_t(1) << 31;
-            uint32_t const mask = msb >> (x & 31);
-            if (gray_line[x] < lower_bound ||
-                    (gray_line[x] <= upper_bound &&
-                     int(gray_line[x]) < threshold)) {
-                // black
-                bw_line[x >> 5] |= mask;
-            } else {
-                // white
-                bw_line[x >> 5] &= ~mask;
+    #pragma omp parallel for schedule(dynamic)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        WindowStats stats(gray, window_size);
+        std::vector<double> thresholds(w);
+
+        int const y_end = std::min(h, (strip + 1) * strip_height);
+        for (int y = strip * strip_height; y < y_end; ++y) {
+            stats.moveTo(y);
+            double const* const means = stats.means();
+            double const* const deviations = stats.deviations();
+
+            double const k = 0.3;
+            for (int x = 0; x < w; ++x) {
+                double const a = 1.0 - deviations[x] / max_deviation;
+                thresholds[x] = means[x] - k * a * (means[x] - min_gray_level);
             }
+
+            uint8_t const* const gray_line = gray_data + gray_bpl * y;
+            double const* const thr = &thresholds[0];
+            packRow(bw_data + bw_wpl * y, w, [=](int x) {
+                return gray_line[x] < lower_bound ||
+                       (gray_line[x] <= upper_bound && int(gray_line[x]) < thr[x]);
+            });
         }
     }
 
@@ -19,6 +19,8 @@
 #include "BinaryImage.h"
 #include "ByteOrder.h"
 #include "BitOps.h"
+#include "Kernels.h"
+#include "PixelBufferPool.h"
 #include <QAtomicInt>
 #include <QImage>
 #include <QRect>
@@ -26,6 +28,7 @@
 #include <memory>
 #include <stdexcept>
 #include <algorithm>
+#include <utility>
 #include <iostream>
 #include <stddef.h>
 #include <stdlib.h>
@@ -84,6 +87,14 @@ public:
 private:
     SharedData() : m_refCounter(1) {}
 
+    /**
+     * The pool aligns the start of a buffer, but we want the pixels
+     * aligned, so the object is placed this far into the buffer.
+     */
+    static size_t offsetInBuffer();
+
+    static void releaseStorage(void const* addr);
+
     SharedData& operator=(SharedData const&); // forbidden
 
     mutable QAtomicInt m_refCounter;
@@ -167,6 +178,18 @@ BinaryImage::BinaryImage(BinaryImage const& other)
     }
 }
 
+BinaryImage::BinaryImage(BinaryImage&& other)
+    :   m_pData(other.m_pData),
+        m_width(other.m_width),
+        m_height(other.m_height),
+        m_wpl(other.m_wpl)
+{
+    other.m_pData = 0;
+    other.m_width = 0;
+    other.m_height = 0;
+    other.m_wpl = 0;
+}
+
 BinaryImage::BinaryImage(QImage const& image, BinaryThreshold const threshold)
     :   m_pData(0),
         m_width(0),
@@ -256,6 +279,13 @@ BinaryImage::operator=(BinaryImage const& other)
     return *this;
 }
 
+BinaryImage&
+BinaryImage::operator=(BinaryImage&& other)
+{
+    BinaryImage(std::move(other)).swap(*this);
+    return *this;
+}
+
 void
 BinaryImage::swap(BinaryImage& other)
 {
@@ -472,13 +502,12 @@ BinaryImage::countBlackPixels(QRect const& rect) const
             }
         }
     } else {
+        Kernels::CountBitsFunc const count_bits = Kernels::active().countBits;
+        int const inner_words = last_word_idx - first_word_idx - 1;
         for (int y = top; y <= bottom; ++y, line += m_wpl) {
-            int idx = first_word_idx;
-            count += countNonZeroBits(line[idx] & first_word_mask);
-            for (++idx; idx != last_word_idx; ++idx) {
-                count += countNonZeroBits(line[idx]);
-            }
-            count += countNonZeroBits(line[idx] & last_word_mask);
+            count += countNonZeroBits(line[first_word_idx] & first_word_mask);
+            count += count_bits(line + first_word_idx + 1, inner_words);
+            count += countNonZeroBits(line[last_word_idx] & last_word_mask);
         }
     }
 
@@ -569,6 +598,74 @@ BinaryImage::contentBoundingBox(BWColor const content_color) const
     return QRect(left, top, w - right - left, bottom - top + 1);
 }
 
+QRect
+BinaryImage::contentBoundingBox(BWColor const content_color, int& num_content_pixels) const
+{
+    num_content_pixels = 0;
+
+    if (isNull()) {
+        return QRect();
+    }
+
+    int const w = m_width;
+    int const h = m_height;
+    int const wpl = m_wpl;
+    int const last_word_idx = (w - 1) >> 5;
+    int const last_word_unused_bits = (last_word_idx << 5) + 31 - (w - 1);
+    uint32_t const last_word_mask = ~uint32_t(0) << last_word_unused_bits;
+    uint32_t const modifier = (content_color == WHITE) ? ~uint32_t(0) : 0;
+    Kernels::CountBitsFunc const count_bits = Kernels::active().countBits;
+
+    int top = -1;
+    int bottom = -1;
+    int left = w; // inclusive
+    int right = -1; // inclusive
+
+    uint32_t const* line = data();
+    for (int y = 0; y < h; ++y, line += wpl) {
+        int const black = count_bits(line, last_word_idx)
+                          + countNonZeroBits(line[last_word_idx] & last_word_mask);
+        int const content = content_color == BLACK ? black : w - black;
+        if (content == 0) {
+            continue;
+        }
+
+        num_content_pixels += content;
+        if (top == -1) {
+            top = y;
+        }
+        bottom = y;
+
+        // Only the words that could extend the box are looked at.
+        for (int idx = 0; idx <= (left >> 5) && idx <= last_word_idx; ++idx) {
+            uint32_t word = line[idx] ^ modifier;
+            if (idx == last_word_idx) {
+                word &= last_word_mask;
+            }
+            if (word) {
+                left = std::min(left, (idx << 5) + countMostSignificantZeroes(word));
+                break;
+            }
+        }
+        for (int idx = last_word_idx; idx >= 0 && idx >= (right >> 5); --idx) {
+            uint32_t word = line[idx] ^ modifier;
+            if (idx == last_word_idx) {
+                word &= last_word_mask;
+            }
+            if (word) {
+                right = std::max(right, (idx << 5) + 31 - countLeastSignificantZeroes(word));
+                break;
+            }
+        }
+    }
+
+    if (top == -1) {
+        return QRect();
+    }
+
+    return QRect(left, top, right - left + 1, bottom - top + 1);
+}
+
 static const int MultiplyDeBruijnBitPosition[32] = {
     0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
     31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
@@ -1417,25 +1514,41 @@ BinaryImage::SharedData::unref() const
 {
     if (!m_refCounter.deref()) {
         this->~SharedData();
-        free((void*)this);
+        releaseStorage(this);
     }
 }
 
+size_t
+BinaryImage::SharedData::offsetInBuffer()
+{
+    SharedData* sd = 0;
+    size_t const data_offset = (char*)&sd->m_data[0] - (char*)sd;
+    size_t const alignment = PixelBufferPool::ALIGNMENT;
+    return ((data_offset + alignment - 1) & ~(alignment - 1)) - data_offset;
+}
+
+void
+BinaryImage::SharedData::releaseStorage(void const* addr)
+{
+    PixelBufferPool::release((char*)addr - offsetInBuffer());
+}
+
 void*
 BinaryImage::SharedData::operator new (size_t, NumWords const num_words)
 {
     SharedData* sd = 0;
-    void* addr = malloc(((char*)&sd->m_data[0] - (char*)sd) + num_words.numWords * 4);
-    if (!addr) {
-        throw std::bad_alloc();
-    }
-    return addr;
+    size_t const data_offset = (char*)&sd->m_data[0] - (char*)sd;
+    size_t const offset = offsetInBuffer();
+    char* const buffer = static_cast<char*>(
+                             PixelBufferPool::allocate(offset + data_offset + num_words.numWords * 4)
+                         );
+    return buffer + offset;
 }
 
 void
 BinaryImage::SharedData::operator delete (void* addr, NumWords)
 {
-    free(addr);
+    releaseStorage(addr);
 }
 
 } // namespace imageproc
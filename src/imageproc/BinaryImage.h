@@ -85,6 +85,14 @@ public:
      */
     BinaryImage(BinaryImage const& other);
 
+    /**
+     * \brief Takes over the data of another image, leaving it null.
+     *
+     * Unlike copying, this leaves no second reference to the data behind,
+     * so a subsequent non-const access doesn't have to make a private copy.
+     */
+    BinaryImage(BinaryImage&& other);
+
     /**
      * \brief Create a new image by copying the contents of a QImage.
      *
@@ -118,6 +126,8 @@ public:
      */
     BinaryImage& operator=(BinaryImage const& other);
 
+    BinaryImage& operator=(BinaryImage&& other);
+
     /**
      * \brief Returns true if the image is null.
      *
@@ -204,6 +214,15 @@ public:
      */
     QRect contentBoundingBox(BWColor content_color = BLACK) const;
 
+    /**
+     * \brief Calculates the bounding box of either black or white content,
+     *        along with the number of content pixels.
+     *
+     * Does in a single pass what contentBoundingBox() followed by
+     * countBlackPixels() or countWhitePixels() would do in two.
+     */
+    QRect contentBoundingBox(BWColor content_color, int& num_content_pixels) const;
+
     void rectangularize(BWColor content_color, std::vector<QRect>& areas, int sensitivity);
 
     int width() const
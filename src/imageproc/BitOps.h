@@ -19,6 +19,8 @@
 #ifndef IMAGEPROC_BITOPS_H_
 #define IMAGEPROC_BITOPS_H_
 
+#include <type_traits>
+
 namespace imageproc
 {
 
@@ -162,9 +164,26 @@ struct LeastSignificantZeroes<T, 0> {
 
 } // namespace detail
 
+/*
+ * With GCC and Clang, the functions below use builtins for types of up
+ * to 64 bits.  Those become POPCNT, LZCNT / BSR and TZCNT / BSF where
+ * the target has them.  BSR and BSF are always there on x86, while
+ * POPCNT is taken only when enabled, as with -mpopcnt or -march=native.
+ * Lookup tables are the fallback elsewhere.  Counting bits of whole
+ * lines is better done with Kernels::countBits().
+ */
+
 template<typename T>
 int countNonZeroBits(T const val)
 {
+#if defined(__GNUC__)
+    typedef typename std::make_unsigned<T>::type U;
+    if (sizeof(T) <= sizeof(unsigned)) {
+        return __builtin_popcount(static_cast<U>(val));
+    } else if (sizeof(T) <= sizeof(unsigned long long)) {
+        return __builtin_popcountll(static_cast<U>(val));
+    }
+#endif
     return detail::NonZeroBits<T, sizeof(T)>::count(val);
 }
 
@@ -180,6 +199,18 @@ int countMostSignificantZeroes(T const val)
     static int const total_bits = sizeof(T) * 8;
     int zeroes = total_bits;
 
+#if defined(__GNUC__)
+    typedef typename std::make_unsigned<T>::type U;
+    if (!val) {
+        return zeroes;
+    } else if (sizeof(T) <= sizeof(unsigned)) {
+        return __builtin_clz(static_cast<U>(val)) - int(sizeof(unsigned) * 8 - total_bits);
+    } else if (sizeof(T) <= sizeof(unsigned long long)) {
+        return __builtin_clzll(static_cast<U>(val))
+               - int(sizeof(unsigned long long) * 8 - total_bits);
+    }
+#endif
+
     if (val) {
         zeroes = detail::MostSignificantZeroes < T, total_bits / 2 >::reduce(
                      val, zeroes
@@ -195,6 +226,17 @@ int countLeastSignificantZeroes(T const val)
     static int const total_bits = sizeof(T) * 8;
     int zeroes = total_bits;
 
+#if defined(__GNUC__)
+    typedef typename std::make_unsigned<T>::type U;
+    if (!val) {
+        return zeroes;
+    } else if (sizeof(T) <= sizeof(unsigned)) {
+        return __builtin_ctz(static_cast<U>(val));
+    } else if (sizeof(T) <= sizeof(unsigned long long)) {
+        return __builtin_ctzll(static_cast<U>(val));
+    }
+#endif
+
     if (val) {
         zeroes = detail::LeastSignificantZeroes < T, total_bits / 2 >::reduce(
                      val, zeroes
@@ -0,0 +1,276 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CcittG4Encoder.h"
+#include "BinaryImage.h"
+#include "BitOps.h"
+#include <assert.h>
+
+namespace imageproc
+{
+
+/*
+ * Code tables from ITU-T T.4.  The makeup tables cover run lengths
+ * of 64 to 2560 in steps of 64, the ones from 1792 up being shared
+ * by both colors.
+ */
+
+CcittG4Encoder::Code const CcittG4Encoder::m_whiteTerminating[64] = {
+    { 0x035, 8 }, { 0x007, 6 }, { 0x007, 4 }, { 0x008, 4 },
+    { 0x00b, 4 }, { 0x00c, 4 }, { 0x00e, 4 }, { 0x00f, 4 },
+    { 0x013, 5 }, { 0x014, 5 }, { 0x007, 5 }, { 0x008, 5 },
+    { 0x008, 6 }, { 0x003, 6 }, { 0x034, 6 }, { 0x035, 6 },
+    { 0x02a, 6 }, { 0x02b, 6 }, { 0x027, 7 }, { 0x00c, 7 },
+    { 0x008, 7 }, { 0x017, 7 }, { 0x003, 7 }, { 0x004, 7 },
+    { 0x028, 7 }, { 0x02b, 7 }, { 0x013, 7 }, { 0x024, 7 },
+    { 0x018, 7 }, { 0x002, 8 }, { 0x003, 8 }, { 0x01a, 8 },
+    { 0x01b, 8 }, { 0x012, 8 }, { 0x013, 8 }, { 0x014, 8 },
+    { 0x015, 8 }, { 0x016, 8 }, { 0x017, 8 }, { 0x028, 8 },
+    { 0x029, 8 }, { 0x02a, 8 }, { 0x02b, 8 }, { 0x02c, 8 },
+    { 0x02d, 8 }, { 0x004, 8 }, { 0x005, 8 }, { 0x00a, 8 },
+    { 0x00b, 8 }, { 0x052, 8 }, { 0x053, 8 }, { 0x054, 8 },
+    { 0x055, 8 }, { 0x024, 8 }, { 0x025, 8 }, { 0x058, 8 },
+    { 0x059, 8 }, { 0x05a, 8 }, { 0x05b, 8 }, { 0x04a, 8 },
+    { 0x04b, 8 }, { 0x032, 8 }, { 0x033, 8 }, { 0x034, 8 }
+};
+
+CcittG4Encoder::Code const CcittG4Encoder::m_whiteMakeup[40] = {
+    { 0x01b, 5 }, { 0x012, 5 }, { 0x017, 6 }, { 0x037, 7 },
+    { 0x036, 8 }, { 0x037, 8 }, { 0x064, 8 }, { 0x065, 8 },
+    { 0x068, 8 }, { 0x067, 8 }, { 0x0cc, 9 }, { 0x0cd, 9 },
+    { 0x0d2, 9 }, { 0x0d3, 9 }, { 0x0d4, 9 }, { 0x0d5, 9 },
+    { 0x0d6, 9 }, { 0x0d7, 9 }, { 0x0d8, 9 }, { 0x0d9, 9 },
+    { 0x0da, 9 }, { 0x0db, 9 }, { 0x098, 9 }, { 0x099, 9 },
+    { 0x09a, 9 }, { 0x018, 6 }, { 0x09b, 9 }, { 0x008, 11 },
+    { 0x00c, 11 }, { 0x00d, 11 }, { 0x012, 12 }, { 0x013, 12 },
+    { 0x014, 12 }, { 0x015, 12 }, { 0x016, 12 }, { 0x017, 12 },
+    { 0x01c, 12 }, { 0x01d, 12 }, { 0x01e, 12 }, { 0x01f, 12 }
+};
+
+CcittG4Encoder::Code const CcittG4Encoder::m_blackTerminating[64] = {
+    { 0x037, 10 }, { 0x002, 3 }, { 0x003, 2 }, { 0x002, 2 },
+    { 0x003, 3 }, { 0x003, 4 }, { 0x002, 4 }, { 0x003, 5 },
+    { 0x005, 6 }, { 0x004, 6 }, { 0x004, 7 }, { 0x005, 7 },
+    { 0x007, 7 }, { 0x004, 8 }, { 0x007, 8 }, { 0x018, 9 },
+    { 0x017, 10 }, { 0x018, 10 }, { 0x008, 10 }, { 0x067, 11 },
+    { 0x068, 11 }, { 0x06c, 11 }, { 0x037, 11 }, { 0x028, 11 },
+    { 0x017, 11 }, { 0x018, 11 }, { 0x0ca, 12 }, { 0x0cb, 12 },
+    { 0x0cc, 12 }, { 0x0cd, 12 }, { 0x068, 12 }, { 0x069, 12 },
+    { 0x06a, 12 }, { 0x06b, 12 }, { 0x0d2, 12 }, { 0x0d3, 12 },
+    { 0x0d4, 12 }, { 0x0d5, 12 }, { 0x0d6, 12 }, { 0x0d7, 12 },
+    { 0x06c, 12 }, { 0x06d, 12 }, { 0x0da, 12 }, { 0x0db, 12 },
+    { 0x054, 12 }, { 0x055, 12 }, { 0x056, 12 }, { 0x057, 12 },
+    { 0x064, 12 }, { 0x065, 12 }, { 0x052, 12 }, { 0x053, 12 },
+    { 0x024, 12 }, { 0x037, 12 }, { 0x038, 12 }, { 0x027, 12 },
+    { 0x028, 12 }, { 0x058, 12 }, { 0x059, 12 }, { 0x02b, 12 },
+    { 0x02c, 12 }, { 0x05a, 12 }, { 0x066, 12 }, { 0x067, 12 }
+};
+
+CcittG4Encoder::Code const CcittG4Encoder::m_blackMakeup[40] = {
+    { 0x00f, 10 }, { 0x0c8, 12 }, { 0x0c9, 12 }, { 0x05b, 12 },
+    { 0x033, 12 }, { 0x034, 12 }, { 0x035, 12 }, { 0x06c, 13 },
+    { 0x06d, 13 }, { 0x04a, 13 }, { 0x04b, 13 }, { 0x04c, 13 },
+    { 0x04d, 13 }, { 0x072, 13 }, { 0x073, 13 }, { 0x074, 13 },
+    { 0x075, 13 }, { 0x076, 13 }, { 0x077, 13 }, { 0x052, 13 },
+    { 0x053, 13 }, { 0x054, 13 }, { 0x055, 13 }, { 0x05a, 13 },
+    { 0x05b, 13 }, { 0x064, 13 }, { 0x065, 13 }, { 0x008, 11 },
+    { 0x00c, 11 }, { 0x00d, 11 }, { 0x012, 12 }, { 0x013, 12 },
+    { 0x014, 12 }, { 0x015, 12 }, { 0x016, 12 }, { 0x017, 12 },
+    { 0x01c, 12 }, { 0x01d, 12 }, { 0x01e, 12 }, { 0x01f, 12 }
+};
+
+/**
+ * Vertical mode codes, indexed by a1 - b1 + 3.
+ */
+CcittG4Encoder::Code const CcittG4Encoder::m_vertical[7] = {
+    { 0x02, 7 }, { 0x02, 6 }, { 0x02, 3 }, { 0x01, 1 },
+    { 0x03, 3 }, { 0x03, 6 }, { 0x03, 7 }
+};
+
+CcittG4Encoder::CcittG4Encoder(int const width)
+    :   m_width(width),
+        m_bitBuffer(0),
+        m_bitCount(0)
+{
+    assert(width > 0);
+
+    // An all-white reference line.  The extra copies of the width
+    // let b1 and b2 be looked up without bounds checks.
+    m_refChanges.assign(3, width);
+    m_curChanges.reserve(64);
+}
+
+void
+CcittG4Encoder::encodeLine(uint32_t const* const line)
+{
+    findChanges(line, m_curChanges);
+
+    // a0 starts as an imaginary white pixel before the first one.
+    int a0 = -1;
+    int a0_color = 0; // 1 for black.
+    int const* a = &m_curChanges[0];
+    int const* b = &m_refChanges[0];
+
+    for (;;) {
+        while (*a <= a0) {
+            ++a;
+        }
+        while (*b <= a0) {
+            ++b;
+        }
+
+        // Changes at even indexes are white to black ones.
+        // b1 has to be of the color opposite to that of a0.
+        int const* b1 = b;
+        if (((b1 - &m_refChanges[0]) & 1) != a0_color) {
+            ++b1;
+        }
+
+        int const a1 = a[0];
+        int const b2 = b1[1];
+        if (b2 < a1) {
+            // Pass mode.
+            putBits(0x1, 4);
+            a0 = b2;
+        } else {
+            int const delta = a1 - b1[0];
+            if (delta >= -3 && delta <= 3) {
+                putCode(m_vertical[delta + 3]);
+                a0 = a1;
+                a0_color ^= 1;
+            } else {
+                // Horizontal mode.
+                int const a2 = a[1];
+                int const run1 = a1 - (a0 < 0 ? 0 : a0);
+                putBits(0x1, 3);
+                if (a0_color) {
+                    putRun(run1, m_blackTerminating, m_blackMakeup);
+                    putRun(a2 - a1, m_whiteTerminating, m_whiteMakeup);
+                } else {
+                    putRun(run1, m_whiteTerminating, m_whiteMakeup);
+                    putRun(a2 - a1, m_blackTerminating, m_blackMakeup);
+                }
+                a0 = a2;
+            }
+        }
+
+        if (a0 >= m_width) {
+            break;
+        }
+    }
+
+    m_refChanges.swap(m_curChanges);
+}
+
+QByteArray
+CcittG4Encoder::finish()
+{
+    // EOFB, which is two EOLs.
+    putBits(0x001, 12);
+    putBits(0x001, 12);
+    if (m_bitCount > 0) {
+        m_data.append(char(m_bitBuffer << (8 - m_bitCount)));
+        m_bitCount = 0;
+    }
+
+    QByteArray data;
+    data.swap(m_data);
+    return data;
+}
+
+QByteArray
+CcittG4Encoder::encode(BinaryImage const& image, int const top, int const rows)
+{
+    assert(!image.isNull());
+    assert(top >= 0 && rows >= 0 && top + rows <= image.height());
+
+    CcittG4Encoder encoder(image.width());
+    int const wpl = image.wordsPerLine();
+    uint32_t const* line = image.data() + top * wpl;
+    for (int i = 0; i < rows; ++i, line += wpl) {
+        encoder.encodeLine(line);
+    }
+    return encoder.finish();
+}
+
+QByteArray
+CcittG4Encoder::encode(BinaryImage const& image)
+{
+    return encode(image, 0, image.height());
+}
+
+/**
+ * Lists the positions of pixels that differ from the pixel to the left,
+ * the one to the left of the first pixel being white, then terminates
+ * the list with three copies of the width.
+ */
+void
+CcittG4Encoder::findChanges(uint32_t const* const line, std::vector<int>& changes) const
+{
+    changes.clear();
+
+    int const last_word_idx = (m_width - 1) >> 5;
+    uint32_t const last_word_mask = ~uint32_t(0) << (31 - ((m_width - 1) & 31));
+
+    uint32_t prev_bit = 0; // The last pixel of the previous word.
+    for (int i = 0; i <= last_word_idx; ++i) {
+        uint32_t const word = (i == last_word_idx) ? line[i] & last_word_mask : line[i];
+        uint32_t diff = word ^ ((word >> 1) | (prev_bit << 31));
+        prev_bit = word & 1;
+        if (i == last_word_idx) {
+            // Don't report the transition to the zero padding.
+            diff &= last_word_mask;
+        }
+
+        int const x0 = i << 5;
+        while (diff) {
+            int const bit = countMostSignificantZeroes(diff);
+            changes.push_back(x0 + bit);
+            diff &= ~(uint32_t(0x80000000) >> bit);
+        }
+    }
+
+    changes.insert(changes.end(), 3, m_width);
+}
+
+void
+CcittG4Encoder::putBits(uint32_t const bits, int const length)
+{
+    m_bitBuffer = (m_bitBuffer << length) | bits;
+    m_bitCount += length;
+    while (m_bitCount >= 8) {
+        m_bitCount -= 8;
+        m_data.append(char(m_bitBuffer >> m_bitCount));
+    }
+}
+
+void
+CcittG4Encoder::putRun(int run, Code const* const terminating, Code const* const makeup)
+{
+    while (run >= 2624) {
+        putCode(makeup[2560 / 64 - 1]);
+        run -= 2560;
+    }
+    if (run >= 64) {
+        putCode(makeup[run / 64 - 1]);
+        run &= 63;
+    }
+    putCode(terminating[run]);
+}
+
+} // namespace imageproc
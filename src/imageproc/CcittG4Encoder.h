@@ -0,0 +1,112 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_CCITTG4ENCODER_H_
+#define IMAGEPROC_CCITTG4ENCODER_H_
+
+#include "NonCopyable.h"
+#include <QByteArray>
+#include <vector>
+#include <stdint.h>
+
+namespace imageproc
+{
+
+class BinaryImage;
+
+/**
+ * \brief Encodes bilevel images as CCITT Group 4 (ITU-T T.6) data.
+ *
+ * Lines are taken in BinaryImage's own layout: 32-bit words, the most
+ * significant bit being the leftmost pixel and 1 being black.  Color
+ * changes are located a word at a time, so long runs cost next to nothing
+ * and no repacking into bytes is necessary.
+ *
+ * The output is what libtiff's COMPRESSION_CCITTFAX4 codec produces for
+ * a strip with FILLORDER_MSB2LSB, and what the PDF CCITTFaxDecode filter
+ * takes with K = -1.  Black pixels are coded as black runs, so with
+ * PHOTOMETRIC_MINISWHITE, or the default BlackIs1 = false in PDF, they
+ * come out black.
+ *
+ * Every encoder starts with an all-white reference line, so separate
+ * strips may be encoded by separate encoders in parallel.
+ */
+class CcittG4Encoder
+{
+    DECLARE_NON_COPYABLE(CcittG4Encoder)
+public:
+    explicit CcittG4Encoder(int width);
+
+    /**
+     * \brief Encodes the next line.
+     *
+     * \param line (width + 31) / 32 words of pixels.  Bits past the
+     *        width of the image are ignored.
+     */
+    void encodeLine(uint32_t const* line);
+
+    /**
+     * \brief Terminates the data with EOFB and returns it.
+     *
+     * The encoder may not be used afterwards.
+     */
+    QByteArray finish();
+
+    /**
+     * \brief Encodes \p rows lines of \p image, starting from \p top.
+     */
+    static QByteArray encode(BinaryImage const& image, int top, int rows);
+
+    /**
+     * \brief Encodes the whole image.
+     */
+    static QByteArray encode(BinaryImage const& image);
+private:
+    struct Code {
+        uint16_t bits;
+        uint8_t length;
+    };
+
+    void findChanges(uint32_t const* line, std::vector<int>& changes) const;
+
+    void putCode(Code const& code)
+    {
+        putBits(code.bits, code.length);
+    }
+
+    void putBits(uint32_t bits, int length);
+
+    void putRun(int run, Code const* terminating, Code const* makeup);
+
+    static Code const m_whiteTerminating[64];
+    static Code const m_whiteMakeup[40];
+    static Code const m_blackTerminating[64];
+    static Code const m_blackMakeup[40];
+    static Code const m_vertical[7];
+
+    int m_width;
+    std::vector<int> m_refChanges;
+    std::vector<int> m_curChanges;
+    QByteArray m_data;
+    uint32_t m_bitBuffer;
+    int m_bitCount;
+};
+
+} // namespace imageproc
+
+#endif
@@ -0,0 +1,88 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CompactConnectivityMap.h"
+#include "ConnectivityMap.h"
+#include <QImage>
+#include <algorithm>
+
+namespace imageproc
+{
+
+namespace
+{
+
+template<typename T>
+void copyLabels(ConnectivityMap const& cmap, std::vector<T>& labels)
+{
+    int const width = cmap.size().width();
+    int const height = cmap.size().height();
+    labels.resize(width * height);
+
+    T* const dst_data = &labels[0];
+    uint32_t const* const src_data = cmap.data();
+    int const src_stride = cmap.stride();
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        T* dst_line = dst_data + y * width;
+        uint32_t const* src_line = src_data + y * src_stride;
+        for (int x = 0; x < width; ++x) {
+            dst_line[x] = static_cast<T>(src_line[x]);
+        }
+    }
+}
+
+} // anonymous namespace
+
+CompactConnectivityMap::CompactConnectivityMap()
+    :   m_maxLabel(0)
+{
+}
+
+CompactConnectivityMap::CompactConnectivityMap(ConnectivityMap const& cmap)
+    :   m_size(cmap.size()),
+        m_maxLabel(cmap.maxLabel())
+{
+    if (m_size.isEmpty()) {
+        return;
+    }
+
+    if (m_maxLabel <= 0xffff) {
+        copyLabels(cmap, m_narrowLabels);
+    } else {
+        copyLabels(cmap, m_wideLabels);
+    }
+}
+
+void
+CompactConnectivityMap::swap(CompactConnectivityMap& other)
+{
+    m_narrowLabels.swap(other.m_narrowLabels);
+    m_wideLabels.swap(other.m_wideLabels);
+    std::swap(m_size, other.m_size);
+    std::swap(m_maxLabel, other.m_maxLabel);
+}
+
+QImage
+CompactConnectivityMap::visualized(QColor const bgcolor) const
+{
+    return ConnectivityMap(*this).visualized(bgcolor);
+}
+
+} // namespace imageproc
@@ -0,0 +1,105 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_COMPACT_CONNECTIVITY_MAP_H_
+#define IMAGEPROC_COMPACT_CONNECTIVITY_MAP_H_
+
+#include <QSize>
+#include <QColor>
+#include <Qt>
+#include <vector>
+#include <stdint.h>
+
+class QImage;
+
+namespace imageproc
+{
+
+class ConnectivityMap;
+
+/**
+ * \brief A read-only copy of a ConnectivityMap that takes less memory.
+ *
+ * Labels are stored as 16-bit integers when maxLabel() fits into them,
+ * and as 32-bit ones otherwise.  No padding is stored.  That makes it
+ * suitable for keeping labels around while something else runs, at
+ * 2 rather than 4 bytes per pixel in the common case.
+ *
+ * Code that needs data() pointers, like InfluenceMap or SEDM, should
+ * construct a ConnectivityMap from it.
+ */
+class CompactConnectivityMap
+{
+public:
+    /**
+     * \brief Constructs a null map.
+     */
+    CompactConnectivityMap();
+
+    explicit CompactConnectivityMap(ConnectivityMap const& cmap);
+
+    void swap(CompactConnectivityMap& other);
+
+    QSize size() const
+    {
+        return m_size;
+    }
+
+    uint32_t maxLabel() const
+    {
+        return m_maxLabel;
+    }
+
+    /**
+     * \brief Returns true if labels are stored as 16-bit integers.
+     */
+    bool isNarrow() const
+    {
+        return m_wideLabels.empty();
+    }
+
+    /**
+     * \brief Returns the label of a pixel.
+     *
+     * \p x and \p y must be within size().
+     */
+    uint32_t label(int x, int y) const
+    {
+        int const offset = y * m_size.width() + x;
+        return isNarrow() ? m_narrowLabels[offset] : m_wideLabels[offset];
+    }
+
+    /**
+     * \see ConnectivityMap::visualized()
+     */
+    QImage visualized(QColor bgcolor = Qt::black) const;
+private:
+    std::vector<uint16_t> m_narrowLabels;
+    std::vector<uint32_t> m_wideLabels;
+    QSize m_size;
+    uint32_t m_maxLabel;
+};
+
+inline void swap(CompactConnectivityMap& o1, CompactConnectivityMap& o2)
+{
+    o1.swap(o2);
+}
+
+} // namespace imageproc
+
+#endif
@@ -0,0 +1,186 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ConnCompExtractor.h"
+#include "RleBinaryImage.h"
+#include "BinaryImage.h"
+#include "BWColor.h"
+#include <QPoint>
+#include <QRect>
+#include <algorithm>
+
+namespace imageproc
+{
+
+namespace
+{
+
+struct BBox {
+    QPoint seed; // The first pixel in raster order.
+    int left;
+    int right; // Inclusive.
+    int top;
+    int bottom; // Inclusive.
+    int pixCount;
+};
+
+int findRoot(std::vector<int>& parent, int idx)
+{
+    while (parent[idx] != idx) {
+        parent[idx] = parent[parent[idx]];
+        idx = parent[idx];
+    }
+    return idx;
+}
+
+/**
+ * Keeps the smallest index as the root, so that the root of every
+ * component ends up being its first run in raster order.
+ */
+void unite(std::vector<int>& parent, int idx1, int idx2)
+{
+    idx1 = findRoot(parent, idx1);
+    idx2 = findRoot(parent, idx2);
+    if (idx1 < idx2) {
+        parent[idx2] = idx1;
+    } else if (idx2 < idx1) {
+        parent[idx1] = idx2;
+    }
+}
+
+} // anonymous namespace
+
+ConnCompExtractor::ConnCompExtractor(
+    BinaryImage const& image, Connectivity const conn, bool const keep_spans)
+{
+    if (keep_spans) {
+        m_spanStarts.push_back(0);
+    }
+
+    RleBinaryImage const rle(image);
+    int const num_runs = rle.numRuns();
+    if (num_runs == 0) {
+        return;
+    }
+
+    RleBinaryImage::Run const* const runs = rle.lineBegin(0);
+    int const height = rle.height();
+
+    // Runs on adjacent lines are connected if they overlap horizontally,
+    // or, for 8-connectivity, if they touch diagonally.
+    int const slack = conn == CONN8 ? 1 : 0;
+
+    std::vector<int> parent(num_runs);
+    std::vector<int> run_y(num_runs);
+    for (int y = 0; y < height; ++y) {
+        RleBinaryImage::Run const* const line_begin = rle.lineBegin(y);
+        RleBinaryImage::Run const* const line_end = rle.lineEnd(y);
+        for (RleBinaryImage::Run const* run = line_begin; run != line_end; ++run) {
+            int const idx = run - runs;
+            parent[idx] = idx;
+            run_y[idx] = y;
+        }
+
+        if (y == 0) {
+            continue;
+        }
+
+        RleBinaryImage::Run const* prev = rle.lineBegin(y - 1);
+        RleBinaryImage::Run const* const prev_end = rle.lineEnd(y - 1);
+        for (RleBinaryImage::Run const* run = line_begin; run != line_end; ++run) {
+            while (prev != prev_end && prev->xTo + slack <= run->xFrom) {
+                ++prev;
+            }
+            for (RleBinaryImage::Run const* p = prev;
+                 p != prev_end && p->xFrom < run->xTo + slack; ++p) {
+                unite(parent, p - runs, run - runs);
+            }
+        }
+    }
+
+    // Roots precede the rest of their components, so a single pass
+    // both numbers the components and accumulates their bounding boxes.
+    std::vector<int> label(num_runs);
+    std::vector<BBox> bboxes;
+    for (int idx = 0; idx < num_runs; ++idx) {
+        RleBinaryImage::Run const& run = runs[idx];
+        int const y = run_y[idx];
+        int const root = findRoot(parent, idx);
+        if (root == idx) {
+            BBox const bbox = {
+                QPoint(run.xFrom, y), run.xFrom, run.xTo - 1, y, y, run.xTo - run.xFrom
+            };
+            label[idx] = bboxes.size();
+            bboxes.push_back(bbox);
+        } else {
+            // label[root] was assigned in an earlier iteration.
+            int const lbl = label[root];
+            label[idx] = lbl;
+            BBox& bbox = bboxes[lbl];
+            bbox.left = std::min(bbox.left, run.xFrom);
+            bbox.right = std::max(bbox.right, run.xTo - 1);
+            bbox.bottom = y;
+            bbox.pixCount += run.xTo - run.xFrom;
+        }
+    }
+
+    m_connComps.reserve(bboxes.size());
+    for (BBox const& bbox : bboxes) {
+        QRect const rect(QPoint(bbox.left, bbox.top), QPoint(bbox.right, bbox.bottom));
+        m_connComps.push_back(ConnComp(bbox.seed, rect, bbox.pixCount));
+    }
+
+    if (!keep_spans) {
+        return;
+    }
+
+    // Group spans by component, keeping the raster order within groups.
+    m_spanStarts.assign(m_connComps.size() + 1, 0);
+    for (int idx = 0; idx < num_runs; ++idx) {
+        ++m_spanStarts[label[idx] + 1];
+    }
+    for (size_t i = 1; i < m_spanStarts.size(); ++i) {
+        m_spanStarts[i] += m_spanStarts[i - 1];
+    }
+
+    std::vector<int> next(m_spanStarts.begin(), m_spanStarts.end() - 1);
+    m_spans.resize(num_runs);
+    for (int idx = 0; idx < num_runs; ++idx) {
+        Span const span = { run_y[idx], runs[idx].xFrom, runs[idx].xTo };
+        m_spans[next[label[idx]]++] = span;
+    }
+}
+
+BinaryImage
+ConnCompExtractor::computeConnCompImage(size_t const idx) const
+{
+    QRect const& rect = m_connComps[idx].rect();
+    BinaryImage img(rect.size(), WHITE);
+
+    Span const* const end = spansEnd(idx);
+    for (Span const* span = spansBegin(idx); span != end; ++span) {
+        img.fill(
+            QRect(span->xFrom - rect.left(), span->y - rect.top(), span->xTo - span->xFrom, 1),
+            BLACK
+        );
+    }
+
+    return img;
+}
+
+} // namespace imageproc
@@ -0,0 +1,113 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_CONNCOMPEXTRACTOR_H_
+#define IMAGEPROC_CONNCOMPEXTRACTOR_H_
+
+#include "Connectivity.h"
+#include "ConnComp.h"
+#include <vector>
+#include <stddef.h>
+
+namespace imageproc
+{
+
+class BinaryImage;
+
+/**
+ * \brief Finds all connected components of an image at once.
+ *
+ * Unlike ConnCompEraser, which flood-erases one component at a time,
+ * this class labels horizontal runs of black pixels in a single pass
+ * over the image, joining runs that touch runs on the previous line.
+ * Components are numbered in the order their first pixels appear in
+ * a top to bottom, left to right scan, which is also the order
+ * ConnCompEraser would return them in.
+ */
+class ConnCompExtractor
+{
+    // Member-wise copying is OK.
+public:
+    /**
+     * \brief A horizontal run of black pixels.
+     */
+    struct Span {
+        int y;
+        int xFrom;
+        int xTo; // Exclusive.
+    };
+
+    /**
+     * \brief Labels the components of \p image.
+     *
+     * \param image The image to process.  It's not modified.
+     * \param conn Defines which neighbouring pixels are considered to be connected.
+     * \param keep_spans Whether to keep the spans of each component.
+     *        They are needed by spans() and computeConnCompImage().
+     */
+    ConnCompExtractor(BinaryImage const& image, Connectivity conn, bool keep_spans = false);
+
+    size_t size() const
+    {
+        return m_connComps.size();
+    }
+
+    ConnComp const& operator[](size_t idx) const
+    {
+        return m_connComps[idx];
+    }
+
+    std::vector<ConnComp> const& connComps() const
+    {
+        return m_connComps;
+    }
+
+    /**
+     * \brief Returns a pointer to the first span of component \p idx.
+     *
+     * Spans of a component are ordered top to bottom, left to right.
+     * Only available if the object was constructed with keep_spans set.
+     */
+    Span const* spansBegin(size_t idx) const
+    {
+        return m_spans.data() + m_spanStarts[idx];
+    }
+
+    /**
+     * \brief Returns a pointer past the last span of component \p idx.
+     */
+    Span const* spansEnd(size_t idx) const
+    {
+        return m_spans.data() + m_spanStarts[idx + 1];
+    }
+
+    /**
+     * \brief Draws component \p idx in its bounding box coordinates.
+     *
+     * Only available if the object was constructed with keep_spans set.
+     */
+    BinaryImage computeConnCompImage(size_t idx) const;
+private:
+    std::vector<ConnComp> m_connComps;
+    std::vector<Span> m_spans; // Grouped by component.
+    std::vector<int> m_spanStarts; // Indexes into m_spans, size() + 1 of them.
+};
+
+} // namespace imageproc
+
+#endif
@@ -19,10 +19,12 @@
 #include "ConnectivityMap.h"
 #include "BinaryImage.h"
 #include "InfluenceMap.h"
+#include "CompactConnectivityMap.h"
 #include "BitOps.h"
 #include <QImage>
 #include <QColor>
 #include <QDebug>
+#include <QAtomicInt>
 #include <algorithm>
 #include <stdexcept>
 #include <assert.h>
@@ -30,6 +32,53 @@
 namespace imageproc
 {
 
+namespace
+{
+
+/**
+ * Follows parent links to the root, halving the path on the way.
+ * Entries are only ever redirected to their ancestors, which keeps
+ * concurrent finds and unions consistent without locking.
+ */
+int findRoot(QAtomicInt* parents, int node)
+{
+    for (;;) {
+        int const parent = parents[node].loadAcquire();
+        if (parent == node) {
+            return node;
+        }
+        int const grandparent = parents[parent].loadAcquire();
+        if (grandparent != parent) {
+            parents[node].testAndSetRelaxed(parent, grandparent);
+        }
+        node = grandparent;
+    }
+}
+
+/**
+ * Joins the sets of two nodes.  The larger root is always linked
+ * to the smaller one, so a root is the minimum node of its set.
+ */
+void unite(QAtomicInt* parents, int node1, int node2)
+{
+    for (;;) {
+        node1 = findRoot(parents, node1);
+        node2 = findRoot(parents, node2);
+        if (node1 == node2) {
+            return;
+        }
+        if (node1 > node2) {
+            std::swap(node1, node2);
+        }
+        if (parents[node2].testAndSetOrdered(node2, node1)) {
+            return;
+        }
+        // node2 got linked by someone else in the meantime.
+    }
+}
+
+} // anonymous namespace
+
 uint32_t const ConnectivityMap::BACKGROUND = ~uint32_t(0);
 uint32_t const ConnectivityMap::UNTAGGED_FG = BACKGROUND - 1;
 
@@ -60,7 +109,7 @@ ConnectivityMap::ConnectivityMap(QSize const& size)
 }
 
 ConnectivityMap::ConnectivityMap(
-    BinaryImage const& image, Connectivity const conn)
+    BinaryImage const& image, Connectivity const conn, Engine const engine)
     :   m_pData(0),
         m_size(image.size()),
         m_stride(0),
@@ -94,7 +143,7 @@ ConnectivityMap::ConnectivityMap(
         dst += dst_stride;
     }
 
-    assignIds(conn);
+    assignIds(conn, engine);
 }
 
 ConnectivityMap::ConnectivityMap(ConnectivityMap const& other)
@@ -123,6 +172,35 @@ ConnectivityMap::ConnectivityMap(InfluenceMap const& imap)
     copyFromInfluenceMap(imap);
 }
 
+ConnectivityMap::ConnectivityMap(CompactConnectivityMap const& cmap)
+    :   m_pData(0),
+        m_size(cmap.size()),
+        m_stride(0),
+        m_maxLabel(cmap.maxLabel())
+{
+    if (m_size.isEmpty()) {
+        return;
+    }
+
+    int const width = m_size.width();
+    int const height = m_size.height();
+
+    m_data.resize((width + 2) * (height + 2), 0);
+    m_stride = width + 2;
+    m_pData = &m_data[0] + 1 + m_stride;
+
+    uint32_t* const dst_data = m_pData;
+    int const dst_stride = m_stride;
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        uint32_t* dst_line = dst_data + y * dst_stride;
+        for (int x = 0; x < width; ++x) {
+            dst_line[x] = cmap.label(x, y);
+        }
+    }
+}
+
 ConnectivityMap&
 ConnectivityMap::operator=(ConnectivityMap const& other)
 {
@@ -256,8 +334,15 @@ ConnectivityMap::copyFromInfluenceMap(InfluenceMap const& imap)
 }
 
 void
-ConnectivityMap::assignIds(Connectivity const conn)
+ConnectivityMap::assignIds(Connectivity const conn, Engine const engine)
 {
+    if (engine == ENGINE_PARALLEL) {
+        std::vector<uint32_t> table;
+        m_maxLabel = labelStripsInParallel(conn, table);
+        remapIds(table);
+        return;
+    }
+
     uint32_t const num_initial_tags = initialTagging();
     std::vector<uint32_t> table(num_initial_tags, 0);
 
@@ -312,6 +397,129 @@ ConnectivityMap::initialTagging()
     return next_label - 1;
 }
 
+/**
+ * Tags runs of object pixels in horizontal strips, the same way
+ * initialTagging() would, then joins the tags of runs touching each other
+ * and builds a table mapping tags to final labels.  The final labels
+ * come out exactly the same as with the sequential engine, as in both
+ * cases a component gets the smallest tag in it and tags are then
+ * numbered without gaps.
+ *
+ * \return The maximum label.
+ */
+uint32_t
+ConnectivityMap::labelStripsInParallel(
+    Connectivity const conn, std::vector<uint32_t>& table)
+{
+    int const width = m_size.width();
+    int const height = m_size.height();
+    int const stride = m_stride;
+
+    int const strip_height = 64;
+    int const num_strips = std::max(1, height / strip_height);
+
+    // Runs per strip, turned into the first tag of each strip.
+    std::vector<uint32_t> first_tags(num_strips + 1, 0);
+
+    #pragma omp parallel for schedule(static)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        int const y0 = strip * strip_height;
+        int const y1 = strip == num_strips - 1 ? height : y0 + strip_height;
+        uint32_t num_runs = 0;
+
+        uint32_t const* line = m_pData + y0 * stride;
+        for (int y = y0; y < y1; ++y, line += stride) {
+            for (int x = 0; x < width; ++x) {
+                if (line[x - 1] == BACKGROUND && line[x] == UNTAGGED_FG) {
+                    ++num_runs;
+                }
+            }
+        }
+
+        first_tags[strip + 1] = num_runs;
+    }
+
+    first_tags[0] = 1;
+    for (int strip = 0; strip < num_strips; ++strip) {
+        first_tags[strip + 1] += first_tags[strip];
+    }
+    int const num_tags = first_tags[num_strips] - 1;
+
+    // Every pixel of a run gets the tag of the run.
+    #pragma omp parallel for schedule(static)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        int const y0 = strip * strip_height;
+        int const y1 = strip == num_strips - 1 ? height : y0 + strip_height;
+        uint32_t next_tag = first_tags[strip];
+
+        uint32_t* line = m_pData + y0 * stride;
+        for (int y = y0; y < y1; ++y, line += stride) {
+            for (int x = 0; x < width; ++x) {
+                if (line[x] != UNTAGGED_FG) {
+                    continue;
+                }
+                line[x] = line[x - 1] == BACKGROUND ? next_tag++ : line[x - 1];
+            }
+        }
+    }
+
+    // parents[tag - 1] is the parent of a tag, in zero-based form.
+    std::vector<QAtomicInt> parents(num_tags);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < num_tags; ++i) {
+        parents[i].storeRelease(i);
+    }
+
+    // Join runs with the object pixels above them.  Most unions stay
+    // within a strip, while those on the first line of a strip join it
+    // with the previous one.  Neither needs any locking.
+    int const x_reach = conn == CONN8 ? 1 : 0;
+    QAtomicInt* const p_parents = num_tags ? &parents[0] : nullptr;
+
+    #pragma omp parallel for schedule(static)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        int const y0 = std::max(1, strip * strip_height);
+        int const y1 = strip == num_strips - 1 ? height : strip * strip_height + strip_height;
+
+        uint32_t const* line = m_pData + y0 * stride;
+        for (int y = y0; y < y1; ++y, line += stride) {
+            uint32_t const* prev_line = line - stride;
+            uint32_t last_joined = BACKGROUND;
+            for (int x = 0; x < width; ++x) {
+                uint32_t const tag = line[x];
+                if (tag == BACKGROUND) {
+                    last_joined = BACKGROUND;
+                    continue;
+                }
+                for (int dx = -x_reach; dx <= x_reach; ++dx) {
+                    uint32_t const above = prev_line[x + dx];
+                    if (above != BACKGROUND && above != last_joined) {
+                        unite(p_parents, tag - 1, above - 1);
+                        last_joined = above;
+                    }
+                }
+            }
+        }
+    }
+
+    // Roots are the smallest tags in their sets and precede other tags,
+    // so a single forward pass numbers them and resolves the rest.
+    table.resize(num_tags);
+    uint32_t next_label = 1;
+    for (int i = 0; i < num_tags; ++i) {
+        int const root = findRoot(p_parents, i);
+        if (root == i) {
+            table[i] = next_label;
+            ++next_label;
+        } else {
+            table[i] = table[root];
+        }
+    }
+
+    return next_label - 1;
+}
+
 void
 ConnectivityMap::spreadMin4()
 {
@@ -560,7 +768,12 @@ ConnectivityMap::markUsedIds(std::vector<uint32_t>& used_map) const
 void
 ConnectivityMap::remapIds(std::vector<uint32_t> const& map)
 {
-    for (uint32_t& label : m_data) {
+    int const size = static_cast<int>(m_data.size());
+    uint32_t* const data = &m_data[0];
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < size; ++i) {
+        uint32_t& label = data[i];
         if (label == BACKGROUND) {
             label = 0;
         } else {
@@ -21,6 +21,7 @@
 
 #include "Connectivity.h"
 #include "FastQueue.h"
+#include "PixelBufferPool.h"
 #include <QSize>
 #include <QColor>
 #include <Qt>
@@ -34,6 +35,7 @@ namespace imageproc
 
 class BinaryImage;
 class InfluenceMap;
+class CompactConnectivityMap;
 
 /**
  * \brief Assigns each pixel a label that identifies the connected component
@@ -43,11 +45,31 @@ class InfluenceMap;
  * connected or not.
  *
  * Background (white) pixels are assigned the label of zero, and the remaining
- * labels are guaranteed not to have gaps.
+ * labels are guaranteed not to have gaps.  Components are numbered in the
+ * order their first pixels appear in a top to bottom, left to right scan,
+ * regardless of the labelling engine.
  */
 class ConnectivityMap
 {
 public:
+    /**
+     * \brief The algorithm used to label components.
+     */
+    enum Engine {
+        /**
+         * Propagates minimum labels over the whole map, then
+         * fixes up what's left with a flood fill.
+         */
+        ENGINE_SEQUENTIAL,
+
+        /**
+         * Labels horizontal strips independently, joins labels
+         * touching across strip borders with a lock-free union-find,
+         * then relabels everything in a final pass.
+         */
+        ENGINE_PARALLEL
+    };
+
     /**
      * \brief Constructs a null connectivity map.
      *
@@ -65,7 +87,8 @@ public:
     /**
      * \brief Labels components in a binary image.
      */
-    ConnectivityMap(BinaryImage const& image, Connectivity conn);
+    ConnectivityMap(BinaryImage const& image, Connectivity conn,
+                    Engine engine = ENGINE_PARALLEL);
 
     /**
      * \brief Same as the version working with BinaryImage
@@ -74,7 +97,8 @@ public:
     template<typename T>
     ConnectivityMap(
         QSize size, T const* data,
-        int units_per_line, Connectivity conn);
+        int units_per_line, Connectivity conn,
+        Engine engine = ENGINE_PARALLEL);
 
     ConnectivityMap(ConnectivityMap const& other);
 
@@ -83,6 +107,11 @@ public:
      */
     explicit ConnectivityMap(InfluenceMap const& imap);
 
+    /**
+     * \brief Expands a compact connectivity map back to a regular one.
+     */
+    explicit ConnectivityMap(CompactConnectivityMap const& cmap);
+
     ConnectivityMap& operator=(ConnectivityMap const& other);
 
     /**
@@ -197,10 +226,12 @@ public:
 private:
     void copyFromInfluenceMap(InfluenceMap const& imap);
 
-    void assignIds(Connectivity conn);
+    void assignIds(Connectivity conn, Engine engine);
 
     uint32_t initialTagging();
 
+    uint32_t labelStripsInParallel(Connectivity conn, std::vector<uint32_t>& table);
+
     void spreadMin4();
 
     void spreadMin8();
@@ -222,7 +253,7 @@ private:
     static uint32_t const BACKGROUND;
     static uint32_t const UNTAGGED_FG;
 
-    std::vector<uint32_t> m_data;
+    std::vector<uint32_t, PixelBufferAllocator<uint32_t> > m_data;
     uint32_t* m_pData;
     QSize m_size;
     int m_stride;
@@ -237,7 +268,7 @@ inline void swap(ConnectivityMap& o1, ConnectivityMap& o2)
 template<typename T>
 ConnectivityMap::ConnectivityMap(
     QSize const size, T const* src,
-    int const src_stride, Connectivity const conn)
+    int const src_stride, Connectivity const conn, Engine const engine)
     :   m_pData(0),
         m_size(size),
         m_stride(0),
@@ -267,7 +298,7 @@ ConnectivityMap::ConnectivityMap(
         dst += dst_stride;
     }
 
-    assignIds(conn);
+    assignIds(conn, engine);
 }
 
 } // namespace imageproc
@@ -21,6 +21,8 @@
 
 #include "GaussBlur.h"
 #include "GrayImage.h"
+#include "GpuCompute.h"
+#include "Grid.h"
 #include "Constants.h"
 #include <stdint.h>
 #include <math.h>
@@ -95,6 +97,67 @@ void find_iir_constants(
     }
 }
 
+namespace
+{
+
+template<int Lanes>
+void iirFilter(
+    float const* n, float const* d, float const* bd,
+    float const* src, float* dst, int const len, int const step)
+{
+    // Samples before the beginning of a line are assumed to be
+    // equal to the first one.
+    float initial[Lanes];
+    for (int lane = 0; lane < Lanes; ++lane) {
+        initial[lane] = src[lane];
+    }
+
+    int const head = len < 4 ? len : 4;
+    int k = 0;
+    for (; k < head; ++k, src += step, dst += step) {
+        for (int lane = 0; lane < Lanes; ++lane) {
+            float acc = n[0] * src[lane];
+            int i = 1;
+            for (; i <= k; ++i) {
+                acc += n[i] * src[lane - i * step] - d[i] * dst[lane - i * step];
+            }
+            for (; i <= 4; ++i) {
+                acc += (n[i] - bd[i]) * initial[lane];
+            }
+            dst[lane] = acc;
+        }
+    }
+
+    // The same as above with all previous samples available,
+    // and without branches in the loop over lanes.
+    for (; k < len; ++k, src += step, dst += step) {
+        for (int lane = 0; lane < Lanes; ++lane) {
+            float acc = n[0] * src[lane];
+            acc += n[1] * src[lane - step] - d[1] * dst[lane - step];
+            acc += n[2] * src[lane - 2 * step] - d[2] * dst[lane - 2 * step];
+            acc += n[3] * src[lane - 3 * step] - d[3] * dst[lane - 3 * step];
+            acc += n[4] * src[lane - 4 * step] - d[4] * dst[lane - 4 * step];
+            dst[lane] = acc;
+        }
+    }
+}
+
+} // anonymous namespace
+
+void iirFilterColumnBlock(
+    float const* n, float const* d, float const* bd,
+    float const* src, float* dst, int const len, int const step)
+{
+    iirFilter<COLUMN_BLOCK>(n, d, bd, src, dst, len, step);
+}
+
+void iirFilterLine(
+    float const* n, float const* d, float const* bd,
+    float const* src, float* dst, int const len, int const step)
+{
+    iirFilter<1>(n, d, bd, src, dst, len, step);
+}
+
 } // namespace gauss_blur_impl
 
 GrayImage gaussBlur(GrayImage const& src, float h_sigma, float v_sigma)
@@ -103,9 +166,14 @@ GrayImage gaussBlur(GrayImage const& src, float h_sigma, float v_sigma)
         return src;
     }
 
+    GrayImage dst;
+    if (GpuCompute::gaussBlur(src, h_sigma, v_sigma, dst)) {
+        return dst;
+    }
+
     RoundAndClipValueConv<uint8_t> const float2byte;
 
-    GrayImage dst(src.size());
+    dst = GrayImage(src.size());
     gaussBlurGeneric(
         src.size(), h_sigma, v_sigma,
         src.data(), src.stride(), StaticCastValueConv<float>(),
@@ -115,4 +183,24 @@ GrayImage gaussBlur(GrayImage const& src, float h_sigma, float v_sigma)
     return dst;
 }
 
+Grid<float> gaussBlur(Grid<float> const& src, float const h_sigma, float const v_sigma)
+{
+    Grid<float> dst(src.width(), src.height(), 0, Grid<float>::ALIGNED_ROWS);
+    gaussBlurGeneric(
+        QSize(src.width(), src.height()), h_sigma, v_sigma,
+        src.data(), src.stride(), StaticCastValueConv<float>(),
+        dst.data(), dst.stride(), gauss_blur_impl::FloatToFloatWriter()
+    );
+    return dst;
+}
+
+void gaussBlurInPlace(Grid<float>& grid, float const h_sigma, float const v_sigma)
+{
+    gaussBlurGeneric(
+        QSize(grid.width(), grid.height()), h_sigma, v_sigma,
+        grid.data(), grid.stride(), StaticCastValueConv<float>(),
+        grid.data(), grid.stride(), gauss_blur_impl::FloatToFloatWriter()
+    );
+}
+
 } // namespace imageproc
@@ -30,6 +30,8 @@
 #include <iterator>
 #include <string.h>
 
+template<typename Node> class Grid;
+
 namespace imageproc
 {
 
@@ -45,6 +47,20 @@ class GrayImage;
  */
 GrayImage gaussBlur(GrayImage const& src, float h_sigma, float v_sigma);
 
+/**
+ * \brief Applies gaussian blur on a grid of floats.
+ *
+ * Padding of \p src is ignored, and the result has no padding.
+ */
+Grid<float> gaussBlur(Grid<float> const& src, float h_sigma, float v_sigma);
+
+/**
+ * \brief Same as the above, but modifies the grid in place.
+ *
+ * The padding is left as is.
+ */
+void gaussBlurInPlace(Grid<float>& grid, float h_sigma, float v_sigma);
+
 /**
  * \brief Applies a 2D gaussian filter on an arbitrary data grid.
  *
@@ -93,6 +109,32 @@ void find_iir_constants(
     float* n_p, float* n_m, float* d_p,
     float* d_m, float* bd_p, float* bd_m, float std_dev);
 
+/**
+ * The number of columns the vertical pass filters in lockstep.
+ * That's 8 floats, which is a single AVX or two SSE registers.
+ */
+enum { COLUMN_BLOCK = 8 };
+
+/**
+ * \brief Applies one direction of the recursive filter to COLUMN_BLOCK
+ *        interleaved lines at once.
+ *
+ * The k-th sample of lane l is src[k * step + l], where step is either
+ * COLUMN_BLOCK or -COLUMN_BLOCK.  The output is laid out the same way.
+ */
+void iirFilterColumnBlock(
+    float const* n, float const* d, float const* bd,
+    float const* src, float* dst, int len, int step);
+
+/**
+ * \brief Applies one direction of the recursive filter to a single line.
+ *
+ * The k-th sample is src[k * step], where step is either 1 or -1.
+ */
+void iirFilterLine(
+    float const* n, float const* d, float const* bd,
+    float const* src, float* dst, int len, int step);
+
 template<typename Src1It, typename Src2It, typename DstIt, typename FloatWriter>
 void save(int num_items, Src1It src1, Src2It src2,
           DstIt dst, int dst_stride, FloatWriter writer)
@@ -121,95 +163,89 @@ void gaussBlurGeneric(QSize const size, float const h_sigma, float const v_sigma
                       SrcIt const input, int const input_stride, FloatReader const float_reader,
                       DstIt const output, int const output_stride, FloatWriter const float_writer)
 {
+    using namespace gauss_blur_impl;
+
     if (size.isEmpty()) {
         return;
     }
 
     int const width = size.width();
     int const height = size.height();
-    int const width_height_max = width > height ? width : height;
 
-    boost::scoped_array<float> val_p(new float[width_height_max]);
-    boost::scoped_array<float> val_m(new float[width_height_max]);
     boost::scoped_array<float> intermediate_image(new float[width * height]);
+    float* const intermediate_data = &intermediate_image[0];
     int const intermediate_stride = width;
 
     // IIR parameters.
     float n_p[5], n_m[5], d_p[5], d_m[5], bd_p[5], bd_m[5];
 
-    // Vertical pass.
-    gauss_blur_impl::find_iir_constants(n_p, n_m, d_p, d_m, bd_p, bd_m, v_sigma);
-    for (int x = 0; x < width; ++x) {
-        memset(&val_p[0], 0, height * sizeof(val_p[0]));
-        memset(&val_m[0], 0, height * sizeof(val_m[0]));
-
-        SrcIt sp_p(input + x);
-        SrcIt sp_m(sp_p + (height - 1) * input_stride);
-        float* vp = &val_p[0];
-        float* vm = &val_m[0] + height - 1;
-        float const initial_p = float_reader(sp_p[0]);
-        float const initial_m = float_reader(sp_m[0]);
+    // Vertical pass.  Blocks of adjacent columns are filtered in lockstep,
+    // which vectorizes, and different blocks go to different threads.
+    // Input is fully consumed here, so output may alias it.
+    find_iir_constants(n_p, n_m, d_p, d_m, bd_p, bd_m, v_sigma);
+    int const num_blocks = (width + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
 
-        for (int y = 0; y < height; ++y) {
-            int const terms = y < 4 ? y : 4;
-            int i = 0;
-            int sp_off = 0;
-            for (; i <= terms; ++i, sp_off += input_stride) {
-                *vp += n_p[i] * float_reader(sp_p[-sp_off]) - d_p[i] * vp[-i];
-                *vm += n_m[i] * float_reader(sp_m[sp_off]) - d_m[i] * vm[i];
+    #pragma omp parallel
+    {
+        boost::scoped_array<float> column(new float[height * COLUMN_BLOCK]);
+        boost::scoped_array<float> val_p(new float[height * COLUMN_BLOCK]);
+        boost::scoped_array<float> val_m(new float[height * COLUMN_BLOCK]);
+
+        #pragma omp for schedule(static)
+        for (int block = 0; block < num_blocks; ++block) {
+            int const x0 = block * COLUMN_BLOCK;
+            int const block_width = width - x0 < COLUMN_BLOCK ? width - x0 : COLUMN_BLOCK;
+
+            // Gather the block, repeating the last column to fill unused lanes.
+            SrcIt src_line(input + x0);
+            float* col = &column[0];
+            for (int y = 0; y < height; ++y) {
+                for (int lane = 0; lane < COLUMN_BLOCK; ++lane) {
+                    col[lane] = float_reader(src_line[lane < block_width ? lane : block_width - 1]);
+                }
+                src_line += input_stride;
+                col += COLUMN_BLOCK;
             }
-            for (; i <= 4; ++i) {
-                *vp += (n_p[i] - bd_p[i]) * initial_p;
-                *vm += (n_m[i] - bd_m[i]) * initial_m;
+
+            int const last = (height - 1) * COLUMN_BLOCK;
+            iirFilterColumnBlock(
+                n_p, d_p, bd_p, &column[0], &val_p[0], height, COLUMN_BLOCK
+            );
+            iirFilterColumnBlock(
+                n_m, d_m, bd_m, &column[0] + last, &val_m[0] + last, height, -COLUMN_BLOCK
+            );
+
+            float* dst_line = intermediate_data + x0;
+            for (int y = 0; y < height; ++y) {
+                int const offset = y * COLUMN_BLOCK;
+                for (int lane = 0; lane < block_width; ++lane) {
+                    dst_line[lane] = val_p[offset + lane] + val_m[offset + lane];
+                }
+                dst_line += intermediate_stride;
             }
-            sp_p += input_stride;
-            sp_m -= input_stride;
-            ++vp;
-            --vm;
         }
-
-        gauss_blur_impl::save(
-            height, &val_p[0], &val_m[0], &intermediate_image[0] + x,
-            intermediate_stride, gauss_blur_impl::FloatToFloatWriter()
-        );
     }
 
-    // Horizontal pass.
-    gauss_blur_impl::find_iir_constants(n_p, n_m, d_p, d_m, bd_p, bd_m, h_sigma);
-    float const* intermediate_line = &intermediate_image[0];
-    DstIt output_line(output);
-    for (int y = 0; y < height; ++y) {
-        memset(&val_p[0], 0, width * sizeof(val_p[0]));
-        memset(&val_m[0], 0, width * sizeof(val_m[0]));
-
-        float const* sp_p = intermediate_line;
-        float const* sp_m = intermediate_line + width - 1;
-        float* vp = &val_p[0];
-        float* vm = &val_m[0] + width - 1;
-        float const initial_p = sp_p[0];
-        float const initial_m = sp_m[0];
-
-        for (int x = 0; x < width; ++x) {
-            int const terms = x < 4 ? x : 4;
-            int i = 0;
-            for (; i <= terms; ++i) {
-                *vp += n_p[i] * sp_p[-i] - d_p[i] * vp[-i];
-                *vm += n_m[i] * sp_m[i] - d_m[i] * vm[i];
-            }
-            for (; i <= 4; ++i) {
-                *vp += (n_p[i] - bd_p[i]) * initial_p;
-                *vm += (n_m[i] - bd_m[i]) * initial_m;
-            }
-            ++sp_p;
-            --sp_m;
-            ++vp;
-            --vm;
-        }
+    // Horizontal pass.  Lines are independent, so they go to different threads.
+    find_iir_constants(n_p, n_m, d_p, d_m, bd_p, bd_m, h_sigma);
 
-        gauss_blur_impl::save(width, &val_p[0], &val_m[0], output_line, 1, float_writer);
+    #pragma omp parallel
+    {
+        boost::scoped_array<float> val_p(new float[width]);
+        boost::scoped_array<float> val_m(new float[width]);
 
-        intermediate_line += intermediate_stride;
-        output_line += output_stride;
+        #pragma omp for schedule(static)
+        for (int y = 0; y < height; ++y) {
+            float const* intermediate_line = intermediate_data + y * intermediate_stride;
+            iirFilterLine(n_p, d_p, bd_p, intermediate_line, &val_p[0], width, 1);
+            iirFilterLine(
+                n_m, d_m, bd_m, intermediate_line + width - 1,
+                &val_m[0] + width - 1, width, -1
+            );
+
+            DstIt output_line(output + y * output_stride);
+            save(width, &val_p[0], &val_m[0], output_line, 1, float_writer);
+        }
     }
 }
 
@@ -0,0 +1,1167 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GpuCompute.h"
+#include "config.h"
+#include "BinaryImage.h"
+#include "GrayImage.h"
+#include "Morphology.h"
+#include <QAtomicInt>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#ifdef ENABLE_GPU_COMPUTE
+#include "GaussBlur.h"
+#include "NonCopyable.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QByteArray>
+#include <QDebug>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace imageproc
+{
+
+namespace
+{
+
+QAtomicInt g_enabled(0);
+
+} // anonymous namespace
+
+void
+GpuCompute::setEnabled(bool const enabled)
+{
+    g_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+bool
+GpuCompute::isEnabled()
+{
+    return g_enabled.loadAcquire() != 0;
+}
+
+#ifndef ENABLE_GPU_COMPUTE
+
+QString
+GpuCompute::deviceName()
+{
+    return QString();
+}
+
+bool
+GpuCompute::gaussBlur(GrayImage const&, float, float, GrayImage&)
+{
+    return false;
+}
+
+bool
+GpuCompute::dilateGray(
+    GrayImage const&, Brick const&, QRect const&, unsigned char, GrayImage&)
+{
+    return false;
+}
+
+bool
+GpuCompute::erodeGray(
+    GrayImage const&, Brick const&, QRect const&, unsigned char, GrayImage&)
+{
+    return false;
+}
+
+bool
+GpuCompute::openGray(
+    GrayImage const&, QSize const&, QRect const&, unsigned char, GrayImage&)
+{
+    return false;
+}
+
+bool
+GpuCompute::closeGray(
+    GrayImage const&, QSize const&, QRect const&, unsigned char, GrayImage&)
+{
+    return false;
+}
+
+bool
+GpuCompute::binarizeSauvola(QImage const&, QSize const&, BinaryImage&)
+{
+    return false;
+}
+
+bool
+GpuCompute::binarizeWolf(
+    QImage const&, QSize const&, unsigned char, unsigned char, BinaryImage&)
+{
+    return false;
+}
+
+#else // ENABLE_GPU_COMPUTE
+
+namespace
+{
+
+/**
+ * Below that, transferring an image costs more than the device saves.
+ */
+int const MIN_PIXELS = 1 << 20;
+
+char const program_source[] =
+    "#pragma OPENCL FP_CONTRACT OFF\n"
+    "\n"
+    "#ifdef cl_khr_fp64\n"
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "typedef double real;\n"
+    "#define REAL(v) v\n"
+    "#else\n"
+    "typedef float real;\n"
+    "#define REAL(v) v##f\n"
+    "#endif\n"
+    "\n"
+    "typedef struct\n"
+    "{\n"
+    "    float x1, x2, x3, x4;\n"
+    "    float y1, y2, y3, y4;\n"
+    "} IirState;\n"
+    "\n"
+    "// c[0..4] are the feed-forward coefficients, c[5..9] the feedback ones\n"
+    "// and c[10] is the gain at zero frequency.  Samples before the beginning\n"
+    "// of a line are taken to be equal to the first one, and so are the\n"
+    "// outputs they would have produced.\n"
+    "void iir_init(IirState* s, __constant float const* c, float const first)\n"
+    "{\n"
+    "    s->x1 = s->x2 = s->x3 = s->x4 = first;\n"
+    "    s->y1 = s->y2 = s->y3 = s->y4 = c[10] * first;\n"
+    "}\n"
+    "\n"
+    "float iir_step(IirState* s, __constant float const* c, float const x0)\n"
+    "{\n"
+    "    float const y0 = c[0] * x0\n"
+    "        + c[1] * s->x1 - c[6] * s->y1\n"
+    "        + c[2] * s->x2 - c[7] * s->y2\n"
+    "        + c[3] * s->x3 - c[8] * s->y3\n"
+    "        + c[4] * s->x4 - c[9] * s->y4;\n"
+    "    s->x4 = s->x3;\n"
+    "    s->x3 = s->x2;\n"
+    "    s->x2 = s->x1;\n"
+    "    s->x1 = x0;\n"
+    "    s->y4 = s->y3;\n"
+    "    s->y3 = s->y2;\n"
+    "    s->y2 = s->y1;\n"
+    "    s->y1 = y0;\n"
+    "    return y0;\n"
+    "}\n"
+    "\n"
+    "// The vertical pass of gaussBlur().  One work item per column.\n"
+    "// c holds the causal coefficients followed by the anti-causal ones.\n"
+    "__kernel void gauss_columns(\n"
+    "    __global uchar const* src, int const src_stride, int const w, int const h,\n"
+    "    __constant float const* c, __global float* dst)\n"
+    "{\n"
+    "    int const x = get_global_id(0);\n"
+    "    if (x >= w) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    IirState s;\n"
+    "    iir_init(&s, c, src[x]);\n"
+    "    for (int y = 0; y < h; ++y) {\n"
+    "        dst[y * w + x] = iir_step(&s, c, src[y * src_stride + x]);\n"
+    "    }\n"
+    "\n"
+    "    iir_init(&s, c + 11, src[(h - 1) * src_stride + x]);\n"
+    "    for (int y = h - 1; y >= 0; --y) {\n"
+    "        dst[y * w + x] += iir_step(&s, c + 11, src[y * src_stride + x]);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// The horizontal pass of gaussBlur().  One work item per row.\n"
+    "// The causal part goes to scratch, leaving src intact for the\n"
+    "// anti-causal part.\n"
+    "__kernel void gauss_rows(\n"
+    "    __global float const* src, int const w, int const h,\n"
+    "    __constant float const* c, __global float* scratch, __global uchar* dst)\n"
+    "{\n"
+    "    int const y = get_global_id(0);\n"
+    "    if (y >= h) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    __global float const* const src_line = src + y * w;\n"
+    "    __global float* const scratch_line = scratch + y * w;\n"
+    "    __global uchar* const dst_line = dst + y * w;\n"
+    "\n"
+    "    IirState s;\n"
+    "    iir_init(&s, c, src_line[0]);\n"
+    "    for (int x = 0; x < w; ++x) {\n"
+    "        scratch_line[x] = iir_step(&s, c, src_line[x]);\n"
+    "    }\n"
+    "\n"
+    "    iir_init(&s, c + 11, src_line[w - 1]);\n"
+    "    for (int x = w - 1; x >= 0; --x) {\n"
+    "        float const val = scratch_line[x] + iir_step(&s, c + 11, src_line[x]);\n"
+    "        dst_line[x] = (uchar)clamp(floor(val + 0.5f), 0.0f, 255.0f);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// The horizontal half of a gray dilation or erosion.  dst(x, y) is\n"
+    "// the extremum of src(origin_x + x + dx, origin_y + y) for dx in\n"
+    "// [min_dx, max_dx], with pixels outside of src equal to surroundings.\n"
+    "__kernel void morph_rows(\n"
+    "    __global uchar const* src, int const src_stride, int const src_w, int const src_h,\n"
+    "    int const origin_x, int const origin_y, int const min_dx, int const max_dx,\n"
+    "    int const surroundings, int const take_min,\n"
+    "    __global uchar* dst, int const dst_w, int const dst_h)\n"
+    "{\n"
+    "    int const x = get_global_id(0);\n"
+    "    int const y = get_global_id(1);\n"
+    "    if (x >= dst_w || y >= dst_h) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    int const sy = origin_y + y;\n"
+    "    int const sx0 = origin_x + x + min_dx;\n"
+    "    int const sx1 = origin_x + x + max_dx; // inclusive\n"
+    "\n"
+    "    uint extremum = take_min ? 255 : 0;\n"
+    "    if (sy < 0 || sy >= src_h || sx0 < 0 || sx1 >= src_w) {\n"
+    "        extremum = surroundings;\n"
+    "    }\n"
+    "\n"
+    "    if (sy >= 0 && sy < src_h) {\n"
+    "        __global uchar const* const line = src + sy * src_stride;\n"
+    "        int const end = min(sx1, src_w - 1);\n"
+    "        for (int sx = max(sx0, 0); sx <= end; ++sx) {\n"
+    "            uint const pixel = line[sx];\n"
+    "            extremum = take_min ? min(extremum, pixel) : max(extremum, pixel);\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    dst[y * dst_w + x] = (uchar)extremum;\n"
+    "}\n"
+    "\n"
+    "// The vertical half.  dst(x, y) is the extremum of src(x, y + i)\n"
+    "// for i in [0, span).\n"
+    "__kernel void morph_columns(\n"
+    "    __global uchar const* src, int const w, int const span, int const take_min,\n"
+    "    __global uchar* dst, int const h)\n"
+    "{\n"
+    "    int const x = get_global_id(0);\n"
+    "    int const y = get_global_id(1);\n"
+    "    if (x >= w || y >= h) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    __global uchar const* p = src + y * w + x;\n"
+    "    uint extremum = *p;\n"
+    "    for (int i = 1; i < span; ++i) {\n"
+    "        p += w;\n"
+    "        uint const pixel = *p;\n"
+    "        extremum = take_min ? min(extremum, pixel) : max(extremum, pixel);\n"
+    "    }\n"
+    "\n"
+    "    dst[y * w + x] = (uchar)extremum;\n"
+    "}\n"
+    "\n"
+    "// Sums of gray levels and of their squares over the rows inside the window\n"
+    "// around each row, one work item per column.  Rows of sums and sqsums are\n"
+    "// w + 1 entries long, with the first entry left for row_prefix_sums().\n"
+    "__kernel void window_column_sums(\n"
+    "    __global uchar const* gray, int const stride, int const w, int const h,\n"
+    "    int const lower_half, int const upper_half,\n"
+    "    __global uint* sums, __global ulong* sqsums)\n"
+    "{\n"
+    "    int const x = get_global_id(0);\n"
+    "    if (x >= w) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    uint sum = 0;\n"
+    "    ulong sqsum = 0;\n"
+    "    int top = 0;\n"
+    "    int bottom = 0; // exclusive\n"
+    "    for (int y = 0; y < h; ++y) {\n"
+    "        int const new_top = max(0, y - lower_half);\n"
+    "        int const new_bottom = min(h, y + upper_half);\n"
+    "        for (; bottom < new_bottom; ++bottom) {\n"
+    "            uint const pixel = gray[bottom * stride + x];\n"
+    "            sum += pixel;\n"
+    "            sqsum += pixel * pixel;\n"
+    "        }\n"
+    "        for (; top < new_top; ++top) {\n"
+    "            uint const pixel = gray[top * stride + x];\n"
+    "            sum -= pixel;\n"
+    "            sqsum -= pixel * pixel;\n"
+    "        }\n"
+    "        sums[y * (w + 1) + x + 1] = sum;\n"
+    "        sqsums[y * (w + 1) + x + 1] = sqsum;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// Turns each row of column sums into prefix sums, one work item per row.\n"
+    "// Unsigned overflow is fine, as only differences are used.\n"
+    "__kernel void row_prefix_sums(\n"
+    "    __global uint* sums, __global ulong* sqsums, int const w, int const h)\n"
+    "{\n"
+    "    int const y = get_global_id(0);\n"
+    "    if (y >= h) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    __global uint* const s = sums + y * (w + 1);\n"
+    "    __global ulong* const sq = sqsums + y * (w + 1);\n"
+    "    s[0] = 0;\n"
+    "    sq[0] = 0;\n"
+    "    for (int x = 1; x <= w; ++x) {\n"
+    "        s[x] += s[x - 1];\n"
+    "        sq[x] += sq[x - 1];\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// halves holds the lower, upper, left and right halves of the window.\n"
+    "void window_stats(\n"
+    "    __global uint const* sums, __global ulong const* sqsums,\n"
+    "    int const w, int const h, int4 const halves, int const x, int const y,\n"
+    "    real* mean, real* deviation)\n"
+    "{\n"
+    "    int const top = max(0, y - halves.s0);\n"
+    "    int const bottom = min(h, y + halves.s1); // exclusive\n"
+    "    int const left = max(0, x - halves.s2);\n"
+    "    int const right = min(w, x + halves.s3); // exclusive\n"
+    "    int const area = (bottom - top) * (right - left);\n"
+    "    int const row = y * (w + 1);\n"
+    "\n"
+    "    real const window_sum = (uint)(sums[row + right] - sums[row + left]);\n"
+    "    real const window_sqsum = (real)(sqsums[row + right] - sqsums[row + left]);\n"
+    "\n"
+    "    real const r_area = REAL(1.0) / area;\n"
+    "    real const m = window_sum * r_area;\n"
+    "    real const sqmean = window_sqsum * r_area;\n"
+    "    real const variance = sqmean - m * m;\n"
+    "\n"
+    "    *mean = m;\n"
+    "    *deviation = sqrt(fabs(variance));\n"
+    "}\n"
+    "\n"
+    "// One work item per 32 pixel word of the output.\n"
+    "__kernel void sauvola(\n"
+    "    __global uchar const* gray, int const stride, int const w, int const h,\n"
+    "    __global uint const* sums, __global ulong const* sqsums, int4 const halves,\n"
+    "    __global uint* bw, int const wpl)\n"
+    "{\n"
+    "    int const word = get_global_id(0);\n"
+    "    int const y = get_global_id(1);\n"
+    "    if (word >= wpl || y >= h) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    __global uchar const* const line = gray + y * stride;\n"
+    "    int const x0 = word << 5;\n"
+    "    int const x1 = min(w, x0 + 32);\n"
+    "\n"
+    "    real const k = REAL(0.34);\n"
+    "    uint bits = 0;\n"
+    "    for (int x = x0; x < x1; ++x) {\n"
+    "        real mean, deviation;\n"
+    "        window_stats(sums, sqsums, w, h, halves, x, y, &mean, &deviation);\n"
+    "        real const threshold = mean * (REAL(1.0) + k * (deviation / REAL(128.0) - REAL(1.0)));\n"
+    "        bits = (bits << 1) | (uint)((real)line[x] < threshold);\n"
+    "    }\n"
+    "\n"
+    "    bw[y * wpl + word] = bits << (32 - (x1 - x0));\n"
+    "}\n"
+    "\n"
+    "// The global extremes binarizeWolf() needs, reduced per row.\n"
+    "__kernel void wolf_extremes(\n"
+    "    __global uchar const* gray, int const stride, int const w, int const h,\n"
+    "    __global uint const* sums, __global ulong const* sqsums, int4 const halves,\n"
+    "    __global real* max_deviations, __global uint* min_gray_levels)\n"
+    "{\n"
+    "    int const y = get_global_id(0);\n"
+    "    if (y >= h) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    __global uchar const* const line = gray + y * stride;\n"
+    "    real max_deviation = 0;\n"
+    "    uint min_gray_level = 255;\n"
+    "    for (int x = 0; x < w; ++x) {\n"
+    "        real mean, deviation;\n"
+    "        window_stats(sums, sqsums, w, h, halves, x, y, &mean, &deviation);\n"
+    "        max_deviation = fmax(max_deviation, deviation);\n"
+    "        min_gray_level = min(min_gray_level, (uint)line[x]);\n"
+    "    }\n"
+    "\n"
+    "    max_deviations[y] = max_deviation;\n"
+    "    min_gray_levels[y] = min_gray_level;\n"
+    "}\n"
+    "\n"
+    "// One work item per 32 pixel word of the output.\n"
+    "__kernel void wolf(\n"
+    "    __global uchar const* gray, int const stride, int const w, int const h,\n"
+    "    __global uint const* sums, __global ulong const* sqsums, int4 const halves,\n"
+    "    real const max_deviation, real const min_gray_level,\n"
+    "    int const lower_bound, int const upper_bound,\n"
+    "    __global uint* bw, int const wpl)\n"
+    "{\n"
+    "    int const word = get_global_id(0);\n"
+    "    int const y = get_global_id(1);\n"
+    "    if (word >= wpl || y >= h) {\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    __global uchar const* const line = gray + y * stride;\n"
+    "    int const x0 = word << 5;\n"
+    "    int const x1 = min(w, x0 + 32);\n"
+    "\n"
+    "    real const k = REAL(0.3);\n"
+    "    uint bits = 0;\n"
+    "    for (int x = x0; x < x1; ++x) {\n"
+    "        real mean, deviation;\n"
+    "        window_stats(sums, sqsums, w, h, halves, x, y, &mean, &deviation);\n"
+    "        real const a = REAL(1.0) - deviation / max_deviation;\n"
+    "        real const threshold = mean - k * a * (mean - min_gray_level);\n"
+    "        int const pixel = line[x];\n"
+    "        int const black = pixel < lower_bound\n"
+    "            || (pixel <= upper_bound && (real)pixel < threshold);\n"
+    "        bits = (bits << 1) | (uint)black;\n"
+    "    }\n"
+    "\n"
+    "    bw[y * wpl + word] = bits << (32 - (x1 - x0));\n"
+    "}\n";
+
+class Device
+{
+    DECLARE_NON_COPYABLE(Device)
+public:
+    Device();
+
+    ~Device();
+
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel gaussColumns;
+    cl_kernel gaussRows;
+    cl_kernel morphRows;
+    cl_kernel morphColumns;
+    cl_kernel windowColumnSums;
+    cl_kernel rowPrefixSums;
+    cl_kernel sauvola;
+    cl_kernel wolfExtremes;
+    cl_kernel wolf;
+    QString name;
+
+    /**
+     * Whether the kernels compute in double precision, like the CPU code.
+     * It also defines the size of the "real" type in the kernels.
+     */
+    bool hasDouble;
+};
+
+Device::Device()
+    :   context(0),
+        queue(0),
+        program(0),
+        gaussColumns(0),
+        gaussRows(0),
+        morphRows(0),
+        morphColumns(0),
+        windowColumnSums(0),
+        rowPrefixSums(0),
+        sauvola(0),
+        wolfExtremes(0),
+        wolf(0),
+        hasDouble(false)
+{
+}
+
+Device::~Device()
+{
+    cl_kernel const kernels[] = {
+        gaussColumns, gaussRows, morphRows, morphColumns,
+        windowColumnSums, rowPrefixSums, sauvola, wolfExtremes, wolf
+    };
+    for (cl_kernel const kernel : kernels) {
+        if (kernel) {
+            clReleaseKernel(kernel);
+        }
+    }
+    if (program) {
+        clReleaseProgram(program);
+    }
+    if (queue) {
+        clReleaseCommandQueue(queue);
+    }
+    if (context) {
+        clReleaseContext(context);
+    }
+}
+
+QByteArray deviceInfo(cl_device_id const device, cl_device_info const param)
+{
+    size_t size = 0;
+    if (clGetDeviceInfo(device, param, 0, 0, &size) != CL_SUCCESS || size == 0) {
+        return QByteArray();
+    }
+    QByteArray value(int(size), '\0');
+    if (clGetDeviceInfo(device, param, size, value.data(), 0) != CL_SUCCESS) {
+        return QByteArray();
+    }
+    return QByteArray(value.constData()); // Drop the trailing zero.
+}
+
+cl_device_id findGpuDevice()
+{
+    cl_uint num_platforms = 0;
+    if (clGetPlatformIDs(0, 0, &num_platforms) != CL_SUCCESS || num_platforms == 0) {
+        return 0;
+    }
+
+    std::vector<cl_platform_id> platforms(num_platforms);
+    if (clGetPlatformIDs(num_platforms, &platforms[0], 0) != CL_SUCCESS) {
+        return 0;
+    }
+
+    for (cl_platform_id const platform : platforms) {
+        cl_device_id device = 0;
+        if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, 0) == CL_SUCCESS) {
+            return device;
+        }
+    }
+
+    return 0;
+}
+
+bool createKernel(cl_program const program, char const* name, cl_kernel& kernel)
+{
+    cl_int err = CL_SUCCESS;
+    kernel = clCreateKernel(program, name, &err);
+    return err == CL_SUCCESS;
+}
+
+std::unique_ptr<Device> createDevice()
+{
+    cl_device_id const device_id = findGpuDevice();
+    if (!device_id) {
+        qWarning() << "GpuCompute: no OpenCL GPU device found";
+        return std::unique_ptr<Device>();
+    }
+
+    std::unique_ptr<Device> device(new Device);
+    device->name = QString::fromUtf8(deviceInfo(device_id, CL_DEVICE_NAME)).trimmed();
+    device->hasDouble = deviceInfo(device_id, CL_DEVICE_EXTENSIONS).contains("cl_khr_fp64");
+
+    cl_int err = CL_SUCCESS;
+    device->context = clCreateContext(0, 1, &device_id, 0, 0, &err);
+    if (err != CL_SUCCESS) {
+        qWarning() << "GpuCompute: failed to create a context on" << device->name;
+        return std::unique_ptr<Device>();
+    }
+
+    device->queue = clCreateCommandQueue(device->context, device_id, 0, &err);
+    if (err != CL_SUCCESS) {
+        qWarning() << "GpuCompute: failed to create a command queue on" << device->name;
+        return std::unique_ptr<Device>();
+    }
+
+    char const* source = program_source;
+    device->program = clCreateProgramWithSource(device->context, 1, &source, 0, &err);
+    if (err != CL_SUCCESS) {
+        return std::unique_ptr<Device>();
+    }
+
+    if (clBuildProgram(device->program, 1, &device_id, "", 0, 0) != CL_SUCCESS) {
+        size_t size = 0;
+        clGetProgramBuildInfo(device->program, device_id, CL_PROGRAM_BUILD_LOG, 0, 0, &size);
+        QByteArray log(int(size), '\0');
+        clGetProgramBuildInfo(
+            device->program, device_id, CL_PROGRAM_BUILD_LOG, size, log.data(), 0
+        );
+        qWarning() << "GpuCompute: failed to build kernels:" << log.constData();
+        return std::unique_ptr<Device>();
+    }
+
+    if (!createKernel(device->program, "gauss_columns", device->gaussColumns)
+            || !createKernel(device->program, "gauss_rows", device->gaussRows)
+            || !createKernel(device->program, "morph_rows", device->morphRows)
+            || !createKernel(device->program, "morph_columns", device->morphColumns)
+            || !createKernel(device->program, "window_column_sums", device->windowColumnSums)
+            || !createKernel(device->program, "row_prefix_sums", device->rowPrefixSums)
+            || !createKernel(device->program, "sauvola", device->sauvola)
+            || !createKernel(device->program, "wolf_extremes", device->wolfExtremes)
+            || !createKernel(device->program, "wolf", device->wolf)) {
+        return std::unique_ptr<Device>();
+    }
+
+    return device;
+}
+
+/**
+ * Serializes access to the device.  Kernel arguments are per kernel object,
+ * so concurrent callers would overwrite each other's.
+ */
+QMutex g_mutex;
+
+bool g_initAttempted = false;
+
+/**
+ * Never destroyed, as OpenCL runtimes don't like being shut down
+ * from static destructors.
+ */
+Device* g_pDevice = 0;
+
+/**
+ * Sets up the device on first use.  Must be called with g_mutex locked.
+ * Returns null if there is no usable device.
+ */
+Device* device()
+{
+    if (!g_initAttempted) {
+        g_initAttempted = true;
+        g_pDevice = createDevice().release();
+    }
+    return g_pDevice;
+}
+
+bool worthIt(QSize const& size)
+{
+    return GpuCompute::isEnabled() && qint64(size.width()) * size.height() >= MIN_PIXELS;
+}
+
+/**
+ * \brief Owns a device buffer.
+ *
+ * The runtime keeps the memory alive until the commands
+ * already queued on it finish.
+ */
+class Buffer
+{
+    DECLARE_NON_COPYABLE(Buffer)
+public:
+    Buffer() : m_mem(0) {}
+
+    ~Buffer()
+    {
+        if (m_mem) {
+            clReleaseMemObject(m_mem);
+        }
+    }
+
+    /**
+     * Allocates the buffer, optionally initializing it from host memory.
+     * Returns false on failure, including running out of device memory.
+     */
+    bool create(Device const* dev, size_t const size, void const* host_data = 0)
+    {
+        cl_mem_flags flags = CL_MEM_READ_WRITE;
+        if (host_data) {
+            flags |= CL_MEM_COPY_HOST_PTR;
+        }
+        cl_int err = CL_SUCCESS;
+        m_mem = clCreateBuffer(dev->context, flags, size, const_cast<void*>(host_data), &err);
+        return err == CL_SUCCESS;
+    }
+
+    cl_mem get() const
+    {
+        return m_mem;
+    }
+private:
+    cl_mem m_mem;
+};
+
+bool setArgs(cl_kernel, cl_uint)
+{
+    return true;
+}
+
+template<typename T, typename... Rest>
+bool setArgs(cl_kernel const kernel, cl_uint const idx, T const& value, Rest const& ... rest)
+{
+    if (clSetKernelArg(kernel, idx, sizeof(T), &value) != CL_SUCCESS) {
+        return false;
+    }
+    return setArgs(kernel, idx + 1, rest...);
+}
+
+/**
+ * Sets an argument of the "real" type of the kernels.
+ */
+bool setRealArg(Device const* dev, cl_kernel const kernel, cl_uint const idx, double const value)
+{
+    if (dev->hasDouble) {
+        return setArgs(kernel, idx, value);
+    } else {
+        return setArgs(kernel, idx, float(value));
+    }
+}
+
+bool run(Device const* dev, cl_kernel const kernel, size_t const width, size_t const height = 0)
+{
+    size_t const global_size[] = { width, height };
+    return clEnqueueNDRangeKernel(
+               dev->queue, kernel, height ? 2 : 1, 0, global_size, 0, 0, 0, 0
+           ) == CL_SUCCESS;
+}
+
+/**
+ * Reads \p rows rows of \p row_bytes bytes each, waiting for
+ * the queued commands to finish.
+ */
+bool read(
+    Device const* dev, Buffer const& src, int const src_pitch,
+    void* dst, int const dst_pitch, int const row_bytes, int const rows)
+{
+    size_t const origin[] = { 0, 0, 0 };
+    size_t const region[] = { size_t(row_bytes), size_t(rows), 1 };
+    return clEnqueueReadBufferRect(
+               dev->queue, src.get(), CL_TRUE, origin, origin, region,
+               src_pitch, 0, dst_pitch, 0, dst, 0, 0, 0
+           ) == CL_SUCCESS;
+}
+
+/**
+ * \brief The IIR coefficients of gaussBlur() in the layout the kernels expect.
+ *
+ * That's the causal n and d, followed by the gain at zero frequency,
+ * then the same for the anti-causal direction.
+ */
+class IirCoefficients
+{
+public:
+    explicit IirCoefficients(float const sigma)
+    {
+        float n_p[5], n_m[5], d_p[5], d_m[5], bd_p[5], bd_m[5];
+        gauss_blur_impl::find_iir_constants(n_p, n_m, d_p, d_m, bd_p, bd_m, sigma);
+        pack(m_values, n_p, d_p);
+        pack(m_values + 11, n_m, d_m);
+    }
+
+    float const* values() const
+    {
+        return m_values;
+    }
+
+    static size_t size()
+    {
+        return sizeof(m_values);
+    }
+private:
+    static void pack(float* out, float const* n, float const* d)
+    {
+        float sum_n = 0.0;
+        float sum_d = 0.0;
+        for (int i = 0; i <= 4; ++i) {
+            out[i] = n[i];
+            out[5 + i] = d[i];
+            sum_n += n[i];
+            sum_d += d[i];
+        }
+        out[10] = sum_n / (1.0 + sum_d);
+    }
+
+    float m_values[22];
+};
+
+/**
+ * \brief Min or max over the collect area, like dilateOrErodeGray().
+ *
+ * dst(x, y) is the extremum of src(x + dx, y + dy) over (dx, dy) in
+ * \p collect_area, where (x, y) are in global coordinates inside
+ * \p dst_area.  The result has no padding between lines.
+ */
+bool spreadGray(
+    Device const* dev, cl_mem const src, int const src_stride, QSize const& src_size,
+    QRect const& dst_area, Brick const& collect_area, int const surroundings,
+    bool const take_min, Buffer& dst)
+{
+    int const dst_w = dst_area.width();
+    int const dst_h = dst_area.height();
+    int const span = collect_area.maxY() - collect_area.minY() + 1;
+    int const tmp_h = dst_h + span - 1;
+    int const min_arg = take_min ? 1 : 0;
+
+    Buffer tmp;
+    return tmp.create(dev, size_t(dst_w) * tmp_h)
+           && dst.create(dev, size_t(dst_w) * dst_h)
+           && setArgs(
+               dev->morphRows, 0, src, src_stride, src_size.width(), src_size.height(),
+               dst_area.left(), dst_area.top() + collect_area.minY(),
+               collect_area.minX(), collect_area.maxX(),
+               surroundings, min_arg, tmp.get(), dst_w, tmp_h
+           )
+           && run(dev, dev->morphRows, dst_w, tmp_h)
+           && setArgs(dev->morphColumns, 0, tmp.get(), dst_w, span, min_arg, dst.get(), dst_h)
+           && run(dev, dev->morphColumns, dst_w, dst_h);
+}
+
+bool readGray(Device const* dev, Buffer const& src, QSize const& size, GrayImage& dst)
+{
+    GrayImage result(size);
+    if (!read(dev, src, size.width(), result.data(), result.stride(),
+              size.width(), size.height())) {
+        return false;
+    }
+    dst = result;
+    return true;
+}
+
+bool dilateOrErodeGray(
+    GrayImage const& src, Brick const& brick, QRect const& dst_area,
+    unsigned char const src_surroundings, bool const take_min, GrayImage& dst)
+{
+    if (!worthIt(dst_area.size())) {
+        return false;
+    }
+
+    QMutexLocker const locker(&g_mutex);
+    Device const* const dev = device();
+    if (!dev) {
+        return false;
+    }
+
+    Buffer src_buf;
+    Buffer dst_buf;
+    return src_buf.create(dev, size_t(src.stride()) * src.height(), src.data())
+           && spreadGray(
+               dev, src_buf.get(), src.stride(), src.size(), dst_area,
+               brick.flipped(), src_surroundings, take_min, dst_buf
+           )
+           && readGray(dev, dst_buf, dst_area.size(), dst);
+}
+
+/**
+ * Opening is an erosion followed by a dilation, closing is the reverse.
+ * The intermediate image stays on the device.
+ */
+bool openOrCloseGray(
+    GrayImage const& src, QSize const& brick, QRect const& dst_area,
+    unsigned char const src_surroundings, bool const open, GrayImage& dst)
+{
+    if (!worthIt(dst_area.size())) {
+        return false;
+    }
+
+    QMutexLocker const locker(&g_mutex);
+    Device const* const dev = device();
+    if (!dev) {
+        return false;
+    }
+
+    Brick const brick1(brick);
+    Brick const brick2(brick1.flipped());
+    Brick const& tmp_brick = open ? brick1 : brick2;
+    QRect const tmp_rect(
+        dst_area.adjusted(
+            tmp_brick.minX(), tmp_brick.minY(), tmp_brick.maxX(), tmp_brick.maxY()
+        )
+    );
+
+    // The first operation uses brick1, so it collects over brick2,
+    // and the other way around for the second one.
+    Buffer src_buf;
+    Buffer tmp_buf;
+    Buffer dst_buf;
+    return src_buf.create(dev, size_t(src.stride()) * src.height(), src.data())
+           && spreadGray(
+               dev, src_buf.get(), src.stride(), src.size(), tmp_rect,
+               brick2, src_surroundings, !open, tmp_buf
+           )
+           && spreadGray(
+               dev, tmp_buf.get(), tmp_rect.width(), tmp_rect.size(),
+               dst_area.translated(-tmp_rect.topLeft()),
+               brick1, src_surroundings, open, dst_buf
+           )
+           && readGray(dev, dst_buf, dst_area.size(), dst);
+}
+
+/**
+ * Leaves in \p sums and \p sqsums what the window_stats() kernel function expects.
+ */
+bool windowSums(
+    Device const* dev, Buffer const& gray, int const stride, QSize const& size,
+    cl_int4 const& halves, Buffer& sums, Buffer& sqsums)
+{
+    int const w = size.width();
+    int const h = size.height();
+    size_t const num_entries = size_t(w + 1) * h;
+
+    return sums.create(dev, num_entries * sizeof(cl_uint))
+           && sqsums.create(dev, num_entries * sizeof(cl_ulong))
+           && setArgs(
+               dev->windowColumnSums, 0, gray.get(), stride, w, h,
+               halves.s[0], halves.s[1], sums.get(), sqsums.get()
+           )
+           && run(dev, dev->windowColumnSums, w)
+           && setArgs(dev->rowPrefixSums, 0, sums.get(), sqsums.get(), w, h)
+           && run(dev, dev->rowPrefixSums, h);
+}
+
+cl_int4 windowHalves(QSize const& window_size)
+{
+    cl_int4 halves;
+    halves.s[0] = window_size.height() >> 1;
+    halves.s[1] = window_size.height() - halves.s[0];
+    halves.s[2] = window_size.width() >> 1;
+    halves.s[3] = window_size.width() - halves.s[2];
+    return halves;
+}
+
+/**
+ * Reads an array of the "real" type of the kernels.
+ */
+bool readReals(Device const* dev, Buffer const& src, std::vector<double>& dst)
+{
+    size_t const count = dst.size();
+    if (dev->hasDouble) {
+        return read(dev, src, 0, &dst[0], 0, sizeof(double) * count, 1);
+    }
+
+    std::vector<float> values(count);
+    if (!read(dev, src, 0, &values[0], 0, sizeof(float) * count, 1)) {
+        return false;
+    }
+    std::copy(values.begin(), values.end(), dst.begin());
+    return true;
+}
+
+int wordsPerLine(int const width)
+{
+    return (width + 31) / 32;
+}
+
+bool readBinary(Device const* dev, Buffer const& src, QSize const& size, BinaryImage& dst)
+{
+    int const wpl = wordsPerLine(size.width());
+    BinaryImage result(size.width(), size.height());
+    if (!read(dev, src, wpl * 4, result.data(), result.wordsPerLine() * 4,
+              wpl * 4, size.height())) {
+        return false;
+    }
+    dst = result;
+    return true;
+}
+
+} // anonymous namespace
+
+QString
+GpuCompute::deviceName()
+{
+    if (!isEnabled()) {
+        return QString();
+    }
+
+    QMutexLocker const locker(&g_mutex);
+    Device const* const dev = device();
+    return dev ? dev->name : QString();
+}
+
+bool
+GpuCompute::gaussBlur(
+    GrayImage const& src, float const h_sigma, float const v_sigma, GrayImage& dst)
+{
+    if (!worthIt(src.size())) {
+        return false;
+    }
+
+    QMutexLocker const locker(&g_mutex);
+    Device const* const dev = device();
+    if (!dev) {
+        return false;
+    }
+
+    int const w = src.width();
+    int const h = src.height();
+    IirCoefficients const v_coeffs(v_sigma);
+    IirCoefficients const h_coeffs(h_sigma);
+
+    Buffer src_buf;
+    Buffer v_coeffs_buf;
+    Buffer h_coeffs_buf;
+    Buffer intermediate;
+    Buffer scratch;
+    Buffer dst_buf;
+    return src_buf.create(dev, size_t(src.stride()) * h, src.data())
+           && v_coeffs_buf.create(dev, IirCoefficients::size(), v_coeffs.values())
+           && h_coeffs_buf.create(dev, IirCoefficients::size(), h_coeffs.values())
+           && intermediate.create(dev, sizeof(float) * w * h)
+           && scratch.create(dev, sizeof(float) * w * h)
+           && dst_buf.create(dev, size_t(w) * h)
+           && setArgs(
+               dev->gaussColumns, 0, src_buf.get(), src.stride(), w, h,
+               v_coeffs_buf.get(), intermediate.get()
+           )
+           && run(dev, dev->gaussColumns, w)
+           && setArgs(
+               dev->gaussRows, 0, intermediate.get(), w, h,
+               h_coeffs_buf.get(), scratch.get(), dst_buf.get()
+           )
+           && run(dev, dev->gaussRows, h)
+           && readGray(dev, dst_buf, src.size(), dst);
+}
+
+bool
+GpuCompute::dilateGray(
+    GrayImage const& src, Brick const& brick, QRect const& dst_area,
+    unsigned char const src_surroundings, GrayImage& dst)
+{
+    return dilateOrErodeGray(src, brick, dst_area, src_surroundings, true, dst);
+}
+
+bool
+GpuCompute::erodeGray(
+    GrayImage const& src, Brick const& brick, QRect const& dst_area,
+    unsigned char const src_surroundings, GrayImage& dst)
+{
+    return dilateOrErodeGray(src, brick, dst_area, src_surroundings, false, dst);
+}
+
+bool
+GpuCompute::openGray(
+    GrayImage const& src, QSize const& brick, QRect const& dst_area,
+    unsigned char const src_surroundings, GrayImage& dst)
+{
+    return openOrCloseGray(src, brick, dst_area, src_surroundings, true, dst);
+}
+
+bool
+GpuCompute::closeGray(
+    GrayImage const& src, QSize const& brick, QRect const& dst_area,
+    unsigned char const src_surroundings, GrayImage& dst)
+{
+    return openOrCloseGray(src, brick, dst_area, src_surroundings, false, dst);
+}
+
+bool
+GpuCompute::binarizeSauvola(
+    QImage const& gray, QSize const& window_size, BinaryImage& dst)
+{
+    if (!worthIt(gray.size())) {
+        return false;
+    }
+
+    QMutexLocker const locker(&g_mutex);
+    Device const* const dev = device();
+    if (!dev) {
+        return false;
+    }
+
+    int const w = gray.width();
+    int const h = gray.height();
+    int const stride = gray.bytesPerLine();
+    int const wpl = wordsPerLine(w);
+    cl_int4 const halves(windowHalves(window_size));
+
+    Buffer gray_buf;
+    Buffer sums;
+    Buffer sqsums;
+    Buffer bw_buf;
+    return gray_buf.create(dev, size_t(stride) * h, gray.bits())
+           && windowSums(dev, gray_buf, stride, gray.size(), halves, sums, sqsums)
+           && bw_buf.create(dev, sizeof(cl_uint) * wpl * h)
+           && setArgs(
+               dev->sauvola, 0, gray_buf.get(), stride, w, h,
+               sums.get(), sqsums.get(), halves, bw_buf.get(), wpl
+           )
+           && run(dev, dev->sauvola, wpl, h)
+           && readBinary(dev, bw_buf, gray.size(), dst);
+}
+
+bool
+GpuCompute::binarizeWolf(
+    QImage const& gray, QSize const& window_size,
+    unsigned char const lower_bound, unsigned char const upper_bound, BinaryImage& dst)
+{
+    if (!worthIt(gray.size())) {
+        return false;
+    }
+
+    QMutexLocker const locker(&g_mutex);
+    Device const* const dev = device();
+    if (!dev) {
+        return false;
+    }
+
+    int const w = gray.width();
+    int const h = gray.height();
+    int const stride = gray.bytesPerLine();
+    int const wpl = wordsPerLine(w);
+    cl_int4 const halves(windowHalves(window_size));
+    size_t const real_size = dev->hasDouble ? sizeof(double) : sizeof(float);
+
+    Buffer gray_buf;
+    Buffer sums;
+    Buffer sqsums;
+    Buffer max_deviations_buf;
+    Buffer min_gray_levels_buf;
+    if (!gray_buf.create(dev, size_t(stride) * h, gray.bits())
+            || !windowSums(dev, gray_buf, stride, gray.size(), halves, sums, sqsums)
+            || !max_deviations_buf.create(dev, real_size * h)
+            || !min_gray_levels_buf.create(dev, sizeof(cl_uint) * h)
+            || !setArgs(
+                dev->wolfExtremes, 0, gray_buf.get(), stride, w, h,
+                sums.get(), sqsums.get(), halves,
+                max_deviations_buf.get(), min_gray_levels_buf.get()
+            )
+            || !run(dev, dev->wolfExtremes, h)) {
+        return false;
+    }
+
+    // The per-row extremes are small enough to finish on the host.
+    // The window sums stay on the device for the second pass.
+    std::vector<double> max_deviations(h);
+    std::vector<cl_uint> min_gray_levels(h);
+    if (!readReals(dev, max_deviations_buf, max_deviations)
+            || !read(dev, min_gray_levels_buf, 0, &min_gray_levels[0], 0,
+                     sizeof(cl_uint) * h, 1)) {
+        return false;
+    }
+
+    double const max_deviation = *std::max_element(max_deviations.begin(), max_deviations.end());
+    double const min_gray_level = *std::min_element(min_gray_levels.begin(), min_gray_levels.end());
+
+    Buffer bw_buf;
+    return bw_buf.create(dev, sizeof(cl_uint) * wpl * h)
+           && setArgs(
+               dev->wolf, 0, gray_buf.get(), stride, w, h,
+               sums.get(), sqsums.get(), halves
+           )
+           && setRealArg(dev, dev->wolf, 7, max_deviation)
+           && setRealArg(dev, dev->wolf, 8, min_gray_level)
+           && setArgs(
+               dev->wolf, 9, int(lower_bound), int(upper_bound), bw_buf.get(), wpl
+           )
+           && run(dev, dev->wolf, wpl, h)
+           && readBinary(dev, bw_buf, gray.size(), dst);
+}
+
+#endif // ENABLE_GPU_COMPUTE
+
+} // namespace imageproc
@@ -0,0 +1,126 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_GPUCOMPUTE_H_
+#define IMAGEPROC_GPUCOMPUTE_H_
+
+#include <QString>
+
+class QImage;
+class QRect;
+class QSize;
+
+namespace imageproc
+{
+
+class BinaryImage;
+class GrayImage;
+class Brick;
+
+/**
+ * \brief Runs some of the heavier image operations on a GPU with OpenCL.
+ *
+ * The backend is off unless enabled with setEnabled(), and it's only
+ * compiled in when building with ENABLE_GPU_COMPUTE.  gaussBlur(),
+ * the gray morphology functions and the Sauvola and Wolf binarization
+ * functions try it first and fall back to their CPU code when the
+ * functions below return false.  That happens when the backend is
+ * disabled or unavailable, when the image is too small to be worth
+ * the transfer, or when anything goes wrong on the device.
+ *
+ * Intermediate results, like the first pass of a blur or an opening,
+ * stay in device memory.  Only the source and the result are transferred.
+ *
+ * The results are not guaranteed to be byte-identical to the CPU ones.
+ * A blur may differ by one gray level because of floating point
+ * evaluation order.  Morphology is exact.  Binarization is exact on
+ * devices with double precision support, and otherwise may differ
+ * in pixels that are within rounding error of the threshold.
+ *
+ * All functions are thread-safe.  Device work is serialized.
+ */
+class GpuCompute
+{
+public:
+    static void setEnabled(bool enabled);
+
+    static bool isEnabled();
+
+    /**
+     * \brief Returns the name of the device in use.
+     *
+     * Sets up the device if that wasn't done yet.  Returns an empty
+     * string if the backend is disabled or no device could be set up.
+     */
+    static QString deviceName();
+
+    /**
+     * \see imageproc::gaussBlur()
+     */
+    static bool gaussBlur(
+        GrayImage const& src, float h_sigma, float v_sigma, GrayImage& dst);
+
+    /**
+     * \see imageproc::dilateGray()
+     */
+    static bool dilateGray(
+        GrayImage const& src, Brick const& brick, QRect const& dst_area,
+        unsigned char src_surroundings, GrayImage& dst);
+
+    /**
+     * \see imageproc::erodeGray()
+     */
+    static bool erodeGray(
+        GrayImage const& src, Brick const& brick, QRect const& dst_area,
+        unsigned char src_surroundings, GrayImage& dst);
+
+    /**
+     * \see imageproc::openGray()
+     */
+    static bool openGray(
+        GrayImage const& src, QSize const& brick, QRect const& dst_area,
+        unsigned char src_surroundings, GrayImage& dst);
+
+    /**
+     * \see imageproc::closeGray()
+     */
+    static bool closeGray(
+        GrayImage const& src, QSize const& brick, QRect const& dst_area,
+        unsigned char src_surroundings, GrayImage& dst);
+
+    /**
+     * \see imageproc::binarizeSauvola()
+     *
+     * \p gray must be a grayscale image, as returned by toGrayscale().
+     */
+    static bool binarizeSauvola(
+        QImage const& gray, QSize const& window_size, BinaryImage& dst);
+
+    /**
+     * \see imageproc::binarizeWolf()
+     *
+     * \p gray must be a grayscale image, as returned by toGrayscale().
+     */
+    static bool binarizeWolf(
+        QImage const& gray, QSize const& window_size,
+        unsigned char lower_bound, unsigned char upper_bound, BinaryImage& dst);
+};
+
+} // namespace imageproc
+
+#endif
@@ -18,6 +18,7 @@
 
 #include "GrayImage.h"
 #include "Grayscale.h"
+#include "PixelBufferPool.h"
 #include <new>
 
 namespace imageproc
@@ -29,7 +30,18 @@ GrayImage::GrayImage(QSize size)
         return;
     }
 
-    m_image = QImage(size, QImage::Format_Indexed8);
+    // Lines are padded to a multiple of 4 bytes, as in QImage's own buffers.
+    int const stride = (size.width() + 3) & ~3;
+    void* const buffer = PixelBufferPool::allocate(size_t(stride) * size.height());
+    m_image = QImage(
+                  static_cast<uchar*>(buffer), size.width(), size.height(),
+                  stride, QImage::Format_Indexed8,
+                  &PixelBufferPool::release, buffer
+              );
+    if (m_image.isNull()) {
+        PixelBufferPool::release(buffer);
+        throw std::bad_alloc();
+    }
     m_image.setColorTable(createGrayscalePalette());
     if (m_image.isNull()) {
         throw std::bad_alloc();
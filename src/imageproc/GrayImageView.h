@@ -0,0 +1,157 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAGEPROC_GRAYIMAGEVIEW_H_
+#define IMAGEPROC_GRAYIMAGEVIEW_H_
+
+#include "GrayImage.h"
+#include <QSize>
+#include <QRect>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+namespace imageproc
+{
+
+/**
+ * \brief A non-owning, read-only view of a rectangle of 8-bit grayscale pixels.
+ *
+ * A view is a pointer to the top-left pixel, a stride and a size.
+ * Taking a view of a sub-rectangle of a GrayImage costs nothing,
+ * which makes views the way to pass regions of interest to kernels
+ * without copying them first.
+ *
+ * A view doesn't keep the pixels alive.  The image it was taken from
+ * must outlive it and must not be modified while the view is in use.
+ */
+class GrayImageView
+{
+public:
+    /**
+     * \brief Constructs a null view.
+     */
+    GrayImageView() : m_pData(0), m_stride(0), m_width(0), m_height(0) {}
+
+    /**
+     * \brief A view of the whole image.
+     */
+    GrayImageView(GrayImage const& image)
+        :   m_pData(image.data()), m_stride(image.stride()),
+            m_width(image.width()), m_height(image.height()) {}
+
+    /**
+     * \brief A view of a part of an image.
+     *
+     * \p rect must be within image.rect().
+     */
+    GrayImageView(GrayImage const& image, QRect const& rect)
+    {
+        *this = GrayImageView(image).subView(rect);
+    }
+
+    GrayImageView(uint8_t const* data, int stride, QSize const& size)
+        :   m_pData(data), m_stride(stride),
+            m_width(size.width()), m_height(size.height()) {}
+
+    /**
+     * \brief A view of a part of this view.
+     *
+     * \p rect is in the coordinates of this view and must be within rect().
+     * An empty \p rect produces a null view.
+     */
+    GrayImageView subView(QRect const& rect) const
+    {
+        assert(rect.isEmpty() || this->rect().contains(rect));
+        if (rect.isEmpty()) {
+            return GrayImageView();
+        }
+        return GrayImageView(
+                   m_pData + rect.top() * m_stride + rect.left(),
+                   m_stride, rect.size()
+               );
+    }
+
+    /**
+     * \brief Copies the pixels of the view into a new image.
+     */
+    GrayImage toGrayImage() const
+    {
+        GrayImage dst(size());
+        uint8_t const* src_line = m_pData;
+        uint8_t* dst_line = dst.data();
+        int const dst_stride = dst.stride();
+        for (int y = 0; y < m_height; ++y) {
+            memcpy(dst_line, src_line, m_width);
+            src_line += m_stride;
+            dst_line += dst_stride;
+        }
+        return dst;
+    }
+
+    bool isNull() const
+    {
+        return !m_pData || m_width <= 0 || m_height <= 0;
+    }
+
+    uint8_t const* data() const
+    {
+        return m_pData;
+    }
+
+    /**
+     * \brief Number of bytes between the starts of adjacent lines.
+     *
+     * Unlike GrayImage::stride(), this one is not necessarily
+     * a multiple of 4, and neither is data() aligned.
+     */
+    int stride() const
+    {
+        return m_stride;
+    }
+
+    QSize size() const
+    {
+        return QSize(m_width, m_height);
+    }
+
+    QRect rect() const
+    {
+        return QRect(0, 0, m_width, m_height);
+    }
+
+    int width() const
+    {
+        return m_width;
+    }
+
+    int height() const
+    {
+        return m_height;
+    }
+private:
+    uint8_t const* m_pData;
+    int m_stride;
+    int m_width;
+    int m_height;
+};
+
+} // namespace imageproc
+
+#endif
@@ -20,6 +20,7 @@
 #include "GrayImage.h"
 #include "BinaryImage.h"
 #include "BitOps.h"
+#include "Kernels.h"
 #include <QImage>
 #include <QColor>
 #include <QtGlobal>
@@ -129,12 +130,73 @@ static QImage rgbToGrayscale(QImage const& src)
         throw std::bad_alloc();
     }
 
+    Kernels::RgbToGrayFunc const rgb_to_gray = Kernels::active().rgbToGray;
+
     #pragma omp parallel for
     for (int y = 0; y < height; ++y) {
         uint8_t* dst_line = dst.scanLine(y);
         const QRgb* src_line = reinterpret_cast<const QRgb*>(src.scanLine(y));
+        rgb_to_gray(src_line, dst_line, width);
+    }
+
+    dst.setDotsPerMeterX(src.dotsPerMeterX());
+    dst.setDotsPerMeterY(src.dotsPerMeterY());
+
+    return dst;
+}
+
+static QImage rgb888ToGrayscale(QImage const& src)
+{
+    int const width = src.width();
+    int const height = src.height();
+
+    QImage dst(width, height, QImage::Format_Indexed8);
+    dst.setColorTable(createGrayscalePalette());
+    if (width > 0 && height > 0 && dst.isNull()) {
+        throw std::bad_alloc();
+    }
+
+    Kernels::Rgb888ToGrayFunc const rgb888_to_gray = Kernels::active().rgb888ToGray;
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        rgb888_to_gray(src.scanLine(y), dst.scanLine(y), width);
+    }
+
+    dst.setDotsPerMeterX(src.dotsPerMeterX());
+    dst.setDotsPerMeterY(src.dotsPerMeterY());
+
+    return dst;
+}
+
+/**
+ * Converts a color table image by converting its color table.
+ */
+static QImage indexed8ToGrayscale(QImage const& src)
+{
+    int const width = src.width();
+    int const height = src.height();
+
+    QImage dst(width, height, QImage::Format_Indexed8);
+    dst.setColorTable(createGrayscalePalette());
+    if (width > 0 && height > 0 && dst.isNull()) {
+        throw std::bad_alloc();
+    }
+
+    // QImage::pixel() gives 0 for indices past the color table.
+    uint8_t index_to_gray[256];
+    memset(index_to_gray, 0, sizeof(index_to_gray));
+    int const num_colors = std::min(src.colorCount(), 256);
+    for (int i = 0; i < num_colors; ++i) {
+        index_to_gray[i] = static_cast<uint8_t>(qGray(src.color(i)));
+    }
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        uint8_t const* src_line = src.scanLine(y);
+        uint8_t* dst_line = dst.scanLine(y);
         for (int x = 0; x < width; ++x) {
-            dst_line[x] = static_cast<uint8_t>(qGray(*src_line++));
+            dst_line[x] = index_to_gray[src_line[x]];
         }
     }
 
@@ -198,6 +260,8 @@ QImage toGrayscale(QImage const& src)
     case QImage::Format_ARGB32:
     case QImage::Format_ARGB32_Premultiplied:
         return rgbToGrayscale(src);
+    case QImage::Format_RGB888:
+        return rgb888ToGrayscale(src);
     case QImage::Format_Indexed8:
         if (src.isGrayscale()) {
             if (src.colorCount() == 256) {
@@ -211,7 +275,7 @@ QImage toGrayscale(QImage const& src)
                 return dst;
             }
         }
-    // fall though
+        return indexed8ToGrayscale(src);
     default:
         return anyToGrayscale(src);
     }
@@ -230,11 +294,30 @@ GrayImage stretchGrayRange(
     int const width = dst.width();
     int const height = dst.height();
 
-    int const num_pixels = width * height;
+    uint8_t gray_mapping[256];
+    stretchGrayRangeMapping(dst, gray_mapping, black_clip_fraction, white_clip_fraction);
+
+    uint8_t* line = dst.data();
+    int const stride = dst.stride();
+
+    for (int y = 0; y < height; ++y, line += stride) {
+        for (int x = 0; x < width; ++x) {
+            line[x] = gray_mapping[line[x]];
+        }
+    }
+
+    return dst;
+}
+
+void stretchGrayRangeMapping(
+    GrayImage const& src, uint8_t* const gray_mapping,
+    double const black_clip_fraction, double const white_clip_fraction)
+{
+    int const num_pixels = src.width() * src.height();
     int black_clip_pixels = qRound(black_clip_fraction * num_pixels);
     int white_clip_pixels = qRound(white_clip_fraction * num_pixels);
 
-    GrayscaleHistogram const hist(dst);
+    GrayscaleHistogram const hist(src);
 
     int min = 0;
     if (black_clip_fraction >= 1.0) {
@@ -260,8 +343,6 @@ GrayImage stretchGrayRange(
         }
     }
 
-    uint8_t gray_mapping[256];
-
     if (min >= max) {
         int const avg = (min + max) / 2;
         for (int i = 0; i <= avg; ++i) {
@@ -279,17 +360,6 @@ GrayImage stretchGrayRange(
             gray_mapping[i] = static_cast<uint8_t>(dst_level);
         }
     }
-
-    uint8_t* line = dst.data();
-    int const stride = dst.stride();
-
-    for (int y = 0; y < height; ++y, line += stride) {
-        for (int x = 0; x < width; ++x) {
-            line[x] = gray_mapping[line[x]];
-        }
-    }
-
-    return dst;
 }
 
 GrayImage createFramedImage(QSize const& size,
@@ -479,12 +549,38 @@ GrayscaleHistogram::fromGrayscaleImage(QImage const& img)
     int const w = img.width();
     int const h = img.height();
     int const bpl = img.bytesPerLine();
+    uint8_t const* const data = img.bits();
+
+    // Each thread counts into histograms of its own, which are summed up
+    // at the end.  Sharing m_pixels between threads would lose counts.
+    // Neighbouring pixels go to different sub-histograms, so that runs
+    // of the same gray level, typical for the background, don't wait
+    // on incrementing the same counter over and over.
+    #pragma omp parallel
+    {
+        int counts[4][256];
+        memset(counts, 0, sizeof(counts));
+
+        #pragma omp for schedule(static)
+        for (int y = 0; y < h; ++y) {
+            uint8_t const* line = data + y * bpl;
+            int x = 0;
+            for (; x + 4 <= w; x += 4) {
+                ++counts[0][line[x]];
+                ++counts[1][line[x + 1]];
+                ++counts[2][line[x + 2]];
+                ++counts[3][line[x + 3]];
+            }
+            for (; x < w; ++x) {
+                ++counts[0][line[x]];
+            }
+        }
 
-    #pragma omp parallel for
-    for (int y = 0; y < h; ++y) {
-        uint8_t const* line = img.bits() + y * bpl;
-        for (int x = 0; x < w; ++x) {
-            ++m_pixels[line[x]];
+        #pragma omp critical
+        {
+            for (int i = 0; i < 256; ++i) {
+                m_pixels[i] += counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i];
+            }
         }
     }
 }
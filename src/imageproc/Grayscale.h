@@ -22,6 +22,7 @@
 #include "GrayImage.h"
 #include <QVector>
 #include <QColor>
+#include <stdint.h>
 
 class QImage;
 class QSize;
@@ -91,6 +92,18 @@ QImage toGrayscale(QImage const& src);
 GrayImage stretchGrayRange(GrayImage const& src, double black_clip_fraction = 0.0,
                            double white_clip_fraction = 0.0);
 
+/**
+ * \brief The gray level mapping stretchGrayRange() would apply.
+ *
+ * The mapping is monotonic, so it may be applied after operations like
+ * min and max rather than before them, with the same result.
+ *
+ * \param mapping Receives the new level for each of 256 gray levels.
+ */
+void stretchGrayRangeMapping(
+    GrayImage const& src, uint8_t* mapping,
+    double black_clip_fraction = 0.0, double white_clip_fraction = 0.0);
+
 /**
  * \brief Create a grayscale image consisting of a 1 pixel frame and an inner area.
  *
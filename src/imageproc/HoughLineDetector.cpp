@@ -19,7 +19,7 @@
 #include "HoughLineDetector.h"
 #include "BinaryImage.h"
 #include "BWColor.h"
-#include "ConnCompEraser.h"
+#include "ConnCompExtractor.h"
 #include "ConnComp.h"
 #include "Connectivity.h"
 #include "Constants.h"
@@ -116,6 +116,29 @@ HoughLineDetector::process(int x, int y, unsigned weight)
     }
 }
 
+void
+HoughLineDetector::processRow(
+    int const y, int const* xs, unsigned const* weights, int const num_points)
+{
+    unsigned* hist_line = &m_histogram[0];
+
+    for (QPointF const& uv : m_angleUnitVectors) {
+        double const uv_x = uv.x();
+        double const y_term = uv.y() * y;
+        for (int i = 0; i < num_points; ++i) {
+            // Same operation order as in process(), to get the same bins.
+            double const distance = uv_x * xs[i] + y_term;
+            double const biased_distance = distance + m_distanceBias;
+
+            int const bin = (int)(biased_distance * m_recipDistanceResolution + 0.5);
+            assert(bin >= 0 && bin < m_histWidth);
+            hist_line[bin] += weights[i];
+        }
+
+        hist_line += m_histWidth;
+    }
+}
+
 QImage
 HoughLineDetector::visualizeHoughSpace(unsigned const lower_bound) const
 {
@@ -194,9 +217,8 @@ HoughLineDetector::findLines(unsigned const quality_lower_bound) const
     std::vector<HoughLine> lines;
 
 //    QRect const peaks_rect(peaks.rect());
-    ConnCompEraser eraser(peaks.release(), CONN8);
-    ConnComp cc;
-    while (!(cc = eraser.nextConnComp()).isNull()) {
+    ConnCompExtractor const extractor(peaks, CONN8);
+    for (ConnComp const& cc : extractor.connComps()) {
         unsigned const level = m_histogram[
                                    cc.seed().y() * m_histWidth + cc.seed().x()
                         ];
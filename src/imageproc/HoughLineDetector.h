@@ -110,6 +110,15 @@ public:
      */
     void process(int x, int y, unsigned weight = 1);
 
+    /**
+     * \brief Processes a batch of points on the same row.
+     *
+     * Equivalent to calling process(xs[i], y, weights[i]) for every i,
+     * but goes through the histogram one angle at a time, which is
+     * a lot more cache friendly for large batches.
+     */
+    void processRow(int y, int const* xs, unsigned const* weights, int num_points);
+
     QImage visualizeHoughSpace(unsigned lower_bound) const;
 
     /**
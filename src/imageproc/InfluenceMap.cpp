@@ -23,6 +23,7 @@
 #include "BitOps.h"
 #include <QImage>
 #include <QColor>
+#include <QThread>
 #include <algorithm>
 #include <stdexcept>
 #include <assert.h>
@@ -32,6 +33,16 @@ class QImage;
 namespace imageproc
 {
 
+namespace
+{
+
+/**
+ * Bands shorter than this aren't worth the work of joining them.
+ */
+int const MIN_BAND_HEIGHT = 128;
+
+} // anonymous namespace
+
 InfluenceMap::InfluenceMap()
     :   m_pData(0),
         m_size(),
@@ -112,57 +123,111 @@ InfluenceMap::init(
     m_pData = &m_data[0] + width + 1;
     m_maxLabel = cmap.maxLabel();
 
-    FastQueue<Cell*> queue;
-
-    Cell* cell = &m_data[0];
-    uint32_t const* label = cmap.paddedData();
-    for (int i = width * height; i > 0; --i) {
-        assert(*label <= cmap.maxLabel());
-        cell->label = *label;
-        cell->distSq = 0;
-        cell->vec.x = 0;
-        cell->vec.y = 0;
-        if (*label != 0) {
-            queue.push(cell);
-        }
-        ++cell;
-        ++label;
+    Cell* const padded = &m_data[0];
+
+    // The padding lines are never extended into.
+    for (int x = 0; x < width; ++x) {
+        Cell const cell = { 0, 0, { 0, 0 } };
+        padded[x] = cell;
+        padded[(height - 1) * width + x] = cell;
+    }
+
+    // Each band of lines is extended independently, without looking
+    // into other bands.  The extension is then continued across band
+    // boundaries, which usually affects only a few lines around them.
+    int const inner_height = height - 2;
+    int const num_bands = std::max(
+        1, std::min(QThread::idealThreadCount(), inner_height / MIN_BAND_HEIGHT)
+    );
+
+    #pragma omp parallel for schedule(static, 1)
+    for (int band = 0; band < num_bands; ++band) {
+        int const y_from = 1 + inner_height * band / num_bands;
+        int const y_to = 1 + inner_height * (band + 1) / num_bands;
+
+        FastQueue<Cell*> queue;
+        initLines(cmap, mask, y_from, y_to, queue);
+        propagate(queue, padded + y_from * width, padded + y_to * width);
     }
 
-    if (mask) {
-        uint32_t const* mask_line = mask->data();
-        int const mask_stride = mask->wordsPerLine();
-        cell = m_pData;
-        uint32_t const msb = uint32_t(1) << 31;
-        for (int y = 0; y < height - 2; ++y) {
-            for (int x = 0; x < width - 2; ++x, ++cell) {
-                if (mask_line[x >> 5] & (msb >> (x & 31))) {
-                    if (cell->label == 0) {
-                        cell->distSq = ~uint32_t(0);
-                    }
+    if (num_bands > 1) {
+        FastQueue<Cell*> queue;
+        for (int band = 1; band < num_bands; ++band) {
+            int const boundary = 1 + inner_height * band / num_bands;
+            Cell* cell = padded + (boundary - 1) * width;
+            for (int i = width * 2; i > 0; --i, ++cell) {
+                if (cell->label != 0) {
+                    queue.push(cell);
                 }
             }
-            mask_line += mask_stride;
-            cell += 2;
         }
-    } else {
-        cell = m_pData;
-        for (int y = 0; y < height - 2; ++y) {
-            for (int x = 0; x < width - 2; ++x, ++cell) {
-                if (cell->label == 0) {
+        propagate(queue, padded, padded + width * height);
+    }
+}
+
+void
+InfluenceMap::initLines(
+    ConnectivityMap const& cmap, BinaryImage const* mask,
+    int const y_from, int const y_to, FastQueue<Cell*>& queue)
+{
+    int const width = m_stride;
+    uint32_t const msb = uint32_t(1) << 31;
+
+    for (int y = y_from; y < y_to; ++y) {
+        Cell* cell = &m_data[0] + y * width;
+        uint32_t const* label = cmap.paddedData() + y * width;
+        uint32_t const* const mask_line = mask ? mask->data() + (y - 1) * mask->wordsPerLine() : 0;
+
+        for (int x = 0; x < width; ++x, ++cell, ++label) {
+            assert(*label <= cmap.maxLabel());
+            cell->label = *label;
+            cell->distSq = 0;
+            cell->vec.x = 0;
+            cell->vec.y = 0;
+            if (*label != 0) {
+                queue.push(cell);
+            } else if (x != 0 && x != width - 1) {
+                int const mx = x - 1;
+                if (!mask_line || (mask_line[mx >> 5] & (msb >> (mx & 31)))) {
                     cell->distSq = ~uint32_t(0);
                 }
             }
-            cell += 2;
         }
     }
+}
+
+inline void
+InfluenceMap::relax(
+    Cell const& cell, Cell* const nbh, uint32_t const new_dist_sq,
+    int const dx, int const dy, Cell* const begin, Cell* const end,
+    FastQueue<Cell*>& queue)
+{
+    if (nbh < begin || nbh >= end) {
+        // Belongs to another band.
+        return;
+    }
+
+    if (new_dist_sq < nbh->distSq) {
+        nbh->label = cell.label;
+        nbh->distSq = new_dist_sq;
+        nbh->vec.x = cell.vec.x + dx;
+        nbh->vec.y = cell.vec.y + dy;
+        queue.push(nbh);
+    }
+}
+
+void
+InfluenceMap::propagate(
+    FastQueue<Cell*>& queue, Cell* const begin, Cell* const end)
+{
+    int const width = m_stride;
 
     while (!queue.empty()) {
-        cell = queue.front();
+        Cell* const cell = queue.front();
         queue.pop();
 
         assert((cell - &m_data[0]) / width > 0);
-        assert((cell - &m_data[0]) / width < height - 1);
+        assert((cell - &m_data[0]) / width < int(m_data.size()) / width - 1);
         assert((cell - &m_data[0]) % width > 0);
         assert((cell - &m_data[0]) % width < width - 1);
         assert(cell->distSq != ~uint32_t(0));
@@ -173,92 +238,28 @@ InfluenceMap::init(
         int32_t const dy2 = cell->vec.y << 1;
 
         // North-western neighbor.
-        Cell* nbh = cell - width - 1;
-        uint32_t new_dist_sq = cell->distSq + dx2 + dy2 + 2;
-        if (new_dist_sq < nbh->distSq) {
-            nbh->label = cell->label;
-            nbh->distSq = new_dist_sq;
-            nbh->vec.x = cell->vec.x + 1;
-            nbh->vec.y = cell->vec.y + 1;
-            queue.push(nbh);
-        }
+        relax(*cell, cell - width - 1, cell->distSq + dx2 + dy2 + 2, 1, 1, begin, end, queue);
 
         // Northern neighbor.
-        ++nbh;
-        new_dist_sq = cell->distSq + dy2 + 1;
-        if (new_dist_sq < nbh->distSq) {
-            nbh->label = cell->label;
-            nbh->distSq = new_dist_sq;
-            nbh->vec.x = cell->vec.x;
-            nbh->vec.y = cell->vec.y + 1;
-            queue.push(nbh);
-        }
+        relax(*cell, cell - width, cell->distSq + dy2 + 1, 0, 1, begin, end, queue);
 
         // North-eastern neighbor.
-        ++nbh;
-        new_dist_sq = cell->distSq - dx2 + dy2 + 2;
-        if (new_dist_sq < nbh->distSq) {
-            nbh->label = cell->label;
-            nbh->distSq = new_dist_sq;
-            nbh->vec.x = cell->vec.x - 1;
-            nbh->vec.y = cell->vec.y + 1;
-            queue.push(nbh);
-        }
+        relax(*cell, cell - width + 1, cell->distSq - dx2 + dy2 + 2, -1, 1, begin, end, queue);
 
         // Eastern neighbor.
-        nbh += width;
-        new_dist_sq = cell->distSq - dx2 + 1;
-        if (new_dist_sq < nbh->distSq) {
-            nbh->label = cell->label;
-            nbh->distSq = new_dist_sq;
-            nbh->vec.x = cell->vec.x - 1;
-            nbh->vec.y = cell->vec.y;
-            queue.push(nbh);
-        }
+        relax(*cell, cell + 1, cell->distSq - dx2 + 1, -1, 0, begin, end, queue);
 
         // South-eastern neighbor.
-        nbh += width;
-        new_dist_sq = cell->distSq - dx2 - dy2 + 2;
-        if (new_dist_sq < nbh->distSq) {
-            nbh->label = cell->label;
-            nbh->distSq = new_dist_sq;
-            nbh->vec.x = cell->vec.x - 1;
-            nbh->vec.y = cell->vec.y - 1;
-            queue.push(nbh);
-        }
+        relax(*cell, cell + width + 1, cell->distSq - dx2 - dy2 + 2, -1, -1, begin, end, queue);
 
         // Southern neighbor.
-        --nbh;
-        new_dist_sq = cell->distSq - dy2 + 1;
-        if (new_dist_sq < nbh->distSq) {
-            nbh->label = cell->label;
-            nbh->distSq = new_dist_sq;
-            nbh->vec.x = cell->vec.x;
-            nbh->vec.y = cell->vec.y - 1;
-            queue.push(nbh);
-        }
+        relax(*cell, cell + width, cell->distSq - dy2 + 1, 0, -1, begin, end, queue);
 
         // South-western neighbor.
-        --nbh;
-        new_dist_sq = cell->distSq + dx2 - dy2 + 2;
-        if (new_dist_sq < nbh->distSq) {
-            nbh->label = cell->label;
-            nbh->distSq = new_dist_sq;
-            nbh->vec.x = cell->vec.x + 1;
-            nbh->vec.y = cell->vec.y - 1;
-            queue.push(nbh);
-        }
+        relax(*cell, cell + width - 1, cell->distSq + dx2 - dy2 + 2, 1, -1, begin, end, queue);
 
         // Western neighbor.
-        nbh -= width;
-        new_dist_sq = cell->distSq + dx2 + 1;
-        if (new_dist_sq < nbh->distSq) {
-            nbh->label = cell->label;
-            nbh->distSq = new_dist_sq;
-            nbh->vec.x = cell->vec.x + 1;
-            nbh->vec.y = cell->vec.y;
-            queue.push(nbh);
-        }
+        relax(*cell, cell - 1, cell->distSq + dx2 + 1, 1, 0, begin, end, queue);
     }
 }
 
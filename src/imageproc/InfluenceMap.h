@@ -19,6 +19,7 @@
 #ifndef IMAGEPROC_INFLUENCE_MAP_H_
 #define IMAGEPROC_INFLUENCE_MAP_H_
 
+#include "FastQueue.h"
 #include <QSize>
 #include <vector>
 #include <stdint.h>
@@ -177,6 +178,23 @@ public:
 private:
     void init(ConnectivityMap const& cmap, BinaryImage const* mask = 0);
 
+    /**
+     * Initializes lines [y_from, y_to) of the padded map and queues
+     * the labelled cells.
+     */
+    void initLines(
+        ConnectivityMap const& cmap, BinaryImage const* mask,
+        int y_from, int y_to, FastQueue<Cell*>& queue);
+
+    /**
+     * Extends the queued cells, never touching cells outside of [begin, end).
+     */
+    void propagate(FastQueue<Cell*>& queue, Cell* begin, Cell* end);
+
+    static void relax(
+        Cell const& cell, Cell* nbh, uint32_t new_dist_sq,
+        int dx, int dy, Cell* begin, Cell* end, FastQueue<Cell*>& queue);
+
     std::vector<Cell> m_data;
     Cell* m_pData;
     QSize m_size;
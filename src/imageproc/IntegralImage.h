@@ -74,6 +74,14 @@ public:
      *       undefined.
      */
     T sum(QRect const& rect) const;
+
+    /**
+     * \brief Returns the dimensions of the original array.
+     */
+    QSize size() const
+    {
+        return QSize(m_width - 1, m_height - 1);
+    }
 private:
     void init(int width, int height);
 
@@ -0,0 +1,338 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Jbig2Encoder.h"
+#include "BinaryImage.h"
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+namespace imageproc
+{
+
+namespace
+{
+
+/**
+ * The probability estimation table of the MQ coder, from T.88 Table E.1.
+ */
+struct QeEntry {
+    uint16_t qe;
+    uint8_t nmps;
+    uint8_t nlps;
+    uint8_t switchMps;
+};
+
+QeEntry const qeTable[47] = {
+    { 0x5601, 1, 1, 1 }, { 0x3401, 2, 6, 0 }, { 0x1801, 3, 9, 0 },
+    { 0x0ac1, 4, 12, 0 }, { 0x0521, 5, 29, 0 }, { 0x0221, 38, 33, 0 },
+    { 0x5601, 7, 6, 1 }, { 0x5401, 8, 14, 0 }, { 0x4801, 9, 14, 0 },
+    { 0x3801, 10, 14, 0 }, { 0x3001, 11, 17, 0 }, { 0x2401, 12, 18, 0 },
+    { 0x1c01, 13, 20, 0 }, { 0x1601, 29, 21, 0 }, { 0x5601, 15, 14, 1 },
+    { 0x5401, 16, 14, 0 }, { 0x5101, 17, 15, 0 }, { 0x4801, 18, 16, 0 },
+    { 0x3801, 19, 17, 0 }, { 0x3401, 20, 18, 0 }, { 0x3001, 21, 19, 0 },
+    { 0x2801, 22, 19, 0 }, { 0x2401, 23, 20, 0 }, { 0x2201, 24, 21, 0 },
+    { 0x1c01, 25, 22, 0 }, { 0x1801, 26, 23, 0 }, { 0x1601, 27, 24, 0 },
+    { 0x1401, 28, 25, 0 }, { 0x1201, 29, 26, 0 }, { 0x1101, 30, 27, 0 },
+    { 0x0ac1, 31, 28, 0 }, { 0x09c1, 32, 29, 0 }, { 0x08a1, 33, 30, 0 },
+    { 0x0521, 34, 31, 0 }, { 0x0441, 35, 32, 0 }, { 0x02a1, 36, 33, 0 },
+    { 0x0221, 37, 34, 0 }, { 0x0141, 38, 35, 0 }, { 0x0111, 39, 36, 0 },
+    { 0x0085, 40, 37, 0 }, { 0x0049, 41, 38, 0 }, { 0x0025, 42, 39, 0 },
+    { 0x0015, 43, 40, 0 }, { 0x0009, 44, 41, 0 }, { 0x0005, 45, 42, 0 },
+    { 0x0001, 45, 43, 0 }, { 0x5601, 46, 46, 0 }
+};
+
+/**
+ * The MQ arithmetic encoder, as described in T.88 Annex E.2.
+ */
+class MqEncoder
+{
+public:
+    explicit MqEncoder(int num_contexts)
+        :   m_index(num_contexts, 0),
+            m_mps(num_contexts, 0),
+            m_a(0x8000),
+            m_c(0),
+            m_ct(12),
+            m_b(0),
+            m_haveB(false)
+    {
+    }
+
+    void encode(int const cx, int const bit)
+    {
+        QeEntry const& entry = qeTable[m_index[cx]];
+        uint32_t const qe = entry.qe;
+        m_a -= qe;
+
+        if (bit == m_mps[cx]) {
+            if (m_a & 0x8000) {
+                m_c += qe;
+                return;
+            }
+            if (m_a < qe) {
+                m_a = qe;
+            } else {
+                m_c += qe;
+            }
+            m_index[cx] = entry.nmps;
+        } else {
+            if (m_a < qe) {
+                m_c += qe;
+            } else {
+                m_a = qe;
+            }
+            if (entry.switchMps) {
+                m_mps[cx] ^= 1;
+            }
+            m_index[cx] = entry.nlps;
+        }
+
+        do {
+            m_a <<= 1;
+            m_c <<= 1;
+            if (--m_ct == 0) {
+                byteOut();
+            }
+        } while (!(m_a & 0x8000));
+    }
+
+    /**
+     * Flushes the coder and appends the 0xFF 0xAC marker.
+     */
+    void finish()
+    {
+        uint32_t const temp_c = m_c + m_a;
+        m_c |= 0xffff;
+        if (m_c >= temp_c) {
+            m_c -= 0x8000;
+        }
+        m_c <<= m_ct;
+        byteOut();
+        m_c <<= m_ct;
+        byteOut();
+
+        emit();
+        if (m_b != 0xff) {
+            m_data.append(char(0xff));
+        }
+        m_data.append(char(0xac));
+    }
+
+    QByteArray const& data() const
+    {
+        return m_data;
+    }
+private:
+    void byteOut()
+    {
+        if (m_b == 0xff) {
+            // A bit is stuffed after 0xFF, so that carries can't
+            // produce a marker.
+            emit();
+            m_b = m_c >> 20;
+            m_c &= 0xfffff;
+            m_ct = 7;
+            return;
+        }
+
+        if (m_c >= 0x8000000) {
+            // Propagate the carry.
+            ++m_b;
+            if (m_b == 0xff) {
+                m_c &= 0x7ffffff;
+                emit();
+                m_b = m_c >> 20;
+                m_c &= 0xfffff;
+                m_ct = 7;
+                return;
+            }
+        }
+
+        emit();
+        m_b = (m_c >> 19) & 0xff;
+        m_c &= 0x7ffff;
+        m_ct = 8;
+    }
+
+    /**
+     * Outputs the pending byte, except for the imaginary one that
+     * precedes the data.
+     */
+    void emit()
+    {
+        if (m_haveB) {
+            m_data.append(char(m_b));
+        }
+        m_haveB = true;
+    }
+
+    std::vector<uint8_t> m_index;
+    std::vector<uint8_t> m_mps;
+    QByteArray m_data;
+    uint32_t m_a;
+    uint32_t m_c;
+    int m_ct;
+    uint32_t m_b;
+    bool m_haveB;
+};
+
+/**
+ * A copy of a line of the image with the bits past its width cleared
+ * and a zero word at the end, so pixels to the right of the image
+ * can be read as white.
+ */
+class PaddedLine
+{
+public:
+    explicit PaddedLine(int width)
+        :   m_words(((width + 31) >> 5) + 1, 0),
+            m_width(width)
+    {
+    }
+
+    void load(uint32_t const* line)
+    {
+        int const num_words = (m_width + 31) >> 5;
+        memcpy(&m_words[0], line, num_words * 4);
+        if (m_width & 31) {
+            m_words[num_words - 1] &= ~uint32_t(0) << (32 - (m_width & 31));
+        }
+    }
+
+    int pixel(int const x) const
+    {
+        return (m_words[x >> 5] >> (31 - (x & 31))) & 1;
+    }
+private:
+    std::vector<uint32_t> m_words;
+    int m_width;
+};
+
+void putUint32(QByteArray& data, uint32_t const val)
+{
+    data.append(char(val >> 24));
+    data.append(char(val >> 16));
+    data.append(char(val >> 8));
+    data.append(char(val));
+}
+
+void putSegmentHeader(
+    QByteArray& data, uint32_t const number, int const type, uint32_t const data_length)
+{
+    putUint32(data, number);
+    data.append(char(type)); // With a one byte page association.
+    data.append(char(0)); // Refers to no other segments.
+    data.append(char(1)); // Page 1.
+    putUint32(data, data_length);
+}
+
+} // anonymous namespace
+
+QByteArray
+Jbig2Encoder::encodeEmbedded(BinaryImage const& image)
+{
+    assert(!image.isNull());
+
+    uint32_t const width = image.width();
+    uint32_t const height = image.height();
+
+    QByteArray data;
+
+    // Page information.  The resolution is left unspecified,
+    // as PDF takes the size from the image dictionary.
+    putSegmentHeader(data, 0, 48, 19);
+    putUint32(data, width);
+    putUint32(data, height);
+    putUint32(data, 0);
+    putUint32(data, 0);
+    data.append(char(0)); // White by default, OR combination operator.
+    data.append(char(0)); // Not striped.
+    data.append(char(0));
+
+    QByteArray const region(encodeGenericRegion(image));
+
+    // Immediate lossless generic region.
+    putSegmentHeader(data, 1, 38, 17 + 1 + 8 + region.size());
+    putUint32(data, width);
+    putUint32(data, height);
+    putUint32(data, 0); // x
+    putUint32(data, 0); // y
+    data.append(char(0)); // OR combination operator.
+    data.append(char(0)); // Arithmetic coding, template 0, no typical prediction.
+    static signed char const at_pixels[] = { 3, -1, -3, -1, 2, -2, -2, -2 };
+    data.append(reinterpret_cast<char const*>(at_pixels), sizeof(at_pixels));
+    data.append(region);
+
+    return data;
+}
+
+QByteArray
+Jbig2Encoder::encodeGenericRegion(BinaryImage const& image)
+{
+    assert(!image.isNull());
+
+    int const width = image.width();
+    int const height = image.height();
+    int const wpl = image.wordsPerLine();
+    uint32_t const* line = image.data();
+
+    MqEncoder encoder(1 << 16);
+
+    // Lines y - 2, y - 1 and y.
+    PaddedLine lines[3] = { PaddedLine(width), PaddedLine(width), PaddedLine(width) };
+    int above2 = 0;
+    int above1 = 1;
+    int current = 2;
+
+    for (int y = 0; y < height; ++y, line += wpl) {
+        lines[current].load(line);
+        PaddedLine const& l2 = lines[above2];
+        PaddedLine const& l1 = lines[above1];
+        PaddedLine const& l0 = lines[current];
+
+        // The template 0 context, with the adaptive pixels at their
+        // default positions, is made of:
+        // bits 0-3: pixels x - 1 to x - 4 of line y;
+        // bits 4-10: pixels x + 3 to x - 3 of line y - 1;
+        // bits 11-15: pixels x + 2 to x - 2 of line y - 2.
+        // Each part is kept in a window that slides to the right.
+        uint32_t w0 = 0;
+        uint32_t w1 = (l1.pixel(0) << 2) | (l1.pixel(1) << 1) | l1.pixel(2);
+        uint32_t w2 = (l2.pixel(0) << 1) | l2.pixel(1);
+
+        for (int x = 0; x < width; ++x) {
+            w1 = ((w1 << 1) | l1.pixel(x + 3)) & 0x7f;
+            w2 = ((w2 << 1) | l2.pixel(x + 2)) & 0x1f;
+            int const pixel = l0.pixel(x);
+            encoder.encode(w0 | (w1 << 4) | (w2 << 11), pixel);
+            w0 = ((w0 << 1) | pixel) & 0x0f;
+        }
+
+        int const recycled = above2;
+        above2 = above1;
+        above1 = current;
+        current = recycled;
+    }
+
+    encoder.finish();
+    return encoder.data();
+}
+
+} // namespace imageproc
@@ -0,0 +1,66 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_JBIG2ENCODER_H_
+#define IMAGEPROC_JBIG2ENCODER_H_
+
+#include <QByteArray>
+
+namespace imageproc
+{
+
+class BinaryImage;
+
+/**
+ * \brief Encodes bilevel images as JBIG2 (ITU-T T.88) generic regions.
+ *
+ * The whole image becomes a single generic region, arithmetic coded
+ * with template 0 and the default adaptive pixels.  That's lossless and
+ * typically takes noticeably less space than CCITT G4, at the cost of
+ * being slower to encode.  No symbol dictionaries are built.
+ *
+ * Pixels are read from BinaryImage's words directly, with the coding
+ * context updated incrementally as the lines are scanned.
+ */
+class Jbig2Encoder
+{
+public:
+    /**
+     * \brief Encodes an image as the embedded stream PDF's JBIG2Decode
+     *        filter takes.
+     *
+     * That's a page information segment followed by an immediate generic
+     * region segment, without the file header and the end of page
+     * segment.  JBIG2 codes black as 1, so an image mask made of this
+     * needs /Decode [1 0] to paint the black pixels.
+     */
+    static QByteArray encodeEmbedded(BinaryImage const& image);
+
+    /**
+     * \brief Returns just the arithmetic coded pixels of a generic region.
+     *
+     * That's what follows the region header in the segments produced
+     * by encodeEmbedded().  The data is terminated with the 0xFF 0xAC
+     * marker.
+     */
+    static QByteArray encodeGenericRegion(BinaryImage const& image);
+};
+
+} // namespace imageproc
+
+#endif
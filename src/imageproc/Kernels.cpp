@@ -0,0 +1,424 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kernels.h"
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QtGlobal>
+#include <assert.h>
+
+// Specialized kernels are the generic code below compiled for a particular
+// instruction set, which lets the compiler vectorize it accordingly.
+// The target attribute needed for that is GCC / Clang specific.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGEPROC_X86_KERNELS 1
+#endif
+
+#if defined(__GNUC__) && (defined(__ARM_NEON) || defined(__aarch64__))
+#define IMAGEPROC_NEON_KERNELS 1
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define IMAGEPROC_SCALAR_ATTR __attribute__((optimize("no-tree-vectorize")))
+#else
+#define IMAGEPROC_SCALAR_ATTR
+#endif
+
+namespace imageproc
+{
+
+namespace
+{
+
+inline void rgbToGrayImpl(uint32_t const* src, uint8_t* dst, int const count)
+{
+    for (int i = 0; i < count; ++i) {
+        uint32_t const rgb = src[i];
+        uint32_t const r = (rgb >> 16) & 0xff;
+        uint32_t const g = (rgb >> 8) & 0xff;
+        uint32_t const b = rgb & 0xff;
+        // Same as qGray().
+        dst[i] = static_cast<uint8_t>((r * 11 + g * 16 + b * 5) >> 5);
+    }
+}
+
+inline void rgb888ToGrayImpl(uint8_t const* src, uint8_t* dst, int const count)
+{
+    for (int i = 0; i < count; ++i) {
+        uint32_t const r = src[i * 3];
+        uint32_t const g = src[i * 3 + 1];
+        uint32_t const b = src[i * 3 + 2];
+        dst[i] = static_cast<uint8_t>((r * 11 + g * 16 + b * 5) >> 5);
+    }
+}
+
+template<int Threshold>
+inline uint32_t thresholdWords(uint32_t const top, uint32_t const bottom)
+{
+    switch (Threshold) {
+    case 1: {
+        uint32_t const word = top | bottom;
+        return word | (word << 1);
+    }
+    case 2: {
+        uint32_t const word1 = top & bottom;
+        uint32_t const word2 = top | bottom;
+        return (word1 | (word1 << 1)) | (word2 & (word2 << 1));
+    }
+    case 3: {
+        uint32_t const word1 = top | bottom;
+        uint32_t const word2 = top & bottom;
+        return (word1 & (word1 << 1)) & (word2 | (word2 << 1));
+    }
+    default: {
+        uint32_t const word = top & bottom;
+        return word & (word << 1);
+    }
+    }
+}
+
+/**
+ * Throw away every other bit starting with bit 0 and pack the remaining
+ * bits into the lower half of a word.  Unlike a lookup table, this
+ * vectorizes well.
+ */
+inline uint32_t compressOddBits(uint32_t const bits)
+{
+    uint32_t r = (bits >> 1) & 0x55555555;
+    r = (r | (r >> 1)) & 0x33333333;
+    r = (r | (r >> 2)) & 0x0f0f0f0f;
+    r = (r | (r >> 4)) & 0x00ff00ff;
+    r = (r | (r >> 8)) & 0x0000ffff;
+    return r;
+}
+
+template<int Threshold>
+inline void reduceThresholdImpl(
+    uint32_t const* top, uint32_t const* bottom, uint32_t* dst, int const src_words)
+{
+    int const pairs = src_words >> 1;
+    for (int i = 0; i < pairs; ++i) {
+        uint32_t const upper = thresholdWords<Threshold>(top[i * 2], bottom[i * 2]);
+        uint32_t const lower = thresholdWords<Threshold>(top[i * 2 + 1], bottom[i * 2 + 1]);
+        dst[i] = (compressOddBits(upper) << 16) | compressOddBits(lower);
+    }
+
+    if (src_words & 1) {
+        uint32_t const upper = thresholdWords<Threshold>(top[pairs * 2], bottom[pairs * 2]);
+        dst[pairs] = compressOddBits(upper) << 16;
+    }
+}
+
+inline void reduceThresholdImpl(
+    uint32_t const* top, uint32_t const* bottom,
+    uint32_t* dst, int const src_words, int const threshold)
+{
+    switch (threshold) {
+    case 1:
+        reduceThresholdImpl<1>(top, bottom, dst, src_words);
+        break;
+    case 2:
+        reduceThresholdImpl<2>(top, bottom, dst, src_words);
+        break;
+    case 3:
+        reduceThresholdImpl<3>(top, bottom, dst, src_words);
+        break;
+    default:
+        assert(threshold == 4);
+        reduceThresholdImpl<4>(top, bottom, dst, src_words);
+        break;
+    }
+}
+
+inline uint8_t reservedPixel(uint8_t const pixel)
+{
+    return pixel == 0x00 ? 0x01 : (pixel == 0xff ? 0xfe : pixel);
+}
+
+inline uint32_t reservedPixel(uint32_t const pixel)
+{
+    // We handle both RGB32 and ARGB32 here.
+    uint32_t const rgb = pixel & 0x00ffffff;
+    return rgb == 0x00000000 ? 0xff010101 : (rgb == 0x00ffffff ? 0xfffefefe : pixel);
+}
+
+template<typename Pixel>
+inline void reserveBlackAndWhiteImpl(Pixel* pixels, int const count)
+{
+    for (int i = 0; i < count; ++i) {
+        pixels[i] = reservedPixel(pixels[i]);
+    }
+}
+
+template<typename Pixel>
+inline Pixel combinedPixel(
+    Pixel const pixel, uint32_t const content_word,
+    uint32_t const mask_word, int const bit)
+{
+    // 0 for white and 1 for black becomes 0xffffffff and 0, then opaque.
+    uint32_t const bw = (((content_word >> bit) & 1) - 1) | 0xff000000;
+    return ((mask_word >> bit) & 1) ? static_cast<Pixel>(bw) : reservedPixel(pixel);
+}
+
+/**
+ * Goes word by word, so that the inner loop has a constant trip count
+ * and constant shifts, which is what lets it vectorize into masked blends.
+ */
+template<typename Pixel>
+inline void combineMixedImpl(
+    Pixel* mixed, uint32_t const* bw_content,
+    uint32_t const* bw_mask, int const count)
+{
+    int const full_words = count >> 5;
+    for (int w = 0; w < full_words; ++w, mixed += 32) {
+        uint32_t const content_word = bw_content[w];
+        uint32_t const mask_word = bw_mask[w];
+        for (int i = 0; i < 32; ++i) {
+            mixed[i] = combinedPixel(mixed[i], content_word, mask_word, 31 - i);
+        }
+    }
+
+    int const tail = count & 31;
+    if (tail) {
+        uint32_t const content_word = bw_content[full_words];
+        uint32_t const mask_word = bw_mask[full_words];
+        for (int i = 0; i < tail; ++i) {
+            mixed[i] = combinedPixel(mixed[i], content_word, mask_word, 31 - i);
+        }
+    }
+}
+
+/**
+ * A population count made of plain arithmetic.  Unlike the POPCNT
+ * instruction, which has no vector form below AVX-512 VPOPCNTDQ,
+ * this vectorizes at every level.
+ */
+inline uint32_t bitCount(uint32_t word)
+{
+    word = word - ((word >> 1) & 0x55555555);
+    word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+    return (((word + (word >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+inline int countBitsImpl(uint32_t const* words, int const count)
+{
+    uint32_t bits = 0;
+    for (int i = 0; i < count; ++i) {
+        bits += bitCount(words[i]);
+    }
+    return static_cast<int>(bits);
+}
+
+#define IMAGEPROC_DEFINE_KERNELS(suffix, attr)                              \
+    attr void rgbToGray##suffix(                                            \
+        uint32_t const* src, uint8_t* dst, int count)                       \
+    {                                                                       \
+        rgbToGrayImpl(src, dst, count);                                     \
+    }                                                                       \
+    attr void rgb888ToGray##suffix(                                         \
+        uint8_t const* src, uint8_t* dst, int count)                        \
+    {                                                                       \
+        rgb888ToGrayImpl(src, dst, count);                                  \
+    }                                                                       \
+    attr void reduceThreshold##suffix(                                      \
+        uint32_t const* top, uint32_t const* bottom,                        \
+        uint32_t* dst, int src_words, int threshold)                        \
+    {                                                                       \
+        reduceThresholdImpl(top, bottom, dst, src_words, threshold);        \
+    }                                                                       \
+    attr void reserveBlackAndWhiteGray##suffix(uint8_t* pixels, int count)  \
+    {                                                                       \
+        reserveBlackAndWhiteImpl(pixels, count);                            \
+    }                                                                       \
+    attr void reserveBlackAndWhiteRgb##suffix(uint32_t* pixels, int count)  \
+    {                                                                       \
+        reserveBlackAndWhiteImpl(pixels, count);                            \
+    }                                                                       \
+    attr void combineMixedGray##suffix(                                     \
+        uint8_t* mixed, uint32_t const* bw_content,                         \
+        uint32_t const* bw_mask, int count)                                 \
+    {                                                                       \
+        combineMixedImpl(mixed, bw_content, bw_mask, count);                \
+    }                                                                       \
+    attr void combineMixedRgb##suffix(                                      \
+        uint32_t* mixed, uint32_t const* bw_content,                        \
+        uint32_t const* bw_mask, int count)                                 \
+    {                                                                       \
+        combineMixedImpl(mixed, bw_content, bw_mask, count);                \
+    }                                                                       \
+    attr int countBits##suffix(uint32_t const* words, int count)            \
+    {                                                                       \
+        return countBitsImpl(words, count);                                 \
+    }
+
+IMAGEPROC_DEFINE_KERNELS(Scalar, IMAGEPROC_SCALAR_ATTR)
+
+#if IMAGEPROC_X86_KERNELS
+IMAGEPROC_DEFINE_KERNELS(Sse41, __attribute__((target("sse4.1"))))
+IMAGEPROC_DEFINE_KERNELS(Avx2, __attribute__((target("avx2"))))
+IMAGEPROC_DEFINE_KERNELS(Avx512, __attribute__((target("avx512f,avx512bw"))))
+#endif
+
+#if IMAGEPROC_NEON_KERNELS
+// NEON is part of the baseline there, so no special attribute is needed.
+IMAGEPROC_DEFINE_KERNELS(Neon, )
+#endif
+
+#undef IMAGEPROC_DEFINE_KERNELS
+
+#define IMAGEPROC_KERNELS_ENTRY(level, suffix)                              \
+    {                                                                       \
+        level, &rgbToGray##suffix, &rgb888ToGray##suffix,                   \
+        &reduceThreshold##suffix,                                           \
+        &reserveBlackAndWhiteGray##suffix, &reserveBlackAndWhiteRgb##suffix,\
+        &combineMixedGray##suffix, &combineMixedRgb##suffix,                \
+        &countBits##suffix                                                  \
+    }
+#define IMAGEPROC_MISSING_KERNELS_ENTRY(level)                              \
+    {                                                                       \
+        level, nullptr, nullptr, nullptr, nullptr,                          \
+        nullptr, nullptr, nullptr, nullptr                                  \
+    }
+
+Kernels const tables[Kernels::NUM_LEVELS] = {
+    IMAGEPROC_KERNELS_ENTRY(Kernels::SCALAR, Scalar),
+#if IMAGEPROC_X86_KERNELS
+    IMAGEPROC_KERNELS_ENTRY(Kernels::SSE41, Sse41),
+    IMAGEPROC_KERNELS_ENTRY(Kernels::AVX2, Avx2),
+    IMAGEPROC_KERNELS_ENTRY(Kernels::AVX512, Avx512),
+#else
+    IMAGEPROC_MISSING_KERNELS_ENTRY(Kernels::SSE41),
+    IMAGEPROC_MISSING_KERNELS_ENTRY(Kernels::AVX2),
+    IMAGEPROC_MISSING_KERNELS_ENTRY(Kernels::AVX512),
+#endif
+#if IMAGEPROC_NEON_KERNELS
+    IMAGEPROC_KERNELS_ENTRY(Kernels::NEON, Neon)
+#else
+    IMAGEPROC_MISSING_KERNELS_ENTRY(Kernels::NEON)
+#endif
+};
+
+#undef IMAGEPROC_KERNELS_ENTRY
+#undef IMAGEPROC_MISSING_KERNELS_ENTRY
+
+bool cpuSupports(Kernels::Level const level)
+{
+#if IMAGEPROC_X86_KERNELS
+    __builtin_cpu_init();
+#endif
+
+    switch (level) {
+    case Kernels::SCALAR:
+        return true;
+#if IMAGEPROC_X86_KERNELS
+    case Kernels::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case Kernels::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case Kernels::AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+#if IMAGEPROC_NEON_KERNELS
+    case Kernels::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+Kernels const& bestUpTo(Kernels::Level const max_level)
+{
+    for (int level = max_level; level > Kernels::SCALAR; --level) {
+        if (Kernels const* kernels = Kernels::forLevel(Kernels::Level(level))) {
+            return *kernels;
+        }
+    }
+    return tables[Kernels::SCALAR];
+}
+
+Kernels::Level maxLevelFromEnvironment()
+{
+    QByteArray const name(qgetenv("SCANTAILOR_CPU_KERNELS"));
+    if (!name.isEmpty()) {
+        for (int level = 0; level < Kernels::NUM_LEVELS; ++level) {
+            if (name == Kernels::levelName(Kernels::Level(level))) {
+                return Kernels::Level(level);
+            }
+        }
+    }
+    return Kernels::Level(Kernels::NUM_LEVELS - 1);
+}
+
+QAtomicPointer<Kernels const> activeKernels;
+
+} // anonymous namespace
+
+Kernels const&
+Kernels::active()
+{
+    Kernels const* kernels = activeKernels.loadAcquire();
+    if (!kernels) {
+        // Racing threads come up with the same answer, so whoever wins is fine.
+        activeKernels.testAndSetOrdered(nullptr, &bestUpTo(maxLevelFromEnvironment()));
+        kernels = activeKernels.loadAcquire();
+    }
+    return *kernels;
+}
+
+Kernels const*
+Kernels::forLevel(Level const level)
+{
+    if (level < 0 || level >= NUM_LEVELS) {
+        return nullptr;
+    }
+
+    Kernels const& kernels = tables[level];
+    if (!kernels.rgbToGray || !cpuSupports(level)) {
+        return nullptr;
+    }
+
+    return &kernels;
+}
+
+void
+Kernels::setMaxLevel(Level const level)
+{
+    activeKernels.storeRelease(&bestUpTo(level));
+}
+
+char const*
+Kernels::levelName(Level const level)
+{
+    switch (level) {
+    case SCALAR:
+        return "scalar";
+    case SSE41:
+        return "sse4.1";
+    case AVX2:
+        return "avx2";
+    case AVX512:
+        return "avx512";
+    case NEON:
+        return "neon";
+    default:
+        return "";
+    }
+}
+
+} // namespace imageproc
@@ -0,0 +1,124 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_KERNELS_H_
+#define IMAGEPROC_KERNELS_H_
+
+#include <stdint.h>
+
+namespace imageproc
+{
+
+/**
+ * \brief A table of low level routines, built for a particular
+ *        instruction set and selected at runtime.
+ *
+ * Each routine has a plain scalar implementation that the others
+ * must match bit for bit.  The scalar one is compiled with
+ * auto-vectorization disabled, so it serves as a reference.
+ *
+ * The level in use may be capped by setting the SCANTAILOR_CPU_KERNELS
+ * environment variable to one of the names returned by levelName().
+ */
+class Kernels
+{
+public:
+    enum Level { SCALAR, SSE41, AVX2, AVX512, NEON, NUM_LEVELS };
+
+    /**
+     * Converts \p count pixels in QRgb format to gray levels,
+     * the same way qGray() does.
+     */
+    typedef void (*RgbToGrayFunc)(uint32_t const* src, uint8_t* dst, int count);
+
+    /**
+     * Same as RgbToGrayFunc, for \p count pixels of three bytes
+     * in R, G, B order, as in QImage::Format_RGB888.
+     */
+    typedef void (*Rgb888ToGrayFunc)(uint8_t const* src, uint8_t* dst, int count);
+
+    /**
+     * Reduces a pair of binary image lines to a single line of half
+     * the width, as ReduceThreshold does.  \p src_words is the number
+     * of source words to process, and \p threshold is from 1 to 4.
+     */
+    typedef void (*ReduceThresholdFunc)(
+        uint32_t const* top, uint32_t const* bottom,
+        uint32_t* dst, int src_words, int threshold);
+
+    /**
+     * Replaces pure black and pure white in \p count pixels with the
+     * nearest other shades, reserving those two for B/W content.
+     * RGB pixels become opaque when that happens.
+     */
+    typedef void (*ReserveBlackAndWhiteGrayFunc)(uint8_t* pixels, int count);
+    typedef void (*ReserveBlackAndWhiteRgbFunc)(uint32_t* pixels, int count);
+
+    /**
+     * Combines \p count pixels of a mixed output line.  Where \p bw_mask
+     * has a black bit, the pixel becomes the black or white of \p bw_content.
+     * Elsewhere its black and white get reserved, as above.  Both binary
+     * lines are in BinaryImage format.
+     */
+    typedef void (*CombineMixedGrayFunc)(
+        uint8_t* mixed, uint32_t const* bw_content,
+        uint32_t const* bw_mask, int count);
+    typedef void (*CombineMixedRgbFunc)(
+        uint32_t* mixed, uint32_t const* bw_content,
+        uint32_t const* bw_mask, int count);
+
+    /**
+     * Returns the number of set bits in \p count words.
+     */
+    typedef int (*CountBitsFunc)(uint32_t const* words, int count);
+
+    Level level;
+    RgbToGrayFunc rgbToGray;
+    Rgb888ToGrayFunc rgb888ToGray;
+    ReduceThresholdFunc reduceThreshold;
+    ReserveBlackAndWhiteGrayFunc reserveBlackAndWhiteGray;
+    ReserveBlackAndWhiteRgbFunc reserveBlackAndWhiteRgb;
+    CombineMixedGrayFunc combineMixedGray;
+    CombineMixedRgbFunc combineMixedRgb;
+    CountBitsFunc countBits;
+
+    /**
+     * \brief The kernels to use.
+     *
+     * That's the highest level supported by both the build and the CPU,
+     * unless capped by setMaxLevel() or the environment.
+     */
+    static Kernels const& active();
+
+    /**
+     * \brief The kernels of a specific level, or null if they are
+     *        not built in or not supported by this CPU.
+     */
+    static Kernels const* forLevel(Level level);
+
+    /**
+     * \brief Caps the level returned by active().
+     */
+    static void setMaxLevel(Level level);
+
+    static char const* levelName(Level level);
+};
+
+} // namespace imageproc
+
+#endif
@@ -47,30 +47,43 @@ public:
 } // anonymous namespace
 
 MaxWhitespaceFinder::MaxWhitespaceFinder(BinaryImage const& img, QSize min_size)
-    :   m_integralImg(img.size()),
+    :   m_ptrIntegralImg(countBlackPixels(img)),
         m_ptrQueuedRegions(new PriorityStorageImpl<AreaCompare>(AreaCompare())),
         m_minSize(min_size)
 {
-    init(img);
+    init();
 }
 
-void
-MaxWhitespaceFinder::init(BinaryImage const& img)
+MaxWhitespaceFinder::BlackPixelCounts
+MaxWhitespaceFinder::countBlackPixels(BinaryImage const& img)
 {
+    std::shared_ptr<IntegralImage<unsigned> > counts(
+        new IntegralImage<unsigned>(img.size())
+    );
+
     int const width = img.width();
     int const height = img.height();
     uint32_t const* line = img.data();
     int const wpl = img.wordsPerLine();
 
     for (int y = 0; y < height; ++y, line += wpl) {
-        m_integralImg.beginRow();
-        for (int x = 0; x < width; ++x) {
-            int const shift = 31 - (x & 31);
-            m_integralImg.push((line[x >> 5] >> shift) & 1);
+        counts->beginRow();
+        for (int x = 0; x < width; x += 32) {
+            uint32_t const word = line[x >> 5];
+            int const end = std::min(32, width - x);
+            for (int i = 0; i < end; ++i) {
+                counts->push((word >> (31 - i)) & 1);
+            }
         }
     }
 
-    Region region(0, img.rect());
+    return counts;
+}
+
+void
+MaxWhitespaceFinder::init()
+{
+    Region region(0, QRect(QPoint(0, 0), m_ptrIntegralImg->size()));
     m_ptrQueuedRegions->push(region);
 }
 
@@ -100,7 +113,7 @@ MaxWhitespaceFinder::next(ObstacleMode const obstacle_mode, int max_iterations)
             continue;
         }
 
-        if (m_integralImg.sum(region.bounds()) != 0) {
+        if (m_ptrIntegralImg->sum(region.bounds()) != 0) {
             subdivideUsingRaster(region);
             continue;
         }
@@ -200,13 +213,13 @@ QPoint
 MaxWhitespaceFinder::findBlackPixelCloseToCenter(
     QRect const non_white_rect) const
 {
-    assert(m_integralImg.sum(non_white_rect) != 0);
+    assert(m_ptrIntegralImg->sum(non_white_rect) != 0);
 
     QPoint const center(non_white_rect.center());
     QRect outer_rect(non_white_rect);
     QRect inner_rect(center.x(), center.y(), 1, 1);
 
-    if (m_integralImg.sum(inner_rect) != 0) {
+    if (m_ptrIntegralImg->sum(inner_rect) != 0) {
         return center;
     }
 
@@ -241,7 +254,7 @@ MaxWhitespaceFinder::findBlackPixelCloseToCenter(
         assert(outer_rect.contains(middle_rect));
         assert(middle_rect.contains(inner_rect));
 
-        if (m_integralImg.sum(middle_rect) == 0) {
+        if (m_ptrIntegralImg->sum(middle_rect) == 0) {
             inner_rect = middle_rect;
         } else {
             outer_rect = middle_rect;
@@ -252,7 +265,7 @@ MaxWhitespaceFinder::findBlackPixelCloseToCenter(
     if (outer_rect.left() != inner_rect.left()) {
         QRect rect(outer_rect);
         rect.setRight(rect.left()); // Right is inclusive.
-        unsigned const sum = m_integralImg.sum(rect);
+        unsigned const sum = m_ptrIntegralImg->sum(rect);
         if (outer_rect.height() == 1) {
             // This means we are dealing with a horizontal line
             // and that we only have to check at most two pixels
@@ -273,7 +286,7 @@ MaxWhitespaceFinder::findBlackPixelCloseToCenter(
     if (outer_rect.right() != inner_rect.right()) {
         QRect rect(outer_rect);
         rect.setLeft(rect.right()); // Right is inclusive.
-        unsigned const sum = m_integralImg.sum(rect);
+        unsigned const sum = m_ptrIntegralImg->sum(rect);
         if (outer_rect.height() == 1) {
             // Same as above, except rect now points to the
             // right endpoint.
@@ -291,7 +304,7 @@ MaxWhitespaceFinder::findBlackPixelCloseToCenter(
     if (outer_rect.top() != inner_rect.top()) {
         QRect rect(outer_rect);
         rect.setBottom(rect.top()); // Bottom is inclusive.
-        unsigned const sum = m_integralImg.sum(rect);
+        unsigned const sum = m_ptrIntegralImg->sum(rect);
         if (outer_rect.width() == 1) {
             // Same as above, except rect now points to the
             // top endpoint.
@@ -309,7 +322,7 @@ MaxWhitespaceFinder::findBlackPixelCloseToCenter(
     assert(outer_rect.bottom() != inner_rect.bottom());
     QRect rect(outer_rect);
     rect.setTop(rect.bottom()); // Bottom is inclusive.
-    assert(m_integralImg.sum(rect) != 0);
+    assert(m_ptrIntegralImg->sum(rect) != 0);
     if (outer_rect.width() == 1) {
         return outer_rect.bottomLeft();
     } else {
@@ -326,7 +339,7 @@ MaxWhitespaceFinder::extendBlackPixelToBlackBox(
     QRect outer_rect(bounds);
     QRect inner_rect(pixel.x(), pixel.y(), 1, 1);
 
-    if (m_integralImg.sum(outer_rect) ==
+    if (m_ptrIntegralImg->sum(outer_rect) ==
             unsigned(outer_rect.width() * outer_rect.height())) {
         return outer_rect;
     }
@@ -363,7 +376,7 @@ MaxWhitespaceFinder::extendBlackPixelToBlackBox(
         assert(middle_rect.contains(inner_rect));
 
         unsigned const area = middle_rect.width() * middle_rect.height();
-        if (m_integralImg.sum(middle_rect) == area) {
+        if (m_ptrIntegralImg->sum(middle_rect) == area) {
             inner_rect = middle_rect;
         } else {
             outer_rect = middle_rect;
@@ -50,6 +50,20 @@ public:
     /** \see next() */
     enum ObstacleMode { AUTO_OBSTACLES, MANUAL_OBSTACLES };
 
+    /**
+     * \brief Black pixel counts of an image, as produced by countBlackPixels().
+     */
+    typedef std::shared_ptr<IntegralImage<unsigned> const> BlackPixelCounts;
+
+    /**
+     * \brief Builds the integral image of black pixels the finder works on.
+     *
+     * Building it is the only part of the search that touches every
+     * pixel, so finders working on the same image should share it
+     * by using the constructor taking BlackPixelCounts.
+     */
+    static BlackPixelCounts countBlackPixels(BinaryImage const& img);
+
     /**
      * \brief Constructor.
      *
@@ -89,6 +103,15 @@ public:
         QualityCompare comp,
         BinaryImage const& img, QSize min_size = QSize(1, 1));
 
+    /**
+     * \brief Same as above, but with black pixel counts shared
+     *        with other finders.
+     */
+    template<typename QualityCompare>
+    MaxWhitespaceFinder(
+        QualityCompare comp,
+        BlackPixelCounts const& black_pixel_counts, QSize min_size = QSize(1, 1));
+
     /**
      * \brief Mark a region as black.
      *
@@ -166,7 +189,7 @@ private:
         std::vector<QRect> m_obstacles;
     };
 
-    void init(BinaryImage const& img);
+    void init();
 
     void subdivideUsingObstacles(Region const& region);
 
@@ -180,7 +203,7 @@ private:
 
     QRect extendBlackPixelToBlackBox(QPoint pixel, QRect bounds) const;
 
-    IntegralImage<unsigned> m_integralImg;
+    BlackPixelCounts m_ptrIntegralImg;
     std::unique_ptr<max_whitespace_finder::PriorityStorage> m_ptrQueuedRegions;
     std::vector<QRect> m_newObstacles;
     QSize m_minSize;
@@ -350,12 +373,24 @@ PriorityStorageImpl<QualityCompare>::popHeap(
 template<typename QualityCompare>
 MaxWhitespaceFinder::MaxWhitespaceFinder(
     QualityCompare const comp, BinaryImage const& img, QSize const min_size)
-    :   m_integralImg(img.size()),
+    :   m_ptrIntegralImg(countBlackPixels(img)),
+        m_ptrQueuedRegions(
+            new max_whitespace_finder::PriorityStorageImpl<QualityCompare>(comp)),
+        m_minSize(min_size)
+{
+    init();
+}
+
+template<typename QualityCompare>
+MaxWhitespaceFinder::MaxWhitespaceFinder(
+    QualityCompare const comp, BlackPixelCounts const& black_pixel_counts,
+    QSize const min_size)
+    :   m_ptrIntegralImg(black_pixel_counts),
         m_ptrQueuedRegions(
             new max_whitespace_finder::PriorityStorageImpl<QualityCompare>(comp)),
         m_minSize(min_size)
 {
-    init(img);
+    init();
 }
 
 } // namespace imageproc
@@ -19,6 +19,7 @@
 #include "Morphology.h"
 #include "BinaryImage.h"
 #include "GrayImage.h"
+#include "GpuCompute.h"
 #include "RasterOp.h"
 #include "Grayscale.h"
 #include <QPoint>
@@ -454,6 +455,45 @@ void dilateOrErodeBrick(
     }
 }
 
+/**
+ * Same as dilateOrErodeBrick(), but splits dst_area into horizontal bands
+ * processed in parallel.  Each band reads whatever source rows its brick
+ * reaches, so the bands overlap in the source, but never in the output.
+ */
+void dilateOrErodeBrickInBands(
+    BinaryImage& dst, BinaryImage const& src, Brick const& brick,
+    QRect const& dst_area, BWColor const src_surroundings,
+    AbstractRasterOp const& rop, BWColor const spreading_color)
+{
+    // Each band has to process an extra brick height worth of rows,
+    // so bands shouldn't be too short compared to the brick.
+    int const band_height = std::max(64, brick.height() * 4);
+    int const num_bands = dst_area.height() / band_height;
+    if (num_bands < 2) {
+        dilateOrErodeBrick(dst, src, brick, dst_area, src_surroundings, rop, spreading_color);
+        return;
+    }
+
+    uint32_t* const dst_data = dst.data();
+    int const dst_wpl = dst.wordsPerLine();
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_bands; ++i) {
+        int const top = i * band_height;
+        // The last band takes the remainder.
+        int const bottom = i == num_bands - 1 ? dst_area.height() : top + band_height;
+        QRect const band_area(
+            dst_area.left(), dst_area.top() + top, dst_area.width(), bottom - top
+        );
+
+        BinaryImage band(band_area.size());
+        dilateOrErodeBrick(band, src, brick, band_area, src_surroundings, rop, spreading_color);
+
+        assert(band.wordsPerLine() == dst_wpl);
+        memcpy(dst_data + top * dst_wpl, band.data(), (bottom - top) * dst_wpl * 4);
+    }
+}
+
 class Darker
 {
 public:
@@ -513,51 +553,60 @@ void spreadGrayHorizontal(
 {
     int const src_stride = src.stride();
     int const dst_stride = dst.stride();
-    uint8_t const* src_line = src.data() + dy * src_stride;
-    uint8_t* dst_line = dst.data();
+    uint8_t const* const src_data = src.data() + dy * src_stride;
+    uint8_t* const dst_data = dst.data();
 
     int const dst_width = dst.width();
     int const dst_height = dst.height();
 
     int const se_len = dx2 - dx1 + 1;
 
-    std::vector<uint8_t> min_max_array(se_len * 2 - 1, 0);
-    uint8_t* const array_center = &min_max_array[se_len - 1];
-
-    for (int y = 0; y < dst_height; ++y) {
-        for (int dst_segment_first = 0; dst_segment_first < dst_width;
-                dst_segment_first += se_len) {
-            int const dst_segment_last = std::min(
-                                             dst_segment_first + se_len, dst_width
-                                         ) - 1; // inclusive
-            int const src_segment_first = dst_segment_first + dx1;
-            int const src_segment_last = dst_segment_last + dx2;
-            int const src_segment_center =
-                (src_segment_first + src_segment_last) >> 1;
-
-            fillExtremumArrayLeftHalf<MinOrMax>(
-                array_center, src_line + src_segment_center, 1,
-                src_segment_first, src_segment_center
-            );
+    // Rows are independent, so we process strips of them in parallel.
+    int const strip_height = 32;
+    int const num_strips = (dst_height + strip_height - 1) / strip_height;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        std::vector<uint8_t> min_max_array(se_len * 2 - 1, 0);
+        uint8_t* const array_center = &min_max_array[se_len - 1];
+
+        int const y_begin = strip * strip_height;
+        int const y_end = std::min(dst_height, y_begin + strip_height);
+        for (int y = y_begin; y < y_end; ++y) {
+            uint8_t const* const src_line = src_data + y * src_stride;
+            uint8_t* const dst_line = dst_data + y * dst_stride;
+
+            for (int dst_segment_first = 0; dst_segment_first < dst_width;
+                    dst_segment_first += se_len) {
+                int const dst_segment_last = std::min(
+                                                 dst_segment_first + se_len, dst_width
+                                             ) - 1; // inclusive
+                int const src_segment_first = dst_segment_first + dx1;
+                int const src_segment_last = dst_segment_last + dx2;
+                int const src_segment_center =
+                    (src_segment_first + src_segment_last) >> 1;
+
+                fillExtremumArrayLeftHalf<MinOrMax>(
+                    array_center, src_line + src_segment_center, 1,
+                    src_segment_first, src_segment_center
+                );
 
-            fillExtremumArrayRightHalf<MinOrMax>(
-                array_center, src_line + src_segment_center, 1,
-                src_segment_center, src_segment_last
-            );
+                fillExtremumArrayRightHalf<MinOrMax>(
+                    array_center, src_line + src_segment_center, 1,
+                    src_segment_center, src_segment_last
+                );
 
-            for (int x = dst_segment_first; x <= dst_segment_last; ++x) {
-                int const src_first = x + dx1;
-                int const src_last = x + dx2; // inclusive
-                assert(src_segment_center >= src_first);
-                assert(src_segment_center <= src_last);
-                uint8_t v1 = array_center[src_first - src_segment_center];
-                uint8_t v2 = array_center[src_last - src_segment_center];
-                dst_line[x] = MinOrMax::select(v1, v2);
+                for (int x = dst_segment_first; x <= dst_segment_last; ++x) {
+                    int const src_first = x + dx1;
+                    int const src_last = x + dx2; // inclusive
+                    assert(src_segment_center >= src_first);
+                    assert(src_segment_center <= src_last);
+                    uint8_t v1 = array_center[src_first - src_segment_center];
+                    uint8_t v2 = array_center[src_last - src_segment_center];
+                    dst_line[x] = MinOrMax::select(v1, v2);
+                }
             }
         }
-
-        src_line += src_stride;
-        dst_line += dst_stride;
     }
 }
 
@@ -591,10 +640,22 @@ void spreadGrayVertical(
 
     int const se_len = dy2 - dy1 + 1;
 
-    std::vector<uint8_t> min_max_array(se_len * 2 - 1, 0);
-    uint8_t* const array_center = &min_max_array[se_len - 1];
+    // The same algorithm as in spreadGrayHorizontal(), except we process
+    // blocks of columns at once, so that every step is a contiguous
+    // loop across columns.  That's both cache friendly and vectorizable.
+    // Blocks are independent, so they are processed in parallel.
+    int const block_width = 64;
+    int const num_blocks = (dst_width + block_width - 1) / block_width;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int block = 0; block < num_blocks; ++block) {
+        int const x0 = block * block_width;
+        int const width = std::min(block_width, dst_width - x0);
+
+        // Row i of the array corresponds to source row src_segment_center + i.
+        std::vector<uint8_t> min_max_array((se_len * 2 - 1) * block_width, 0);
+        uint8_t* const array_center = &min_max_array[(se_len - 1) * block_width];
 
-    for (int x = 0; x < dst_width; ++x) {
         for (int dst_segment_first = 0; dst_segment_first < dst_height;
                 dst_segment_first += se_len) {
             int const dst_segment_last = std::min(
@@ -605,26 +666,42 @@ void spreadGrayVertical(
             int const src_segment_center =
                 (src_segment_first + src_segment_last) >> 1;
 
-            fillExtremumArrayLeftHalf<MinOrMax>(
-                array_center, src_data + x + src_segment_center * src_stride,
-                src_stride, src_segment_first, src_segment_center
-            );
+            uint8_t const* const src_center = src_data + x0 + src_segment_center * src_stride;
+            memcpy(array_center, src_center, width);
+
+            uint8_t const* src = src_center;
+            uint8_t* arr = array_center;
+            for (int i = src_segment_center - 1; i >= src_segment_first; --i) {
+                src -= src_stride;
+                uint8_t* const prev = arr;
+                arr -= block_width;
+                for (int x = 0; x < width; ++x) {
+                    arr[x] = MinOrMax::select(prev[x], src[x]);
+                }
+            }
 
-            fillExtremumArrayRightHalf<MinOrMax>(
-                array_center, src_data + x + src_segment_center * src_stride,
-                src_stride, src_segment_center, src_segment_last
-            );
+            src = src_center;
+            arr = array_center;
+            for (int i = src_segment_center + 1; i <= src_segment_last; ++i) {
+                src += src_stride;
+                uint8_t* const prev = arr;
+                arr += block_width;
+                for (int x = 0; x < width; ++x) {
+                    arr[x] = MinOrMax::select(prev[x], src[x]);
+                }
+            }
 
-            uint8_t* dst = dst_data + x + dst_segment_first * dst_stride;
-            for (int y = dst_segment_first; y <= dst_segment_last; ++y) {
+            uint8_t* dst = dst_data + x0 + dst_segment_first * dst_stride;
+            for (int y = dst_segment_first; y <= dst_segment_last; ++y, dst += dst_stride) {
                 int const src_first = y + dy1;
                 int const src_last = y + dy2; // inclusive
                 assert(src_segment_center >= src_first);
                 assert(src_segment_center <= src_last);
-                uint8_t v1 = array_center[src_first - src_segment_center];
-                uint8_t v2 = array_center[src_last - src_segment_center];
-                *dst = MinOrMax::select(v1, v2);
-                dst += dst_stride;
+                uint8_t const* const v1 = array_center + (src_first - src_segment_center) * block_width;
+                uint8_t const* const v2 = array_center + (src_last - src_segment_center) * block_width;
+                for (int x = 0; x < width; ++x) {
+                    dst[x] = MinOrMax::select(v1[x], v2[x]);
+                }
             }
         }
     }
@@ -821,7 +898,7 @@ BinaryImage dilateBrick(
 
     TemplateRasterOp<RopOr<RopSrc, RopDst> > rop;
     BinaryImage dst(dst_area.size());
-    dilateOrErodeBrick(dst, src, brick, dst_area, src_surroundings, rop, BLACK);
+    dilateOrErodeBrickInBands(dst, src, brick, dst_area, src_surroundings, rop, BLACK);
 
     return dst;
 }
@@ -840,6 +917,11 @@ GrayImage dilateGray(
         throw std::invalid_argument("dilateGray: dst_area is empty");
     }
 
+    GrayImage dst;
+    if (GpuCompute::dilateGray(src, brick, dst_area, src_surroundings, dst)) {
+        return dst;
+    }
+
     return dilateOrErodeGray<Darker>(src, brick, dst_area, src_surroundings);
 }
 
@@ -873,7 +955,7 @@ BinaryImage erodeBrick(
 
     TemplateRasterOp<RopAnd<RopSrc, RopDst> > rop;
     BinaryImage dst(dst_area.size());
-    dilateOrErodeBrick(dst, src, brick, dst_area, src_surroundings, rop, WHITE);
+    dilateOrErodeBrickInBands(dst, src, brick, dst_area, src_surroundings, rop, WHITE);
 
     return dst;
 }
@@ -892,6 +974,11 @@ GrayImage erodeGray(
         throw std::invalid_argument("erodeGray: dst_area is empty");
     }
 
+    GrayImage dst;
+    if (GpuCompute::erodeGray(src, brick, dst_area, src_surroundings, dst)) {
+        return dst;
+    }
+
     return dilateOrErodeGray<Lighter>(src, brick, dst_area, src_surroundings);
 }
 
@@ -968,6 +1055,11 @@ GrayImage openGray(
         throw std::invalid_argument("openGray: dst_area is empty");
     }
 
+    GrayImage dst;
+    if (GpuCompute::openGray(src, brick, dst_area, src_surroundings, dst)) {
+        return dst;
+    }
+
     Brick const brick1(brick);
     Brick const brick2(brick1.flipped());
 
@@ -1052,6 +1144,11 @@ GrayImage closeGray(
         throw std::invalid_argument("closeGray: dst_area is empty");
     }
 
+    GrayImage dst;
+    if (GpuCompute::closeGray(src, brick, dst_area, src_surroundings, dst)) {
+        return dst;
+    }
+
     Brick const brick1(brick);
     Brick const brick2(brick1.flipped());
 
@@ -20,10 +20,18 @@
 #include "BinaryImage.h"
 #include "BWColor.h"
 #include "RasterOp.h"
+#include <QImage>
 #include <QRect>
+#include <QTransform>
 #include <algorithm>
+#include <new>
 #include <stdexcept>
+#include <stddef.h>
+#include <string.h>
 #include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace imageproc
 {
@@ -185,4 +193,271 @@ BinaryImage orthogonalRotation(BinaryImage const& src, int const degrees)
     return orthogonalRotation(src, src.rect(), degrees);
 }
 
+namespace
+{
+
+/**
+ * A 24-bit pixel.  Its channel order doesn't matter, as it's only copied.
+ */
+struct Pixel24 {
+    uint8_t bytes[3];
+};
+
+/**
+ * \brief dst(x, y) = src(y, x) for x in [x0, x1) and y in [y0, y1).
+ *
+ * Both images are addressed by their top-left pixel and a stride
+ * in bytes, either of which may be negative.
+ */
+template<typename T>
+void transposeArea(
+    uchar const* const src, ptrdiff_t const src_stride,
+    uchar* const dst, ptrdiff_t const dst_stride,
+    int const x0, int const x1, int const y0, int const y1)
+{
+    for (int x = x0; x < x1; ++x) {
+        T* const dst_line = reinterpret_cast<T*>(dst + x * dst_stride);
+        uchar const* src_pixel = src + y0 * src_stride + x * sizeof(T);
+        for (int y = y0; y < y1; ++y, src_pixel += src_stride) {
+            dst_line[y] = *reinterpret_cast<T const*>(src_pixel);
+        }
+    }
+}
+
+template<typename T>
+void transposeTile(
+    uchar const* const src, ptrdiff_t const src_stride,
+    uchar* const dst, ptrdiff_t const dst_stride,
+    int const x0, int const x1, int const y0, int const y1)
+{
+    transposeArea<T>(src, src_stride, dst, dst_stride, x0, x1, y0, y1);
+}
+
+#ifdef __SSE2__
+/**
+ * Transposes the tile in blocks of 4x4 pixels, leaving the edges
+ * that don't make a whole block to transposeArea().
+ */
+template<>
+void transposeTile<uint32_t>(
+    uchar const* const src, ptrdiff_t const src_stride,
+    uchar* const dst, ptrdiff_t const dst_stride,
+    int const x0, int const x1, int const y0, int const y1)
+{
+    int const bx1 = x0 + ((x1 - x0) & ~3);
+    int const by1 = y0 + ((y1 - y0) & ~3);
+
+    for (int y = y0; y < by1; y += 4) {
+        uchar const* const src_line = src + y * src_stride;
+        for (int x = x0; x < bx1; x += 4) {
+            uchar const* const p = src_line + x * 4;
+            __m128i const r0 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+            __m128i const r1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + src_stride));
+            __m128i const r2 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + src_stride * 2));
+            __m128i const r3 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + src_stride * 3));
+
+            __m128i const t0 = _mm_unpacklo_epi32(r0, r1);
+            __m128i const t1 = _mm_unpacklo_epi32(r2, r3);
+            __m128i const t2 = _mm_unpackhi_epi32(r0, r1);
+            __m128i const t3 = _mm_unpackhi_epi32(r2, r3);
+
+            uchar* const q = dst + x * dst_stride + y * 4;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(q), _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(q + dst_stride), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(q + dst_stride * 2), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(q + dst_stride * 3), _mm_unpackhi_epi64(t2, t3));
+        }
+    }
+
+    transposeArea<uint32_t>(src, src_stride, dst, dst_stride, bx1, x1, y0, y1);
+    transposeArea<uint32_t>(src, src_stride, dst, dst_stride, x0, bx1, by1, y1);
+}
+
+/**
+ * Transposes the tile in blocks of 8x8 pixels, leaving the edges
+ * that don't make a whole block to transposeArea().
+ */
+template<>
+void transposeTile<uint8_t>(
+    uchar const* const src, ptrdiff_t const src_stride,
+    uchar* const dst, ptrdiff_t const dst_stride,
+    int const x0, int const x1, int const y0, int const y1)
+{
+    int const bx1 = x0 + ((x1 - x0) & ~7);
+    int const by1 = y0 + ((y1 - y0) & ~7);
+
+    for (int y = y0; y < by1; y += 8) {
+        uchar const* const src_line = src + y * src_stride;
+        for (int x = x0; x < bx1; x += 8) {
+            __m128i r[8];
+            for (int i = 0; i < 8; ++i) {
+                r[i] = _mm_loadl_epi64(
+                           reinterpret_cast<__m128i const*>(src_line + i * src_stride + x)
+                       );
+            }
+
+            // Interleave pairs of lines, then pairs of pairs, ending
+            // up with two source columns in each register.
+            __m128i const a0 = _mm_unpacklo_epi8(r[0], r[1]);
+            __m128i const a1 = _mm_unpacklo_epi8(r[2], r[3]);
+            __m128i const a2 = _mm_unpacklo_epi8(r[4], r[5]);
+            __m128i const a3 = _mm_unpacklo_epi8(r[6], r[7]);
+            __m128i const b0 = _mm_unpacklo_epi16(a0, a1);
+            __m128i const b1 = _mm_unpackhi_epi16(a0, a1);
+            __m128i const b2 = _mm_unpacklo_epi16(a2, a3);
+            __m128i const b3 = _mm_unpackhi_epi16(a2, a3);
+            __m128i const cols[4] = {
+                _mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2),
+                _mm_unpacklo_epi32(b1, b3), _mm_unpackhi_epi32(b1, b3)
+            };
+
+            uchar* q = dst + x * dst_stride + y;
+            for (int i = 0; i < 4; ++i) {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(q), cols[i]);
+                q += dst_stride;
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(q), _mm_unpackhi_epi64(cols[i], cols[i]));
+                q += dst_stride;
+            }
+        }
+    }
+
+    transposeArea<uint8_t>(src, src_stride, dst, dst_stride, bx1, x1, y0, y1);
+    transposeArea<uint8_t>(src, src_stride, dst, dst_stride, x0, bx1, by1, y1);
+}
+#endif // __SSE2__
+
+/**
+ * \brief Transposes a \p width x \p height source into the destination.
+ *
+ * The work is split into square tiles small enough for the source
+ * lines a tile touches to stay in cache while its columns are read.
+ * With a negative stride, a transpose becomes a rotation.
+ */
+template<typename T>
+void transpose(
+    uchar const* const src, ptrdiff_t const src_stride,
+    uchar* const dst, ptrdiff_t const dst_stride,
+    int const width, int const height)
+{
+    int const tile_size = sizeof(T) == 1 ? 64 : 32;
+    int const num_tile_rows = (width + tile_size - 1) / tile_size;
+
+    // Each iteration produces its own band of destination lines.
+    #pragma omp parallel for schedule(static)
+    for (int ty = 0; ty < num_tile_rows; ++ty) {
+        int const x0 = ty * tile_size;
+        int const x1 = std::min(x0 + tile_size, width);
+        for (int y0 = 0; y0 < height; y0 += tile_size) {
+            int const y1 = std::min(y0 + tile_size, height);
+            transposeTile<T>(src, src_stride, dst, dst_stride, x0, x1, y0, y1);
+        }
+    }
+}
+
+template<typename T>
+void rotatePixels(
+    QImage const& src, QRect const& src_rect, QImage& dst, int const degrees)
+{
+    int const width = src_rect.width();
+    int const height = src_rect.height();
+    ptrdiff_t const src_stride = src.bytesPerLine();
+    ptrdiff_t const dst_stride = dst.bytesPerLine();
+    uchar const* const src_data = src.bits()
+                                  + src_rect.top() * src_stride + src_rect.left() * sizeof(T);
+    uchar* const dst_data = dst.bits();
+
+    switch (degrees) {
+    case 0:
+        for (int y = 0; y < height; ++y) {
+            memcpy(dst_data + y * dst_stride, src_data + y * src_stride, width * sizeof(T));
+        }
+        break;
+    case 90:
+        // dst(x, y) = src(y, height - 1 - x)
+        transpose<T>(
+            src_data + (height - 1) * src_stride, -src_stride,
+            dst_data, dst_stride, width, height
+        );
+        break;
+    case 180:
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; ++y) {
+            T const* const src_line = reinterpret_cast<T const*>(
+                                          src_data + (height - 1 - y) * src_stride
+                                      );
+            std::reverse_copy(
+                src_line, src_line + width,
+                reinterpret_cast<T*>(dst_data + y * dst_stride)
+            );
+        }
+        break;
+    case 270:
+        // dst(x, y) = src(width - 1 - y, x)
+        transpose<T>(
+            src_data, src_stride,
+            dst_data + (width - 1) * dst_stride, -dst_stride, width, height
+        );
+        break;
+    }
+}
+
+} // anonymous namespace
+
+QImage orthogonalRotation(
+    QImage const& src, QRect const& src_rect, int const degrees)
+{
+    if (src.isNull() || src_rect.isNull()) {
+        return QImage();
+    }
+
+    if (src_rect.intersected(src.rect()) != src_rect) {
+        throw std::invalid_argument("orthogonalRotation: invalid src_rect");
+    }
+
+    int const angle = (degrees % 360 + 360) % 360;
+    if (angle % 90 != 0) {
+        throw std::invalid_argument("orthogonalRotation: invalid angle");
+    }
+
+    if (angle == 0 && src_rect == src.rect()) {
+        return src;
+    }
+
+    int const depth = src.depth();
+    if (depth != 8 && depth != 24 && depth != 32) {
+        return src.copy(src_rect).transformed(QTransform().rotate(angle));
+    }
+
+    bool const swap_dims = angle == 90 || angle == 270;
+    QImage dst(
+        swap_dims ? src_rect.height() : src_rect.width(),
+        swap_dims ? src_rect.width() : src_rect.height(), src.format()
+    );
+    if (dst.isNull()) {
+        throw std::bad_alloc();
+    }
+    dst.setColorTable(src.colorTable());
+    dst.setDotsPerMeterX(swap_dims ? src.dotsPerMeterY() : src.dotsPerMeterX());
+    dst.setDotsPerMeterY(swap_dims ? src.dotsPerMeterX() : src.dotsPerMeterY());
+
+    switch (depth) {
+    case 8:
+        rotatePixels<uint8_t>(src, src_rect, dst, angle);
+        break;
+    case 24:
+        rotatePixels<Pixel24>(src, src_rect, dst, angle);
+        break;
+    case 32:
+        rotatePixels<uint32_t>(src, src_rect, dst, angle);
+        break;
+    }
+
+    return dst;
+}
+
+QImage orthogonalRotation(QImage const& src, int const degrees)
+{
+    return orthogonalRotation(src, src.rect(), degrees);
+}
+
 } // namespace imageproc
@@ -20,6 +20,7 @@
 #define IMAGEPROC_ORTHOGONAL_ROTATION_H_
 
 class QRect;
+class QImage;
 
 namespace imageproc
 {
@@ -50,6 +51,33 @@ BinaryImage orthogonalRotation(
  */
 BinaryImage orthogonalRotation(BinaryImage const& src, int degrees);
 
+/**
+ * \brief Rotation of a gray or colour image by 0, 90, 180 or 270 degrees.
+ *
+ * Images of 8, 24 and 32 bits per pixel are rotated by cache-blocked
+ * transposition, without any resampling.  Other formats are handed
+ * over to QImage::transformed().
+ *
+ * \param src The source image.  May be null, in which case
+ *        a null rotated image will be returned.
+ * \param src_rect The area that is to be rotated.
+ * \param degrees The rotation angle in degrees.  The angle
+ *        must be a multiple of 90.  Positive values indicate
+ *        clockwise rotation.
+ * \return The rotated area of the source image, in the same format
+ *         and with the same palette as \p src.
+ */
+QImage orthogonalRotation(
+    QImage const& src, QRect const& src_rect, int degrees);
+
+/**
+ * \brief Rotation by 90, 180 or 270 degrees.
+ *
+ * This is an overload provided for convenience.
+ * It rotates the whole image, not a portion of it.
+ */
+QImage orthogonalRotation(QImage const& src, int degrees);
+
 } // namespace imageproc
 
 #endif
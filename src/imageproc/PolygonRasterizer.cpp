@@ -27,9 +27,10 @@
 #include <QImage>
 #include <QtGlobal>
 #include <vector>
-#include <iterator>
+#include <memory>
 #include <algorithm>
 #include <stdexcept>
+#include <limits>
 #include <math.h>
 #include <string.h>
 #include <stdint.h>
@@ -129,16 +130,6 @@ public:
     {
         return lhs.top() < rhs.top();
     }
-
-    bool operator()(EdgeComponent const& lhs, double rhs) const
-    {
-        return lhs.bottom() <= rhs; // bottom is not a part of the interval.
-    }
-
-    bool operator()(double lhs, EdgeComponent const& rhs) const
-    {
-        return lhs < rhs.top();
-    }
 };
 
 class PolygonRasterizer::EdgeOrderX
@@ -156,12 +147,70 @@ public:
     Rasterizer(QRect const& image_rect, QPolygonF const& poly,
                Qt::FillRule const fill_rule, bool invert);
 
-    void fillBinary(BinaryImage& image, BWColor color) const;
+    /**
+     * \brief Fills lines of images with one or more polygons.
+     *
+     * Lines are split into bands that are processed in parallel.
+     * Within a band, every line is finished with all the rasterizers
+     * before moving on to the next one, so an image is only traversed
+     * once no matter how many polygons there are.
+     *
+     * \param line_filler A functor called as
+     *        line_filler(rasterizer_idx, y, edges_for_line).
+     */
+    template<typename LineFiller>
+    static void forEachLine(
+        std::vector<std::unique_ptr<Rasterizer> > const& rasterizers,
+        LineFiller const& line_filler);
+
+    void fillBinaryLine(
+        std::vector<EdgeComponent> const& edges_for_line,
+        uint32_t* line, uint32_t pattern) const;
+
+    void fillGrayscaleLine(
+        std::vector<EdgeComponent> const& edges_for_line,
+        uint8_t* line, uint8_t color) const;
+
+    /**
+     * \brief Calls segment_sink(x_from, x_to) for every segment
+     *        fillBinaryLine() would fill.
+     */
+    template<typename SegmentSink>
+    void forEachSegment(
+        std::vector<EdgeComponent> const& edges_for_line,
+        SegmentSink const& segment_sink) const;
 
-    void fillGrayscale(QImage& image, uint8_t color) const;
+    static void fillBinarySegment(
+        int x_from, int x_to, uint32_t* line, uint32_t pattern);
 private:
+    /**
+     * \brief An interval of y values that edge components don't cross
+     *        the boundaries of, and the edge components within it.
+     */
+    struct Slab {
+        double top;
+        double bottom; // Not a part of the interval.
+        int firstComponent;
+        int endComponent;
+    };
+
+    /**
+     * Lines in bands of this many are processed by a single thread.
+     */
+    enum { BAND_HEIGHT = 32 };
+
     void prepareEdges();
 
+    void prepareSlabs();
+
+    /**
+     * \brief Collects edge components intersecting the line at the center
+     *        of row \p y, sorted by the x value of the intersection point.
+     *
+     * \return false if \p edges_for_line ended up empty.
+     */
+    bool edgesForLine(int y, std::vector<EdgeComponent>& edges_for_line) const;
+
     static void oddEvenLineBinary(
         EdgeComponent const* edges, int num_edges,
         uint32_t* line, uint32_t pattern);
@@ -178,14 +227,14 @@ private:
         EdgeComponent const* edges, int num_edges,
         uint8_t* line, uint8_t pattern, bool invert);
 
-    static void fillBinarySegment(
-        int x_from, int x_to, uint32_t* line, uint32_t pattern);
-
     std::vector<Edge> m_edges; // m_edgeComponents references m_edges.
     std::vector<EdgeComponent> m_edgeComponents;
+    std::vector<Slab> m_slabs; // Ordered by y.
     QRect m_imageRect;
     QPolygonF m_fillPoly;
     QRectF m_boundingBox;
+    int m_firstLine;
+    int m_lineLimit;
     Qt::FillRule m_fillRule;
     bool m_invert;
 };
@@ -196,13 +245,103 @@ void
 PolygonRasterizer::fill(
     BinaryImage& image, BWColor const color,
     QPolygonF const& poly, Qt::FillRule const fill_rule)
+{
+    fill(image, std::vector<BinaryFillOp>(1, BinaryFillOp(poly, color, fill_rule)));
+}
+
+void
+PolygonRasterizer::fill(BinaryImage& image, std::vector<BinaryFillOp> const& ops)
 {
     if (image.isNull()) {
         throw std::invalid_argument("PolygonRasterizer: target image is null");
     }
 
-    Rasterizer rasterizer(image.rect(), poly, fill_rule, false);
-    rasterizer.fillBinary(image, color);
+    std::vector<std::unique_ptr<Rasterizer> > rasterizers;
+    std::vector<uint32_t> patterns;
+    rasterizers.reserve(ops.size());
+    patterns.reserve(ops.size());
+    for (BinaryFillOp const& op : ops) {
+        rasterizers.emplace_back(new Rasterizer(image.rect(), op.poly, op.fillRule, false));
+        patterns.push_back(op.color == WHITE ? 0 : ~uint32_t(0));
+    }
+
+    uint32_t* const data = image.data();
+    int const wpl = image.wordsPerLine();
+    Rasterizer::forEachLine(
+        rasterizers,
+        [&](int const idx, int const y, std::vector<EdgeComponent> const& edges) {
+            rasterizers[idx]->fillBinaryLine(edges, data + y * wpl, patterns[idx]);
+        }
+    );
+}
+
+PolygonRasterizer::Spans
+PolygonRasterizer::rasterize(QSize const& size, std::vector<BinaryFillOp> const& ops)
+{
+    Spans spans;
+    if (size.isEmpty()) {
+        return spans;
+    }
+
+    QRect const image_rect(QPoint(0, 0), size);
+    std::vector<std::unique_ptr<Rasterizer> > rasterizers;
+    std::vector<uint32_t> patterns;
+    rasterizers.reserve(ops.size());
+    patterns.reserve(ops.size());
+    for (BinaryFillOp const& op : ops) {
+        rasterizers.emplace_back(new Rasterizer(image_rect, op.poly, op.fillRule, false));
+        patterns.push_back(op.color == WHITE ? 0 : ~uint32_t(0));
+    }
+
+    // Each line is only ever visited by one thread.
+    std::vector<std::vector<Spans::Run> > lines(size.height());
+    Rasterizer::forEachLine(
+        rasterizers,
+        [&](int const idx, int const y, std::vector<EdgeComponent> const& edges) {
+            std::vector<Spans::Run>& line = lines[y];
+            rasterizers[idx]->forEachSegment(
+                edges, [&](int const x_from, int const x_to) {
+                    Spans::Run const run = { x_from, x_to, patterns[idx] };
+                    line.push_back(run);
+                }
+            );
+        }
+    );
+
+    spans.m_size = size;
+    spans.m_lineStarts.reserve(lines.size() + 1);
+    for (std::vector<Spans::Run> const& line : lines) {
+        spans.m_lineStarts.push_back(spans.m_runs.size());
+        spans.m_runs.insert(spans.m_runs.end(), line.begin(), line.end());
+    }
+    spans.m_lineStarts.push_back(spans.m_runs.size());
+
+    return spans;
+}
+
+void
+PolygonRasterizer::fill(BinaryImage& image, Spans const& spans)
+{
+    if (image.isNull()) {
+        throw std::invalid_argument("PolygonRasterizer: target image is null");
+    }
+    if (image.size() != spans.size()) {
+        throw std::invalid_argument("PolygonRasterizer: spans are for a different size");
+    }
+
+    uint32_t* const data = image.data();
+    int const wpl = image.wordsPerLine();
+    int const height = image.height();
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; ++y) {
+        uint32_t* const line = data + y * wpl;
+        int const end = spans.m_lineStarts[y + 1];
+        for (int i = spans.m_lineStarts[y]; i < end; ++i) {
+            Spans::Run const& run = spans.m_runs[i];
+            Rasterizer::fillBinarySegment(run.xFrom, run.xTo, line, run.pattern);
+        }
+    }
 }
 
 void
@@ -214,8 +353,18 @@ PolygonRasterizer::fillExcept(
         throw std::invalid_argument("PolygonRasterizer: target image is null");
     }
 
-    Rasterizer rasterizer(image.rect(), poly, fill_rule, true);
-    rasterizer.fillBinary(image, color);
+    std::vector<std::unique_ptr<Rasterizer> > rasterizers;
+    rasterizers.emplace_back(new Rasterizer(image.rect(), poly, fill_rule, true));
+
+    uint32_t* const data = image.data();
+    int const wpl = image.wordsPerLine();
+    uint32_t const pattern = (color == WHITE) ? 0 : ~uint32_t(0);
+    Rasterizer::forEachLine(
+        rasterizers,
+        [&](int const idx, int const y, std::vector<EdgeComponent> const& edges) {
+            rasterizers[idx]->fillBinaryLine(edges, data + y * wpl, pattern);
+        }
+    );
 }
 
 void
@@ -223,21 +372,21 @@ PolygonRasterizer::grayFill(
     QImage& image, unsigned char const color,
     QPolygonF const& poly, Qt::FillRule const fill_rule)
 {
-    if (image.isNull()) {
-        throw std::invalid_argument("PolygonRasterizer: target image is null");
-    }
-    if (image.format() != QImage::Format_Indexed8 || !image.isGrayscale()) {
-        throw std::invalid_argument("PolygonRasterizer: target image is not grayscale");
-    }
-
-    Rasterizer rasterizer(image.rect(), poly, fill_rule, false);
-    rasterizer.fillGrayscale(image, color);
+    grayFillImpl(image, color, poly, fill_rule, false);
 }
 
 void
 PolygonRasterizer::grayFillExcept(
     QImage& image, unsigned char const color,
     QPolygonF const& poly, Qt::FillRule const fill_rule)
+{
+    grayFillImpl(image, color, poly, fill_rule, true);
+}
+
+void
+PolygonRasterizer::grayFillImpl(
+    QImage& image, unsigned char const color,
+    QPolygonF const& poly, Qt::FillRule const fill_rule, bool const invert)
 {
     if (image.isNull()) {
         throw std::invalid_argument("PolygonRasterizer: target image is null");
@@ -246,8 +395,17 @@ PolygonRasterizer::grayFillExcept(
         throw std::invalid_argument("PolygonRasterizer: target image is not grayscale");
     }
 
-    Rasterizer rasterizer(image.rect(), poly, fill_rule, true);
-    rasterizer.fillGrayscale(image, color);
+    std::vector<std::unique_ptr<Rasterizer> > rasterizers;
+    rasterizers.emplace_back(new Rasterizer(image.rect(), poly, fill_rule, invert));
+
+    uint8_t* const data = image.bits();
+    int const bpl = image.bytesPerLine();
+    Rasterizer::forEachLine(
+        rasterizers,
+        [&](int const idx, int const y, std::vector<EdgeComponent> const& edges) {
+            rasterizers[idx]->fillGrayscaleLine(edges, data + y * bpl, color);
+        }
+    );
 }
 
 /*======================= PolygonRasterizer::Edge ==========================*/
@@ -310,7 +468,11 @@ PolygonRasterizer::Rasterizer::Rasterizer(
         m_boundingBox = m_fillPoly.boundingRect();
     }
 
+    m_firstLine = std::max(qRound(m_boundingBox.top()), image_rect.top());
+    m_lineLimit = std::min(qRound(m_boundingBox.bottom()), image_rect.bottom() + 1);
+
     prepareEdges();
+    prepareSlabs();
 }
 
 void
@@ -381,120 +543,170 @@ PolygonRasterizer::Rasterizer::prepareEdges()
 }
 
 void
-PolygonRasterizer::Rasterizer::fillBinary(
-    BinaryImage& image, BWColor const color) const
+PolygonRasterizer::Rasterizer::prepareSlabs()
 {
-    std::vector<EdgeComponent> edges_for_line;
-    typedef std::vector<EdgeComponent>::const_iterator EdgeIter;
+    // Edge components were made from consecutive pairs of the same
+    // ordered list of y values, so ones sharing a top also share a bottom.
+    int const num_components = m_edgeComponents.size();
+    for (int i = 0; i < num_components;) {
+        Slab slab;
+        slab.top = m_edgeComponents[i].top();
+        slab.bottom = m_edgeComponents[i].bottom();
+        slab.firstComponent = i;
+        do {
+            ++i;
+        } while (i < num_components && m_edgeComponents[i].top() == slab.top);
+        slab.endComponent = i;
+        m_slabs.push_back(slab);
+    }
+}
 
-    uint32_t* line = image.data();
-    int const wpl = image.wordsPerLine();
-    uint32_t const pattern = (color == WHITE) ? 0 : ~uint32_t(0);
+template<typename LineFiller>
+void
+PolygonRasterizer::Rasterizer::forEachLine(
+    std::vector<std::unique_ptr<Rasterizer> > const& rasterizers,
+    LineFiller const& line_filler)
+{
+    int first_line = std::numeric_limits<int>::max();
+    int line_limit = std::numeric_limits<int>::min();
+    for (std::unique_ptr<Rasterizer> const& rasterizer : rasterizers) {
+        if (rasterizer->m_firstLine < rasterizer->m_lineLimit) {
+            first_line = std::min(first_line, rasterizer->m_firstLine);
+            line_limit = std::max(line_limit, rasterizer->m_lineLimit);
+        }
+    }
+    if (first_line >= line_limit) {
+        return;
+    }
 
-    int i = qRound(m_boundingBox.top());
-    line += i * wpl;
-    int const limit = qRound(m_boundingBox.bottom());
-    for (; i < limit; ++i, line += wpl, edges_for_line.clear()) {
-        double const y = i + 0.5;
-
-        // Get edges intersecting this horizontal line.
-        std::pair<EdgeIter, EdgeIter> const range(
-            std::equal_range(
-                m_edgeComponents.begin(), m_edgeComponents.end(),
-                y, EdgeOrderY()
-            )
-        );
+    int const num_bands = (line_limit - first_line + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    int const num_rasterizers = rasterizers.size();
 
-        if (range.first == range.second) {
-            continue;
+    #pragma omp parallel if (num_bands > 1)
+    {
+        std::vector<EdgeComponent> edges_for_line;
+
+        #pragma omp for schedule(dynamic)
+        for (int band = 0; band < num_bands; ++band) {
+            int const band_first = first_line + band * BAND_HEIGHT;
+            int const band_limit = std::min(band_first + BAND_HEIGHT, line_limit);
+            for (int y = band_first; y < band_limit; ++y) {
+                for (int i = 0; i < num_rasterizers; ++i) {
+                    Rasterizer const& rasterizer = *rasterizers[i];
+                    if (y < rasterizer.m_firstLine || y >= rasterizer.m_lineLimit) {
+                        continue;
+                    }
+                    if (rasterizer.edgesForLine(y, edges_for_line)) {
+                        line_filler(i, y, edges_for_line);
+                    }
+                }
+            }
         }
+    }
+}
 
-        std::copy(
-            range.first, range.second,
-            std::back_inserter(edges_for_line)
-        );
+bool
+PolygonRasterizer::Rasterizer::edgesForLine(
+    int const y_int, std::vector<EdgeComponent>& edges_for_line) const
+{
+    edges_for_line.clear();
 
-        // Calculate the intersection point of each edge with
-        // the current horizontal line.
-        for (EdgeComponent& ecomp : edges_for_line) {
-            ecomp.setX(ecomp.edge().xForY(y));
-        }
+    double const y = y_int + 0.5;
 
-        // Sort edge components by the x value of the intersection point.
-        std::sort(
-            edges_for_line.begin(), edges_for_line.end(),
-            EdgeOrderX()
-        );
+    // Find the slab containing this horizontal line.
+    std::vector<Slab>::const_iterator const slab(
+        std::upper_bound(
+            m_slabs.begin(), m_slabs.end(), y,
+            [](double const val, Slab const& s) {
+                return val < s.bottom;
+            }
+        )
+    );
+    if (slab == m_slabs.end() || slab->top > y) {
+        return false;
+    }
 
-        if (m_fillRule == Qt::OddEvenFill) {
-            oddEvenLineBinary(
-                &edges_for_line.front(), edges_for_line.size(),
-                line, pattern
-            );
-        } else {
-            windingLineBinary(
-                &edges_for_line.front(), edges_for_line.size(),
-                line, pattern, m_invert
-            );
-        }
+    edges_for_line.assign(
+        m_edgeComponents.begin() + slab->firstComponent,
+        m_edgeComponents.begin() + slab->endComponent
+    );
+
+    // Calculate the intersection point of each edge with
+    // the current horizontal line.
+    for (EdgeComponent& ecomp : edges_for_line) {
+        ecomp.setX(ecomp.edge().xForY(y));
     }
+
+    // Sort edge components by the x value of the intersection point.
+    std::sort(edges_for_line.begin(), edges_for_line.end(), EdgeOrderX());
+
+    return true;
 }
 
 void
-PolygonRasterizer::Rasterizer::fillGrayscale(
-    QImage& image, uint8_t const color) const
+PolygonRasterizer::Rasterizer::fillBinaryLine(
+    std::vector<EdgeComponent> const& edges_for_line,
+    uint32_t* const line, uint32_t const pattern) const
 {
-    std::vector<EdgeComponent> edges_for_line;
-    typedef std::vector<EdgeComponent>::const_iterator EdgeIter;
-
-    uint8_t* line = image.bits();
-    int const bpl = image.bytesPerLine();
-
-    int i = qRound(m_boundingBox.top());
-    line += i * bpl;
-    int const limit = qRound(m_boundingBox.bottom());
-    for (; i < limit; ++i, line += bpl, edges_for_line.clear()) {
-        double const y = i + 0.5;
-
-        // Get edges intersecting this horizontal line.
-        std::pair<EdgeIter, EdgeIter> const range(
-            std::equal_range(
-                m_edgeComponents.begin(), m_edgeComponents.end(),
-                y, EdgeOrderY()
-            )
+    if (m_fillRule == Qt::OddEvenFill) {
+        oddEvenLineBinary(
+            &edges_for_line.front(), edges_for_line.size(),
+            line, pattern
         );
-
-        if (range.first == range.second) {
-            continue;
-        }
-
-        std::copy(
-            range.first, range.second,
-            std::back_inserter(edges_for_line)
+    } else {
+        windingLineBinary(
+            &edges_for_line.front(), edges_for_line.size(),
+            line, pattern, m_invert
         );
+    }
+}
 
-        // Calculate the intersection point of each edge with
-        // the current horizontal line.
-        for (EdgeComponent& ecomp : edges_for_line) {
-            ecomp.setX(ecomp.edge().xForY(y));
-        }
-
-        // Sort edge components by the x value of the intersection point.
-        std::sort(
-            edges_for_line.begin(), edges_for_line.end(),
-            EdgeOrderX()
+void
+PolygonRasterizer::Rasterizer::fillGrayscaleLine(
+    std::vector<EdgeComponent> const& edges_for_line,
+    uint8_t* const line, uint8_t const color) const
+{
+    if (m_fillRule == Qt::OddEvenFill) {
+        oddEvenLineGrayscale(
+            &edges_for_line.front(), edges_for_line.size(),
+            line, color
+        );
+    } else {
+        windingLineGrayscale(
+            &edges_for_line.front(), edges_for_line.size(),
+            line, color, m_invert
         );
+    }
+}
 
-        if (m_fillRule == Qt::OddEvenFill) {
-            oddEvenLineGrayscale(
-                &edges_for_line.front(), edges_for_line.size(),
-                line, color
-            );
-        } else {
-            windingLineGrayscale(
-                &edges_for_line.front(), edges_for_line.size(),
-                line, color, m_invert
-            );
+template<typename SegmentSink>
+void
+PolygonRasterizer::Rasterizer::forEachSegment(
+    std::vector<EdgeComponent> const& edges_for_line,
+    SegmentSink const& segment_sink) const
+{
+    EdgeComponent const* const edges = &edges_for_line.front();
+    int const num_edges = edges_for_line.size();
+
+    if (m_fillRule == Qt::OddEvenFill) {
+        for (int i = 0; i < num_edges - 1; i += 2) {
+            int const from = qRound(edges[i].x());
+            int const to = qRound(edges[i + 1].x());
+            if (from != to) {
+                segment_sink(from, to);
+            }
+        }
+    } else {
+        int dir_sum = 0;
+        for (int i = 0; i < num_edges - 1; ++i) {
+            dir_sum += edges[i].edge().vertDirection();
+            if ((dir_sum == 0) == m_invert) {
+                int const from = qRound(edges[i].x());
+                int const to = qRound(edges[i + 1].x());
+                if (from != to) {
+                    segment_sink(from, to);
+                }
+            }
         }
     }
 }
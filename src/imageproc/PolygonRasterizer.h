@@ -20,9 +20,12 @@
 #define IMAGEPROC_POLYGONRASTERIZER_H_
 
 #include "BWColor.h"
+#include <QPolygonF>
+#include <QSize>
 #include <Qt>
+#include <vector>
+#include <stdint.h>
 
-class QPolygonF;
 class QRectF;
 class QImage;
 
@@ -30,14 +33,86 @@ namespace imageproc
 {
 
 class BinaryImage;
+class RleBinaryImage;
 
 class PolygonRasterizer
 {
 public:
+    /**
+     * \brief A polygon to be filled as a part of a batch.
+     */
+    struct BinaryFillOp {
+        QPolygonF poly;
+        BWColor color;
+        Qt::FillRule fillRule;
+
+        BinaryFillOp(QPolygonF const& p, BWColor c, Qt::FillRule rule)
+            : poly(p), color(c), fillRule(rule) {}
+    };
+
+    /**
+     * \brief A batch of polygons rasterized into horizontal runs.
+     *
+     * It's much more compact than an image for typical zones, and
+     * painting it onto an image only touches the covered words.
+     */
+    class Spans
+    {
+    public:
+        Spans() {}
+
+        bool isNull() const
+        {
+            return m_size.isEmpty();
+        }
+
+        QSize const& size() const
+        {
+            return m_size;
+        }
+    private:
+        friend class PolygonRasterizer;
+        friend class RleBinaryImage;
+
+        struct Run {
+            int xFrom;
+            int xTo; // Exclusive.
+            uint32_t pattern;
+        };
+
+        QSize m_size;
+        std::vector<int> m_lineStarts; // Indexes into m_runs, height + 1 of them.
+        std::vector<Run> m_runs; // Line by line, in the order of the ops.
+    };
+
     static void fill(
         BinaryImage& image, BWColor color,
         QPolygonF const& poly, Qt::FillRule fill_rule);
 
+    /**
+     * \brief Fills a number of polygons in a single pass over the image.
+     *
+     * The result is the same as of calling fill() for each of \p ops
+     * in order, so later polygons paint over earlier ones.
+     */
+    static void fill(BinaryImage& image, std::vector<BinaryFillOp> const& ops);
+
+    /**
+     * \brief Rasterizes \p ops for an image of size \p size without
+     *        painting them yet.
+     *
+     * fill(image, rasterize(image.size(), ops)) gives the same result
+     * as fill(image, ops).
+     */
+    static Spans rasterize(QSize const& size, std::vector<BinaryFillOp> const& ops);
+
+    /**
+     * \brief Paints spans previously produced by rasterize().
+     *
+     * \p image must be of the same size as \p spans.
+     */
+    static void fill(BinaryImage& image, Spans const& spans);
+
     static void fillExcept(
         BinaryImage& image, BWColor color,
         QPolygonF const& poly, Qt::FillRule fill_rule);
@@ -50,6 +125,10 @@ public:
         QImage& image, unsigned char color,
         QPolygonF const& poly, Qt::FillRule fill_rule);
 private:
+    static void grayFillImpl(
+        QImage& image, unsigned char color,
+        QPolygonF const& poly, Qt::FillRule fill_rule, bool invert);
+
     class Edge;
     class EdgeComponent;
     class EdgeOrderY;
@@ -17,7 +17,6 @@
 */
 
 #include "PolynomialSurface.h"
-#include "AlignedArray.h"
 #include "BinaryImage.h"
 #include "GrayImage.h"
 #include "Grayscale.h"
@@ -28,6 +27,7 @@
 #include "MatrixCalc.h"
 #include <stdexcept>
 #include <algorithm>
+#include <vector>
 #include <math.h>
 #include <stdint.h>
 #include <assert.h>
@@ -134,54 +134,54 @@ PolynomialSurface::render(QSize const& size) const
     int const width = size.width();
     int const height = size.height();
     int const bpl = image.stride();
-    int const num_coeffs = m_coeffs.size();
+    int const hor_terms = m_horDegree + 1;
 
     // Pretend that both x and y positions of pixels
     // lie in range of [0, 1].
     double const xscale = calcScale(width);
     double const yscale = calcScale(height);
 
-    AlignedArray<float, 4> vert_matrix(num_coeffs * height);
-    float* out = &vert_matrix[0];
-    for (int y = 0; y < height; ++y) {
-        double const y_adjusted = y * yscale;
-        double pow = 1.0;
-        int pos = 0;
-        for (int i = 0; i <= m_vertDegree; ++i) {
-            for (int j = 0; j <= m_horDegree; ++j, ++pos, ++out) {
-                *out = static_cast<float>(m_coeffs[pos] * pow);
-            }
-            pow *= y_adjusted;
-        }
-    }
-
-    AlignedArray<float, 4> hor_matrix(num_coeffs * width);
-    out = &hor_matrix[0];
+    std::vector<double> x_adjusted(width);
     for (int x = 0; x < width; ++x) {
-        double const x_adjusted = x * xscale;
-        for (int i = 0; i <= m_vertDegree; ++i) {
-            double pow = 1.0;
-            for (int j = 0; j <= m_horDegree; ++j, ++out) {
-                *out = static_cast<float>(pow);
-                pow *= x_adjusted;
-            }
-        }
+        x_adjusted[x] = x * xscale;
     }
 
     unsigned char* image_data = image.data(); // never call .data() inside omp
 
-    #pragma omp parallel for schedule(static) shared(image, vert_matrix, hor_matrix)
-    for (int y = 0; y < height; ++y) {
-        unsigned char* line = image_data + y * bpl;
-        float const* vert_line = &vert_matrix[0] + y * num_coeffs;
-        float const* hor_line = &hor_matrix[0];
-        for (int x = 0; x < width; ++x, hor_line += num_coeffs) {
-            float sum = 0; // for rounding purposes.
-            for (int i = 0; i < num_coeffs; ++i) {
-                sum += hor_line[i] * vert_line[i];
+    #pragma omp parallel shared(x_adjusted)
+    {
+        // Coefficients of the polynomial in x for a given y.
+        std::vector<double> row_coeffs(hor_terms);
+        std::vector<double> row_values(width);
+
+        #pragma omp for schedule(static)
+        for (int y = 0; y < height; ++y) {
+            double const y_adjusted = y * yscale;
+            for (int j = 0; j < hor_terms; ++j) {
+                double sum = 0.0;
+                for (int i = m_vertDegree; i >= 0; --i) {
+                    sum = sum * y_adjusted + m_coeffs[i * hor_terms + j];
+                }
+                row_coeffs[j] = sum;
+            }
+
+            // Horner's scheme, one power of x at a time for the whole line,
+            // which lets the compiler vectorize the inner loop.
+            double* const values = &row_values[0];
+            double const* const xs = &x_adjusted[0];
+            std::fill(values, values + width, row_coeffs[m_horDegree]);
+            for (int j = m_horDegree - 1; j >= 0; --j) {
+                double const coeff = row_coeffs[j];
+                for (int x = 0; x < width; ++x) {
+                    values[x] = values[x] * xs[x] + coeff;
+                }
+            }
+
+            unsigned char* line = image_data + y * bpl;
+            for (int x = 0; x < width; ++x) {
+                int const isum = (int)(values[x] * 255.0 + 0.5);
+                line[x] = isum <= 0 ? 0 : (isum >= 255 ? 255 : (unsigned char) isum);
             }
-            int const isum = (int)(sum * 255.0 + 0.5f);
-            line[x] = isum <= 0 ? 0 : (isum >= 255 ? 255 : (unsigned char) isum);
         }
     }
 
@@ -222,73 +222,7 @@ void PolynomialSurface::prepareDataForLeastSquares(
     GrayImage const& image, MatT<double>& AtA, VecT<double>& Atb,
     int const h_degree, int const v_degree)
 {
-    double* const AtA_data = AtA.data();
-    double* const Atb_data = Atb.data();
-
-    int const width = image.width();
-    int const height = image.height();
-    int const num_terms = Atb.size();
-
-    uint8_t const* line = image.data();
-    int const stride = image.stride();
-
-    // Pretend that both x and y positions of pixels
-    // lie in range of [0, 1].
-    double const xscale = calcScale(width);
-    double const yscale = calcScale(height);
-
-    // To force data samples into [0, 1] range.
-    double const data_scale = 1.0 / 255.0;
-
-    // 1, y, y^2, y^3, ...
-    VecT<double> y_powers(v_degree + 1); // Initialized to 0.
-
-    // Same as y_powers, except y_powers correspond to a given y,
-    // while x_powers are computed for all possible x values.
-    MatT<double> x_powers(h_degree + 1, width); // Initialized to 0.
-    for (int x = 0; x < width; ++x) {
-        double const x_adjusted = xscale * x;
-        double x_power = 1.0;
-        for (int i = 0; i <= h_degree; ++i) {
-            x_powers(i, x) = x_power;
-            x_power *= x_adjusted;
-        }
-    }
-
-    VecT<double> full_powers(num_terms);
-
-    for (int y = 0; y < height; ++y, line += stride) {
-        double const y_adjusted = yscale * y;
-
-        double y_power = 1.0;
-        for (int i = 0; i <= v_degree; ++i) {
-            y_powers[i] = y_power;
-            y_power *= y_adjusted;
-        }
-
-        for (int x = 0; x < width; ++x) {
-            double const data_point = data_scale * line[x];
-
-            int pos = 0;
-            for (int i = 0; i <= v_degree; ++i) {
-                for (int j = 0; j <= h_degree; ++j, ++pos) {
-                    full_powers[pos] = y_powers[i] * x_powers(j, x);
-                }
-            }
-
-            double* p_AtA = AtA_data;
-            for (int i = 0; i < num_terms; ++i) {
-                double const i_val = full_powers[i];
-                Atb_data[i] += i_val * data_point;
-
-                for (int j = 0; j < num_terms; ++j) {
-                    double const j_val = full_powers[j];
-                    *p_AtA += i_val * j_val;
-                    ++p_AtA;
-                }
-            }
-        }
-    }
+    accumulateLeastSquares(image, nullptr, AtA, Atb, h_degree, v_degree);
 }
 
 void PolynomialSurface::prepareDataForLeastSquares(
@@ -296,18 +230,29 @@ void PolynomialSurface::prepareDataForLeastSquares(
     MatT<double>& AtA, VecT<double>& Atb,
     int const h_degree, int const v_degree)
 {
-    double* const AtA_data = AtA.data();
-    double* const Atb_data = Atb.data();
+    accumulateLeastSquares(image, &mask, AtA, Atb, h_degree, v_degree);
+}
 
+void PolynomialSurface::accumulateLeastSquares(
+    GrayImage const& image, BinaryImage const* mask,
+    MatT<double>& AtA, VecT<double>& Atb,
+    int const h_degree, int const v_degree)
+{
     int const width = image.width();
     int const height = image.height();
     int const num_terms = Atb.size();
+    int const hor_terms = h_degree + 1;
 
-    uint8_t const* image_line = image.data();
+    // A term is a product of x and y powers, so a product of two terms
+    // involves powers up to these.
+    int const num_x_powers = h_degree * 2 + 1;
+    int const num_y_powers = v_degree * 2 + 1;
+
+    uint8_t const* const image_data = image.data();
     int const image_stride = image.stride();
 
-    uint32_t const* mask_line = mask.data();
-    int const mask_stride = mask.wordsPerLine();
+    uint32_t const* const mask_data = mask ? mask->data() : nullptr;
+    int const mask_stride = mask ? mask->wordsPerLine() : 0;
 
     // Pretend that both x and y positions of pixels
     // lie in range of [0, 1].
@@ -317,62 +262,110 @@ void PolynomialSurface::prepareDataForLeastSquares(
     // To force data samples into [0, 1] range.
     double const data_scale = 1.0 / 255.0;
 
-    // 1, y, y^2, y^3, ...
-    VecT<double> y_powers(v_degree + 1); // Initialized to 0.
-
-    // Same as y_powers, except y_powers correspond to a given y,
-    // while x_powers are computed for all possible x values.
-    MatT<double> x_powers(h_degree + 1, width); // Initialized to 0.
+    // 1, x, x^2, x^3, ... for every x, and the same for every y.
+    std::vector<double> x_powers(num_x_powers * width);
     for (int x = 0; x < width; ++x) {
         double const x_adjusted = xscale * x;
         double x_power = 1.0;
-        for (int i = 0; i <= h_degree; ++i) {
-            x_powers(i, x) = x_power;
+        for (int i = 0; i < num_x_powers; ++i) {
+            x_powers[x * num_x_powers + i] = x_power;
             x_power *= x_adjusted;
         }
     }
 
-    VecT<double> full_powers(num_terms);
-
-    uint32_t const msb = uint32_t(1) << 31;
+    std::vector<double> y_powers(num_y_powers * height);
     for (int y = 0; y < height; ++y) {
         double const y_adjusted = yscale * y;
-
         double y_power = 1.0;
-        for (int i = 0; i <= v_degree; ++i) {
-            y_powers[i] = y_power;
+        for (int i = 0; i < num_y_powers; ++i) {
+            y_powers[y * num_y_powers + i] = y_power;
             y_power *= y_adjusted;
         }
+    }
 
-        for (int x = 0; x < width; ++x) {
-            if (!(mask_line[x >> 5] & (msb >> (x & 31)))) {
-                continue;
-            }
+    // Within a line, y powers are constant, so pixels only need to
+    // contribute to sums of x powers, with and without the data point.
+    // Those sums are then expanded into A^T*A and A^T*b once per line.
+    // Lines are grouped into strips, each having its own partial sums.
+    // Those are added up in a fixed order, so the outcome doesn't depend
+    // on the number of threads.
+    int const strip_height = 32;
+    int const num_strips = (height + strip_height - 1) / strip_height;
+    int const partial_size = num_terms * num_terms + num_terms;
+    std::vector<double> partials(num_strips * partial_size, 0.0);
 
-            double const data_point = data_scale * image_line[x];
+    uint32_t const msb = uint32_t(1) << 31;
 
-            int pos = 0;
-            for (int i = 0; i <= v_degree; ++i) {
-                for (int j = 0; j <= h_degree; ++j, ++pos) {
-                    full_powers[pos] = y_powers[i] * x_powers(j, x);
+    #pragma omp parallel shared(x_powers, y_powers, partials)
+    {
+        std::vector<double> x_sums(num_x_powers);
+        std::vector<double> data_sums(hor_terms);
+
+        #pragma omp for schedule(dynamic)
+        for (int strip = 0; strip < num_strips; ++strip) {
+            double* const strip_AtA = &partials[strip * partial_size];
+            double* const strip_Atb = strip_AtA + num_terms * num_terms;
+            int const y_end = std::min(height, (strip + 1) * strip_height);
+
+            for (int y = strip * strip_height; y < y_end; ++y) {
+                uint8_t const* const image_line = image_data + y * image_stride;
+                uint32_t const* const mask_line = mask_data ? mask_data + y * mask_stride : nullptr;
+
+                std::fill(x_sums.begin(), x_sums.end(), 0.0);
+                std::fill(data_sums.begin(), data_sums.end(), 0.0);
+                bool have_data_points = false;
+
+                for (int x = 0; x < width; ++x) {
+                    if (mask_line && !(mask_line[x >> 5] & (msb >> (x & 31)))) {
+                        continue;
+                    }
+
+                    double const data_point = data_scale * image_line[x];
+                    double const* const powers = &x_powers[x * num_x_powers];
+                    for (int i = 0; i < num_x_powers; ++i) {
+                        x_sums[i] += powers[i];
+                    }
+                    for (int i = 0; i < hor_terms; ++i) {
+                        data_sums[i] += powers[i] * data_point;
+                    }
+                    have_data_points = true;
                 }
-            }
 
-            double* p_AtA = AtA_data;
-            for (int i = 0; i < num_terms; ++i) {
-                double const i_val = full_powers[i];
-                Atb_data[i] += i_val * data_point;
+                if (!have_data_points) {
+                    continue;
+                }
 
-                for (int j = 0; j < num_terms; ++j) {
-                    double const j_val = full_powers[j];
-                    *p_AtA += i_val * j_val;
-                    ++p_AtA;
+                double const* const powers = &y_powers[y * num_y_powers];
+                double* p_AtA = strip_AtA;
+                int pos = 0;
+                for (int i1 = 0; i1 <= v_degree; ++i1) {
+                    for (int j1 = 0; j1 <= h_degree; ++j1, ++pos) {
+                        strip_Atb[pos] += powers[i1] * data_sums[j1];
+
+                        for (int i2 = 0; i2 <= v_degree; ++i2) {
+                            double const y_power = powers[i1 + i2];
+                            for (int j2 = 0; j2 <= h_degree; ++j2) {
+                                *p_AtA += y_power * x_sums[j1 + j2];
+                                ++p_AtA;
+                            }
+                        }
+                    }
                 }
             }
         }
+    }
 
-        image_line += image_stride;
-        mask_line += mask_stride;
+    double* const AtA_data = AtA.data();
+    double* const Atb_data = Atb.data();
+    for (int strip = 0; strip < num_strips; ++strip) {
+        double const* const strip_AtA = &partials[strip * partial_size];
+        double const* const strip_Atb = strip_AtA + num_terms * num_terms;
+        for (int i = 0; i < num_terms * num_terms; ++i) {
+            AtA_data[i] += strip_AtA[i];
+        }
+        for (int i = 0; i < num_terms; ++i) {
+            Atb_data[i] += strip_Atb[i];
+        }
     }
 }
 
@@ -99,6 +99,14 @@ private:
         GrayImage const& image, BinaryImage const& mask,
         MatT<double>& AtA, VecT<double>& Atb, int h_degree, int v_degree);
 
+    /**
+     * Adds the contribution of pixels of \p image to A^T*A and A^T*b.
+     * If \p mask is provided, only pixels that are black on it are considered.
+     */
+    static void accumulateLeastSquares(
+        GrayImage const& image, BinaryImage const* mask,
+        MatT<double>& AtA, VecT<double>& Atb, int h_degree, int v_degree);
+
     static void fixSquareMatrixRankDeficiency(MatT<double>& mat);
 
     VecT<double> m_coeffs;
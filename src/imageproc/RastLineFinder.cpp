@@ -80,7 +80,7 @@ RastLineFinder::RastLineFinder(std::vector<QPointF> const& points, RastLineFinde
     ,   m_angleToleranceRad(params.angleToleranceDeg() * constants::DEG2RAD)
     ,   m_maxDistFromLine(params.maxDistFromLine())
     ,   m_minSupportPoints(params.minSupportPoints())
-    ,   m_firstLine(true)
+    ,   m_numLinesFound(0)
 {
     std::string error;
     if (!params.validate(&error)) {
@@ -124,12 +124,6 @@ RastLineFinder::RastLineFinder(std::vector<QPointF> const& points, RastLineFinde
 QLineF
 RastLineFinder::findNext(std::vector<unsigned>* point_idxs)
 {
-    if (m_firstLine) {
-        m_firstLine = false;
-    } else {
-        pruneUnavailablePoints();
-    }
-
     SearchSpace dist_ssp1, dist_ssp2;
     SearchSpace angle_ssp1, angle_ssp2;
 
@@ -137,6 +131,16 @@ RastLineFinder::findNext(std::vector<unsigned>* point_idxs)
         SearchSpace ssp;
         m_orderedSearchSpaces.retrieveFront(ssp);
 
+        if (ssp.generation() != m_numLinesFound) {
+            // Lines found since this search space was created may have taken
+            // some of its points.  Pruning can only lower its priority,
+            // so pruning lazily, when it comes up, doesn't change the order
+            // in which search spaces are explored.
+            ssp.pruneUnavailablePoints(PointUnavailablePred(&m_points), m_numLinesFound);
+            pushIfGoodEnough(ssp);
+            continue;
+        }
+
         if (!ssp.subdivideDist(*this, dist_ssp1, dist_ssp2)) {
             if (!ssp.subdivideAngle(*this, angle_ssp1, angle_ssp2)) {
                 // Can't subdivide at all - return what we've got then.
@@ -189,24 +193,7 @@ RastLineFinder::markPointsUnavailable(std::vector<unsigned> const& point_idxs)
     for (unsigned idx : point_idxs) {
         m_points[idx].available = false;
     }
-}
-
-void
-RastLineFinder::pruneUnavailablePoints()
-{
-    OrderedSearchSpaces new_search_spaces;
-    SearchSpace ssp;
-    PointUnavailablePred pred(&m_points);
-
-    while (!m_orderedSearchSpaces.empty()) {
-        m_orderedSearchSpaces.retrieveFront(ssp);
-        ssp.pruneUnavailablePoints(pred);
-        if (ssp.pointIdxs().size() >= m_minSupportPoints) {
-            new_search_spaces.pushDestructive(ssp);
-        }
-    }
-
-    m_orderedSearchSpaces.swapWith(new_search_spaces);
+    ++m_numLinesFound;
 }
 
 /*============================= SearchSpace ================================*/
@@ -216,6 +203,7 @@ RastLineFinder::SearchSpace::SearchSpace()
     ,   m_maxDist(0)
     ,   m_minAngleRad(0)
     ,   m_maxAngleRad(0)
+    ,   m_generation(0)
 {
 }
 
@@ -226,8 +214,10 @@ RastLineFinder::SearchSpace::SearchSpace(
     ,   m_maxDist(max_dist)
     ,   m_minAngleRad(min_angle_rad)
     ,   m_maxAngleRad(max_angle_rad)
+    ,   m_generation(owner.m_numLinesFound)
 {
-    m_pointIdxs.reserve(candidate_idxs.size());
+    std::vector<unsigned>& accepted_idxs = owner.m_scratchIdxs;
+    accepted_idxs.clear();
 
     QPointF const origin(owner.m_origin);
 
@@ -270,12 +260,12 @@ RastLineFinder::SearchSpace::SearchSpace(
             continue;
         }
 
-        m_pointIdxs.push_back(idx);
+        accepted_idxs.push_back(idx);
     }
 
-    // Compact m_pointIdxs, as we expect a lot of SearchSpace objects
-    // to exist at the same time.
-    std::vector<unsigned>(m_pointIdxs).swap(m_pointIdxs);
+    // Allocate exactly as much as needed, as we expect a lot of SearchSpace
+    // objects to exist at the same time.
+    m_pointIdxs.assign(accepted_idxs.begin(), accepted_idxs.end());
 }
 
 QLineF
@@ -339,9 +329,11 @@ RastLineFinder::SearchSpace::subdivideAngle(
 }
 
 void
-RastLineFinder::SearchSpace::pruneUnavailablePoints(PointUnavailablePred pred)
+RastLineFinder::SearchSpace::pruneUnavailablePoints(
+    PointUnavailablePred pred, unsigned const generation)
 {
     m_pointIdxs.resize(std::remove_if(m_pointIdxs.begin(), m_pointIdxs.end(), pred) - m_pointIdxs.begin());
+    m_generation = generation;
 }
 
 void
@@ -352,6 +344,7 @@ RastLineFinder::SearchSpace::swap(SearchSpace& other)
     std::swap(m_minAngleRad, other.m_minAngleRad);
     std::swap(m_maxAngleRad, other.m_maxAngleRad);
     m_pointIdxs.swap(other.m_pointIdxs);
+    std::swap(m_generation, other.m_generation);
 }
 
 } // namespace imageproc
@@ -237,7 +237,20 @@ private:
 
         bool subdivideAngle(RastLineFinder const& owner, SearchSpace& subspace1, SearchSpace& subspace2) const;
 
-        void pruneUnavailablePoints(PointUnavailablePred pred);
+        /**
+         * Removes points that became unavailable, and marks the
+         * search space as up to date with respect to \p generation.
+         */
+        void pruneUnavailablePoints(PointUnavailablePred pred, unsigned generation);
+
+        /**
+         * The number of lines that had been found when the list of points
+         * was last filtered against point availability.
+         */
+        unsigned generation() const
+        {
+            return m_generation;
+        }
 
         std::vector<unsigned>& pointIdxs()
         {
@@ -256,6 +269,7 @@ private:
         float m_minAngleRad;
         float m_maxAngleRad;
         std::vector<unsigned> m_pointIdxs; // Indexes into m_points of the parent object.
+        unsigned m_generation;
     };
 
     class OrderedSearchSpaces : public PriorityQueue<SearchSpace, OrderedSearchSpaces>
@@ -274,7 +288,6 @@ private:
 
     void markPointsUnavailable(std::vector<unsigned> const& point_idxs);
 
-    void pruneUnavailablePoints();
 
     QPointF m_origin;
     double m_angleToleranceRad;
@@ -282,7 +295,13 @@ private:
     unsigned m_minSupportPoints;
     std::vector<Point> m_points;
     OrderedSearchSpaces m_orderedSearchSpaces;
-    bool m_firstLine;
+    unsigned m_numLinesFound;
+
+    /**
+     * Reused by SearchSpace constructor, to avoid allocating
+     * a worst-case sized vector for every subspace.
+     */
+    mutable std::vector<unsigned> m_scratchIdxs;
 };
 
 } // namespace imageproc
@@ -17,6 +17,7 @@
 */
 
 #include "ReduceThreshold.h"
+#include "Kernels.h"
 #include <stdexcept>
 #include <stdint.h>
 #include <assert.h>
@@ -88,38 +89,6 @@ inline uint32_t compressBitsLowerHalf(uint32_t const bits)
     return r;
 }
 
-inline uint32_t threshold1(uint32_t const top, uint32_t const bottom)
-{
-    uint32_t word = top | bottom;
-    word |= word << 1;
-    return word;
-}
-
-inline uint32_t threshold2(uint32_t const top, uint32_t const bottom)
-{
-    uint32_t word1 = top & bottom;
-    word1 |= word1 << 1;
-    uint32_t word2 = top | bottom;
-    word2 &= word2 << 1;
-    return word1 | word2;
-}
-
-inline uint32_t threshold3(uint32_t const top, uint32_t const bottom)
-{
-    uint32_t word1 = top | bottom;
-    word1 &= word1 << 1;
-    uint32_t word2 = top & bottom;
-    word2 |= word2 << 1;
-    return word1 & word2;
-}
-
-inline uint32_t threshold4(uint32_t const top, uint32_t const bottom)
-{
-    uint32_t word = top & bottom;
-    word &= word << 1;
-    return word;
-}
-
 } // anonymous namespace
 
 ReduceThreshold::ReduceThreshold(BinaryImage const& image)
@@ -162,63 +131,95 @@ ReduceThreshold::reduce(int const threshold)
     uint32_t const* src_line = src.data();
     uint32_t* dst_line = dst.data();
 
-    uint32_t word;
+    Kernels::ReduceThresholdFunc const reduce_line = Kernels::active().reduceThreshold;
 
-    if (threshold == 1) {
-        for (int i = dst_h; i > 0; --i) {
-            for (int j = 0; j < steps_per_line; j += 2) {
-                word = threshold1(src_line[j], src_line[j + src_wpl]);
-                dst_line[j / 2] = compressBitsUpperHalf(word);
-            }
-            for (int j = 1; j < steps_per_line; j += 2) {
-                word = threshold1(src_line[j], src_line[j + src_wpl]);
-                dst_line[j / 2] |= compressBitsLowerHalf(word);
-            }
-            src_line += src_wpl * 2;
-            dst_line += dst_wpl;
+    for (int i = dst_h; i > 0; --i) {
+        reduce_line(src_line, src_line + src_wpl, dst_line, steps_per_line, threshold);
+        src_line += src_wpl * 2;
+        dst_line += dst_wpl;
+    }
+
+    m_image = dst;
+    return *this;
+}
+
+ReduceThreshold&
+ReduceThreshold::reduceCascade(
+    std::vector<int> const& thresholds, std::vector<BinaryImage>* levels)
+{
+    for (int const threshold : thresholds) {
+        if (threshold < 1 || threshold > 4) {
+            throw std::invalid_argument("ReduceThreshold: invalid threshold");
         }
-    } else if (threshold == 2) {
-        for (int i = dst_h; i > 0; --i) {
-            for (int j = 0; j < steps_per_line; j += 2) {
-                word = threshold2(src_line[j], src_line[j + src_wpl]);
-                dst_line[j / 2] = compressBitsUpperHalf(word);
-            }
-            for (int j = 1; j < steps_per_line; j += 2) {
-                word = threshold2(src_line[j], src_line[j + src_wpl]);
-                dst_line[j / 2] |= compressBitsLowerHalf(word);
-            }
-            src_line += src_wpl * 2;
-            dst_line += dst_wpl;
+    }
+
+    int const num_levels = thresholds.size();
+    if (levels) {
+        levels->clear();
+        levels->reserve(num_levels);
+    }
+
+    if (m_image.isNull()) {
+        if (levels) {
+            levels->resize(num_levels);
         }
-    } else if (threshold == 3) {
-        for (int i = dst_h; i > 0; --i) {
-            for (int j = 0; j < steps_per_line; j += 2) {
-                word = threshold3(src_line[j], src_line[j + src_wpl]);
-                dst_line[j / 2] = compressBitsUpperHalf(word);
-            }
-            for (int j = 1; j < steps_per_line; j += 2) {
-                word = threshold3(src_line[j], src_line[j + src_wpl]);
-                dst_line[j / 2] |= compressBitsLowerHalf(word);
+        return *this;
+    }
+
+    // Lines and single pixels are left to reduce().  Only the levels before
+    // the image degenerates into one of those are done in a single pass.
+    std::vector<BinaryImage> dst;
+    int width = m_image.width();
+    int height = m_image.height();
+    for (int level = 0; level < num_levels && width >= 2 && height >= 2; ++level) {
+        width /= 2;
+        height /= 2;
+        dst.push_back(BinaryImage(width, height));
+    }
+    int const num_joint_levels = dst.size();
+
+    if (num_joint_levels > 0) {
+        Kernels::ReduceThresholdFunc const reduce_line = Kernels::active().reduceThreshold;
+
+        for (int y = 0; y < dst[0].height(); ++y) {
+            int line = y;
+            int level = 0;
+            for (;;) {
+                BinaryImage const& from = level == 0 ? m_image : dst[level - 1];
+                BinaryImage& to = dst[level];
+                int const from_wpl = from.wordsPerLine();
+                int const steps_per_line = (to.width() * 2 + 31) / 32;
+                uint32_t const* from_line = from.data() + from_wpl * line * 2;
+                reduce_line(
+                    from_line, from_line + from_wpl,
+                    to.data() + to.wordsPerLine() * line,
+                    steps_per_line, thresholds[level]
+                );
+
+                // Having completed a pair of lines, we can reduce it further
+                // while it's still in cache.
+                if (++level == num_joint_levels || !(line & 1)
+                        || (line >> 1) >= dst[level].height()) {
+                    break;
+                }
+                line >>= 1;
             }
-            src_line += src_wpl * 2;
-            dst_line += dst_wpl;
         }
-    } else if (threshold == 4) {
-        for (int i = dst_h; i > 0; --i) {
-            for (int j = 0; j < steps_per_line; j += 2) {
-                word = threshold4(src_line[j], src_line[j + src_wpl]);
-                dst_line[j / 2] = compressBitsUpperHalf(word);
-            }
-            for (int j = 1; j < steps_per_line; j += 2) {
-                word = threshold4(src_line[j], src_line[j + src_wpl]);
-                dst_line[j / 2] |= compressBitsLowerHalf(word);
-            }
-            src_line += src_wpl * 2;
-            dst_line += dst_wpl;
+    }
+
+    for (int level = 0; level < num_joint_levels; ++level) {
+        m_image = dst[level];
+        if (levels) {
+            levels->push_back(m_image);
+        }
+    }
+    for (int level = num_joint_levels; level < num_levels; ++level) {
+        reduce(thresholds[level]);
+        if (levels) {
+            levels->push_back(m_image);
         }
     }
 
-    m_image = dst;
     return *this;
 }
 
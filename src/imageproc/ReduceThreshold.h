@@ -20,6 +20,7 @@
 #define IMAGEPROC_REDUCETHRESHOLD_H_
 
 #include "BinaryImage.h"
+#include <vector>
 
 namespace imageproc
 {
@@ -48,6 +49,10 @@ namespace imageproc
  * \code
  * BinaryImage out = ReduceThreshold(input)(4)(4)(3);
  * \endcode
+ * or, without going over the intermediate images once per reduction:
+ * \code
+ * BinaryImage out = ReduceThreshold(input).reduceCascade({4, 4, 3});
+ * \endcode
  */
 class ReduceThreshold
 {
@@ -85,6 +90,21 @@ public:
     {
         return reduce(threshold);
     }
+
+    /**
+     * \brief Performs a series of reductions in a single pass and returns *this.
+     *
+     * The result is the same as calling reduce() for each of \p thresholds
+     * in turn.  The difference is that each pair of freshly reduced lines
+     * gets reduced further right away, while it's still in cache.
+     *
+     * \param thresholds The thresholds of successive reductions.
+     * \param levels If provided, receives the image after each reduction,
+     *        the last one being the same as image().
+     */
+    ReduceThreshold& reduceCascade(
+        std::vector<int> const& thresholds,
+        std::vector<BinaryImage>* levels = nullptr);
 private:
     void reduceHorLine(int threshold);
 
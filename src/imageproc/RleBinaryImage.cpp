@@ -0,0 +1,482 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RleBinaryImage.h"
+#include "BinaryImage.h"
+#include "BitOps.h"
+#include "PolygonRasterizer.h"
+#include <QPoint>
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+namespace imageproc
+{
+
+RleBinaryImage::RleBinaryImage()
+{
+}
+
+RleBinaryImage::RleBinaryImage(QSize const size, BWColor const color)
+{
+    if (size.isEmpty()) {
+        return;
+    }
+
+    m_size = size;
+    fill(color);
+}
+
+RleBinaryImage::RleBinaryImage(BinaryImage const& image)
+{
+    if (image.isNull()) {
+        return;
+    }
+
+    int const w = image.width();
+    int const h = image.height();
+    int const wpl = image.wordsPerLine();
+    int const last_word_idx = (w - 1) >> 5;
+    uint32_t const last_word_mask = ~uint32_t(0) << (31 - ((w - 1) & 31));
+    uint32_t const* line = image.data();
+
+    m_size = image.size();
+    m_lineStarts.reserve(h + 1);
+
+    for (int y = 0; y < h; ++y, line += wpl) {
+        m_lineStarts.push_back(m_runs.size());
+
+        int run_start = -1;
+        for (int i = 0; i <= last_word_idx; ++i) {
+            uint32_t const word = (i == last_word_idx) ? line[i] & last_word_mask : line[i];
+            int const x0 = i << 5;
+
+            if (word == 0) {
+                if (run_start >= 0) {
+                    Run const run = { run_start, x0 };
+                    m_runs.push_back(run);
+                    run_start = -1;
+                }
+                continue;
+            } else if (word == ~uint32_t(0)) {
+                if (run_start < 0) {
+                    run_start = x0;
+                }
+                continue;
+            }
+
+            // Look for the next bit that differs from the current color.
+            // The bits shifted in from the right never do.
+            int bit = 0;
+            while (bit < 32) {
+                uint32_t const rest = (run_start < 0 ? word : ~word) << bit;
+                if (!rest) {
+                    break;
+                }
+                bit += countMostSignificantZeroes(rest);
+                if (run_start < 0) {
+                    run_start = x0 + bit;
+                } else {
+                    Run const run = { run_start, x0 + bit };
+                    m_runs.push_back(run);
+                    run_start = -1;
+                }
+            }
+        }
+
+        if (run_start >= 0) {
+            Run const run = { run_start, w };
+            m_runs.push_back(run);
+        }
+    }
+
+    m_lineStarts.push_back(m_runs.size());
+}
+
+BinaryImage
+RleBinaryImage::toBinaryImage() const
+{
+    if (isNull()) {
+        return BinaryImage();
+    }
+
+    BinaryImage image(m_size, WHITE);
+    uint32_t* const data = image.data();
+    int const wpl = image.wordsPerLine();
+    int const h = height();
+
+    for (int y = 0; y < h; ++y) {
+        uint32_t* const line = data + y * wpl;
+        for (Run const* run = lineBegin(y); run != lineEnd(y); ++run) {
+            uint32_t const first_word_mask = ~uint32_t(0) >> (run->xFrom & 31);
+            uint32_t const last_word_mask = ~uint32_t(0) << (31 - ((run->xTo - 1) & 31));
+            int const first_word_idx = run->xFrom >> 5;
+            int const last_word_idx = (run->xTo - 1) >> 5;
+
+            if (first_word_idx == last_word_idx) {
+                line[first_word_idx] |= first_word_mask & last_word_mask;
+                continue;
+            }
+
+            line[first_word_idx] |= first_word_mask;
+            if (last_word_idx - first_word_idx > 1) {
+                memset(
+                    line + first_word_idx + 1, 0xff,
+                    (last_word_idx - first_word_idx - 1) * 4
+                );
+            }
+            line[last_word_idx] |= last_word_mask;
+        }
+    }
+
+    return image;
+}
+
+void
+RleBinaryImage::swap(RleBinaryImage& other)
+{
+    std::swap(m_size, other.m_size);
+    m_lineStarts.swap(other.m_lineStarts);
+    m_runs.swap(other.m_runs);
+}
+
+void
+RleBinaryImage::invert()
+{
+    if (isNull()) {
+        return;
+    }
+
+    int const w = width();
+    int const h = height();
+    std::vector<int> line_starts;
+    std::vector<Run> runs;
+    line_starts.reserve(h + 1);
+    runs.reserve(m_runs.size() + h);
+
+    for (int y = 0; y < h; ++y) {
+        line_starts.push_back(runs.size());
+        int x = 0;
+        for (Run const* run = lineBegin(y); run != lineEnd(y); ++run) {
+            if (run->xFrom > x) {
+                Run const gap = { x, run->xFrom };
+                runs.push_back(gap);
+            }
+            x = run->xTo;
+        }
+        if (x < w) {
+            Run const gap = { x, w };
+            runs.push_back(gap);
+        }
+    }
+    line_starts.push_back(runs.size());
+
+    m_lineStarts.swap(line_starts);
+    m_runs.swap(runs);
+}
+
+void
+RleBinaryImage::fill(BWColor const color)
+{
+    if (isNull()) {
+        return;
+    }
+
+    int const h = height();
+    m_lineStarts.clear();
+    m_runs.clear();
+    m_lineStarts.reserve(h + 1);
+
+    if (color == WHITE) {
+        m_lineStarts.resize(h + 1, 0);
+        return;
+    }
+
+    Run const run = { 0, width() };
+    m_runs.resize(h, run);
+    for (int y = 0; y <= h; ++y) {
+        m_lineStarts.push_back(y);
+    }
+}
+
+void
+RleBinaryImage::fill(QRect const& rect, BWColor const color)
+{
+    QRect const bounded_rect(rect.intersected(this->rect()));
+    if (bounded_rect.isEmpty()) {
+        return;
+    }
+
+    int const h = height();
+    int const top = bounded_rect.top();
+    int const bottom = bounded_rect.bottom();
+    std::vector<int> line_starts;
+    std::vector<Run> runs;
+    std::vector<Run> line;
+    line_starts.reserve(h + 1);
+    runs.reserve(m_runs.size() + bounded_rect.height());
+
+    for (int y = 0; y < h; ++y) {
+        line_starts.push_back(runs.size());
+        if (y < top || y > bottom) {
+            runs.insert(runs.end(), lineBegin(y), lineEnd(y));
+            continue;
+        }
+        line.assign(lineBegin(y), lineEnd(y));
+        paintRun(line, bounded_rect.left(), bounded_rect.right() + 1, color == BLACK);
+        runs.insert(runs.end(), line.begin(), line.end());
+    }
+    line_starts.push_back(runs.size());
+
+    m_lineStarts.swap(line_starts);
+    m_runs.swap(runs);
+}
+
+void
+RleBinaryImage::fill(
+    QPolygonF const& poly, BWColor const color, Qt::FillRule const fill_rule)
+{
+    if (isNull()) {
+        throw std::invalid_argument("RleBinaryImage: target image is null");
+    }
+
+    std::vector<PolygonRasterizer::BinaryFillOp> ops;
+    ops.push_back(PolygonRasterizer::BinaryFillOp(poly, color, fill_rule));
+    PolygonRasterizer::Spans const spans(PolygonRasterizer::rasterize(m_size, ops));
+
+    int const h = height();
+    std::vector<int> line_starts;
+    std::vector<Run> runs;
+    std::vector<Run> line;
+    line_starts.reserve(h + 1);
+    runs.reserve(m_runs.size());
+
+    for (int y = 0; y < h; ++y) {
+        line_starts.push_back(runs.size());
+        int const end = spans.m_lineStarts[y + 1];
+        int i = spans.m_lineStarts[y];
+        if (i == end) {
+            runs.insert(runs.end(), lineBegin(y), lineEnd(y));
+            continue;
+        }
+        line.assign(lineBegin(y), lineEnd(y));
+        for (; i < end; ++i) {
+            PolygonRasterizer::Spans::Run const& span = spans.m_runs[i];
+            paintRun(line, span.xFrom, span.xTo, span.pattern != 0);
+        }
+        runs.insert(runs.end(), line.begin(), line.end());
+    }
+    line_starts.push_back(runs.size());
+
+    m_lineStarts.swap(line_starts);
+    m_runs.swap(runs);
+}
+
+int
+RleBinaryImage::countBlackPixels() const
+{
+    int count = 0;
+    for (Run const& run : m_runs) {
+        count += run.xTo - run.xFrom;
+    }
+    return count;
+}
+
+int
+RleBinaryImage::countWhitePixels() const
+{
+    return width() * height() - countBlackPixels();
+}
+
+QRect
+RleBinaryImage::contentBoundingBox(BWColor const content_color) const
+{
+    int const w = width();
+    int const h = height();
+    int top = -1;
+    int bottom = -1;
+    int left = w;
+    int right = -1;
+
+    for (int y = 0; y < h; ++y) {
+        Run const* const begin = lineBegin(y);
+        Run const* const end = lineEnd(y);
+        int line_left;
+        int line_right; // Inclusive.
+
+        if (content_color == BLACK) {
+            if (begin == end) {
+                continue;
+            }
+            line_left = begin->xFrom;
+            line_right = (end - 1)->xTo - 1;
+        } else {
+            if (end - begin == 1 && begin->xFrom == 0 && begin->xTo == w) {
+                continue;
+            }
+            // Runs are never adjacent, so a run ending inside
+            // the line is always followed by a white pixel.
+            line_left = (begin == end || begin->xFrom > 0) ? 0 : begin->xTo;
+            line_right = (begin == end || (end - 1)->xTo < w) ? w - 1 : (end - 1)->xFrom - 1;
+        }
+
+        if (top < 0) {
+            top = y;
+        }
+        bottom = y;
+        left = std::min(left, line_left);
+        right = std::max(right, line_right);
+    }
+
+    if (top < 0) {
+        return QRect();
+    }
+
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+void
+RleBinaryImage::applyTruthTable(RleBinaryImage const& src, unsigned const truth_table)
+{
+    if (m_size != src.size()) {
+        throw std::invalid_argument("RleBinaryImage: images have different dimensions");
+    }
+
+    int const w = width();
+    int const h = height();
+    std::vector<int> line_starts;
+    std::vector<Run> runs;
+    line_starts.reserve(h + 1);
+    runs.reserve(std::max(m_runs.size(), src.m_runs.size()));
+
+    for (int y = 0; y < h; ++y) {
+        line_starts.push_back(runs.size());
+        size_t const line_start = runs.size();
+
+        Run const* s = src.lineBegin(y);
+        Run const* const s_end = src.lineEnd(y);
+        Run const* d = lineBegin(y);
+        Run const* const d_end = lineEnd(y);
+
+        // Walk the segments where neither the source nor the destination
+        // changes color.
+        int x = 0;
+        while (x < w) {
+            bool const s_black = s != s_end && s->xFrom <= x;
+            bool const d_black = d != d_end && d->xFrom <= x;
+            int const s_next = s == s_end ? w : (s_black ? s->xTo : s->xFrom);
+            int const d_next = d == d_end ? w : (d_black ? d->xTo : d->xFrom);
+            int const next = std::min(s_next, d_next);
+
+            if ((truth_table >> ((unsigned(s_black) << 1) | unsigned(d_black))) & 1) {
+                if (runs.size() > line_start && runs.back().xTo == x) {
+                    runs.back().xTo = next;
+                } else {
+                    Run const run = { x, next };
+                    runs.push_back(run);
+                }
+            }
+
+            x = next;
+            if (s != s_end && s->xTo <= x) {
+                ++s;
+            }
+            if (d != d_end && d->xTo <= x) {
+                ++d;
+            }
+        }
+    }
+    line_starts.push_back(runs.size());
+
+    m_lineStarts.swap(line_starts);
+    m_runs.swap(runs);
+}
+
+void
+RleBinaryImage::paintRun(
+    std::vector<Run>& line, int x_from, int x_to, bool const black)
+{
+    if (x_from >= x_to) {
+        return;
+    }
+
+    std::vector<Run> res;
+    res.reserve(line.size() + 2);
+
+    size_t const n = line.size();
+    size_t i = 0;
+
+    // Runs entirely to the left.
+    for (; i < n && line[i].xTo < x_from; ++i) {
+        res.push_back(line[i]);
+    }
+
+    // Runs touching or overlapping [x_from, x_to).
+    for (; i < n && line[i].xFrom <= x_to; ++i) {
+        Run const& run = line[i];
+        if (black) {
+            x_from = std::min(x_from, run.xFrom);
+            x_to = std::max(x_to, run.xTo);
+            continue;
+        }
+        if (run.xFrom < x_from) {
+            Run const left = { run.xFrom, std::min(run.xTo, x_from) };
+            res.push_back(left);
+        }
+        if (run.xTo > x_to) {
+            Run const right = { std::max(run.xFrom, x_to), run.xTo };
+            res.push_back(right);
+        }
+    }
+
+    if (black) {
+        Run const run = { x_from, x_to };
+        res.push_back(run);
+    }
+
+    // Runs entirely to the right.
+    res.insert(res.end(), line.begin() + i, line.end());
+
+    line.swap(res);
+}
+
+bool operator==(RleBinaryImage const& lhs, RleBinaryImage const& rhs)
+{
+    if (lhs.isNull() || rhs.isNull()) {
+        return lhs.isNull() == rhs.isNull();
+    }
+
+    if (lhs.m_size != rhs.m_size || lhs.m_runs.size() != rhs.m_runs.size()) {
+        return false;
+    }
+
+    if (lhs.m_lineStarts != rhs.m_lineStarts) {
+        return false;
+    }
+
+    for (size_t i = 0; i < lhs.m_runs.size(); ++i) {
+        if (lhs.m_runs[i].xFrom != rhs.m_runs[i].xFrom
+                || lhs.m_runs[i].xTo != rhs.m_runs[i].xTo) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace imageproc
@@ -0,0 +1,220 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_RLEBINARYIMAGE_H_
+#define IMAGEPROC_RLEBINARYIMAGE_H_
+
+#include "BWColor.h"
+#include <QPolygonF>
+#include <QRect>
+#include <QSize>
+#include <Qt>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace imageproc
+{
+
+class BinaryImage;
+
+/**
+ * \brief A black and white image stored as runs of black pixels.
+ *
+ * Each line is a sorted list of non-overlapping, non-adjacent runs
+ * of black pixels.  For sparse or mostly uniform images, such as
+ * picture masks or speckle masks, this takes a fraction of the memory
+ * of a BinaryImage, and counting, bounding box calculation and logical
+ * operations only cost as much as there are runs.
+ */
+class RleBinaryImage
+{
+public:
+    /**
+     * \brief A run of black pixels within a line.
+     */
+    struct Run {
+        int xFrom;
+        int xTo; // Exclusive.
+    };
+
+    /**
+     * \brief Creates a null image.
+     */
+    RleBinaryImage();
+
+    /**
+     * \brief Creates a new image filled with specified color.
+     */
+    RleBinaryImage(QSize size, BWColor color);
+
+    /**
+     * \brief Creates a run-length encoded copy of a BinaryImage.
+     *
+     * Words that are entirely white or entirely black are skipped
+     * without looking at individual bits.
+     */
+    explicit RleBinaryImage(BinaryImage const& image);
+
+    bool isNull() const
+    {
+        return m_size.isEmpty();
+    }
+
+    int width() const
+    {
+        return m_size.width();
+    }
+
+    int height() const
+    {
+        return m_size.height();
+    }
+
+    QSize const& size() const
+    {
+        return m_size;
+    }
+
+    QRect rect() const
+    {
+        return QRect(QPoint(0, 0), m_size);
+    }
+
+    /**
+     * \brief Returns the total number of black runs.
+     */
+    size_t numRuns() const
+    {
+        return m_runs.size();
+    }
+
+    /**
+     * \brief Returns a pointer to the first run on line \p y.
+     */
+    Run const* lineBegin(int y) const
+    {
+        return m_runs.data() + m_lineStarts[y];
+    }
+
+    /**
+     * \brief Returns a pointer past the last run on line \p y.
+     */
+    Run const* lineEnd(int y) const
+    {
+        return m_runs.data() + m_lineStarts[y + 1];
+    }
+
+    /**
+     * \brief Converts back to a BinaryImage.
+     */
+    BinaryImage toBinaryImage() const;
+
+    void swap(RleBinaryImage& other);
+
+    void invert();
+
+    void fill(BWColor color);
+
+    /**
+     * \brief Fills a portion of the image with either white or black color.
+     *
+     * If the rectangle exceeds the image area, it's automatically truncated.
+     */
+    void fill(QRect const& rect, BWColor color);
+
+    /**
+     * \brief Fills a polygon, the same way PolygonRasterizer::fill() would
+     *        on a BinaryImage.
+     */
+    void fill(QPolygonF const& poly, BWColor color, Qt::FillRule fill_rule);
+
+    int countBlackPixels() const;
+
+    int countWhitePixels() const;
+
+    /**
+     * \brief Calculates the bounding box of either black or white content.
+     */
+    QRect contentBoundingBox(BWColor content_color = BLACK) const;
+
+    /**
+     * \brief Applies a logical operation to every pair of pixels
+     *        of this image and \p src.
+     *
+     * Bit \c (s << 1 | d) of \p truth_table is the resulting color
+     * (1 for black) of a pixel whose source color is \c s and
+     * destination color is \c d.  Use rasterOp() instead of calling
+     * this directly.
+     */
+    void applyTruthTable(RleBinaryImage const& src, unsigned truth_table);
+private:
+    friend bool operator==(RleBinaryImage const& lhs, RleBinaryImage const& rhs);
+
+    /**
+     * Sets pixels [x_from, x_to) of a line given as a sorted list of runs.
+     */
+    static void paintRun(std::vector<Run>& line, int x_from, int x_to, bool black);
+
+    QSize m_size;
+    std::vector<int> m_lineStarts; // Indexes into m_runs, height + 1 of them.
+    std::vector<Run> m_runs;
+};
+
+inline void swap(RleBinaryImage& o1, RleBinaryImage& o2)
+{
+    o1.swap(o2);
+}
+
+/**
+ * \brief Compares image data.
+ */
+bool operator==(RleBinaryImage const& lhs, RleBinaryImage const& rhs);
+
+/**
+ * \brief Compares image data.
+ */
+inline bool operator!=(RleBinaryImage const& lhs, RleBinaryImage const& rhs)
+{
+    return !(lhs == rhs);
+}
+
+/**
+ * \brief Perform pixel-wise logical operations on whole run-length
+ *        encoded images.
+ *
+ * Works with the same Rop* operations as the BinaryImage version of
+ * rasterOp(), without ever expanding the runs into pixels.
+ * \p src must have the same dimensions as \p dst.
+ */
+template<typename Rop>
+void rasterOp(RleBinaryImage& dst, RleBinaryImage const& src)
+{
+    unsigned truth_table = 0;
+    for (unsigned s = 0; s < 2; ++s) {
+        for (unsigned d = 0; d < 2; ++d) {
+            uint32_t const res = Rop::transform(s ? ~uint32_t(0) : 0, d ? ~uint32_t(0) : 0);
+            truth_table |= (res & 1) << (s << 1 | d);
+        }
+    }
+    dst.applyTruthTable(src, truth_table);
+}
+
+} // namespace imageproc
+
+#endif
@@ -46,7 +46,7 @@ SEDM::SEDM()
 
 SEDM::SEDM(
     BinaryImage const& image, DistType const dist_type,
-    Borders const borders)
+    Borders const borders, Engine const engine)
     :   m_pData(0),
         m_size(image.size()),
         m_stride(0)
@@ -107,11 +107,16 @@ SEDM::SEDM(
         img_line += img_stride;
     }
 
-    processColumns();
-    processRows();
+    if (engine == ENGINE_FELZENSZWALB) {
+        processColumnBlocks(nullptr);
+        processRowsInParallel(nullptr);
+    } else {
+        processColumns();
+        processRows();
+    }
 }
 
-SEDM::SEDM(ConnectivityMap& cmap)
+SEDM::SEDM(ConnectivityMap& cmap, Engine const engine)
     :   m_pData(0),
         m_size(cmap.size()),
         m_stride(0)
@@ -139,8 +144,13 @@ SEDM::SEDM(ConnectivityMap& cmap)
         p_label += 2;
     }
 
-    processColumns(cmap);
-    processRows(cmap);
+    if (engine == ENGINE_FELZENSZWALB) {
+        processColumnBlocks(cmap.paddedData());
+        processRowsInParallel(cmap.paddedData());
+    } else {
+        processColumns(cmap);
+        processRows(cmap);
+    }
 }
 
 SEDM::SEDM(SEDM const& other)
@@ -412,6 +422,152 @@ SEDM::processRows(ConnectivityMap& cmap)
     }
 }
 
+void
+SEDM::processColumnBlocks(uint32_t* const labels)
+{
+    int const width = m_size.width() + 2;
+    int const height = m_size.height() + 2;
+
+    // Instead of walking down one column at a time, we walk down a block
+    // of adjacent columns, touching a few cache lines per row.
+    int const block_width = 64;
+    int const num_blocks = (width + block_width - 1) / block_width;
+    uint32_t* const data = &m_data[0];
+
+    #pragma omp parallel for schedule(static)
+    for (int block = 0; block < num_blocks; ++block) {
+        int const x0 = block * block_width;
+        int const bw = std::min(block_width, width - x0);
+
+        // (d + 1)^2 = d^2 + 2d + 1
+        uint32_t b[block_width]; // 2d + 1 in the above formula.
+
+        std::fill(b, b + bw, 1);
+        uint32_t* line = data + x0;
+        uint32_t* label_line = labels ? labels + x0 : nullptr;
+        for (int y = 1; y < height; ++y) {
+            uint32_t const* prev = line;
+            line += width;
+            for (int i = 0; i < bw; ++i) {
+                uint32_t const sqd = prev[i] + b[i];
+                if (sqd < line[i]) {
+                    line[i] = sqd;
+                    b[i] += 2;
+                } else {
+                    b[i] = 1;
+                }
+            }
+            if (label_line) {
+                uint32_t const* prev_label = label_line;
+                label_line += width;
+                for (int i = 0; i < bw; ++i) {
+                    if (b[i] != 1) {
+                        label_line[i] = prev_label[i];
+                    }
+                }
+            }
+        }
+
+        std::fill(b, b + bw, 1);
+        for (int y = height - 2; y >= 0; --y) {
+            uint32_t const* next = line;
+            line -= width;
+            for (int i = 0; i < bw; ++i) {
+                uint32_t const sqd = next[i] + b[i];
+                if (sqd < line[i]) {
+                    line[i] = sqd;
+                    b[i] += 2;
+                } else {
+                    b[i] = 1;
+                }
+            }
+            if (label_line) {
+                uint32_t const* next_label = label_line;
+                label_line -= width;
+                for (int i = 0; i < bw; ++i) {
+                    if (b[i] != 1) {
+                        label_line[i] = next_label[i];
+                    }
+                }
+            }
+        }
+    }
+}
+
+void
+SEDM::processRowsInParallel(uint32_t* const labels)
+{
+    int const width = m_size.width() + 2;
+    int const height = m_size.height() + 2;
+    uint32_t* const data = &m_data[0];
+
+    #pragma omp parallel
+    {
+        // Per thread buffers.
+        std::vector<int> v(width); // Parabola apexes of the lower envelope.
+        std::vector<double> z(width + 1); // Boundaries between parabolas.
+        std::vector<uint32_t> row_copy(width);
+        std::vector<uint32_t> label_copy(labels ? width : 0);
+
+        #pragma omp for schedule(static)
+        for (int y = 0; y < height; ++y) {
+            uint32_t* const line = data + y * width;
+            uint32_t* const label_line = labels ? labels + y * width : nullptr;
+
+            // Cells at INF_DIST aren't parabolas, so we just skip them.
+            int k = -1;
+            for (int q = 0; q < width; ++q) {
+                uint32_t const fq = line[q];
+                if (fq == INF_DIST) {
+                    continue;
+                }
+
+                double const hq = double(fq) + double(q) * q;
+                double s = 0.0;
+                while (k >= 0) {
+                    int const p = v[k];
+                    double const hp = double(line[p]) + double(p) * p;
+                    s = (hq - hp) / (2.0 * (q - p));
+                    if (s > z[k]) {
+                        break;
+                    }
+                    --k;
+                }
+
+                ++k;
+                v[k] = q;
+                z[k] = k == 0 ? -1.0 : s;
+            }
+
+            if (k < 0) {
+                // No finite distances in this row.
+                continue;
+            }
+
+            int const num_parabolas = k + 1;
+            z[num_parabolas] = width;
+
+            memcpy(&row_copy[0], line, width * sizeof(*line));
+            if (label_line) {
+                memcpy(&label_copy[0], label_line, width * sizeof(*label_line));
+            }
+
+            k = 0;
+            for (int x = 0; x < width; ++x) {
+                while (z[k + 1] < x) {
+                    ++k;
+                }
+                int const p = v[k];
+                int const dx = x - p;
+                line[x] = row_copy[p] + uint32_t(dx * dx);
+                if (label_line) {
+                    label_line[x] = label_copy[p];
+                }
+            }
+        }
+    }
+}
+
 /*====================== Peak finding stuff goes below ====================*/
 
 BinaryImage
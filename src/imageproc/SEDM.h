@@ -20,6 +20,7 @@
 #define IMAGEPROC_SEDM_H_
 
 #include "foundation/FlagOps.h"
+#include "PixelBufferPool.h"
 #include <vector>
 #include <QSize>
 #include <stdint.h>
@@ -41,6 +42,13 @@ class ConnectivityMap;
  * A general algorithm for computing distance transforms in linear time.
  * In Proceedings of the 5th International Conference on Mathematical
  * Morphology and its Applications to Image and Signal Processing.
+ *
+ * An alternative engine processes blocks of columns and individual rows
+ * in parallel, using the lower envelope of parabolas described in:\n
+ * Felzenszwalb, P., and Huttenlocher, D. 2012.
+ * Distance Transforms of Sampled Functions.
+ * Theory of Computing, 8(19), 415-428.
+ * Both engines produce identical distance maps.
  */
 class SEDM
 {
@@ -76,6 +84,23 @@ public:
         DIST_TO_ALL_BORDERS = DIST_TO_HOR_BORDERS | DIST_TO_VERT_BORDERS
     };
 
+    /**
+     * \brief The algorithm used to build the distance map.
+     */
+    enum Engine {
+        /**
+         * The original single-threaded implementation.
+         */
+        ENGINE_MEIJSTER,
+
+        /**
+         * Separable parallel implementation.  The column pass works
+         * on blocks of adjacent columns at once, so that memory is
+         * accessed row by row rather than with a stride.
+         */
+        ENGINE_FELZENSZWALB
+    };
+
     /**
      * \brief The infinite distance.
      *
@@ -106,10 +131,12 @@ public:
      * \param borders Determines whether to compute
      *        distance to particular borders.  The borders
      *        are assumed to lie one pixel off the image area.
+     * \param engine The algorithm to use.
      */
     explicit SEDM(
         BinaryImage const& image, DistType dist_type = DIST_TO_WHITE,
-        Borders borders = DIST_TO_ALL_BORDERS);
+        Borders borders = DIST_TO_ALL_BORDERS,
+        Engine engine = ENGINE_FELZENSZWALB);
 
     /**
      * \brief Build a distance map from a connectivity map.
@@ -122,7 +149,7 @@ public:
      *       with the nearest non-zero label.  This applies to
      *       the padding areas of the connectivity map as well.
      */
-    explicit SEDM(ConnectivityMap& cmap);
+    explicit SEDM(ConnectivityMap& cmap, Engine engine = ENGINE_FELZENSZWALB);
 
     SEDM(SEDM const& other);
 
@@ -194,6 +221,18 @@ private:
 
     void processRows(ConnectivityMap& cmap);
 
+    /**
+     * Column pass of the parallel engine.  If \p labels is not null,
+     * it's a padded label grid with the same layout as m_data, and its
+     * labels are propagated along with distances.
+     */
+    void processColumnBlocks(uint32_t* labels);
+
+    /**
+     * Row pass of the parallel engine.  \p labels is as above.
+     */
+    void processRowsInParallel(uint32_t* labels);
+
     BinaryImage findPeakCandidatesNonPadded() const;
 
     BinaryImage buildEqualMapNonPadded(uint32_t const* src1, uint32_t const* src2) const;
@@ -206,7 +245,7 @@ private:
 
     void incrementMaskedPadded(BinaryImage const& mask);
 
-    std::vector<uint32_t> m_data;
+    std::vector<uint32_t, PixelBufferAllocator<uint32_t> > m_data;
     uint32_t* m_pData;
     QSize m_size;
     int m_stride;
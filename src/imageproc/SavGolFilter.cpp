@@ -24,6 +24,10 @@
 #include <QSize>
 #include <QPoint>
 #include <QtGlobal>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <string.h>
 #include <stdexcept>
 #include <new>
 #include <stdint.h>
@@ -73,6 +77,31 @@ Kernel::convolve(uint8_t* dst, uint8_t const* src_top_left, int src_bpl) const
     *dst = static_cast<uint8_t>(qBound(0, val, 255));
 }
 
+/**
+ * Applies a 1D kernel of \p num_taps taps to \p count outputs.
+ * The taps of output i are at src[i + j * tap_stride].
+ *
+ * The loop over the taps is the outer one, which lets the inner one
+ * vectorize.  Every output still sums its taps in order, so the result
+ * is the same as with the taps in the inner loop.
+ */
+template<typename T>
+void convolveLine(
+    float* dst, T const* src, int const tap_stride,
+    SavGolKernel const& kernel, int const num_taps, int const count)
+{
+    for (int i = 0; i < count; ++i) {
+        dst[i] = 0.0f;
+    }
+
+    for (int j = 0; j < num_taps; ++j, src += tap_stride) {
+        float const k = kernel[j];
+        for (int i = 0; i < count; ++i) {
+            dst[i] += src[i] * k;
+        }
+    }
+}
+
 QImage savGolFilterGrayToGray(
     QImage const& src, QSize const& window_size,
     int const hor_degree, int const vert_degree)
@@ -130,10 +159,13 @@ QImage savGolFilterGrayToGray(
     uint8_t* const dst_data = dst.bits();
     int const dst_bpl = dst.bytesPerLine();
 
+    // The areas along the edges share a kernel that gets recalculated
+    // for every origin, so unlike the central area, they are processed
+    // by a single thread.  They are narrow anyway.
+
     // Top-left corner.
     uint8_t const* src_line = src_data;
     Kernel kernel(window_size, QPoint(0, 0), hor_degree, vert_degree);
-    #pragma omp parallel for schedule(static)
     for (int y = 0; y < k_top; ++y) {
         uint8_t* dst_line = dst_data + y * dst_bpl;
         k_origin.setY(y);
@@ -147,7 +179,6 @@ QImage savGolFilterGrayToGray(
     // Top area between two corners.
     k_origin.setX(k_center.x());
     src_line = src_data - k_left;
-    #pragma omp parallel for schedule(static)
     for (int y = 0; y < k_top; ++y) {
         uint8_t* dst_line = dst_data + y * dst_bpl;
         k_origin.setY(y);
@@ -160,7 +191,6 @@ QImage savGolFilterGrayToGray(
     // Top-right corner.
     k_origin.setY(0);
     src_line = src_data + width - kw;
-    #pragma omp parallel for schedule(static)
     for (int y = 0; y < k_top; ++y) {
         uint8_t* dst_line = dst_data + y * dst_bpl;
         k_origin.setY(y);
@@ -196,54 +226,69 @@ QImage savGolFilterGrayToGray(
         QPoint(0, k_center.y()), 0, vert_degree
     );
 
-    int const shift = kw - 1;
-
-    // Allocate a 16-byte aligned temporary storage.
+    // The central area is processed in horizontal bands, so that the
+    // temporary storage only has to cover a band rather than the whole
+    // image, which would take 4 times the memory of the image itself.
+    // Each band needs kh - 1 extra lines from the horizontal pass.
+    // Bands are handed out to threads one by one, and every thread
+    // has temporary storage of its own.
+    int const band_height = 256;
+    int const temp_height = band_height + kh - 1;
+    int const central_width = width - kw + 1;
+    int const central_height = height - kh + 1;
+    int const num_bands = (central_height + band_height - 1) / band_height;
+
+    // Keep the lines 16-byte aligned.
     // That may help the compiler to emit efficient SSE code.
-    int const temp_stride = (width - shift + 3) & ~3;
-    AlignedArray<float, 4> temp_array(temp_stride * height);
-
-    // Horizontal pass.
-    src_line = src_data - shift;
-    float* temp_line = temp_array.data() - shift;
-    #pragma omp parallel for schedule(static) shared(temp_array, temp_line, src_line)
-    for (int y = 0; y < height; ++y) {
-        float* tmp_ = temp_line + y * temp_stride;
-        uint8_t const* src_ = src_line + y * src_bpl;
-        for (int i = shift; i < width; ++i) {
-            float sum = 0.0f;
-
-            uint8_t const* src = src_ + i;
-            for (int j = 0; j < kw; ++j) {
-                sum += src[j] * hor_kernel[j];
+    int const temp_stride = (central_width + 3) & ~3;
+
+    std::atomic<int> next_band(0);
+    #pragma omp parallel
+    {
+        try {
+            AlignedArray<float, 4> temp_array(temp_stride * temp_height);
+            AlignedArray<float, 4> sum_line(temp_stride);
+
+            for (int band; (band = next_band++) < num_bands;) {
+                int const band_top = k_top + band * band_height;
+                int const band_bottom = std::min(band_top + band_height, height - k_bottom);
+                int const num_temp_lines = band_bottom - band_top + kh - 1;
+
+                // Horizontal pass.
+                uint8_t const* src_line = src_data + (band_top - k_top) * src_bpl;
+                for (int y = 0; y < num_temp_lines; ++y, src_line += src_bpl) {
+                    convolveLine(
+                        temp_array.data() + y * temp_stride, src_line, 1,
+                        hor_kernel, kw, central_width
+                    );
+                }
+
+                // Vertical pass.
+                float const* temp_line = temp_array.data();
+                uint8_t* dst_line = dst_data + band_top * dst_bpl + k_left;
+                for (int y = band_top; y < band_bottom; ++y) {
+                    float* const sum = sum_line.data();
+                    convolveLine(sum, temp_line, temp_stride, vert_kernel, kh, central_width);
+                    for (int i = 0; i < central_width; ++i) {
+                        int const val = static_cast<int>(sum[i]);
+                        dst_line[i] = static_cast<uint8_t>(qBound(0, val, 255));
+                    }
+                    temp_line += temp_stride;
+                    dst_line += dst_bpl;
+                }
             }
-            tmp_[i] = sum;
+        } catch (std::bad_alloc const&) {
+            // The other threads will take the remaining bands.
         }
     }
 
-    // Vertical pass.
-    uint8_t* dst_line_base = dst_data + k_top * dst_bpl + k_left - shift;
-    temp_line = temp_array.data() - shift;
-    #pragma omp parallel for schedule(static) shared(temp_array, temp_line, dst_line_base)
-    for (int y = k_top; y < height - k_bottom; ++y) {
-        float* tmp_ = temp_line + (y - k_top) * temp_stride;
-        uint8_t* dst_ = dst_line_base + (y - k_top) * dst_bpl;
-        for (int i = shift; i < width; ++i) {
-            float sum = 0.0f;
-
-            float* tmp = tmp_ + i;
-            for (int j = 0; j < kh; ++j, tmp += temp_stride) {
-                sum += *tmp * vert_kernel[j];
-            }
-            int const val = static_cast<int>(sum);
-            dst_[i] = static_cast<uint8_t>(qBound(0, val, 255));
-        }
+    if (next_band < num_bands) {
+        throw std::bad_alloc();
     }
 #endif
 
     // Left area between two corners.
     k_origin.setY(k_center.y() + 1);
-    #pragma omp parallel for schedule(static)
     for (int x = 0; x < k_left; ++x) {
         k_origin.setX(x);
         uint8_t const* src_line = src_data;
@@ -259,7 +304,6 @@ QImage savGolFilterGrayToGray(
 
     // Right area between two corners.
     k_origin.setY(k_center.y());
-    #pragma omp parallel for schedule(static)
     for (int x = width - k_right; x < width; ++x) {
         k_origin.setX(k_center.x() + x - (width - k_right - 1));
         uint8_t const* src_line = src_data + width - kw;
@@ -276,7 +320,6 @@ QImage savGolFilterGrayToGray(
     // Bottom-left corner.
 //  k_origin.setY(k_center.y() + 1);
     src_line = src_data + src_bpl * (height - kh);
-    #pragma omp parallel for schedule(static)
     for (int y = height - k_bottom; y < height; ++y) {
         k_origin.setY(k_center.y() + y - (height - k_bottom - 1));
         uint8_t* dst_line = dst_data + dst_bpl * (height - k_bottom) + (y - height + k_bottom) * dst_bpl;
@@ -290,7 +333,6 @@ QImage savGolFilterGrayToGray(
     // Bottom area between two corners.
     k_origin.setX(k_center.x());
     src_line = src_data + src_bpl * (height - kh) - k_left;
-    #pragma omp parallel for schedule(static)
     for (int y = height - k_bottom; y < height; ++y) {
         k_origin.setY(k_center.y() + y - (height - k_bottom - 1));
         uint8_t* dst_line = dst_data + dst_bpl * (height - k_bottom) + (y - height + k_bottom) * dst_bpl;
@@ -302,7 +344,6 @@ QImage savGolFilterGrayToGray(
 
     // Bottom-right corner.
     src_line = src_data + src_bpl * (height - kh) + (width - kw);
-    #pragma omp parallel for schedule(static)
     for (int y = height - k_bottom; y < height; ++y) {
         k_origin.setY(k_center.y() + y - (height - k_bottom - 1));
         uint8_t* dst_line = dst_data + dst_bpl * (height - k_bottom) + (y - height + k_bottom) * dst_bpl;
@@ -316,11 +357,7 @@ QImage savGolFilterGrayToGray(
     return dst;
 }
 
-} // anonymous namespace
-
-QImage savGolFilter(
-    QImage const& src, QSize const& window_size,
-    int const hor_degree, int const vert_degree)
+void checkParams(QSize const& window_size, int const hor_degree, int const vert_degree)
 {
     if (hor_degree < 0 || vert_degree < 0) {
         throw std::invalid_argument("savGolFilter: invalid polynomial degree");
@@ -334,10 +371,102 @@ QImage savGolFilter(
         throw std::invalid_argument(
             "savGolFilter: order is too big for that window");
     }
+}
+
+} // anonymous namespace
+
+QImage savGolFilter(
+    QImage const& src, QSize const& window_size,
+    int const hor_degree, int const vert_degree)
+{
+    checkParams(window_size, hor_degree, vert_degree);
 
     return savGolFilterGrayToGray(
                toGrayscale(src), window_size, hor_degree, vert_degree
            );
 }
 
+void savGolFilterInPlace(
+    QImage& image, QSize const& window_size,
+    int const hor_degree, int const vert_degree)
+{
+    checkParams(window_size, hor_degree, vert_degree);
+
+    image = toGrayscale(image);
+
+    int const width = image.width();
+    int const height = image.height();
+    int const kw = window_size.width();
+    int const kh = window_size.height();
+
+    if (kw > width || kh > height) {
+        return; // That's what savGolFilter() does as well.
+    }
+
+    // The lines the kernel reaches above and below its center.
+    int const k_top = kh / 2;
+    int const k_bottom = kh - k_top - 1;
+
+    // A line at least k_top lines away from the top of a band and
+    // k_bottom lines away from its bottom is computed exactly as
+    // it would be in the whole image.
+    int const band_height = std::max(512, kh);
+
+    uint8_t* const data = image.bits();
+    int const bpl = image.bytesPerLine();
+    int const line_bytes = width;
+
+    // Original contents of the lines above the current band,
+    // which the previous band has already overwritten.
+    std::vector<uint8_t> context(k_top * line_bytes);
+
+    QImage band;
+    for (int top = 0; top < height;) {
+        int bottom = std::min(top + band_height, height);
+        if (height - bottom < kh) {
+            // Don't leave a band too short for the kernel.
+            bottom = height;
+        }
+
+        int const band_top = std::max(0, top - k_top);
+        int const band_bottom = std::min(height, bottom + k_bottom);
+
+        if (band.height() != band_bottom - band_top) {
+            band = QImage(width, band_bottom - band_top, QImage::Format_Indexed8);
+            band.setColorTable(image.colorTable());
+            if (band.isNull()) {
+                throw std::bad_alloc();
+            }
+        }
+
+        int const band_bpl = band.bytesPerLine();
+        uint8_t* const band_data = band.bits();
+        for (int y = band_top; y < top; ++y) {
+            memcpy(band_data + (y - band_top) * band_bpl,
+                   &context[(y - top + k_top) * line_bytes], line_bytes);
+        }
+        for (int y = top; y < band_bottom; ++y) {
+            memcpy(band_data + (y - band_top) * band_bpl, data + y * bpl, line_bytes);
+        }
+
+        QImage const filtered(
+            savGolFilterGrayToGray(band, window_size, hor_degree, vert_degree)
+        );
+
+        // Save what the next band needs before overwriting it.
+        int const context_top = std::max(0, bottom - k_top);
+        for (int y = context_top; y < bottom; ++y) {
+            memcpy(&context[(y - bottom + k_top) * line_bytes], data + y * bpl, line_bytes);
+        }
+
+        uint8_t const* const filtered_data = filtered.bits();
+        int const filtered_bpl = filtered.bytesPerLine();
+        for (int y = top; y < bottom; ++y) {
+            memcpy(data + y * bpl, filtered_data + (y - band_top) * filtered_bpl, line_bytes);
+        }
+
+        top = bottom;
+    }
+}
+
 } // namespace imageproc
@@ -52,6 +52,21 @@ QImage savGolFilter(
     QImage const& src, QSize const& window_size,
     int hor_degree, int vert_degree);
 
+/**
+ * \brief The same as savGolFilter(), but replaces the image contents.
+ *
+ * The image is processed in horizontal bands, each one extended by the
+ * lines the kernel reaches beyond it, so besides the image itself only
+ * a band's worth of memory is needed.  The result is identical to that
+ * of savGolFilter().
+ *
+ * \param image The image to filter.  Unless it's already grayscale,
+ *        it's converted to grayscale first.
+ */
+void savGolFilterInPlace(
+    QImage& image, QSize const& window_size,
+    int hor_degree, int vert_degree);
+
 } // namespace imageproc
 
 #endif
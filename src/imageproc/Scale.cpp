@@ -18,31 +18,68 @@
 
 #include "Scale.h"
 #include "GrayImage.h"
+#include "GrayImageView.h"
 #include <QImage>
 #include <QSize>
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace imageproc
 {
 
+/**
+ * Averages 2x2 blocks of two source lines into \p dw destination pixels.
+ */
+static void scaleDown2x2Line(
+    uint8_t const* src_line1, uint8_t const* src_line2, uint8_t* dst_line, int const dw)
+{
+    int dx = 0;
+
+#ifdef __SSE2__
+    // Every 16-bit lane holds a horizontal pair of source pixels.
+    __m128i const low_bytes = _mm_set1_epi16(0x00ff);
+    __m128i const half_area = _mm_set1_epi16(2);
+    for (; dx + 8 <= dw; dx += 8) {
+        __m128i const pair1 = _mm_loadu_si128((__m128i const*)(src_line1 + dx * 2));
+        __m128i const pair2 = _mm_loadu_si128((__m128i const*)(src_line2 + dx * 2));
+        __m128i sum = _mm_add_epi16(_mm_and_si128(pair1, low_bytes), _mm_srli_epi16(pair1, 8));
+        sum = _mm_add_epi16(sum, _mm_and_si128(pair2, low_bytes));
+        sum = _mm_add_epi16(sum, _mm_srli_epi16(pair2, 8));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, half_area), 2);
+        _mm_storel_epi64((__m128i*)(dst_line + dx), _mm_packus_epi16(sum, sum));
+    }
+#endif
+
+    for (; dx < dw; ++dx) {
+        unsigned const gray_level = src_line1[dx * 2] + src_line1[dx * 2 + 1]
+                                    + src_line2[dx * 2] + src_line2[dx * 2 + 1];
+        dst_line[dx] = static_cast<uint8_t>((gray_level + 2) >> 2);
+    }
+}
+
 /**
  * This is an optimized implementation for the case when every destination
  * pixel maps exactly to a M x N block of source pixels.
+ *
+ * Source lines are summed column-wise first, which goes through memory
+ * sequentially and vectorizes, and then the column sums are summed
+ * in groups of M.  2x2 blocks have a kernel of their own.
  */
-static GrayImage scaleDownIntGrayToGray(GrayImage const& src, QSize const& dst_size)
+static GrayImage scaleDownIntGrayToGray(
+    GrayImageView const& src, int const xscale, int const yscale)
 {
-    int const sw = src.width();
-    int const sh = src.height();
-    int const dw = dst_size.width();
-    int const dh = dst_size.height();
-
-    int const xscale = sw / dw;
-    int const yscale = sh / dh;
+    int const dw = src.width() / xscale;
+    int const dh = src.height() / yscale;
     int const total_area = xscale * yscale;
 
-    GrayImage dst(dst_size);
+    GrayImage dst(QSize(dw, dh));
 
     uint8_t const* src_line = src.data();
     uint8_t* dst_line = dst.data();
@@ -50,21 +87,33 @@ static GrayImage scaleDownIntGrayToGray(GrayImage const& src, QSize const& dst_s
     int const src_stride_scaled = src_stride * yscale;
     int const dst_stride = dst.stride();
 
-    int sy = 0;
-    int dy = 0;
-    for (; dy < dh; ++dy, sy += yscale) {
+    if (xscale == 2 && yscale == 2) {
+        for (int dy = 0; dy < dh; ++dy) {
+            scaleDown2x2Line(src_line, src_line + src_stride, dst_line, dw);
+            src_line += src_stride_scaled;
+            dst_line += dst_stride;
+        }
+        return dst;
+    }
 
-        int sx = 0;
-        int dx = 0;
-        for (; dx < dw; ++dx, sx += xscale) {
+    int const sw = dw * xscale;
+    std::vector<unsigned> column_sums(sw);
 
-            unsigned gray_level = 0;
-            uint8_t const* psrc = src_line + sx;
+    for (int dy = 0; dy < dh; ++dy) {
+        std::fill(column_sums.begin(), column_sums.end(), 0);
 
-            for (int i = 0; i < yscale; ++i, psrc += src_stride) {
-                for (int j = 0; j < xscale; ++j) {
-                    gray_level += psrc[j];
-                }
+        uint8_t const* psrc = src_line;
+        for (int i = 0; i < yscale; ++i, psrc += src_stride) {
+            for (int sx = 0; sx < sw; ++sx) {
+                column_sums[sx] += psrc[sx];
+            }
+        }
+
+        unsigned const* psum = &column_sums[0];
+        for (int dx = 0; dx < dw; ++dx, psum += xscale) {
+            unsigned gray_level = 0;
+            for (int j = 0; j < xscale; ++j) {
+                gray_level += psum[j];
             }
 
             unsigned const pix_value = (gray_level + (total_area >> 1)) / total_area;
@@ -82,43 +131,41 @@ static GrayImage scaleDownIntGrayToGray(GrayImage const& src, QSize const& dst_s
 /**
  * This is an optimized implementation for the case when every destination
  * pixel maps to a single source pixel (possibly to a part of it).
+ *
+ * Only the first of every \p yscale destination lines is built pixel
+ * by pixel.  The rest are copies of it.
  */
-static GrayImage scaleUpIntGrayToGray(GrayImage const& src, QSize const& dst_size)
+static GrayImage scaleUpIntGrayToGray(
+    GrayImageView const& src, int const xscale, int const yscale)
 {
     int const sw = src.width();
     int const sh = src.height();
-    int const dw = dst_size.width();
-    int const dh = dst_size.height();
+    int const dw = sw * xscale;
 
-    int const xscale = dw / sw;
-    int const yscale = dh / sh;
-
-    GrayImage dst(dst_size);
+    GrayImage dst(QSize(dw, sh * yscale));
 
     uint8_t const* src_line = src.data();
     uint8_t* dst_line = dst.data();
     int const src_stride = src.stride();
     int const dst_stride = dst.stride();
-    int const dst_stride_scaled = dst_stride * yscale;
-
-    int sy = 0;
-    int dy = 0;
-    for (; dy < dh; ++sy, dy += xscale) {
-        int sx = 0;
-        int dx = 0;
 
-        for (; dx < dw; ++sx, dx += xscale) {
-            uint8_t* pdst = dst_line + dx;
-
-            for (int i = 0; i < yscale; ++i, pdst += dst_stride) {
-                for (int j = 0; j < xscale; ++j) {
-                    pdst[j] = src_line[sx];
-                }
+    for (int sy = 0; sy < sh; ++sy, src_line += src_stride) {
+        uint8_t* pdst = dst_line;
+        if (xscale == 2) {
+            for (int sx = 0; sx < sw; ++sx, pdst += 2) {
+                pdst[0] = pdst[1] = src_line[sx];
+            }
+        } else {
+            for (int sx = 0; sx < sw; ++sx, pdst += xscale) {
+                memset(pdst, src_line[sx], xscale);
             }
         }
 
-        src_line += src_stride;
-        dst_line += dst_stride_scaled;
+        uint8_t const* const first_line = dst_line;
+        dst_line += dst_stride;
+        for (int i = 1; i < yscale; ++i, dst_line += dst_stride) {
+            memcpy(dst_line, first_line, dw);
+        }
     }
 
     return dst;
@@ -151,7 +198,7 @@ static double calc32xRatio1(int const dst, int const src)
  * the destination image is larger than the source image both
  * horizontally and vertically.
  */
-static GrayImage scaleUpGrayToGray(GrayImage const& src, QSize const& dst_size)
+static GrayImage scaleUpGrayToGray(GrayImageView const& src, QSize const& dst_size)
 {
     int const sw = src.width();
     int const sh = src.height();
@@ -230,7 +277,7 @@ static double calc32xRatio2(int const dst, int const src)
 /**
  * This is a generic implementation of the scaling algorithm.
  */
-static GrayImage scaleGrayToGray(GrayImage const& src, QSize const& dst_size)
+static GrayImage scaleGrayToGray(GrayImageView const& src, QSize const& dst_size)
 {
     int const sw = src.width();
     int const sh = src.height();
@@ -239,11 +286,11 @@ static GrayImage scaleGrayToGray(GrayImage const& src, QSize const& dst_size)
 
     // Try versions optimized for a particular case.
     if (sw == dw && sh == dh) {
-        return src;
+        return src.toGrayImage();
     } else if (sw % dw == 0 && sh % dh == 0) {
-        return scaleDownIntGrayToGray(src, dst_size);
+        return scaleDownIntGrayToGray(src, sw / dw, sh / dh);
     } else if (dw % sw == 0 && dh % sh == 0) {
-        return scaleUpIntGrayToGray(src, dst_size);
+        return scaleUpIntGrayToGray(src, dw / sw, dh / sh);
     } else if (dw > sw && dh > sh) {
         return scaleUpGrayToGray(src, dst_size);
     }
@@ -381,9 +428,18 @@ static GrayImage scaleGrayToGray(GrayImage const& src, QSize const& dst_size)
 }
 
 GrayImage scaleToGray(GrayImage const& src, QSize const& dst_size)
+{
+    if (src.size() == dst_size) {
+        return src; // Shallow copy.
+    }
+
+    return scaleToGray(GrayImageView(src), dst_size);
+}
+
+GrayImage scaleToGray(GrayImageView const& src, QSize const& dst_size)
 {
     if (src.isNull()) {
-        return src;
+        return GrayImage();
     }
 
     if (!dst_size.isValid()) {
@@ -397,4 +453,55 @@ GrayImage scaleToGray(GrayImage const& src, QSize const& dst_size)
     return scaleGrayToGray(src, dst_size);
 }
 
+GrayImage scaleDownIntegerTimes(GrayImageView const& src, int xscale, int yscale)
+{
+    if (xscale <= 0 || yscale <= 0) {
+        throw std::invalid_argument("scaleDownIntegerTimes: invalid scaling factor");
+    }
+
+    if (src.width() < xscale || src.height() < yscale) {
+        return GrayImage();
+    }
+
+    if (xscale == 1 && yscale == 1) {
+        return src.toGrayImage();
+    }
+
+    return scaleDownIntGrayToGray(src, xscale, yscale);
+}
+
+GrayImage scaleUpIntegerTimes(GrayImageView const& src, int xscale, int yscale)
+{
+    if (xscale <= 0 || yscale <= 0) {
+        throw std::invalid_argument("scaleUpIntegerTimes: invalid scaling factor");
+    }
+
+    if (src.isNull()) {
+        return GrayImage();
+    }
+
+    return scaleUpIntGrayToGray(src, xscale, yscale);
+}
+
+std::vector<GrayImage> buildGrayPyramid(GrayImage const& src, int const num_levels)
+{
+    std::vector<GrayImage> levels;
+    if (src.isNull() || num_levels <= 0) {
+        return levels;
+    }
+
+    levels.reserve(num_levels);
+    levels.push_back(src); // Shallow copy.
+
+    while ((int)levels.size() < num_levels) {
+        GrayImage const& prev = levels.back();
+        if (prev.width() < 2 || prev.height() < 2) {
+            break;
+        }
+        levels.push_back(scaleDownIntGrayToGray(prev, 2, 2));
+    }
+
+    return levels;
+}
+
 } // namespace imageproc
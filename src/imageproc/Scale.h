@@ -19,12 +19,15 @@
 #ifndef IMAGEPROC_SCALE_H_
 #define IMAGEPROC_SCALE_H_
 
+#include <vector>
+
 class QSize;
 
 namespace imageproc
 {
 
 class GrayImage;
+class GrayImageView;
 
 /**
  * \brief Converts an image to grayscale and scales it to dst_size.
@@ -38,6 +41,44 @@ class GrayImage;
  */
 GrayImage scaleToGray(GrayImage const& src, QSize const& dst_size);
 
+/**
+ * \brief Same as above, but scales a region of interest in place.
+ *
+ * Passing a GrayImageView of a sub-rectangle avoids copying it first.
+ */
+GrayImage scaleToGray(GrayImageView const& src, QSize const& dst_size);
+
+/**
+ * \brief Averages \p xscale x \p yscale blocks of pixels into one.
+ *
+ * Columns and rows past the last whole block are ignored.  When the
+ * image size is a multiple of the block size, the result is the same
+ * as that of scaleToGray().
+ *
+ * \return The downscaled image, or a null image if \p src is smaller
+ *         than a single block.
+ */
+GrayImage scaleDownIntegerTimes(GrayImageView const& src, int xscale, int yscale);
+
+/**
+ * \brief Replicates every pixel into a \p xscale x \p yscale block.
+ *
+ * The result is the same as that of scaleToGray() to the multiplied size.
+ * \see upscaleIntegerTimes() for binary images.
+ */
+GrayImage scaleUpIntegerTimes(GrayImageView const& src, int xscale, int yscale);
+
+/**
+ * \brief Builds up to \p num_levels levels of an image pyramid.
+ *
+ * The first level is \p src itself, and every next one is the previous
+ * one downscaled 2x in each direction with scaleDownIntegerTimes().
+ * Building stops early when a level gets narrower or lower than 2 pixels.
+ * Note that averaging twice rounds twice, so the third level may differ
+ * by one gray level from downscaling the source 4x directly.
+ */
+std::vector<GrayImage> buildGrayPyramid(GrayImage const& src, int num_levels);
+
 } // namespace imageproc
 
 #endif
@@ -249,6 +249,25 @@ inline bool darker_than(uint8_t lhs, uint8_t rhs)
     return lhs < rhs;
 }
 
+/**
+ * Function objects rather than function pointers get inlined into
+ * seedFillGenericInPlace(), which lets its line loops be vectorized
+ * with byte-wise min / max instructions.
+ */
+struct Lightest {
+    uint8_t operator()(uint8_t lhs, uint8_t rhs) const
+    {
+        return lhs > rhs ? lhs : rhs;
+    }
+};
+
+struct Darkest {
+    uint8_t operator()(uint8_t lhs, uint8_t rhs) const
+    {
+        return lhs < rhs ? lhs : rhs;
+    }
+};
+
 void seedFillGrayHorLine(uint8_t* seed, uint8_t const* mask, int const line_len)
 {
     assert(line_len > 0);
@@ -538,8 +557,8 @@ void seedFillGrayInPlace(
         return;
     }
 
-    seedFillGenericInPlace(
-        &darkest, &lightest, connectivity,
+    seedFillGenericInPlaceParallel(
+        Darkest(), Lightest(), connectivity,
         seed.data(), seed.stride(), seed.size(),
         mask.data(), mask.stride()
     );
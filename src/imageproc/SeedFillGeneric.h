@@ -226,7 +226,7 @@ void spread8(
 
         // South-Western neighbor.
         seed = pos.seed + (seed_stride & vt.south_mask) + ht.west_delta;
-        mask = pos.mask + (seed_stride & vt.south_mask) + ht.west_delta;
+        mask = pos.mask + (mask_stride & vt.south_mask) + ht.west_delta;
         processNeighbor(
             spread_op, mask_op, queue, this_val, seed, mask,
             pos, ht.west_delta, 1 & vt.south_mask
@@ -249,16 +249,17 @@ void seedFill4(
 
     // Top to bottom.
     for (int y = 0; y < h; ++y) {
-        int x = 0;
-
-        // First item in line.
-        T prev(mask_op(mask_line[x], spread_op(seed_line[x], prev_line[x])));
-        seed_line[x] = prev;
+        // Spreading from the line above doesn't depend on the order
+        // of pixels, so we do it separately, in a loop the compiler
+        // is able to vectorize.  The result is the same, because
+        // mask_op(m, spread_op(mask_op(m, a), b)) == mask_op(m, spread_op(a, b)).
+        for (int x = 0; x < w; ++x) {
+            seed_line[x] = mask_op(mask_line[x], spread_op(seed_line[x], prev_line[x]));
+        }
 
-        // Other items, left to right.
-        while (++x < w) {
-            prev = mask_op(mask_line[x], spread_op(prev, spread_op(seed_line[x], prev_line[x])));
-            seed_line[x] = prev;
+        // Left to right.
+        for (int x = 1; x < w; ++x) {
+            seed_line[x] = mask_op(mask_line[x], spread_op(seed_line[x], seed_line[x - 1]));
         }
 
         prev_line = seed_line;
@@ -370,39 +371,44 @@ void seedFill8(
         seed_line += seed_stride;
         mask_line += mask_stride;
 
-        int x = 0;
+        // Spreading from the line above first, in a vectorizable loop.
+        // See seedFill4() for why it doesn't change the result.
 
         // Leftmost pixel.
-        seed_line[x] = mask_op(
-                           mask_line[x],
+        seed_line[0] = mask_op(
+                           mask_line[0],
                            spread_op(
-                               seed_line[x],
-                               spread_op(prev_line[x], prev_line[x + 1])
+                               seed_line[0],
+                               spread_op(prev_line[0], prev_line[1])
                            )
                        );
 
-        // Left to right.
-        while (++x < w - 1) {
+        for (int x = 1; x < w - 1; ++x) {
             seed_line[x] = mask_op(
                                mask_line[x],
                                spread_op(
+                                   seed_line[x],
                                    spread_op(
-                                       spread_op(seed_line[x], seed_line[x - 1]),
-                                       spread_op(prev_line[x], prev_line[x - 1])
-                                   ),
-                                   prev_line[x + 1]
+                                       spread_op(prev_line[x - 1], prev_line[x]),
+                                       prev_line[x + 1]
+                                   )
                                )
                            );
         }
 
         // Rightmost pixel.
-        seed_line[x] = mask_op(
-                           mask_line[x],
-                           spread_op(
-                               spread_op(seed_line[x], seed_line[x - 1]),
-                               spread_op(prev_line[x], prev_line[x - 1])
-                           )
-                       );
+        seed_line[w - 1] = mask_op(
+                               mask_line[w - 1],
+                               spread_op(
+                                   seed_line[w - 1],
+                                   spread_op(prev_line[w - 2], prev_line[w - 1])
+                               )
+                           );
+
+        // Left to right.
+        for (int x = 1; x < w; ++x) {
+            seed_line[x] = mask_op(mask_line[x], spread_op(seed_line[x], seed_line[x - 1]));
+        }
 
         prev_line = seed_line;
     }
@@ -541,6 +547,76 @@ void seedFillGenericInPlace(
     }
 }
 
+/**
+ * \brief A parallel version of seedFillGenericInPlace().
+ *
+ * The image is split into horizontal strips, which are filled
+ * independently and concurrently.  After that, within each strip, no pixel
+ * may spread to a neighbor in the same strip, so it's only the lines
+ * adjacent to strip seams that may need further propagation.  Those are put
+ * into a queue that's processed the same way as in the single-threaded
+ * version, but across the whole image.  The result is identical to that of
+ * seedFillGenericInPlace().
+ */
+template<typename T, typename SpreadOp, typename MaskOp>
+void seedFillGenericInPlaceParallel(
+    SpreadOp spread_op, MaskOp mask_op, Connectivity conn,
+    T* seed, int seed_stride, QSize size,
+    T const* mask, int mask_stride)
+{
+    using namespace detail::seed_fill_generic;
+
+    int const w = size.width();
+    int const h = size.height();
+    int const strip_height = 128;
+    int const num_strips = h / strip_height;
+    if (num_strips < 2 || w < 2) {
+        seedFillGenericInPlace(spread_op, mask_op, conn, seed, seed_stride, size, mask, mask_stride);
+        return;
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_strips; ++i) {
+        int const top = i * strip_height;
+        // The last strip takes the remainder.
+        int const bottom = i == num_strips - 1 ? h : top + strip_height;
+        seedFillGenericInPlace(
+            spread_op, mask_op, conn, seed + top * seed_stride, seed_stride,
+            QSize(w, bottom - top), mask + top * mask_stride, mask_stride
+        );
+    }
+
+    FastQueue<Position<T> > queue;
+    std::vector<HTransition> h_transitions;
+    std::vector<VTransition> v_transitions;
+    initHorTransitions(h_transitions, w);
+    initVertTransitions(v_transitions, h);
+
+    for (int i = 1; i < num_strips; ++i) {
+        int const seam = i * strip_height;
+        for (int y = seam - 1; y <= seam; ++y) {
+            T* const seed_line = seed + y * seed_stride;
+            T const* const mask_line = mask + y * mask_stride;
+            for (int x = 0; x < w; ++x) {
+                queue.push(Position<T>(seed_line + x, mask_line + x, x, y));
+            }
+        }
+    }
+
+    if (conn == CONN4) {
+        spread4(
+            spread_op, mask_op, queue, &h_transitions[0],
+            &v_transitions[0], seed_stride, mask_stride
+        );
+    } else {
+        assert(conn == CONN8);
+        spread8(
+            spread_op, mask_op, queue, &h_transitions[0],
+            &v_transitions[0], seed_stride, mask_stride
+        );
+    }
+}
+
 } // namespace imageproc
 
 #endif
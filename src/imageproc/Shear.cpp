@@ -17,18 +17,185 @@
 */
 
 #include "Shear.h"
-#include "RasterOp.h"
 #include "BinaryImage.h"
-#include <QRect>
-#include <QPoint>
 #include <stdexcept>
+#include <vector>
+#include <algorithm>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace imageproc
 {
 
+namespace
+{
+
+/**
+ * A range of columns or lines sharing the same shift.
+ */
+struct ShearBlock {
+    int begin;
+    int end;
+    int shift;
+};
+
+/**
+ * Splits [0, length) into blocks of equal shift, where
+ * shift = floor(0.5 + shear * (pos + 0.5 - origin)).
+ *
+ * The shift is accumulated the way the original rasterOp() based
+ * implementation did it, so that positions right on a rounding boundary
+ * still get the same shift.  Returns an empty list if the shift
+ * is zero everywhere.
+ */
+std::vector<ShearBlock> shearBlocks(int const length, double const shear, double const origin)
+{
+    std::vector<ShearBlock> blocks;
+
+    double shift = 0.5 + shear * (0.5 - origin);
+    double const shift_end = 0.5 + shear * (length - 0.5 - origin);
+    int shift1 = (int)floor(shift);
+
+    if (shift1 == floor(shift_end)) {
+        assert(shift1 == 0);
+        return blocks;
+    }
+
+    int pos1 = 0;
+    int pos2 = 0;
+    for (;;) {
+        ++pos2;
+        shift += shear;
+        int const shift2 = (int)floor(shift);
+        if (shift1 != shift2 || pos2 == length) {
+            ShearBlock const block = { pos1, pos2, shift1 };
+            blocks.push_back(block);
+
+            if (pos2 == length) {
+                break;
+            }
+
+            pos1 = pos2;
+            shift1 = shift2;
+        }
+    }
+
+    return blocks;
+}
+
+/**
+ * Returns word \p idx of a line, with the background in place of
+ * words outside of the line and bits past its width.
+ */
+inline uint32_t lineWord(
+    uint32_t const* line, int const wpl, uint32_t const tail_mask,
+    uint32_t const bg_word, int const idx)
+{
+    if (idx < 0 || idx >= wpl) {
+        return bg_word;
+    } else if (idx == wpl - 1) {
+        return (line[idx] & tail_mask) | (bg_word & ~tail_mask);
+    } else {
+        return line[idx];
+    }
+}
+
+/**
+ * Makes pixel x of \p dst_line equal to pixel x + \p offset of \p src_line.
+ *
+ * Whole words are combined from pairs of source words with funnel shifts,
+ * four at a time with SSE2.  Only the words near the ends of the line,
+ * which may involve the background, are handled one by one.
+ * The lines must not overlap.
+ */
+void shiftLine(
+    uint32_t* const dst_line, uint32_t const* const src_line,
+    int const wpl, uint32_t const tail_mask, uint32_t const bg_word, int const offset)
+{
+    // offset == 32 * word_offset + bit_offset, with 0 <= bit_offset < 32.
+    int const bit_offset = offset & 31;
+    int const word_offset = (offset - bit_offset) / 32;
+
+    // Within [inner_begin, inner_end) both source words are inside
+    // the line and aren't its last word.
+    int const inner_begin = std::min(wpl, std::max(0, -word_offset));
+    int const inner_end = std::max(inner_begin, std::min(wpl, wpl - 2 - word_offset));
+
+    int i = 0;
+    for (; i < inner_begin; ++i) {
+        uint32_t const w1 = lineWord(src_line, wpl, tail_mask, bg_word, i + word_offset);
+        uint32_t const w2 = lineWord(src_line, wpl, tail_mask, bg_word, i + word_offset + 1);
+        dst_line[i] = bit_offset ? (w1 << bit_offset) | (w2 >> (32 - bit_offset)) : w1;
+    }
+
+    uint32_t const* const src = src_line + word_offset;
+    if (bit_offset == 0) {
+        memcpy(dst_line + i, src + i, (inner_end - i) * 4);
+        i = inner_end;
+    } else {
+#ifdef __SSE2__
+        __m128i const left = _mm_cvtsi32_si128(bit_offset);
+        __m128i const right = _mm_cvtsi32_si128(32 - bit_offset);
+        for (; i + 4 <= inner_end; i += 4) {
+            __m128i const w1 = _mm_loadu_si128((__m128i const*)(src + i));
+            __m128i const w2 = _mm_loadu_si128((__m128i const*)(src + i + 1));
+            _mm_storeu_si128(
+                (__m128i*)(dst_line + i),
+                _mm_or_si128(_mm_sll_epi32(w1, left), _mm_srl_epi32(w2, right))
+            );
+        }
+#endif
+        for (; i < inner_end; ++i) {
+            dst_line[i] = (src[i] << bit_offset) | (src[i + 1] >> (32 - bit_offset));
+        }
+    }
+
+    for (; i < wpl; ++i) {
+        uint32_t const w1 = lineWord(src_line, wpl, tail_mask, bg_word, i + word_offset);
+        uint32_t const w2 = lineWord(src_line, wpl, tail_mask, bg_word, i + word_offset + 1);
+        dst_line[i] = bit_offset ? (w1 << bit_offset) | (w2 >> (32 - bit_offset)) : w1;
+    }
+}
+
+/**
+ * Copies pixels [x1, x2) of \p src_line to \p dst_line, or fills them
+ * with the background if \p src_line is null.
+ */
+void copyLineSpan(
+    uint32_t* const dst_line, uint32_t const* const src_line,
+    int const x1, int const x2, uint32_t const bg_word)
+{
+    int const first_word = x1 >> 5;
+    int const last_word = (x2 - 1) >> 5;
+    uint32_t const first_mask = ~uint32_t(0) >> (x1 & 31);
+    uint32_t const last_mask = ~uint32_t(0) << (31 - ((x2 - 1) & 31));
+
+    if (first_word == last_word) {
+        uint32_t const mask = first_mask & last_mask;
+        uint32_t const src_word = src_line ? src_line[first_word] : bg_word;
+        dst_line[first_word] = (dst_line[first_word] & ~mask) | (src_word & mask);
+        return;
+    }
+
+    uint32_t src_word = src_line ? src_line[first_word] : bg_word;
+    dst_line[first_word] = (dst_line[first_word] & ~first_mask) | (src_word & first_mask);
+
+    for (int i = first_word + 1; i < last_word; ++i) {
+        dst_line[i] = src_line ? src_line[i] : bg_word;
+    }
+
+    src_word = src_line ? src_line[last_word] : bg_word;
+    dst_line[last_word] = (dst_line[last_word] & ~last_mask) | (src_word & last_mask);
+}
+
+} // anonymous namespace
+
 void hShearFromTo(BinaryImage const& src, BinaryImage& dst, double const shear,
                   double const y_origin, BWColor const background_color)
 {
@@ -42,58 +209,35 @@ void hShearFromTo(BinaryImage const& src, BinaryImage& dst, double const shear,
     int const width = src.width();
     int const height = src.height();
 
-    // shift = floor(0.5 + shear * (y + 0.5 - y_origin));
-    double shift = 0.5 + shear * (0.5 - y_origin);
-    double const shift_end = 0.5 + shear * (height - 0.5 - y_origin);
-    int shift1 = (int)floor(shift);
-
-    if (shift1 == floor(shift_end)) {
-        assert(shift1 == 0);
+    std::vector<ShearBlock> const blocks(shearBlocks(height, shear, y_origin));
+    if (blocks.empty()) {
         dst = src;
         return;
     }
 
-    int shift2 = shift1;
-    int y1 = 0;
-    int y2 = 0;
-    for (;;) {
-        ++y2;
-        shift += shear;
-        shift2 = (int)floor(shift);
-        if (shift1 != shift2 || y2 == height) {
-            int const block_height = y2 - y1;
-            if (abs(shift1) >= width) {
-                // The shifted block would be completely off the image.
-                QRect const fr(0, y1, width, block_height);
-                dst.fill(fr, background_color);
-            } else if (shift1 < 0) {
-                // Shift to the left.
-                QRect const dr(0, y1, width + shift1, block_height);
-                QPoint const sp(-shift1, y1);
-                rasterOp<RopSrc>(dst, dr, src, sp);
-                QRect const fr(width + shift1, y1, -shift1, block_height);
-                dst.fill(fr, background_color);
-            } else if (shift1 > 0) {
-                // Shift to the right.
-                QRect const dr(shift1, y1, width - shift1, block_height);
-                QPoint const sp(0, y1);
-                rasterOp<RopSrc>(dst, dr, src, sp);
-                QRect const fr(0, y1, shift1, block_height);
-                dst.fill(fr, background_color);
-            } else {
-                // No shift, just copy.
-                QRect const dr(0, y1, width, block_height);
-                QPoint const sp(0, y1);
-                rasterOp<RopSrc>(dst, dr, src, sp);
-            }
+    // If dst is src, or shares data with it, this makes dst.data()
+    // detach, so that lines are never shifted in place.
+    BinaryImage const src_copy(src);
+    uint32_t* const dst_data = dst.data();
+    uint32_t const* const src_data = src_copy.data();
+    assert(dst_data != src_data);
 
-            if (y2 == height) {
-                break;
-            }
+    int const wpl = src.wordsPerLine();
+    uint32_t const tail_mask = ~uint32_t(0) << ((32 - width % 32) % 32);
+    uint32_t const bg_word = background_color == BLACK ? ~uint32_t(0) : 0;
 
-            y1 = y2;
-            shift1 = shift2;
-        }
+    std::vector<int> line_shifts(height);
+    for (ShearBlock const& block : blocks) {
+        std::fill(line_shifts.begin() + block.begin, line_shifts.begin() + block.end, block.shift);
+    }
+
+    // Lines are independent, so they are processed in parallel.
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        shiftLine(
+            dst_data + y * wpl, src_data + y * wpl,
+            wpl, tail_mask, bg_word, -line_shifts[y]
+        );
     }
 }
 
@@ -107,60 +251,33 @@ void vShearFromTo(BinaryImage const& src, BinaryImage& dst, double const shear,
         throw std::invalid_argument("Can't shear when dst.size() != src.size()");
     }
 
-    int const width = src.width();
     int const height = src.height();
 
-    // shift = floor(0.5 + shear * (x + 0.5 - x_origin));
-    double shift = 0.5 + shear * (0.5 - x_origin);
-    double const shift_end = 0.5 + shear * (width - 0.5 - x_origin);
-    int shift1 = (int)floor(shift);
-
-    if (shift1 == floor(shift_end)) {
-        assert(shift1 == 0);
+    std::vector<ShearBlock> const blocks(shearBlocks(src.width(), shear, x_origin));
+    if (blocks.empty()) {
         dst = src;
         return;
     }
 
-    int shift2 = shift1;
-    int x1 = 0;
-    int x2 = 0;
-    for (;;) {
-        ++x2;
-        shift += shear;
-        shift2 = (int)floor(shift);
-        if (shift1 != shift2 || x2 == width) {
-            int const block_width = x2 - x1;
-            if (abs(shift1) >= height) {
-                // The shifted block would be completely off the image.
-                QRect const fr(x1, 0, block_width, height);
-                dst.fill(fr, background_color);
-            } else if (shift1 < 0) {
-                // Shift upwards.
-                QRect const dr(x1, 0, block_width, height + shift1);
-                QPoint const sp(x1, -shift1);
-                rasterOp<RopSrc>(dst, dr, src, sp);
-                QRect const fr(x1, height + shift1, block_width, -shift1);
-                dst.fill(fr, background_color);
-            } else if (shift1 > 0) {
-                // Shift downwards.
-                QRect const dr(x1, shift1, block_width, height - shift1);
-                QPoint const sp(x1, 0);
-                rasterOp<RopSrc>(dst, dr, src, sp);
-                QRect const fr(x1, 0, block_width, shift1);
-                dst.fill(fr, background_color);
-            } else {
-                // No shift, just copy.
-                QRect const dr(x1, 0, block_width, height);
-                QPoint const sp(x1, 0);
-                rasterOp<RopSrc>(dst, dr, src, sp);
-            }
+    // See hShearFromTo().
+    BinaryImage const src_copy(src);
+    uint32_t* const dst_data = dst.data();
+    uint32_t const* const src_data = src_copy.data();
+    assert(dst_data != src_data);
 
-            if (x2 == width) {
-                break;
-            }
+    int const wpl = src.wordsPerLine();
+    uint32_t const bg_word = background_color == BLACK ? ~uint32_t(0) : 0;
 
-            x1 = x2;
-            shift1 = shift2;
+    // Each destination line is assembled from spans of differently
+    // offset source lines, without any shifting of bits.
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        uint32_t* const dst_line = dst_data + y * wpl;
+        for (ShearBlock const& block : blocks) {
+            int const src_y = y - block.shift;
+            uint32_t const* const src_line = (src_y >= 0 && src_y < height)
+                                             ? src_data + src_y * wpl : nullptr;
+            copyLineSpan(dst_line, src_line, block.begin, block.end, bg_word);
         }
     }
 }
@@ -20,17 +20,137 @@
 #include "BinaryImage.h"
 #include "BWColor.h"
 #include "BitOps.h"
-#include "Shear.h"
 #include "ReduceThreshold.h"
 #include "Constants.h"
 #include <QDebug>
+#include <vector>
+#include <algorithm>
 #include <stdexcept>
 #include <stdint.h>
+#include <stdlib.h>
 #include <math.h>
 
 namespace imageproc
 {
 
+/**
+ * \brief Scores vertical shears of an image without materializing them.
+ *
+ * For a given shear, columns split into blocks that move by the same
+ * number of rows.  A row of the sheared image is then a sum of per-block
+ * pixel counts taken from the source rows, and those come from per-row
+ * prefix sums of black pixel counts.  The score is the same as
+ * shearing the image and summing squared differences of adjacent rows.
+ */
+class SkewFinder::RowProjector
+{
+public:
+    explicit RowProjector(BinaryImage const& image);
+
+    int width() const
+    {
+        return m_width;
+    }
+
+    double score(double shear, double x_origin);
+private:
+    /**
+     * Number of black pixels in row \p y to the left of \p x.
+     */
+    int countLeftOf(int y, int x) const
+    {
+        uint32_t const* line = m_pData + y * m_wpl;
+        int const word_idx = x >> 5;
+        int count = m_prefixSums[y * (m_wpl + 1) + word_idx];
+        if (x & 31) {
+            count += countNonZeroBits(line[word_idx] >> (32 - (x & 31)));
+        }
+        return count;
+    }
+
+    void addBlock(int x1, int x2, int shift);
+
+    BinaryImage m_image;
+    uint32_t const* m_pData;
+    int m_width;
+    int m_height;
+    int m_wpl;
+    std::vector<int> m_prefixSums;
+    std::vector<int> m_rowSums;
+};
+
+SkewFinder::RowProjector::RowProjector(BinaryImage const& image)
+    :   m_image(image),
+        m_pData(m_image.data()),
+        m_width(image.width()),
+        m_height(image.height()),
+        m_wpl(image.wordsPerLine()),
+        m_prefixSums(size_t(m_height) * (m_wpl + 1)),
+        m_rowSums(m_height)
+{
+    int const full_words = m_width >> 5;
+    uint32_t const* line = m_pData;
+    int* prefix = &m_prefixSums[0];
+    for (int y = 0; y < m_height; ++y, line += m_wpl, prefix += m_wpl + 1) {
+        int sum = 0;
+        prefix[0] = 0;
+        for (int i = 0; i < full_words; ++i) {
+            sum += countNonZeroBits(line[i]);
+            prefix[i + 1] = sum;
+        }
+        // Entries past the last full word are only read together with
+        // a partial word count, which is masked.
+        for (int i = full_words; i < m_wpl; ++i) {
+            prefix[i + 1] = sum;
+        }
+    }
+}
+
+void
+SkewFinder::RowProjector::addBlock(int const x1, int const x2, int const shift)
+{
+    // Source rows that land inside the image after shifting by shift.
+    int const y_begin = std::max(0, -shift);
+    int const y_end = std::min(m_height, m_height - shift);
+    for (int y = y_begin; y < y_end; ++y) {
+        m_rowSums[y + shift] += countLeftOf(y, x2) - countLeftOf(y, x1);
+    }
+}
+
+double
+SkewFinder::RowProjector::score(double const shear, double const x_origin)
+{
+    std::fill(m_rowSums.begin(), m_rowSums.end(), 0);
+
+    // Same block decomposition as vShearFromTo().
+    // shift = floor(0.5 + shear * (x + 0.5 - x_origin));
+    double shift = 0.5 + shear * (0.5 - x_origin);
+    int shift1 = (int)floor(shift);
+    int x1 = 0;
+    for (int x2 = 1;; ++x2) {
+        shift += shear;
+        int const shift2 = (int)floor(shift);
+        if (shift1 != shift2 || x2 == m_width) {
+            if (abs(shift1) < m_height) {
+                addBlock(x1, x2, shift1);
+            }
+            if (x2 == m_width) {
+                break;
+            }
+            x1 = x2;
+            shift1 = shift2;
+        }
+    }
+
+    double score = 0.0;
+    for (int y = 1; y < m_height; ++y) {
+        double const diff = m_rowSums[y] - m_rowSums[y - 1];
+        score += diff * diff;
+    }
+
+    return score;
+}
+
 double const Skew::GOOD_CONFIDENCE = 2.0;
 
 double const SkewFinder::DEFAULT_MAX_ANGLE = 7.0;
@@ -45,6 +165,7 @@ double const SkewFinder::LOW_SCORE = 1000.0;
 
 SkewFinder::SkewFinder()
     :   m_maxAngle(DEFAULT_MAX_ANGLE),
+        m_searchCenter(0.0),
         m_accuracy(DEFAULT_ACCURACY),
         m_resolutionRatio(1.0),
         m_coarseReduction(DEFAULT_COARSE_REDUCTION),
@@ -61,6 +182,16 @@ SkewFinder::setMaxAngle(double const max_angle)
     m_maxAngle = max_angle;
 }
 
+void
+SkewFinder::setSearchCenter(double const center)
+{
+    if (center < -45.0 || center > 45.0) {
+        throw std::invalid_argument("SkewFinder: search center is invalid");
+    }
+    // Internally we work with shear angles, which are of the opposite sign.
+    m_searchCenter = -center;
+}
+
 void
 SkewFinder::setDesiredAccuracy(double const accuracy)
 {
@@ -101,28 +232,32 @@ SkewFinder::findSkew(BinaryImage const& image) const
         throw std::invalid_argument("SkewFinder: null image was provided");
     }
 
-    ReduceThreshold coarse_reduced(image);
-    int const min_reduction = std::min(m_coarseReduction, m_fineReduction);
-    for (int i = 0; i < min_reduction; ++i) {
-        coarse_reduced.reduce(i == 0 ? 1 : 2);
+    std::vector<int> thresholds;
+    for (int i = 0; i < m_coarseReduction; ++i) {
+        thresholds.push_back(i == 0 ? 1 : 2);
     }
 
-    ReduceThreshold fine_reduced(coarse_reduced.image());
+    // The fine level is either on the way to the coarse one or above it.
+    std::vector<BinaryImage> levels;
+    ReduceThreshold coarse_reduced(image);
+    coarse_reduced.reduceCascade(thresholds, &levels);
 
-    for (int i = min_reduction; i < m_coarseReduction; ++i) {
-        coarse_reduced.reduce(i == 0 ? 1 : 2);
-    }
+    int const min_reduction = std::min(m_coarseReduction, m_fineReduction);
+    ReduceThreshold fine_reduced(min_reduction == 0 ? image : levels[min_reduction - 1]);
+    levels.clear();
 
-    BinaryImage skewed(coarse_reduced.image().size());
+    RowProjector coarse_projector(coarse_reduced.image());
     double const coarse_step = 1.0; // degrees
 
     // Coarse linear search.
     int num_coarse_scores = 0;
     double sum_coarse_scores = 0.0;
     double best_coarse_score = 0.0;
-    double best_coarse_angle = -m_maxAngle;
-    for (double angle = -m_maxAngle; angle <= m_maxAngle; angle += coarse_step) {
-        double const score = process(coarse_reduced, skewed, angle);
+    double const min_angle = m_searchCenter - m_maxAngle;
+    double const max_angle = m_searchCenter + m_maxAngle;
+    double best_coarse_angle = min_angle;
+    for (double angle = min_angle; angle <= max_angle; angle += coarse_step) {
+        double const score = process(coarse_projector, angle);
         sum_coarse_scores += score;
         ++num_coarse_scores;
         if (score > best_coarse_score) {
@@ -144,24 +279,22 @@ SkewFinder::findSkew(BinaryImage const& image) const
         fine_reduced.reduce(i == 0 ? 1 : 2);
     }
 
-    if (m_coarseReduction != m_fineReduction) {
-        skewed = BinaryImage(fine_reduced.image().size());
-    }
+    RowProjector fine_projector(fine_reduced.image());
 
     // Fine binary search.
     double angle_plus = best_coarse_angle + 0.5 * coarse_step;
     double angle_minus = best_coarse_angle - 0.5 * coarse_step;
-    double score_plus = process(fine_reduced, skewed, angle_plus);
-    double score_minus = process(fine_reduced, skewed, angle_minus);
+    double score_plus = process(fine_projector, angle_plus);
+    double score_minus = process(fine_projector, angle_minus);
     double const fine_score1 = score_plus;
     double const fine_score2 = score_minus;
     while (angle_plus - angle_minus > m_accuracy) {
         if (score_plus > score_minus) {
             angle_minus = 0.5 * (angle_plus + angle_minus);
-            score_minus = process(fine_reduced, skewed, angle_minus);
+            score_minus = process(fine_projector, angle_minus);
         } else if (score_plus < score_minus) {
             angle_plus = 0.5 * (angle_plus + angle_minus);
-            score_plus = process(fine_reduced, skewed, angle_plus);
+            score_plus = process(fine_projector, angle_plus);
         } else {
             // This protects us from unreasonably low m_accuracy.
             break;
@@ -197,42 +330,11 @@ SkewFinder::findSkew(BinaryImage const& image) const
 }
 
 double
-SkewFinder::process(BinaryImage const& src, BinaryImage& dst, double const angle) const
+SkewFinder::process(RowProjector& projector, double const angle) const
 {
     double const tg = tan(angle * constants::DEG2RAD);
-    double const x_center = 0.5 * dst.width();
-    vShearFromTo(src, dst, tg / m_resolutionRatio, x_center, WHITE);
-    return calcScore(dst);
-}
-
-double
-SkewFinder::calcScore(BinaryImage const& image)
-{
-    int const width = image.width();
-    int const height = image.height();
-    uint32_t const* line = image.data();
-    int const wpl = image.wordsPerLine();
-    int const last_word_idx = (width - 1) >> 5;
-    uint32_t const last_word_mask = ~uint32_t(0) << (31 - ((width - 1) & 31));
-
-    double score = 0.0;
-    int last_line_black_pixels = 0;
-    for (int y = 0; y < height; ++y, line += wpl) {
-        int num_black_pixels = 0;
-        int i = 0;
-        for (; i != last_word_idx; ++i) {
-            num_black_pixels += countNonZeroBits(line[i]);
-        }
-        num_black_pixels += countNonZeroBits(line[i] & last_word_mask);
-
-        if (y != 0) {
-            double const diff = num_black_pixels - last_line_black_pixels;
-            score += diff * diff;
-        }
-        last_line_black_pixels = num_black_pixels;
-    }
-
-    return score;
+    double const x_center = 0.5 * projector.width();
+    return projector.score(tg / m_resolutionRatio, x_center);
 }
 
 } // namespace imageproc
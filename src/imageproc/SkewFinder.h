@@ -93,6 +93,15 @@ public:
      */
     void setMaxAngle(double max_angle = DEFAULT_MAX_ANGLE);
 
+    /**
+     * \brief Center the search range around a known skew angle.
+     *
+     * The range checked becomes [center - max_angle, center + max_angle].
+     * \param center The expected skew, in the convention of Skew::angle().
+     * \note The angle can't exceed 45 degrees.
+     */
+    void setSearchCenter(double center = 0.0);
+
     /**
      * \brief Set the desired accuracy.
      *
@@ -146,11 +155,12 @@ public:
 private:
     static double const LOW_SCORE;
 
-    double process(BinaryImage const& src, BinaryImage& dst, double angle) const;
+    class RowProjector;
 
-    static double calcScore(BinaryImage const& image);
+    double process(RowProjector& projector, double angle) const;
 
     double m_maxAngle;
+    double m_searchCenter;
     double m_accuracy;
     double m_resolutionRatio;
     int m_coarseReduction;
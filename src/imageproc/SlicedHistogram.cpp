@@ -20,11 +20,121 @@
 #include "BinaryImage.h"
 #include "BitOps.h"
 #include <QRect>
+#include <algorithm>
 #include <stdexcept>
+#include <stdint.h>
 
 namespace imageproc
 {
 
+namespace
+{
+
+/**
+ * Maps a byte of pixels to 8 one-byte lanes, the leftmost pixel
+ * going to the least significant lane.
+ */
+class SpreadTable
+{
+public:
+    SpreadTable()
+    {
+        for (unsigned byte = 0; byte < 256; ++byte) {
+            uint64_t lanes = 0;
+            for (int lane = 0; lane < 8; ++lane) {
+                lanes |= uint64_t((byte >> (7 - lane)) & 1) << (lane * 8);
+            }
+            m_lanes[byte] = lanes;
+        }
+    }
+
+    uint64_t operator[](uint32_t byte) const
+    {
+        return m_lanes[byte];
+    }
+private:
+    uint64_t m_lanes[256];
+};
+
+/**
+ * Accumulates per-column black pixel counts while walking the image
+ * line by line.  Each word contributes to 32 one-byte counters at once,
+ * which are flushed into full-width counters before they can overflow.
+ * Compared to walking the image column by column, this touches every
+ * word once, in memory order.
+ */
+class ColumnCounter
+{
+public:
+    explicit ColumnCounter(QRect const& area)
+        : m_firstWordIdx(area.left() >> 5),
+          m_numWords((area.right() >> 5) - (area.left() >> 5) + 1),
+          m_firstBit(area.left() & 31),
+          m_width(area.width()),
+          m_pendingLines(0),
+          m_lanes(m_numWords * 4, 0),
+          m_counts(m_numWords * 32, 0)
+    {
+    }
+
+    void addLine(uint32_t const* line)
+    {
+        static SpreadTable const spread;
+
+        line += m_firstWordIdx;
+        uint64_t* lanes = m_lanes.data();
+        for (int i = 0; i < m_numWords; ++i, lanes += 4) {
+            uint32_t const word = line[i];
+            if (word) {
+                lanes[0] += spread[word >> 24];
+                lanes[1] += spread[(word >> 16) & 0xff];
+                lanes[2] += spread[(word >> 8) & 0xff];
+                lanes[3] += spread[word & 0xff];
+            }
+        }
+
+        if (++m_pendingLines == 255) {
+            flush();
+        }
+    }
+
+    void finish(std::vector<int>& counts)
+    {
+        flush();
+        std::vector<int>::const_iterator const begin(m_counts.begin() + m_firstBit);
+        counts.assign(begin, begin + m_width);
+    }
+private:
+    void flush()
+    {
+        if (m_pendingLines == 0) {
+            return;
+        }
+        m_pendingLines = 0;
+
+        int* counts = m_counts.data();
+        for (uint64_t& lanes : m_lanes) {
+            if (lanes) {
+                for (int lane = 0; lane < 8; ++lane) {
+                    counts[lane] += static_cast<int>((lanes >> (lane * 8)) & 0xff);
+                }
+                lanes = 0;
+            }
+            counts += 8;
+        }
+    }
+
+    int m_firstWordIdx;
+    int m_numWords;
+    int m_firstBit;
+    int m_width;
+    int m_pendingLines;
+    std::vector<uint64_t> m_lanes;
+    std::vector<int> m_counts;
+};
+
+} // anonymous namespace
+
 SlicedHistogram::SlicedHistogram()
 {
 }
@@ -95,22 +205,64 @@ SlicedHistogram::processHorizontalLines(BinaryImage const& image, QRect const& a
 void
 SlicedHistogram::processVerticalLines(BinaryImage const& image, QRect const& area)
 {
-    m_data.reserve(area.width());
+    if (area.width() <= 0) {
+        return;
+    }
+
+    int const wpl = image.wordsPerLine();
+    uint32_t const* line = image.data() + area.top() * wpl;
+
+    ColumnCounter counter(area);
+    for (int i = area.height(); i > 0; --i, line += wpl) {
+        counter.addLine(line);
+    }
+    counter.finish(m_data);
+}
+
+void
+SlicedHistogram::calcRowsAndCols(
+    BinaryImage const& image, QRect const& area,
+    SlicedHistogram& rows, SlicedHistogram& cols)
+{
+    if (!image.rect().contains(area)) {
+        throw std::invalid_argument("SlicedHistogram: area exceeds the image");
+    }
+
+    rows.m_data.clear();
+    cols.m_data.clear();
+    if (area.width() <= 0 || area.height() <= 0) {
+        rows.m_data.resize(std::max(area.height(), 0));
+        cols.m_data.resize(std::max(area.width(), 0));
+        return;
+    }
+
+    rows.m_data.reserve(area.height());
 
-    int const right = area.right();
-    int const height = area.height();
     int const wpl = image.wordsPerLine();
-    uint32_t const* const top_line = image.data() + area.top() * wpl;
-
-    for (int x = area.left(); x <= right; ++x) {
-        uint32_t const* pword = top_line + (x >> 5);
-        int const least_significant_zeroes = 31 - (x & 31);
-        int count = 0;
-        for (int i = 0; i < height; ++i, pword += wpl) {
-            count += (*pword >> least_significant_zeroes) & 1;
+    int const first_word_idx = area.left() >> 5;
+    int const last_word_idx = area.right() >> 5;
+    uint32_t const first_word_mask = ~uint32_t(0) >> (area.left() & 31);
+    int const last_word_unused_bits = (last_word_idx << 5) + 31 - area.right();
+    uint32_t const last_word_mask = ~uint32_t(0) << last_word_unused_bits;
+    uint32_t const* line = image.data() + area.top() * wpl;
+
+    ColumnCounter counter(area);
+    for (int i = area.height(); i > 0; --i, line += wpl) {
+        int count;
+        if (first_word_idx == last_word_idx) {
+            count = countNonZeroBits(line[first_word_idx] & first_word_mask & last_word_mask);
+        } else {
+            int idx = first_word_idx;
+            count = countNonZeroBits(line[idx] & first_word_mask);
+            for (++idx; idx != last_word_idx; ++idx) {
+                count += countNonZeroBits(line[idx]);
+            }
+            count += countNonZeroBits(line[idx] & last_word_mask);
         }
-        m_data.push_back(count);
+        rows.m_data.push_back(count);
+        counter.addLine(line);
     }
+    counter.finish(cols.m_data);
 }
 
 } // namespace imageproc
@@ -70,6 +70,20 @@ public:
      */
     SlicedHistogram(BinaryImage const& image, QRect const& area, Type type);
 
+    /**
+     * \brief Calculates both the row and the column histograms
+     *        of a portion of the image in a single pass over it.
+     *
+     * The results are the same as constructing a ROWS and a COLS
+     * histogram of \p area separately.
+     *
+     * \exception std::invalid_argument If \p area is not completely
+     *            within image.rect().
+     */
+    static void calcRowsAndCols(
+        BinaryImage const& image, QRect const& area,
+        SlicedHistogram& rows, SlicedHistogram& cols);
+
     size_t size() const
     {
         return m_data.size();
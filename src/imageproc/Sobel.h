@@ -27,6 +27,8 @@
  * but the gradient multiplied by 8.
  */
 
+#include <vector>
+
 namespace imageproc
 {
 
@@ -113,32 +115,28 @@ void horizontalSobel(
     }
 
     // Vertical pre-accumulation pass: mid = top + mid*2 + bottom
+    // It goes line by line rather than column by column, to access
+    // memory sequentially.  Lines above the current one may already
+    // be overwritten, so their original values are kept in a buffer.
+    TmpIt const tmp_orig(tmp);
+    std::vector<T> prev_line(width);
     for (int x = 0; x < width; ++x) {
-        SrcIt p_src(src + x);
-        TmpIt p_tmp(tmp + x);
-
-        T top(src_reader(*p_src));
-        if (height == 1) {
-            tmp_writer(*p_tmp, top + top + top + top);
-            continue;
-        }
-
-        T mid(src_reader(p_src[src_stride]));
-        tmp_writer(*p_tmp, top + top + top + mid);
+        prev_line[x] = src_reader(src[x]);
+    }
 
-        for (int y = 1; y < height - 1; ++y) {
-            p_src += src_stride;
-            p_tmp += tmp_stride;
-            T const bottom(src_reader(p_src[src_stride]));
-            tmp_writer(*p_tmp, top + mid + mid + bottom);
-            top = mid;
-            mid = bottom;
+    for (int y = 0; y < height; ++y) {
+        SrcIt const next_src(y + 1 < height ? src + src_stride : src);
+        for (int x = 0; x < width; ++x) {
+            T const top(prev_line[x]);
+            T const mid(src_reader(src[x]));
+            T const bottom(src_reader(next_src[x]));
+            tmp_writer(tmp[x], top + mid + mid + bottom);
+            prev_line[x] = mid;
         }
-
-        p_src += src_stride;
-        p_tmp += tmp_stride;
-        tmp_writer(*p_tmp, top + mid + mid + mid);
+        src += src_stride;
+        tmp += tmp_stride;
     }
+    tmp = tmp_orig;
 
     // Horizontal pass: mid = right - left
     for (int y = 0; y < height; ++y) {
@@ -206,31 +204,25 @@ void verticalSobel(
     }
 
     // Vertical pass: mid = bottom - top
+    // See the pre-accumulation pass in horizontalSobel() for why
+    // a line buffer is used.
+    tmp = tmp_orig;
+    std::vector<T> prev_line(width);
     for (int x = 0; x < width; ++x) {
-        TmpIt p_tmp(tmp_orig + x);
-        TmpIt p_dst(dst + x);
-
-        T top(tmp_reader(*p_tmp));
-        if (height == 1) {
-            dst_writer(*p_dst, top - top);
-            continue;
-        }
-
-        T mid(tmp_reader(p_tmp[tmp_stride]));
-        dst_writer(*p_dst, mid - top);
+        prev_line[x] = tmp_reader(tmp[x]);
+    }
 
-        for (int y = 1; y < height - 1; ++y) {
-            p_tmp += tmp_stride;
-            p_dst += dst_stride;
-            T const bottom(tmp_reader(p_tmp[tmp_stride]));
-            dst_writer(*p_dst, bottom - top);
-            top = mid;
-            mid = bottom;
+    for (int y = 0; y < height; ++y) {
+        TmpIt const next_tmp(y + 1 < height ? tmp + tmp_stride : tmp);
+        for (int x = 0; x < width; ++x) {
+            T const top(prev_line[x]);
+            T const mid(tmp_reader(tmp[x]));
+            T const bottom(tmp_reader(next_tmp[x]));
+            dst_writer(dst[x], bottom - top);
+            prev_line[x] = mid;
         }
-
-        p_tmp += tmp_stride;
-        p_dst += dst_stride;
-        dst_writer(*p_dst, mid - top);
+        tmp += tmp_stride;
+        dst += dst_stride;
     }
 }
 
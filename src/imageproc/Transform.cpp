@@ -19,8 +19,10 @@
 #include "Transform.h"
 #include "Grayscale.h"
 #include "GrayImage.h"
+#include "OrthogonalRotation.h"
 #include <QImage>
 #include <QRect>
+#include <QPoint>
 #include <QSizeF>
 #include <QPointF>
 #include <QPolygonF>
@@ -30,7 +32,10 @@
 #include <QDebug>
 #include <stdexcept>
 #include <algorithm>
+#include <new>
+#include <vector>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 
@@ -57,13 +62,29 @@ struct YLess {
 class Gray
 {
 public:
+    enum { NUM_CHANNELS = 1 };
+
     Gray() : m_grayLevel(0) {}
 
+    static inline unsigned channel(uint8_t const gray_level, int)
+    {
+        return gray_level;
+    }
+
     inline void add(uint8_t const gray_level, unsigned const area)
     {
         m_grayLevel += gray_level * area;
     }
 
+    /**
+     * Adds area-weighted sums of channel values, in the order
+     * defined by channel().
+     */
+    inline void addChannels(unsigned const* sums)
+    {
+        m_grayLevel += sums[0];
+    }
+
     inline uint8_t result(unsigned const total_area) const
     {
         unsigned const half_area = total_area >> 1;
@@ -77,8 +98,22 @@ private:
 class RGB32
 {
 public:
+    enum { NUM_CHANNELS = 3 };
+
     RGB32() : m_red(0), m_green(0), m_blue(0) {}
 
+    static inline unsigned channel(uint32_t const rgb, int const idx)
+    {
+        return (rgb >> (idx << 3)) & 0xFF;
+    }
+
+    inline void addChannels(unsigned const* sums)
+    {
+        m_blue += sums[0];
+        m_green += sums[1];
+        m_red += sums[2];
+    }
+
     inline void add(uint32_t rgb, unsigned const area)
     {
         m_blue += (rgb & 0xFF) * area;
@@ -108,8 +143,23 @@ private:
 class ARGB32
 {
 public:
+    enum { NUM_CHANNELS = 4 };
+
     ARGB32() : m_alpha(0), m_red(0), m_green(0), m_blue(0) {}
 
+    static inline unsigned channel(uint32_t const argb, int const idx)
+    {
+        return (argb >> (idx << 3)) & 0xFF;
+    }
+
+    inline void addChannels(unsigned const* sums)
+    {
+        m_blue += sums[0];
+        m_green += sums[1];
+        m_red += sums[2];
+        m_alpha += sums[3];
+    }
+
     inline void add(uint32_t argb, unsigned const area)
     {
         m_blue += (argb & 0xFF) * area;
@@ -163,6 +213,306 @@ static QSizeF calcSrcUnitSize(QTransform const& xform, QSizeF const& min)
            );
 }
 
+/**
+ * A transformation that maps destination pixels one-to-one onto source
+ * pixels, possibly rotating them by a multiple of 90 degrees.  That's what
+ * a pure orientation fix comes down to.
+ */
+struct PixelAlignedRotation {
+    int degrees;
+    QRect srcRect; // The area of the source image to rotate.
+    QPoint dstOffset; // Where the rotated area goes in the destination image.
+    bool clipped; // Whether some destination pixels are outside of srcRect.
+};
+
+static inline bool isNear(double const val, double const target)
+{
+    return fabs(val - target) < 1e-4;
+}
+
+static bool detectPixelAlignedRotation(
+    QTransform const& xform, QRect const& dst_rect, QSize const& src_size,
+    int const outside_flags, QSizeF const& min_mapping_area,
+    PixelAlignedRotation& rotation)
+{
+    if (min_mapping_area.width() > 1.0 || min_mapping_area.height() > 1.0) {
+        // Smoothing was requested.
+        return false;
+    }
+
+    QTransform inv_xform;
+    inv_xform.translate(dst_rect.x(), dst_rect.y());
+    inv_xform *= xform.inverted();
+
+    if (isNear(inv_xform.m12(), 0.0) && isNear(inv_xform.m21(), 0.0)) {
+        if (isNear(inv_xform.m11(), 1.0) && isNear(inv_xform.m22(), 1.0)) {
+            rotation.degrees = 0;
+        } else if (isNear(inv_xform.m11(), -1.0) && isNear(inv_xform.m22(), -1.0)) {
+            rotation.degrees = 180;
+        } else {
+            return false;
+        }
+    } else if (isNear(inv_xform.m11(), 0.0) && isNear(inv_xform.m22(), 0.0)) {
+        // sx = dy * m21 + tx, sy = dx * m12 + ty
+        if (isNear(inv_xform.m21(), 1.0) && isNear(inv_xform.m12(), -1.0)) {
+            rotation.degrees = 90;
+        } else if (isNear(inv_xform.m21(), -1.0) && isNear(inv_xform.m12(), 1.0)) {
+            rotation.degrees = 270;
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    // Pixel centers have to map onto pixel centers, which for such
+    // transformations means the source area has integer edges.
+    QRectF const src_area(
+        inv_xform.mapRect(QRectF(0.0, 0.0, dst_rect.width(), dst_rect.height()))
+    );
+    int const left = qRound(src_area.left());
+    int const top = qRound(src_area.top());
+    int const right = qRound(src_area.right());
+    int const bottom = qRound(src_area.bottom());
+    if (!isNear(src_area.left(), left) || !isNear(src_area.top(), top)
+            || !isNear(src_area.right(), right) || !isNear(src_area.bottom(), bottom)) {
+        return false;
+    }
+
+    QRect const aligned_area(left, top, right - left, bottom - top);
+    rotation.srcRect = aligned_area.intersected(QRect(QPoint(0, 0), src_size));
+    if (rotation.srcRect.isEmpty()) {
+        return false;
+    }
+
+    // Destination pixels outside of the source image are simply of the outside
+    // color, while emulating OutsidePixels::NEAREST would take more than a copy.
+    rotation.clipped = rotation.srcRect != aligned_area;
+    if (rotation.clipped && !(outside_flags & OutsidePixels::COLOR)) {
+        return false;
+    }
+
+    QRectF const dst_area(inv_xform.inverted().mapRect(QRectF(rotation.srcRect)));
+    rotation.dstOffset = QPoint(qRound(dst_area.left()), qRound(dst_area.top()));
+
+    return true;
+}
+
+/**
+ * Carries out a PixelAlignedRotation without resampling.
+ * The returned image is of the same format as \p src.
+ */
+static QImage rotatePixelAligned(
+    QImage const& src, PixelAlignedRotation const& rotation,
+    QSize const& dst_size, uint const outside_color)
+{
+    QImage const rotated(orthogonalRotation(src, rotation.srcRect, rotation.degrees));
+    if (!rotation.clipped) {
+        return rotated;
+    }
+
+    QImage dst(dst_size, rotated.format());
+    if (dst.isNull()) {
+        throw std::bad_alloc();
+    }
+    dst.setColorTable(rotated.colorTable());
+    dst.fill(outside_color);
+
+    int const bytes_per_pixel = rotated.depth() / 8;
+    int const line_bytes = rotated.width() * bytes_per_pixel;
+    for (int y = 0; y < rotated.height(); ++y) {
+        memcpy(
+            dst.scanLine(rotation.dstOffset.y() + y)
+            + rotation.dstOffset.x() * bytes_per_pixel,
+            rotated.constScanLine(y), line_bytes
+        );
+    }
+
+    return dst;
+}
+
+/**
+ * The footprint of a destination pixel along one axis, for transformations
+ * that don't mix the axes.  Coordinates are in 1/32 of a source pixel.
+ */
+struct AxisSpan {
+    int first; // First source pixel, clipped to the image.
+    int last; // Last source pixel (inclusive), clipped to the image.
+    unsigned firstWeight;
+    unsigned lastWeight;
+    unsigned clippedLength; // In 1/32 units.
+    int nearest; // The pixel to use if the footprint is outside the image.
+    bool outside;
+
+    unsigned weight(int const src) const
+    {
+        if (first == last) {
+            return clippedLength;
+        } else if (src == first) {
+            return firstWeight;
+        } else if (src == last) {
+            return lastWeight;
+        } else {
+            return 32;
+        }
+    }
+};
+
+/**
+ * Computes per-axis footprints exactly the way transformGeneric() does
+ * per pixel, so both paths produce identical results.
+ */
+static void calcAxisSpans(
+    std::vector<AxisSpan>& spans, int const dst_len, int const src_len,
+    double const scale32, double const offset32, int const src32_unit)
+{
+    spans.resize(dst_len);
+    for (int d = 0; d < dst_len; ++d) {
+        AxisSpan& span = spans[d];
+        double const f_s32_center = (d + 0.5) * scale32 + offset32;
+        int s32_first = (int)f_s32_center - (src32_unit >> 1);
+        int s32_end = s32_first + src32_unit;
+        int first = s32_first >> 5;
+        int last = (s32_end - 1) >> 5; // inclusive
+
+        span.nearest = qBound<int>(0, (first + last) >> 1, src_len - 1);
+        span.outside = last < 0 || first >= src_len;
+        if (span.outside) {
+            span.first = span.last = 0;
+            span.firstWeight = span.lastWeight = span.clippedLength = 0;
+            continue;
+        }
+
+        if (first < 0) {
+            first = 0;
+            s32_first = 0;
+        }
+        if (last >= src_len) {
+            last = src_len - 1;
+            s32_end = src_len << 5;
+        }
+
+        span.first = first;
+        span.last = last;
+        span.firstWeight = 32 - (s32_first & 31);
+        span.lastWeight = s32_end - (last << 5);
+        span.clippedLength = s32_end - s32_first;
+        assert(span.clippedLength > 0);
+    }
+}
+
+/**
+ * A fast path of transformGeneric() for transformations without rotation
+ * or shear, which is what DPI changes come down to.  The area each
+ * destination pixel maps to is then a product of per-axis footprints,
+ * so weighted column sums are computed for each destination line and then
+ * reduced horizontally.  Integer arithmetic makes the result exact.
+ */
+template<typename StorageUnit, typename Mixer>
+static void transformScaleOnly(
+    StorageUnit const* const src_data, int const src_stride, QSize const src_size,
+    StorageUnit* const dst_data, int const dst_stride, QTransform const& inv_xform,
+    QSize const dst_size, StorageUnit const outside_color, int const outside_flags,
+    int const src32_unit_w, int const src32_unit_h)
+{
+    int const num_channels = Mixer::NUM_CHANNELS;
+    int const sw = src_size.width();
+    int const sh = src_size.height();
+    int const dw = dst_size.width();
+    int const dh = dst_size.height();
+
+    std::vector<AxisSpan> x_spans;
+    std::vector<AxisSpan> y_spans;
+    calcAxisSpans(x_spans, dw, sw, inv_xform.m11(), inv_xform.dx(), src32_unit_w);
+    calcAxisSpans(y_spans, dh, sh, inv_xform.m22(), inv_xform.dy(), src32_unit_h);
+
+    // The range of source columns any destination pixel maps to.
+    int src_x0 = sw;
+    int src_x1 = -1;
+    for (AxisSpan const& span : x_spans) {
+        if (!span.outside) {
+            src_x0 = std::min(src_x0, span.first);
+            src_x1 = std::max(src_x1, span.last);
+        }
+    }
+
+    unsigned const unit_area = src32_unit_w * src32_unit_h;
+
+    #pragma omp parallel
+    {
+        // Channel planes of weighted column sums.
+        std::vector<unsigned> col_sums(num_channels * std::max(sw, 1));
+
+        #pragma omp for schedule(static)
+        for (int dy = 0; dy < dh; ++dy) {
+            StorageUnit* const dst_line = dst_data + dy * dst_stride;
+            AxisSpan const& ys = y_spans[dy];
+
+            if (!ys.outside) {
+                StorageUnit const* src_line = src_data + ys.first * src_stride;
+                for (int ch = 0; ch < num_channels; ++ch) {
+                    unsigned* const plane = &col_sums[ch * sw];
+                    unsigned const w = ys.weight(ys.first);
+                    for (int sx = src_x0; sx <= src_x1; ++sx) {
+                        plane[sx] = w * Mixer::channel(src_line[sx], ch);
+                    }
+                }
+                for (int sy = ys.first + 1; sy <= ys.last; ++sy) {
+                    src_line += src_stride;
+                    unsigned const w = ys.weight(sy);
+                    for (int ch = 0; ch < num_channels; ++ch) {
+                        unsigned* const plane = &col_sums[ch * sw];
+                        for (int sx = src_x0; sx <= src_x1; ++sx) {
+                            plane[sx] += w * Mixer::channel(src_line[sx], ch);
+                        }
+                    }
+                }
+            }
+
+            for (int dx = 0; dx < dw; ++dx) {
+                AxisSpan const& xs = x_spans[dx];
+                if (ys.outside || xs.outside) {
+                    // Completely outside of src image.
+                    if (outside_flags & OutsidePixels::COLOR) {
+                        dst_line[dx] = outside_color;
+                    } else {
+                        dst_line[dx] = src_data[ys.nearest * src_stride + xs.nearest];
+                    }
+                    continue;
+                }
+
+                unsigned const src_area = xs.clippedLength * ys.clippedLength;
+                unsigned background_area = unit_area - src_area;
+
+                Mixer mixer;
+                if (outside_flags & OutsidePixels::WEAK) {
+                    background_area = 0;
+                } else {
+                    mixer.add(outside_color, background_area);
+                }
+
+                unsigned sums[num_channels];
+                for (int ch = 0; ch < num_channels; ++ch) {
+                    unsigned const* const plane = &col_sums[ch * sw];
+                    if (xs.first == xs.last) {
+                        sums[ch] = xs.clippedLength * plane[xs.first];
+                        continue;
+                    }
+                    unsigned middle = 0;
+                    for (int sx = xs.first + 1; sx < xs.last; ++sx) {
+                        middle += plane[sx];
+                    }
+                    sums[ch] = xs.firstWeight * plane[xs.first] + (middle << 5)
+                               + xs.lastWeight * plane[xs.last];
+                }
+                mixer.addChannels(sums);
+
+                dst_line[dx] = mixer.result(src_area + background_area);
+            }
+        }
+    }
+}
+
 template<typename StorageUnit, typename Mixer>
 static void transformGeneric(
     StorageUnit const* const src_data, int const src_stride, QSize const src_size,
@@ -187,17 +537,32 @@ static void transformGeneric(
     int const src32_unit_w = std::max<int>(1, qRound(src32_unit_size.width()));
     int const src32_unit_h = std::max<int>(1, qRound(src32_unit_size.height()));
 
-    #pragma omp parallel for schedule(static) shared(inv_xform)
+    if (inv_xform.m12() == 0.0 && inv_xform.m21() == 0.0) {
+        transformScaleOnly<StorageUnit, Mixer>(
+            src_data, src_stride, src_size, dst_data, dst_stride, inv_xform,
+            dst_rect.size(), outside_color, outside_flags, src32_unit_w, src32_unit_h
+        );
+        return;
+    }
+
+    double const m11 = inv_xform.m11();
+    double const m12 = inv_xform.m12();
+    double const m21 = inv_xform.m21();
+    double const m22 = inv_xform.m22();
+    double const tx = inv_xform.dx();
+    double const ty = inv_xform.dy();
+
+    #pragma omp parallel for schedule(static)
     for (int dy = 0; dy < dh; ++dy) {
         StorageUnit* dst_line = dst_data + dy * dst_stride;
         double const f_dy_center = dy + 0.5;
-        double const f_sx32_base = f_dy_center * inv_xform.m21() + inv_xform.dx();
-        double const f_sy32_base = f_dy_center * inv_xform.m22() + inv_xform.dy();
+        double const f_sx32_base = f_dy_center * m21 + tx;
+        double const f_sy32_base = f_dy_center * m22 + ty;
 
         for (int dx = 0; dx < dw; ++dx) {
             double const f_dx_center = dx + 0.5;
-            double const f_sx32_center = f_sx32_base + f_dx_center * inv_xform.m11();
-            double const f_sy32_center = f_sy32_base + f_dx_center * inv_xform.m12();
+            double const f_sx32_center = f_sx32_base + f_dx_center * m11;
+            double const f_sy32_center = f_sy32_base + f_dx_center * m12;
             int src32_left = (int)f_sx32_center - (src32_unit_w >> 1);
             int src32_top = (int)f_sy32_center - (src32_unit_h >> 1);
             int src32_right = src32_left + src32_unit_w;
@@ -417,10 +782,22 @@ QImage transform(
         throw std::invalid_argument("transform: dst_rect is invalid");
     }
 
+    PixelAlignedRotation rotation;
+    bool const pixel_aligned = detectPixelAlignedRotation(
+                                   xform, dst_rect, src.size(), outside_pixels.flags(),
+                                   min_mapping_area, rotation
+                               );
+
     if (src.format() == QImage::Format_Indexed8 && src.allGray()) {
         // The palette of src may be non-standard, so we create a GrayImage,
         // which is guaranteed to have a standard palette.
         GrayImage gray_src(src);
+        if (pixel_aligned) {
+            return rotatePixelAligned(
+                       gray_src.toQImage(), rotation, dst_rect.size(),
+                       outside_pixels.grayLevel()
+                   );
+        }
         GrayImage gray_dst(dst_rect.size());
         transformGeneric<uint8_t, Gray>(
             gray_src.data(), gray_src.stride(), src.size(),
@@ -432,6 +809,11 @@ QImage transform(
     } else {
         if (src.hasAlphaChannel() || qAlpha(outside_pixels.rgba()) != 0xff) {
             QImage const src_argb32(src.convertToFormat(QImage::Format_ARGB32));
+            if (pixel_aligned) {
+                return rotatePixelAligned(
+                           src_argb32, rotation, dst_rect.size(), outside_pixels.rgba()
+                       );
+            }
             QImage dst(dst_rect.size(), QImage::Format_ARGB32);
             transformGeneric<uint32_t, ARGB32>(
                 (uint32_t const*)src_argb32.bits(), src_argb32.bytesPerLine() / 4, src_argb32.size(),
@@ -441,6 +823,11 @@ QImage transform(
             return dst;
         } else {
             QImage const src_rgb32(src.convertToFormat(QImage::Format_RGB32));
+            if (pixel_aligned) {
+                return rotatePixelAligned(
+                           src_rgb32, rotation, dst_rect.size(), outside_pixels.rgb()
+                       );
+            }
             QImage dst(dst_rect.size(), QImage::Format_RGB32);
             transformGeneric<uint32_t, RGB32>(
                 (uint32_t const*)src_rgb32.bits(), src_rgb32.bytesPerLine() / 4, src_rgb32.size(),
@@ -470,6 +857,18 @@ GrayImage transformToGray(
     }
 
     GrayImage const gray_src(src);
+
+    PixelAlignedRotation rotation;
+    if (detectPixelAlignedRotation(xform, dst_rect, src.size(), outside_pixels.flags(),
+                                   min_mapping_area, rotation)) {
+        return GrayImage(
+                   rotatePixelAligned(
+                       gray_src.toQImage(), rotation, dst_rect.size(),
+                       outside_pixels.grayLevel()
+                   )
+               );
+    }
+
     GrayImage dst(dst_rect.size());
 
     transformGeneric<uint8_t, Gray>(
@@ -0,0 +1,378 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * \file
+ * Times the imageproc kernels the filters depend on.
+ *
+ * Usage: imageproc_bench [--iterations=N] [--filter=substring] [image ...]
+ *
+ * Besides synthetic 150, 300 and 600 dpi pages, every image given on the
+ * command line is used as a fixture.  Results are printed to stdout as
+ * JSON lines, one object per kernel and fixture, so they can be collected
+ * per commit and graphed.
+ */
+
+#include "Constants.h"
+#include "BinaryImage.h"
+#include "BinaryThreshold.h"
+#include "Binarize.h"
+#include "Connectivity.h"
+#include "ConnectivityMap.h"
+#include "GaussBlur.h"
+#include "GrayImage.h"
+#include "Morphology.h"
+#include "Scale.h"
+#include "SEDM.h"
+#include "SeedFill.h"
+#include "Shear.h"
+#include "SkewFinder.h"
+#include "Transform.h"
+#include "FastQueue.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QSize>
+#include <QRect>
+#include <QString>
+#include <QStringList>
+#include <QTransform>
+#include <QColor>
+#ifndef Q_MOC_RUN
+#include <boost/function.hpp>
+#endif
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdint.h>
+
+using namespace imageproc;
+
+namespace
+{
+
+struct Fixture
+{
+    QString name;
+    int dpi;
+    GrayImage gray;
+    BinaryImage bw;
+};
+
+struct Benchmark
+{
+    char const* name;
+    boost::function<void(Fixture const&)> run;
+};
+
+/**
+ * Generates a page of text-like glyph boxes on an unevenly lit
+ * background, with lines skewed by half a degree so that SkewFinder
+ * has something to find.
+ */
+GrayImage syntheticPage(int const dpi)
+{
+    QSize const size(dpi * 827 / 100, dpi * 1169 / 100); // A4
+    GrayImage page(size);
+
+    std::minstd_rand rng(dpi);
+    std::uniform_int_distribution<int> noise(-6, 6);
+
+    uint8_t* line = page.data();
+    for (int y = 0; y < size.height(); ++y, line += page.stride()) {
+        for (int x = 0; x < size.width(); ++x) {
+            int const background = 235 - 20 * x / size.width() - 10 * y / size.height();
+            line[x] = uint8_t(background + noise(rng));
+        }
+    }
+
+    double const slope = tan(0.5 * constants::DEG2RAD);
+    int const margin = dpi;
+    int const line_height = dpi / 6;
+    int const glyph_height = dpi / 10;
+    std::uniform_int_distribution<int> glyph_width(dpi / 40, dpi / 12);
+    std::uniform_int_distribution<int> ink(20, 60);
+
+    for (int base_y = margin; base_y + line_height < size.height() - margin; base_y += line_height) {
+        int x = margin;
+        while (x < size.width() - margin) {
+            int const w = glyph_width(rng);
+            int const top = base_y + int(x * slope);
+            for (int y = top; y < top + glyph_height && y < size.height(); ++y) {
+                uint8_t* const row = page.data() + y * page.stride();
+                for (int xx = x; xx < x + w && xx < size.width() - margin; ++xx) {
+                    row[xx] = uint8_t(ink(rng));
+                }
+            }
+            x += w + dpi / 60;
+        }
+    }
+
+    return page;
+}
+
+Fixture makeFixture(QString const& name, int const dpi, GrayImage const& gray)
+{
+    Fixture fixture;
+    fixture.name = name;
+    fixture.dpi = dpi;
+    fixture.gray = gray;
+    fixture.bw = BinaryImage(
+                     gray.toQImage(), BinaryThreshold::otsuThreshold(gray.toQImage())
+                 );
+    return fixture;
+}
+
+int oddWindow(int const dpi, int const fraction)
+{
+    return (dpi / fraction) | 1;
+}
+
+std::vector<Benchmark> benchmarks()
+{
+    std::vector<Benchmark> list;
+
+    struct Sauvola
+    {
+        void operator()(Fixture const& f) const
+        {
+            int const window = oddWindow(f.dpi, 6);
+            binarizeSauvola(f.gray.toQImage(), QSize(window, window));
+        }
+    };
+    list.push_back(Benchmark { "binarizeSauvola", Sauvola() });
+
+    struct Dilate
+    {
+        void operator()(Fixture const& f) const
+        {
+            dilateBrick(f.bw, Brick(QSize(oddWindow(f.dpi, 30), oddWindow(f.dpi, 30))));
+        }
+    };
+    list.push_back(Benchmark { "dilateBrick", Dilate() });
+
+    struct Distance
+    {
+        void operator()(Fixture const& f) const
+        {
+            SEDM const sedm(f.bw);
+        }
+    };
+    list.push_back(Benchmark { "SEDM", Distance() });
+
+    struct Labeling
+    {
+        void operator()(Fixture const& f) const
+        {
+            ConnectivityMap const cmap(f.bw, CONN8);
+        }
+    };
+    list.push_back(Benchmark { "ConnectivityMap", Labeling() });
+
+    struct Fill
+    {
+        void operator()(Fixture const& f) const
+        {
+            // Seeding from a single row makes the fill cover the most ground.
+            BinaryImage seed(f.bw.size(), WHITE);
+            seed.fill(QRect(0, f.bw.height() / 2, f.bw.width(), 1), BLACK);
+            seedFill(seed, f.bw, CONN8);
+        }
+    };
+    list.push_back(Benchmark { "seedFill", Fill() });
+
+    struct Rotate
+    {
+        void operator()(Fixture const& f) const
+        {
+            QRect const rect(f.gray.toQImage().rect());
+            QTransform xform;
+            xform.translate(0.5 * rect.width(), 0.5 * rect.height());
+            xform.rotate(1.5);
+            xform.translate(-0.5 * rect.width(), -0.5 * rect.height());
+            transform(
+                f.gray.toQImage(), xform, rect,
+                OutsidePixels::assumeColor(Qt::white)
+            );
+        }
+    };
+    list.push_back(Benchmark { "transform", Rotate() });
+
+    struct Blur
+    {
+        void operator()(Fixture const& f) const
+        {
+            float const sigma = f.dpi / 150.0f;
+            gaussBlur(f.gray, sigma, sigma);
+        }
+    };
+    list.push_back(Benchmark { "gaussBlur", Blur() });
+
+    struct Downscale
+    {
+        void operator()(Fixture const& f) const
+        {
+            scaleToGray(f.gray, f.gray.size() / 2);
+        }
+    };
+    list.push_back(Benchmark { "scaleToGray", Downscale() });
+
+    struct HorizontalShear
+    {
+        void operator()(Fixture const& f) const
+        {
+            double const shear = tan(1.5 * constants::DEG2RAD);
+            hShear(f.bw, shear, 0.5 * f.bw.height(), WHITE);
+        }
+    };
+    list.push_back(Benchmark { "hShear", HorizontalShear() });
+
+    struct VerticalShear
+    {
+        void operator()(Fixture const& f) const
+        {
+            double const shear = tan(1.5 * constants::DEG2RAD);
+            vShear(f.bw, shear, 0.5 * f.bw.width(), WHITE);
+        }
+    };
+    list.push_back(Benchmark { "vShear", VerticalShear() });
+
+    struct FindSkew
+    {
+        void operator()(Fixture const& f) const
+        {
+            SkewFinder skew_finder;
+            skew_finder.findSkew(f.bw);
+        }
+    };
+    list.push_back(Benchmark { "SkewFinder", FindSkew() });
+
+    struct Queue
+    {
+        void operator()(Fixture const& f) const
+        {
+            // The front of a flood fill over the page: a backlog of about
+            // a line's worth of elements, with every pixel passing through.
+            int const backlog = f.bw.width() * 4;
+            int const total = f.bw.width() * f.bw.height();
+            FastQueue<uint32_t> queue;
+            uint32_t sum = 0;
+            for (int i = 0; i < backlog; ++i) {
+                queue.push(i);
+            }
+            for (int i = backlog; i < total; ++i) {
+                queue.push(i);
+                sum += queue.front();
+                queue.pop();
+            }
+            while (!queue.empty()) {
+                sum += queue.front();
+                queue.pop();
+            }
+            volatile uint32_t const result = sum;
+            (void)result;
+        }
+    };
+    list.push_back(Benchmark { "FastQueue", Queue() });
+
+    return list;
+}
+
+QString jsonEscaped(QString str)
+{
+    str.replace(QLatin1String("\\"), QLatin1String("\\\\"));
+    str.replace(QLatin1String("\""), QLatin1String("\\\""));
+    return str;
+}
+
+void runBenchmark(Benchmark const& bench, Fixture const& fixture, int const iterations)
+{
+    std::vector<double> msecs;
+    msecs.reserve(iterations);
+    for (int i = 0; i < iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        bench.run(fixture);
+        msecs.push_back(timer.nsecsElapsed() / 1000000.0);
+    }
+    std::sort(msecs.begin(), msecs.end());
+
+    std::cout << "{\"benchmark\": \"" << bench.name
+              << "\", \"fixture\": \"" << jsonEscaped(fixture.name).toUtf8().constData()
+              << "\", \"width\": " << fixture.gray.width()
+              << ", \"height\": " << fixture.gray.height()
+              << ", \"dpi\": " << fixture.dpi
+              << ", \"iterations\": " << iterations
+              << ", \"min_msec\": " << msecs.front()
+              << ", \"median_msec\": " << msecs[msecs.size() / 2]
+              << "}" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    // Makes image format plugins available for real fixtures.
+    QCoreApplication app(argc, argv);
+
+    int iterations = 5;
+    QString filter;
+    QStringList files;
+    QStringList const args(app.arguments().mid(1));
+    for (QString const& arg : args) {
+        if (arg.startsWith(QLatin1String("--iterations="))) {
+            iterations = std::max(1, arg.mid(13).toInt());
+        } else if (arg.startsWith(QLatin1String("--filter="))) {
+            filter = arg.mid(9);
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    std::vector<Fixture> fixtures;
+    fixtures.push_back(makeFixture("synthetic_150dpi", 150, syntheticPage(150)));
+    fixtures.push_back(makeFixture("synthetic_300dpi", 300, syntheticPage(300)));
+    fixtures.push_back(makeFixture("synthetic_600dpi", 600, syntheticPage(600)));
+    for (QString const& file : files) {
+        QImage const image(file);
+        if (image.isNull()) {
+            std::cerr << "Unable to load " << file.toLocal8Bit().constData() << std::endl;
+            return 1;
+        }
+        int dpi = qRound(image.dotsPerMeterX() * constants::DPM2DPI);
+        if (dpi < 50) {
+            dpi = 300;
+        }
+        fixtures.push_back(makeFixture(QFileInfo(file).fileName(), dpi, GrayImage(image)));
+    }
+
+    std::vector<Benchmark> const list(benchmarks());
+    for (Benchmark const& bench : list) {
+        if (!filter.isEmpty() && !QString::fromLatin1(bench.name).contains(filter)) {
+            continue;
+        }
+        for (Fixture const& fixture : fixtures) {
+            runBenchmark(bench, fixture, iterations);
+        }
+    }
+
+    return 0;
+}
@@ -18,9 +18,15 @@
 
 #include "Binarize.h"
 #include "BinaryImage.h"
+#include "Grayscale.h"
 #include "Utils.h"
 #include <QImage>
 #include <QSize>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -33,7 +39,162 @@ namespace tests
 
 using namespace utils;
 
+namespace
+{
+
+/**
+ * Straightforward implementations of local window statistics
+ * to check the sliding window ones against.
+ */
+class ReferenceStats
+{
+public:
+    ReferenceStats(QImage const& gray, QSize const& window_size)
+        :   m_width(gray.width()),
+            m_height(gray.height()),
+            m_means(m_width * m_height),
+            m_deviations(m_width * m_height)
+    {
+        int const lower_half = window_size.height() >> 1;
+        int const upper_half = window_size.height() - lower_half;
+        int const left_half = window_size.width() >> 1;
+        int const right_half = window_size.width() - left_half;
+
+        for (int y = 0; y < m_height; ++y) {
+            int const top = std::max(0, y - lower_half);
+            int const bottom = std::min(m_height, y + upper_half);
+            for (int x = 0; x < m_width; ++x) {
+                int const left = std::max(0, x - left_half);
+                int const right = std::min(m_width, x + right_half);
+                long double sum = 0;
+                long double sqsum = 0;
+                for (int yy = top; yy < bottom; ++yy) {
+                    uint8_t const* line = gray.constScanLine(yy);
+                    for (int xx = left; xx < right; ++xx) {
+                        sum += line[xx];
+                        sqsum += line[xx] * line[xx];
+                    }
+                }
+                long double const area = (bottom - top) * (right - left);
+                long double const mean = sum / area;
+                m_means[y * m_width + x] = mean;
+                m_deviations[y * m_width + x] = sqrt(fabs(sqsum / area - mean * mean));
+            }
+        }
+    }
+
+    long double mean(int x, int y) const
+    {
+        return m_means[y * m_width + x];
+    }
+
+    long double deviation(int x, int y) const
+    {
+        return m_deviations[y * m_width + x];
+    }
+
+    long double maxDeviation() const
+    {
+        return *std::max_element(m_deviations.begin(), m_deviations.end());
+    }
+private:
+    int m_width;
+    int m_height;
+    std::vector<long double> m_means;
+    std::vector<long double> m_deviations;
+};
+
+QImage randomFullRangeGrayImage(int const width, int const height)
+{
+    QImage img(width, height, QImage::Format_Indexed8);
+    img.setColorTable(createGrayscalePalette());
+    for (int y = 0; y < height; ++y) {
+        uint8_t* line = img.scanLine(y);
+        for (int x = 0; x < width; ++x) {
+            line[x] = rand() % 256;
+        }
+    }
+    return img;
+}
+
+bool isBlack(BinaryImage const& img, int const x, int const y)
+{
+    uint32_t const* line = img.data() + img.wordsPerLine() * y;
+    return (line[x >> 5] >> (31 - (x & 31))) & 1;
+}
+
+/**
+ * Counts pixels that differ from the expectation for reasons
+ * other than rounding right at the threshold.
+ */
+template<typename ThresholdFunc>
+int countMismatches(
+    QImage const& gray, BinaryImage const& bw,
+    unsigned char const lower_bound, unsigned char const upper_bound,
+    ThresholdFunc threshold_func)
+{
+    int mismatches = 0;
+    for (int y = 0; y < gray.height(); ++y) {
+        uint8_t const* line = gray.constScanLine(y);
+        for (int x = 0; x < gray.width(); ++x) {
+            long double const threshold = threshold_func(x, y);
+            bool const expected = line[x] < lower_bound ||
+                                  (line[x] <= upper_bound && line[x] < threshold);
+            if (isBlack(bw, x, y) != expected && fabs(line[x] - threshold) > 1e-6) {
+                ++mismatches;
+            }
+        }
+    }
+    return mismatches;
+}
+
+} // anonymous namespace
+
 BOOST_AUTO_TEST_SUITE(BinarizeTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_sauvola_matches_reference)
+{
+    // Window sizes both smaller and larger than the image,
+    // and tall enough to span several strips.
+    QSize const window_sizes[] = { QSize(1, 1), QSize(7, 5), QSize(40, 90), QSize(300, 300) };
+
+    for (QSize const& window_size : window_sizes) {
+        QImage const gray(randomFullRangeGrayImage(77, 203));
+        BinaryImage const bw(binarizeSauvola(gray, window_size));
+        ReferenceStats const ref(gray, window_size);
+
+        int const mismatches = countMismatches(gray, bw, 0, 255, [&](int x, int y) {
+            return ref.mean(x, y) * (1.0 + 0.34 * (ref.deviation(x, y) / 128.0 - 1.0));
+        });
+        BOOST_CHECK_EQUAL(mismatches, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_wolf_matches_reference)
+{
+    QSize const window_sizes[] = { QSize(3, 3), QSize(31, 31), QSize(51, 130) };
+
+    for (QSize const& window_size : window_sizes) {
+        QImage const gray(randomFullRangeGrayImage(131, 190));
+        BinaryImage const bw(binarizeWolf(gray, window_size, 50, 254));
+        ReferenceStats const ref(gray, window_size);
+        long double const max_deviation = ref.maxDeviation();
+
+        int min_gray_level = 255;
+        for (int y = 0; y < gray.height(); ++y) {
+            uint8_t const* line = gray.constScanLine(y);
+            min_gray_level = std::min<int>(min_gray_level, *std::min_element(line, line + gray.width()));
+        }
+
+        int const mismatches = countMismatches(gray, bw, 50, 254, [&](int x, int y) {
+            long double const mean = ref.mean(x, y);
+            long double const a = 1.0 - ref.deviation(x, y) / max_deviation;
+            return mean - 0.3 * a * (mean - min_gray_level);
+        });
+        BOOST_CHECK_EQUAL(mismatches, 0);
+    }
+}
+
 #if 0
 BOOST_AUTO_TEST_CASE(test)
 {
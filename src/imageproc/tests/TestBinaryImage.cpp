@@ -161,6 +161,57 @@ BOOST_AUTO_TEST_CASE(test_content_bounding_box4)
     BOOST_CHECK(img.contentBoundingBox() == QRect(1, 1, 6, 6));
 }
 
+BOOST_AUTO_TEST_CASE(test_content_bounding_box_with_count)
+{
+    int num_pixels = -1;
+    BOOST_CHECK(BinaryImage().contentBoundingBox(BLACK, num_pixels).isNull());
+    BOOST_CHECK_EQUAL(num_pixels, 0);
+
+    BinaryImage const white(75, 20, WHITE);
+    BOOST_CHECK(white.contentBoundingBox(BLACK, num_pixels).isNull());
+    BOOST_CHECK_EQUAL(num_pixels, 0);
+    BOOST_CHECK(white.contentBoundingBox(WHITE, num_pixels) == white.rect());
+    BOOST_CHECK_EQUAL(num_pixels, 75 * 20);
+
+    // Widths that are and aren't multiples of 32.
+    static int const widths[] = { 1, 32, 33, 75, 128 };
+    for (int const width : widths) {
+        BinaryImage img(width, 40, WHITE);
+        img.fill(QRect(width / 3, 5, width / 2 + 1, 7), BLACK);
+        img.fill(QRect(width - 1, 30, 1, 2), BLACK);
+        BinaryImage const random(randomBinaryImage(width, 40));
+        for (BinaryImage const& image : { img, random }) {
+            for (BWColor const color : { BLACK, WHITE }) {
+                QRect const box(image.contentBoundingBox(color, num_pixels));
+                BOOST_CHECK(box == image.contentBoundingBox(color));
+                int const expected = color == BLACK
+                                     ? image.countBlackPixels() : image.countWhitePixels();
+                BOOST_CHECK_EQUAL(num_pixels, expected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_count_black_pixels)
+{
+    BinaryImage const img(randomBinaryImage(150, 10));
+    QImage const qimg(img.toQImage());
+
+    QRect const rects[] = {
+        img.rect(), QRect(0, 0, 1, 10), QRect(3, 2, 20, 5),
+        QRect(31, 0, 2, 10), QRect(5, 1, 140, 8), QRect(64, 3, 64, 1)
+    };
+    for (QRect const& rect : rects) {
+        int expected = 0;
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                expected += qimg.pixelIndex(x, y) == 1;
+            }
+        }
+        BOOST_CHECK_EQUAL(img.countBlackPixels(rect), expected);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
@@ -0,0 +1,233 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BucketQueue.h"
+#include "PriorityQueue.h"
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+namespace
+{
+
+/**
+ * A grid of costs, with a border of nodes that are never visited.
+ * The cost of a path is the highest node cost along it, as in
+ * TopBottomEdgeTracer.
+ */
+struct CostGrid {
+    int width;
+    int height;
+    int stride;
+    std::vector<float> nodeCosts;
+
+    CostGrid(int w, int h) : width(w), height(h), stride(w + 2), nodeCosts((w + 2) * (h + 2), -1.0f)
+    {
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                nodeCosts[(y + 1) * stride + x + 1] = float(rand() % 10000) / 9999.0f;
+            }
+        }
+    }
+
+    /**
+     * Initial path costs: zero for the leftmost column, infinity
+     * for everything else, and -1 for the border.
+     */
+    std::vector<float> initialPathCosts() const
+    {
+        std::vector<float> costs(nodeCosts.size(), -1.0f);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                costs[(y + 1) * stride + x + 1] = x == 0 ? 0.0f : 2.0f;
+            }
+        }
+        return costs;
+    }
+
+    int offsets[3];
+
+    void initOffsets()
+    {
+        // Rightwards only, like the neighbours of TopBottomEdgeTracer.
+        offsets[0] = -stride + 1;
+        offsets[1] = 1;
+        offsets[2] = stride + 1;
+    }
+};
+
+class HeapQueue : public PriorityQueue<uint32_t, HeapQueue>
+{
+public:
+    HeapQueue(float const* costs, std::vector<uint32_t>& heap_idx)
+        : m_pCosts(costs), m_rHeapIdx(heap_idx) {}
+
+    bool higherThan(uint32_t lhs, uint32_t rhs) const
+    {
+        return m_pCosts[lhs] < m_pCosts[rhs];
+    }
+
+    void setIndex(uint32_t node_idx, size_t heap_idx)
+    {
+        m_rHeapIdx[node_idx] = static_cast<uint32_t>(heap_idx);
+    }
+
+    void reposition(uint32_t node_idx)
+    {
+        PriorityQueue<uint32_t, HeapQueue>::reposition(m_rHeapIdx[node_idx]);
+    }
+private:
+    float const* m_pCosts;
+    std::vector<uint32_t>& m_rHeapIdx;
+};
+
+uint32_t const NOT_QUEUED = ~uint32_t(0);
+
+std::vector<float> shortestPathsWithHeap(CostGrid const& grid)
+{
+    std::vector<float> costs(grid.initialPathCosts());
+    std::vector<uint32_t> heap_idx(costs.size(), NOT_QUEUED);
+    HeapQueue queue(&costs[0], heap_idx);
+
+    for (int y = 0; y < grid.height; ++y) {
+        queue.push((y + 1) * grid.stride + 1);
+    }
+
+    while (!queue.empty()) {
+        uint32_t const idx = queue.front();
+        queue.pop();
+        heap_idx[idx] = NOT_QUEUED;
+
+        for (int i = 0; i < 3; ++i) {
+            uint32_t const nbh_idx = idx + grid.offsets[i];
+            float const new_cost = std::max(costs[idx], grid.nodeCosts[idx]);
+            if (new_cost < costs[nbh_idx]) {
+                costs[nbh_idx] = new_cost;
+                if (heap_idx[nbh_idx] == NOT_QUEUED) {
+                    queue.push(nbh_idx);
+                } else {
+                    queue.reposition(nbh_idx);
+                }
+            }
+        }
+    }
+
+    return costs;
+}
+
+std::vector<float> shortestPathsWithBuckets(CostGrid const& grid)
+{
+    int const num_buckets = 4096;
+    std::vector<float> costs(grid.initialPathCosts());
+    std::vector<uint8_t> queued(costs.size(), 0);
+    BucketQueue queue(num_buckets);
+
+    for (int y = 0; y < grid.height; ++y) {
+        uint32_t const idx = (y + 1) * grid.stride + 1;
+        queued[idx] = 1;
+        queue.push(idx, 0);
+    }
+
+    while (!queue.empty()) {
+        uint32_t const idx = queue.front();
+        queue.pop();
+        if (!queued[idx]) {
+            continue; // A stale entry.
+        }
+        queued[idx] = 0;
+
+        for (int i = 0; i < 3; ++i) {
+            uint32_t const nbh_idx = idx + grid.offsets[i];
+            float const new_cost = std::max(costs[idx], grid.nodeCosts[idx]);
+            if (new_cost < costs[nbh_idx]) {
+                costs[nbh_idx] = new_cost;
+                queued[nbh_idx] = 1;
+                queue.push(nbh_idx, int(new_cost * (num_buckets - 1)));
+            }
+        }
+    }
+
+    return costs;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(BucketQueueTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_pops_in_priority_order)
+{
+    BucketQueue queue(100);
+    std::vector<int> priorities(1000);
+    for (size_t i = 0; i < priorities.size(); ++i) {
+        priorities[i] = rand() % 100;
+        queue.push(uint32_t(i), priorities[i]);
+    }
+
+    int prev_priority = 0;
+    while (!queue.empty()) {
+        uint32_t const id = queue.front();
+        BOOST_REQUIRE_EQUAL(queue.frontPriority(), priorities[id]);
+        BOOST_REQUIRE(priorities[id] >= prev_priority);
+        prev_priority = priorities[id];
+        queue.pop();
+
+        // Monotone pushes are allowed while popping.
+        if (rand() % 4 == 0 && priorities[id] < 99) {
+            priorities.push_back(priorities[id] + 1);
+            queue.push(uint32_t(priorities.size() - 1), priorities.back());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_shortest_paths_match_heap)
+{
+    CostGrid grid(700, 1000);
+    grid.initOffsets();
+
+    clock_t const heap_start = clock();
+    std::vector<float> const expected(shortestPathsWithHeap(grid));
+    clock_t const heap_end = clock();
+    std::vector<float> const actual(shortestPathsWithBuckets(grid));
+    clock_t const buckets_end = clock();
+
+    BOOST_REQUIRE(expected == actual);
+
+    BOOST_TEST_MESSAGE(
+        "Shortest paths over " << grid.width << "x" << grid.height << ": PriorityQueue "
+                               << (heap_end - heap_start) * 1000 / CLOCKS_PER_SEC << " ms, BucketQueue "
+                               << (buckets_end - heap_end) * 1000 / CLOCKS_PER_SEC << " ms"
+    );
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
@@ -0,0 +1,142 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CcittG4Encoder.h"
+#include "BinaryImage.h"
+#include "BWColor.h"
+#include "Utils.h"
+#include <QTemporaryFile>
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+#include <QRect>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <tiff.h>
+#include <tiffio.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+using namespace utils;
+
+namespace
+{
+
+/**
+ * Writes \p image as a TIFF with its strips encoded by CcittG4Encoder,
+ * then has libtiff decode it.
+ */
+BinaryImage roundTrip(BinaryImage const& image, int const rows_per_strip)
+{
+    QTemporaryFile file;
+    if (!file.open()) {
+        return BinaryImage();
+    }
+    QByteArray const path(QFile::encodeName(file.fileName()));
+
+    int const width = image.width();
+    int const height = image.height();
+
+    TIFF* tif = TIFFOpen(path.constData(), "w");
+    if (!tif) {
+        return BinaryImage();
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, uint32(width));
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, uint32(height));
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, uint16(1));
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, uint16(1));
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_CCITTFAX4);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISWHITE);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, uint32(rows_per_strip));
+    for (int top = 0, strip = 0; top < height; top += rows_per_strip, ++strip) {
+        int const rows = std::min(rows_per_strip, height - top);
+        QByteArray data(CcittG4Encoder::encode(image, top, rows));
+        TIFFWriteRawStrip(tif, strip, data.data(), data.size());
+    }
+    TIFFClose(tif);
+
+    tif = TIFFOpen(path.constData(), "r");
+    if (!tif) {
+        return BinaryImage();
+    }
+    BinaryImage decoded(width, height);
+    std::vector<uint8_t> line((width + 7) / 8);
+    for (int y = 0; y < height; ++y) {
+        if (TIFFReadScanline(tif, &line[0], y) == -1) {
+            TIFFClose(tif);
+            return BinaryImage();
+        }
+        uint32_t* dst_line = decoded.data() + y * decoded.wordsPerLine();
+        for (int x = 0; x < width; ++x) {
+            if (line[x >> 3] & (0x80 >> (x & 7))) {
+                dst_line[x >> 5] |= uint32_t(0x80000000) >> (x & 31);
+            } else {
+                dst_line[x >> 5] &= ~(uint32_t(0x80000000) >> (x & 31));
+            }
+        }
+    }
+    TIFFClose(tif);
+
+    return decoded;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(CcittG4EncoderTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_random_images)
+{
+    int const widths[] = { 1, 31, 32, 33, 100 };
+    for (int const w : widths) {
+        BinaryImage const img(randomBinaryImage(w, 40));
+        BOOST_CHECK(roundTrip(img, 40) == img);
+        BOOST_CHECK(roundTrip(img, 7) == img);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_long_runs)
+{
+    // Runs longer than the largest makeup code, of both colors.
+    BinaryImage img(6000, 30, WHITE);
+    img.fill(QRect(0, 0, 6000, 3), BLACK);
+    img.fill(QRect(10, 5, 5900, 10), BLACK);
+    img.fill(QRect(2700, 8, 3, 20), WHITE);
+    img.fill(QRect(5999, 20, 1, 10), BLACK);
+    BOOST_CHECK(roundTrip(img, 30) == img);
+    BOOST_CHECK(roundTrip(img, 4) == img);
+}
+
+BOOST_AUTO_TEST_CASE(test_blank_image)
+{
+    BinaryImage const img(1000, 10, WHITE);
+    BOOST_CHECK(roundTrip(img, 10) == img);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
@@ -0,0 +1,122 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ConnCompExtractor.h"
+#include "ConnCompEraser.h"
+#include "ConnComp.h"
+#include "BinaryImage.h"
+#include "RasterOp.h"
+#include "BWColor.h"
+#include "Utils.h"
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+using namespace utils;
+
+static bool matchesEraser(BinaryImage const& img, Connectivity const conn)
+{
+    ConnCompExtractor const extractor(img, conn);
+    ConnCompEraser eraser(img, conn);
+
+    for (ConnComp const& cc : extractor.connComps()) {
+        ConnComp const expected(eraser.nextConnComp());
+        if (expected.isNull() || cc.rect() != expected.rect()
+            || cc.seed() != expected.seed() || cc.pixCount() != expected.pixCount()) {
+            return false;
+        }
+    }
+
+    return eraser.nextConnComp().isNull();
+}
+
+BOOST_AUTO_TEST_SUITE(ConnCompExtractorTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_null_image)
+{
+    ConnCompExtractor const extractor(BinaryImage(), CONN4, true);
+    BOOST_CHECK(extractor.size() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_small_image)
+{
+    static int const inp[] = {
+        0, 0, 1, 1, 0, 0, 0, 0, 0,
+        0, 0, 0, 1, 0, 0, 0, 0, 0,
+        0, 0, 0, 1, 0, 1, 1, 1, 1,
+        1, 1, 0, 1, 1, 0, 1, 0, 0,
+        0, 0, 1, 1, 0, 0, 1, 1, 0,
+        0, 1, 0, 1, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 1, 0, 1, 0,
+        1, 1, 1, 1, 1, 1, 1, 0, 0
+    };
+
+    BinaryImage const img(makeBinaryImage(inp, 9, 8));
+
+    ConnCompExtractor const extractor4(img, CONN4);
+    BOOST_REQUIRE(extractor4.size() == 6);
+    BOOST_CHECK(extractor4[0].rect() == QRect(2, 0, 3, 6));
+    BOOST_CHECK(extractor4[1].rect() == QRect(5, 2, 4, 3));
+    BOOST_CHECK(extractor4[2].rect() == QRect(0, 3, 2, 1));
+    BOOST_CHECK(extractor4[3].rect() == QRect(1, 5, 1, 1));
+    BOOST_CHECK(extractor4[4].rect() == QRect(0, 6, 7, 2));
+    BOOST_CHECK(extractor4[5].rect() == QRect(7, 6, 1, 1));
+
+    ConnCompExtractor const extractor8(img, CONN8);
+    BOOST_REQUIRE(extractor8.size() == 2);
+    BOOST_CHECK(extractor8[0].rect() == QRect(0, 0, 9, 6));
+    BOOST_CHECK(extractor8[1].rect() == QRect(0, 6, 8, 2));
+}
+
+BOOST_AUTO_TEST_CASE(test_random_images)
+{
+    for (int i = 0; i < 10; ++i) {
+        BinaryImage const img(randomBinaryImage(70, 40));
+        BOOST_CHECK(matchesEraser(img, CONN4));
+        BOOST_CHECK(matchesEraser(img, CONN8));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_conn_comp_images)
+{
+    BinaryImage const img(randomBinaryImage(70, 40));
+    ConnCompExtractor const extractor(img, CONN8, true);
+
+    BinaryImage reassembled(img.size(), WHITE);
+    for (size_t i = 0; i < extractor.size(); ++i) {
+        QRect const& rect = extractor[i].rect();
+        BinaryImage const cc_img(extractor.computeConnCompImage(i));
+        BOOST_REQUIRE(cc_img.size() == rect.size());
+        BOOST_CHECK(cc_img.countBlackPixels() == extractor[i].pixCount());
+        rasterOp<RopOr<RopSrc, RopDst> >(reassembled, rect, cc_img, QPoint(0, 0));
+    }
+
+    BOOST_CHECK(reassembled == img);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
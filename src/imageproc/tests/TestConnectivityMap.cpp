@@ -0,0 +1,162 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kernels.h"
+#include <QtGlobal>
+#include "ConnectivityMap.h"
+#include "CompactConnectivityMap.h"
+#include "BinaryImage.h"
+#include "BWColor.h"
+#include "Utils.h"
+#include <QRect>
+#include <stdint.h>
+#include <stdlib.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+using namespace utils;
+
+namespace
+{
+
+bool sameMaps(ConnectivityMap const& cmap1, ConnectivityMap const& cmap2)
+{
+    if (cmap1.size() != cmap2.size() || cmap1.maxLabel() != cmap2.maxLabel()) {
+        return false;
+    }
+
+    // Padding included.
+    int const num_units = cmap1.stride() * (cmap1.size().height() + 2);
+    uint32_t const* data1 = cmap1.paddedData();
+    uint32_t const* data2 = cmap2.paddedData();
+    for (int i = 0; i < num_units; ++i) {
+        if (data1[i] != data2[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BinaryImage blockyBinaryImage(int const width, int const height)
+{
+    BinaryImage img(width, height, WHITE);
+    for (int i = width * height / 50; i > 0; --i) {
+        QRect const rect(rand() % width, rand() % height, 1 + rand() % 8, 1 + rand() % 8);
+        img.fill(rect.intersected(img.rect()), BLACK);
+    }
+    return img;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(ConnectivityMapTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_small)
+{
+    static int const inp[] = {
+        1, 1, 0, 0, 1,
+        0, 1, 0, 1, 0,
+        0, 0, 0, 0, 0,
+        1, 0, 1, 1, 1,
+        1, 0, 0, 0, 1
+    };
+
+    static uint32_t const out4[] = {
+        1, 1, 0, 0, 2,
+        0, 1, 0, 3, 0,
+        0, 0, 0, 0, 0,
+        4, 0, 5, 5, 5,
+        4, 0, 0, 0, 5
+    };
+
+    static uint32_t const out8[] = {
+        1, 1, 0, 0, 2,
+        0, 1, 0, 2, 0,
+        0, 0, 0, 0, 0,
+        3, 0, 4, 4, 4,
+        3, 0, 0, 0, 4
+    };
+
+    BinaryImage const img(makeBinaryImage(inp, 5, 5));
+    for (int engine = 0; engine < 2; ++engine) {
+        ConnectivityMap::Engine const eng = ConnectivityMap::Engine(engine);
+        ConnectivityMap const cmap4(img, CONN4, eng);
+        ConnectivityMap const cmap8(img, CONN8, eng);
+        BOOST_CHECK_EQUAL(cmap4.maxLabel(), 5u);
+        BOOST_CHECK_EQUAL(cmap8.maxLabel(), 4u);
+        for (int y = 0; y < 5; ++y) {
+            for (int x = 0; x < 5; ++x) {
+                BOOST_CHECK_EQUAL(cmap4.data()[y * cmap4.stride() + x], out4[y * 5 + x]);
+                BOOST_CHECK_EQUAL(cmap8.data()[y * cmap8.stride() + x], out8[y * 5 + x]);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_engines_match)
+{
+    for (int i = 0; i < 30; ++i) {
+        int const width = 1 + rand() % 300;
+        int const height = 1 + rand() % 300;
+        BinaryImage const img(
+            i & 1 ? randomBinaryImage(width, height) : blockyBinaryImage(width, height)
+        );
+
+        for (int conn = 0; conn < 2; ++conn) {
+            Connectivity const c = conn ? CONN8 : CONN4;
+            ConnectivityMap const sequential(img, c, ConnectivityMap::ENGINE_SEQUENTIAL);
+            ConnectivityMap const parallel(img, c, ConnectivityMap::ENGINE_PARALLEL);
+            BOOST_REQUIRE(sameMaps(sequential, parallel));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_round_trip)
+{
+    // Isolated pixels on every other line and column give
+    // too many labels for 16 bits.
+    BinaryImage dotted(600, 600, WHITE);
+    for (int y = 0; y < dotted.height(); y += 2) {
+        for (int x = 0; x < dotted.width(); x += 2) {
+            dotted.fill(QRect(x, y, 1, 1), BLACK);
+        }
+    }
+
+    BinaryImage const images[] = { blockyBinaryImage(300, 200), dotted };
+    bool const narrow[] = { true, false };
+    for (int i = 0; i < 2; ++i) {
+        ConnectivityMap const cmap(images[i], CONN8);
+        CompactConnectivityMap const compact(cmap);
+        BOOST_CHECK(compact.isNarrow() == narrow[i]);
+        BOOST_CHECK(compact.maxLabel() == cmap.maxLabel());
+        BOOST_REQUIRE(sameMaps(ConnectivityMap(compact), cmap));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
@@ -0,0 +1,181 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GpuCompute.h"
+#include "GaussBlur.h"
+#include "Morphology.h"
+#include "Binarize.h"
+#include "BinaryImage.h"
+#include "GrayImage.h"
+#include "RasterOp.h"
+#include "Utils.h"
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+using namespace utils;
+
+namespace
+{
+
+// Large enough for the GPU path to be taken, with a width
+// that's not a multiple of 32.
+int const WIDTH = 1100;
+int const HEIGHT = 1000;
+
+/**
+ * Enables the GPU backend for its lifetime, restoring the CPU path afterwards.
+ * Returns false from available() if there is nothing to test.
+ */
+class GpuScope
+{
+public:
+    GpuScope()
+    {
+        GpuCompute::setEnabled(true);
+    }
+
+    ~GpuScope()
+    {
+        GpuCompute::setEnabled(false);
+    }
+
+    bool available() const
+    {
+        if (GpuCompute::deviceName().isEmpty()) {
+            BOOST_TEST_MESSAGE("No OpenCL device available, skipping.");
+            return false;
+        }
+        return true;
+    }
+};
+
+int maxDifference(GrayImage const& img1, GrayImage const& img2)
+{
+    int max_diff = 0;
+    for (int y = 0; y < img1.height(); ++y) {
+        uint8_t const* line1 = img1.data() + y * img1.stride();
+        uint8_t const* line2 = img2.data() + y * img2.stride();
+        for (int x = 0; x < img1.width(); ++x) {
+            max_diff = std::max(max_diff, abs(int(line1[x]) - int(line2[x])));
+        }
+    }
+    return max_diff;
+}
+
+int countDifferentPixels(BinaryImage const& img1, BinaryImage const& img2)
+{
+    BinaryImage diff(img1);
+    rasterOp<RopXor<RopSrc, RopDst> >(diff, img2);
+    return diff.countBlackPixels();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(GpuComputeTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_gauss_blur)
+{
+    GrayImage const src(randomGrayImage(WIDTH, HEIGHT));
+    GrayImage const cpu(gaussBlur(src, 3.0f, 7.0f));
+
+    GpuScope const gpu;
+    if (!gpu.available()) {
+        return;
+    }
+
+    GrayImage gpu_result;
+    BOOST_REQUIRE(GpuCompute::gaussBlur(src, 3.0f, 7.0f, gpu_result));
+    BOOST_REQUIRE(gpu_result.size() == cpu.size());
+    BOOST_CHECK(maxDifference(gpu_result, cpu) <= 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_morphology)
+{
+    GrayImage const src(randomGrayImage(WIDTH, HEIGHT));
+    QSize const brick_size(7, 4);
+    Brick const brick(QSize(5, 9));
+    QRect const dst_area(src.rect().adjusted(-3, 5, 10, -2));
+
+    GrayImage const cpu_dilated(dilateGray(src, brick, dst_area, 0x00));
+    GrayImage const cpu_eroded(erodeGray(src, brick, dst_area, 0xff));
+    GrayImage const cpu_opened(openGray(src, brick_size, dst_area, 0xff));
+    GrayImage const cpu_closed(closeGray(src, brick_size, dst_area, 0x00));
+
+    GpuScope const gpu;
+    if (!gpu.available()) {
+        return;
+    }
+
+    GrayImage dilated;
+    GrayImage eroded;
+    GrayImage opened;
+    GrayImage closed;
+    BOOST_REQUIRE(GpuCompute::dilateGray(src, brick, dst_area, 0x00, dilated));
+    BOOST_REQUIRE(GpuCompute::erodeGray(src, brick, dst_area, 0xff, eroded));
+    BOOST_REQUIRE(GpuCompute::openGray(src, brick_size, dst_area, 0xff, opened));
+    BOOST_REQUIRE(GpuCompute::closeGray(src, brick_size, dst_area, 0x00, closed));
+
+    BOOST_CHECK(dilated == cpu_dilated);
+    BOOST_CHECK(eroded == cpu_eroded);
+    BOOST_CHECK(opened == cpu_opened);
+    BOOST_CHECK(closed == cpu_closed);
+}
+
+BOOST_AUTO_TEST_CASE(test_binarize)
+{
+    QImage const src(randomGrayImage(WIDTH, HEIGHT));
+    QSize const window_size(41, 31);
+
+    BinaryImage const cpu_sauvola(binarizeSauvola(src, window_size));
+    BinaryImage const cpu_wolf(binarizeWolf(src, window_size, 1, 254));
+
+    GpuScope const gpu;
+    if (!gpu.available()) {
+        return;
+    }
+
+    BinaryImage sauvola;
+    BinaryImage wolf;
+    BOOST_REQUIRE(GpuCompute::binarizeSauvola(src, window_size, sauvola));
+    BOOST_REQUIRE(GpuCompute::binarizeWolf(src, window_size, 1, 254, wolf));
+
+    // Devices without double precision may disagree with the CPU
+    // on pixels within rounding error of the threshold.
+    int const tolerance = WIDTH * HEIGHT / 1000;
+    BOOST_CHECK(countDifferentPixels(sauvola, cpu_sauvola) <= tolerance);
+    BOOST_CHECK(countDifferentPixels(wolf, cpu_wolf) <= tolerance);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
@@ -17,8 +17,11 @@
 */
 
 #include "Grayscale.h"
+#include "GrayImage.h"
 #include "Utils.h"
 #include <QImage>
+#include <QColor>
+#include <QVector>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -81,6 +84,90 @@ BOOST_AUTO_TEST_CASE(test_argb32_to_grayscale)
     BOOST_CHECK(toGrayscale(argb32) == gray);
 }
 
+BOOST_AUTO_TEST_CASE(test_rgb888_to_grayscale)
+{
+    int const w = 37;
+    int const h = 20;
+    QImage rgb888(w, h, QImage::Format_RGB888);
+    QImage gray(w, h, QImage::Format_Indexed8);
+    gray.setColorTable(createGrayscalePalette());
+
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            QRgb const rgb = qRgb(rand() & 0xff, rand() & 0xff, rand() & 0xff);
+            rgb888.setPixel(x, y, rgb);
+            gray.setPixel(x, y, qGray(rgb));
+        }
+    }
+
+    BOOST_CHECK(toGrayscale(rgb888) == gray);
+}
+
+BOOST_AUTO_TEST_CASE(test_indexed8_to_grayscale)
+{
+    int const w = 41;
+    int const h = 15;
+    QVector<QRgb> color_table;
+    for (int i = 0; i < 100; ++i) {
+        color_table.push_back(qRgb(rand() & 0xff, rand() & 0xff, rand() & 0xff));
+    }
+
+    QImage indexed8(w, h, QImage::Format_Indexed8);
+    indexed8.setColorTable(color_table);
+    QImage gray(w, h, QImage::Format_Indexed8);
+    gray.setColorTable(createGrayscalePalette());
+
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int const idx = rand() % color_table.size();
+            indexed8.setPixel(x, y, idx);
+            gray.setPixel(x, y, qGray(color_table[idx]));
+        }
+    }
+
+    BOOST_CHECK(toGrayscale(indexed8) == gray);
+}
+
+BOOST_AUTO_TEST_CASE(test_histogram)
+{
+    QImage const img(randomGrayImage(1037, 523));
+
+    int expected[256] = { 0 };
+    for (int y = 0; y < img.height(); ++y) {
+        uint8_t const* line = img.constScanLine(y);
+        for (int x = 0; x < img.width(); ++x) {
+            ++expected[line[x]];
+        }
+    }
+
+    GrayscaleHistogram const hist(img);
+    for (int i = 0; i < 256; ++i) {
+        BOOST_REQUIRE_EQUAL(hist[i], expected[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_stretch_gray_range_mapping)
+{
+    GrayImage const img(randomGrayImage(41, 23));
+
+    uint8_t mapping[256];
+    stretchGrayRangeMapping(img, mapping, 0.01, 0.01);
+
+    GrayImage expected(img);
+    for (int y = 0; y < expected.height(); ++y) {
+        uint8_t* line = expected.data() + y * expected.stride();
+        for (int x = 0; x < expected.width(); ++x) {
+            line[x] = mapping[line[x]];
+        }
+    }
+    BOOST_CHECK(stretchGrayRange(img, 0.01, 0.01) == expected);
+
+    // Operations like min and max rely on this.
+    for (int i = 1; i < 256; ++i) {
+        BOOST_REQUIRE(mapping[i - 1] <= mapping[i]);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
@@ -0,0 +1,267 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Jbig2Encoder.h"
+#include "BinaryImage.h"
+#include "BWColor.h"
+#include "Utils.h"
+#include <QByteArray>
+#include <QRect>
+#include <vector>
+#include <stdint.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+using namespace utils;
+
+namespace
+{
+
+struct QeEntry {
+    unsigned qe;
+    int nmps;
+    int nlps;
+    int switchMps;
+};
+
+QeEntry const qeTable[47] = {
+    { 0x5601, 1, 1, 1 }, { 0x3401, 2, 6, 0 }, { 0x1801, 3, 9, 0 },
+    { 0x0ac1, 4, 12, 0 }, { 0x0521, 5, 29, 0 }, { 0x0221, 38, 33, 0 },
+    { 0x5601, 7, 6, 1 }, { 0x5401, 8, 14, 0 }, { 0x4801, 9, 14, 0 },
+    { 0x3801, 10, 14, 0 }, { 0x3001, 11, 17, 0 }, { 0x2401, 12, 18, 0 },
+    { 0x1c01, 13, 20, 0 }, { 0x1601, 29, 21, 0 }, { 0x5601, 15, 14, 1 },
+    { 0x5401, 16, 14, 0 }, { 0x5101, 17, 15, 0 }, { 0x4801, 18, 16, 0 },
+    { 0x3801, 19, 17, 0 }, { 0x3401, 20, 18, 0 }, { 0x3001, 21, 19, 0 },
+    { 0x2801, 22, 19, 0 }, { 0x2401, 23, 20, 0 }, { 0x2201, 24, 21, 0 },
+    { 0x1c01, 25, 22, 0 }, { 0x1801, 26, 23, 0 }, { 0x1601, 27, 24, 0 },
+    { 0x1401, 28, 25, 0 }, { 0x1201, 29, 26, 0 }, { 0x1101, 30, 27, 0 },
+    { 0x0ac1, 31, 28, 0 }, { 0x09c1, 32, 29, 0 }, { 0x08a1, 33, 30, 0 },
+    { 0x0521, 34, 31, 0 }, { 0x0441, 35, 32, 0 }, { 0x02a1, 36, 33, 0 },
+    { 0x0221, 37, 34, 0 }, { 0x0141, 38, 35, 0 }, { 0x0111, 39, 36, 0 },
+    { 0x0085, 40, 37, 0 }, { 0x0049, 41, 38, 0 }, { 0x0025, 42, 39, 0 },
+    { 0x0015, 43, 40, 0 }, { 0x0009, 44, 41, 0 }, { 0x0005, 45, 42, 0 },
+    { 0x0001, 45, 43, 0 }, { 0x5601, 46, 46, 0 }
+};
+
+/**
+ * A straightforward MQ decoder, following the decoding procedures
+ * of T.88 Annex E.3.
+ */
+class MqDecoder
+{
+public:
+    explicit MqDecoder(QByteArray const& data)
+        :   m_data(data),
+            m_pos(0),
+            m_index(1 << 16, 0),
+            m_mps(1 << 16, 0)
+    {
+        m_c = byteAt(0) << 16;
+        byteIn();
+        m_c <<= 7;
+        m_ct -= 7;
+        m_a = 0x8000;
+    }
+
+    int decode(int const cx)
+    {
+        QeEntry const& entry = qeTable[m_index[cx]];
+        int bit;
+        m_a -= entry.qe;
+        if ((m_c >> 16) < entry.qe) {
+            if (m_a < entry.qe) {
+                bit = m_mps[cx];
+                m_index[cx] = entry.nmps;
+            } else {
+                bit = 1 - m_mps[cx];
+                switchAndGoTo(cx, entry);
+            }
+            m_a = entry.qe;
+            renormalize();
+        } else {
+            m_c -= entry.qe << 16;
+            if (m_a & 0x8000) {
+                return m_mps[cx];
+            }
+            if (m_a < entry.qe) {
+                bit = 1 - m_mps[cx];
+                switchAndGoTo(cx, entry);
+            } else {
+                bit = m_mps[cx];
+                m_index[cx] = entry.nmps;
+            }
+            renormalize();
+        }
+        return bit;
+    }
+private:
+    unsigned byteAt(int const pos) const
+    {
+        return pos < m_data.size() ? uint8_t(m_data[pos]) : 0xff;
+    }
+
+    void byteIn()
+    {
+        if (byteAt(m_pos) == 0xff) {
+            if (byteAt(m_pos + 1) > 0x8f) {
+                m_c += 0xff00;
+                m_ct = 8;
+            } else {
+                ++m_pos;
+                m_c += byteAt(m_pos) << 9;
+                m_ct = 7;
+            }
+        } else {
+            ++m_pos;
+            m_c += byteAt(m_pos) << 8;
+            m_ct = 8;
+        }
+    }
+
+    void renormalize()
+    {
+        do {
+            if (m_ct == 0) {
+                byteIn();
+            }
+            m_a <<= 1;
+            m_c <<= 1;
+            --m_ct;
+        } while (!(m_a & 0x8000));
+    }
+
+    void switchAndGoTo(int const cx, QeEntry const& entry)
+    {
+        if (entry.switchMps) {
+            m_mps[cx] ^= 1;
+        }
+        m_index[cx] = entry.nlps;
+    }
+
+    QByteArray m_data;
+    int m_pos;
+    std::vector<int> m_index;
+    std::vector<int> m_mps;
+    uint32_t m_a;
+    uint32_t m_c;
+    int m_ct;
+};
+
+int getPixel(BinaryImage const& img, int const x, int const y)
+{
+    if (x < 0 || x >= img.width() || y < 0) {
+        return 0;
+    }
+    uint32_t const word = img.data()[y * img.wordsPerLine() + (x >> 5)];
+    return (word >> (31 - (x & 31))) & 1;
+}
+
+/**
+ * Decodes a template 0 generic region with the default adaptive
+ * pixels, forming the contexts pixel by pixel.
+ */
+BinaryImage decodeGenericRegion(QByteArray const& data, int const width, int const height)
+{
+    MqDecoder decoder(data);
+    BinaryImage img(width, height, WHITE);
+    for (int y = 0; y < height; ++y) {
+        uint32_t* line = img.data() + y * img.wordsPerLine();
+        for (int x = 0; x < width; ++x) {
+            int const cx =
+                getPixel(img, x - 1, y) | (getPixel(img, x - 2, y) << 1)
+                | (getPixel(img, x - 3, y) << 2) | (getPixel(img, x - 4, y) << 3)
+                | (getPixel(img, x + 3, y - 1) << 4) | (getPixel(img, x + 2, y - 1) << 5)
+                | (getPixel(img, x + 1, y - 1) << 6) | (getPixel(img, x, y - 1) << 7)
+                | (getPixel(img, x - 1, y - 1) << 8) | (getPixel(img, x - 2, y - 1) << 9)
+                | (getPixel(img, x - 3, y - 1) << 10) | (getPixel(img, x + 2, y - 2) << 11)
+                | (getPixel(img, x + 1, y - 2) << 12) | (getPixel(img, x, y - 2) << 13)
+                | (getPixel(img, x - 1, y - 2) << 14) | (getPixel(img, x - 2, y - 2) << 15);
+            if (decoder.decode(cx)) {
+                line[x >> 5] |= uint32_t(0x80000000) >> (x & 31);
+            }
+        }
+    }
+    return img;
+}
+
+uint32_t readUint32(QByteArray const& data, int const pos)
+{
+    return (uint32_t(uint8_t(data[pos])) << 24) | (uint32_t(uint8_t(data[pos + 1])) << 16)
+           | (uint32_t(uint8_t(data[pos + 2])) << 8) | uint32_t(uint8_t(data[pos + 3]));
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(Jbig2EncoderTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_generic_region_round_trip)
+{
+    int const widths[] = { 1, 3, 31, 32, 33, 100 };
+    for (int const w : widths) {
+        BinaryImage const img(randomBinaryImage(w, 30));
+        QByteArray const data(Jbig2Encoder::encodeGenericRegion(img));
+        BOOST_REQUIRE(data.size() >= 2);
+        BOOST_CHECK(data.endsWith("\xff\xac"));
+        BOOST_CHECK(decodeGenericRegion(data, w, 30) == img);
+    }
+
+    BinaryImage img(500, 100, WHITE);
+    img.fill(QRect(20, 10, 400, 5), BLACK);
+    img.fill(QRect(100, 30, 3, 60), BLACK);
+    img.fill(QRect(499, 0, 1, 100), BLACK);
+    BOOST_CHECK(decodeGenericRegion(Jbig2Encoder::encodeGenericRegion(img), 500, 100) == img);
+}
+
+BOOST_AUTO_TEST_CASE(test_embedded_segments)
+{
+    BinaryImage const img(randomBinaryImage(77, 13));
+    QByteArray const data(Jbig2Encoder::encodeEmbedded(img));
+
+    // Page information segment.
+    BOOST_REQUIRE(data.size() > 11 + 19 + 11 + 26);
+    BOOST_CHECK_EQUAL(readUint32(data, 0), 0u);
+    BOOST_CHECK_EQUAL(int(data[4]), 48);
+    BOOST_CHECK_EQUAL(int(data[6]), 1);
+    BOOST_CHECK_EQUAL(readUint32(data, 7), 19u);
+    BOOST_CHECK_EQUAL(readUint32(data, 11), 77u);
+    BOOST_CHECK_EQUAL(readUint32(data, 15), 13u);
+
+    // Immediate generic region segment.
+    int const seg = 11 + 19;
+    BOOST_CHECK_EQUAL(readUint32(data, seg), 1u);
+    BOOST_CHECK_EQUAL(int(data[seg + 4]), 38);
+    BOOST_CHECK_EQUAL(int(readUint32(data, seg + 7)), data.size() - seg - 11);
+    BOOST_CHECK_EQUAL(readUint32(data, seg + 11), 77u);
+    BOOST_CHECK_EQUAL(readUint32(data, seg + 15), 13u);
+
+    int const region_data = seg + 11 + 17 + 1 + 8;
+    BOOST_CHECK(decodeGenericRegion(data.mid(region_data), 77, 13) == img);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
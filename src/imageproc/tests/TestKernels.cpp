@@ -0,0 +1,255 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Kernels.h"
+#include <QtGlobal>
+#include <QColor>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+namespace
+{
+
+uint32_t randomWord()
+{
+    return (uint32_t(rand() & 0xffff) << 16) | uint32_t(rand() & 0xffff);
+}
+
+std::vector<uint32_t> randomWords(int const count)
+{
+    std::vector<uint32_t> words(count);
+    for (int i = 0; i < count; ++i) {
+        words[i] = randomWord();
+    }
+    return words;
+}
+
+bool getBit(uint32_t const* line, int const x)
+{
+    return (line[x >> 5] >> (31 - (x & 31))) & 1;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(KernelsTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_scalar_always_available)
+{
+    BOOST_REQUIRE(Kernels::forLevel(Kernels::SCALAR));
+    BOOST_CHECK(Kernels::forLevel(Kernels::NUM_LEVELS) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_scalar_rgb_to_gray)
+{
+    std::vector<uint32_t> const src(randomWords(1000));
+    std::vector<uint8_t> dst(src.size());
+
+    Kernels::forLevel(Kernels::SCALAR)->rgbToGray(&src[0], &dst[0], int(src.size()));
+
+    for (size_t i = 0; i < src.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(int(dst[i]), qGray(src[i]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_scalar_reduce_threshold)
+{
+    int const src_words = 7;
+    std::vector<uint32_t> const top(randomWords(src_words));
+    std::vector<uint32_t> const bottom(randomWords(src_words));
+
+    for (int threshold = 1; threshold <= 4; ++threshold) {
+        std::vector<uint32_t> dst((src_words + 1) / 2, 0);
+        Kernels::forLevel(Kernels::SCALAR)->reduceThreshold(
+            &top[0], &bottom[0], &dst[0], src_words, threshold
+        );
+
+        for (int x = 0; x < src_words * 16; ++x) {
+            int const black = getBit(&top[0], x * 2) + getBit(&top[0], x * 2 + 1)
+                              + getBit(&bottom[0], x * 2) + getBit(&bottom[0], x * 2 + 1);
+            BOOST_REQUIRE_EQUAL(getBit(&dst[0], x), black >= threshold);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_scalar_combine_mixed)
+{
+    int const width = 77;
+    std::vector<uint32_t> const bw_content(randomWords(3));
+    std::vector<uint32_t> const bw_mask(randomWords(3));
+    std::vector<uint32_t> rgb(randomWords(width + 1));
+    std::vector<uint8_t> gray(width + 1);
+    for (int x = 0; x <= width; ++x) {
+        // Make sure pure black and white get tested.
+        if (x % 3 == 0) {
+            rgb[x] &= 0xff000000;
+        } else if (x % 3 == 1) {
+            rgb[x] |= 0x00ffffff;
+        }
+        gray[x] = static_cast<uint8_t>(rgb[x]);
+    }
+    std::vector<uint32_t> const orig_rgb(rgb);
+    std::vector<uint8_t> const orig_gray(gray);
+
+    Kernels const& scalar = *Kernels::forLevel(Kernels::SCALAR);
+    scalar.combineMixedRgb(&rgb[0], &bw_content[0], &bw_mask[0], width);
+    scalar.combineMixedGray(&gray[0], &bw_content[0], &bw_mask[0], width);
+
+    for (int x = 0; x < width; ++x) {
+        if (getBit(&bw_mask[0], x)) {
+            bool const black = getBit(&bw_content[0], x);
+            BOOST_REQUIRE_EQUAL(rgb[x], black ? 0xff000000u : 0xffffffffu);
+            BOOST_REQUIRE_EQUAL(int(gray[x]), black ? 0x00 : 0xff);
+        } else {
+            uint32_t const orig_rgb_bits = orig_rgb[x] & 0x00ffffff;
+            if (orig_rgb_bits == 0) {
+                BOOST_REQUIRE_EQUAL(rgb[x], 0xff010101u);
+            } else if (orig_rgb_bits == 0x00ffffff) {
+                BOOST_REQUIRE_EQUAL(rgb[x], 0xfffefefeu);
+            } else {
+                BOOST_REQUIRE_EQUAL(rgb[x], orig_rgb[x]);
+            }
+
+            int const expected_gray = orig_gray[x] == 0x00 ? 0x01
+                                      : (orig_gray[x] == 0xff ? 0xfe : orig_gray[x]);
+            BOOST_REQUIRE_EQUAL(int(gray[x]), expected_gray);
+        }
+    }
+
+    // Pixels past the width stay as they were.
+    BOOST_CHECK_EQUAL(rgb[width], orig_rgb[width]);
+    BOOST_CHECK_EQUAL(int(gray[width]), int(orig_gray[width]));
+}
+
+BOOST_AUTO_TEST_CASE(test_scalar_count_bits)
+{
+    std::vector<uint32_t> const words(randomWords(100));
+
+    int expected = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        for (int bit = 0; bit < 32; ++bit) {
+            expected += (words[i] >> bit) & 1;
+        }
+    }
+
+    Kernels const& scalar = *Kernels::forLevel(Kernels::SCALAR);
+    BOOST_CHECK_EQUAL(scalar.countBits(&words[0], int(words.size())), expected);
+    BOOST_CHECK_EQUAL(scalar.countBits(&words[0], 0), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_all_levels_match_scalar)
+{
+    Kernels const& scalar = *Kernels::forLevel(Kernels::SCALAR);
+
+    std::vector<uint32_t> const pixels(randomWords(300));
+    std::vector<uint32_t> const top(randomWords(64));
+    std::vector<uint32_t> const bottom(randomWords(64));
+
+    for (int level = Kernels::SCALAR + 1; level < Kernels::NUM_LEVELS; ++level) {
+        Kernels const* kernels = Kernels::forLevel(Kernels::Level(level));
+        if (!kernels) {
+            continue;
+        }
+
+        BOOST_TEST_MESSAGE("Checking " << Kernels::levelName(kernels->level));
+
+        // Odd sizes and offsets exercise unaligned heads and tails.
+        for (int offset = 0; offset < 4; ++offset) {
+            for (int count = 0; count < int(pixels.size()) - offset; count += 37) {
+                std::vector<uint8_t> expected(count + 1, 0);
+                std::vector<uint8_t> actual(count + 1, 0);
+                scalar.rgbToGray(&pixels[offset], &expected[0], count);
+                kernels->rgbToGray(&pixels[offset], &actual[0], count);
+                BOOST_REQUIRE(expected == actual);
+
+                uint8_t const* bytes = reinterpret_cast<uint8_t const*>(&pixels[0]) + offset;
+                scalar.rgb888ToGray(bytes, &expected[0], count);
+                kernels->rgb888ToGray(bytes, &actual[0], count);
+                BOOST_REQUIRE(expected == actual);
+            }
+        }
+
+        for (int count = 0; count < int(pixels.size()); count += 29) {
+            // Pure black and white are what these kernels act on.
+            std::vector<uint32_t> expected(pixels);
+            for (size_t i = 0; i < expected.size(); i += 3) {
+                expected[i] = (i & 1) ? (expected[i] | 0x00ffffff) : (expected[i] & 0xff000000);
+            }
+            std::vector<uint32_t> actual(expected);
+            std::vector<uint8_t> expected_gray(expected.begin(), expected.end());
+            std::vector<uint8_t> actual_gray(expected_gray);
+
+            scalar.reserveBlackAndWhiteRgb(&expected[0], count);
+            kernels->reserveBlackAndWhiteRgb(&actual[0], count);
+            BOOST_REQUIRE(expected == actual);
+            scalar.reserveBlackAndWhiteGray(&expected_gray[0], count);
+            kernels->reserveBlackAndWhiteGray(&actual_gray[0], count);
+            BOOST_REQUIRE(expected_gray == actual_gray);
+
+            scalar.combineMixedRgb(&expected[0], &top[0], &bottom[0], count);
+            kernels->combineMixedRgb(&actual[0], &top[0], &bottom[0], count);
+            BOOST_REQUIRE(expected == actual);
+            scalar.combineMixedGray(&expected_gray[0], &top[0], &bottom[0], count);
+            kernels->combineMixedGray(&actual_gray[0], &top[0], &bottom[0], count);
+            BOOST_REQUIRE(expected_gray == actual_gray);
+        }
+
+        for (int offset = 0; offset < 4; ++offset) {
+            for (int count = 0; count < int(pixels.size()) - offset; count += 23) {
+                BOOST_REQUIRE_EQUAL(
+                    kernels->countBits(&pixels[offset], count),
+                    scalar.countBits(&pixels[offset], count)
+                );
+            }
+        }
+
+        for (int threshold = 1; threshold <= 4; ++threshold) {
+            for (int src_words = 0; src_words <= int(top.size()); ++src_words) {
+                std::vector<uint32_t> expected(top.size() / 2 + 1, 0);
+                std::vector<uint32_t> actual(top.size() / 2 + 1, 0);
+                scalar.reduceThreshold(&top[0], &bottom[0], &expected[0], src_words, threshold);
+                kernels->reduceThreshold(&top[0], &bottom[0], &actual[0], src_words, threshold);
+                BOOST_REQUIRE(expected == actual);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_max_level)
+{
+    Kernels::setMaxLevel(Kernels::SCALAR);
+    BOOST_CHECK_EQUAL(int(Kernels::active().level), int(Kernels::SCALAR));
+
+    Kernels::setMaxLevel(Kernels::Level(Kernels::NUM_LEVELS - 1));
+    BOOST_CHECK(Kernels::forLevel(Kernels::active().level) == &Kernels::active());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
@@ -0,0 +1,126 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LocalMinMaxGeneric.h"
+#include <QRect>
+#include <QSize>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+namespace
+{
+
+template<typename T, typename MinMaxSelector>
+std::vector<T> bruteForceMinMax(
+    MinMaxSelector selector, QRect const& neighborhood, T const outside_values,
+    std::vector<T> const& input, int const width, int const height)
+{
+    std::vector<T> output(input.size());
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            bool first = true;
+            T extremum = outside_values;
+            for (int dy = neighborhood.top(); dy <= neighborhood.bottom(); ++dy) {
+                for (int dx = neighborhood.left(); dx <= neighborhood.right(); ++dx) {
+                    int const xx = x + dx;
+                    int const yy = y + dy;
+                    T const val = xx < 0 || yy < 0 || xx >= width || yy >= height
+                                  ? outside_values : input[yy * width + xx];
+                    extremum = first ? val : selector(extremum, val);
+                    first = false;
+                }
+            }
+            output[y * width + x] = extremum;
+        }
+    }
+    return output;
+}
+
+template<typename T, typename MinMaxSelector>
+bool matchesBruteForce(MinMaxSelector selector, T const outside_values, T (*random_value)())
+{
+    int const width = 1 + rand() % 40;
+    int const height = 1 + rand() % 40;
+    QRect neighborhood(
+        -(rand() % 8), -(rand() % 8), 1 + rand() % 12, 1 + rand() % 12
+    );
+    if (rand() % 5 == 0) {
+        // Not containing the origin, possibly not even overlapping the grid.
+        neighborhood.moveTo(rand() % 50 - 25, rand() % 50 - 25);
+    }
+
+    std::vector<T> input(width * height);
+    std::generate(input.begin(), input.end(), random_value);
+
+    std::vector<T> output(input.size());
+    localMinMaxGeneric(
+        selector, neighborhood, outside_values,
+        &input[0], width, QSize(width, height), &output[0], width
+    );
+
+    return output == bruteForceMinMax(
+        selector, neighborhood, outside_values, input, width, height
+    );
+}
+
+uint8_t randomByte()
+{
+    return static_cast<uint8_t>(rand());
+}
+
+float randomFloat()
+{
+    return rand() / float(RAND_MAX) - 0.5f;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(LocalMinMaxGenericTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_uint8)
+{
+    for (int i = 0; i < 500; ++i) {
+        BOOST_REQUIRE(matchesBruteForce(MinSelector(), randomByte(), &randomByte));
+        BOOST_REQUIRE(matchesBruteForce(MaxSelector(), randomByte(), &randomByte));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_float)
+{
+    for (int i = 0; i < 500; ++i) {
+        BOOST_REQUIRE(matchesBruteForce(MinSelector(), randomFloat(), &randomFloat));
+        BOOST_REQUIRE(matchesBruteForce(MaxSelector(), randomFloat(), &randomFloat));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
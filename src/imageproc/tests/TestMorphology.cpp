@@ -24,6 +24,10 @@
 #include <QImage>
 #include <QSize>
 #include <QPoint>
+#include <QRect>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -36,6 +40,75 @@ namespace tests
 
 using namespace utils;
 
+namespace
+{
+
+bool isBlack(BinaryImage const& img, int const x, int const y, BWColor const surroundings)
+{
+    if (!img.rect().contains(x, y)) {
+        return surroundings == BLACK;
+    }
+    uint32_t const* line = img.data() + img.wordsPerLine() * y;
+    return (line[x >> 5] >> (31 - (x & 31))) & 1;
+}
+
+/**
+ * A brute force dilation or erosion to check the real thing against.
+ */
+BinaryImage bruteForceDilateOrErode(
+    BinaryImage const& src, Brick const& brick,
+    BWColor const surroundings, bool const dilate)
+{
+    BinaryImage dst(src.size(), WHITE);
+    for (int y = 0; y < src.height(); ++y) {
+        for (int x = 0; x < src.width(); ++x) {
+            bool black = !dilate;
+            for (int dy = brick.minY(); dy <= brick.maxY(); ++dy) {
+                for (int dx = brick.minX(); dx <= brick.maxX(); ++dx) {
+                    if (dilate) {
+                        black = black || isBlack(src, x - dx, y - dy, surroundings);
+                    } else {
+                        black = black && isBlack(src, x - dx, y - dy, surroundings);
+                    }
+                }
+            }
+            if (black) {
+                dst.fill(QRect(x, y, 1, 1), BLACK);
+            }
+        }
+    }
+    return dst;
+}
+
+/**
+ * A brute force gray dilation (darkest) or erosion (lightest).
+ * Only symmetric bricks are supported.
+ */
+GrayImage bruteForceDilateOrErodeGray(
+    GrayImage const& src, Brick const& brick,
+    uint8_t const surroundings, bool const dilate)
+{
+    GrayImage dst(src.size());
+    for (int y = 0; y < src.height(); ++y) {
+        for (int x = 0; x < src.width(); ++x) {
+            uint8_t extremum = dilate ? 0xff : 0x00;
+            for (int dy = brick.minY(); dy <= brick.maxY(); ++dy) {
+                for (int dx = brick.minX(); dx <= brick.maxX(); ++dx) {
+                    uint8_t pixel = surroundings;
+                    if (src.rect().contains(x + dx, y + dy)) {
+                        pixel = src.data()[(y + dy) * src.stride() + x + dx];
+                    }
+                    extremum = dilate ? std::min(extremum, pixel) : std::max(extremum, pixel);
+                }
+            }
+            dst.data()[y * dst.stride() + x] = extremum;
+        }
+    }
+    return dst;
+}
+
+} // anonymous namespace
+
 BOOST_AUTO_TEST_SUITE(MorphologyTestSuite);
 
 BOOST_AUTO_TEST_CASE(test_dilate_1x1)
@@ -323,6 +396,26 @@ BOOST_AUTO_TEST_CASE(test_dilate_3x3_gray_shrinked)
     BOOST_CHECK(dilateGray(img, QSize(3, 3), dst_area) == control);
 }
 
+BOOST_AUTO_TEST_CASE(test_large_gray_matches_brute_force)
+{
+    // Wider than a column block and taller than a row strip,
+    // with bricks both smaller and larger than the image.
+    GrayImage img(QSize(141, 97));
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            img.data()[y * img.stride() + x] = rand() % 256;
+        }
+    }
+
+    QSize const brick_sizes[] = { QSize(3, 3), QSize(1, 25), QSize(31, 1), QSize(21, 15), QSize(201, 151) };
+
+    for (QSize const& brick_size : brick_sizes) {
+        Brick const brick(brick_size);
+        BOOST_CHECK(dilateGray(img, brick, 0x80) == bruteForceDilateOrErodeGray(img, brick, 0x80, true));
+        BOOST_CHECK(erodeGray(img, brick, 0x80) == bruteForceDilateOrErodeGray(img, brick, 0x80, false));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_open_1x2_gray)
 {
     static int const inp[] = {
@@ -641,6 +734,33 @@ BOOST_AUTO_TEST_CASE(test_large_dilate)
     BOOST_CHECK(dilateBrick(img, brick, img.rect(), WHITE) == control);
 }
 
+BOOST_AUTO_TEST_CASE(test_banded_dilate_erode)
+{
+    // Tall enough to be split into several bands.  Sparse noise plus
+    // a few blocks, so neither dilation nor erosion saturates.
+    BinaryImage img(150, 419, WHITE);
+    for (int i = 0; i < 400; ++i) {
+        img.fill(QRect(rand() % img.width(), rand() % img.height(), 1, 1), BLACK);
+    }
+    for (int i = 0; i < 15; ++i) {
+        img.fill(QRect(rand() % img.width(), rand() % img.height(), 12, 25), BLACK);
+    }
+    Brick const bricks[] = { Brick(QSize(5, 7)), Brick(QSize(3, 40)), Brick(-4, 2, 1, 9) };
+
+    for (Brick const& brick : bricks) {
+        for (BWColor const surroundings : { WHITE, BLACK }) {
+            BOOST_CHECK(
+                dilateBrick(img, brick, surroundings)
+                == bruteForceDilateOrErode(img, brick, surroundings, true)
+            );
+            BOOST_CHECK(
+                erodeBrick(img, brick, surroundings)
+                == bruteForceDilateOrErode(img, brick, surroundings, false)
+            );
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_erode_1x1)
 {
     static int const inp[] = {
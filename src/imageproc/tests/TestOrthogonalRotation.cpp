@@ -21,9 +21,12 @@
 #include "Utils.h"
 #include <QImage>
 #include <QRect>
+#include <QVector>
+#include <QColor>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
+#include <stdlib.h>
 
 namespace imageproc
 {
@@ -177,6 +180,86 @@ BOOST_AUTO_TEST_CASE(test_sub_image)
     BOOST_REQUIRE(orthogonalRotation(img, rect, -90) == out4_img);
 }
 
+static QImage randomImage(int const width, int const height, QImage::Format const format)
+{
+    QImage img(width, height, format);
+    if (format == QImage::Format_Indexed8) {
+        QVector<QRgb> palette(256);
+        for (int i = 0; i < 256; ++i) {
+            palette[i] = qRgb(i, 255 - i, i / 2);
+        }
+        img.setColorTable(palette);
+    }
+    for (int y = 0; y < height; ++y) {
+        uchar* const line = img.scanLine(y);
+        for (int i = 0; i < img.bytesPerLine(); ++i) {
+            line[i] = rand() % 256;
+        }
+    }
+    return img;
+}
+
+/**
+ * Checks that \p rotated is \p rect of \p img rotated by \p degrees,
+ * which is one of 0, 90, 180 or 270, pixel by pixel.
+ */
+static bool checkRotation(
+    QImage const& img, QRect const& rect, int const degrees, QImage const& rotated)
+{
+    bool const swap_dims = degrees == 90 || degrees == 270;
+    if (rotated.width() != (swap_dims ? rect.height() : rect.width())
+            || rotated.height() != (swap_dims ? rect.width() : rect.height())) {
+        return false;
+    }
+
+    for (int y = 0; y < rotated.height(); ++y) {
+        for (int x = 0; x < rotated.width(); ++x) {
+            int sx = x;
+            int sy = y;
+            if (degrees == 90) {
+                sx = y;
+                sy = rect.height() - 1 - x;
+            } else if (degrees == 180) {
+                sx = rect.width() - 1 - x;
+                sy = rect.height() - 1 - y;
+            } else if (degrees == 270) {
+                sx = rect.width() - 1 - y;
+                sy = x;
+            }
+            if (rotated.pixel(x, y) != img.pixel(rect.left() + sx, rect.top() + sy)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(test_qimage_formats)
+{
+    QImage::Format const formats[] = {
+        QImage::Format_Indexed8, QImage::Format_RGB888,
+        QImage::Format_RGB32, QImage::Format_ARGB32
+    };
+
+    for (QImage::Format const format : formats) {
+        // Sizes that aren't multiples of SIMD blocks or tiles.
+        QImage const img(randomImage(101, 67, format));
+        QRect const rect(3, 5, 90, 61);
+        for (int degrees = -270; degrees <= 360; degrees += 90) {
+            int const angle = (degrees + 360) % 360;
+
+            QImage const full(orthogonalRotation(img, degrees));
+            BOOST_REQUIRE_EQUAL(full.format(), format);
+            BOOST_REQUIRE(full.colorTable() == img.colorTable());
+            BOOST_REQUIRE(checkRotation(img, img.rect(), angle, full));
+
+            QImage const part(orthogonalRotation(img, rect, degrees));
+            BOOST_REQUIRE(checkRotation(img, rect, angle, part));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
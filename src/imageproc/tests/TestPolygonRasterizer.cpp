@@ -33,6 +33,7 @@
 #include <QColor>
 #include <Qt>
 #include <memory>
+#include <vector>
 #include <math.h>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
@@ -193,6 +194,54 @@ BOOST_AUTO_TEST_CASE(regression_test_1)
     BOOST_CHECK(testFillExceptShape(QSize(938, 1299), shape, Qt::WindingFill));
 }
 
+BOOST_AUTO_TEST_CASE(test_batch_fill)
+{
+    QSize const image_size(500, 500);
+    QPolygonF const star(createShape(image_size, 230));
+    QPolygonF const rect(QRectF(QPointF(100, 150), QSize(250, 200)));
+    QPolygonF const offscreen(QRectF(QPointF(400, 400), QSize(300, 300)));
+
+    std::vector<PolygonRasterizer::BinaryFillOp> ops;
+    ops.push_back(PolygonRasterizer::BinaryFillOp(star, BLACK, Qt::OddEvenFill));
+    ops.push_back(PolygonRasterizer::BinaryFillOp(rect, WHITE, Qt::WindingFill));
+    ops.push_back(PolygonRasterizer::BinaryFillOp(offscreen, BLACK, Qt::WindingFill));
+
+    BinaryImage batch_image(image_size, WHITE);
+    PolygonRasterizer::fill(batch_image, ops);
+
+    BinaryImage control_image(image_size, WHITE);
+    for (PolygonRasterizer::BinaryFillOp const& op : ops) {
+        PolygonRasterizer::fill(control_image, op.color, op.poly, op.fillRule);
+    }
+
+    BOOST_CHECK(batch_image == control_image);
+}
+
+BOOST_AUTO_TEST_CASE(test_spans_fill)
+{
+    QSize const image_size(500, 500);
+    QPolygonF const star(createShape(image_size, 300));
+    QPolygonF const rect(QRectF(QPointF(100, 150), QSize(250, 200)));
+
+    std::vector<PolygonRasterizer::BinaryFillOp> ops;
+    ops.push_back(PolygonRasterizer::BinaryFillOp(star, BLACK, Qt::WindingFill));
+    ops.push_back(PolygonRasterizer::BinaryFillOp(rect, WHITE, Qt::OddEvenFill));
+
+    PolygonRasterizer::Spans const spans(PolygonRasterizer::rasterize(image_size, ops));
+    BOOST_CHECK(spans.size() == image_size);
+
+    // Starting from a non-uniform image shows that pixels outside
+    // of the spans are left alone.
+    BinaryImage spans_image(image_size, WHITE);
+    spans_image.fill(QRect(0, 0, 250, 500), BLACK);
+    BinaryImage control_image(spans_image);
+
+    PolygonRasterizer::fill(spans_image, spans);
+    PolygonRasterizer::fill(control_image, ops);
+
+    BOOST_CHECK(spans_image == control_image);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
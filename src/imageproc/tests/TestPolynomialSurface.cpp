@@ -0,0 +1,116 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "PolynomialSurface.h"
+#include "GrayImage.h"
+#include "BinaryImage.h"
+#include "BWColor.h"
+#include <QSize>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+namespace
+{
+
+/**
+ * A smooth surface, exactly representable with degrees of 2 and 1.
+ */
+GrayImage makeSurface(int const width, int const height)
+{
+    GrayImage image(QSize(width, height));
+    uint8_t* line = image.data();
+    for (int y = 0; y < height; ++y, line += image.stride()) {
+        double const fy = double(y) / (height - 1);
+        for (int x = 0; x < width; ++x) {
+            double const fx = double(x) / (width - 1);
+            double const val = 0.2 + 0.5 * fx - 0.3 * fx * fx + 0.2 * fx * fy + 0.1 * fy;
+            line[x] = static_cast<uint8_t>(val * 255.0 + 0.5);
+        }
+    }
+    return image;
+}
+
+int maxDifference(GrayImage const& img1, GrayImage const& img2)
+{
+    int max_diff = 0;
+    for (int y = 0; y < img1.height(); ++y) {
+        uint8_t const* line1 = img1.data() + y * img1.stride();
+        uint8_t const* line2 = img2.data() + y * img2.stride();
+        for (int x = 0; x < img1.width(); ++x) {
+            max_diff = std::max(max_diff, abs(int(line1[x]) - int(line2[x])));
+        }
+    }
+    return max_diff;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(PolynomialSurfaceTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_reproduces_polynomial)
+{
+    GrayImage const surface(makeSurface(173, 91));
+    GrayImage const rendered(PolynomialSurface(3, 3, surface).render(surface.size()));
+    BOOST_CHECK_LE(maxDifference(surface, rendered), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_masked_fit)
+{
+    GrayImage surface(makeSurface(120, 200));
+
+    // Spoil some pixels and mask them out.  Some lines get fully masked out.
+    BinaryImage mask(surface.size(), BLACK);
+    for (int y = 0; y < surface.height(); ++y) {
+        for (int x = 0; x < surface.width(); ++x) {
+            if ((y > 50 && y < 60) || (x * 7 + y * 3) % 11 == 0) {
+                surface.data()[y * surface.stride() + x] = 0;
+                mask.setPixel(x, y, WHITE);
+            }
+        }
+    }
+
+    GrayImage const rendered(PolynomialSurface(3, 3, surface, mask).render(surface.size()));
+    BOOST_CHECK_LE(maxDifference(makeSurface(120, 200), rendered), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_full_mask_matches_unmasked)
+{
+    GrayImage const surface(makeSurface(64, 300));
+    BinaryImage const mask(surface.size(), BLACK);
+
+    GrayImage const unmasked(PolynomialSurface(4, 2, surface).render(QSize(100, 100)));
+    GrayImage const masked(PolynomialSurface(4, 2, surface, mask).render(QSize(100, 100)));
+    BOOST_CHECK(unmasked == masked);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
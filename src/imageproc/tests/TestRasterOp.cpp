@@ -221,6 +221,33 @@ BOOST_AUTO_TEST_CASE(test_move_blocks)
     BOOST_REQUIRE(tester.testBlockMove(QRect(51, 35, 199, 200), 1, 1));
 }
 
+BOOST_AUTO_TEST_CASE(test_three_images)
+{
+    BinaryImage const a(randomBinaryImage(101, 37));
+    BinaryImage const b(randomBinaryImage(101, 37));
+    BinaryImage const c(randomBinaryImage(101, 37));
+
+    // dst = (a & ~b) | c, in two steps.
+    BinaryImage expected(a);
+    rasterOp<RopSubtract<RopDst, RopSrc> >(expected, b);
+    rasterOp<RopOr<RopSrc, RopDst> >(expected, c);
+
+    // The same in one step.
+    BinaryImage dst(c);
+    rasterOp<RopOr<RopSubtract<RopSrc, RopSrc2>, RopDst> >(dst, a, b);
+    BOOST_CHECK(dst == expected);
+
+    // With the destination being one of the sources.
+    dst = a;
+    rasterOp<RopOr<RopSubtract<RopDst, RopSrc>, RopSrc2> >(dst, b, c);
+    BOOST_CHECK(dst == expected);
+
+    // An uninitialized destination, fully overwritten.
+    BinaryImage fresh(a.size());
+    rasterOp<RopOr<RopSrc, RopNot<RopSrc2> > >(fresh, c, c);
+    BOOST_CHECK(fresh == BinaryImage(a.size(), BLACK));
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
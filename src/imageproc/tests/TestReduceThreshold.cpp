@@ -20,6 +20,7 @@
 #include "BinaryImage.h"
 #include "Utils.h"
 #include <QImage>
+#include <vector>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -120,6 +121,30 @@ BOOST_AUTO_TEST_CASE(test_lines)
     BOOST_CHECK(makeBinaryImage(out4, 1, 4) == ReduceThreshold(img)(4));
 }
 
+BOOST_AUTO_TEST_CASE(test_cascade_matches_chained_reductions)
+{
+    int const sizes[][2] = {
+        { 1, 1 }, { 1, 37 }, { 37, 1 }, { 2, 2 }, { 5, 9 },
+        { 33, 17 }, { 64, 64 }, { 100, 3 }, { 199, 131 }
+    };
+    std::vector<int> const thresholds { 1, 2, 3, 4, 2 };
+
+    for (auto const& size : sizes) {
+        BinaryImage const img(randomBinaryImage(size[0], size[1]));
+
+        std::vector<BinaryImage> levels;
+        BinaryImage const cascaded(ReduceThreshold(img).reduceCascade(thresholds, &levels));
+        BOOST_REQUIRE(levels.size() == thresholds.size());
+
+        ReduceThreshold chained(img);
+        for (size_t i = 0; i < thresholds.size(); ++i) {
+            chained.reduce(thresholds[i]);
+            BOOST_CHECK(levels[i] == chained.image());
+        }
+        BOOST_CHECK(cascaded == chained.image());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
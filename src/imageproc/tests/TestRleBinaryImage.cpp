@@ -0,0 +1,157 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RleBinaryImage.h"
+#include "BinaryImage.h"
+#include "PolygonRasterizer.h"
+#include "RasterOp.h"
+#include "BWColor.h"
+#include "Utils.h"
+#include <QPolygonF>
+#include <QPointF>
+#include <QRect>
+#include <Qt>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+using namespace utils;
+
+BOOST_AUTO_TEST_SUITE(RleBinaryImageTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_null_image)
+{
+    BOOST_CHECK(RleBinaryImage().isNull());
+    BOOST_CHECK(RleBinaryImage(BinaryImage()).isNull());
+    BOOST_CHECK(RleBinaryImage().toBinaryImage().isNull());
+}
+
+BOOST_AUTO_TEST_CASE(test_round_trip)
+{
+    int const widths[] = { 1, 31, 32, 33, 64, 100 };
+    for (int const w : widths) {
+        BinaryImage const img(randomBinaryImage(w, 20));
+        RleBinaryImage const rle(img);
+        BOOST_CHECK(rle.toBinaryImage() == img);
+        BOOST_CHECK(RleBinaryImage(rle.toBinaryImage()) == rle);
+    }
+
+    BinaryImage sparse(100, 50, WHITE);
+    sparse.fill(QRect(10, 5, 60, 3), BLACK);
+    sparse.fill(QRect(95, 40, 5, 10), BLACK);
+    RleBinaryImage const rle(sparse);
+    BOOST_CHECK(rle.numRuns() == 13);
+    BOOST_CHECK(rle.toBinaryImage() == sparse);
+}
+
+BOOST_AUTO_TEST_CASE(test_count_and_bounding_box)
+{
+    BinaryImage img(100, 50, WHITE);
+    RleBinaryImage rle(img);
+    BOOST_CHECK(rle.countBlackPixels() == 0);
+    BOOST_CHECK(rle.contentBoundingBox(BLACK).isNull());
+    BOOST_CHECK(rle.contentBoundingBox(WHITE) == img.contentBoundingBox(WHITE));
+
+    img.fill(QRect(0, 3, 100, 40), BLACK);
+    img.fill(QRect(20, 10, 7, 5), WHITE);
+    rle = RleBinaryImage(img);
+    BOOST_CHECK(rle.countBlackPixels() == img.countBlackPixels());
+    BOOST_CHECK(rle.countWhitePixels() == img.countWhitePixels());
+    BOOST_CHECK(rle.contentBoundingBox(BLACK) == img.contentBoundingBox(BLACK));
+    BOOST_CHECK(rle.contentBoundingBox(WHITE) == img.contentBoundingBox(WHITE));
+
+    img = randomBinaryImage(77, 33);
+    rle = RleBinaryImage(img);
+    BOOST_CHECK(rle.countBlackPixels() == img.countBlackPixels());
+    BOOST_CHECK(rle.contentBoundingBox(BLACK) == img.contentBoundingBox(BLACK));
+    BOOST_CHECK(rle.contentBoundingBox(WHITE) == img.contentBoundingBox(WHITE));
+}
+
+BOOST_AUTO_TEST_CASE(test_fill_and_invert)
+{
+    BinaryImage img(randomBinaryImage(70, 30));
+    RleBinaryImage rle(img);
+
+    img.fill(QRect(5, 5, 40, 10), BLACK);
+    rle.fill(QRect(5, 5, 40, 10), BLACK);
+    BOOST_CHECK(rle.toBinaryImage() == img);
+
+    img.fill(QRect(30, 0, 100, 20), WHITE);
+    rle.fill(QRect(30, 0, 100, 20), WHITE);
+    BOOST_CHECK(rle.toBinaryImage() == img);
+
+    img.invert();
+    rle.invert();
+    BOOST_CHECK(rle.toBinaryImage() == img);
+}
+
+BOOST_AUTO_TEST_CASE(test_raster_op)
+{
+    BinaryImage const src(randomBinaryImage(90, 25));
+    BinaryImage const dst(randomBinaryImage(90, 25));
+    RleBinaryImage const rle_src(src);
+
+    BinaryImage and_img(dst);
+    RleBinaryImage rle_and(dst);
+    rasterOp<RopAnd<RopSrc, RopDst> >(and_img, src);
+    rasterOp<RopAnd<RopSrc, RopDst> >(rle_and, rle_src);
+    BOOST_CHECK(rle_and.toBinaryImage() == and_img);
+
+    BinaryImage or_img(dst);
+    RleBinaryImage rle_or(dst);
+    rasterOp<RopOr<RopSrc, RopDst> >(or_img, src);
+    rasterOp<RopOr<RopSrc, RopDst> >(rle_or, rle_src);
+    BOOST_CHECK(rle_or.toBinaryImage() == or_img);
+
+    BinaryImage subtract_img(dst);
+    RleBinaryImage rle_subtract(dst);
+    rasterOp<RopSubtract<RopDst, RopSrc> >(subtract_img, src);
+    rasterOp<RopSubtract<RopDst, RopSrc> >(rle_subtract, rle_src);
+    BOOST_CHECK(rle_subtract.toBinaryImage() == subtract_img);
+}
+
+BOOST_AUTO_TEST_CASE(test_polygon_fill)
+{
+    QPolygonF triangle;
+    triangle << QPointF(10, 5) << QPointF(180, 40) << QPointF(60, 95);
+    QPolygonF quad;
+    quad << QPointF(-20, 50) << QPointF(120, 30) << QPointF(150, 130) << QPointF(40, 80);
+
+    BinaryImage img(randomBinaryImage(170, 100));
+    RleBinaryImage rle(img);
+
+    PolygonRasterizer::fill(img, BLACK, triangle, Qt::WindingFill);
+    rle.fill(triangle, BLACK, Qt::WindingFill);
+    BOOST_CHECK(rle.toBinaryImage() == img);
+
+    PolygonRasterizer::fill(img, WHITE, quad, Qt::OddEvenFill);
+    rle.fill(quad, WHITE, Qt::OddEvenFill);
+    BOOST_CHECK(rle.toBinaryImage() == img);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
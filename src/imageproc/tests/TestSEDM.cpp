@@ -18,15 +18,18 @@
 
 #include "SEDM.h"
 #include "BinaryImage.h"
+#include "ConnectivityMap.h"
 #include "BWColor.h"
 #include "Utils.h"
 #include <iostream>
 #include <QImage>
+#include <QRect>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
 
 #include <math.h>
+#include <stdlib.h>
 
 namespace imageproc
 {
@@ -96,6 +99,79 @@ BOOST_AUTO_TEST_CASE(test1)
     BOOST_CHECK(verifySEDM(sedm, out));
 }
 
+bool sameDistances(SEDM const& sedm1, SEDM const& sedm2)
+{
+    if (sedm1.size() != sedm2.size()) {
+        return false;
+    }
+
+    // Padding included.
+    int const num_lines = sedm1.size().height() + 2;
+    uint32_t const* line1 = sedm1.data() - sedm1.stride() - 1;
+    uint32_t const* line2 = sedm2.data() - sedm2.stride() - 1;
+    for (int y = 0; y < num_lines; ++y) {
+        for (int x = 0; x < sedm1.stride(); ++x) {
+            if (line1[x] != line2[x]) {
+                return false;
+            }
+        }
+        line1 += sedm1.stride();
+        line2 += sedm2.stride();
+    }
+    return true;
+}
+
+BinaryImage sparseBinaryImage(int const width, int const height)
+{
+    BinaryImage img(width, height, WHITE);
+    for (int i = rand() % 6; i > 0; --i) {
+        int const x = rand() % width;
+        int const y = rand() % height;
+        img.fill(QRect(x, y, 1 + rand() % 5, 1 + rand() % 5).intersected(img.rect()), BLACK);
+    }
+    return img;
+}
+
+BOOST_AUTO_TEST_CASE(test_engines_match)
+{
+    for (int i = 0; i < 40; ++i) {
+        int const width = 1 + rand() % 200;
+        int const height = 1 + rand() % 200;
+        BinaryImage const img(
+            i & 1 ? randomBinaryImage(width, height) : sparseBinaryImage(width, height)
+        );
+
+        for (int borders = 0; borders <= SEDM::DIST_TO_ALL_BORDERS; ++borders) {
+            for (int dt = 0; dt < 2; ++dt) {
+                SEDM::DistType const dist_type = dt ? SEDM::DIST_TO_BLACK : SEDM::DIST_TO_WHITE;
+                SEDM const meijster(
+                    img, dist_type, SEDM::Borders(borders), SEDM::ENGINE_MEIJSTER
+                );
+                SEDM const fh(
+                    img, dist_type, SEDM::Borders(borders), SEDM::ENGINE_FELZENSZWALB
+                );
+                BOOST_REQUIRE(sameDistances(meijster, fh));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_engines_match_on_connectivity_map)
+{
+    for (int i = 0; i < 20; ++i) {
+        int const width = 1 + rand() % 200;
+        int const height = 1 + rand() % 200;
+        BinaryImage const img(sparseBinaryImage(width, height));
+
+        // Labels may legitimately differ where two objects are equally close.
+        ConnectivityMap cmap1(img, CONN8);
+        ConnectivityMap cmap2(cmap1);
+        SEDM const meijster(cmap1, SEDM::ENGINE_MEIJSTER);
+        SEDM const fh(cmap2, SEDM::ENGINE_FELZENSZWALB);
+        BOOST_REQUIRE(sameDistances(meijster, fh));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
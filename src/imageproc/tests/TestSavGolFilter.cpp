@@ -0,0 +1,68 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2009  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SavGolFilter.h"
+#include "Utils.h"
+#include <QImage>
+#include <QSize>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+using namespace utils;
+
+BOOST_AUTO_TEST_SUITE(SavGolFilterTestSuite);
+
+static bool checkInPlace(int const width, int const height, QSize const& window, int const degree)
+{
+    QImage const src(randomGrayImage(width, height));
+    QImage const expected(savGolFilter(src, window, degree, degree));
+
+    QImage actual(src);
+    savGolFilterInPlace(actual, window, degree, degree);
+
+    return actual == expected;
+}
+
+BOOST_AUTO_TEST_CASE(test_in_place_matches_copying)
+{
+    // Heights around and well beyond the height of a band.
+    BOOST_CHECK(checkInPlace(37, 1300, QSize(7, 7), 4));
+    BOOST_CHECK(checkInPlace(40, 1030, QSize(11, 11), 2));
+    BOOST_CHECK(checkInPlace(23, 520, QSize(11, 11), 4));
+    BOOST_CHECK(checkInPlace(19, 512, QSize(5, 5), 3));
+}
+
+BOOST_AUTO_TEST_CASE(test_in_place_small_images)
+{
+    BOOST_CHECK(checkInPlace(20, 11, QSize(11, 11), 2));
+    BOOST_CHECK(checkInPlace(20, 10, QSize(11, 11), 2));
+    BOOST_CHECK(checkInPlace(6, 30, QSize(7, 7), 4));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
@@ -18,6 +18,7 @@
 
 #include "Scale.h"
 #include "GrayImage.h"
+#include "GrayImageView.h"
 #include "Utils.h"
 #include <QImage>
 #include <QSize>
@@ -100,6 +101,105 @@ BOOST_AUTO_TEST_CASE(test_random_image)
     //BOOST_CHECK(checkScale(img, QSize(145, 55)));
 }
 
+BOOST_AUTO_TEST_CASE(test_sub_view)
+{
+    GrayImage img(QSize(100, 100));
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = rand() % 256;
+        }
+        line += img.stride();
+    }
+
+    QRect const roi(13, 7, 61, 77);
+    GrayImageView const view(img, roi);
+    GrayImage const copy(img.toQImage().copy(roi));
+
+    BOOST_CHECK(view.toGrayImage() == copy);
+    BOOST_CHECK(scaleToGray(view, QSize(61, 77)) == copy);
+    BOOST_CHECK(scaleToGray(view, QSize(30, 40)) == scaleToGray(copy, QSize(30, 40)));
+    BOOST_CHECK(scaleToGray(view, QSize(122, 154)) == scaleToGray(copy, QSize(122, 154)));
+    BOOST_CHECK(scaleToGray(view, QSize(100, 90)) == scaleToGray(copy, QSize(100, 90)));
+}
+
+static GrayImage randomImage(QSize const& size)
+{
+    GrayImage img(size);
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = rand() % 256;
+        }
+        line += img.stride();
+    }
+    return img;
+}
+
+static GrayImage naiveScaleDown(GrayImage const& src, int xscale, int yscale)
+{
+    GrayImage dst(QSize(src.width() / xscale, src.height() / yscale));
+    int const area = xscale * yscale;
+    for (int dy = 0; dy < dst.height(); ++dy) {
+        for (int dx = 0; dx < dst.width(); ++dx) {
+            unsigned sum = 0;
+            for (int sy = dy * yscale; sy < (dy + 1) * yscale; ++sy) {
+                for (int sx = dx * xscale; sx < (dx + 1) * xscale; ++sx) {
+                    sum += src.data()[sy * src.stride() + sx];
+                }
+            }
+            dst.data()[dy * dst.stride() + dx] = uint8_t((sum + area / 2) / area);
+        }
+    }
+    return dst;
+}
+
+BOOST_AUTO_TEST_CASE(test_integer_downscale)
+{
+    GrayImage const img(randomImage(QSize(103, 61)));
+
+    BOOST_CHECK(scaleDownIntegerTimes(img, 2, 2) == naiveScaleDown(img, 2, 2));
+    BOOST_CHECK(scaleDownIntegerTimes(img, 3, 3) == naiveScaleDown(img, 3, 3));
+    BOOST_CHECK(scaleDownIntegerTimes(img, 4, 2) == naiveScaleDown(img, 4, 2));
+    BOOST_CHECK(scaleDownIntegerTimes(img, 1, 5) == naiveScaleDown(img, 1, 5));
+    BOOST_CHECK(scaleDownIntegerTimes(img, 200, 1).isNull());
+
+    GrayImageView const view(img, QRect(1, 1, 100, 60));
+    BOOST_CHECK(scaleToGray(view, QSize(50, 30)) == scaleDownIntegerTimes(view, 2, 2));
+    BOOST_CHECK(scaleToGray(view, QSize(25, 20)) == scaleDownIntegerTimes(view, 4, 3));
+}
+
+BOOST_AUTO_TEST_CASE(test_integer_upscale)
+{
+    GrayImage const img(randomImage(QSize(17, 11)));
+
+    GrayImage const upscaled(scaleUpIntegerTimes(img, 3, 2));
+    BOOST_REQUIRE(upscaled.size() == QSize(51, 22));
+    BOOST_CHECK(scaleToGray(img, QSize(51, 22)) == upscaled);
+
+    bool ok = true;
+    for (int y = 0; y < upscaled.height(); ++y) {
+        for (int x = 0; x < upscaled.width(); ++x) {
+            ok &= upscaled.data()[y * upscaled.stride() + x]
+                  == img.data()[(y / 2) * img.stride() + x / 3];
+        }
+    }
+    BOOST_CHECK(ok);
+}
+
+BOOST_AUTO_TEST_CASE(test_pyramid)
+{
+    GrayImage const img(randomImage(QSize(40, 13)));
+
+    std::vector<GrayImage> const levels(buildGrayPyramid(img, 5));
+    BOOST_REQUIRE(levels.size() == 4);
+    BOOST_CHECK(levels[0] == img);
+    BOOST_CHECK(levels[1] == naiveScaleDown(img, 2, 2));
+    BOOST_CHECK(levels[2] == naiveScaleDown(levels[1], 2, 2));
+    BOOST_CHECK(levels[3] == naiveScaleDown(levels[2], 2, 2));
+    BOOST_CHECK(levels[3].size() == QSize(5, 1));
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
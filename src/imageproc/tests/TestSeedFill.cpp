@@ -25,6 +25,7 @@
 #include <QImage>
 #include <QSize>
 #include <QPoint>
+#include <stdlib.h>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -176,6 +177,39 @@ BOOST_AUTO_TEST_CASE(test_gray8_random)
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_gray_tall_random)
+{
+    // Tall enough to be split into several strips that are filled in parallel.
+    for (int i = 0; i < 4; ++i) {
+        GrayImage const seed(randomGrayImage(37, 600));
+        GrayImage const mask(randomGrayImage(37, 600));
+        Connectivity const conn = i & 1 ? CONN8 : CONN4;
+        BOOST_REQUIRE(seedFillGray(seed, mask, conn) == seedFillGraySlow(seed, mask, conn));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_gray_across_strips)
+{
+    // A single dark seed pixel at the bottom has to spread through
+    // a dark mask all the way up, crossing every strip seam.
+    int const width = 23;
+    int const height = 700;
+    GrayImage seed(QSize(width, height));
+    seed.fill(0xff);
+    seed.data()[(height - 1) * seed.stride()] = 0;
+
+    GrayImage mask(QSize(width, height));
+    uint8_t* mask_line = mask.data();
+    for (int y = 0; y < height; ++y, mask_line += mask.stride()) {
+        for (int x = 0; x < width; ++x) {
+            mask_line[x] = rand() % 10 == 0 ? 200 + rand() % 50 : rand() % 60;
+        }
+    }
+
+    BOOST_CHECK(seedFillGray(seed, mask, CONN4) == seedFillGraySlow(seed, mask, CONN4));
+    BOOST_CHECK(seedFillGray(seed, mask, CONN8) == seedFillGraySlow(seed, mask, CONN8));
+}
+
 BOOST_AUTO_TEST_CASE(test_gray_vs_binary)
 {
     for (int i = 0; i < 200; ++i) {
@@ -21,6 +21,8 @@
 #include "BWColor.h"
 #include "Utils.h"
 #include <QImage>
+#include <math.h>
+#include <stdint.h>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -35,6 +37,66 @@ using namespace utils;
 
 BOOST_AUTO_TEST_SUITE(ShearTestSuite);
 
+namespace
+{
+
+int getPixel(BinaryImage const& img, int const x, int const y)
+{
+    uint32_t const word = img.data()[y * img.wordsPerLine() + (x >> 5)];
+    return (word >> (31 - (x & 31))) & 1;
+}
+
+void setPixel(BinaryImage& img, int const x, int const y, int const black)
+{
+    uint32_t& word = img.data()[y * img.wordsPerLine() + (x >> 5)];
+    uint32_t const bit = uint32_t(1) << (31 - (x & 31));
+    word = black ? (word | bit) : (word & ~bit);
+}
+
+/**
+ * A pixel by pixel horizontal shear.  Shears used with this are
+ * exact binary fractions, so it doesn't matter whether shifts are
+ * computed directly or accumulated.
+ */
+BinaryImage slowHShear(
+    BinaryImage const& src, double const shear,
+    double const y_origin, BWColor const background_color)
+{
+    BinaryImage dst(src.size(), background_color);
+    for (int y = 0; y < src.height(); ++y) {
+        int const shift = (int)floor(0.5 + shear * (y + 0.5 - y_origin));
+        for (int x = 0; x < src.width(); ++x) {
+            int const src_x = x - shift;
+            if (src_x >= 0 && src_x < src.width()) {
+                setPixel(dst, x, y, getPixel(src, src_x, y));
+            }
+        }
+    }
+    return dst;
+}
+
+/**
+ * \see slowHShear()
+ */
+BinaryImage slowVShear(
+    BinaryImage const& src, double const shear,
+    double const x_origin, BWColor const background_color)
+{
+    BinaryImage dst(src.size(), background_color);
+    for (int x = 0; x < src.width(); ++x) {
+        int const shift = (int)floor(0.5 + shear * (x + 0.5 - x_origin));
+        for (int y = 0; y < src.height(); ++y) {
+            int const src_y = y - shift;
+            if (src_y >= 0 && src_y < src.height()) {
+                setPixel(dst, x, y, getPixel(src, x, src_y));
+            }
+        }
+    }
+    return dst;
+}
+
+} // anonymous namespace
+
 BOOST_AUTO_TEST_CASE(test_small_image)
 {
     static int const inp[] = {
@@ -92,6 +154,36 @@ BOOST_AUTO_TEST_CASE(test_small_image)
     BOOST_REQUIRE(v_shear_inplace == v_out_img);
 }
 
+BOOST_AUTO_TEST_CASE(test_random_images)
+{
+    // Widths that are and aren't multiples of 32, and shears large
+    // enough for some lines to be shifted completely off the image.
+    static int const widths[] = { 1, 31, 64, 97, 300 };
+    static double const shears[] = { 0.125, -0.0625, 0.75, -3.0 };
+
+    for (int const width : widths) {
+        BinaryImage const img(randomBinaryImage(width, 75));
+        for (double const shear : shears) {
+            for (BWColor const bg : { WHITE, BLACK }) {
+                double const y_origin = 0.25 * img.height();
+                double const x_origin = 0.5 * img.width();
+
+                BinaryImage const h_expected(slowHShear(img, shear, y_origin, bg));
+                BOOST_CHECK(hShear(img, shear, y_origin, bg) == h_expected);
+                BinaryImage h_inplace(img);
+                hShearInPlace(h_inplace, shear, y_origin, bg);
+                BOOST_CHECK(h_inplace == h_expected);
+
+                BinaryImage const v_expected(slowVShear(img, shear, x_origin, bg));
+                BOOST_CHECK(vShear(img, shear, x_origin, bg) == v_expected);
+                BinaryImage v_inplace(img);
+                vShearInPlace(v_inplace, shear, x_origin, bg);
+                BOOST_CHECK(v_inplace == v_expected);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
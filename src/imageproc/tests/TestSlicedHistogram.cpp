@@ -18,8 +18,10 @@
 
 #include "SlicedHistogram.h"
 #include "BinaryImage.h"
+#include "BWColor.h"
 #include "Utils.h"
 #include <QImage>
+#include <QRect>
 #include <stdexcept>
 #include <stddef.h>
 #ifndef Q_MOC_RUN
@@ -114,6 +116,51 @@ BOOST_AUTO_TEST_CASE(test_small_image)
     BOOST_CHECK(checkHistogram(ver_hist, ver_counts + 1, ver_counts + 9));
 }
 
+BOOST_AUTO_TEST_CASE(test_rows_and_cols)
+{
+    // Tall enough to overflow the per-byte column counters.
+    BinaryImage img(randomBinaryImage(100, 600));
+    QRect const areas[] = {
+        img.rect(), QRect(3, 7, 90, 550), QRect(33, 0, 31, 600), QRect(40, 10, 5, 1)
+    };
+
+    for (QRect const& area : areas) {
+        SlicedHistogram rows;
+        SlicedHistogram cols;
+        SlicedHistogram::calcRowsAndCols(img, area, rows, cols);
+
+        BOOST_REQUIRE(rows.size() == size_t(area.height()));
+        BOOST_REQUIRE(cols.size() == size_t(area.width()));
+
+        SlicedHistogram const ver_hist(img, area, SlicedHistogram::COLS);
+        BOOST_REQUIRE(ver_hist.size() == cols.size());
+
+        for (int y = 0; y < area.height(); ++y) {
+            int count = 0;
+            for (int x = 0; x < area.width(); ++x) {
+                count += img.getPixel(area.left() + x, area.top() + y) == BLACK ? 1 : 0;
+            }
+            BOOST_CHECK(rows[y] == count);
+        }
+        for (int x = 0; x < area.width(); ++x) {
+            int count = 0;
+            for (int y = 0; y < area.height(); ++y) {
+                count += img.getPixel(area.left() + x, area.top() + y) == BLACK ? 1 : 0;
+            }
+            BOOST_CHECK(cols[x] == count);
+            BOOST_CHECK(ver_hist[x] == count);
+        }
+    }
+
+    BinaryImage const small(1, 1);
+    SlicedHistogram rows;
+    SlicedHistogram cols;
+    BOOST_CHECK_THROW(
+        SlicedHistogram::calcRowsAndCols(small, QRect(0, 0, 1, 2), rows, cols),
+        std::invalid_argument
+    );
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
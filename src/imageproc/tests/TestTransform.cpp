@@ -21,6 +21,9 @@
 #include "Utils.h"
 #include <QImage>
 #include <QSize>
+#include <QSizeF>
+#include <QRect>
+#include <QTransform>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
@@ -66,6 +69,101 @@ BOOST_AUTO_TEST_CASE(test_random_image)
     BOOST_CHECK(transformToGray(img, null_xform, img.rect(), outside_pixels) == img);
 }
 
+BOOST_AUTO_TEST_CASE(test_downscale_averages_blocks)
+{
+    GrayImage img(QSize(64, 48));
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = rand() % 256;
+        }
+        line += img.stride();
+    }
+
+    QColor const bgcolor(0xff, 0xff, 0xff);
+    OutsidePixels const outside_pixels(OutsidePixels::assumeColor(bgcolor));
+
+    QTransform xform;
+    xform.scale(0.5, 0.5);
+    GrayImage const dst(
+        transformToGray(img, xform, QRect(0, 0, 32, 24), outside_pixels)
+    );
+
+    for (int y = 0; y < dst.height(); ++y) {
+        uint8_t const* top = img.data() + y * 2 * img.stride();
+        uint8_t const* bottom = top + img.stride();
+        for (int x = 0; x < dst.width(); ++x) {
+            int const sum = top[x * 2] + top[x * 2 + 1] + bottom[x * 2] + bottom[x * 2 + 1];
+            BOOST_REQUIRE_EQUAL(int(dst.data()[y * dst.stride() + x]), (sum + 2) / 4);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_upscale_replicates_pixels)
+{
+    GrayImage img(QSize(30, 20));
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = rand() % 256;
+        }
+        line += img.stride();
+    }
+
+    QColor const bgcolor(0xff, 0xff, 0xff);
+    OutsidePixels const outside_pixels(OutsidePixels::assumeColor(bgcolor));
+
+    // With no smoothing, each destination pixel falls within a single source pixel.
+    QTransform xform;
+    xform.scale(4.0, 4.0);
+    GrayImage const dst(
+        transformToGray(img, xform, QRect(0, 0, 120, 80), outside_pixels, QSizeF(0.0, 0.0))
+    );
+
+    for (int y = 0; y < dst.height(); ++y) {
+        for (int x = 0; x < dst.width(); ++x) {
+            BOOST_REQUIRE_EQUAL(
+                int(dst.data()[y * dst.stride() + x]),
+                int(img.data()[(y / 4) * img.stride() + x / 4])
+            );
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_orthogonal_rotation_copies_pixels)
+{
+    GrayImage img(QSize(30, 20));
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = rand() % 256;
+        }
+        line += img.stride();
+    }
+
+    QColor const bgcolor(0xff, 0xff, 0xff);
+    OutsidePixels const outside_pixels(OutsidePixels::assumeColor(bgcolor));
+
+    // Rotate by 90 degrees clockwise, keeping a 2 pixel background margin.
+    QTransform xform;
+    xform.rotate(90);
+    xform *= QTransform().translate(img.height(), 0);
+    QRect const dst_rect(-2, -2, img.height() + 4, img.width() + 4);
+    GrayImage const dst(transformToGray(img, xform, dst_rect, outside_pixels));
+
+    for (int y = 0; y < dst.height(); ++y) {
+        for (int x = 0; x < dst.width(); ++x) {
+            int const sx = y - 2;
+            int const sy = img.height() - 1 - (x - 2);
+            int expected = 0xff;
+            if (img.rect().contains(sx, sy)) {
+                expected = img.data()[sy * img.stride() + sx];
+            }
+            BOOST_REQUIRE_EQUAL(int(dst.data()[y * dst.stride() + x]), expected);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
@@ -17,6 +17,7 @@
 */
 
 #include "ArcLengthMapper.h"
+#include <algorithm>
 #include <math.h>
 #include <assert.h>
 
@@ -52,6 +53,9 @@ ArcLengthMapper::addSample(double x, double fx)
 
     m_samples.push_back(Sample(x, arc_len));
     m_prevFX = fx;
+
+    m_xTable.clear();
+    m_arcLenTable.clear();
 }
 
 double
@@ -74,6 +78,21 @@ ArcLengthMapper::normalizeRange(double total_arc_len)
     for (Sample& sample : m_samples) {
         sample.arcLen *= scale;
     }
+
+    buildLookupTables();
+}
+
+void
+ArcLengthMapper::buildLookupTables()
+{
+    if (m_samples.size() < 2) {
+        m_xTable.clear();
+        m_arcLenTable.clear();
+        return;
+    }
+
+    m_xTable.build(m_samples, &Sample::x);
+    m_arcLenTable.build(m_samples, &Sample::arcLen);
 }
 
 double
@@ -108,6 +127,11 @@ ArcLengthMapper::arcLenToX(double arc_len, Hint& hint) const
         return interpolateArcLenInSegment(arc_len, hint.m_lastSegment);
     }
 
+    if (!m_arcLenTable.isEmpty()) {
+        hint.update(m_arcLenTable.find(m_samples, &Sample::arcLen, arc_len));
+        return interpolateArcLenInSegment(arc_len, hint.m_lastSegment);
+    }
+
     // Do a binary search.
     int left_idx = 0;
     int right_idx = m_samples.size() - 1;
@@ -161,6 +185,11 @@ ArcLengthMapper::xToArcLen(double x, Hint& hint) const
         return interpolateXInSegment(x, hint.m_lastSegment);
     }
 
+    if (!m_xTable.isEmpty()) {
+        hint.update(m_xTable.find(m_samples, &Sample::x, x));
+        return interpolateXInSegment(x, hint.m_lastSegment);
+    }
+
     // Do a binary search.
     int left_idx = 0;
     int right_idx = m_samples.size() - 1;
@@ -243,3 +272,42 @@ ArcLengthMapper::interpolateXInSegment(double x, int segment) const
     double const a = a0 + (a1 - a0) * (x - x0) / (x1 - x0);
     return a;
 }
+
+/*======================= ArcLengthMapper::LookupTable ======================*/
+
+void
+ArcLengthMapper::LookupTable::build(
+    std::vector<Sample> const& samples, double Sample::* key)
+{
+    assert(samples.size() > 1); // Enforced by the caller.
+
+    int const num_segments = samples.size() - 1;
+    double const range = samples.back().*key - samples.front().*key;
+    m_origin = samples.front().*key;
+    m_scale = range > 0 ? num_segments / range : 0;
+
+    m_segments.resize(num_segments);
+    int segment = 0;
+    for (int i = 0; i < num_segments; ++i) {
+        double const bucket_start = m_origin + i * (range / num_segments);
+        while (segment + 1 < num_segments && samples[segment + 1].*key <= bucket_start) {
+            ++segment;
+        }
+        m_segments[i] = segment;
+    }
+}
+
+int
+ArcLengthMapper::LookupTable::find(
+    std::vector<Sample> const& samples, double Sample::* key, double value) const
+{
+    int const num_segments = m_segments.size();
+    int const bucket = std::min(
+        std::max(0, int((value - m_origin) * m_scale)), num_segments - 1
+    );
+    int segment = m_segments[bucket];
+    while (segment + 1 < num_segments && samples[segment + 1].*key < value) {
+        ++segment;
+    }
+    return segment;
+}
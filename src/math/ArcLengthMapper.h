@@ -31,6 +31,10 @@
  * We consider the arc length between two adjacent samples
  * to be monotonously increasing, that is we consider adjacent samples
  * to be connected by straight lines.
+ *
+ * Once normalizeRange() or buildLookupTables() has been called, lookups
+ * take constant time even when the hint is of no help, as is the case
+ * with a fresh hint for every lookup.
  */
 class ArcLengthMapper
 {
@@ -73,6 +77,14 @@ public:
      */
     void normalizeRange(double total_arc_len);
 
+    /**
+     * \brief Tabulates the samples for constant time lookups.
+     *
+     * normalizeRange() does that as well.  Adding a sample drops the tables,
+     * and lookups fall back to a binary search until they are rebuilt.
+     */
+    void buildLookupTables();
+
     /**
      * \brief Maps from arc length to the corresponding function argument.
      *
@@ -92,6 +104,40 @@ private:
         Sample(double x, double arc_len) : x(x), arcLen(arc_len) {}
     };
 
+    /**
+     * Splits the range of x or arc length into as many equal buckets
+     * as there are segments, and stores the first segment overlapping
+     * each bucket.  Locating a segment then takes a bucket lookup followed
+     * by a short linear scan.
+     */
+    class LookupTable
+    {
+    public:
+        LookupTable() : m_origin(0), m_scale(0) {}
+
+        void build(std::vector<Sample> const& samples, double Sample::* key);
+
+        void clear()
+        {
+            m_segments.clear();
+        }
+
+        bool isEmpty() const
+        {
+            return m_segments.empty();
+        }
+
+        /**
+         * Returns the segment containing \p value, which must lie
+         * between the keys of the first and the last samples.
+         */
+        int find(std::vector<Sample> const& samples, double Sample::* key, double value) const;
+    private:
+        double m_origin;
+        double m_scale;
+        std::vector<int> m_segments;
+    };
+
     bool checkSegmentForArcLen(double arc_len, int segment) const;
 
     bool checkSegmentForX(double x, int segment) const;
@@ -101,6 +147,8 @@ private:
     double interpolateXInSegment(double x, int segment) const;
 
     std::vector<Sample> m_samples;
+    LookupTable m_xTable;
+    LookupTable m_arcLenTable;
     double m_prevFX;
 };
 
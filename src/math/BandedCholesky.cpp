@@ -0,0 +1,116 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BandedCholesky.h"
+#include <algorithm>
+#include <math.h>
+#include <assert.h>
+
+BandedCholesky::BandedCholesky()
+    : m_size(0)
+    , m_bandwidth(0)
+{
+}
+
+size_t
+BandedCholesky::bandwidth(double const* A, size_t n)
+{
+    size_t bandwidth = 0;
+    for (size_t col = 0; col < n; ++col) {
+        double const* column = A + col * n;
+        // The first non-zero element below the diagonal, from the bottom.
+        for (size_t row = n - 1; row > col + bandwidth; --row) {
+            if (column[row] != 0.0) {
+                bandwidth = row - col;
+                break;
+            }
+        }
+        // The first non-zero element above the diagonal, from the top.
+        for (size_t row = 0; row + bandwidth < col; ++row) {
+            if (column[row] != 0.0) {
+                bandwidth = col - row;
+                break;
+            }
+        }
+    }
+    return bandwidth;
+}
+
+bool
+BandedCholesky::factorize(double const* A, size_t const n, size_t const bandwidth)
+{
+    m_size = n;
+    m_bandwidth = bandwidth;
+    m_band.assign(n * (bandwidth + 1), 0.0);
+
+    double max_diag = 0;
+    for (size_t i = 0; i < n; ++i) {
+        max_diag = std::max(max_diag, fabs(A[i * n + i]));
+    }
+    // Pivots below this relative to the largest diagonal element are
+    // treated as zeros, to avoid producing garbage for singular matrices.
+    double const min_pivot = max_diag * 1e-12;
+
+    for (size_t i = 0; i < n; ++i) {
+        size_t const first = i > bandwidth ? i - bandwidth : 0;
+        for (size_t j = first; j <= i; ++j) {
+            double sum = A[j * n + i];
+            // Row j starts no later than row i does, so L(j, k) is in the band.
+            for (size_t k = first; k < j; ++k) {
+                sum -= L(i, k) * L(j, k);
+            }
+
+            if (j < i) {
+                L(i, j) = sum / L(j, j);
+            } else if (sum > min_pivot) {
+                L(i, i) = sqrt(sum);
+            } else {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void
+BandedCholesky::solve(double* xb) const
+{
+    size_t const n = m_size;
+    size_t const bandwidth = m_bandwidth;
+
+    // L * y = b
+    for (size_t i = 0; i < n; ++i) {
+        size_t const first = i > bandwidth ? i - bandwidth : 0;
+        double sum = xb[i];
+        for (size_t k = first; k < i; ++k) {
+            sum -= L(i, k) * xb[k];
+        }
+        xb[i] = sum / L(i, i);
+    }
+
+    // L^T * x = y
+    for (size_t i = n; i-- > 0;) {
+        size_t const last = std::min(n - 1, i + bandwidth);
+        double sum = xb[i];
+        for (size_t k = i + 1; k <= last; ++k) {
+            sum -= L(k, i) * xb[k];
+        }
+        xb[i] = sum / L(i, i);
+    }
+}
@@ -0,0 +1,90 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BANDED_CHOLESKY_H_
+#define BANDED_CHOLESKY_H_
+
+#include <vector>
+#include <stddef.h>
+
+/**
+ * \brief Solves Ax = b for a symmetric positive definite band matrix A,
+ *        using Cholesky decomposition.
+ *
+ * With n being the size of A and w its bandwidth, factorization
+ * takes O(n * w^2) time and O(n * w) memory, compared to O(n^3)
+ * time and O(n^2) memory of LinearSolver.
+ *
+ * An instance may be reused for factorizing different matrices.
+ * Its storage is only reallocated when it has to grow.
+ *
+ * \note All matrices are assumed to be in column-major order.
+ */
+class BandedCholesky
+{
+    // Member-wise copying is OK.
+public:
+    BandedCholesky();
+
+    /**
+     * \brief Returns the smallest w such that A(i, j) == 0 for all |i - j| > w.
+     *
+     * \param A A square matrix of size \p n.
+     * \param n The number of rows and columns in \p A.
+     */
+    static size_t bandwidth(double const* A, size_t n);
+
+    /**
+     * \brief Computes the lower triangular L such that A = L * L^T.
+     *
+     * \param A A symmetric matrix of size \p n.  Only the lower part
+     *        of the band gets read.
+     * \param n The number of rows and columns in \p A.
+     * \param bandwidth See bandwidth().
+     * \return false if \p A is not positive definite or is too close
+     *         to being singular.  Calling solve() is not allowed then.
+     */
+    bool factorize(double const* A, size_t n, size_t bandwidth);
+
+    /**
+     * \brief Solves Ax = b, where A is the last matrix passed to factorize().
+     *
+     * \param xb Vector b on input, vector x on output.
+     */
+    void solve(double* xb) const;
+private:
+    double& L(size_t row, size_t col)
+    {
+        return m_band[row * (m_bandwidth + 1) + m_bandwidth + col - row];
+    }
+
+    double L(size_t row, size_t col) const
+    {
+        return m_band[row * (m_bandwidth + 1) + m_bandwidth + col - row];
+    }
+
+    /**
+     * Row i of L, elements from i - m_bandwidth to i.
+     * Elements falling before the matrix are zeros.
+     */
+    std::vector<double> m_band;
+    size_t m_size;
+    size_t m_bandwidth;
+};
+
+#endif
@@ -25,6 +25,7 @@
 #include <limits>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <boost/scoped_array.hpp>
 #include <stddef.h>
 #include <assert.h>
@@ -35,6 +36,11 @@
  * Overdetermined systems are supported.  Solving them will succeed
  * provided the system is consistent.
  *
+ * Square systems of up to 4 unknowns, which is what most callers solve,
+ * go through a copy of the code with the dimensions known at compile time,
+ * letting the compiler unroll the loops and keep the matrix in registers.
+ * The arithmetic is the same, and so are the results.
+ *
  * \note All matrices are assumed to be in column-major order.
  *
  * \see MatrixCalc
@@ -66,26 +72,42 @@ public:
      * \brief A simplified version of the one above.
      *
      * In this version, buffers are allocated internally.
+     * Small ones are allocated on the stack.
      */
     template<typename T>
     void solve(T const* A, T* X, T const* B) const;
 private:
+    enum { MAX_STACK_TBUFFER = 64, MAX_STACK_PBUFFER = 16 };
+
+    /**
+     * A dimension known at compile time.  Converts to size_t
+     * wherever a dimension known at run time would be used.
+     */
+    template<size_t N>
+    struct Dim : public std::integral_constant<size_t, N> {};
+
+    template<typename T, typename RowsAB, typename ColsArowsX>
+    void solveImpl(RowsAB rows_AB, ColsArowsX cols_A_rows_X,
+                   T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) const;
+
     size_t m_rowsAB;
     size_t m_colsArowsX;
     size_t m_colsBX;
 };
 
-template<typename T>
+template<typename T, typename RowsAB, typename ColsArowsX>
 void
-LinearSolver::solve(T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) const
+LinearSolver::solveImpl(
+    RowsAB const rows_AB, ColsArowsX const cols_A_rows_X,
+    T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) const
 {
     using namespace std; // To catch different overloads of abs()
 
     T const epsilon(sqrt(numeric_limits<T>::epsilon()));
 
-    size_t const num_elements_A = m_rowsAB * m_colsArowsX;
+    size_t const num_elements_A = size_t(rows_AB) * cols_A_rows_X;
 
-    T* const lu_data = tbuffer; // Dimensions: m_rowsAB, m_colsArowsX
+    T* const lu_data = tbuffer; // Dimensions: rows_AB, cols_A_rows_X
     tbuffer += num_elements_A;
 
     // Copy this matrix to lu.
@@ -95,16 +117,16 @@ LinearSolver::solve(T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) c
 
     // Maps virtual row numbers to physical ones.
     size_t* const perm = pbuffer;
-    for (size_t i = 0; i < m_rowsAB; ++i) {
+    for (size_t i = 0; i < rows_AB; ++i) {
         perm[i] = i;
     }
 
     T* p_col = lu_data;
-    for (size_t i = 0; i < m_colsArowsX; ++i, p_col += m_rowsAB) {
+    for (size_t i = 0; i < cols_A_rows_X; ++i, p_col += rows_AB) {
         // Find the largest pivot.
         size_t virt_pivot_row = i;
         T largest_abs_pivot(abs(p_col[perm[i]]));
-        for (size_t j = i + 1; j < m_rowsAB; ++j) {
+        for (size_t j = i + 1; j < rows_AB; ++j) {
             T const abs_pivot(abs(p_col[perm[j]]));
             if (abs_pivot > largest_abs_pivot) {
                 largest_abs_pivot = abs_pivot;
@@ -124,7 +146,7 @@ LinearSolver::solve(T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) c
         T const r_pivot(T(1) / *p_pivot);
 
         // Eliminate entries below the pivot.
-        for (size_t j = i + 1; j < m_rowsAB; ++j) {
+        for (size_t j = i + 1; j < rows_AB; ++j) {
             T const* p1 = p_pivot;
             T* p2 = p_col + perm[j];
             if (abs(*p2) <= epsilon) {
@@ -137,22 +159,22 @@ LinearSolver::solve(T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) c
             *p2 = factor; // Factor goes into L, zero goes into U.
 
             // Transform the rest of the row.
-            for (size_t col = i + 1; col < m_colsArowsX; ++col) {
-                p1 += m_rowsAB;
-                p2 += m_rowsAB;
+            for (size_t col = i + 1; col < cols_A_rows_X; ++col) {
+                p1 += rows_AB;
+                p2 += rows_AB;
                 *p2 -= *p1 * factor;
             }
         }
     }
 
     // First solve Ly = b
-    T* const y_data = tbuffer; // Dimensions: m_colsArowsX, m_colsBX
-    //tbuffer += m_colsArowsX * m_colsBX;
+    T* const y_data = tbuffer; // Dimensions: cols_A_rows_X, m_colsBX
+    //tbuffer += cols_A_rows_X * m_colsBX;
     T* p_y_col = y_data;
     T const* p_b_col = B;
     for (size_t y_col = 0; y_col < m_colsBX; ++y_col) {
         size_t virt_row = 0;
-        for (; virt_row < m_colsArowsX; ++virt_row) {
+        for (; virt_row < cols_A_rows_X; ++virt_row) {
             int const phys_row = perm[virt_row];
             T right(p_b_col[phys_row]);
 
@@ -161,7 +183,7 @@ LinearSolver::solve(T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) c
             // Go left to right, stop at diagonal.
             for (size_t lu_col = 0; lu_col < virt_row; ++lu_col) {
                 right -= *p_lu * p_y_col[lu_col];
-                p_lu += m_rowsAB;
+                p_lu += rows_AB;
             }
 
             // We assume L has ones on the diagonal, so no division here.
@@ -169,54 +191,83 @@ LinearSolver::solve(T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) c
         }
 
         // Continue below the square part (if any).
-        for (; virt_row < m_rowsAB; ++virt_row) {
+        for (; virt_row < rows_AB; ++virt_row) {
             int const phys_row = perm[virt_row];
             T right(p_b_col[phys_row]);
 
             // Move everything to the right side, then verify it's zero.
             T const* p_lu = lu_data + phys_row;
             // Go left to right all the way.
-            for (size_t lu_col = 0; lu_col < m_colsArowsX; ++lu_col) {
+            for (size_t lu_col = 0; lu_col < cols_A_rows_X; ++lu_col) {
                 right -= *p_lu * p_y_col[lu_col];
-                p_lu += m_rowsAB;
+                p_lu += rows_AB;
             }
             if (abs(right) > epsilon) {
                 throw std::runtime_error("LinearSolver: inconsistent overdetermined system");
             }
         }
 
-        p_y_col += m_colsArowsX;
-        p_b_col += m_rowsAB;
+        p_y_col += cols_A_rows_X;
+        p_b_col += rows_AB;
     }
 
     // Now solve Ux = y
     T* p_x_col = X;
     p_y_col = y_data;
-    T const* p_lu_last_col = lu_data + (m_colsArowsX - 1) * m_rowsAB;
+    T const* p_lu_last_col = lu_data + (cols_A_rows_X - 1) * rows_AB;
     for (size_t x_col = 0; x_col < m_colsBX; ++x_col) {
-        for (int virt_row = m_colsArowsX - 1; virt_row >= 0; --virt_row) {
+        for (int virt_row = cols_A_rows_X - 1; virt_row >= 0; --virt_row) {
             T right(p_y_col[virt_row]);
 
             // Move already calculated factors to the right side.
             T const* p_lu = p_lu_last_col + perm[virt_row];
             // Go right to left, stop at diagonal.
-            for (int lu_col = m_colsArowsX - 1; lu_col > virt_row; --lu_col) {
+            for (int lu_col = cols_A_rows_X - 1; lu_col > virt_row; --lu_col) {
                 right -= *p_lu * p_x_col[lu_col];
-                p_lu -= m_rowsAB;
+                p_lu -= rows_AB;
             }
             p_x_col[virt_row] = right / *p_lu;
         }
 
-        p_x_col += m_colsArowsX;
-        p_y_col += m_colsArowsX;
+        p_x_col += cols_A_rows_X;
+        p_y_col += cols_A_rows_X;
     }
 }
 
+template<typename T>
+void
+LinearSolver::solve(T const* A, T* X, T const* B, T* tbuffer, size_t* pbuffer) const
+{
+    if (m_rowsAB == m_colsArowsX) {
+        switch (m_rowsAB) {
+            case 2:
+                solveImpl(Dim<2>(), Dim<2>(), A, X, B, tbuffer, pbuffer);
+                return;
+            case 3:
+                solveImpl(Dim<3>(), Dim<3>(), A, X, B, tbuffer, pbuffer);
+                return;
+            case 4:
+                solveImpl(Dim<4>(), Dim<4>(), A, X, B, tbuffer, pbuffer);
+                return;
+        }
+    }
+
+    solveImpl(m_rowsAB, m_colsArowsX, A, X, B, tbuffer, pbuffer);
+}
+
 template<typename T>
 void
 LinearSolver::solve(T const* A, T* X, T const* B) const
 {
-    boost::scoped_array<T> tbuffer(new T[m_colsArowsX * (m_rowsAB + m_colsBX)]);
+    size_t const tbuffer_size = m_colsArowsX * (m_rowsAB + m_colsBX);
+    if (tbuffer_size <= MAX_STACK_TBUFFER && m_rowsAB <= MAX_STACK_PBUFFER) {
+        T tbuffer[MAX_STACK_TBUFFER];
+        size_t pbuffer[MAX_STACK_PBUFFER];
+        solve(A, X, B, tbuffer, pbuffer);
+        return;
+    }
+
+    boost::scoped_array<T> tbuffer(new T[tbuffer_size]);
     boost::scoped_array<size_t> pbuffer(new size_t[m_rowsAB]);
 
     solve(A, X, B, tbuffer.get(), pbuffer.get());
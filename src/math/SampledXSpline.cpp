@@ -0,0 +1,217 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "SampledXSpline.h"
+#include "XSpline.h"
+#include <algorithm>
+#include <math.h>
+#include <assert.h>
+
+SampledXSpline::SampledXSpline()
+    :   m_intervalT(0),
+        m_numIntervals(0)
+{
+}
+
+SampledXSpline::SampledXSpline(XSpline const& spline, int const intervals_per_segment)
+{
+    int const num_segments = spline.numSegments();
+    assert(num_segments > 0);
+    assert(intervals_per_segment > 0);
+
+    m_numIntervals = num_segments * intervals_per_segment;
+    m_intervalT = 1.0 / m_numIntervals;
+    m_slotControlPoints.resize(m_numIntervals * NUM_SLOTS);
+    m_slotWeights.resize(m_numIntervals * NUM_SLOTS);
+
+    int const last_control_point = spline.numControlPoints() - 1;
+    for (int segment = 0; segment < num_segments; ++segment) {
+        int const control_points[NUM_SLOTS] = {
+            std::max(0, segment - 1), segment, segment + 1,
+            std::min(segment + 2, last_control_point)
+        };
+
+        for (int i = 0; i < intervals_per_segment; ++i) {
+            // Point and first derivative weights at both ends of the interval.
+            double p0[NUM_SLOTS] = { 0, 0, 0, 0 };
+            double d0[NUM_SLOTS] = { 0, 0, 0, 0 };
+            double p1[NUM_SLOTS] = { 0, 0, 0, 0 };
+            double d1[NUM_SLOTS] = { 0, 0, 0, 0 };
+
+            // Both ends are evaluated within this segment, so that a sharp
+            // angle at a junction doesn't leak into the adjacent interval.
+            double* const point_weights[2] = { p0, p1 };
+            double* const deriv_weights[2] = { d0, d1 };
+            for (int end = 0; end < 2; ++end) {
+                XSpline::LinearCoefficient point_coeffs[NUM_SLOTS];
+                XSpline::LinearCoefficient deriv_coeffs[NUM_SLOTS];
+                int const num_coeffs = spline.segmentLinearCombination(
+                    segment, double(i + end) / intervals_per_segment, point_coeffs, deriv_coeffs
+                );
+                for (int k = 0; k < num_coeffs; ++k) {
+                    int const slot = std::find(
+                        control_points, control_points + NUM_SLOTS,
+                        point_coeffs[k].controlPointIdx
+                    ) - control_points;
+                    assert(slot < NUM_SLOTS);
+                    point_weights[end][slot] += point_coeffs[k].coeff;
+                    // With respect to the position within the interval rather than t.
+                    deriv_weights[end][slot] += deriv_coeffs[k].coeff * m_intervalT;
+                }
+            }
+
+            // The cubic Hermite polynomial in power form.
+            int const interval = segment * intervals_per_segment + i;
+            for (int slot = 0; slot < NUM_SLOTS; ++slot) {
+                SlotWeights& w = m_slotWeights[interval * NUM_SLOTS + slot];
+                w.a = p0[slot];
+                w.b = d0[slot];
+                w.c = 3.0 * (p1[slot] - p0[slot]) - 2.0 * d0[slot] - d1[slot];
+                w.d = 2.0 * (p0[slot] - p1[slot]) + d0[slot] + d1[slot];
+                m_slotControlPoints[interval * NUM_SLOTS + slot] = control_points[slot];
+            }
+        }
+    }
+
+    updateControlPoints(spline);
+}
+
+void
+SampledXSpline::updateControlPoints(XSpline const& spline)
+{
+    assert(m_numIntervals > 0);
+    assert(m_numIntervals % spline.numSegments() == 0);
+
+    m_cubics.resize(m_numIntervals);
+    m_gridPoints.resize(m_numIntervals + 1);
+    m_arcLens.resize(m_numIntervals + 1);
+
+    int const* control_point = &m_slotControlPoints[0];
+    SlotWeights const* w = &m_slotWeights[0];
+    for (int interval = 0; interval < m_numIntervals; ++interval) {
+        Cubic& cubic = m_cubics[interval];
+        cubic = Cubic();
+        for (int slot = 0; slot < NUM_SLOTS; ++slot, ++control_point, ++w) {
+            QPointF const pt(spline.controlPointPosition(*control_point));
+            cubic.a += pt * w->a;
+            cubic.b += pt * w->b;
+            cubic.c += pt * w->c;
+            cubic.d += pt * w->d;
+        }
+        m_gridPoints[interval] = cubic.a;
+    }
+    Cubic const& last = m_cubics.back();
+    m_gridPoints.back() = last.a + last.b + last.c + last.d;
+
+    m_arcLens[0] = 0;
+    for (int i = 0; i < m_numIntervals; ++i) {
+        QPointF const vec(m_gridPoints[i + 1] - m_gridPoints[i]);
+        m_arcLens[i + 1] = m_arcLens[i] + sqrt(vec.x() * vec.x() + vec.y() * vec.y());
+    }
+
+    double const total_arc_len = m_arcLens.back();
+    m_arcLenBuckets.resize(m_numIntervals);
+    int interval = 0;
+    for (int i = 0; i < m_numIntervals; ++i) {
+        double const bucket_start = i * (total_arc_len / m_numIntervals);
+        while (interval + 1 < m_numIntervals && m_arcLens[interval + 1] <= bucket_start) {
+            ++interval;
+        }
+        m_arcLenBuckets[i] = interval;
+    }
+}
+
+QPointF
+SampledXSpline::pointAt(double const t) const
+{
+    double u;
+    int const interval = intervalAt(t, u);
+    return m_cubics[interval](u);
+}
+
+void
+SampledXSpline::pointsAt(double const* ts, size_t const count, QPointF* points) const
+{
+    assert(!isEmpty());
+
+    double const num_intervals = m_numIntervals;
+    int const last_interval = m_numIntervals - 1;
+    Cubic const* const cubics = &m_cubics[0];
+    for (size_t i = 0; i < count; ++i) {
+        double const pos = ts[i] * num_intervals;
+        int const interval = std::min(std::max(int(pos), 0), last_interval);
+        points[i] = cubics[interval](pos - interval);
+    }
+}
+
+std::vector<QPointF>
+SampledXSpline::pointsAt(std::vector<double> const& ts) const
+{
+    std::vector<QPointF> points(ts.size());
+    if (!ts.empty()) {
+        pointsAt(&ts[0], ts.size(), &points[0]);
+    }
+    return points;
+}
+
+double
+SampledXSpline::tToArcLen(double const t) const
+{
+    double u;
+    int const interval = intervalAt(t, u);
+    return m_arcLens[interval] + u * (m_arcLens[interval + 1] - m_arcLens[interval]);
+}
+
+double
+SampledXSpline::arcLenToT(double arc_len) const
+{
+    assert(!isEmpty());
+
+    double const total_arc_len = m_arcLens.back();
+    if (total_arc_len <= 0) {
+        return 0;
+    }
+    arc_len = std::min(std::max(arc_len, 0.0), total_arc_len);
+
+    int const bucket = std::min(
+        int(arc_len * (m_numIntervals / total_arc_len)), m_numIntervals - 1
+    );
+    int interval = m_arcLenBuckets[bucket];
+    while (interval + 1 < m_numIntervals && m_arcLens[interval + 1] < arc_len) {
+        ++interval;
+    }
+
+    double const interval_arc_len = m_arcLens[interval + 1] - m_arcLens[interval];
+    double u = 0;
+    if (interval_arc_len > 0) {
+        u = (arc_len - m_arcLens[interval]) / interval_arc_len;
+    }
+    return (interval + u) * m_intervalT;
+}
+
+int
+SampledXSpline::intervalAt(double const t, double& u) const
+{
+    assert(!isEmpty());
+
+    double const pos = t * m_numIntervals;
+    int const interval = std::min(std::max(int(pos), 0), m_numIntervals - 1);
+    u = pos - interval;
+    return interval;
+}
@@ -0,0 +1,186 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SAMPLED_XSPLINE_H_
+#define SAMPLED_XSPLINE_H_
+
+#include <QPointF>
+#include <vector>
+#include <stddef.h>
+
+class XSpline;
+
+/**
+ * \brief An XSpline tabulated on a fixed grid of t values, for fast
+ *        evaluation and arc length lookups.
+ *
+ * Every segment of the spline is split into the same number of equal
+ * intervals.  The blending weights of the control points at both ends of
+ * every interval, for the point and for the first derivative, are computed
+ * once, and turned into the weights of a cubic polynomial in the position
+ * within the interval.  Evaluating a point then takes a multiply-add per
+ * control point to build the polynomial, which is done once for the whole
+ * grid, and a cubic evaluation per point.
+ *
+ * Points on the grid are exact.  Between them, the cubic matches the spline
+ * and its first derivative at the ends of the interval.  The error falls
+ * quickly with the interval length: with intervals a few tens of pixels
+ * long, it's a fraction of a pixel.
+ *
+ * The arc length is that of the polyline through the grid points.
+ * Mapping an arc length back to t takes constant time.
+ */
+class SampledXSpline
+{
+    // Member-wise copying is OK.
+public:
+    SampledXSpline();
+
+    /**
+     * \note The spline must have at least 2 control points.
+     */
+    SampledXSpline(XSpline const& spline, int intervals_per_segment);
+
+    /**
+     * \brief Re-evaluates the grid after control points were moved.
+     *
+     * The spline must have the same number of control points with the same
+     * tensions as the one this object was built from.  The blending weights
+     * are reused, so that's cheaper than building a new object.
+     */
+    void updateControlPoints(XSpline const& spline);
+
+    bool isEmpty() const
+    {
+        return m_gridPoints.empty();
+    }
+
+    int numGridPoints() const
+    {
+        return m_gridPoints.size();
+    }
+
+    double gridT(int idx) const
+    {
+        return idx * m_intervalT;
+    }
+
+    /**
+     * \brief Points at gridT(0), gridT(1), ... gridT(numGridPoints() - 1).
+     */
+    std::vector<QPointF> const& gridPoints() const
+    {
+        return m_gridPoints;
+    }
+
+    /**
+     * \param t Position on the spline in the range of [0, 1].
+     */
+    QPointF pointAt(double t) const;
+
+    /**
+     * \brief Evaluates \p count points at once.
+     *
+     * \param ts Positions on the spline in the range of [0, 1].
+     * \param points Receives the points.
+     */
+    void pointsAt(double const* ts, size_t count, QPointF* points) const;
+
+    std::vector<QPointF> pointsAt(std::vector<double> const& ts) const;
+
+    double totalArcLength() const
+    {
+        return m_arcLens.empty() ? 0.0 : m_arcLens.back();
+    }
+
+    /**
+     * \brief Returns the arc length from the start of the spline to t.
+     */
+    double tToArcLen(double t) const;
+
+    /**
+     * \brief Returns t at a given arc length from the start of the spline.
+     *
+     * Arc lengths outside of [0, totalArcLength()] are clamped.
+     */
+    double arcLenToT(double arc_len) const;
+private:
+    enum { NUM_SLOTS = 4 };
+
+    /**
+     * Polynomial weights of a control point within an interval.
+     * The point at position u in [0, 1] within the interval is
+     * sum((a + b * u + c * u^2 + d * u^3) * control_point).
+     */
+    struct SlotWeights
+    {
+        double a;
+        double b;
+        double c;
+        double d;
+    };
+
+    /**
+     * A cubic polynomial in the position within an interval.
+     */
+    struct Cubic
+    {
+        QPointF a;
+        QPointF b;
+        QPointF c;
+        QPointF d;
+
+        QPointF operator()(double u) const
+        {
+            return ((d * u + c) * u + b) * u + a;
+        }
+    };
+
+    int intervalAt(double t, double& u) const;
+
+    /**
+     * The control points of each interval's segment, NUM_SLOTS per interval.
+     * Slots a segment doesn't use have zero weights.
+     */
+    std::vector<int> m_slotControlPoints;
+
+    /**
+     * NUM_SLOTS per interval.
+     */
+    std::vector<SlotWeights> m_slotWeights;
+
+    std::vector<Cubic> m_cubics;
+    std::vector<QPointF> m_gridPoints;
+
+    /**
+     * Arc lengths at grid points.
+     */
+    std::vector<double> m_arcLens;
+
+    /**
+     * Splits the arc length into as many equal buckets as there are
+     * intervals, and stores the first interval overlapping each bucket.
+     */
+    std::vector<int> m_arcLenBuckets;
+
+    double m_intervalT;
+    int m_numIntervals;
+};
+
+#endif
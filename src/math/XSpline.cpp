@@ -374,6 +374,20 @@ XSpline::linearCombinationFor(LinearCoefficient* coeffs, int segment, double t)
     return out_idx;
 }
 
+int
+XSpline::segmentLinearCombination(
+    int const segment, double const t, LinearCoefficient* point_coeffs,
+    LinearCoefficient* deriv_coeffs) const
+{
+    DecomposedDerivs const derivs(decomposedDerivsImpl(segment, t));
+    for (int i = 0; i < derivs.numControlPoints; ++i) {
+        int const idx = derivs.controlPoints[i];
+        point_coeffs[i] = LinearCoefficient(idx, derivs.zeroDerivCoeffs[i]);
+        deriv_coeffs[i] = LinearCoefficient(idx, derivs.firstDerivCoeffs[i]);
+    }
+    return derivs.numControlPoints;
+}
+
 XSpline::PointAndDerivs
 XSpline::pointAndDtsAt(double t) const
 {
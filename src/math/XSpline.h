@@ -112,6 +112,26 @@ public:
     /** \see spfit::FittableSpline::linearCombinationAt() */
     virtual void linearCombinationAt(double t, std::vector<LinearCoefficient>& coeffs) const;
 
+    /**
+     * \brief Expresses a point within a segment and the first derivative
+     *        there as linear combinations of control points.
+     *
+     * Unlike the functions taking a t in [0, 1] across the whole spline,
+     * this one lets the end of a segment be evaluated within that segment
+     * rather than the next one.  That matters at junctions with sharp angles.
+     *
+     * \param segment Segment index in the range of [0, numSegments()).
+     * \param t Position within the segment, in the range of [0, 1].
+     * \param point_coeffs Receives up to 4 coefficients of the point.
+     * \param deriv_coeffs Receives up to 4 coefficients of the first
+     *        derivative with respect to the t of pointAt(), for the same
+     *        control points as \p point_coeffs.
+     * \return The number of coefficients written to each array.
+     */
+    int segmentLinearCombination(
+        int segment, double t, LinearCoefficient* point_coeffs,
+        LinearCoefficient* deriv_coeffs) const;
+
     /**
      * Returns a function equivalent to:
      * \code
@@ -20,6 +20,7 @@
 #include "MatrixCalc.h"
 #include <stdexcept>
 #include <algorithm>
+#include <vector>
 #include <assert.h>
 
 namespace spfit
@@ -124,21 +125,27 @@ Optimizer::optimize(double internal_force_weight)
     QuadraticFunction::Gradient const grad(m_internalForce.gradient());
     for (size_t i = 0; i < m_numVars; ++i) {
         m_b[i] = -grad.b[i];
-        for (size_t j = 0; j < m_numVars; ++j) {
-            m_A(i, j) = grad.A(i, j);
-        }
     }
 
     double const total_force_before = m_internalForce.c;
-    DynamicMatrixCalc<double> mc;
-
-    try {
-        mc(m_A).solve(mc(m_b)).write(m_x.data());
-    } catch (std::runtime_error const&) {
-        m_externalForce.reset();
-        m_internalForce.reset();
-        m_x.fill(0); // To make undoLastStep() work as expected.
-        return OptimizationResult(total_force_before, total_force_before);
+
+    if (!solveBanded(grad.A)) {
+        for (size_t i = 0; i < m_numVars; ++i) {
+            for (size_t j = 0; j < m_numVars; ++j) {
+                m_A(i, j) = grad.A(i, j);
+            }
+        }
+
+        DynamicMatrixCalc<double> mc;
+
+        try {
+            mc(m_A).solve(mc(m_b)).write(m_x.data());
+        } catch (std::runtime_error const&) {
+            m_externalForce.reset();
+            m_internalForce.reset();
+            m_x.fill(0); // To make undoLastStep() work as expected.
+            return OptimizationResult(total_force_before, total_force_before);
+        }
     }
 
     double const total_force_after = m_internalForce.evaluate(m_x.data());
@@ -152,6 +159,91 @@ Optimizer::optimize(double internal_force_weight)
     return OptimizationResult(total_force_before, total_force_after);
 }
 
+/**
+ * Solves the system described in setConstraints() by eliminating
+ * displacements, which takes advantage of the N block being banded
+ * for splines, where each control point only interacts with a few
+ * neighbouring ones.  With n variables, k constraints and bandwidth w,
+ * that's O(n * w^2 + n * w * k + k^3) rather than O((n + k)^3).
+ *
+ * Returns false if N is not banded enough or is not positive definite,
+ * in which case the general solver is to be used.
+ */
+bool
+Optimizer::solveBanded(MatT<double> const& N)
+{
+    size_t const num_vars = m_numVars;
+    size_t const num_constraints = m_b.size() - num_vars;
+
+    size_t const bandwidth = BandedCholesky::bandwidth(N.data(), num_vars);
+    if (num_vars == 0 || bandwidth * 2 >= num_vars) {
+        return false;
+    }
+    if (!m_cholesky.factorize(N.data(), num_vars, bandwidth)) {
+        return false;
+    }
+
+    // With x being displacements and l Lagrange multipliers, we have:
+    // N * x + C^T * l = -D
+    // C * x = -J
+    // Therefore:
+    // x = x0 - Y * l, where x0 = N^-1 * -D and Y = N^-1 * C^T
+    // C * Y * l = C * x0 + J
+    std::vector<double> x0(m_b.data(), m_b.data() + num_vars);
+    m_cholesky.solve(&x0[0]);
+
+    std::vector<double> Y(num_vars * num_constraints);
+    for (size_t c = 0; c < num_constraints; ++c) {
+        double* column = &Y[0] + c * num_vars;
+        for (size_t j = 0; j < num_vars; ++j) {
+            column[j] = m_A(num_vars + c, j);
+        }
+        m_cholesky.solve(column);
+    }
+
+    VecT<double> lambda(num_constraints);
+    if (num_constraints != 0) {
+        MatT<double> CY(num_constraints, num_constraints);
+        VecT<double> rhs(num_constraints);
+        for (size_t r = 0; r < num_constraints; ++r) {
+            double sum = 0;
+            for (size_t j = 0; j < num_vars; ++j) {
+                sum += m_A(num_vars + r, j) * x0[j];
+            }
+            rhs[r] = sum - m_b[num_vars + r];
+
+            for (size_t c = 0; c < num_constraints; ++c) {
+                double const* column = &Y[0] + c * num_vars;
+                double dot = 0;
+                for (size_t j = 0; j < num_vars; ++j) {
+                    dot += m_A(num_vars + r, j) * column[j];
+                }
+                CY(r, c) = dot;
+            }
+        }
+
+        DynamicMatrixCalc<double> mc;
+        try {
+            mc(CY).solve(mc(rhs)).write(lambda.data());
+        } catch (std::runtime_error const&) {
+            return false;
+        }
+    }
+
+    for (size_t j = 0; j < num_vars; ++j) {
+        double x = x0[j];
+        for (size_t c = 0; c < num_constraints; ++c) {
+            x -= Y[c * num_vars + j] * lambda[c];
+        }
+        m_x[j] = x;
+    }
+    for (size_t c = 0; c < num_constraints; ++c) {
+        m_x[num_vars + c] = lambda[c];
+    }
+
+    return true;
+}
+
 void
 Optimizer::undoLastStep()
 {
@@ -186,6 +278,7 @@ Optimizer::swap(Optimizer& other)
     m_x.swap(other.m_x);
     m_externalForce.swap(other.m_externalForce);
     m_internalForce.swap(other.m_internalForce);
+    std::swap(m_cholesky, other.m_cholesky);
     std::swap(m_numVars, other.m_numVars);
 }
 
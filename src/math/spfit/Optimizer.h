@@ -28,6 +28,7 @@
 #include "VecT.h"
 #include "LinearFunction.h"
 #include "QuadraticFunction.h"
+#include "BandedCholesky.h"
 #include <vector>
 #include <list>
 
@@ -98,12 +99,15 @@ public:
 private:
     void adjustConstraints(double direction);
 
+    bool solveBanded(MatT<double> const& N);
+
     size_t m_numVars;
     MatT<double> m_A;
     VecT<double> m_b;
     VecT<double> m_x;
     QuadraticFunction m_externalForce;
     QuadraticFunction m_internalForce;
+    BandedCholesky m_cholesky;
 };
 
 inline void swap(Optimizer& o1, Optimizer& o2)
@@ -18,7 +18,6 @@
 
 #include "SqDistApproximant.h"
 #include "FrenetFrame.h"
-#include "MatrixCalc.h"
 #include <limits>
 #include <assert.h>
 #include <math.h>
@@ -46,9 +45,7 @@ SqDistApproximant::SqDistApproximant(
     R(0, 0) = u[0];  R(0, 1) = u[1];
     R(1, 0) = v[0];  R(1, 1) = v[1];
 
-    StaticMatrixCalc<double, 4> mc;
-    Vec2d t; // Translation component.
-    (-(mc(R) * mc(origin, 2, 1))).write(t);
+    Vec2d const t(-(R * origin)); // Translation component.
 
     A(0, 0) = m * R(0, 0) * R(0, 0) + n * R(1, 0) * R(1, 0);
     A(0, 1) = A(1, 0) = m * R(0, 0) * R(0, 1) + n * R(1, 0) * R(1, 1);
@@ -124,8 +121,7 @@ SqDistApproximant::weightedCurveDistance(
 double
 SqDistApproximant::evaluate(Vec2d const& pt) const
 {
-    StaticMatrixCalc<double, 8, 1> mc;
-    return (mc(pt, 1, 2) * mc(A) * mc(pt, 2, 1) + mc(b, 1, 2) * mc(pt, 2, 1)).rawData()[0] + c;
+    return pt.dot(A * pt) + b.dot(pt) + c;
 }
 
 } // namespace spfit
@@ -0,0 +1,191 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Optimizer.h"
+#include "QuadraticFunction.h"
+#include "LinearFunction.h"
+#include "MatrixCalc.h"
+#include "MatT.h"
+#include "VecT.h"
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#include <boost/test/tools/floating_point_comparison.hpp>
+#endif
+#include <list>
+#include <vector>
+#include <stdlib.h>
+#include <math.h>
+
+namespace spfit
+{
+
+namespace tests
+{
+
+BOOST_AUTO_TEST_SUITE(OptimizerTestSuite);
+
+static double frand(double from, double to)
+{
+    double const rand_0_1 = rand() / double(RAND_MAX);
+    return from + (to - from) * rand_0_1;
+}
+
+/**
+ * (x[i] - x[i + 1] - offset)^2, as a function of 2 variables.
+ */
+static QuadraticFunction differenceForce(double offset)
+{
+    QuadraticFunction f(2);
+    f.A(0, 0) = 1;
+    f.A(0, 1) = -1;
+    f.A(1, 0) = -1;
+    f.A(1, 1) = 1;
+    f.b[0] = -2 * offset;
+    f.b[1] = 2 * offset;
+    f.c = offset * offset;
+    return f;
+}
+
+/**
+ * (x - target)^2, as a function of 1 variable.
+ */
+static QuadraticFunction attractionForce(double target)
+{
+    QuadraticFunction f(1);
+    f.A(0, 0) = 1;
+    f.b[0] = -2 * target;
+    f.c = target * target;
+    return f;
+}
+
+/**
+ * Solves the whole system with the general solver, for reference.
+ */
+static VecT<double> solveDense(
+    QuadraticFunction const& force, std::list<LinearFunction> const& constraints)
+{
+    size_t const num_vars = force.numVars();
+    size_t const num_dimensions = num_vars + constraints.size();
+    QuadraticFunction::Gradient const grad(force.gradient());
+
+    MatT<double> A(num_dimensions, num_dimensions);
+    VecT<double> b(num_dimensions);
+    for (size_t i = 0; i < num_vars; ++i) {
+        b[i] = -grad.b[i];
+        for (size_t j = 0; j < num_vars; ++j) {
+            A(i, j) = grad.A(i, j);
+        }
+    }
+
+    size_t i = num_vars;
+    for (LinearFunction const& ctr : constraints) {
+        b[i] = -ctr.b;
+        for (size_t j = 0; j < num_vars; ++j) {
+            A(i, j) = A(j, i) = ctr.a[j];
+        }
+        ++i;
+    }
+
+    VecT<double> x(num_dimensions);
+    DynamicMatrixCalc<double> mc;
+    mc(A).solve(mc(b)).write(x.data());
+    return x;
+}
+
+/**
+ * \param detach_last If set, no forces are applied to the last variable,
+ *        which makes the banded solver fail.  The last variable is
+ *        constrained instead, to keep the whole system solvable.
+ */
+static void checkAgainstDense(size_t const num_vars, bool const detach_last)
+{
+    std::list<LinearFunction> constraints;
+    for (int i = 0; i < 3; ++i) {
+        LinearFunction ctr(num_vars);
+        ctr.a[rand() % (num_vars - 1)] = 1;
+        ctr.a[rand() % (num_vars - 1)] += frand(0.5, 1.5);
+        ctr.b = frand(-10, 10);
+        constraints.push_back(ctr);
+    }
+    if (detach_last) {
+        LinearFunction ctr(num_vars);
+        ctr.a[num_vars - 1] = 1;
+        ctr.b = frand(-10, 10);
+        constraints.push_back(ctr);
+    }
+
+    size_t const num_attached = detach_last ? num_vars - 1 : num_vars;
+
+    Optimizer optimizer(num_vars);
+    optimizer.setConstraints(constraints);
+
+    double const internal_force_weight = 0.5;
+    QuadraticFunction total_force(num_vars);
+    std::vector<int> sparse_map(2);
+
+    for (size_t i = 0; i + 1 < num_attached; ++i) {
+        QuadraticFunction const f(differenceForce(frand(-1, 1)));
+        sparse_map[0] = int(i);
+        sparse_map[1] = int(i + 1);
+        optimizer.addInternalForce(f, sparse_map);
+        for (int r = 0; r < 2; ++r) {
+            for (int c = 0; c < 2; ++c) {
+                total_force.A(sparse_map[r], sparse_map[c]) += internal_force_weight * f.A(r, c);
+            }
+            total_force.b[sparse_map[r]] += internal_force_weight * f.b[r];
+        }
+        total_force.c += internal_force_weight * f.c;
+    }
+
+    sparse_map.resize(1);
+    for (size_t i = 0; i < num_attached; i += 2) {
+        QuadraticFunction const f(attractionForce(frand(-10, 10)));
+        sparse_map[0] = int(i);
+        optimizer.addExternalForce(f, sparse_map);
+        total_force.A(i, i) += f.A(0, 0);
+        total_force.b[i] += f.b[0];
+        total_force.c += f.c;
+    }
+
+    VecT<double> const expected(solveDense(total_force, constraints));
+    optimizer.optimize(internal_force_weight);
+
+    for (size_t i = 0; i < num_vars; ++i) {
+        BOOST_REQUIRE_SMALL(optimizer.displacementVector()[i] - expected[i], 1e-06);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_banded_matches_dense)
+{
+    for (int i = 0; i < 10; ++i) {
+        checkAgainstDense(60, false);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_fallback_matches_dense)
+{
+    for (int i = 0; i < 10; ++i) {
+        checkAgainstDense(60, true);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace spfit